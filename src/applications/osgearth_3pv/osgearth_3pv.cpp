@@ -246,6 +246,20 @@ main( int argc, char** argv )
 
     MapNode* mapNode = MapNode::get(node.get());
 
+    // Color the spied-on tiles by a performance metric:
+    // --overlay lod|latency|bytes|cost
+    std::string overlay;
+    if (mapNode && arguments.read("--overlay", overlay))
+    {
+        TerrainOptions::DebugOverlay metric =
+            overlay == "lod"     ? TerrainOptions::DEBUG_OVERLAY_LOD :
+            overlay == "latency" ? TerrainOptions::DEBUG_OVERLAY_LATENCY :
+            overlay == "bytes"   ? TerrainOptions::DEBUG_OVERLAY_BYTES :
+            overlay == "cost"    ? TerrainOptions::DEBUG_OVERLAY_COST :
+            TerrainOptions::DEBUG_OVERLAY_NONE;
+        mapNode->getTerrainOptions().setDebugOverlay(metric);
+    }
+
     osg::ref_ptr<osg::Image> icon = osgDB::readRefImageFile("../data/placemark32.png");
     PlaceNode* place = new PlaceNode();
     place->setIconImage(icon.get());
@@ -70,6 +70,8 @@ usage(const char* msg, const char* name =0L)
             << "\n        --out-image <path>              : Output path for the atlas image (defaults to an OSGB file in"
             << "\n                                          the working directory). The paths in the resulting catalog"
             << "\n                                          file will point to this location using a relative path if possible."
+            << "\n        --compress                      : Compress the atlas for the GPU, with mipmaps (needs an"
+            << "\n                                          image processor plugin such as fastdxt)"
             << "\n        --aux <pattern> <r> <g> <b> <a> : Build an auxiliary atlas for files matching the pattern"
             << "\n                                          \"filename_pattern.ext\", e.g., \"texture.jpg\" will match"
             << "\n                                          \"texture_NML.jpg\" for pattern = \"NML\". The RGBA are the"
@@ -129,6 +131,9 @@ build(osg::ArgumentParser& arguments)
     // Whether to build RGB images
     bool rgb = arguments.read("--rgb");
     builder.setRGB( rgb );
+
+    // Whether to compress the images for the GPU
+    builder.setCompress( arguments.read("--compress") );
     
 
     // auxiliary atlas patterns:
@@ -55,6 +55,7 @@ usage( const std::string& msg = "" )
         << "            [--min-level <num>]             : The minimum level to stop backfilling to.  (default=0)\n"
         << "            [--max-level <num>]             : The level to start backfilling from(default=inf)\n"                
         << "            [--db-options]                : db options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
+        << "            [--method <average|min|max>]  : how to combine child pixels (default=average)\n"
         << std::endl
         << "         [--quiet]               : suppress progress output" << std::endl;
 
@@ -97,6 +98,18 @@ main(int argc, char** argv)
     unsigned maxLevel = ~0;
     args.read( "--max-level", maxLevel );  
 
+    TMSBackFiller::Method method = TMSBackFiller::METHOD_AVERAGE;
+    std::string methodName;
+    if (args.read("--method", methodName))
+    {
+        if (methodName == "min")
+            method = TMSBackFiller::METHOD_MIN;
+        else if (methodName == "max")
+            method = TMSBackFiller::METHOD_MAX;
+        else if (methodName != "average")
+            return usage( "Unknown method " + methodName );
+    }
+
     std::string dbOptions;
     args.read("--db-options", dbOptions);
     std::string::size_type n = 0;
@@ -129,5 +142,6 @@ main(int argc, char** argv)
     backfiller.setMinLevel( minLevel );
     backfiller.setMaxLevel( maxLevel );
     backfiller.setBounds( bounds );
+    backfiller.setMethod( method );
     backfiller.process( tmsPath, options.get() );
 }
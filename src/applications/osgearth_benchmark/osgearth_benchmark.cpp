@@ -0,0 +1,363 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Terrain paging benchmark. Flies a recorded camera path over an earth file,
+ * waits for the terrain to settle at each viewpoint, and writes the results
+ * as JSON so runs can be compared from build to build.
+ *
+ * For repeatable numbers, point the earth file at a local cache and run with
+ * --cache-only so that no request ever reaches the network.
+ */
+
+#include <osgViewer/Viewer>
+#include <osg/GLExtensions>
+#include <osgEarth/Notify>
+#include <osgEarth/EarthManipulator>
+#include <osgEarth/ExampleResources>
+#include <osgEarth/MapNode>
+#include <osgEarth/Registry>
+#include <osgEarth/Metrics>
+#include <osgEarth/Memory>
+#include <osgEarth/StringUtils>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#define LC "[benchmark] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#ifndef GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+#define GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX   0x9048
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+
+int
+usage(const char* name)
+{
+    OE_NOTICE
+        << "\nUsage: " << name << " file.earth [options]" << std::endl
+        << "    --path <file>           : camera path, one viewpoint per line:" << std::endl
+        << "                              lon lat alt heading pitch range" << std::endl
+        << "    --out <file>            : write the JSON report here (default = stdout)" << std::endl
+        << "    --settle-timeout <sec>  : give up on a viewpoint after this long (default = 60)" << std::endl
+        << "    --settle-frames <n>     : quiet frames that count as settled (default = 10)" << std::endl
+        << "    --size <w> <h>          : render target size (default = 1920 1080)" << std::endl
+        << "    --onscreen              : render to a window instead of a pbuffer" << std::endl
+        << "    --cache-only            : read all data from the cache" << std::endl
+        << MapNodeHelper().usage() << std::endl;
+
+    return 0;
+}
+
+namespace
+{
+    // Tracks the GPU memory in use, on drivers that support GL_NVX_gpu_memory_info.
+    struct GPUMemoryCallback : public osg::Camera::DrawCallback
+    {
+        mutable bool _checked, _supported;
+        mutable int _total, _minAvailable;
+
+        GPUMemoryCallback() : _checked(false), _supported(false), _total(0), _minAvailable(0) { }
+
+        virtual void operator()(osg::RenderInfo& ri) const
+        {
+            if (!_checked)
+            {
+                _checked = true;
+                _supported = osg::isGLExtensionSupported(ri.getContextID(), "GL_NVX_gpu_memory_info");
+                if (_supported)
+                {
+                    glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &_total);
+                    _minAvailable = _total;
+                }
+            }
+
+            if (_supported)
+            {
+                GLint available = 0;
+                glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+                _minAvailable = std::min(_minAvailable, (int)available);
+            }
+        }
+
+        //! Peak GPU memory in use during the run, in KB, or -1 if unknown
+        int peakUsedKB() const { return _supported ? _total - _minAvailable : -1; }
+    };
+
+    struct Result
+    {
+        std::string name;
+        double settleSeconds;
+        unsigned frames;
+        bool timedOut;
+    };
+
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        unsigned i = (unsigned)(p * (double)(sorted.size() - 1) + 0.5);
+        return sorted[std::min(i, (unsigned)sorted.size() - 1)];
+    }
+
+    bool readPath(const std::string& filename, std::vector<Viewpoint>& output)
+    {
+        std::ifstream in(filename.c_str());
+        if (!in.is_open())
+            return false;
+
+        std::string line;
+        while (std::getline(in, line))
+        {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream buf(line);
+            double lon, lat, alt, heading, pitch, range;
+            if (buf >> lon >> lat >> alt >> heading >> pitch >> range)
+            {
+                std::string name = Stringify() << "vp" << output.size();
+                output.push_back(Viewpoint(name.c_str(), lon, lat, alt, heading, pitch, range));
+            }
+            else
+            {
+                OE_WARN << LC << "Skipping malformed path line: " << line << std::endl;
+            }
+        }
+        return true;
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc,argv);
+
+    if ( arguments.read("--help") )
+        return usage(argv[0]);
+
+    std::string pathFile, outFile;
+    arguments.read("--path", pathFile);
+    arguments.read("--out", outFile);
+
+    double settleTimeout = 60.0;
+    arguments.read("--settle-timeout", settleTimeout);
+
+    unsigned settleFrames = 10u;
+    arguments.read("--settle-frames", settleFrames);
+
+    int width = 1920, height = 1080;
+    arguments.read("--size", width, height);
+
+    bool onscreen = arguments.read("--onscreen");
+
+    if (arguments.read("--cache-only"))
+        Registry::instance()->setOverrideCachePolicy(CachePolicy::CACHE_ONLY);
+
+    osgViewer::Viewer viewer(arguments);
+
+    // One thread keeps the frame loop deterministic; the pager threads
+    // still do the loading.
+    viewer.setThreadingModel(osgViewer::Viewer::SingleThreaded);
+
+    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits();
+    traits->x = 0;
+    traits->y = 0;
+    traits->width = width;
+    traits->height = height;
+    traits->doubleBuffer = onscreen;
+    traits->pbuffer = !onscreen;
+    traits->windowDecoration = false;
+    traits->vsync = false;
+    traits->sharedContext = 0L;
+
+    osg::ref_ptr<osg::GraphicsContext> gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    if (!gc.valid())
+    {
+        OE_WARN << LC << "Failed to create a graphics context" << std::endl;
+        return -1;
+    }
+
+    osg::Camera* camera = viewer.getCamera();
+    camera->setGraphicsContext(gc.get());
+    camera->setViewport(new osg::Viewport(0, 0, width, height));
+    camera->setProjectionMatrixAsPerspective(30.0, (double)width/(double)height, 1.0, 1000.0);
+    camera->setDrawBuffer(onscreen ? GL_BACK : GL_FRONT);
+    camera->setReadBuffer(onscreen ? GL_BACK : GL_FRONT);
+    camera->setSmallFeatureCullingPixelSize(-1.0f);
+    camera->setNearFarRatio(0.0001);
+
+    osg::ref_ptr<GPUMemoryCallback> gpuMemory = new GPUMemoryCallback();
+    camera->setFinalDrawCallback(gpuMemory.get());
+
+    viewer.getDatabasePager()->setUnrefImageDataAfterApplyPolicy( true, false );
+    osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper("osg::Image");
+
+    EarthManipulator* manip = new EarthManipulator(arguments);
+    viewer.setCameraManipulator( manip );
+
+    osg::Node* node = MapNodeHelper().load(arguments, &viewer);
+    if ( !node )
+        return usage(argv[0]);
+
+    viewer.setSceneData( node );
+
+    std::vector<Viewpoint> path;
+    if (!pathFile.empty() && !readPath(pathFile, path))
+    {
+        OE_WARN << LC << "Cannot read camera path \"" << pathFile << "\"" << std::endl;
+        return -1;
+    }
+
+    viewer.realize();
+
+    // with no path, benchmark the home viewpoint only
+    if (path.empty())
+        path.push_back(manip->getViewpoint());
+
+    Metrics::Counter* tilesLoaded = Metrics::counter("rex.tiles.loaded");
+    Metrics::Counter* tilesMerged = Metrics::counter("rex.tiles.merged");
+    Metrics::Gauge*   requests    = Metrics::gauge("rex.loader.requests");
+    Metrics::Gauge*   merges      = Metrics::gauge("rex.loader.merges_pending");
+
+    std::vector<Result> results;
+    std::vector<double> frameTimesMS;
+
+    long long loadedAtStart = tilesLoaded->get();
+    osg::Timer_t runStart = osg::Timer::instance()->tick();
+
+    for (unsigned i = 0; i < path.size() && !viewer.done(); ++i)
+    {
+        manip->setViewpoint(path[i], 0.0);
+
+        Result result;
+        result.name = path[i].name().isSet() ? path[i].name().get() : std::string(Stringify() << "vp" << i);
+        result.frames = 0u;
+        result.timedOut = false;
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        long long lastMerged = tilesMerged->get();
+        unsigned quietFrames = 0u;
+
+        // Settled means nothing queued, nothing waiting to merge, and no
+        // merges for settleFrames frames in a row.
+        while (!viewer.done())
+        {
+            osg::Timer_t frameStart = osg::Timer::instance()->tick();
+            viewer.frame();
+            frameTimesMS.push_back(osg::Timer::instance()->delta_m(frameStart, osg::Timer::instance()->tick()));
+            ++result.frames;
+
+            long long merged = tilesMerged->get();
+            if (requests->get() == 0 && merges->get() == 0 && merged == lastMerged)
+                ++quietFrames;
+            else
+                quietFrames = 0u;
+            lastMerged = merged;
+
+            double elapsed = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            if (quietFrames >= settleFrames)
+            {
+                result.settleSeconds = elapsed;
+                break;
+            }
+
+            if (elapsed >= settleTimeout)
+            {
+                result.settleSeconds = elapsed;
+                result.timedOut = true;
+                OE_WARN << LC << "Viewpoint " << result.name << " did not settle in " << settleTimeout << "s" << std::endl;
+                break;
+            }
+        }
+
+        OE_INFO << LC << result.name << ": " << result.settleSeconds << "s, " << result.frames << " frames" << std::endl;
+        results.push_back(result);
+    }
+
+    double runSeconds = osg::Timer::instance()->delta_s(runStart, osg::Timer::instance()->tick());
+    long long loaded = tilesLoaded->get() - loadedAtStart;
+
+    std::vector<double> sorted(frameTimesMS);
+    std::sort(sorted.begin(), sorted.end());
+
+    std::ostringstream buf;
+    buf << "{\n"
+        << "  \"run_seconds\": " << runSeconds << ",\n"
+        << "  \"tiles_loaded\": " << loaded << ",\n"
+        << "  \"tiles_loaded_per_second\": " << (runSeconds > 0.0 ? (double)loaded / runSeconds : 0.0) << ",\n"
+        << "  \"frames\": " << sorted.size() << ",\n"
+        << "  \"frame_ms\": { "
+        << "\"p50\": " << percentile(sorted, 0.50) << ", "
+        << "\"p95\": " << percentile(sorted, 0.95) << ", "
+        << "\"p99\": " << percentile(sorted, 0.99) << ", "
+        << "\"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << " },\n"
+        << "  \"peak_memory_mb\": " << (double)Memory::getProcessPeakPrivateUsage() / 1048576.0 << ",\n"
+        << "  \"peak_gpu_memory_mb\": ";
+
+    if (gpuMemory->peakUsedKB() >= 0)
+        buf << (double)gpuMemory->peakUsedKB() / 1024.0;
+    else
+        buf << "null";
+
+    buf << ",\n  \"viewpoints\": [\n";
+    for (unsigned i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        buf << "    { \"name\": \"" << r.name << "\", "
+            << "\"settle_seconds\": " << r.settleSeconds << ", "
+            << "\"frames\": " << r.frames << ", "
+            << "\"timed_out\": " << (r.timedOut ? "true" : "false") << " }"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    buf << "  ],\n  \"metrics\": ";
+    Metrics::write(buf, Metrics::FORMAT_JSON);
+    buf << "\n}\n";
+
+    if (outFile.empty())
+    {
+        std::cout << buf.str();
+    }
+    else
+    {
+        std::ofstream out(outFile.c_str());
+        if (!out.is_open())
+        {
+            OE_WARN << LC << "Cannot write \"" << outFile << "\"" << std::endl;
+            return -1;
+        }
+        out << buf.str();
+    }
+
+    // non-zero exit if any viewpoint failed to settle, for use in scripts
+    for (unsigned i = 0; i < results.size(); ++i)
+        if (results[i].timedOut)
+            return 1;
+
+    return 0;
+}
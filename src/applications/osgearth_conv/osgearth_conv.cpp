@@ -30,6 +30,7 @@
 #include <osgEarth/ElevationLayer>
 #include <osg/ArgumentParser>
 #include <osg/Timer>
+#include <OpenThreads/Thread>
 #include <iomanip>
 #include <algorithm>
 #include <iterator>
@@ -50,16 +51,49 @@ int usage(char** argv)
         << "\n    --osg-options [OSG options string]  : options to pass to OSG readers/writers"
         << "\n    --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy"
         << "\n    --no-overwrite                      : skip tiles that already exist in the destination"
+        << "\n    --threads [int]                     : number of copy threads (default = number of processors)"
         << std::endl;
 
     return 0;
 }
 
 
+// Tile count and total busy time of one stage of the copy
+struct StageStats
+{
+    StageStats() : _count(0u), _seconds(0.0) { }
+
+    void add(osg::Timer_t start)
+    {
+        double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        Threading::ScopedMutexLock lock(_mutex);
+        ++_count;
+        _seconds += seconds;
+    }
+
+    void get(unsigned& count, double& seconds)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        count = _count;
+        seconds = _seconds;
+    }
+
+    unsigned _count;
+    double _seconds;
+    Threading::Mutex _mutex;
+};
+
+// Per-stage statistics of the copy: existence checks, reads and writes
+struct CopyStats : public osg::Referenced
+{
+    StageStats _check, _read, _write;
+};
+
+
 struct ImageLayerTileCopy : public TileHandler
 {
-    ImageLayerTileCopy(ImageLayer* source, ImageLayer* dest, bool overwrite)
-        : _source(source), _dest(dest), _overwrite(overwrite)
+    ImageLayerTileCopy(ImageLayer* source, ImageLayer* dest, bool overwrite, CopyStats* stats)
+        : _source(source), _dest(dest), _overwrite(overwrite), _stats(stats)
     {
         //nop
     }
@@ -72,16 +106,25 @@ struct ImageLayerTileCopy : public TileHandler
         // already has data for the key
         if (_overwrite == false)
         {
-            if (_dest->createImage(key).valid())
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            bool exists = _dest->createImage(key).valid();
+            _stats->_check.add(start);
+            if (exists)
             {
                 return true;
             }
         }
 
+        osg::Timer_t start = osg::Timer::instance()->tick();
         GeoImage image = _source->createImage(key);
+        _stats->_read.add(start);
+
         if (image.valid())
         {
+            start = osg::Timer::instance()->tick();
             Status status = _dest->writeImage(key, image.getImage(), 0L);
+            _stats->_write.add(start);
+
             ok = status.isOK();
             if (!ok)
             {
@@ -100,13 +143,14 @@ struct ImageLayerTileCopy : public TileHandler
     osg::ref_ptr<ImageLayer> _source;
     osg::ref_ptr<ImageLayer> _dest;
     bool _overwrite;
+    osg::ref_ptr<CopyStats> _stats;
 };
 
 
 struct ElevationLayerTileCopy : public TileHandler
 {
-    ElevationLayerTileCopy(ElevationLayer* source, ElevationLayer* dest, bool overwrite)
-        : _source(source), _dest(dest), _overwrite(overwrite)
+    ElevationLayerTileCopy(ElevationLayer* source, ElevationLayer* dest, bool overwrite, CopyStats* stats)
+        : _source(source), _dest(dest), _overwrite(overwrite), _stats(stats)
     {
         //nop
     }
@@ -119,16 +163,25 @@ struct ElevationLayerTileCopy : public TileHandler
         // already has data for the key
         if (_overwrite == false)
         {
-            if (_dest->createHeightField(key).valid())
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            bool exists = _dest->createHeightField(key).valid();
+            _stats->_check.add(start);
+            if (exists)
             {
                 return true;
             }
         }
 
+        osg::Timer_t start = osg::Timer::instance()->tick();
         GeoHeightField hf = _source->createHeightField(key, 0L);
+        _stats->_read.add(start);
+
         if ( hf.valid() )
         {
+            start = osg::Timer::instance()->tick();
             Status s = _dest->writeHeightField(key, hf.getHeightField(), 0L);
+            _stats->_write.add(start);
+
             ok = s.isOK();
             if (!ok)
                 OE_WARN << key.str() << ": " << s.message() << std::endl;
@@ -148,13 +201,14 @@ struct ElevationLayerTileCopy : public TileHandler
     osg::ref_ptr<ElevationLayer> _source;
     osg::ref_ptr<ElevationLayer> _dest;
     bool _overwrite;
+    osg::ref_ptr<CopyStats> _stats;
 };
 
 
 // Custom progress reporter
 struct ProgressReporter : public osgEarth::ProgressCallback
 {
-    ProgressReporter() : _first(true), _start(0) { }
+    ProgressReporter(CopyStats* stats) : _stats(stats), _first(true), _start(0) { }
 
     bool reportProgress(double             current,
                         double             total,
@@ -183,13 +237,22 @@ struct ProgressReporter : public osgEarth::ProgressCallback
         double minsTotal = projectedTotalTime/60.0;
         double secsTotal = fmod(projectedTotalTime,60.0);
 
+        // throughput of each stage so far, in tiles per second
+        unsigned numRead, numWritten;
+        double readTime, writeTime;
+        _stats->_read.get(numRead, readTime);
+        _stats->_write.get(numWritten, writeTime);
+        double readRate = timeSoFar > 0.0 ? (double)numRead/timeSoFar : 0.0;
+        double writeRate = timeSoFar > 0.0 ? (double)numWritten/timeSoFar : 0.0;
+
         std::cout
             << std::fixed
             << std::setprecision(1) << "\r"
             << (int)current << "/" << (int)total
             << " " << int(100.0f*percentage) << "% complete, " 
             << (int)minsTotal << "m" << (int)secsTotal << "s projected, "
-            << (int)minsToGo << "m" << (int)secsToGo << "s remaining          "
+            << (int)minsToGo << "m" << (int)secsToGo << "s remaining, "
+            << (int)readRate << " read/s, " << (int)writeRate << " written/s          "
             << std::flush;
 
         if ( percentage >= 100.0f )
@@ -200,11 +263,29 @@ struct ProgressReporter : public osgEarth::ProgressCallback
         return false;
     }
 
+    osg::ref_ptr<CopyStats> _stats;
     Threading::Mutex _mutex;
     bool _first;
     osg::Timer_t _start;
 };
 
+// Prints the totals of one stage of the copy
+void reportStage(const std::string& name, StageStats& stage, double wallTime)
+{
+    unsigned count;
+    double seconds;
+    stage.get(count, seconds);
+    if (count == 0u)
+        return;
+
+    std::cout
+        << "    " << std::left << std::setw(8) << name << std::right
+        << count << " tiles, "
+        << std::setprecision(1) << (wallTime > 0.0 ? (double)count/wallTime : 0.0) << " tiles/s, "
+        << std::setprecision(2) << 1000.0*seconds/(double)count << " ms/tile"
+        << std::endl;
+}
+
 
 /**
  * Command-line tool that copies the contents of one TileSource
@@ -357,11 +438,14 @@ main(int argc, char** argv)
     // create the visitor.
     osg::ref_ptr<TileVisitor> visitor;
 
-    unsigned numThreads = 1;
-    if (args.read("--threads", numThreads))
+    // The multithreaded visitor generates keys into a bounded job queue that
+    // feeds parallel copy threads; each thread reads, encodes and writes.
+    unsigned numThreads = OpenThreads::GetNumberOfProcessors();
+    args.read("--threads", numThreads);
+    if (numThreads > 1)
     {
         MultithreadedTileVisitor* mtv = new MultithreadedTileVisitor();
-        mtv->setNumThreads( numThreads < 1 ? 1 : numThreads );
+        mtv->setNumThreads( numThreads );
         visitor = mtv;
     }
     else
@@ -373,19 +457,23 @@ main(int argc, char** argv)
     if (args.read("--no-overwrite"))
         overwrite = false;
 
+    osg::ref_ptr<CopyStats> stats = new CopyStats();
+
     if (dynamic_cast<ImageLayer*>(input.get()) && dynamic_cast<ImageLayer*>(output.get()))
     {
         visitor->setTileHandler(new ImageLayerTileCopy(
             dynamic_cast<ImageLayer*>(input.get()),
             dynamic_cast<ImageLayer*>(output.get()),
-            overwrite));
+            overwrite,
+            stats.get()));
     }
     else if (dynamic_cast<ElevationLayer*>(input.get()) && dynamic_cast<ElevationLayer*>(output.get()))
     {
         visitor->setTileHandler(new ElevationLayerTileCopy(
             dynamic_cast<ElevationLayer*>(input.get()),
             dynamic_cast<ElevationLayer*>(output.get()),
-            overwrite));
+            overwrite,
+            stats.get()));
     }
 
     // set the manula extents, if specified:
@@ -439,7 +527,7 @@ main(int argc, char** argv)
     // Ready!!!
     std::cout << "Working..." << std::endl;
 
-    visitor->setProgressCallback( new ProgressReporter() );
+    visitor->setProgressCallback( new ProgressReporter(stats.get()) );
 
     osg::Timer_t t0 = osg::Timer::instance()->tick();
 
@@ -455,5 +543,10 @@ main(int argc, char** argv)
         << osg::Timer::instance()->delta_s(t0, t1)
         << " seconds." << std::endl;
 
+    double wallTime = osg::Timer::instance()->delta_s(t0, t1);
+    reportStage("check", stats->_check, wallTime);
+    reportStage("read", stats->_read, wallTime);
+    reportStage("write", stats->_write, wallTime);
+
     return 0;
 }
@@ -0,0 +1,509 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/Notify>
+#include <osgEarth/MapNode>
+#include <osgEarth/FeatureModelLayer>
+#include <osgEarth/FeatureIndex>
+#include <osgEarth/GeometryCompiler>
+#include <osgEarth/Session>
+#include <osgEarth/TDTiles>
+#include <osgEarth/JobArena>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/JsonUtils>
+#include <osg/ArgumentParser>
+#include <osg/MatrixTransform>
+#include <osgDB/FileUtils>
+#include <osgDB/WriteFile>
+#include <fstream>
+
+#define LC "[export3dtiles] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+using namespace osgEarth::Contrib;
+
+int
+usage(const char* name, const std::string& error)
+{
+    OE_NOTICE
+        << "Exports a feature model layer to a 3D Tiles tileset (b3dm + tileset.json)."
+        << "\nError: " << error
+        << "\nUsage:"
+        << "\n" << name
+        << "\n  <earthfile>              ; earth file containing the feature model layer"
+        << "\n  --layer <name>           ; name of the FeatureModelLayer to export"
+        << "\n  --out <directory>        ; output folder"
+        << "\n  [--max-features <n>]     ; maximum features per b3dm tile (default = 1000)"
+        << "\n  [--max-lod <n>]          ; maximum subdivision level (default = 18)"
+        << "\n  [--quiet]                ; suppress console output"
+        << std::endl;
+
+    return -1;
+}
+
+namespace
+{
+    // Vertex attribute location for the per-vertex batch ID. The GLTF
+    // writer finds the array by name, so the location only has to avoid
+    // the arrays the feature filters generate themselves.
+    const unsigned BATCH_ID_LOCATION = 7u;
+
+    // Ratio of a tile's radius to the geometric error we report for it;
+    // a smaller value defers refinement until the viewer is closer.
+    const double GEOMETRIC_ERROR_RATIO = 0.1;
+
+    //! Feature index that assigns 3D Tiles batch IDs and collects the
+    //! attributes of each batched feature for the batch table.
+    class BatchTableBuilder : public FeatureIndexBuilder
+    {
+    public:
+        ObjectID tagDrawable(osg::Drawable* drawable, Feature* feature)
+        {
+            ObjectID id = getOrCreateBatchID(feature);
+
+            osg::Geometry* geom = drawable ? drawable->asGeometry() : 0L;
+            if (geom && geom->getVertexArray())
+            {
+                osg::FloatArray* ids = new osg::FloatArray(geom->getVertexArray()->getNumElements());
+                std::fill(ids->begin(), ids->end(), (float)id);
+                ids->setName("_BATCHID");
+                ids->setBinding(osg::Array::BIND_PER_VERTEX);
+                geom->setVertexAttribArray(BATCH_ID_LOCATION, ids);
+            }
+            return id;
+        }
+
+        ObjectID tagAllDrawables(osg::Node* node, Feature* feature)
+        {
+            ObjectID id = getOrCreateBatchID(feature);
+            if (node)
+            {
+                TagDrawables visitor(this, feature);
+                node->accept(visitor);
+            }
+            return id;
+        }
+
+        ObjectID tagNode(osg::Node* node, Feature* feature)
+        {
+            // Substituted models share their geometry between features, so
+            // there is no per-vertex ID to write; the feature still gets a
+            // row in the batch table.
+            return getOrCreateBatchID(feature);
+        }
+
+        unsigned size() const
+        {
+            return _features.size();
+        }
+
+        //! Batch table JSON: one array per attribute, indexed by batch ID.
+        std::string getJSON() const
+        {
+            Json::Value table(Json::objectValue);
+            const unsigned count = _features.size();
+
+            for (unsigned i = 0; i < count; ++i)
+            {
+                const Feature* feature = _features[i].get();
+                table["id"][i] = (double)feature->getFID();
+
+                const AttributeTable& attrs = feature->getAttrs();
+                for (AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+                {
+                    if (a->first == "id")
+                        continue;
+
+                    Json::Value& column = table[a->first];
+                    if (column.isNull())
+                        column = Json::Value(Json::arrayValue);
+                    column[i] = toJSON(a->second);
+                }
+            }
+
+            // every column must have exactly one entry per batch ID
+            Json::Value::Members names = table.getMemberNames();
+            for (unsigned n = 0; n < names.size(); ++n)
+                table[names[n]].resize(count);
+
+            Json::FastWriter writer;
+            return writer.write(table);
+        }
+
+    private:
+        struct TagDrawables : public osg::NodeVisitor
+        {
+            TagDrawables(BatchTableBuilder* builder, Feature* feature) :
+                osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _builder(builder), _feature(feature) { }
+
+            void apply(osg::Drawable& drawable)
+            {
+                _builder->tagDrawable(&drawable, _feature);
+            }
+
+            BatchTableBuilder* _builder;
+            Feature* _feature;
+        };
+
+        ObjectID getOrCreateBatchID(Feature* feature)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            std::map<Feature*, ObjectID>::const_iterator i = _ids.find(feature);
+            if (i != _ids.end())
+                return i->second;
+
+            ObjectID id = _features.size();
+            _features.push_back(feature);
+            _ids[feature] = id;
+            return id;
+        }
+
+        static Json::Value toJSON(const AttributeValue& value)
+        {
+            if (!value.second.set)
+                return Json::Value();
+
+            switch(value.first)
+            {
+            case ATTRTYPE_INT:
+                return Json::Value(value.getInt());
+            case ATTRTYPE_DOUBLE:
+                return Json::Value(value.getDouble());
+            case ATTRTYPE_BOOL:
+                return Json::Value(value.getBool());
+            case ATTRTYPE_DOUBLEARRAY:
+            {
+                Json::Value a(Json::arrayValue);
+                const std::vector<double>& values = value.getDoubleArrayValue();
+                for (unsigned i = 0; i < values.size(); ++i)
+                    a.append(values[i]);
+                return a;
+            }
+            default:
+                return Json::Value(value.getString());
+            }
+        }
+
+        Threading::Mutex _mutex;
+        std::vector<osg::ref_ptr<Feature> > _features;
+        std::map<Feature*, ObjectID> _ids;
+    };
+
+    //! A feature and its centroid in the map profile's SRS
+    struct Item
+    {
+        osg::ref_ptr<Feature> feature;
+        double x, y;
+    };
+    typedef std::vector<Item> Items;
+
+    struct Env
+    {
+        osg::ref_ptr<const Map> map;
+        osg::ref_ptr<Session> session;
+        osg::ref_ptr<const FeatureProfile> featureProfile;
+        Style style;
+        GeometryCompilerOptions compilerOptions;
+        std::string outDir;
+        unsigned maxFeatures;
+        unsigned maxLOD;
+        bool verbose;
+        JobArena* arena;
+
+        Threading::Mutex mutex;
+        unsigned tilesWritten;
+        unsigned tilesTotal;
+    };
+
+    //! Compiles one leaf tile's features and writes them out as a b3dm.
+    struct ExportTileTask : public TaskRequest
+    {
+        ExportTileTask(Env& env, const TileKey& key, Items& items, ThreeDTiles::Tile* tile) :
+            _env(env), _key(key), _tile(tile)
+        {
+            _items.swap(items);
+        }
+
+        void operator()(ProgressCallback*)
+        {
+            FeatureList features;
+            for (Items::iterator i = _items.begin(); i != _items.end(); ++i)
+                features.push_back(i->feature.get());
+
+            BatchTableBuilder batches;
+            FilterContext context(_env.session.get(), _env.featureProfile.get(), _key.getExtent(), &batches);
+            GeometryCompiler compiler(_env.compilerOptions);
+            osg::ref_ptr<osg::Node> node = compiler.compile(features, _env.style, context);
+
+            std::string filename = Stringify()
+                << _key.getLOD() << "_" << _key.getTileX() << "_" << _key.getTileY() << ".b3dm";
+
+            bool ok = false;
+            if (node.valid() && node->getBound().valid())
+            {
+                // glTF content is Y-up; the b3dm reader rotates it back.
+                osg::ref_ptr<osg::MatrixTransform> root = new osg::MatrixTransform(
+                    osg::Matrix::rotate(osg::Vec3d(0.0, 0.0, 1.0), osg::Vec3d(0.0, 1.0, 0.0)));
+                root->addChild(node.get());
+                root->setUserValue("b3dm.batchLength", batches.size());
+                root->setUserValue("b3dm.batchTable", batches.getJSON());
+
+                ok = osgDB::writeNodeFile(*root.get(), _env.outDir + "/" + filename);
+            }
+
+            if (ok)
+            {
+                // Height range from the compiled geometry (in world coordinates)
+                const osg::BoundingSphere& bs = node->getBound();
+                GeoPoint center;
+                center.fromWorld(_env.map->getSRS(), bs.center());
+                _tile->boundingVolume()->region()->zMin() = center.z() - bs.radius();
+                _tile->boundingVolume()->region()->zMax() = center.z() + bs.radius();
+                _tile->content()->uri() = URI(filename);
+            }
+            else
+            {
+                OE_WARN << LC << "No content written for tile " << _key.str() << std::endl;
+            }
+
+            Threading::ScopedMutexLock lock(_env.mutex);
+            ++_env.tilesWritten;
+            if (_env.verbose)
+            {
+                std::cout << "\r" << _env.tilesWritten << "/" << _env.tilesTotal << " tiles" << std::flush;
+            }
+        }
+
+        Env& _env;
+        TileKey _key;
+        Items _items;
+        osg::ref_ptr<ThreeDTiles::Tile> _tile;
+    };
+
+    void setRegion(ThreeDTiles::Tile* tile, const GeoExtent& extent)
+    {
+        GeoExtent e = extent.transform(SpatialReference::get("epsg:4979"));
+        tile->boundingVolume()->region()->set(
+            osg::DegreesToRadians(e.xMin()), osg::DegreesToRadians(e.yMin()), 0.0,
+            osg::DegreesToRadians(e.xMax()), osg::DegreesToRadians(e.yMax()), 0.0);
+    }
+
+    //! Builds the tile hierarchy under "tile", splitting "items" into the
+    //! key's quadrants until a tile holds few enough features, then
+    //! dispatches a job to compile and write each leaf.
+    void build(const TileKey& key, Items& items, ThreeDTiles::Tile* tile, Env& env)
+    {
+        setRegion(tile, key.getExtent());
+        tile->refine() = ThreeDTiles::REFINE_ADD;
+
+        if (items.size() <= env.maxFeatures || key.getLOD() >= env.maxLOD)
+        {
+            tile->geometricError() = 0.0;
+            env.tilesTotal++;
+            env.arena->dispatch(new ExportTileTask(env, key, items, tile));
+            return;
+        }
+
+        tile->geometricError() =
+            key.getExtent().computeBoundingGeoCircle().getRadius() * GEOMETRIC_ERROR_RATIO;
+
+        Items childItems[4];
+        for (Items::iterator i = items.begin(); i != items.end(); ++i)
+        {
+            const GeoExtent& extent = key.getExtent();
+            unsigned q =
+                (i->x < extent.xMin() + 0.5*extent.width() ? 0u : 1u) +
+                (i->y > extent.yMin() + 0.5*extent.height() ? 0u : 2u);
+            childItems[q].push_back(*i);
+        }
+        items.clear();
+
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            if (!childItems[q].empty())
+            {
+                osg::ref_ptr<ThreeDTiles::Tile> child = new ThreeDTiles::Tile();
+                tile->children().push_back(child.get());
+                build(key.createChildKey(q), childItems[q], child.get(), env);
+            }
+        }
+    }
+
+    //! Propagates the leaf height ranges up to the parent tiles.
+    void updateHeights(ThreeDTiles::Tile* tile)
+    {
+        if (tile->children().empty())
+            return;
+
+        bool first = true;
+        osg::BoundingBoxd& region = tile->boundingVolume()->region().mutable_value();
+        for (unsigned i = 0; i < tile->children().size(); ++i)
+        {
+            ThreeDTiles::Tile* child = tile->children()[i].get();
+            updateHeights(child);
+            const osg::BoundingBoxd& c = child->boundingVolume()->region().get();
+            region.zMin() = first ? c.zMin() : osg::minimum(region.zMin(), c.zMin());
+            region.zMax() = first ? c.zMax() : osg::maximum(region.zMax(), c.zMax());
+            first = false;
+        }
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+
+    Env env;
+    env.verbose = !arguments.read("--quiet");
+    env.maxFeatures = 1000u;
+    env.maxLOD = 18u;
+    env.tilesWritten = 0u;
+    env.tilesTotal = 0u;
+
+    std::string layerName;
+    if (!arguments.read("--layer", layerName))
+        return usage(argv[0], "Missing --layer");
+
+    if (!arguments.read("--out", env.outDir))
+        return usage(argv[0], "Missing --out");
+
+    arguments.read("--max-features", env.maxFeatures);
+    arguments.read("--max-lod", env.maxLOD);
+    if (env.maxFeatures == 0u)
+        return usage(argv[0], "Illegal --max-features");
+
+    osg::ref_ptr<MapNode> mapNode = MapNode::load(arguments);
+    if (!mapNode.valid())
+        return usage(argv[0], "No earth file");
+
+    const Map* map = mapNode->getMap();
+    FeatureModelLayer* layer = map->getLayerByName<FeatureModelLayer>(layerName);
+    if (!layer)
+        return usage(argv[0], "Feature model layer \"" + layerName + "\" not found");
+
+    FeatureSource* fs = layer->getFeatureSource();
+    if (!fs || !fs->getFeatureProfile())
+        return usage(argv[0], "Layer has no feature source");
+
+    if (!layer->getStyleSheet() || !layer->getStyleSheet()->getDefaultStyle())
+        return usage(argv[0], "Layer has no style");
+
+    if (!osgDB::makeDirectory(env.outDir))
+        return usage(argv[0], "Unable to create/find output location");
+
+    env.map = map;
+    env.featureProfile = fs->getFeatureProfile();
+    env.style = *layer->getStyleSheet()->getDefaultStyle();
+
+    // One session for all tiles, so each substituted model is loaded
+    // once and shared by every tile that references it.
+    env.session = new Session(map, layer->getStyleSheet(), fs, layer->getReadOptions());
+
+    env.compilerOptions = layer->options();
+    env.compilerOptions.instancing() = false;
+    env.compilerOptions.shaderPolicy() = SHADERPOLICY_DISABLE;
+
+    env.arena = JobArena::get("oe.export3dtiles");
+
+    // Read the features once and sort them into the profile's root keys
+    // by centroid.
+    const Profile* profile = map->getProfile();
+    std::vector<TileKey> rootKeys;
+    profile->getRootKeys(rootKeys);
+    std::vector<Items> rootItems(rootKeys.size());
+
+    unsigned numFeatures = 0u;
+    osg::ref_ptr<FeatureCursor> cursor = fs->createFeatureCursor(Query(), 0L);
+    while (cursor.valid() && cursor->hasMore())
+    {
+        Feature* f = cursor->nextFeature();
+        if (!f || !f->getGeometry())
+            continue;
+
+        double x, y;
+        f->getExtent().getCentroid(x, y);
+        GeoPoint centroid(f->getSRS(), x, y, 0.0, ALTMODE_ABSOLUTE);
+        if (!centroid.transform(profile->getSRS(), centroid))
+            continue;
+
+        for (unsigned k = 0; k < rootKeys.size(); ++k)
+        {
+            if (rootKeys[k].getExtent().contains(centroid.x(), centroid.y()))
+            {
+                Item item;
+                item.feature = f;
+                item.x = centroid.x();
+                item.y = centroid.y();
+                rootItems[k].push_back(item);
+                ++numFeatures;
+                break;
+            }
+        }
+    }
+
+    if (numFeatures == 0u)
+        return usage(argv[0], "No features to export");
+
+    if (env.verbose)
+        std::cout << "Exporting " << numFeatures << " features..." << std::endl;
+
+    osg::ref_ptr<ThreeDTiles::Tile> root = new ThreeDTiles::Tile();
+    setRegion(root.get(), profile->getExtent());
+    root->refine() = ThreeDTiles::REFINE_ADD;
+    root->geometricError() = profile->getExtent().computeBoundingGeoCircle().getRadius() * GEOMETRIC_ERROR_RATIO;
+
+    for (unsigned k = 0; k < rootKeys.size(); ++k)
+    {
+        if (!rootItems[k].empty())
+        {
+            osg::ref_ptr<ThreeDTiles::Tile> child = new ThreeDTiles::Tile();
+            root->children().push_back(child.get());
+            build(rootKeys[k], rootItems[k], child.get(), env);
+        }
+    }
+
+    env.arena->waitUntilIdle();
+
+    if (env.verbose)
+        std::cout << std::endl;
+
+    updateHeights(root.get());
+
+    osg::ref_ptr<ThreeDTiles::Tileset> tileset = new ThreeDTiles::Tileset();
+    tileset->asset()->version() = "1.0";
+    tileset->geometricError() = root->geometricError().get();
+    tileset->root() = root.get();
+
+    std::string outFile = env.outDir + "/tileset.json";
+    std::ofstream out(outFile.c_str());
+    Json::Value tilesetJSON = tileset->getJSON();
+    Json::StyledStreamWriter writer;
+    writer.write(out, tilesetJSON);
+    out.close();
+
+    if (env.verbose)
+        std::cout << "Wrote " << outFile << std::endl;
+
+    return 0;
+}
@@ -69,6 +69,8 @@ usage( const std::string& msg = "" )
         << "            [--ext <extension>]             : overrides the image file extension (e.g. jpg)\n"
         << "            [--overwrite]                   : overwrite existing tiles\n"
         << "            [--keep-empties]                : writes out fully transparent image tiles (normally discarded)\n"
+        << "            [--dedupe]                      : writes identical tiles (e.g. open ocean) once and hard-links the duplicates\n"
+        << "            [--write-threads <num>]         : encodes and writes tiles on this many background threads\n"
         << "            [--continue-single-color]       : continues to subdivide single color tiles, subdivision typicall stops on single color images\n"
         << "            [--elevation-pixel-depth]       : pixeldepth for elevations\n"
         << "            [--db-options]                  : osgDB options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
@@ -192,7 +194,6 @@ makeTMS( osg::ArgumentParser& args )
         rootFolder = Stringify() << earthFile << ".tms_repo";
 
     // whether to overwrite existing tile files
-    //TODO:  Support
     bool overwrite = false;
     if( args.read( "--overwrite" ) )
         overwrite = true;
@@ -214,7 +215,14 @@ makeTMS( osg::ArgumentParser& args )
     // whether to keep 'empty' tiles
     bool keepEmpties = args.read( "--keep-empties" );
 
-    //TODO:  Single color
+    // whether to write identical tiles only once
+    bool dedupe = args.read( "--dedupe" );
+
+    // number of background threads for encoding and writing tiles
+    unsigned writeThreads = 0u;
+    args.read( "--write-threads", writeThreads );
+
+    // whether to subdivide below tiles that are a single color
     bool continueSingleColor = args.read( "--continue-single-color" );
 
     // elevation pixel depth
@@ -329,6 +337,9 @@ makeTMS( osg::ArgumentParser& args )
     packager.setWriteOptions(options.get());
     packager.setOverwrite(overwrite);
     packager.setKeepEmpties(keepEmpties);
+    packager.setSubdivideSingleColorTiles(continueSingleColor);
+    packager.setDeduplicate(dedupe);
+    packager.setNumWriteThreads(writeThreads);
     packager.setApplyAlphaMask(applyAlphaMask);
 
 
@@ -84,13 +84,18 @@ int usage( const std::string& msg )
         << std::endl
         << "    --seed file.earth                   ; Seeds the cache in a .earth file"  << std::endl
         << "        [--estimate]                    ; Print out an estimation of the number of tiles, disk space and time it will take to perform this seed operation" << std::endl
+        << "        [--samples num]                 ; With --estimate, read num random tiles per level from the layer (--image, --elevation, or the first layer) to measure real tile sizes" << std::endl
         << "        [--min-level level]             ; Lowest LOD level to seed (default=0)" << std::endl
         << "        [--max-level level]             ; Highest LOD level to seed (default=highest available)" << std::endl
         << "        [--bounds xmin ymin xmax ymax]* ; Geospatial bounding box to seed (in map coordinates; default=entire map)" << std::endl
         << "        [--index shapefile]             ; Use the feature extents in a shapefile to set the bounding boxes for seeding" << std::endl
         << "        [--mp]                          ; Use multiprocessing to process the tiles.  Useful for GDAL sources as this avoids the global GDAL lock" << std::endl
         << "        [--mt]                          ; Use multithreading to process the tiles." << std::endl
-        << "        [--concurrency]                 ; The number of threads or processes to use if --mp or --mt are provided." << std::endl
+        << "        [--parallel]                    ; Use work-stealing threads over the tile pyramid, with optional resume." << std::endl
+        << "        [--concurrency]                 ; The number of threads or processes to use if --mp, --mt or --parallel are provided." << std::endl
+        << "        [--journal file]                ; Record completed subtrees in a file and skip them when run again (implies --parallel)" << std::endl
+        << "        [--coordinate dir name]         ; Seed together with other workers sharing a directory, as worker \"name\" (implies --parallel)" << std::endl
+        << "        [--checkpoint-level level]      ; Level of the subtrees to journal and share out (default=max level - 8)" << std::endl
         << "        [--verbose]                     ; Displays progress of the seed operation" << std::endl
         << std::endl
         << "    --purge file.earth                  ; Purges a layer cache in a .earth file (interactive)" << std::endl
@@ -123,6 +128,9 @@ int seed( osg::ArgumentParser& args )
     while (args.read("--max-level", maxLevel));
 
     bool estimate = args.read("--estimate");        
+
+    unsigned samples = 0u;
+    args.read("--samples", samples);
     
 
     std::vector< Bounds > bounds;
@@ -206,13 +214,45 @@ int seed( osg::ArgumentParser& args )
             est.addExtent( extent );
         } 
 
+        if (samples > 0u)
+        {
+            osg::ref_ptr<TileLayer> layer;
+            if (imageLayerIndex >= 0)
+                layer = mapNode->getMap()->getLayerAt<ImageLayer>( imageLayerIndex );
+            else if (elevationLayerIndex >= 0)
+                layer = mapNode->getMap()->getLayerAt<ElevationLayer>( elevationLayerIndex );
+            else
+                layer = mapNode->getMap()->getLayer<TileLayer>();
+
+            if (layer.valid())
+            {
+                est.setLayer( layer.get() );
+                est.setSamplesPerLevel( samples );
+                osg::ref_ptr<ProgressCallback> progress = new ConsoleProgressCallback();
+                if (!est.sample( progress.get() ))
+                    std::cout << "Failed to sample layer " << layer->getName() << std::endl;
+            }
+        }
+
         unsigned int numTiles = est.getNumTiles();
         double size = est.getSizeInMB();
         double time = est.getTotalTimeInSeconds();
         std::cout << "Cache Estimation " << std::endl
             << "---------------- " << std::endl
-            << "Total number of tiles: " << numTiles << std::endl
-            << "Size on disk:          " << osgEarth::prettyPrintSize( size ) << std::endl
+            << "Total number of tiles: " << numTiles << std::endl;
+        if (est.hasSamples())
+        {
+            std::cout
+                << "Tiles with data:       " << (unsigned int)est.getNumTilesWithData() << std::endl
+                << "Size on disk:          " << osgEarth::prettyPrintSize( size )
+                << " (+/- " << osgEarth::prettyPrintSize( est.getSizeInMBError() ) << ")" << std::endl;
+        }
+        else
+        {
+            std::cout
+                << "Size on disk:          " << osgEarth::prettyPrintSize( size ) << std::endl;
+        }
+        std::cout
             << "Total time:            " << osgEarth::prettyPrintTime( time ) << std::endl;
 
         return 0;
@@ -237,7 +277,36 @@ int seed( osg::ArgumentParser& args )
     // If we dont' have a visitor create one.
     if (!visitor.valid())
     {
-        if (args.read("--mt"))
+        std::string journal, coordinationPath, workerName;
+        bool parallel = args.read("--parallel");
+        while (args.read("--journal", journal)) parallel = true;
+        while (args.read("--coordinate", coordinationPath, workerName)) parallel = true;
+        int checkpointLevel = -1;
+        args.read("--checkpoint-level", checkpointLevel);
+
+        if (parallel)
+        {
+            // Create a resumable, work-stealing visitor
+            ParallelTileVisitor* v = new ParallelTileVisitor();
+            if (concurrency > 0)
+            {
+                v->setNumThreads(concurrency);
+            }
+            if (checkpointLevel >= 0)
+            {
+                v->setCheckpointLevel(checkpointLevel);
+            }
+            if (!coordinationPath.empty())
+            {
+                v->setCoordinationPath(coordinationPath, workerName);
+            }
+            else
+            {
+                v->setJournal(journal);
+            }
+            visitor = v;
+        }
+        else if (args.read("--mt"))
         {
             // Create a multithreaded visitor
             MultithreadedTileVisitor* v = new MultithreadedTileVisitor();
@@ -26,6 +26,10 @@
 #include <osgEarth/Registry>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/ExampleResources>
+#include <osgEarth/Containers>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osg/Timer>
 #include <osgDB/ReaderWriter>
 #include <osgDB/ReadFile>
 #include <osgDB/Registry>
@@ -49,6 +53,8 @@
 #include <Poco/Util/OptionSet.h>
 #include <Poco/Util/HelpFormatter.h>
 #include <iostream>
+#include <sstream>
+#include <map>
 
 using Poco::Net::ServerSocket;
 using Poco::Net::HTTPRequestHandler;
@@ -296,6 +302,11 @@ usage(const char* name)
 {
     OE_NOTICE 
         << "\nUsage: " << name << " file.earth" << std::endl
+        << "    --port <n>          : HTTP port (default 8000)" << std::endl
+        << "    --threads <n>       : max request threads (default 16)" << std::endl
+        << "    --queue <n>         : max queued connections (default 256)" << std::endl
+        << "    --cache-size <n>    : number of encoded tiles to cache (default 4096)" << std::endl
+        << "    Tiles are served at /z/x/y.ext; statistics at /stats" << std::endl
         << MapNodeHelper().usage() << std::endl;
 
     return 0;
@@ -463,58 +474,225 @@ public:
 
 static TileImageServer* _server;
 
+
+// Upper bounds of the latency histogram buckets, in milliseconds
+#define NUM_BUCKETS 12
+const double latencyBuckets[NUM_BUCKETS] = {
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+
+/**
+ * An encoded tile, ready to send. Shared by the response cache and by
+ * all the requests waiting on it.
+ */
+struct EncodedTile : public osg::Referenced
+{
+    std::string _data;
+    std::string _mimeType;
+    std::string _etag;
+};
+
+/**
+ * Renders each tile once, no matter how many clients request it at the same
+ * time, and caches the encoded bytes.
+ */
+class TileService
+{
+public:
+    TileService(unsigned cacheSize) :
+        _cache(true, cacheSize),
+        _hits(0u),
+        _misses(0u),
+        _coalesced(0u)
+    {
+        for (unsigned i = 0; i < LOD_COUNT; ++i)
+            _histograms[i].assign(NUM_BUCKETS + 1, 0u);
+    }
+
+    osg::ref_ptr<EncodedTile> getTile(unsigned z, unsigned x, unsigned y, const std::string& ext)
+    {
+        std::string key = Stringify() << z << "/" << x << "/" << y << "." << ext;
+
+        Cache::Record rec;
+        if (_cache.get(key, rec))
+        {
+            Threading::ScopedMutexLock lock(_statsMutex);
+            ++_hits;
+            return rec.value();
+        }
+
+        // Join a render already in progress for this tile, or start one.
+        osg::ref_ptr<InFlight> inFlight;
+        bool owner = false;
+        {
+            Threading::ScopedMutexLock lock(_inFlightMutex);
+            osg::ref_ptr<InFlight>& entry = _inFlight[key];
+            if (!entry.valid())
+            {
+                entry = new InFlight();
+                owner = true;
+            }
+            inFlight = entry;
+        }
+
+        if (!owner)
+        {
+            inFlight->_done.wait();
+            Threading::ScopedMutexLock lock(_statsMutex);
+            ++_coalesced;
+            return inFlight->_result;
+        }
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        osg::ref_ptr<EncodedTile> tile = encode(_server->getTile(z, x, y), ext);
+        if (tile.valid())
+        {
+            _cache.insert(key, tile.get());
+        }
+
+        double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+        {
+            Threading::ScopedMutexLock lock(_statsMutex);
+            ++_misses;
+            unsigned bucket = 0;
+            while (bucket < NUM_BUCKETS && ms > latencyBuckets[bucket])
+                ++bucket;
+            _histograms[osg::minimum(z, LOD_COUNT - 1u)][bucket]++;
+        }
+
+        inFlight->_result = tile.get();
+        {
+            Threading::ScopedMutexLock lock(_inFlightMutex);
+            _inFlight.erase(key);
+        }
+        inFlight->_done.set();
+
+        return tile;
+    }
+
+    //! Cache statistics and the render latency histogram of each LOD, as JSON
+    std::string getStats()
+    {
+        Threading::ScopedMutexLock lock(_statsMutex);
+        std::stringstream buf;
+        buf << "{\"hits\":" << _hits
+            << ",\"misses\":" << _misses
+            << ",\"coalesced\":" << _coalesced
+            << ",\"buckets_ms\":[";
+        for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+            buf << (i > 0 ? "," : "") << latencyBuckets[i];
+        buf << "],\"render_latency\":{";
+        bool first = true;
+        for (unsigned z = 0; z < LOD_COUNT; ++z)
+        {
+            unsigned total = 0;
+            for (unsigned i = 0; i <= NUM_BUCKETS; ++i)
+                total += _histograms[z][i];
+            if (total == 0)
+                continue;
+
+            buf << (first ? "" : ",") << "\"" << z << "\":[";
+            for (unsigned i = 0; i <= NUM_BUCKETS; ++i)
+                buf << (i > 0 ? "," : "") << _histograms[z][i];
+            buf << "]";
+            first = false;
+        }
+        buf << "}}";
+        return buf.str();
+    }
+
+private:
+    struct InFlight : public osg::Referenced
+    {
+        Threading::Event _done;
+        osg::ref_ptr<EncodedTile> _result;
+    };
+
+    typedef LRUCache<std::string, osg::ref_ptr<EncodedTile> > Cache;
+
+    EncodedTile* encode(osg::Image* rawImage, const std::string& ext)
+    {
+        osg::ref_ptr<osg::Image> image = rawImage;
+        if (!image.valid())
+            return 0L;
+
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
+        if (!rw)
+            return 0L;
+
+        std::stringstream buf;
+        if (!rw->writeImage(*image.get(), buf).success())
+            return 0L;
+
+        EncodedTile* tile = new EncodedTile();
+        tile->_data = buf.str();
+        tile->_mimeType = (ext == "jpeg" || ext == "jpg") ? "image/jpeg" : "image/png";
+        tile->_etag = Stringify() << "\"" << std::hex << hashString(tile->_data) << "\"";
+        return tile;
+    }
+
+    Cache _cache;
+    std::map<std::string, osg::ref_ptr<InFlight> > _inFlight;
+    Threading::Mutex _inFlightMutex;
+
+    std::vector<unsigned> _histograms[LOD_COUNT];
+    unsigned _hits, _misses, _coalesced;
+    Threading::Mutex _statsMutex;
+};
+
+static TileService* _service;
+
 class TileRequestHandler: public HTTPRequestHandler
 {
 public:
-    TileRequestHandler()
+    TileRequestHandler(unsigned z, unsigned x, unsigned y, const std::string& ext) :
+        _z(z), _x(x), _y(y), _ext(ext)
     {
     }
 
     void handleRequest(HTTPServerRequest& request,
                        HTTPServerResponse& response)
     {
-        StringTokenizer tok("/");
-        StringVector tized;
-        tok.tokenize(request.getURI(), tized);            
-        if ( tized.size() == 4 )
-        {
-            int z = as<int>(tized[1], 0);
-            int x = as<int>(tized[2], 0);
-            unsigned int y = as<int>(osgDB::getNameLessExtension(tized[3]),0);
-            std::string ext = osgDB::getFileExtension(tized[3]);
-
-            OE_DEBUG << "z=" << z << std::endl;
-            OE_DEBUG << "x=" << x << std::endl;
-            OE_DEBUG << "y=" << y << std::endl;              
-            OE_DEBUG << "ext=" << ext << std::endl;
+        OE_DEBUG << "z=" << _z << ", x=" << _x << ", y=" << _y << ", ext=" << _ext << std::endl;
 
-            response.setChunkedTransferEncoding(true);
+        osg::ref_ptr<EncodedTile> tile = _service->getTile(_z, _x, _y, _ext);
+        if (!tile.valid())
+        {
+            response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+            response.send();
+            return;
+        }
 
-            osg::ref_ptr< osg::Image > image = _server->getTile(z, x, y);
-            
-            if (image)
-            {
-                osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
-                if (rw)
-                {
-                    std::string mime = "image/png";
-                    if (ext == "jpeg" || ext == "jpg")
-                    {
-                        mime = "image/jpeg";
-                    }                    
-                    response.setContentType(mime);
-                    std::ostream& ostr = response.send();                 
-                    rw->writeImage(*image.get(), ostr);                    
-                }             
+        response.set("ETag", tile->_etag);
 
-            }
+        if (request.has("If-None-Match") && request.get("If-None-Match") == tile->_etag)
+        {
+            response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_MODIFIED);
+            response.send();
+            return;
         }
- 
-        response.setStatus(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);                
+
+        // send straight from the cached bytes
+        response.setContentType(tile->_mimeType);
+        response.sendBuffer(tile->_data.data(), tile->_data.size());
     }
 
 private:
-    std::string _format;
+    unsigned _z, _x, _y;
+    std::string _ext;
+};
+
+class StatsRequestHandler: public HTTPRequestHandler
+{
+public:
+    void handleRequest(HTTPServerRequest& request,
+                       HTTPServerResponse& response)
+    {
+        std::string stats = _service->getStats();
+        response.setContentType("application/json");
+        response.sendBuffer(stats.data(), stats.size());
+    }
 };
 
 class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
@@ -537,12 +715,12 @@ class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
             unsigned int y = as<int>(osgDB::getNameLessExtension(tized[3]),0);
             std::string ext = osgDB::getFileExtension(tized[3]);
 
-            OE_DEBUG << "z=" << z << std::endl;
-            OE_DEBUG << "x=" << x << std::endl;
-            OE_DEBUG << "y=" << y << std::endl;              
-            OE_DEBUG << "ext=" << ext << std::endl;
+            return new TileRequestHandler(z, x, y, ext);
+        }
 
-            return new TileRequestHandler();
+        if ( tized.size() == 2 && tized[1] == "stats" )
+        {
+            return new StatsRequestHandler();
         }
 
         return 0;
@@ -552,8 +730,10 @@ class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
 class TileHTTPServer: public Poco::Util::ServerApplication
 {
 public:
-    TileHTTPServer(int port):
-      _port(port)
+    TileHTTPServer(int port, int maxThreads, int maxQueued):
+      _port(port),
+      _maxThreads(maxThreads),
+      _maxQueued(maxQueued)
     {
     }
 
@@ -575,8 +755,13 @@ protected:
 
     int main(const std::vector<std::string>& args)
     {
+        // bounded worker pool; requests beyond the queue are refused.
+        HTTPServerParams* params = new HTTPServerParams();
+        params->setMaxThreads(_maxThreads);
+        params->setMaxQueued(_maxQueued);
+
         ServerSocket svs(_port);
-        HTTPServer srv(new TileRequestHandlerFactory(), svs, new HTTPServerParams);
+        HTTPServer srv(new TileRequestHandlerFactory(), svs, params);
         srv.start();
         waitForTerminationRequest();
         srv.stop();
@@ -585,6 +770,8 @@ protected:
 
 private:
     int _port;
+    int _maxThreads;
+    int _maxQueued;
 };
 
 
@@ -602,6 +789,15 @@ main(int argc, char** argv)
     arguments.read("--port", port);
     OE_NOTICE << "Listening on port " << port << std::endl;
 
+    int maxThreads = 16;
+    arguments.read("--threads", maxThreads);
+
+    int maxQueued = 256;
+    arguments.read("--queue", maxQueued);
+
+    unsigned cacheSize = 4096;
+    arguments.read("--cache-size", cacheSize);
+
     // thread-safe initialization of the OSG wrapper manager. Calling this here
     // prevents the "unsupported wrapper" messages from OSG
     osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper("osg::Image");
@@ -617,7 +813,8 @@ main(int argc, char** argv)
     }
 
     _server = new TileImageServer( mapNode.get() );
+    _service = new TileService( cacheSize );
 
-    TileHTTPServer app(port);
+    TileHTTPServer app(port, maxThreads, maxQueued);
     return app.run(argc, argv);
 }
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/AltitudeFilter>
+#include <osgEarth/FeatureBatch>
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/GeoData>
 #include <osgEarth/Metrics>
@@ -64,6 +65,99 @@ AltitudeFilter::push( FeatureList& features, FilterContext& cx )
     return cx;
 }
 
+FilterContext
+AltitudeFilter::push( FeatureBatch& batch, FilterContext& cx )
+{
+    OE_PROFILING_ZONE;
+
+    bool clampToMap = 
+        _altitude.valid()                                          && 
+        _altitude->clamping()  != AltitudeSymbol::CLAMP_NONE       &&
+        _altitude->technique() == AltitudeSymbol::TECHNIQUE_MAP    &&
+        cx.getSession()        != 0L                               &&
+        cx.profile()           != 0L;
+
+    bool hasScale  = _altitude.valid() && _altitude->verticalScale().isSet();
+    bool hasOffset = _altitude.valid() && _altitude->verticalOffset().isSet();
+
+    NumericExpression scaleExpr;
+    if ( hasScale )
+        scaleExpr = *_altitude->verticalScale();
+
+    NumericExpression offsetExpr;
+    if ( hasOffset )
+        offsetExpr = *_altitude->verticalOffset();
+
+    // evaluate the expressions for the whole batch up front; this fails if
+    // a variable isn't an attribute of every feature (it could be a script).
+    std::vector<double> scales, offsets;
+
+    if ( clampToMap ||
+         (_altitude.valid() && _altitude->script().isSet()) ||
+         (hasScale && !batch.eval( scaleExpr, scales )) ||
+         (hasOffset && !batch.eval( offsetExpr, offsets )) )
+    {
+        return FeatureFilter::push( batch, cx );
+    }
+
+    bool gpuClamping =
+        _altitude.valid() &&
+        _altitude->technique() == _altitude->TECHNIQUE_GPU;
+
+    bool ignoreZ =
+        gpuClamping && 
+        _altitude->clamping() == _altitude->CLAMP_TO_TERRAIN;
+
+    std::vector<double>& z = batch.z();
+
+    for( unsigned f = 0; f < batch.getNumFeatures(); ++f )
+    {
+        unsigned firstPart = batch.getFirstPart(f);
+        unsigned lastPart  = batch.getFirstPart(f+1);
+        if ( firstPart == lastPart )
+            continue;
+
+        double scaleZ  = hasScale  ? scales[f]  : 1.0;
+        double offsetZ = hasOffset ? offsets[f] : 0.0;
+
+        double minHAT =  DBL_MAX;
+        double maxHAT = -DBL_MAX;
+
+        unsigned end = batch.getFirstPoint(lastPart);
+        for( unsigned p = batch.getFirstPoint(firstPart); p < end; ++p )
+        {
+            if ( ignoreZ )
+            {
+                z[p] = 0.0;
+            }
+
+            if ( !gpuClamping )
+            {
+                z[p] = z[p] * scaleZ + offsetZ;
+            }
+
+            if ( z[p] < minHAT )
+                minHAT = z[p];
+            if ( z[p] > maxHAT )
+                maxHAT = z[p];
+        }
+
+        if ( minHAT != DBL_MAX )
+        {
+            batch.setDouble( "__min_hat", f, minHAT );
+            batch.setDouble( "__max_hat", f, maxHAT );
+        }
+
+        if ( gpuClamping )
+        {
+            batch.setDouble( "__oe_verticalScale",  f, scaleZ );
+            batch.setDouble( "__oe_verticalOffset", f, offsetZ );
+        }
+    }
+
+    return cx;
+}
+
 void
 AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
 {
@@ -18,11 +18,32 @@
  */
 #include <osgEarth/AnnotationLayer>
 #include <osgEarth/AnnotationRegistry>
+#include <osgEarth/Metrics>
 
 using namespace osgEarth;
 
 REGISTER_OSGEARTH_LAYER(annotations, AnnotationLayer);
 
+namespace
+{
+    // Root group that records the time spent culling annotations.
+    struct AnnotationRoot : public osg::Group
+    {
+        void traverse(osg::NodeVisitor& nv)
+        {
+            if (nv.getVisitorType() == nv.CULL_VISITOR)
+            {
+                OE_METRICS_TIMED_SCOPE("frame.cull.annotations_us");
+                osg::Group::traverse(nv);
+            }
+            else
+            {
+                osg::Group::traverse(nv);
+            }
+        }
+    };
+}
+
 //...................................................................
 
 Config
@@ -45,7 +66,7 @@ AnnotationLayer::init()
 {
     VisibleLayer::init();
 
-    _root = new osg::Group();
+    _root = new AnnotationRoot();
 
     deserialize();
 
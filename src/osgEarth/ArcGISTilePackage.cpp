@@ -34,16 +34,61 @@ using namespace osgEarth::ArcGIS;
 
 namespace osgEarth { namespace ArcGIS
 {
-    unsigned int computeOffset(const std::vector<char>& buffer)
+    // Reads an unsigned little-endian integer of up to 8 bytes
+    uint64_t readOffset(const char* data, unsigned int numBytes)
     {
-        unsigned int sum = 0;
-        for (unsigned int i = 0; i < buffer.size(); i++) {
-            char v = buffer[i];
-            sum += ((unsigned int)v & 0xff) * pow(2.0, 8.0 * i);
+        uint64_t sum = 0;
+        for (unsigned int i = 0; i < numBytes; i++) {
+            sum |= ((uint64_t)data[i] & 0xff) << (8u * i);
         }
         return sum;
     }
 
+    // Read-only stream over a tile in the mapped bundle, so the image
+    // reader sees the bytes without copying them into a stringstream.
+    class TileStream : public std::istream
+    {
+    public:
+        TileStream(const char* data, size_t size) : std::istream(&_buf)
+        {
+            _buf.set(data, size);
+        }
+
+    private:
+        struct Buffer : public std::streambuf
+        {
+            void set(const char* data, size_t size)
+            {
+                char* begin = const_cast<char*>(data);
+                setg(begin, begin, begin + size);
+            }
+
+            pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+            {
+                if ((which & std::ios_base::in) == 0)
+                    return pos_type(off_type(-1));
+
+                char* target =
+                    dir == std::ios_base::beg ? eback() + off :
+                    dir == std::ios_base::cur ? gptr() + off :
+                    egptr() + off;
+
+                if (target < eback() || target > egptr())
+                    return pos_type(off_type(-1));
+
+                setg(eback(), target, egptr());
+                return pos_type(target - eback());
+            }
+
+            pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+            {
+                return seekoff(off_type(pos), std::ios_base::beg, which);
+            }
+        };
+
+        Buffer _buf;
+    };
+
     unsigned int hexFromString(const std::string& input)
     {
         unsigned int result;
@@ -93,13 +138,10 @@ BundleReader::BundleReader(const std::string& bundleFile, unsigned int bundleSiz
 void BundleReader::init()
 {
     std::string base = osgDB::getNameLessExtension(_bundleFile);
-    _indexFile = base + ".bundlx";
-
-    // Open the bundle
-    _in.open(_bundleFile.c_str(), std::ofstream::binary);
 
-    // Read the index
-    readIndex(_indexFile, _index);
+    // Map the bundle and its index
+    _bundle.open(_bundleFile);
+    _indexFile.open(base + ".bundlx");
 
     std::string baseName = osgDB::getSimpleFileName(base);
 
@@ -117,21 +159,19 @@ void BundleReader::init()
 */
 void BundleReader::readIndex(const std::string& filename, std::vector<int>& index)
 {
-    std::ifstream input(filename.c_str(), std::ifstream::binary);
-    char header[INDEX_HEADER_SIZE];
-    input.read(header, INDEX_HEADER_SIZE);
-    while (input.good()) {
-        std::vector<char> buffer;
-        buffer.resize(5);
-        if (input.read(&buffer[0], INDEX_SIZE))
-        {
-            int offset = computeOffset(buffer);
-            index.push_back(offset);
-        }
+    Util::MappedFile file;
+    if (!file.open(filename) || file.size() < INDEX_HEADER_SIZE)
+        return;
+
+    uint64_t count = (file.size() - INDEX_HEADER_SIZE) / INDEX_SIZE;
+    index.reserve(index.size() + count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        index.push_back((int)readOffset(file.data() + INDEX_HEADER_SIZE + i*INDEX_SIZE, INDEX_SIZE));
     }
 }
 
-osg::Image* BundleReader::readImage(const TileKey& key)
+osg::Image* BundleReader::readImage(const TileKey& key) const
 {
     // Figure out the index for the tilekey
     unsigned int row = key.getTileX() - _colOffset;
@@ -139,22 +179,22 @@ osg::Image* BundleReader::readImage(const TileKey& key)
     return readImage(i);
 }
 
-osg::Image* BundleReader::readImage(unsigned int index)
+osg::Image* BundleReader::readImage(unsigned int index) const
 {
-    if (index < 0 || index >= _index.size()) return 0;
-
-    _in.seekg(_index[index], std::ios::beg);
-    std::vector<char> sizeBuffer;
-    sizeBuffer.resize(4);
-    _in.read(&sizeBuffer[0], 4);
-    int size = computeOffset(sizeBuffer);
-    if (size > 0)
+    if (!valid() || _indexFile.size() < INDEX_HEADER_SIZE) return 0;
+
+    // Look up the tile's offset straight from the mapped index:
+    uint64_t count = (_indexFile.size() - INDEX_HEADER_SIZE) / INDEX_SIZE;
+    if (index >= count) return 0;
+
+    uint64_t offset = readOffset(_indexFile.data() + INDEX_HEADER_SIZE + (uint64_t)index*INDEX_SIZE, INDEX_SIZE);
+    if (offset + 4u > _bundle.size()) return 0;
+
+    uint64_t size = readOffset(_bundle.data() + offset, 4u);
+    if (size > 0 && offset + 4u + size <= _bundle.size())
     {
-        std::string image;
-        image.resize(size);
-        _in.read(&image[0], size);
-        std::stringstream ss(image);
-        return ImageUtils::readStream(ss, 0);
+        TileStream in(_bundle.data() + offset + 4u, (size_t)size);
+        return ImageUtils::readStream(in, 0);
     }
 
     return 0;
@@ -188,6 +228,7 @@ ArcGISTilePackageImageLayer::init()
     ImageLayer::init();
     _bundleSize = 128u;
     _extension = "png";
+    _bundles.setMaxSize(64u);
 }
 
 ArcGISTilePackageImageLayer::~ArcGISTilePackageImageLayer()
@@ -224,6 +265,14 @@ ArcGISTilePackageImageLayer::openImplementation()
     return Status::NoError;
 }
 
+Status
+ArcGISTilePackageImageLayer::closeImplementation()
+{
+    Threading::ScopedMutexLock lock(_bundlesMutex);
+    _bundles.clear();
+    return ImageLayer::closeImplementation();
+}
+
 GeoImage
 ArcGISTilePackageImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
 {
@@ -242,10 +291,32 @@ ArcGISTilePackageImageLayer::createImageImplementation(const TileKey& key, Progr
     buf << ".bundle";
 
     std::string bundleFile = buf.str();
-    if (osgDB::fileExists(bundleFile))
+
+    // Bundles stay open (and missing ones stay missing) in an LRU, so
+    // reading a tile doesn't touch the file system at all:
+    osg::ref_ptr<BundleReader> reader;
+    {
+        Threading::ScopedMutexLock lock(_bundlesMutex);
+        BundleCache::Record record;
+        if (_bundles.get(bundleFile, record))
+        {
+            reader = record.value();
+        }
+        else
+        {
+            if (osgDB::fileExists(bundleFile))
+            {
+                reader = new BundleReader(bundleFile, _bundleSize);
+                if (!reader->valid())
+                    reader = 0L;
+            }
+            _bundles.insert(bundleFile, reader);
+        }
+    }
+
+    if (reader.valid())
     {
-        BundleReader reader(bundleFile, _bundleSize);
-        osg::Image* result = reader.readImage(key);
+        osg::Image* result = reader->readImage(key);
         return GeoImage(result, key.getExtent());
     }
 
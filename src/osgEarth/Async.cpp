@@ -22,10 +22,14 @@
 #include <osgEarth/NodeUtils>
 
 #include <osg/CullStack>
+#include <osg/Geometry>
+#include <osg/Texture>
 #include <osgDB/ReaderWriter>
 #include <osgDB/FileNameUtils>
 #include <osgDB/Registry>
 
+#include <algorithm>
+
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
@@ -35,6 +39,10 @@ using namespace osgEarth::Util;
 
 #define ASYNC_PSEUDOLOADER_EXT "osgearth_async_node"
 #define TAG_ASYNC_CALLBACK     "osgearth_async_callback"
+#define TAG_ASYNC_PROGRESS     "osgearth_async_progress"
+
+// number of frames a node can go unseen (or unrequested) before it expires
+#define ASYNC_EXPIRY_FRAMES    2
 
 //........................................................................
 
@@ -57,6 +65,9 @@ namespace osgEarth { namespace Util
            : _lastTimeWeMet(0.0)
            , _minValue(0.0f)
            , _maxValue(0.0f)
+           , _lastFrameSeen(0u)
+           , _lastFrameAsked(0u)
+           , _bytes(0u)
         {
             _needy = true;
             _id = ++_idgen;
@@ -74,9 +85,13 @@ namespace osgEarth { namespace Util
         float _minValue;
         float _maxValue;
         float _priority;
+        unsigned _lastFrameSeen;
+        unsigned _lastFrameAsked;
+        size_t _bytes;
         osg::BoundingSphere _bound;
         osg::ref_ptr<osg::Referenced> _internalHandle;
         osg::ref_ptr<osgDB::Options> _options;
+        osg::ref_ptr<ProgressCallback> _progress; // options only hold an observer
 
         //! Use the node's bound if we have it, or a preset bound if we don't.
         osg::BoundingSphere computeBound() const
@@ -114,6 +129,105 @@ namespace osgEarth { namespace Util
     };
 
     OpenThreads::Atomic AsyncNode::_idgen;
+
+    // Progress callback handed to the AsyncFunction. It reports canceled
+    // once the node leaves the graph or stops being requested, so that
+    // the pager does not waste time on content nobody is waiting for.
+    class AsyncProgress : public ProgressCallback
+    {
+    public:
+        AsyncProgress(AsyncNode* node) : _node(node) { }
+
+        bool isCanceled()
+        {
+            if (_canceled)
+                return true;
+
+            osg::ref_ptr<AsyncNode> node;
+            if (!_node.lock(node) || node->getNumParents() == 0)
+                return true;
+
+            AsyncMemoryManager* mm = Registry::instance()->getAsyncMemoryManager();
+            if (mm)
+            {
+                int age = (int)(mm->getFrameNumber() - node->_lastFrameAsked);
+                if (age > ASYNC_EXPIRY_FRAMES)
+                    return true;
+            }
+            return false;
+        }
+
+        osg::observer_ptr<AsyncNode> _node;
+    };
+
+    // Estimates the memory used by loaded content: geometry arrays,
+    // primitive sets and texture images (each counted once).
+    struct ContentSizeVisitor : public osg::NodeVisitor
+    {
+        size_t _bytes;
+        std::set<const osg::Object*> _counted;
+
+        ContentSizeVisitor() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _bytes(0u)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Node& node)
+        {
+            applyStateSet(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            applyStateSet(drawable.getStateSet());
+
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom)
+            {
+                osg::Geometry::ArrayList arrays;
+                geom->getArrayList(arrays);
+                for (unsigned i = 0; i < arrays.size(); ++i)
+                {
+                    if (arrays[i].valid() && _counted.insert(arrays[i].get()).second)
+                        _bytes += arrays[i]->getTotalDataSize();
+                }
+                for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                {
+                    const osg::DrawElements* de = geom->getPrimitiveSet(i)->getDrawElements();
+                    if (de && _counted.insert(de).second)
+                        _bytes += de->getTotalDataSize();
+                }
+            }
+        }
+
+        void applyStateSet(osg::StateSet* stateSet)
+        {
+            if (!stateSet)
+                return;
+
+            for (unsigned unit = 0; unit < stateSet->getTextureAttributeList().size(); ++unit)
+            {
+                osg::Texture* tex = dynamic_cast<osg::Texture*>(
+                    stateSet->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+
+                if (tex && _counted.insert(tex).second)
+                {
+                    for (unsigned i = 0; i < tex->getNumImages(); ++i)
+                    {
+                        if (tex->getImage(i))
+                            _bytes += tex->getImage(i)->getTotalSizeInBytesIncludingMipmaps();
+                    }
+                }
+            }
+        }
+    };
+
+    // expiration order under a memory budget
+    bool isLessRecentlySeen(const AsyncNode* lhs, const AsyncNode* rhs)
+    {
+        return lhs->_lastFrameSeen < rhs->_lastFrameSeen;
+    }
 } }
 
 //........................................................................
@@ -174,6 +288,8 @@ AsyncLOD::addChild(AsyncFunction* callback, float minValue, float maxValue)
     child->_lastTimeWeMet = DBL_MAX;
     child->_options = Registry::instance()->cloneOrCreateOptions(_readOptions.get());
     OptionsData<AsyncFunction>::set(child->_options.get(), TAG_ASYNC_CALLBACK, callback);
+    child->_progress = new AsyncProgress(child);
+    OptionsData<ProgressCallback>::set(child->_options.get(), TAG_ASYNC_PROGRESS, child->_progress.get());
     
     _mutex.lock();
     _lookup[child->_id] = child;
@@ -226,6 +342,11 @@ AsyncLOD::addChild(osg::Node* node)
 
             // node is no longer needy. Yay!
             async->_needy = false;
+
+            // account for the new content so it can be recycled later
+            AsyncMemoryManager* mm = Registry::instance()->getAsyncMemoryManager();
+            if (mm && async->getNumChildren() > 0)
+                mm->loaded(async);
         }
         _mutex.unlock();
         return true;
@@ -273,8 +394,9 @@ AsyncLOD::traverse(osg::NodeVisitor& nv)
             AsyncNode* child = dynamic_cast<AsyncNode*>(getChild(i));
             if (child)
             {
-                // is the child visible?
-                if (isVisible(*child, nv))
+                // is the child visible? (also refreshes its load priority,
+                // so pending requests re-sort as the camera moves)
+                if (isVisibleWithPriority(*child, nv, child->_priority))
                 {
                     // if so, update its timestamp
                     child->_lastTimeWeMet = nv.getFrameStamp()->getReferenceTime();
@@ -342,16 +464,14 @@ AsyncLOD::traverse(osg::NodeVisitor& nv)
 void
 AsyncLOD::ask(AsyncNode& child, osg::NodeVisitor& nv)
 {
-    float priority = 
-        _mode == MODE_GEOMETRIC_ERROR? child._maxValue :
-        _mode == MODE_PIXEL_SIZE? child._maxValue :
-        _mode == MODE_RANGE? 1.0f/child._maxValue :
-        1.0f;
+    // keeps the request from being canceled (see AsyncProgress)
+    child._lastFrameAsked = nv.getFrameStamp()->getFrameNumber();
 
+    // re-issuing the request every frame lets the pager pick up the new priority
     nv.getDatabaseRequestHandler()->requestNodeFile(
         child._pseudoloaderFilename,        // pseudo name that will invoke AsyncNodePseudoLoader
         _nodePath,                          // parent of node to "add" when request completes
-        priority,                           // priority (higher loads sooner)
+        child._priority,                    // priority (higher loads sooner)
         nv.getFrameStamp(),                 // frame stamp
         child._internalHandle,              // associates the request with a unique ID
         child._options.get()                // osgDB plugin options
@@ -399,9 +519,52 @@ AsyncLOD::isVisible(const AsyncNode& async, osg::NodeVisitor& nv) const
     return false;
 }
 
+bool
+AsyncLOD::isVisibleWithPriority(const AsyncNode& async, osg::NodeVisitor& nv, float& out_priority) const
+{
+    if (!isVisible(async, nv))
+        return false;
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,6)
+    osg::CullStack* cullStack = nv.asCullStack();
+#else
+    osg::CullStack* cullStack = dynamic_cast<osg::CullStack*>(&nv);
+#endif
+
+    if (_mode == MODE_GEOMETRIC_ERROR || _mode == MODE_PIXEL_SIZE)
+    {
+        if (cullStack && cullStack->getLODScale() > 0)
+        {
+            float sizeInPixels = cullStack->clampedPixelSize(getBound()) / cullStack->getLODScale();
+            if (_mode == MODE_GEOMETRIC_ERROR)
+            {
+                // the further below the error threshold, the sooner we want it
+                float sizeInMeters = getBound().radius() * 2.0;
+                float metersPerPixel = sizeInPixels > 0.0 ? sizeInMeters / sizeInPixels : 0.0f;
+                out_priority = async._maxValue / osg::maximum(metersPerPixel, 1e-6f);
+            }
+            else
+            {
+                out_priority = sizeInPixels;
+            }
+        }
+    }
+
+    else if (_mode == MODE_RANGE)
+    {
+        float range = nv.getDistanceToViewPoint(getBound().center(), true);
+        out_priority = async._maxValue / osg::maximum(range, 1.0f);
+    }
+
+    return true;
+}
+
 //........................................................................
 
-AsyncMemoryManager::AsyncMemoryManager()
+AsyncMemoryManager::AsyncMemoryManager() :
+_bytes(0u),
+_maxBytes(0u),
+_frame(0u)
 {
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
 }
@@ -411,14 +574,44 @@ AsyncMemoryManager::~AsyncMemoryManager()
     //nop
 }
 
+void
+AsyncMemoryManager::setMaxBytes(size_t value)
+{
+    _maxBytes = value;
+}
+
+size_t
+AsyncMemoryManager::getMaxBytes() const
+{
+    return _maxBytes;
+}
+
+size_t
+AsyncMemoryManager::getBytes() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _bytes;
+}
+
 void
 AsyncMemoryManager::push(AsyncNode* node, osg::NodeVisitor& nv)
 {
-    _mutex.lock();
-    _alive.insert(node);
-    _orphaned.erase(node);
-    _dead.erase(node);
-    _mutex.unlock();
+    if (nv.getFrameStamp())
+        node->_lastFrameSeen = nv.getFrameStamp()->getFrameNumber();
+}
+
+void
+AsyncMemoryManager::loaded(AsyncNode* node)
+{
+    ContentSizeVisitor sizer;
+    node->accept(sizer);
+
+    Threading::ScopedMutexLock lock(_mutex);
+    if (_resident.insert(node).second == false)
+        _bytes -= node->_bytes;
+    node->_bytes = sizer._bytes;
+    node->_lastFrameSeen = _frame;
+    _bytes += node->_bytes;
 }
 
 void
@@ -440,22 +633,48 @@ AsyncMemoryManager::traverse(osg::NodeVisitor& nv)
 void
 AsyncMemoryManager::cycle(osg::NodeVisitor& nv)
 {
-    _mutex.lock();
-    if (!_dead.empty())
+    if (nv.getFrameStamp())
+        _frame = nv.getFrameStamp()->getFrameNumber();
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // collect the content that has gone unseen long enough to expire,
+    // and forget about content removed from the graph by other means.
+    std::vector<AsyncNode*> expired;
+    for (RefNodeSet::iterator i = _resident.begin(); i != _resident.end(); )
     {
-        unsigned count = _dead.size();
-        for (RefNodeSet::iterator i = _dead.begin();
-            i != _dead.end();
-            ++i)
+        AsyncNode* node = i->get();
+        if (node->getNumParents() == 0 || node->getNumChildren() == 0)
         {
-            AsyncNode* node = i->get();
-            node->clear();
+            _bytes -= node->_bytes;
+            node->_bytes = 0u;
+            _resident.erase(i++);
+        }
+        else
+        {
+            if ((int)(_frame - node->_lastFrameSeen) > ASYNC_EXPIRY_FRAMES)
+                expired.push_back(node);
+            ++i;
         }
-        _dead.clear();
     }
-    _orphaned.swap(_dead);
-    _alive.swap(_orphaned);
-    _mutex.unlock();
+
+    // under a budget, keep expired content around until we need the room
+    if (_maxBytes > 0u)
+    {
+        std::sort(expired.begin(), expired.end(), isLessRecentlySeen);
+    }
+
+    for (std::vector<AsyncNode*>::iterator i = expired.begin(); i != expired.end(); ++i)
+    {
+        if (_maxBytes > 0u && _bytes <= _maxBytes)
+            break;
+
+        AsyncNode* node = *i;
+        _bytes -= node->_bytes;
+        node->_bytes = 0u;
+        node->clear();
+        _resident.erase(node);
+    }
 }
 
 //........................................................................
@@ -476,9 +695,17 @@ namespace osgEarth { namespace Util
                 return ReadResult::FILE_NOT_FOUND;
             }
 
+            osg::ref_ptr<ProgressCallback> progress = OptionsData<ProgressCallback>::get(options, TAG_ASYNC_PROGRESS);
+            if (progress.valid() && progress->isCanceled())
+                return ReadResult::FILE_NOT_HANDLED;
+
             unsigned id = atoi(osgDB::getNameLessExtension(location).c_str());
-            osgEarth::ReadResult r = (*callback.get())();
-            //TODO: record error, use Progress...
+            osgEarth::ReadResult r = (*callback.get())(progress.get());
+
+            // leave the node needy so it can be requested again later
+            if (progress.valid() && progress->isCanceled())
+                return ReadResult::FILE_NOT_HANDLED;
+
             osg::ref_ptr<AsyncResult> result = new AsyncResult(r.releaseNode());
             if (result.valid())result->_requestId = id;
             return ReadResult(result.release());
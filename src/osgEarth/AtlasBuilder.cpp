@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/AtlasBuilder>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/JobArena>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
@@ -56,6 +58,258 @@ namespace
             return true;
         }
     };
+
+    /** Runs work(i) for i in [0..count), sharing the items with the job arena. */
+    struct WorkGroup : public osg::Referenced
+    {
+        WorkGroup(unsigned count) : _count(count), _next(0u), _remaining(count) { }
+
+        virtual void work(unsigned i) =0;
+
+        void run()
+        {
+            for(;;)
+            {
+                unsigned n = (++_next) - 1u;
+                if (n >= _count)
+                    break;
+
+                work(n);
+
+                if (--_remaining == 0u)
+                    _done.set();
+            }
+        }
+
+        void runAndWait()
+        {
+            if (_count == 0u)
+                return;
+
+            JobArena* arena = JobArena::get("oe.atlas");
+            unsigned numHelpers = osg::minimum(arena->getConcurrency(), _count - 1u);
+            for (unsigned i = 0; i < numHelpers; ++i)
+            {
+                arena->dispatch(new WorkTask(this));
+            }
+            run();
+            _done.wait();
+        }
+
+        struct WorkTask : public TaskRequest
+        {
+            WorkTask(WorkGroup* group) : _group(group) { }
+
+            void operator()(ProgressCallback*)
+            {
+                _group->run();
+            }
+
+            osg::ref_ptr<WorkGroup> _group;
+        };
+
+        unsigned _count;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+    };
+
+    /** Loads a skin's image and its auxiliary images. */
+    struct LoadGroup : public WorkGroup
+    {
+        struct Loaded
+        {
+            osg::ref_ptr<osg::Image> _image;
+            std::vector<osg::ref_ptr<osg::Image> > _aux;
+        };
+
+        LoadGroup(const SkinResourceVector& skins,
+                  const std::vector<std::string>& auxPatterns,
+                  const std::vector<osg::Vec4f>& auxDefaults,
+                  const osgDB::Options* options) :
+            WorkGroup(skins.size()),
+            _skins(skins), _auxPatterns(auxPatterns), _auxDefaults(auxDefaults), _options(options),
+            _loaded(skins.size()) { }
+
+        void work(unsigned i)
+        {
+            SkinResource* skin = _skins[i].get();
+            Loaded& loaded = _loaded[i];
+
+            osg::ref_ptr<osg::Image> image = skin->createImage( _options );
+            if ( !image.valid() )
+                return;
+
+            OE_INFO << LC << "Loaded skin file: " << skin->imageURI()->full() << std::endl;
+
+            // an atlas of atlases is an error; leave it for the caller to report.
+            loaded._image = image.get();
+            if ( image->r() > 1 )
+                return;
+
+            // normalize to RGBA8
+            image = ImageUtils::convertToRGBA8(image.get());
+            loaded._image = image.get();
+
+            // for each aux pattern, either load and resize the aux image or create
+            // an empty placeholder.
+            for(unsigned a=0; a<_auxPatterns.size(); ++a)
+            {
+                const std::string& pattern      = _auxPatterns[a];
+                const osg::Vec4f&  defaultValue = _auxDefaults[a];
+
+                std::string base = osgDB::getNameLessExtension(skin->imageURI()->full());
+                std::string ext  = osgDB::getFileExtension(skin->imageURI()->base());
+                std::string auxFile = base + "_" + pattern + "." + ext;
+
+                // read in the auxiliary image:
+                osg::ref_ptr<osg::Image> auxImage = osgDB::readRefImageFile( auxFile, _options );
+
+                // if that didn't work, try alternate extensions:
+                const char* alternateExtensions[3] = {"png", "jpg", "osgb"};
+                for(int b = 0; b < 3 && !auxImage.valid(); ++b)
+                {
+                    auxFile = base + "_" + pattern + "." + alternateExtensions[b];
+                    auxImage = osgDB::readRefImageFile( auxFile, _options );
+                }
+
+                if ( auxImage.valid() )
+                {
+                    OE_INFO << LC << "  Found aux file: " << auxFile << std::endl;
+                    auxImage = ImageUtils::convertToRGBA8(auxImage.get());
+                }
+                else
+                {
+                    // failing that, create an empty one as a placeholder.
+                    auxImage = new osg::Image();
+                    auxImage->allocateImage(image->s(), image->t(), 1, GL_RGBA, GL_UNSIGNED_BYTE);
+                    ImageUtils::PixelVisitor<SetDefaults> filler;
+                    filler._value = defaultValue;
+                    filler.accept(auxImage.get());
+                }
+
+                if ( auxImage->s() != image->s() || auxImage->t() != image->t() )
+                {
+                    osg::ref_ptr<osg::Image> temp;
+                    osgEarth::ImageUtils::resizeImage(auxImage.get(), image->s(), image->t(), temp);
+                    auxImage = temp.get();
+                    OE_INFO << "  ...resized " << auxFile << " to match atlas size" << std::endl;
+                }
+
+                if ( !ImageUtils::sameFormat(image.get(), auxImage.get()) ) 
+                {
+                    auxImage = ImageUtils::convertToRGBA8(auxImage.get());
+                }
+
+                loaded._aux.push_back(auxImage.get());
+            }
+        }
+
+        const SkinResourceVector& _skins;
+        const std::vector<std::string>& _auxPatterns;
+        const std::vector<osg::Vec4f>& _auxDefaults;
+        const osgDB::Options* _options;
+        std::vector<Loaded> _loaded;
+    };
+
+    /** Copies each atlas image into a full-size layer, and optionally compresses it. */
+    struct LayerGroup : public WorkGroup
+    {
+        LayerGroup(const TextureAtlasBuilderEx::AtlasListEx& atlasList, unsigned s, unsigned t, GLenum format, bool compress) :
+            WorkGroup(atlasList.size()),
+            _atlasList(atlasList), _s(s), _t(t), _format(format), _compress(compress),
+            _layers(atlasList.size()) { }
+
+        void work(unsigned r)
+        {
+            const osg::Image* atlasImage = _atlasList[r]->_image.get();
+
+            osg::ref_ptr<osg::Image> layer = new osg::Image();
+            layer->allocateImage(_s, _t, 1, _format, GL_UNSIGNED_BYTE);
+            memset(layer->data(), 0, layer->getTotalSizeInBytes());
+
+            if (atlasImage->getPixelFormat() == _format &&
+                atlasImage->getDataType() == GL_UNSIGNED_BYTE)
+            {
+                // same layout: copy whole rows.
+                unsigned rowBytes = atlasImage->s() * (atlasImage->getPixelSizeInBits() / 8u);
+                for(int t=0; t<atlasImage->t(); ++t)
+                    memcpy(layer->data(0, t), atlasImage->data(0, t), rowBytes);
+            }
+            else
+            {
+                ImageUtils::PixelReader read (atlasImage);
+                ImageUtils::PixelWriter write(layer.get());
+
+                for(int s=0; s<atlasImage->s(); ++s)
+                    for(int t=0; t<atlasImage->t(); ++t)
+                        write(read(s, t, 0), s, t, 0);
+            }
+
+            if (_compress)
+            {
+                ImageUtils::compressImage(layer.get(), true);
+            }
+
+            _layers[r] = layer.get();
+        }
+
+        // Stacks the layers into one multi-layer image, level by level, so
+        // each mipmap level holds that level of every layer.
+        osg::Image* assemble() const
+        {
+            const osg::Image* first = _layers.front().get();
+            for(unsigned r=1; r<_layers.size(); ++r)
+            {
+                const osg::Image* layer = _layers[r].get();
+                if (layer->getPixelFormat() != first->getPixelFormat() ||
+                    layer->getNumMipmapLevels() != first->getNumMipmapLevels() ||
+                    layer->getTotalSizeInBytesIncludingMipmaps() != first->getTotalSizeInBytesIncludingMipmaps())
+                {
+                    return 0L;
+                }
+            }
+
+            unsigned numLevels = first->getNumMipmapLevels();
+            unsigned layerBytes = first->getTotalSizeInBytesIncludingMipmaps();
+            unsigned char* data = new unsigned char[layerBytes * _layers.size()];
+            unsigned char* ptr = data;
+            osg::Image::MipmapDataType offsets;
+
+            for(unsigned m=0; m<numLevels; ++m)
+            {
+                unsigned begin = first->getMipmapOffset(m);
+                unsigned end = m+1 < numLevels ? first->getMipmapOffset(m+1) : layerBytes;
+
+                if (m > 0)
+                    offsets.push_back((unsigned)(ptr - data));
+
+                for(unsigned r=0; r<_layers.size(); ++r)
+                {
+                    memcpy(ptr, _layers[r]->data() + begin, end - begin);
+                    ptr += end - begin;
+                }
+            }
+
+            osg::Image* result = new osg::Image();
+            result->setImage(
+                first->s(), first->t(), _layers.size(),
+                first->getInternalTextureFormat(),
+                first->getPixelFormat(),
+                first->getDataType(),
+                data,
+                osg::Image::USE_NEW_DELETE,
+                first->getPacking());
+            result->setMipmapLevels(offsets);
+            return result;
+        }
+
+        const TextureAtlasBuilderEx::AtlasListEx& _atlasList;
+        unsigned _s, _t;
+        GLenum _format;
+        bool _compress;
+        std::vector<osg::ref_ptr<osg::Image> > _layers;
+    };
 }
 
 
@@ -64,7 +318,8 @@ _options( options ),
 _width  ( 1024 ),
 _height ( 1024 ),
 _debug  ( false ),
-_rgb    ( false )
+_rgb    ( false ),
+_compress( false )
 {
     //nop
     if (::getenv("OSGEARTH_ATLAS_DEBUG"))
@@ -118,26 +373,34 @@ AtlasBuilder::build(const ResourceLibrary* inputLib,
     typedef std::map<TextureAtlasBuilderEx::SourceEx*, SkinResource*> SourceSkinMap;
     SourceSkinMap sourceSkins;
 
-    // fetch all the skins from the catalog:
+    // fetch all the skins from the catalog, skipping
+    // skins that say "no atlas please":
     SkinResourceVector skins;
     out._lib->getSkins( skins );
+
+    SkinResourceVector atlasSkins;
     for(SkinResourceVector::iterator i = skins.begin(); i != skins.end(); ++i)
     {
-        SkinResource* skin = i->get();
-
-        // skip skins that say "no atlas please"
-        if ( skin->atlasHint() == false )
+        if ( i->get()->atlasHint() == true )
         {
-            continue;
+            atlasSkins.push_back( i->get() );
         }
+    }
 
-        osg::ref_ptr<osg::Image> image = skin->createImage( _options.get() );
-        if ( image.valid() )
-        {
-            OE_INFO << LC << "Loaded skin file: " << skin->imageURI()->full() << std::endl;
+    // load and prepare all the images in parallel:
+    osg::ref_ptr<LoadGroup> loader = new LoadGroup(atlasSkins, _auxPatterns, _auxDefaults, _options.get());
+    loader->runAndWait();
+
+    // add them to the atlasers in catalog order:
+    for(unsigned n = 0; n < atlasSkins.size(); ++n)
+    {
+        SkinResource* skin = atlasSkins[n].get();
+        LoadGroup::Loaded& loaded = loader->_loaded[n];
 
+        if ( loaded._image.valid() )
+        {
             // ensure we're not trying to atlas an atlas.
-            if ( image->r() > 1 )
+            if ( loaded._image->r() > 1 )
             {
                 OE_WARN << LC <<
                     "Found an image with more than one layer. You cannot create an "
@@ -145,64 +408,13 @@ AtlasBuilder::build(const ResourceLibrary* inputLib,
                 return false;
             }
 
-            // normalize to RGBA8
-            image = ImageUtils::convertToRGBA8(image.get());
-
-            maintab->addSource( image.get() );
+            maintab->addSource( loaded._image.get() );
 
-            // for each aux pattern, either load and resize the aux image or create
-            // an empty placeholder.
             TABs::iterator tab = maintab;
             ++tab;
-            for(int a=0; a<_auxPatterns.size(); ++a, ++tab)
+            for(unsigned a=0; a<loaded._aux.size(); ++a, ++tab)
             {
-                const std::string& pattern      = _auxPatterns[a];
-                const osg::Vec4f&  defaultValue = _auxDefaults[a];
-
-                std::string base = osgDB::getNameLessExtension(skin->imageURI()->full());
-                std::string ext  = osgDB::getFileExtension(skin->imageURI()->base());
-                std::string auxFile = base + "_" + pattern + "." + ext;
-
-                // read in the auxiliary image:
-                osg::ref_ptr<osg::Image> auxImage = osgDB::readRefImageFile( auxFile, _options.get() );
-
-                // if that didn't work, try alternate extensions:
-                const char* alternateExtensions[3] = {"png", "jpg", "osgb"};
-                for(int b = 0; b < 3 && !auxImage.valid(); ++b)
-                {
-                    auxFile = base + "_" + pattern + "." + alternateExtensions[b];
-                    auxImage = osgDB::readRefImageFile( auxFile, _options.get() );
-                }
-
-                if ( auxImage.valid() )
-                {
-                    OE_INFO << LC << "  Found aux file: " << auxFile << std::endl;
-                    auxImage = ImageUtils::convertToRGBA8(auxImage.get());
-                }
-                else
-                {
-                    // failing that, create an empty one as a placeholder.
-                    auxImage = new osg::Image();
-                    auxImage->allocateImage(image->s(), image->t(), 1, GL_RGBA, GL_UNSIGNED_BYTE);
-                    ImageUtils::PixelVisitor<SetDefaults> filler;
-                    filler._value = defaultValue;
-                    filler.accept(auxImage.get());
-                }
-
-                if ( auxImage->s() != image->s() || auxImage->t() != image->t() )
-                {
-                    osg::ref_ptr<osg::Image> temp;
-                    osgEarth::ImageUtils::resizeImage(auxImage.get(), image->s(), image->t(), temp);
-                    auxImage = temp.get();
-                    OE_INFO << "  ...resized " << auxFile << " to match atlas size" << std::endl;
-                }
-
-                if ( !ImageUtils::sameFormat(image.get(), auxImage.get()) ) 
-                {
-                    auxImage = ImageUtils::convertToRGBA8(auxImage.get());
-                }
-
-                tab->addSource( auxImage.get() );
+                tab->addSource( loaded._aux[a].get() );
             }
 
             // re-write the URI to point at our new atlas:
@@ -210,8 +422,6 @@ AtlasBuilder::build(const ResourceLibrary* inputLib,
 
             // save the associate so we can come back later:
             sourceSkins[maintab->getSourceList().back().get()] = skin;
-
-            //OE_INFO << LC << "Added skin: \"" << skin->name() << "\"" << std::endl;
         }
         else
         {
@@ -260,40 +470,42 @@ AtlasBuilder::build(const ResourceLibrary* inputLib,
     {
         const TextureAtlasBuilderEx::AtlasListEx& atlasList = tab->getAtlasList();
 
-        // create the target multi-layer image.
-        osg::Image* imageArray = new osg::Image();
-
-        imageArray->allocateImage(
-            maxS,
-            maxT,
-            atlasList.size(),
-            _rgb ? GL_RGB : GL_RGBA,
-            GL_UNSIGNED_BYTE);
-
-        // initialize to all zeros
-        memset(imageArray->data(), 0, imageArray->getTotalSizeInBytesIncludingMipmaps());
-
-        // combine each of the atlas images into the corresponding "r" slot of the composed image:
-        for(int r=0; r<(int)atlasList.size(); ++r)
+        if ( _debug )
         {
-            // copy the atlas image into the image array:
-            osg::Image* atlasImage = atlasList[r]->_image.get();
-
-            if ( _debug )
+            for(int r=0; r<(int)atlasList.size(); ++r)
             {
                 std::string name = Stringify() << "image_" << (int)(tab-tabs.begin()) << "_" << r << ".png";
-                osgDB::writeImageFile(*atlasImage, name);
+                osgDB::writeImageFile(*atlasList[r]->_image.get(), name);
             }
+        }
 
-            ImageUtils::PixelReader read (atlasImage);
-            ImageUtils::PixelWriter write(imageArray);
+        // copy (and maybe compress) each of the atlas images into a layer,
+        // then combine the layers into the "r" slots of the composed image:
+        osg::ref_ptr<LayerGroup> layers = new LayerGroup(atlasList, maxS, maxT, _rgb ? GL_RGB : GL_RGBA, _compress);
+        layers->runAndWait();
 
-            for(int s=0; s<atlasImage->s(); ++s)
-                for(int t=0; t<atlasImage->t(); ++t)
-                    write(read(s, t, 0), s, t, r);
+        osg::ref_ptr<osg::Image> imageArray = atlasList.empty() ? 0L : layers->assemble();
+
+        if ( !imageArray.valid() && _compress && !atlasList.empty() )
+        {
+            OE_WARN << LC << "Failed to compress atlas layers; writing them uncompressed" << std::endl;
+            layers = new LayerGroup(atlasList, maxS, maxT, _rgb ? GL_RGB : GL_RGBA, false);
+            layers->runAndWait();
+            imageArray = layers->assemble();
+        }
+        else if ( imageArray.valid() && _compress && !ImageUtils::isCompressed(imageArray.get()) )
+        {
+            OE_WARN << LC << "No image processor available to compress the atlas; writing it uncompressed" << std::endl;
+        }
+
+        if ( !imageArray.valid() )
+        {
+            imageArray = new osg::Image();
+            imageArray->allocateImage(maxS, maxT, 1, _rgb ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE);
+            memset(imageArray->data(), 0, imageArray->getTotalSizeInBytes());
         }
 
-        out._images.push_back(imageArray);
+        out._images.push_back(imageArray.get());
     }
 
     
@@ -20,6 +20,7 @@
 #include <osgEarth/MapNode>
 #include <osgEarth/Registry>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/ReversedDepthBuffer>
 
 #define LC "[AutoClip] "
 
@@ -30,9 +31,9 @@ namespace
 {
     struct CustomProjClamper : public osg::CullSettings::ClampProjectionMatrixCallback
     {
-        double _minNear, _maxFar, _nearFarRatio;
+        double _minNear, _maxFar, _nearFarRatio, _nearPlaneFloor;
 
-        CustomProjClamper() : _minNear( -DBL_MAX ), _maxFar( DBL_MAX ), _nearFarRatio( 0.00015 ) { }
+        CustomProjClamper() : _minNear( -DBL_MAX ), _maxFar( DBL_MAX ), _nearFarRatio( 0.00015 ), _nearPlaneFloor( 1.0 ) { }
 
         // NOTE: this code is just copied from CullVisitor. I could not find a way to simply 
         // call into it from a custom callback..
@@ -97,8 +98,8 @@ namespace
                 if (desired_znear<min_near_plane) desired_znear=min_near_plane;
                 //if (desired_znear > min_near_plane) desired_znear=min_near_plane;
 
-                if ( desired_znear < 1.0 )
-                    desired_znear = 1.0;
+                if ( desired_znear < _nearPlaneFloor )
+                    desired_znear = _nearPlaneFloor;
 
 #if 0
                 OE_INFO << std::fixed
@@ -254,8 +255,19 @@ AutoClipPlaneCullCallback::operator()( osg::Node* node, osg::NodeVisitor* nv )
                     //OE_NOTICE << "HAE=" << hae <<  std::endl;
                 }
 
-                // ramp a new near/far ratio based on the HAE.
-                c->_nearFarRatio = Utils::remap( hae, 0.0, _haeThreshold, _minNearFarRatio, _maxNearFarRatio );
+                if ( ReversedDepthBuffer::isInstalled(cam) )
+                {
+                    // reversed-Z precision does not depend on the near/far ratio,
+                    // so let the near plane come in close.
+                    c->_nearFarRatio = cam->getNearFarRatio();
+                    c->_nearPlaneFloor = 0.1;
+                }
+                else
+                {
+                    // ramp a new near/far ratio based on the HAE.
+                    c->_nearFarRatio = Utils::remap( hae, 0.0, _haeThreshold, _minNearFarRatio, _maxNearFarRatio );
+                    c->_nearPlaneFloor = 1.0;
+                }
             }
 
 #if 0
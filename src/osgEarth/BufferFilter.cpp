@@ -84,34 +84,41 @@ BufferFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    //OE_NOTICE << "Buffer: input = " << input.size() << " features" << std::endl;
-    for( FeatureList::iterator i = input.begin(); i != input.end(); )
+    BufferParameters params;
+    
+    params._capStyle =
+            _capStyle == Stroke::LINECAP_ROUND  ? BufferParameters::CAP_ROUND :
+            _capStyle == Stroke::LINECAP_SQUARE ? BufferParameters::CAP_SQUARE :
+            _capStyle == Stroke::LINECAP_FLAT   ? BufferParameters::CAP_FLAT :
+                                                  BufferParameters::CAP_SQUARE;
+
+    params._cornerSegs = _numQuadSegs;
+
+    // buffer the whole list as one batch so the GEOS setup happens once:
+    GeometryCollection geoms;
+    geoms.reserve( input.size() );
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
     {
-        Feature* feature = i->get();
-        if ( !feature || !feature->getGeometry() )
-            continue;
-
-        osg::ref_ptr<Geometry> output;
-
-        BufferParameters params;
-        
-        params._capStyle =
-                _capStyle == Stroke::LINECAP_ROUND  ? BufferParameters::CAP_ROUND :
-                _capStyle == Stroke::LINECAP_SQUARE ? BufferParameters::CAP_SQUARE :
-                _capStyle == Stroke::LINECAP_FLAT   ? BufferParameters::CAP_FLAT :
-                                                      BufferParameters::CAP_SQUARE;
+        geoms.push_back( i->valid() ? i->get()->getGeometry() : 0L );
+    }
 
-        params._cornerSegs = _numQuadSegs;
+    GeometryCollection output;
+    Geometry::buffer( geoms, _distance.value(), output, params );
 
-        if ( feature->getGeometry()->buffer( _distance.value(), output, params ) )
+    unsigned k = 0;
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++k )
+    {
+        Feature* feature = i->get();
+        if ( output[k].valid() )
         {
-            feature->setGeometry( output.get() );
+            feature->setGeometry( output[k].get() );
             ++i;
         }
         else
         {
+            if ( feature )
+                OE_DEBUG << LC << "feature " << feature->getFID() << " yielded no geometry" << std::endl;
             i = input.erase( i );
-            OE_DEBUG << LC << "feature " << feature->getFID() << " yielded no geometry" << std::endl;
         }
     }
 
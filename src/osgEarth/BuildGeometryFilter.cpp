@@ -34,6 +34,9 @@
 #include <osgEarth/PointDrawable>
 #include <osgEarth/StateSetCache>
 #include <osgEarth/Registry>
+#include <osgEarth/FeatureSource>
+#include <osgEarth/Containers>
+#include "sha1.hpp"
 #include <osg/Geode>
 #include <osg/Geometry>
 #include <osg/LineStipple>
@@ -95,10 +98,13 @@ namespace
 BuildGeometryFilter::BuildGeometryFilter( const Style& style ) :
 _style        ( style ),
 _maxAngle_deg ( 180.0 ),
+_maxError_m   ( 0.0 ),
+_parallelism  ( 1u ),
 _geoInterp    ( GEOINTERP_RHUMB_LINE ),
 _maxPolyTilingAngle_deg( 45.0f ),
 _optimizeVertexOrdering( false ),
-_maximumCreaseAngle( 0.0f )
+_maximumCreaseAngle( 0.0f ),
+_tessellationCache( false )
 {
     //nop
 }
@@ -192,7 +198,8 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
                 hats->push_back( i->z() );
 
             // build the geometry:
-            tileAndBuildPolygon(part, featureSRS, outputSRS, makeECEF, true, osgGeom.get(), w2l);
+            tileAndBuildPolygon(part, featureSRS, outputSRS, makeECEF, true,
+                getTessellationEngine(poly, useOSGTessellator() == true), osgGeom.get(), w2l);
 
             osg::Vec3Array* allPoints = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
             if (allPoints && allPoints->size() > 0)
@@ -216,6 +223,8 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
                     //OE_TEST << "Running mesh subdivider with threshold " << *_maxAngle_deg << std::endl;
 
                     MeshSubdivider ms( _world2local, _local2world );
+                    ms.setMaxError( *_maxError_m );
+                    ms.setParallelism( *_parallelism );
                     if ( input->geoInterp().isSet() )
                         ms.run( *osgGeom, threshold, *input->geoInterp() );
                     else
@@ -749,28 +758,142 @@ namespace
         }
     }
 
+    // Tessellated index buffers, by the hash of the input geometry.
+    typedef LRUCache<std::string, std::string> TessellationLRU;
+
+    TessellationLRU& tessellationLRU()
+    {
+        static TessellationLRU s_lru(true, 4096u);
+        return s_lru;
+    }
+
+    /**
+     * Makes a cache key for tessellating this geometry: a hash of the
+     * vertices, the outline primitive sets and the tessellation engine.
+     * Returns false if the geometry isn't something the cache handles.
+     */
+    bool makeTessellationKey(const osg::Geometry* geometry, Tessellator::Engine engine, std::string& key)
+    {
+        const osg::Vec3Array* verts = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+        if (!verts || verts->empty())
+            return false;
+
+        sha1 hash;
+        hash.add((char)('0' + (int)engine));
+        hash.add(verts->getDataPointer(), verts->getTotalDataSize());
+
+        for (unsigned i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+        {
+            const osg::DrawArrays* da = dynamic_cast<const osg::DrawArrays*>(geometry->getPrimitiveSet(i));
+            if (!da)
+                return false;
+
+            uint32_t range[3] = { (uint32_t)da->getMode(), (uint32_t)da->getFirst(), (uint32_t)da->getCount() };
+            hash.add(range, sizeof(range));
+        }
+
+        char hex[SHA1_HEX_SIZE];
+        hash.finalize().print_hex(hex);
+
+        // same layout as Cache::makeCacheKey
+        std::string value(hex);
+        key = "tessellation/" + value.substr(0, 2) + "/" + value.substr(2);
+        return true;
+    }
+
+    /**
+     * Writes the primitive sets of a tessellated geometry as a compact buffer:
+     * vertex count, number of sets, then mode, count and indices of each set.
+     * Returns false if the tessellator changed the vertices, since only the
+     * indices are kept.
+     */
+    bool encodeTessellation(const osg::Geometry* geometry, unsigned numVerts, std::string& buffer)
+    {
+        if (geometry->getVertexArray()->getNumElements() != numVerts)
+            return false;
+
+        std::vector<uint32_t> data;
+        data.push_back(numVerts);
+        data.push_back(geometry->getNumPrimitiveSets());
+
+        for (unsigned i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+        {
+            const osg::DrawElementsUInt* de = dynamic_cast<const osg::DrawElementsUInt*>(geometry->getPrimitiveSet(i));
+            if (!de)
+                return false;
+
+            data.push_back(de->getMode());
+            data.push_back(de->size());
+            data.insert(data.end(), de->begin(), de->end());
+        }
+
+        buffer.assign((const char*)&data[0], data.size() * sizeof(uint32_t));
+        return true;
+    }
+
+    //! Replaces the geometry's primitive sets with a buffer from encodeTessellation.
+    bool decodeTessellation(const std::string& buffer, osg::Geometry* geometry)
+    {
+        if (buffer.size() < 2 * sizeof(uint32_t) || buffer.size() % sizeof(uint32_t) != 0)
+            return false;
+
+        const uint32_t* data = (const uint32_t*)buffer.data();
+        const uint32_t* end = data + buffer.size() / sizeof(uint32_t);
+
+        uint32_t numVerts = *data++;
+        if (geometry->getVertexArray()->getNumElements() != numVerts)
+            return false;
+
+        osg::Geometry::PrimitiveSetList sets;
+        uint32_t numSets = *data++;
+        for (uint32_t i = 0; i < numSets; ++i)
+        {
+            if (end - data < 2)
+                return false;
+
+            GLenum mode = *data++;
+            uint32_t count = *data++;
+            if ((uint32_t)(end - data) < count)
+                return false;
+
+            osg::DrawElementsUInt* de = new osg::DrawElementsUInt(mode, data, data + count);
+            sets.push_back(de);
+            data += count;
+        }
+
+        geometry->setPrimitiveSetList(sets);
+        return true;
+    }
+
+    //! Tessellation engine for a polygon symbol
+    Tessellator::Engine getTessellationEngine(const PolygonSymbol* poly, bool useOSGTessellator)
+    {
+        if (poly && poly->tessellation().isSet())
+        {
+            switch (poly->tessellation().get())
+            {
+            case PolygonSymbol::TESSELLATION_EARCLIP: return Tessellator::ENGINE_EARCLIP;
+            case PolygonSymbol::TESSELLATION_OSG:     return Tessellator::ENGINE_OSG;
+            default:                                  return Tessellator::ENGINE_EARCUT;
+            }
+        }
+        return useOSGTessellator ? Tessellator::ENGINE_OSG : Tessellator::getDefaultEngine();
+    }
+
     /**
-     * Tesselates an osg::Geometry using the osgEarth tesselator.
+     * Tesselates an osg::Geometry using the chosen osgEarth tesselator engine.
      * If it fails, fall back to the osgUtil tesselator.
      */
-    bool tesselateGeometry(osg::Geometry* geometry, bool useOSGTessellator)
+    bool tesselateGeometry(osg::Geometry* geometry, Tessellator::Engine engine)
     {
-        if (useOSGTessellator) {
+        osgEarth::Tessellator oeTess(engine);
+        if (!oeTess.tessellateGeometry(*geometry))
+        {
             osgUtil::Tessellator tess;
             tess.setTessellationType(osgUtil::Tessellator::TESS_TYPE_GEOMETRY);
-            tess.setWindingType(osgUtil::Tessellator::TESS_WINDING_ODD);
+            tess.setWindingType(osgUtil::Tessellator::TESS_WINDING_POSITIVE);
             tess.retessellatePolygons(*geometry);
         }
-        else {
-            osgEarth::Tessellator oeTess;
-            if (!oeTess.tessellateGeometry(*geometry))
-            {
-                osgUtil::Tessellator tess;
-                tess.setTessellationType(osgUtil::Tessellator::TESS_TYPE_GEOMETRY);
-                tess.setWindingType(osgUtil::Tessellator::TESS_WINDING_POSITIVE);
-                tess.retessellatePolygons(*geometry);
-            }
-        }
 
         // Make sure all of the primitive sets are osg::DrawElementsUInt
         // The osgEarth tesselator will occassionally fail, and we fall back to the osgUtil::Tesselator which can produce a mix
@@ -779,6 +902,50 @@ namespace
         return true;
     }
 
+    /**
+     * Tessellates through the tessellation cache: memory first, then the
+     * cache bin (if there is one), then the tessellator.
+     */
+    bool tesselateGeometry(osg::Geometry* geometry, Tessellator::Engine engine, CacheBin* bin)
+    {
+        std::string key;
+        if (!makeTessellationKey(geometry, engine, key))
+            return tesselateGeometry(geometry, engine);
+
+        TessellationLRU::Record rec;
+        if (tessellationLRU().get(key, rec) && decodeTessellation(rec.value(), geometry))
+            return true;
+
+        if (bin)
+        {
+            ReadResult rr = bin->readString(key, 0L);
+            if (rr.succeeded() && decodeTessellation(rr.getString(), geometry))
+            {
+                tessellationLRU().insert(key, rr.getString());
+                return true;
+            }
+        }
+
+        unsigned numVerts = geometry->getVertexArray()->getNumElements();
+
+        if (!tesselateGeometry(geometry, engine))
+            return false;
+
+        std::string buffer;
+        if (encodeTessellation(geometry, numVerts, buffer))
+        {
+            tessellationLRU().insert(key, buffer);
+
+            if (bin)
+            {
+                osg::ref_ptr<StringObject> object = new StringObject(buffer);
+                bin->write(key, object.get(), 0L);
+            }
+        }
+
+        return true;
+    }
+
     /**
      * Tiles the Geometry into the given number of columns and rows
      */
@@ -938,6 +1105,7 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
                                          const SpatialReference* outputSRS,
                                          bool                    makeECEF,
                                          bool                    tessellate,
+                                         Tessellator::Engine     engine,
                                          osg::Geometry*          osgGeom,
                                          const osg::Matrixd      &world2local)
 {
@@ -989,7 +1157,11 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
             if ( temp->getNumPrimitiveSets() > 0 )
             {
                 // Tesselate the polygon while the coordinates are still in the LTP
-                if (tesselateGeometry( temp.get(), useOSGTessellator().value() ))
+                bool tessellated = _tessellationCache == true ?
+                    tesselateGeometry( temp.get(), engine, _tessellationCacheBin.get() ) :
+                    tesselateGeometry( temp.get(), engine );
+
+                if (tessellated)
                 {
                     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(temp->getVertexArray());
                     if ( verts->getNumElements() > 0 )
@@ -1299,6 +1471,15 @@ BuildGeometryFilter::push( FeatureList& input, FilterContext& context )
 
     computeLocalizers( context );
 
+    // persist tessellations in the feature layer's cache, if it has one
+    _tessellationCacheBin = 0L;
+    if ( _tessellationCache == true && context.getSession() && context.getSession()->getFeatureSource() )
+    {
+        CacheSettings* cacheSettings = context.getSession()->getFeatureSource()->getCacheSettings();
+        if ( cacheSettings && cacheSettings->isCacheEnabled() )
+            _tessellationCacheBin = cacheSettings->getCacheBin();
+    }
+
     const LineSymbol*    line  = _style.get<LineSymbol>();
     const PolygonSymbol* poly  = _style.get<PolygonSymbol>();
     const PointSymbol*   point = _style.get<PointSymbol>();
@@ -0,0 +1,1510 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "COG"
+#include <osgEarth/Registry>
+#include <osgEarth/HTTPClient>
+#include <osgEarth/Progress>
+#include <osgEarth/Cache>
+#include <osgEarth/StringUtils>
+#include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
+#include <cpl_conv.h>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace osgEarth;
+using namespace osgEarth::COG;
+
+#undef LC
+#define LC "[COG] "
+
+namespace
+{
+    // TIFF and GeoTIFF tags we use
+    enum
+    {
+        TAG_NEW_SUBFILE_TYPE     = 254,
+        TAG_IMAGE_WIDTH          = 256,
+        TAG_IMAGE_LENGTH         = 257,
+        TAG_BITS_PER_SAMPLE      = 258,
+        TAG_COMPRESSION          = 259,
+        TAG_PHOTOMETRIC          = 262,
+        TAG_SAMPLES_PER_PIXEL    = 277,
+        TAG_PLANAR_CONFIG        = 284,
+        TAG_PREDICTOR            = 317,
+        TAG_COLOR_MAP            = 320,
+        TAG_TILE_WIDTH           = 322,
+        TAG_TILE_LENGTH          = 323,
+        TAG_TILE_OFFSETS         = 324,
+        TAG_TILE_BYTE_COUNTS     = 325,
+        TAG_SAMPLE_FORMAT        = 339,
+        TAG_JPEG_TABLES          = 347,
+        TAG_MODEL_PIXEL_SCALE    = 33550,
+        TAG_MODEL_TIEPOINT       = 33922,
+        TAG_MODEL_TRANSFORMATION = 34264,
+        TAG_GEO_KEY_DIRECTORY    = 34735,
+        TAG_GDAL_NODATA          = 42113
+    };
+
+    // GeoTIFF keys we use
+    enum
+    {
+        KEY_RASTER_TYPE    = 1025,
+        KEY_GEOGRAPHIC_CS  = 2048,
+        KEY_PROJECTED_CS   = 3072,
+        KEY_USER_DEFINED   = 32767,
+        RASTER_PIXEL_IS_POINT = 2
+    };
+
+    // TIFF field types
+    enum
+    {
+        TYPE_BYTE = 1, TYPE_ASCII = 2, TYPE_SHORT = 3, TYPE_LONG = 4, TYPE_RATIONAL = 5,
+        TYPE_SBYTE = 6, TYPE_UNDEFINED = 7, TYPE_SSHORT = 8, TYPE_SLONG = 9, TYPE_SRATIONAL = 10,
+        TYPE_FLOAT = 11, TYPE_DOUBLE = 12, TYPE_LONG8 = 16, TYPE_SLONG8 = 17, TYPE_IFD8 = 18
+    };
+
+    enum
+    {
+        COMPRESSION_NONE = 1,
+        COMPRESSION_LZW = 5,
+        COMPRESSION_JPEG = 7,
+        COMPRESSION_DEFLATE = 8,
+        COMPRESSION_ADOBE_DEFLATE = 32946,
+        PREDICTOR_HORIZONTAL = 2,
+        PREDICTOR_FLOATING_POINT = 3,
+        PHOTOMETRIC_MIN_IS_WHITE = 0,
+        PHOTOMETRIC_PALETTE = 3,
+        SAMPLE_FORMAT_UINT = 1,
+        SAMPLE_FORMAT_INT = 2,
+        SAMPLE_FORMAT_FLOAT = 3
+    };
+
+    unsigned typeSize(unsigned type)
+    {
+        switch (type)
+        {
+        case TYPE_BYTE: case TYPE_ASCII: case TYPE_SBYTE: case TYPE_UNDEFINED: return 1;
+        case TYPE_SHORT: case TYPE_SSHORT: return 2;
+        case TYPE_LONG: case TYPE_SLONG: case TYPE_FLOAT: return 4;
+        case TYPE_RATIONAL: case TYPE_SRATIONAL: case TYPE_DOUBLE:
+        case TYPE_LONG8: case TYPE_SLONG8: case TYPE_IFD8: return 8;
+        default: return 0;
+        }
+    }
+
+    bool hostIsLittleEndian()
+    {
+        const unsigned short one = 1;
+        return *reinterpret_cast<const unsigned char*>(&one) == 1;
+    }
+
+    // Reads unsigned integers of a given size in the file's byte order
+    struct ByteOrder
+    {
+        bool _little;
+
+        uint64_t get(const char* p, unsigned bytes) const
+        {
+            uint64_t v = 0;
+            for (unsigned i = 0; i < bytes; ++i)
+            {
+                unsigned char b = (unsigned char)p[_little ? bytes - 1 - i : i];
+                v = (v << 8) | b;
+            }
+            return v;
+        }
+    };
+
+    // One IFD entry, with all of its values
+    struct Field
+    {
+        unsigned _type;
+        uint64_t _count;
+        std::string _data;
+    };
+    typedef std::map<unsigned, Field> Fields;
+
+    // Something to read byte ranges of the file from
+    struct RangeSource
+    {
+        virtual bool read(uint64_t offset, uint64_t length, std::string& out) = 0;
+        virtual ~RangeSource() { }
+    };
+
+    /**
+     * Reads the header and the IFDs of a classic or Big TIFF.
+     */
+    class TIFFReader
+    {
+    public:
+        TIFFReader(RangeSource* source) : _source(source), _big(false) { _order._little = true; }
+
+        bool readHeader(uint64_t& firstIFD, std::string& error)
+        {
+            // A COG keeps all its IFDs at the front of the file, so one
+            // read usually gets them all.
+            if (!_source->read(0, 16384, _head) || _head.size() < 8)
+            {
+                error = "Failed to read the TIFF header";
+                return false;
+            }
+
+            if (_head[0] == 'I' && _head[1] == 'I')
+                _order._little = true;
+            else if (_head[0] == 'M' && _head[1] == 'M')
+                _order._little = false;
+            else
+            {
+                error = "Not a TIFF file";
+                return false;
+            }
+
+            unsigned version = (unsigned)_order.get(&_head[2], 2);
+            if (version == 42)
+            {
+                _big = false;
+                firstIFD = _order.get(&_head[4], 4);
+            }
+            else if (version == 43 && _head.size() >= 16)
+            {
+                _big = true;
+                firstIFD = _order.get(&_head[8], 8);
+            }
+            else
+            {
+                error = "Unsupported TIFF version";
+                return false;
+            }
+            return true;
+        }
+
+        bool read(uint64_t offset, uint64_t length, std::string& out)
+        {
+            if (offset + length <= _head.size())
+            {
+                out.assign(_head, (size_t)offset, (size_t)length);
+                return true;
+            }
+            return _source->read(offset, length, out) && out.size() == length;
+        }
+
+        bool readIFD(uint64_t offset, Fields& fields, uint64_t& next)
+        {
+            unsigned countSize = _big ? 8 : 2;
+            unsigned entrySize = _big ? 20 : 12;
+            unsigned valueSize = _big ? 8 : 4;
+
+            std::string buf;
+            if (!read(offset, countSize, buf))
+                return false;
+
+            uint64_t count = _order.get(buf.data(), countSize);
+            if (count == 0 || count > 4096)
+                return false;
+
+            std::string entries;
+            if (!read(offset + countSize, count*entrySize + valueSize, entries))
+                return false;
+
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                const char* e = entries.data() + i*entrySize;
+                unsigned tag = (unsigned)_order.get(e, 2);
+                unsigned type = (unsigned)_order.get(e + 2, 2);
+                uint64_t n = _order.get(e + 4, valueSize);
+                unsigned size = typeSize(type);
+                if (size == 0)
+                    continue;
+
+                Field& field = fields[tag];
+                field._type = type;
+                field._count = n;
+
+                // values that fit go in the entry itself
+                uint64_t bytes = n * size;
+                if (bytes <= valueSize)
+                    field._data.assign(e + 4 + valueSize, (size_t)bytes);
+                else if (!read(_order.get(e + 4 + valueSize, valueSize), bytes, field._data))
+                    return false;
+            }
+
+            next = _order.get(entries.data() + count*entrySize, valueSize);
+            return true;
+        }
+
+        bool getInts(const Fields& fields, unsigned tag, std::vector<uint64_t>& out) const
+        {
+            Fields::const_iterator i = fields.find(tag);
+            if (i == fields.end())
+                return false;
+
+            const Field& f = i->second;
+            if (f._type == TYPE_FLOAT || f._type == TYPE_DOUBLE || f._type == TYPE_RATIONAL || f._type == TYPE_SRATIONAL)
+                return false;
+
+            unsigned size = typeSize(f._type);
+            out.resize((size_t)f._count);
+            for (uint64_t k = 0; k < f._count; ++k)
+                out[k] = _order.get(&f._data[k*size], size);
+            return true;
+        }
+
+        uint64_t getInt(const Fields& fields, unsigned tag, uint64_t defaultValue) const
+        {
+            std::vector<uint64_t> values;
+            return getInts(fields, tag, values) && !values.empty() ? values[0] : defaultValue;
+        }
+
+        bool getDoubles(const Fields& fields, unsigned tag, std::vector<double>& out) const
+        {
+            Fields::const_iterator i = fields.find(tag);
+            if (i == fields.end())
+                return false;
+
+            const Field& f = i->second;
+            unsigned size = typeSize(f._type);
+            out.resize((size_t)f._count);
+            for (uint64_t k = 0; k < f._count; ++k)
+            {
+                const char* p = &f._data[k*size];
+                if (f._type == TYPE_DOUBLE)
+                {
+                    uint64_t v = _order.get(p, 8);
+                    memcpy(&out[k], &v, 8);
+                }
+                else if (f._type == TYPE_FLOAT)
+                {
+                    uint32_t v = (uint32_t)_order.get(p, 4);
+                    float fv;
+                    memcpy(&fv, &v, 4);
+                    out[k] = fv;
+                }
+                else if (f._type == TYPE_RATIONAL)
+                {
+                    uint64_t d = _order.get(p + 4, 4);
+                    out[k] = d != 0 ? (double)_order.get(p, 4) / (double)d : 0.0;
+                }
+                else
+                {
+                    out[k] = (double)_order.get(p, size);
+                }
+            }
+            return true;
+        }
+
+        bool getString(const Fields& fields, unsigned tag, std::string& out) const
+        {
+            Fields::const_iterator i = fields.find(tag);
+            if (i == fields.end())
+                return false;
+            out = i->second._data;
+            return true;
+        }
+
+        bool isLittleEndian() const { return _order._little; }
+
+    private:
+        RangeSource* _source;
+        ByteOrder    _order;
+        bool         _big;
+        std::string  _head;
+    };
+
+    // Decodes TIFF-flavored LZW (MSB first, early change)
+    bool decodeLZW(const std::string& in, unsigned char* out, size_t outSize)
+    {
+        const unsigned CLEAR = 256, EOI = 257, FIRST = 258, MAX_CODES = 4096;
+
+        std::vector<unsigned short> prefix(MAX_CODES), length(MAX_CODES);
+        std::vector<unsigned char> suffix(MAX_CODES), first(MAX_CODES);
+        for (unsigned i = 0; i < 256; ++i)
+        {
+            prefix[i] = 0;
+            suffix[i] = (unsigned char)i;
+            first[i] = (unsigned char)i;
+            length[i] = 1;
+        }
+
+        unsigned width = 9;
+        unsigned next = FIRST;
+        int old = -1;
+        size_t pos = 0;
+        size_t inPos = 0;
+        uint32_t bits = 0;
+        unsigned numBits = 0;
+
+        while (pos < outSize)
+        {
+            while (numBits < width && inPos < in.size())
+            {
+                bits = (bits << 8) | (unsigned char)in[inPos++];
+                numBits += 8;
+            }
+            if (numBits < width)
+                break;
+
+            unsigned code = (bits >> (numBits - width)) & ((1u << width) - 1u);
+            numBits -= width;
+
+            if (code == EOI)
+                break;
+
+            if (code == CLEAR)
+            {
+                width = 9;
+                next = FIRST;
+                old = -1;
+                continue;
+            }
+
+            if (old >= 0)
+            {
+                // add the previous string plus the first byte of this one
+                if (code > next)
+                    return false;
+
+                if (next < MAX_CODES)
+                {
+                    prefix[next] = (unsigned short)old;
+                    suffix[next] = code < next ? first[code] : first[old];
+                    first[next] = first[old];
+                    length[next] = length[old] + 1;
+                    ++next;
+                }
+
+                if (next >= (1u << width) - 1u && width < 12)
+                    ++width;
+            }
+            else if (code > 255)
+            {
+                return false;
+            }
+
+            // write out the string for this code, back to front
+            size_t len = length[code];
+            unsigned c = code;
+            for (size_t i = len; i > 0; --i)
+            {
+                if (pos + i - 1 < outSize)
+                    out[pos + i - 1] = suffix[c];
+                c = prefix[c];
+            }
+            pos += len;
+            old = code;
+        }
+
+        // a short block leaves the rest zero
+        if (pos < outSize)
+            memset(out + pos, 0, outSize - pos);
+
+        return pos > 0;
+    }
+
+    template<typename T>
+    void undoHorizontal(T* row, unsigned count, unsigned stride)
+    {
+        for (unsigned i = stride; i < count; ++i)
+            row[i] = (T)(row[i] + row[i - stride]);
+    }
+
+    void swapBytes(unsigned char* data, size_t size, unsigned bytesPerSample)
+    {
+        for (size_t i = 0; i + bytesPerSample <= size; i += bytesPerSample)
+            std::reverse(data + i, data + i + bytesPerSample);
+    }
+
+    // Converts a decompressed block to host byte order, undoing any predictor.
+    void unpredict(unsigned char* data, unsigned width, unsigned height, unsigned spp,
+                   unsigned bitsPerSample, unsigned predictor, bool fileIsLittleEndian)
+    {
+        unsigned bytesPerSample = bitsPerSample / 8u;
+        unsigned samplesPerRow = width * spp;
+        size_t rowBytes = samplesPerRow * bytesPerSample;
+        bool host = hostIsLittleEndian();
+
+        if (predictor == PREDICTOR_FLOATING_POINT)
+        {
+            // Each row holds the bytes of its samples split into planes,
+            // most significant first, byte-differenced across the row.
+            std::vector<unsigned char> tmp(rowBytes);
+            for (unsigned r = 0; r < height; ++r)
+            {
+                unsigned char* row = data + r*rowBytes;
+                for (size_t i = spp; i < rowBytes; ++i)
+                    row[i] = (unsigned char)(row[i] + row[i - spp]);
+
+                memcpy(&tmp[0], row, rowBytes);
+                for (unsigned s = 0; s < samplesPerRow; ++s)
+                    for (unsigned b = 0; b < bytesPerSample; ++b)
+                        row[s*bytesPerSample + (host ? bytesPerSample - 1 - b : b)] = tmp[b*samplesPerRow + s];
+            }
+            return;
+        }
+
+        if (bytesPerSample > 1 && fileIsLittleEndian != host)
+        {
+            swapBytes(data, rowBytes*height, bytesPerSample);
+        }
+
+        if (predictor == PREDICTOR_HORIZONTAL)
+        {
+            for (unsigned r = 0; r < height; ++r)
+            {
+                unsigned char* row = data + r*rowBytes;
+                switch (bitsPerSample)
+                {
+                case 8:  undoHorizontal(row, samplesPerRow, spp); break;
+                case 16: undoHorizontal(reinterpret_cast<uint16_t*>(row), samplesPerRow, spp); break;
+                case 32: undoHorizontal(reinterpret_cast<uint32_t*>(row), samplesPerRow, spp); break;
+                case 64: undoHorizontal(reinterpret_cast<uint64_t*>(row), samplesPerRow, spp); break;
+                }
+            }
+        }
+    }
+
+    // Reads a sample as a double
+    double getValue(const unsigned char* p, unsigned bitsPerSample, unsigned sampleFormat)
+    {
+        if (sampleFormat == SAMPLE_FORMAT_FLOAT)
+        {
+            if (bitsPerSample == 32) { float v; memcpy(&v, p, 4); return v; }
+            if (bitsPerSample == 64) { double v; memcpy(&v, p, 8); return v; }
+            return 0.0;
+        }
+        if (sampleFormat == SAMPLE_FORMAT_INT)
+        {
+            switch (bitsPerSample)
+            {
+            case 8:  return *reinterpret_cast<const int8_t*>(p);
+            case 16: { int16_t v; memcpy(&v, p, 2); return v; }
+            case 32: { int32_t v; memcpy(&v, p, 4); return v; }
+            case 64: { int64_t v; memcpy(&v, p, 8); return (double)v; }
+            }
+            return 0.0;
+        }
+        switch (bitsPerSample)
+        {
+        case 8:  return *p;
+        case 16: { uint16_t v; memcpy(&v, p, 2); return v; }
+        case 32: { uint32_t v; memcpy(&v, p, 4); return v; }
+        case 64: { uint64_t v; memcpy(&v, p, 8); return (double)v; }
+        }
+        return 0.0;
+    }
+}
+
+//........................................................................
+
+namespace
+{
+    // Points a TIFFReader at the driver's ranged reads
+    struct DriverSource : public RangeSource
+    {
+        DriverSource(const std::string& url, bool remote, const osgDB::Options* readOptions) :
+            _url(url), _remote(remote), _readOptions(readOptions) { }
+
+        bool read(uint64_t offset, uint64_t length, std::string& out);
+
+        std::string _url;
+        bool _remote;
+        const osgDB::Options* _readOptions;
+    };
+
+    bool readFileRange(const std::string& url, bool remote, uint64_t offset, uint64_t length,
+                       std::string& out, const osgDB::Options* readOptions, ProgressCallback* progress)
+    {
+        out.clear();
+        if (length == 0)
+            return true;
+
+        if (remote)
+        {
+            HTTPRequest request(url);
+            request.addHeader("Range", Stringify() << "bytes=" << offset << "-" << (offset + length - 1));
+
+            HTTPResponse response = HTTPClient::get(request, readOptions, progress);
+
+            if (response.getCode() == 206 && response.getNumParts() > 0)
+            {
+                out = response.getPartAsString(0);
+            }
+            else if (response.isOK() && response.getNumParts() > 0)
+            {
+                // The server ignored the range and sent the whole thing.
+                std::string all = response.getPartAsString(0);
+                if (offset >= all.size())
+                    return false;
+                out = all.substr((size_t)offset, (size_t)length);
+            }
+            else
+            {
+                OE_DEBUG << LC << "Range request failed (" << response.getCode() << ") for " << url << std::endl;
+                return false;
+            }
+            return !out.empty();
+        }
+        else
+        {
+            std::ifstream in(url.c_str(), std::ios::in | std::ios::binary);
+            if (!in.is_open())
+                return false;
+
+            in.seekg((std::streamoff)offset, std::ios::beg);
+            out.resize((size_t)length);
+            in.read(&out[0], (std::streamsize)length);
+            out.resize((size_t)in.gcount());
+            return !out.empty();
+        }
+    }
+
+    bool DriverSource::read(uint64_t offset, uint64_t length, std::string& out)
+    {
+        return readFileRange(_url, _remote, offset, length, out, _readOptions, 0L);
+    }
+
+    struct WantedBlock
+    {
+        unsigned _index;
+        uint64_t _offset;
+        uint64_t _size;
+        bool operator < (const WantedBlock& rhs) const { return _offset < rhs._offset; }
+    };
+
+    // Upper limit on the size of one merged range request
+    const uint64_t MAX_RANGE_BYTES = 16u * 1024u * 1024u;
+}
+
+//........................................................................
+
+void
+COG::Options::readFrom(const Config& conf)
+{
+    _interpolation.init(INTERP_BILINEAR);
+    _maxRangeGap.init(65536u);
+    _blockCacheSize.init(256u);
+    conf.get("url", _url);
+    conf.get("max_range_gap", _maxRangeGap);
+    conf.get("block_cache_size", _blockCacheSize);
+    conf.get("interpolation", "nearest", _interpolation, osgEarth::INTERP_NEAREST);
+    conf.get("interpolation", "bilinear", _interpolation, osgEarth::INTERP_BILINEAR);
+}
+
+void
+COG::Options::writeTo(Config& conf) const
+{
+    conf.set("url", _url);
+    conf.set("max_range_gap", _maxRangeGap);
+    conf.set("block_cache_size", _blockCacheSize);
+    conf.set("interpolation", "nearest", _interpolation, osgEarth::INTERP_NEAREST);
+    conf.set("interpolation", "bilinear", _interpolation, osgEarth::INTERP_BILINEAR);
+}
+
+//........................................................................
+
+COG::Driver::Driver() :
+_remote(false),
+_littleEndian(true),
+_xmin(0.0), _ymax(0.0), _xmax(0.0), _ymin(0.0),
+_blockCache(true, 256u)
+{
+    //nop
+}
+
+Status
+COG::Driver::open(const std::string& name,
+                  const COG::Options& options,
+                  unsigned tileSize,
+                  osg::ref_ptr<const Profile>& profile,
+                  DataExtentList& out_dataExtents,
+                  CacheBin* cacheBin,
+                  const osgDB::Options* readOptions)
+{
+    if (!options.url().isSet() || options.url()->empty())
+    {
+        return Status::Error(Status::ConfigurationError, "Valid URL is missing");
+    }
+
+    _name = name;
+    _options = options;
+    _url = options.url()->full();
+    _remote = osgDB::containsServerAddress(_url);
+    _cacheBin = cacheBin;
+    _readOptions = readOptions;
+    _blockCache.setMaxSize(osg::maximum(options.blockCacheSize().get(), 1u));
+
+    DriverSource source(_url, _remote, readOptions);
+    TIFFReader tiff(&source);
+
+    uint64_t offset = 0;
+    std::string error;
+    if (!tiff.readHeader(offset, error))
+    {
+        return Status::Error(Status::ResourceUnavailable, Stringify() << error << " (" << _url << ")");
+    }
+    _littleEndian = tiff.isLittleEndian();
+
+    Fields georef;
+
+    for (unsigned count = 0; offset != 0 && count < 64; ++count)
+    {
+        Fields fields;
+        uint64_t next = 0;
+        if (!tiff.readIFD(offset, fields, next))
+        {
+            return Status::Error(Status::ResourceUnavailable, Stringify() << "Failed to read an IFD (" << _url << ")");
+        }
+        offset = next;
+
+        // skip transparency masks
+        if ((tiff.getInt(fields, TAG_NEW_SUBFILE_TYPE, 0) & 4u) != 0)
+            continue;
+
+        Level level;
+        level._width = (unsigned)tiff.getInt(fields, TAG_IMAGE_WIDTH, 0);
+        level._height = (unsigned)tiff.getInt(fields, TAG_IMAGE_LENGTH, 0);
+        level._tileWidth = (unsigned)tiff.getInt(fields, TAG_TILE_WIDTH, 0);
+        level._tileHeight = (unsigned)tiff.getInt(fields, TAG_TILE_LENGTH, 0);
+        level._samplesPerPixel = (unsigned)tiff.getInt(fields, TAG_SAMPLES_PER_PIXEL, 1);
+        level._bitsPerSample = (unsigned)tiff.getInt(fields, TAG_BITS_PER_SAMPLE, 1);
+        level._sampleFormat = (unsigned)tiff.getInt(fields, TAG_SAMPLE_FORMAT, SAMPLE_FORMAT_UINT);
+        level._compression = (unsigned)tiff.getInt(fields, TAG_COMPRESSION, COMPRESSION_NONE);
+        level._predictor = (unsigned)tiff.getInt(fields, TAG_PREDICTOR, 1);
+        level._photometric = (unsigned)tiff.getInt(fields, TAG_PHOTOMETRIC, 1);
+
+        if (level._width == 0 || level._height == 0 || level._tileWidth == 0 || level._tileHeight == 0)
+        {
+            if (_levels.empty())
+                return Status::Error(Status::ResourceUnavailable, Stringify() << "Image is not tiled; not a COG (" << _url << ")");
+            continue;
+        }
+
+        if (tiff.getInt(fields, TAG_PLANAR_CONFIG, 1) != 1 && level._samplesPerPixel > 1)
+        {
+            return Status::Error(Status::ResourceUnavailable, Stringify() << "Separate sample planes are not supported (" << _url << ")");
+        }
+
+        if (level._bitsPerSample % 8u != 0 || level._bitsPerSample > 64)
+        {
+            return Status::Error(Status::ResourceUnavailable, Stringify() << level._bitsPerSample << "-bit samples are not supported (" << _url << ")");
+        }
+
+        if (level._compression != COMPRESSION_NONE &&
+            level._compression != COMPRESSION_LZW &&
+            level._compression != COMPRESSION_JPEG &&
+            level._compression != COMPRESSION_DEFLATE &&
+            level._compression != COMPRESSION_ADOBE_DEFLATE)
+        {
+            return Status::Error(Status::ResourceUnavailable, Stringify() << "Compression " << level._compression << " is not supported (" << _url << ")");
+        }
+
+        level._tilesAcross = (level._width + level._tileWidth - 1) / level._tileWidth;
+        level._tilesDown = (level._height + level._tileHeight - 1) / level._tileHeight;
+
+        tiff.getInts(fields, TAG_TILE_OFFSETS, level._offsets);
+        tiff.getInts(fields, TAG_TILE_BYTE_COUNTS, level._byteCounts);
+        if (level._offsets.size() < level._tilesAcross*level._tilesDown ||
+            level._byteCounts.size() != level._offsets.size())
+        {
+            return Status::Error(Status::ResourceUnavailable, Stringify() << "Tile offsets are missing (" << _url << ")");
+        }
+
+        std::vector<uint64_t> colorMap;
+        if (tiff.getInts(fields, TAG_COLOR_MAP, colorMap))
+        {
+            level._colorMap.assign(colorMap.begin(), colorMap.end());
+        }
+
+        tiff.getString(fields, TAG_JPEG_TABLES, level._jpegTables);
+
+        if (_levels.empty())
+        {
+            georef = fields;
+        }
+
+        _levels.push_back(level);
+    }
+
+    if (_levels.empty())
+    {
+        return Status::Error(Status::ResourceUnavailable, Stringify() << "No images found (" << _url << ")");
+    }
+
+    // full resolution first, then finer to coarser overviews
+    const Level& full = _levels[0];
+
+    // Georeferencing
+    double resX = 0.0, resY = 0.0;
+    std::vector<double> scale, tiepoint, transform;
+    if (tiff.getDoubles(georef, TAG_MODEL_PIXEL_SCALE, scale) && scale.size() >= 2 &&
+        tiff.getDoubles(georef, TAG_MODEL_TIEPOINT, tiepoint) && tiepoint.size() >= 6)
+    {
+        resX = scale[0];
+        resY = scale[1];
+        _xmin = tiepoint[3] - tiepoint[0] * resX;
+        _ymax = tiepoint[4] + tiepoint[1] * resY;
+    }
+    else if (tiff.getDoubles(georef, TAG_MODEL_TRANSFORMATION, transform) && transform.size() >= 16)
+    {
+        if (transform[1] != 0.0 || transform[4] != 0.0)
+        {
+            return Status::Error(Status::ResourceUnavailable, Stringify() << "Rotated images are not supported (" << _url << ")");
+        }
+        resX = transform[0];
+        resY = -transform[5];
+        _xmin = transform[3];
+        _ymax = transform[7];
+    }
+    else
+    {
+        return Status::Error(Status::ResourceUnavailable, Stringify() << "Image has no georeferencing (" << _url << ")");
+    }
+
+    if (resX <= 0.0 || resY <= 0.0)
+    {
+        return Status::Error(Status::ResourceUnavailable, Stringify() << "Unsupported pixel scale (" << _url << ")");
+    }
+
+    unsigned epsg = 0;
+    std::vector<uint64_t> keys;
+    if (tiff.getInts(georef, TAG_GEO_KEY_DIRECTORY, keys) && keys.size() >= 4)
+    {
+        unsigned numKeys = (unsigned)keys[3];
+        for (unsigned k = 0; k < numKeys && 4 + k*4 + 3 < keys.size(); ++k)
+        {
+            unsigned id = (unsigned)keys[4 + k*4];
+            unsigned location = (unsigned)keys[4 + k*4 + 1];
+            unsigned value = (unsigned)keys[4 + k*4 + 3];
+            if (location != 0)
+                continue;
+
+            if (id == KEY_RASTER_TYPE && value == RASTER_PIXEL_IS_POINT)
+            {
+                _xmin -= 0.5*resX;
+                _ymax += 0.5*resY;
+            }
+            else if (id == KEY_PROJECTED_CS && value != KEY_USER_DEFINED)
+            {
+                epsg = value;
+            }
+            else if (id == KEY_GEOGRAPHIC_CS && value != KEY_USER_DEFINED && epsg == 0)
+            {
+                epsg = value;
+            }
+        }
+    }
+
+    _xmax = _xmin + resX * (double)full._width;
+    _ymin = _ymax - resY * (double)full._height;
+
+    for (unsigned i = 0; i < _levels.size(); ++i)
+    {
+        _levels[i]._resX = (_xmax - _xmin) / (double)_levels[i]._width;
+        _levels[i]._resY = (_ymax - _ymin) / (double)_levels[i]._height;
+    }
+
+    if (epsg != 0)
+    {
+        _srs = SpatialReference::get(Stringify() << "epsg:" << epsg);
+    }
+    else if (profile.valid())
+    {
+        _srs = profile->getSRS();
+    }
+
+    if (!_srs.valid())
+    {
+        return Status::Error(Status::ResourceUnavailable, Stringify() << "Image has no EPSG code; set a profile (" << _url << ")");
+    }
+
+    std::string noData;
+    if (tiff.getString(georef, TAG_GDAL_NODATA, noData))
+    {
+        noData = trim(std::string(noData.c_str()));
+        if (!noData.empty())
+            _noDataValue = as<float>(noData, 0.0f);
+    }
+
+    if (profile.valid())
+    {
+        if (!profile->getSRS()->isHorizEquivalentTo(_srs.get()))
+        {
+            return Status::Error(Status::ConfigurationError, Stringify() << "Profile SRS must match the image SRS (" << _url << ")");
+        }
+    }
+    else if (_srs->isGeographic())
+    {
+        profile = Profile::create(_srs.get(), -180.0, -90.0, 180.0, 90.0, 2u, 1u);
+    }
+    else
+    {
+        profile = Profile::create(_srs.get(), _xmin, _ymin, _xmax, _ymax);
+    }
+
+    if (!profile.valid())
+    {
+        return Status::Error(Status::ResourceUnavailable, Stringify() << "Cannot create a profile for " << _srs->getName());
+    }
+
+    // The deepest level at which the tiles are still coarser than the image
+    double maxResolution = osg::minimum(resX, resY);
+    unsigned maxDataLevel = 0;
+    for (; maxDataLevel < 30; ++maxDataLevel)
+    {
+        double w, h;
+        profile->getTileDimensions(maxDataLevel, w, h);
+        if (w / (double)tileSize < maxResolution || h / (double)tileSize < maxResolution)
+            break;
+    }
+
+    out_dataExtents.push_back(DataExtent(GeoExtent(_srs.get(), _xmin, _ymin, _xmax, _ymax), 0, maxDataLevel));
+
+    OE_INFO << LC << _name << ": " << full._width << "x" << full._height << " px, "
+        << _levels.size() - 1 << " overviews, " << full._tileWidth << "x" << full._tileHeight << " blocks, "
+        << "compression " << full._compression << ", max data level " << maxDataLevel << std::endl;
+
+    return STATUS_OK;
+}
+
+bool
+COG::Driver::readRange(uint64_t offset, uint64_t length, std::string& out, ProgressCallback* progress) const
+{
+    return readFileRange(_url, _remote, offset, length, out, _readOptions.get(), progress);
+}
+
+bool
+COG::Driver::decodeBlock(const Level& level, const std::string& raw, Block& out) const
+{
+    unsigned bytesPerSample = level._bitsPerSample / 8u;
+    size_t rowBytes = level._tileWidth * level._samplesPerPixel * bytesPerSample;
+    size_t size = rowBytes * level._tileHeight;
+    out.resize(size);
+
+    switch (level._compression)
+    {
+    case COMPRESSION_NONE:
+        memset(&out[0], 0, size);
+        memcpy(&out[0], raw.data(), osg::minimum(size, raw.size()));
+        break;
+
+    case COMPRESSION_LZW:
+        if (!decodeLZW(raw, &out[0], size))
+            return false;
+        break;
+
+    case COMPRESSION_DEFLATE:
+    case COMPRESSION_ADOBE_DEFLATE:
+        {
+            size_t outBytes = 0;
+            if (CPLZLibInflate(raw.data(), raw.size(), &out[0], size, &outBytes) == NULL)
+                return false;
+            if (outBytes < size)
+                memset(&out[outBytes], 0, size - outBytes);
+        }
+        break;
+
+    case COMPRESSION_JPEG:
+        {
+            // The quantization and Huffman tables are usually in the
+            // JPEGTables tag, to splice in ahead of the block's own data.
+            std::string jpeg;
+            if (level._jpegTables.size() > 4 && raw.size() > 2)
+                jpeg = level._jpegTables.substr(0, level._jpegTables.size() - 2) + raw.substr(2);
+            else
+                jpeg = raw;
+
+            osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension("jpg");
+            if (!rw)
+                return false;
+
+            std::stringstream buf(jpeg);
+            osgDB::ReaderWriter::ReadResult rr = rw->readImage(buf);
+            const osg::Image* image = rr.getImage();
+
+            if (!image ||
+                image->s() != (int)level._tileWidth ||
+                image->t() != (int)level._tileHeight ||
+                osg::Image::computeNumComponents(image->getPixelFormat()) != (int)level._samplesPerPixel ||
+                image->getDataType() != GL_UNSIGNED_BYTE)
+            {
+                return false;
+            }
+
+            // OSG images are bottom up
+            for (unsigned r = 0; r < level._tileHeight; ++r)
+            {
+                memcpy(&out[r*rowBytes], image->data(0, level._tileHeight - 1 - r), rowBytes);
+            }
+        }
+        return true;
+
+    default:
+        return false;
+    }
+
+    unpredict(&out[0], level._tileWidth, level._tileHeight, level._samplesPerPixel,
+              level._bitsPerSample, level._predictor, _littleEndian);
+
+    return true;
+}
+
+bool
+COG::Driver::readBlocks(unsigned li, unsigned colMin, unsigned colMax, unsigned rowMin, unsigned rowMax,
+                        BlockMap& out, ProgressCallback* progress) const
+{
+    const Level& level = _levels[li];
+
+    std::vector<WantedBlock> wanted;
+
+    for (unsigned row = rowMin; row <= rowMax; ++row)
+    {
+        for (unsigned col = colMin; col <= colMax; ++col)
+        {
+            unsigned index = row * level._tilesAcross + col;
+
+            // a sparse COG has no data for empty blocks
+            if (level._byteCounts[index] == 0)
+                continue;
+
+            std::string key = Stringify() << "cog_block/" << li << "/" << index;
+
+            LRUCache<std::string, std::string>::Record rec;
+            if (_blockCache.get(key, rec))
+            {
+                if (!decodeBlock(level, rec.value(), out[index]))
+                    out.erase(index);
+                continue;
+            }
+
+            if (_cacheBin.valid())
+            {
+                ReadResult rr = _cacheBin->readString(key, _readOptions.get());
+                if (rr.succeeded())
+                {
+                    const std::string& raw = rr.getString();
+                    _blockCache.insert(key, raw);
+                    if (!decodeBlock(level, raw, out[index]))
+                        out.erase(index);
+                    continue;
+                }
+            }
+
+            WantedBlock block;
+            block._index = index;
+            block._offset = level._offsets[index];
+            block._size = level._byteCounts[index];
+            wanted.push_back(block);
+        }
+    }
+
+    std::sort(wanted.begin(), wanted.end());
+
+    // Fetch runs of blocks that are close together in one request each.
+    uint64_t maxGap = _options.maxRangeGap().get();
+    for (unsigned i = 0; i < wanted.size(); )
+    {
+        uint64_t start = wanted[i]._offset;
+        uint64_t end = start + wanted[i]._size;
+        unsigned j = i + 1;
+        while (j < wanted.size() &&
+               wanted[j]._offset <= end + maxGap &&
+               wanted[j]._offset + wanted[j]._size - start <= MAX_RANGE_BYTES)
+        {
+            end = osg::maximum(end, wanted[j]._offset + wanted[j]._size);
+            ++j;
+        }
+
+        std::string data;
+        if (!readRange(start, end - start, data, progress))
+        {
+            return false;
+        }
+
+        for (unsigned k = i; k < j; ++k)
+        {
+            uint64_t first = wanted[k]._offset - start;
+            if (first + wanted[k]._size > data.size())
+                continue;
+
+            std::string raw = data.substr((size_t)first, (size_t)wanted[k]._size);
+            std::string key = Stringify() << "cog_block/" << li << "/" << wanted[k]._index;
+
+            _blockCache.insert(key, raw);
+            if (_cacheBin.valid())
+            {
+                osg::ref_ptr<StringObject> object = new StringObject(raw);
+                _cacheBin->write(key, object.get(), _readOptions.get());
+            }
+
+            if (!decodeBlock(level, raw, out[wanted[k]._index]))
+            {
+                OE_DEBUG << LC << "Failed to decode block " << key << std::endl;
+                out.erase(wanted[k]._index);
+            }
+        }
+
+        i = j;
+    }
+
+    return true;
+}
+
+unsigned
+COG::Driver::selectLevel(const TileKey& key, unsigned tileSize, bool edges) const
+{
+    // The coarsest level that is still at least as fine as the tile.
+    double resolution = key.getExtent().width() / (double)(edges ? tileSize - 1 : tileSize);
+    unsigned best = 0;
+    for (unsigned i = 1; i < _levels.size(); ++i)
+    {
+        if (_levels[i]._resX <= resolution * 1.001 && _levels[i]._resX > _levels[best]._resX)
+            best = i;
+    }
+    return best;
+}
+
+bool
+COG::Driver::getWindow(const TileKey& key, unsigned li, unsigned tileSize, bool edges,
+                       unsigned& colMin, unsigned& colMax, unsigned& rowMin, unsigned& rowMax) const
+{
+    const Level& level = _levels[li];
+    const GeoExtent& extent = key.getExtent();
+
+    // pixels under the tile, plus one around it for interpolation
+    double pad = edges ? 1.0 : 0.0;
+    double px0 = (extent.xMin() - _xmin) / level._resX - pad;
+    double px1 = (extent.xMax() - _xmin) / level._resX + pad;
+    double py0 = (_ymax - extent.yMax()) / level._resY - pad;
+    double py1 = (_ymax - extent.yMin()) / level._resY + pad;
+
+    if (px1 < 0.0 || py1 < 0.0 || px0 >= (double)level._width || py0 >= (double)level._height)
+        return false;
+
+    int x0 = osg::clampBetween((int)floor(px0), 0, (int)level._width - 1);
+    int x1 = osg::clampBetween((int)floor(px1), 0, (int)level._width - 1);
+    int y0 = osg::clampBetween((int)floor(py0), 0, (int)level._height - 1);
+    int y1 = osg::clampBetween((int)floor(py1), 0, (int)level._height - 1);
+
+    colMin = x0 / level._tileWidth;
+    colMax = x1 / level._tileWidth;
+    rowMin = y0 / level._tileHeight;
+    rowMax = y1 / level._tileHeight;
+    return true;
+}
+
+osg::Image*
+COG::Driver::createImage(const TileKey& key,
+                         unsigned tileSize,
+                         ProgressCallback* progress) const
+{
+    if (_levels.empty())
+        return NULL;
+
+    unsigned li = selectLevel(key, tileSize, false);
+    const Level& level = _levels[li];
+
+    if (level._bitsPerSample != 8 && level._bitsPerSample != 16)
+    {
+        OE_DEBUG << LC << "Images need 8- or 16-bit samples" << std::endl;
+        return NULL;
+    }
+
+    unsigned colMin, colMax, rowMin, rowMax;
+    if (!getWindow(key, li, tileSize, false, colMin, colMax, rowMin, rowMax))
+        return NULL;
+
+    BlockMap blocks;
+    if (!readBlocks(li, colMin, colMax, rowMin, rowMax, blocks, progress) || blocks.empty())
+        return NULL;
+
+    if (progress && progress->isCanceled())
+        return NULL;
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(tileSize, tileSize, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    memset(image->data(), 0, image->getTotalSizeInBytes());
+
+    const GeoExtent& extent = key.getExtent();
+    double dx = extent.width() / (double)tileSize;
+    double dy = extent.height() / (double)tileSize;
+    unsigned spp = level._samplesPerPixel;
+    unsigned bytesPerSample = level._bitsPerSample / 8u;
+    unsigned pixelBytes = spp * bytesPerSample;
+    unsigned paletteSize = level._colorMap.size() / 3u;
+    bool hasData = false;
+
+    for (unsigned r = 0; r < tileSize; ++r)
+    {
+        // image rows go from south to north
+        double y = extent.yMin() + ((double)r + 0.5) * dy;
+        double py = (_ymax - y) / level._resY;
+        if (py < 0.0 || py >= (double)level._height)
+            continue;
+        unsigned iy = (unsigned)py;
+
+        for (unsigned c = 0; c < tileSize; ++c)
+        {
+            double x = extent.xMin() + ((double)c + 0.5) * dx;
+            double px = (x - _xmin) / level._resX;
+            if (px < 0.0 || px >= (double)level._width)
+                continue;
+            unsigned ix = (unsigned)px;
+
+            unsigned index = (iy / level._tileHeight) * level._tilesAcross + (ix / level._tileWidth);
+            BlockMap::const_iterator b = blocks.find(index);
+            if (b == blocks.end())
+                continue;
+
+            const unsigned char* p = &b->second[
+                ((iy % level._tileHeight) * level._tileWidth + (ix % level._tileWidth)) * pixelBytes];
+
+            // 8-bit values of the first four samples
+            unsigned v[4] = { 0, 0, 0, 255 };
+            for (unsigned s = 0; s < spp && s < 4; ++s)
+            {
+                v[s] = bytesPerSample == 1 ? p[s] : (unsigned)getValue(p + s*2, 16, SAMPLE_FORMAT_UINT) >> 8;
+            }
+
+            bool isNoData =
+                _noDataValue.isSet() &&
+                (float)(bytesPerSample == 1 ? p[0] : getValue(p, 16, SAMPLE_FORMAT_UINT)) == _noDataValue.get() &&
+                (spp < 3 || (v[1] == v[0] && v[2] == v[0]));
+            if (isNoData)
+                continue;
+
+            unsigned char* out = image->data(c, r);
+            if (spp <= 2)
+            {
+                if (level._photometric == PHOTOMETRIC_PALETTE && v[0] < paletteSize)
+                {
+                    out[0] = level._colorMap[v[0]] >> 8;
+                    out[1] = level._colorMap[paletteSize + v[0]] >> 8;
+                    out[2] = level._colorMap[2*paletteSize + v[0]] >> 8;
+                }
+                else
+                {
+                    unsigned gray = level._photometric == PHOTOMETRIC_MIN_IS_WHITE ? 255 - v[0] : v[0];
+                    out[0] = out[1] = out[2] = gray;
+                }
+                out[3] = spp == 2 ? v[1] : 255;
+            }
+            else
+            {
+                out[0] = v[0];
+                out[1] = v[1];
+                out[2] = v[2];
+                out[3] = spp >= 4 ? v[3] : 255;
+            }
+            hasData = true;
+        }
+    }
+
+    return hasData ? image.release() : NULL;
+}
+
+osg::HeightField*
+COG::Driver::createHeightField(const TileKey& key,
+                               unsigned tileSize,
+                               ProgressCallback* progress) const
+{
+    if (_levels.empty() || tileSize < 2)
+        return NULL;
+
+    unsigned li = selectLevel(key, tileSize, true);
+    const Level& level = _levels[li];
+
+    if (level._samplesPerPixel != 1)
+    {
+        OE_DEBUG << LC << "Elevation needs a single band" << std::endl;
+        return NULL;
+    }
+
+    unsigned colMin, colMax, rowMin, rowMax;
+    if (!getWindow(key, li, tileSize, true, colMin, colMax, rowMin, rowMax))
+        return NULL;
+
+    BlockMap blocks;
+    if (!readBlocks(li, colMin, colMax, rowMin, rowMax, blocks, progress) || blocks.empty())
+        return NULL;
+
+    if (progress && progress->isCanceled())
+        return NULL;
+
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+    hf->allocate(tileSize, tileSize);
+    for (unsigned i = 0; i < hf->getHeightList().size(); ++i)
+        hf->getHeightList()[i] = NO_DATA_VALUE;
+
+    const GeoExtent& extent = key.getExtent();
+    double dx = extent.width() / (double)(tileSize - 1);
+    double dy = extent.height() / (double)(tileSize - 1);
+    unsigned bytesPerSample = level._bitsPerSample / 8u;
+    bool bilinear = _options.interpolation() != INTERP_NEAREST;
+
+    struct Sampler
+    {
+        const Level& _level;
+        const BlockMap& _blocks;
+        unsigned _bytesPerSample;
+        const optional<float>& _noData;
+
+        // value of pixel (ix, iy), false if there isn't one
+        bool get(int ix, int iy, float& out) const
+        {
+            ix = osg::clampBetween(ix, 0, (int)_level._width - 1);
+            iy = osg::clampBetween(iy, 0, (int)_level._height - 1);
+
+            unsigned index = (iy / _level._tileHeight) * _level._tilesAcross + (ix / _level._tileWidth);
+            BlockMap::const_iterator b = _blocks.find(index);
+            if (b == _blocks.end())
+                return false;
+
+            const unsigned char* p = &b->second[
+                ((iy % _level._tileHeight) * _level._tileWidth + (ix % _level._tileWidth)) * _bytesPerSample];
+
+            out = (float)getValue(p, _level._bitsPerSample, _level._sampleFormat);
+            return !osg::isNaN(out) && !(_noData.isSet() && out == _noData.get());
+        }
+    };
+    Sampler sampler = { level, blocks, bytesPerSample, _noDataValue };
+
+    for (unsigned r = 0; r < tileSize; ++r)
+    {
+        double y = extent.yMin() + (double)r * dy;
+        double py = (_ymax - y) / level._resY - 0.5;
+        if (py < -0.5 || py > (double)level._height - 0.5)
+            continue;
+
+        for (unsigned c = 0; c < tileSize; ++c)
+        {
+            double x = extent.xMin() + (double)c * dx;
+            double px = (x - _xmin) / level._resX - 0.5;
+            if (px < -0.5 || px > (double)level._width - 0.5)
+                continue;
+
+            float h;
+            bool ok = false;
+
+            if (bilinear)
+            {
+                int x0 = (int)floor(px), y0 = (int)floor(py);
+                float fx = (float)(px - x0), fy = (float)(py - y0);
+                float h00, h10, h01, h11;
+                if (sampler.get(x0, y0, h00) && sampler.get(x0 + 1, y0, h10) &&
+                    sampler.get(x0, y0 + 1, h01) && sampler.get(x0 + 1, y0 + 1, h11))
+                {
+                    h = (h00*(1.0f - fx) + h10*fx) * (1.0f - fy) + (h01*(1.0f - fx) + h11*fx) * fy;
+                    ok = true;
+                }
+            }
+
+            // nearest neighbor, or a fallback for holes next to the point
+            if (!ok)
+            {
+                ok = sampler.get((int)floor(px + 0.5), (int)floor(py + 0.5), h);
+            }
+
+            if (ok)
+            {
+                hf->setHeight(c, r, h);
+            }
+        }
+    }
+
+    return hf.release();
+}
+
+//........................................................................
+
+Config
+COGImageLayer::Options::getConfig() const
+{
+    Config conf = ImageLayer::Options::getConfig();
+    writeTo(conf);
+    return conf;
+}
+
+void
+COGImageLayer::Options::fromConfig(const Config& conf)
+{
+    readFrom(conf);
+}
+
+//........................................................................
+
+REGISTER_OSGEARTH_LAYER(cogimage, COGImageLayer);
+
+OE_LAYER_PROPERTY_IMPL(COGImageLayer, URI, URL, url);
+OE_LAYER_PROPERTY_IMPL(COGImageLayer, unsigned, MaxRangeGap, maxRangeGap);
+OE_LAYER_PROPERTY_IMPL(COGImageLayer, unsigned, BlockCacheSize, blockCacheSize);
+
+void
+COGImageLayer::init()
+{
+    ImageLayer::init();
+}
+
+Status
+COGImageLayer::openImplementation()
+{
+    Status parent = ImageLayer::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    // raw blocks go into the layer's cache bin next to the tiles
+    CacheBin* bin = 0L;
+    CacheSettings* cacheSettings = getCacheSettings();
+    if (cacheSettings && cacheSettings->isCacheEnabled() && cacheSettings->cachePolicy()->isCacheWriteable())
+    {
+        bin = cacheSettings->getCacheBin();
+    }
+
+    osg::ref_ptr<const Profile> profile = getProfile();
+
+    _driver = new COG::Driver();
+    Status status = _driver->open(
+        getName(),
+        options(),
+        options().tileSize().get(),
+        profile,
+        dataExtents(),
+        bin,
+        getReadOptions());
+
+    if (status.isError())
+        return status;
+
+    if (profile.get() != getProfile())
+    {
+        setProfile(profile.get());
+    }
+
+    return Status::NoError;
+}
+
+Status
+COGImageLayer::closeImplementation()
+{
+    _driver = 0L;
+    dataExtents().clear();
+    return ImageLayer::closeImplementation();
+}
+
+GeoImage
+COGImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
+{
+    osg::ref_ptr<COG::Driver> driver = _driver.get();
+    osg::ref_ptr<osg::Image> image;
+    if (driver.valid())
+    {
+        image = driver->createImage(key, options().tileSize().get(), progress);
+    }
+    return GeoImage(image.get(), key.getExtent());
+}
+
+//........................................................................
+
+Config
+COGElevationLayer::Options::getConfig() const
+{
+    Config conf = ElevationLayer::Options::getConfig();
+    writeTo(conf);
+    return conf;
+}
+
+void
+COGElevationLayer::Options::fromConfig(const Config& conf)
+{
+    readFrom(conf);
+}
+
+//........................................................................
+
+REGISTER_OSGEARTH_LAYER(cogelevation, COGElevationLayer);
+
+OE_LAYER_PROPERTY_IMPL(COGElevationLayer, URI, URL, url);
+OE_LAYER_PROPERTY_IMPL(COGElevationLayer, RasterInterpolation, Interpolation, interpolation);
+OE_LAYER_PROPERTY_IMPL(COGElevationLayer, unsigned, MaxRangeGap, maxRangeGap);
+OE_LAYER_PROPERTY_IMPL(COGElevationLayer, unsigned, BlockCacheSize, blockCacheSize);
+
+void
+COGElevationLayer::init()
+{
+    ElevationLayer::init();
+}
+
+Status
+COGElevationLayer::openImplementation()
+{
+    Status parent = ElevationLayer::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    CacheBin* bin = 0L;
+    CacheSettings* cacheSettings = getCacheSettings();
+    if (cacheSettings && cacheSettings->isCacheEnabled() && cacheSettings->cachePolicy()->isCacheWriteable())
+    {
+        bin = cacheSettings->getCacheBin();
+    }
+
+    osg::ref_ptr<const Profile> profile = getProfile();
+
+    _driver = new COG::Driver();
+    Status status = _driver->open(
+        getName(),
+        options(),
+        options().tileSize().get(),
+        profile,
+        dataExtents(),
+        bin,
+        getReadOptions());
+
+    if (status.isError())
+        return status;
+
+    if (profile.get() != getProfile())
+    {
+        setProfile(profile.get());
+    }
+
+    return Status::NoError;
+}
+
+Status
+COGElevationLayer::closeImplementation()
+{
+    _driver = 0L;
+    dataExtents().clear();
+    return ElevationLayer::closeImplementation();
+}
+
+GeoHeightField
+COGElevationLayer::createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const
+{
+    osg::ref_ptr<COG::Driver> driver = _driver.get();
+    osg::ref_ptr<osg::HeightField> heightfield;
+    if (driver.valid())
+    {
+        heightfield = driver->createHeightField(key, options().tileSize().get(), progress);
+    }
+    return GeoHeightField(heightfield.get(), key.getExtent());
+}
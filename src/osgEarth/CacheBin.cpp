@@ -267,6 +267,36 @@ CacheBin::writeNode(const std::string&    key,
     return true;
 }
 
+void
+CacheBin::readMany(const std::vector<std::string>& keys,
+                   ReadType                        type,
+                   std::vector<ReadResult>&        output,
+                   const osgDB::Options*           readOptions)
+{
+    output.clear();
+    output.reserve(keys.size());
+
+    for (std::vector<std::string>::const_iterator key = keys.begin(); key != keys.end(); ++key)
+    {
+        output.push_back(type == READ_IMAGE ?
+            readImage(*key, readOptions) :
+            readObject(*key, readOptions));
+    }
+}
+
+bool
+CacheBin::writeBatch(const WriteRecords&   records,
+                     const osgDB::Options* writeOptions)
+{
+    bool ok = true;
+    for (WriteRecords::const_iterator r = records.begin(); r != records.end(); ++r)
+    {
+        if (!write(r->_key, r->_object.get(), r->_metadata, writeOptions))
+            ok = false;
+    }
+    return ok;
+}
+
 
 #undef  LC
 #define LC "[ReadImageFromCachePseudoLoader] "
@@ -0,0 +1,380 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/CacheCodec>
+#include <osgEarth/Notify>
+#include <osgDB/Registry>
+#include <osgDB/ObjectWrapper>
+#include <osg/Image>
+#include <osg/Shape>
+#include <sstream>
+#include <iterator>
+#include <cstring>
+
+using namespace osgEarth;
+
+#define LC "[CacheCodec] "
+
+namespace
+{
+    // Tag at the start of every encoded record. An osgb stream can't start
+    // with it, so untagged records are left to the osgb reader.
+    const char     MAGIC[8] = { 'O','E','C','O','D','E','C', 1 };
+    const unsigned MAGIC_SIZE = sizeof(MAGIC);
+
+    enum Kind
+    {
+        KIND_IMAGE_FILE  = 1,   // image file written by an image ReaderWriter
+        KIND_IMAGE_RAW   = 2,   // image pixels packed by a compressor
+        KIND_HEIGHTFIELD = 3    // heightfield samples packed by a compressor
+    };
+
+    // Records are only read on the machine that wrote them, so values
+    // go in native byte order.
+    template<typename T>
+    void put(std::ostream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool get(std::istream& in, T& value)
+    {
+        in.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return in.good();
+    }
+
+    osgDB::BaseCompressor* findCompressor(const std::string& codec)
+    {
+        return osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor(codec);
+    }
+
+    // Groups the bytes of each sample by significance (byte 0 of all the
+    // samples, then byte 1, etc.), which makes float and 16-bit data
+    // much easier for a general purpose compressor to pack.
+    void shuffle(const unsigned char* in, unsigned size, unsigned elementSize, std::string& out)
+    {
+        out.resize(size);
+        unsigned count = size / elementSize;
+        for (unsigned b = 0; b < elementSize; ++b)
+            for (unsigned i = 0; i < count; ++i)
+                out[b*count + i] = (char)in[i*elementSize + b];
+
+        // any leftover bytes go at the end as-is
+        for (unsigned i = count*elementSize; i < size; ++i)
+            out[i] = (char)in[i];
+    }
+
+    void unshuffle(const std::string& in, unsigned elementSize, unsigned char* out)
+    {
+        unsigned size = in.size();
+        unsigned count = size / elementSize;
+        for (unsigned b = 0; b < elementSize; ++b)
+            for (unsigned i = 0; i < count; ++i)
+                out[i*elementSize + b] = (unsigned char)in[b*count + i];
+
+        for (unsigned i = count*elementSize; i < size; ++i)
+            out[i] = (unsigned char)in[i];
+    }
+
+    unsigned getBytesPerComponent(const osg::Image* image)
+    {
+        unsigned components = osg::Image::computeNumComponents(image->getPixelFormat());
+        unsigned bits = osg::Image::computePixelSizeInBits(image->getPixelFormat(), image->getDataType());
+        unsigned bytes = components > 0u ? bits / (8u * components) : 0u;
+        return bytes > 0u ? bytes : 1u;
+    }
+
+    // An image we can pack sample by sample
+    bool isPlainImage(const osg::Image* image)
+    {
+        return
+            image->data() != 0L &&
+            !image->isCompressed() &&
+            !image->isMipmap() &&
+            image->isDataContiguous();
+    }
+
+    void writeHeader(std::ostream& out, const std::string& codec, Kind kind)
+    {
+        out.write(MAGIC, MAGIC_SIZE);
+        put(out, (unsigned char)codec.size());
+        out.write(codec.c_str(), codec.size());
+        put(out, (unsigned char)kind);
+    }
+
+    bool encodeImageFile(const osg::Image* image, const std::string& codec, osgDB::ReaderWriter* rw, std::ostream& out, const osgDB::Options* writeOptions)
+    {
+        // Image file formats are for 8-bit color imagery.
+        if (!isPlainImage(image) ||
+            image->r() != 1 ||
+            image->getDataType() != GL_UNSIGNED_BYTE ||
+            (image->getPixelFormat() != GL_RGB && image->getPixelFormat() != GL_RGBA))
+        {
+            return false;
+        }
+
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult r = rw->writeImage(*image, buf, writeOptions);
+        if (!r.success())
+            return false;
+
+        writeHeader(out, codec, KIND_IMAGE_FILE);
+        put(out, (unsigned char)image->getOrigin());
+        put(out, (int)image->getInternalTextureFormat());
+        out << buf.rdbuf();
+        return true;
+    }
+
+    bool encodeImageRaw(const osg::Image* image, const std::string& codec, osgDB::BaseCompressor* compressor, std::ostream& out)
+    {
+        if (!isPlainImage(image))
+            return false;
+
+        unsigned elementSize = getBytesPerComponent(image);
+        std::string samples;
+        shuffle(image->data(), image->getTotalSizeInBytes(), elementSize, samples);
+
+        std::stringstream buf;
+        if (!compressor->compress(buf, samples))
+            return false;
+
+        writeHeader(out, codec, KIND_IMAGE_RAW);
+        put(out, (unsigned)image->s());
+        put(out, (unsigned)image->t());
+        put(out, (unsigned)image->r());
+        put(out, (int)image->getInternalTextureFormat());
+        put(out, (unsigned)image->getPixelFormat());
+        put(out, (unsigned)image->getDataType());
+        put(out, (unsigned)image->getPacking());
+        put(out, (unsigned char)image->getOrigin());
+        put(out, (unsigned char)elementSize);
+        out << buf.rdbuf();
+        return true;
+    }
+
+    bool encodeHeightField(const osg::HeightField* hf, const std::string& codec, osgDB::BaseCompressor* compressor, std::ostream& out)
+    {
+        const osg::HeightField::HeightList& heights = hf->getHeightList();
+        if (heights.empty() || heights.size() != hf->getNumColumns()*hf->getNumRows())
+            return false;
+
+        std::string samples;
+        shuffle(reinterpret_cast<const unsigned char*>(&heights[0]), heights.size()*sizeof(float), sizeof(float), samples);
+
+        std::stringstream buf;
+        if (!compressor->compress(buf, samples))
+            return false;
+
+        writeHeader(out, codec, KIND_HEIGHTFIELD);
+        put(out, (unsigned)hf->getNumColumns());
+        put(out, (unsigned)hf->getNumRows());
+        put(out, (double)hf->getOrigin().x());
+        put(out, (double)hf->getOrigin().y());
+        put(out, (double)hf->getOrigin().z());
+        put(out, (float)hf->getXInterval());
+        put(out, (float)hf->getYInterval());
+        put(out, (float)hf->getSkirtHeight());
+        put(out, (unsigned)hf->getBorderWidth());
+        out << buf.rdbuf();
+        return true;
+    }
+
+    osg::Image* decodeImageFile(std::istream& in, osgDB::ReaderWriter* rw, const osgDB::Options* readOptions)
+    {
+        unsigned char origin;
+        int internalFormat;
+        if (!get(in, origin) || !get(in, internalFormat))
+            return 0L;
+
+        // readers may seek around, so give them a stream of their own
+        std::string payload((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::istringstream payloadStream(payload);
+
+        osgDB::ReaderWriter::ReadResult r = rw->readImage(payloadStream, readOptions);
+        if (!r.success() || !r.getImage())
+            return 0L;
+
+        osg::Image* image = r.takeImage();
+        image->setOrigin((osg::Image::Origin)origin);
+        image->setInternalTextureFormat(internalFormat);
+        return image;
+    }
+
+    osg::Image* decodeImageRaw(std::istream& in, osgDB::BaseCompressor* compressor)
+    {
+        unsigned s, t, r, pixelFormat, dataType, packing;
+        int internalFormat;
+        unsigned char origin, elementSize;
+        if (!get(in, s) || !get(in, t) || !get(in, r) ||
+            !get(in, internalFormat) || !get(in, pixelFormat) || !get(in, dataType) || !get(in, packing) ||
+            !get(in, origin) || !get(in, elementSize) || elementSize == 0)
+        {
+            return 0L;
+        }
+
+        std::string samples;
+        if (!compressor->decompress(in, samples))
+            return 0L;
+
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(s, t, r, pixelFormat, dataType, packing);
+        if (image->data() == 0L || image->getTotalSizeInBytes() != samples.size())
+            return 0L;
+
+        unshuffle(samples, elementSize, image->data());
+        image->setInternalTextureFormat(internalFormat);
+        image->setOrigin((osg::Image::Origin)origin);
+        return image.release();
+    }
+
+    osg::HeightField* decodeHeightField(std::istream& in, osgDB::BaseCompressor* compressor)
+    {
+        unsigned cols, rows, borderWidth;
+        double x, y, z;
+        float xInterval, yInterval, skirtHeight;
+        if (!get(in, cols) || !get(in, rows) ||
+            !get(in, x) || !get(in, y) || !get(in, z) ||
+            !get(in, xInterval) || !get(in, yInterval) || !get(in, skirtHeight) ||
+            !get(in, borderWidth))
+        {
+            return 0L;
+        }
+
+        std::string samples;
+        if (!compressor->decompress(in, samples))
+            return 0L;
+
+        if (samples.size() != cols*rows*sizeof(float))
+            return 0L;
+
+        osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+        hf->allocate(cols, rows);
+        unshuffle(samples, sizeof(float), reinterpret_cast<unsigned char*>(&hf->getHeightList()[0]));
+        hf->setOrigin(osg::Vec3(x, y, z));
+        hf->setXInterval(xInterval);
+        hf->setYInterval(yInterval);
+        hf->setSkirtHeight(skirtHeight);
+        hf->setBorderWidth(borderWidth);
+        return hf.release();
+    }
+}
+
+bool
+CacheCodec::encode(const osg::Object*    object,
+                   const std::string&    codec,
+                   std::ostream&         out,
+                   const osgDB::Options* writeOptions)
+{
+    if (!object || codec.empty() || codec.size() > 255u)
+        return false;
+
+    const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+    const osg::HeightField* hf = image ? 0L : dynamic_cast<const osg::HeightField*>(object);
+    if (!image && !hf)
+        return false;
+
+    osgDB::BaseCompressor* compressor = findCompressor(codec);
+    if (compressor)
+    {
+        return image ?
+            encodeImageRaw(image, codec, compressor, out) :
+            encodeHeightField(hf, codec, compressor, out);
+    }
+
+    if (image)
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(codec);
+        if (rw)
+            return encodeImageFile(image, codec, rw, out, writeOptions);
+    }
+
+    return false;
+}
+
+bool
+CacheCodec::isEncoded(const char* data, unsigned length)
+{
+    return length >= MAGIC_SIZE && ::memcmp(data, MAGIC, MAGIC_SIZE) == 0;
+}
+
+bool
+CacheCodec::isEncoded(std::istream& in)
+{
+    char buf[MAGIC_SIZE];
+    std::streampos start = in.tellg();
+    in.read(buf, MAGIC_SIZE);
+    bool encoded = in.gcount() == (std::streamsize)MAGIC_SIZE && isEncoded(buf, MAGIC_SIZE);
+    in.clear();
+    in.seekg(start);
+    return encoded;
+}
+
+osg::Object*
+CacheCodec::decode(std::istream& in, const osgDB::Options* readOptions)
+{
+    char magic[MAGIC_SIZE];
+    in.read(magic, MAGIC_SIZE);
+    if (in.gcount() != (std::streamsize)MAGIC_SIZE || !isEncoded(magic, MAGIC_SIZE))
+        return 0L;
+
+    unsigned char nameLength, kind;
+    if (!get(in, nameLength))
+        return 0L;
+
+    std::string codec(nameLength, ' ');
+    if (nameLength > 0u)
+        in.read(&codec[0], nameLength);
+
+    if (!get(in, kind))
+        return 0L;
+
+    if (kind == KIND_IMAGE_FILE)
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(codec);
+        if (!rw)
+        {
+            OE_WARN << LC << "No reader for codec \"" << codec << "\"" << std::endl;
+            return 0L;
+        }
+        return decodeImageFile(in, rw, readOptions);
+    }
+
+    osgDB::BaseCompressor* compressor = findCompressor(codec);
+    if (!compressor)
+    {
+        OE_WARN << LC << "No compressor for codec \"" << codec << "\"" << std::endl;
+        return 0L;
+    }
+
+    if (kind == KIND_IMAGE_RAW)
+        return decodeImageRaw(in, compressor);
+    else if (kind == KIND_HEIGHTFIELD)
+        return decodeHeightField(in, compressor);
+    else
+        return 0L;
+}
+
+bool
+CacheCodec::isAvailable(const std::string& codec)
+{
+    return
+        !codec.empty() &&
+        (findCompressor(codec) != 0L ||
+         osgDB::Registry::instance()->getReaderWriterForExtension(codec) != 0L);
+}
@@ -19,13 +19,23 @@
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/Registry>
 #include <osgEarth/TileKey>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/JobArena>
+#include <osgEarth/Random>
+#include <osgDB/Registry>
+#include <osg/Timer>
+#include <algorithm>
+#include <climits>
+#include <sstream>
 
 using namespace osgEarth;
 
 CacheEstimator::CacheEstimator():
 _minLevel (0),
 _maxLevel (12),
-_profile( osgEarth::Registry::instance()->getGlobalGeodeticProfile() )
+_profile( osgEarth::Registry::instance()->getGlobalGeodeticProfile() ),
+_samplesPerLevel( 32 )
 {    
     // By default we can give them a somewhat worse case estimate since it's going to be next to impossible to know what the real size of the data is going to be due to the fact that it's 
     // dependant on the dataset itself as well as compression.  So lets just default to about 130 kb per tile to start with.
@@ -43,48 +53,398 @@ CacheEstimator::addExtent( const GeoExtent& value)
     _extents.push_back( value );
 }
 
-unsigned int
-CacheEstimator::getNumTiles() const
+namespace
 {
-    unsigned int total = 0;
+    // Inclusive range of tiles at one level
+    struct TileRange
+    {
+        unsigned x0, y0, x1, y1;
+    };
+
+    // Counts the tiles covered by the union of the ranges, without double-counting
+    // overlaps: sweep across the distinct column boundaries and merge the row spans
+    // that cover each band of columns.
+    double countTiles(const std::vector<TileRange>& ranges)
+    {
+        std::vector<double> xs;
+        for (std::vector<TileRange>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+        {
+            xs.push_back(r->x0);
+            xs.push_back((double)r->x1 + 1.0);
+        }
+        std::sort(xs.begin(), xs.end());
+        xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
 
-    GeoExtent extentsUnion;
-    for (std::vector< GeoExtent >::const_iterator itr = _extents.begin(); itr != _extents.end(); ++itr)
-        extentsUnion.expandToInclude(*itr);
+        double total = 0.0;
+        std::vector< std::pair<double, double> > spans;
 
-    for (unsigned int level = _minLevel; level <= _maxLevel; level++)
+        for (unsigned i = 0; i + 1 < xs.size(); ++i)
+        {
+            spans.clear();
+            for (std::vector<TileRange>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+            {
+                if ((double)r->x0 <= xs[i] && (double)r->x1 + 1.0 >= xs[i+1])
+                    spans.push_back(std::make_pair((double)r->y0, (double)r->y1 + 1.0));
+            }
+            if (spans.empty())
+                continue;
+
+            std::sort(spans.begin(), spans.end());
+
+            double rows = 0.0;
+            double start = spans[0].first, end = spans[0].second;
+            for (unsigned j = 1; j < spans.size(); ++j)
+            {
+                if (spans[j].first > end)
+                {
+                    rows += end - start;
+                    start = spans[j].first;
+                }
+                end = osg::maximum(end, spans[j].second);
+            }
+            rows += end - start;
+
+            total += rows * (xs[i+1] - xs[i]);
+        }
+
+        return total;
+    }
+
+    // the extents, in the profile's SRS
+    void getProfileExtents(const Profile* profile, const std::vector<GeoExtent>& in, std::vector<GeoExtent>& out)
     {
-        if (_extents.empty())
+        for (std::vector<GeoExtent>::const_iterator itr = in.begin(); itr != in.end(); ++itr)
         {
-            unsigned int wide, high;
-            _profile->getNumTiles( level, wide, high );
-            total += (wide * high);
+            GeoExtent extent = profile->clampAndTransformExtent(*itr);
+            if (extent.isValid())
+                out.push_back(extent);
         }
-        else
+    }
+
+    // the tiles each extent overlaps at a level
+    void getTileRanges(const Profile* profile, const std::vector<GeoExtent>& extents, unsigned level, std::vector<TileRange>& ranges)
+    {
+        const GeoExtent& pe = profile->getExtent();
+
+        unsigned int wide, high;
+        profile->getNumTiles( level, wide, high );
+
+        double tileWidth, tileHeight;
+        profile->getTileDimensions(level, tileWidth, tileHeight);
+
+        for (std::vector<GeoExtent>::const_iterator e = extents.begin(); e != extents.end(); ++e)
         {
-            TileKey ll = _profile->createTileKey(extentsUnion.xMin(), extentsUnion.yMin(), level);
-            TileKey ur = _profile->createTileKey(extentsUnion.xMax(), extentsUnion.yMax(), level);
-
-            if (!ll.valid() || !ur.valid()) continue;
-                
-            int tilesWide = ur.getTileX() - ll.getTileX() + 1;
-            int tilesHigh = ll.getTileY() - ur.getTileY() + 1;
-            int tilesAtLevel = tilesWide * tilesHigh;                
-            total += tilesAtLevel;
+            TileRange r;
+            r.x0 = (unsigned)osg::clampBetween(floor((e->xMin() - pe.xMin()) / tileWidth), 0.0, (double)(wide-1));
+            r.x1 = (unsigned)osg::clampBetween(ceil ((e->xMax() - pe.xMin()) / tileWidth) - 1.0, (double)r.x0, (double)(wide-1));
+            r.y0 = (unsigned)osg::clampBetween(floor((pe.yMax() - e->yMax()) / tileHeight), 0.0, (double)(high-1));
+            r.y1 = (unsigned)osg::clampBetween(ceil ((pe.yMax() - e->yMin()) / tileHeight) - 1.0, (double)r.y0, (double)(high-1));
+            ranges.push_back(r);
         }
     }
-    return total;
+
+    // size of an object in the cache's native (osgb) encoding, in MB
+    double getEncodedSizeInMB(const osg::Object* object)
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+        if (!rw || !object)
+            return 0.0;
+
+        std::stringstream buf;
+        const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+        osgDB::ReaderWriter::WriteResult wr = image ?
+            rw->writeImage(*image, buf) :
+            rw->writeObject(*object, buf);
+
+        return wr.success() ? (double)buf.str().size() / 1048576.0 : 0.0;
+    }
+
+    // Creates a list of tiles from a layer, sharing the work with the job arena.
+    struct SampleGroup : public osg::Referenced
+    {
+        struct Result
+        {
+            Result() : _empty(true), _sizeInMB(0.0), _seconds(0.0) { }
+            bool _empty;
+            double _sizeInMB;
+            double _seconds;
+        };
+
+        SampleGroup(TileLayer* layer, ProgressCallback* progress) :
+            _layer(layer), _progress(progress), _next(0u), _remaining(0u), _completed(0u) { }
+
+        void work(unsigned i)
+        {
+            const TileKey& key = _keys[i];
+            Result& result = _results[i];
+
+            // known-empty tiles (outside the layer's data extents) cost nothing:
+            if (!_layer->mayHaveData(key))
+                return;
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            osg::ref_ptr<const osg::Object> data;
+            if (ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(_layer.get()))
+            {
+                GeoImage image = imageLayer->createImage(key, _progress.get());
+                if (image.valid())
+                    data = image.getImage();
+            }
+            else if (ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(_layer.get()))
+            {
+                GeoHeightField hf = elevationLayer->createHeightField(key, _progress.get());
+                if (hf.valid())
+                    data = hf.getHeightField();
+            }
+
+            result._seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            if (data.valid())
+            {
+                result._empty = false;
+                result._sizeInMB = getEncodedSizeInMB(data.get());
+            }
+        }
+
+        void run()
+        {
+            unsigned count = _keys.size();
+            for(;;)
+            {
+                unsigned n = (++_next) - 1u;
+                if (n >= count)
+                    break;
+
+                if (!(_progress.valid() && _progress->isCanceled()))
+                {
+                    work(n);
+
+                    if (_progress.valid())
+                        _progress->reportProgress((double)(++_completed), (double)count);
+                }
+
+                if (--_remaining == 0u)
+                    _done.set();
+            }
+        }
+
+        void runAndWait()
+        {
+            unsigned count = _keys.size();
+            if (count == 0u)
+                return;
+
+            _results.resize(count);
+            _remaining.exchange(count);
+
+            JobArena* arena = JobArena::get("oe.cacheestimator");
+            unsigned numHelpers = osg::minimum(arena->getConcurrency(), count - 1u);
+            for (unsigned i = 0; i < numHelpers; ++i)
+            {
+                arena->dispatch(new SampleTask(this));
+            }
+            run();
+            _done.wait();
+        }
+
+        struct SampleTask : public TaskRequest
+        {
+            SampleTask(SampleGroup* group) : _group(group) { }
+
+            void operator()(ProgressCallback*)
+            {
+                _group->run();
+            }
+
+            osg::ref_ptr<SampleGroup> _group;
+        };
+
+        osg::ref_ptr<TileLayer> _layer;
+        osg::ref_ptr<ProgressCallback> _progress;
+        std::vector<TileKey> _keys;
+        std::vector<Result> _results;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        OpenThreads::Atomic _completed;
+        Threading::Event _done;
+    };
+}
+
+double
+CacheEstimator::getNumTiles(unsigned level) const
+{
+    if (_extents.empty())
+    {
+        unsigned int wide, high;
+        _profile->getNumTiles( level, wide, high );
+        return (double)wide * (double)high;
+    }
+
+    std::vector<GeoExtent> extents;
+    getProfileExtents(_profile.get(), _extents, extents);
+
+    std::vector<TileRange> ranges;
+    getTileRanges(_profile.get(), extents, level, ranges);
+    return countTiles(ranges);
+}
+
+unsigned int
+CacheEstimator::getNumTiles() const
+{
+    double total = 0.0;
+    for (unsigned int level = _minLevel; level <= _maxLevel; level++)
+    {
+        total += getNumTiles(level);
+    }
+
+    return (unsigned int)osg::minimum(total, (double)UINT_MAX);
 }
 
 double CacheEstimator::getSizeInMB() const
 {
-    return getNumTiles() * _sizeInMBPerTile;
+    if (_samples.empty())
+        return getNumTiles() * _sizeInMBPerTile;
+
+    double total = 0.0;
+    for (std::vector<LevelSample>::const_iterator ls = _samples.begin(); ls != _samples.end(); ++ls)
+    {
+        total += ls->_count > 0u ?
+            ls->_numTiles * ls->_sumMB / (double)ls->_count :
+            ls->_numTiles * _sizeInMBPerTile;
+    }
+    return total;
+}
+
+double CacheEstimator::getSizeInMBError() const
+{
+    // each level is a simple random sample, so the variance of its total
+    // is N^2 * s^2 / n, with the finite population correction.
+    double variance = 0.0;
+    for (std::vector<LevelSample>::const_iterator ls = _samples.begin(); ls != _samples.end(); ++ls)
+    {
+        if (ls->_count < 2u)
+            continue;
+
+        double n = (double)ls->_count;
+        double s2 = osg::maximum(0.0, (ls->_sumMB2 - ls->_sumMB * ls->_sumMB / n) / (n - 1.0));
+        double fpc = osg::maximum(0.0, 1.0 - n / ls->_numTiles);
+        variance += ls->_numTiles * ls->_numTiles * s2 / n * fpc;
+    }
+    return 1.96 * sqrt(variance);
+}
+
+double CacheEstimator::getNumTilesWithData() const
+{
+    if (_samples.empty())
+        return getNumTiles();
+
+    double total = 0.0;
+    for (std::vector<LevelSample>::const_iterator ls = _samples.begin(); ls != _samples.end(); ++ls)
+    {
+        total += ls->_count > 0u ?
+            ls->_numTiles * (double)(ls->_count - ls->_empty) / (double)ls->_count :
+            ls->_numTiles;
+    }
+    return total;
 }
 
 double CacheEstimator::getTotalTimeInSeconds() const
 {
-    return getNumTiles() * _timeInSecondsPerTile;
+    if (_samples.empty())
+        return getNumTiles() * _timeInSecondsPerTile;
+
+    double total = 0.0;
+    for (std::vector<LevelSample>::const_iterator ls = _samples.begin(); ls != _samples.end(); ++ls)
+    {
+        total += ls->_count > 0u ?
+            ls->_numTiles * ls->_sumSeconds / (double)ls->_count :
+            ls->_numTiles * _timeInSecondsPerTile;
+    }
+    return total;
 }
 
+bool
+CacheEstimator::sample(ProgressCallback* progress)
+{
+    if (!_layer.valid() || !_layer->isOpen() || _maxLevel < _minLevel)
+        return false;
+
+    std::vector<GeoExtent> extents;
+    getProfileExtents(_profile.get(), _extents, extents);
 
+    osg::ref_ptr<SampleGroup> group = new SampleGroup(_layer.get(), progress);
+
+    std::vector<LevelSample> samples(_maxLevel - _minLevel + 1u);
+
+    std::vector<TileRange> ranges;
+    std::vector<double> cumulative;
+
+    for (unsigned int level = _minLevel; level <= _maxLevel; level++)
+    {
+        LevelSample& ls = samples[level - _minLevel];
+        ls._numTiles = getNumTiles(level);
+        ls._count = 0u;
+        ls._empty = 0u;
+        ls._sumMB = 0.0;
+        ls._sumMB2 = 0.0;
+        ls._sumSeconds = 0.0;
 
+        ranges.clear();
+        if (_extents.empty())
+        {
+            unsigned int wide, high;
+            _profile->getNumTiles(level, wide, high);
+            TileRange r = { 0u, 0u, wide - 1u, high - 1u };
+            ranges.push_back(r);
+        }
+        else
+        {
+            getTileRanges(_profile.get(), extents, level, ranges);
+        }
+
+        if (ranges.empty())
+            continue;
+
+        // pick a range in proportion to its size, then a tile within it.
+        // (tiles under overlapping extents are slightly more likely to be picked.)
+        cumulative.clear();
+        double area = 0.0;
+        for (std::vector<TileRange>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+        {
+            area += ((double)r->x1 - (double)r->x0 + 1.0) * ((double)r->y1 - (double)r->y0 + 1.0);
+            cumulative.push_back(area);
+        }
+
+        Random rng(level + 1u);
+        unsigned numSamples = (unsigned)osg::minimum((double)_samplesPerLevel, ls._numTiles);
+        for (unsigned i = 0; i < numSamples; ++i)
+        {
+            unsigned index = std::lower_bound(cumulative.begin(), cumulative.end(), rng.next() * area) - cumulative.begin();
+            const TileRange& r = ranges[osg::minimum(index, (unsigned)ranges.size() - 1u)];
+            unsigned x = r.x0 + rng.next(r.x1 - r.x0 + 1u);
+            unsigned y = r.y0 + rng.next(r.y1 - r.y0 + 1u);
+            group->_keys.push_back(TileKey(level, x, y, _profile.get()));
+        }
+    }
+
+    group->runAndWait();
+
+    if (progress && progress->isCanceled())
+        return false;
+
+    for (unsigned i = 0; i < group->_keys.size(); ++i)
+    {
+        LevelSample& ls = samples[group->_keys[i].getLOD() - _minLevel];
+        const SampleGroup::Result& result = group->_results[i];
+        ls._count++;
+        if (result._empty)
+            ls._empty++;
+        ls._sumMB += result._sizeInMB;
+        ls._sumMB2 += result._sizeInMB * result._sizeInMB;
+        ls._sumSeconds += result._seconds;
+    }
+
+    _samples.swap(samples);
+    return true;
+}
@@ -34,7 +34,8 @@ CachePolicy CachePolicy::CACHE_ONLY( CachePolicy::USAGE_CACHE_ONLY );
 CachePolicy::CachePolicy() :
 _usage  ( USAGE_READ_WRITE ),
 _maxAge ( INT_MAX ),
-_minTime( 0 )
+_minTime( 0 ),
+_staleWhileRevalidate( false )
 {
     //nop
 }
@@ -42,7 +43,8 @@ _minTime( 0 )
 CachePolicy::CachePolicy( const Usage& usage ) :
 _usage  ( usage ),
 _maxAge ( INT_MAX ),
-_minTime( 0 )
+_minTime( 0 ),
+_staleWhileRevalidate( false )
 {
     _usage = usage; // explicity set the optional<>
 }
@@ -50,7 +52,8 @@ _minTime( 0 )
 CachePolicy::CachePolicy( const Config& conf ) :
 _usage  ( USAGE_READ_WRITE ),
 _maxAge ( INT_MAX ),
-_minTime( 0 )
+_minTime( 0 ),
+_staleWhileRevalidate( false )
 {
     fromConfig( conf );
 }
@@ -58,7 +61,8 @@ _minTime( 0 )
 CachePolicy::CachePolicy(const CachePolicy& rhs) :
 _usage  ( rhs._usage ),
 _maxAge ( rhs._maxAge ),
-_minTime( rhs._minTime )
+_minTime( rhs._minTime ),
+_staleWhileRevalidate( rhs._staleWhileRevalidate )
 {
     //nop
 }
@@ -74,6 +78,9 @@ CachePolicy::mergeAndOverride(const CachePolicy& rhs)
 
     if ( rhs.maxAge().isSet() )
         maxAge() = rhs.maxAge().get();
+
+    if ( rhs.staleWhileRevalidate().isSet() )
+        staleWhileRevalidate() = rhs.staleWhileRevalidate().get();
 }
 
 void
@@ -106,7 +113,8 @@ CachePolicy::operator == (const CachePolicy& rhs) const
     return 
         (_usage.get() == rhs._usage.get()) &&
         (_maxAge.get() == rhs._maxAge.get()) &&
-        (_minTime.get() == rhs._minTime.get());
+        (_minTime.get() == rhs._minTime.get()) &&
+        (_staleWhileRevalidate.get() == rhs._staleWhileRevalidate.get());
 }
 
 CachePolicy&
@@ -115,6 +123,7 @@ CachePolicy::operator = ( const CachePolicy& rhs )
     _usage  = optional<Usage>(rhs._usage);
     _maxAge = optional<TimeSpan>(rhs._maxAge);
     _minTime = optional<TimeStamp>(rhs._minTime);
+    _staleWhileRevalidate = optional<bool>(rhs._staleWhileRevalidate);
 
     return *this;
 }
@@ -132,7 +141,7 @@ CachePolicy::usageString() const
 bool
 CachePolicy::empty() const
 {
-    bool isSet = _usage.isSet() || _maxAge.isSet() || _minTime.isSet();
+    bool isSet = _usage.isSet() || _maxAge.isSet() || _minTime.isSet() || _staleWhileRevalidate.isSet();
     return !isSet;
 }
 
@@ -146,6 +155,7 @@ CachePolicy::fromConfig( const Config& conf )
     conf.get( "usage", "none",         _usage, USAGE_NO_CACHE );
     conf.get( "max_age", _maxAge );
     conf.get( "min_time", _minTime );
+    conf.get( "stale_while_revalidate", _staleWhileRevalidate );
 }
 
 Config
@@ -158,5 +168,6 @@ CachePolicy::getConfig() const
     conf.set( "usage", "no_cache",     _usage, USAGE_NO_CACHE );
     conf.set( "max_age", _maxAge );
     conf.set( "min_time", _minTime );
+    conf.set( "stale_while_revalidate", _staleWhileRevalidate );
     return conf;
 }
@@ -21,6 +21,7 @@
 */
 #include <osgEarth/CameraUtils>
 #include <osg/Camera>
+#include <osg/ValueObject>
 
 #define LC "[CameraUtils] "
 
@@ -56,3 +57,18 @@ CameraUtils::isDepthCamera(const osg::Camera* camera)
     const osg::StateSet* ss = camera->getStateSet();
     return ss && ss->getDefinePair("OE_IS_DEPTH_CAMERA") != 0L;
 }
+
+void
+CameraUtils::setTerrainCullGroup(osg::Camera* camera, unsigned groupID)
+{
+    camera->setUserValue("osgEarth.TerrainCullGroup", groupID);
+}
+
+unsigned
+CameraUtils::getTerrainCullGroup(const osg::Camera* camera)
+{
+    unsigned groupID = 0u;
+    if (camera)
+        camera->getUserValue("osgEarth.TerrainCullGroup", groupID);
+    return groupID;
+}
@@ -183,7 +183,8 @@ _resources(resources),
 _constrainMaxYToFrustum(false),
 _constrainRttBoxToDrapingSetBounds(true),
 _useProjectionFitting(true),
-_minNearFarRatio(0.25)
+_minNearFarRatio(0.25),
+_cascadeReuseTolerance(0.05)
 {
     if (::getenv("OSGEARTH_DRAPING_DEBUG"))
         _debug = true;
@@ -221,6 +222,10 @@ _minNearFarRatio(0.25)
     c = ::getenv("OSGEARTH_DRAPING_USE_PROJECTION_FITTING");
     if (c)
         _useProjectionFitting = atoi(c)?true:false;
+
+    c = ::getenv("OSGEARTH_DRAPING_REUSE_TOLERANCE");
+    if (c)
+        setCascadeReuseTolerance(atof(c));
 }
 
 void
@@ -259,6 +264,12 @@ CascadeDrapingDecorator::setMinimumNearFarRatio(double value)
     _minNearFarRatio = value;
 }
 
+void
+CascadeDrapingDecorator::setCascadeReuseTolerance(double value)
+{
+    _cascadeReuseTolerance = osg::maximum(value, 0.0);
+}
+
 void
 CascadeDrapingDecorator::traverse(osg::NodeVisitor& nv)
 {
@@ -625,6 +636,7 @@ CascadeDrapingDecorator::CameraLocal::initialize(osg::Camera* camera, CascadeDra
         // no addChild() because the DrapingCamera will automatically traverse the current cull set
 
         _cascades[i]._rtt = rtt.get();
+        _cascades[i]._rendered = false;
     }
 
     // Set up a stateSet for the terrain that will apply the projected texture.
@@ -752,6 +764,50 @@ void CascadeDrapingDecorator::Cascade::makeProj(double rttFar)
     _rttProj.makeOrtho(_box.xMin(), _box.xMax(), _box.yMin(), _box.yMax(), -rttFar*4, rttFar);
 }
 
+// Whether the texture rendered with _renderedView/_renderedProj can stand in
+// for the newly computed projection. It can if the resolution is about the
+// same and the old projection still covers the entire new region on the
+// horizon plane, so the shader never falls through a gap between cascades.
+bool CascadeDrapingDecorator::Cascade::canReuse(const osg::Matrix& rttView, double dp, double tolerance) const
+{
+    if (!_rendered)
+        return false;
+
+    if (rttView == _renderedView && _rttProj == _renderedProj)
+        return true;
+
+    if (tolerance <= 0.0)
+        return false;
+
+    double oldDepth = _renderedBox.yMax() - _renderedBox.yMin();
+    double newDepth = _box.yMax() - _box.yMin();
+    if (oldDepth <= 0.0 || fabs(newDepth - oldDepth) > oldDepth*tolerance)
+        return false;
+
+    osg::Matrix iRttView, iRttProj;
+    iRttView.invert(rttView);
+    iRttProj.invert(_rttProj);
+    osg::Matrix oldMVP = _renderedView * _renderedProj;
+
+    const double corners[4][2] = { {-1,-1}, {1,-1}, {1,1}, {-1,1} };
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        // unproject the new clip corner onto the horizon plane (view z = -dp):
+        osg::Vec3d a = osg::Vec3d(corners[i][0], corners[i][1], -1.0) * iRttProj;
+        osg::Vec3d b = osg::Vec3d(corners[i][0], corners[i][1], +1.0) * iRttProj;
+        if (osg::equivalent(a.z(), b.z()))
+            return false;
+        osg::Vec3d p = a + (b - a) * ((-dp - a.z()) / (b.z() - a.z()));
+
+        // and see whether it falls inside the old projection:
+        osg::Vec3d oldClip = p * iRttView * oldMVP;
+        if (fabs(oldClip.x()) > 1.0 || fabs(oldClip.y()) > 1.0)
+            return false;
+    }
+
+    return true;
+}
+
 // Computes the "coverage" of the RTT region in normalized [0..1] clip space.
 // If the width and height are 1.0, that means the RTT region will fit exactly 
 // within the camera's viewport. For example, a heightNDC of 3.0 means that the
@@ -1123,18 +1179,42 @@ CascadeDrapingDecorator::CameraLocal::traverse(osgUtil::CullVisitor* cv, Cascade
     ArrayUniform texMat("oe_Draping_texMatrix", osg::Uniform::FLOAT_MAT4, _terrainSS.get(), decorator._maxCascades);
     unsigned i;
 
+    // Cascades whose content and coverage are unchanged keep their texture
+    // from a previous frame. Only the far cascades may drift with the camera;
+    // the first one has to track it exactly.
+    DrapingCullSet& cullSet = decorator._manager.get(camera);
+    unsigned signature = 0u;
+    bool isStatic = cullSet.getSignature(cv->getFrameStamp(), signature);
+    bool reuse[8];
+    bool renderAny = false;
+
     for (i = 0; i < _numCascades; ++i)
     {
         Cascade& cascade = _cascades[i];
         osg::Camera* rtt = cascade._rtt.get();
 
-        // configure the RTT camera's matrices:
-        rtt->setViewMatrix(rttView);
-        rtt->setProjectionMatrix(cascade._rttProj);
+        reuse[i] =
+            isStatic &&
+            cascade._renderedSignature == signature &&
+            cascade.canReuse(rttView, dp, i > 0 ? decorator._cascadeReuseTolerance : 0.0);
+
+        if (!reuse[i])
+        {
+            // configure the RTT camera's matrices:
+            rtt->setViewMatrix(rttView);
+            rtt->setProjectionMatrix(cascade._rttProj);
+
+            cascade._rendered = isStatic;
+            cascade._renderedSignature = signature;
+            cascade._renderedView = rttView;
+            cascade._renderedProj = cascade._rttProj;
+            cascade._renderedBox = cascade._box;
+            renderAny = true;
+        }
 
         // Create the texture matrix that will transform the RTT frame into texture [0..1] space.
         // Doing this on the CPU avoids precision errors on the GPU.
-        texMat.setElement(i, iCamMV * rttView * cascade._rttProj * clipToTex);
+        texMat.setElement(i, iCamMV * cascade._renderedView * cascade._renderedProj * clipToTex);
     }
 
     if (i < _maxCascades)
@@ -1145,16 +1225,20 @@ CascadeDrapingDecorator::CameraLocal::traverse(osgUtil::CullVisitor* cv, Cascade
     }
 
     // traverse and write to the texture.
-    if (_numCascades > 0u)
+    if (renderAny)
     {
         cv->pushStateSet(_rttSS.get());
         for (unsigned i = 0; i < _numCascades; ++i)
         {
             Cascade& c = _cascades[i];
-            c._rtt->accept(*cv);
+            if (!reuse[i])
+                c._rtt->accept(*cv);
         }
         cv->popStateSet(); // _rttSS
     }
+
+    // reset the cull set in case no cascade traversed it
+    cullSet.skip();
 }
 
 void
@@ -125,6 +125,21 @@ void ChromaKeyColorFilter::install(osg::StateSet* stateSet) const
     }
 }
 
+void ChromaKeyColorFilter::apply(osg::Vec4f* colors, unsigned count) const
+{
+    // same as the shader, compared squared to skip the sqrt
+    const osg::Vec3f key = getColor();
+    const float distance = getDistance();
+    const float distance2 = distance * distance;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        osg::Vec4f& c = colors[i];
+        float dr = c.r() - key.x(), dg = c.g() - key.y(), db = c.b() - key.z();
+        if (dr*dr + dg*dg + db*db <= distance2)
+            c.a() = 0.0f;
+    }
+}
+
 
 
 //---------------------------------------------------------------------------
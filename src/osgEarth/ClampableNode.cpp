@@ -26,9 +26,24 @@
 
 using namespace osgEarth;
 
+namespace
+{
+    // GeometryClamper that starts from the node's world matrix, since the
+    // clamped subgraph may sit below transforms the clamper never visits.
+    struct WorldGeometryClamper : public Util::GeometryClamper
+    {
+        WorldGeometryClamper(LocalData& data, const osg::Matrixd& world) : Util::GeometryClamper(data)
+        {
+            _matrixStack.push_back(world);
+        }
+    };
+}
+
 
 ClampableNode::ClampableNode() :
-_mapNodeUpdateRequested(true)
+_mapNodeUpdateRequested(true),
+_staticClamping(false),
+_clampRequested(false)
 {
     // bounding box culling doesn't work on clampable geometry
     // since the GPU will be moving verts. So, disable the default culling
@@ -39,10 +54,109 @@ _mapNodeUpdateRequested(true)
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
 }
 
+void
+ClampableNode::setStaticClamping(bool value)
+{
+    if (value == _staticClamping)
+        return;
+
+    _staticClamping = value;
+
+    // statically clamped verts are where they appear, so normal culling works:
+    setCullingActive(_staticClamping);
+
+    if (_staticClamping)
+    {
+        requestClamp();
+    }
+    else
+    {
+        // restore the original verts and go back to GPU clamping:
+        Util::GeometryClamper clamper(_clamperData);
+        clamper.setRevert(true);
+        this->accept(clamper);
+        _clamperData.clear();
+
+        osg::ref_ptr<MapNode> mapNode;
+        if (_clampCallback.valid() && _mapNode.lock(mapNode) && mapNode->getTerrain())
+        {
+            mapNode->getTerrain()->removeTerrainCallback(_clampCallback.get());
+        }
+        _clampCallback = 0L;
+    }
+}
+
+void
+ClampableNode::requestClamp()
+{
+    if (!_clampRequested)
+    {
+        _clampRequested = true;
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+}
+
+void
+ClampableNode::onTileUpdate(const TileKey& key, osg::Node* graph, TerrainCallbackContext& context)
+{
+    if (!_staticClamping || _clampRequested)
+        return;
+
+    bool needsClamp;
+
+    if (key.valid())
+    {
+        osg::Polytope tope;
+        key.getExtent().createPolytope(tope);
+        needsClamp = tope.contains(this->getBound());
+    }
+    else
+    {
+        // without a valid tilekey we don't know the extent of the change,
+        // so clamping is required.
+        needsClamp = true;
+    }
+
+    if (needsClamp)
+    {
+        requestClamp();
+    }
+}
+
+void
+ClampableNode::clamp(MapNode* mapNode)
+{
+    Terrain* terrain = mapNode->getTerrain();
+    if (!terrain || !terrain->getGraph())
+        return;
+
+    // listen for terrain updates so we can re-clamp as the terrain refines:
+    if (!_clampCallback.valid())
+    {
+        _clampCallback = new ClampCallback(this);
+        terrain->addTerrainCallback(_clampCallback.get());
+    }
+
+    osg::NodePathList paths = getParentalNodePaths();
+    osg::Matrixd world = paths.empty() ? osg::Matrixd::identity() : osg::computeLocalToWorld(paths.front());
+
+    WorldGeometryClamper clamper(_clamperData, world);
+    clamper.setTerrainPatch(terrain->getGraph());
+    clamper.setTerrainSRS(terrain->getSRS());
+    clamper.setUseVertexZ(false);
+    this->accept(clamper);
+}
+
 void
 ClampableNode::traverse(osg::NodeVisitor& nv)
 {
-    if ( nv.getVisitorType() == nv.CULL_VISITOR )
+    if ( nv.getVisitorType() == nv.CULL_VISITOR && _staticClamping )
+    {
+        // already clamped; no need for the clamping technique.
+        osg::Group::traverse(nv);
+    }
+
+    else if ( nv.getVisitorType() == nv.CULL_VISITOR )
     {
         // Lock a reference to the map node:
         osg::ref_ptr<MapNode> mapNode;
@@ -132,6 +246,17 @@ ClampableNode::traverse(osg::NodeVisitor& nv)
             }
         }
 
+        if (_clampRequested && _staticClamping)
+        {
+            osg::ref_ptr<MapNode> mapNode;
+            if (_mapNode.lock(mapNode))
+            {
+                clamp(mapNode.get());
+                _clampRequested = false;
+                ADJUST_UPDATE_TRAV_COUNT(this, -1);
+            }
+        }
+
         osg::Group::traverse(nv);
     }
     else
@@ -154,6 +279,6 @@ namespace osgEarth { namespace Serializers { namespace ClampableNode
         osgEarth::ClampableNode,
         "osg::Object osg::Node osg::Group osgEarth::ClampableNode")
     {
-        //nop
+        ADD_BOOL_SERIALIZER(StaticClamping, false);
     }
 }}}
@@ -81,8 +81,15 @@ namespace
 
         unsigned _renderLeafCount;
 
+        // what the depth texture currently holds, so unchanged frames can reuse it
+        mutable bool _rendered;
+        unsigned     _renderedTerrainRevision;
+        osg::Matrix  _renderedView;
+        osg::Matrix  _renderedProj;
+        osg::Matrix  _renderedModelView;
+
         META_Object(osgEarth,LocalPerViewData);
-        LocalPerViewData() { }
+        LocalPerViewData() : _rendered(false), _renderedTerrainRevision(0u) { }
         LocalPerViewData(const LocalPerViewData& rhs, const osg::CopyOp& co) { }
         
         void resizeGLObjectBuffers(unsigned maxSize) {
@@ -90,12 +97,14 @@ namespace
                 _rttTexture->resizeGLObjectBuffers(maxSize);
             if (_groupStateSet.valid())
                 _groupStateSet->resizeGLObjectBuffers(maxSize);
+            _rendered = false;
         }
         void releaseGLObjects(osg::State* state) const {
             if (_rttTexture.valid())
                 _rttTexture->releaseGLObjects(state);
             if (_groupStateSet.valid())
                 _groupStateSet->releaseGLObjects(state);
+            _rendered = false;
         }
 
 
@@ -339,12 +348,32 @@ ClampingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
         osg::Matrix viewMatrixInverse = osg::Matrix::inverse(params._rttViewMatrix);
         params._rttToPrimaryMatrixUniform->set(viewMatrixInverse * (*cv->getModelViewMatrix()));
 
-        // create the depth texture (render the terrain to tex)
-        params._rttCamera->accept( *cv );
-        
-
         LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
 
+        // create the depth texture (render the terrain to tex), unless the
+        // one from a previous frame was taken of the same terrain from the
+        // same view. The modelview matters too because the RTT camera
+        // inherits the main camera's viewpoint for terrain LOD selection.
+        unsigned terrainRevision = _engine && _engine->getTerrain() ? _engine->getTerrain()->getRevision() : 0u;
+
+        bool reuse =
+            local._rendered &&
+            local._renderedTerrainRevision == terrainRevision &&
+            local._renderedView == params._rttViewMatrix &&
+            local._renderedProj == params._rttProjMatrix &&
+            local._renderedModelView == *cv->getModelViewMatrix();
+
+        if (!reuse)
+        {
+            params._rttCamera->accept( *cv );
+
+            local._rendered = true;
+            local._renderedTerrainRevision = terrainRevision;
+            local._renderedView = params._rttViewMatrix;
+            local._renderedProj = params._rttProjMatrix;
+            local._renderedModelView = *cv->getModelViewMatrix();
+        }
+
         // construct a matrix that transforms from camera view coords to depth texture
         // clip coords directly. This will avoid precision loss in the 32-bit shader.
         static osg::Matrix s_scaleBiasMat = 
@@ -1,13 +1,21 @@
 #include <osgEarth/ClusterNode>
 
-#include <osgEarth/kdbush.hpp>
-
-typedef std::pair<int, int> TPoint;
-typedef std::vector< std::size_t > TIds;
+#include <cmath>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+namespace
+{
+    inline uint64_t cellKey(int cx, int cy)
+    {
+        return ((uint64_t)(uint32_t)cx << 32) | (uint64_t)(uint32_t)cy;
+    }
+
+    // deepest zoom level we will cluster at
+    const int MAX_ZOOM = 24;
+}
+
 ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _radius(50),
     _mapNode(mapNode),
@@ -15,7 +23,7 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _enabled(true),
     _dirty(true),
     _defaultImage(defaultImage),
-    _dirtyIndex(true)
+    _lastZoom(-1)
 {
     setCullingActive(false);
     
@@ -24,27 +32,67 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
 
 void ClusterNode::addNode(osg::Node* node)
 {
+    if (!node || _nodeSlots.find(node) != _nodeSlots.end())
+        return;
+
+    _nodeSlots[node] = _nodes.size();
     _nodes.push_back(node);
+
+    for (ZoomLevels::iterator itr = _zoomLevels.begin(); itr != _zoomLevels.end(); ++itr)
+    {
+        insert(itr->second, itr->first, node);
+    }
     _dirty = true;
-    _dirtyIndex = true;
 }
 
 void ClusterNode::removeNode(osg::Node* node)
 {
-    osg::NodeList::iterator itr = std::find(_nodes.begin(), _nodes.end(), node);
-    if (itr != _nodes.end())
+    UnorderedMap<osg::Node*, unsigned>::iterator slot = _nodeSlots.find(node);
+    if (slot == _nodeSlots.end())
+        return;
+
+    for (ZoomLevels::iterator itr = _zoomLevels.begin(); itr != _zoomLevels.end(); ++itr)
+    {
+        remove(itr->second, node);
+    }
+
+    // fill the hole with the last node
+    unsigned i = slot->second;
+    _nodeSlots.erase(slot);
+    if (i + 1 < _nodes.size())
+    {
+        _nodes[i] = _nodes.back();
+        _nodeSlots[_nodes[i].get()] = i;
+    }
+    _nodes.pop_back();
+
+    _dirty = true;
+}
+
+void ClusterNode::updateNode(osg::Node* node)
+{
+    if (_nodeSlots.find(node) == _nodeSlots.end())
+        return;
+
+    for (ZoomLevels::iterator itr = _zoomLevels.begin(); itr != _zoomLevels.end(); ++itr)
     {
-        _nodes.erase(itr);
+        remove(itr->second, node);
+        insert(itr->second, itr->first, node);
     }
     _dirty = true;
-    _dirtyIndex = true;
 }
 
 void ClusterNode::clear()
 {
     _nodes.clear();
+    _nodeSlots.clear();
+    dirtyZoomLevels();
+}
+
+void ClusterNode::dirtyZoomLevels()
+{
+    _zoomLevels.clear();
     _dirty = true;
-    _dirtyIndex = true;
 }
 
 unsigned int ClusterNode::getRadius() const
@@ -55,7 +103,7 @@ unsigned int ClusterNode::getRadius() const
 void ClusterNode::setRadius(unsigned int radius)
 {
     _radius = radius;
-    _dirty = true;
+    dirtyZoomLevels();
 }
 
 bool ClusterNode::getEnabled() const
@@ -79,8 +127,7 @@ void ClusterNode::setMapNode(MapNode* mapNode)
     if (_mapNode != mapNode)
     {
         _mapNode = mapNode;
-        _dirty = true;
-        _dirtyIndex = true;
+        dirtyZoomLevels();
         _labelPool.clear();
         _nextLabel = 0;
     }
@@ -106,44 +153,155 @@ ClusterNode::CanClusterCallback* ClusterNode::getCanClusterCallback()
 void ClusterNode::setCanClusterCallback(ClusterNode::CanClusterCallback* callback)
 {
     _canClusterCallback = callback;
-    _dirty = true;
+    dirtyZoomLevels();
 }
 
-namespace
+int ClusterNode::computeZoom(osgUtil::CullVisitor* cv) const
 {
-    bool boundSort(const osg::ref_ptr< osg::Node> &i, const osg::ref_ptr< osg::Node> &j)
-    {
-        osg::BoundingSphere bsI = i->getBound();
-        osg::BoundingSphere bsJ = j->getBound();
+    osg::Camera* camera = cv->getCurrentCamera();
+    const osg::Viewport* viewport = camera->getViewport();
+    const SpatialReference* srs = _mapNode->getMapSRS();
 
-        return bsI.center().x() < bsJ.center().x();
+    // size of a pixel on the ground below the eye
+    double metersPerPixel = 0.0;
+    double left, right, bottom, top, zNear, zFar, fovy, ar;
+    if (camera->getProjectionMatrixAsOrtho(left, right, bottom, top, zNear, zFar))
+    {
+        metersPerPixel = (right - left) / viewport->width();
+    }
+    else if (camera->getProjectionMatrixAsPerspective(fovy, ar, zNear, zFar))
+    {
+        osg::Vec3d eye, center, up;
+        camera->getViewMatrixAsLookAt(eye, center, up);
+        GeoPoint eyePoint;
+        eyePoint.fromWorld(srs, eye);
+        double range = osg::maximum(eyePoint.z(), 1.0);
+        metersPerPixel = 2.0 * range * tan(osg::DegreesToRadians(0.5*fovy)) / viewport->height();
     }
+
+    if (metersPerPixel <= 0.0)
+        return 0;
+
+    // Web Mercator zoom level with the same pixel size at the equator
+    double circumference = 2.0 * osg::PI * srs->getEllipsoid()->getRadiusEquator();
+    int zoom = (int)floor(log(circumference / (256.0 * metersPerPixel)) / log(2.0) + 0.5);
+    return osg::clampBetween(zoom, 0, MAX_ZOOM);
 }
-void ClusterNode::buildIndex()
+
+bool ClusterNode::computePixel(osg::Node* node, int zoom, double& x, double& y) const
 {
-    if (_dirtyIndex)
+    const SpatialReference* srs = _mapNode->getMapSRS();
+
+    GeoPoint p;
+    if (!p.fromWorld(srs, node->getBound().center()) ||
+        !p.transformInPlace(srs->getGeographicSRS()))
     {
-        _clusterIndex.clear();
+        return false;
+    }
 
-        std::sort(_nodes.begin(), _nodes.end(), boundSort);
+    double size = 256.0 * (double)(1u << zoom);
+    double lat = osg::DegreesToRadians(osg::clampBetween(p.y(), -85.0511, 85.0511));
+    x = (p.x() + 180.0) / 360.0 * size;
+    y = (1.0 - log(tan(lat) + 1.0 / cos(lat)) / osg::PI) * 0.5 * size;
+    return true;
+}
 
-        unsigned int maxNodes = 10000;
+ClusterNode::ZoomLevel& ClusterNode::getZoomLevel(int zoom)
+{
+    ZoomLevels::iterator itr = _zoomLevels.find(zoom);
+    if (itr != _zoomLevels.end())
+        return itr->second;
 
-        osg::Group* currentGroup = 0;
+    ZoomLevel& level = _zoomLevels[zoom];
+    for (unsigned int i = 0; i < _nodes.size(); i++)
+    {
+        insert(level, zoom, _nodes[i].get());
+    }
+    return level;
+}
 
-        for (unsigned int i = 0; i < _nodes.size(); i++)
+void ClusterNode::insert(ZoomLevel& level, int zoom, osg::Node* node)
+{
+    double x, y;
+    if (!computePixel(node, zoom, x, y))
+        return;
+
+    double radius = (double)osg::maximum(_radius, 1u);
+    int cx = (int)floor(x / radius);
+    int cy = (int)floor(y / radius);
+
+    // join the first cluster whose seed is within the radius
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
         {
-            if (!currentGroup || currentGroup->getNumChildren() >= maxNodes)
+            UnorderedMap<uint64_t, std::vector<unsigned> >::iterator cell = level.cells.find(cellKey(cx + dx, cy + dy));
+            if (cell == level.cells.end())
+                continue;
+
+            for (std::vector<unsigned>::iterator g = cell->second.begin(); g != cell->second.end(); ++g)
             {
-                currentGroup = new osg::Group;
-                _clusterIndex.push_back(currentGroup);
+                ZoomLevel::Group& group = level.groups[*g];
+                if (fabs(group.x - x) > radius || fabs(group.y - y) > radius)
+                    continue;
+
+                if (_canClusterCallback.valid() && !(*_canClusterCallback)(group.nodes.front().get(), node))
+                    continue;
+
+                group.nodes.push_back(node);
+                level.membership[node] = *g;
+                return;
             }
-            currentGroup->addChild(_nodes[i]);                      
         }
     }
-    _dirtyIndex = false;
+
+    // otherwise the node seeds a new cluster
+    unsigned id;
+    if (!level.freeGroups.empty())
+    {
+        id = level.freeGroups.back();
+        level.freeGroups.pop_back();
+    }
+    else
+    {
+        id = level.groups.size();
+        level.groups.push_back(ZoomLevel::Group());
+    }
+
+    ZoomLevel::Group& group = level.groups[id];
+    group.nodes.push_back(node);
+    group.x = x;
+    group.y = y;
+    group.cell = cellKey(cx, cy);
+    level.cells[group.cell].push_back(id);
+    level.membership[node] = id;
 }
 
+void ClusterNode::remove(ZoomLevel& level, osg::Node* node)
+{
+    UnorderedMap<osg::Node*, unsigned>::iterator m = level.membership.find(node);
+    if (m == level.membership.end())
+        return;
+
+    unsigned id = m->second;
+    level.membership.erase(m);
+
+    // The cluster keeps its seed position even if the seed node leaves,
+    // so the other members stay where they are.
+    ZoomLevel::Group& group = level.groups[id];
+    osg::NodeList::iterator itr = std::find(group.nodes.begin(), group.nodes.end(), node);
+    if (itr != group.nodes.end())
+        group.nodes.erase(itr);
+
+    if (group.nodes.empty())
+    {
+        std::vector<unsigned>& cell = level.cells[group.cell];
+        cell.erase(std::find(cell.begin(), cell.end(), id));
+        if (cell.empty())
+            level.cells.erase(group.cell);
+        level.freeGroups.push_back(id);
+    }
+}
 
 void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 {
@@ -161,94 +319,58 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
         camera->getProjectionMatrix() *
         camera->getViewport()->computeWindowMatrix();
 
-    std::vector<TPoint> points;
-
-    osg::NodeList validPlaces;
+    // Clusters are cached per zoom level and kept up to date as nodes come
+    // and go, so here we only have to find the visible ones.
+    int zoom = computeZoom(cv);
+    ZoomLevel& level = getZoomLevel(zoom);
 
-    buildIndex();
-
-    for (osg::NodeList::iterator itr = _clusterIndex.begin(); itr != _clusterIndex.end(); ++itr)
+    // drop levels we have moved away from; they would only need updating
+    if (zoom != _lastZoom)
     {
-        osg::Group* index = static_cast<osg::Group*>(itr->get());
-        if (cv->isCulled(index->getBound()))
+        for (ZoomLevels::iterator itr = _zoomLevels.begin(); itr != _zoomLevels.end(); )
         {
-            continue;
-        }
-
-        for (unsigned int i = 0; i < index->getNumChildren(); i++)
-        {
-            osg::Node* node = index->getChild(i);
-            osg::Vec3d world = node->getBound().center();
-
-            if (cv->isCulled(*node))
-            {
-                continue;
-            }
-
-            if (!_horizon->isVisible(world))
-            {
-                continue;
-            }
-
-            osg::Vec3d screen = world * mvpw;
-
-            if (screen.x() >= 0 && screen.x() <= viewport->width() &&
-                screen.y() >= 0 && screen.y() <= viewport->height())
-            {
-                validPlaces.push_back(node);
-                points.push_back(TPoint(screen.x(), screen.y()));
-            }
+            if (osg::absolute(itr->first - zoom) > 2)
+                _zoomLevels.erase(itr++);
+            else
+                ++itr;
         }
+        _lastZoom = zoom;
     }
 
-    if (validPlaces.size() == 0) return;
-
-    kdbush::KDBush<TPoint> index(points);
-    std::set< unsigned int > clustered;
-
-    for (unsigned int i = 0; i < validPlaces.size(); i++)
+    for (std::vector<ZoomLevel::Group>::const_iterator g = level.groups.begin(); g != level.groups.end(); ++g)
     {
-        TPoint &screen = points[i];
-        osg::Node* node = validPlaces[i].get();
-
-        // If this thing is already part of a cluster then just continue.
-        if (clustered.find(i) != clustered.end())
+        if (g->nodes.empty())
         {
             continue;
         }
 
+        // The seed node stands in for the cluster
+        osg::Node* node = g->nodes.front().get();
         osg::Vec3d world = node->getBound().center();
 
-        // Get any matching indices that are part of this cluster.
-        TIds indices;
-
-        index.range(screen.first - _radius, screen.second - _radius, screen.first + _radius, screen.second + _radius, indices);
+        if (cv->isCulled(*node))
+        {
+            continue;
+        }
 
-        // Create a new cluster.
-        Cluster cluster;
+        if (!_horizon->isVisible(world))
+        {
+            continue;
+        }
 
-        unsigned int actualCount = 0;
+        osg::Vec3d screen = world * mvpw;
 
-        // Add all of the points to the cluster.
-        for (unsigned int j = 0; j < indices.size(); j++)
+        if (screen.x() < 0 || screen.x() > viewport->width() ||
+            screen.y() < 0 || screen.y() > viewport->height())
         {
-            if (clustered.find(indices[j]) == clustered.end())
-            {
-                if (_canClusterCallback.valid())
-                {
-                    bool canCluster = (*_canClusterCallback)(node, validPlaces[indices[j]].get());
-                    if (!canCluster) {
-                        continue;
-                    }
-                }
-                cluster.nodes.push_back(validPlaces[indices[j]]);
-                actualCount++;
-                clustered.insert(indices[j]);
-            }
+            continue;
         }
 
+        Cluster cluster;
+        cluster.nodes = g->nodes;
+
         std::stringstream buf;
-        buf << actualCount << std::endl;
+        buf << cluster.nodes.size() << std::endl;
 
         PlaceNode* marker = getOrCreateLabel();
         GeoPoint markerPos;
@@ -258,8 +380,6 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 
         cluster.marker = marker;
         out.push_back(cluster);
-
-        clustered.insert(i);
     }
 }
 
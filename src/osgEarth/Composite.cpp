@@ -18,6 +18,9 @@
  */
 #include <osgEarth/Composite>
 #include <osgEarth/Progress>
+#include <osgEarth/JobArena>
+#include <osgEarth/HeightFieldUtils>
+#include <algorithm>
 
 using namespace osgEarth;
 
@@ -72,6 +75,217 @@ namespace osgEarth { namespace Composite
 
     // some helper types.    
     typedef std::vector<ImageInfo> ImageMixVector;   
+
+    /**
+     * Fetches the component data of one tile, one layer per claim. Layers
+     * are claimed from the top down so that a layer that hides everything
+     * beneath it is usually known before the lower layers are started;
+     * those are then skipped.
+     */
+    struct FetchGroup : public osg::Referenced
+    {
+        FetchGroup(unsigned numLayers, ProgressCallback* progress) :
+            _numLayers(numLayers), _progress(progress),
+            _floor(0u), _next(0u), _remaining(numLayers) { }
+
+        // fetch the data for one layer
+        virtual void fetch(unsigned layer) =0;
+
+        void run()
+        {
+            for(;;)
+            {
+                unsigned n = (++_next) - 1u;
+                if (n >= _numLayers)
+                    break;
+
+                unsigned layer = _numLayers - 1u - n;
+                if (!isHidden(layer) && !(_progress && _progress->isCanceled()))
+                {
+                    fetch(layer);
+                }
+
+                if (--_remaining == 0u)
+                    _done.set();
+            }
+        }
+
+        // fetch all the layers with help from the job arena, and wait.
+        void runAndWait()
+        {
+            JobArena* arena = JobArena::get("oe.composite");
+            unsigned numHelpers = osg::minimum(arena->getConcurrency(), _numLayers - 1u);
+            for (unsigned i = 0; i < numHelpers; ++i)
+            {
+                arena->dispatch(new FetchTask(this));
+            }
+            run();
+            _done.wait();
+        }
+
+        // marks all layers below this one as hidden
+        void hideBelow(unsigned layer)
+        {
+            Threading::ScopedMutexLock lock(_floorMutex);
+            _floor = osg::maximum(_floor, layer);
+        }
+
+        bool isHidden(unsigned layer) const
+        {
+            Threading::ScopedMutexLock lock(_floorMutex);
+            return layer < _floor;
+        }
+
+        struct FetchTask : public TaskRequest
+        {
+            FetchTask(FetchGroup* group) : _group(group) { }
+
+            void operator()(ProgressCallback*)
+            {
+                _group->run();
+            }
+
+            osg::ref_ptr<FetchGroup> _group;
+        };
+
+        unsigned _numLayers;
+        ProgressCallback* _progress;
+        unsigned _floor;
+        mutable Threading::Mutex _floorMutex;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+    };
+
+    struct ImageFetchGroup : public FetchGroup
+    {
+        ImageFetchGroup(const ImageLayerVector& layers, const TileKey& key, ImageMixVector& images, ProgressCallback* progress) :
+            FetchGroup(layers.size(), progress), _layers(layers), _key(key), _images(images) { }
+
+        void fetch(unsigned i)
+        {
+            ImageLayer* layer = _layers[i].get();
+            ImageInfo& imageInfo = _images[i];
+            imageInfo.bestAvailableKey = layer->getBestAvailableTileKey(_key);
+
+            // if there is possibly actual data for this key...
+            if (imageInfo.bestAvailableKey == _key)
+            {
+                GeoImage image = layer->createImage(_key, _progress);
+                if (image.valid())
+                {
+                    imageInfo.image = image.getImage();
+
+                    // an opaque image hides all the layers beneath it.
+                    if (imageInfo.opacity >= 1.0f &&
+                        !ImageUtils::hasTransparency(imageInfo.image.get()))
+                    {
+                        hideBelow(i);
+                    }
+                }
+            }
+        }
+
+        const ImageLayerVector& _layers;
+        TileKey _key;
+        ImageMixVector& _images;
+    };
+
+    struct HeightFieldInfo
+    {
+        HeightFieldInfo() : fallback(false) { }
+
+        GeoHeightField heightField;
+        bool fallback;
+    };
+
+    typedef std::vector<HeightFieldInfo> HeightFieldMixVector;
+
+    struct HeightFieldFetchGroup : public FetchGroup
+    {
+        HeightFieldFetchGroup(const ElevationLayerVector& layers, const TileKey& key, unsigned tileSize, HeightFieldMixVector& heightFields, ProgressCallback* progress) :
+            FetchGroup(layers.size(), progress), _layers(layers), _key(key), _tileSize(tileSize), _heightFields(heightFields) { }
+
+        void fetch(unsigned i)
+        {
+            ElevationLayer* layer = _layers[i].get();
+            if (!layer->isOpen() || _key.getLOD() < layer->getMinLevel())
+                return;
+
+            // calculate the resolution-mapped key (adjusted for tile resolution differential).
+            TileKey mappedKey = _key.mapResolution(_tileSize, layer->getTileSize());
+            TileKey bestKey = layer->getBestAvailableTileKey(mappedKey);
+
+            // fall back on parent keys to make sure that we have data at the
+            // location even if it's lower resolution.
+            HeightFieldInfo& info = _heightFields[i];
+            while (!info.heightField.valid() && bestKey.valid() && layer->isKeyInLegalRange(bestKey))
+            {
+                info.heightField = layer->createHeightField(bestKey, _progress);
+                if (!info.heightField.valid())
+                    bestKey = bestKey.createParentKey();
+            }
+
+            if (info.heightField.valid())
+            {
+                info.fallback = (bestKey != mappedKey);
+
+                // full-resolution data with no holes hides all the layers beneath it.
+                if (!info.fallback && !layer->isOffset())
+                {
+                    const osg::FloatArray* heights = info.heightField.getHeightField()->getFloatArray();
+                    if (std::find(heights->begin(), heights->end(), NO_DATA_VALUE) == heights->end())
+                    {
+                        hideBelow(i);
+                    }
+                }
+            }
+        }
+
+        const ElevationLayerVector& _layers;
+        TileKey _key;
+        unsigned _tileSize;
+        HeightFieldMixVector& _heightFields;
+    };
+
+    //! Samples a heightfield at every post of a size x size grid over the
+    //! key extent in one pass, leaving NO_DATA_VALUE at posts outside the
+    //! heightfield. Returns false (and samples nothing) if the heightfield
+    //! is not in the key's SRS and must be sampled post by post instead.
+    bool sampleGrid(const GeoHeightField& geoHF, const GeoExtent& keyExtent, unsigned size, std::vector<float>& output)
+    {
+        const GeoExtent& ex = geoHF.getExtent();
+        const SpatialReference* srs = ex.getSRS();
+        if (!srs->isHorizEquivalentTo(keyExtent.getSRS()) || !srs->isVertEquivalentTo(keyExtent.getSRS()))
+            return false;
+
+        const osg::HeightField* hf = geoHF.getHeightField();
+        double xInterval = ex.width()  / (double)(hf->getNumColumns()-1);
+        double yInterval = ex.height() / (double)(hf->getNumRows()-1);
+        double dx = keyExtent.width()  / (double)(size-1);
+        double dy = keyExtent.height() / (double)(size-1);
+
+        std::vector<double> cols(size), rows(size);
+        for (unsigned i = 0; i < size; ++i)
+        {
+            cols[i] = osg::clampBetween((keyExtent.xMin() + dx*(double)i - ex.xMin()) / xInterval, 0.0, (double)(hf->getNumColumns()-1));
+            rows[i] = osg::clampBetween((keyExtent.yMin() + dy*(double)i - ex.yMin()) / yInterval, 0.0, (double)(hf->getNumRows()-1));
+        }
+
+        output.resize(size*size);
+        HeightFieldUtils::getHeightsAtPixels(hf, &cols[0], size, &rows[0], size, &output[0], INTERP_BILINEAR);
+
+        for (unsigned r = 0; r < size; ++r)
+        {
+            double y = keyExtent.yMin() + dy*(double)r;
+            for (unsigned c = 0; c < size; ++c)
+            {
+                if (!ex.contains(keyExtent.xMin() + dx*(double)c, y))
+                    output[r*size + c] = NO_DATA_VALUE;
+            }
+        }
+        return true;
+    }
 } }
 
 REGISTER_OSGEARTH_LAYER(compositeimage, CompositeImageLayer);
@@ -298,32 +512,33 @@ CompositeImageLayer::createImageImplementation(const TileKey& key, ProgressCallb
     Composite::ImageMixVector images;
     images.reserve(_layers.size());
 
-    // Try to get an image from each of the layers for the given key.
     for (ImageLayerVector::const_iterator itr = _layers.begin(); itr != _layers.end(); ++itr)
     {
-        ImageLayer* layer = itr->get();
         Composite::ImageInfo imageInfo;
-        imageInfo.opacity = layer->getOpacity();
-        imageInfo.bestAvailableKey = layer->getBestAvailableTileKey(key);
-        
-        // if there is possibly actual data for this key...
-        if (imageInfo.bestAvailableKey == key)
-        {
-            GeoImage image = layer->createImage(key, progress);
-            if (image.valid())
-            {
-                imageInfo.image = image.getImage();
-            }
+        imageInfo.opacity = itr->get()->getOpacity();
+        images.push_back(imageInfo);
+    }
 
-            // If the progress got cancelled or it needs a retry then return NULL to prevent this tile from being built and cached with incomplete or partial data.
-            if (progress && progress->isCanceled())
-            {
-                OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
-                return GeoImage::INVALID;
-            }
+    // Try to get an image from each of the layers for the given key, in parallel.
+    if (!_layers.empty())
+    {
+        osg::ref_ptr<Composite::ImageFetchGroup> group = new Composite::ImageFetchGroup(
+            _layers, key, images, progress);
+
+        group->runAndWait();
+
+        // Layers hidden by an opaque image get no data and no fallback.
+        for (unsigned i = 0; i < group->_floor; ++i)
+        {
+            images[i] = Composite::ImageInfo();
         }
+    }
 
-        images.push_back(imageInfo);
+    // If the progress got cancelled or it needs a retry then return NULL to prevent this tile from being built and cached with incomplete or partial data.
+    if (progress && progress->isCanceled())
+    {
+        OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
+        return GeoImage::INVALID;
     }
 
     // Determine the output texture size to use based on the image that were created.
@@ -692,22 +907,144 @@ CompositeElevationLayer::closeImplementation()
 GeoHeightField
 CompositeElevationLayer::createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const
 {
+    if (_layers.empty())
+        return GeoHeightField::INVALID;
+
     unsigned size = getTileSize();
+
+    // Fetch a heightfield from each of the layers in parallel.
+    Composite::HeightFieldMixVector heightFields(_layers.size());
+
+    osg::ref_ptr<Composite::HeightFieldFetchGroup> group = new Composite::HeightFieldFetchGroup(
+        _layers, key, size, heightFields, progress);
+
+    group->runAndWait();
+
+    if (progress && progress->isCanceled())
+    {
+        return GeoHeightField::INVALID;
+    }
+
+    // Collect the visible layers, highest priority (last) first. We only have
+    // real data if at least one of them is not fallback data.
+    std::vector<unsigned> contenders;
+    std::vector<unsigned> offsets;
+    bool realData = false;
+
+    for (int i = (int)_layers.size() - 1; i >= (int)group->_floor; --i)
+    {
+        const Composite::HeightFieldInfo& info = heightFields[i];
+        if (info.heightField.valid())
+        {
+            if (_layers[i]->isOffset())
+                offsets.push_back(i);
+            else
+                contenders.push_back(i);
+
+            if (!info.fallback)
+                realData = true;
+        }
+    }
+
+    if (!realData)
+    {
+        return GeoHeightField::INVALID;
+    }
+
     osg::ref_ptr< osg::HeightField > heightField = new osg::HeightField();
     heightField->allocate(size, size);
 
     // Initialize the heightfield to nodata
     heightField->getFloatArray()->assign(size*size, NO_DATA_VALUE);
 
-    // Populate the heightfield and return it if it's valid
-    if (_layers.populateHeightFieldAndNormalMap(heightField.get(), 0L, key, 0, INTERP_BILINEAR, progress))
-    {                
-        return GeoHeightField(heightField.release(), key.getExtent());
+    const SpatialReference* keySRS = key.getProfile()->getSRS();
+    double xmin = key.getExtent().xMin();
+    double ymin = key.getExtent().yMin();
+    double dx = key.getExtent().width() / (double)(size-1);
+    double dy = key.getExtent().height() / (double)(size-1);
+
+    // When every layer is already in the key's SRS, sample each one over the
+    // whole grid at once and merge the results.
+    std::vector<std::vector<float> > grids(_layers.size());
+    bool gridded = true;
+    for (unsigned i = 0; i < contenders.size() && gridded; ++i)
+        gridded = Composite::sampleGrid(heightFields[contenders[i]].heightField, key.getExtent(), size, grids[contenders[i]]);
+    for (unsigned i = 0; i < offsets.size() && gridded; ++i)
+        gridded = Composite::sampleGrid(heightFields[offsets[i]].heightField, key.getExtent(), size, grids[offsets[i]]);
+
+    if (gridded)
+    {
+        float* output = &heightField->getFloatArray()->front();
+        for (unsigned p = 0; p < size*size; ++p)
+        {
+            // The highest priority layer with data at this location wins.
+            int resolvedIndex = -1;
+            for (unsigned i = 0; i < contenders.size() && resolvedIndex < 0; ++i)
+            {
+                float elevation = grids[contenders[i]][p];
+                if (elevation != NO_DATA_VALUE)
+                {
+                    resolvedIndex = contenders[i];
+                    output[p] = elevation;
+                }
+            }
+
+            for (unsigned i = 0; i < offsets.size(); ++i)
+            {
+                if (resolvedIndex >= 0 && (int)offsets[i] < resolvedIndex)
+                    continue;
+
+                float elevation = grids[offsets[i]][p];
+                if (elevation != NO_DATA_VALUE)
+                    output[p] += elevation;
+            }
+        }
     }
     else
-    {        
-        return GeoHeightField::INVALID;
+    {
+        for (unsigned c = 0; c < size; ++c)
+        {
+            double x = xmin + (dx * (double)c);
+
+            for (unsigned r = 0; r < size; ++r)
+            {
+                double y = ymin + (dy * (double)r);
+
+                // The highest priority layer with data at this location wins.
+                int resolvedIndex = -1;
+                for (unsigned i = 0; i < contenders.size() && resolvedIndex < 0; ++i)
+                {
+                    float elevation;
+                    if (heightFields[contenders[i]].heightField.getElevation(keySRS, x, y, INTERP_BILINEAR, keySRS, elevation) &&
+                        elevation != NO_DATA_VALUE)
+                    {
+                        resolvedIndex = contenders[i];
+                        heightField->setHeight(c, r, elevation);
+                    }
+                }
+
+                // Only apply an offset layer if it sits on top of the resolved layer
+                // (or if there was no resolved layer).
+                for (unsigned i = 0; i < offsets.size(); ++i)
+                {
+                    if (resolvedIndex >= 0 && (int)offsets[i] < resolvedIndex)
+                        continue;
+
+                    float elevation;
+                    if (heightFields[offsets[i]].heightField.getElevation(keySRS, x, y, INTERP_BILINEAR, keySRS, elevation) &&
+                        elevation != NO_DATA_VALUE)
+                    {
+                        heightField->getHeight(c, r) += elevation;
+                    }
+                }
+            }
+        }
     }
+
+    // Resolve any invalid heights in the output heightfield.
+    HeightFieldUtils::resolveInvalidHeights(heightField.get(), key.getExtent(), NO_DATA_VALUE, 0L);
+
+    return GeoHeightField(heightField.release(), key.getExtent());
 }
 
 
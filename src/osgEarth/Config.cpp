@@ -24,6 +24,7 @@
 #include <osgEarth/JsonUtils>
 #include <osgEarth/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <set>
 
 using namespace osgEarth;
 
@@ -129,8 +130,17 @@ void
 Config::merge( const Config& rhs ) 
 {
     // remove any matching keys first; this will allow the addition of multi-key values
+    std::set<std::string> keys;
     for( ConfigSet::const_iterator c = rhs._children.begin(); c != rhs._children.end(); ++c )
-        remove( c->key() );
+        keys.insert( c->key() );
+
+    for( ConfigSet::iterator i = _children.begin(); i != _children.end(); )
+    {
+        if ( keys.find(i->key()) != keys.end() )
+            i = _children.erase(i);
+        else
+            ++i;
+    }
 
     // add in the new values.
     for( ConfigSet::const_iterator c = rhs._children.begin(); c != rhs._children.end(); ++c )
@@ -38,6 +38,11 @@ ContourMapLayer::Options::getMetadata()
         { "name" : "ContourMap",
           "properties" : [
             { "name": "grayscale", "description" : "", "type" : "bool", "default" : "" },
+            { "name": "fill", "description" : "Color the terrain by elevation", "type" : "bool", "default" : "true" },
+            { "name": "lines", "description" : "Draw contour lines", "type" : "bool", "default" : "false" },
+            { "name": "line_interval", "description" : "Elevation between contour lines (m)", "type" : "float", "default" : "100.0" },
+            { "name": "line_width", "description" : "Width of the contour lines (px)", "type" : "float", "default" : "1.0" },
+            { "name": "line_color", "description" : "Color of the contour lines", "type" : "color", "default" : "#000000ff" },
           ]
         }
     ));
@@ -48,6 +53,11 @@ ContourMapLayer::Options::getConfig() const
 {
     Config conf = VisibleLayer::Options::getConfig();
     conf.set("grayscale", _grayscale);
+    conf.set("fill", _fill);
+    conf.set("lines", _lines);
+    conf.set("line_interval", _lineInterval);
+    conf.set("line_width", _lineWidth);
+    conf.set("line_color", _lineColor);
     return conf;
 }
 
@@ -55,7 +65,18 @@ void
 ContourMapLayer::Options::fromConfig(const Config& conf)
 {
     _grayscale.init(false);
+    _fill.init(true);
+    _lines.init(false);
+    _lineInterval.init(100.0f);
+    _lineWidth.init(1.0f);
+    _lineColor.init(Color::Black);
+
     conf.get("grayscale", _grayscale);
+    conf.get("fill", _fill);
+    conf.get("lines", _lines);
+    conf.get("line_interval", _lineInterval);
+    conf.get("line_width", _lineWidth);
+    conf.get("line_color", _lineColor);
 }
 
 //........................................................................
@@ -64,6 +85,87 @@ REGISTER_OSGEARTH_LAYER(contourmap, ContourMapLayer);
 
 OE_LAYER_PROPERTY_IMPL(ContourMapLayer, bool, Grayscale, grayscale);
 
+void
+ContourMapLayer::setFill(const bool& value)
+{
+    options().fill() = value;
+    updateDefines();
+}
+
+const bool&
+ContourMapLayer::getFill() const
+{
+    return options().fill().get();
+}
+
+void
+ContourMapLayer::setLines(const bool& value)
+{
+    options().lines() = value;
+    updateDefines();
+}
+
+const bool&
+ContourMapLayer::getLines() const
+{
+    return options().lines().get();
+}
+
+void
+ContourMapLayer::setLineInterval(const float& value)
+{
+    options().lineInterval() = value;
+    _lineInterval->set(osg::maximum(value, 0.001f));
+}
+
+const float&
+ContourMapLayer::getLineInterval() const
+{
+    return options().lineInterval().get();
+}
+
+void
+ContourMapLayer::setLineWidth(const float& value)
+{
+    options().lineWidth() = value;
+    _lineWidth->set(value);
+}
+
+const float&
+ContourMapLayer::getLineWidth() const
+{
+    return options().lineWidth().get();
+}
+
+void
+ContourMapLayer::setLineColor(const Color& value)
+{
+    options().lineColor() = value;
+    _lineColor->set(value);
+}
+
+const Color&
+ContourMapLayer::getLineColor() const
+{
+    return options().lineColor().get();
+}
+
+void
+ContourMapLayer::updateDefines()
+{
+    osg::StateSet* stateset = getOrCreateStateSet();
+
+    if (getFill())
+        stateset->setDefine("OE_CONTOUR_FILL");
+    else
+        stateset->removeDefine("OE_CONTOUR_FILL");
+
+    if (getLines())
+        stateset->setDefine("OE_CONTOUR_LINES");
+    else
+        stateset->removeDefine("OE_CONTOUR_LINES");
+}
+
 void
 ContourMapLayer::setTransferFunction(osg::TransferFunction1D* xfer)
 {
@@ -91,6 +193,17 @@ ContourMapLayer::init()
     _xferRange = new osg::Uniform(osg::Uniform::FLOAT, "oe_contour_range");
     stateset->addUniform(_xferRange.get());
 
+    _lineInterval = new osg::Uniform("oe_contour_lineInterval", osg::maximum(getLineInterval(), 0.001f));
+    stateset->addUniform(_lineInterval.get());
+
+    _lineWidth = new osg::Uniform("oe_contour_lineWidth", getLineWidth());
+    stateset->addUniform(_lineWidth.get());
+
+    _lineColor = new osg::Uniform("oe_contour_lineColor", osg::Vec4f(getLineColor()));
+    stateset->addUniform(_lineColor.get());
+
+    updateDefines();
+
 #if defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
     _xferSampler = new osg::Uniform(osg::Uniform::SAMPLER_2D, "oe_contour_xfer");
 #else
@@ -175,6 +175,7 @@ Control::init()
     _active = false;
     _absorbEvents = true;
     _dirty = true;
+    _contentDirty = false;
     _borderWidth = 1.0f;
 
     _geode = new osg::Geode();
@@ -520,6 +521,31 @@ namespace
             }
         }
     }
+
+    // flags the ancestors of a content-dirty control so the canvas can find it
+    // without touching the layout of the rest of the tree.
+    void dirtyContentParent(osg::Group* p)
+    {
+        if ( p )
+        {
+            Control* c = dynamic_cast<Control*>( p );
+            if ( c )
+            {
+                c->dirtyContent();
+            }
+            else if ( dynamic_cast<ControlCanvas*>( p ) )
+            {
+                return;
+            }
+            else
+            {
+                for( unsigned i=0; i<p->getNumParents(); ++i )
+                {
+                    dirtyContentParent( p->getParent(i) );
+                }
+            }
+        }
+    }
 }
 
 void
@@ -532,6 +558,31 @@ Control::dirty()
     }
 }
 
+void
+Control::dirtyContent()
+{
+    // nothing to do if a full layout (or an in-place redraw) is already pending
+    if ( _dirty || _contentDirty )
+        return;
+
+    _contentDirty = true;
+    for(unsigned i=0; i<getNumParents(); ++i)
+    {
+        dirtyContentParent( getParent(i) );
+    }
+}
+
+bool
+Control::refresh(const ControlContext& cx)
+{
+    if ( _contentDirty )
+    {
+        draw( cx );
+        _contentDirty = false;
+    }
+    return true;
+}
+
 void
 Control::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
 {
@@ -671,6 +722,7 @@ Control::draw(const ControlContext& cx)
         }
         
         _dirty = false;
+        _contentDirty = false;
     }
 }
 
@@ -831,7 +883,8 @@ LabelControl::setText( const std::string& value )
 {
     if ( value != _text ) {
         _text = value;
-        dirty();
+        // the new text may still fit the current layout; refresh() decides.
+        dirtyContent();
     }
 }
 
@@ -977,6 +1030,25 @@ LabelControl::draw( const ControlContext& cx )
     }
 }
 
+bool
+LabelControl::refresh( const ControlContext& cx )
+{
+    if ( !_contentDirty )
+        return true;
+
+    // re-measure the text; if the label keeps its size, the existing layout
+    // (and therefore our render position) is still valid.
+    osg::Vec2f oldSize = _renderSize;
+    osg::Vec2f dummySize;
+    calcSize( cx, dummySize );
+    if ( _renderSize != oldSize )
+        return false;
+
+    draw( cx );
+    _contentDirty = false;
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 
 ButtonControl::ButtonControl(const std::string&   text,
@@ -1727,6 +1799,27 @@ Container::draw( const ControlContext& cx )
     Control::draw( cx );
 }
 
+bool
+Container::refresh( const ControlContext& cx )
+{
+    if ( !_contentDirty )
+        return true;
+
+    // only descend into the children that asked for a redraw.
+    for( unsigned i=1; i<getNumChildren(); ++i )
+    {
+        Control* child = dynamic_cast<Control*>( getChild(i) );
+        if ( child && child->_contentDirty )
+        {
+            if ( !child->refresh( cx ) )
+                return false;
+        }
+    }
+
+    _contentDirty = false;
+    return true;
+}
+
 bool
 Container::handle( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa, ControlContext& cx )
 {
@@ -2943,7 +3036,16 @@ ControlCanvas::update(const osg::FrameStamp* frameStamp)
     for( unsigned i=1; i<getNumChildren(); ++i )
     {
         Control* control = dynamic_cast<Control*>( getChild(i) );
-        if ( control && (control->isDirty() || _contextDirty))
+        if ( !control )
+            continue;
+
+        // a content-only change redraws in place; fall back to a full layout
+        // of this control's subtree only if something changed size.
+        bool needsLayout = _contextDirty || control->isLayoutDirty();
+        if ( !needsLayout && control->_contentDirty )
+            needsLayout = !control->refresh( _context );
+
+        if ( needsLayout )
         {
             osg::Vec2f size;
             control->calcSize( _context, size );
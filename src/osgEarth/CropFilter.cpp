@@ -76,8 +76,8 @@ CropFilter::push( FeatureList& input, FilterContext& context )
     {
 #ifdef OSGEARTH_HAVE_GEOS
 
-        // create the intersection polygon:
-        osg::ref_ptr<Polygon> poly;
+        // create the intersection polygon, prepared once for all the features:
+        osg::ref_ptr<PreparedGeometry> cropArea;
         
         for( FeatureList::iterator i = input.begin(); i != input.end();  )
         {
@@ -104,17 +104,18 @@ CropFilter::push( FeatureList& input, FilterContext& context )
                 // then move on to the cropping operation:
                 else
                 {
-                    if ( !poly.valid() )
+                    if ( !cropArea.valid() )
                     {
-                        poly = new Polygon();
+                        osg::ref_ptr<Polygon> poly = new Polygon();
                         poly->push_back( osg::Vec3d( extent.xMin(), extent.yMin(), 0 ));
                         poly->push_back( osg::Vec3d( extent.xMax(), extent.yMin(), 0 ));
                         poly->push_back( osg::Vec3d( extent.xMax(), extent.yMax(), 0 ));
                         poly->push_back( osg::Vec3d( extent.xMin(), extent.yMax(), 0 ));
+                        cropArea = new PreparedGeometry( poly.get() );
                     }
 
                     osg::ref_ptr<Geometry> croppedGeometry;
-                    if ( featureGeom->crop( poly.get(), croppedGeometry ) )
+                    if ( cropArea->crop( featureGeom, croppedGeometry ) )
                     {
                         if ( croppedGeometry->isValid() )
                         {
@@ -22,13 +22,148 @@
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/ImageToHeightFieldConverter>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/rtree.h>
 #include <osg/MatrixTransform>
 #include <osg/BlendFunc>
 #include <osg/BlendEquation>
+#include <algorithm>
+#include <climits>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+//........................................................................
+
+struct DecalSpatialIndex::Impl
+{
+    typedef RTree<unsigned, double, 2> Tree;
+    Tree _tree;
+
+    // bounds of each decal in the tree, needed for removal
+    struct Bounds { double _min[2], _max[2]; };
+    typedef std::map<unsigned, Bounds> BoundsTable;
+    BoundsTable _bounds;
+};
+
+namespace
+{
+    // Decals are indexed in geographic coordinates so that tiles from
+    // any profile can query them.
+    bool getIndexBounds(const GeoExtent& extent, double* a_min, double* a_max)
+    {
+        if (!extent.isValid())
+            return false;
+
+        GeoExtent geo = extent.transform(extent.getSRS()->getGeographicSRS());
+        if (!geo.isValid())
+            return false;
+
+        a_min[0] = geo.xMin(), a_min[1] = geo.yMin();
+        a_max[0] = geo.xMax(), a_max[1] = geo.yMax();
+        return true;
+    }
+}
+
+DecalSpatialIndex::DecalSpatialIndex() :
+    _impl(new Impl())
+{
+    //nop
+}
+
+DecalSpatialIndex::~DecalSpatialIndex()
+{
+    delete _impl;
+}
+
+void
+DecalSpatialIndex::insert(unsigned serial, const GeoExtent& extent)
+{
+    Impl::Bounds b;
+    if (getIndexBounds(extent, b._min, b._max))
+    {
+        _impl->_tree.Insert(b._min, b._max, serial);
+        _impl->_bounds[serial] = b;
+    }
+}
+
+void
+DecalSpatialIndex::remove(unsigned serial)
+{
+    Impl::BoundsTable::iterator i = _impl->_bounds.find(serial);
+    if (i != _impl->_bounds.end())
+    {
+        _impl->_tree.Remove(i->second._min, i->second._max, serial);
+        _impl->_bounds.erase(i);
+    }
+}
+
+void
+DecalSpatialIndex::clear()
+{
+    _impl->_tree.RemoveAll();
+    _impl->_bounds.clear();
+}
+
+void
+DecalSpatialIndex::query(const GeoExtent& extent, std::vector<unsigned>& serials) const
+{
+    serials.clear();
+
+    double a_min[2], a_max[2];
+    if (!_impl->_bounds.empty() && getIndexBounds(extent, a_min, a_max))
+    {
+        _impl->_tree.Search(a_min, a_max, &serials, INT_MAX);
+        std::sort(serials.begin(), serials.end());
+    }
+}
+
+//........................................................................
+
+DecalTileCache::DecalTileCache(unsigned maxTiles) :
+    _tiles(true, maxTiles)
+{
+    //nop
+}
+
+unsigned
+DecalTileCache::get(const TileKey& key, const std::vector<unsigned>& serials, osg::ref_ptr<osg::Object>& tile) const
+{
+    LRUCache<TileKey, Entry>::Record rec;
+    if (_tiles.get(key, rec))
+    {
+        // Usable only if every decal in the cached tile is still there
+        // and nothing was inserted before them; i.e. the cached serials
+        // are a prefix of the current ones.
+        const std::vector<unsigned>& cached = rec.value()._serials;
+        if (cached.size() <= serials.size() &&
+            std::equal(cached.begin(), cached.end(), serials.begin()))
+        {
+            tile = rec.value()._tile->clone(osg::CopyOp::DEEP_COPY_ALL);
+            return cached.size();
+        }
+    }
+    tile = 0L;
+    return 0u;
+}
+
+void
+DecalTileCache::put(const TileKey& key, const std::vector<unsigned>& serials, const osg::Object* tile)
+{
+    Entry entry;
+    entry._tile = tile->clone(osg::CopyOp::DEEP_COPY_ALL);
+    entry._serials = serials;
+    _tiles.insert(key, entry);
+}
+
+void
+DecalTileCache::clear()
+{
+    _tiles.clear();
+}
+
+//........................................................................
+
 #define LC "[DecalImageLayer] "
 
 REGISTER_OSGEARTH_LAYER(decalimage, DecalImageLayer);
@@ -53,62 +188,68 @@ DecalImageLayer::init()
 {
     ImageLayer::init();
 
+    _nextSerial = 0u;
+
     // Set the layer profile.
     setProfile(Profile::create("global-geodetic"));
 
-    // Never cache decals
+    // Never cache decals. The layer keeps its own cache of composed
+    // tiles, and does not change revision when decals come and go, so
+    // the L2 cache would serve stale tiles.
     layerHints().cachePolicy() = CachePolicy::NO_CACHE;
+    layerHints().L2CacheSize() = 0u;
 }
 
 GeoImage
 DecalImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
 {
+    std::vector<unsigned> serials;
     std::vector<Decal> decals;
-    std::vector<GeoExtent> outputExtentsInDecalSRS;
-    std::vector<GeoExtent> intersections;
 
     const GeoExtent& outputExtent = key.getExtent();
 
-    // thread-safe collection of intersecting decals
+    // thread-safe collection of intersecting decals, in the order they were added
     {
         Threading::ScopedMutexLock lock(_mutex);
 
-        for(std::list<Decal>::const_iterator i = _decalList.begin();
-            i != _decalList.end();
-            ++i)
+        _spatialIndex.query(outputExtent, serials);
+
+        for(std::vector<unsigned>::const_iterator i = serials.begin(); i != serials.end(); ++i)
         {
-            const Decal& decal = *i;
-            GeoExtent outputExtentInDecalSRS = outputExtent.transform(decal._extent.getSRS());
-            GeoExtent intersectionExtent = decal._extent.intersectionSameSRS(outputExtentInDecalSRS);
-            if (intersectionExtent.isValid())
-            {
-                decals.push_back(decal);
-                outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
-                intersections.push_back(intersectionExtent);
-            }
+            decals.push_back(_decals.find(*i)->second);
         }
     }
 
     if (decals.empty())
         return GeoImage::INVALID;
 
-    osg::ref_ptr<osg::Image> output = new osg::Image();
-    output->allocateImage(getTileSize(), getTileSize(), 1, GL_RGBA, GL_UNSIGNED_BYTE);
-    output->setInternalTextureFormat(GL_RGBA8);
-    ::memset(output->data(), 0, output->getTotalSizeInBytes());
+    // Start from the tile we composed last time if possible, and only
+    // draw the decals added since.
+    osg::ref_ptr<osg::Object> cached;
+    unsigned first = _tileCache.get(key, serials, cached);
+
+    osg::ref_ptr<osg::Image> output = dynamic_cast<osg::Image*>(cached.get());
+    if (!output.valid())
+    {
+        first = 0u;
+        output = new osg::Image();
+        output->allocateImage(getTileSize(), getTileSize(), 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        output->setInternalTextureFormat(GL_RGBA8);
+        ::memset(output->data(), 0, output->getTotalSizeInBytes());
+    }
+
     ImageUtils::PixelWriter writeOutput(output.get());
     ImageUtils::PixelReader readOutput(output.get());
 
     osg::Vec4 existingValue;
     osg::Vec4 value;
 
-    for(unsigned i=0; i<decals.size(); ++i)
+    for(unsigned i=first; i<decals.size(); ++i)
     {
         const Decal& decal = decals[i];
         const GeoExtent& decalExtent = decal._extent;
         ImageUtils::PixelReader readInput(decal._image.get());
-        const GeoExtent& outputExtentInDecalSRS = outputExtentsInDecalSRS[i];
-        const GeoExtent& intersection = intersections[i];
+        GeoExtent outputExtentInDecalSRS = outputExtent.transform(decalExtent.getSRS());
 
         for(unsigned t=0; t<(unsigned)output->t(); ++t)
         {
@@ -143,27 +284,32 @@ DecalImageLayer::createImageImplementation(const TileKey& key, ProgressCallback*
         }
     }
 
+    _tileCache.put(key, serials, output.get());
+
     return GeoImage(output.get(), outputExtent);
 }
 
 bool
 DecalImageLayer::addDecal(const std::string& id, const GeoExtent& extent, const osg::Image* image)
 {
+    if (!extent.isValid() || !image)
+        return false;
+
     Threading::ScopedMutexLock lock(_mutex);
 
     DecalIndex::iterator i = _decalIndex.find(id);
     if (i != _decalIndex.end())
         return false;
 
-    _decalList.push_back(Decal());
-    Decal& decal = _decalList.back();
+    unsigned serial = _nextSerial++;
+    Decal& decal = _decals[serial];
     decal._extent = extent;
     decal._image = image;
 
-    _decalIndex[id] = --_decalList.end();
+    _decalIndex[id] = serial;
+    _spatialIndex.insert(serial, extent);
 
-    // data changed so up the revsion.
-    bumpRevision();
+    // No revision change; only the tiles under the decal are affected.
     return true;
 }
 
@@ -175,11 +321,9 @@ DecalImageLayer::removeDecal(const std::string& id)
     DecalIndex::iterator i = _decalIndex.find(id);
     if (i != _decalIndex.end())
     {
-        _decalList.erase(i->second);
+        _spatialIndex.remove(i->second);
+        _decals.erase(i->second);
         _decalIndex.erase(i);
-
-        // data changed so up the revsion.
-        bumpRevision();
     }
 }
 
@@ -190,7 +334,7 @@ DecalImageLayer::getDecalExtent(const std::string& id) const
     DecalIndex::const_iterator i = _decalIndex.find(id);
     if (i != _decalIndex.end())
     {
-        return i->second->_extent;
+        return _decals.find(i->second)->second._extent;
     }
     return GeoExtent::INVALID;
 }
@@ -200,7 +344,9 @@ DecalImageLayer::clearDecals()
 {
     Threading::ScopedMutexLock lock(_mutex);
     _decalIndex.clear();
-    _decalList.clear();
+    _decals.clear();
+    _spatialIndex.clear();
+    _tileCache.clear();
     bumpRevision();
 }
 
@@ -232,59 +378,94 @@ DecalElevationLayer::init()
 {
     ElevationLayer::init();
 
+    _nextSerial = 0u;
+
     // Set the layer profile.
     setProfile(Profile::create("global-geodetic"));
 
     // This is an offset layer (the elevation values are offsets)
     setOffset(true);
 
-    // Never cache decals
+    // Never cache decals. The layer keeps its own cache of composed
+    // tiles, and does not change revision when decals come and go, so
+    // the L2 cache would serve stale tiles.
     layerHints().cachePolicy() = CachePolicy::NO_CACHE;
+    layerHints().L2CacheSize() = 0u;
+}
+
+void
+DecalElevationLayer::addedToMap(const Map* map)
+{
+    ElevationLayer::addedToMap(map);
+    _map = map;
+}
+
+void
+DecalElevationLayer::removedFromMap(const Map* map)
+{
+    ElevationLayer::removedFromMap(map);
+    _map = 0L;
+}
+
+void
+DecalElevationLayer::refreshElevationPool(const GeoExtent& extent)
+{
+    // Since the revision doesn't change, the elevation pool would keep
+    // serving the old heights under the decal.
+    osg::ref_ptr<const Map> map;
+    if (_map.lock(map) && map->getElevationPool())
+    {
+        map->getElevationPool()->clear(extent);
+    }
 }
 
 GeoHeightField
 DecalElevationLayer::createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const
 {
+    std::vector<unsigned> serials;
     std::vector<Decal> decals;
-    std::vector<GeoExtent> outputExtentsInDecalSRS;
-    std::vector<GeoExtent> intersections;
 
     const GeoExtent& outputExtent = key.getExtent();
 
-    // thread-safe collection of intersecting decals
+    // thread-safe collection of intersecting decals, in the order they were added
     {
         Threading::ScopedMutexLock lock(_mutex);
 
-        for(std::list<Decal>::const_iterator i = _decalList.begin();
-            i != _decalList.end();
-            ++i)
+        _spatialIndex.query(outputExtent, serials);
+
+        for(std::vector<unsigned>::const_iterator i = serials.begin(); i != serials.end(); ++i)
         {
-            const Decal& decal = *i;
-            GeoExtent outputExtentInDecalSRS = outputExtent.transform(decal._heightfield.getExtent().getSRS());
-            GeoExtent intersectionExtent = decal._heightfield.getExtent().intersectionSameSRS(outputExtentInDecalSRS);
-            if (intersectionExtent.isValid())
-            {
-                decals.push_back(decal);
-                outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
-                intersections.push_back(intersectionExtent);
-            }
+            decals.push_back(_decals.find(*i)->second);
         }
     }
 
     if (decals.empty())
         return GeoHeightField::INVALID;
 
-    osg::ref_ptr<osg::HeightField> output = new osg::HeightField();
-    output->allocate(getTileSize(), getTileSize());
-    output->getFloatArray()->assign(output->getFloatArray()->size(), 0.0f);
+    // Heights add up, so the tile we composed last time only
+    // needs the decals added since.
+    osg::ref_ptr<osg::Object> cached;
+    unsigned first = _tileCache.get(key, serials, cached);
 
-    for(unsigned i=0; i<decals.size(); ++i)
+    osg::ref_ptr<osg::HeightField> output = dynamic_cast<osg::HeightField*>(cached.get());
+    if (!output.valid())
+    {
+        first = 0u;
+        output = new osg::HeightField();
+        output->allocate(getTileSize(), getTileSize());
+        output->getFloatArray()->assign(output->getFloatArray()->size(), 0.0f);
+    }
+
+    for(unsigned i=first; i<decals.size(); ++i)
     {
         const Decal& decal = decals[i];
 
         const GeoExtent& decalExtent = decal._heightfield.getExtent();
-        const GeoExtent& outputExtentInDecalSRS = outputExtentsInDecalSRS[i];
-        const GeoExtent& intersection = intersections[i];
+        GeoExtent outputExtentInDecalSRS = outputExtent.transform(decalExtent.getSRS());
+        GeoExtent intersection = decalExtent.intersectionSameSRS(outputExtentInDecalSRS);
+        if (!intersection.isValid())
+            continue;
+
         const osg::HeightField* decal_hf = decal._heightfield.getHeightField();
 
         double xInterval = outputExtentInDecalSRS.width() / (double)(output->getNumColumns()-1);
@@ -320,6 +501,8 @@ DecalElevationLayer::createHeightFieldImplementation(const TileKey& key, Progres
         }
     }
 
+    _tileCache.put(key, serials, output.get());
+
     return GeoHeightField(output.get(), outputExtent);
 }
 
@@ -329,12 +512,6 @@ DecalElevationLayer::addDecal(const std::string& id, const GeoExtent& extent, co
     if (!extent.isValid() || !image)
         return false;
 
-    Threading::ScopedMutexLock lock(_mutex);
-
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
-        return false;
-
     osg::HeightField* hf = new osg::HeightField();
     hf->allocate(image->s(), image->t());
 
@@ -353,15 +530,7 @@ DecalElevationLayer::addDecal(const std::string& id, const GeoExtent& extent, co
         }
     }
 
-    _decalList.push_back(Decal());
-    Decal& decal = _decalList.back();
-    decal._heightfield = GeoHeightField(hf, extent);
-
-    _decalIndex[id] = --_decalList.end();
-
-    // data changed so up the revsion.
-    bumpRevision();
-    return true;
+    return addDecal(id, GeoHeightField(hf, extent));
 }
 
 bool
@@ -370,12 +539,6 @@ DecalElevationLayer::addDecal(const std::string& id, const GeoExtent& extent, co
     if (!extent.isValid() || !image)
         return false;
 
-    Threading::ScopedMutexLock lock(_mutex);
-
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
-        return false;
-
     osg::HeightField* hf = new osg::HeightField();
     hf->allocate(image->s(), image->t());
 
@@ -392,31 +555,52 @@ DecalElevationLayer::addDecal(const std::string& id, const GeoExtent& extent, co
         }
     }
 
-    _decalList.push_back(Decal());
-    Decal& decal = _decalList.back();
-    decal._heightfield = GeoHeightField(hf, extent);
+    return addDecal(id, GeoHeightField(hf, extent));
+}
+
+bool
+DecalElevationLayer::addDecal(const std::string& id, const GeoHeightField& heightfield)
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
 
-    _decalIndex[id] = --_decalList.end();
+        DecalIndex::iterator i = _decalIndex.find(id);
+        if (i != _decalIndex.end())
+            return false;
 
-    // data changed so up the revsion.
-    bumpRevision();
+        unsigned serial = _nextSerial++;
+        Decal& decal = _decals[serial];
+        decal._extent = heightfield.getExtent();
+        decal._heightfield = heightfield;
+
+        _decalIndex[id] = serial;
+        _spatialIndex.insert(serial, decal._extent);
+    }
+
+    // No revision change; only the tiles under the decal are affected.
+    refreshElevationPool(heightfield.getExtent());
     return true;
 }
 
 void
 DecalElevationLayer::removeDecal(const std::string& id)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
+    GeoExtent extent;
     {
-        _decalList.erase(i->second);
-        _decalIndex.erase(i);
+        Threading::ScopedMutexLock lock(_mutex);
 
-        // data changed so up the revsion.
-        bumpRevision();
+        DecalIndex::iterator i = _decalIndex.find(id);
+        if (i == _decalIndex.end())
+            return;
+
+        Decals::iterator d = _decals.find(i->second);
+        extent = d->second._extent;
+        _spatialIndex.remove(i->second);
+        _decals.erase(d);
+        _decalIndex.erase(i);
     }
+
+    refreshElevationPool(extent);
 }
 
 const GeoExtent&
@@ -426,7 +610,7 @@ DecalElevationLayer::getDecalExtent(const std::string& id) const
     DecalIndex::const_iterator i = _decalIndex.find(id);
     if (i != _decalIndex.end())
     {
-        return i->second->_heightfield.getExtent();
+        return _decals.find(i->second)->second._extent;
     }
     return GeoExtent::INVALID;
 }
@@ -436,7 +620,9 @@ DecalElevationLayer::clearDecals()
 {
     Threading::ScopedMutexLock lock(_mutex);
     _decalIndex.clear();
-    _decalList.clear();
+    _decals.clear();
+    _spatialIndex.clear();
+    _tileCache.clear();
     bumpRevision();
 }
 
@@ -465,11 +651,16 @@ DecalLandCoverLayer::init()
 {
     LandCoverLayer::init();
 
+    _nextSerial = 0u;
+
     // Set the layer profile.
     setProfile(Profile::create("global-geodetic"));
 
-    // Never cache decals
+    // Never cache decals. The layer keeps its own cache of composed
+    // tiles, and does not change revision when decals come and go, so
+    // the L2 cache would serve stale tiles.
     layerHints().cachePolicy() = CachePolicy::NO_CACHE;
+    layerHints().L2CacheSize() = 0u;
 }
 
 Status
@@ -493,54 +684,52 @@ DecalLandCoverLayer::openImplementation()
 GeoImage
 DecalLandCoverLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
 {
+    std::vector<unsigned> serials;
     std::vector<Decal> decals;
-    std::vector<GeoExtent> outputExtentsInDecalSRS;
-    std::vector<GeoExtent> intersections;
 
     const GeoExtent& outputExtent = key.getExtent();
 
-    // thread-safe collection of intersecting decals
+    // thread-safe collection of intersecting decals, in the order they were added
     {
         Threading::ScopedMutexLock lock(_mutex);
 
-        for(std::list<Decal>::const_iterator i = _decalList.begin();
-            i != _decalList.end();
-            ++i)
+        _spatialIndex.query(outputExtent, serials);
+
+        for(std::vector<unsigned>::const_iterator i = serials.begin(); i != serials.end(); ++i)
         {
-            const Decal& decal = *i;
-            const GeoExtent& decalExtent = decal._extent;
-            GeoExtent outputExtentInDecalSRS = outputExtent.transform(decalExtent.getSRS());
-            GeoExtent intersectionExtent = decalExtent.intersectionSameSRS(outputExtentInDecalSRS);
-            if (intersectionExtent.isValid())
-            {
-                decals.push_back(decal);
-                outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
-                intersections.push_back(intersectionExtent);
-            }
+            decals.push_back(_decals.find(*i)->second);
         }
     }
 
     if (decals.empty())
         return GeoImage::INVALID;
 
-    osg::ref_ptr<osg::Image> output = LandCover::createImage(getTileSize());
+    // Later decals overwrite earlier ones, so the tile we composed
+    // last time only needs the decals added since.
+    osg::ref_ptr<osg::Object> cached;
+    unsigned first = _tileCache.get(key, serials, cached);
+
+    osg::ref_ptr<osg::Image> output = dynamic_cast<osg::Image*>(cached.get());
+    if (!output.valid())
+    {
+        first = 0u;
+        output = LandCover::createImage(getTileSize());
     
-    // initialize to nodata
-    ImageUtils::PixelWriter writeOutput(output.get());
-    writeOutput.assign(Color::all(NO_DATA_VALUE));
+        // initialize to nodata
+        ImageUtils::PixelWriter writeOutput(output.get());
+        writeOutput.assign(Color::all(NO_DATA_VALUE));
+    }
 
-    ImageUtils::PixelReader readOutput(output.get());
-    readOutput.setBilinear(false);
+    ImageUtils::PixelWriter writeOutput(output.get());
 
     osg::Vec4 value;
 
-    for(unsigned i=0; i<decals.size(); ++i)
+    for(unsigned i=first; i<decals.size(); ++i)
     {
         const Decal& decal = decals[i];
         const GeoExtent& decalExtent = decal._extent;
         ImageUtils::PixelReader readInput(decal._image.get());
-        const GeoExtent& outputExtentInDecalSRS = outputExtentsInDecalSRS[i];
-        const GeoExtent& intersection = intersections[i];
+        GeoExtent outputExtentInDecalSRS = outputExtent.transform(decalExtent.getSRS());
 
         for(unsigned t=0; t<(unsigned)output->t(); ++t)
         {
@@ -570,27 +759,32 @@ DecalLandCoverLayer::createImageImplementation(const TileKey& key, ProgressCallb
         }
     }
 
+    _tileCache.put(key, serials, output.get());
+
     return GeoImage(output.get(), outputExtent);
 }
 
 bool
 DecalLandCoverLayer::addDecal(const std::string& id, const GeoExtent& extent, const osg::Image* image)
 {
+    if (!extent.isValid() || !image)
+        return false;
+
     Threading::ScopedMutexLock lock(_mutex);
 
     DecalIndex::iterator i = _decalIndex.find(id);
     if (i != _decalIndex.end())
         return false;
 
-    _decalList.push_back(Decal());
-    Decal& decal = _decalList.back();
+    unsigned serial = _nextSerial++;
+    Decal& decal = _decals[serial];
     decal._extent = extent;
     decal._image = image;
 
-    _decalIndex[id] = --_decalList.end();
+    _decalIndex[id] = serial;
+    _spatialIndex.insert(serial, extent);
 
-    // data changed so up the revsion.
-    bumpRevision();
+    // No revision change; only the tiles under the decal are affected.
     return true;
 }
 
@@ -602,11 +796,9 @@ DecalLandCoverLayer::removeDecal(const std::string& id)
     DecalIndex::iterator i = _decalIndex.find(id);
     if (i != _decalIndex.end())
     {
-        _decalList.erase(i->second);
+        _spatialIndex.remove(i->second);
+        _decals.erase(i->second);
         _decalIndex.erase(i);
-
-        // data changed so up the revsion.
-        bumpRevision();
     }
 }
 
@@ -617,7 +809,7 @@ DecalLandCoverLayer::getDecalExtent(const std::string& id) const
     DecalIndex::const_iterator i = _decalIndex.find(id);
     if (i != _decalIndex.end())
     {
-        return i->second->_extent;
+        return _decals.find(i->second)->second._extent;
     }
     return GeoExtent::INVALID;
 }
@@ -627,6 +819,8 @@ DecalLandCoverLayer::clearDecals()
 {
     Threading::ScopedMutexLock lock(_mutex);
     _decalIndex.clear();
-    _decalList.clear();
+    _decals.clear();
+    _spatialIndex.clear();
+    _tileCache.clear();
     bumpRevision();
 }
@@ -29,7 +29,8 @@ using namespace osgEarth;
 
 DrapeableNode::DrapeableNode() :
 _drapingEnabled( true ),
-_updateRequested( true )
+_updateRequested( true ),
+_drapingRevision( 0u )
 {
     // Unfortunetly, there's no way to return a correct bounding sphere for
     // the node since the draping will move it to the ground. The bounds
@@ -47,6 +48,7 @@ osg::Group(rhs, copy)
 {
     _drapingEnabled = rhs._drapingEnabled;
     _updateRequested = rhs._updateRequested;
+    _drapingRevision = 0u;
 }
 
 void
@@ -56,6 +58,7 @@ DrapeableNode::setDrapingEnabled(bool value)
     {
         _drapingEnabled = value;
         setCullingActive( !_drapingEnabled );
+        dirtyDraping();
     }
 }
 
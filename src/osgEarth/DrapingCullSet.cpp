@@ -27,6 +27,20 @@
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
+namespace
+{
+    // FNV-1a over raw bytes
+    void hashBytes(unsigned& hash, const void* data, unsigned size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (unsigned i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+    }
+}
+
 
 DrapingCullSet&
 DrapingManager::get(const osg::Camera* cam)
@@ -148,3 +162,44 @@ DrapingCullSet::accept(osg::NodeVisitor& nv)
         _frameCulled = true;
     }
 }
+
+bool
+DrapingCullSet::getSignature(const osg::FrameStamp* stamp, unsigned& out) const
+{
+    int frame = stamp ? stamp->getFrameNumber() : 0;
+
+    unsigned hash = 2166136261u;
+
+    for (std::vector<Entry>::const_iterator entry = _entries.begin(); entry != _entries.end(); ++entry)
+    {
+        // same filter as accept()
+        if (frame - entry->_frame > 1)
+            continue;
+
+        const DrapeableNode* node = static_cast<const DrapeableNode*>(entry->_node.get());
+
+        // animated content changes without telling us:
+        if (node->getNumChildrenRequiringUpdateTraversal() > 0 || node->getUpdateCallback())
+            return false;
+
+        const osg::Node* ptr = node;
+        hashBytes(hash, &ptr, sizeof(ptr));
+
+        unsigned revision = node->getDrapingRevision();
+        hashBytes(hash, &revision, sizeof(revision));
+
+        unsigned numChildren = node->getNumChildren();
+        hashBytes(hash, &numChildren, sizeof(numChildren));
+
+        const osg::BoundingSphere& bs = node->getBound();
+        osg::BoundingSphere::value_type radius = bs.radius();
+        hashBytes(hash, bs.center().ptr(), sizeof(osg::BoundingSphere::vec_type));
+        hashBytes(hash, &radius, sizeof(radius));
+
+        if (entry->_matrix.valid())
+            hashBytes(hash, entry->_matrix->ptr(), 16*sizeof(osg::RefMatrix::value_type));
+    }
+
+    out = hash;
+    return true;
+}
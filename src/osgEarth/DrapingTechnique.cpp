@@ -123,16 +123,24 @@ namespace
 
         osg::ref_ptr<osg::Uniform> _texGenUniform;
 
+        // what the RTT texture currently holds, so unchanged frames can reuse it
+        mutable bool _rendered;
+        unsigned     _signature;
+        osg::Matrix  _renderedView;
+        osg::Matrix  _renderedProj;
+
         void resizeGLObjectBuffers(unsigned maxSize) {
             if (_texGenUniform.valid())
                 _texGenUniform->resizeGLObjectBuffers(maxSize);
+            _rendered = false;
         }
         void releaseGLObjects(osg::State* state) const {
             if (_texGenUniform.valid())
                 _texGenUniform->releaseGLObjects(state);
+            _rendered = false;
         }
 
-        LocalPerViewData() { }
+        LocalPerViewData() : _rendered(false), _signature(0u) { }
         LocalPerViewData(const LocalPerViewData& rhs, const osg::CopyOp& co) { }
     };
 }
@@ -669,6 +677,27 @@ DrapingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
             local._texGenUniform->set( vm * VPT );
         }
 
+        // If neither the RTT view nor the draped content changed since the
+        // last render, the texture still holds the right image; skip it.
+        DrapingCullSet& cullSet = _drapingManager.get(cv->getCurrentCamera());
+        unsigned signature = 0u;
+        bool isStatic = cullSet.getSignature(cv->getFrameStamp(), signature);
+
+        if (isStatic &&
+            local._rendered &&
+            local._signature == signature &&
+            local._renderedView == params._rttViewMatrix &&
+            local._renderedProj == params._rttProjMatrix)
+        {
+            cullSet.skip();
+            return;
+        }
+
+        local._rendered = isStatic;
+        local._signature = signature;
+        local._renderedView = params._rttViewMatrix;
+        local._renderedProj = params._rttProjMatrix;
+
         // traverse the overlay group (via the RTT camera).
         static_cast<DrapingCamera*>(params._rttCamera.get())->accept( *cv, cv->getCurrentCamera() );
     }
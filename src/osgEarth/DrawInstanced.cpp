@@ -23,10 +23,14 @@
 #include <osgEarth/Utils>
 #include <osgEarth/Shaders>
 #include <osgEarth/ObjectIndex>
+#include <osgEarth/ThreadingUtils>
 
 #include <osg/ComputeBoundsVisitor>
 #include <osg/TextureBuffer>
+#include <osg/BufferObject>
+#include <osg/GLExtensions>
 #include <osgUtil/Optimizer>
+#include <cstring>
 
 #define LC "[DrawInstanced] "
 
@@ -40,6 +44,11 @@ using namespace osgEarth::Util;
 //Uncomment to experiment with instance count adjustment
 //#define USE_INSTANCE_LODS
 
+// Shader storage instancing needs the GL 4.3 entry points in OSG 3.6+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+#define USE_SHADER_STORAGE
+#endif
+
 //----------------------------------------------------------------------
 
 namespace osgEarth { namespace Util
@@ -270,8 +279,562 @@ DrawInstanced::remove(osg::StateSet* stateset)
     pkg.unload( vp, pkg.Instancing );
 }
 
+//----------------------------------------------------------------------
+
+#ifdef USE_SHADER_STORAGE
+
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+#define BINDING_COMMAND_BUFFER  0
+#define BINDING_INSTANCE_BUFFER 1
+#define BINDING_VISIBLE_BUFFER  2
+
+#define CULL_GROUP_SIZE 64
+
+// floats per instance record (see Instancing.SSBO.glsl)
+#define RECORD_SIZE 8
+
+namespace
+{
+    const char* cull_CS =
+        "#version 430\n"
+
+        "layout(local_size_x=64, local_size_y=1, local_size_z=1) in; \n"
+
+        // count, instanceCount, first/firstIndex, baseVertex/baseInstance, baseInstance
+        "struct DrawCommand { \n"
+        "    uint count; \n"
+        "    uint instanceCount; \n"
+        "    uint first; \n"
+        "    uint baseVertex; \n"
+        "    uint baseInstance; \n"
+        "}; \n"
+
+        "layout(std430, binding=0) buffer DrawCommandsBuffer { \n"
+        "    DrawCommand cmd[]; \n"
+        "}; \n"
+
+        "struct Instance { \n"
+        "    vec4 offsetScale; \n"
+        "    vec4 rotation; \n"
+        "}; \n"
+
+        "layout(std430, binding=1) readonly buffer InstanceBuffer { \n"
+        "    Instance instances[]; \n"
+        "}; \n"
+
+        "layout(std430, binding=2) writeonly buffer VisibleBuffer { \n"
+        "    uint visibleInstances[]; \n"
+        "}; \n"
+
+        "uniform mat4 oe_di_modelView; \n"
+        "uniform mat4 oe_di_projection; \n"
+        "uniform int oe_di_numInstances; \n"
+        "uniform vec4 oe_di_modelBound; \n" // bounding sphere of the model (center, radius)
+        "uniform float oe_di_maxRange; \n"  // 0 = no limit
+
+        "vec3 rotate(in vec4 q, in vec3 v) { \n"
+        "    return v + 2.0*cross(q.xyz, cross(q.xyz, v) + q.w*v); \n"
+        "} \n"
+
+        // conservative test of the instance's bounding sphere against the view volume
+        "bool visible(in vec4 view, in float radius) \n"
+        "{ \n"
+        "    if (view.z > radius) return false; \n" // behind the eye
+        "    vec4 clip = oe_di_projection * view; \n"
+        "    vec2 margin = radius * vec2( \n"
+        "        length(vec2(oe_di_projection[0][0], 1.0)), \n"
+        "        length(vec2(oe_di_projection[1][1], 1.0))); \n"
+        "    return abs(clip.x) <= clip.w + margin.x && abs(clip.y) <= clip.w + margin.y; \n"
+        "} \n"
+
+        "void main() { \n"
+        "    int i = int(gl_GlobalInvocationID.x); \n"
+        "    if (i >= oe_di_numInstances) return; \n"
+        "    Instance instance = instances[i]; \n"
+        "    vec3 qv = instance.rotation.xyz; \n"
+        "    vec4 q = vec4(qv, sqrt(max(0.0, 1.0 - dot(qv, qv)))); \n"
+        "    float scale = instance.offsetScale.w; \n"
+        "    vec3 center = rotate(q, oe_di_modelBound.xyz*scale) + instance.offsetScale.xyz; \n"
+        "    float radius = oe_di_modelBound.w*scale; \n"
+        "    vec4 view = oe_di_modelView * vec4(center, 1.0); \n"
+        "    if (oe_di_maxRange > 0.0 && length(view.xyz) - radius > oe_di_maxRange) return; \n"
+        "    if (!visible(view, radius)) return; \n"
+        "    uint slot = atomicAdd(cmd[0].instanceCount, 1u); \n"
+        "    visibleInstances[slot] = uint(i); \n"
+        "} \n";
+
+    // Every primitive set draws the same culled instances, so copy the
+    // count from the first command to the rest.
+    const char* copy_CS =
+        "#version 430\n"
+
+        "layout(local_size_x=1, local_size_y=1, local_size_z=1) in; \n"
+
+        "struct DrawCommand { \n"
+        "    uint count; \n"
+        "    uint instanceCount; \n"
+        "    uint first; \n"
+        "    uint baseVertex; \n"
+        "    uint baseInstance; \n"
+        "}; \n"
+
+        "layout(std430, binding=0) buffer DrawCommandsBuffer { \n"
+        "    DrawCommand cmd[]; \n"
+        "}; \n"
+
+        "uniform int oe_di_numCommands; \n"
+
+        "void main() { \n"
+        "    uint n = cmd[0].instanceCount; \n"
+        "    for(int i=1; i<oe_di_numCommands; ++i) \n"
+        "        cmd[i].instanceCount = n; \n"
+        "} \n";
+
+    // Indirect draw command. DrawArrays commands use the first four fields
+    // (count, instanceCount, first, baseInstance).
+    struct DrawCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint first;
+        GLuint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // compute programs, shared by all instance buffers
+    Threading::Mutex         s_programsMutex;
+    osg::ref_ptr<osg::Program> s_cullProgram;
+    osg::ref_ptr<osg::Program> s_copyProgram;
+
+    void getComputePrograms(osg::ref_ptr<osg::Program>& cull, osg::ref_ptr<osg::Program>& copy)
+    {
+        Threading::ScopedMutexLock lock(s_programsMutex);
+        if (!s_cullProgram.valid())
+        {
+            s_cullProgram = new osg::Program();
+            s_cullProgram->setName("DrawInstanced cull");
+            s_cullProgram->addShader(new osg::Shader(osg::Shader::COMPUTE, cull_CS));
+
+            s_copyProgram = new osg::Program();
+            s_copyProgram->setName("DrawInstanced copy");
+            s_copyProgram->addShader(new osg::Shader(osg::Shader::COMPUTE, copy_CS));
+        }
+        cull = s_cullProgram.get();
+        copy = s_copyProgram.get();
+    }
+
+    /**
+     * GPU-side instances of one model: the compact instance records,
+     * one indirect draw command per primitive set, and the list of
+     * instances that passed the cull for the current camera.
+     */
+    class InstanceBuffer : public osg::Referenced
+    {
+    public:
+        InstanceBuffer(osg::FloatArray* records, const osg::BoundingSphere& modelBound, float maxRange) :
+            _records(records),
+            _numInstances(records->size() / RECORD_SIZE),
+            _modelBound(modelBound),
+            _maxRange(maxRange)
+        {
+            getComputePrograms(_cullProgram, _copyProgram);
+        }
+
+        //! Adds a draw command for a primitive set and returns its index
+        unsigned addCommand(const osg::PrimitiveSet* ps)
+        {
+            DrawCommand cmd;
+            cmd.count = ps->getNumIndices();
+            cmd.instanceCount = 0;
+            cmd.first = 0;
+            cmd.baseVertex = 0;
+            cmd.baseInstance = 0;
+
+            const osg::DrawArrays* da = dynamic_cast<const osg::DrawArrays*>(ps);
+            if (da)
+                cmd.first = da->getFirst();
+
+            _commands.push_back(cmd);
+            return _commands.size() - 1;
+        }
+
+        //! Runs the cull compute shader for the current camera.
+        void cull(osg::RenderInfo& ri) const
+        {
+            osg::State* state = ri.getState();
+            osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+            GLObjects& gl = _gl[state->getContextID()];
+
+            if (_commands.empty() || _numInstances == 0)
+                return;
+
+            // allocate GL objects on first run
+            if (gl.commandBuffer == 0)
+                allocate(gl, ext);
+
+            const osg::Program::PerContextProgram* renderPCP = state->getLastAppliedProgramObject();
+
+            // reset the instance counts:
+            ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.commandBuffer);
+            ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, _commands.size() * sizeof(DrawCommand), &_commands[0]);
+            ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_COMMAND_BUFFER, gl.commandBuffer);
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INSTANCE_BUFFER, gl.instanceBuffer);
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_VISIBLE_BUFFER, gl.visibleBuffer);
+
+            _cullProgram->apply(*state);
+            const osg::Program::PerContextProgram* pcp = state->getLastAppliedProgramObject();
+            if (pcp)
+            {
+                osg::Matrixf mv(state->getModelViewMatrix());
+                osg::Matrixf proj(state->getProjectionMatrix());
+                ext->glUniformMatrix4fv(pcp->getUniformLocation("oe_di_modelView"), 1, GL_FALSE, mv.ptr());
+                ext->glUniformMatrix4fv(pcp->getUniformLocation("oe_di_projection"), 1, GL_FALSE, proj.ptr());
+                ext->glUniform1i(pcp->getUniformLocation("oe_di_numInstances"), (GLint)_numInstances);
+                ext->glUniform4f(pcp->getUniformLocation("oe_di_modelBound"),
+                    _modelBound.center().x(), _modelBound.center().y(), _modelBound.center().z(), _modelBound.radius());
+                ext->glUniform1f(pcp->getUniformLocation("oe_di_maxRange"), _maxRange);
+
+                // one invocation per instance:
+                GLuint numGroups = (_numInstances + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+                ext->glDispatchCompute(numGroups, 1, 1);
+
+                if (_commands.size() > 1)
+                {
+                    ext->glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+                    _copyProgram->apply(*state);
+                    pcp = state->getLastAppliedProgramObject();
+                    if (pcp)
+                    {
+                        ext->glUniform1i(pcp->getUniformLocation("oe_di_numCommands"), (GLint)_commands.size());
+                        ext->glDispatchCompute(1, 1, 1);
+                    }
+                }
+
+                ext->glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+            }
+
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_COMMAND_BUFFER, 0);
+
+            // restore the render program
+            if (renderPCP)
+                renderPCP->useProgram();
+            state->setLastAppliedProgramObject(renderPCP);
+        }
+
+        //! Binds the buffers the vertex shader and indirect draws read.
+        //! Returns false if the cull has not run in this context yet.
+        bool bind(osg::State& state) const
+        {
+            const GLObjects& gl = _gl[state.getContextID()];
+            if (gl.commandBuffer == 0)
+                return false;
+
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INSTANCE_BUFFER, gl.instanceBuffer);
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_VISIBLE_BUFFER, gl.visibleBuffer);
+            ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gl.commandBuffer);
+            return true;
+        }
+
+        void unbind(osg::State& state) const
+        {
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+            ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INSTANCE_BUFFER, 0);
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_VISIBLE_BUFFER, 0);
+        }
+
+        void releaseGLObjects(osg::State* state) const
+        {
+            for (unsigned i = 0; i < _gl.size(); ++i)
+            {
+                if (state == NULL || state->getContextID() == i)
+                {
+                    GLObjects& gl = _gl[i];
+                    if (state && gl.commandBuffer != 0)
+                    {
+                        osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+                        ext->glDeleteBuffers(1, &gl.commandBuffer);
+                        ext->glDeleteBuffers(1, &gl.instanceBuffer);
+                        ext->glDeleteBuffers(1, &gl.visibleBuffer);
+                    }
+                    gl = GLObjects();
+                }
+            }
+        }
+
+    private:
+        struct GLObjects
+        {
+            GLuint commandBuffer;
+            GLuint instanceBuffer;
+            GLuint visibleBuffer;
+            GLObjects() : commandBuffer(0), instanceBuffer(0), visibleBuffer(0) { }
+        };
+
+        void allocate(GLObjects& gl, osg::GLExtensions* ext) const
+        {
+            ext->glGenBuffers(1, &gl.commandBuffer);
+            ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.commandBuffer);
+            ext->glBufferStorage(GL_SHADER_STORAGE_BUFFER, _commands.size() * sizeof(DrawCommand), &_commands[0], GL_DYNAMIC_STORAGE_BIT);
+
+            ext->glGenBuffers(1, &gl.instanceBuffer);
+            ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.instanceBuffer);
+            ext->glBufferStorage(GL_SHADER_STORAGE_BUFFER, _records->size() * sizeof(GLfloat), _records->getDataPointer(), 0);
+
+            ext->glGenBuffers(1, &gl.visibleBuffer);
+            ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl.visibleBuffer);
+            ext->glBufferStorage(GL_SHADER_STORAGE_BUFFER, _numInstances * sizeof(GLuint), NULL, 0);
+
+            ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+
+        // kept so other graphics contexts can allocate their own copy
+        osg::ref_ptr<osg::FloatArray> _records;
+        unsigned _numInstances;
+        osg::BoundingSphere _modelBound;
+        float _maxRange;
+        std::vector<DrawCommand> _commands;
+        osg::ref_ptr<osg::Program> _cullProgram;
+        osg::ref_ptr<osg::Program> _copyProgram;
+        mutable osg::buffered_object<GLObjects> _gl;
+    };
+
+    /**
+     * Runs the instance cull. It sits in a render bin ahead of the
+     * instanced geometry so the visible list is ready when that draws.
+     */
+    class InstanceCullDrawable : public osg::Drawable
+    {
+    public:
+        InstanceCullDrawable(InstanceBuffer* buffer, const osg::BoundingBox& bbox) :
+            _buffer(buffer),
+            _bbox(bbox)
+        {
+            setUseDisplayList(false);
+            setCullingActive(false);
+            getOrCreateStateSet()->setRenderBinDetails(-1, "RenderBin");
+        }
+
+        osg::BoundingBox computeBoundingBox() const { return _bbox; }
+
+        void drawImplementation(osg::RenderInfo& ri) const { _buffer->cull(ri); }
+
+        void releaseGLObjects(osg::State* state) const
+        {
+            osg::Drawable::releaseGLObjects(state);
+            _buffer->releaseGLObjects(state);
+        }
+
+    private:
+        osg::ref_ptr<InstanceBuffer> _buffer;
+        osg::BoundingBox _bbox;
+    };
+
+    /**
+     * Draws each primitive set of a geometry with its indirect command,
+     * so the instance count comes from the GPU cull.
+     */
+    struct IndirectDrawCallback : public osg::Drawable::DrawCallback
+    {
+        osg::ref_ptr<InstanceBuffer> _buffer;
+        std::vector<unsigned> _commands; // command index per primitive set
+
+        IndirectDrawCallback(InstanceBuffer* buffer) : _buffer(buffer) { }
+
+        void drawImplementation(osg::RenderInfo& ri, const osg::Drawable* drawable) const
+        {
+            osg::State& state = *ri.getState();
+            const osg::Geometry* geom = drawable->asGeometry();
+            if (!geom || !_buffer->bind(state))
+                return;
+
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+            osg::VertexArrayState* vas = state.getCurrentVertexArrayState();
+            vas->setVertexBufferObjectSupported(true);
+
+            geom->drawVertexArraysImplementation(ri);
+
+            for (unsigned i = 0; i < geom->getNumPrimitiveSets() && i < _commands.size(); ++i)
+            {
+                const osg::PrimitiveSet* ps = geom->getPrimitiveSet(i);
+                const GLvoid* offset = (const GLvoid*)(_commands[i] * sizeof(DrawCommand));
+
+                const osg::DrawElements* de = ps->getDrawElements();
+                if (de)
+                {
+                    osg::GLBufferObject* ebo = de->getOrCreateGLBufferObject(state.getContextID());
+                    if (ebo->isDirty())
+                        ebo->compileBuffer();
+                    vas->bindElementBufferObject(ebo);
+
+                    ext->glMultiDrawElementsIndirect(de->getMode(), de->getDataType(), offset, 1, 0);
+                }
+                else
+                {
+                    ext->glMultiDrawArraysIndirect(ps->getMode(), offset, 1, 0);
+                }
+            }
+
+            vas->unbindElementBufferObject();
+            _buffer->unbind(state);
+        }
+    };
+
+    // Collects the geometries in a model, and whether all of them can be
+    // drawn with indirect commands.
+    struct CollectGeometries : public osg::NodeVisitor
+    {
+        std::vector<osg::Geometry*> _geoms;
+        bool _ok;
+
+        CollectGeometries() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _ok(true)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            osg::Geometry* geom = drawable.asGeometry();
+            if (!geom)
+            {
+                _ok = false;
+                return;
+            }
+
+            for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+            {
+                const osg::PrimitiveSet* ps = geom->getPrimitiveSet(i);
+                if (ps->getDrawElements() == 0L && ps->getType() != osg::PrimitiveSet::DrawArraysPrimitiveType)
+                    _ok = false;
+            }
+
+            _geoms.push_back(geom);
+        }
+    };
+
+    /**
+     * Packs the instances into compact records: (offset.xyz, scale) and
+     * (rotation.xyz, object ID). Returns false if any instance has a
+     * non-uniform or negative scale, which the record cannot hold.
+     */
+    bool makeInstanceRecords(const std::vector<ModelInstance>& instances, osg::FloatArray* records)
+    {
+        records->reserve(instances.size() * RECORD_SIZE);
+
+        for (std::vector<ModelInstance>::const_iterator i = instances.begin(); i != instances.end(); ++i)
+        {
+            osg::Vec3d translate, scale;
+            osg::Quat rotation, scaleOrientation;
+            i->matrix.decompose(translate, rotation, scale, scaleOrientation);
+
+            double tolerance = 1e-4 * scale.x();
+            if (scale.x() <= 0.0 ||
+                !osg::equivalent(scale.x(), scale.y(), tolerance) ||
+                !osg::equivalent(scale.x(), scale.z(), tolerance))
+            {
+                return false;
+            }
+
+            // keep w positive so the shader can rebuild it from xyz
+            double len = rotation.length();
+            if (len > 0.0)
+                rotation /= len;
+            if (rotation.w() < 0.0)
+                rotation = -rotation;
+
+            GLfloat objectID;
+            ::memcpy(&objectID, &i->objectID, sizeof(GLfloat));
+
+            records->push_back(translate.x());
+            records->push_back(translate.y());
+            records->push_back(translate.z());
+            records->push_back(scale.x());
+            records->push_back(rotation.x());
+            records->push_back(rotation.y());
+            records->push_back(rotation.z());
+            records->push_back(objectID);
+        }
+
+        return true;
+    }
+
+    /**
+     * Sets up shader storage instancing for a model. Returns false,
+     * leaving the model untouched, if the model or its instances
+     * do not fit the compact format.
+     */
+    bool convertToShaderStorage(osg::Node*                        node,
+                                const std::vector<ModelInstance>& instances,
+                                const osg::BoundingBox&           nodeBox,
+                                const osg::BoundingBox&           bbox,
+                                float                             maxRange,
+                                osg::Group*                       instanceGroup)
+    {
+        if (!Registry::capabilities().supportsGLSL(430u))
+            return false;
+
+        CollectGeometries check;
+        node->accept(check);
+        if (!check._ok || check._geoms.empty())
+            return false;
+
+        osg::ref_ptr<osg::FloatArray> records = new osg::FloatArray();
+        if (!makeInstanceRecords(instances, records.get()))
+            return false;
+
+        // reduce LODs and set the static bounds, as for the texture buffer path
+        ConvertToDrawInstanced cdi(instances.size(), bbox, true, 0L, 0);
+        node->accept(cdi);
+
+        CollectGeometries collect;
+        node->accept(collect);
+
+        osg::ref_ptr<InstanceBuffer> buffer = new InstanceBuffer(records.get(), osg::BoundingSphere(nodeBox), maxRange);
+
+        for (std::vector<osg::Geometry*>::iterator g = collect._geoms.begin(); g != collect._geoms.end(); ++g)
+        {
+            osg::Geometry* geom = *g;
+            IndirectDrawCallback* callback = new IndirectDrawCallback(buffer.get());
+
+            for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+            {
+                osg::PrimitiveSet* ps = geom->getPrimitiveSet(i);
+
+                // give each element array its own buffer object, so the
+                // indirect command can start at index zero
+                osg::DrawElements* de = ps->getDrawElements();
+                if (de)
+                    de->setElementBufferObject(new osg::ElementBufferObject());
+
+                callback->_commands.push_back(buffer->addCommand(ps));
+            }
+
+            geom->setDrawCallback(callback);
+        }
+
+        instanceGroup->addChild(new InstanceCullDrawable(buffer.get(), bbox));
+
+        VirtualProgram* vp = VirtualProgram::getOrCreate(instanceGroup->getOrCreateStateSet());
+        vp->setName("DrawInstanced SSBO");
+        Shaders pkg;
+        pkg.load(vp, pkg.InstancingSSBO);
+
+        return true;
+    }
+}
+
+#endif // USE_SHADER_STORAGE
+
 bool
-DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
+DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent, float maxRange )
 {
     if ( !Registry::capabilities().supportsDrawInstanced() )
         return false;
@@ -351,6 +914,33 @@ DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
             bbox.expandBy(nodeBox.corner(7) * m->matrix);
         }
 
+        // Flatten any transforms in the node graph:
+        MakeTransformsStatic makeStatic;
+        node->accept(makeStatic);
+        osgUtil::Optimizer::FlattenStaticTransformsDuplicatingSharedSubgraphsVisitor flatten;
+        node->accept(flatten);
+
+        // this group is simply a container for the uniform:
+        osg::Group* instanceGroup = new osg::Group();
+
+#ifdef USE_SHADER_STORAGE
+        // Compact instance records in a shader storage buffer, culled on
+        // the GPU. No size limit, so every instance is kept.
+        if (convertToShaderStorage(node, instances, nodeBox, bbox, maxRange, instanceGroup))
+        {
+            MatrixRefVector* nodeMats = new MatrixRefVector();
+            nodeMats->setName(TAG_MATRIX_VECTOR);
+            nodeMats->reserve(instances.size());
+            for (std::vector<ModelInstance>::const_iterator m = instances.begin(); m != instances.end(); ++m)
+                nodeMats->push_back(m->matrix);
+            node->getOrCreateUserDataContainer()->addUserObject(nodeMats);
+
+            instanceGroup->addChild( node );
+            parent->addChild( instanceGroup );
+            continue;
+        }
+#endif
+
 		unsigned tboSize = 0;
 		unsigned numInstancesToStore = 0;
 
@@ -374,9 +964,6 @@ DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
         nodeMats->reserve(numInstancesToStore);
         node->getOrCreateUserDataContainer()->addUserObject(nodeMats);
 
-        // this group is simply a container for the uniform:
-        osg::Group* instanceGroup = new osg::Group();
-
         // sampler that will hold the instance matrices:
         osg::Image* image = new osg::Image();
         image->setName("osgearth.drawinstanced.postex");
@@ -420,12 +1007,6 @@ DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
         posTBO->setInternalFormat( GL_RGBA32F_ARB );
         posTBO->setUnRefImageDataAfterApply( true );
 
-        // Flatten any transforms in the node graph:
-        MakeTransformsStatic makeStatic;
-        node->accept(makeStatic);
-        osgUtil::Optimizer::FlattenStaticTransformsDuplicatingSharedSubgraphsVisitor flatten;
-        node->accept(flatten);
-
         // Convert the node's primitive sets to use "draw-instanced" rendering; at the
         // same time, assign our computed bounding box as the static bounds for all
         // geometries. (As DI's they cannot report bounds naturally.)
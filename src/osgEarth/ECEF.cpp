@@ -51,14 +51,16 @@ ECEF::transformAndLocalize(const std::vector<osg::Vec3d>& input,
     if (inputSRS==NULL || outputSRS==NULL)
         return false;
 
-    const SpatialReference* geocentricSRS = outputSRS->getGeocentricSRS();
-    output->reserve( output->size() + input.size() );
+    // transform all the points at once so the batch kernels apply
+    std::vector<osg::Vec3d> ecef(input);
+    if ( !inputSRS->transform( ecef, outputSRS->getGeocentricSRS() ) )
+        return false;
+
+    output->reserve( output->size() + ecef.size() );
 
-    for( std::vector<osg::Vec3d>::const_iterator i = input.begin(); i != input.end(); ++i )
+    for( std::vector<osg::Vec3d>::const_iterator i = ecef.begin(); i != ecef.end(); ++i )
     {
-        osg::Vec3d geoc;
-        inputSRS->transform( *i, geocentricSRS, geoc );
-        output->push_back( geoc * world2local );
+        output->push_back( (*i) * world2local );
     }
 
     return true;
@@ -76,14 +78,15 @@ ECEF::transformAndLocalize(const std::vector<osg::Vec3d>& input,
     if (inputSRS==NULL || outputSRS==NULL)
         return false;
 
-    const SpatialReference* ecefSRS = outputSRS->getGeocentricSRS();
-    out_verts->reserve( out_verts->size() + input.size() );
+    std::vector<osg::Vec3d> ecef(input);
+    if ( !inputSRS->transform( ecef, outputSRS->getGeocentricSRS() ) )
+        return false;
+
+    out_verts->reserve( out_verts->size() + ecef.size() );
     
-    for( std::vector<osg::Vec3d>::const_iterator i = input.begin(); i != input.end(); ++i )
+    for( std::vector<osg::Vec3d>::const_iterator i = ecef.begin(); i != ecef.end(); ++i )
     {
-        osg::Vec3d ecef;
-        inputSRS->transform( *i, ecefSRS, ecef );
-        out_verts->push_back( ecef * world2local );
+        out_verts->push_back( (*i) * world2local );
     }
 
     if ( out_normals )
@@ -293,6 +293,7 @@ _max_vp_duration_s              ( 8.0 ),
 _orthoTracksPerspective         ( true ),
 _terrainAvoidanceEnabled        ( true ),
 _terrainAvoidanceMinDistance    ( 1.0 ),
+_heightfieldIntersection        ( false ),
 _throwingEnabled                ( false ),
 _throwDecayRate                 ( 0.05 ),
 _zoomToMouse                    ( false )
@@ -325,6 +326,7 @@ _orthoTracksPerspective( rhs._orthoTracksPerspective ),
 _breakTetherActions( rhs._breakTetherActions ),
 _terrainAvoidanceEnabled( rhs._terrainAvoidanceEnabled ),
 _terrainAvoidanceMinDistance( rhs._terrainAvoidanceMinDistance ),
+_heightfieldIntersection( rhs._heightfieldIntersection ),
 _throwingEnabled( rhs._throwingEnabled ),
 _throwDecayRate( rhs._throwDecayRate ),
 _zoomToMouse( rhs._zoomToMouse )
@@ -342,6 +344,8 @@ EarthManipulator::Settings::apply(osg::ArgumentParser& args)
         setTerrainAvoidanceEnabled( boolval );
     if ( args.read("--manip-terrain-avoidance-min-distance", doubleval) )
         setTerrainAvoidanceMinimumDistance( doubleval );
+    if ( args.read("--manip-heightfield-intersection") )
+        setHeightfieldIntersection( true );
     if ( args.read("--manip-min-distance", doubleval) )
         setMinMaxDistance(doubleval, _max_distance);
     if ( args.read("--manip-max-distance", doubleval) )
@@ -1355,30 +1359,63 @@ void EarthManipulator::collisionDetect()
 
 
 bool
-EarthManipulator::intersect(const osg::Vec3d& start, const osg::Vec3d& end, osg::Vec3d& intersection, osg::Vec3d& normal) const
+EarthManipulator::intersectTerrain(const osg::Vec3d& start, const osg::Vec3d& end, osg::Vec3d& intersection, osg::Vec3d& normal) const
 {
     osg::ref_ptr<MapNode> mapNode;
-    if ( _mapNode.lock(mapNode) && mapNode->getTerrainEngine() )
-    {
-		osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi = NULL;
+    if ( !_mapNode.lock(mapNode) || !mapNode->getTerrainEngine() )
+        return false;
 
-		lsi = new osgUtil::LineSegmentIntersector(start,end);
+    TerrainEngineNode* engine = mapNode->getTerrainEngine();
 
-        osgUtil::IntersectionVisitor iv(lsi.get());
-        iv.setTraversalMask(_intersectTraversalMask);
+    osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi = new osgUtil::LineSegmentIntersector(start,end);
+    lsi->setIntersectionLimit(lsi->LIMIT_NEAREST);
 
-        mapNode->getTerrainEngine()->accept(iv);
+    osgUtil::IntersectionVisitor iv(lsi.get());
+    iv.setTraversalMask(_intersectTraversalMask);
+
+    osg::Node* tileGraph = _settings->getHeightfieldIntersection() ? engine->getTileGraph() : 0L;
+    if ( tileGraph )
+    {
+        // Query the tiles' elevation data directly, and only traverse the
+        // rest of the engine's subgraph looking for non-terrain geometry.
+        bool hit = engine->intersectTiles(start, end, intersection, normal);
+
+        for(unsigned i=0; i<engine->getNumChildren(); ++i)
+        {
+            if ( engine->getChild(i) != tileGraph )
+                engine->getChild(i)->accept(iv);
+        }
 
         if (lsi->containsIntersections())
         {
-            intersection = lsi->getIntersections().begin()->getWorldIntersectPoint();
-            normal = lsi->getIntersections().begin()->getWorldIntersectNormal();
-            return true;
+            const osgUtil::LineSegmentIntersector::Intersection& first = *lsi->getIntersections().begin();
+            if (!hit || first.ratio < (intersection-start).length() / (end-start).length())
+            {
+                intersection = first.getWorldIntersectPoint();
+                normal = first.getWorldIntersectNormal();
+            }
+            hit = true;
         }
+        return hit;
+    }
+
+    engine->accept(iv);
+
+    if (lsi->containsIntersections())
+    {
+        intersection = lsi->getIntersections().begin()->getWorldIntersectPoint();
+        normal = lsi->getIntersections().begin()->getWorldIntersectNormal();
+        return true;
     }
     return false;
 }
 
+bool
+EarthManipulator::intersect(const osg::Vec3d& start, const osg::Vec3d& end, osg::Vec3d& intersection, osg::Vec3d& normal) const
+{
+    return intersectTerrain(start, end, intersection, normal);
+}
+
 bool
 EarthManipulator::intersectLookVector(osg::Vec3d& out_eye,
                                       osg::Vec3d& out_target,
@@ -1394,19 +1431,10 @@ EarthManipulator::intersectLookVector(osg::Vec3d& out_eye,
         getWorldInverseMatrix().getLookAt(out_eye, out_target, out_up, 1.0);
         osg::Vec3d look = out_target-out_eye;
 
-		osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi =
-		    new osgUtil::LineSegmentIntersector(out_eye, out_eye+look*1e8);
-
-        lsi->setIntersectionLimit(lsi->LIMIT_NEAREST);
-
-        osgUtil::IntersectionVisitor iv(lsi.get());
-        iv.setTraversalMask(_intersectTraversalMask);
-
-        mapNode->getTerrainEngine()->accept(iv);
-
-        if (lsi->containsIntersections())
+        osg::Vec3d hit, normal;
+        if (intersectTerrain(out_eye, out_eye+look*1e8, hit, normal))
         {
-            out_target = lsi->getIntersections().begin()->getWorldIntersectPoint();
+            out_target = hit;
             if ( !_srs->isGeographic() || GeoMath::isPointVisible(out_eye, out_target, R) )
             {
                 success = true;
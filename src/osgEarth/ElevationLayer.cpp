@@ -285,33 +285,107 @@ ElevationLayer::assembleHeightField(const TileKey& key,
             double dx = (maxx - minx)/(double)(width-1);
             double dy = (maxy - miny)/(double)(height-1);
 
-            //Create the new heightfield by sampling all of them.
-            for (unsigned int c = 0; c < width; ++c)
+            const SpatialReference* keySRS = key.getExtent().getSRS();
+
+            bool sameSRS = true;
+            for (GeoHeightFieldVector::iterator itr = heightFields.begin(); itr != heightFields.end() && sameSRS; ++itr)
+            {
+                const SpatialReference* srs = itr->getExtent().getSRS();
+                sameSRS = srs->isHorizEquivalentTo(keySRS) && srs->isVertEquivalentTo(keySRS);
+            }
+
+            if (sameSRS)
             {
-                double x = minx + (dx * (double)c);
-                for (unsigned r = 0; r < height; ++r)
+                // No reprojection needed, so sample each source over the whole
+                // grid at once, and let each output post take its value from
+                // the first (highest resolution) source that contains it, like
+                // the general path below does.
+                out_hf->getFloatArray()->assign(width*height, NO_DATA_VALUE);
+                std::vector<bool> claimed(width*height, false);
+                unsigned numClaimed = 0u;
+
+                std::vector<double> cols(width), rows(height);
+                std::vector<float> heights(width*height);
+
+                for (GeoHeightFieldVector::iterator itr = heightFields.begin(); itr != heightFields.end() && numClaimed < width*height; ++itr)
                 {
-                    double y = miny + (dy * (double)r);
+                    const GeoExtent& ex = itr->getExtent();
+                    const osg::HeightField* hf = itr->getHeightField();
+                    double xInterval = ex.width()  / (double)(hf->getNumColumns()-1);
+                    double yInterval = ex.height() / (double)(hf->getNumRows()-1);
+
+                    for (unsigned c = 0; c < width; ++c)
+                        cols[c] = osg::clampBetween((minx + dx*(double)c - ex.xMin()) / xInterval, 0.0, (double)(hf->getNumColumns()-1));
+                    for (unsigned r = 0; r < height; ++r)
+                        rows[r] = osg::clampBetween((miny + dy*(double)r - ex.yMin()) / yInterval, 0.0, (double)(hf->getNumRows()-1));
+
+                    HeightFieldUtils::getHeightsAtPixels(hf, &cols[0], width, &rows[0], height, &heights[0], INTERP_BILINEAR);
+
+                    HeightFieldNeighborhood hood;
+                    hood.setNeighbor(0, 0, const_cast<osg::HeightField*>(hf));
 
-                    //For each sample point, try each heightfield.  The first one with a valid elevation wins.
-                    float elevation = NO_DATA_VALUE;
-                    osg::Vec3 normal(0,0,1);
+                    for (unsigned r = 0; r < height; ++r)
+                    {
+                        double y = miny + (dy * (double)r);
+                        for (unsigned c = 0; c < width; ++c)
+                        {
+                            unsigned i = r*width + c;
+                            double x = minx + (dx * (double)c);
+                            if (claimed[i] || !ex.contains(x, y))
+                                continue;
+
+                            claimed[i] = true;
+                            ++numClaimed;
+                            out_hf->setHeight(c, r, heights[i]);
+
+                            // same normal as GeoHeightField::getElevationAndNormal
+                            osg::Vec3 normal = itr->getNormalMap() ?
+                                itr->getNormalMap()->getNormalByUV(
+                                    osg::clampBetween((x - ex.xMin()) / ex.width(), 0.0, 1.0),
+                                    osg::clampBetween((y - ex.yMin()) / ex.height(), 0.0, 1.0)) :
+                                HeightFieldUtils::getNormalAtLocation(hood, x, y, ex.xMin(), ex.yMin(), xInterval, yInterval);
+                            out_normalMap->set(c, r, normal);
+                        }
+                    }
+                }
 
-                    for (GeoHeightFieldVector::iterator itr = heightFields.begin(); itr != heightFields.end(); ++itr)
+                // posts no source covers keep the defaults
+                for (unsigned i = 0; i < width*height; ++i)
+                {
+                    if (!claimed[i])
+                        out_normalMap->set(i % width, i / width, osg::Vec3(0,0,1));
+                }
+            }
+            else
+            {
+                //Create the new heightfield by sampling all of them.
+                for (unsigned int c = 0; c < width; ++c)
+                {
+                    double x = minx + (dx * (double)c);
+                    for (unsigned r = 0; r < height; ++r)
                     {
-                        // get the elevation value, at the same time transforming it vertically into the 
-                        // requesting key's vertical datum.
-                        float e = 0.0;
-                        osg::Vec3 n;
-                        if (itr->getElevationAndNormal(key.getExtent().getSRS(), x, y, INTERP_BILINEAR, key.getExtent().getSRS(), e, n))
+                        double y = miny + (dy * (double)r);
+
+                        //For each sample point, try each heightfield.  The first one with a valid elevation wins.
+                        float elevation = NO_DATA_VALUE;
+                        osg::Vec3 normal(0,0,1);
+
+                        for (GeoHeightFieldVector::iterator itr = heightFields.begin(); itr != heightFields.end(); ++itr)
                         {
-                            elevation = e;
-                            normal = n;
-                            break;
+                            // get the elevation value, at the same time transforming it vertically into the 
+                            // requesting key's vertical datum.
+                            float e = 0.0;
+                            osg::Vec3 n;
+                            if (itr->getElevationAndNormal(key.getExtent().getSRS(), x, y, INTERP_BILINEAR, key.getExtent().getSRS(), e, n))
+                            {
+                                elevation = e;
+                                normal = n;
+                                break;
+                            }
                         }
+                        out_hf->setHeight( c, r, elevation );   
+                        out_normalMap->set( c, r, normal );
                     }
-                    out_hf->setHeight( c, r, elevation );   
-                    out_normalMap->set( c, r, normal );
                 }
             }
         }
@@ -383,6 +457,10 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
 
     char memCacheKey[64];
 
+    // times for getTileMetrics(), in ms
+    double fetchMS = -1.0, cacheMS = 0.0, processMS = -1.0;
+    OE_START_TIMER(cache_read);
+
     // Try the L2 memory cache first:
     if ( _memCache.valid() )
     {
@@ -400,6 +478,8 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
         }
     }
 
+    cacheMS = OE_GET_TIMER(cache_read)*1000.0;
+
     // Next try the main cache:
     if ( !result.valid() )
     {
@@ -437,6 +517,8 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
             }
         }
 
+        cacheMS = OE_GET_TIMER(cache_read)*1000.0;
+
         // if we're cache-only, but didn't get data from the cache, fail silently.
         if ( !hf.valid() && policy.isCacheOnly() )
         {
@@ -456,6 +538,14 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
             //getOrCreatePreCacheOp() is only used in TileSource-based path atm.
             //We need to include the funcionality in all 
 
+            // Don't bother the source if it already came back empty for this key.
+            if ( isKnownEmpty(key) )
+            {
+                return cachedHF.valid() ? GeoHeightField(cachedHF.get(), key.getExtent()) : GeoHeightField::INVALID;
+            }
+
+            OE_START_TIMER(fetch);
+
             if (key.getProfile()->isHorizEquivalentTo(getProfile()))
             {
                 result = createHeightFieldImplementation(key, progress);
@@ -469,12 +559,21 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
                 result = GeoHeightField(hf.get(), normalMap.get(), key.getExtent());
             }
 
+            fetchMS = OE_GET_TIMER(fetch)*1000.0;
+
             // Check for cancelation before writing to a cache
             if (progress && progress->isCanceled())
             {
                 return GeoHeightField::INVALID;
             }
 
+            if ( !result.valid() )
+            {
+                recordEmptyTile(key, progress);
+            }
+
+            OE_START_TIMER(process);
+
             // The const_cast is safe here because we just created the
             // heightfield from scratch...not from a cache.
             // TODO: note, I don't like this -gw
@@ -512,6 +611,8 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
                 invoke_onCreate(key, result);
             }
 
+            processMS = OE_GET_TIMER(process)*1000.0;
+
             // If we have a cacheable heightfield, and it didn't come from the cache
             // itself, cache it now.
             if ( hf.valid()    && 
@@ -520,7 +621,9 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
                  policy.isCacheWriteable() )
             {
                 OE_PROFILING_ZONE_NAMED("cache write");
+                OE_START_TIMER(cache_write);
                 cacheBin->write(cacheKey, hf.get(), 0L);
+                cacheMS += OE_GET_TIMER(cache_write)*1000.0;
             }
 
             // If we have an expired heightfield from the cache and were not able to create
@@ -553,8 +656,17 @@ ElevationLayer::createHeightFieldInKeyProfile(const TileKey& key, ProgressCallba
     // write to mem cache if needed:
     if ( result.valid() && !fromMemCache && _memCache.valid() )
     {
+        OE_START_TIMER(mem_write);
         CacheBin* bin = _memCache->getOrCreateDefaultBin();
         bin->write(memCacheKey, result.getHeightField(), 0L);
+        cacheMS += OE_GET_TIMER(mem_write)*1000.0;
+    }
+
+    if ( result.valid() )
+    {
+        const osg::HeightField* rhf = result.getHeightField();
+        getTileMetrics().record(fetchMS, cacheMS, processMS,
+            rhf->getNumColumns() * rhf->getNumRows() * sizeof(float));
     }
 
     return result;
@@ -646,38 +758,67 @@ namespace
     //typedef std::pair<RefElevationLayer, TileKey> LayerAndKey;
     typedef std::vector<LayerData>              LayerDataVector;
 
-    //! Gets the normal vector for elevation data at column s, row t.
-    osg::Vec3 getNormal(const GeoExtent& extent, const osg::HeightField* hf, int s, int t)
+    //! Computes the (unnormalized) normal vector for each sample of the
+    //! heightfield, using central differences, into a row-major array.
+    //! The loops are branch-free across each interior row so that the
+    //! compiler can vectorize them.
+    void getNormals(const GeoExtent& extent, const osg::HeightField* hf, std::vector<osg::Vec3f>& out)
     {
         int w = hf->getNumColumns();
         int h = hf->getNumRows();
 
+        out.resize(w*h);
+
         osg::Vec2d res(
             extent.width() / (double)(w-1),
             extent.height() / (double)(h-1));
 
-        float e = hf->getHeight(s, t);
-
-        double dx = res.x(), dy = res.y();
-
-        if (extent.getSRS()->isGeographic())
+        bool geographic = extent.getSRS()->isGeographic();
+        double mPerDegAtEquator = 0.0;
+        if (geographic)
         {
             double R = extent.getSRS()->getEllipsoid()->getRadiusEquator();
-            double mPerDegAtEquator = (2.0 * osg::PI * R) / 360.0;
-            dy = dy * mPerDegAtEquator;
-            double lat = extent.yMin() + res.y()*(double)t;
-            dx = dx * mPerDegAtEquator * cos(osg::DegreesToRadians(lat));
+            mPerDegAtEquator = (2.0 * osg::PI * R) / 360.0;
         }
-        
-        osg::Vec3d west(0, 0, e), east(0, 0, e), south(0, 0, e), north(0, 0, e);
 
-        if (s > 0)     west.set (-dx, 0, hf->getHeight(s-1, t));
-        if (s < w - 1) east.set ( dx, 0, hf->getHeight(s+1, t));
-        if (t > 0)     south.set(0, -dy, hf->getHeight(s, t-1));
-        if (t < h - 1) north.set(0,  dy, hf->getHeight(s, t+1));
+        const float* heights = &hf->getFloatArray()->front();
 
-        osg::Vec3d normal = (east - west) ^ (north - south);
-        return normal;
+        for (int t = 0; t < h; ++t)
+        {
+            double dx = res.x(), dy = res.y();
+            if (geographic)
+            {
+                dy = dy * mPerDegAtEquator;
+                double lat = extent.yMin() + res.y()*(double)t;
+                dx = dx * mPerDegAtEquator * cos(osg::DegreesToRadians(lat));
+            }
+
+            // an edge sample stands in for its missing neighbor:
+            const float* row = heights + t*w;
+            const float* south = t > 0 ? row - w : row;
+            const float* north = t < h - 1 ? row + w : row;
+            float by = (float)(dy * (double)((t > 0 ? 1 : 0) + (t < h - 1 ? 1 : 0)));
+            float ax = (float)(2.0 * dx);
+            osg::Vec3f* normals = &out[t*w];
+
+            for (int s = 1; s < w - 1; ++s)
+            {
+                float az = row[s+1] - row[s-1];
+                float bz = north[s] - south[s];
+                normals[s].set(-az*by, -ax*bz, ax*by);
+            }
+
+            // edge columns (normal = (east - west) ^ (north - south)):
+            for (int s = 0; s < w; s += osg::maximum(w - 1, 1))
+            {
+                int sw = s > 0 ? s - 1 : s;
+                int se = s < w - 1 ? s + 1 : s;
+                float ex = (float)(dx * (double)(se - sw));
+                float az = row[se] - row[sw];
+                float bz = north[s] - south[s];
+                normals[s].set(-az*by, -ex*bz, ex*by);
+            }
+        }
     }
 
     //! Creates a normal map for heightfield "hf" and stores it in the
@@ -699,21 +840,22 @@ namespace
         int w = hf->getNumColumns();
         int h = hf->getNumRows();
 
-        for (int t = 0; t < (int)hf->getNumRows(); ++t)
+        // the normal at each sample; fallback samples interpolate between these.
+        std::vector<osg::Vec3f> normals;
+        getNormals(extent, hf, normals);
+
+        for (int t = 0; t < h; ++t)
         {
-            for (int s = 0; s<(int)hf->getNumColumns(); ++s)
+            for (int s = 0; s < w; ++s)
             {
-                int step = 1 << (*deltaLOD)[t*h + s];
+                int step = 1 << (*deltaLOD)[t*w + s];
 
                 osg::Vec3 normal;
 
-                // four corners:
-                int s0=s, s1=s, t0=t, t1=t;
-
                 if (step == 1)
                 {
                     // Same LOD, simple query
-                    normal = getNormal(extent, hf, s, t);
+                    normal = normals[t*w + s];
                 }
                 else
                 {
@@ -725,29 +867,29 @@ namespace
                     if (s0 == s1 && t0 == t1)
                     {
                         // on-pixel, simple query
-                        normal = getNormal(extent, hf, s0, t0);
+                        normal = normals[t0*w + s0];
                     }
                     else if (s0 == s1)
                     {
                         // same column; linear interpolate along row
-                        osg::Vec3 S = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 N = getNormal(extent, hf, s0, t1);
+                        const osg::Vec3& S = normals[t0*w + s0];
+                        const osg::Vec3& N = normals[t1*w + s0];
                         normal = S*(double)(t1 - t) + N*(double)(t - t0);
                     }
                     else if (t0 == t1)
                     {
                         // same row; linear interpolate along column
-                        osg::Vec3 W = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 E = getNormal(extent, hf, s1, t0);
+                        const osg::Vec3& W = normals[t0*w + s0];
+                        const osg::Vec3& E = normals[t0*w + s1];
                         normal = W*(double)(s1 - s) + E*(double)(s - s0);
                     }
                     else
                     {
                         // bilinear interpolate
-                        osg::Vec3 SW = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 SE = getNormal(extent, hf, s1, t0);
-                        osg::Vec3 NW = getNormal(extent, hf, s0, t1);
-                        osg::Vec3 NE = getNormal(extent, hf, s1, t1);
+                        const osg::Vec3& SW = normals[t0*w + s0];
+                        const osg::Vec3& SE = normals[t0*w + s1];
+                        const osg::Vec3& NW = normals[t1*w + s0];
+                        const osg::Vec3& NE = normals[t1*w + s1];
 
                         osg::Vec3 S = SW*(double)(s1 - s) + SE*(double)(s - s0);
                         osg::Vec3 N = NW*(double)(s1 - s) + NE*(double)(s - s0);
@@ -19,6 +19,7 @@
 #include <osgEarth/ElevationPool>
 #include <osgEarth/Map>
 #include <osgEarth/Metrics>
+#include <osgEarth/HeightFieldUtils>
 
 using namespace osgEarth;
 
@@ -36,68 +37,169 @@ using namespace osgEarth;
 
 
 ElevationPool::ElevationPool() :
-_entries(0u),
 _maxEntries( 128u ),
 _tileSize( 257u )
 {
-    //nop
-    //_opQueue = Registry::instance()->getAsyncOperationQueue();
-    if (!_opQueue.valid())
-    {
-        _opQueue = new osg::OperationQueue();
-        for (unsigned i=0; i<2; ++i)
-        {
-            osg::OperationThread* thread = new osg::OperationThread();
-            thread->setOperationQueue(_opQueue.get());
-            thread->start();
-            _opThreads.push_back(thread);
-        }
-    }
+    _arena = new JobArena("oe.elevationpool", 2u);
+    Util::MemoryGovernor::instance()->addClient(this, Util::MemoryGovernor::PRIORITY_ELEVATION_POOL);
 }
 
 ElevationPool::~ElevationPool()
 {
+    Util::MemoryGovernor::instance()->removeClient(this);
     stopThreading();
 }
 
 void
 ElevationPool::setMap(const Map* map)
 {
-    Threading::ScopedMutexLock lock(_tiles.mutex());
+    lockAllShards();
     _map = map;
     clearImpl();
+    unlockAllShards();
 }
 
 void
 ElevationPool::clear()
 {
-    Threading::ScopedMutexLock lock(_tiles.mutex());
+    lockAllShards();
     clearImpl();
+    unlockAllShards();
+}
+
+void
+ElevationPool::clear(const GeoExtent& extent)
+{
+    if (!extent.isValid())
+        return;
+
+    lockAllShards();
+
+    // all keys come from the map profile, so this usually transforms once
+    GeoExtent local;
+
+    for (unsigned i = 0; i < NUM_TILE_SHARDS; ++i)
+    {
+        TileShard& shard = _shards[i];
+        for (TileShard::LRU::iterator e = shard._lru.begin(); e != shard._lru.end(); )
+        {
+            const GeoExtent& tileExtent = e->first.getExtent();
+            if (!local.isValid() || !local.getSRS()->isHorizEquivalentTo(tileExtent.getSRS()))
+                local = extent.transform(tileExtent.getSRS());
+
+            if (local.intersects(tileExtent))
+            {
+                shard._index.erase(e->first);
+                e = shard._lru.erase(e);
+                --shard._entries;
+            }
+            else ++e;
+        }
+    }
+
+    unlockAllShards();
 }
 
 void
 ElevationPool::stopThreading()
 {
-    _opQueue->releaseAllOperations();
-    
-    for (unsigned i = 0; i<_opThreads.size(); ++i)
-    _opThreads[i]->setDone(true);
+    _arena->cancelAll();
 }
 
 void
 ElevationPool::setElevationLayers(const ElevationLayerVector& layers)
 {
-    Threading::ScopedMutexLock lock(_tiles.mutex());
+    lockAllShards();
     _layers = layers;
     clearImpl();
+    unlockAllShards();
 }
 
 void
 ElevationPool::setTileSize(unsigned value)
 {
-    Threading::ScopedMutexLock lock(_tiles.mutex());
+    lockAllShards();
     _tileSize = value;
     clearImpl();
+    unlockAllShards();
+}
+
+void
+ElevationPool::setMaxEntries(unsigned value)
+{
+    lockAllShards();
+    _maxEntries = value;
+    for (unsigned i = 0; i < NUM_TILE_SHARDS; ++i)
+        trimShard(_shards[i]);
+    unlockAllShards();
+}
+
+ElevationPool::Stats
+ElevationPool::getStats() const
+{
+    Stats stats;
+    stats._entries = 0u;
+    for (unsigned i = 0; i < NUM_TILE_SHARDS; ++i)
+    {
+        Threading::ScopedMutexLock lock(_shards[i]._mutex);
+        stats._entries += _shards[i]._entries;
+    }
+    stats._maxEntries = _maxEntries;
+    stats._queries = _queries;
+    stats._hits = _hits;
+    stats._contentions = _contentions;
+    stats._hitRatio = stats._queries > 0u ? (float)stats._hits / (float)stats._queries : 0.0f;
+    return stats;
+}
+
+void
+ElevationPool::resetStats()
+{
+    _queries.exchange(0u);
+    _hits.exchange(0u);
+    _contentions.exchange(0u);
+}
+
+void
+ElevationPool::lockShard(TileShard& shard)
+{
+    // trylock returns zero on success; anything else means another
+    // thread holds this stripe and we will have to wait for it.
+    if (shard._mutex.trylock() != 0)
+    {
+        ++_contentions;
+        shard._mutex.lock();
+    }
+}
+
+void
+ElevationPool::lockAllShards()
+{
+    for (unsigned i = 0; i < NUM_TILE_SHARDS; ++i)
+        _shards[i]._mutex.lock();
+}
+
+void
+ElevationPool::unlockAllShards()
+{
+    for (int i = NUM_TILE_SHARDS - 1; i >= 0; --i)
+        _shards[i]._mutex.unlock();
+}
+
+void
+ElevationPool::trimShard(TileShard& shard)
+{
+    // assumes the shard is locked.
+    unsigned maxPerShard = osg::maximum(1u, (_maxEntries + NUM_TILE_SHARDS - 1u) / NUM_TILE_SHARDS);
+
+    while (shard._entries > maxPerShard)
+    {
+        // drop the LRU entry. Any envelope still using the Tile holds its
+        // own reference, so the Tile itself stays alive until they're done.
+        shard._index.erase(shard._lru.back().first);
+        shard._lru.pop_back();
+        --shard._entries;
+    }
 }
 
 Future<ElevationSample>
@@ -105,7 +207,7 @@ ElevationPool::getElevation(const GeoPoint& point, unsigned lod)
 {
     GetElevationOp* op = new GetElevationOp(this, point, lod);
     Future<ElevationSample> result = op->_promise.getFuture();
-    _opQueue->add(op);
+    _arena->dispatch(op);
     return result;
 }
 
@@ -116,7 +218,7 @@ _pool(pool), _point(point), _lod(lod)
 }
 
 void
-ElevationPool::GetElevationOp::operator()(osg::Object*)
+ElevationPool::GetElevationOp::operator()(ProgressCallback*)
 {
     osg::ref_ptr<ElevationPool> pool;
     if (!_promise.isAbandoned() && _pool.lock(pool))
@@ -186,26 +288,6 @@ ElevationPool::fetchTileFromMap(
     return out_tile->_hf.valid();
 }
 
-void
-ElevationPool::popMRU()
-{
-    // first rememeber the key of the item we're about the pop:
-    TileKey key = _mru.back()->_key;
-
-    // establish a temporary observer on the item:
-    osg::observer_ptr<Tile> temp = _mru.back().get();
-
-    // pop the Tile from the MRU:
-    _mru.pop_back();
-
-    // if our observer went to NULL, we know there are no more pointers
-    // to that Tile in the MRU, and we can remove it from the main list:
-    if (!temp.valid())
-    {
-        _tiles.erase(key);
-    }
-}
-
 bool
 ElevationPool::tryTile(
     const TileKey& key, 
@@ -224,34 +306,34 @@ ElevationPool::tryTile(
     TileKey keyToUse = key;
 #endif
 
-    // first see whether the tile is available
-    _tiles.lock();
+    ++_queries;
 
-    // locate the tile in the local tile cache:
-    osg::observer_ptr<Tile>& tile_obs = _tiles[keyToUse];
+    // first see whether the tile is available
+    TileShard& shard = getShard(keyToUse);
+    lockShard(shard);
 
     osg::ref_ptr<Tile> tile;
 
-    // Get a safe pointer to it. If this is NULL, we need to create and
-    // fetch a new tile from the Map.
-    if (!tile_obs.lock(tile))
+    // locate the tile in the local tile cache:
+    TileShard::Index::iterator entry = shard._index.find(keyToUse);
+
+    if (entry != shard._index.end())
+    {
+        // existing tile: promote it to the front of the LRU.
+        tile = entry->second->second.get();
+        shard._lru.splice(shard._lru.begin(), shard._lru, entry->second);
+    }
+    else
     {
         // a new tile; status -> EMPTY
         tile = new Tile();
         tile->_key = key;
 
-        // update the LRU:
-        _mru.push_front(tile.get());
-
-        // prune the MRU if necessary:
-        if (++_entries > _maxEntries )
-        {
-            popMRU();
-            --_entries;
-        }
-
-        // add to the main cache (after putting it on the LRU).
-        tile_obs = tile;
+        // add to the LRU and the index, and prune the LRU if necessary:
+        shard._lru.push_front(TileShard::LRUEntry(keyToUse, tile.get()));
+        shard._index[keyToUse] = shard._lru.begin();
+        ++shard._entries;
+        trimShard(shard);
     }
        
     // This means the tile object exists but has yet to be populated:
@@ -259,7 +341,8 @@ ElevationPool::tryTile(
     {
         OE_TEST << "  getTile(" << key.str() << ") -> fetch from map\n";
         tile->_status.exchange(STATUS_IN_PROGRESS);
-        _tiles.unlock();
+        shard._mutex.unlock();
+        OE_METRICS_COUNT("elevation_pool.misses", 1);
 
         bool ok = fetchTileFromMap(keyToUse, layers, memory, tile.get());
         tile->_status.exchange( ok ? STATUS_AVAILABLE : STATUS_FAIL );
@@ -272,19 +355,10 @@ ElevationPool::tryTile(
     else if ( tile->_status == STATUS_AVAILABLE )
     {
         OE_TEST << "  getTile(" << key.str() << ") -> available\n";
+        shard._mutex.unlock();
+        ++_hits;
+        OE_METRICS_COUNT("elevation_pool.hits", 1);
         out_tile = tile.get();
-
-        // Mark this tile as recently used:
-        _mru.push_front(tile.get());
-
-        // prune the MRU if necessary
-        if (++_entries > _maxEntries)
-        {
-            popMRU();
-            --_entries;
-        }
-
-        _tiles.unlock();
         return true;
     }
 
@@ -292,7 +366,7 @@ ElevationPool::tryTile(
     else if ( tile->_status == STATUS_FAIL )
     {
         OE_TEST << "  getTile(" << key.str() << ") -> fail\n";
-        _tiles.unlock();
+        shard._mutex.unlock();
         out_tile = 0L;
         return false;
     }
@@ -302,7 +376,7 @@ ElevationPool::tryTile(
     else //if ( tile->_status == STATUS_IN_PROGRESS )
     {
         OE_DEBUG << "  getTile(" << key.str() << ") -> in progress...waiting\n";
-        _tiles.unlock();
+        shard._mutex.unlock();
         out_tile = 0L;
         return true;            // out:NULL => check back later please.
     }
@@ -311,10 +385,13 @@ ElevationPool::tryTile(
 void
 ElevationPool::clearImpl()
 {
-    // assumes the tiles lock is taken.
-    _tiles.clear();
-    _mru.clear();
-    _entries = 0u;
+    // assumes all the shard locks are taken.
+    for (unsigned i = 0; i < NUM_TILE_SHARDS; ++i)
+    {
+        _shards[i]._index.clear();
+        _shards[i]._lru.clear();
+        _shards[i]._entries = 0u;
+    }
 }
 
 bool
@@ -357,7 +434,7 @@ ElevationPool::getTile(
         }
         else
         {
-            OE_WARN << LC << "Got a tile with an invalid HF (" << key.str() << ")\n";
+            OE_WARN_THROTTLED << LC << "Got a tile with an invalid HF (" << key.str() << ")\n";
         }
     }
 
@@ -419,16 +496,9 @@ ElevationEnvelope::~ElevationEnvelope()
     //nop
 }
 
-bool
-ElevationEnvelope::sample(
-    double x, double y,
-    Context* context,
-    float& out_elevation, float& out_resolution)
+void
+ElevationEnvelope::syncRevisions(Context* context)
 {
-    out_elevation = NO_DATA_VALUE;
-
-    ++_queries;
-
     // Keep the envelope in sync with the elevation layers.
     unsigned changes = 0;
     for(unsigned i=0; i<_layers.size(); ++i)
@@ -447,115 +517,138 @@ ElevationEnvelope::sample(
             context->_tiles.clear();
         collectDataExtents();
     }
+}
 
-    out_elevation = NO_DATA_VALUE;
-    out_resolution = 0.0f;
+bool
+ElevationEnvelope::findTile(
+    double x, double y,
+    Context* context,
+    osg::ref_ptr<ElevationPool::Tile>& tile)
+{
+    // x, y are in the map SRS.
     bool foundTile = false;
-    osg::ref_ptr<ElevationPool::Tile> tile;
-
-    GeoPoint p(_inputSRS.get(), x, y, 0.0f, ALTMODE_ABSOLUTE);
+    unsigned lodToUse = _lod;
 
+#ifdef USE_ENVELOPE_DATA_EXTENTS
+    // check the data extents under the point to come up with an LOD.
+    bool foundData = false;
+    for(SortedDataExtentList::const_iterator i = _dataExtentsSortedHiToLoRes.begin();
+        i != _dataExtentsSortedHiToLoRes.end();
+        ++i)
+    {
+        if (i->maxLevel().isSet() && i->contains(x, y))
+        {
+            lodToUse = osg::minimum(_lod, i->maxLevel().get());
+            foundData = true;
+            break;
+        }
+    }
 
-    if (p.transformInPlace(_mapProfile->getSRS()))
+    if (!foundData)
     {
-        unsigned lodToUse = _lod;
+        return false;
+    }
+#endif
 
-#ifdef USE_ENVELOPE_DATA_EXTENTS
-        // check the data extents under the point to come up with an LOD.
-        bool foundData = false;
-        for(SortedDataExtentList::const_iterator i = _dataExtentsSortedHiToLoRes.begin();
-            i != _dataExtentsSortedHiToLoRes.end();
-            ++i)
+#ifdef USE_ENVELOPE_TILE_CACHE
+    // See if we have a cached tile containing the point:
+    if (!foundTile && !context)
+    {
+        for(ElevationPool::QuerySet::const_iterator tile_ref = _tiles.begin();
+            tile_ref != _tiles.end();
+            ++tile_ref)
         {
-            if (i->maxLevel().isSet() && i->contains(p.x(), p.y()))
+            tile = tile_ref->get();
+
+            // Important: test against the bounds of the original key that was used
+            // to make the tile request, even if the request fell back on an ancestor
+            // key. We cannot assume that points outside the original request bounds
+            // would result in the same tile.
+            if (lodToUse <= tile->_key.getLOD() &&
+                tile->_key.getExtent().contains(x, y))
             {
-                lodToUse = osg::minimum(_lod, i->maxLevel().get());
-                foundData = true;
+                foundTile = true;
+                ++_cachehits;
                 break;
             }
         }
+    }
+#endif    
 
-        if (!foundData)
-        {
-            return false;
-        }
-#endif
+    // If we still don't have a tile, we need to ask the pool for the tile.
+    if (!foundTile)
+    {
+#ifdef USE_ENVELOPE_CONTEXT
 
-#ifdef USE_ENVELOPE_TILE_CACHE
-        // See if we have a cached tile containing the point:
-        if (!foundTile && !context)
+        if (context && context->_tiles.empty())
+            ++_newcontexts;
+
+        // If the user passed in a context, check that first.
+        if (context && context->_tiles.empty() == false)
         {
-            for(ElevationPool::QuerySet::const_iterator tile_ref = _tiles.begin();
-                tile_ref != _tiles.end();
-                ++tile_ref)
+            for(Context::TileMRU::iterator i = context->_tiles.begin();
+                i != context->_tiles.end();
+                ++i)
             {
-                tile = tile_ref->get();
-
-                // Important: test against the bounds of the original key that was used
-                // to make the tile request, even if the request fell back on an ancestor
-                // key. We cannot assume that points outside the original request bounds
-                // would result in the same tile.
-                if (lodToUse <= tile->_key.getLOD() &&
-                    tile->_key.getExtent().contains(p.x(), p.y()))
+                ElevationPool::Tile* temp = i->get();
+
+                if (lodToUse <= temp->_key.getLOD() &&
+                    temp->_key.getExtent().contains(x, y))
                 {
+                    tile = temp;
                     foundTile = true;
-                    ++_cachehits;
+                    context->_tiles.erase(i); // will re-push it to front later
+                    ++_contexthits;
                     break;
                 }
             }
         }
-#endif    
+#endif
 
-        // If we still don't have a tile, we need to ask the pool for the tile.
         if (!foundTile)
         {
-#ifdef USE_ENVELOPE_CONTEXT
+            TileKey key = _mapProfile->createTileKey(x, y, lodToUse);
 
-            if (context && context->_tiles.empty())
-                ++_newcontexts;
+            osg::ref_ptr<ElevationPool> pool;
 
-            // If the user passed in a context, check that first.
-            if (context && context->_tiles.empty() == false)
+            if (_pool.lock(pool) && pool->getTile(key, _layers, _memory, tile))
             {
-                for(Context::TileMRU::iterator i = context->_tiles.begin();
-                    i != context->_tiles.end();
-                    ++i)
-                {
-                    ElevationPool::Tile* temp = i->get();
+                foundTile = true;
 
-                    if (lodToUse <= temp->_key.getLOD() &&
-                        temp->_key.getExtent().contains(p.x(), p.y()))
-                    {
-                        tile = temp;
-                        foundTile = true;
-                        context->_tiles.erase(i); // will re-push it to front later
-                        ++_contexthits;
-                        break;
-                    }
-                }
-            }
+#ifdef USE_ENVELOPE_TILE_CACHE
+                // Got the new tile; put it in the query set:
+                _tiles.insert(tile.get());
 #endif
+            }
+        }
+    }
 
-            if (!foundTile)
-            {
-                TileKey key = _mapProfile->createTileKey(p.x(), p.y(), lodToUse);
+    return foundTile;
+}
 
-                osg::ref_ptr<ElevationPool> pool;
+bool
+ElevationEnvelope::sample(
+    double x, double y,
+    Context* context,
+    float& out_elevation, float& out_resolution)
+{
+    out_elevation = NO_DATA_VALUE;
 
-                if (_pool.lock(pool) && pool->getTile(key, _layers, _memory, tile))
-                {
-                    foundTile = true;
+    ++_queries;
 
-#ifdef USE_ENVELOPE_TILE_CACHE
-                    // Got the new tile; put it in the query set:
-                    _tiles.insert(tile.get());
-#endif
-                }
-            }
-        }
+    syncRevisions(context);
+
+    out_elevation = NO_DATA_VALUE;
+    out_resolution = 0.0f;
+    osg::ref_ptr<ElevationPool::Tile> tile;
+
+    GeoPoint p(_inputSRS.get(), x, y, 0.0f, ALTMODE_ABSOLUTE);
 
+
+    if (p.transformInPlace(_mapProfile->getSRS()))
+    {
         // Finally, so the actual elevation query against out found tile.
-        if (foundTile)
+        if (findTile(p.x(), p.y(), context, tile))
         {
             if (tile->_hf.getElevation(0L, p.x(), p.y(), INTERP_BILINEAR, 0L, out_elevation))
             {
@@ -638,22 +731,123 @@ ElevationEnvelope::getElevations(const std::vector<osg::Vec3d>& input,
     OE_PROFILING_ZONE;
     OE_PROFILING_ZONE_TEXT(Stringify() << "Count " << input.size());
 
-    unsigned count = 0u;
+    output.resize(input.size());
+    if (input.empty())
+        return 0u;
+
+    std::vector<double> xs(input.size()), ys(input.size());
+    for (unsigned i = 0; i < input.size(); ++i)
+    {
+        xs[i] = input[i].x();
+        ys[i] = input[i].y();
+    }
+
+    return getElevations(&xs[0], &ys[0], &output[0], input.size());
+}
 
-    output.reserve(input.size());
-    output.clear();
+unsigned
+ElevationEnvelope::getElevations(const double* xs, const double* ys,
+                                 float* out, size_t count)
+{
+    OE_PROFILING_ZONE;
 
-    // for each input point:
-    for (std::vector<osg::Vec3d>::const_iterator v = input.begin(); v != input.end(); ++v)
+    if (count == 0)
+        return 0u;
+
+    syncRevisions(0L);
+
+    // transform all the points into the map SRS in one go:
+    std::vector<osg::Vec3d> points(count);
+    for (size_t i = 0; i < count; ++i)
+        points[i].set(xs[i], ys[i], 0.0);
+
+    if (!_inputSRS->isHorizEquivalentTo(_mapProfile->getSRS()) &&
+        !_inputSRS->transform(points, _mapProfile->getSRS()))
     {
-        float elevation, resolution;
-        sample(v->x(), v->y(), NULL, elevation, resolution);
-        output.push_back(elevation);
-        if (elevation != NO_DATA_VALUE)
-            ++count;
+        OE_WARN << LC << "getElevations: xform failed" << std::endl;
+        for (size_t i = 0; i < count; ++i)
+            out[i] = NO_DATA_VALUE;
+        return 0u;
+    }
+
+    // Assign each point to the tile that covers it. Consecutive points
+    // in a feature tend to fall in the same tile, so check the previous
+    // tile before doing a full lookup.
+    typedef std::vector<size_t> Indices;
+    typedef std::map<ElevationPool::Tile*, Indices> TileGroups;
+    TileGroups groups;
+    std::vector<osg::ref_ptr<ElevationPool::Tile> > holder;
+
+    osg::ref_ptr<ElevationPool::Tile> lastTile;
+    Indices* lastGroup = 0L;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        ++_queries;
+        out[i] = NO_DATA_VALUE;
+
+        const osg::Vec3d& p = points[i];
+
+        if (lastGroup && lastTile->_key.getExtent().contains(p.x(), p.y()))
+        {
+            lastGroup->push_back(i);
+            ++_cachehits;
+            continue;
+        }
+
+        osg::ref_ptr<ElevationPool::Tile> tile;
+        if (findTile(p.x(), p.y(), 0L, tile))
+        {
+            Indices& group = groups[tile.get()];
+            if (group.empty())
+                holder.push_back(tile.get());
+            group.push_back(i);
+            lastTile = tile.get();
+            lastGroup = &group;
+        }
+        else
+        {
+            ++_fails;
+        }
+    }
+
+    // Sample each tile's heightfield in one batch:
+    unsigned numValid = 0u;
+    std::vector<double> gx, gy;
+    std::vector<float> gz;
+
+    for (TileGroups::iterator g = groups.begin(); g != groups.end(); ++g)
+    {
+        const GeoHeightField& geohf = g->first->_hf;
+        const osg::HeightField* hf = geohf.getHeightField();
+        const GeoExtent& ex = geohf.getExtent();
+        const Indices& indices = g->second;
+
+        gx.resize(indices.size());
+        gy.resize(indices.size());
+        gz.resize(indices.size());
+
+        for (size_t k = 0; k < indices.size(); ++k)
+        {
+            gx[k] = points[indices[k]].x();
+            gy[k] = points[indices[k]].y();
+        }
+
+        HeightFieldUtils::getHeightsAtLocations(
+            hf, &gx[0], &gy[0], &gz[0], indices.size(),
+            ex.xMin(), ex.yMin(),
+            ex.width() / (double)(hf->getNumColumns()-1),
+            ex.height() / (double)(hf->getNumRows()-1));
+
+        for (size_t k = 0; k < indices.size(); ++k)
+        {
+            out[indices[k]] = gz[k];
+            if (gz[k] != NO_DATA_VALUE)
+                ++numValid;
+        }
     }
 
-    return count;
+    return numValid;
 }
 
 bool
@@ -18,13 +18,105 @@
  */
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/Map>
+#include <osgEarth/JobArena>
 #include <osgSim/LineOfSight>
+#include <algorithm>
 
 #define LC "[ElevationQuery] "
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
+namespace
+{
+    // Each thread sampling a batch gets at least this many points.
+    const size_t MIN_POINTS_PER_THREAD = 65536u;
+
+    // Runs per thread; more runs balance the load when some tiles are
+    // slower to fetch than others.
+    const unsigned RUNS_PER_THREAD = 4u;
+
+    // LOD at which to query the elevation data for a resolution
+    unsigned getLOD(const Map* map, double desiredResolution)
+    {
+        // tile size (resolution of elevation tiles)
+        unsigned tileSize = 257; // yes?
+
+        // default LOD:
+        unsigned lod = 23u;
+
+        // attempt to map the requested resolution to an LOD:
+        if (desiredResolution > 0.0)
+        {
+            int level = map->getProfile()->getLevelOfDetailForHorizResolution(desiredResolution, tileSize);
+            if ( level > 0 )
+                lod = level;
+        }
+        return lod;
+    }
+
+    /**
+     * A batch of points in the map SRS, split into contiguous runs that
+     * threads claim one at a time. Each thread samples with its own envelope.
+     */
+    struct BatchGroup : public osg::Referenced
+    {
+        BatchGroup(ElevationPool* pool, const SpatialReference* srs, unsigned lod,
+                   const double* xs, const double* ys, float* out, size_t count, unsigned numRuns) :
+            _pool(pool), _srs(srs), _lod(lod),
+            _xs(xs), _ys(ys), _out(out), _count(count), _numRuns(numRuns),
+            _next(0u), _remaining(numRuns) { }
+
+        void run()
+        {
+            osg::ref_ptr<ElevationEnvelope> envelope;
+            for(;;)
+            {
+                unsigned run = (++_next) - 1u;
+                if (run >= _numRuns)
+                    break;
+
+                size_t first = (_count * run) / _numRuns;
+                size_t last = (_count * (run + 1u)) / _numRuns;
+                if (last > first)
+                {
+                    if (!envelope.valid())
+                        envelope = _pool->createEnvelope(_srs.get(), _lod);
+
+                    envelope->getElevations(_xs + first, _ys + first, _out + first, last - first);
+                }
+
+                if (--_remaining == 0u)
+                    _done.set();
+            }
+        }
+
+        osg::ref_ptr<ElevationPool> _pool;
+        osg::ref_ptr<const SpatialReference> _srs;
+        unsigned _lod;
+        const double* _xs;
+        const double* _ys;
+        float* _out;
+        size_t _count;
+        unsigned _numRuns;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+    };
+
+    struct BatchTask : public TaskRequest
+    {
+        BatchTask(BatchGroup* group) : _group(group) { }
+
+        void operator()(ProgressCallback*)
+        {
+            _group->run();
+        }
+
+        osg::ref_ptr<BatchGroup> _group;
+    };
+}
+
 
 ElevationQuery::ElevationQuery()
 {
@@ -133,20 +225,24 @@ ElevationQuery::getElevations(std::vector<osg::Vec3d>& points,
                               double                   desiredResolution )
 {
     sync();
-    for( osg::Vec3dArray::iterator i = points.begin(); i != points.end(); ++i )
+
+    std::vector<float> elevations(points.size());
+    if (!elevations.empty())
+        getElevationsImpl(points, pointsSRS, &elevations[0], desiredResolution);
+
+    for (size_t i = 0; i < points.size(); ++i)
     {
-        float elevation;
-        double z = (*i).z();
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
-        if ( getElevationImpl(p, elevation, desiredResolution, 0L))
+        float elevation = elevations[i];
+        if (elevation == NO_DATA_VALUE)
         {
-            if (elevation == NO_DATA_VALUE)
-            {
-                elevation = 0.0;
-            }
-
-            (*i).z() = ignoreZ ? elevation : elevation + z;
+            // no heightfields at all reads as zero; missing data leaves the point alone
+            if (!_elevationLayers.empty())
+                continue;
+            elevation = 0.0;
         }
+
+        double z = points[i].z();
+        points[i].z() = ignoreZ ? elevation : elevation + z;
     }
     return true;
 }
@@ -158,21 +254,127 @@ ElevationQuery::getElevations(const std::vector<osg::Vec3d>& points,
                               double                         desiredResolution )
 {
     sync();
-    for( osg::Vec3dArray::const_iterator i = points.begin(); i != points.end(); ++i )
+
+    size_t offset = out_elevations.size();
+    out_elevations.resize(offset + points.size());
+    if (points.empty())
+        return true;
+
+    getElevationsImpl(points, pointsSRS, &out_elevations[offset], desiredResolution);
+
+    // missing data reads as zero (unless there are no heightfields at all)
+    if (!_elevationLayers.empty())
     {
-        float elevation;
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
+        for (size_t i = offset; i < out_elevations.size(); ++i)
+        {
+            if (out_elevations[i] == NO_DATA_VALUE)
+                out_elevations[i] = 0.0;
+        }
+    }
+    return true;
+}
+
+void
+ElevationQuery::getElevationsImpl(const std::vector<osg::Vec3d>& points,
+                                  const SpatialReference*        pointsSRS,
+                                  float*                         out_elevations,
+                                  double                         desiredResolution)
+{
+    size_t count = points.size();
+
+    // terrain patches need an intersection per point.
+    if (_terrainModelLayers.size() > 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            GeoPoint p(pointsSRS, points[i], ALTMODE_ABSOLUTE);
+            if (!getElevationImpl(p, out_elevations[i], desiredResolution, 0L))
+                out_elevations[i] = NO_DATA_VALUE;
+        }
+        return;
+    }
+
+    std::fill(out_elevations, out_elevations + count, NO_DATA_VALUE);
+
+    osg::ref_ptr<const Map> map;
+    if (_elevationLayers.empty() || !pointsSRS || !_map.lock(map))
+        return;
+
+    const Profile* profile = map->getProfile();
+    const SpatialReference* mapSRS = profile->getSRS();
+    unsigned lod = getLOD(map.get(), desiredResolution);
+
+    // work in the map SRS, where the tiles are axis-aligned:
+    std::vector<osg::Vec3d> mapPoints(points);
+    if (!pointsSRS->isHorizEquivalentTo(mapSRS) && !pointsSRS->transform(mapPoints, mapSRS))
+    {
+        OE_WARN << LC << "getElevations: xform failed" << std::endl;
+        return;
+    }
+
+    // Sort the points by the tile that covers them at the query LOD. Each
+    // tile's points are then contiguous, so the envelope looks each tile up
+    // once, and threads sampling different runs touch different tiles.
+    double tileWidth, tileHeight;
+    profile->getTileDimensions(lod, tileWidth, tileHeight);
+    unsigned tilesWide, tilesHigh;
+    profile->getNumTiles(lod, tilesWide, tilesHigh);
+    const GeoExtent& extent = profile->getExtent();
+
+    std::vector< std::pair<unsigned long long, size_t> > order(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        double col = osg::clampBetween((mapPoints[i].x() - extent.xMin()) / tileWidth, 0.0, (double)(tilesWide - 1u));
+        double row = osg::clampBetween((extent.yMax() - mapPoints[i].y()) / tileHeight, 0.0, (double)(tilesHigh - 1u));
+        order[i].first = (unsigned long long)row * (unsigned long long)tilesWide + (unsigned long long)col;
+        order[i].second = i;
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<double> xs(count), ys(count);
+    std::vector<float> hs(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        xs[i] = mapPoints[order[i].second].x();
+        ys[i] = mapPoints[order[i].second].y();
+    }
+
+    // the calling thread samples too, with help from the arena's threads:
+    JobArena* arena = JobArena::get("oe.elevationquery");
+    size_t numThreads = osg::maximum(count / MIN_POINTS_PER_THREAD, (size_t)1u);
+    unsigned numHelpers = (unsigned)osg::minimum((size_t)arena->getConcurrency(), numThreads - 1u);
 
-        if ( getElevationImpl(p, elevation, desiredResolution, 0L) )
+    if (numHelpers == 0u)
+    {
+        // do we need a new ElevationEnvelope?
+        if (!_envelope.valid() ||
+            !mapSRS->isHorizEquivalentTo(_envelope->getSRS()) ||
+            lod != _envelope->getLOD())
         {
-            out_elevations.push_back( elevation );
+            _envelope = map->getElevationPool()->createEnvelope(mapSRS, lod);
         }
-        else
+
+        _envelope->getElevations(&xs[0], &ys[0], &hs[0], count);
+    }
+    else
+    {
+        osg::ref_ptr<BatchGroup> group = new BatchGroup(
+            map->getElevationPool(), mapSRS, lod,
+            &xs[0], &ys[0], &hs[0], count, (numHelpers + 1u) * RUNS_PER_THREAD);
+
+        for (unsigned i = 0; i < numHelpers; ++i)
         {
-            out_elevations.push_back( 0.0 );
+            arena->dispatch(new BatchTask(group.get()));
         }
+
+        group->run();
+        group->_done.wait();
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        out_elevations[order[i].second] = hs[i];
     }
-    return true;
 }
 
 bool
@@ -272,19 +474,7 @@ ElevationQuery::getElevationImpl(const GeoPoint& point,
         return false;
     }    
 
-    // tile size (resolution of elevation tiles)
-    unsigned tileSize = 257; // yes?
-
-    // default LOD:
-    unsigned lod = 23u;
-
-    // attempt to map the requested resolution to an LOD:
-    if (desiredResolution > 0.0)
-    {
-        int level = map->getProfile()->getLevelOfDetailForHorizResolution(desiredResolution, tileSize);
-        if ( level > 0 )
-            lod = level;
-    }
+    unsigned lod = getLOD(map.get(), desiredResolution);
 
     // do we need a new ElevationEnvelope?
     if (!_envelope.valid() ||
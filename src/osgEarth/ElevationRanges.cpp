@@ -18,6 +18,7 @@
  */
 #include <osgEarth/ElevationRanges>
 #include <osgEarth/Registry>
+#include <sstream>
 
 using namespace osgEarth;
 
@@ -54,4 +55,146 @@ bool ElevationRanges::getElevationRange(unsigned int level, unsigned int x, unsi
     min = s_minElevationsLOD[level][index];
     max = s_maxElevationsLOD[level][index];
     return true;
-}
\ No newline at end of file
+}
+
+//........................................................................
+
+#undef  LC
+#define LC "[ElevationRangeIndex] "
+
+#define ELEVATION_RANGE_INDEX_KEY "elevation_range_index"
+
+ElevationRangeIndex::ElevationRangeIndex(const Profile* profile) :
+_profile(profile),
+_maxLevel(14u),
+_dirty(false)
+{
+    //nop
+}
+
+void
+ElevationRangeIndex::record(const TileKey& key, float minHeight, float maxHeight)
+{
+    if (!key.valid() || minHeight > maxHeight || !key.getProfile()->isHorizEquivalentTo(_profile.get()))
+        return;
+
+    TileKey k = key.getLOD() > _maxLevel ? key.createAncestorKey(_maxLevel) : key;
+
+    Threading::ScopedWriteLock lock(_mutex);
+
+    RangeTable::iterator i = _table.find(k);
+    if (i == _table.end())
+    {
+        Range& r = _table[k];
+        r._min = minHeight;
+        r._max = maxHeight;
+        _dirty = true;
+    }
+    else if (minHeight < i->second._min || maxHeight > i->second._max)
+    {
+        i->second._min = osg::minimum(i->second._min, minHeight);
+        i->second._max = osg::maximum(i->second._max, maxHeight);
+        _dirty = true;
+    }
+    else return;
+
+    // a parent's range must contain all its children's ranges
+    for (k = k.createParentKey(); k.valid(); k = k.createParentKey())
+    {
+        i = _table.find(k);
+        if (i != _table.end())
+        {
+            i->second._min = osg::minimum(i->second._min, minHeight);
+            i->second._max = osg::maximum(i->second._max, maxHeight);
+        }
+    }
+}
+
+bool
+ElevationRangeIndex::getElevationRange(const TileKey& key, float& out_min, float& out_max) const
+{
+    if (!key.valid())
+        return false;
+
+    TileKey k = key.getLOD() > _maxLevel ? key.createAncestorKey(_maxLevel) : key;
+
+    Threading::ScopedReadLock lock(_mutex);
+
+    RangeTable::const_iterator i = _table.find(k);
+    if (i == _table.end())
+        return false;
+
+    out_min = i->second._min;
+    out_max = i->second._max;
+    return true;
+}
+
+bool
+ElevationRangeIndex::load()
+{
+    osg::ref_ptr<CacheBin> bin = _bin.get();
+    if (!bin.valid())
+        return false;
+
+    ReadResult rr = bin->readString(ELEVATION_RANGE_INDEX_KEY, 0L);
+    if (!rr.succeeded())
+        return false;
+
+    // a header line with the profile signature, then
+    // one "lod x y min max" record per line.
+    std::istringstream in(rr.getString());
+    std::string signature;
+    if (!std::getline(in, signature) || signature != _profile->getHorizSignature())
+        return false;
+
+    bool wasDirty;
+    {
+        Threading::ScopedReadLock lock(_mutex);
+        wasDirty = _dirty;
+    }
+
+    unsigned lod, x, y;
+    float minHeight, maxHeight;
+    unsigned count = 0u;
+    while (in >> lod >> x >> y >> minHeight >> maxHeight)
+    {
+        record(TileKey(lod, x, y, _profile.get()), minHeight, maxHeight);
+        ++count;
+    }
+
+    // what we just read is already in the cache
+    {
+        Threading::ScopedWriteLock lock(_mutex);
+        _dirty = wasDirty;
+    }
+
+    OE_DEBUG << LC << "Loaded " << count << " tile ranges" << std::endl;
+    return true;
+}
+
+bool
+ElevationRangeIndex::save()
+{
+    osg::ref_ptr<CacheBin> bin = _bin.get();
+    if (!bin.valid())
+        return false;
+
+    std::ostringstream out;
+    {
+        Threading::ScopedWriteLock lock(_mutex);
+        if (!_dirty)
+            return true;
+
+        out << _profile->getHorizSignature() << '\n';
+        for (RangeTable::const_iterator i = _table.begin(); i != _table.end(); ++i)
+        {
+            out << i->first.getLOD() << ' ' << i->first.getTileX() << ' ' << i->first.getTileY() << ' '
+                << i->second._min << ' ' << i->second._max << '\n';
+        }
+        _dirty = false;
+    }
+
+    osg::ref_ptr<StringObject> so = new StringObject();
+    so->setString(out.str());
+    return bin->write(ELEVATION_RANGE_INDEX_KEY, so.get(), 0L);
+}
@@ -27,6 +27,7 @@
 #include <osgEarth/Shadowing>
 #include <osgEarth/ActivityMonitorTool>
 #include <osgEarth/LogarithmicDepthBuffer>
+#include <osgEarth/ReversedDepthBuffer>
 #include <osgEarth/SimpleOceanLayer>
 
 #include <osgEarth/AnnotationData>
@@ -34,6 +35,7 @@
 #include <osgEarth/NodeUtils>
 #include <osgEarth/GLUtils>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/PagingScheduler>
 
 #include <osgEarthDrivers/kml/KML>
 
@@ -388,6 +390,15 @@ MapNodeHelper::load(osg::ArgumentParser&   args,
     else if (args.read("--novsync"))
         vsync = false;
 
+    // compile paged data incrementally, within a per-frame budget, before
+    // it joins the scene graph:
+    double compileBudget = 4.0;
+    args.read("--compile-budget", compileBudget);
+    if (viewer && !args.read("--nocompile"))
+    {
+        GLUtils::enableIncrementalCompile(viewer, compileBudget);
+    }
+
     if (viewer)
     {
 #ifdef OSG_GL3_AVAILABLE
@@ -439,7 +450,8 @@ MapNodeHelper::parse(MapNode*             mapNode,
     bool useCoords     = args.read("--coords");
     bool showActivity  = args.read("--activity");
     bool useLogDepth2  = args.read("--logdepth2");
-    bool useLogDepth   = !args.read("--nologdepth") && !useLogDepth2; //args.read("--logdepth");
+    bool useReversedZ  = args.read("--reversedz");
+    bool useLogDepth   = !args.read("--nologdepth") && !useLogDepth2 && !useReversedZ; //args.read("--logdepth");
     bool kmlUI         = args.read("--kmlui");
 
     std::string kmlFile;
@@ -500,6 +512,10 @@ MapNodeHelper::parse(MapNode*             mapNode,
         defaultText->halo() = Stroke(0.3,0.3,0.3,1.0);
         kml_options.defaultTextSymbol() = defaultText;
 
+        // load in the background so a large file doesn't stall startup; the
+        // KML UI needs the content up front, though.
+        kml_options.background() = !kmlUI;
+
         osg::Node* kml = KML::load( URI(kmlFile), mapNode, kml_options );
         if ( kml )
         {
@@ -584,6 +600,13 @@ MapNodeHelper::parse(MapNode*             mapNode,
         logDepth.install( view->getCamera() );
     }
 
+    else if ( useReversedZ )
+    {
+        OE_INFO << LC << "Activating reversed-Z depth buffer on main camera" << std::endl;
+        osgEarth::Util::ReversedDepthBuffer reversedDepth;
+        reversedDepth.install( view->getCamera() );
+    }
+
     // Generic named value uniform with min/max.
     VBox* uniformBox = 0L;
     while( args.find( "--uniform" ) >= 0 )
@@ -726,6 +749,9 @@ MapNodeHelper::configureView( osgViewer::View* view ) const
     // default uniform values:
     GLUtils::setGlobalDefaults(view->getCamera()->getOrCreateStateSet());
 
+    // order the paging requests of all osgEarth subsystems together:
+    PagingScheduler::install(view);
+
     // add some stock OSG handlers:
     view->addEventHandler(new osgViewer::StatsHandler());
     view->addEventHandler(new osgViewer::WindowSizeHandler());
@@ -748,13 +774,16 @@ MapNodeHelper::usage() const
         << "  --ortho                       : use an orthographic camera\n"
         << "  --logdepth                    : activates the logarithmic depth buffer\n"
         << "  --logdepth2                   : activates logarithmic depth buffer with per-fragment interpolation\n"
+        << "  --reversedz                   : activates a reversed-Z depth buffer instead of the logarithmic one\n"
         << "  --shadows                     : activates model layer shadows\n"
         << "  --out-earth [file]            : write the loaded map to an earth file\n"
         << "  --uniform [name] [min] [max]  : create a uniform controller with min/max values\n"
         << "  --define [name]               : install a shader #define\n"
         << "  --path [file]                 : load and playback an animation path\n"
         << "  --extension [name]            : loads a named extension\n"
-        << "  --ocean                       : add a simple ocean model (requires bathymetry)\n";
+        << "  --ocean                       : add a simple ocean model (requires bathymetry)\n"
+        << "  --compile-budget [ms]         : GL compile time per frame for paged data (default 4)\n"
+        << "  --nocompile                   : compile paged data on first draw instead\n";
 }
 
 
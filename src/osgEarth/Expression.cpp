@@ -29,7 +29,8 @@ using namespace osgEarth;
 
 NumericExpression::NumericExpression() :
 _value(0.0),
-_dirty(true)
+_dirty(true),
+_stackSize(0u)
 {
     //nop
 }
@@ -37,7 +38,8 @@ _dirty(true)
 NumericExpression::NumericExpression( const std::string& expr ) : 
 _src  ( expr ),
 _value( 0.0 ),
-_dirty( true )
+_dirty( true ),
+_stackSize( 0u )
 {
     init();
 }
@@ -47,14 +49,17 @@ _src  ( rhs._src ),
 _rpn  ( rhs._rpn ),
 _vars ( rhs._vars ),
 _value( rhs._value ),
-_dirty( rhs._dirty )
+_dirty( rhs._dirty ),
+_program( rhs._program ),
+_stackSize( rhs._stackSize )
 {
     //nop
 }
 
 NumericExpression::NumericExpression( double staticValue ) :
 _value( staticValue ),
-_dirty( false )
+_dirty( false ),
+_stackSize( 0u )
 {
     _src = Stringify() << staticValue;
     init();
@@ -62,7 +67,8 @@ _dirty( false )
 
 NumericExpression::NumericExpression( const Config& conf ) :
 _value( 0.0 ),
-_dirty( true )
+_dirty( true ),
+_stackSize( 0u )
 {
     mergeConfig( conf );
     init();
@@ -263,6 +269,40 @@ NumericExpression::init()
         _rpn.push_back( s.top() );
         s.pop();
     }
+
+    compile();
+}
+
+void
+NumericExpression::compile()
+{
+    _program.clear();
+    _program.reserve( _rpn.size() );
+    _stackSize = 0u;
+
+    std::vector<unsigned> varIndex( _rpn.size(), 0u );
+    for( unsigned v=0; v<_vars.size(); ++v )
+        varIndex[_vars[v].second] = v;
+
+    unsigned depth = 0u;
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        Instruction ins;
+        ins._op    = _rpn[i].first;
+        ins._value = _rpn[i].second;
+        ins._var   = varIndex[i];
+        _program.push_back( ins );
+
+        if ( ins._op >= ADD && ins._op <= MAX )
+        {
+            if ( depth >= 2u )
+                --depth;
+        }
+        else
+        {
+            _stackSize = osg::maximum( _stackSize, ++depth );
+        }
+    }
 }
 
 void 
@@ -281,88 +321,58 @@ NumericExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stack<double> s;
-
-        for( unsigned i=0; i<_rpn.size(); ++i )
+        double local[16];
+        std::vector<double> heap;
+        double* values = local;
+        if ( _vars.size() > 16u )
         {
-            const Atom& a = _rpn[i];
-
-            if ( a.first == ADD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 + op2 );
-                }
-            }
-            else if ( a.first == SUB )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 - op2 );
-                }
-            }
-            else if ( a.first == MULT )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 * op2 );
-                }
-            }
-            else if ( a.first == DIV )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 / op2 );
-                }
-            }
-            else if ( a.first == MOD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( fmod(op1, op2) );
-                }
-            }
-            else if ( a.first == MIN )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( osg::minimum(op1, op2) );
-                }
-            }
-            else if ( a.first == MAX )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( osg::maximum(op1, op2) );
-                }
-            }
-            else // OPERAND or VARIABLE
-            {
-                s.push( a.second );
-            }
+            heap.resize( _vars.size() );
+            values = &heap[0];
         }
 
-        const_cast<NumericExpression*>(this)->_value = s.size() > 0 ? s.top() : 0.0;
+        for( unsigned v=0; v<_vars.size(); ++v )
+            values[v] = _rpn[_vars[v].second].second;
+
+        const_cast<NumericExpression*>(this)->_value = eval( values );
         const_cast<NumericExpression*>(this)->_dirty = false;
     }
 
     return !osg::isNaN( _value ) ? _value : 0.0;
 }
 
+double
+NumericExpression::eval( const double* values ) const
+{
+    double local[16];
+    std::vector<double> heap;
+    double* s = local;
+    if ( _stackSize > 16u )
+    {
+        heap.resize( _stackSize );
+        s = &heap[0];
+    }
+
+    unsigned n = 0u;
+    for( Program::const_iterator i = _program.begin(); i != _program.end(); ++i )
+    {
+        switch( i->_op )
+        {
+        case ADD:  if ( n >= 2u ) { --n; s[n-1] = s[n-1] + s[n]; } break;
+        case SUB:  if ( n >= 2u ) { --n; s[n-1] = s[n-1] - s[n]; } break;
+        case MULT: if ( n >= 2u ) { --n; s[n-1] = s[n-1] * s[n]; } break;
+        case DIV:  if ( n >= 2u ) { --n; s[n-1] = s[n-1] / s[n]; } break;
+        case MOD:  if ( n >= 2u ) { --n; s[n-1] = fmod( s[n-1], s[n] ); } break;
+        case MIN:  if ( n >= 2u ) { --n; s[n-1] = osg::minimum( s[n-1], s[n] ); } break;
+        case MAX:  if ( n >= 2u ) { --n; s[n-1] = osg::maximum( s[n-1], s[n] ); } break;
+        case VARIABLE: s[n++] = values[i->_var]; break;
+        default:       s[n++] = i->_value; break;
+        }
+    }
+
+    double result = n > 0u ? s[n-1] : 0.0;
+    return !osg::isNaN( result ) ? result : 0.0;
+}
+
 //------------------------------------------------------------------------
 
 StringExpression::StringExpression() :
@@ -549,11 +559,11 @@ StringExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stringstream buf;
+        std::string& value = const_cast<StringExpression*>(this)->_value;
+        value.clear();
         for( AtomVector::const_iterator i = _infix.begin(); i != _infix.end(); ++i )
-            buf << i->second;
+            value.append( i->second );
 
-        const_cast<StringExpression*>(this)->_value = buf.str();
         const_cast<StringExpression*>(this)->_dirty = false;
     }
 
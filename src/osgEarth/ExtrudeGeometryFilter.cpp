@@ -31,6 +31,10 @@
 #include <osgEarth/LineDrawable>
 #include <osgEarth/StateSetCache>
 #include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/ShaderGenerator>
+#include <osgEarth/Shaders>
+#include <osgEarth/VirtualProgram>
 
 #include <osg/Geode>
 #include <osg/Geometry>
@@ -41,6 +45,9 @@
 #include <osgUtil/Simplifier>
 #include <osg/LineWidth>
 #include <osg/PolygonOffset>
+#include <osg/TextureBuffer>
+#include <osg/Texture2DArray>
+#include <osg/TexEnv>
 
 #define LC "[ExtrudeGeometryFilter] "
 
@@ -73,6 +80,34 @@ namespace
 
         return atan2( p2.x()-p1.x(), p2.y()-p1.y() );
     }
+
+    // Instanced walls draw from a shared pattern that says nothing about
+    // where they are, so they carry a precomputed bounding box.
+    struct StaticBBox : public osg::Drawable::ComputeBoundingBoxCallback
+    {
+        osg::BoundingBox _box;
+        StaticBBox(const osg::BoundingBox& box) : _box(box) { }
+        osg::BoundingBox computeBound(const osg::Drawable&) const { return _box; }
+    };
+
+    // Packs a vector of records into an RGBA32F texture buffer.
+    osg::TextureBuffer* createRecordBuffer(const std::vector<osg::Vec4f>& records)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(osg::maximum((int)records.size(), 1), 1, 1, GL_RGBA, GL_FLOAT);
+        if (!records.empty())
+            ::memcpy(image->data(), &records[0], records.size()*sizeof(osg::Vec4f));
+
+        // so the TBO will serialize properly.
+        image->setWriteHint(osg::Image::STORE_INLINE);
+
+        osg::TextureBuffer* tbo = new osg::TextureBuffer();
+        tbo->setImage(image);
+        tbo->setInternalFormat(GL_RGBA32F_ARB);
+        tbo->setUnRefImageDataAfterApply(true);
+        ShaderGenerator::setIgnoreHint(tbo, true);
+        return tbo;
+    }
 }
 
 #define AS_VEC4(V3, X) osg::Vec4f( (V3).x(), (V3).y(), (V3).z(), X )
@@ -84,7 +119,9 @@ _mergeGeometry         ( true ),
 _wallAngleThresh_deg   ( 60.0 ),
 _styleDirty            ( true ),
 _makeStencilVolume     ( false ),
-_gpuClamping           ( false )
+_gpuClamping           ( false ),
+_instancing            ( false ),
+_maxInstancedTexels    ( 0u )
 {
     _cosWallAngleThresh = cos( _wallAngleThresh_deg );
 }
@@ -101,6 +138,7 @@ ExtrudeGeometryFilter::reset( const FilterContext& context )
 {
     _cosWallAngleThresh = cos( _wallAngleThresh_deg );
     _geodes.clear();
+    _instancedWalls.clear();
     
     if ( _styleDirty )
     {
@@ -198,6 +236,15 @@ ExtrudeGeometryFilter::reset( const FilterContext& context )
 
         _styleDirty = false;
     }
+
+    // GPU-instanced walls need instanced draws and texture buffers.
+    const Capabilities& caps = Registry::capabilities();
+    _instancing =
+        _extrusionSymbol.valid() &&
+        _extrusionSymbol->instanced() == true &&
+        caps.supportsDrawInstanced() &&
+        caps.supportsTextureBuffer();
+    _maxInstancedTexels = (unsigned)osg::maximum(caps.getMaxTextureBufferSize(), 0);
 }
 
 bool
@@ -784,6 +831,16 @@ ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
 
     // Tessellate the roof lines into polygons.
     osgEarth::Tessellator oeTess;
+    if ( _roofPolygonSymbol.valid() && _roofPolygonSymbol->tessellation().isSet() )
+    {
+        switch( _roofPolygonSymbol->tessellation().get() )
+        {
+        case PolygonSymbol::TESSELLATION_EARCLIP: oeTess.setEngine( Tessellator::ENGINE_EARCLIP ); break;
+        case PolygonSymbol::TESSELLATION_OSG:     oeTess.setEngine( Tessellator::ENGINE_OSG ); break;
+        default:                                  oeTess.setEngine( Tessellator::ENGINE_EARCUT ); break;
+        }
+    }
+
     if (!oeTess.tessellateGeometry(*roof))
     {
         //fallback to osg tessellator
@@ -945,6 +1002,182 @@ ExtrudeGeometryFilter::buildOutlineGeometry(const Structure& structure)
     return lines->empty() ? 0L : lines.release();
 }
 
+bool
+ExtrudeGeometryFilter::canInstance(const Geometry* part, double height, FilterContext& context) const
+{
+    if ( !_instancing )
+        return false;
+
+    // Instanced walls carry no per-vertex clamping or feature index attributes,
+    // and the merged batch cannot take per-feature names.
+    if ( _gpuClamping || _makeStencilVolume || !_featureNameExpr.empty() || context.featureIndex() )
+        return false;
+
+    // They model a single closed ring extruded up to a flat roof.
+    if ( height < 0.0 || _extrusionSymbol->flatten() == false )
+        return false;
+
+    if ( part->getType() != Geometry::TYPE_POLYGON || part->size() < 3 )
+        return false;
+
+    return static_cast<const Polygon*>(part)->getHoles().empty();
+}
+
+void
+ExtrudeGeometryFilter::addInstancedWalls(const Structure&     structure,
+                                         const SkinResource*  wallSkin,
+                                         osg::StateSet*       wallStateSet)
+{
+    if ( structure.elevations.empty() )
+        return;
+
+    const Faces& faces = structure.elevations.front().faces;
+    if ( faces.size() < 3 || faces.size() > _maxInstancedTexels )
+        return;
+
+    // The roof is flat, so one plane describes it for every corner.
+    const Corner& first = faces.front().left;
+    osg::Vec3d up = first.roof - first.base;
+    if ( up.normalize() <= 0.0 )
+        return;
+    double roofPlane = first.roof * up;
+
+    std::vector<InstancedWalls>& batches = _instancedWalls[wallStateSet];
+    if ( batches.empty() || batches.back().corners.size() + faces.size() > _maxInstancedTexels )
+    {
+        batches.push_back( InstancedWalls() );
+    }
+    InstancedWalls& walls = batches.back();
+
+    double maxHeight = 0.0;
+    for(Faces::const_iterator f = faces.begin(); f != faces.end(); ++f)
+    {
+        maxHeight = osg::maximum(maxHeight, (double)f->left.height);
+    }
+
+    int   skin      = -1;
+    float texHeight = maxHeight;
+
+    if ( wallSkin )
+    {
+        std::map<const SkinResource*, int>::const_iterator i = walls.skinIndex.find(wallSkin);
+        if ( i != walls.skinIndex.end() )
+        {
+            skin = i->second;
+        }
+        else
+        {
+            skin = walls.skins.size() / 2;
+            walls.skinIndex[wallSkin] = skin;
+
+            float texWidthM  = *wallSkin->imageWidth()  > 0.0f ? *wallSkin->imageWidth()  : 1.0f;
+            float texHeightM = *wallSkin->imageHeight() > 0.0f ? *wallSkin->imageHeight() : 1.0f;
+
+            walls.skins.push_back( osg::Vec4f(
+                wallSkin->imageBiasS().get(), wallSkin->imageBiasT().get(),
+                wallSkin->imageScaleS().get(), wallSkin->imageScaleT().get()) );
+
+            walls.skins.push_back( osg::Vec4f(
+                (float)wallSkin->imageLayer().get(), texWidthM, texHeightM,
+                wallSkin->isTiled() == true ? 1.0f : 0.0f) );
+        }
+
+        // Same adjustment as buildStructure: a whole number of texture repeats
+        // up to the tallest corner.
+        double texHeightM = *wallSkin->imageHeight() > 0.0f ? *wallSkin->imageHeight() : 1.0;
+        double div = osg::round(maxHeight / texHeightM);
+        texHeight = div > 0.0 ? maxHeight / div : maxHeight;
+    }
+
+    float building = (float)(walls.buildings.size() / 2);
+
+    walls.buildings.push_back( AS_VEC4(up, roofPlane) );
+    walls.buildings.push_back( osg::Vec4f((float)walls.corners.size(), (float)faces.size(), (float)skin, texHeight) );
+
+    for(Faces::const_iterator f = faces.begin(); f != faces.end(); ++f)
+    {
+        walls.corners.push_back( AS_VEC4(f->left.base, building) );
+        walls.bounds.expandBy( f->left.base );
+        walls.bounds.expandBy( f->left.roof );
+    }
+}
+
+osg::Node*
+ExtrudeGeometryFilter::createInstancedWalls(osg::StateSet*        skinStateSet,
+                                            const InstancedWalls& walls,
+                                            const osg::Vec4f&     wallColor,
+                                            const osg::Vec4f&     wallBaseColor)
+{
+    // The shared wall pattern: x = left/right corner, y = base/roof,
+    // in the same order as the per-vertex walls.
+    osg::Vec3Array* pattern = new osg::Vec3Array();
+    pattern->push_back( osg::Vec3(0, 1, 0) );
+    pattern->push_back( osg::Vec3(0, 0, 0) );
+    pattern->push_back( osg::Vec3(1, 0, 0) );
+    pattern->push_back( osg::Vec3(1, 0, 0) );
+    pattern->push_back( osg::Vec3(1, 1, 0) );
+    pattern->push_back( osg::Vec3(0, 1, 0) );
+
+    osg::Geometry* geom = new osg::Geometry();
+    geom->setUseDisplayList( false );
+    geom->setUseVertexBufferObjects( true );
+    geom->setVertexArray( pattern );
+    geom->addPrimitiveSet( new osg::DrawArrays(GL_TRIANGLES, 0, 6, walls.corners.size()) );
+    geom->setComputeBoundingBoxCallback( new StaticBBox(walls.bounds) );
+
+    osg::Geode* geode = new osg::Geode();
+    geode->addDrawable( geom );
+
+    // Keep the skin's texture, blending and render bin; the shaders below
+    // replace what the shader generator would make for it.
+    osg::StateSet* stateSet = skinStateSet ?
+        osg::clone(skinStateSet, osg::CopyOp::SHALLOW_COPY) :
+        new osg::StateSet();
+    geode->setStateSet( stateSet );
+    ShaderGenerator::setIgnoreHint( geode, true );
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate( stateSet );
+    vp->setName( "ExtrudeInstanced" );
+    Shaders pkg;
+    pkg.load( vp, pkg.ExtrudeInstanced );
+
+    bool decal = false;
+    if ( skinStateSet )
+    {
+        osg::StateAttribute* tex = stateSet->getTextureAttribute(0, osg::StateAttribute::TEXTURE);
+        if ( dynamic_cast<osg::Texture2DArray*>(tex) )
+        {
+            stateSet->setDefine( "OE_XI_TEXTURE_ARRAY" );
+            stateSet->getOrCreateUniform( "oe_xi_skinTex", osg::Uniform::SAMPLER_2D_ARRAY )->set( 0 );
+        }
+        else
+        {
+            stateSet->getOrCreateUniform( "oe_xi_skinTex", osg::Uniform::SAMPLER_2D )->set( 0 );
+        }
+
+        osg::TexEnv* texenv = dynamic_cast<osg::TexEnv*>(stateSet->getTextureAttribute(0, osg::StateAttribute::TEXENV));
+        decal = texenv && texenv->getMode() == osg::TexEnv::DECAL;
+    }
+
+    // Bind the record buffers above any units the skin uses.
+    int unit = osg::maximum( (int)stateSet->getNumTextureAttributeLists(), 1 );
+
+    stateSet->setTextureAttribute( unit, createRecordBuffer(walls.corners) );
+    stateSet->getOrCreateUniform( "oe_xi_corners", osg::Uniform::SAMPLER_BUFFER )->set( unit++ );
+
+    stateSet->setTextureAttribute( unit, createRecordBuffer(walls.buildings) );
+    stateSet->getOrCreateUniform( "oe_xi_buildings", osg::Uniform::SAMPLER_BUFFER )->set( unit++ );
+
+    stateSet->setTextureAttribute( unit, createRecordBuffer(walls.skins) );
+    stateSet->getOrCreateUniform( "oe_xi_skins", osg::Uniform::SAMPLER_BUFFER )->set( unit++ );
+
+    osg::Vec4f white(1,1,1,1);
+    stateSet->addUniform( new osg::Uniform("oe_xi_wallColor",     decal ? white : wallColor) );
+    stateSet->addUniform( new osg::Uniform("oe_xi_wallBaseColor", decal ? white : wallBaseColor) );
+
+    return geode;
+}
+
 void
 ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
                                    osg::StateSet*       stateSet,
@@ -1109,7 +1342,11 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
 
             float verticalOffset = (float)input->getDouble("__oe_verticalOffset", 0.0);
 
-            // Build the data model for the structure.
+            // Simple buildings can store their walls as compact records instead.
+            bool instanced = canInstance(part, height, context);
+
+            // Build the data model for the structure. Instanced walls place their
+            // textures on the GPU, so they don't need corners at texture boundaries.
             Structure structure;
 
             buildStructure(
@@ -1117,13 +1354,23 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                 height,
                 _extrusionSymbol->flatten().get(),
                 verticalOffset,
-                wallSkin,
+                instanced ? 0L : wallSkin,
                 roofSkin,
                 structure,
                 context);
 
             // Create the walls.
-            if ( walls.valid() )
+            if ( instanced )
+            {
+                if ( wallSkin )
+                {
+                    context.resourceCache()->getOrCreateStateSet(wallSkin, wallStateSet, context.getDBOptions());
+                }
+
+                addInstancedWalls(structure, wallSkin, wallStateSet.get());
+                walls = 0L;
+            }
+            else if ( walls.valid() )
             {
                 osg::Vec4f wallColor(1,1,1,1), wallBaseColor(1,1,1,1);
 
@@ -1273,6 +1520,34 @@ ExtrudeGeometryFilter::push( FeatureList& input, FilterContext& context )
     }
     _geodes.clear();
 
+    if ( !_instancedWalls.empty() )
+    {
+        osg::Vec4f wallColor(1,1,1,1), wallBaseColor;
+
+        if ( _wallPolygonSymbol.valid() )
+        {
+            wallColor = _wallPolygonSymbol->fill()->color();
+        }
+
+        if ( _extrusionSymbol->wallGradientPercentage().isSet() )
+        {
+            wallBaseColor = Color(wallColor).brightness( 1.0 - *_extrusionSymbol->wallGradientPercentage() );
+        }
+        else
+        {
+            wallBaseColor = wallColor;
+        }
+
+        for( InstancedWallsMap::iterator i = _instancedWalls.begin(); i != _instancedWalls.end(); ++i )
+        {
+            for(unsigned b = 0; b < i->second.size(); ++b)
+            {
+                group->addChild( createInstancedWalls(i->first.get(), i->second[b], wallColor, wallBaseColor) );
+            }
+        }
+        _instancedWalls.clear();
+    }
+
     for (SortedGeodeMap::iterator i = _lineGroups.begin(); i != _lineGroups.end(); ++i)
     {
         group->addChild(i->second.get());
@@ -0,0 +1,106 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#extension GL_ARB_draw_instanced: enable
+
+#pragma vp_name       ExtrudeInstanced VS
+#pragma vp_entryPoint oe_xi_VS
+#pragma vp_location   vertex_model
+#pragma vp_order      0.0
+
+// One texel per footprint corner: local base point, building index
+uniform samplerBuffer oe_xi_corners;
+
+// Two texels per building: (up vector, roof plane distance),
+// (first corner, number of corners, skin index, adjusted texture height)
+uniform samplerBuffer oe_xi_buildings;
+
+// Two texels per skin: (bias S/T, scale S/T), (layer, width, height, tiled)
+uniform samplerBuffer oe_xi_skins;
+
+uniform vec4 oe_xi_wallColor;
+uniform vec4 oe_xi_wallBaseColor;
+
+// stage globals
+vec3 vp_Normal;
+vec4 vp_Color;
+
+out vec3 oe_xi_texcoord;
+flat out vec4 oe_xi_skinBiasScale;
+flat out float oe_xi_textured;
+
+void oe_xi_VS(inout vec4 vertex)
+{
+    // Each instance is one wall. The shared pattern vertex tells us which
+    // corner of the wall this is: x = 0 (left) or 1 (right), y = 0 (base) or 1 (roof).
+    vec2 pattern = vertex.xy;
+
+    int wall = gl_InstanceID;
+    vec4 corner = texelFetch(oe_xi_corners, wall);
+    int b = int(corner.w);
+
+    vec4 roofPlane = texelFetch(oe_xi_buildings, 2*b);
+    vec4 ring = texelFetch(oe_xi_buildings, 2*b+1);
+
+    int first = int(ring.x);
+    int count = int(ring.y);
+    int next = first + (wall - first + 1) % count;
+
+    vec3 left = corner.xyz;
+    vec3 right = texelFetch(oe_xi_corners, next).xyz;
+    vec3 up = roofPlane.xyz;
+
+    vec3 base = mix(left, right, pattern.x);
+    float height = roofPlane.w - dot(base, up);
+
+    vertex = vec4(base + up*height*pattern.y, 1.0);
+    vp_Normal = normalize(cross(right-left, up));
+    vp_Color = mix(oe_xi_wallBaseColor, oe_xi_wallColor, pattern.y);
+
+    int skin = int(ring.z);
+    oe_xi_textured = skin >= 0 ? 1.0 : 0.0;
+    if (skin >= 0)
+    {
+        oe_xi_skinBiasScale = texelFetch(oe_xi_skins, 2*skin);
+        vec4 params = texelFetch(oe_xi_skins, 2*skin+1);
+
+        float u = pattern.x * length(right-left) / params.y;
+        float v = params.w > 0.5 ? pattern.y * height / ring.w : pattern.y;
+        oe_xi_texcoord = vec3(u, v, params.x);
+    }
+}
+
+[break]
+
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_name       ExtrudeInstanced FS
+#pragma vp_entryPoint oe_xi_FS
+#pragma vp_location   fragment_coloring
+#pragma vp_order      0.0
+#pragma import_defines(OE_XI_TEXTURE_ARRAY)
+
+#ifdef OE_XI_TEXTURE_ARRAY
+uniform sampler2DArray oe_xi_skinTex;
+#else
+uniform sampler2D oe_xi_skinTex;
+#endif
+
+in vec3 oe_xi_texcoord;
+flat in vec4 oe_xi_skinBiasScale;
+flat in float oe_xi_textured;
+
+void oe_xi_FS(inout vec4 color)
+{
+    if (oe_xi_textured > 0.0)
+    {
+        // wrap inside the skin's region of the (possibly atlased) texture:
+        vec2 st = oe_xi_skinBiasScale.xy + fract(oe_xi_texcoord.xy)*oe_xi_skinBiasScale.zw;
+#ifdef OE_XI_TEXTURE_ARRAY
+        color *= texture(oe_xi_skinTex, vec3(st, oe_xi_texcoord.z));
+#else
+        color *= texture(oe_xi_skinTex, st);
+#endif
+    }
+}
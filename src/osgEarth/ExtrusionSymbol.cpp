@@ -32,13 +32,15 @@ Symbol(rhs, copyop)
     _wallStyleName = rhs._wallStyleName;
     _roofStyleName = rhs._roofStyleName;
     _wallGradientPercentage = rhs._wallGradientPercentage;
+    _instanced = rhs._instanced;
 }
 
 ExtrusionSymbol::ExtrusionSymbol( const Config& conf ) :
 Symbol    ( conf ),
 _height   ( 10.0 ),
 _flatten  ( true ),
-_wallGradientPercentage( 0.0f )
+_wallGradientPercentage( 0.0f ),
+_instanced( false )
 {
     if ( !conf.empty() )
         mergeConfig(conf);
@@ -55,6 +57,7 @@ ExtrusionSymbol::getConfig() const
     conf.set( "wall_style", _wallStyleName );
     conf.set( "roof_style", _roofStyleName );
     conf.set( "wall_gradient", _wallGradientPercentage );
+    conf.set( "instanced", _instanced );
     return conf;
 }
 
@@ -67,6 +70,7 @@ ExtrusionSymbol::mergeConfig( const Config& conf )
     conf.get( "wall_style", _wallStyleName );
     conf.get( "roof_style", _roofStyleName );
     conf.get( "wall_gradient", _wallGradientPercentage );
+    conf.get( "instanced", _instanced );
 }
 
 void
@@ -87,6 +91,9 @@ ExtrusionSymbol::parseSLD(const Config& c, Style& style)
     else if ( match(c.key(), "extrusion-wall-gradient") ) {
         style.getOrCreate<ExtrusionSymbol>()->wallGradientPercentage() = as<float>(c.value(), 0.0f);
     }
+    else if ( match(c.key(), "extrusion-instanced") ) {
+        style.getOrCreate<ExtrusionSymbol>()->instanced() = as<bool>(c.value(), false);
+    }
     else if ( match(c.key(), "extrusion-script") ) {
         style.getOrCreate<ExtrusionSymbol>()->script() = StringExpression(c.value());
     }
@@ -382,11 +382,22 @@ Feature::isSet( const std::string& name) const
 double
 Feature::eval( NumericExpression& expr, FilterContext const* context ) const
 {
+    // the attribute table compares names case-insensitively, so there's
+    // no need to lower-case the variable names here.
     const NumericExpression::Variables& vars = expr.variables();
+    double local[16];
+    std::vector<double> heap;
+    double* values = local;
+    if (vars.size() > 16u)
+    {
+        heap.resize(vars.size());
+        values = &heap[0];
+    }
+
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       double val = 0.0;
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
+      AttributeTable::const_iterator ai = _attrs.find(i->first);
       if (ai != _attrs.end())
       {
         val = ai->second.getDouble(0.0);
@@ -406,20 +417,29 @@ Feature::eval( NumericExpression& expr, FilterContext const* context ) const
         }
       }
 
-      expr.set( *i, val); //osgEarth::as<double>(getAttr(i->first),0.0) );
+      values[i - vars.begin()] = val;
     }
 
-    return expr.eval();
+    return expr.eval(values);
 }
 
 double
 Feature::eval(NumericExpression& expr, Session* session) const
 {
     const NumericExpression::Variables& vars = expr.variables();
+    double local[16];
+    std::vector<double> heap;
+    double* values = local;
+    if (vars.size() > 16u)
+    {
+        heap.resize(vars.size());
+        values = &heap[0];
+    }
+
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
         double val = 0.0;
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
+        AttributeTable::const_iterator ai = _attrs.find(i->first);
         if (ai != _attrs.end())
         {
             val = ai->second.getDouble(0.0);
@@ -442,10 +462,10 @@ Feature::eval(NumericExpression& expr, Session* session) const
             }
         }
 
-        expr.set( *i, val );
+        values[i - vars.begin()] = val;
     }
 
-    return expr.eval();
+    return expr.eval(values);
 }
 
 const std::string&
@@ -455,7 +475,7 @@ Feature::eval( StringExpression& expr, FilterContext const* context ) const
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       std::string val = "";
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
+      AttributeTable::const_iterator ai = _attrs.find(i->first);
       if (ai != _attrs.end())
       {
         val = ai->second.getString();
@@ -491,7 +511,7 @@ Feature::eval(StringExpression& expr, Session* session) const
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
         std::string val = "";
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
+        AttributeTable::const_iterator ai = _attrs.find(i->first);
         if (ai != _attrs.end())
         {
             val = ai->second.getString();
@@ -0,0 +1,424 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/FeatureBatch>
+#include <osgEarth/StringUtils>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[FeatureBatch] "
+
+FeatureBatch::FeatureBatch()
+{
+    clear();
+}
+
+void
+FeatureBatch::clear()
+{
+    _srs = 0L;
+    _fids.clear();
+    _featureParts.assign(1, 0u);
+    _featureFlags.clear();
+    _featureStyles.clear();
+    _styles.clear();
+    _featureInterp.clear();
+    _partPoints.assign(1, 0u);
+    _partTypes.clear();
+    _partFlags.clear();
+    _x.clear();
+    _y.clear();
+    _z.clear();
+    _columns.clear();
+    _stringArena.clear();
+    _arrayArena.clear();
+}
+
+void
+FeatureBatch::add(const FeatureList& features)
+{
+    for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        add(i->get());
+    }
+}
+
+void
+FeatureBatch::add(const Feature* feature)
+{
+    if (!feature)
+        return;
+
+    if (!_srs.valid())
+        _srs = feature->getSRS();
+
+    unsigned f = _fids.size();
+
+    // attributes first, while f is still the number of features before this one
+    const AttributeTable& attrs = feature->getAttrs();
+    for (AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+    {
+        Column& column = getOrCreateColumn(a->first, a->second.first, f);
+        pushValue(column, &a->second);
+    }
+
+    for (Columns::iterator c = _columns.begin(); c != _columns.end(); ++c)
+    {
+        if (c->second._state.size() == f)
+            pushValue(c->second, 0L);
+    }
+
+    unsigned flags = 0;
+    const Geometry* geom = feature->getGeometry();
+    if (geom && geom->getType() == Geometry::TYPE_MULTI)
+    {
+        flags |= FEATURE_MULTI;
+        const GeometryCollection& parts = static_cast<const MultiGeometry*>(geom)->getComponents();
+        for (GeometryCollection::const_iterator i = parts.begin(); i != parts.end(); ++i)
+        {
+            addGeometry(i->get(), 0);
+        }
+    }
+    else if (geom)
+    {
+        addGeometry(geom, 0);
+    }
+
+    _fids.push_back(feature->getFID());
+    _featureParts.push_back(_partTypes.size());
+    _featureFlags.push_back(flags);
+
+    if (feature->style().isSet())
+    {
+        _featureStyles.push_back(_styles.size());
+        _styles.push_back(feature->style().get());
+    }
+    else
+    {
+        _featureStyles.push_back(-1);
+    }
+
+    _featureInterp.push_back(feature->geoInterp().isSet() ? (signed char)feature->geoInterp().get() : -1);
+}
+
+void
+FeatureBatch::addGeometry(const Geometry* geom, unsigned flags)
+{
+    _x.reserve(_x.size() + geom->size());
+    _y.reserve(_y.size() + geom->size());
+    _z.reserve(_z.size() + geom->size());
+
+    for (Geometry::const_iterator i = geom->begin(); i != geom->end(); ++i)
+    {
+        _x.push_back(i->x());
+        _y.push_back(i->y());
+        _z.push_back(i->z());
+    }
+
+    _partPoints.push_back(_x.size());
+    _partTypes.push_back((unsigned char)geom->getType());
+    _partFlags.push_back((unsigned char)flags);
+
+    if (geom->getType() == Geometry::TYPE_POLYGON)
+    {
+        const RingCollection& holes = static_cast<const Polygon*>(geom)->getHoles();
+        for (RingCollection::const_iterator h = holes.begin(); h != holes.end(); ++h)
+        {
+            addGeometry(h->get(), PART_HOLE);
+        }
+    }
+}
+
+Geometry*
+FeatureBatch::createPart(unsigned p) const
+{
+    unsigned begin = _partPoints[p], end = _partPoints[p + 1];
+
+    Geometry* geom = 0L;
+    switch (_partTypes[p])
+    {
+    case Geometry::TYPE_POINT:      geom = new Point(); break;
+    case Geometry::TYPE_POINTSET:   geom = new PointSet(end - begin); break;
+    case Geometry::TYPE_LINESTRING: geom = new LineString(end - begin); break;
+    case Geometry::TYPE_RING:       geom = new Ring(end - begin); break;
+    case Geometry::TYPE_POLYGON:    geom = new Polygon(end - begin); break;
+    default:                        geom = new Geometry(end - begin); break;
+    }
+
+    for (unsigned i = begin; i < end; ++i)
+    {
+        geom->push_back(osg::Vec3d(_x[i], _y[i], _z[i]));
+    }
+
+    return geom;
+}
+
+void
+FeatureBatch::toFeatures(FeatureList& output) const
+{
+    for (unsigned f = 0; f < _fids.size(); ++f)
+    {
+        // group the parts back into geometries; holes follow their polygon
+        GeometryCollection geoms;
+        for (unsigned p = _featureParts[f]; p < _featureParts[f + 1]; ++p)
+        {
+            Geometry* part = createPart(p);
+            if ((_partFlags[p] & PART_HOLE) != 0 && !geoms.empty() && geoms.back()->getType() == Geometry::TYPE_POLYGON)
+            {
+                static_cast<Polygon*>(geoms.back().get())->getHoles().push_back(static_cast<Ring*>(part));
+            }
+            else
+            {
+                geoms.push_back(part);
+            }
+        }
+
+        osg::ref_ptr<Geometry> geom;
+        if ((_featureFlags[f] & FEATURE_MULTI) != 0)
+            geom = new MultiGeometry(geoms);
+        else if (!geoms.empty())
+            geom = geoms.front().get();
+
+        osg::ref_ptr<Feature> feature = new Feature(geom.get(), _srs.get(), Style(), _fids[f]);
+
+        if (_featureStyles[f] >= 0)
+            feature->style() = _styles[_featureStyles[f]];
+
+        if (_featureInterp[f] >= 0)
+            feature->geoInterp() = (GeoInterpolation)_featureInterp[f];
+
+        for (Columns::const_iterator c = _columns.begin(); c != _columns.end(); ++c)
+        {
+            const Column& column = c->second;
+            if (column._state[f] == VALUE_SET)
+                feature->set(c->first, getValue(column, f));
+            else if (column._state[f] == VALUE_NULL)
+                feature->setNull(c->first, column._type);
+        }
+
+        output.push_back(feature.get());
+    }
+}
+
+void
+FeatureBatch::swapPoints(std::vector<double>& x,
+                         std::vector<double>& y,
+                         std::vector<double>& z,
+                         std::vector<unsigned>& partPoints)
+{
+    if (partPoints.size() != _partPoints.size() || x.size() != y.size() || x.size() != z.size())
+    {
+        OE_WARN << LC << "swapPoints: arrays don't match the batch" << std::endl;
+        return;
+    }
+
+    _x.swap(x);
+    _y.swap(y);
+    _z.swap(z);
+    _partPoints.swap(partPoints);
+}
+
+FeatureBatch::Column&
+FeatureBatch::getOrCreateColumn(const std::string& name, AttributeType type, unsigned numFeatures)
+{
+    Columns::iterator i = _columns.find(name);
+    if (i != _columns.end())
+        return i->second;
+
+    Column& column = _columns[name];
+    column._type = type == ATTRTYPE_UNSPECIFIED ? ATTRTYPE_STRING : type;
+    column._offsets.push_back(column._type == ATTRTYPE_DOUBLEARRAY ? _arrayArena.size() : _stringArena.size());
+
+    // features before this one don't have it
+    for (unsigned f = 0; f < numFeatures; ++f)
+        pushValue(column, 0L);
+
+    return column;
+}
+
+void
+FeatureBatch::pushValue(Column& column, const AttributeValue* value)
+{
+    column._state.push_back(
+        value == 0L ? VALUE_MISSING :
+        value->second.set ? VALUE_SET :
+        VALUE_NULL);
+
+    bool set = column._state.back() == VALUE_SET;
+
+    // values of a different type than the column are converted
+    switch (column._type)
+    {
+    case ATTRTYPE_DOUBLE:
+        column._doubles.push_back(set ? value->getDouble() : 0.0);
+        break;
+
+    case ATTRTYPE_INT:
+        column._ints.push_back(set ? value->getInt() : 0);
+        break;
+
+    case ATTRTYPE_BOOL:
+        column._ints.push_back(set && value->getBool() ? 1 : 0);
+        break;
+
+    case ATTRTYPE_DOUBLEARRAY:
+        if (set && value->first == ATTRTYPE_DOUBLEARRAY)
+        {
+            const std::vector<double>& array = value->second.doubleArrayValue;
+            _arrayArena.insert(_arrayArena.end(), array.begin(), array.end());
+        }
+        column._offsets.push_back(_arrayArena.size());
+        break;
+
+    default:
+        if (set)
+        {
+            std::string s = value->getString();
+            _stringArena.insert(_stringArena.end(), s.begin(), s.end());
+        }
+        column._offsets.push_back(_stringArena.size());
+        break;
+    }
+}
+
+AttributeValue
+FeatureBatch::getValue(const Column& column, unsigned f) const
+{
+    AttributeValue value;
+    value.first = column._type;
+    value.second.set = column._state[f] == VALUE_SET;
+
+    switch (column._type)
+    {
+    case ATTRTYPE_DOUBLE:
+        value.second.doubleValue = column._doubles[f];
+        break;
+
+    case ATTRTYPE_INT:
+        value.second.intValue = column._ints[f];
+        break;
+
+    case ATTRTYPE_BOOL:
+        value.second.boolValue = column._ints[f] != 0;
+        break;
+
+    case ATTRTYPE_DOUBLEARRAY:
+        value.second.doubleArrayValue.assign(
+            _arrayArena.begin() + column._offsets[f],
+            _arrayArena.begin() + column._offsets[f + 1]);
+        break;
+
+    default:
+        value.second.stringValue = getString(column, f);
+        break;
+    }
+    return value;
+}
+
+const FeatureBatch::Column*
+FeatureBatch::getColumn(const std::string& name) const
+{
+    Columns::const_iterator i = _columns.find(name);
+    return i != _columns.end() ? &i->second : 0L;
+}
+
+double
+FeatureBatch::getDouble(const Column& column, unsigned f, double defaultValue) const
+{
+    if (column._state[f] != VALUE_SET)
+        return defaultValue;
+
+    switch (column._type)
+    {
+    case ATTRTYPE_DOUBLE:
+        return column._doubles[f];
+    case ATTRTYPE_INT:
+    case ATTRTYPE_BOOL:
+        return (double)column._ints[f];
+    case ATTRTYPE_DOUBLEARRAY:
+        return defaultValue;
+    default:
+        return as<double>(getString(column, f), defaultValue);
+    }
+}
+
+bool
+FeatureBatch::eval(const NumericExpression& expr, std::vector<double>& output) const
+{
+    const NumericExpression::Variables& vars = expr.variables();
+
+    std::vector<const Column*> columns(vars.size());
+    for (unsigned v = 0; v < vars.size(); ++v)
+    {
+        columns[v] = getColumn(vars[v].first);
+        if (!columns[v])
+            return false;
+
+        for (unsigned f = 0; f < getNumFeatures(); ++f)
+            if (columns[v]->_state[f] == VALUE_MISSING)
+                return false;
+    }
+
+    output.resize(getNumFeatures());
+    std::vector<double> values(vars.size() + 1u);
+
+    for (unsigned f = 0; f < getNumFeatures(); ++f)
+    {
+        for (unsigned v = 0; v < columns.size(); ++v)
+            values[v] = getDouble(*columns[v], f);
+
+        output[f] = expr.eval(&values[0]);
+    }
+
+    return true;
+}
+
+std::string
+FeatureBatch::getString(const Column& column, unsigned f) const
+{
+    if (column._type == ATTRTYPE_STRING || column._type == ATTRTYPE_UNSPECIFIED)
+    {
+        return std::string(
+            _stringArena.begin() + column._offsets[f],
+            _stringArena.begin() + column._offsets[f + 1]);
+    }
+    return column._state[f] == VALUE_SET ? getValue(column, f).getString() : std::string();
+}
+
+void
+FeatureBatch::setDouble(const std::string& name, unsigned f, double value)
+{
+    Column& column = getOrCreateColumn(name, ATTRTYPE_DOUBLE, _fids.size());
+
+    // Feature::set() changes the attribute's type, so do the same here.
+    if (column._type != ATTRTYPE_DOUBLE)
+    {
+        std::vector<double> doubles(column._state.size());
+        for (unsigned i = 0; i < doubles.size(); ++i)
+            doubles[i] = getDouble(column, i, 0.0);
+
+        column._type = ATTRTYPE_DOUBLE;
+        column._doubles.swap(doubles);
+        column._ints.clear();
+        column._offsets.clear();
+    }
+
+    column._doubles[f] = value;
+    column._state[f] = VALUE_SET;
+}
@@ -0,0 +1,369 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/FeatureBlob>
+#include <osgEarth/Geometry>
+#include <cstring>
+
+using namespace osgEarth;
+
+namespace
+{
+    // "OEFB" and the format version; bump the version when the layout changes
+    const uint32_t BLOB_MAGIC = 0x4246454f;
+    const uint32_t BLOB_VERSION = 1u;
+
+    // deepest MultiGeometry nesting a blob may hold
+    const unsigned MAX_DEPTH = 16u;
+
+    struct Writer
+    {
+        Writer(std::string& buffer) : _buffer(buffer) { }
+
+        template<typename T>
+        void put(const T& value)
+        {
+            _buffer.append((const char*)&value, sizeof(T));
+        }
+
+        void putString(const std::string& value)
+        {
+            put<uint32_t>(value.size());
+            _buffer.append(value);
+        }
+
+        void putPoints(const Geometry* geom)
+        {
+            put<uint32_t>(geom->size());
+            if (!geom->empty())
+                _buffer.append((const char*)&(*geom)[0], geom->size() * sizeof(osg::Vec3d));
+        }
+
+        std::string& _buffer;
+    };
+
+    struct Reader
+    {
+        Reader(const std::string& buffer) :
+            _ptr(buffer.data()), _end(buffer.data() + buffer.size()) { }
+
+        bool has(size_t bytes) const
+        {
+            return (size_t)(_end - _ptr) >= bytes;
+        }
+
+        template<typename T>
+        bool get(T& value)
+        {
+            if (!has(sizeof(T)))
+                return false;
+            ::memcpy(&value, _ptr, sizeof(T));
+            _ptr += sizeof(T);
+            return true;
+        }
+
+        bool getString(std::string& value)
+        {
+            uint32_t size;
+            if (!get(size) || !has(size))
+                return false;
+            value.assign(_ptr, size);
+            _ptr += size;
+            return true;
+        }
+
+        bool getPoints(Geometry* geom)
+        {
+            uint32_t size;
+            if (!get(size) || size > (size_t)(_end - _ptr) / sizeof(osg::Vec3d))
+                return false;
+            geom->resize(size);
+            if (size > 0)
+                ::memcpy(&(*geom)[0], _ptr, size * sizeof(osg::Vec3d));
+            _ptr += size * sizeof(osg::Vec3d);
+            return true;
+        }
+
+        const char* _ptr;
+        const char* _end;
+    };
+
+    void writeGeometry(Writer& w, const Geometry* geom)
+    {
+        w.put<uint8_t>(geom->getType());
+
+        if (geom->getType() == Geometry::TYPE_MULTI)
+        {
+            const GeometryCollection& parts = static_cast<const MultiGeometry*>(geom)->getComponents();
+            w.put<uint32_t>(parts.size());
+            for (GeometryCollection::const_iterator i = parts.begin(); i != parts.end(); ++i)
+                writeGeometry(w, i->get());
+        }
+        else
+        {
+            w.putPoints(geom);
+
+            if (geom->getType() == Geometry::TYPE_POLYGON)
+            {
+                const RingCollection& holes = static_cast<const Polygon*>(geom)->getHoles();
+                w.put<uint32_t>(holes.size());
+                for (RingCollection::const_iterator i = holes.begin(); i != holes.end(); ++i)
+                    w.putPoints(i->get());
+            }
+        }
+    }
+
+    Geometry* readGeometry(Reader& r, unsigned depth)
+    {
+        uint8_t type;
+        if (depth > MAX_DEPTH || !r.get(type))
+            return 0L;
+
+        osg::ref_ptr<Geometry> geom;
+        switch (type)
+        {
+        case Geometry::TYPE_UNKNOWN:    geom = new Geometry(); break;
+        case Geometry::TYPE_POINT:      geom = new Point(); break;
+        case Geometry::TYPE_POINTSET:   geom = new PointSet(); break;
+        case Geometry::TYPE_LINESTRING: geom = new LineString(); break;
+        case Geometry::TYPE_RING:       geom = new Ring(); break;
+        case Geometry::TYPE_POLYGON:    geom = new Polygon(); break;
+        case Geometry::TYPE_MULTI:
+            {
+                uint32_t numParts;
+                if (!r.get(numParts))
+                    return 0L;
+
+                osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+                for (uint32_t i = 0; i < numParts; ++i)
+                {
+                    Geometry* part = readGeometry(r, depth + 1);
+                    if (!part)
+                        return 0L;
+                    multi->add(part);
+                }
+                return multi.release();
+            }
+        default:
+            return 0L;
+        }
+
+        if (!r.getPoints(geom.get()))
+            return 0L;
+
+        if (type == Geometry::TYPE_POLYGON)
+        {
+            uint32_t numHoles;
+            if (!r.get(numHoles))
+                return 0L;
+
+            RingCollection& holes = static_cast<Polygon*>(geom.get())->getHoles();
+            for (uint32_t i = 0; i < numHoles; ++i)
+            {
+                osg::ref_ptr<Ring> hole = new Ring();
+                if (!r.getPoints(hole.get()))
+                    return 0L;
+                holes.push_back(hole.get());
+            }
+        }
+
+        return geom.release();
+    }
+
+    void writeAttribute(Writer& w, const std::string& name, const AttributeValue& value)
+    {
+        w.putString(name);
+        w.put<uint8_t>(value.first);
+        w.put<uint8_t>(value.second.set ? 1 : 0);
+        if (!value.second.set)
+            return;
+
+        switch (value.first)
+        {
+        case ATTRTYPE_STRING:
+            w.putString(value.second.stringValue);
+            break;
+        case ATTRTYPE_INT:
+            w.put<int32_t>(value.second.intValue);
+            break;
+        case ATTRTYPE_DOUBLE:
+            w.put<double>(value.second.doubleValue);
+            break;
+        case ATTRTYPE_BOOL:
+            w.put<uint8_t>(value.second.boolValue ? 1 : 0);
+            break;
+        case ATTRTYPE_DOUBLEARRAY:
+            {
+                const std::vector<double>& values = value.second.doubleArrayValue;
+                w.put<uint32_t>(values.size());
+                if (!values.empty())
+                    w._buffer.append((const char*)&values[0], values.size() * sizeof(double));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    bool readAttribute(Reader& r, Feature* feature)
+    {
+        std::string name;
+        uint8_t type, set;
+        if (!r.getString(name) || !r.get(type) || !r.get(set))
+            return false;
+
+        if (!set)
+        {
+            feature->setNull(name, (AttributeType)type);
+            return true;
+        }
+
+        switch (type)
+        {
+        case ATTRTYPE_STRING:
+            {
+                std::string value;
+                if (!r.getString(value))
+                    return false;
+                feature->set(name, value);
+            }
+            break;
+        case ATTRTYPE_INT:
+            {
+                int32_t value;
+                if (!r.get(value))
+                    return false;
+                feature->set(name, (int)value);
+            }
+            break;
+        case ATTRTYPE_DOUBLE:
+            {
+                double value;
+                if (!r.get(value))
+                    return false;
+                feature->set(name, value);
+            }
+            break;
+        case ATTRTYPE_BOOL:
+            {
+                uint8_t value;
+                if (!r.get(value))
+                    return false;
+                feature->set(name, value != 0);
+            }
+            break;
+        case ATTRTYPE_DOUBLEARRAY:
+            {
+                uint32_t size;
+                if (!r.get(size) || size > (size_t)(r._end - r._ptr) / sizeof(double))
+                    return false;
+                std::vector<double> values(size);
+                if (size > 0)
+                    ::memcpy(&values[0], r._ptr, size * sizeof(double));
+                r._ptr += size * sizeof(double);
+                feature->setSwap(name, values);
+            }
+            break;
+        default:
+            // unset type; nothing else to read
+            feature->setNull(name, (AttributeType)type);
+            break;
+        }
+        return true;
+    }
+}
+
+void
+FeatureBlob::encode(const FeatureList& features, std::string& buffer)
+{
+    buffer.clear();
+    Writer w(buffer);
+
+    w.put<uint32_t>(BLOB_MAGIC);
+    w.put<uint32_t>(BLOB_VERSION);
+    w.put<uint32_t>(features.size());
+
+    for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        const Feature* feature = i->get();
+
+        w.put<uint64_t>(feature->getFID());
+
+        const Geometry* geom = feature->getGeometry();
+        w.put<uint8_t>(geom ? 1 : 0);
+        if (geom)
+            writeGeometry(w, geom);
+
+        const AttributeTable& attrs = feature->getAttrs();
+        w.put<uint32_t>(attrs.size());
+        for (AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+            writeAttribute(w, a->first, a->second);
+    }
+}
+
+bool
+FeatureBlob::decode(const std::string& buffer, const FeatureProfile* profile, FeatureList& output)
+{
+    Reader r(buffer);
+
+    uint32_t magic, version, count;
+    if (!r.get(magic) || magic != BLOB_MAGIC ||
+        !r.get(version) || version != BLOB_VERSION ||
+        !r.get(count))
+    {
+        return false;
+    }
+
+    const SpatialReference* srs = profile ? profile->getSRS() : 0L;
+
+    FeatureList features;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint64_t fid;
+        uint8_t hasGeom;
+        if (!r.get(fid) || !r.get(hasGeom))
+            return false;
+
+        osg::ref_ptr<Geometry> geom;
+        if (hasGeom)
+        {
+            geom = readGeometry(r, 0u);
+            if (!geom.valid())
+                return false;
+        }
+
+        osg::ref_ptr<Feature> feature = new Feature(geom.get(), srs, Style(), (FeatureID)fid);
+        if (profile && profile->geoInterp().isSet())
+            feature->geoInterp() = profile->geoInterp().get();
+
+        uint32_t numAttrs;
+        if (!r.get(numAttrs))
+            return false;
+
+        for (uint32_t a = 0; a < numAttrs; ++a)
+        {
+            if (!readAttribute(r, feature.get()))
+                return false;
+        }
+
+        features.push_back(feature.get());
+    }
+
+    output.splice(output.end(), features);
+    return true;
+}
@@ -20,8 +20,12 @@
 #include <osgEarth/FeatureCursor>
 #include <osgEarth/Filter>
 #include <osgEarth/Progress>
+#include <osgEarth/JobArena>
+#include <osgEarth/ThreadingUtils>
+#include <deque>
 
 using namespace osgEarth;
+using namespace osgEarth::Util;
 using namespace OpenThreads;
 
 //---------------------------------------------------------------------------
@@ -37,13 +41,26 @@ FeatureCursor::~FeatureCursor()
     //nop
 }
 
-void
-FeatureCursor::fill(FeatureList& list)
+unsigned
+FeatureCursor::nextBatch(FeatureList& output, unsigned maxFeatures)
 {
-    while( hasMore() )
+    unsigned count = 0u;
+    while( count < maxFeatures && hasMore() )
     {
-        list.push_back( nextFeature() );
+        Feature* f = nextFeature();
+        if ( f )
+        {
+            output.push_back( f );
+            ++count;
+        }
     }
+    return count;
+}
+
+void
+FeatureCursor::fill(FeatureList& list)
+{
+    while( nextBatch(list, 500u) > 0u );
 }
 
 //---------------------------------------------------------------------------
@@ -56,6 +73,14 @@ _clone   ( false )
     _iter = _features.begin();
 }
 
+FeatureListCursor::FeatureListCursor(const FeatureList& features, bool clone) :
+FeatureCursor(0L),
+_features( features ),
+_clone   ( clone )
+{
+    _iter = _features.begin();
+}
+
 FeatureListCursor::~FeatureListCursor()
 {
     //nop
@@ -75,6 +100,17 @@ FeatureListCursor::nextFeature()
     return _clone ? osg::clone(r, osg::CopyOp::DEEP_COPY_ALL) : r;
 }
 
+unsigned
+FeatureListCursor::nextBatch(FeatureList& output, unsigned maxFeatures)
+{
+    unsigned count = 0u;
+    for( ; count < maxFeatures && _iter != _features.end(); ++count, ++_iter )
+    {
+        output.push_back( _clone ? osg::clone(_iter->get(), osg::CopyOp::DEEP_COPY_ALL) : _iter->get() );
+    }
+    return count;
+}
+
 //---------------------------------------------------------------------------
 
 GeometryFeatureCursor::GeometryFeatureCursor(Geometry* geom) :
@@ -165,11 +201,7 @@ FilteredFeatureCursor::hasMore() const
     while(_cursor->hasMore() && _cache.size() < chunkSize)
     {
         FeatureList local;
-
-        while(_cursor->hasMore() && local.size() < chunkSize)
-        {
-            local.push_back(_cursor->nextFeature());
-        }
+        _cursor->nextBatch(local, chunkSize);
 
         for(FeatureFilterChain::const_iterator filter = _chain->begin();
             filter != _chain->end();
@@ -191,3 +223,191 @@ FilteredFeatureCursor::nextFeature()
     _cache.pop_front();
     return feature;
 }
+
+unsigned
+FilteredFeatureCursor::nextBatch(FeatureList& output, unsigned maxFeatures)
+{
+    unsigned count = 0u;
+    while (count < maxFeatures && hasMore())
+    {
+        FeatureList::iterator end = _cache.begin();
+        unsigned n = osg::minimum(maxFeatures - count, (unsigned)_cache.size());
+        std::advance(end, n);
+        output.splice(output.end(), _cache, _cache.begin(), end);
+        count += n;
+    }
+    return count;
+}
+
+//---------------------------------------------------------------------------
+
+struct PrefetchFeatureCursor::Shared : public osg::Referenced
+{
+    osg::ref_ptr<FeatureCursor> _cursor;
+    unsigned _batchSize;
+    unsigned _maxBatches;
+
+    Threading::Mutex _mutex;
+    OpenThreads::Condition _cond;
+    std::deque<FeatureList> _batches;
+    bool _reading;   // a thread is reading from the cursor right now
+    bool _queued;    // a background read is waiting to run
+    bool _done;      // the cursor is exhausted
+    bool _abandoned; // the prefetch cursor went away
+
+    Shared(FeatureCursor* cursor, unsigned batchSize, unsigned maxBatches) :
+        _cursor(cursor),
+        _batchSize(osg::maximum(batchSize, 1u)),
+        _maxBatches(osg::maximum(maxBatches, 1u)),
+        _reading(false),
+        _queued(false),
+        _done(cursor == 0L),
+        _abandoned(false) { }
+
+    bool isCanceled() const
+    {
+        return _cursor->getProgress() && _cursor->getProgress()->isCanceled();
+    }
+
+    // reads one batch with the reading flag set. Call with the mutex held;
+    // it is released during the read.
+    void readBatch()
+    {
+        _reading = true;
+        _mutex.unlock();
+
+        FeatureList batch;
+        bool more = false;
+        if (!isCanceled())
+        {
+            _cursor->nextBatch(batch, _batchSize);
+            more = _cursor->hasMore() && !isCanceled();
+        }
+
+        _mutex.lock();
+        _reading = false;
+        if (!batch.empty())
+        {
+            _batches.push_back(FeatureList());
+            _batches.back().swap(batch);
+        }
+        if (!more)
+            _done = true;
+        _cond.broadcast();
+    }
+
+    // queues a background read if there is room for another batch.
+    // Call with the mutex held.
+    void prefetch();
+};
+
+namespace
+{
+    struct PrefetchTask : public TaskRequest
+    {
+        osg::ref_ptr<PrefetchFeatureCursor::Shared> _shared;
+
+        PrefetchTask(PrefetchFeatureCursor::Shared* shared) : _shared(shared) { }
+
+        void operator()(ProgressCallback*)
+        {
+            PrefetchFeatureCursor::Shared& s = *_shared.get();
+            ScopedLock<Mutex> lock(s._mutex);
+            s._queued = false;
+
+            // the consumer may have read the batch itself in the meantime
+            if (s._reading || s._abandoned || s._done || s._batches.size() >= s._maxBatches)
+                return;
+
+            s.readBatch();
+            s.prefetch();
+        }
+    };
+}
+
+void
+PrefetchFeatureCursor::Shared::prefetch()
+{
+    if (!_queued && !_reading && !_done && !_abandoned && _batches.size() < _maxBatches)
+    {
+        _queued = true;
+        JobArena::get("oe.featureprefetch")->dispatch(new PrefetchTask(this));
+    }
+}
+
+PrefetchFeatureCursor::PrefetchFeatureCursor(FeatureCursor* cursor,
+                                             unsigned batchSize,
+                                             unsigned maxBatches) :
+    FeatureCursor(cursor ? cursor->getProgress() : 0L)
+{
+    _shared = new Shared(cursor, batchSize, maxBatches);
+    ScopedLock<Mutex> lock(_shared->_mutex);
+    _shared->prefetch();
+}
+
+PrefetchFeatureCursor::~PrefetchFeatureCursor()
+{
+    // a queued read will see this and return without touching the cursor;
+    // a running one finishes its batch and stops.
+    ScopedLock<Mutex> lock(_shared->_mutex);
+    _shared->_abandoned = true;
+}
+
+bool
+PrefetchFeatureCursor::fetch() const
+{
+    Shared& s = *_shared.get();
+    ScopedLock<Mutex> lock(s._mutex);
+
+    while (s._batches.empty() && !s._done)
+    {
+        // Only wait when another thread is actually reading. Otherwise read
+        // the batch here: the background read may be stuck behind other jobs,
+        // or this thread may itself be one of the workers it would need.
+        if (s._reading)
+            s._cond.wait(&s._mutex);
+        else
+            s.readBatch();
+    }
+
+    if (s._batches.empty())
+        return false;
+
+    _current.swap(s._batches.front());
+    s._batches.pop_front();
+    s.prefetch();
+    return true;
+}
+
+bool
+PrefetchFeatureCursor::hasMore() const
+{
+    return !_current.empty() || fetch();
+}
+
+Feature*
+PrefetchFeatureCursor::nextFeature()
+{
+    if (!hasMore())
+        return 0L;
+
+    // hold a reference so the caller doesn't have to
+    _lastFeatureReturned = _current.front().get();
+    _current.pop_front();
+    return _lastFeatureReturned.get();
+}
+
+unsigned
+PrefetchFeatureCursor::nextBatch(FeatureList& output, unsigned maxFeatures)
+{
+    unsigned count = 0u;
+    while (count < maxFeatures && hasMore())
+    {
+        FeatureList::iterator end = _current.begin();
+        unsigned n = osg::minimum(maxFeatures - count, (unsigned)_current.size());
+        std::advance(end, n);
+        output.splice(output.end(), _current, _current.begin(), end);
+        count += n;
+    }
+    return count;
+}
@@ -27,8 +27,16 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Progress>
 #include <osgEarth/LandCover>
+#include <osgEarth/JobArena>
+#include <osgEarth/GeometryCompiler>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define OE_FIL_SIMD_SSE2
+#endif
 
 using namespace osgEarth;
+using namespace osgEarth::Util;
 
 #define LC "[FeatureImageLayer] " << getName() << ": "
 
@@ -44,6 +52,7 @@ namespace osgEarth { namespace FeatureImageLayerImpl
     {
         double xmin, ymin;
         double xf, yf;
+        double yoffset; // first image row of the buffer being rendered
     };
 
     struct float32
@@ -94,39 +103,76 @@ namespace osgEarth { namespace FeatureImageLayerImpl
         }
     };
 
-    // rasterizes a geometry to color
-    void rasterize(const Geometry* geometry, const osg::Vec4& color, RenderFrame& frame, 
-                   agg::rasterizer& ras, agg::rendering_buffer& buffer)
+    // Same output as agg::span_abgr32, but blends two pixels at a time
+    // with SSE2 where it's available.
+    struct span_abgr32_blend
     {
-        unsigned a = (unsigned)(127.0f+(color.a()*255.0f)/2.0f); // scale alpha up
-        agg::rgba8 fgColor = agg::rgba8( (unsigned)(color.r()*255.0f), (unsigned)(color.g()*255.0f), (unsigned)(color.b()*255.0f), a );
-        
-        ConstGeometryIterator gi( geometry );
-        while( gi.hasMore() )
+        static void render(unsigned char* ptr, 
+                           int x,
+                           unsigned count, 
+                           const unsigned char* covers, 
+                           const agg::rgba8& c)
         {
-            const Geometry* g = gi.next();
+            unsigned char* p = ptr + (x << 2);
 
-            for( Geometry::const_iterator p = g->begin(); p != g->end(); p++ )
+#ifdef OE_FIL_SIMD_SSE2
+            // Each channel is d + floor((c-d)*alpha / 65536). The signed product
+            // doesn't fit in 16 bits, so split (c-d) into its positive and negative
+            // parts and take the high words of the unsigned products; the floor of
+            // a negative quotient rounds down once more when the low word is non-zero.
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i one = _mm_set1_epi16(1);
+            const __m128i color = _mm_setr_epi16(c.a, c.b, c.g, c.r, c.a, c.b, c.g, c.r);
+
+            for (; count >= 2u; count -= 2u, p += 8, covers += 2)
             {
-                const osg::Vec3d& p0 = *p;
-                double x0 = frame.xf*(p0.x()-frame.xmin);
-                double y0 = frame.yf*(p0.y()-frame.ymin);
+                short a0 = (short)(covers[0] * c.a);
+                short a1 = (short)(covers[1] * c.a);
+                __m128i alpha = _mm_setr_epi16(a0, a0, a0, a0, a1, a1, a1, a1);
 
-                if ( p == g->begin() )
-                    ras.move_to_d( x0, y0 );
-                else
-                    ras.line_to_d( x0, y0 );
+                __m128i dst = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), zero);
+                __m128i up = _mm_subs_epu16(color, dst);
+                __m128i down = _mm_subs_epu16(dst, color);
+
+                __m128i upHi = _mm_mulhi_epu16(up, alpha);
+                __m128i downHi = _mm_mulhi_epu16(down, alpha);
+                __m128i downLo = _mm_mullo_epi16(down, alpha);
+                __m128i borrow = _mm_andnot_si128(_mm_cmpeq_epi16(downLo, zero), one);
+
+                __m128i result = _mm_sub_epi16(_mm_sub_epi16(_mm_add_epi16(dst, upHi), downHi), borrow);
+                _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(result, result));
+            }
+#endif
+
+            for (; count > 0u; --count)
+            {
+                int alpha = (*covers++) * c.a;
+                int a = p[0];
+                int b = p[1];
+                int g = p[2];
+                int r = p[3];
+                *p++ = (((c.a - a) * alpha) + (a << 16)) >> 16;
+                *p++ = (((c.b - b) * alpha) + (b << 16)) >> 16;
+                *p++ = (((c.g - g) * alpha) + (g << 16)) >> 16;
+                *p++ = (((c.r - r) * alpha) + (r << 16)) >> 16;
             }
         }
-        agg::renderer<agg::span_abgr32, agg::rgba8> ren(buffer);
-        ras.render(ren, fgColor);
 
-        ras.reset();
-    }
+        static void hline(unsigned char* ptr, 
+                          int x,
+                          unsigned count, 
+                          const agg::rgba8& c)
+        {
+            agg::span_abgr32::hline(ptr, x, count, c);
+        }
 
+        static agg::rgba8 get(unsigned char* ptr, int x)
+        {
+            return agg::span_abgr32::get(ptr, x);
+        }
+    };
 
-    void rasterizeCoverage(const Geometry* geometry, float value, RenderFrame& frame, 
-                           agg::rasterizer& ras, agg::rendering_buffer& buffer)
+    void addOutline(const Geometry* geometry, const RenderFrame& frame, agg::rasterizer& ras)
     {
         ConstGeometryIterator gi( geometry );
         while( gi.hasMore() )
@@ -137,7 +183,7 @@ namespace osgEarth { namespace FeatureImageLayerImpl
             {
                 const osg::Vec3d& p0 = *p;
                 double x0 = frame.xf*(p0.x()-frame.xmin);
-                double y0 = frame.yf*(p0.y()-frame.ymin);
+                double y0 = frame.yf*(p0.y()-frame.ymin) - frame.yoffset;
 
                 if ( p == g->begin() )
                     ras.move_to_d( x0, y0 );
@@ -145,21 +191,166 @@ namespace osgEarth { namespace FeatureImageLayerImpl
                     ras.line_to_d( x0, y0 );
             }
         }
-        
+    }
+
+    // rasterizes a geometry to color
+    void rasterize(const Geometry* geometry, const osg::Vec4& color, const RenderFrame& frame, 
+                   agg::rasterizer& ras, agg::rendering_buffer& buffer)
+    {
+        unsigned a = (unsigned)(127.0f+(color.a()*255.0f)/2.0f); // scale alpha up
+        agg::rgba8 fgColor = agg::rgba8( (unsigned)(color.r()*255.0f), (unsigned)(color.g()*255.0f), (unsigned)(color.b()*255.0f), a );
+
+        addOutline(geometry, frame, ras);
+
+        agg::renderer<span_abgr32_blend, agg::rgba8> ren(buffer);
+        ras.render(ren, fgColor);
+
+        ras.reset();
+    }
+
+
+    void rasterizeCoverage(const Geometry* geometry, float value, const RenderFrame& frame, 
+                           agg::rasterizer& ras, agg::rendering_buffer& buffer)
+    {
+        addOutline(geometry, frame, ras);
+
         agg::renderer<span_coverage32, float32> ren(buffer);
         ras.render(ren, value);
         ras.reset();
     }
 
+    // A cropped geometry ready to rasterize, with the range of image
+    // rows it touches so each stripe can skip the ones it doesn't.
+    struct RenderItem
+    {
+        RenderItem() : _value(NO_DATA_VALUE), _coverage(false), _firstRow(0), _lastRow(0) { }
+
+        osg::ref_ptr<Geometry> _geometry;
+        osg::Vec4f _color;
+        float _value;
+        bool _coverage;
+        int _firstRow, _lastRow;
+    };
+
+    typedef std::vector<RenderItem> RenderItems;
+
+    // Rasterizes the items that touch image rows [firstRow, lastRow)
+    // into that band of the image, in their original order.
+    void renderStripe(const RenderItems& items, const RenderFrame& frame, double gamma,
+                      osg::Image* image, int firstRow, int lastRow)
+    {
+        RenderFrame stripeFrame = frame;
+        stripeFrame.yoffset = (double)firstRow;
+
+        agg::rendering_buffer rbuf(image->data(0, firstRow), image->s(), lastRow - firstRow, image->s() * 4);
+
+        agg::rasterizer ras;
+        ras.gamma(gamma);
+        ras.filling_rule(agg::fill_even_odd);
+
+        for (RenderItems::const_iterator i = items.begin(); i != items.end(); ++i)
+        {
+            if (i->_lastRow < firstRow || i->_firstRow >= lastRow)
+                continue;
+
+            if (i->_coverage)
+                rasterizeCoverage(i->_geometry.get(), i->_value, stripeFrame, ras, rbuf);
+            else
+                rasterize(i->_geometry.get(), i->_color, stripeFrame, ras, rbuf);
+        }
+    }
+
+    struct StripeGroup : public osg::Referenced
+    {
+        StripeGroup() : _next(0u), _remaining(0u) { }
+
+        //! Claims and renders the next stripe; returns false if there are none left.
+        bool runNext()
+        {
+            unsigned index = (++_next) - 1u;
+            if (index >= _numStripes)
+                return false;
+
+            int rows = _image->t();
+            int firstRow = (int)(((unsigned)rows * index) / _numStripes);
+            int lastRow = (int)(((unsigned)rows * (index + 1u)) / _numStripes);
+            renderStripe(*_items, _frame, _gamma, _image, firstRow, lastRow);
+
+            if (--_remaining == 0u)
+                _done.set();
+
+            return true;
+        }
+
+        void runAndWait()
+        {
+            while (runNext());
+            _done.wait();
+        }
+
+        const RenderItems* _items;
+        RenderFrame _frame;
+        double _gamma;
+        osg::Image* _image;
+        unsigned _numStripes;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+    };
+
+    struct StripeTask : public TaskRequest
+    {
+        StripeTask(StripeGroup* group) : _group(group) { }
+
+        void operator()(ProgressCallback*)
+        {
+            while (_group->runNext());
+        }
+
+        osg::ref_ptr<StripeGroup> _group;
+    };
+
     FeatureCursor* createCursor(FeatureSource* fs, FeatureFilterChain* chain, FilterContext& cx, const Query& query, ProgressCallback* progress)
     {
-        FeatureCursor* cursor = fs->createFeatureCursor(query, progress);
+        // tile queries go through the source's tile cache (if it has one),
+        // so child tiles reuse the features already read for their parents.
+        FeatureCursor* cursor = fs->createTileCursor(query, progress);
         if (chain)
         {
             cursor = new FilteredFeatureCursor(cursor, chain, cx);
         }
         return cursor;
     }
+
+    typedef std::vector< std::pair<Style, FeatureList> > StyleToFeatures;
+
+    void addFeatureToStyleGroup(Feature* feature, const Style& style, StyleToFeatures& groups)
+    {
+        if (!style.getName().empty())
+        {
+            for (unsigned i = 0; i < groups.size(); ++i)
+            {
+                if (groups[i].first.getName() == style.getName())
+                {
+                    groups[i].second.push_back(feature);
+                    return;
+                }
+            }
+        }
+
+        groups.push_back(std::make_pair(style, FeatureList()));
+        groups.back().second.push_back(feature);
+    }
+
+    // Extent the GPU rasterizer draws in: a tangent plane at the corner of
+    // the tile, which keeps the compiled geometry local and precise.
+    GeoExtent createRasterizerExtent(const TileKey& key)
+    {
+        const GeoExtent& extent = key.getExtent();
+        osg::Vec3d pos(extent.west(), extent.south(), 0);
+        osg::ref_ptr<const SpatialReference> srs = extent.getSRS()->createTangentPlaneSRS(pos);
+        return extent.transform(srs.get());
+    }
 }};
 
 //........................................................................
@@ -171,6 +362,10 @@ FeatureImageLayer::Options::getConfig() const
     featureSource().set(conf, "features");
     styleSheet().set(conf, "styles");
     conf.set("gamma", gamma());
+    conf.set("render_stripes", renderStripes());
+    conf.set("rasterizer", "agg", rasterizer(), RASTERIZER_AGG);
+    conf.set("rasterizer", "gpu", rasterizer(), RASTERIZER_GPU);
+    conf.set("gpu_readback", gpuReadback());
 
     if (filters().empty() == false)
     {
@@ -187,10 +382,17 @@ void
 FeatureImageLayer::Options::fromConfig(const Config& conf)
 {
     gamma().init(1.3);
+    renderStripes().init(1u);
+    rasterizer().init(RASTERIZER_AGG);
+    gpuReadback().init(true);
 
     featureSource().get(conf, "features");
     styleSheet().get(conf, "styles");
     conf.get("gamma", gamma());
+    conf.get("render_stripes", renderStripes());
+    conf.get("rasterizer", "agg", rasterizer(), RASTERIZER_AGG);
+    conf.get("rasterizer", "gpu", rasterizer(), RASTERIZER_GPU);
+    conf.get("gpu_readback", gpuReadback());
 
     const Config& filtersConf = conf.child("filters");
     for(ConfigSet::const_iterator i = filtersConf.children().begin(); i != filtersConf.children().end(); ++i)
@@ -211,6 +413,33 @@ FeatureImageLayer::init()
     {
         setProfile(Profile::create("global-geodetic"));
     }
+
+    if (options().rasterizer() == Options::RASTERIZER_GPU)
+    {
+        if (options().coverage() == true)
+        {
+            OE_WARN << LC << "GPU rasterizer does not support coverage data; using AGG" << std::endl;
+        }
+        else
+        {
+            // Camera that draws the compiled features into the tile images.
+            _rasterizer = new TileRasterizer();
+
+            // Without readback there's no CPU image; hand the rendered
+            // texture straight to the terrain.
+            if (options().gpuReadback() == false)
+            {
+                setUseCreateTexture();
+            }
+        }
+    }
+}
+
+osg::Node*
+FeatureImageLayer::getNode() const
+{
+    // adds the rasterizer to the scene graph so it can draw tiles
+    return _rasterizer.get();
 }
 
 Status
@@ -367,6 +596,22 @@ FeatureImageLayer::createImageImplementation(const TileKey& key, ProgressCallbac
         return GeoImage::INVALID;
     }
     
+    if (_rasterizer.valid())
+    {
+        GeoExtent outputExtent = createRasterizerExtent(key);
+
+        osg::ref_ptr<osg::Node> node = compileForRasterizer(key, outputExtent, progress);
+        if (!node.valid())
+            return GeoImage::INVALID;
+
+        // Schedule the rasterization and wait for it.
+        // NULL means there was nothing to render.
+        Threading::Future<osg::Image> result = _rasterizer->push(node.get(), getTileSize(), outputExtent);
+        osg::ref_ptr<osg::Image> image = result.release();
+
+        return image.valid() ? GeoImage(image.get(), key.getExtent()) : GeoImage::INVALID;
+    }
+
     // allocate the image.
     osg::ref_ptr<osg::Image> image;
 
@@ -395,6 +640,147 @@ FeatureImageLayer::createImageImplementation(const TileKey& key, ProgressCallbac
     }
 }
 
+TextureWindow
+FeatureImageLayer::createTexture(const TileKey& key, ProgressCallback* progress) const
+{
+    if (!_rasterizer.valid() || !getFeatureSource() || !getFeatureSource()->getFeatureProfile() || !_session.valid())
+        return TextureWindow();
+
+    GeoExtent outputExtent = createRasterizerExtent(key);
+
+    osg::ref_ptr<osg::Node> node = compileForRasterizer(key, outputExtent, progress);
+    if (!node.valid())
+        return TextureWindow();
+
+    osg::Texture2D* texture = new osg::Texture2D();
+    texture->setTextureSize(getTileSize(), getTileSize());
+    texture->setInternalFormat(GL_RGBA8);
+    texture->setSourceFormat(GL_RGBA);
+    texture->setSourceType(GL_UNSIGNED_BYTE);
+    texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+
+    // The texture fills in when the rasterizer gets to it.
+    _rasterizer->push(node.get(), texture, outputExtent);
+
+    return TextureWindow(texture, osg::Matrix::identity());
+}
+
+osg::Node*
+FeatureImageLayer::compileForRasterizer(const TileKey&    key,
+                                        const GeoExtent&  outputExtent,
+                                        ProgressCallback* progress) const
+{
+    FeatureSource* features = getFeatureSource();
+    const FeatureProfile* featureProfile = features->getFeatureProfile();
+    const StyleSheet* styles = getStyleSheet();
+
+    Query defaultQuery;
+    defaultQuery.tileKey() = key;
+
+    FilterContext context(_session.get(), featureProfile, key.getExtent().transform(featureProfile->getSRS()));
+
+    // sort the features into style groups, the same way render() picks styles:
+    StyleToFeatures groups;
+
+    if (features->hasEmbeddedStyles() || !styles || styles->getSelectors().empty())
+    {
+        const Style* defaultStyle = styles ? styles->getDefaultStyle() : 0L;
+
+        FeatureList list;
+        getFeatures(_session.get(), defaultQuery, key.getExtent(), list, progress);
+        for (FeatureList::iterator i = list.begin(); i != list.end(); ++i)
+        {
+            Feature* feature = i->get();
+            if (features->hasEmbeddedStyles() && feature->style().isSet())
+                addFeatureToStyleGroup(feature, *feature->style(), groups);
+            else if (defaultStyle)
+                addFeatureToStyleGroup(feature, *defaultStyle, groups);
+        }
+    }
+    else
+    {
+        for (StyleSelectors::const_iterator i = styles->getSelectors().begin();
+            i != styles->getSelectors().end();
+            ++i)
+        {
+            const StyleSelector& sel = i->second;
+
+            if (sel.styleExpression().isSet())
+            {
+                StringExpression styleExprCopy(sel.styleExpression().get());
+
+                FeatureList list;
+                getFeatures(_session.get(), defaultQuery, key.getExtent(), list, progress);
+                for (FeatureList::iterator itr = list.begin(); itr != list.end(); ++itr)
+                {
+                    Feature* feature = itr->get();
+
+                    const std::string& styleString = feature->eval(styleExprCopy, &context);
+                    if (!styleString.empty() && styleString != "null")
+                    {
+                        Style combinedStyle;
+
+                        // inline style definition, or a style name with no fallback:
+                        if (styleString[0] == '{')
+                        {
+                            Config conf("style", styleString);
+                            conf.setReferrer(sel.styleExpression().get().uriContext().referrer());
+                            conf.set("type", "text/css");
+                            combinedStyle = Style(conf);
+                        }
+                        else
+                        {
+                            const Style* selectedStyle = styles->getStyle(styleString, false);
+                            if (selectedStyle)
+                                combinedStyle = *selectedStyle;
+                        }
+
+                        if (!combinedStyle.empty())
+                            addFeatureToStyleGroup(feature, combinedStyle, groups);
+                    }
+                }
+            }
+            else
+            {
+                const Style* style = styles->getStyle(sel.getSelectedStyleName());
+                Query query = sel.query().get();
+                query.tileKey() = key;
+
+                if (style)
+                {
+                    FeatureList list;
+                    getFeatures(_session.get(), query, key.getExtent(), list, progress);
+                    for (FeatureList::iterator itr = list.begin(); itr != list.end(); ++itr)
+                        addFeatureToStyleGroup(itr->get(), *style, groups);
+                }
+            }
+        }
+    }
+
+    if (groups.empty() || (progress && progress->isCanceled()))
+        return 0L;
+
+    context.setOutputSRS(outputExtent.getSRS());
+
+    // compile the features into a node.
+    GeometryCompiler compiler;
+    osg::ref_ptr<osg::Group> group = new osg::Group();
+
+    for (unsigned i = 0; i < groups.size(); ++i)
+    {
+        osg::ref_ptr<osg::Node> node = compiler.compile(groups[i].second, groups[i].first, context);
+        if (node.valid() && node->getBound().valid())
+        {
+            group->addChild(node.get());
+        }
+    }
+
+    return group->getNumChildren() > 0 ? group.release() : 0L;
+}
+
 bool
 FeatureImageLayer::preProcess(osg::Image* image) const
 {
@@ -501,6 +887,7 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
     frame.ymin = imageExtent.yMin();
     frame.xf = (double)image->s() / imageExtent.width();
     frame.yf = (double)image->t() / imageExtent.height();
+    frame.yoffset = 0.0;
 
     if (lines.size() > 0)
     {
@@ -590,20 +977,6 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
     FilterContext polysContext = xform.push(polygons, context);
     FilterContext linesContext = xform.push(lines, context);
 
-    // set up the AGG renderer:
-    agg::rendering_buffer rbuf(image->data(), image->s(), image->t(), image->s() * 4);
-
-    // Create the renderer and the rasterizer
-    agg::rasterizer ras;
-
-    // Setup the rasterizer
-    if (options().coverage() == true)
-        ras.gamma(1.0);
-    else
-        ras.gamma(options().gamma().get());
-
-    ras.filling_rule(agg::fill_even_odd);
-
     // construct an extent for cropping the geometry to our tile.
     // extend just outside the actual extents so we don't get edge artifacts:
     GeoExtent cropExtent = GeoExtent(imageExtent);
@@ -640,7 +1013,12 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
     if (covsym && covsym->valueExpression().isSet())
         covValue = covsym->valueExpression().get();
 
-    // render the polygons
+    // crop everything up front and note the rows each geometry touches, so that
+    // stripes rendered in parallel only visit the geometry that concerns them.
+    RenderItems items;
+    items.reserve(polygons.size() + lines.size());
+
+    // collect the polygons
     for (FeatureList::iterator i = polygons.begin(); i != polygons.end(); i++)
     {
         Feature*  feature = i->get();
@@ -653,21 +1031,20 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
                 feature->style().isSet() && feature->style()->has<PolygonSymbol>() ? feature->style()->get<PolygonSymbol>() :
                 masterPoly;
 
-            if (options().coverage() == true && covValue.isSet())
-            {
-                float value = (float)feature->eval(covValue.mutable_value(), &context);
-                rasterizeCoverage(croppedGeometry.get(), value, frame, ras, rbuf);
-            }
+            RenderItem item;
+            item._geometry = croppedGeometry;
+            item._coverage = options().coverage() == true && covValue.isSet();
+
+            if (item._coverage)
+                item._value = (float)feature->eval(covValue.mutable_value(), &context);
             else
-            {
-                Color color = poly ? poly->fill()->color() : Color::White;
-                rasterize(croppedGeometry.get(), color, frame, ras, rbuf);
-            }
+                item._color = poly ? poly->fill()->color() : Color::White;
 
+            items.push_back(item);
         }
     }
 
-    // render the lines
+    // collect the lines
     for (FeatureList::iterator i = lines.begin(); i != lines.end(); i++)
     {
         Feature*  feature = i->get();
@@ -680,19 +1057,60 @@ FeatureImageLayer::renderFeaturesForStyle(Session*           session,
                 feature->style().isSet() && feature->style()->has<LineSymbol>() ? feature->style()->get<LineSymbol>() :
                 masterLine;
 
-            if (options().coverage() == true && covValue.isSet())
-            {
-                float value = (float)feature->eval(covValue.mutable_value(), &context);
-                rasterizeCoverage(croppedGeometry.get(), value, frame, ras, rbuf);
-            }
+            RenderItem item;
+            item._geometry = croppedGeometry;
+            item._coverage = options().coverage() == true && covValue.isSet();
+
+            if (item._coverage)
+                item._value = (float)feature->eval(covValue.mutable_value(), &context);
             else
-            {
-                osg::Vec4f color = line ? static_cast<osg::Vec4>(line->stroke()->color()) : osg::Vec4(1, 1, 1, 1);
-                rasterize(croppedGeometry.get(), color, frame, ras, rbuf);
-            }
+                item._color = line ? static_cast<osg::Vec4>(line->stroke()->color()) : osg::Vec4(1, 1, 1, 1);
+
+            items.push_back(item);
         }
     }
 
+    if (items.empty())
+        return true;
+
+    for (RenderItems::iterator i = items.begin(); i != items.end(); ++i)
+    {
+        Bounds b = i->_geometry->getBounds();
+        i->_firstRow = (int)floor(frame.yf*(b.yMin() - frame.ymin)) - 1;
+        i->_lastRow = (int)ceil(frame.yf*(b.yMax() - frame.ymin)) + 1;
+    }
+
+    double gamma = options().coverage() == true ? 1.0 : options().gamma().get();
+
+    // Split the tile into horizontal stripes and rasterize them in parallel.
+    // The stripes cover disjoint rows, so the result matches a serial render.
+    unsigned numStripes = osg::clampBetween(options().renderStripes().get(), 1u, (unsigned)image->t());
+    if (numStripes > 1u && items.size() > 1u)
+    {
+        osg::ref_ptr<StripeGroup> group = new StripeGroup();
+        group->_items = &items;
+        group->_frame = frame;
+        group->_gamma = gamma;
+        group->_image = image;
+        group->_numStripes = numStripes;
+        group->_remaining = numStripes;
+
+        JobArena* arena = JobArena::get("oe.featureimage");
+        if (arena->getConcurrency() < numStripes - 1u)
+            arena->setConcurrency(numStripes - 1u);
+
+        for (unsigned i = 1; i < numStripes; ++i)
+        {
+            arena->dispatch(new StripeTask(group.get()));
+        }
+
+        group->runAndWait();
+    }
+    else
+    {
+        renderStripe(items, frame, gamma, image, 0, image->t());
+    }
+
     return true;
 }
 
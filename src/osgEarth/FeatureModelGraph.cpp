@@ -36,6 +36,7 @@
 #include <osgEarth/Metrics>
 #include <osgEarth/ElevationRanges>
 #include <osgEarth/LineDrawable>
+#include <osgEarth/PagingScheduler>
 
 #include <osg/CullFace>
 #include <osg/PagedLOD>
@@ -283,6 +284,7 @@ namespace
         p->setDatabaseOptions(options);
         // so we can find the FMG instance in the pseudoloader.
         OptionsData<FeatureModelGraph>::set(options, USER_OBJECT_NAME, fmg);
+        PagingScheduler::setSubsystem(options, PagingScheduler::FEATURES);
 
         return p;
 
@@ -1384,7 +1386,11 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
 FeatureCursor*
 FeatureModelGraph::createCursor(FeatureSource* fs, FilterContext& cx, const Query& query, ProgressCallback* progress) const
 {
-    FeatureCursor* cursor = fs->createFeatureCursor(query, progress);
+    FeatureCursor* cursor = fs->createTileCursor(query, progress);
+    if (cursor && _options.prefetchFeatures() == true)
+    {
+        cursor = new PrefetchFeatureCursor(cursor);
+    }
     if (_filterChain.valid())
     {
         cursor = new FilteredFeatureCursor(cursor, _filterChain.get(), cx);
@@ -1623,17 +1629,19 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
 
     // visit each feature and run the expression to sort it into a bin.
     std::map<std::string, FeatureList> styleBins;
-    while (cursor->hasMore())
+    FeatureList batch;
+    while (cursor->nextBatch(batch, 500u) > 0u)
     {
-        osg::ref_ptr<Feature> feature = cursor->nextFeature();
-        if (feature.valid())
+        for (FeatureList::iterator i = batch.begin(); i != batch.end(); ++i)
         {
+            Feature* feature = i->get();
             const std::string& styleString = feature->eval(styleExprCopy, &context);
             if (!styleString.empty() && styleString != "null")
             {
-                styleBins[styleString].push_back(feature.get());
+                styleBins[styleString].push_back(feature);
             }
         }
+        batch.clear();
 
         if (progress && progress->isCanceled())
             return;
@@ -1948,6 +1956,7 @@ FeatureModelGraph::traverse(osg::NodeVisitor& nv)
         OE_PROFILING_ZONE;
         if (!_ownerName.empty())
             OE_PROFILING_ZONE_TEXT(_ownerName);
+        OE_METRICS_TIMED_SCOPE("frame.cull.features_us");
 
         osg::Group::traverse(nv);
     }
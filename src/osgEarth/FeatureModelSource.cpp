@@ -46,7 +46,8 @@ _clusterCulling    ( false ),
 _backfaceCulling   ( true ),
 _alphaBlending     ( true ),
 _sessionWideResourceCache( true ),
-_nodeCaching(false)
+_nodeCaching(false),
+_prefetchFeatures(false)
 {
     fromConfig(co.getConfig());
 }
@@ -67,6 +68,7 @@ FeatureModelOptions::fromConfig(const Config& conf)
     conf.get( "backface_culling", _backfaceCulling );
     conf.get( "alpha_blending",   _alphaBlending );
     conf.get( "node_caching",     _nodeCaching );
+    conf.get( "prefetch_features", _prefetchFeatures );
     
     conf.get( "session_wide_resource_cache", _sessionWideResourceCache );
 
@@ -93,6 +95,7 @@ FeatureModelOptions::getConfig() const
     conf.set( "backface_culling", _backfaceCulling );
     conf.set( "alpha_blending",   _alphaBlending );
     conf.set( "node_caching",     _nodeCaching );
+    conf.set( "prefetch_features", _prefetchFeatures );
     
     conf.set( "session_wide_resource_cache", _sessionWideResourceCache );
 
@@ -184,6 +187,18 @@ FeatureNodeFactory::getOrCreateStyleGroup(const Style& style,
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    // About a pixel of a 256-pixel tile: finer than that won't show.
+    double getTileGranularityError(const TileKey& key)
+    {
+        const GeoExtent& extent = key.getExtent();
+        double height = extent.height();
+        if ( extent.getSRS()->isGeographic() )
+            height = osg::DegreesToRadians(height) * extent.getSRS()->getEllipsoid()->getRadiusEquator();
+        return height / 256.0;
+    }
+}
 
 GeomFeatureNodeFactory::GeomFeatureNodeFactory( const GeometryCompilerOptions& options ) : 
 _options( options ) 
@@ -199,7 +214,19 @@ bool GeomFeatureNodeFactory::createOrUpdateNode(
     const Query&              query
 )
 {
-    GeometryCompiler compiler( _options );
-    node = compiler.compile( features, style, context );
+    // A tile only needs to conform to the ellipsoid as closely as its LOD
+    // can show, so let coarse tiles subdivide less.
+    if ( !_options.maxGranularityError().isSet() && query.tileKey().isSet() )
+    {
+        GeometryCompilerOptions options( _options );
+        options.maxGranularityError() = getTileGranularityError( query.tileKey().get() );
+        GeometryCompiler compiler( options );
+        node = compiler.compile( features, style, context );
+    }
+    else
+    {
+        GeometryCompiler compiler( _options );
+        node = compiler.compile( features, style, context );
+    }
     return node.valid();
 }
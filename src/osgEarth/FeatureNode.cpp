@@ -56,6 +56,7 @@ _options           ( options ),
 _needsRebuild      ( true ),
 _styleSheet        ( styleSheet ),
 _clampDirty        (false),
+_useElevationPool  (false),
 _index             ( 0 )
 {
     _features.push_back( feature );
@@ -78,6 +79,7 @@ _options        ( options ),
 _needsRebuild   ( true ),
 _styleSheet     ( styleSheet ),
 _clampDirty     ( false ),
+_useElevationPool( false ),
 _index          ( 0 )
 {
     _features.insert( _features.end(), features.begin(), features.end() );
@@ -147,6 +149,10 @@ FeatureNode::build()
         GeometryCompiler compiler( options );
         Session* session = new Session( getMapNode()->getMap(), _styleSheet.get() );
 
+        // Share state attributes with every other annotation so that
+        // compatible styles sort together and skip redundant applies.
+        session->setStateSetCache( Registry::stateSetCache() );
+
         FilterContext context( session, new FeatureProfile( _extent ), _extent, _index);
 
         _compiled = compiler.compile( clone, style, context );
@@ -211,7 +217,8 @@ FeatureNode::build()
                 SetDataVarianceVisitor sdv(osg::Object::DYNAMIC);
                 this->accept(sdv);
 
-                getMapNode()->getTerrain()->addTerrainCallback(_clampCallback.get());
+                // only tiles under the features need to re-clamp them
+                getMapNode()->getTerrain()->addTerrainCallback(_clampCallback.get(), _extent);
                 clamp(getMapNode()->getTerrain()->getGraph(), getMapNode()->getTerrain());
             }
             else
@@ -310,34 +317,32 @@ FeatureNode::onTileUpdate(const TileKey&          key,
                          osg::Node*              graph,
                          TerrainCallbackContext& context)
 {
-    if (!_clampDirty)
-    {
-        bool needsClamp;
+    bool needsClamp;
 
-        if (key.valid())
-        {
-            osg::Polytope tope;
-            key.getExtent().createPolytope(tope);
-            needsClamp = tope.contains(this->getBound());
-        }
-        else
-        {
-            // without a valid tilekey we don't know the extent of the change,
-            // so clamping is required.
-            needsClamp = true;
-        }
+    if (key.valid())
+    {
+        osg::Polytope tope;
+        key.getExtent().createPolytope(tope);
+        needsClamp = tope.contains(this->getBound());
+    }
+    else
+    {
+        // without a valid tilekey we don't know the extent of the change,
+        // so clamping is required.
+        needsClamp = true;
+    }
 
-        if (needsClamp)
-        {
-            _clampDirty = true;
-            ADJUST_UPDATE_TRAV_COUNT(this, +1);
-            //clamp(graph, context.getTerrain());
-        }
+    // Collect the changed tiles and re-clamp once, in the next update
+    // traversal, where they changed.
+    if (needsClamp && _clampRegion.add(key) && !_clampDirty)
+    {
+        _clampDirty = true;
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
     }
 }
 
 void
-FeatureNode::clamp(osg::Node* graph, const Terrain* terrain)
+FeatureNode::clamp(osg::Node* graph, const Terrain* terrain, const GeoExtent& region)
 {
     if ( terrain && graph )
     {
@@ -353,6 +358,10 @@ FeatureNode::clamp(osg::Node* graph, const Terrain* terrain)
         clamper.setTerrainSRS( terrain->getSRS() );
         clamper.setUseVertexZ( relative );
         clamper.setOffset( offset );
+        clamper.setRegion( region );
+
+        if ( _useElevationPool && getMapNode() )
+            clamper.setElevationPool( getMapNode()->getMap()->getElevationPool() );
 
         this->accept( clamper );
     }
@@ -367,10 +376,11 @@ FeatureNode::traverse(osg::NodeVisitor& nv)
         {
             osg::ref_ptr<Terrain> terrain = getMapNode()->getTerrain();
             if (terrain.valid())
-                clamp(terrain->getGraph(), terrain.get());
+                clamp(terrain->getGraph(), terrain.get(), _clampRegion.getExtent());
 
             ADJUST_UPDATE_TRAV_COUNT(this, -1);
             _clampDirty = false;
+            _clampRegion.reset();
         }
     }
     AnnotationNode::traverse(nv);
@@ -386,6 +396,7 @@ FeatureNode::FeatureNode(const Config&         conf,
                          const osgDB::Options* readOptions ) :
 AnnotationNode(conf, readOptions),
 _clampDirty(false),
+_useElevationPool(false),
 _index(0)
 {
     osg::ref_ptr<Geometry> geom;
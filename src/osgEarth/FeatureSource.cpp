@@ -18,12 +18,40 @@
  */
 #include <osgEarth/FeatureSource>
 #include <osgEarth/Filter>
+#include <osgEarth/FeatureBlob>
+#include <osgEarth/JobArena>
+#include <osgEarth/Cache>
+#include <osgEarth/StringUtils>
 
 #define LC "[FeatureSource] " << getName() << ": "
 
 using namespace osgEarth;
 using namespace OpenThreads;
 
+namespace
+{
+    // prefetched tiles not yet claimed by readTile(), per source
+    const unsigned MAX_PREFETCHED_TILES = 64u;
+
+    // Fetches one tile in the background. Holds only an observer so a
+    // source that closes before the job runs does not fetch anything.
+    struct PrefetchTileJob : public TaskRequest
+    {
+        PrefetchTileJob(FeatureSource* source, const TileKey& key) :
+            TaskRequest(-(float)key.getLOD()), _source(source), _key(key) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<FeatureSource> source;
+            if (_source.lock(source))
+                source->prefetchTile(_key, progress);
+        }
+
+        osg::observer_ptr<FeatureSource> _source;
+        TileKey _key;
+    };
+}
+
 //...................................................................
 
 Config
@@ -37,6 +65,8 @@ FeatureSource::Options::getConfig() const
     conf.set( "geo_interpolation", "rhumb_line",   geoInterp(), GEOINTERP_RHUMB_LINE );
     conf.set( "fid_attribute", fidAttribute() );
     conf.set( "rewind_polygons", rewindPolygons());
+    conf.set( "tile_cache_size_mb", tileCacheSizeMB());
+    conf.set( "tile_prefetch_radius", tilePrefetchRadius());
 
     if (!filters().empty())
     {
@@ -55,6 +85,8 @@ void
 FeatureSource::Options::fromConfig(const Config& conf)
 {
     _rewindPolygons.init(true);
+    _tileCacheSizeMB.init(0u);
+    _tilePrefetchRadius.init(1u);
 
     conf.get( "open_write",   openWrite() );
     conf.get( "profile",      profile() );
@@ -62,6 +94,8 @@ FeatureSource::Options::fromConfig(const Config& conf)
     conf.get( "geo_interpolation", "rhumb_line",   geoInterp(), GEOINTERP_RHUMB_LINE );
     conf.get( "fid_attribute", fidAttribute() );
     conf.get( "rewind_polygons", rewindPolygons());
+    conf.get( "tile_cache_size_mb", tileCacheSizeMB());
+    conf.get( "tile_prefetch_radius", tilePrefetchRadius());
 
 #if 0
     // For backwards-compatibility (before adding the "filters" block)
@@ -100,6 +134,8 @@ OE_LAYER_PROPERTY_IMPL(FeatureSource, bool, OpenWrite, openWrite);
 OE_LAYER_PROPERTY_IMPL(FeatureSource, GeoInterpolation, GeoInterpolation, geoInterp);
 OE_LAYER_PROPERTY_IMPL(FeatureSource, std::string, FIDAttribute, fidAttribute);
 OE_LAYER_PROPERTY_IMPL(FeatureSource, bool, RewindPolygons, rewindPolygons);
+OE_LAYER_PROPERTY_IMPL(FeatureSource, unsigned, TileCacheSizeMB, tileCacheSizeMB);
+OE_LAYER_PROPERTY_IMPL(FeatureSource, unsigned, TilePrefetchRadius, tilePrefetchRadius);
 
 void
 FeatureSource::init()
@@ -121,9 +157,239 @@ FeatureSource::openImplementation()
         return _filters->getStatus();
     }
 
+    _tileCache = 0L;
+    if (options().tileCacheSizeMB().get() > 0u)
+    {
+        _tileCache = new FeatureTileCache((size_t)options().tileCacheSizeMB().get() * 1048576u);
+    }
+
+    _cursorMetrics = Util::Metrics::layerHistograms(getName());
+
     return Status::NoError;
 }
 
+FeatureCursor*
+FeatureSource::createTileCursor(const Query& query, ProgressCallback* progress)
+{
+    OE_START_TIMER(fetch);
+
+    osg::ref_ptr<FeatureTileCache> cache = _tileCache.get();
+    FeatureCursor* cursor = cache.valid() ?
+        cache->createFeatureCursor(this, query, progress) :
+        createFeatureCursor(query, progress);
+
+    if (cursor && _cursorMetrics.fetch)
+        _cursorMetrics.fetch->sample(OE_GET_TIMER(fetch)*1000.0);
+
+    return cursor;
+}
+
+bool
+FeatureSource::readTile(const TileKey& key, FeatureList& output, ProgressCallback* progress)
+{
+    bool ok = false;
+    bool owner = false;
+    osg::ref_ptr<Threading::RefEvent> inflight;
+    {
+        Threading::ScopedMutexLock lock(_prefetchMutex);
+        ok = takePrefetched(key, output);
+        if (!ok)
+        {
+            TileEvents::iterator i = _tilesInFlight.find(key);
+            if (i != _tilesInFlight.end())
+            {
+                inflight = i->second.get();
+            }
+            else
+            {
+                // claim the tile so a prefetch doesn't request it again
+                inflight = new Threading::RefEvent();
+                _tilesInFlight[key] = inflight.get();
+                owner = true;
+            }
+        }
+    }
+
+    if (!ok && !owner)
+    {
+        // the tile is already on its way; wait for it
+        inflight->wait();
+        Threading::ScopedMutexLock lock(_prefetchMutex);
+        ok = takePrefetched(key, output);
+    }
+
+    if (!ok)
+    {
+        ok = loadTile(key, output, progress);
+    }
+
+    if (owner)
+    {
+        Threading::ScopedMutexLock lock(_prefetchMutex);
+        _tilesInFlight.erase(key);
+        inflight->set();
+    }
+
+    prefetchNeighbors(key);
+
+    return ok;
+}
+
+void
+FeatureSource::prefetchTile(const TileKey& key, ProgressCallback* progress)
+{
+    osg::ref_ptr<Threading::RefEvent> inflight = new Threading::RefEvent();
+    {
+        Threading::ScopedMutexLock lock(_prefetchMutex);
+        if (_tilesInFlight.find(key) != _tilesInFlight.end() ||
+            _tilesPrefetched.find(key) != _tilesPrefetched.end())
+        {
+            return;
+        }
+        _tilesInFlight[key] = inflight.get();
+    }
+
+    FeatureList features;
+    bool ok = loadTile(key, features, progress);
+
+    Threading::ScopedMutexLock lock(_prefetchMutex);
+    if (ok)
+    {
+        _tilesPrefetched[key].swap(features);
+        _tilesPrefetchedOrder.push_back(key);
+
+        // drop the oldest tiles nobody asked for
+        while (_tilesPrefetchedOrder.size() > MAX_PREFETCHED_TILES)
+        {
+            _tilesPrefetched.erase(_tilesPrefetchedOrder.front());
+            _tilesPrefetchedOrder.pop_front();
+        }
+    }
+    _tilesInFlight.erase(key);
+    inflight->set();
+}
+
+// call with _prefetchMutex held
+bool
+FeatureSource::takePrefetched(const TileKey& key, FeatureList& output)
+{
+    PrefetchedTiles::iterator i = _tilesPrefetched.find(key);
+    if (i == _tilesPrefetched.end())
+        return false;
+
+    output.splice(output.end(), i->second);
+    _tilesPrefetched.erase(i);
+    _tilesPrefetchedOrder.remove(key);
+    return true;
+}
+
+bool
+FeatureSource::loadTile(const TileKey& key, FeatureList& output, ProgressCallback* progress)
+{
+    CacheBin* bin = 0L;
+    CachePolicy policy;
+    CacheSettings* cacheSettings = getCacheSettings();
+    if (cacheSettings && cacheSettings->isCacheEnabled())
+    {
+        bin = cacheSettings->getCacheBin();
+        policy = cacheSettings->cachePolicy().get();
+    }
+
+    std::string cacheKey = Cache::makeCacheKey(
+        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
+        "features");
+
+    // parsed features from the cache skip the request and the parse:
+    if (bin && policy.isCacheReadable())
+    {
+        ReadResult r = bin->readString(cacheKey, 0L);
+        if (r.succeeded() && !policy.isExpired(r.lastModifiedTime()))
+        {
+            FeatureList cached;
+            if (FeatureBlob::decode(r.getString(), getFeatureProfile(), cached))
+            {
+                // the blacklist may have changed since the tile was cached
+                for (FeatureList::iterator i = cached.begin(); i != cached.end(); )
+                {
+                    if (isBlacklisted(i->get()->getFID()))
+                        i = cached.erase(i);
+                    else
+                        ++i;
+                }
+                output.splice(output.end(), cached);
+                return true;
+            }
+        }
+    }
+
+    if (policy.isCacheOnly())
+        return false;
+
+    FeatureList features;
+    if (!fetchTile(key, features, progress))
+        return false;
+
+    if (bin && policy.isCacheWriteable() && !(progress && progress->isCanceled()))
+    {
+        std::string blob;
+        FeatureBlob::encode(features, blob);
+        osg::ref_ptr<StringObject> object = new StringObject(blob);
+        bin->write(cacheKey, object.get(), 0L);
+    }
+
+    output.splice(output.end(), features);
+    return true;
+}
+
+void
+FeatureSource::prefetchNeighbors(const TileKey& key)
+{
+    int radius = (int)options().tilePrefetchRadius().get();
+    if (radius <= 0 || !isOpen())
+        return;
+
+    const FeatureProfile* fp = getFeatureProfile();
+    if (fp && fp->isTiled() &&
+        ((int)key.getLOD() < fp->getFirstLevel() || (int)key.getLOD() > fp->getMaxLevel()))
+    {
+        return;
+    }
+
+    unsigned tilesWide, tilesHigh;
+    key.getProfile()->getNumTiles(key.getLOD(), tilesWide, tilesHigh);
+
+    JobArena* arena = JobArena::get("oe.featureprefetch");
+
+    for (int dy = -radius; dy <= radius; ++dy)
+    {
+        for (int dx = -radius; dx <= radius; ++dx)
+        {
+            if (dx == 0 && dy == 0)
+                continue;
+
+            // don't wrap around at the poles
+            int y = (int)key.getTileY() + dy;
+            if (y < 0 || y >= (int)tilesHigh)
+                continue;
+
+            TileKey neighbor = key.createNeighborKey(dx, dy);
+            if (!neighbor.valid())
+                continue;
+
+            {
+                Threading::ScopedMutexLock lock(_prefetchMutex);
+                if (_tilesInFlight.find(neighbor) != _tilesInFlight.end() ||
+                    _tilesPrefetched.find(neighbor) != _tilesPrefetched.end())
+                {
+                    continue;
+                }
+            }
+
+            arena->dispatch(new PrefetchTileJob(this, neighbor));
+        }
+    }
+}
+
 const Status&
 FeatureSource::create(
     const FeatureProfile* profile,
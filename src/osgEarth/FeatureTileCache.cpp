@@ -0,0 +1,232 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/FeatureTileCache>
+#include <osgEarth/FeatureSource>
+
+#define LC "[FeatureTileCache] "
+
+using namespace osgEarth;
+using namespace OpenThreads;
+
+namespace
+{
+    // number of levels to search upwards for a cached ancestor
+    const unsigned MAX_ANCESTOR_LEVELS = 8u;
+
+    bool intersects2d(const Bounds& a, const Bounds& b)
+    {
+        return
+            a.xMin() <= b.xMax() && a.xMax() >= b.xMin() &&
+            a.yMin() <= b.yMax() && a.yMax() >= b.yMin();
+    }
+
+    bool sameBounds(const optional<Bounds>& a, const optional<Bounds>& b)
+    {
+        if (a.isSet() != b.isSet())
+            return false;
+        return !a.isSet() || (a->_min == b->_min && a->_max == b->_max);
+    }
+}
+
+FeatureTileCache::FeatureTileCache(size_t maxBytes) :
+_bytes(0u),
+_maxBytes(maxBytes)
+{
+    _stats._maxBytes = maxBytes;
+}
+
+size_t
+FeatureTileCache::getSizeInBytes(const Feature* feature)
+{
+    size_t bytes = sizeof(Feature);
+
+    if (feature->getGeometry())
+    {
+        bytes += sizeof(Geometry) + feature->getGeometry()->getTotalPointCount() * sizeof(osg::Vec3d);
+    }
+
+    for (AttributeTable::const_iterator i = feature->getAttrs().begin(); i != feature->getAttrs().end(); ++i)
+    {
+        bytes += 64u + i->first.size() + sizeof(AttributeValue) +
+            i->second.second.stringValue.size() +
+            i->second.second.doubleArrayValue.size() * sizeof(double);
+    }
+
+    return bytes;
+}
+
+bool
+FeatureTileCache::canUseAncestors(const FeatureSource* source, const TileKey& key) const
+{
+    // source-level filters might depend on the query extent (cropping, for example)
+    if (source->getFilters() && !source->getFilters()->empty())
+        return false;
+
+    const FeatureProfile* fp = source->getFeatureProfile();
+    if (!fp)
+        return false;
+
+    // an untiled source returns what intersects the query extent at any level;
+    // a tiled source can only be subdivided once it runs out of levels.
+    return !fp->isTiled() || (int)key.getLevelOfDetail() > fp->getMaxLevel();
+}
+
+FeatureCursor*
+FeatureTileCache::createFeatureCursor(FeatureSource* source, const Query& query, ProgressCallback* progress)
+{
+    if (!source ||
+        !query.tileKey().isSet() ||
+        query.expression().isSet() ||
+        query.orderby().isSet() ||
+        query.limit().isSet())
+    {
+        return source ? source->createFeatureCursor(query, progress) : 0L;
+    }
+
+    const TileKey& key = query.tileKey().get();
+
+    {
+        ScopedLock<Mutex> lock(_mutex);
+
+        Entries::iterator i = _entries.find(key);
+        if (i != _entries.end() && sameBounds(i->second._bounds, query.bounds()))
+        {
+            _lru.splice(_lru.begin(), _lru, i->second._lru);
+            ++_stats._hits;
+            return new FeatureListCursor(i->second._features, true);
+        }
+
+        if (canUseAncestors(source, key))
+        {
+            TileKey parent = key.createParentKey();
+            for (unsigned n = 0; n < MAX_ANCESTOR_LEVELS && parent.valid(); ++n, parent = parent.createParentKey())
+            {
+                Entries::iterator p = _entries.find(parent);
+                if (p == _entries.end())
+                    continue;
+
+                // ancestors with a narrower query than the tile can't be used
+                if (p->second._bounds.isSet() && query.bounds().isSet() &&
+                    !p->second._bounds->contains(query.bounds().get()))
+                    continue;
+
+                Bounds box = query.bounds().isSet() ?
+                    query.bounds().get() :
+                    key.getExtent().transform(source->getFeatureProfile()->getSRS()).bounds();
+
+                FeatureList features;
+                for (FeatureList::const_iterator f = p->second._features.begin(); f != p->second._features.end(); ++f)
+                {
+                    const Geometry* geom = f->get()->getGeometry();
+                    if (geom && intersects2d(geom->getBounds(), box))
+                    {
+                        features.push_back(f->get());
+                    }
+                }
+
+                _lru.splice(_lru.begin(), _lru, p->second._lru);
+                ++_stats._parentHits;
+
+                // cache the subset too, so the tile's own children search less
+                insert(key, query.bounds(), features);
+                return new FeatureListCursor(features, true);
+            }
+        }
+
+        ++_stats._misses;
+    }
+
+    // read the whole tile from the source, outside the lock:
+    osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(query, progress);
+    FeatureList features;
+    if (cursor.valid())
+    {
+        cursor->fill(features);
+    }
+
+    // don't cache partial results
+    if (progress && progress->isCanceled())
+    {
+        return new FeatureListCursor(features);
+    }
+
+    {
+        ScopedLock<Mutex> lock(_mutex);
+        insert(key, query.bounds(), features);
+    }
+
+    return new FeatureListCursor(features, true);
+}
+
+void
+FeatureTileCache::insert(const TileKey& key, const optional<Bounds>& bounds, FeatureList& features)
+{
+    size_t bytes = sizeof(Entry) + 64u;
+    for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+    {
+        bytes += getSizeInBytes(f->get());
+    }
+
+    // a tile that would take up most of the budget by itself is not worth keeping
+    if (bytes > _maxBytes / 2u)
+        return;
+
+    Entries::iterator i = _entries.find(key);
+    if (i != _entries.end())
+    {
+        _bytes -= i->second._bytes;
+        _lru.erase(i->second._lru);
+        _entries.erase(i);
+    }
+
+    while (_bytes + bytes > _maxBytes && !_lru.empty())
+    {
+        Entries::iterator victim = _entries.find(_lru.back());
+        _bytes -= victim->second._bytes;
+        _entries.erase(victim);
+        _lru.pop_back();
+        ++_stats._evictions;
+    }
+
+    Entry& entry = _entries[key];
+    entry._features = features;
+    entry._bounds = bounds;
+    entry._bytes = bytes;
+    entry._lru = _lru.insert(_lru.begin(), key);
+    _bytes += bytes;
+}
+
+void
+FeatureTileCache::clear()
+{
+    ScopedLock<Mutex> lock(_mutex);
+    _entries.clear();
+    _lru.clear();
+    _bytes = 0u;
+}
+
+FeatureTileCache::Stats
+FeatureTileCache::getStats() const
+{
+    ScopedLock<Mutex> lock(_mutex);
+    Stats stats = _stats;
+    stats._entries = _entries.size();
+    stats._bytes = _bytes;
+    return stats;
+}
@@ -18,6 +18,7 @@
  */
 #include <osgEarth/Filter>
 #include <osgEarth/FilterContext>
+#include <osgEarth/FeatureBatch>
 #include <osgEarth/LineSymbol>
 #include <osgEarth/PointSymbol>
 #include <osgEarth/ECEF>
@@ -40,6 +41,24 @@ FeatureFilter::~FeatureFilter()
 {
 }
 
+FilterContext
+FeatureFilter::push(FeatureBatch& input, FilterContext& context)
+{
+    FeatureList features;
+    input.toFeatures(features);
+
+    FilterContext output = push(features, context);
+
+    input.clear();
+    input.add(features);
+
+    // filters that reproject report the new SRS in the context
+    if (output.profile().valid())
+        input.setSRS(output.profile()->getSRS());
+
+    return output;
+}
+
 /********************************************************************************/
 
 #undef LC
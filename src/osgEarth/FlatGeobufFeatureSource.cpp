@@ -0,0 +1,1373 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/FlatGeobufFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <osgEarth/Filter>
+#include <osgEarth/HTTPClient>
+#include <osgEarth/StringUtils>
+#include <algorithm>
+#include <queue>
+#include <cstring>
+#include <cfloat>
+#include <climits>
+
+#define LC "[FlatGeobufFeatureSource] "
+
+using namespace osgEarth;
+using namespace osgEarth::FlatGeobuf;
+
+// FlatGeobuf stores everything little-endian; like PackedRTree, this
+// reader assumes a little-endian host.
+
+namespace
+{
+    // "fgb", major version 3, "fgb", patch version
+    const unsigned char s_magic[7] = { 0x66, 0x67, 0x62, 0x03, 0x66, 0x67, 0x62 };
+    const uint64_t      MAGIC_SIZE = 8u;
+
+    // sanity limit on the header size
+    const uint32_t      MAX_HEADER_SIZE = 10u * 1024u * 1024u;
+
+    // bytes per packed R-tree node: min x, min y, max x, max y, offset
+    const uint64_t      NODE_SIZE = 40u;
+
+    // Over HTTP, index nodes and features closer together than these
+    // gaps are read in one request rather than two:
+    const uint64_t      MAX_NODE_GAP    = 256u;
+    const uint64_t      MAX_FEATURE_GAP = 64u * 1024u;
+    const uint64_t      MAX_BLOCK_SIZE  = 4u * 1024u * 1024u;
+
+    const uint64_t      UNKNOWN = ~(uint64_t)0u;
+
+    // limit on nested geometry collections
+    const int           MAX_GEOMETRY_DEPTH = 16;
+
+    enum GeometryType
+    {
+        GT_UNKNOWN = 0,
+        GT_POINT,
+        GT_LINESTRING,
+        GT_POLYGON,
+        GT_MULTIPOINT,
+        GT_MULTILINESTRING,
+        GT_MULTIPOLYGON,
+        GT_GEOMETRYCOLLECTION
+    };
+
+    enum ColumnType
+    {
+        CT_BYTE = 0,
+        CT_UBYTE,
+        CT_BOOL,
+        CT_SHORT,
+        CT_USHORT,
+        CT_INT,
+        CT_UINT,
+        CT_LONG,
+        CT_ULONG,
+        CT_FLOAT,
+        CT_DOUBLE,
+        CT_STRING,
+        CT_JSON,
+        CT_DATETIME,
+        CT_BINARY
+    };
+
+    // field numbers in the FlatGeobuf schema:
+    namespace HeaderField   { enum { NAME = 0, ENVELOPE, GEOMETRY_TYPE, HAS_Z, HAS_M, HAS_T, HAS_TM, COLUMNS, FEATURES_COUNT, INDEX_NODE_SIZE, CRS }; }
+    namespace CrsField      { enum { ORG = 0, CODE, NAME, DESCRIPTION, WKT }; }
+    namespace ColumnField   { enum { NAME = 0, TYPE }; }
+    namespace FeatureField  { enum { GEOMETRY = 0, PROPERTIES, COLUMNS }; }
+    namespace GeometryField { enum { ENDS = 0, XY, Z, M, T, TM, TYPE, PARTS }; }
+
+    template<typename T>
+    inline T readLE(const char* ptr)
+    {
+        T value;
+        ::memcpy(&value, ptr, sizeof(T));
+        return value;
+    }
+
+    /**
+     * Read-only view of one FlatBuffers table. Every access is checked
+     * against the size of the buffer, so a damaged file yields missing
+     * fields instead of reads out of bounds.
+     */
+    class Table
+    {
+    public:
+        Table() : _buf(0L), _size(0u), _pos(0u), _vtable(0u), _vtableSize(0u) { }
+
+        //! The root table of a buffer
+        static Table root(const char* buf, uint64_t size)
+        {
+            if (size < 4u)
+                return Table();
+            return Table(buf, size, readLE<uint32_t>(buf));
+        }
+
+        bool valid() const { return _buf != 0L; }
+
+        //! Scalar field, or the default if absent
+        template<typename T>
+        T scalar(unsigned field, T defaultValue) const
+        {
+            uint64_t pos = position(field);
+            if (pos == 0u || pos + sizeof(T) > _size)
+                return defaultValue;
+            return readLE<T>(_buf + pos);
+        }
+
+        //! String field
+        bool string(unsigned field, std::string& output) const
+        {
+            uint64_t count;
+            const char* data;
+            if (!vector(field, 1u, count, data))
+                return false;
+            output.assign(data, count);
+            return true;
+        }
+
+        //! Vector field: number of elements and the first element
+        bool vector(unsigned field, uint64_t elementSize, uint64_t& count, const char*& data) const
+        {
+            count = 0u;
+            data = 0L;
+            uint64_t pos = indirect(field);
+            if (pos == 0u || pos + 4u > _size)
+                return false;
+            uint64_t n = readLE<uint32_t>(_buf + pos);
+            if (pos + 4u + n*elementSize > _size)
+                return false;
+            count = n;
+            data = _buf + pos + 4u;
+            return true;
+        }
+
+        //! Table field
+        Table table(unsigned field) const
+        {
+            uint64_t pos = indirect(field);
+            return pos != 0u ? Table(_buf, _size, pos) : Table();
+        }
+
+        //! Element of a vector of tables (as returned by vector() with elementSize 4)
+        Table element(const char* data, uint64_t i) const
+        {
+            uint64_t pos = (data - _buf) + 4u*i;
+            return Table(_buf, _size, pos + readLE<uint32_t>(_buf + pos));
+        }
+
+    private:
+        Table(const char* buf, uint64_t size, uint64_t pos) :
+            _buf(0L), _size(size), _pos(pos), _vtable(0u), _vtableSize(0u)
+        {
+            if (pos + 4u > size)
+                return;
+
+            int64_t vtable = (int64_t)pos - (int64_t)readLE<int32_t>(buf + pos);
+            if (vtable < 0 || (uint64_t)vtable + 4u > size)
+                return;
+
+            uint16_t vtableSize = readLE<uint16_t>(buf + vtable);
+            if ((uint64_t)vtable + vtableSize > size)
+                return;
+
+            _buf = buf;
+            _vtable = (uint64_t)vtable;
+            _vtableSize = vtableSize;
+        }
+
+        // position of a field in the buffer, or 0 if absent
+        uint64_t position(unsigned field) const
+        {
+            if (!_buf)
+                return 0u;
+            uint64_t entry = 4u + 2u*field;
+            if (entry + 2u > _vtableSize)
+                return 0u;
+            uint16_t offset = readLE<uint16_t>(_buf + _vtable + entry);
+            return offset != 0u ? _pos + offset : 0u;
+        }
+
+        // position of the object an offset field refers to, or 0 if absent
+        uint64_t indirect(unsigned field) const
+        {
+            uint64_t pos = position(field);
+            if (pos == 0u || pos + 4u > _size)
+                return 0u;
+            uint64_t target = pos + readLE<uint32_t>(_buf + pos);
+            return target < _size ? target : 0u;
+        }
+
+        const char* _buf;
+        uint64_t    _size;
+        uint64_t    _pos;
+        uint64_t    _vtable;
+        uint16_t    _vtableSize;
+    };
+
+    bool readColumns(const Table& table, unsigned field, std::vector<Dataset::Column>& output)
+    {
+        uint64_t count;
+        const char* data;
+        if (!table.vector(field, 4u, count, data))
+            return false;
+
+        output.resize(count);
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            Table column = table.element(data, i);
+            column.string(ColumnField::NAME, output[i].name);
+            output[i].type = column.scalar<uint8_t>(ColumnField::TYPE, CT_STRING);
+        }
+        return true;
+    }
+
+    // number of nodes at each level of a packed R-tree, leaves first
+    void levelSizes(uint64_t numItems, unsigned nodeSize, std::vector<uint64_t>& output)
+    {
+        uint64_t n = numItems;
+        output.push_back(n);
+        do
+        {
+            n = (n + nodeSize - 1u) / nodeSize;
+            output.push_back(n);
+        }
+        while (n != 1u);
+    }
+
+    inline void readPoints(
+        Geometry* output,
+        const char* xy, const char* z, uint64_t numZ,
+        uint64_t begin, uint64_t end)
+    {
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            output->push_back(osg::Vec3d(
+                readLE<double>(xy + 16u*i),
+                readLE<double>(xy + 16u*i + 8u),
+                i < numZ ? readLE<double>(z + 8u*i) : 0.0));
+        }
+    }
+
+    Geometry* decodeGeometry(const Table& g, unsigned type, bool rewindPolygons, int depth)
+    {
+        if (!g.valid() || depth > MAX_GEOMETRY_DEPTH)
+            return 0L;
+
+        if (type == GT_UNKNOWN)
+            type = g.scalar<uint8_t>(GeometryField::TYPE, GT_UNKNOWN);
+
+        // multipolygons and collections hold their parts as separate geometries:
+        if (type == GT_MULTIPOLYGON || type == GT_GEOMETRYCOLLECTION)
+        {
+            uint64_t numParts;
+            const char* parts;
+            if (!g.vector(GeometryField::PARTS, 4u, numParts, parts))
+                return 0L;
+
+            osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+            for (uint64_t i = 0; i < numParts; ++i)
+            {
+                Geometry* part = decodeGeometry(
+                    g.element(parts, i),
+                    type == GT_MULTIPOLYGON ? GT_POLYGON : GT_UNKNOWN,
+                    rewindPolygons,
+                    depth + 1);
+
+                if (part)
+                    multi->add(part);
+            }
+            return multi->getComponents().empty() ? 0L : multi.release();
+        }
+
+        uint64_t numXY, numZ, numEnds;
+        const char *xy, *z, *ends;
+        if (!g.vector(GeometryField::XY, 16u, numXY, xy) || numXY == 0u)
+            return 0L;
+        g.vector(GeometryField::Z, 8u, numZ, z);
+        g.vector(GeometryField::ENDS, 4u, numEnds, ends);
+
+        switch (type)
+        {
+        case GT_POINT:
+        {
+            Point* point = new Point(1);
+            readPoints(point, xy, z, numZ, 0u, 1u);
+            return point;
+        }
+
+        case GT_MULTIPOINT:
+        {
+            PointSet* points = new PointSet(numXY);
+            readPoints(points, xy, z, numZ, 0u, numXY);
+            return points;
+        }
+
+        case GT_LINESTRING:
+        {
+            LineString* line = new LineString(numXY);
+            readPoints(line, xy, z, numZ, 0u, numXY);
+            return line;
+        }
+
+        case GT_MULTILINESTRING:
+        {
+            if (numEnds <= 1u)
+            {
+                LineString* line = new LineString(numXY);
+                readPoints(line, xy, z, numZ, 0u, numXY);
+                return line;
+            }
+
+            osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+            uint64_t begin = 0u;
+            for (uint64_t e = 0; e < numEnds; ++e)
+            {
+                uint64_t end = std::min((uint64_t)readLE<uint32_t>(ends + 4u*e), numXY);
+                if (end > begin)
+                {
+                    LineString* line = new LineString(end - begin);
+                    readPoints(line, xy, z, numZ, begin, end);
+                    multi->add(line);
+                    begin = end;
+                }
+            }
+            return multi->getComponents().empty() ? 0L : multi.release();
+        }
+
+        case GT_POLYGON:
+        {
+            // the first ring is the boundary, the rest are holes:
+            Polygon* polygon = 0L;
+            uint64_t numRings = numEnds > 0u ? numEnds : 1u;
+            uint64_t begin = 0u;
+            for (uint64_t r = 0; r < numRings; ++r)
+            {
+                uint64_t end = numEnds > 0u ? std::min((uint64_t)readLE<uint32_t>(ends + 4u*r), numXY) : numXY;
+                if (end <= begin)
+                    continue;
+
+                if (!polygon)
+                {
+                    polygon = new Polygon(end - begin);
+                    readPoints(polygon, xy, z, numZ, begin, end);
+                    if (rewindPolygons)
+                    {
+                        polygon->open();
+                        polygon->rewind(Ring::ORIENTATION_CCW);
+                    }
+                }
+                else
+                {
+                    Ring* hole = new Ring(end - begin);
+                    readPoints(hole, xy, z, numZ, begin, end);
+                    if (rewindPolygons)
+                    {
+                        hole->open();
+                        hole->rewind(Ring::ORIENTATION_CW);
+                    }
+                    polygon->getHoles().push_back(hole);
+                }
+                begin = end;
+            }
+            return polygon;
+        }
+
+        default:
+            // curves, surfaces, and TINs are not supported
+            return 0L;
+        }
+    }
+
+    inline unsigned fixedSize(unsigned type)
+    {
+        switch (type)
+        {
+        case CT_BYTE: case CT_UBYTE: case CT_BOOL: return 1u;
+        case CT_SHORT: case CT_USHORT: return 2u;
+        case CT_INT: case CT_UINT: case CT_FLOAT: return 4u;
+        case CT_LONG: case CT_ULONG: case CT_DOUBLE: return 8u;
+        default: return 0u;
+        }
+    }
+
+    inline void setInteger(Feature* feature, const std::string& name, double value)
+    {
+        // Attributes hold 32-bit ints; wider values go in as doubles.
+        if (value >= (double)INT_MIN && value <= (double)INT_MAX)
+            feature->set(name, (int)value);
+        else
+            feature->set(name, value);
+    }
+
+    void decodeProperties(
+        const Table& f,
+        const std::vector<Dataset::Column>& columns,
+        const std::vector<bool>* keep,
+        Feature* feature)
+    {
+        uint64_t size;
+        const char* p;
+        if (!f.vector(FeatureField::PROPERTIES, 1u, size, p))
+            return;
+
+        // each property is a column index followed by its value:
+        uint64_t i = 0u;
+        while (i + 2u <= size)
+        {
+            uint16_t c = readLE<uint16_t>(p + i);
+            i += 2u;
+            if (c >= columns.size())
+                return;
+
+            const Dataset::Column& column = columns[c];
+            bool use = !keep || (*keep)[c];
+
+            unsigned width = fixedSize(column.type);
+            if (width > 0u)
+            {
+                if (i + width > size)
+                    return;
+
+                if (use)
+                {
+                    const char* v = p + i;
+                    switch (column.type)
+                    {
+                    case CT_BYTE:   feature->set(column.name, (int)readLE<int8_t>(v)); break;
+                    case CT_UBYTE:  feature->set(column.name, (int)readLE<uint8_t>(v)); break;
+                    case CT_BOOL:   feature->set(column.name, readLE<uint8_t>(v) != 0u); break;
+                    case CT_SHORT:  feature->set(column.name, (int)readLE<int16_t>(v)); break;
+                    case CT_USHORT: feature->set(column.name, (int)readLE<uint16_t>(v)); break;
+                    case CT_INT:    feature->set(column.name, (int)readLE<int32_t>(v)); break;
+                    case CT_UINT:   setInteger(feature, column.name, (double)readLE<uint32_t>(v)); break;
+                    case CT_LONG:   setInteger(feature, column.name, (double)readLE<int64_t>(v)); break;
+                    case CT_ULONG:  setInteger(feature, column.name, (double)readLE<uint64_t>(v)); break;
+                    case CT_FLOAT:  feature->set(column.name, (double)readLE<float>(v)); break;
+                    case CT_DOUBLE: feature->set(column.name, readLE<double>(v)); break;
+                    }
+                }
+                i += width;
+            }
+            else
+            {
+                // strings, JSON, date-times, and binary are length-prefixed
+                if (i + 4u > size)
+                    return;
+                uint64_t length = readLE<uint32_t>(p + i);
+                i += 4u;
+                if (i + length > size)
+                    return;
+
+                if (use && column.type != CT_BINARY)
+                    feature->set(column.name, std::string(p + i, length));
+                i += length;
+            }
+        }
+    }
+
+    // Decodes one size-prefixed feature.
+    Feature* decodeFeature(
+        const char* data,
+        uint64_t size,
+        const Dataset* dataset,
+        const SpatialReference* srs,
+        const std::vector<bool>* keep,
+        const Query* query,
+        bool rewindPolygons,
+        FeatureID fid)
+    {
+        if (!data || size < 4u)
+            return 0L;
+
+        uint64_t length = readLE<uint32_t>(data);
+        if (length + 4u > size)
+            return 0L;
+
+        Table f = Table::root(data + 4u, length);
+        if (!f.valid())
+            return 0L;
+
+        osg::ref_ptr<Geometry> geometry = decodeGeometry(
+            f.table(FeatureField::GEOMETRY),
+            dataset->_geometryType,
+            rewindPolygons,
+            0);
+
+        osg::ref_ptr<Feature> feature = new Feature(geometry.get(), srs, Style(), fid);
+
+        // a feature may carry its own columns in place of the header's:
+        std::vector<Dataset::Column> columns;
+        if (readColumns(f, FeatureField::COLUMNS, columns))
+        {
+            std::vector<bool> keepLocal(columns.size(), true);
+            if (query && query->attributes().isSet())
+            {
+                for (unsigned i = 0; i < columns.size(); ++i)
+                    keepLocal[i] = query->attributes()->find(columns[i].name) != query->attributes()->end();
+            }
+            decodeProperties(f, columns, &keepLocal, feature.get());
+        }
+        else
+        {
+            decodeProperties(f, dataset->_columns, keep, feature.get());
+        }
+
+        return feature.release();
+    }
+
+    inline bool validateGeometry(Geometry* geometry)
+    {
+        if (!geometry || !geometry->isValid())
+            return false;
+
+        for (Geometry::iterator i = geometry->begin(); i != geometry->end(); ++i)
+        {
+            if (osg::isNaN(i->z()))
+                i->z() = 0.0;
+            if (!i->valid())
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Decodes the features the index (or a scan) located, a chunk at a
+     * time. Mapped files decode in place; remote features are fetched in
+     * blocks that cover runs of nearby features.
+     */
+    class FlatGeobufFeatureCursor : public FeatureCursor
+    {
+    public:
+        FlatGeobufFeatureCursor(
+            const Dataset*            dataset,
+            std::vector<Dataset::Hit>& hits,
+            std::string&              block,
+            const optional<Bounds>&   scanBounds,
+            const FeatureSource*      source,
+            const FeatureProfile*     profile,
+            const Query&              query,
+            const FeatureFilterChain* filters,
+            bool                      rewindPolygons,
+            ProgressCallback*         progress) :
+
+            FeatureCursor(progress),
+            _dataset(dataset),
+            _scanBounds(scanBounds),
+            _source(source),
+            _profile(profile),
+            _query(query),
+            _filters(filters),
+            _rewindPolygons(rewindPolygons),
+            _chunkSize(500u),
+            _next(0u),
+            _blockOffset(0u),
+            _blockToEnd(false),
+            _remaining(query.limit().isSet() ? (uint64_t)std::max(query.limit().get(), 0) : UNKNOWN)
+        {
+            _hits.swap(hits);
+
+            // a remote scan hands over the whole features section
+            if (!block.empty())
+            {
+                _block.swap(block);
+                _blockOffset = dataset->_featuresOffset;
+                _blockToEnd = true;
+            }
+
+            if (_query.attributes().isSet())
+            {
+                _keep.resize(dataset->_columns.size());
+                for (unsigned i = 0; i < dataset->_columns.size(); ++i)
+                    _keep[i] = _query.attributes()->find(dataset->_columns[i].name) != _query.attributes()->end();
+            }
+
+            readChunk();
+        }
+
+    public: // FeatureCursor
+
+        bool hasMore() const
+        {
+            return !_queue.empty();
+        }
+
+        Feature* nextFeature()
+        {
+            if (!hasMore())
+                return 0L;
+
+            if (_queue.size() == 1u)
+                readChunk();
+
+            _lastFeatureReturned = _queue.front();
+            _queue.pop();
+            return _lastFeatureReturned.get();
+        }
+
+        unsigned nextBatch(FeatureList& output, unsigned maxFeatures)
+        {
+            unsigned count = 0u;
+            while (count < maxFeatures && hasMore())
+            {
+                while (count < maxFeatures && !_queue.empty())
+                {
+                    output.push_back(_queue.front());
+                    _queue.pop();
+                    ++count;
+                }
+
+                if (_queue.empty())
+                    readChunk();
+            }
+            return count;
+        }
+
+    private:
+        osg::ref_ptr<const Dataset> _dataset;
+        std::vector<Dataset::Hit> _hits;
+        optional<Bounds> _scanBounds;
+        osg::ref_ptr<const FeatureSource> _source;
+        osg::ref_ptr<const FeatureProfile> _profile;
+        Query _query;
+        osg::ref_ptr<const FeatureFilterChain> _filters;
+        bool _rewindPolygons;
+        unsigned _chunkSize;
+        std::vector<bool> _keep;
+        std::queue< osg::ref_ptr<Feature> > _queue;
+        osg::ref_ptr<Feature> _lastFeatureReturned;
+        std::size_t _next;
+        std::string _block;
+        uint64_t _blockOffset;
+        bool _blockToEnd;
+        uint64_t _remaining;
+
+        // bytes of the hit _next-1, fetching a new block if necessary
+        const char* bytes(const Dataset::Hit& hit, uint64_t& size)
+        {
+            if (_dataset->isMapped())
+            {
+                size = hit.end - hit.offset;
+                return _dataset->read(hit.offset, size, _block, _progress.get());
+            }
+
+            uint64_t blockEnd = _blockOffset + _block.size();
+            if (!_block.empty() &&
+                hit.offset >= _blockOffset &&
+                (hit.end == UNKNOWN ? _blockToEnd : hit.end <= blockEnd))
+            {
+                size = (hit.end == UNKNOWN ? blockEnd : hit.end) - hit.offset;
+                return _block.data() + (hit.offset - _blockOffset);
+            }
+
+            // read this feature along with those that follow closely:
+            uint64_t end = hit.end;
+            for (std::size_t i = _next; i < _hits.size() && end != UNKNOWN; ++i)
+            {
+                const Dataset::Hit& h = _hits[i];
+                if (h.offset - end > MAX_FEATURE_GAP || h.offset - hit.offset > MAX_BLOCK_SIZE)
+                    break;
+                end = h.end;
+            }
+
+            const char* data = _dataset->read(
+                hit.offset,
+                end == UNKNOWN ? UNKNOWN : end - hit.offset,
+                _block,
+                _progress.get());
+
+            if (!data)
+            {
+                _block.clear();
+                return 0L;
+            }
+
+            _blockOffset = hit.offset;
+            _blockToEnd = (end == UNKNOWN);
+            size = (hit.end == UNKNOWN ? _blockOffset + _block.size() : hit.end) - hit.offset;
+            return data;
+        }
+
+        void readChunk()
+        {
+            const SpatialReference* srs = _profile.valid() ? _profile->getSRS() : 0L;
+
+            while (_queue.size() < _chunkSize && _next < _hits.size() && _remaining > 0u)
+            {
+                FeatureList filterList;
+                while (filterList.size() < _chunkSize && _next < _hits.size() && _remaining > 0u)
+                {
+                    if (_progress.valid() && _progress->isCanceled())
+                    {
+                        _next = _hits.size();
+                        break;
+                    }
+
+                    const Dataset::Hit& hit = _hits[_next++];
+
+                    if (_source.valid() && _source->isBlacklisted(hit.index))
+                        continue;
+
+                    uint64_t size = 0u;
+                    const char* data = bytes(hit, size);
+
+                    osg::ref_ptr<Feature> feature = decodeFeature(
+                        data, size,
+                        _dataset.get(),
+                        srs,
+                        _keep.empty() ? 0L : &_keep,
+                        &_query,
+                        _rewindPolygons,
+                        hit.index);
+
+                    if (!feature.valid() || !validateGeometry(feature->getGeometry()))
+                    {
+                        OE_DEBUG << LC << "Skipping invalid feature " << hit.index << std::endl;
+                        continue;
+                    }
+
+                    // a scan has no index to do the spatial test:
+                    if (_scanBounds.isSet())
+                    {
+                        Bounds b = feature->getGeometry()->getBounds();
+                        if (b.xMax() < _scanBounds->xMin() || b.yMax() < _scanBounds->yMin() ||
+                            b.xMin() > _scanBounds->xMax() || b.yMin() > _scanBounds->yMax())
+                        {
+                            continue;
+                        }
+                    }
+
+                    filterList.push_back(feature.get());
+                    if (_remaining != UNKNOWN)
+                        --_remaining;
+                }
+
+                // preprocess the features using the filter list:
+                if (_filters.valid() && !_filters->empty() && _profile.valid())
+                {
+                    FilterContext cx;
+                    cx.setProfile(_profile.get());
+                    if (_query.bounds().isSet())
+                        cx.extent() = GeoExtent(_profile->getSRS(), _query.bounds().get());
+                    else
+                        cx.extent() = _profile->getExtent();
+
+                    for (FeatureFilterChain::const_iterator i = _filters->begin(); i != _filters->end(); ++i)
+                    {
+                        FeatureFilter* filter = i->get();
+                        cx = filter->push(filterList, cx);
+                    }
+                }
+
+                for (FeatureList::const_iterator i = filterList.begin(); i != filterList.end(); ++i)
+                {
+                    _queue.push(i->get());
+                }
+            }
+        }
+    };
+}
+
+//........................................................................
+
+Dataset::Dataset() :
+_hasEnvelope   ( false ),
+_geometryType  ( GT_UNKNOWN ),
+_hasZ          ( false ),
+_featuresCount ( 0u ),
+_indexNodeSize ( 0u ),
+_crsCode       ( 0 ),
+_indexOffset   ( 0u ),
+_featuresOffset( 0u ),
+_numNodes      ( 0u )
+{
+    _envelope[0] = _envelope[1] = _envelope[2] = _envelope[3] = 0.0;
+}
+
+Dataset::~Dataset()
+{
+    //nop
+}
+
+Status
+Dataset::open(const URI& uri, const osgDB::Options* readOptions)
+{
+    _url = uri.full();
+    _readOptions = readOptions;
+
+    std::string storage;
+    const char* prefix = 0L;
+
+    if (uri.isRemote())
+    {
+        prefix = read(0u, MAGIC_SIZE + 4u, storage, 0L);
+        if (!prefix)
+            return Status(Status::ResourceUnavailable, Stringify() << "Failed to read \"" << _url << "\"");
+    }
+    else
+    {
+        if (!_file.open(_url) || _file.size() < MAGIC_SIZE + 4u)
+            return Status(Status::ResourceUnavailable, Stringify() << "Failed to open \"" << _url << "\"");
+        prefix = _file.data();
+    }
+
+    if (::memcmp(prefix, s_magic, sizeof(s_magic)) != 0)
+        return Status(Status::ResourceUnavailable, Stringify() << "\"" << _url << "\" is not a FlatGeobuf (version 3) file");
+
+    uint32_t headerSize = readLE<uint32_t>(prefix + MAGIC_SIZE);
+    if (headerSize == 0u || headerSize > MAX_HEADER_SIZE)
+        return Status(Status::ResourceUnavailable, Stringify() << "Invalid header in \"" << _url << "\"");
+
+    const char* header = read(MAGIC_SIZE + 4u, headerSize, storage, 0L);
+    if (!header || !parseHeader(header, headerSize))
+        return Status(Status::ResourceUnavailable, Stringify() << "Invalid header in \"" << _url << "\"");
+
+    // the index follows the header, then the features:
+    _indexOffset = MAGIC_SIZE + 4u + headerSize;
+    _featuresOffset = _indexOffset;
+    _levelStarts.clear();
+    _numNodes = 0u;
+
+    if (_indexNodeSize > 0u && _featuresCount > 0u)
+    {
+        std::vector<uint64_t> sizes;
+        levelSizes(_featuresCount, _indexNodeSize, sizes);
+
+        for (unsigned i = 0; i < sizes.size(); ++i)
+            _numNodes += sizes[i];
+
+        // levels are stored root first, so the leaves come last:
+        uint64_t start = _numNodes;
+        for (unsigned i = 0; i < sizes.size(); ++i)
+        {
+            start -= sizes[i];
+            _levelStarts.push_back(start);
+        }
+
+        _featuresOffset = _indexOffset + _numNodes*NODE_SIZE;
+
+        if (isMapped() && _featuresOffset > _file.size())
+            return Status(Status::ResourceUnavailable, Stringify() << "Truncated index in \"" << _url << "\"");
+
+        // without an envelope in the header, the root node has the extent:
+        if (!_hasEnvelope)
+        {
+            const char* root = 0L;
+            if (readNodes(0u, 1u, storage, root, 0L))
+            {
+                for (unsigned i = 0; i < 4; ++i)
+                    _envelope[i] = readLE<double>(root + 8u*i);
+                _hasEnvelope = true;
+            }
+        }
+    }
+    else
+    {
+        _indexNodeSize = 0u;
+    }
+
+    return Status::NoError;
+}
+
+bool
+Dataset::parseHeader(const char* data, uint64_t size)
+{
+    Table header = Table::root(data, size);
+    if (!header.valid())
+        return false;
+
+    header.string(HeaderField::NAME, _name);
+
+    uint64_t count;
+    const char* envelope;
+    if (header.vector(HeaderField::ENVELOPE, 8u, count, envelope) && count >= 4u)
+    {
+        for (unsigned i = 0; i < 4; ++i)
+            _envelope[i] = readLE<double>(envelope + 8u*i);
+        _hasEnvelope = true;
+    }
+
+    _geometryType  = header.scalar<uint8_t>(HeaderField::GEOMETRY_TYPE, GT_UNKNOWN);
+    _hasZ          = header.scalar<uint8_t>(HeaderField::HAS_Z, 0u) != 0u;
+    _featuresCount = header.scalar<uint64_t>(HeaderField::FEATURES_COUNT, 0u);
+    _indexNodeSize = header.scalar<uint16_t>(HeaderField::INDEX_NODE_SIZE, 16u);
+
+    // a node size of 1 cannot form a tree
+    if (_indexNodeSize == 1u)
+        return false;
+
+    readColumns(header, HeaderField::COLUMNS, _columns);
+
+    Table crs = header.table(HeaderField::CRS);
+    if (crs.valid())
+    {
+        crs.string(CrsField::ORG, _crsOrg);
+        _crsCode = crs.scalar<int32_t>(CrsField::CODE, 0);
+        crs.string(CrsField::WKT, _crsWKT);
+    }
+
+    return true;
+}
+
+const char*
+Dataset::read(uint64_t offset, uint64_t size, std::string& storage, ProgressCallback* progress) const
+{
+    if (isMapped())
+    {
+        if (offset > _file.size())
+            return 0L;
+        if (size != UNKNOWN && size > _file.size() - offset)
+            return 0L;
+        return _file.data() + offset;
+    }
+
+    if (_url.empty())
+        return 0L;
+
+    HTTPRequest request(_url);
+    if (size == UNKNOWN)
+        request.addHeader("Range", Stringify() << "bytes=" << offset << "-");
+    else if (size > 0u)
+        request.addHeader("Range", Stringify() << "bytes=" << offset << "-" << (offset + size - 1u));
+    else
+        return 0L;
+
+    HTTPResponse response = HTTPClient::get(request, _readOptions.get(), progress);
+    if (response.getCodeCategory() != HTTPResponse::CATEGORY_SUCCESS || response.getNumParts() == 0u)
+        return 0L;
+
+    storage = response.getPartAsString(0);
+
+    // a server that ignores the range returns the whole file
+    if (response.getCode() == HTTPResponse::OK)
+    {
+        if (storage.size() < offset)
+            return 0L;
+        storage.erase(0, offset);
+    }
+
+    if (size != UNKNOWN)
+    {
+        if (storage.size() < size)
+            return 0L;
+        storage.resize(size);
+    }
+
+    return storage.empty() ? 0L : storage.data();
+}
+
+bool
+Dataset::readNodes(uint64_t first, uint64_t count, std::string& storage, const char*& nodes, ProgressCallback* progress) const
+{
+    nodes = read(_indexOffset + first*NODE_SIZE, count*NODE_SIZE, storage, progress);
+    return nodes != 0L;
+}
+
+bool
+Dataset::search(double xmin, double ymin, double xmax, double ymax,
+                std::vector<Hit>& output,
+                ProgressCallback* progress) const
+{
+    if (_indexNodeSize == 0u)
+        return false;
+
+    if (_numNodes == 0u)
+        return true;
+
+    // Walk the tree a level at a time, so that over HTTP each level costs
+    // a few requests covering the runs of nodes it needs.
+    std::string storage;
+    std::vector<uint64_t> groups(1, 0u); // first node of each set of siblings to test
+    std::vector<uint64_t> next;
+
+    for (int level = (int)_levelStarts.size() - 1; level >= 0 && !groups.empty(); --level)
+    {
+        bool leaves = (level == 0);
+        uint64_t levelEnd = leaves ? _numNodes : _levelStarts[level - 1];
+
+        next.clear();
+
+        std::size_t g = 0u;
+        while (g < groups.size())
+        {
+            uint64_t first = groups[g];
+            uint64_t last = std::min(first + _indexNodeSize, levelEnd);
+
+            std::size_t h = g + 1u;
+            while (h < groups.size() && groups[h] <= last + MAX_NODE_GAP)
+            {
+                last = std::min(groups[h] + _indexNodeSize, levelEnd);
+                ++h;
+            }
+
+            // for leaves, one more node gives the end of the last feature:
+            uint64_t count = last - first + (leaves && last < levelEnd ? 1u : 0u);
+
+            const char* nodes = 0L;
+            if (!readNodes(first, count, storage, nodes, progress))
+                return false;
+
+            for (std::size_t k = g; k < h; ++k)
+            {
+                uint64_t end = std::min(groups[k] + _indexNodeSize, levelEnd);
+                for (uint64_t pos = groups[k]; pos < end; ++pos)
+                {
+                    const char* node = nodes + (pos - first)*NODE_SIZE;
+                    if (xmax < readLE<double>(node)      || ymax < readLE<double>(node + 8u) ||
+                        xmin > readLE<double>(node + 16u) || ymin > readLE<double>(node + 24u))
+                    {
+                        continue;
+                    }
+
+                    uint64_t offset = readLE<uint64_t>(node + 32u);
+
+                    if (leaves)
+                    {
+                        Hit hit;
+                        hit.offset = _featuresOffset + offset;
+                        hit.index = pos - _levelStarts[0];
+                        hit.end =
+                            pos + 1u < levelEnd ? _featuresOffset + readLE<uint64_t>(node + NODE_SIZE + 32u) :
+                            isMapped() ? _file.size() :
+                            UNKNOWN;
+                        output.push_back(hit);
+                    }
+                    else
+                    {
+                        next.push_back(offset);
+                    }
+                }
+            }
+
+            g = h;
+        }
+
+        groups.swap(next);
+    }
+
+    return true;
+}
+
+bool
+Dataset::scan(std::vector<Hit>& output, std::string& storage, ProgressCallback* progress) const
+{
+    const char* data = read(_featuresOffset, UNKNOWN, storage, progress);
+    if (!data)
+        return isMapped() && _featuresOffset == _file.size(); // empty file
+
+    uint64_t size = isMapped() ? _file.size() - _featuresOffset : storage.size();
+
+    uint64_t pos = 0u;
+    for (uint64_t index = 0u; pos + 4u <= size; ++index)
+    {
+        uint64_t length = readLE<uint32_t>(data + pos);
+        if (pos + 4u + length > size)
+            break;
+
+        Hit hit;
+        hit.offset = _featuresOffset + pos;
+        hit.end = hit.offset + 4u + length;
+        hit.index = index;
+        output.push_back(hit);
+
+        pos += 4u + length;
+    }
+
+    return true;
+}
+
+bool
+Dataset::locate(uint64_t index, Hit& output, ProgressCallback* progress) const
+{
+    if (_indexNodeSize == 0u || index >= _featuresCount)
+        return false;
+
+    // leaf nodes are in feature order:
+    uint64_t pos = _levelStarts[0] + index;
+    uint64_t count = pos + 1u < _numNodes ? 2u : 1u;
+
+    std::string storage;
+    const char* nodes = 0L;
+    if (!readNodes(pos, count, storage, nodes, progress))
+        return false;
+
+    output.offset = _featuresOffset + readLE<uint64_t>(nodes + 32u);
+    output.end =
+        count == 2u ? _featuresOffset + readLE<uint64_t>(nodes + NODE_SIZE + 32u) :
+        isMapped() ? _file.size() :
+        UNKNOWN;
+    output.index = index;
+    return true;
+}
+
+//........................................................................
+
+Config
+FlatGeobufFeatureSource::Options::getConfig() const
+{
+    Config conf = FeatureSource::Options::getConfig();
+    conf.set("url", _url);
+    return conf;
+}
+
+void
+FlatGeobufFeatureSource::Options::fromConfig(const Config& conf)
+{
+    conf.get("url", _url);
+}
+
+//........................................................................
+
+REGISTER_OSGEARTH_LAYER(flatgeobuffeatures, FlatGeobufFeatureSource);
+
+OE_LAYER_PROPERTY_IMPL(FlatGeobufFeatureSource, URI, URL, url);
+
+void
+FlatGeobufFeatureSource::init()
+{
+    FeatureSource::init();
+    _geometryType = Geometry::TYPE_UNKNOWN;
+}
+
+Status
+FlatGeobufFeatureSource::openImplementation()
+{
+    Status parent = FeatureSource::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    if (!options().url().isSet())
+    {
+        return Status(Status::ConfigurationError, "No URL provided");
+    }
+
+    osg::ref_ptr<Dataset> dataset = new Dataset();
+    Status status = dataset->open(options().url().get(), getReadOptions());
+    if (status.isError())
+        return status;
+
+    FeatureProfile* featureProfile = 0L;
+
+    // a custom profile overrides the file's SRS and extent:
+    if (options().profile().isSet())
+    {
+        osg::ref_ptr<const Profile> profile = Profile::create(*options().profile());
+        if (profile.valid())
+        {
+            featureProfile = new FeatureProfile(profile->getExtent());
+        }
+    }
+
+    if (!featureProfile)
+    {
+        osg::ref_ptr<SpatialReference> srs;
+        if (dataset->_crsCode > 0)
+        {
+            std::string org = dataset->_crsOrg.empty() ? "epsg" : toLower(dataset->_crsOrg);
+            srs = SpatialReference::create(Stringify() << org << ":" << dataset->_crsCode);
+        }
+        if (!srs.valid() && !dataset->_crsWKT.empty())
+        {
+            srs = SpatialReference::create(dataset->_crsWKT);
+        }
+        if (!srs.valid() && dataset->_crsCode <= 0 && dataset->_crsWKT.empty())
+        {
+            // no CRS in the file; assume geographic coordinates
+            srs = SpatialReference::create("wgs84");
+        }
+        if (!srs.valid())
+        {
+            return Status(Status::ResourceUnavailable, Stringify() << "Unrecognized SRS found in \"" << options().url()->full() << "\"");
+        }
+
+        if (!dataset->_hasEnvelope)
+        {
+            return Status(Status::ResourceUnavailable, Stringify() << "No extent found in \"" << options().url()->full() << "\"");
+        }
+
+        GeoExtent extent(
+            srs.get(),
+            dataset->_envelope[0], dataset->_envelope[1],
+            dataset->_envelope[2], dataset->_envelope[3]);
+
+        if (!extent.isValid())
+        {
+            return Status(Status::ResourceUnavailable, Stringify() << "Invalid extent found in \"" << options().url()->full() << "\"");
+        }
+
+        featureProfile = new FeatureProfile(extent);
+    }
+
+    if (options().geoInterp().isSet())
+    {
+        featureProfile->geoInterp() = options().geoInterp().get();
+    }
+    setFeatureProfile(featureProfile);
+
+    // establish the feature schema:
+    _schema.clear();
+    for (unsigned i = 0; i < dataset->_columns.size(); ++i)
+    {
+        const Dataset::Column& column = dataset->_columns[i];
+        switch (column.type)
+        {
+        case CT_BOOL:
+            _schema[column.name] = ATTRTYPE_BOOL; break;
+        case CT_BYTE: case CT_UBYTE: case CT_SHORT: case CT_USHORT:
+        case CT_INT: case CT_UINT: case CT_LONG: case CT_ULONG:
+            _schema[column.name] = ATTRTYPE_INT; break;
+        case CT_FLOAT: case CT_DOUBLE:
+            _schema[column.name] = ATTRTYPE_DOUBLE; break;
+        case CT_STRING: case CT_JSON: case CT_DATETIME:
+            _schema[column.name] = ATTRTYPE_STRING; break;
+        default:
+            break;
+        }
+    }
+
+    // and the geometry type:
+    switch (dataset->_geometryType)
+    {
+    case GT_POINT:           _geometryType = Geometry::TYPE_POINT; break;
+    case GT_MULTIPOINT:      _geometryType = Geometry::TYPE_POINTSET; break;
+    case GT_LINESTRING:      _geometryType = Geometry::TYPE_LINESTRING; break;
+    case GT_POLYGON:         _geometryType = Geometry::TYPE_POLYGON; break;
+    case GT_MULTILINESTRING:
+    case GT_MULTIPOLYGON:
+    case GT_GEOMETRYCOLLECTION: _geometryType = Geometry::TYPE_MULTI; break;
+    default:                 _geometryType = Geometry::TYPE_UNKNOWN; break;
+    }
+
+    _dataset = dataset.get();
+
+    OE_INFO << LC << getName() << " : opened " << dataset->_featuresCount << " features"
+        << (dataset->_indexNodeSize > 0u ? " (indexed)" : " (no index)")
+        << (dataset->isMapped() ? ", mapped" : ", remote") << std::endl;
+
+    return Status::NoError;
+}
+
+Status
+FlatGeobufFeatureSource::closeImplementation()
+{
+    // open cursors keep the dataset (and its mapping) alive until they finish
+    _dataset = 0L;
+    return FeatureSource::closeImplementation();
+}
+
+FeatureCursor*
+FlatGeobufFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* progress)
+{
+    osg::ref_ptr<Dataset> dataset = _dataset.get();
+    if (!dataset.valid())
+        return 0L;
+
+    // extent of the query in the feature SRS:
+    optional<Bounds> bounds;
+    if (query.bounds().isSet())
+    {
+        bounds = query.bounds().get();
+    }
+    else if (query.tileKey().isSet())
+    {
+        bounds = query.tileKey()->getExtent().transform(getFeatureProfile()->getSRS()).bounds();
+    }
+
+    std::vector<Dataset::Hit> hits;
+    std::string block;
+    optional<Bounds> scanBounds;
+
+    if (dataset->_indexNodeSize > 0u)
+    {
+        bool ok = bounds.isSet() ?
+            dataset->search(bounds->xMin(), bounds->yMin(), bounds->xMax(), bounds->yMax(), hits, progress) :
+            dataset->search(-DBL_MAX, -DBL_MAX, DBL_MAX, DBL_MAX, hits, progress);
+
+        if (!ok)
+            return 0L;
+    }
+    else
+    {
+        if (!dataset->scan(hits, block, progress))
+            return 0L;
+
+        scanBounds = bounds;
+    }
+
+    Query cursorQuery(query);
+    if (bounds.isSet())
+        cursorQuery.bounds() = bounds.get();
+
+    return new FlatGeobufFeatureCursor(
+        dataset.get(),
+        hits,
+        block,
+        scanBounds,
+        this,
+        getFeatureProfile(),
+        cursorQuery,
+        getFilters(),
+        options().rewindPolygons().get(),
+        progress);
+}
+
+int
+FlatGeobufFeatureSource::getFeatureCount() const
+{
+    return _dataset.valid() ? (int)_dataset->_featuresCount : -1;
+}
+
+bool
+FlatGeobufFeatureSource::supportsGetFeature() const
+{
+    return _dataset.valid() && _dataset->_indexNodeSize > 0u;
+}
+
+Feature*
+FlatGeobufFeatureSource::getFeature(FeatureID fid)
+{
+    osg::ref_ptr<Dataset> dataset = _dataset.get();
+    if (!dataset.valid() || isBlacklisted(fid))
+        return 0L;
+
+    Dataset::Hit hit;
+    if (!dataset->locate(fid, hit, 0L))
+        return 0L;
+
+    std::string storage;
+    const char* data = dataset->read(
+        hit.offset,
+        hit.end == UNKNOWN ? UNKNOWN : hit.end - hit.offset,
+        storage,
+        0L);
+
+    uint64_t size = hit.end == UNKNOWN ? storage.size() : hit.end - hit.offset;
+
+    return decodeFeature(
+        data, size,
+        dataset.get(),
+        getFeatureProfile() ? getFeatureProfile()->getSRS() : 0L,
+        0L,
+        0L,
+        options().rewindPolygons().get(),
+        fid);
+}
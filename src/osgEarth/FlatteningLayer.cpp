@@ -307,6 +307,8 @@ namespace
         osg::Vec3d A;   // endpoint of segment
         osg::Vec3d B;   // other endpoint of segment;
         double T;       // segment parameter of closest point
+        float elevA;    // source elevation at A
+        float elevB;    // source elevation at B
 
         // used later:
         float elevPROJ; // elevation at point on segment
@@ -373,6 +375,70 @@ namespace
         return samples.size() > 0 ? (numer / (double)(samples.size())) : FLT_MAX;
     }
 
+    // A line segment that may flatten the terrain, with its flattening radii and
+    // the source elevations at its endpoints.
+    struct Segment {
+        osg::Vec3d A;
+        osg::Vec3d B;
+        double innerRadius;
+        double outerRadius;
+        float elevA;
+        float elevB;
+    };
+
+    typedef std::vector<Segment> Segments;
+
+    /**
+     * Uniform grid over the sample points of one heightfield. Each cell lists
+     * the segments whose flattening area overlaps it (in segment order), so a
+     * sample point only has to test the segments near it.
+     */
+    struct SegmentGrid
+    {
+        SegmentGrid(const Segments& segments, const osg::BoundingBoxd& bounds, unsigned dim) :
+            _bounds(bounds), _dim(dim), _cells(dim*dim)
+        {
+            _cellWidth = osg::maximum((bounds.xMax() - bounds.xMin()) / (double)dim, 1e-9);
+            _cellHeight = osg::maximum((bounds.yMax() - bounds.yMin()) / (double)dim, 1e-9);
+
+            for (unsigned s = 0; s < segments.size(); ++s)
+            {
+                const Segment& seg = segments[s];
+                unsigned c0 = col(osg::minimum(seg.A.x(), seg.B.x()) - seg.outerRadius);
+                unsigned c1 = col(osg::maximum(seg.A.x(), seg.B.x()) + seg.outerRadius);
+                unsigned r0 = row(osg::minimum(seg.A.y(), seg.B.y()) - seg.outerRadius);
+                unsigned r1 = row(osg::maximum(seg.A.y(), seg.B.y()) + seg.outerRadius);
+
+                for (unsigned r = r0; r <= r1; ++r)
+                    for (unsigned c = c0; c <= c1; ++c)
+                        _cells[r*_dim + c].push_back(s);
+            }
+        }
+
+        const std::vector<unsigned>& get(const osg::Vec3d& P) const
+        {
+            return _cells[row(P.y())*_dim + col(P.x())];
+        }
+
+        unsigned col(double x) const
+        {
+            return (unsigned)clamp(floor((x - _bounds.xMin()) / _cellWidth), 0.0, (double)(_dim - 1));
+        }
+
+        unsigned row(double y) const
+        {
+            return (unsigned)clamp(floor((y - _bounds.yMin()) / _cellHeight), 0.0, (double)(_dim - 1));
+        }
+
+        osg::BoundingBoxd _bounds;
+        unsigned _dim;
+        double _cellWidth, _cellHeight;
+        std::vector< std::vector<unsigned> > _cells;
+    };
+
+    // Number of grid cells along each side of a SegmentGrid
+    const unsigned SEGMENT_GRID_SIZE = 32u;
+
     /**
      * Create a heightfield that flattens the terrain around linear geometry.
      * lineWidth = width of completely flat area
@@ -396,123 +462,197 @@ namespace
 
         const GeoExtent& ex = key.getExtent();
 
-        double col_interval = ex.width() / (double)(hf->getNumColumns()-1);
-        double row_interval = ex.height() / (double)(hf->getNumRows()-1);
+        unsigned numCols = hf->getNumColumns();
+        unsigned numRows = hf->getNumRows();
+        double col_interval = ex.width() / (double)(numCols-1);
+        double row_interval = ex.height() / (double)(numRows-1);
 
-        osg::Vec3d Pex, P, PROJ;
+        // All the heightfield sample points, moved into the working SRS in one go.
+        std::vector<osg::Vec3d> points(numCols*numRows);
+        for (unsigned col = 0; col < numCols; ++col)
+        {
+            for (unsigned row = 0; row < numRows; ++row)
+            {
+                points[col*numRows + row].set(
+                    ex.xMin() + (double)col * col_interval,
+                    ex.yMin() + (double)row * row_interval,
+                    0.0);
+            }
+        }
 
-        bool needsTransform = ex.getSRS() != geomSRS;
-        
-        // Loop over the new heightfield.
-        for (unsigned col = 0; col < hf->getNumColumns(); ++col)
+        if (ex.getSRS() != geomSRS && !ex.getSRS()->transform(points, geomSRS))
+            return false;
+
+        osg::BoundingBoxd bounds;
+        for (unsigned i = 0; i < points.size(); ++i)
+            bounds.expandBy(points[i]);
+
+        // Collect the segments whose flattening area reaches the heightfield.
+        Segments segments;
+        for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
         {
-            Pex.x() = ex.xMin() + (double)col * col_interval;
+            Widths w = widths[geomIndex];
+            double innerRadius = w.lineWidth * 0.5;
+            double outerRadius = innerRadius + w.bufferWidth;
 
-            for (unsigned row = 0; row < hf->getNumRows(); ++row)
+            Geometry* component = geom->getComponents()[geomIndex].get();
+            ConstGeometryIterator giter(component);
+            while (giter.hasMore())
+            {
+                const Geometry* part = giter.next();
+
+                for (int i = 0; i < part->size()-1; ++i)
+                {
+                    const osg::Vec3d& A = (*part)[i];
+                    const osg::Vec3d& B = (*part)[i+1];
+
+                    if (osg::maximum(A.x(), B.x()) + outerRadius < bounds.xMin() ||
+                        osg::minimum(A.x(), B.x()) - outerRadius > bounds.xMax() ||
+                        osg::maximum(A.y(), B.y()) + outerRadius < bounds.yMin() ||
+                        osg::minimum(A.y(), B.y()) - outerRadius > bounds.yMax())
+                    {
+                        continue;
+                    }
+
+                    Segment seg;
+                    seg.A = A;
+                    seg.B = B;
+                    seg.innerRadius = innerRadius;
+                    seg.outerRadius = outerRadius;
+                    segments.push_back(seg);
+                }
+            }
+        }
+
+        if (segments.empty() && !fillAllPixels)
+            return false;
+
+        // Query the source elevations of all the sample points and all the segment
+        // endpoints in one batch, instead of one at a time as they come up.
+        size_t numQueries = points.size() + 2*segments.size();
+        std::vector<double> xs(numQueries), ys(numQueries);
+        std::vector<float> elevs(numQueries);
+        for (unsigned i = 0; i < points.size(); ++i)
+        {
+            xs[i] = points[i].x();
+            ys[i] = points[i].y();
+        }
+        for (unsigned s = 0; s < segments.size(); ++s)
+        {
+            size_t i = points.size() + 2*s;
+            xs[i] = segments[s].A.x();
+            ys[i] = segments[s].A.y();
+            xs[i+1] = segments[s].B.x();
+            ys[i+1] = segments[s].B.y();
+        }
+
+        envelope->getElevations(&xs[0], &ys[0], &elevs[0], numQueries);
+
+        for (unsigned s = 0; s < segments.size(); ++s)
+        {
+            segments[s].elevA = elevs[points.size() + 2*s];
+            segments[s].elevB = elevs[points.size() + 2*s + 1];
+        }
+
+        SegmentGrid grid(segments, bounds, SEGMENT_GRID_SIZE);
+
+        Samples samples;
+        osg::Vec3d PROJ;
+
+        // Loop over the new heightfield.
+        for (unsigned col = 0; col < numCols; ++col)
+        {
+            for (unsigned row = 0; row < numRows; ++row)
             {
                 // check for cancelation periodically
                 //if (progress && progress->isCanceled())
                 //    return false;
 
-                Pex.y() = ex.yMin() + (double)row * row_interval;
+                const osg::Vec3d& P = points[col*numRows + row];
 
-                // Move the point into the working SRS if necessary
-                if (needsTransform)
-                    ex.getSRS()->transform(Pex, geomSRS, P);
-                else
-                    P = Pex;
+                // The original elevation at our point:
+                float elevP = elevs[col*numRows + row];
 
                 // For each point, we need to find the closest line segments to that point
                 // because the elevation values on these line segments will be the flattening
                 // value. There may be more than one line segment that falls within the search
                 // radius; we will collect up to MaxSamples of these for each heightfield point.
                 static const unsigned Maxsamples = 4;
-                Samples samples;
+                samples.clear();
 
-                for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+                const std::vector<unsigned>& candidates = grid.get(P);
+                for (unsigned c = 0; c < candidates.size(); ++c)
                 {
-                    Widths w = widths[geomIndex];
-                    double innerRadius = w.lineWidth * 0.5;
-                    double outerRadius = innerRadius + w.bufferWidth;
-                    double outerRadius2 = outerRadius * outerRadius;
+                    // AB is a candidate line segment:
+                    const Segment& seg = segments[candidates[c]];
+                    const osg::Vec3d& A = seg.A;
+                    const osg::Vec3d& B = seg.B;
+                    double outerRadius2 = seg.outerRadius * seg.outerRadius;
 
-                    Geometry* component = geom->getComponents()[geomIndex].get();
-                    // Search for line segments.
-                    ConstGeometryIterator giter(component);
-                    while (giter.hasMore())
-                    {
-                        const Geometry* part = giter.next();                        
-
-                        for (int i = 0; i < part->size()-1; ++i)
-                        {
-                            // AB is a candidate line segment:
-                            const osg::Vec3d& A = (*part)[i];
-                            const osg::Vec3d& B = (*part)[i+1];
+                    osg::Vec3d AB = B - A;    // current segment AB
 
-                            osg::Vec3d AB = B - A;    // current segment AB
+                    double t;                 // parameter [0..1] on segment AB
+                    double D2;                // shortest distance from point P to segment AB, squared
+                    double L2 = AB.length2(); // length (squared) of segment AB
+                    osg::Vec3d AP = P - A;    // vector from endpoint A to point P
 
-                            double t;                 // parameter [0..1] on segment AB
-                            double D2;                // shortest distance from point P to segment AB, squared
-                            double L2 = AB.length2(); // length (squared) of segment AB
-                            osg::Vec3d AP = P - A;    // vector from endpoint A to point P
-
-                            if (L2 == 0.0)
-                            {
-                                // trivial case: zero-length segment
-                                t = 0.0;
-                                D2 = AP.length2();
-                            }
-                            else
-                            {
-                                // Calculate parameter "t" [0..1] which will yield the closest point on AB to P.
-                                // Clamping it means the closest point won't be beyond the endpoints of the segment.
-                                t = clamp((AP * AB)/L2, 0.0, 1.0);
+                    if (L2 == 0.0)
+                    {
+                        // trivial case: zero-length segment
+                        t = 0.0;
+                        D2 = AP.length2();
+                    }
+                    else
+                    {
+                        // Calculate parameter "t" [0..1] which will yield the closest point on AB to P.
+                        // Clamping it means the closest point won't be beyond the endpoints of the segment.
+                        t = clamp((AP * AB)/L2, 0.0, 1.0);
 
-                                // project our point P onto segment AB:
-                                PROJ.set( A + AB*t );
+                        // project our point P onto segment AB:
+                        PROJ.set( A + AB*t );
 
-                                // measure the distance (squared) from P to the projected point on AB:
-                                D2 = (P - PROJ).length2();
-                            }
+                        // measure the distance (squared) from P to the projected point on AB:
+                        D2 = (P - PROJ).length2();
+                    }
 
-                            // If the distance from our point to the line segment falls within
-                            // the maximum flattening distance, store it.
-                            if (D2 <= outerRadius2)
-                            {
-                                // see if P is a new sample.
-                                Sample* b;
-                                if (samples.size() < Maxsamples)
-                                {
-                                    // If we haven't collected the maximum number of samples yet,
-                                    // just add this to the list:
-                                    samples.push_back(Sample());
-                                    b = &samples.back();
-                                }
-                                else
-                                {
-                                    // If we are maxed out on samples, find the farthest one we have so far
-                                    // and replace it if the new point is closer:
-                                    unsigned max_i = 0;
-                                    for (unsigned i=1; i<samples.size(); ++i)
-                                        if (samples[i].D2 > samples[max_i].D2)
-                                            max_i = i;
+                    // If the distance from our point to the line segment falls within
+                    // the maximum flattening distance, store it.
+                    if (D2 <= outerRadius2)
+                    {
+                        // see if P is a new sample.
+                        Sample* b;
+                        if (samples.size() < Maxsamples)
+                        {
+                            // If we haven't collected the maximum number of samples yet,
+                            // just add this to the list:
+                            samples.push_back(Sample());
+                            b = &samples.back();
+                        }
+                        else
+                        {
+                            // If we are maxed out on samples, find the farthest one we have so far
+                            // and replace it if the new point is closer:
+                            unsigned max_i = 0;
+                            for (unsigned i=1; i<samples.size(); ++i)
+                                if (samples[i].D2 > samples[max_i].D2)
+                                    max_i = i;
 
-                                    b = &samples[max_i];
+                            b = &samples[max_i];
 
-                                    if (b->D2 < D2)
-                                        b = 0L;
-                                }
+                            if (b->D2 < D2)
+                                b = 0L;
+                        }
 
-                                if (b)
-                                {
-                                    b->D2 = D2;
-                                    b->A = A;
-                                    b->B = B;
-                                    b->T = t;
-                                    b->innerRadius = innerRadius;
-                                    b->outerRadius = outerRadius;
-                                }
-                            }
+                        if (b)
+                        {
+                            b->D2 = D2;
+                            b->A = A;
+                            b->B = B;
+                            b->T = t;
+                            b->innerRadius = seg.innerRadius;
+                            b->outerRadius = seg.outerRadius;
+                            b->elevA = seg.elevA;
+                            b->elevB = seg.elevB;
                         }
                     }
                 }
@@ -532,9 +672,6 @@ namespace
                 // create a new elevation value for our point.
                 if (samples.size() > 0)
                 {
-                    // The original elevation at our point:
-                    float elevP = envelope->getElevation(P.x(), P.y());
-                    
                     for (unsigned i = 0; i < samples.size(); ++i)
                     {
                         Sample& sample = samples[i];
@@ -546,32 +683,17 @@ namespace
                         double blend = clamp(
                             (sample.D - sample.innerRadius) / (sample.outerRadius - sample.innerRadius),
                             0.0, 1.0);
-                        
+
+                        float elevA = sample.elevA != NO_DATA_VALUE ? sample.elevA : elevP;
+                        float elevB = sample.elevB != NO_DATA_VALUE ? sample.elevB : elevP;
+
                         if (sample.T == 0.0)
-                        {
-                            sample.elevPROJ = envelope->getElevation(sample.A.x(), sample.A.y());
-                            if (sample.elevPROJ == NO_DATA_VALUE)
-                                sample.elevPROJ = elevP;
-                        }
+                            sample.elevPROJ = elevA;
                         else if (sample.T == 1.0)
-                        {
-                            sample.elevPROJ = envelope->getElevation(sample.B.x(), sample.B.y());
-                            if (sample.elevPROJ == NO_DATA_VALUE)
-                                sample.elevPROJ = elevP;
-                        }
+                            sample.elevPROJ = elevB;
                         else
-                        {
-                            float elevA = envelope->getElevation(sample.A.x(), sample.A.y());
-                            if (elevA == NO_DATA_VALUE)
-                                elevA = elevP;
-
-                            float elevB = envelope->getElevation(sample.B.x(), sample.B.y());
-                            if (elevB == NO_DATA_VALUE)
-                                elevB = elevP;
-
                             // linear interpolation of height from point A to point B on the segment:
                             sample.elevPROJ = mix(elevA, elevB, sample.T);
-                        }
 
                         // smoothstep interpolation of along the buffer (perpendicular to the segment)
                         // will gently integrate the new value into the existing terrain.
@@ -591,8 +713,7 @@ namespace
                 else if (fillAllPixels)
                 {
                     // No close segments were found, so just copy over the source data.
-                    float h = envelope->getElevation(P.x(), P.y());
-                    hf->setHeight(col, row, h);
+                    hf->setHeight(col, row, elevP);
 
                     // Note: do not set wroteChanges to true.
                 }
@@ -705,6 +826,8 @@ FlatteningLayer::init()
     // Experiment with this and see what will work.
     _pool = new ElevationPool();
     _pool->setTileSize(257u);
+
+    _cache.setMaxSize(64u);
 }
 
 Config
@@ -784,6 +907,20 @@ FlatteningLayer::removedFromMap(const Map* map)
     ElevationLayer::removedFromMap(map);
 }
 
+unsigned
+FlatteningLayer::getSourceRevision() const
+{
+    // Revisions only increase, so the sum changes whenever the features
+    // or any of the source elevation layers change.
+    unsigned revision = getFeatureSource() ? getFeatureSource()->getRevision() : 0u;
+
+    const ElevationLayerVector& layers = _pool->getElevationLayers();
+    for (ElevationLayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+        revision += i->get()->getRevision();
+
+    return revision;
+}
+
 GeoHeightField
 FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const
 {
@@ -824,6 +961,22 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
         return GeoHeightField::INVALID;
     }
 
+    // Reuse a flattened heightfield if neither the features nor the source
+    // elevation have changed since we made it. The caller may modify the
+    // heightfield it gets, so always hand out a copy.
+    unsigned sourceRevision = getSourceRevision();
+    {
+        Threading::ScopedMutexLock lock(_cacheMutex);
+        LRUCache<TileKey, CachedHeightField>::Record rec;
+        if (_cache.get(key, rec) && rec.value().first == sourceRevision)
+        {
+            const osg::HeightField* cached = rec.value().second.get();
+            return GeoHeightField(
+                cached ? new osg::HeightField(*cached, osg::CopyOp::DEEP_COPY_ALL) : 0L,
+                key.getExtent());
+        }
+    }
+
     OE_START_TIMER(create);
     
     osg::ref_ptr<osg::HeightField> hf;
@@ -1028,5 +1181,17 @@ FlatteningLayer::createHeightFieldImplementation(const TileKey& key, ProgressCal
         }
     }
 
+    if (progress && progress->isCanceled())
+    {
+        return GeoHeightField::INVALID;
+    }
+
+    {
+        Threading::ScopedMutexLock lock(_cacheMutex);
+        _cache.insert(key, CachedHeightField(
+            sourceRevision,
+            hf.valid() ? new osg::HeightField(*hf.get(), osg::CopyOp::DEEP_COPY_ALL) : 0L));
+    }
+
     return GeoHeightField(hf.get(), key.getExtent());
 }
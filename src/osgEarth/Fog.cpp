@@ -32,27 +32,31 @@ using namespace osgEarth::Util;
 
 void FogCallback::operator() (osg::StateAttribute* attr, osg::NodeVisitor* nv)
 {
-    // Update the oe_fog_algo uniform to reflect the current algorithm.
+    // Select the fog shader variant with a define that matches the current
+    // algorithm. The defines only change when the mode does, so the
+    // program is not re-selected every frame.
     osg::Fog* fog = static_cast<osg::Fog*>(attr);
+    bool exp  = (fog->getMode() == osg::Fog::EXP);
+    bool exp2 = (fog->getMode() == osg::Fog::EXP2);
+
     for (unsigned int i = 0; i < attr->getNumParents(); i++)
     {
         osg::StateSet* stateSet = attr->getParent(i);
-
-        if (fog->getMode() == osg::Fog::LINEAR)
-        {
-            stateSet->getOrCreateUniform("oe_fog_algo", osg::Uniform::INT)->set(0);
-        }
-        else if (fog->getMode() == osg::Fog::EXP)
-        {
-            stateSet->getOrCreateUniform("oe_fog_algo", osg::Uniform::INT)->set(1);
-        }
-        else if (fog->getMode() == osg::Fog::EXP2)
-        {
-            stateSet->getOrCreateUniform("oe_fog_algo", osg::Uniform::INT)->set(2);
-        }
+        setFogDefine(stateSet, "OE_FOG_EXP", exp);
+        setFogDefine(stateSet, "OE_FOG_EXP2", exp2);
     }
 }
 
+void FogCallback::setFogDefine(osg::StateSet* stateSet, const std::string& name, bool value)
+{
+    const osg::StateSet::DefineList& defines = stateSet->getDefineList();
+    bool isSet = defines.find(name) != defines.end();
+    if (value && !isSet)
+        stateSet->setDefine(name);
+    else if (!value && isSet)
+        stateSet->removeDefine(name);
+}
+
 
 FogEffect::FogEffect()
 {
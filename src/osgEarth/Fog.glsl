@@ -3,8 +3,10 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 
 #pragma vp_entryPoint oe_fog_vertex
 #pragma vp_location   vertex_view
+#pragma import_defines(OE_FOG_EXP, OE_FOG_EXP2)
 
-uniform int oe_fog_algo;
+// FogCallback sets OE_FOG_EXP or OE_FOG_EXP2 to match the osg::Fog mode;
+// neither means linear fog.
 
 out float oe_fogFactor;
 
@@ -12,22 +14,14 @@ void oe_fog_vertex(inout vec4 vertexVIEW)
 {
     float z = length( vertexVIEW.xyz );
 
-	// linear fog
-	if (oe_fog_algo == 0)
-	{
-	  oe_fogFactor = clamp((gl_Fog.end - z) / (gl_Fog.end - gl_Fog.start), 0.0, 1.0);
-	}
-	// exp fog
-	else if (oe_fog_algo == 1)
-	{	
-	  oe_fogFactor = clamp(exp( -gl_Fog.density * z ), 0.0, 1.0);
-	}	
-	else
-	// exp2 fog
-	{
-        const float LOG2 = 1.442695;
-        oe_fogFactor = clamp(exp2( -gl_Fog.density * gl_Fog.density * z * z * LOG2 ), 0.0, 1.0);
-	}	
+#if defined(OE_FOG_EXP)
+    oe_fogFactor = clamp(exp( -gl_Fog.density * z ), 0.0, 1.0);
+#elif defined(OE_FOG_EXP2)
+    const float LOG2 = 1.442695;
+    oe_fogFactor = clamp(exp2( -gl_Fog.density * gl_Fog.density * z * z * LOG2 ), 0.0, 1.0);
+#else
+    oe_fogFactor = clamp((gl_Fog.end - z) / (gl_Fog.end - gl_Fog.start), 0.0, 1.0);
+#endif
 }
 
 
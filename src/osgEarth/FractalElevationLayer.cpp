@@ -265,6 +265,22 @@ FractalElevationLayer::createHeightFieldImplementation(const TileKey& key, Progr
 
     osg::Vec4f sample;
 
+    // The LOD scaling is separable in u and v, so compute the wrapped noise
+    // texture coordinates once per column and once per row.
+    const unsigned size = getTileSize();
+    std::vector<double> uMod1(size), vMod1(size), uMod2(size), vMod2(size);
+    for (unsigned i = 0; i < size; ++i)
+    {
+        double w = (double)i / (double)(size - 1);
+        double u = w, v = w;
+        scaleCoordsToLOD(u, v, options().baseLOD().get(), key);
+        uMod1[i] = fmod(u, 1.0), vMod1[i] = fmod(v, 1.0);
+
+        u = w, v = w;
+        scaleCoordsToLOD(u, v, options().baseLOD().get() + 3, key);
+        uMod2[i] = fmod(u, 1.0), vMod2[i] = fmod(v, 1.0);
+    }
+
     for (int s = 0; s < (int)getTileSize(); ++s)
     {
         for (int t = 0; t < (int)getTileSize(); ++t)
@@ -273,32 +289,20 @@ FractalElevationLayer::createHeightFieldImplementation(const TileKey& key, Progr
             double v = (double)t / (double)(getTileSize() - 1);
 
             double n = 0.0;
-            double uScaled, vScaled;
 
             double finalScale = 4.0;
 
             // Step 1
             if (_noiseImage1.valid())
             {
-                uScaled = u, vScaled = v;
-                scaleCoordsToLOD(uScaled, vScaled, options().baseLOD().get(), key);
-
-                double uMod = fmod(uScaled, 1.0);
-                double vMod = fmod(vScaled, 1.0);
-
-                noise1(sample, uMod, vMod);
+                noise1(sample, uMod1[s], vMod1[t]);
                 n += sample.r() - 0.5;
                 finalScale *= 0.5;
             }
 
             if (_noiseImage2.valid())
             {
-                uScaled = u, vScaled = v;
-                scaleCoordsToLOD(uScaled, vScaled, options().baseLOD().get() + 3, key);
-
-                double uMod = fmod(uScaled, 1.0);
-                double vMod = fmod(vScaled, 1.0);
-                noise2(sample, uMod, vMod);
+                noise2(sample, uMod2[s], vMod2[t]);
                 n += sample.r() - 0.5;
                 finalScale *= 0.5;
             }
@@ -169,6 +169,23 @@ namespace
 
     void GridNode::build()
     { 
+        Style style = _graticule->options().style().get();
+
+        double lon, lat;
+        _extent.getCentroid(lon, lat);
+        std::string label = getGARSLabel(lon, lat, _level);
+
+        // GARS labels are unique per level, so they identify the cell:
+        std::string key = GraticuleNodeCache::makeKey(Stringify() << "gars" << (int)_level, label, style);
+        osg::Node* cached = _graticule->getNodeCache()->get(key);
+        if (cached)
+        {
+            _attachPoint->addChild(cached);
+            return;
+        }
+
+        osg::Group* cell = new osg::Group();
+
         Feature* feature = new Feature(new LineString(5), SpatialReference::create("wgs84"));
         feature->getGeometry()->push_back(_extent.west(), _extent.south(), 0.0);
         feature->getGeometry()->push_back(_extent.east(), _extent.south(), 0.0);
@@ -177,16 +194,9 @@ namespace
         feature->getGeometry()->push_back(_extent.west(), _extent.south(), 0.0);    
         FeatureList features;
         features.push_back(feature);
-
-        Style style = _graticule->options().style().get();
-
-        double lon, lat;
-        _extent.getCentroid(lon, lat);
-        std::string label = getGARSLabel(lon, lat, _level);
     
         FeatureNode* featureNode = new FeatureNode(features, style);
-        // Add the node to the attachpoint.
-        _attachPoint->addChild(featureNode);
+        cell->addChild(featureNode);
        
         GeoPoint centroid(_extent.getSRS(), lon, lat, 0.0f);
         GeoPoint ll(_extent.getSRS(), _extent.west(), _extent.south(), 0.0f);
@@ -218,7 +228,10 @@ namespace
         ll.createLocalToWorld(local2World);
         mt->setMatrix(local2World);
 
-       _attachPoint->addChild(mt);
+        cell->addChild(mt);
+
+        _graticule->getNodeCache()->insert(key, cell);
+        _attachPoint->addChild(cell);
 
        //Registry::shaderGenerator().run(this, Registry::stateSetCache());
     }
@@ -344,6 +357,8 @@ GARSGraticule::init()
     options().style()->getOrCreateSymbol<AltitudeSymbol>()->technique() = AltitudeSymbol::TECHNIQUE_DRAPE;
 
     _root = new osg::Group();
+
+    _nodeCache = new GraticuleNodeCache();
 }
 
 void
@@ -357,6 +372,8 @@ void
 GARSGraticule::removedFromMap(const Map* map)
 {
     VisibleLayer::removedFromMap(map);
+    if (_nodeCache.valid())
+        _nodeCache->clear();
 }
 
 osg::Node*
@@ -280,8 +280,6 @@ namespace osgEarth { namespace GDAL
     */
     GDALRasterBand* findBandByColorInterp(GDALDataset *ds, GDALColorInterp colorInterp)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetColorInterpretation() == colorInterp) return ds->GetRasterBand(i);
@@ -291,8 +289,6 @@ namespace osgEarth { namespace GDAL
 
     GDALRasterBand* findBandByDataType(GDALDataset *ds, GDALDataType dataType)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetRasterDataType() == dataType) return ds->GetRasterBand(i);
@@ -438,19 +434,129 @@ namespace osgEarth { namespace GDAL
         }
         return (err == CE_None);
     }
+
+    bool hasNoDataValue(GDALRasterBand* band)
+    {
+        int success = 0;
+        band->GetNoDataValue(&success);
+        return success != 0;
+    }
+
+    // Whether a pixel coordinate is (close enough to) a pixel edge
+    bool isPixelEdge(double value)
+    {
+        return osg::equivalent(value, floor(value + 0.5), 0.0001);
+    }
 } } // namespace osgEarth::GDAL
 
 //...................................................................
 
+GDAL::DriverPool::DriverPool(Driver* first, unsigned maxDrivers) :
+_numOpen(1u),
+_maxDrivers(osg::maximum(maxDrivers, 1u))
+{
+    _drivers.push_back(first);
+    _idle.push_back(first);
+}
+
+GDAL::Driver*
+GDAL::DriverPool::acquire()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    while (_idle.empty())
+    {
+        if (_numOpen < _maxDrivers)
+        {
+            // Open a new one without holding up the threads giving
+            // drivers back.
+            ++_numOpen;
+            Driver* first = _drivers.front().get();
+            _mutex.unlock();
+            osg::ref_ptr<Driver> driver = first->openCopy();
+            _mutex.lock();
+
+            if (driver.valid())
+            {
+                OE_DEBUG << LC << "Opened dataset handle " << _numOpen << " on " << first->getName() << std::endl;
+                _drivers.push_back(driver.get());
+                return driver.get();
+            }
+
+            // It won't work any better next time.
+            --_numOpen;
+            _maxDrivers = _numOpen;
+        }
+        else
+        {
+            _returned.wait(&_mutex);
+        }
+    }
+
+    Driver* driver = _idle.back();
+    _idle.pop_back();
+    return driver;
+}
+
+void
+GDAL::DriverPool::release(Driver* driver)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _idle.push_back(driver);
+    _returned.signal();
+}
+
 GDAL::Driver::Driver() :
 _srcDS(NULL),
 _warpedDS(NULL),
 _maxDataLevel(30),
-_linearUnits(1.0)
+_linearUnits(1.0),
+_tileSize(0u)
 {
     //nop
 }
 
+GDAL::Driver::~Driver()
+{
+    GDAL_SCOPED_LOCK;
+
+    if (_warpedDS && _warpedDS != _srcDS)
+    {
+        GDALClose(_warpedDS);
+    }
+
+    bool external = _externalDataset.valid() && _externalDataset->dataset() == _srcDS;
+    if (_srcDS && (!external || _externalDataset->ownsDataset()))
+    {
+        GDALClose(_srcDS);
+    }
+}
+
+GDAL::Driver*
+GDAL::Driver::openCopy() const
+{
+    if (_srcDS == NULL || _externalDataset.valid())
+        return NULL;
+
+    osg::ref_ptr<Driver> copy = new Driver();
+    copy->_noDataValue = _noDataValue;
+    copy->_minValidValue = _minValidValue;
+    copy->_maxValidValue = _maxValidValue;
+    copy->_maxDataLevel = _maxDataLevel;
+    copy->_profile = _profile;
+
+    // the data extents are the same as ours, so toss them
+    DataExtentList dataExtents;
+    Status status = copy->open(_name, _gdalOptions, _tileSize, dataExtents, _readOptions.get());
+    if (status.isError())
+    {
+        OE_WARN << LC << "Failed to open another handle on " << _name << ": " << status.message() << std::endl;
+        return NULL;
+    }
+
+    return copy.release();
+}
+
 void
 GDAL::Driver::setExternalDataset(GDAL::ExternalDataset* value)
 {
@@ -469,6 +575,8 @@ GDAL::Driver::open(const std::string& name,
 
     _name = name;
     _gdalOptions = options;
+    _tileSize = tileSize;
+    _readOptions = readOptions;
 
     // Is a valid external GDAL dataset specified ?
     bool useExternalDataset = false;
@@ -914,7 +1022,7 @@ GDAL::Driver::isValidValue_noLock(float v, GDALRasterBand* band)
 bool
 GDAL::Driver::isValidValue(float v, GDALRasterBand* band)
 {
-    GDAL_SCOPED_LOCK;
+    // callers already hold the driver's lock
     return isValidValue_noLock(v, band);
 }
 
@@ -1055,7 +1163,9 @@ GDAL::Driver::createImage(const TileKey& key,
         return NULL;
     }
 
-    GDAL_SCOPED_LOCK;
+    // Each driver has its own dataset handles, so there's no need for
+    // the global GDAL lock; this only guards against a shared driver.
+    Threading::ScopedMutexLock lock(_mutex);
 
     if (progress && progress->isCanceled())
     {
@@ -1111,11 +1221,29 @@ GDAL::Driver::createImage(const TileKey& key,
     geoToPixel(west, intersection.yMax(), src_min_x, src_min_y);
     geoToPixel(east, intersection.yMin(), src_max_x, src_max_y);
 
+    // An unwarped source whose pixel edges fall on the window edges may
+    // be copied without resampling (checked again below for resolution).
+    bool aligned =
+        _warpedDS == _srcDS &&
+        isPixelEdge(src_min_x) && isPixelEdge(src_min_y) &&
+        isPixelEdge(src_max_x) && isPixelEdge(src_max_y);
+
     // Convert the doubles to integers.  We floor the mins and ceil the maximums to give the widest window possible.
-    src_min_x = floor(src_min_x);
-    src_min_y = floor(src_min_y);
-    src_max_x = ceil(src_max_x);
-    src_max_y = ceil(src_max_y);
+    // Aligned edges are rounded, so rounding error doesn't widen the window.
+    if (aligned)
+    {
+        src_min_x = floor(src_min_x + 0.5);
+        src_min_y = floor(src_min_y + 0.5);
+        src_max_x = floor(src_max_x + 0.5);
+        src_max_y = floor(src_max_y + 0.5);
+    }
+    else
+    {
+        src_min_x = floor(src_min_x);
+        src_min_y = floor(src_min_y);
+        src_max_x = ceil(src_max_x);
+        src_max_y = ceil(src_max_y);
+    }
 
     int off_x = (int)(src_min_x);
     int off_y = (int)(src_min_y);
@@ -1146,6 +1274,14 @@ GDAL::Driver::createImage(const TileKey& key,
     double dx = (xmax - xmin) / (double)(tileSize - 1);
     double dy = (ymax - ymin) / (double)(tileSize - 1);
 
+    // Same resolution as the source too?
+    if (aligned)
+    {
+        aligned =
+            osg::round((intersection.width() / key.getExtent().width())*(double)tileSize) == width &&
+            osg::round((intersection.height() / key.getExtent().height())*(double)tileSize) == height;
+    }
+
     OE_DEBUG << LC << "ReadWindow " << off_x << "," << off_y << " " << width << "x" << height << std::endl;
     OE_DEBUG << LC << "DestWindow " << tile_offset_left << "," << tile_offset_top << " " << target_width << "x" << target_height << std::endl;
 
@@ -1205,7 +1341,16 @@ GDAL::Driver::createImage(const TileKey& key,
     GLenum pixelFormat = GL_RGBA;
 
 
-    if (bandRed && bandGreen && bandBlue)
+    if (aligned && !isCoverage && ((bandRed && bandGreen && bandBlue) || bandGray))
+    {
+        image = createAlignedImage(
+            bandRed, bandGreen, bandBlue, bandGray, bandAlpha,
+            off_x, off_y, width, height,
+            tileSize,
+            (int)osg::round((offset_left / key.getExtent().width()) * (double)tileSize),
+            (int)osg::round((offset_top / key.getExtent().height()) * (double)tileSize));
+    }
+    else if (bandRed && bandGreen && bandBlue)
     {
         unsigned char *red = new unsigned char[target_width * target_height];
         unsigned char *green = new unsigned char[target_width * target_height];
@@ -1462,6 +1607,86 @@ GDAL::Driver::createImage(const TileKey& key,
     return image.release();
 }
 
+osg::Image*
+GDAL::Driver::createAlignedImage(GDALRasterBand* red, GDALRasterBand* green, GDALRasterBand* blue,
+                                 GDALRasterBand* gray, GDALRasterBand* alpha,
+                                 int off_x, int off_y, int width, int height,
+                                 unsigned tileSize, int tile_offset_left, int tile_offset_top)
+{
+    if (tile_offset_left < 0 || tile_offset_top < 0 ||
+        tile_offset_left + width > (int)tileSize || tile_offset_top + height > (int)tileSize)
+    {
+        return NULL;
+    }
+
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage(tileSize, tileSize, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    memset(image->data(), 0, image->getImageSizeInBytes());
+
+    bool rgb = red && green && blue;
+
+    // The image is bottom-up, so start at the top row of the window and
+    // step backwards through the rows; each band fills its own channel.
+    unsigned char* top = image->data(tile_offset_left, tileSize - tile_offset_top - 1);
+    GSpacing pixelSpace = 4;
+    GSpacing lineSpace = -(GSpacing)image->getRowSizeInBytes();
+
+    bool ok = rgb ?
+        rasterIO(red,   GF_Read, off_x, off_y, width, height, top + 0, width, height, GDT_Byte, pixelSpace, lineSpace) &&
+        rasterIO(green, GF_Read, off_x, off_y, width, height, top + 1, width, height, GDT_Byte, pixelSpace, lineSpace) &&
+        rasterIO(blue,  GF_Read, off_x, off_y, width, height, top + 2, width, height, GDT_Byte, pixelSpace, lineSpace) :
+        rasterIO(gray,  GF_Read, off_x, off_y, width, height, top + 0, width, height, GDT_Byte, pixelSpace, lineSpace);
+
+    if (ok && alpha)
+    {
+        ok = rasterIO(alpha, GF_Read, off_x, off_y, width, height, top + 3, width, height, GDT_Byte, pixelSpace, lineSpace);
+    }
+
+    if (!ok)
+    {
+        OE_WARN << LC << "RasterIO failed.\n";
+        return NULL;
+    }
+
+    // Skip the validity tests when nothing can fail them.
+    bool check =
+        hasNoDataValue(rgb ? red : gray) ||
+        (rgb && (hasNoDataValue(green) || hasNoDataValue(blue))) ||
+        (alpha && hasNoDataValue(alpha)) ||
+        _noDataValue.isSet() || _minValidValue.isSet() || _maxValidValue.isSet();
+
+    for (int r = 0; r < height; ++r)
+    {
+        unsigned char* p = top + r * lineSpace;
+        for (int c = 0; c < width; ++c, p += 4)
+        {
+            if (!rgb)
+            {
+                p[1] = p[2] = p[0];
+            }
+
+            if (!alpha)
+            {
+                p[3] = 255;
+            }
+
+            if (check)
+            {
+                bool valid = rgb ?
+                    isValidValue(p[0], red) && isValidValue(p[1], green) && isValidValue(p[2], blue) :
+                    isValidValue(p[0], gray);
+
+                if (!valid || (alpha && !isValidValue(p[3], alpha)))
+                {
+                    p[3] = 0;
+                }
+            }
+        }
+    }
+
+    return image.release();
+}
+
 osg::HeightField*
 GDAL::Driver::createHeightField(const TileKey& key,
                                 unsigned tileSize,
@@ -1473,7 +1698,7 @@ GDAL::Driver::createHeightField(const TileKey& key,
         return NULL;
     }
 
-    GDAL_SCOPED_LOCK;
+    Threading::ScopedMutexLock lock(_mutex);
 
     //Allocate the heightfield
     osg::ref_ptr<osg::HeightField> hf = new osg::HeightField;
@@ -1569,7 +1794,7 @@ GDAL::Driver::createHeightFieldWithVRT(const TileKey& key,
         return NULL;
     }
 
-    GDAL_SCOPED_LOCK;
+    Threading::ScopedMutexLock lock(_mutex);
 
     //Allocate the heightfield
     osg::ref_ptr<osg::HeightField> hf = new osg::HeightField;
@@ -1705,10 +1930,12 @@ GDAL::Options::readFrom(const Config& conf)
 {
     _interpolation.init(INTERP_AVERAGE);
     _useVRT.init(false);
+    _maxOpenHandles.init(4u);
     conf.get("url", _url);
     conf.get("connection", _connection);
     conf.get("subdataset", _subDataSet);
     conf.get("use_vrt", _useVRT);
+    conf.get("max_open_handles", _maxOpenHandles);
     conf.get("warp_profile", _warpProfile);
     conf.get("interpolation", "nearest", _interpolation, osgEarth::INTERP_NEAREST);
     conf.get("interpolation", "average", _interpolation, osgEarth::INTERP_AVERAGE);
@@ -1725,6 +1952,7 @@ GDAL::Options::writeTo(Config& conf) const
     conf.set("subdataset", _subDataSet);
     conf.set("warp_profile", _warpProfile);
     conf.set("use_vrt", _useVRT);
+    conf.set("max_open_handles", _maxOpenHandles);
     conf.set("interpolation", "nearest", _interpolation, osgEarth::INTERP_NEAREST);
     conf.set("interpolation", "average", _interpolation, osgEarth::INTERP_AVERAGE);
     conf.set("interpolation", "bilinear", _interpolation, osgEarth::INTERP_BILINEAR);
@@ -1757,6 +1985,7 @@ OE_LAYER_PROPERTY_IMPL(GDALImageLayer, std::string, Connection, connection);
 OE_LAYER_PROPERTY_IMPL(GDALImageLayer, unsigned, SubDataSet, subDataSet);
 OE_LAYER_PROPERTY_IMPL(GDALImageLayer, ProfileOptions, WarpProfile, warpProfile);
 OE_LAYER_PROPERTY_IMPL(GDALImageLayer, RasterInterpolation, Interpolation, interpolation);
+OE_LAYER_PROPERTY_IMPL(GDALImageLayer, unsigned, MaxOpenHandles, maxOpenHandles);
 
 void
 GDALImageLayer::init()
@@ -1810,12 +2039,15 @@ GDALImageLayer::openImplementation()
         setProfile(_driver->getProfile());
     }
 
+    _drivers = new GDAL::DriverPool(_driver.get(), options().maxOpenHandles().get());
+
     return Status::NoError;
 }
 
 Status
 GDALImageLayer::closeImplementation()
 {
+    _drivers = 0L;
     _driver = 0L;
     dataExtents().clear();
     setProfile(NULL); // must do this to support override profiles
@@ -1825,15 +2057,17 @@ GDALImageLayer::closeImplementation()
 GeoImage
 GDALImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
 {
-    GDAL::Driver* driver = dynamic_cast<GDAL::Driver*>(_driver.get());
+    osg::ref_ptr<GDAL::DriverPool> drivers = _drivers.get();
     osg::ref_ptr<osg::Image> image;
-    if (driver)
+    if (drivers.valid())
     {
+        GDAL::Driver* driver = drivers->acquire();
         image = driver->createImage(
             key,
             options().tileSize().get(),
             options().coverage() == true,
             progress);
+        drivers->release(driver);
     }
     return GeoImage(image.get(), key.getExtent());
 }
@@ -1864,6 +2098,7 @@ OE_LAYER_PROPERTY_IMPL(GDALElevationLayer, unsigned, SubDataSet, subDataSet);
 OE_LAYER_PROPERTY_IMPL(GDALElevationLayer, ProfileOptions, WarpProfile, warpProfile);
 OE_LAYER_PROPERTY_IMPL(GDALElevationLayer, RasterInterpolation, Interpolation, interpolation);
 OE_LAYER_PROPERTY_IMPL(GDALElevationLayer, bool, UseVRT, useVRT);
+OE_LAYER_PROPERTY_IMPL(GDALElevationLayer, unsigned, MaxOpenHandles, maxOpenHandles);
 
 void GDALElevationLayer::setExternalDataset(GDAL::ExternalDataset* value)
 {
@@ -1920,12 +2155,15 @@ GDALElevationLayer::openImplementation()
         setProfile(_driver->getProfile());
     }
 
+    _drivers = new GDAL::DriverPool(_driver.get(), options().maxOpenHandles().get());
+
     return Status::NoError;
 }
 
 Status
 GDALElevationLayer::closeImplementation()
 {
+    _drivers = 0L;
     _driver = 0L;
     dataExtents().clear();
     setProfile(NULL); // must do this to support override profiles
@@ -1935,10 +2173,11 @@ GDALElevationLayer::closeImplementation()
 GeoHeightField
 GDALElevationLayer::createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const
 {
-    GDAL::Driver* driver = dynamic_cast<GDAL::Driver*>(_driver.get());
+    osg::ref_ptr<GDAL::DriverPool> drivers = _drivers.get();
     osg::ref_ptr<osg::HeightField> heightfield;
-    if (driver)
+    if (drivers.valid())
     {
+        GDAL::Driver* driver = drivers->acquire();
         if (*_options->useVRT())
         {
             heightfield = driver->createHeightFieldWithVRT(
@@ -1953,6 +2192,7 @@ GDALElevationLayer::createHeightFieldImplementation(const TileKey& key, Progress
                 options().tileSize().get(),
                 progress);
         }
+        drivers->release(driver);
     }
     return GeoHeightField(heightfield.get(), key.getExtent());
 }
@@ -43,9 +43,6 @@ using namespace geos::operation;
 
 #define LC "[GEOS] "
 
-#define GEOS_VERSION_AT_LEAST(MAJOR, MINOR) \
-    ((GEOS_VERSION_MAJOR>MAJOR) || (GEOS_VERSION_MAJOR==MAJOR && GEOS_VERSION_MINOR>=MINOR))
-
 namespace
 {
     geom::CoordinateSequence*
@@ -21,10 +21,15 @@
 */
 #include <osgEarth/GLUtils>
 #include <osgEarth/Lighting>
+#include <osgEarth/Notify>
 
 #include <osg/LineStipple>
 #include <osg/GraphicsContext>
 #include <osgViewer/GraphicsWindow>
+#include <osgViewer/ViewerBase>
+#include <osgUtil/IncrementalCompileOperation>
+#include <OpenThreads/ScopedLock>
+#include <OpenThreads/Thread>
 
 #ifdef OSG_GL_FIXED_FUNCTION_AVAILABLE
 #include <osg/LineWidth>
@@ -86,6 +91,10 @@ GLUtils::setLineStipple(osg::StateSet* stateSet, int factor, unsigned short patt
 
     stateSet->addUniform(new osg::Uniform("oe_GL_LineStippleFactor", (int)factor), ov);
     stateSet->addUniform(new osg::Uniform("oe_GL_LineStipplePattern", (int)pattern), ov);
+
+    // A solid pattern compiles the stippling code out of the line shaders
+    // instead of testing the pattern uniform per vertex and per fragment.
+    stateSet->setDefine("OE_LINE_STIPPLE", pattern != 0xffff ? ov : (ov & ~osg::StateAttribute::ON));
 }
 
 void
@@ -166,6 +175,7 @@ GLUtils::remove(osg::StateSet* stateSet, GLenum cap)
     case GL_LINE_STIPPLE:
         stateSet->removeUniform("oe_GL_LineStippleFactor");
         stateSet->removeUniform("oe_GL_LineStipplePattern");
+        stateSet->removeDefine("OE_LINE_STIPPLE");
         break;
 
     case GL_LINE_SMOOTH:
@@ -178,6 +188,108 @@ GLUtils::remove(osg::StateSet* stateSet, GLenum cap)
     }
 }
 
+osgUtil::IncrementalCompileOperation*
+GLUtils::enableIncrementalCompile(osgViewer::ViewerBase* viewer, double millisecondsPerFrame)
+{
+    if (!viewer)
+        return 0L;
+
+    osgUtil::IncrementalCompileOperation* ico = viewer->getIncrementalCompileOperation();
+    if (!ico)
+    {
+        ico = new osgUtil::IncrementalCompileOperation();
+        viewer->setIncrementalCompileOperation(ico);
+    }
+
+    // The ICO uses whatever is left of the target frame time, but never less
+    // than the minimum; use the full minimum rather than a conservative share.
+    ico->setMinimumTimeAvailableForGLCompileAndDeletePerFrame(osg::maximum(millisecondsPerFrame, 0.0) * 0.001);
+    ico->setConservativeTimeRatio(1.0);
+
+    return ico;
+}
+
+namespace
+{
+    // Compile operation that runs on shared compile contexts. Passes that
+    // compile something end with a glFinish so the objects are complete
+    // before they are handed back to the pager; idle passes sleep so the
+    // compile thread does not spin.
+    struct BackgroundCompileOperation : public osgUtil::IncrementalCompileOperation
+    {
+        void operator()(osg::GraphicsContext* context)
+        {
+            bool idle;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(*getToCompiledMutex());
+                idle = getToCompile().empty();
+            }
+
+            if (idle)
+            {
+                OpenThreads::Thread::microSleep(1000);
+                return;
+            }
+
+            osgUtil::IncrementalCompileOperation::operator()(context);
+            glFinish();
+        }
+    };
+}
+
+osgUtil::IncrementalCompileOperation*
+GLUtils::enableBackgroundCompile(osgViewer::ViewerBase* viewer, double millisecondsPerFrame)
+{
+    if (!viewer)
+        return 0L;
+
+    if (!viewer->isRealized())
+    {
+        OE_WARN << LC << "Background compile requires a realized viewer" << std::endl;
+        return 0L;
+    }
+
+    osg::ref_ptr<osgUtil::IncrementalCompileOperation> ico = new BackgroundCompileOperation();
+    ico->setMinimumTimeAvailableForGLCompileAndDeletePerFrame(osg::maximum(millisecondsPerFrame, 0.0) * 0.001);
+    ico->setConservativeTimeRatio(1.0);
+
+    // installing the ICO assigns it to every viewer context:
+    viewer->setIncrementalCompileOperation(ico.get());
+
+    osgViewer::ViewerBase::Contexts contexts;
+    viewer->getContexts(contexts);
+
+    for (osgViewer::ViewerBase::Contexts::iterator i = contexts.begin(); i != contexts.end(); ++i)
+    {
+        osg::GraphicsContext* gc = *i;
+        if (!gc->getState())
+            continue;
+
+        osg::GraphicsContext* compileContext =
+            osg::GraphicsContext::getOrCreateCompileContext(gc->getState()->getContextID());
+
+        if (compileContext)
+        {
+            if (!compileContext->getGraphicsThread())
+            {
+                compileContext->createGraphicsThread();
+                compileContext->getGraphicsThread()->startThread();
+            }
+
+            // move the compile work off the draw thread:
+            ico->removeGraphicsContext(gc);
+            ico->addGraphicsContext(compileContext);
+        }
+        else
+        {
+            OE_WARN << LC << "No shared compile context for context "
+                << gc->getState()->getContextID() << "; compiling on the draw thread" << std::endl;
+        }
+    }
+
+    return ico.get();
+}
+
 void
 CustomRealizeOperation::setSyncToVBlank(bool value)
 {
@@ -22,6 +22,7 @@
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Terrain>
+#include <osgEarth/Containers>
 
 
 #include <gdal_priv.h>
@@ -2042,6 +2043,151 @@ namespace
     }    
 
 
+    // Source-SRS coordinates of a destination sample grid, stored as a
+    // sparse lattice of exactly transformed points. Reprojecting the same
+    // extent again (another layer, another view, a cache miss on the same
+    // tile) reuses it instead of transforming every pixel.
+    struct WarpGrid : public osg::Referenced
+    {
+        std::vector<unsigned> cols, rows; // lattice pixel indices (first and last included)
+        std::vector<double> x, y;         // source coords at the lattice points, column-major
+
+        // Fills the full-resolution, column-major point arrays (the same
+        // layout transformExtentPoints produces) by interpolating the lattice.
+        void interpolate(double* outX, double* outY, unsigned width, unsigned height) const
+        {
+            const unsigned nr = rows.size();
+            unsigned ci = 0;
+            for (unsigned c = 0; c < width; ++c)
+            {
+                while (ci + 2 < cols.size() && c > cols[ci+1]) ++ci;
+                double tx = (double)(c - cols[ci]) / (double)(cols[ci+1] - cols[ci]);
+
+                unsigned ri = 0;
+                for (unsigned r = 0; r < height; ++r)
+                {
+                    while (ri + 2 < nr && r > rows[ri+1]) ++ri;
+                    double ty = (double)(r - rows[ri]) / (double)(rows[ri+1] - rows[ri]);
+
+                    unsigned i00 = ci*nr + ri, i01 = i00 + 1, i10 = i00 + nr, i11 = i10 + 1;
+                    unsigned p = c*height + r;
+                    outX[p] =
+                        (1.0-tx)*((1.0-ty)*x[i00] + ty*x[i01]) +
+                        tx*((1.0-ty)*x[i10] + ty*x[i11]);
+                    outY[p] =
+                        (1.0-tx)*((1.0-ty)*y[i00] + ty*y[i01]) +
+                        tx*((1.0-ty)*y[i10] + ty*y[i11]);
+                }
+            }
+        }
+    };
+
+    // Lattice indices every "step" pixels, always including the last one.
+    void makeLatticeIndices(unsigned size, unsigned step, std::vector<unsigned>& out)
+    {
+        out.clear();
+        for (unsigned i = 0; i < size - 1; i += step)
+            out.push_back(i);
+        out.push_back(size - 1);
+    }
+
+    // Creates (or fetches) the warp grid for a width x height sample grid over
+    // dest_extent, pixel-centered as in manualReproject. The lattice starts
+    // coarse and is refined until interpolating it lands within "tolerance"
+    // (in source units) of the exact transform at the lattice cell centers.
+    osg::ref_ptr<WarpGrid> getOrCreateWarpGrid(
+        const GeoExtent& src_extent,
+        const GeoExtent& dest_extent,
+        unsigned width, unsigned height,
+        double tolerance)
+    {
+        static LRUCache<std::string, osg::ref_ptr<WarpGrid> > s_cache(true, 128u);
+
+        const SpatialReference* srcSRS = src_extent.getSRS();
+        const SpatialReference* destSRS = dest_extent.getSRS();
+
+        std::string key = Stringify() << std::setprecision(17)
+            << srcSRS->getHorizInitString() << "|" << destSRS->getHorizInitString() << "|"
+            << dest_extent.xMin() << "," << dest_extent.yMin() << ","
+            << dest_extent.xMax() << "," << dest_extent.yMax() << "|"
+            << width << "x" << height << "|" << tolerance;
+
+        LRUCache<std::string, osg::ref_ptr<WarpGrid> >::Record record;
+        if (s_cache.get(key, record))
+            return record.value();
+
+        const double dx = dest_extent.width() / (double)width;
+        const double dy = dest_extent.height() / (double)height;
+        const double x0 = dest_extent.xMin() + .5 * dx, y0 = dest_extent.yMin() + .5 * dy;
+        const double sx = (dest_extent.width() - dx) / (double)(width - 1);
+        const double sy = (dest_extent.height() - dy) / (double)(height - 1);
+
+        osg::ref_ptr<WarpGrid> grid = new WarpGrid();
+
+        for (unsigned step = 16u; ; step /= 2u)
+        {
+            makeLatticeIndices(width, step, grid->cols);
+            makeLatticeIndices(height, step, grid->rows);
+
+            // exact transform at the lattice points:
+            std::vector<osg::Vec3d> points;
+            points.reserve(grid->cols.size() * grid->rows.size());
+            for (unsigned c = 0; c < grid->cols.size(); ++c)
+                for (unsigned r = 0; r < grid->rows.size(); ++r)
+                    points.push_back(osg::Vec3d(x0 + sx*(double)grid->cols[c], y0 + sy*(double)grid->rows[r], 0.0));
+
+            if (!destSRS->transform(points, srcSRS))
+                return 0L;
+
+            grid->x.resize(points.size());
+            grid->y.resize(points.size());
+            for (unsigned i = 0; i < points.size(); ++i)
+            {
+                grid->x[i] = points[i].x();
+                grid->y[i] = points[i].y();
+            }
+
+            if (step == 1u)
+                break;
+
+            // check the interpolation at the lattice cell centers:
+            std::vector<osg::Vec3d> centers;
+            std::vector<osg::Vec2d> interpolated;
+            for (unsigned c = 0; c + 1 < grid->cols.size(); ++c)
+            {
+                for (unsigned r = 0; r + 1 < grid->rows.size(); ++r)
+                {
+                    double pc = 0.5 * (double)(grid->cols[c] + grid->cols[c+1]);
+                    double pr = 0.5 * (double)(grid->rows[r] + grid->rows[r+1]);
+                    centers.push_back(osg::Vec3d(x0 + sx*pc, y0 + sy*pr, 0.0));
+
+                    unsigned nr = grid->rows.size();
+                    unsigned i00 = c*nr + r, i01 = i00 + 1, i10 = i00 + nr, i11 = i10 + 1;
+                    interpolated.push_back(osg::Vec2d(
+                        0.25 * (grid->x[i00] + grid->x[i01] + grid->x[i10] + grid->x[i11]),
+                        0.25 * (grid->y[i00] + grid->y[i01] + grid->y[i10] + grid->y[i11])));
+                }
+            }
+
+            if (!destSRS->transform(centers, srcSRS))
+                return 0L;
+
+            bool accurate = true;
+            for (unsigned i = 0; i < centers.size() && accurate; ++i)
+            {
+                accurate =
+                    fabs(centers[i].x() - interpolated[i].x()) <= tolerance &&
+                    fabs(centers[i].y() - interpolated[i].y()) <= tolerance;
+            }
+
+            if (accurate)
+                break;
+        }
+
+        s_cache.insert(key, grid);
+        return grid;
+    }
+
     osg::Image* manualReproject(
         const osg::Image* image, 
         const GeoExtent&  src_extent, 
@@ -2077,17 +2223,36 @@ namespace
 
         unsigned int numPixels = width * height;
 
+        double xfac = (image->s() - 1) / src_extent.width();
+        double yfac = (image->t() - 1) / src_extent.height();
+
         // Start by creating a sample grid over the destination
         // extent. These will be the source coordinates. Then, reproject
         // the sample grid into the source coordinate system.
         double *srcPointsX = new double[numPixels * 2];
         double *srcPointsY = srcPointsX + numPixels;
 
-        dest_extent.getSRS()->transformExtentPoints(
-            src_extent.getSRS(),
-            dest_extent.xMin() + .5 * dx, dest_extent.yMin() + .5 * dy,
-            dest_extent.xMax() - .5 * dx, dest_extent.yMax() - .5 * dy,
-            srcPointsX, srcPointsY, width, height);
+        // Use a (cached) sparse warp grid when we can, good to a tenth of a
+        // source pixel; otherwise transform every sample point.
+        osg::ref_ptr<WarpGrid> warp;
+        if (width > 1 && height > 1)
+        {
+            double tolerance = 0.1 * osg::minimum(1.0/xfac, 1.0/yfac);
+            warp = getOrCreateWarpGrid(src_extent, dest_extent, width, height, tolerance);
+        }
+
+        if (warp.valid())
+        {
+            warp->interpolate(srcPointsX, srcPointsY, width, height);
+        }
+        else
+        {
+            dest_extent.getSRS()->transformExtentPoints(
+                src_extent.getSRS(),
+                dest_extent.xMin() + .5 * dx, dest_extent.yMin() + .5 * dy,
+                dest_extent.xMax() - .5 * dx, dest_extent.yMax() - .5 * dy,
+                srcPointsX, srcPointsY, width, height);
+        }
 
         ImageUtils::PixelReader ia(image);
         osg::Vec4 color;
@@ -2096,16 +2261,17 @@ namespace
         osg::Vec4 ulColor;
         osg::Vec4 lrColor;
 
-        double xfac = (image->s() - 1) / src_extent.width();
-        double yfac = (image->t() - 1) / src_extent.height();
+        // Nearest-neighbor sampling of an uncompressed image is a straight
+        // copy of the source pixel's bytes.
+        const unsigned pixelBits = image->getPixelSizeInBits();
+        const bool copyPixels = !interpolate && !ImageUtils::isCompressed(image) && (pixelBits % 8u) == 0u;
+        const unsigned pixelBytes = pixelBits / 8u;
 
         for (int depth = 0; depth < image->r(); depth++)
         {
            // Next, go through the source-SRS sample grid, read the color at each point from the source image,
            // and write it to the corresponding pixel in the destination image.
            int pixel = 0;
-           double xfac = (image->s() - 1) / src_extent.width();
-           double yfac = (image->t() - 1) / src_extent.height();
            for (unsigned int c = 0; c < width; ++c)
            {
               for (unsigned int r = 0; r < height; ++r)
@@ -2127,9 +2293,14 @@ namespace
                  int px_i = osg::clampBetween((int)osg::round(px), 0, image->s() - 1);
                  int py_i = osg::clampBetween((int)osg::round(py), 0, image->t() - 1);
 
-                 color.set(0,0,0,0);
-
                  // TODO: consider this again later. Causes blockiness.
+                 if (copyPixels)
+                 {
+                    memcpy(result->data(c, r, depth), image->data(px_i, py_i, depth), pixelBytes);
+                    pixel++;
+                    continue;
+                 }
+
                  if (!interpolate) //! isSrcContiguous ) // non-contiguous space- use nearest neighbot
                  {
                     ia(color, px_i, py_i, depth);
@@ -2150,46 +2321,14 @@ namespace
                     ia(ulColor, colMin, rowMax, depth);
                     ia(lrColor, colMax, rowMin, depth);
 
-                    /*Bilinear interpolation*/
-                    //Check for exact value
-                    if ((colMax == colMin) && (rowMax == rowMin))
-                    {
-                       //OE_NOTICE << "[osgEarth::GeoData] Exact value" << std::endl;
-                       ia(color, px_i, py_i, depth);
-                    }
-                    else if (colMax == colMin)
-                    {
-                       //OE_NOTICE << "[osgEarth::GeoData] Vertically" << std::endl;
-                       //Linear interpolate vertically
-                       for (unsigned int i = 0; i < 4; ++i)
-                       {
-                          color[i] = ((float)rowMax - py) * llColor[i] + (py - (float)rowMin) * ulColor[i];
-                       }
-                    }
-                    else if (rowMax == rowMin)
-                    {
-                       //OE_NOTICE << "[osgEarth::GeoData] Horizontally" << std::endl;
-                       //Linear interpolate horizontally
-                       for (unsigned int i = 0; i < 4; ++i)
-                       {
-                          color[i] = ((float)colMax - px) * llColor[i] + (px - (float)colMin) * lrColor[i];
-                       }
-                    }
-                    else
-                    {
-                       //OE_NOTICE << "[osgEarth::GeoData] Bilinear" << std::endl;
-                       //Bilinear interpolate
-                       float col1 = colMax - px, col2 = px - colMin;
-                       float row1 = rowMax - py, row2 = py - rowMin;
-                       for (unsigned int i = 0; i < 4; ++i)
-                       {
-                          float r1 = col1 * llColor[i] + col2 * lrColor[i];
-                          float r2 = col1 * ulColor[i] + col2 * urColor[i];
-
-                          //OE_INFO << "r1, r2 = " << r1 << " , " << r2 << std::endl;
-                          color[i] = row1 * r1 + row2 * r2;
-                       }
-                    }
+                    // Bilinear interpolation on all four channels at once. When
+                    // the sample sits on a row or column the paired texels are
+                    // the same, so this also covers the exact/linear cases.
+                    float fx = colMax > colMin ? px - (float)colMin : 0.0f;
+                    float fy = rowMax > rowMin ? py - (float)rowMin : 0.0f;
+                    osg::Vec4 bottom = llColor + (lrColor - llColor) * fx;
+                    osg::Vec4 top    = ulColor + (urColor - ulColor) * fx;
+                    color = bottom + (top - bottom) * fy;
                  }
 
                  writer(color, c, r, depth);
@@ -2750,24 +2889,25 @@ GeoHeightField::createSubSample( const GeoExtent& destEx, unsigned int width, un
     dest->setXInterval( dx );
     dest->setYInterval( dy );
 
-    double x, y;
-    int col, row;
-
     double x0 = (destEx.xMin()-_extent.xMin())/_extent.width();
     double y0 = (destEx.yMin()-_extent.yMin())/_extent.height();
 
     double xstep = div / (double)(width-1);
     double ystep = div / (double)(height-1);
-    
-    for( x = x0, col = 0; col < (int)width; x += xstep, col++ )
-    {
-        for( y = y0, row = 0; row < (int)height; y += ystep, row++ )
-        {
-            float height = HeightFieldUtils::getHeightAtNormalizedLocation(
-                _heightField.get(), x, y, interpolation );
-            dest->setHeight( col, row, height );
-        }
-    }
+
+    // normalized locations -> source pixels, then sample the whole grid at once
+    double maxCol = (double)(_heightField->getNumColumns()-1);
+    double maxRow = (double)(_heightField->getNumRows()-1);
+
+    std::vector<double> cols(width), rows(height);
+    for( unsigned col = 0; col < width; ++col )
+        cols[col] = osg::clampBetween(x0 + xstep*(double)col, 0.0, 1.0) * maxCol;
+    for( unsigned row = 0; row < height; ++row )
+        rows[row] = osg::clampBetween(y0 + ystep*(double)row, 0.0, 1.0) * maxRow;
+
+    HeightFieldUtils::getHeightsAtPixels(
+        _heightField.get(), &cols[0], width, &rows[0], height,
+        &dest->getFloatArray()->front(), interpolation );
 
     return GeoHeightField( dest, destEx ); // Q: is the VDATUM accounted for?
 }
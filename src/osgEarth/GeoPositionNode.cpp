@@ -149,6 +149,18 @@ GeoPositionNode::setPosition(const GeoPoint& pos)
     _geoxform->setPosition(pos);
 }
 
+unsigned
+GeoPositionNode::setPositions(GeoPositionNode* const* nodes, const GeoPoint* points, unsigned count)
+{
+    std::vector<GeoTransform*> xforms(count, (GeoTransform*)0L);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (nodes[i])
+            xforms[i] = nodes[i]->_geoxform;
+    }
+    return count > 0 ? GeoTransform::setPositions(&xforms[0], points, count) : 0u;
+}
+
 bool
 GeoPositionNode::getOcclusionCulling() const
 {
@@ -144,14 +144,24 @@ GeoTransform::setPosition(const GeoPoint& position)
 
     // Is this is a relative-Z position, we need to install a terrain callback
     // so we can recompute the altitude when new terrain tiles become available.
+    // It's registered at our location so that only tiles under us call it.
     if (_position.altitudeMode() == ALTMODE_RELATIVE &&
         _autoRecomputeHeights &&
-        !_terrainCallbackInstalled &&
         terrain.valid())
     {
         // The Adapter template auto-destructs, so we never need to remote it manually.
-        terrain->addTerrainCallback( new TerrainCallbackAdapter<GeoTransform>(this) );
-        _terrainCallbackInstalled = true;
+        if (!_terrainCallback.valid())
+            _terrainCallback = new TerrainCallbackAdapter<GeoTransform>(this);
+
+        osg::Vec2d location(p.x(), p.y());
+        if (!_terrainCallbackInstalled || location != _terrainCallbackLocation)
+        {
+            terrain->addTerrainCallback(
+                _terrainCallback.get(),
+                GeoExtent(p.getSRS(), p.x(), p.y(), p.x(), p.y()));
+            _terrainCallbackLocation = location;
+            _terrainCallbackInstalled = true;
+        }
     }
 
     // Finally, assemble the matrix from our position point.
@@ -162,6 +172,99 @@ GeoTransform::setPosition(const GeoPoint& position)
     return true;
 }
 
+unsigned
+GeoTransform::setPositions(GeoTransform* const* xforms, const GeoPoint* points, unsigned count)
+{
+    unsigned numSet = 0u;
+
+    // Absolute points are grouped by their SRS and output SRS, so each group
+    // takes a single array transform; anything else takes the regular path.
+    struct Group
+    {
+        const SpatialReference*  inputSRS;
+        const SpatialReference*  outputSRS;
+        std::vector<osg::Vec3d>  coords;
+        std::vector<unsigned>    indices;
+    };
+    std::vector<Group> groups;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        GeoTransform* xform = xforms[i];
+        const GeoPoint& position = points[i];
+
+        if (!xform || !position.isValid())
+            continue;
+
+        osg::ref_ptr<Terrain> terrain;
+        xform->_terrain.lock(terrain);
+
+        if (terrain.valid() && position.altitudeMode() != ALTMODE_ABSOLUTE)
+        {
+            if (xform->setPosition(position))
+                ++numSet;
+            continue;
+        }
+
+        xform->_position = position;
+
+        if (!terrain.valid() && !xform->_findTerrainInUpdateTraversal)
+        {
+            xform->_findTerrainInUpdateTraversal = true;
+            ADJUST_UPDATE_TRAV_COUNT(xform, +1);
+        }
+
+        const SpatialReference* inputSRS = position.getSRS();
+        const SpatialReference* outputSRS =
+            terrain.valid() && !terrain->getSRS()->isEquivalentTo(inputSRS) ? terrain->getSRS() : inputSRS;
+
+        Group* group = 0L;
+        for (std::vector<Group>::iterator g = groups.begin(); g != groups.end() && !group; ++g)
+        {
+            if (g->inputSRS == inputSRS && g->outputSRS == outputSRS)
+                group = &(*g);
+        }
+        if (!group)
+        {
+            groups.push_back(Group());
+            group = &groups.back();
+            group->inputSRS = inputSRS;
+            group->outputSRS = outputSRS;
+        }
+        group->coords.push_back(position.vec3d());
+        group->indices.push_back(i);
+    }
+
+    for (std::vector<Group>::iterator g = groups.begin(); g != groups.end(); ++g)
+    {
+        if (g->inputSRS != g->outputSRS)
+        {
+            // on partial failure, fall back to one point at a time
+            if (!g->inputSRS->transform(g->coords, g->outputSRS))
+            {
+                for (unsigned k = 0; k < g->indices.size(); ++k)
+                {
+                    if (xforms[g->indices[k]]->setPosition(points[g->indices[k]]))
+                        ++numSet;
+                }
+                continue;
+            }
+        }
+
+        for (unsigned k = 0; k < g->indices.size(); ++k)
+        {
+            osg::Matrixd local2world;
+            if (g->outputSRS->createLocalToWorld(g->coords[k], local2world))
+            {
+                xforms[g->indices[k]]->setMatrix(local2world);
+                ++numSet;
+            }
+        }
+    }
+
+    return numSet;
+}
+
 void
 GeoTransform::onTileUpdate(const TileKey&          key,
                           osg::Node*              node,
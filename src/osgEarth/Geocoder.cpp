@@ -21,6 +21,9 @@
 #include <osgEarth/Metrics>
 #include <osgEarth/Utils>
 #include <osgEarth/Containers>
+#include <osgEarth/JobArena>
+#include <osgEarth/GeometryUtils>
+#include <osgEarth/StringUtils>
 #include "ogr_geocoding.h"
 
 using namespace osgEarth;
@@ -58,27 +61,40 @@ namespace
         void setServiceOption(const std::string& key, const std::string& value);
 
     private:
-        OGRGeocodingSessionH _session;
+        // An OGR session is not thread-safe, so each concurrent search
+        // takes its own from a pool of idle sessions.
+        std::vector<OGRGeocodingSessionH> _idle;
         UnorderedMap<std::string,std::string> _options;
+        unsigned _generation;
+        Threading::Mutex _mutex;
+        OGRGeocodingSessionH createSession();
         void reset();
     };
 
     OGRGeocodeImplementation::OGRGeocodeImplementation() :
-        _session(NULL)
+        _generation(0u)
     {
-        reset();
+        //nop
     }
 
     OGRGeocodeImplementation::~OGRGeocodeImplementation()
     {
-        if (_session)
-            OGRGeocodeDestroySession(_session);
+        reset();
     }
 
     void OGRGeocodeImplementation::reset()
     {
-        if (_session)
-            OGRGeocodeDestroySession(_session);
+        // ASSUME LOCKED (or destructing)
+        for (unsigned i = 0; i < _idle.size(); ++i)
+            OGRGeocodeDestroySession(_idle[i]);
+        _idle.clear();
+        ++_generation;
+    }
+
+    OGRGeocodingSessionH OGRGeocodeImplementation::createSession()
+    {
+        // ASSUME LOCKED
+        OGRGeocodingSessionH session = NULL;
 
         if (_options.empty() == false)
         {
@@ -93,25 +109,55 @@ namespace
             }
             str[c] = 0L;
 
-            _session = OGRGeocodeCreateSession(str);
+            session = OGRGeocodeCreateSession(str);
 
             delete [] str;
         }
         else
         {
-            _session = OGRGeocodeCreateSession(NULL);
+            session = OGRGeocodeCreateSession(NULL);
         }
+
+        return session;
     }
 
     void OGRGeocodeImplementation::setServiceOption(const std::string& name, const std::string& value)
     {
+        Threading::ScopedMutexLock lock(_mutex);
         _options[name] = value;
         reset();
     }
 
     Status OGRGeocodeImplementation::search(const std::string& input,  osg::ref_ptr<FeatureCursor>& output)
     {
-        OGRLayerH layerHandle = OGRGeocode(_session, input.c_str(), NULL, NULL);
+        OGRGeocodingSessionH session;
+        unsigned generation;
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (_idle.empty())
+            {
+                session = createSession();
+            }
+            else
+            {
+                session = _idle.back();
+                _idle.pop_back();
+            }
+            generation = _generation;
+        }
+
+        OGRLayerH layerHandle = session ? OGRGeocode(session, input.c_str(), NULL, NULL) : NULL;
+
+        // return the session to the pool, unless the options changed meanwhile
+        if (session)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (generation == _generation)
+                _idle.push_back(session);
+            else
+                OGRGeocodeDestroySession(session);
+        }
+
         if (!layerHandle)
         {
             return Status(Status::ServiceUnavailable);
@@ -153,9 +199,117 @@ namespace
             }
         }
     };
+
+    // Results are kept in the cache bin as JSON: one child per feature,
+    // with the geometry as WKT and the attributes as strings.
+    std::string encodeResults(const FeatureList& features)
+    {
+        Config conf("geocode");
+        for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+        {
+            Config fconf("feature");
+            if (i->get()->getGeometry())
+                fconf.set("geometry", GeometryUtils::geometryToWKT(i->get()->getGeometry()));
+
+            Config attrs("attributes");
+            const AttributeTable& table = i->get()->getAttrs();
+            for (AttributeTable::const_iterator a = table.begin(); a != table.end(); ++a)
+                attrs.set(a->first, a->second.getString());
+            fconf.add(attrs);
+
+            conf.add(fconf);
+        }
+        return conf.toJSON();
+    }
+
+    bool decodeResults(const std::string& json, FeatureList& features)
+    {
+        Config conf;
+        if (!conf.fromJSON(json))
+            return false;
+
+        osg::ref_ptr<const SpatialReference> srs = SpatialReference::get("wgs84");
+
+        const ConfigSet children = conf.children("feature");
+        for (ConfigSet::const_iterator i = children.begin(); i != children.end(); ++i)
+        {
+            Geometry* geom = 0L;
+            if (i->hasValue("geometry"))
+                geom = GeometryUtils::geometryFromWKT(i->value("geometry"));
+
+            osg::ref_ptr<Feature> feature = new Feature(geom, srs.get());
+
+            const ConfigSet& attrs = i->child("attributes").children();
+            for (ConfigSet::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+                feature->set(a->key(), a->value());
+
+            features.push_back(feature.get());
+        }
+        return true;
+    }
+
+    // Task that runs one batch lookup: from the cache bin if possible,
+    // otherwise from the service.
+    struct GeocodeTask : public TaskRequest
+    {
+        std::string _input;
+        std::string _key;
+        Promise<Geocoder::OutputData> _promise;
+        osg::ref_ptr<Geocoder::Implementation> _impl;
+        osg::ref_ptr<Geocoder::SharedState> _state;
+
+        void operator()(ProgressCallback*)
+        {
+            OE_PROFILING_ZONE_NAMED("Geocode");
+
+            osg::ref_ptr<Geocoder::OutputData> data;
+
+            osg::ref_ptr<CacheBin> bin = _state->_cacheBin.get();
+            if (bin.valid())
+            {
+                ReadResult rr = bin->readString(_key, 0L);
+                FeatureList features;
+                if (rr.succeeded() && decodeResults(rr.getString(), features))
+                {
+                    data = new Geocoder::OutputData(Status::OK(), features);
+                }
+            }
+
+            if (!data.valid())
+            {
+                osg::ref_ptr<FeatureCursor> cursor;
+                Status status = _impl->search(_input, cursor);
+
+                FeatureList features;
+                if (status.isOK() && cursor.valid())
+                    cursor->fill(features);
+
+                data = new Geocoder::OutputData(status, features);
+
+                if (status.isOK() && bin.valid())
+                {
+                    osg::ref_ptr<StringObject> so = new StringObject();
+                    so->setString(encodeResults(features));
+                    bin->write(_key, so.get(), 0L);
+                }
+            }
+
+            // failures are not remembered, so the next request tries again:
+            if (data->_status.isOK())
+                _state->_results.insert(_key, data.get());
+
+            {
+                Threading::ScopedMutexLock lock(_state->_mutex);
+                _state->_inflight.erase(_key);
+            }
+
+            _promise.resolve(data.get());
+        }
+    };
 }
 
-Geocoder::Geocoder()
+Geocoder::Geocoder() :
+    _state(new SharedState())
 {
     setImplementation( new OGRGeocodeImplementation() );
 }
@@ -165,6 +319,93 @@ Geocoder::setServiceOption(const std::string& key, const std::string& value)
 {
     if (_impl)
         _impl->setServiceOption(key, value);
+
+    // results from different service options must not mix
+    Threading::ScopedMutexLock lock(_state->_mutex);
+    _state->_optionsKey += key + "=" + value + ";";
+}
+
+void
+Geocoder::setCacheBin(CacheBin* bin)
+{
+    _state->_cacheBin = bin;
+}
+
+CacheBin*
+Geocoder::getCacheBin() const
+{
+    return _state->_cacheBin.get();
+}
+
+void
+Geocoder::setConcurrency(unsigned value)
+{
+    JobArena::get("oe.geocoder")->setConcurrency(value);
+}
+
+unsigned
+Geocoder::getConcurrency() const
+{
+    return JobArena::get("oe.geocoder")->getConcurrency();
+}
+
+std::vector<Geocoder::Results>
+Geocoder::searchBatch(const std::vector<std::string>& inputs)
+{
+    std::vector<Results> output;
+    output.reserve(inputs.size());
+
+    if (!_impl.valid())
+    {
+        for (unsigned i = 0; i < inputs.size(); ++i)
+        {
+            output.push_back(Results(
+                Status(Status::ServiceUnavailable, "No geocoder implementation installed"),
+                NULL));
+        }
+        return output;
+    }
+
+    JobArena* arena = JobArena::get("oe.geocoder");
+
+    for (unsigned i = 0; i < inputs.size(); ++i)
+    {
+        std::string key;
+        {
+            Threading::ScopedMutexLock lock(_state->_mutex);
+            key = hashToString(_state->_optionsKey + inputs[i]);
+        }
+
+        // already have it?
+        LRUCache<std::string, osg::ref_ptr<OutputData> >::Record record;
+        if (_state->_results.get(key, record))
+        {
+            output.push_back(Results(record.value().get()));
+            continue;
+        }
+
+        Threading::ScopedMutexLock lock(_state->_mutex);
+
+        // already looking for it?
+        std::map<std::string, Future<OutputData> >::iterator f = _state->_inflight.find(key);
+        if (f != _state->_inflight.end())
+        {
+            output.push_back(Results(f->second));
+            continue;
+        }
+
+        GeocodeTask* task = new GeocodeTask();
+        task->_input = inputs[i];
+        task->_key = key;
+        task->_impl = _impl.get();
+        task->_state = _state.get();
+        _state->_inflight[key] = task->_promise.getFuture();
+        output.push_back(Results(task->_promise.getFuture()));
+
+        arena->dispatch(task);
+    }
+
+    return output;
 }
 
 Geocoder::Results
@@ -210,6 +451,12 @@ Geocoder::Results::Results(const Status& status, FeatureCursor* cursor) :
     //NOP - error status
 }
 
+Geocoder::Results::Results(Geocoder::OutputData* data) :
+    FutureResult(data)
+{
+    //NOP - already available
+}
+
 Geocoder::Results::Results(Future<Geocoder::OutputData> data) :
     FutureResult<Geocoder::OutputData>(data)
 {
@@ -225,5 +472,16 @@ Geocoder::Results::getStatus()
 FeatureCursor*
 Geocoder::Results::getFeatures()
 {
-    return _future.get() ? _future.get()->_cursor.get() : NULL;
+    OutputData* data = _future.get();
+    if (!data)
+        return NULL;
+
+    if (data->_cursor.valid())
+        return data->_cursor.get();
+
+    // shared results: give this Results its own cursor over copies
+    if (!_features.valid())
+        _features = new FeatureListCursor(data->_features, true);
+
+    return _features.get();
 }
@@ -43,7 +43,11 @@ double GeodeticLabelingEngine::getResolution() const
 
 void GeodeticLabelingEngine::setResolution(double resolution)
 {
-    _resolution = resolution;
+    if (resolution != _resolution)
+    {
+        _resolution = resolution;
+        dirtyLayout();
+    }
 }
 
 std::string
@@ -90,9 +94,7 @@ GeodeticLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_
         std::string text = getText(p, false);
         GeoPoint eye(wgs84, -180.0 + (double)i * resDegrees, minLat+0.1, 0, ALTMODE_ABSOLUTE);
         window.clampToBottom(p, eye); // also xforms to geographic
-        data.xLabels[xi]->setPosition(p);
-        data.xLabels[xi]->setText(text);
-        data.xLabels[xi]->setNodeMask(~0);
+        showLabel(data.xLabels[xi].get(), p, text);
         xi++;
         if (xi >= data.xLabels.size()) break;
     }
@@ -104,9 +106,7 @@ GeodeticLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_
         std::string text = getText(p, true);
         GeoPoint eye(wgs84, minLon+0.01, -90.0 + (double)i * resDegrees, 0, ALTMODE_ABSOLUTE);
         window.clampToLeft(p, eye); // also xforms to geographic
-        data.yLabels[yi]->setPosition(p);
-        data.yLabels[yi]->setText(text);
-        data.yLabels[yi]->setNodeMask(~0);
+        showLabel(data.yLabels[yi].get(), p, text);
         yi++;
         if (yi >= data.yLabels.size()) break;
     }
@@ -19,6 +19,7 @@
 
 #include <osgEarth/Geoid>
 #include <osgEarth/HeightFieldUtils>
+#include <algorithm>
 
 #define LC "[Geoid] "
 
@@ -91,6 +92,26 @@ Geoid::getHeight(double lat_deg, double lon_deg, const RasterInterpolation& inte
     return result;
 }
 
+void
+Geoid::getHeights(const double* lats_deg, const double* lons_deg, float* out_heights, unsigned count) const
+{
+    if ( !_valid )
+    {
+        std::fill(out_heights, out_heights + count, 0.0f);
+        return;
+    }
+
+    HeightFieldUtils::getHeightsAtLocations(
+        _hf.get(), lons_deg, lats_deg, out_heights, count,
+        _bounds.xMin(), _bounds.yMin(), _hf->getXInterval(), _hf->getYInterval());
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if ( !_bounds.contains(lons_deg[i], lats_deg[i]) || out_heights[i] == NO_DATA_VALUE )
+            out_heights[i] = 0.0f;
+    }
+}
+
 bool
 Geoid::isEquivalentTo( const Geoid& rhs ) const
 {
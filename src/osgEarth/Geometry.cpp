@@ -32,6 +32,8 @@ using namespace osgEarth;
 #  include <geos/operation/buffer/BufferOp.h>
 #  include <geos/operation/buffer/BufferBuilder.h> 
 #  include <geos/operation/overlay/OverlayOp.h>
+#  include <geos/geom/prep/PreparedGeometry.h>
+#  include <geos/geom/prep/PreparedGeometryFactory.h>
 using namespace geos;
 using namespace geos::operation;
 #endif
@@ -40,6 +42,138 @@ using namespace geos::operation;
 
 #define LC "[Geometry] "
 
+#ifdef OSGEARTH_HAVE_GEOS
+namespace
+{
+    bool bufferGEOS(GEOSContext& gc,
+                    const Geometry* input,
+                    double distance,
+                    const BufferParameters& params,
+                    osg::ref_ptr<Geometry>& output)
+    {
+        geom::Geometry* inGeom = gc.importGeometry( input );
+        if ( inGeom )
+        {
+            buffer::BufferParameters::EndCapStyle geosEndCap =
+                params._capStyle == BufferParameters::CAP_ROUND  ? buffer::BufferParameters::CAP_ROUND :
+                params._capStyle == BufferParameters::CAP_SQUARE ? buffer::BufferParameters::CAP_SQUARE :
+                params._capStyle == BufferParameters::CAP_FLAT   ? buffer::BufferParameters::CAP_FLAT :
+                buffer::BufferParameters::CAP_SQUARE;
+
+            buffer::BufferParameters::JoinStyle geosJoinStyle =
+                params._joinStyle == BufferParameters::JOIN_ROUND ? buffer::BufferParameters::JOIN_ROUND :
+                params._joinStyle == BufferParameters::JOIN_MITRE ? buffer::BufferParameters::JOIN_MITRE :
+                params._joinStyle == BufferParameters::JOIN_BEVEL ? buffer::BufferParameters::JOIN_BEVEL :
+                buffer::BufferParameters::JOIN_ROUND;
+
+            //JB:  Referencing buffer::BufferParameters::DEFAULT_QUADRANT_SEGMENTS causes link errors b/c it is defined as a static in the header of BufferParameters.h and not defined in the cpp anywhere.
+            //     This seems to only effect the Linux build, Windows works fine
+            int geosQuadSegs = params._cornerSegs > 0 
+                ? params._cornerSegs
+                : 8; //buffer::BufferParameters::DEFAULT_QUADRANT_SEGMENTS;
+
+            geom::Geometry* outGeom = NULL;
+
+            buffer::BufferParameters geosBufferParams;
+            geosBufferParams.setQuadrantSegments( geosQuadSegs );
+            geosBufferParams.setEndCapStyle( geosEndCap );
+            geosBufferParams.setJoinStyle( geosJoinStyle );
+            buffer::BufferBuilder bufBuilder( geosBufferParams );
+
+            try
+            {
+                if (params._singleSided)
+                {
+                    outGeom = bufBuilder.bufferLineSingleSided(inGeom, distance, params._leftSide);
+                }
+                else
+                {
+                    outGeom = bufBuilder.buffer(inGeom, distance);
+                }
+            }
+            catch(const geos::util::GEOSException& ex)
+            {
+                OE_NOTICE << LC << "buffer(GEOS): "
+                    << (ex.what()? ex.what() : " no error message")
+                    << std::endl;
+                outGeom = 0L;
+            }
+
+            if ( outGeom )
+            {
+                output = gc.exportGeometry( outGeom );
+                gc.disposeGeometry( outGeom );
+            }
+
+            gc.disposeGeometry( inGeom );
+        }
+
+        return output.valid();
+    }
+
+    // Intersects inGeom with cropGeom. On an empty result, output is set to an
+    // empty geometry and the function returns false.
+    bool cropGEOS(GEOSContext& gc,
+                  const geom::Geometry* inGeom,
+                  const geom::Geometry* cropGeom,
+                  osg::ref_ptr<Geometry>& output)
+    {
+        bool success = false;
+
+        geom::Geometry* outGeom = 0L;
+        try {
+            outGeom = overlay::OverlayOp::overlayOp(
+                inGeom,
+                cropGeom,
+                overlay::OverlayOp::opINTERSECTION );
+        }
+        catch (const geos::util::TopologyException& ex) {
+            GEOS_OUT << LC << "Crop(GEOS): "
+                << (ex.what()? ex.what() : " no error message")
+                << std::endl;
+            outGeom = 0L;
+        }
+        catch(const geos::util::GEOSException& ex) {
+            OE_INFO << LC << "Crop(GEOS): "
+                << (ex.what()? ex.what() : " no error message")
+                << std::endl;
+            outGeom = 0L;
+        }
+
+        if ( outGeom )
+        {
+            output = gc.exportGeometry( outGeom );
+
+            if ( output.valid())
+            {
+                if ( output->isValid() )
+                {
+                    success = true;
+                }
+                else
+                {
+                    // GEOS result is invalid
+                    output = 0L;
+                }
+            }
+            else
+            {
+                // set output to empty geometry to indicate the (valid) empty case,
+                // still returning false but allows for check.
+                if (outGeom->getNumPoints() == 0)
+                {
+                    output = new osgEarth::Geometry();
+                }
+            }
+
+            gc.disposeGeometry( outGeom );
+        }
+
+        return success;
+    }
+}
+#endif // OSGEARTH_HAVE_GEOS
+
 
 Geometry::Geometry( const Geometry& rhs ) :
 osgEarth::InlineVector<osg::Vec3d,osg::Referenced>( rhs )
@@ -162,74 +296,44 @@ Geometry::buffer(double distance,
 #ifdef OSGEARTH_HAVE_GEOS   
 
     GEOSContext gc;
+    return bufferGEOS( gc, this, distance, params, output );
 
-    geom::Geometry* inGeom = gc.importGeometry( this );
-    if ( inGeom )
-    {
-        buffer::BufferParameters::EndCapStyle geosEndCap =
-            params._capStyle == BufferParameters::CAP_ROUND  ? buffer::BufferParameters::CAP_ROUND :
-            params._capStyle == BufferParameters::CAP_SQUARE ? buffer::BufferParameters::CAP_SQUARE :
-            params._capStyle == BufferParameters::CAP_FLAT   ? buffer::BufferParameters::CAP_FLAT :
-            buffer::BufferParameters::CAP_SQUARE;
-
-        buffer::BufferParameters::JoinStyle geosJoinStyle =
-            params._joinStyle == BufferParameters::JOIN_ROUND ? buffer::BufferParameters::JOIN_ROUND :
-            params._joinStyle == BufferParameters::JOIN_MITRE ? buffer::BufferParameters::JOIN_MITRE :
-            params._joinStyle == BufferParameters::JOIN_BEVEL ? buffer::BufferParameters::JOIN_BEVEL :
-            buffer::BufferParameters::JOIN_ROUND;
-
-        //JB:  Referencing buffer::BufferParameters::DEFAULT_QUADRANT_SEGMENTS causes link errors b/c it is defined as a static in the header of BufferParameters.h and not defined in the cpp anywhere.
-        //     This seems to only effect the Linux build, Windows works fine
-        int geosQuadSegs = params._cornerSegs > 0 
-            ? params._cornerSegs
-            : 8; //buffer::BufferParameters::DEFAULT_QUADRANT_SEGMENTS;
-
-        geom::Geometry* outGeom = NULL;
-
-        buffer::BufferParameters geosBufferParams;
-        geosBufferParams.setQuadrantSegments( geosQuadSegs );
-        geosBufferParams.setEndCapStyle( geosEndCap );
-        geosBufferParams.setJoinStyle( geosJoinStyle );
-        buffer::BufferBuilder bufBuilder( geosBufferParams );
-
-        try
-        {
-            if (params._singleSided)
-            {
-                outGeom = bufBuilder.bufferLineSingleSided(inGeom, distance, params._leftSide);
-            }
-            else
-            {
-                outGeom = bufBuilder.buffer(inGeom, distance);
-            }
-        }
-        catch(const geos::util::GEOSException& ex)
-        {
-            OE_NOTICE << LC << "buffer(GEOS): "
-                << (ex.what()? ex.what() : " no error message")
-                << std::endl;
-            outGeom = 0L;
-        }
+#else // OSGEARTH_HAVE_GEOS
 
-        bool sharedFactory = 
-            inGeom && outGeom &&
-            inGeom->getFactory() == outGeom->getFactory();
+    OE_WARN << LC << "Buffer failed - GEOS not available" << std::endl;
+    return false;
 
-        if ( outGeom )
-        {
-            output = gc.exportGeometry( outGeom );
-            gc.disposeGeometry( outGeom );
-        }
+#endif // OSGEARTH_HAVE_GEOS
+}
 
-        gc.disposeGeometry( inGeom );
-    }
+unsigned
+Geometry::buffer(const GeometryCollection& input,
+                 double distance,
+                 GeometryCollection& output,
+                 const BufferParameters& params )
+{
+    output.clear();
+    output.resize( input.size() );
 
-    return output.valid();
+#ifdef OSGEARTH_HAVE_GEOS
+
+    // one context (and factory) for the whole batch
+    GEOSContext gc;
+
+    unsigned count = 0u;
+    for( unsigned i=0; i<input.size(); ++i )
+    {
+        if ( input[i].valid() && bufferGEOS( gc, input[i].get(), distance, params, output[i] ) )
+            ++count;
+        else
+            output[i] = 0L;
+    }
+    return count;
 
 #else // OSGEARTH_HAVE_GEOS
 
     OE_WARN << LC << "Buffer failed - GEOS not available" << std::endl;
-    return false;
+    return 0u;
 
 #endif // OSGEARTH_HAVE_GEOS
 }
@@ -248,55 +352,8 @@ Geometry::crop( const Polygon* cropPoly, osg::ref_ptr<Geometry>& output ) const
     geom::Geometry* cropGeom = gc.importGeometry( cropPoly );
 
     if ( inGeom )
-    {    
-        geom::Geometry* outGeom = 0L;
-        try {
-            outGeom = overlay::OverlayOp::overlayOp(
-                inGeom,
-                cropGeom,
-                overlay::OverlayOp::opINTERSECTION );
-        }
-        catch (const geos::util::TopologyException& ex) {
-            GEOS_OUT << LC << "Crop(GEOS): "
-                << (ex.what()? ex.what() : " no error message")
-                << std::endl;
-            outGeom = 0L;
-        }
-        catch(const geos::util::GEOSException& ex) {
-            OE_INFO << LC << "Crop(GEOS): "
-                << (ex.what()? ex.what() : " no error message")
-                << std::endl;
-            outGeom = 0L;
-        }
-
-        if ( outGeom )
-        {
-            output = gc.exportGeometry( outGeom );
-
-            if ( output.valid())
-            {
-                if ( output->isValid() )
-                {
-                    success = true;
-                }
-                else
-                {
-                    // GEOS result is invalid
-                    output = 0L;
-                }
-            }
-            else
-            {
-                // set output to empty geometry to indicate the (valid) empty case,
-                // still returning false but allows for check.
-                if (outGeom->getNumPoints() == 0)
-                {
-                    output = new osgEarth::Geometry();
-                }
-            }
-
-            gc.disposeGeometry( outGeom );
-        }
+    {
+        success = cropGEOS( gc, inGeom, cropGeom, output );
     }
 
     //Destroy the geometry
@@ -1195,3 +1252,204 @@ ConstSegmentIterator::next()
 
     return Segment( p0, *_iter );
 }
+
+//----------------------------------------------------------------------------
+
+#ifdef OSGEARTH_HAVE_GEOS
+struct PreparedGeometry::Impl
+{
+    GEOSContext _gc;
+    geom::Geometry* _geom;
+    const geom::prep::PreparedGeometry* _prepared;
+};
+#else
+struct PreparedGeometry::Impl { };
+#endif
+
+PreparedGeometry::PreparedGeometry(const Geometry* input) :
+_geom(input),
+_impl(0L)
+{
+#ifdef OSGEARTH_HAVE_GEOS
+    // GEOS treats a bare ring as a line; import rings as polygons so the
+    // tests run against the enclosed area, like Ring::contains2D does.
+    osg::ref_ptr<const Geometry> areal = input;
+    if ( input && input->getType() == Geometry::TYPE_RING )
+    {
+        areal = new Polygon( &input->asVector() );
+    }
+    else if ( input && input->getType() == Geometry::TYPE_MULTI && input->getComponentType() == Geometry::TYPE_RING )
+    {
+        osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+        ConstGeometryIterator i( input, false );
+        while( i.hasMore() )
+            multi->add( new Polygon( &i.next()->asVector() ) );
+        areal = multi.get();
+    }
+
+    _impl = new Impl();
+    _impl->_prepared = 0L;
+    _impl->_geom = _impl->_gc.importGeometry( areal.get() );
+    if ( _impl->_geom )
+    {
+        try {
+#if GEOS_VERSION_AT_LEAST(3,8)
+            _impl->_prepared = geom::prep::PreparedGeometryFactory::prepare( _impl->_geom ).release();
+#else
+            _impl->_prepared = geom::prep::PreparedGeometryFactory::prepare( _impl->_geom );
+#endif
+        }
+        catch(const geos::util::GEOSException& ex) {
+            OE_INFO << LC << "Prepare(GEOS): "
+                << (ex.what()? ex.what() : " no error message")
+                << std::endl;
+        }
+    }
+#endif
+}
+
+PreparedGeometry::~PreparedGeometry()
+{
+#ifdef OSGEARTH_HAVE_GEOS
+    // the prepared geometry references _geom, so goes first
+    delete _impl->_prepared;
+    _impl->_gc.disposeGeometry( _impl->_geom );
+#endif
+    delete _impl;
+}
+
+bool
+PreparedGeometry::intersects(const Geometry* other) const
+{
+#ifdef OSGEARTH_HAVE_GEOS
+
+    if ( !_impl->_prepared )
+        return false;
+
+    geom::Geometry* otherGeom = _impl->_gc.importGeometry( other );
+    if ( !otherGeom )
+        return false;
+
+    bool intersects = _impl->_prepared->intersects( otherGeom );
+    _impl->_gc.disposeGeometry( otherGeom );
+    return intersects;
+
+#else // OSGEARTH_HAVE_GEOS
+
+    OE_WARN << LC << "Intersects failed - GEOS not available" << std::endl;
+    return false;
+
+#endif // OSGEARTH_HAVE_GEOS
+}
+
+bool
+PreparedGeometry::contains2D(double x, double y) const
+{
+#ifdef OSGEARTH_HAVE_GEOS
+
+    if ( _impl->_prepared )
+    {
+        osg::ref_ptr<Point> point = new Point();
+        point->set( osg::Vec3d(x, y, 0.0) );
+
+        geom::Geometry* pointGeom = _impl->_gc.importGeometry( point.get() );
+        if ( !pointGeom )
+            return false;
+
+        bool contains = _impl->_prepared->contains( pointGeom );
+        _impl->_gc.disposeGeometry( pointGeom );
+        return contains;
+    }
+
+#endif // OSGEARTH_HAVE_GEOS
+
+    // no GEOS, or it failed to prepare; test the areal parts directly.
+    ConstGeometryIterator i( _geom.get(), false );
+    while( i.hasMore() )
+    {
+        const Geometry* part = i.next();
+        if ( part &&
+            (part->getType() == Geometry::TYPE_RING || part->getType() == Geometry::TYPE_POLYGON) &&
+            static_cast<const Ring*>(part)->contains2D(x, y) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+PreparedGeometry::crop(const Geometry* input, osg::ref_ptr<Geometry>& output) const
+{
+    output = 0L;
+
+#ifdef OSGEARTH_HAVE_GEOS
+
+    if ( !_impl->_geom )
+        return false;
+
+    geom::Geometry* inGeom = _impl->_gc.importGeometry( input );
+    if ( !inGeom )
+        return false;
+
+    bool success = false;
+
+    // Indexed predicates let us skip the overlay for the common cases
+    // of geometry entirely outside or entirely inside the crop area.
+    bool overlay = true;
+    if ( _impl->_prepared )
+    {
+        try {
+            if ( !_impl->_prepared->intersects( inGeom ) )
+            {
+                // valid empty result; see cropGEOS
+                output = new osgEarth::Geometry();
+                overlay = false;
+            }
+            else if ( _impl->_prepared->covers( inGeom ) )
+            {
+                output = input->cloneAs( input->getType() );
+                success = output.valid() && output->isValid();
+                overlay = !success;
+            }
+        }
+        catch(const geos::util::GEOSException& ex) {
+            GEOS_OUT << LC << "Crop(GEOS): "
+                << (ex.what()? ex.what() : " no error message")
+                << std::endl;
+        }
+    }
+
+    if ( overlay )
+    {
+        success = cropGEOS( _impl->_gc, inGeom, _impl->_geom, output );
+    }
+
+    _impl->_gc.disposeGeometry( inGeom );
+
+    return success;
+
+#else // OSGEARTH_HAVE_GEOS
+
+    OE_WARN << LC << "Crop failed - GEOS not available" << std::endl;
+    return false;
+
+#endif // OSGEARTH_HAVE_GEOS
+}
+
+unsigned
+PreparedGeometry::crop(const GeometryCollection& input, GeometryCollection& output) const
+{
+    output.clear();
+    output.resize( input.size() );
+
+    unsigned count = 0u;
+    for( unsigned i=0; i<input.size(); ++i )
+    {
+        if ( input[i].valid() && crop( input[i].get(), output[i] ) )
+            ++count;
+        else
+            output[i] = 0L;
+    }
+    return count;
+}
@@ -34,7 +34,8 @@ _localData(localData),
 _useVertexZ(true),
 _revert(false),
 _scale( 1.0f ),
-_offset( 0.0f )
+_offset( 0.0f ),
+_poolLOD( 23u )
 {
     this->setNodeMaskOverride( ~0 );
     _lsi = new osgUtil::LineSegmentIntersector(osg::Vec3d(0,0,0), osg::Vec3d(0,0,0));
@@ -71,7 +72,7 @@ GeometryClamper::apply(osg::Drawable& drawable)
         return;
     }
     
-    if ( !_terrainSRS.valid() )
+    if ( !_terrainSRS.valid() || (!_pool.valid() && !_terrainPatch.valid()) )
         return;
 
     const osg::Matrixd& local2world = _matrixStack.back();
@@ -79,12 +80,10 @@ GeometryClamper::apply(osg::Drawable& drawable)
     world2local.invert( local2world );
 
     const osg::EllipsoidModel* em = _terrainSRS->getEllipsoid();
-    osg::Vec3d n_vector(0,0,1), start, end, msl;
+    osg::Vec3d n_vector(0,0,1);
 
     bool isGeocentric = _terrainSRS->isGeographic();
 
-    osgUtil::IntersectionVisitor iv( _lsi.get() );
-
     double r = osg::minimum( em->getRadiusEquator(), em->getRadiusPolar() );
 
     unsigned count = 0;
@@ -103,6 +102,23 @@ GeometryClamper::apply(osg::Drawable& drawable)
         storeAltitudes = true;
     }
 
+    // Only honor the region once the original altitudes are stored;
+    // the first clamp has to visit every vertex.
+    GeoExtent region;
+    if (_region.isValid() && !storeAltitudes)
+    {
+        region = _region.getSRS()->isHorizEquivalentTo(_terrainSRS.get()) ? _region : _region.transform(_terrainSRS.get());
+    }
+    bool needMapCoords = region.isValid() || _pool.valid();
+
+    // First pass: find the vertices to clamp, in world and map coordinates.
+    std::vector<unsigned>   indices;
+    std::vector<osg::Vec3d> worldVerts, normals;
+    std::vector<double>     xs, ys;
+    indices.reserve(verts->size());
+    worldVerts.reserve(verts->size());
+    normals.reserve(verts->size());
+
     for( unsigned k=0; k<verts->size(); ++k )
     {
         osg::Vec3d vw = (*verts)[k];
@@ -131,36 +147,98 @@ GeometryClamper::apply(osg::Drawable& drawable)
             }
         }
 
-        _lsi->reset();
-        _lsi->setStart( vw + n_vector*r*_scale );
-        _lsi->setEnd( vw - n_vector*r );
-        _lsi->setIntersectionLimit( _lsi->LIMIT_NEAREST );
+        if ( needMapCoords )
+        {
+            osg::Vec3d map;
+            if ( !_terrainSRS->transformFromWorld(vw, map) )
+                continue;
+
+            // terrain outside the region didn't change, so neither would the vertex
+            if ( region.isValid() && !region.contains(map.x(), map.y()) )
+                continue;
+
+            xs.push_back( map.x() );
+            ys.push_back( map.y() );
+        }
+
+        indices.push_back( k );
+        worldVerts.push_back( vw );
+        normals.push_back( n_vector );
+    }
+
+    if ( indices.empty() )
+        return;
+
+    // Second pass: find the terrain under each of those vertices.
+    std::vector<osg::Vec3d> hits( indices.size() );
+    std::vector<bool>       found( indices.size(), false );
+
+    if ( _pool.valid() )
+    {
+        if ( !_envelope.valid() )
+            _envelope = _pool->createEnvelope( _terrainSRS.get(), _poolLOD );
 
-        _terrainPatch->accept( iv );
+        std::vector<float> heights( indices.size() );
+        _envelope->getElevations( &xs[0], &ys[0], &heights[0], indices.size() );
 
-        if ( _lsi->containsIntersections() )
+        for( unsigned i=0; i<indices.size(); ++i )
         {
-            osg::Vec3d fw = _lsi->getFirstIntersection().getWorldIntersectPoint();
-            //if ( _scale != 1.0 )
-            //{
-            //    osg::Vec3d delta = fw - msl;
-            //    fw += delta*_scale;
-            //}
-
-            if ( _offset != 0.0 )
+            if ( heights[i] == NO_DATA_VALUE )
+                continue;
+
+            if ( isGeocentric )
             {
-                fw += n_vector*_offset;
+                found[i] = _terrainSRS->transformToWorld( osg::Vec3d(xs[i], ys[i], heights[i]), hits[i] );
             }
+            else
+            {
+                hits[i].set( worldVerts[i].x(), worldVerts[i].y(), heights[i] );
+                found[i] = true;
+            }
+        }
+    }
+    else
+    {
+        osgUtil::IntersectionVisitor iv( _lsi.get() );
+
+        for( unsigned i=0; i<indices.size(); ++i )
+        {
+            _lsi->reset();
+            _lsi->setStart( worldVerts[i] + normals[i]*r*_scale );
+            _lsi->setEnd( worldVerts[i] - normals[i]*r );
+            _lsi->setIntersectionLimit( _lsi->LIMIT_NEAREST );
+
+            _terrainPatch->accept( iv );
 
-            if (_useVertexZ)
+            if ( _lsi->containsIntersections() )
             {
-                fw += n_vector * (*data._altitudes)[k];
+                hits[i] = _lsi->getFirstIntersection().getWorldIntersectPoint();
+                found[i] = true;
             }
+        }
+    }
+
+    for( unsigned i=0; i<indices.size(); ++i )
+    {
+        if ( !found[i] )
+            continue;
+
+        unsigned k = indices[i];
+        osg::Vec3d fw = hits[i];
 
-            (*verts)[k] = (fw * world2local);
-            geomDirty = true;
-            ++count;
+        if ( _offset != 0.0 )
+        {
+            fw += normals[i]*_offset;
         }
+
+        if (_useVertexZ)
+        {
+            fw += normals[i] * (*data._altitudes)[k];
+        }
+
+        (*verts)[k] = (fw * world2local);
+        geomDirty = true;
+        ++count;
     }
 
     if ( geomDirty )
@@ -184,6 +262,38 @@ GeometryClamper::apply(osg::Drawable& drawable)
     }
 }
 
+//-----------------------------------------------------------------------
+
+bool
+GeometryClamper::DirtyRegion::add(const TileKey& key)
+{
+    bool wasClean = !_dirty;
+    _dirty = true;
+
+    if (!key.valid())
+    {
+        _all = true;
+    }
+    else if (!_all)
+    {
+        if (_extent.isValid())
+            _extent.expandToInclude(key.getExtent());
+        else
+            _extent = key.getExtent();
+    }
+
+    return wasClean;
+}
+
+void
+GeometryClamper::DirtyRegion::reset()
+{
+    _dirty = false;
+    _all = false;
+    _extent = GeoExtent::INVALID;
+}
+
+//-----------------------------------------------------------------------
 
 void
 GeometryClamperCallback::onTileUpdate(const TileKey&          key, 
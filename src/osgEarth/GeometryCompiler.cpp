@@ -36,6 +36,7 @@
 #include <osgEarth/ShaderUtils>
 #include <osgEarth/Utils>
 #include <osgEarth/Metrics>
+#include <osgEarth/JobArena>
 
 #include <osg/MatrixTransform>
 #include <osg/Timer>
@@ -76,7 +77,9 @@ _optimize              ( false ),
 _optimizeVertexOrdering( true ),
 _validate              ( false ),
 _maxPolyTilingAngle    ( 45.0f ),
-_useOSGTessellator     ( false )
+_useOSGTessellator     ( false ),
+_parallelism           ( 1u ),
+_tessellationCache     ( false )
 {
     //nop
 }
@@ -96,7 +99,9 @@ _optimize              ( s_defaults.optimize().value() ),
 _optimizeVertexOrdering( s_defaults.optimizeVertexOrdering().value() ),
 _validate              ( s_defaults.validate().value() ),
 _maxPolyTilingAngle    ( s_defaults.maxPolygonTilingAngle().value() ),
-_useOSGTessellator     (s_defaults.useOSGTessellator().value())
+_useOSGTessellator     (s_defaults.useOSGTessellator().value()),
+_parallelism           ( s_defaults.parallelism().value() ),
+_tessellationCache     ( s_defaults.tessellationCache().value() )
 {
     fromConfig(conf.getConfig());
 }
@@ -105,6 +110,7 @@ void
 GeometryCompilerOptions::fromConfig( const Config& conf )
 {
     conf.get( "max_granularity",  _maxGranularity_deg );
+    conf.get( "max_granularity_error", _maxGranularityError_m );
     conf.get( "merge_geometry",   _mergeGeometry );
     conf.get( "clustering",       _clustering );
     conf.get( "instancing",       _instancing );
@@ -118,6 +124,8 @@ GeometryCompilerOptions::fromConfig( const Config& conf )
     conf.get( "validate", _validate );
     conf.get( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.get( "use_osg_tessellator", _useOSGTessellator);
+    conf.get( "parallelism", _parallelism );
+    conf.get( "tessellation_cache", _tessellationCache );
 
     conf.get( "shader_policy", "disable",  _shaderPolicy, SHADERPOLICY_DISABLE );
     conf.get( "shader_policy", "inherit",  _shaderPolicy, SHADERPOLICY_INHERIT );
@@ -129,6 +137,7 @@ GeometryCompilerOptions::getConfig() const
 {
     Config conf;
     conf.set( "max_granularity",  _maxGranularity_deg );
+    conf.set( "max_granularity_error", _maxGranularityError_m );
     conf.set( "merge_geometry",   _mergeGeometry );
     conf.set( "clustering",       _clustering );
     conf.set( "instancing",       _instancing );
@@ -142,6 +151,8 @@ GeometryCompilerOptions::getConfig() const
     conf.set( "validate", _validate );
     conf.set( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.set( "use_osg_tessellator", _useOSGTessellator);
+    conf.set( "parallelism", _parallelism );
+    conf.set( "tessellation_cache", _tessellationCache );
 
     conf.set( "shader_policy", "disable",  _shaderPolicy, SHADERPOLICY_DISABLE );
     conf.set( "shader_policy", "inherit",  _shaderPolicy, SHADERPOLICY_INHERIT );
@@ -150,6 +161,142 @@ GeometryCompilerOptions::getConfig() const
 }
 
 
+//-----------------------------------------------------------------------
+
+namespace
+{
+    // Smallest partition worth handing to another thread
+    const unsigned MIN_FEATURES_PER_PARTITION = 64u;
+
+    /**
+     * Runs the per-feature filters on contiguous partitions of a feature
+     * list. Each partition gets its own filter instances and its own copy of
+     * the filter context. The calling thread claims partitions along with the
+     * helper threads, so the compile finishes even if no helper is free.
+     */
+    struct PartitionGroup : public osg::Referenced
+    {
+        PartitionGroup() : _next(0u), _remaining(0u),
+            _line(0L), _resample(false), _clamp(false) { }
+
+        void runPartition(FeatureList& features)
+        {
+            FilterContext cx = _context;
+
+            if (_line && _line->tessellation().isSet())
+            {
+                TessellateOperator filter;
+                filter.setNumPartitions(*_line->tessellation());
+                filter.setDefaultGeoInterp(_options.geoInterp().get());
+                cx = filter.push(features, cx);
+            }
+            else if (_line && _line->tessellationSize().isSet())
+            {
+                TessellateOperator filter;
+                filter.setMaxPartitionSize(*_line->tessellationSize());
+                filter.setDefaultGeoInterp(_options.geoInterp().get());
+                cx = filter.push(features, cx);
+            }
+
+            if (_resample)
+            {
+                ResampleFilter resample;
+                resample.resampleMode() = *_options.resampleMode();
+                if (_options.resampleMaxLength().isSet())
+                {
+                    resample.maxLength() = *_options.resampleMaxLength();
+                }
+                cx = resample.push(features, cx);
+            }
+
+            if (_clamp)
+            {
+                AltitudeFilter clamp;
+                clamp.setPropertiesFromStyle(_style);
+                cx = clamp.push(features, cx);
+            }
+        }
+
+        //! Claims and runs the next partition; returns false if there are none left.
+        bool runNext()
+        {
+            unsigned index = (++_next) - 1u;
+            if (index >= _partitions.size())
+                return false;
+
+            runPartition(_partitions[index]);
+
+            if (--_remaining == 0u)
+                _done.set();
+
+            return true;
+        }
+
+        void runAndWait()
+        {
+            while (runNext());
+            _done.wait();
+        }
+
+        std::vector<FeatureList> _partitions;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+
+        GeometryCompilerOptions _options;
+        FilterContext _context;
+        Style _style;
+        const LineSymbol* _line;
+        bool _resample;
+        bool _clamp;
+    };
+
+    struct PartitionTask : public TaskRequest
+    {
+        PartitionTask(PartitionGroup* group) : _group(group) { }
+
+        void operator()(ProgressCallback*)
+        {
+            while (_group->runNext());
+        }
+
+        osg::ref_ptr<PartitionGroup> _group;
+    };
+
+    //! Splits the features into partitions, runs them, and splices them back
+    //! together in their original order.
+    void runPartitioned(PartitionGroup* group, FeatureList& features, unsigned numPartitions)
+    {
+        unsigned perPartition = (features.size() + numPartitions - 1u) / numPartitions;
+
+        group->_partitions.resize(numPartitions);
+        for (unsigned p = 0; p < numPartitions && !features.empty(); ++p)
+        {
+            FeatureList::iterator end = features.begin();
+            std::advance(end, osg::minimum(perPartition, (unsigned)features.size()));
+            group->_partitions[p].splice(group->_partitions[p].end(), features, features.begin(), end);
+            ++group->_remaining;
+        }
+        group->_partitions.resize(group->_remaining);
+
+        JobArena* arena = JobArena::get("oe.geometrycompiler");
+        if (arena->getConcurrency() < numPartitions - 1u)
+            arena->setConcurrency(numPartitions - 1u);
+
+        for (unsigned i = 1; i < numPartitions; ++i)
+        {
+            arena->dispatch(new PartitionTask(group));
+        }
+
+        group->runAndWait();
+
+        for (unsigned p = 0; p < group->_partitions.size(); ++p)
+        {
+            features.splice(features.end(), group->_partitions[p]);
+        }
+    }
+}
+
 //-----------------------------------------------------------------------
 
 GeometryCompiler::GeometryCompiler()
@@ -259,8 +406,29 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     const ModelSymbol*     model     = style.get<ModelSymbol>();
     const RenderSymbol*    render    = style.get<RenderSymbol>();
 
+    // check whether we need to do elevation clamping:
+    bool altRequired =
+        _options.ignoreAltitudeSymbol() != true &&
+        altitude && (
+            altitude->clamping() != AltitudeSymbol::CLAMP_NONE ||
+            altitude->verticalOffset().isSet() ||
+            altitude->verticalScale().isSet() ||
+            altitude->script().isSet() );    
+
+    // Partition a large feature list across threads for the per-feature filters.
+    // Script engines are not thread-safe, so anything that might run a script
+    // stays on this thread.
+    unsigned numPartitions = osg::minimum(
+        _options.parallelism().get(),
+        (unsigned)workingSet.size() / MIN_FEATURES_PER_PARTITION);
+
+    bool parallel =
+        numPartitions > 1u &&
+        (sharedCX.getSession() == 0L || sharedCX.getSession()->getScriptEngine() == 0L) &&
+        !(altitude && altitude->script().isSet());
+
     // Perform tessellation first.
-    if ( line )
+    if ( line && !parallel )
     {
         if ( line->tessellation().isSet() )
         {
@@ -311,8 +479,34 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         }
     }
 
+    if ( parallel )
+    {
+        osg::ref_ptr<PartitionGroup> group = new PartitionGroup();
+        group->_options = _options;
+        group->_context = sharedCX;
+        group->_style = style;
+        group->_line = line && (line->tessellation().isSet() || line->tessellationSize().isSet()) ? line : 0L;
+        group->_resample = _options.resampleMode().isSet();
+
+        // the extrusion and simple geometry paths clamp before anything else
+        // touches the features, so the clamp can happen here.
+        group->_clamp = altRequired && !model && (extrusion || point || line || polygon);
+
+        runPartitioned(group.get(), workingSet, numPartitions);
+
+        if ( trackHistory )
+        {
+            if ( group->_line ) history.push_back( "tessellation" );
+            if ( group->_resample ) history.push_back( "resample" );
+            if ( group->_clamp ) history.push_back( "altitude" );
+        }
+
+        if ( group->_clamp )
+            altRequired = false;
+    }
+
     // resample the geometry if necessary:
-    if (_options.resampleMode().isSet())
+    else if (_options.resampleMode().isSet())
     {
         ResampleFilter resample;
         resample.resampleMode() = *_options.resampleMode();        
@@ -323,15 +517,6 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         sharedCX = resample.push( workingSet, sharedCX ); 
         if ( trackHistory ) history.push_back( "resample" );
     }    
-    
-    // check whether we need to do elevation clamping:
-    bool altRequired =
-        _options.ignoreAltitudeSymbol() != true &&
-        altitude && (
-            altitude->clamping() != AltitudeSymbol::CLAMP_NONE ||
-            altitude->verticalOffset().isSet() ||
-            altitude->verticalScale().isSet() ||
-            altitude->script().isSet() );    
 
     // instance substitution (replaces marker)
     if ( model )
@@ -436,8 +621,12 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         BuildGeometryFilter filter( style );
 
         filter.maxGranularity() = *_options.maxGranularity();
+        filter.parallelism()    = *_options.parallelism();
+        if ( _options.maxGranularityError().isSet() )
+            filter.maxGranularityError() = *_options.maxGranularityError();
         filter.geoInterp()      = *_options.geoInterp();
         filter.useOSGTessellator() = *_options.useOSGTessellator();
+        filter.tessellationCache() = *_options.tessellationCache();
 
         if (_options.maxPolygonTilingAngle().isSet())
             filter.maxPolygonTilingAngle() = *_options.maxPolygonTilingAngle();
@@ -64,7 +64,9 @@ namespace
 
 //........................................................................
 
-GraticuleLabelingEngine::GraticuleLabelingEngine(const SpatialReference* srs)
+GraticuleLabelingEngine::GraticuleLabelingEngine(const SpatialReference* srs) :
+_pixelThreshold(1.0f),
+_layoutRevision(0u)
 {
     _srs = srs;
 
@@ -116,6 +118,7 @@ GraticuleLabelingEngine::setStyles(const Style& xStyle, const Style& yStyle)
 {
     _xLabelStyle = xStyle;
     _yLabelStyle = yStyle;
+    dirtyLayout();
 
     UpdateLabelStyles update(_xLabelStyle, _yLabelStyle);
     _cameraDataMap.forEach(update);
@@ -172,6 +175,15 @@ GraticuleLabelingEngine::cullTraverse(osgUtil::CullVisitor& nv, CameraData& data
         return false;
 #endif
 
+    osg::Matrix MVP = (*nv.getModelViewMatrix()) * cam->getProjectionMatrix();
+
+    // If the view hasn't moved the frustum corners by more than the threshold,
+    // keep the labels from last time.
+    if (layoutStillValid(MVP, nv.getViewport(), data))
+        return data.visible;
+
+    data.layoutValid = false;
+
     // Initialize the label pool for this camera if we have not done so:
     if (data.xLabels.empty())
     {
@@ -209,7 +221,6 @@ GraticuleLabelingEngine::cullTraverse(osgUtil::CullVisitor& nv, CameraData& data
     // for displaying the extent of the current view.
 
     // Calculate the "clip to world" matrix = MVPinv.
-    osg::Matrix MVP = (*nv.getModelViewMatrix()) * cam->getProjectionMatrix();
     osg::Matrix MVPinv;
     MVPinv.invert(MVP);
 
@@ -246,7 +257,59 @@ GraticuleLabelingEngine::cullTraverse(osgUtil::CullVisitor& nv, CameraData& data
     // Use this for clamping geopoints to the edges of the frustum:
     ClipSpace window(MVP, MVPinv);
 
-    return updateLabels(LL_world, UL_world, LR_world, window, data);
+    bool visible = updateLabels(LL_world, UL_world, LR_world, window, data);
+
+    const osg::Viewport* vp = nv.getViewport();
+    if (vp && _pixelThreshold > 0.0f)
+    {
+        data.LL_world = LL_world;
+        data.UL_world = UL_world;
+        data.LR_world = LR_world;
+        data.viewport.set(vp->x(), vp->y(), vp->width(), vp->height());
+        data.layoutRevision = _layoutRevision;
+        data.layoutValid = true;
+    }
+
+    return visible;
+}
+
+bool
+GraticuleLabelingEngine::layoutStillValid(const osg::Matrix& MVP, const osg::Viewport* vp, const CameraData& data) const
+{
+    if (!data.layoutValid || !vp || _pixelThreshold <= 0.0f || data.layoutRevision != _layoutRevision)
+        return false;
+
+    if (data.viewport != osg::Vec4d(vp->x(), vp->y(), vp->width(), vp->height()))
+        return false;
+
+    // Where the last layout's corners land now, versus the clip-space
+    // corners they were computed for:
+    const osg::Vec3d world[3] = { data.LL_world, data.UL_world, data.LR_world };
+    const osg::Vec2d corner[3] = { osg::Vec2d(-1,-1), osg::Vec2d(-1,+1), osg::Vec2d(+1,-1) };
+
+    double halfWidth = 0.5*vp->width(), halfHeight = 0.5*vp->height();
+    double threshold2 = _pixelThreshold*_pixelThreshold;
+
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        osg::Vec4d clip = osg::Vec4d(world[i], 1.0) * MVP;
+        if (clip.w() <= 0.0)
+            return false;
+        double dx = (clip.x()/clip.w() - corner[i].x()) * halfWidth;
+        double dy = (clip.y()/clip.w() - corner[i].y()) * halfHeight;
+        if (dx*dx + dy*dy > threshold2)
+            return false;
+    }
+    return true;
+}
+
+void
+GraticuleLabelingEngine::showLabel(LabelNode* label, const GeoPoint& position, const std::string& text) const
+{
+    label->setPosition(position);
+    if (label->getText() != text)
+        label->setText(text);
+    label->setNodeMask(~0);
 }
 
 bool GraticuleLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_world, osg::Vec3d& LR_world, ClipSpace& clipSpace, CameraData& data)
@@ -0,0 +1,61 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "GraticuleNodeCache"
+#include <osgEarth/StringUtils>
+
+#define LC "[GraticuleNodeCache] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+GraticuleNodeCache::GraticuleNodeCache(unsigned maxSize) :
+_cache(true, maxSize)
+{
+    //nop
+}
+
+std::string
+GraticuleNodeCache::makeKey(const std::string& grid, const std::string& cell, const Style& style)
+{
+    unsigned styleHash = hashString(style.getConfig().toJSON());
+    return Stringify() << grid << '/' << cell << '/' << std::hex << styleHash;
+}
+
+osg::Node*
+GraticuleNodeCache::get(const std::string& key)
+{
+    LRUCache<std::string, osg::ref_ptr<osg::Node> >::Record rec;
+    return _cache.get(key, rec) ? rec.value().get() : 0L;
+}
+
+void
+GraticuleNodeCache::insert(const std::string& key, osg::Node* node)
+{
+    if (node)
+        _cache.insert(key, node);
+}
+
+void
+GraticuleNodeCache::clear()
+{
+    _cache.clear();
+}
@@ -22,10 +22,86 @@
 #include <osgEarth/HTM>
 #include <osgEarth/LabelNode>
 #include <osgEarth/DrapeableNode>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+namespace
+{
+    // the base manifold of 8 CCW triangles (unit sphere)
+    void getBaseTriangle(unsigned i, osg::Vec3d* v)
+    {
+        static const osg::Vec3d p[6] = {
+            osg::Vec3d( 0,  0,  1),     // lat= 90  long=  0
+            osg::Vec3d( 1,  0,  0),     // lat=  0  long=  0
+            osg::Vec3d( 0,  1,  0),     // lat=  0  long= 90
+            osg::Vec3d(-1,  0,  0),     // lat=  0  long=180
+            osg::Vec3d( 0, -1,  0),     // lat=  0  long=-90
+            osg::Vec3d( 0,  0, -1) };   // lat=-90  long=  0
+
+        static const unsigned index[8][3] = {
+            {0,1,2}, {0,2,3}, {0,3,4}, {0,4,1},
+            {5,1,4}, {5,4,3}, {5,3,2}, {5,2,1} };
+
+        v[0] = p[index[i][0]];
+        v[1] = p[index[i][1]];
+        v[2] = p[index[i][2]];
+    }
+
+    // same test as HTMNode::Triangle::contains, without building a polytope
+    inline bool inTriangle(const osg::Vec3d& p, const osg::Vec3d& a, const osg::Vec3d& b, const osg::Vec3d& c)
+    {
+        return ((a^b)*p) >= 0.0 && ((b^c)*p) >= 0.0 && ((c^a)*p) >= 0.0;
+    }
+
+    // Computes the HTM path of point p: the base triangle index followed by
+    // two bits per level naming the subcell, in the same order as HTMNode::split.
+    bool makeKey(const osg::Vec3d& p, unsigned long long& key)
+    {
+        osg::Vec3d v[3];
+        unsigned base;
+        for (base = 0; base < 8; ++base)
+        {
+            getBaseTriangle(base, v);
+            if (inTriangle(p, v[0], v[1], v[2]))
+                break;
+        }
+        if (base == 8)
+            return false;
+
+        key = base;
+
+        for (unsigned level = 0; level < HTMNode::KEY_LEVELS; ++level)
+        {
+            osg::Vec3d w0 = v[0] + v[1]; w0.normalize();
+            osg::Vec3d w1 = v[1] + v[2]; w1.normalize();
+            osg::Vec3d w2 = v[2] + v[0]; w2.normalize();
+
+            const osg::Vec3d c[4][3] = {
+                { v[0], w0, w2 },
+                { v[1], w1, w0 },
+                { v[2], w2, w1 },
+                { w0,   w1, w2 } };
+
+            // same search order as HTMNode::pickSubcell
+            unsigned k = 3;
+            for (int j = 3; j >= 0; --j)
+            {
+                if (inTriangle(p, c[j][0], c[j][1], c[j][2]))
+                {
+                    k = j;
+                    break;
+                }
+            }
+
+            key = (key << 2) | k;
+            v[0] = c[k][0]; v[1] = c[k][1]; v[2] = c[k][2];
+        }
+        return true;
+    }
+}
+
 //-----------------------------------------------------------------------
 
 #undef  LC
@@ -94,6 +170,7 @@ _settings(settings)
     setName(id);
 
     _isLeaf = true;
+    _numObjects = 0u;
     _tri.set( v0, v1, v2 );
 
     if (settings._debugGeom)
@@ -141,6 +218,14 @@ HTMNode::traverse(osg::NodeVisitor& nv)
 {
     if ( nv.getVisitorType() == nv.CULL_VISITOR )
     {
+        // nothing to draw under an empty cell, so skip the range test
+        if (_numObjects == 0u)
+        {
+            if (_debug.valid())
+                _debug->accept(nv);
+            return;
+        }
+
         //OE_INFO << getName() << std::endl;
 #if 0
         if ( _isLeaf )
@@ -194,8 +279,23 @@ HTMNode::traverse(osg::NodeVisitor& nv)
     }
 }
 
+HTMNode*
+HTMNode::pickSubcell(const osg::Vec3d& p) const
+{
+    for (int i = 3; i >= 0; --i)
+    {
+        HTMNode* child = getSubcell(i);
+        if (child->contains(p))
+            return child;
+    }
+
+    // p is on an edge and numerical error put it outside all four;
+    // use the center cell rather than drop the object.
+    return getSubcell(3);
+}
+
 void
-HTMNode::insert(osg::Node* node)
+HTMNode::insert(osg::Node* node, const osg::Vec3d& p)
 {
     if ( _isLeaf )
     {
@@ -206,32 +306,128 @@ HTMNode::insert(osg::Node* node)
         if ((underMaxCellSize && roomForMoreObjects) || reachedMinCellSize)
         {
             addChild( node );
+            ++_numObjects;
         }
 
         else
         {
             split();
-            insert( node );
+            insert( node, p );
         }
     }
 
     else
     {
-        const osg::Vec3d& p = node->getBound().center();
+        pickSubcell(p)->insert(node, p);
+        ++_numObjects;
+    }
+}
+
+void
+HTMNode::insert(Entries::iterator first, Entries::iterator last, unsigned level)
+{
+    unsigned count = last - first;
+    if (count == 0u)
+        return;
+
+    if ( _isLeaf )
+    {
+        osg::BoundingSphere bs = getBound();
+        for (Entries::iterator i = first; i != last; ++i)
+            bs.expandBy(i->_node->getBound());
+
+        bool roomForMoreObjects = (getNumChildren() + count <= _settings._maxObjectsPerCell);
+        bool underMaxCellSize = bs.radius()*2.0 < _settings._maxCellSize;
+        bool reachedMinCellSize = bs.radius()*2.0 <= _settings._minCellSize;
 
-        // last four children are the subcells
-        for (int i = _children.size() - 1; i >= _children.size()-4; --i)
+        if ((underMaxCellSize && roomForMoreObjects) || reachedMinCellSize || level >= KEY_LEVELS)
         {
-            HTMNode* child = dynamic_cast<HTMNode*>(_children[i].get());
-            if ( child && child->contains(p) )
-            {
-                child->insert(node);
-                break;
-            }
+            _children.reserve(_children.size() + count);
+            for (Entries::iterator i = first; i != last; ++i)
+                addChild(i->_node);
+            _numObjects += count;
+            return;
         }
+
+        split();
     }
+
+    // The entries are sorted by key, so the objects for each
+    // subcell form a contiguous run.
+    unsigned shift = 2u * (KEY_LEVELS - 1u - level);
+    Entries::iterator runStart = first;
+    while (runStart != last)
+    {
+        unsigned k = (runStart->_key >> shift) & 3u;
+        Entries::iterator runEnd = runStart;
+        while (runEnd != last && ((runEnd->_key >> shift) & 3u) == k)
+            ++runEnd;
+
+        getSubcell(k)->insert(runStart, runEnd, level + 1u);
+        runStart = runEnd;
+    }
+
+    _numObjects += count;
 }
 
+bool
+HTMNode::remove(osg::Node* node, const osg::Vec3d& p)
+{
+    unsigned numLocal = getNumLocalObjects();
+    for (unsigned i = 0; i < numLocal; ++i)
+    {
+        if (_children[i].get() == node)
+        {
+            osg::Group::removeChildren(i, 1);
+            --_numObjects;
+            return true;
+        }
+    }
+
+    if (_isLeaf)
+        return false;
+
+    // Look in the subcell containing p first. If the object was
+    // redistributed after it moved, fall back on the others.
+    HTMNode* first = pickSubcell(p);
+    bool removed = first->remove(node, p);
+    for (unsigned i = 0; i < 4 && !removed; ++i)
+    {
+        if (getSubcell(i) != first)
+            removed = getSubcell(i)->remove(node, p);
+    }
+
+    if (removed)
+    {
+        --_numObjects;
+        merge();
+    }
+
+    return removed;
+}
+
+HTMNode*
+HTMNode::find(osg::Node* node, const osg::Vec3d& p)
+{
+    unsigned numLocal = getNumLocalObjects();
+    for (unsigned i = 0; i < numLocal; ++i)
+    {
+        if (_children[i].get() == node)
+            return this;
+    }
+
+    if (_isLeaf)
+        return 0L;
+
+    HTMNode* first = pickSubcell(p);
+    HTMNode* cell = first->find(node, p);
+    for (unsigned i = 0; i < 4 && !cell; ++i)
+    {
+        if (getSubcell(i) != first)
+            cell = getSubcell(i)->find(node, p);
+    }
+    return cell;
+}
 
 void
 HTMNode::split()
@@ -249,25 +445,11 @@ HTMNode::split()
     c[2] = new HTMNode(_settings, _tri._v[2], w[2], w[1], Stringify() << getName() << "2");
     c[3] = new HTMNode(_settings, w[0], w[1], w[2], Stringify() << getName() << "3");
     
+    osg::NodeList objects;
     if (_settings._storeObjectsInLeavesOnly == true)
     {
-        // distribute the data amongst the children
-        for(osg::NodeList::iterator i = _children.begin(); i != _children.end(); ++i)
-        {
-            osg::Node* node = i->get();        
-            const osg::Vec3d& p = node->getBound().center();
-
-            for(unsigned j=0; j<4; ++j)
-            {
-                if ( c[j]->contains(p) )
-                {
-                    c[j]->insert( node );
-                    break;
-                }
-            }
-        }
-
         // remove the leaves from this node
+        objects = _children;
         osg::Group::removeChildren(0, getNumChildren());
     }
 
@@ -277,9 +459,67 @@ HTMNode::split()
         osg::Group::addChild( c[i] );
     }
 
+    // distribute the data amongst the children
+    for(osg::NodeList::iterator i = objects.begin(); i != objects.end(); ++i)
+    {
+        osg::Node* node = i->get();
+        pickSubcell(node->getBound().center())->insert( node, node->getBound().center() );
+    }
+
     _isLeaf = false;
 }
 
+void
+HTMNode::merge()
+{
+    // Wait until the cell is half empty before merging, so that adding and
+    // removing objects near the limit doesn't split and merge every time.
+    if (_isLeaf || _numObjects > _settings._maxObjectsPerCell/2)
+        return;
+
+    // subcells merge from the bottom up as objects leave them
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        if (!getSubcell(i)->_isLeaf)
+            return;
+    }
+
+    osg::NodeList objects;
+    objects.reserve(_numObjects);
+    osg::BoundingSphere bs;
+
+    for (unsigned i = 0; i < getNumLocalObjects(); ++i)
+    {
+        bs.expandBy(_children[i]->getBound());
+    }
+
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        HTMNode* sub = getSubcell(i);
+        for (unsigned j = 0; j < sub->getNumChildren(); ++j)
+        {
+            objects.push_back(sub->getChild(j));
+            bs.expandBy(sub->getChild(j)->getBound());
+        }
+    }
+
+    // don't merge objects that would make this cell split again right away
+    double size = bs.radius()*2.0;
+    if (size >= _settings._maxCellSize && size > _settings._minCellSize)
+        return;
+
+    OE_DEBUG << LC << "Merging htmid:" << getName() << std::endl;
+
+    osg::Group::removeChildren(getNumChildren() - 4, 4);
+
+    for (osg::NodeList::iterator i = objects.begin(); i != objects.end(); ++i)
+    {
+        osg::Group::addChild(i->get());
+    }
+
+    _isLeaf = true;
+}
+
 //-----------------------------------------------------------------------
 
 HTMGroup::HTMGroup()
@@ -301,33 +541,24 @@ void
 HTMGroup::reinitialize()
 {
     _children.clear();
-
-    double rx = 1.0;
-    double ry = 1.0;
-    double rz = 1.0;
+    _positions.clear();
 
     // assemble the base manifold of 8 triangles.
-    osg::Vec3d v0( 0,   0,   rz);     // lat= 90  long=  0
-    osg::Vec3d v1( rx,  0,   0);      // lat=  0  long=  0
-    osg::Vec3d v2( 0,   ry,  0);      // lat=  0  long= 90
-    osg::Vec3d v3(-rx,  0,   0);      // lat=  0  long=180
-    osg::Vec3d v4( 0,  -ry,  0);      // lat=  0  long=-90
-    osg::Vec3d v5( 0,   0,  -rz);     // lat=-90  long=  0
-
-    // CCW triangles.
-    osg::Group::addChild( new HTMNode(_settings, v0, v1, v2, "0") );
-    osg::Group::addChild( new HTMNode(_settings, v0, v2, v3, "1") );
-    osg::Group::addChild( new HTMNode(_settings, v0, v3, v4, "2") );
-    osg::Group::addChild( new HTMNode(_settings, v0, v4, v1, "3") );
-    osg::Group::addChild( new HTMNode(_settings, v5, v1, v4, "4") );
-    osg::Group::addChild( new HTMNode(_settings, v5, v4, v3, "5") );
-    osg::Group::addChild( new HTMNode(_settings, v5, v3, v2, "6") );
-    osg::Group::addChild( new HTMNode(_settings, v5, v2, v1, "7") );
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        osg::Vec3d v[3];
+        getBaseTriangle(i, v);
+        osg::Group::addChild( new HTMNode(_settings, v[0], v[1], v[2], Stringify() << i) );
+    }
 }
 
 bool
 HTMGroup::insert(osg::Node* node)
 {
+    // each node is indexed once
+    if (_positions.find(node) != _positions.end())
+        return false;
+
     osg::Vec3d p = node->getBound().center();
     p.normalize(); // need?
 
@@ -338,7 +569,8 @@ HTMGroup::insert(osg::Node* node)
         HTMNode* child = static_cast<HTMNode*>(_children[i].get());
         if ( child->contains(p) )
         {
-            child->insert(node);
+            child->insert(node, p);
+            _positions[node] = p;
             inserted = true;
             break;
         }
@@ -346,6 +578,118 @@ HTMGroup::insert(osg::Node* node)
 
     return inserted;
 }
+
+bool
+HTMGroup::remove(osg::Node* node, const osg::Vec3d& p)
+{
+    for (unsigned i = 0; i < _children.size(); ++i)
+    {
+        HTMNode* child = static_cast<HTMNode*>(_children[i].get());
+        if (child->contains(p) && child->remove(node, p))
+            return true;
+    }
+
+    // not where it was indexed; search everywhere
+    for (unsigned i = 0; i < _children.size(); ++i)
+    {
+        HTMNode* child = static_cast<HTMNode*>(_children[i].get());
+        if (!child->contains(p) && child->remove(node, p))
+            return true;
+    }
+
+    return false;
+}
+
+HTMNode*
+HTMGroup::find(osg::Node* node, const osg::Vec3d& p) const
+{
+    HTMNode* cell = 0L;
+
+    for (unsigned i = 0; i < _children.size() && !cell; ++i)
+    {
+        HTMNode* child = static_cast<HTMNode*>(_children[i].get());
+        if (child->contains(p))
+            cell = child->find(node, p);
+    }
+
+    for (unsigned i = 0; i < _children.size() && !cell; ++i)
+    {
+        HTMNode* child = static_cast<HTMNode*>(_children[i].get());
+        if (!child->contains(p))
+            cell = child->find(node, p);
+    }
+
+    return cell;
+}
+
+unsigned
+HTMGroup::addChildren(const osg::NodeList& children)
+{
+    HTMNode::Entries entries;
+    entries.reserve(children.size());
+
+    for (osg::NodeList::const_iterator i = children.begin(); i != children.end(); ++i)
+    {
+        osg::Node* node = i->get();
+        if (node == 0L || _positions.find(node) != _positions.end())
+            continue;
+
+        HTMNode::Entry entry;
+        entry._node = node;
+        entry._point = node->getBound().center();
+        entry._point.normalize();
+
+        if (makeKey(entry._point, entry._key))
+        {
+            _positions[node] = entry._point;
+            entries.push_back(entry);
+        }
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    // the base triangle index sits above the per-level bits
+    const unsigned shift = 2u * HTMNode::KEY_LEVELS;
+    HTMNode::Entries::iterator runStart = entries.begin();
+    while (runStart != entries.end())
+    {
+        unsigned base = (unsigned)(runStart->_key >> shift);
+        HTMNode::Entries::iterator runEnd = runStart;
+        while (runEnd != entries.end() && (unsigned)(runEnd->_key >> shift) == base)
+            ++runEnd;
+
+        static_cast<HTMNode*>(_children[base].get())->insert(runStart, runEnd, 0u);
+        runStart = runEnd;
+    }
+
+    return entries.size();
+}
+
+bool
+HTMGroup::moveChild(osg::Node* child)
+{
+    Positions::iterator i = _positions.find(child);
+    if (i == _positions.end())
+        return false;
+
+    osg::Vec3d p = child->getBound().center();
+    p.normalize();
+
+    // If the node is still inside its cell, OSG propagates the new bound
+    // on its own and there is nothing to re-index.
+    HTMNode* cell = find(child, i->second);
+    if (cell && cell->contains(p))
+    {
+        i->second = p;
+        return true;
+    }
+
+    osg::ref_ptr<osg::Node> hold = child;
+    remove(child, i->second);
+    _positions.erase(i);
+    return insert(child);
+}
+
 bool 
 HTMGroup::addChild(osg::Node* child)
 {
@@ -358,6 +702,18 @@ HTMGroup::insertChild(unsigned index, osg::Node* child)
     return insert( child );
 }
 
+bool
+HTMGroup::removeChild(osg::Node* child)
+{
+    Positions::iterator i = _positions.find(child);
+    if (i == _positions.end())
+        return false;
+
+    bool removed = remove(child, i->second);
+    _positions.erase(i);
+    return removed;
+}
+
 bool 
 HTMGroup::removeChildren(unsigned pos, unsigned numChildrenToRemove)
 {
@@ -40,9 +40,12 @@ using namespace osgEarth::Util;
 
 namespace osgEarth
 {
+    // Largest body we'll allocate up front on the server's word
+    const std::size_t MAX_RESERVE_BYTES = 64u * 1024u * 1024u;
+
     struct StreamObject
     {
-        StreamObject(std::ostream* stream) : _stream(stream) { }
+        StreamObject(HTTPResponse::Body* stream) : _stream(stream) { }
 
         void write(const char* ptr, size_t realsize)
         {
@@ -56,10 +59,20 @@ namespace osgEarth
             StringVector tized;
             tok.tokenize(header, tized);
             if ( tized.size() >= 2 )
+            {
                 _headers[tized[0]] = tized[1];
+
+                // Size the body buffer once instead of growing it as data arrives
+                if (_stream && osgEarth::ciEquals(tized[0], "Content-Length"))
+                {
+                    std::size_t length = osgEarth::as<std::size_t>(tized[1], 0u);
+                    if (length > 0u && length <= MAX_RESERVE_BYTES)
+                        _stream->reserve(length);
+                }
+            }
         }
 
-        std::ostream* _stream;
+        HTTPResponse::Body* _stream;
         Headers _headers;
         std::string     _resultMimeType;
     };
@@ -341,7 +354,7 @@ HTTPResponse::getNumParts() const {
 
 unsigned int
 HTTPResponse::getPartSize( unsigned int n ) const {
-    return _parts[n]->_size;
+    return _parts[n]->_stream.size();
 }
 
 const std::string&
@@ -402,6 +415,7 @@ namespace
     static long                        s_timeout = 0;
     static long                        s_connectTimeout = 0;
     static float                       s_retryDelay_s = 0.5f;
+    static unsigned                    s_maxConnectionsPerHost = 0u;
 
     // HTTP debugging.
     static bool                        s_HTTP_DEBUG = false;
@@ -416,6 +430,108 @@ namespace
 
 //.........................................................................
 
+namespace
+{
+    // Connections, TLS sessions and DNS lookups shared by the per-thread
+    // CURL handles, so that a thread does not have to open its own
+    // connection and negotiate its own TLS session with every server.
+    struct CURLShare
+    {
+        CURLShare() : _handle(0L) { }
+
+        ~CURLShare()
+        {
+            if (_handle)
+                curl_share_cleanup(_handle);
+        }
+
+        void initialize()
+        {
+            if (_handle)
+                return;
+
+            _handle = curl_share_init();
+            if (_handle)
+            {
+                curl_share_setopt(_handle, CURLSHOPT_LOCKFUNC, &CURLShare::lock);
+                curl_share_setopt(_handle, CURLSHOPT_UNLOCKFUNC, &CURLShare::unlock);
+                curl_share_setopt(_handle, CURLSHOPT_USERDATA, this);
+                curl_share_setopt(_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x071700
+                curl_share_setopt(_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073900
+                curl_share_setopt(_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+            }
+        }
+
+        static void lock(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+        {
+            static_cast<CURLShare*>(userptr)->_mutex[data].lock();
+        }
+
+        static void unlock(CURL*, curl_lock_data data, void* userptr)
+        {
+            static_cast<CURLShare*>(userptr)->_mutex[data].unlock();
+        }
+
+        CURLSH* _handle;
+        Threading::Mutex _mutex[CURL_LOCK_DATA_LAST];
+    };
+
+    static CURLShare s_curlShare;
+
+    // Limits the number of requests in progress to each host.
+    class HostGate
+    {
+    public:
+        //! Waits until there is room for another request to the host, and
+        //! takes it. Returns false if the progress callback cancels first.
+        bool enter(const std::string& host, unsigned max, ProgressCallback* progress)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            unsigned& count = _counts[host];
+            while (count >= max)
+            {
+                if (progress && progress->isCanceled())
+                    return false;
+                _cond.wait(&_mutex, 100);
+            }
+            ++count;
+            return true;
+        }
+
+        //! Gives up a request's room at the host.
+        void leave(const std::string& host)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            std::map<std::string, unsigned>::iterator i = _counts.find(host);
+            if (i != _counts.end() && --i->second == 0u)
+                _counts.erase(i);
+            _cond.broadcast();
+        }
+
+        //! The host (and port) part of a URL
+        static std::string getHost(const std::string& url)
+        {
+            std::string::size_type start = url.find("://");
+            start = start == std::string::npos ? 0 : start + 3;
+            std::string::size_type end = url.find_first_of("/?#", start);
+            return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        }
+
+    private:
+        Threading::Mutex _mutex;
+        OpenThreads::Condition _cond;
+        std::map<std::string, unsigned> _counts;
+    };
+
+    static HostGate s_hostGate;
+}
+
+//.........................................................................
+
 namespace
 {
     class CURLImplementation : public HTTPClient::Implementation
@@ -441,6 +557,22 @@ namespace
             // Note that you must have curl built against zlib to support gzip or deflate encoding.
             curl_easy_setopt( _curl_handle, CURLOPT_ENCODING, "");
 
+            // Reuse connections and TLS sessions across threads.
+            if (s_curlShare._handle)
+            {
+                curl_easy_setopt( _curl_handle, CURLOPT_SHARE, s_curlShare._handle );
+            }
+
+#if LIBCURL_VERSION_NUM >= 0x072f00
+            // Use HTTP/2 where the server offers it over TLS (falls back to
+            // HTTP/1.1 otherwise, or if curl was built without HTTP/2).
+            curl_easy_setopt( _curl_handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x071900
+            // Keep idle connections alive between tile requests.
+            curl_easy_setopt( _curl_handle, CURLOPT_TCP_KEEPALIVE, 1L );
+#endif
+
             osg::ref_ptr< ConfigHandler > curlConfigHandler = HTTPClient::getConfigHandler();
             if (curlConfigHandler.valid()) {
                 curlConfigHandler->onInitialize(_curl_handle);
@@ -654,8 +786,31 @@ namespace
                 configHandler->onGet(_curl_handle);
             }
 
+            // Wait for room at the host, if requests per host are limited.
+            std::string host;
+            if (s_maxConnectionsPerHost > 0u)
+            {
+                host = HostGate::getHost(url);
+                if (!s_hostGate.enter(host, s_maxConnectionsPerHost, progress))
+                {
+                    curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)0);
+                    if (headers)
+                    {
+                        curl_slist_free_all(headers);
+                    }
+                    HTTPResponse canceled(0);
+                    canceled.setCanceled(true);
+                    return canceled;
+                }
+            }
+
             res = curl_easy_perform(_curl_handle);
 
+            if (!host.empty())
+            {
+                s_hostGate.leave(host);
+            }
+
             curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)0 );
             curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)0);
 
@@ -1286,6 +1441,13 @@ HTTPClient::initializeImpl()
     }
     OE_DEBUG << LC << "Setting retry delay to " << s_retryDelay_s << std::endl;
 
+    const char* maxPerHostEnv = getenv("OSGEARTH_HTTP_MAX_CONNECTIONS_PER_HOST");
+    if (maxPerHostEnv)
+    {
+        s_maxConnectionsPerHost = osgEarth::as<unsigned>(std::string(maxPerHostEnv), 0u);
+    }
+    OE_DEBUG << LC << "Setting max connections per host to " << s_maxConnectionsPerHost << std::endl;
+
     _impl->initialize();
 
     _impl->setUserAgent(userAgent.c_str());
@@ -1351,6 +1513,16 @@ float HTTPClient::getRetryDelay()
     return s_retryDelay_s;
 }
 
+void HTTPClient::setMaxConnectionsPerHost(unsigned value)
+{
+    s_maxConnectionsPerHost = value;
+}
+
+unsigned HTTPClient::getMaxConnectionsPerHost()
+{
+    return s_maxConnectionsPerHost;
+}
+
 URLRewriter* HTTPClient::getURLRewriter()
 {
     return s_rewriter.get();
@@ -1376,6 +1548,7 @@ HTTPClient::globalInit()
 {
 #ifndef OSGEARTH_USE_WININET_FOR_HTTP
     curl_global_init(CURL_GLOBAL_ALL);
+    s_curlShare.initialize();
 #endif
 }
 
@@ -1469,6 +1642,21 @@ HTTPClient::doGet(const HTTPRequest&    request,
 
     HTTPResponse response = _impl->doGet(request, options, progress);
 
+    OE_METRICS_COUNT("http.requests", 1);
+    if (!response.isCanceled())
+    {
+        unsigned bytes = 0u;
+        for (unsigned i = 0; i < response.getNumParts(); ++i)
+            bytes += response.getPartSize(i);
+        OE_METRICS_COUNT("http.bytes", bytes);
+        OE_METRICS_SAMPLE("http.latency_ms", response.getDuration() * 1000.0);
+    }
+    if (response.getCodeCategory() == HTTPResponse::CATEGORY_SERVER_ERROR ||
+        response.getCodeCategory() == HTTPResponse::CATEGORY_CLIENT_ERROR)
+    {
+        OE_METRICS_COUNT("http.errors", 1);
+    }
+
     OE_PROFILING_ZONE_TEXT(Stringify() << "response_code " << response.getCode());
     if (response.isCanceled())
     {
@@ -1491,19 +1679,12 @@ HTTPClient::doDownload(const std::string& url, const std::string& filename)
             return false;
 
         unsigned int part_num = response.getNumParts() > 1? 1 : 0;
-        std::istream& input_stream = response.getPartStream( part_num );
+        const HTTPResponse::Body& body = response.getParts()[part_num]->_stream;
 
         std::ofstream fout;
         fout.open(filename.c_str(), std::ios::out | std::ios::binary);
-
-        input_stream.seekg (0, std::ios::end);
-        int length = input_stream.tellg();
-        input_stream.seekg (0, std::ios::beg);
-
-        char *buffer = new char[length];
-        input_stream.read(buffer, length);
-        fout.write(buffer, length);
-        delete[] buffer;
+        if (body.size() > 0u)
+            fout.write(body.data(), body.size());
         fout.close();
         return true;
     }
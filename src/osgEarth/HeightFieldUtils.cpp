@@ -21,9 +21,216 @@
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/CullingUtils>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define OE_HF_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define OE_HF_SIMD_NEON
+#endif
+
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
+namespace
+{
+    // Fetches the four neighboring samples and the fractional offsets for a
+    // bilinear lookup at pixel (c, r), with the same edge clamping and nodata
+    // substitution rules as getHeightAtPixel. Returns false if all four
+    // samples are nodata.
+    inline bool gatherBilinear(
+        const osg::HeightField* hf,
+        double c, double r,
+        float& ll, float& lr, float& ul, float& ur,
+        float& fx, float& fy)
+    {
+        int cols = (int)hf->getNumColumns();
+        int rows = (int)hf->getNumRows();
+
+        c = osg::clampBetween(c, 0.0, (double)(cols-1));
+        r = osg::clampBetween(r, 0.0, (double)(rows-1));
+
+        int c0 = (int)c, r0 = (int)r;
+        int c1 = osg::minimum(c0+1, cols-1);
+        int r1 = osg::minimum(r0+1, rows-1);
+
+        fx = (float)(c - (double)c0);
+        fy = (float)(r - (double)r0);
+
+        ll = hf->getHeight(c0, r0);
+        lr = hf->getHeight(c1, r0);
+        ul = hf->getHeight(c0, r1);
+        ur = hf->getHeight(c1, r1);
+
+        return HeightFieldUtils::validateSamples(ur, ll, ul, lr);
+    }
+
+    // Interpolates four bilinear samples at once.
+    inline void bilinear4(
+        const float* ll, const float* lr, const float* ul, const float* ur,
+        const float* fx, const float* fy,
+        float* out)
+    {
+#if defined(OE_HF_SIMD_SSE2)
+        __m128 vfx = _mm_loadu_ps(fx);
+        __m128 vll = _mm_loadu_ps(ll);
+        __m128 vul = _mm_loadu_ps(ul);
+        __m128 bottom = _mm_add_ps(vll, _mm_mul_ps(vfx, _mm_sub_ps(_mm_loadu_ps(lr), vll)));
+        __m128 top    = _mm_add_ps(vul, _mm_mul_ps(vfx, _mm_sub_ps(_mm_loadu_ps(ur), vul)));
+        __m128 result = _mm_add_ps(bottom, _mm_mul_ps(_mm_loadu_ps(fy), _mm_sub_ps(top, bottom)));
+        _mm_storeu_ps(out, result);
+#elif defined(OE_HF_SIMD_NEON)
+        float32x4_t vfx = vld1q_f32(fx);
+        float32x4_t vll = vld1q_f32(ll);
+        float32x4_t vul = vld1q_f32(ul);
+        float32x4_t bottom = vmlaq_f32(vll, vfx, vsubq_f32(vld1q_f32(lr), vll));
+        float32x4_t top    = vmlaq_f32(vul, vfx, vsubq_f32(vld1q_f32(ur), vul));
+        vst1q_f32(out, vmlaq_f32(bottom, vld1q_f32(fy), vsubq_f32(top, bottom)));
+#else
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            float bottom = ll[k] + fx[k] * (lr[k] - ll[k]);
+            float top    = ul[k] + fx[k] * (ur[k] - ul[k]);
+            out[k] = bottom + fy[k] * (top - bottom);
+        }
+#endif
+    }
+
+    // Bilinear sample from four posts, with getHeightAtPixel's nodata rules:
+    // a post that lies exactly on the sample row/column stands in for its
+    // unused neighbor, and remaining nodata posts take a valid post's value.
+    inline float bilinearWithNoData(float ll, float lr, float ul, float ur, float fx, float fy)
+    {
+        if (fx == 0.0f) { lr = ll; ur = ul; }
+        if (fy == 0.0f) { ul = ll; ur = lr; }
+        if (!HeightFieldUtils::validateSamples(ur, ll, ul, lr))
+            return NO_DATA_VALUE;
+        float bottom = ll + fx * (lr - ll);
+        float top    = ul + fx * (ur - ul);
+        return bottom + fy * (top - bottom);
+    }
+
+    // Samples a heightfield over a grid of pixel coordinates, with one
+    // specialization per interpolation mode so the inner loops carry no
+    // mode switch. The generic version goes through getHeightAtPixel.
+    template<RasterInterpolation INTERP>
+    struct GridSampler
+    {
+        static void run(const osg::HeightField* hf,
+                        const double* cols, unsigned numCols,
+                        const double* rows, unsigned numRows,
+                        float* output)
+        {
+            for (unsigned j = 0; j < numRows; ++j)
+            {
+                float* out = output + j*numCols;
+                for (unsigned i = 0; i < numCols; ++i)
+                    out[i] = HeightFieldUtils::getHeightAtPixel(hf, cols[i], rows[j], INTERP);
+            }
+        }
+    };
+
+    template<>
+    struct GridSampler<INTERP_NEAREST>
+    {
+        static void run(const osg::HeightField* hf,
+                        const double* cols, unsigned numCols,
+                        const double* rows, unsigned numRows,
+                        float* output)
+        {
+            const float* heights = &hf->getFloatArray()->front();
+            const unsigned hfCols = hf->getNumColumns();
+
+            std::vector<unsigned> c(numCols);
+            for (unsigned i = 0; i < numCols; ++i)
+                c[i] = (unsigned)osg::round(cols[i]);
+
+            for (unsigned j = 0; j < numRows; ++j)
+            {
+                const float* in = heights + (unsigned)osg::round(rows[j]) * hfCols;
+                float* out = output + j*numCols;
+                for (unsigned i = 0; i < numCols; ++i)
+                    out[i] = in[c[i]];
+            }
+        }
+    };
+
+    // Also serves INTERP_AVERAGE, which is the same weighting.
+    template<>
+    struct GridSampler<INTERP_BILINEAR>
+    {
+        static void run(const osg::HeightField* hf,
+                        const double* cols, unsigned numCols,
+                        const double* rows, unsigned numRows,
+                        float* output)
+        {
+            const float* heights = &hf->getFloatArray()->front();
+            const int hfCols = (int)hf->getNumColumns();
+            const int hfRows = (int)hf->getNumRows();
+
+            // column posts and weights are the same for every row
+            std::vector<int> c0(numCols), c1(numCols);
+            std::vector<float> fx(numCols);
+            for (unsigned i = 0; i < numCols; ++i)
+            {
+                double c = osg::clampBetween(cols[i], 0.0, (double)(hfCols-1));
+                c0[i] = (int)c;
+                c1[i] = osg::minimum(c0[i]+1, hfCols-1);
+                fx[i] = (float)(c - (double)c0[i]);
+            }
+
+            float ll[4], lr[4], ul[4], ur[4], fy4[4];
+
+            for (unsigned j = 0; j < numRows; ++j)
+            {
+                double r = osg::clampBetween(rows[j], 0.0, (double)(hfRows-1));
+                int r0 = (int)r;
+                int r1 = osg::minimum(r0+1, hfRows-1);
+                float fy = (float)(r - (double)r0);
+                fy4[0] = fy4[1] = fy4[2] = fy4[3] = fy;
+
+                const float* lower = heights + r0*hfCols;
+                const float* upper = heights + r1*hfCols;
+                float* out = output + j*numCols;
+
+                unsigned i = 0;
+
+                // four at a time; a block that touches nodata takes the
+                // scalar path so the vector path needs no per-lane masking
+                for (; i + 4 <= numCols; i += 4)
+                {
+                    bool noData = false;
+                    for (unsigned k = 0; k < 4; ++k)
+                    {
+                        ll[k] = lower[c0[i+k]]; lr[k] = lower[c1[i+k]];
+                        ul[k] = upper[c0[i+k]]; ur[k] = upper[c1[i+k]];
+                        noData |=
+                            ll[k] == NO_DATA_VALUE || lr[k] == NO_DATA_VALUE ||
+                            ul[k] == NO_DATA_VALUE || ur[k] == NO_DATA_VALUE;
+                    }
+
+                    if (!noData)
+                    {
+                        bilinear4(ll, lr, ul, ur, &fx[i], fy4, &out[i]);
+                    }
+                    else
+                    {
+                        for (unsigned k = 0; k < 4; ++k)
+                            out[i+k] = bilinearWithNoData(ll[k], lr[k], ul[k], ur[k], fx[i+k], fy);
+                    }
+                }
+
+                // remainder
+                for (; i < numCols; ++i)
+                {
+                    out[i] = bilinearWithNoData(
+                        lower[c0[i]], lower[c1[i]], upper[c0[i]], upper[c1[i]], fx[i], fy);
+                }
+            }
+        }
+    };
+}
+
 
 bool
 HeightFieldUtils::validateSamples(float &a, float &b, float &c, float &d)
@@ -278,6 +485,80 @@ HeightFieldUtils::getHeightAtLocation(const osg::HeightField* hf, double x, doub
     return getHeightAtPixel(hf, px, py, interpolation);
 }
 
+void
+HeightFieldUtils::getHeightsAtLocations(const osg::HeightField* hf,
+                                        const double* xs, const double* ys,
+                                        float* out_heights, unsigned count,
+                                        double llx, double lly,
+                                        double dx, double dy)
+{
+    float ll[4], lr[4], ul[4], ur[4], fx[4], fy[4];
+    bool valid[4];
+
+    unsigned i = 0;
+
+    // four at a time: scalar gather, vector interpolation
+    for (; i + 4 <= count; i += 4)
+    {
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            valid[k] = gatherBilinear(
+                hf, (xs[i+k] - llx) / dx, (ys[i+k] - lly) / dy,
+                ll[k], lr[k], ul[k], ur[k], fx[k], fy[k]);
+        }
+
+        bilinear4(ll, lr, ul, ur, fx, fy, &out_heights[i]);
+
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            if (!valid[k])
+                out_heights[i+k] = NO_DATA_VALUE;
+        }
+    }
+
+    // remainder
+    for (; i < count; ++i)
+    {
+        if (gatherBilinear(hf, (xs[i] - llx) / dx, (ys[i] - lly) / dy,
+                           ll[0], lr[0], ul[0], ur[0], fx[0], fy[0]))
+        {
+            float bottom = ll[0] + fx[0] * (lr[0] - ll[0]);
+            float top    = ul[0] + fx[0] * (ur[0] - ul[0]);
+            out_heights[i] = bottom + fy[0] * (top - bottom);
+        }
+        else
+        {
+            out_heights[i] = NO_DATA_VALUE;
+        }
+    }
+}
+
+void
+HeightFieldUtils::getHeightsAtPixels(const osg::HeightField* hf,
+                                     const double* cols, unsigned numCols,
+                                     const double* rows, unsigned numRows,
+                                     float* output,
+                                     RasterInterpolation interp)
+{
+    if (!hf || numCols == 0 || numRows == 0)
+        return;
+
+    // resolve the interpolation mode once, not per sample
+    switch (interp)
+    {
+    case INTERP_NEAREST:
+        GridSampler<INTERP_NEAREST>::run(hf, cols, numCols, rows, numRows, output);
+        break;
+    case INTERP_BILINEAR:
+    case INTERP_AVERAGE:
+        GridSampler<INTERP_BILINEAR>::run(hf, cols, numCols, rows, numRows, output);
+        break;
+    default:
+        GridSampler<INTERP_TRIANGULATE>::run(hf, cols, numCols, rows, numRows, output);
+        break;
+    }
+}
+
 osg::Vec3
 HeightFieldUtils::getNormalAtLocation(const HeightFieldNeighborhood& hood, double x, double y, double llx, double lly, double dx, double dy, RasterInterpolation interp)
 {
@@ -435,18 +716,20 @@ HeightFieldUtils::createSubSample(const osg::HeightField* input,
     // copy over the skirt height, adjusting it for relative tile size.
     dest->setSkirtHeight( input->getSkirtHeight() * div );
 
-    double x, y;
-    int col, row;
-
-    for( x = outputEx.xMin(), col=0; col < numCols; x += dx, col++ )
+    std::vector<double> cols(numCols), rows(numRows);
+    for( int col = 0; col < numCols; ++col )
     {
-        for( y = outputEx.yMin(), row=0; row < numRows; y += dy, row++ )
-        {
-            float height = HeightFieldUtils::getHeightAtLocation( input, x, y, inputEx.xMin(), inputEx.yMin(), xInterval, yInterval, interpolation);
-            dest->setHeight( col, row, height );
-        }
+        double x = outputEx.xMin() + dx*(double)col;
+        cols[col] = osg::clampBetween( (x - inputEx.xMin()) / xInterval, 0.0, (double)(numCols-1) );
+    }
+    for( int row = 0; row < numRows; ++row )
+    {
+        double y = outputEx.yMin() + dy*(double)row;
+        rows[row] = osg::clampBetween( (y - inputEx.yMin()) / yInterval, 0.0, (double)(numRows-1) );
     }
 
+    getHeightsAtPixels( input, &cols[0], numCols, &rows[0], numRows, &dest->getFloatArray()->front(), interpolation );
+
     osg::Vec3d orig( outputEx.xMin(), outputEx.yMin(), input->getOrigin().z() );
     dest->setOrigin( orig );
 
@@ -480,16 +763,13 @@ HeightFieldUtils::resampleHeightField(osg::HeightField*      input,
     output->setYInterval( stepY );
     output->setOrigin( origin );
     
+    std::vector<double> cols(newColumns), rows(newRows);
+    for( int x = 0; x < newColumns; ++x )
+        cols[x] = ((double)x / (double)(newColumns-1)) * (double)(input->getNumColumns() - 1);
     for( int y = 0; y < newRows; ++y )
-    {
-        for( int x = 0; x < newColumns; ++x )
-        {
-            double nx = (double)x / (double)(newColumns-1);
-            double ny = (double)y / (double)(newRows-1);
-            float h = getHeightAtNormalizedLocation( input, nx, ny, interp );
-            output->setHeight( x, y, h );
-        }
-    }
+        rows[y] = ((double)y / (double)(newRows-1)) * (double)(input->getNumRows() - 1);
+
+    getHeightsAtPixels( input, &cols[0], newColumns, &rows[0], newRows, &output->getFloatArray()->front(), interp );
 
     return output;
 }
@@ -45,6 +45,7 @@ ImageLayer::Options::fromConfig(const Config& conf)
     _shared.init( false );
     _coverage.init( false );  
     _reprojectedTileSize.init( 256 );  
+    _cpuColorFilters.init( false );
 
     conf.get( "nodata_image",   _noDataImageFilename );
     conf.get( "shared",         _shared );
@@ -53,6 +54,7 @@ ImageLayer::Options::fromConfig(const Config& conf)
     conf.get( "altitude",       _altitude );
     conf.get( "edge_buffer_ratio", _edgeBufferRatio);
     conf.get( "reprojected_tilesize", _reprojectedTileSize);
+    conf.get( "cpu_color_filters", _cpuColorFilters);
 
     if ( conf.hasValue( "transparent_color" ) )
         _transparentColor = stringToColor( conf.value( "transparent_color" ), osg::Vec4ub(0,0,0,0));
@@ -80,6 +82,7 @@ ImageLayer::Options::fromConfig(const Config& conf)
     conf.get("texture_compression", "auto", _textureCompression, (osg::Texture::InternalFormatMode)~0);
     conf.get("texture_compression", "on",   _textureCompression, (osg::Texture::InternalFormatMode)~0);
     conf.get("texture_compression", "fastdxt", _textureCompression, (osg::Texture::InternalFormatMode)(~0 - 1));
+    conf.get("texture_compression", "cpu",  _textureCompression, (osg::Texture::InternalFormatMode)(~0 - 2));
     //TODO add all the enums
 
     // uniform names
@@ -99,6 +102,7 @@ ImageLayer::Options::getConfig() const
     conf.set( "altitude",       _altitude );
     conf.set( "edge_buffer_ratio", _edgeBufferRatio);
     conf.set( "reprojected_tilesize", _reprojectedTileSize);
+    conf.set( "cpu_color_filters", _cpuColorFilters);
 
     if (_transparentColor.isSet())
         conf.set("transparent_color", colorToString( _transparentColor.value()));
@@ -128,6 +132,7 @@ ImageLayer::Options::getConfig() const
     conf.set("texture_compression", "none", _textureCompression, osg::Texture::USE_IMAGE_DATA_FORMAT);
     conf.set("texture_compression", "auto", _textureCompression, (osg::Texture::InternalFormatMode)~0);
     conf.set("texture_compression", "fastdxt", _textureCompression, (osg::Texture::InternalFormatMode)(~0 - 1));
+    conf.set("texture_compression", "cpu",  _textureCompression, (osg::Texture::InternalFormatMode)(~0 - 2));
     //TODO add all the enums
 
     // uniform names
@@ -157,7 +162,9 @@ ImageLayer::TileProcessor::init(const ImageLayer::Options& options,
 
     const osg::Vec4ub& ck= *_options.transparentColor();
     _chromaKey.set( ck.r() / 255.0f, ck.g() / 255.0f, ck.b() / 255.0f, 1.0 );
+    _keyTransparentColor = _options.transparentColor().isSet();
 
+    _noDataImage = 0L;
     if ( _options.noDataImageFilename().isSet() && !_options.noDataImageFilename()->empty() )
     {
         _noDataImage = _options.noDataImageFilename()->getImage( dbOptions );
@@ -166,6 +173,23 @@ ImageLayer::TileProcessor::init(const ImageLayer::Options& options,
             OE_WARN << "Failed to read nodata image from \"" << _options.noDataImageFilename()->full() << "\"" << std::endl;
         }
     }
+
+    _cpuFilters.clear();
+    if ( _options.cpuColorFilters() == true )
+    {
+        const ColorFilterChain& chain = _options.colorFilters().get();
+        for(ColorFilterChain::const_iterator i = chain.begin(); i != chain.end(); ++i)
+        {
+            if ( i->valid() && i->get()->supportsCPU() )
+                _cpuFilters.push_back( i->get() );
+        }
+    }
+}
+
+bool
+ImageLayer::TileProcessor::needsPixelPass() const
+{
+    return _keyTransparentColor || !_cpuFilters.empty();
 }
 
 void
@@ -188,12 +212,100 @@ ImageLayer::TileProcessor::process( osg::ref_ptr<osg::Image>& image ) const
     // If this is a compressed image, uncompress it IF the image is not already in the
     // target profile...because if it's not in the target profile, we will have to do
     // some mosaicing...and we can't mosaic a compressed image.
-    if (_mosaicingPossible &&
+    // The pixel pass needs the pixels too.
+    if ((_mosaicingPossible || needsPixelPass()) &&
         ImageUtils::isCompressed(image.get()) &&
         ImageUtils::canConvert(image.get(), GL_RGBA, GL_UNSIGNED_BYTE) )
     {
         image = ImageUtils::convertToRGBA8( image.get() );
     }
+
+    if ( needsPixelPass() && !ImageUtils::isCompressed(image.get()) )
+    {
+        image = processPixels( image.get() );
+    }
+}
+
+osg::Image*
+ImageLayer::TileProcessor::processPixels( const osg::Image* input ) const
+{
+    // One pass over the pixels: each row is unpacked to RGBA floats, keyed
+    // against the transparent color, run through the CPU color filters and
+    // written back out as RGBA8. The result is a new image since the source
+    // may share its images with other users.
+    const int width = input->s();
+
+    osg::ref_ptr<osg::Image> output = new osg::Image();
+    output->allocateImage(width, input->t(), input->r(), GL_RGBA, GL_UNSIGNED_BYTE);
+    output->setInternalTextureFormat(GL_RGBA8);
+
+    const bool rgba8 =
+        input->getDataType() == GL_UNSIGNED_BYTE &&
+        (input->getPixelFormat() == GL_RGBA || input->getPixelFormat() == GL_RGB);
+    const unsigned components = input->getPixelFormat() == GL_RGBA ? 4u : 3u;
+
+    ImageUtils::PixelReader read( input );
+    std::vector<osg::Vec4f> row( width );
+
+    // half a step of tolerance, since the key is compared in floating point
+    const float tolerance = 0.5f / 255.0f;
+
+    for(int r = 0; r < input->r(); ++r)
+    {
+        for(int t = 0; t < input->t(); ++t)
+        {
+            // unpack:
+            if ( rgba8 )
+            {
+                const unsigned char* in = input->data(0, t, r);
+                for(int s = 0; s < width; ++s, in += components)
+                {
+                    row[s].set(
+                        in[0] / 255.0f, in[1] / 255.0f, in[2] / 255.0f,
+                        components == 4u ? in[3] / 255.0f : 1.0f );
+                }
+            }
+            else
+            {
+                for(int s = 0; s < width; ++s)
+                    read( row[s], s, t, r );
+            }
+
+            // transparent color:
+            if ( _keyTransparentColor )
+            {
+                for(int s = 0; s < width; ++s)
+                {
+                    osg::Vec4f& c = row[s];
+                    if (fabs(c.r() - _chromaKey.r()) <= tolerance &&
+                        fabs(c.g() - _chromaKey.g()) <= tolerance &&
+                        fabs(c.b() - _chromaKey.b()) <= tolerance)
+                    {
+                        c.a() = 0.0f;
+                    }
+                }
+            }
+
+            // color filters, in chain order:
+            for(ColorFilterChain::const_iterator i = _cpuFilters.begin(); i != _cpuFilters.end(); ++i)
+            {
+                i->get()->apply( &row[0], width );
+            }
+
+            // pack:
+            unsigned char* out = output->data(0, t, r);
+            for(int s = 0; s < width; ++s, out += 4)
+            {
+                const osg::Vec4f& c = row[s];
+                out[0] = (unsigned char)(osg::clampBetween(c.r(), 0.0f, 1.0f) * 255.0f + 0.5f);
+                out[1] = (unsigned char)(osg::clampBetween(c.g(), 0.0f, 1.0f) * 255.0f + 0.5f);
+                out[2] = (unsigned char)(osg::clampBetween(c.b(), 0.0f, 1.0f) * 255.0f + 0.5f);
+                out[3] = (unsigned char)(osg::clampBetween(c.a(), 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    return output.release();
 }
 
 //------------------------------------------------------------------------
@@ -277,6 +389,8 @@ ImageLayer::openImplementation()
     if (!options().shareTexMatUniformName().isSet() )
         options().shareTexMatUniformName().init(Stringify() << options().shareTexUniformName().get() << "_matrix");
 
+    _processor.init(options(), getReadOptions(), false);
+
     return Status::NoError;
 }
 
@@ -326,6 +440,32 @@ ImageLayer::getAltitude() const
     return options().altitude().get();
 }
 
+bool
+ImageLayer::mayHaveData(const TileKey& key) const
+{
+    if (!TileLayer::mayHaveData(key))
+        return false;
+
+    if (_callbacks.empty() == false) // not thread-safe but that's ok
+    {
+        Callbacks temp;
+
+        _callbacks.lock();
+        temp = _callbacks;
+        _callbacks.unlock();
+
+        for(Callbacks::const_iterator i = temp.begin();
+            i != temp.end();
+            ++i)
+        {
+            if (i->get()->mayHaveData(key) == false)
+                return false;
+        }
+    }
+
+    return true;
+}
+
 void
 ImageLayer::invoke_onCreate(const TileKey& key, GeoImage& data)
 {
@@ -370,6 +510,18 @@ ImageLayer::removeColorFilter( ColorFilter* filter )
     }
 }
 
+void
+ImageLayer::setCPUColorFilters(bool value)
+{
+    setOptionThatRequiresReopen(options().cpuColorFilters(), value);
+}
+
+bool
+ImageLayer::getCPUColorFilters() const
+{
+    return options().cpuColorFilters().get();
+}
+
 const ColorFilterChain&
 ImageLayer::getColorFilters() const
 {
@@ -389,14 +541,60 @@ ImageLayer::createImage(const TileKey&    key,
         return GeoImage::INVALID;
     }
 
-    // prevents 2 threads from creating the same object at the same time
-    //_sentry.lock(key);
+    // If another thread is already creating this image (e.g. for another
+    // view), wait for it and share its result instead of creating it again.
+    while (true)
+    {
+        osg::ref_ptr<InFlight> flight;
+        bool leader = false;
 
-    GeoImage result = createImageInKeyProfile( key, progress );
+        _inFlight.lock();
+        {
+            osg::ref_ptr<InFlight>& entry = _inFlight[key];
+            if (!entry.valid())
+            {
+                entry = new InFlight();
+                leader = true;
+            }
+            flight = entry;
+        }
+        _inFlight.unlock();
+
+        if (leader)
+        {
+            // In "cpu" compression mode, the tiles leave here (and go in the
+            // cache) as GPU blocks, ready to upload.
+            bool compress =
+                !isCoverage() &&
+                options().textureCompression() == (osg::Texture::InternalFormatMode)(~0 - 2);
 
-    //_sentry.unlock(key);
+            GeoImage result = createImageInKeyProfile( key, progress, compress );
 
-    return result;
+            flight->_result = result;
+            flight->_canceled = !result.valid() && progress && progress->isCanceled();
+
+            _inFlight.lock();
+            _inFlight.erase(key);
+            _inFlight.unlock();
+
+            flight->_done.set();
+            return result;
+        }
+
+        // wait for the leader, unless our own request gets canceled first
+        while (!flight->_done.wait(100u))
+        {
+            if (progress && progress->isCanceled())
+                return GeoImage::INVALID;
+        }
+
+        // the leader's request was canceled; that doesn't mean ours is,
+        // so try again (and maybe lead).
+        if (flight->_canceled)
+            continue;
+
+        return flight->_result;
+    }
 }
 
 GeoImage
@@ -466,6 +664,12 @@ ImageLayer::createImageInNativeProfile(const TileKey& key, ProgressCallback* pro
 
 GeoImage
 ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progress)
+{
+    return createImageInKeyProfile(key, progress, false);
+}
+
+GeoImage
+ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progress, bool compress)
 {
     // If the layer is disabled, bail out.
     if ( !isOpen() )
@@ -486,24 +690,34 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
         << key.getExtent().toString() << std::endl;
 
     // the cache key combines the Key and the horizontal profile.
+    // Compressed tiles are separate records, since the other users of this
+    // layer need the pixels.
     std::string cacheKey = Cache::makeCacheKey(
         Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
-        "image");
+        compress ? "image_gpu" : "image");
 
     // The L2 cache key includes the layer revision of course!
     char memCacheKey[64];
 
     const CachePolicy& policy = getCacheSettings()->cachePolicy().get();
+
+    // times for getTileMetrics(), in ms
+    double fetchMS = -1.0, cacheMS = 0.0, processMS = -1.0;
+    OE_START_TIMER(cache_read);
     
     // Check the layer L2 cache first
     if ( _memCache.valid() )
     {
-        sprintf(memCacheKey, "%d/%s/%s", getRevision(), key.str().c_str(), key.getProfile()->getHorizSignature().c_str());
+        sprintf(memCacheKey, "%d/%s/%s%s", getRevision(), key.str().c_str(), key.getProfile()->getHorizSignature().c_str(), compress ? "/gpu" : "");
 
         CacheBin* bin = _memCache->getOrCreateDefaultBin();
         ReadResult result = bin->readObject(memCacheKey, 0L);
         if ( result.succeeded() )
-            return GeoImage(static_cast<osg::Image*>(result.releaseObject()), key.getExtent());
+        {
+            osg::ref_ptr<osg::Image> image = static_cast<osg::Image*>(result.releaseObject());
+            getTileMetrics().record(-1.0, OE_GET_TIMER(cache_read)*1000.0, -1.0, image->getTotalSizeInBytes());
+            return GeoImage(image.get(), key.getExtent());
+        }
     }
 
     // locate the cache bin for the target profile for this layer:
@@ -531,6 +745,7 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
             if (!expired)
             {
                 OE_DEBUG << "Got cached image for " << key.str() << std::endl;                
+                getTileMetrics().record(-1.0, OE_GET_TIMER(cache_read)*1000.0, -1.0, cachedImage->getTotalSizeInBytes());
                 return GeoImage( cachedImage.get(), key.getExtent() );                        
             }
             else
@@ -539,6 +754,8 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
             }
         }
     }
+
+    cacheMS = OE_GET_TIMER(cache_read)*1000.0;
     
     // The data was not in the cache. If we are cache-only, fail sliently
     if ( policy.isCacheOnly() )
@@ -554,6 +771,14 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
         }
     }
     
+    // Don't bother the source if it already came back empty for this key.
+    if (isKnownEmpty(key))
+    {
+        return cachedImage.valid() ? GeoImage(cachedImage.get(), key.getExtent()) : GeoImage::INVALID;
+    }
+
+    OE_START_TIMER(fetch);
+
     if (key.getProfile()->isHorizEquivalentTo(getProfile()))
     {
         result = createImageImplementation(key, progress);
@@ -564,18 +789,53 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
         result = assembleImage( key, progress );
     }
 
+    fetchMS = OE_GET_TIMER(fetch)*1000.0;
+
     // Check for cancelation before writing to a cache:
     if (progress && progress->isCanceled())
     {
         return GeoImage::INVALID;
     }
 
+    if (!result.valid())
+    {
+        recordEmptyTile(key, progress);
+    }
+
+    OE_START_TIMER(process);
+
+    // nodata, transparent color and CPU color filters
+    if (result.valid())
+    {
+        osg::ref_ptr<osg::Image> image = result.getImage();
+        _processor.process(image);
+        result = image.valid() ? GeoImage(image.get(), result.getExtent()) : GeoImage::INVALID;
+    }
+
     // invoke user callbacks
     if (result.valid())
     {
         invoke_onCreate(key, result);
     }
 
+    // compress into GPU blocks, on a copy since the source may share its images
+    if (compress && result.valid() && !ImageUtils::isCompressed(result.getImage()))
+    {
+        osg::Texture::FilterMode minFilter = options().minFilter().get();
+        bool mipmaps =
+            minFilter != osg::Texture::LINEAR &&
+            minFilter != osg::Texture::NEAREST;
+
+        osg::ref_ptr<osg::Image> compressed = new osg::Image(*result.getImage(), osg::CopyOp::DEEP_COPY_ALL);
+        if (ImageUtils::compressImage(compressed.get(), mipmaps))
+        {
+            result = GeoImage(compressed.get(), result.getExtent());
+        }
+    }
+
+    processMS = OE_GET_TIMER(process)*1000.0;
+    OE_START_TIMER(cache_write);
+
     // memory cache first:
     if ( result.valid() && _memCache.valid() )
     {
@@ -597,9 +857,12 @@ ImageLayer::createImageInKeyProfile(const TileKey& key, ProgressCallback* progre
         cacheBin->write(cacheKey, result.getImage(), 0L);
     }
 
+    cacheMS += OE_GET_TIMER(cache_write)*1000.0;
+
     if ( result.valid() )
     {
         OE_DEBUG << LC << key.str() << " result OK" << std::endl;
+        getTileMetrics().record(fetchMS, cacheMS, processMS, result.getImage()->getTotalSizeInBytes());
     }
     else
     {
@@ -826,9 +1089,17 @@ ImageLayer::applyTextureCompressionMode(osg::Texture* tex) const
     }
 
 
-    else if ( options().textureCompression() == (osg::Texture::InternalFormatMode)~0 )
+    else if ( options().textureCompression() == (osg::Texture::InternalFormatMode)(~0 - 2) &&
+              tex->getImage(0) && ImageUtils::isCompressed(tex->getImage(0)) )
+    {
+        // cpu mode: already in GPU blocks, so upload them as they are
+        tex->setInternalFormatMode(osg::Texture::USE_IMAGE_DATA_FORMAT);
+    }
+
+    else if ( options().textureCompression() == (osg::Texture::InternalFormatMode)~0 ||
+              options().textureCompression() == (osg::Texture::InternalFormatMode)(~0 - 2) )
     {
-        // auto mode:
+        // auto mode (or a tile the cpu mode could not compress):
         if ( Registry::capabilities().isGLES() )
         {
             // Many GLES drivers do not support automatic compression, so by 
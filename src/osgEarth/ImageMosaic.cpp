@@ -63,6 +63,12 @@ void ImageMosaic::getExtents(double &minX, double &minY, double &maxX, double &m
 
 osg::Image*
 ImageMosaic::createImage()
+{
+    return createImage(0L);
+}
+
+osg::Image*
+ImageMosaic::createImage(osg::Image* target)
 {
     if (_images.size() == 0)
     {
@@ -82,8 +88,6 @@ ImageMosaic::createImage()
     unsigned int tileWidth = tile->_image->s();
     unsigned int tileHeight = tile->_image->t();
 
-    //OE_NOTICE << "TileDim " << tileWidth << ", " << tileHeight << std::endl;
-
     unsigned int minTileX = tile->_tileX;
     unsigned int minTileY = tile->_tileY;
     unsigned int maxTileX = tile->_tileX;
@@ -104,27 +108,52 @@ ImageMosaic::createImage()
 
     unsigned int pixelsWide = tilesWide * tileWidth;
     unsigned int pixelsHigh = tilesHigh * tileHeight;
-	unsigned int tileDepth = tile->_image->r();
+    unsigned int tileDepth = tile->_image->r();
+
+    // A later image covers an earlier one in the same cell completely,
+    // so only the last valid image in each cell gets copied.
+    std::vector<const TileImage*> cells(tilesWide * tilesHigh, 0L);
+    for (TileImageList::const_iterator i = _images.begin(); i != _images.end(); ++i)
+    {
+        if (i->_image.valid())
+        {
+            cells[(i->_tileY - minTileY) * tilesWide + (i->_tileX - minTileX)] = &(*i);
+        }
+    }
 
-    osg::ref_ptr<osg::Image> image = new osg::Image;
+    // allocateImage keeps the target's existing buffer when the size matches.
+    osg::ref_ptr<osg::Image> image = target ? target : new osg::Image();
     image->allocateImage(pixelsWide, pixelsHigh, tileDepth, tile->_image->getPixelFormat(), tile->_image->getDataType());
     image->setInternalTextureFormat(tile->_image->getInternalTextureFormat());
 
-    //Initialize the image to be completely white!
     ImageUtils::PixelWriter write(image.get());
-    write.assign(osg::Vec4(1,1,1,0));
 
-    //Composite the incoming images into the master image
-    for (TileImageList::iterator i = _images.begin(); i != _images.end(); ++i)
+    for (unsigned int ty = 0; ty < tilesHigh; ++ty)
     {
-        //Determine the indices in the master image for this image
-        int dstX = (i->_tileX - minTileX) * tileWidth;
-        int dstY = (maxTileY - i->_tileY) * tileHeight;
-
-        osg::Image* sourceTile = i->getImage();
-        if ( sourceTile )
+        for (unsigned int tx = 0; tx < tilesWide; ++tx)
         {
-            ImageUtils::copyAsSubImage(sourceTile, image.get(), dstX, dstY);
+            //Determine the indices in the master image for this cell
+            int dstX = tx * tileWidth;
+            int dstY = (tilesHigh - 1 - ty) * tileHeight;
+
+            const TileImage* cell = cells[ty * tilesWide + tx];
+            if (cell == 0L || !ImageUtils::copyAsSubImage(cell->_image.get(), image.get(), dstX, dstY))
+            {
+                // Nothing covers this cell, so initialize it to be completely white!
+                for (unsigned int r = 0; r < tileDepth; ++r)
+                    for (unsigned int t = 0; t < tileHeight; ++t)
+                        for (unsigned int s = 0; s < tileWidth; ++s)
+                            write(osg::Vec4(1,1,1,0), dstX + s, dstY + t, r);
+            }
+            else if (cell->_image->s() < tileWidth || cell->_image->t() < tileHeight)
+            {
+                // A smaller image only partly covers its cell.
+                for (unsigned int r = 0; r < tileDepth; ++r)
+                    for (unsigned int t = 0; t < tileHeight; ++t)
+                        for (unsigned int s = 0; s < tileWidth; ++s)
+                            if (s >= (unsigned)cell->_image->s() || t >= (unsigned)cell->_image->t())
+                                write(osg::Vec4(1,1,1,0), dstX + s, dstY + t, r);
+            }
         }
     }
 
@@ -326,6 +326,8 @@ ImageOverlay::compile()
 
         // image overlay is unlit by default.
         setDefaultLighting(false);
+
+        static_cast<DrapeableNode*>(getChild(0))->dirtyDraping();
     }
 }
 
@@ -527,6 +529,7 @@ ImageOverlay::updateFilters()
         
         _texture->setFilter(osg::Texture::MAG_FILTER, *_magFilter);
 
+        static_cast<DrapeableNode*>(getChild(0))->dirtyDraping();
     }
 }
 
@@ -543,6 +546,7 @@ ImageOverlay::setAlpha(float alpha)
     {
         _alpha = osg::clampBetween(alpha, 0.0f, 1.0f);
         _root->getOrCreateStateSet()->getOrCreateUniform("oe_ImageOverlay_alpha", osg::Uniform::FLOAT)->set(*_alpha);
+        static_cast<DrapeableNode*>(getChild(0))->dirtyDraping();
     }
 }
 
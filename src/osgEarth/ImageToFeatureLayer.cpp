@@ -41,6 +41,7 @@ ImageToFeatureSource::Options::getConfig() const {
     image().set(conf, "image");
     conf.set("level", level());
     conf.set("attribute", attribute());
+    conf.set("threshold", threshold());
     return conf;
 }
 
@@ -52,12 +53,41 @@ ImageToFeatureSource::Options::fromConfig(const Config& conf)
     image().get(conf, "image");
     conf.get("level", level());
     conf.get("attribute", attribute());
+    conf.get("threshold", threshold());
 }
 
 //.........................................................
 
 OE_LAYER_PROPERTY_IMPL(ImageToFeatureSource, unsigned, Level, level);
 OE_LAYER_PROPERTY_IMPL(ImageToFeatureSource, std::string, Attribute, attribute);
+OE_LAYER_PROPERTY_IMPL(ImageToFeatureSource, float, Threshold, threshold);
+
+namespace
+{
+    // A rectangle of pixels with the same value: columns [c0, c1) of
+    // rows [r0, r1).
+    struct Run
+    {
+        unsigned c0, c1, r0, r1;
+        float value;
+    };
+
+    // Splits one row of values into runs of equal values.
+    void findRuns(const std::vector<float>& row, unsigned r, std::vector<Run>& out)
+    {
+        out.clear();
+        unsigned c0 = 0;
+        for (unsigned c = 1; c <= row.size(); ++c)
+        {
+            if (c == row.size() || row[c] != row[c0])
+            {
+                Run run = { c0, c, r, r + 1, row[c0] };
+                out.push_back(run);
+                c0 = c;
+            }
+        }
+    }
+}
 
 void
 ImageToFeatureSource::init()
@@ -126,73 +156,81 @@ ImageToFeatureSource::createFeatureCursor(const Query& query, ProgressCallback*
 
         if (image.valid())
         {
-            double pixWidth = key.getExtent().width() / (double)image.getImage()->s();
-            double pixHeight = key.getExtent().height() / (double)image.getImage()->t();
+            const osg::Image* img = image.getImage();
+            const GeoExtent& extent = key.getExtent();
+            double pixWidth = extent.width() / (double)img->s();
+            double pixHeight = extent.height() / (double)img->t();
 
-            ImageUtils::PixelReader reader(image.getImage());
-            osg::Vec4f color;
+            osg::ref_ptr<const SpatialReference> srs = SpatialReference::create("wgs84");
+            const std::string& attribute = options().attribute().get();
 
-            for (unsigned int r = 0; r < (unsigned)image.getImage()->t(); r++)
-            {
-                double y = key.getExtent().yMin() + (double)r * pixHeight;
+            ImageUtils::PixelReader reader(img);
+            osg::Vec4f color;
 
-                double minX = 0;
-                double maxX = 0;
-                float value = 0.0;
+            std::vector<float> row(img->s());
+            std::vector<Run> open, next, current;
 
-                for (unsigned int c = 0; c < (unsigned)image.getImage()->s(); c++)
+            // Pixels are scanned into runs of equal value one row at a time.
+            // A run that exactly matches one directly below it grows the
+            // rectangle instead of starting a new feature, so large uniform
+            // areas become a handful of features rather than one per row.
+            for (unsigned r = 0; r <= (unsigned)img->t(); ++r)
+            {
+                current.clear();
+                if (r < (unsigned)img->t())
                 {
-                    double x = key.getExtent().xMin() + (double)c * pixWidth;
-
-                    reader(color, c, r);
-
-                    // Starting a new row.  Initialize the values.
-                    if (c == 0)
+                    for (unsigned c = 0; c < (unsigned)img->s(); ++c)
                     {
-                        minX = x;
-                        maxX = x + pixWidth;
-                        value = color.r();
+                        reader(color, c, r);
+                        row[c] = color.r();
                     }
-                    // Ending a row, finish the polygon.
-                    else if (c == image.getImage()->s() - 1)
-                    {
-                        // Increment the maxX to finish the row.
-                        maxX = x + pixWidth;
-                        Polygon* poly = new Polygon();
-                        poly->push_back(minX, y);
-                        poly->push_back(maxX, y);
-                        poly->push_back(maxX, y + pixHeight);
-                        poly->push_back(minX, y + pixHeight);
-                        Feature* feature = new Feature(poly, SpatialReference::create("wgs84"));
-                        feature->set(options().attribute().get(), value);
-                        features.push_back(feature);
-                        minX = x;
-                        maxX = x + pixWidth;
-                        value = color.r();
-                    }
-                    // The value is different, so complete the polygon and start a new one.
-                    else if (color.r() != value)
+
+                    if (options().threshold().isSet())
                     {
-                        Polygon* poly = new Polygon();
-                        poly->push_back(minX, y);
-                        poly->push_back(maxX, y);
-                        poly->push_back(maxX, y + pixHeight);
-                        poly->push_back(minX, y + pixHeight);
-                        Feature* feature = new Feature(poly, SpatialReference::create("wgs84"));
-                        feature->set(options().attribute().get(), value);
-                        features.push_back(feature);
-                        minX = x;
-                        maxX = x + pixWidth;
-                        value = color.r();
+                        const float threshold = options().threshold().get();
+                        for (unsigned c = 0; c < row.size(); ++c)
+                            row[c] = row[c] >= threshold ? 1.0f : 0.0f;
                     }
-                    // The value is the same as the previous value, continue the polygon by increasing the maxX.
-                    else if (color.r() == value)
+
+                    findRuns(row, r, current);
+                }
+
+                // Both lists are sorted by column, so one pass pairs them up.
+                next.clear();
+                std::vector<Run>::iterator i = open.begin();
+                for (std::vector<Run>::iterator j = current.begin(); j != current.end(); ++j)
+                {
+                    for (; i != open.end() && i->c0 < j->c0; ++i)
+                        next.push_back(*i);
+
+                    if (i != open.end() && i->c0 == j->c0 && i->c1 == j->c1 && i->value == j->value)
                     {
-                        maxX = x + pixWidth;
+                        j->r0 = i->r0;
+                        ++i;
                     }
                 }
+                for (; i != open.end(); ++i)
+                    next.push_back(*i);
 
+                // Anything in "next" was not continued, so close it out.
+                for (std::vector<Run>::const_iterator k = next.begin(); k != next.end(); ++k)
+                {
+                    double xMin = extent.xMin() + (double)k->c0 * pixWidth;
+                    double xMax = extent.xMin() + (double)k->c1 * pixWidth;
+                    double yMin = extent.yMin() + (double)k->r0 * pixHeight;
+                    double yMax = extent.yMin() + (double)k->r1 * pixHeight;
+
+                    Polygon* poly = new Polygon();
+                    poly->push_back(xMin, yMin);
+                    poly->push_back(xMax, yMin);
+                    poly->push_back(xMax, yMax);
+                    poly->push_back(xMin, yMax);
+                    Feature* feature = new Feature(poly, srs.get());
+                    feature->set(attribute, k->value);
+                    features.push_back(feature);
+                }
 
+                open.swap(current);
             }
 
             if (!features.empty())
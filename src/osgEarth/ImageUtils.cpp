@@ -76,6 +76,15 @@ ImageUtils::copyAsSubImage(const osg::Image* src, osg::Image* dst, int dst_start
     {
         for(int r=0; r<src->r(); ++r) // each layer
         {
+            // rows are contiguous in both images, so copy them as one block:
+            if (dst_start_col == 0 &&
+                src->getRowStepInBytes() == dst->getRowStepInBytes() &&
+                src->getRowSizeInBytes() == src->getRowStepInBytes())
+            {
+                memcpy( dst->data(0, dst_start_row, r), src->data(0, 0, r), src->getRowStepInBytes() * src->t() );
+                continue;
+            }
+
             for( int src_row=0, dst_row=dst_start_row; src_row < src->t(); src_row++, dst_row++ )
             {
                 const void* src_data = src->data( 0, src_row, r );
@@ -162,6 +171,175 @@ ImageUtils::createBumpMap(const osg::Image* input)
     return output;
 }
 
+namespace
+{
+    // Fast paths for tightly packed 8-bit RGB/RGBA and 32-bit float
+    // single-channel images. These work on the raw samples with the
+    // sampling positions worked out once per row and column, so there
+    // are no per-pixel function calls and the inner loops vectorize.
+    enum FastFormat
+    {
+        FAST_NONE,
+        FAST_RGB8,
+        FAST_RGBA8,
+        FAST_R32F
+    };
+
+    FastFormat getFastFormat(const osg::Image* image)
+    {
+        if (!image || !image->data())
+            return FAST_NONE;
+
+        if (image->getRowLength() != 0 && image->getRowLength() != image->s())
+            return FAST_NONE;
+
+        FastFormat format = FAST_NONE;
+        unsigned pixelSize = 0;
+
+        if (image->getDataType() == GL_UNSIGNED_BYTE)
+        {
+            if (image->getPixelFormat() == GL_RGBA)
+                format = FAST_RGBA8, pixelSize = 4;
+            else if (image->getPixelFormat() == GL_RGB)
+                format = FAST_RGB8, pixelSize = 3;
+        }
+        else if (image->getDataType() == GL_FLOAT)
+        {
+            if (image->getPixelFormat() == GL_RED || image->getPixelFormat() == GL_LUMINANCE)
+                format = FAST_R32F, pixelSize = 4;
+        }
+
+        // no padding between rows
+        if (format != FAST_NONE && image->getRowSizeInBytes() != image->s() * pixelSize)
+            return FAST_NONE;
+
+        return format;
+    }
+
+    inline unsigned char toByte(float value)
+    {
+        return (unsigned char)osg::clampBetween(value + 0.5f, 0.0f, 255.0f);
+    }
+
+    inline float toSample(float value, unsigned char) { return (float)toByte(value); }
+    inline float toSample(float value, float) { return value; }
+
+    // One output row or column: the input samples to read and their weights,
+    // computed the same way as the generic resize.
+    struct Tap
+    {
+        int _i0, _i1;
+        float _w0, _w1;
+    };
+
+    void computeTaps(unsigned in_n, unsigned out_n, bool bilinear, std::vector<Tap>& taps)
+    {
+        taps.resize(out_n);
+        for (unsigned i = 0; i < out_n; ++i)
+        {
+            float pos = ((float)i / (float)out_n) * (float)in_n;
+            if (pos >= (float)in_n) pos = (float)(in_n - 1);
+            else if (pos < 0.0f) pos = 0.0f;
+
+            Tap& tap = taps[i];
+            if (bilinear)
+            {
+                tap._i0 = osg::maximum((int)floor(pos), 0);
+                tap._i1 = osg::maximum(osg::minimum((int)ceil(pos), (int)in_n - 1), 0);
+                if (tap._i0 > tap._i1) tap._i0 = tap._i1;
+                if (tap._i0 == tap._i1)
+                {
+                    tap._w0 = 1.0f, tap._w1 = 0.0f;
+                }
+                else
+                {
+                    tap._w0 = (float)tap._i1 - pos;
+                    tap._w1 = pos - (float)tap._i0;
+                }
+            }
+            else
+            {
+                int n = (pos - (int)pos) <= (ceil(pos) - pos) ?
+                    (int)pos :
+                    osg::minimum(1 + (int)pos, (int)in_n - 1);
+                tap._i0 = tap._i1 = n;
+                tap._w0 = 1.0f, tap._w1 = 0.0f;
+            }
+        }
+    }
+
+    template<typename T, unsigned N>
+    void resizeFast(const osg::Image* input, osg::Image* output, bool bilinear)
+    {
+        std::vector<Tap> cols, rows;
+        computeTaps(input->s(), output->s(), bilinear, cols);
+        computeTaps(input->t(), output->t(), bilinear, rows);
+
+        for (int layer = 0; layer < input->r(); ++layer)
+        {
+            for (unsigned t = 0; t < rows.size(); ++t)
+            {
+                const Tap& row = rows[t];
+                const T* in0 = (const T*)input->data(0, row._i0, layer);
+                const T* in1 = (const T*)input->data(0, row._i1, layer);
+                T* out = (T*)output->data(0, t, layer);
+
+                if (!bilinear)
+                {
+                    for (unsigned s = 0; s < cols.size(); ++s)
+                    {
+                        const T* p = in0 + cols[s]._i0 * N;
+                        for (unsigned c = 0; c < N; ++c)
+                            out[s*N + c] = p[c];
+                    }
+                }
+                else
+                {
+                    for (unsigned s = 0; s < cols.size(); ++s)
+                    {
+                        const Tap& col = cols[s];
+                        const T* p00 = in0 + col._i0 * N;
+                        const T* p01 = in0 + col._i1 * N;
+                        const T* p10 = in1 + col._i0 * N;
+                        const T* p11 = in1 + col._i1 * N;
+                        for (unsigned c = 0; c < N; ++c)
+                        {
+                            float r0 = (float)p00[c] * col._w0 + (float)p01[c] * col._w1;
+                            float r1 = (float)p10[c] * col._w0 + (float)p11[c] * col._w1;
+                            out[s*N + c] = (T)toSample(r0 * row._w0 + r1 * row._w1, T());
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Mixes 8-bit RGB(A) into 8-bit RGB(A); same math as MixImage
+    void mixFast(osg::Image* dest, unsigned destSize, const osg::Image* src, unsigned srcSize, float a)
+    {
+        bool srcHasAlpha = srcSize == 4;
+        bool destHasAlpha = destSize == 4;
+        unsigned count = src->s() * src->t();
+
+        for (int layer = 0; layer < src->r(); ++layer)
+        {
+            const unsigned char* s = src->data(0, 0, layer);
+            unsigned char* d = dest->data(0, 0, layer);
+
+            for (unsigned i = 0; i < count; ++i, s += srcSize, d += destSize)
+            {
+                float sa = srcHasAlpha ? a * ((float)s[3] / 255.0f) : a;
+                float ds = 1.0f - sa;
+                d[0] = toByte((float)d[0] * ds + (float)s[0] * sa);
+                d[1] = toByte((float)d[1] * ds + (float)s[1] * sa);
+                d[2] = toByte((float)d[2] * ds + (float)s[2] * sa);
+                if (destHasAlpha)
+                    d[3] = toByte(osg::maximum(sa * 255.0f, (float)d[3]));
+            }
+        }
+    }
+}
+
 bool
 ImageUtils::resizeImage(const osg::Image* input,
                         unsigned int out_s, unsigned int out_t,
@@ -213,6 +391,18 @@ ImageUtils::resizeImage(const osg::Image* input,
     {
         memcpy( output->data(), input->data(), input->getTotalSizeInBytes() );
     }
+    else if ( mipmapLevel == 0 &&
+              getFastFormat(input) != FAST_NONE &&
+              getFastFormat(input) == getFastFormat(output.get()) &&
+              input->r() == output->r() )
+    {
+        switch( getFastFormat(input) )
+        {
+        case FAST_RGBA8: resizeFast<unsigned char, 4>( input, output.get(), bilinear ); break;
+        case FAST_RGB8:  resizeFast<unsigned char, 3>( input, output.get(), bilinear ); break;
+        default:         resizeFast<float, 1>( input, output.get(), bilinear ); break;
+        }
+    }
     else
     {
         PixelReader read( input );
@@ -718,6 +908,17 @@ ImageUtils::mix(osg::Image* dest, const osg::Image* src, float a)
     {
         return false;
     }
+
+    FastFormat srcFormat = getFastFormat(src);
+    FastFormat destFormat = getFastFormat(dest);
+    if ((srcFormat == FAST_RGBA8 || srcFormat == FAST_RGB8) &&
+        (destFormat == FAST_RGBA8 || destFormat == FAST_RGB8))
+    {
+        mixFast(dest, destFormat == FAST_RGBA8 ? 4 : 3,
+                src, srcFormat == FAST_RGBA8 ? 4 : 3,
+                osg::clampBetween( a, 0.0f, 1.0f ));
+        return true;
+    }
     
     PixelVisitor<MixImage> mixer;
     mixer._a = osg::clampBetween( a, 0.0f, 1.0f );
@@ -867,6 +1068,24 @@ ImageUtils::isEmptyImage(const osg::Image* image, float alphaThreshold)
     if ( !hasAlphaChannel(image) || !PixelReader::supports(image) )
         return false;
 
+    if ( getFastFormat(image) == FAST_RGBA8 )
+    {
+        // largest alpha byte that is still at or under the threshold
+        int limit = -1;
+        for(int b=0; b<256; ++b)
+            if ( (float)(b * (1.0/255.0)) <= alphaThreshold )
+                limit = b;
+
+        unsigned count = image->s() * image->t() * image->r();
+        const unsigned char* alpha = image->data() + 3;
+        for(unsigned i=0; i<count; ++i, alpha += 4)
+        {
+            if ( (int)*alpha > limit )
+                return false;
+        }
+        return true;
+    }
+
     PixelReader read(image);
     for(unsigned r=0; r<(unsigned)image->r(); ++r)
     {
@@ -1094,6 +1313,30 @@ ImageUtils::convert(const osg::Image* image, GLenum pixelFormat, GLenum dataType
         return result;
     }
 
+    // Fast conversion if possible : RGBA8 to RGB8
+    if ( dataType == GL_UNSIGNED_BYTE && pixelFormat == GL_RGB && getFastFormat(image) == FAST_RGBA8 )
+    {
+        osg::ref_ptr<osg::Image> result = new osg::Image();
+        result->allocateImage(image->s(), image->t(), image->r(), GL_RGB, GL_UNSIGNED_BYTE);
+        result->setInternalTextureFormat(GL_RGB8_INTERNAL);
+
+        if ( getFastFormat(result.get()) == FAST_RGB8 )
+        {
+            const unsigned char* pSrcData = image->data();
+            unsigned char* pDstData = result->data();
+            unsigned count = image->s() * image->t() * image->r();
+            for (unsigned i=0; i<count; ++i, pSrcData += 4, pDstData += 3)
+            {
+                pDstData[0] = pSrcData[0];
+                pDstData[1] = pSrcData[1];
+                pDstData[2] = pSrcData[2];
+            }
+            return result.release();
+        }
+
+        // padded rows; fall through to the generic path
+    }
+
     // Test if generic conversion is possible
     if ( !canConvert(image, pixelFormat, dataType) )
         return 0L;
@@ -1218,6 +1461,44 @@ ImageUtils::generateMipmaps(osg::Texture* tex)
     return mipsAdded;
 }
 
+bool
+ImageUtils::compressImage(osg::Image* image, bool generateMipmaps)
+{
+    if (!image || isCompressed(image) || image->r() > 1 ||
+        image->getDataType() != GL_UNSIGNED_BYTE ||
+        (image->getPixelFormat() != GL_RGB && image->getPixelFormat() != GL_RGBA))
+    {
+        return false;
+    }
+
+    osg::Texture::InternalFormatMode mode;
+    if (!computeTextureCompressionMode(image, mode) || mode == osg::Texture::USE_ARB_COMPRESSION)
+    {
+        // ARB compression means "let the driver do it"
+        return false;
+    }
+
+    // FastDXT is the quickest way to S3TC; otherwise try the generic processor (e.g. NVTT)
+    osgDB::ImageProcessor* ip = 0L;
+    if (mode == osg::Texture::USE_S3TC_DXT1_COMPRESSION || mode == osg::Texture::USE_S3TC_DXT5_COMPRESSION)
+    {
+        ip = osgDB::Registry::instance()->getImageProcessorForExtension("fastdxt");
+    }
+    if (!ip)
+    {
+        ip = osgDB::Registry::instance()->getImageProcessor();
+    }
+    if (!ip)
+    {
+        return false;
+    }
+
+    ip->compress(*image, mode, generateMipmaps, true, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::FASTEST);
+    image->dirty();
+
+    return isCompressed(image);
+}
+
 
 bool
 ImageUtils::featherAlphaRegions(osg::Image* image, float maxAlpha)
@@ -1301,6 +1582,20 @@ ImageUtils::convertToPremultipliedAlpha(osg::Image* image)
     if ( !PixelReader::supports(image) || !PixelWriter::supports(image) )
         return false;
 
+    if ( getFastFormat(image) == FAST_RGBA8 )
+    {
+        unsigned count = image->s() * image->t() * image->r();
+        unsigned char* p = image->data();
+        for(unsigned i=0; i<count; ++i, p += 4)
+        {
+            unsigned a = p[3];
+            p[0] = (unsigned char)((p[0] * a + 127u) / 255u);
+            p[1] = (unsigned char)((p[1] * a + 127u) / 255u);
+            p[2] = (unsigned char)((p[2] * a + 127u) / 255u);
+        }
+        return true;
+    }
+
     PixelReader read(image);
     PixelWriter write(image);
     for(int r=0; r<image->r(); ++r) {
@@ -38,13 +38,16 @@ using namespace osgEarth;
 #define BINDING_COMMAND_BUFFER 0
 #define BINDING_POINTS_BUFFER 1
 #define BINDING_RENDER_BUFFER 2
+#define BINDING_IMPOSTOR_RENDER_BUFFER 3
+
+#define CULL_GROUP_SIZE 64
 
 namespace
 {
     const char* cull_CS =
         "#version 430\n"
 
-        "layout(local_size_x=1, local_size_y=1, local_size_z=1) in; \n"
+        "layout(local_size_x=64, local_size_y=1, local_size_z=1) in; \n"
 
         "struct DrawElementsIndirectCommand { \n"
         "    uint count; \n"
@@ -54,6 +57,7 @@ namespace
         "    uint baseInstance; \n"
         "}; \n"
 
+        // cmd[0] draws the model, cmd[1] the impostor
         "layout(std430, binding=0) buffer DrawCommandsBuffer { \n"
         "    DrawElementsIndirectCommand cmd[]; \n"
         "}; \n"
@@ -66,18 +70,37 @@ namespace
         "    vec4 render[]; \n"
         "}; \n"
 
-        "bool visible(in vec4 model) \n"
+        "layout(std430, binding=3) buffer ImpostorRenderBuffer { \n"
+        "    vec4 impostorRender[]; \n"
+        "}; \n"
+
+        "uniform int oe_IC_numInstances; \n"
+        "uniform float oe_IC_radius; \n"   // bounding radius of one instance
+        "uniform vec2 oe_IC_lodRanges; \n" // impostor range, max range (0 = none)
+
+        // conservative test of the instance's bounding sphere against the view volume
+        "bool visible(in vec4 view) \n"
         "{ \n"
-        "    vec4 clip = gl_ModelViewProjectionMatrix * model; \n"
-        "    clip.xyz = abs(clip.xyz/clip.w); \n"
-        "    const float f = 1.0; \n"
-        "    return clip.x <= f && clip.y <= f; \n"
+        "    if (view.z > oe_IC_radius) return false; \n" // behind the eye
+        "    vec4 clip = gl_ProjectionMatrix * view; \n"
+        "    vec2 margin = oe_IC_radius * vec2( \n"
+        "        length(vec2(gl_ProjectionMatrix[0][0], 1.0)), \n"
+        "        length(vec2(gl_ProjectionMatrix[1][1], 1.0))); \n"
+        "    return abs(clip.x) <= clip.w + margin.x && abs(clip.y) <= clip.w + margin.y; \n"
         "} \n"
 
         "void main() { \n"
-        "    const uint i = gl_GlobalInvocationID.x; \n"
-        "    if (visible(points[i])) // frustum cull \n"
-        "    { \n"
+        "    int i = int(gl_GlobalInvocationID.x); \n"
+        "    if (i >= oe_IC_numInstances) return; \n"
+        "    vec4 view = gl_ModelViewMatrix * points[i]; \n"
+        "    float range = length(view.xyz); \n"
+        "    if (oe_IC_lodRanges.y > 0.0 && range - oe_IC_radius > oe_IC_lodRanges.y) return; \n"
+        "    if (!visible(view)) return; \n"
+        "    if (oe_IC_lodRanges.x > 0.0 && range > oe_IC_lodRanges.x) { \n"
+        "        uint slot = atomicAdd(cmd[1].instanceCount, 1); \n"
+        "        impostorRender[slot] = points[i]; \n"
+        "    } \n"
+        "    else { \n"
         "        uint slot = atomicAdd(cmd[0].instanceCount, 1); \n"
         "        render[slot] = points[i]; \n"
         "    } \n"
@@ -110,10 +133,10 @@ InstanceCloud::DrawElementsIndirectCommand::DrawElementsIndirectCommand() :
 InstanceCloud::InstancingData::InstancingData() :
     points(NULL),
     commandBuffer(-1),
-    pointsBuffer(-1),
-    renderBuffer(-1)
+    pointsBuffer(-1)
 {
-    //nop
+    for (unsigned i = 0; i < NUM_LODS; ++i)
+        renderBuffers[i] = -1;
 }
 
 bool
@@ -134,8 +157,8 @@ InstanceCloud::InstancingData::allocate(osg::State* state)
     ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
     ext->glBufferStorage(
         GL_SHADER_STORAGE_BUFFER,
-        1 * sizeof(DrawElementsIndirectCommand),
-        &command,
+        NUM_LODS * sizeof(DrawElementsIndirectCommand),
+        &commands[0],
         GL_DYNAMIC_STORAGE_BIT);
 
     // buffer for the input data:
@@ -147,17 +170,23 @@ InstanceCloud::InstancingData::allocate(osg::State* state)
         points->getDataPointer(), 
         0);
 
-    // buffer for the output data (culled points, written by compute shader)
-    ext->glGenBuffers(1, &renderBuffer);
-    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderBuffer);
-    ext->glBufferStorage(
-        GL_SHADER_STORAGE_BUFFER, 
-        (numInstances * instanceSize), 
-        NULL, 
-        0);
+    // buffers for the output data (culled points, written by compute shader),
+    // one per LOD since any instance may land in either
+    for (unsigned i = 0; i < NUM_LODS; ++i)
+    {
+        ext->glGenBuffers(1, &renderBuffers[i]);
+        ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderBuffers[i]);
+        ext->glBufferStorage(
+            GL_SHADER_STORAGE_BUFFER, 
+            (numInstances * instanceSize), 
+            NULL, 
+            0);
+    }
 }
 
-InstanceCloud::InstanceCloud()
+InstanceCloud::InstanceCloud() :
+    _impostorRange(0.0f),
+    _maxRange(0.0f)
 {
     // install our compute shader in a stateset
     _computeStateSet = new osg::StateSet();
@@ -165,6 +194,13 @@ InstanceCloud::InstanceCloud()
     osg::Program* p = new osg::Program();
     p->addShader(s);
     _computeStateSet->setAttribute(p, osg::StateAttribute::ON);
+
+    _numInstancesUniform = new osg::Uniform("oe_IC_numInstances", (int)0);
+    _radiusUniform = new osg::Uniform("oe_IC_radius", 0.0f);
+    _lodRangesUniform = new osg::Uniform("oe_IC_lodRanges", osg::Vec2f(0.0f, 0.0f));
+    _computeStateSet->addUniform(_numInstancesUniform.get());
+    _computeStateSet->addUniform(_radiusUniform.get());
+    _computeStateSet->addUniform(_lodRangesUniform.get());
 }
 
 void
@@ -174,15 +210,64 @@ InstanceCloud::setGeometry(osg::Geometry* geom)
 
     if (geom)
     {
-        Installer installer(&_data);
+        Installer installer(&_data, LOD_MODEL);
+        geom->accept(installer);
+    }
+
+    updateCullUniforms();
+}
+
+void
+InstanceCloud::setImpostorGeometry(osg::Geometry* geom)
+{
+    _impostorGeom = geom;
+
+    if (geom)
+    {
+        Installer installer(&_data, LOD_IMPOSTOR);
         geom->accept(installer);
     }
+
+    updateCullUniforms();
+}
+
+void
+InstanceCloud::setLODRanges(float impostorRange, float maxRange)
+{
+    _impostorRange = impostorRange;
+    _maxRange = maxRange;
+    updateCullUniforms();
+}
+
+void
+InstanceCloud::updateCullUniforms()
+{
+    // Radius around a position that contains either geometry,
+    // so the frustum test never removes a partly visible instance
+    float radius = 0.0f;
+    if (_geom.valid())
+    {
+        const osg::BoundingSphere& bs = _geom->getBound();
+        radius = osg::maximum(radius, bs.center().length() + bs.radius());
+    }
+    if (_impostorGeom.valid())
+    {
+        const osg::BoundingSphere& bs = _impostorGeom->getBound();
+        radius = osg::maximum(radius, bs.center().length() + bs.radius());
+    }
+    _radiusUniform->set(radius);
+
+    // without an impostor geometry, the model draws out to the max range
+    _lodRangesUniform->set(osg::Vec2f(
+        _impostorGeom.valid() ? _impostorRange : 0.0f,
+        _maxRange));
 }
 
 void
 InstanceCloud::setPositions(osg::Vec4Array* value)
 {
     _data.points = value;
+    _numInstancesUniform->set(value ? (int)value->size() : 0);
 }
 
 void
@@ -234,17 +319,19 @@ InstanceCloud::cull(osg::RenderInfo& ri)
 
     osg::GLExtensions* ext = state->get<osg::GLExtensions>();
 
-    // Clear out the instance count:
+    // Clear out the instance counts:
     ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, _data.commandBuffer);
-    ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(DrawElementsIndirectCommand), &_data.command);
+    ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, NUM_LODS * sizeof(DrawElementsIndirectCommand), &_data.commands[0]);
     //ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); // necessary?
 
     ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_COMMAND_BUFFER, _data.commandBuffer);
     ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_POINTS_BUFFER, _data.pointsBuffer);
-    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_RENDER_BUFFER, _data.renderBuffer);
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_RENDER_BUFFER, _data.renderBuffers[LOD_MODEL]);
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_IMPOSTOR_RENDER_BUFFER, _data.renderBuffers[LOD_IMPOSTOR]);
 
-    ext->glDispatchCompute(_data.points->size(), 1, 1);
-    //ext->glDispatchCompute(_data.numX, _data.numY, 1); //_data.points->size(), 1, 1);
+    // one invocation per position:
+    GLuint numGroups = (_data.points->size() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+    ext->glDispatchCompute(numGroups, 1, 1);
 
     ext->glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
 
@@ -257,11 +344,15 @@ void
 InstanceCloud::draw(osg::RenderInfo& ri) 
 {
     _geom->draw(ri);
+
+    if (_impostorGeom.valid())
+        _impostorGeom->draw(ri);
 }
 
 
-InstanceCloud::Renderer::Renderer(InstancingData* data) :
-    _data(data)
+InstanceCloud::Renderer::Renderer(InstancingData* data, unsigned lod) :
+    _data(data),
+    _lod(lod)
 {
     //nop
 }
@@ -280,24 +371,34 @@ InstanceCloud::Renderer::drawImplementation(osg::RenderInfo& ri, const osg::Draw
     geom->drawVertexArraysImplementation(ri);
 
     // TODO: support multiple primtsets....?
-    osg::GLBufferObject* ebo = geom->getPrimitiveSet(0)->getOrCreateGLBufferObject(state.getContextID());
+    const osg::DrawElements* de = geom->getPrimitiveSet(0)->getDrawElements();
+    if (de == NULL)
+        return;
+
+    osg::GLBufferObject* ebo = de->getOrCreateGLBufferObject(state.getContextID());
     state.getCurrentVertexArrayState()->bindElementBufferObject(ebo);
 
-    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_RENDER_BUFFER, _data->renderBuffer);
+    // the vertex shader reads this LOD's culled points as render[]:
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_RENDER_BUFFER, _data->renderBuffers[_lod]);
 
     ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _data->commandBuffer);
-    ext->glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, 0, 1, 0);
+    ext->glMultiDrawElementsIndirect(
+        de->getMode(),
+        de->getDataType(),
+        (const GLvoid*)(_lod * sizeof(DrawElementsIndirectCommand)),
+        1, 0);
     //ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
     ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_RENDER_BUFFER, 0);
 }
 
 
-InstanceCloud::Installer::Installer(InstancingData* data) :
+InstanceCloud::Installer::Installer(InstancingData* data, unsigned lod) :
     osg::NodeVisitor(TRAVERSE_ALL_CHILDREN),
-    _data(data)
+    _data(data),
+    _lod(lod)
 {
-    _callback = new Renderer(data);
+    _callback = new Renderer(data, lod);
 }
 
 void 
@@ -308,7 +409,7 @@ InstanceCloud::Installer::apply(osg::Drawable& drawable)
     {
         geom->setDrawCallback(_callback.get());
         geom->setCullingActive(false);
-        _data->command.count = geom->getPrimitiveSet(0)->getNumIndices();
+        _data->commands[_lod].count = geom->getPrimitiveSet(0)->getNumIndices();
     }
 }
 
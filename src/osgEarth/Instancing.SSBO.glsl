@@ -0,0 +1,51 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#extension GL_ARB_draw_instanced: enable
+#extension GL_ARB_shader_storage_buffer_object : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#pragma vp_entryPoint oe_di_setInstancePosition
+#pragma vp_location   vertex_model
+#pragma vp_order      0.0
+
+// Compact instance record; see DrawInstanced.cpp
+// offsetScale = (offset from the group origin, uniform scale)
+// rotation = (quaternion xyz with w >= 0, object ID bits)
+struct oe_di_Instance {
+    vec4 offsetScale;
+    vec4 rotation;
+};
+
+layout(std430, binding=1) readonly buffer oe_di_InstanceBuffer {
+    oe_di_Instance oe_di_instances[];
+};
+
+// Indices of the instances that passed the GPU cull this frame
+layout(std430, binding=2) readonly buffer oe_di_VisibleBuffer {
+    uint oe_di_visible[];
+};
+
+// Stage-global containing object ID
+uint oe_index_objectid;
+vec3 vp_Normal;
+
+vec3 oe_di_rotate(in vec4 q, in vec3 v)
+{
+    return v + 2.0*cross(q.xyz, cross(q.xyz, v) + q.w*v);
+}
+
+void oe_di_setInstancePosition(inout vec4 VertexMODEL)
+{
+    oe_di_Instance instance = oe_di_instances[oe_di_visible[gl_InstanceID]];
+
+    vec3 qv = instance.rotation.xyz;
+    vec4 q = vec4(qv, sqrt(max(0.0, 1.0 - dot(qv, qv))));
+
+    oe_index_objectid = floatBitsToUint(instance.rotation.w);
+
+    VertexMODEL.xyz = oe_di_rotate(q, VertexMODEL.xyz * instance.offsetScale.w) + instance.offsetScale.xyz * VertexMODEL.w;
+
+    // uniform scale, so the normal only rotates
+    vp_Normal = oe_di_rotate(q, vp_Normal);
+}
@@ -0,0 +1,438 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/JobArena>
+#include <osgEarth/Notify>
+#include <OpenThreads/Thread>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+using namespace OpenThreads;
+
+#define LC "[JobArena] "
+
+//------------------------------------------------------------------------
+
+struct JobScheduler::Worker : public OpenThreads::Thread
+{
+    Worker(JobScheduler* scheduler, unsigned index) :
+        _scheduler(scheduler), _index(index) { }
+
+    void run()
+    {
+        while (!_scheduler->_done)
+        {
+            osg::ref_ptr<JobArena> arena;
+
+            if (_scheduler->take(_index, arena))
+            {
+                arena->runNext();
+            }
+            else
+            {
+                ScopedLock<Mutex> lock(_scheduler->_sleepMutex);
+                while (_scheduler->_pending == 0 && !_scheduler->_done)
+                {
+                    _scheduler->_wake.wait(&_scheduler->_sleepMutex);
+                }
+            }
+        }
+    }
+
+    JobScheduler* _scheduler;
+    unsigned _index;
+    std::deque< osg::ref_ptr<JobArena> > _deques[NUM_BANDS];
+    Threading::Mutex _mutex;
+};
+
+//------------------------------------------------------------------------
+
+JobScheduler*
+JobScheduler::instance()
+{
+    static Threading::Mutex s_mutex;
+    static osg::ref_ptr<JobScheduler> s_instance;
+
+    ScopedLock<Mutex> lock(s_mutex);
+    if (!s_instance.valid())
+    {
+        int numThreads = OpenThreads::GetNumberOfProcessors();
+        const char* env = ::getenv("OSGEARTH_JOB_THREADS");
+        if (env)
+            numThreads = ::atoi(env);
+
+        s_instance = new JobScheduler(osg::maximum(numThreads, 2));
+    }
+    return s_instance.get();
+}
+
+JobScheduler::JobScheduler(unsigned numThreads) :
+_numWorkers(0),
+_nextWorker(0),
+_pending(0),
+_steals(0),
+_done(false)
+{
+    for (unsigned i = 0; i < MAX_WORKERS; ++i)
+        _workers[i] = 0L;
+
+    reserve(numThreads);
+}
+
+JobScheduler::~JobScheduler()
+{
+    shutdown();
+}
+
+void
+JobScheduler::reserve(unsigned numThreads)
+{
+    ScopedLock<Mutex> lock(_workersMutex);
+
+    if (_done)
+        return;
+
+    numThreads = osg::minimum(numThreads, (unsigned)MAX_WORKERS);
+
+    unsigned count = _numWorkers;
+    if (count < numThreads)
+    {
+        for (; count < numThreads; ++count)
+        {
+            Worker* worker = new Worker(this, count);
+            _workers[count] = worker;
+            // publish the worker only after it's in the table:
+            ++_numWorkers;
+            worker->start();
+        }
+
+        OE_INFO << LC << "Scheduler using " << count << " threads" << std::endl;
+    }
+}
+
+void
+JobScheduler::shutdown()
+{
+    ScopedLock<Mutex> lock(_workersMutex);
+
+    if (_done)
+        return;
+
+    {
+        ScopedLock<Mutex> sleepLock(_sleepMutex);
+        _done = true;
+        _wake.broadcast();
+    }
+
+    unsigned count = _numWorkers;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        _workers[i]->join();
+    }
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        delete _workers[i];
+        _workers[i] = 0L;
+    }
+}
+
+void
+JobScheduler::submit(JobArena* arena, Band band)
+{
+    unsigned count = _numWorkers;
+    if (count == 0u || _done)
+        return;
+
+    // A worker scheduling follow-up work keeps it local (it is likely
+    // to be warm in that thread's cache); everyone else round-robins.
+    unsigned index;
+    Worker* self = dynamic_cast<Worker*>(OpenThreads::Thread::CurrentThread());
+    if (self && self->_scheduler == this)
+        index = self->_index;
+    else
+        index = (unsigned)(++_nextWorker) % count;
+
+    Worker* worker = _workers[index];
+    {
+        ScopedLock<Mutex> lock(worker->_mutex);
+        worker->_deques[band].push_back(arena);
+    }
+
+    {
+        ScopedLock<Mutex> lock(_sleepMutex);
+        ++_pending;
+        _wake.signal();
+    }
+}
+
+bool
+JobScheduler::isWorkerThread() const
+{
+    Worker* self = dynamic_cast<Worker*>(OpenThreads::Thread::CurrentThread());
+    return self && self->_scheduler == this;
+}
+
+bool
+JobScheduler::take(unsigned workerIndex, osg::ref_ptr<JobArena>& out)
+{
+    if (_pending == 0)
+        return false;
+
+    unsigned count = _numWorkers;
+    Worker* self = _workers[workerIndex];
+
+    for (unsigned band = 0; band < NUM_BANDS; ++band)
+    {
+        // own deque first, oldest work first:
+        {
+            ScopedLock<Mutex> lock(self->_mutex);
+            std::deque< osg::ref_ptr<JobArena> >& d = self->_deques[band];
+            if (!d.empty())
+            {
+                out = d.front();
+                d.pop_front();
+                --_pending;
+                return true;
+            }
+        }
+
+        // then steal from the back of the other workers' deques:
+        for (unsigned i = 1; i < count; ++i)
+        {
+            Worker* victim = _workers[(workerIndex + i) % count];
+            ScopedLock<Mutex> lock(victim->_mutex);
+            std::deque< osg::ref_ptr<JobArena> >& d = victim->_deques[band];
+            if (!d.empty())
+            {
+                out = d.back();
+                d.pop_back();
+                --_pending;
+                ++_steals;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    typedef std::map<std::string, osg::ref_ptr<JobArena> > ArenaRegistry;
+
+    Threading::Mutex s_arenasMutex;
+    ArenaRegistry& arenas()
+    {
+        static ArenaRegistry s_arenas;
+        return s_arenas;
+    }
+}
+
+JobArena*
+JobArena::get(const std::string& name)
+{
+    ScopedLock<Mutex> lock(s_arenasMutex);
+    osg::ref_ptr<JobArena>& arena = arenas()[name];
+    if (!arena.valid())
+        arena = new JobArena(name);
+    return arena.get();
+}
+
+JobArena::JobArena(const std::string& name,
+                   unsigned concurrency,
+                   JobScheduler::Band band,
+                   JobScheduler* scheduler) :
+_name(name),
+_concurrency(osg::maximum(concurrency, 1u)),
+_maxPending(0u),
+_band(band),
+_scheduler(scheduler ? scheduler : JobScheduler::instance()),
+_tickets(0u),
+_active(0),
+_pendingGauge(Metrics::gauge("jobs." + name + ".pending"))
+{
+    _scheduler->reserve(_concurrency);
+}
+
+void
+JobArena::setConcurrency(unsigned value)
+{
+    unsigned toSubmit = 0u;
+    {
+        ScopedLock<Mutex> lock(_mutex);
+        _concurrency = osg::maximum(value, 1u);
+
+        // if we raised the limit, put more tickets in play right away:
+        while (_tickets < _concurrency && _tickets < _queue.size())
+        {
+            ++_tickets;
+            ++toSubmit;
+        }
+    }
+
+    _scheduler->reserve(_concurrency);
+
+    for (unsigned i = 0; i < toSubmit; ++i)
+        _scheduler->submit(this, _band);
+}
+
+void
+JobArena::dispatch(TaskRequest* job, ProgressCallback* cancelToken)
+{
+    if (!job)
+        return;
+
+    if (cancelToken)
+        job->setProgressCallback(cancelToken);
+    else if (!job->getProgressCallback())
+        job->setProgressCallback(new ProgressCallback());
+
+    job->setState(TaskRequest::STATE_PENDING);
+
+    // A worker waiting for room would hold a thread the queue needs to
+    // drain; once every worker did so, the arena would deadlock.
+    bool bounded = _maxPending > 0u && !_scheduler->isWorkerThread();
+
+    bool submit = false;
+    {
+        ScopedLock<Mutex> lock(_mutex);
+
+        while (bounded && _queue.size() >= _maxPending)
+        {
+            _notFull.wait(&_mutex);
+        }
+
+        _queue.insert(std::make_pair(job->getPriority(), osg::ref_ptr<TaskRequest>(job)));
+        _pendingGauge->set(_queue.size());
+
+        // Each ticket in the scheduler runs one job and then re-submits
+        // itself if there is more work, so the number of outstanding tickets
+        // is the number of jobs this arena can run in parallel.
+        if (_tickets < _concurrency)
+        {
+            ++_tickets;
+            submit = true;
+        }
+    }
+
+    if (submit)
+        _scheduler->submit(this, _band);
+}
+
+void
+JobArena::runNext()
+{
+    osg::ref_ptr<TaskRequest> job;
+    {
+        ScopedLock<Mutex> lock(_mutex);
+        if (_queue.empty() || _tickets > _concurrency)
+        {
+            // either nothing to do, or the limit was lowered; retire the ticket.
+            --_tickets;
+            return;
+        }
+        job = _queue.begin()->second.get();
+        _queue.erase(_queue.begin());
+        _pendingGauge->set(_queue.size());
+        _running.push_back(job.get());
+        ++_active;
+    }
+
+    _notFull.signal();
+
+    // discard a completed or canceled request:
+    if (job->getState() != TaskRequest::STATE_PENDING)
+    {
+        job->cancel();
+    }
+    else if (!job->wasCanceled())
+    {
+        if (job->getProgressCallback())
+            job->getProgressCallback()->onStarted();
+
+        job->setState(TaskRequest::STATE_IN_PROGRESS);
+        job->run();
+    }
+
+    job->setState(TaskRequest::STATE_COMPLETED);
+
+    if (job->getProgressCallback())
+        job->getProgressCallback()->onCompleted();
+
+    if (job->getCompletedEvent())
+        job->getCompletedEvent()->set();
+
+    bool resubmit = false;
+    {
+        ScopedLock<Mutex> lock(_mutex);
+        _running.erase(std::find(_running.begin(), _running.end(), job));
+        --_active;
+
+        if (!_queue.empty() && _tickets <= _concurrency)
+            resubmit = true;
+        else
+            --_tickets;
+    }
+
+    if (resubmit)
+        _scheduler->submit(this, _band);
+}
+
+void
+JobArena::cancelAll()
+{
+    ScopedLock<Mutex> lock(_mutex);
+
+    for (TaskRequestPriorityMap::iterator i = _queue.begin(); i != _queue.end(); ++i)
+        i->second->cancel();
+    _queue.clear();
+    _pendingGauge->set(0);
+
+    for (TaskRequestVector::iterator i = _running.begin(); i != _running.end(); ++i)
+        (*i)->cancel();
+
+    _notFull.broadcast();
+}
+
+unsigned
+JobArena::getNumPending() const
+{
+    ScopedLock<Mutex> lock(_mutex);
+    return _queue.size();
+}
+
+bool
+JobArena::isIdle() const
+{
+    ScopedLock<Mutex> lock(_mutex);
+    return _queue.empty() && _active == 0;
+}
+
+void
+JobArena::waitUntilIdle() const
+{
+    while (!isIdle())
+    {
+        OpenThreads::Thread::microSleep(1000);
+    }
+}
@@ -3527,3 +3527,461 @@ std::ostream& operator<<( std::ostream &sout, const Value &root )
    return sout;
 }
 
+
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// class ValueBuilder
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+
+namespace osgEarth { namespace Util { namespace Json {
+
+ValueBuilder::ValueBuilder()
+   : complete_( false )
+{
+}
+
+
+void 
+ValueBuilder::reset()
+{
+   root_ = Value();
+   nodes_.clear();
+   key_.clear();
+   complete_ = false;
+}
+
+
+Value *
+ValueBuilder::add( const Value &value )
+{
+   if ( nodes_.empty() )
+   {
+      root_ = value;
+      return &root_;
+   }
+   Value &parent = *nodes_.back();
+   if ( parent.isArray() )
+      return &parent.append( value );
+   return &( parent[key_] = value );
+}
+
+
+bool 
+ValueBuilder::null()
+{
+   add( Value() );
+   complete_ = nodes_.empty();
+   return true;
+}
+
+
+bool 
+ValueBuilder::boolean( bool value )
+{
+   add( Value( value ) );
+   complete_ = nodes_.empty();
+   return true;
+}
+
+
+bool 
+ValueBuilder::integer( Value::Int value )
+{
+   add( Value( value ) );
+   complete_ = nodes_.empty();
+   return true;
+}
+
+
+bool 
+ValueBuilder::uinteger( Value::UInt value )
+{
+   add( Value( value ) );
+   complete_ = nodes_.empty();
+   return true;
+}
+
+
+bool 
+ValueBuilder::real( double value )
+{
+   add( Value( value ) );
+   complete_ = nodes_.empty();
+   return true;
+}
+
+
+bool 
+ValueBuilder::string( const std::string &value )
+{
+   add( Value( value ) );
+   complete_ = nodes_.empty();
+   return true;
+}
+
+
+bool 
+ValueBuilder::startObject()
+{
+   nodes_.push_back( add( Value( objectValue ) ) );
+   return true;
+}
+
+
+bool 
+ValueBuilder::key( const std::string &name )
+{
+   key_ = name;
+   return true;
+}
+
+
+bool 
+ValueBuilder::endObject()
+{
+   nodes_.pop_back();
+   complete_ = nodes_.empty();
+   return true;
+}
+
+
+bool 
+ValueBuilder::startArray()
+{
+   nodes_.push_back( add( Value( arrayValue ) ) );
+   return true;
+}
+
+
+bool 
+ValueBuilder::endArray()
+{
+   nodes_.pop_back();
+   complete_ = nodes_.empty();
+   return true;
+}
+
+
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// class SaxReader
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+
+// deeper documents are rejected rather than overflowing the stack
+static const int maxSaxDepth = 1000;
+
+SaxReader::SaxReader()
+   : begin_( 0 )
+   , end_( 0 )
+   , current_( 0 )
+{
+}
+
+
+bool 
+SaxReader::parse( const std::string &document, SaxHandler &handler )
+{
+   const char *begin = document.c_str();
+   return parse( begin, begin + document.length(), handler );
+}
+
+
+bool 
+SaxReader::parse( const char *beginDoc, const char *endDoc, SaxHandler &handler )
+{
+   begin_ = beginDoc;
+   end_ = endDoc;
+   current_ = beginDoc;
+   error_.clear();
+
+   if ( !readValue( handler, 0 ) )
+      return false;
+
+   skipSpaces();
+   if ( current_ != end_ )
+      return fail( "Extra characters after the document" );
+   return true;
+}
+
+
+bool 
+SaxReader::fail( const std::string &message )
+{
+   if ( error_.empty() )
+   {
+      std::ostringstream buf;
+      buf << message << " at offset " << ( current_ - begin_ );
+      error_ = buf.str();
+   }
+   return false;
+}
+
+
+void 
+SaxReader::skipSpaces()
+{
+   while ( current_ != end_ )
+   {
+      char c = *current_;
+      if ( c == ' ' || c == '\t' || c == '\r' || c == '\n' )
+      {
+         ++current_;
+      }
+      else if ( c == '/' && end_ - current_ > 1 && current_[1] == '/' )
+      {
+         while ( current_ != end_ && *current_ != '\n' )
+            ++current_;
+      }
+      else if ( c == '/' && end_ - current_ > 1 && current_[1] == '*' )
+      {
+         current_ += 2;
+         while ( end_ - current_ > 1 && !( current_[0] == '*' && current_[1] == '/' ) )
+            ++current_;
+         current_ = end_ - current_ > 1 ? current_ + 2 : end_;
+      }
+      else
+      {
+         break;
+      }
+   }
+}
+
+
+bool 
+SaxReader::readLiteral( const char *literal )
+{
+   for ( ; *literal; ++literal, ++current_ )
+   {
+      if ( current_ == end_ || *current_ != *literal )
+         return fail( "Syntax error" );
+   }
+   return true;
+}
+
+
+bool 
+SaxReader::readValue( SaxHandler &handler, int depth )
+{
+   if ( depth > maxSaxDepth )
+      return fail( "Document is nested too deeply" );
+
+   skipSpaces();
+   if ( current_ == end_ )
+      return fail( "Unexpected end of document" );
+
+   switch ( *current_ )
+   {
+   case '{':
+      {
+         ++current_;
+         if ( !handler.startObject() )
+            return fail( "Stopped by handler" );
+         skipSpaces();
+         if ( current_ != end_ && *current_ == '}' )
+         {
+            ++current_;
+            return handler.endObject() || fail( "Stopped by handler" );
+         }
+         for ( ;; )
+         {
+            skipSpaces();
+            if ( current_ == end_ || *current_ != '"' )
+               return fail( "Missing '\"' before an object member name" );
+            if ( !readString( buffer_ ) )
+               return false;
+            if ( !handler.key( buffer_ ) )
+               return fail( "Stopped by handler" );
+            skipSpaces();
+            if ( current_ == end_ || *current_ != ':' )
+               return fail( "Missing ':' after an object member name" );
+            ++current_;
+            if ( !readValue( handler, depth + 1 ) )
+               return false;
+            skipSpaces();
+            if ( current_ == end_ )
+               return fail( "Unexpected end of document in an object" );
+            char c = *current_++;
+            if ( c == '}' )
+               return handler.endObject() || fail( "Stopped by handler" );
+            if ( c != ',' )
+               return fail( "Missing ',' or '}' in an object" );
+         }
+      }
+   case '[':
+      {
+         ++current_;
+         if ( !handler.startArray() )
+            return fail( "Stopped by handler" );
+         skipSpaces();
+         if ( current_ != end_ && *current_ == ']' )
+         {
+            ++current_;
+            return handler.endArray() || fail( "Stopped by handler" );
+         }
+         for ( ;; )
+         {
+            if ( !readValue( handler, depth + 1 ) )
+               return false;
+            skipSpaces();
+            if ( current_ == end_ )
+               return fail( "Unexpected end of document in an array" );
+            char c = *current_++;
+            if ( c == ']' )
+               return handler.endArray() || fail( "Stopped by handler" );
+            if ( c != ',' )
+               return fail( "Missing ',' or ']' in an array" );
+         }
+      }
+   case '"':
+      if ( !readString( buffer_ ) )
+         return false;
+      return handler.string( buffer_ ) || fail( "Stopped by handler" );
+   case 't':
+      return readLiteral( "true" ) && ( handler.boolean( true ) || fail( "Stopped by handler" ) );
+   case 'f':
+      return readLiteral( "false" ) && ( handler.boolean( false ) || fail( "Stopped by handler" ) );
+   case 'n':
+      return readLiteral( "null" ) && ( handler.null() || fail( "Stopped by handler" ) );
+   default:
+      return readNumber( handler );
+   }
+}
+
+
+bool 
+SaxReader::readString( std::string &out )
+{
+   out.clear();
+   ++current_; // skip '"'
+   for ( ;; )
+   {
+      // copy runs of plain characters at once
+      const char *run = current_;
+      while ( current_ != end_ && *current_ != '"' && *current_ != '\\' )
+         ++current_;
+      out.append( run, current_ );
+
+      if ( current_ == end_ )
+         return fail( "Missing '\"' at the end of a string" );
+
+      if ( *current_++ == '"' )
+         return true;
+
+      if ( current_ == end_ )
+         return fail( "Empty escape sequence in string" );
+
+      char escape = *current_++;
+      switch ( escape )
+      {
+      case '"': out += '"'; break;
+      case '/': out += '/'; break;
+      case '\\': out += '\\'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u':
+         {
+            if ( end_ - current_ < 4 )
+               return fail( "Bad unicode escape sequence in string" );
+            unsigned int unicode = 0;
+            for ( int index = 0; index < 4; ++index )
+            {
+               char c = *current_++;
+               unicode *= 16;
+               if ( c >= '0' && c <= '9' )
+                  unicode += c - '0';
+               else if ( c >= 'a' && c <= 'f' )
+                  unicode += c - 'a' + 10;
+               else if ( c >= 'A' && c <= 'F' )
+                  unicode += c - 'A' + 10;
+               else
+                  return fail( "Bad unicode escape sequence in string" );
+            }
+
+            // encode as UTF-8 (surrogate pairs are encoded individually)
+            if ( unicode < 0x80 )
+            {
+               out += static_cast<char>( unicode );
+            }
+            else if ( unicode < 0x800 )
+            {
+               out += static_cast<char>( 0xC0 | ( unicode >> 6 ) );
+               out += static_cast<char>( 0x80 | ( unicode & 0x3F ) );
+            }
+            else
+            {
+               out += static_cast<char>( 0xE0 | ( unicode >> 12 ) );
+               out += static_cast<char>( 0x80 | ( ( unicode >> 6 ) & 0x3F ) );
+               out += static_cast<char>( 0x80 | ( unicode & 0x3F ) );
+            }
+         }
+         break;
+      default:
+         return fail( "Bad escape sequence in string" );
+      }
+   }
+}
+
+
+bool 
+SaxReader::readNumber( SaxHandler &handler )
+{
+   const char *start = current_;
+   bool isDouble = false;
+   while ( current_ != end_ )
+   {
+      char c = *current_;
+      if ( c == '.' || c == 'e' || c == 'E' || c == '+' || ( c == '-' && current_ != start ) )
+         isDouble = true;
+      else if ( c != '-' && ( c < '0' || c > '9' ) )
+         break;
+      ++current_;
+   }
+
+   if ( current_ == start )
+      return fail( "Syntax error" );
+
+   if ( !isDouble )
+   {
+      const char *digit = start;
+      bool isNegative = *digit == '-';
+      if ( isNegative )
+         ++digit;
+      Value::UInt threshold = ( isNegative ? Value::UInt( -Value::minInt ) : Value::maxUInt ) / 10;
+      Value::UInt value = 0;
+      for ( ; digit != current_; ++digit )
+      {
+         if ( *digit < '0' || *digit > '9' || value >= threshold )
+         {
+            isDouble = true;
+            break;
+         }
+         value = value * 10 + Value::UInt( *digit - '0' );
+      }
+
+      if ( !isDouble )
+      {
+         bool ok;
+         if ( isNegative )
+            ok = handler.integer( -Value::Int( value ) );
+         else if ( value <= Value::UInt( Value::maxInt ) )
+            ok = handler.integer( Value::Int( value ) );
+         else
+            ok = handler.uinteger( value );
+         return ok || fail( "Stopped by handler" );
+      }
+   }
+
+   std::string text( start, current_ );
+   char *parsed = 0;
+   double value = strtod( text.c_str(), &parsed );
+   if ( parsed != text.c_str() + text.length() )
+      return fail( "'" + text + "' is not a number" );
+   return handler.real( value ) || fail( "Stopped by handler" );
+}
+
+} } } // namespaces
@@ -0,0 +1,150 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/KnownEmptyTiles>
+#include <osgEarth/CacheBin>
+#include <osgEarth/CachePolicy>
+#include <osgEarth/Notify>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace osgEarth;
+
+#define LC "[KnownEmptyTiles] "
+
+// first line of a stored record
+#define RECORD_HEADER "empty-tiles-1\n"
+
+KnownEmptyTiles::KnownEmptyTiles() :
+_unsaved(0u)
+{
+    //nop
+}
+
+bool
+KnownEmptyTiles::pack(const TileKey& key, uint64_t& output)
+{
+    const uint64_t LIMIT = (uint64_t)1 << 29;
+    if (!key.valid() || key.getLOD() >= 64u || key.getTileX() >= LIMIT || key.getTileY() >= LIMIT)
+        return false;
+
+    output = ((uint64_t)key.getLOD() << 58) | ((uint64_t)key.getTileX() << 29) | (uint64_t)key.getTileY();
+    return true;
+}
+
+bool
+KnownEmptyTiles::contains(const TileKey& key) const
+{
+    uint64_t packed;
+    if (!pack(key, packed))
+        return false;
+
+    Threading::ScopedReadLock lock(_mutex);
+    return _keys.find(packed) != _keys.end();
+}
+
+void
+KnownEmptyTiles::insert(const TileKey& key)
+{
+    uint64_t packed;
+    if (!pack(key, packed))
+        return;
+
+    Threading::ScopedWriteLock lock(_mutex);
+    if (_keys.insert(packed).second)
+        ++_unsaved;
+}
+
+unsigned
+KnownEmptyTiles::size() const
+{
+    Threading::ScopedReadLock lock(_mutex);
+    return _keys.size();
+}
+
+unsigned
+KnownEmptyTiles::getNumUnsaved() const
+{
+    Threading::ScopedReadLock lock(_mutex);
+    return _unsaved;
+}
+
+bool
+KnownEmptyTiles::load(CacheBin* bin, const std::string& recordKey, const CachePolicy& policy)
+{
+    if (!bin)
+        return false;
+
+    ReadResult rr = bin->readString(recordKey, 0L);
+    if (!rr.succeeded() || policy.isExpired(rr.lastModifiedTime()))
+        return false;
+
+    const std::string& record = rr.getString();
+    const std::string header(RECORD_HEADER);
+    if (record.compare(0, header.size(), header) != 0)
+    {
+        OE_WARN << LC << "Record \"" << recordKey << "\" appears to be corrupt" << std::endl;
+        return false;
+    }
+
+    // one hex key per line
+    Util::UnorderedSet<uint64_t> keys;
+    const char* ptr = record.c_str() + header.size();
+    while (*ptr)
+    {
+        char* end;
+        unsigned long long value = strtoull(ptr, &end, 16);
+        if (end == ptr)
+            break;
+        keys.insert((uint64_t)value);
+        ptr = end;
+        while (*ptr == '\n')
+            ++ptr;
+    }
+
+    Threading::ScopedWriteLock lock(_mutex);
+    _keys.swap(keys);
+    _unsaved = 0u;
+
+    OE_DEBUG << LC << "Loaded " << _keys.size() << " keys from \"" << recordKey << "\"" << std::endl;
+    return true;
+}
+
+bool
+KnownEmptyTiles::save(CacheBin* bin, const std::string& recordKey)
+{
+    if (!bin)
+        return false;
+
+    std::string record(RECORD_HEADER);
+    {
+        Threading::ScopedWriteLock lock(_mutex);
+        record.reserve(record.size() + _keys.size() * 17u);
+
+        char buf[32];
+        for (Util::UnorderedSet<uint64_t>::const_iterator i = _keys.begin(); i != _keys.end(); ++i)
+        {
+            int len = snprintf(buf, sizeof(buf), "%llx\n", (unsigned long long)*i);
+            record.append(buf, len);
+        }
+        _unsaved = 0u;
+    }
+
+    osg::ref_ptr<StringObject> temp = new StringObject(record);
+    return bin->write(recordKey, temp.get(), 0L);
+}
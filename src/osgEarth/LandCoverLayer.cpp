@@ -22,6 +22,7 @@
 #include <osgEarth/SimplexNoise>
 #include <osgEarth/Progress>
 #include <osgEarth/Random>
+#include <osgEarth/StringUtils>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -38,7 +39,10 @@ REGISTER_OSGEARTH_LAYER(landcover, LandCoverLayer);
 void
 LandCoverLayer::Options::fromConfig(const Config& conf)
 {
+    baked().init(false);
+
     source().get(conf, "source");
+    conf.get("baked", baked());
 
     ConfigSet mappingsConf = conf.child("land_cover_mappings").children("mapping");
     for (ConfigSet::const_iterator i = mappingsConf.begin(); i != mappingsConf.end(); ++i)
@@ -54,6 +58,7 @@ LandCoverLayer::Options::getConfig() const
     Config conf = ImageLayer::Options::getConfig();
 
     source().set(conf, "source");
+    conf.set("baked", baked());
 
     if (conf.hasChild("land_cover_mappings") == false)
     {   
@@ -76,11 +81,20 @@ LandCoverLayer::Options::getConfig() const
 #undef  LC
 #define LC "[LandCoverLayer] "
 
+// cache record holding the signature of the dictionary used to classify the cached tiles
+#define DICTIONARY_SIGNATURE_KEY "_landcover_dictionary"
+
 void
 LandCoverLayer::init()
 {
     options().coverage() = true;
 
+    // Baked tiles are float codes, which pack well losslessly
+    if (options().baked() == true && !options().cacheCodec().isSet())
+    {
+        options().cacheCodec().init("zlib");
+    }
+
     ImageLayer::init();
 
     setRenderType(RENDERTYPE_NONE);
@@ -128,6 +142,18 @@ LandCoverLayer::map(int value, const std::string& classname)
     options().mappings().push_back(new LandCoverValueMapping(value, classname));
 }
 
+void
+LandCoverLayer::setBaked(const bool& value)
+{
+    setOptionThatRequiresReopen(options().baked(), value);
+}
+
+const bool&
+LandCoverLayer::getBaked() const
+{
+    return options().baked().get();
+}
+
 Status
 LandCoverLayer::openImplementation()
 {
@@ -149,7 +175,21 @@ LandCoverLayer::openImplementation()
     // Try to open it.
     Status cs = options().source().open(getReadOptions());
     if (cs.isError())
+    {
+        // In baked mode the cached tiles are enough to run without the source.
+        if (options().baked() == true && getCacheSettings() && getCacheSettings()->isCacheEnabled())
+        {
+            OE_INFO << LC << getName() << ": source unavailable (" << cs.message() << "); using baked tiles only\n";
+            getCacheSettings()->cachePolicy() = CachePolicy::CACHE_ONLY;
+            return Status::NoError;
+        }
         return cs;
+    }
+
+    if (options().baked() == true && (!getCacheSettings() || !getCacheSettings()->isCacheEnabled()))
+    {
+        OE_WARN << LC << getName() << ": baked mode requires a cache; tiles will be classified at runtime\n";
+    }
 
     // Pull this layer's extents from the coverage layer.
     // TODO: imageLayer can probably not to NULL here
@@ -188,12 +228,14 @@ LandCoverLayer::addedToMap(const Map* map)
 
     if (_lcDictionary.valid())
     {
-        if (getSource())
+        if (getSource() && getSource()->isOpen())
         {
             getSource()->addedToMap(map);
             buildCodeMap(_codemap);
         }
 
+        validateCache();
+
 #if 0
         const LandCoverClass* water = _lcDictionary->getClassByName("water");
         if (water) _waterCode = water->getValue();
@@ -548,6 +590,45 @@ LandCoverLayer::createFractalEnhancedImage(const TileKey& key, ProgressCallback*
     return GeoImage(output.get(), key.getExtent());
 }
 
+// Discards the cached tiles if they were classified with a different
+// dictionary than the current one. The mappings are part of the layer
+// options and therefore already part of the cache ID.
+void
+LandCoverLayer::validateCache()
+{
+    if (!getCacheSettings() || !getCacheSettings()->isCacheEnabled() || !getProfile())
+        return;
+
+    CacheBin* bin = getCacheBin(getProfile());
+    if (!bin)
+        return;
+
+    std::string signature = hashToString(_lcDictionary->getConfig().toJSON(false));
+
+    ReadResult rr = bin->readString(DICTIONARY_SIGNATURE_KEY, getReadOptions());
+    if (rr.succeeded() && rr.getString() == signature)
+        return;
+
+    if (rr.succeeded())
+    {
+        if (getCacheSettings()->cachePolicy()->isCacheOnly())
+        {
+            OE_WARN << LC << getName() << ": baked tiles were made with a different land cover dictionary\n";
+            return;
+        }
+
+        OE_INFO << LC << getName() << ": land cover dictionary changed; clearing cached tiles\n";
+        bin->clear();
+        bumpRevision();
+    }
+
+    if (getCacheSettings()->cachePolicy()->isCacheWriteable())
+    {
+        osg::ref_ptr<StringObject> temp = new StringObject(signature);
+        bin->write(DICTIONARY_SIGNATURE_KEY, temp.get(), getReadOptions());
+    }
+}
+
 // Constructs a code map (int to int) for a coverage layer. We will use this
 // code map to map coverage layer codes to dictionary codes.
 void
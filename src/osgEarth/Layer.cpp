@@ -18,11 +18,14 @@
  */
 #include <osgEarth/Layer>
 #include <osgEarth/Cache>
+#include <osgEarth/CacheCodec>
+#include <osgEarth/MemCache>
 #include <osgEarth/Registry>
 #include <osgEarth/SceneGraphCallback>
 #include <osgEarth/ShaderLoader>
 #include <osgEarth/TileKey>
 #include <osgEarth/TerrainResources>
+#include <osgEarth/WriteBehindCacheBin>
 #include <osg/StateSet>
 
 using namespace osgEarth;
@@ -40,6 +43,7 @@ Layer::Options::getConfig() const
     conf.set("cacheid", cacheId());
     if (cachePolicy().isSet() && !cachePolicy()->empty())
         conf.set("cache_policy", cachePolicy());
+    conf.set("cache_codec", cacheCodec());
     conf.set("shader_define", shaderDefine());
     conf.set("attribution", attribution());
     conf.set("terrain", terrainPatch());
@@ -68,6 +72,7 @@ Layer::Options::fromConfig(const Config& conf)
     conf.get("cacheid", cacheId());
     conf.get("attribution", attribution());
     conf.get("cache_policy", cachePolicy());
+    conf.get("cache_codec", cacheCodec());
 
     // legacy support:
     if (!cachePolicy().isSet())
@@ -156,6 +161,18 @@ Layer::setCacheID(const std::string& value)
     setOptionThatRequiresReopen(options().cacheId(), value);
 }
 
+void
+Layer::setCacheCodec(const std::string& value)
+{
+    setOptionThatRequiresReopen(options().cacheCodec(), value);
+}
+
+const std::string&
+Layer::getCacheCodec() const
+{
+    return options().cacheCodec().get();
+}
+
 std::string
 Layer::getCacheID() const
 {
@@ -182,6 +199,7 @@ Layer::getCacheID() const
         hashConf.remove("cache_only");
         hashConf.remove("cache_enabled");
         hashConf.remove("cache_policy");
+        hashConf.remove("cache_codec");
         hashConf.remove("visible");
         hashConf.remove("l2_cache_size");
 
@@ -332,6 +350,27 @@ Layer::openImplementation()
         CacheBin* bin = _cacheSettings->getCache()->addBin(_runtimeCacheId);
         if (bin)
         {
+            if (options().cacheCodec().isSet())
+            {
+                if (CacheCodec::isAvailable(options().cacheCodec().get()))
+                {
+                    bin->setCodec(options().cacheCodec().get());
+                    OE_INFO << LC << "Cache codec is [" << bin->getCodec() << "]\n";
+                }
+                else
+                {
+                    OE_WARN << LC << "Cache codec \"" << options().cacheCodec().get() << "\" is not available\n";
+                }
+            }
+
+            // Write to persistent caches in the background so the
+            // loader threads don't wait on serialization and I/O.
+            unsigned maxPending = WriteBehindCacheBin::getDefaultMaxPending();
+            if (maxPending > 0u && dynamic_cast<MemCache*>(_cacheSettings->getCache()) == 0L)
+            {
+                bin = new WriteBehindCacheBin(bin, maxPending);
+            }
+
             OE_INFO << LC << "Cache bin is [" << _runtimeCacheId << "]\n";
             _cacheSettings->setCacheBin(bin);
         }
@@ -352,6 +391,14 @@ Layer::openImplementation()
 Status
 Layer::closeImplementation()
 {
+    // finish any cache writes still in flight
+    if (_cacheSettings.valid())
+    {
+        WriteBehindCacheBin* bin = dynamic_cast<WriteBehindCacheBin*>(_cacheSettings->getCacheBin());
+        if (bin)
+            bin->flush();
+    }
+
     _cacheSettings = NULL;
     _runtimeCacheId.clear();
     return Status::NoError;
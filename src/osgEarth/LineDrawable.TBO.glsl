@@ -0,0 +1,78 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#extension GL_ARB_draw_instanced: enable
+
+#pragma vp_name GPU Lines Texture Buffer Model
+#pragma vp_entryPoint oe_LineDrawable_VS_MODEL
+#pragma vp_location vertex_model
+#pragma vp_order first
+
+// Two texels per point: (position, 0), (color)
+uniform samplerBuffer oe_LineDrawable_points;
+
+// 0 = GL_LINE_STRIP, 1 = GL_LINE_LOOP, 2 = GL_LINES
+uniform int oe_LineDrawable_mode;
+
+// Shared stage globals
+vec4 vp_Color;
+vec3 oe_LineDrawable_curr;
+vec3 oe_LineDrawable_prev;
+vec3 oe_LineDrawable_next;
+int oe_LineDrawable_index;
+int oe_LineDrawable_code;
+
+vec3 oe_LineDrawable_point(in int i)
+{
+    return texelFetch(oe_LineDrawable_points, 2*i).xyz;
+}
+
+void oe_LineDrawable_VS_MODEL(inout vec4 vertex)
+{
+    int numPoints = textureSize(oe_LineDrawable_points) / 2;
+
+    // Each instance draws one segment as a quad. In the pattern,
+    // x = 0 at the start of the segment and 1 at the end;
+    // y = 0 on the right side and 1 on the left.
+    bool isEnd = vertex.x > 0.5;
+    bool isLeft = vertex.y > 0.5;
+    oe_LineDrawable_code = (isEnd ? 2 : 0) + (isLeft ? 1 : 0);
+
+    // endpoints of this segment
+    int a, b;
+    if (oe_LineDrawable_mode == 2)
+    {
+        a = gl_InstanceID * 2;
+        b = a + 1;
+    }
+    else
+    {
+        a = gl_InstanceID;
+        b = (a + 1) % numPoints;
+    }
+
+    int i = isEnd ? b : a;
+    oe_LineDrawable_index = i;
+    oe_LineDrawable_curr = oe_LineDrawable_point(i);
+
+    // Neighbors follow the same rules as the expanded arrays: an endpoint
+    // is its own neighbor, which the clip stage detects.
+    if (oe_LineDrawable_mode == 2)
+    {
+        oe_LineDrawable_prev = oe_LineDrawable_point(a);
+        oe_LineDrawable_next = oe_LineDrawable_point(b);
+    }
+    else if (oe_LineDrawable_mode == 1)
+    {
+        oe_LineDrawable_prev = oe_LineDrawable_point((i + numPoints - 1) % numPoints);
+        oe_LineDrawable_next = oe_LineDrawable_point((i + 1) % numPoints);
+    }
+    else
+    {
+        oe_LineDrawable_prev = i > 0 ? oe_LineDrawable_point(i - 1) : oe_LineDrawable_curr;
+        oe_LineDrawable_next = i < numPoints - 1 ? oe_LineDrawable_point(i + 1) : oe_LineDrawable_curr;
+    }
+
+    vp_Color = texelFetch(oe_LineDrawable_points, 2*i + 1);
+    vertex = vec4(oe_LineDrawable_curr, 1.0);
+}
@@ -23,6 +23,7 @@
 #include <osgEarth/LineFunctor>
 #include <osgEarth/GLUtils>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/NodeUtils>
 
 #include <osg/LineStipple>
 #include <osg/LineWidth>
@@ -30,6 +31,10 @@
 
 #include <osgDB/ObjectWrapper>
 
+#include <cstring>
+#include <list>
+#include <map>
+
 
 #if defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
 #define OE_GLES_AVAILABLE
@@ -60,6 +65,440 @@ namespace osgEarth { namespace Serializers { namespace LineGroup
     }
 } } }
 
+namespace
+{
+    // Most real (GPU-expanded) vertices to pack into one shared batch
+#ifdef OE_GLES_AVAILABLE
+    const unsigned MAX_BATCH_VERTS = 0xFFFF;
+#else
+    const unsigned MAX_BATCH_VERTS = 1u << 20;
+#endif
+
+    // Whether a LineDrawable can draw from a shared batch. The shared buffers
+    // only carry the standard line arrays and render with one draw range, so
+    // anything that customizes either must draw on its own.
+    bool isBatchable(const LineDrawable* d)
+    {
+        if (!d->getUseGPU() || d->getUseTextureBuffer() || d->getFirst() > 0u || d->getCount() > 0u)
+            return false;
+
+        if (d->getUpdateCallback() || d->getEventCallback() || d->getCullCallback() || d->getDrawCallback())
+            return false;
+
+        if (d->getVertexArray() == 0L || d->getColorArray() == 0L)
+            return false;
+
+        if (d->getNumPrimitiveSets() != 1u || d->getPrimitiveSet(0)->getDrawElements() == 0L)
+            return false;
+
+        if (d->getNormalArray() || d->getSecondaryColorArray() || d->getFogCoordArray())
+            return false;
+
+        for (unsigned i = 0; i < d->getNumTexCoordArrays(); ++i)
+            if (d->getTexCoordArray(i))
+                return false;
+
+        for (unsigned i = 0; i < d->getNumVertexAttribArrays(); ++i)
+            if (d->getVertexAttribArray(i) &&
+                (int)i != LineDrawable::PreviousVertexAttrLocation &&
+                (int)i != LineDrawable::NextVertexAttrLocation)
+                return false;
+
+        const osg::StateSet* ss = d->getStateSet();
+        if (ss && ss->getUniform("oe_LineDrawable_limits"))
+            return false;
+
+        return true;
+    }
+
+    // Changes whenever any of the drawable's arrays is dirtied
+    unsigned getRevision(const LineDrawable* d)
+    {
+        unsigned r = d->getVertexArray()->getModifiedCount() + d->getColorArray()->getModifiedCount();
+        const osg::Array* prev = d->getVertexAttribArray(LineDrawable::PreviousVertexAttrLocation);
+        const osg::Array* next = d->getVertexAttribArray(LineDrawable::NextVertexAttrLocation);
+        if (prev) r += prev->getModifiedCount();
+        if (next) r += next->getModifiedCount();
+        return r;
+    }
+
+    bool sameState(const osg::StateSet* a, const osg::StateSet* b)
+    {
+        if (a == b) return true;
+        if (a == 0L || b == 0L) return false;
+        return a->compare(*b, true) == 0;
+    }
+}
+
+/**
+ * Packs batchable LineDrawables into shared geometries, one per distinct
+ * state set. Each drawable owns a range of the shared arrays with some room
+ * to grow; edits are copied into that range in place, and the batch is only
+ * repacked when a drawable outgrows its range or drawables come and go.
+ * Runs in the update traversal.
+ */
+class LineGroup::Batches : public osg::Referenced
+{
+public:
+    struct Batch
+    {
+        osg::ref_ptr<osg::Geometry> geom;
+        osg::ref_ptr<osg::Vec3Array> current;
+        osg::ref_ptr<osg::Vec3Array> previous;
+        osg::ref_ptr<osg::Vec3Array> next;
+        osg::ref_ptr<osg::Vec4Array> colors;
+        osg::ref_ptr<osg::DrawElementsUInt> elements;
+        unsigned used;  // real vertices allocated to members
+        bool repack;    // member ranges must be laid out again
+        bool reindex;   // element list must be rebuilt
+    };
+
+    struct Member
+    {
+        osg::ref_ptr<LineDrawable> drawable;
+        Batch* batch;
+        unsigned offset;   // first real vertex of this member in the batch
+        unsigned capacity; // real vertices reserved for this member
+        unsigned size;     // real vertices in use
+        unsigned revision;
+        bool visible;
+        bool seen;
+
+        // state that decides which batch the member belongs to
+        osg::ref_ptr<const osg::PrimitiveSet> prims;
+        const osg::StateSet* stateSet;
+        float width;
+        GLint factor;
+        GLushort pattern;
+        bool smooth;
+    };
+
+    typedef std::map<LineDrawable*, Member> Members;
+
+    Batches()
+    {
+        _geode = new osg::Geode();
+    }
+
+    void sync(LineGroup* group)
+    {
+        _unbatched.clear();
+
+        for (Members::iterator i = _members.begin(); i != _members.end(); ++i)
+            i->second.seen = false;
+
+        for (unsigned i = 0; i < group->getNumChildren(); ++i)
+        {
+            osg::Node* child = group->getChild(i);
+            LineDrawable* d = dynamic_cast<LineDrawable*>(child);
+            if (d == 0L || !isBatchable(d))
+            {
+                _unbatched.push_back(child);
+                continue;
+            }
+
+            Members::iterator mi = _members.find(d);
+            bool isNew = (mi == _members.end());
+            Member& m = isNew ? _members[d] : mi->second;
+            m.seen = true;
+
+            const osg::PrimitiveSet* prims = d->getPrimitiveSet(0);
+            unsigned size = d->getVertexArray()->getNumElements();
+            bool visible = d->getNodeMask() != 0u;
+
+            bool rekey =
+                isNew ||
+                prims != m.prims.get() ||
+                d->getStateSet() != m.stateSet ||
+                d->getLineWidth() != m.width ||
+                d->getStippleFactor() != m.factor ||
+                d->getStipplePattern() != m.pattern ||
+                d->getLineSmooth() != m.smooth;
+
+            if (rekey)
+            {
+                Batch* batch = isNew ? 0L : m.batch;
+                if (batch == 0L || !sameState(d->getStateSet(), batch->geom->getStateSet()))
+                {
+                    if (batch)
+                        batch->repack = true;
+
+                    m.drawable = d;
+                    m.batch = findBatch(d, size);
+                    m.batch->repack = true;
+                    m.capacity = 0u;
+                }
+
+                m.stateSet = d->getStateSet();
+                m.width = d->getLineWidth();
+                m.factor = d->getStippleFactor();
+                m.pattern = d->getStipplePattern();
+                m.smooth = d->getLineSmooth();
+            }
+
+            if (m.batch->repack)
+            {
+                // everything gets copied during the repack
+            }
+            else if (size > m.capacity)
+            {
+                m.batch->repack = true;
+            }
+            else
+            {
+                if (getRevision(d) != m.revision)
+                {
+                    store(m);
+                }
+                if (size != m.size || prims != m.prims.get() || visible != m.visible)
+                {
+                    m.batch->reindex = true;
+                }
+            }
+
+            m.prims = prims;
+            m.visible = visible;
+        }
+
+        // forget drawables that left the group
+        for (Members::iterator i = _members.begin(); i != _members.end(); )
+        {
+            if (i->second.seen == false)
+            {
+                i->second.batch->repack = true;
+                _members.erase(i++);
+            }
+            else ++i;
+        }
+
+        // collect the members of each batch that needs work
+        std::map<Batch*, std::vector<Member*> > work;
+        for (Members::iterator i = _members.begin(); i != _members.end(); ++i)
+        {
+            Batch* b = i->second.batch;
+            if (b->repack || b->reindex)
+                work[b].push_back(&i->second);
+        }
+
+        // batches created by a repack overflow land at the end of the list,
+        // so this loop still visits them.
+        for (std::list<Batch>::iterator b = _batches.begin(); b != _batches.end(); )
+        {
+            if (b->repack || b->reindex)
+            {
+                std::vector<Member*>& list = work[&(*b)];
+                if (list.empty())
+                {
+                    _geode->removeDrawable(b->geom.get());
+                    b = _batches.erase(b);
+                    continue;
+                }
+
+                if (b->repack)
+                    repack(*b, list, work);
+                else
+                    reindex(*b, list);
+            }
+            ++b;
+        }
+    }
+
+    void cull(osg::NodeVisitor& nv)
+    {
+        osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+
+        if (cv && _geode->getNumDrawables() > 0u && _gpuStateSet.valid())
+        {
+            cv->pushStateSet(_gpuStateSet.get());
+            _geode->accept(nv);
+            cv->popStateSet();
+        }
+
+        for (unsigned i = 0; i < _unbatched.size(); ++i)
+        {
+            _unbatched[i]->accept(nv);
+        }
+    }
+
+    void resizeGLObjectBuffers(unsigned maxSize)
+    {
+        _geode->resizeGLObjectBuffers(maxSize);
+    }
+
+    void releaseGLObjects(osg::State* state) const
+    {
+        _geode->releaseGLObjects(state);
+    }
+
+private:
+    Members _members;
+    std::list<Batch> _batches;
+    osg::ref_ptr<osg::Geode> _geode;
+    osg::ref_ptr<osg::StateSet> _gpuStateSet;
+    std::vector< osg::ref_ptr<osg::Node> > _unbatched;
+
+    Batch* findBatch(LineDrawable* d, unsigned size)
+    {
+        for (std::list<Batch>::iterator b = _batches.begin(); b != _batches.end(); ++b)
+        {
+            if (b->used + size <= MAX_BATCH_VERTS && sameState(d->getStateSet(), b->geom->getStateSet()))
+            {
+                return &(*b);
+            }
+        }
+        return createBatch(d);
+    }
+
+    Batch* createBatch(LineDrawable* d)
+    {
+        if (!_gpuStateSet.valid())
+            _gpuStateSet = d->getGPUStateSet();
+
+        _batches.push_back(Batch());
+        Batch& b = _batches.back();
+        b.used = 0u;
+        b.repack = true;
+        b.reindex = false;
+
+        b.geom = new osg::Geometry();
+        b.geom->setUseVertexBufferObjects(true);
+        b.geom->setUseDisplayList(false);
+        b.geom->setDataVariance(osg::Object::DYNAMIC);
+
+        b.current = new osg::Vec3Array();
+        b.current->setBinding(osg::Array::BIND_PER_VERTEX);
+        b.geom->setVertexArray(b.current.get());
+
+        b.colors = new osg::Vec4Array();
+        b.colors->setBinding(osg::Array::BIND_PER_VERTEX);
+        b.geom->setColorArray(b.colors.get());
+
+        b.previous = new osg::Vec3Array();
+        b.previous->setBinding(osg::Array::BIND_PER_VERTEX);
+        b.previous->setNormalize(false);
+        b.geom->setVertexAttribArray(LineDrawable::PreviousVertexAttrLocation, b.previous.get());
+
+        b.next = new osg::Vec3Array();
+        b.next->setBinding(osg::Array::BIND_PER_VERTEX);
+        b.next->setNormalize(false);
+        b.geom->setVertexAttribArray(LineDrawable::NextVertexAttrLocation, b.next.get());
+
+        b.elements = new osg::DrawElementsUInt(GL_TRIANGLES);
+        b.geom->addPrimitiveSet(b.elements.get());
+
+        // Copy the state so later changes to the drawable don't leak
+        // into the other members of the batch.
+        if (d->getStateSet())
+        {
+            b.geom->setStateSet(osg::clone(d->getStateSet(), osg::CopyOp::SHALLOW_COPY));
+        }
+
+        _geode->addDrawable(b.geom.get());
+        return &b;
+    }
+
+    // Lays out the member ranges again, leaving each member some room to grow.
+    void repack(Batch& b, std::vector<Member*>& list, std::map<Batch*, std::vector<Member*> >& work)
+    {
+        unsigned total = 0u;
+        std::vector<Member*> placed;
+        placed.reserve(list.size());
+
+        for (unsigned i = 0; i < list.size(); ++i)
+        {
+            Member* m = list[i];
+            unsigned size = m->drawable->getVertexArray()->getNumElements();
+            unsigned capacity = ((size + size/4u + 3u) / 4u) * 4u;
+
+            if (total > 0u && total + capacity > MAX_BATCH_VERTS)
+            {
+                // Out of room; start a new batch with the same state.
+                m->batch = createBatch(m->drawable.get());
+                work[m->batch].push_back(m);
+                continue;
+            }
+
+            m->offset = total;
+            m->capacity = capacity;
+            total += capacity;
+            placed.push_back(m);
+        }
+
+        b.current->resize(total);
+        b.previous->resize(total);
+        b.next->resize(total);
+        b.colors->resize(total);
+        b.used = total;
+
+        for (unsigned i = 0; i < placed.size(); ++i)
+        {
+            store(*placed[i]);
+        }
+
+        b.repack = false;
+        reindex(b, placed);
+    }
+
+    // Rebuilds the batch's element list from the visible members.
+    void reindex(Batch& b, const std::vector<Member*>& list)
+    {
+        b.elements->clear();
+        for (unsigned i = 0; i < list.size(); ++i)
+        {
+            const Member* m = list[i];
+            if (m->visible && m->batch == &b)
+            {
+                const osg::DrawElements* de = m->drawable->getPrimitiveSet(0)->getDrawElements();
+                for (unsigned e = 0; e < de->getNumIndices(); ++e)
+                {
+                    b.elements->push_back(m->offset + de->index(e));
+                }
+            }
+        }
+        b.elements->dirty();
+        b.reindex = false;
+    }
+
+    // Copies a member's arrays into its range of the batch.
+    void store(Member& m)
+    {
+        Batch& b = *m.batch;
+        LineDrawable* d = m.drawable.get();
+
+        const osg::Vec3Array* current = static_cast<const osg::Vec3Array*>(d->getVertexArray());
+        const osg::Vec3Array* previous = static_cast<const osg::Vec3Array*>(d->getVertexAttribArray(LineDrawable::PreviousVertexAttrLocation));
+        const osg::Vec3Array* next = static_cast<const osg::Vec3Array*>(d->getVertexAttribArray(LineDrawable::NextVertexAttrLocation));
+        const osg::Vec4Array* colors = static_cast<const osg::Vec4Array*>(d->getColorArray());
+
+        unsigned size = current->size();
+        unsigned end = m.offset + m.capacity;
+
+        std::copy(current->begin(), current->end(), b.current->begin() + m.offset);
+        if (previous && previous->size() == size)
+            std::copy(previous->begin(), previous->end(), b.previous->begin() + m.offset);
+        if (next && next->size() == size)
+            std::copy(next->begin(), next->end(), b.next->begin() + m.offset);
+        if (colors && colors->size() == size)
+            std::copy(colors->begin(), colors->end(), b.colors->begin() + m.offset);
+
+        // Park unused vertices on the line itself so they don't
+        // stretch the batch's bounds.
+        if (size > 0u)
+        {
+            std::fill(b.current->begin() + m.offset + size, b.current->begin() + end, current->back());
+        }
+
+        b.current->dirty();
+        b.previous->dirty();
+        b.next->dirty();
+        b.colors->dirty();
+        b.geom->dirtyBound();
+
+        m.size = size;
+        m.revision = getRevision(d);
+    }
+};
+
 LineGroup::LineGroup()
 {
     //nop
@@ -68,7 +507,8 @@ LineGroup::LineGroup()
 LineGroup::LineGroup(const LineGroup& rhs, const osg::CopyOp& copy) :
 osg::Geode(rhs, copy)
 {
-    //nop
+    if (rhs.getUseBatching())
+        setUseBatching(true);
 }
 
 LineGroup::~LineGroup()
@@ -299,6 +739,59 @@ LineGroup::getLineDrawable(unsigned i)
     return i < getNumChildren() ? dynamic_cast<LineDrawable*>(getChild(i)) : 0L;
 }
 
+void
+LineGroup::setUseBatching(bool value)
+{
+    if (value == getUseBatching())
+        return;
+
+    if (value)
+    {
+        _batches = new Batches();
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+    else
+    {
+        _batches = 0L;
+        ADJUST_UPDATE_TRAV_COUNT(this, -1);
+    }
+}
+
+void
+LineGroup::traverse(osg::NodeVisitor& nv)
+{
+    if (_batches.valid())
+    {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+        {
+            _batches->sync(this);
+        }
+        else if (nv.getVisitorType() == nv.CULL_VISITOR)
+        {
+            _batches->cull(nv);
+            return;
+        }
+    }
+
+    osg::Geode::traverse(nv);
+}
+
+void
+LineGroup::resizeGLObjectBuffers(unsigned maxSize)
+{
+    osg::Geode::resizeGLObjectBuffers(maxSize);
+    if (_batches.valid())
+        _batches->resizeGLObjectBuffers(maxSize);
+}
+
+void
+LineGroup::releaseGLObjects(osg::State* state) const
+{
+    osg::Geode::releaseGLObjects(state);
+    if (_batches.valid())
+        _batches->releaseGLObjects(state);
+}
+
 //...................................................................
 
 #undef  LC
@@ -326,11 +819,45 @@ namespace osgEarth { namespace Serializers { namespace LineDrawable
 // static attribute binding locations. Changable by the user.
 int LineDrawable::PreviousVertexAttrLocation = 9;
 int LineDrawable::NextVertexAttrLocation = 10;
+int LineDrawable::TextureBufferUnit = 15;
+
+namespace
+{
+    // One segment of a texture buffer line. The corners are ordered
+    // start-right, start-left, end-right, end-left, and both triangles
+    // end on the start-right corner so it is the provoking vertex
+    // (which GPU stippling depends on).
+    osg::Geometry* createTBOPattern()
+    {
+        osg::Vec3Array* pattern = new osg::Vec3Array();
+        pattern->push_back(osg::Vec3(0.0f, 0.0f, 0.0f));
+        pattern->push_back(osg::Vec3(0.0f, 1.0f, 0.0f));
+        pattern->push_back(osg::Vec3(1.0f, 0.0f, 0.0f));
+        pattern->push_back(osg::Vec3(1.0f, 1.0f, 0.0f));
+
+        osg::DrawElementsUByte* els = new osg::DrawElementsUByte(GL_TRIANGLES);
+        els->addElement(3);
+        els->addElement(1);
+        els->addElement(0); // PV
+        els->addElement(2);
+        els->addElement(3);
+        els->addElement(0); // PV
+
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setUseDisplayList(false);
+        geom->setUseVertexBufferObjects(true);
+        geom->setDataVariance(osg::Object::DYNAMIC);
+        geom->setVertexArray(pattern);
+        geom->addPrimitiveSet(els);
+        return geom;
+    }
+}
 
 LineDrawable::LineDrawable() :
 osg::Geometry(),
 _mode(GL_LINE_STRIP),
 _useGPU(true),
+_useTBO(false),
 _factor(1),
 _pattern(0xFFFF),
 _color(1, 1, 1, 1),
@@ -357,6 +884,7 @@ LineDrawable::LineDrawable(GLenum mode) :
 osg::Geometry(),
 _mode(mode),
 _useGPU(true),
+_useTBO(false),
 _factor(1),
 _pattern(0xFFFF),
 _color(1,1,1,1),
@@ -383,6 +911,7 @@ LineDrawable::LineDrawable(const LineDrawable& rhs, const osg::CopyOp& copy) :
 osg::Geometry(rhs, copy),
 _mode(rhs._mode),
 _useGPU(rhs._useGPU),
+_useTBO(rhs._useTBO),
 _color(rhs._color),
 _factor(rhs._factor),
 _pattern(rhs._pattern),
@@ -396,13 +925,24 @@ _next(NULL),
 _colors(NULL)
 {
     _current = static_cast<osg::Vec3Array*>(getVertexArray());
+    _colors = static_cast<osg::Vec4Array*>(getColorArray());
 
-    if (_useGPU)
+    if (isExpanded())
     {
         _previous = static_cast<osg::Vec3Array*>(getVertexAttribArray(PreviousVertexAttrLocation));
         _next = static_cast<osg::Vec3Array*>(getVertexAttribArray(NextVertexAttrLocation));
+    }
+
+    if (_useGPU)
+    {
         setupShaders();
     }
+
+    if (_useTBO)
+    {
+        setupTextureBuffer();
+        updateTextureBuffer();
+    }
 }
 
 LineDrawable::~LineDrawable()
@@ -418,7 +958,49 @@ LineDrawable::setUseGPU(bool value)
     _next = NULL;
 
     _useGPU = value;
+    if (!_useGPU && _useTBO)
+    {
+        _useTBO = false;
+        _gpuStateSet = 0L;
+        _tbo = 0L;
+        _tboStateSet = 0L;
+        _tboPattern = 0L;
+    }
+
+    initialize();
+}
+
+void
+LineDrawable::setUseTextureBuffer(bool value)
+{
+    if (value && (!_useGPU || !Registry::capabilities().supportsTextureBuffer()))
+        return;
+
+    if (value == _useTBO)
+        return;
+
+    _current = NULL;
+    _previous = NULL;
+    _next = NULL;
+
+    // the expanded path's neighbor arrays don't apply to the texture buffer
+    setVertexAttribArray(PreviousVertexAttrLocation, 0L);
+    setVertexAttribArray(NextVertexAttrLocation, 0L);
+
+    _useTBO = value;
+    _gpuStateSet = 0L;
+    setupShaders();
+
     initialize();
+
+    if (!_useTBO)
+    {
+        _tbo = 0L;
+        _tboStateSet = 0L;
+        _tboPattern = 0L;
+    }
+
+    dirty();
 }
 
 void
@@ -436,13 +1018,16 @@ LineDrawable::initialize()
 
     // See if the arrays already exist:
     _current = static_cast<osg::Vec3Array*>(getVertexArray());
-    if (_useGPU)
+    _colors = static_cast<osg::Vec4Array*>(getColorArray());
+    if (isExpanded())
     {
         _previous = static_cast<osg::Vec3Array*>(getVertexAttribArray(PreviousVertexAttrLocation));
         _next = static_cast<osg::Vec3Array*>(getVertexAttribArray(NextVertexAttrLocation));
     }
 
-    setUseVertexBufferObjects(_supportsVertexBufferObjects);
+    // The texture buffer path never draws the geometry's own arrays,
+    // so don't bother uploading them.
+    setUseVertexBufferObjects(_supportsVertexBufferObjects && !_useTBO);
     setUseDisplayList(false);
 
     if (!_current)
@@ -450,24 +1035,54 @@ LineDrawable::initialize()
         _current = new osg::Vec3Array();
         _current->setBinding(osg::Array::BIND_PER_VERTEX);
         setVertexArray(_current);
+    }
 
+    if (!_colors)
+    {
         _colors = new osg::Vec4Array();
         _colors->setBinding(osg::Array::BIND_PER_VERTEX);
         setColorArray(_colors);
+    }
 
-        if (_useGPU)
+    if (isExpanded())
+    {
+        if (!_previous)
         {
             _previous = new osg::Vec3Array();
             _previous->setBinding(osg::Array::BIND_PER_VERTEX);
             _previous->setNormalize(false);
             setVertexAttribArray(PreviousVertexAttrLocation, _previous);  
+        }
 
+        if (!_next)
+        {
             _next = new osg::Vec3Array();
             _next->setBinding(osg::Array::BIND_PER_VERTEX);
             _next->setNormalize(false);
             setVertexAttribArray(NextVertexAttrLocation, _next);
         }
     }
+
+    setupTextureBuffer();
+}
+
+void
+LineDrawable::setupTextureBuffer()
+{
+    if (_useTBO && !_tbo.valid())
+    {
+        _tbo = new osg::TextureBuffer();
+        _tbo->setInternalFormat(GL_RGBA32F_ARB);
+        _tbo->setUnRefImageDataAfterApply(false);
+        _tbo->setDataVariance(osg::Object::DYNAMIC);
+
+        _tboStateSet = new osg::StateSet();
+        _tboStateSet->setDataVariance(osg::Object::DYNAMIC);
+        _tboStateSet->setTextureAttribute(TextureBufferUnit, _tbo.get());
+        _tboStateSet->getOrCreateUniform("oe_LineDrawable_mode", osg::Uniform::INT)->set(0);
+
+        _tboPattern = createTBOPattern();
+    }
 }
 
 void
@@ -535,6 +1150,9 @@ LineDrawable::setColor(const osg::Vec4& color)
     {
         _colors->assign(_colors->size(), _color);
         _colors->dirty();
+
+        if (_useTBO && _tbo->getImage())
+            updateTextureBuffer();
     }
 }
 
@@ -542,7 +1160,7 @@ void
 LineDrawable::setColor(unsigned vi, const osg::Vec4& color)
 {
     bool dirty = false;
-    if (_useGPU)
+    if (isExpanded())
     {
         if (_mode == GL_LINE_STRIP || _mode == GL_LINE_LOOP)
         {
@@ -603,6 +1221,9 @@ LineDrawable::setColor(unsigned vi, const osg::Vec4& color)
     if (dirty)
     {
         _colors->dirty();
+
+        if (_useTBO)
+            updateTextureBuffer(vi);
     }
 }
 
@@ -647,7 +1268,11 @@ LineDrawable::updateFirstCount()
             ss->addUniform(u, osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
         }
 
-        if (_mode == GL_LINE_STRIP)
+        if (_useTBO)
+        {
+            u->set(osg::Vec2(_first, _count > 0u ? _first + _count - 1u : 0u));
+        }
+        else if (_mode == GL_LINE_STRIP)
         {
             u->set(osg::Vec2(4u*_first + 2u, 4u*(_first+_count-1u)+1u));
         }
@@ -675,7 +1300,7 @@ LineDrawable::pushVertex(const osg::Vec3& vert)
 {
     initialize();
 
-    if (_useGPU)
+    if (isExpanded())
     {
         if (_mode == GL_LINE_STRIP)
         {
@@ -812,7 +1437,7 @@ LineDrawable::setVertex(unsigned vi, const osg::Vec3& vert)
 
     if (vi < numVerts)
     {
-        if (_useGPU)
+        if (isExpanded())
         {
             if (_mode == GL_LINE_STRIP)
             {
@@ -944,6 +1569,9 @@ LineDrawable::setVertex(unsigned vi, const osg::Vec3& vert)
         {
             (*_current)[vi] = vert;
             _current->dirty();
+
+            if (_useTBO)
+                updateTextureBuffer(vi);
         }
 
         dirtyBound();
@@ -959,7 +1587,7 @@ LineDrawable::getVertex(unsigned index) const
 unsigned
 LineDrawable::getRealIndex(unsigned index) const
 {
-    if (_useGPU)
+    if (isExpanded())
         return (_mode == GL_LINE_STRIP || _mode == GL_LINE_LOOP) ? index*4u : index*2u;
     else
         return index;
@@ -974,7 +1602,7 @@ LineDrawable::importVertexArray(const osg::Vec3Array* verts)
     _colors->clear();
     if (verts && verts->size() > 0)
     {
-        if (_useGPU)
+        if (isExpanded())
         {
             _previous->clear();
             _next->clear();
@@ -1024,7 +1652,7 @@ LineDrawable::getNumVerts() const
     if (!_current || _current->empty())
         return 0u;
 
-    if (_useGPU)
+    if (isExpanded())
     {
         if (_mode == GL_LINE_STRIP || _mode == GL_LINE_LOOP)
             return _current->size()/4; //_current->size() == 2 ? 1 : (_current->size()+2)/4;
@@ -1040,7 +1668,7 @@ LineDrawable::getNumVerts() const
 unsigned
 LineDrawable::actualVertsPerVirtualVert(unsigned index) const
 {
-    if (_useGPU)
+    if (isExpanded())
         if (_mode == GL_LINE_STRIP || _mode == GL_LINE_LOOP)
             return 4u; //index == 0u? 2u : 4u;
         else 
@@ -1056,7 +1684,7 @@ LineDrawable::numVirtualVerts(const osg::Array* a) const
     if (n == 0u)
         return 0u;
 
-    if (_useGPU)
+    if (isExpanded())
         if (_mode == GL_LINE_STRIP || _mode == GL_LINE_LOOP)
             return n/4u; //n == 2u ? 1u : (n+2u)/4u;
         else
@@ -1071,7 +1699,7 @@ LineDrawable::reserve(unsigned size)
     initialize();
 
     unsigned actualSize = size;
-    if (_useGPU)
+    if (isExpanded())
     {
         actualSize = (_mode == GL_LINE_STRIP || _mode == GL_LINE_LOOP) ? size*4u : size*2u;
     }
@@ -1127,19 +1755,24 @@ LineDrawable::dirty()
 
     _current->dirty();
 
-    if (_useGPU)
+    if (isExpanded())
     {
         _previous->dirty();
         _next->dirty();
     }
 
+    if (_useTBO)
+    {
+        updateTextureBuffer();
+    }
+
     // rebuild primitive sets.
     if (getNumPrimitiveSets() > 0)
     {
         removePrimitiveSet(0, 1);
     }
 
-    if (_useGPU && _current->size() >= 4)
+    if (isExpanded() && _current->size() >= 4)
     {
         // IMPORTANT!
         // Don't change the order of the elements! Because of the way
@@ -1231,6 +1864,7 @@ LineDrawable::dirty()
 }
 
 osg::observer_ptr<osg::StateSet> LineDrawable::s_gpuStateSet;
+osg::observer_ptr<osg::StateSet> LineDrawable::s_tboStateSet;
 
 void
 LineDrawable::setupShaders()
@@ -1239,24 +1873,36 @@ LineDrawable::setupShaders()
     // shared by all LineDrawable instances so OSG will sort them together.
     if (_useGPU && !_gpuStateSet.valid())
     {
-        if (s_gpuStateSet.lock(_gpuStateSet) == false)
+        // texture buffer lines get their own singleton with the extra shader
+        osg::observer_ptr<osg::StateSet>& shared = _useTBO ? s_tboStateSet : s_gpuStateSet;
+
+        if (shared.lock(_gpuStateSet) == false)
         {
             // serialize access and double-check:
             static Threading::Mutex s_mutex;
             Threading::ScopedMutexLock lock(s_mutex);
 
-            if (s_gpuStateSet.lock(_gpuStateSet) == false)
+            if (shared.lock(_gpuStateSet) == false)
             {
-                s_gpuStateSet = _gpuStateSet = new osg::StateSet();
+                shared = _gpuStateSet = new osg::StateSet();
 
-                VirtualProgram* vp = VirtualProgram::getOrCreate(s_gpuStateSet.get());
+                VirtualProgram* vp = VirtualProgram::getOrCreate(_gpuStateSet.get());
                 vp->setName("osgEarth::LineDrawable");
                 Shaders shaders;
                 shaders.load(vp, shaders.LineDrawable);
-                vp->addBindAttribLocation("oe_LineDrawable_prev", LineDrawable::PreviousVertexAttrLocation);
-                vp->addBindAttribLocation("oe_LineDrawable_next", LineDrawable::NextVertexAttrLocation);
-                s_gpuStateSet->getOrCreateUniform("oe_LineDrawable_limits", osg::Uniform::FLOAT_VEC2)->set(osg::Vec2f(-1, -1));
-                s_gpuStateSet->setMode(GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE | osg::StateAttribute::PROTECTED);
+                if (_useTBO)
+                {
+                    shaders.load(vp, shaders.LineDrawableTBO);
+                    _gpuStateSet->setDefine("OE_LINE_TBO");
+                    _gpuStateSet->getOrCreateUniform("oe_LineDrawable_points", osg::Uniform::SAMPLER_BUFFER)->set(TextureBufferUnit);
+                }
+                else
+                {
+                    vp->addBindAttribLocation("oe_LineDrawable_prev", LineDrawable::PreviousVertexAttrLocation);
+                    vp->addBindAttribLocation("oe_LineDrawable_next", LineDrawable::NextVertexAttrLocation);
+                }
+                _gpuStateSet->getOrCreateUniform("oe_LineDrawable_limits", osg::Uniform::FLOAT_VEC2)->set(osg::Vec2f(-1, -1));
+                _gpuStateSet->setMode(GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE | osg::StateAttribute::PROTECTED);
             }
         }
     }
@@ -1281,24 +1927,118 @@ LineDrawable::accept(osg::NodeVisitor& nv)
         nv.pushOntoNodePath(this);
 
         if (cv)
+        {
             cv->pushStateSet(_gpuStateSet.get());
+            if (_tboStateSet.valid())
+                cv->pushStateSet(_tboStateSet.get());
+        }
 
         nv.apply(*this); 
 
         if (cv)
+        {
+            if (_tboStateSet.valid())
+                cv->popStateSet();
             cv->popStateSet();
+        }
 
         nv.popFromNodePath();
     }
 }
 
 
+void
+LineDrawable::drawImplementation(osg::RenderInfo& ri) const
+{
+    if (_useTBO)
+    {
+        // One instance of the pattern quad per segment; the shader
+        // fetches the points from the texture buffer.
+        if (_tboPattern.valid() && _tboPattern->getPrimitiveSet(0)->getNumInstances() > 0)
+            _tboPattern->draw(ri);
+    }
+    else
+    {
+        osg::Geometry::drawImplementation(ri);
+    }
+}
+
+unsigned
+LineDrawable::getNumSegments() const
+{
+    unsigned n = _current ? _current->size() : 0u;
+    if (n < 2u)
+        return 0u;
+    else if (_mode == GL_LINES)
+        return n/2u;
+    else if (_mode == GL_LINE_LOOP)
+        return n;
+    else
+        return n-1u;
+}
+
+void
+LineDrawable::updateTextureBuffer()
+{
+    if (!_tbo.valid() || !_current)
+        return;
+
+    unsigned numPoints = _current->size();
+    int texels = osg::maximum(2*(int)numPoints, 2);
+
+    osg::Image* image = _tbo->getImage();
+    if (!image || image->s() != texels)
+    {
+        image = new osg::Image();
+        image->allocateImage(texels, 1, 1, GL_RGBA, GL_FLOAT);
+        image->setDataVariance(osg::Object::DYNAMIC);
+        ::memset(image->data(), 0, image->getTotalSizeInBytes());
+        _tbo->setImage(image);
+        _tbo->dirtyTextureObject();
+    }
+
+    osg::Vec4f* texel = reinterpret_cast<osg::Vec4f*>(image->data());
+    for (unsigned i = 0; i < numPoints; ++i)
+    {
+        texel[2*i].set((*_current)[i].x(), (*_current)[i].y(), (*_current)[i].z(), 0.0f);
+        texel[2*i+1] = i < _colors->size() ? (*_colors)[i] : _color;
+    }
+    image->dirty();
+
+    _tboStateSet->getUniform("oe_LineDrawable_mode")->set(
+        _mode == GL_LINES ? 2 : _mode == GL_LINE_LOOP ? 1 : 0);
+
+    osg::PrimitiveSet* instances = _tboPattern->getPrimitiveSet(0);
+    instances->setNumInstances(getNumSegments());
+    instances->dirty();
+}
+
+void
+LineDrawable::updateTextureBuffer(unsigned vi)
+{
+    // Edits a single point in place, provided dirty() has
+    // already sized the buffer to include it.
+    osg::Image* image = _tbo.valid() ? _tbo->getImage() : 0L;
+    if (image && (int)(2u*vi+1u) < image->s() && vi < _current->size())
+    {
+        osg::Vec4f* texel = reinterpret_cast<osg::Vec4f*>(image->data());
+        const osg::Vec3& v = (*_current)[vi];
+        texel[2*vi].set(v.x(), v.y(), v.z(), 0.0f);
+        texel[2*vi+1] = vi < _colors->size() ? (*_colors)[vi] : _color;
+        image->dirty();
+    }
+}
+
 void
 LineDrawable::resizeGLObjectBuffers(unsigned maxSize)
 {
     osg::Geometry::resizeGLObjectBuffers(maxSize);
     if (_gpuStateSet.valid())
         _gpuStateSet->resizeGLObjectBuffers(maxSize);
+    if (_tboStateSet.valid())
+        _tboStateSet->resizeGLObjectBuffers(maxSize);
+    if (_tboPattern.valid())
+        _tboPattern->resizeGLObjectBuffers(maxSize);
 }
 
 void
@@ -1307,4 +2047,8 @@ LineDrawable::releaseGLObjects(osg::State* state) const
     osg::Geometry::releaseGLObjects(state);
     if (_gpuStateSet.valid())
         _gpuStateSet->releaseGLObjects(state);
+    if (_tboStateSet.valid())
+        _tboStateSet->releaseGLObjects(state);
+    if (_tboPattern.valid())
+        _tboPattern->releaseGLObjects(state);
 }
@@ -3,13 +3,22 @@
 #pragma vp_entryPoint oe_LineDrawable_VS_VIEW
 #pragma vp_location vertex_view
 #pragma vp_order last
+#pragma import_defines(OE_LINE_TBO)
 
 uniform vec2 oe_LineDrawable_limits;
 flat out int oe_LineDrawable_draw;
 
+#ifdef OE_LINE_TBO
+// Set by the texture buffer model stage
+vec3 oe_LineDrawable_curr;
+vec3 oe_LineDrawable_prev;
+vec3 oe_LineDrawable_next;
+int oe_LineDrawable_index;
+#else
 // Input attributes for adjacent points
 in vec3 oe_LineDrawable_prev;
 in vec3 oe_LineDrawable_next;
+#endif
 
 // Shared stage globals
 vec4 oe_LineDrawable_prevView;
@@ -17,12 +26,20 @@ vec4 oe_LineDrawable_nextView;
 
 void oe_LineDrawable_VS_VIEW(inout vec4 currView)
 {
+#ifdef OE_LINE_TBO
+    int index = oe_LineDrawable_index;
+    vec4 modelVertex = vec4(oe_LineDrawable_curr, 1.0);
+#else
+    int index = gl_VertexID;
+    vec4 modelVertex = gl_Vertex;
+#endif
+
     oe_LineDrawable_draw = 1;
     int first = int(oe_LineDrawable_limits[0]);
     int last = int(oe_LineDrawable_limits[1]);
     if (first >= 0)
     {
-        if (gl_VertexID < first || (last > 0 && gl_VertexID > last))
+        if (index < first || (last > 0 && index > last))
         {
             oe_LineDrawable_draw = 0;
         }
@@ -31,7 +48,7 @@ void oe_LineDrawable_VS_VIEW(inout vec4 currView)
     // Compute the change in the view vertex so that we can apply the same
     // delta to the prev and next vectors. (An example would be if the verts
     // were GPU-clamped or otherwise permuted in another shader component.)
-    vec4 originalView = gl_ModelViewMatrix * gl_Vertex;
+    vec4 originalView = gl_ModelViewMatrix * modelVertex;
     vec4 deltaView = currView - originalView;
 
     // calculate prev/next points in post-transform view space:
@@ -47,18 +64,25 @@ void oe_LineDrawable_VS_VIEW(inout vec4 currView)
 #pragma vp_name GPU Lines Screen Projected Clip
 #pragma vp_entryPoint oe_LineDrawable_VS_CLIP
 #pragma vp_location vertex_clip
-#pragma import_defines(OE_LINE_SMOOTH)
+#pragma import_defines(OE_LINE_SMOOTH, OE_LINE_STIPPLE, OE_LINE_TBO)
 
 // Set by the InstallCameraUniform callback
 uniform vec3 oe_Camera;
 
 // Set by GLUtils methods
 uniform float oe_GL_LineWidth;
-uniform int oe_GL_LineStipplePattern;
 
+#ifdef OE_LINE_TBO
+// Set by the texture buffer model stage
+vec3 oe_LineDrawable_curr;
+vec3 oe_LineDrawable_prev;
+vec3 oe_LineDrawable_next;
+int oe_LineDrawable_code;
+#else
 // Input attributes for adjacent points
 in vec3 oe_LineDrawable_prev;
 in vec3 oe_LineDrawable_next;
+#endif
 
 flat out int oe_LineDrawable_draw;
 flat out vec2 oe_LineDrawable_rv;
@@ -94,7 +118,13 @@ void oe_LineDrawable_VS_CLIP(inout vec4 currClip)
 #endif
 
     float len = thickness;
+#ifdef OE_LINE_TBO
+    vec3 modelVertex = oe_LineDrawable_curr;
+    int code = oe_LineDrawable_code;
+#else
+    vec3 modelVertex = gl_Vertex.xyz;
     int code = (gl_VertexID+2) & 3; // gl_VertexID % 4
+#endif
     bool isStart = code <= 1;
     bool isRight = code==0 || code==2;
 
@@ -109,14 +139,14 @@ void oe_LineDrawable_VS_CLIP(inout vec4 currClip)
     // space because the equivalency gets mashed after projection.
 
     // starting point uses (next - current)
-    if (gl_Vertex.xyz == oe_LineDrawable_prev)
+    if (modelVertex == oe_LineDrawable_prev)
     {
         dir = normalize(nextPixel - currPixel);
         stippleDir = dir;
     }
     
     // ending point uses (current - previous)
-    else if (gl_Vertex.xyz == oe_LineDrawable_next)
+    else if (modelVertex == oe_LineDrawable_next)
     {
         dir = normalize(currPixel - prevPixel);
         stippleDir = dir;
@@ -163,7 +193,7 @@ void oe_LineDrawable_VS_CLIP(inout vec4 currClip)
     currClip.xy += offset;
 
     // prepare for stippling:
-    if (oe_GL_LineStipplePattern != 0xffff)
+#ifdef OE_LINE_STIPPLE
     {
         // Line creation is done. Now, calculate a rotation angle
         // for use by out fragment shader to do GPU stippling. 
@@ -186,6 +216,7 @@ void oe_LineDrawable_VS_CLIP(inout vec4 currClip)
         // send it to the fragment shader.
         oe_LineDrawable_rv = vec2(cos(angle), sin(angle));
     }
+#endif
 }
 
 
@@ -196,10 +227,12 @@ void oe_LineDrawable_VS_CLIP(inout vec4 currClip)
 #pragma vp_name GPU Lines Screen Projected FS
 #pragma vp_entryPoint oe_LineDrawable_Stippler_FS
 #pragma vp_location fragment_coloring
-#pragma import_defines(OE_LINE_SMOOTH)
+#pragma import_defines(OE_LINE_SMOOTH, OE_LINE_STIPPLE)
 
+#ifdef OE_LINE_STIPPLE
 uniform int oe_GL_LineStippleFactor;
 uniform int oe_GL_LineStipplePattern;
+#endif
 
 flat in vec2 oe_LineDrawable_rv;
 flat in int oe_LineDrawable_draw;
@@ -213,7 +246,7 @@ void oe_LineDrawable_Stippler_FS(inout vec4 color)
     if (oe_LineDrawable_draw == 0)
         discard;
 
-    if (oe_GL_LineStipplePattern != 0xffff)
+#ifdef OE_LINE_STIPPLE
     {
         // coordinate of the fragment, shifted to 0:
         vec2 coord = (gl_FragCoord.xy - 0.5);
@@ -236,6 +269,7 @@ void oe_LineDrawable_Stippler_FS(inout vec4 color)
         //color.r = oe_LineDrawable_rv.x;
         //color.g = oe_LineDrawable_rv.y;
     }
+#endif
 
 #ifdef OE_LINE_SMOOTH
     // anti-aliasing
@@ -0,0 +1,227 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/LineOfSightEngine>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/JobArena>
+#include <osgEarth/Map>
+#include <osgEarth/Notify>
+#include <cmath>
+
+#define LC "[LineOfSightEngine] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    /**
+     * Computes the queries for one thread, reusing one envelope and one set
+     * of sample buffers for all of them.
+     */
+    struct LOSWorker
+    {
+        LOSWorker(ElevationPool* pool, const SpatialReference* srs, unsigned lod, double spacing, unsigned maxSamples) :
+            _srs(srs), _spacing(spacing), _maxSamples(maxSamples)
+        {
+            _envelope = pool->createEnvelope(srs, lod);
+        }
+
+        // Resolves a query point to map coordinates with an absolute altitude
+        bool resolve(const GeoPoint& input, GeoPoint& output)
+        {
+            if (!input.isValid() || !input.transform(_srs.get(), output))
+                return false;
+
+            if (output.altitudeMode() == ALTMODE_RELATIVE)
+            {
+                float h = _envelope->getElevation(output.x(), output.y());
+                if (h != NO_DATA_VALUE)
+                    output.alt() += h;
+                output.altitudeMode() = ALTMODE_ABSOLUTE;
+            }
+            return true;
+        }
+
+        void compute(const LineOfSightEngine::Query& query, LineOfSightEngine::Result& result)
+        {
+            result = LineOfSightEngine::Result();
+
+            GeoPoint start, end;
+            osg::Vec3d startWorld, endWorld;
+            if (!resolve(query._start, start) || !resolve(query._end, end) ||
+                !start.toWorld(startWorld) || !end.toWorld(endWorld))
+            {
+                return;
+            }
+
+            result._valid = true;
+            result._visible = true;
+
+            // Sample the straight world-space segment, excluding its endpoints.
+            osg::Vec3d delta = endWorld - startWorld;
+            double length = delta.length();
+            unsigned numSegments = (unsigned)osg::clampBetween(
+                std::ceil(length / osg::maximum(_spacing, 0.001)), 2.0, (double)osg::maximum(_maxSamples, 2u));
+            unsigned count = numSegments - 1u;
+
+            _xs.resize(count);
+            _ys.resize(count);
+            _zs.resize(count);
+            _hs.resize(count);
+
+            osg::Vec3d local;
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double t = (double)(i + 1u) / (double)numSegments;
+                _srs->transformFromWorld(startWorld + delta*t, local);
+                _xs[i] = local.x();
+                _ys[i] = local.y();
+                _zs[i] = local.z();
+            }
+
+            // One batched query; the envelope groups the samples by tile.
+            _envelope->getElevations(&_xs[0], &_ys[0], &_hs[0], count);
+
+            for (unsigned i = 0; i < count; ++i)
+            {
+                if (_hs[i] != NO_DATA_VALUE && _zs[i] < (double)_hs[i])
+                {
+                    result._visible = false;
+                    result._blockedRatio = (double)(i + 1u) / (double)numSegments;
+                    result._blockedPoint = GeoPoint(_srs.get(), _xs[i], _ys[i], _hs[i], ALTMODE_ABSOLUTE);
+                    break;
+                }
+            }
+        }
+
+        osg::ref_ptr<const SpatialReference> _srs;
+        osg::ref_ptr<ElevationEnvelope> _envelope;
+        double _spacing;
+        unsigned _maxSamples;
+        std::vector<double> _xs, _ys, _zs;
+        std::vector<float> _hs;
+    };
+
+    /**
+     * Queries of one compute() call. Threads claim them one at a time
+     * until they're all done.
+     */
+    struct LOSGroup : public osg::Referenced
+    {
+        LOSGroup(const LineOfSightEngine::Queries& queries, LineOfSightEngine::Results& results,
+                 ElevationPool* pool, const SpatialReference* srs, unsigned lod, double spacing, unsigned maxSamples) :
+            _queries(queries), _results(results), _pool(pool), _srs(srs),
+            _lod(lod), _spacing(spacing), _maxSamples(maxSamples),
+            _next(0u), _remaining(queries.size()), _valid(0u) { }
+
+        void run()
+        {
+            LOSWorker worker(_pool.get(), _srs.get(), _lod, _spacing, _maxSamples);
+            for(;;)
+            {
+                unsigned index = (++_next) - 1u;
+                if (index >= _queries.size())
+                    break;
+
+                worker.compute(_queries[index], _results[index]);
+                if (_results[index]._valid)
+                    ++_valid;
+
+                if (--_remaining == 0u)
+                    _done.set();
+            }
+        }
+
+        const LineOfSightEngine::Queries& _queries;
+        LineOfSightEngine::Results& _results;
+        osg::ref_ptr<ElevationPool> _pool;
+        osg::ref_ptr<const SpatialReference> _srs;
+        unsigned _lod;
+        double _spacing;
+        unsigned _maxSamples;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        OpenThreads::Atomic _valid;
+        Threading::Event _done;
+    };
+
+    struct LOSTask : public TaskRequest
+    {
+        LOSTask(LOSGroup* group) : _group(group) { }
+
+        void operator()(ProgressCallback*)
+        {
+            _group->run();
+        }
+
+        osg::ref_ptr<LOSGroup> _group;
+    };
+}
+
+LineOfSightEngine::LineOfSightEngine(const Map* map) :
+_map(map),
+_lod(14u),
+_spacing(25.0),
+_maxSamples(65536u)
+{
+    //nop
+}
+
+unsigned
+LineOfSightEngine::compute(const Queries& queries, Results& results, unsigned numThreads) const
+{
+    results.assign(queries.size(), Result());
+
+    osg::ref_ptr<const Map> map;
+    if (queries.empty() || !_map.lock(map))
+        return 0u;
+
+    osg::ref_ptr<LOSGroup> group = new LOSGroup(
+        queries, results, map->getElevationPool(), map->getSRS(), _lod, _spacing, _maxSamples);
+
+    unsigned numHelpers = osg::minimum(numThreads, (unsigned)queries.size());
+    if (numHelpers > 1u)
+    {
+        JobArena* arena = JobArena::get("oe.lineofsight");
+        if (arena->getConcurrency() < numHelpers - 1u)
+            arena->setConcurrency(numHelpers - 1u);
+
+        for (unsigned i = 1; i < numHelpers; ++i)
+        {
+            arena->dispatch(new LOSTask(group.get()));
+        }
+    }
+
+    group->run();
+    group->_done.wait();
+
+    return group->_valid;
+}
+
+LineOfSightEngine::Result
+LineOfSightEngine::compute(const GeoPoint& start, const GeoPoint& end) const
+{
+    Queries queries(1, Query(start, end));
+    Results results;
+    compute(queries, results, 1u);
+    return results[0];
+}
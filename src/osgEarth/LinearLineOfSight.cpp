@@ -46,6 +46,21 @@ namespace
     }; 
 
 
+    // region of terrain that can change a line of sight between two points
+    GeoExtent getLineRegion(const GeoPoint& start, const GeoPoint& end)
+    {
+        if (!start.isValid() || !end.isValid())
+            return GeoExtent::INVALID;
+
+        GeoPoint end2 = end.transform(start.getSRS());
+        if (!end2.isValid())
+            return GeoExtent::INVALID;
+
+        GeoExtent region(start.getSRS(), start.x(), start.y(), start.x(), start.y());
+        region.expandToInclude(end2.x(), end2.y());
+        return region;
+    }
+
     osg::Vec3d getNodeCenter(osg::Node* node)
     {
         osg::NodePathList nodePaths = node->getParentalNodePaths();
@@ -109,7 +124,7 @@ void
 LinearLineOfSightNode::subscribeToTerrain()
 {
     _terrainChangedCallback = new TerrainChangedCallback( this );
-    _mapNode->getTerrain()->addTerrainCallback( _terrainChangedCallback.get() );        
+    _mapNode->getTerrain()->addTerrainCallback( _terrainChangedCallback.get(), getLineRegion(_start, _end) );
 }
 
 LinearLineOfSightNode::~LinearLineOfSightNode()
@@ -137,13 +152,24 @@ LinearLineOfSightNode::setMapNode( MapNode* mapNode )
 
         if ( _mapNode.valid() && _terrainChangedCallback.valid() )
         {
-            _mapNode->getTerrain()->addTerrainCallback( _terrainChangedCallback.get() );
+            _mapNode->getTerrain()->addTerrainCallback( _terrainChangedCallback.get(), getLineRegion(_start, _end) );
         }
 
         compute( getNode() );
     }
 }
 
+void
+LinearLineOfSightNode::updateTerrainRegion()
+{
+    // moves the terrain callback so it hears about tiles under the new line
+    osg::ref_ptr<MapNode> mapNode;
+    if ( _terrainChangedCallback.valid() && _mapNode.lock(mapNode) )
+    {
+        mapNode->getTerrain()->addTerrainCallback( _terrainChangedCallback.get(), getLineRegion(_start, _end) );
+    }
+}
+
 void
 LinearLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
@@ -162,6 +188,7 @@ LinearLineOfSightNode::setStart(const GeoPoint& start)
     if (_start != start)
     {
         _start = start;
+        updateTerrainRegion();
         compute(getNode());
     }
 }
@@ -178,6 +205,7 @@ LinearLineOfSightNode::setEnd(const GeoPoint& end)
     if (_end != end)
     {
         _end = end;
+        updateTerrainRegion();
         compute(getNode());
     }
 }
@@ -29,6 +29,7 @@
 #include <osgEarth/GeometryClamper>
 #include <osgEarth/Utils>
 #include <osgEarth/NodeUtils>
+#include <osgEarth/Registry>
 
 #define LC "[GeometryNode] "
 
@@ -56,6 +57,7 @@ LocalGeometryNode::construct()
     _geom = 0L;
     _clampInUpdateTraversal = false;
     _perVertexClampingEnabled = false;
+    _useElevationPool = false;
 }
 
 void
@@ -88,6 +90,10 @@ LocalGeometryNode::compileGeometry()
         if ( getMapNode() )
         {
             session = new Session(getMapNode()->getMap(), 0L);
+
+            // Share state attributes with every other annotation so that
+            // compatible styles sort together and skip redundant applies.
+            session->setStateSetCache(Registry::stateSetCache());
         }
 
         AltitudeSymbol* alt = _style.get<AltitudeSymbol>();
@@ -217,10 +223,6 @@ LocalGeometryNode::onTileUpdate(const TileKey&          key,
                                 osg::Node*              graph, 
                                 TerrainCallbackContext& context)
 {
-    // If we are already set to clamp, ignore this
-    if (_clampInUpdateTraversal)
-        return;
-
     bool needsClamp;
 
     // Does the tile key's polytope intersect the world bounds or this object?
@@ -237,7 +239,9 @@ LocalGeometryNode::onTileUpdate(const TileKey&          key,
         needsClamp = true;
     }
 
-    if (needsClamp)
+    // Collect the changed tiles and re-clamp once, in the next update
+    // traversal, where they changed.
+    if (needsClamp && _clampRegion.add(key) && !_clampInUpdateTraversal)
     {
         _clampInUpdateTraversal = true;
         ADJUST_UPDATE_TRAV_COUNT(this, +1);
@@ -247,14 +251,16 @@ LocalGeometryNode::onTileUpdate(const TileKey&          key,
 }
 
 void
-LocalGeometryNode::reclamp()
+LocalGeometryNode::reclamp(const GeoExtent& region)
 {
     if (_perVertexClampingEnabled)
     {
         osg::ref_ptr<Terrain> terrain = getGeoTransform()->getTerrain();
         if (terrain.valid())
         {
+            _clampExtent = region;
             clamp(terrain->getGraph(), terrain.get());
+            _clampExtent = GeoExtent::INVALID;
         }
     }
 }
@@ -276,6 +282,12 @@ LocalGeometryNode::clamp(osg::Node* graph, const Terrain* terrain)
         // altitude back in as an offset.
         clamper.setOffset(getPosition().alt());
 
+        // only where the terrain changed, if we know:
+        clamper.setRegion(_clampExtent);
+
+        if (_useElevationPool && getMapNode())
+            clamper.setElevationPool(getMapNode()->getMap()->getElevationPool());
+
         this->accept( clamper );
         
         OE_DEBUG << LC << "LGN: clamped.\n";
@@ -287,7 +299,8 @@ LocalGeometryNode::traverse(osg::NodeVisitor& nv)
 {
     if (nv.getVisitorType() == nv.UPDATE_VISITOR && _clampInUpdateTraversal)
     {
-        reclamp();
+        reclamp(_clampRegion.getExtent());
+        _clampRegion.reset();
 
         _clampInUpdateTraversal = false;
         ADJUST_UPDATE_TRAV_COUNT(this, -1);
@@ -308,12 +308,125 @@ MBTilesElevationLayer::writeHeightFieldImplementation(const TileKey& key, const
 #undef LC
 #define LC "[MBTiles] Layer \"" << _name << "\" "
 
+namespace
+{
+    const char* SELECT_TILE_SQL =
+        "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+
+    const char* INSERT_TILE_SQL =
+        "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
+
+    // Number of tile writes to batch into each transaction.
+    const unsigned WRITES_PER_TRANSACTION = 1000u;
+
+    // Runs a prepared tile query and copies out the tile data.
+    bool selectTile(sqlite3_stmt* select, int z, int x, int y, std::string& out_data)
+    {
+        sqlite3_bind_int( select, 1, z );
+        sqlite3_bind_int( select, 2, x );
+        sqlite3_bind_int( select, 3, y );
+
+        bool found = false;
+        if ( sqlite3_step( select ) == SQLITE_ROW )
+        {
+            // the pointer returned from _blob gets freed internally by sqlite, supposedly
+            const char* data = (const char*)sqlite3_column_blob( select, 0 );
+            int dataLen = sqlite3_column_bytes( select, 0 );
+            out_data.assign( data, dataLen );
+            found = true;
+        }
+
+        sqlite3_reset( select );
+        return found;
+    }
+}
+
 MBTiles::Driver::Driver()
 {
     _minLevel = 0;
     _maxLevel = 20;
     _forceRGB = false;
     _database = NULL;
+    _readWrite = false;
+    _insert = NULL;
+    _writesInTransaction = 0u;
+}
+
+MBTiles::Driver::~Driver()
+{
+    commit();
+
+    if (_insert != NULL)
+        sqlite3_finalize((sqlite3_stmt*)_insert);
+
+    for (std::vector<Reader>::iterator i = _idleReaders.begin(); i != _idleReaders.end(); ++i)
+    {
+        sqlite3_finalize((sqlite3_stmt*)i->_select);
+        sqlite3_close((sqlite3*)i->_database);
+    }
+
+    if (_database != NULL)
+        sqlite3_close((sqlite3*)_database);
+}
+
+bool
+MBTiles::Driver::acquireReader(Reader& out) const
+{
+    {
+        Threading::ScopedMutexLock lock(_readersMutex);
+        if (!_idleReaders.empty())
+        {
+            out = _idleReaders.back();
+            _idleReaders.pop_back();
+            return true;
+        }
+    }
+
+    // No idle connection, so open another one. A read-only connection
+    // does not share state with the others and needs no locking.
+    sqlite3* database = NULL;
+    int rc = sqlite3_open_v2(_fullFilename.c_str(), &database, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, 0L);
+    if (rc != SQLITE_OK)
+    {
+        OE_WARN << LC << "Failed to open reader connection: " << sqlite3_errmsg(database) << std::endl;
+        sqlite3_close(database);
+        return false;
+    }
+
+    sqlite3_stmt* select = NULL;
+    rc = sqlite3_prepare_v2( database, SELECT_TILE_SQL, -1, &select, 0L );
+    if ( rc != SQLITE_OK )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << SELECT_TILE_SQL << "; " << sqlite3_errmsg(database) << std::endl;
+        sqlite3_close(database);
+        return false;
+    }
+
+    out._database = database;
+    out._select = select;
+    return true;
+}
+
+void
+MBTiles::Driver::releaseReader(const Reader& reader) const
+{
+    Threading::ScopedMutexLock lock(_readersMutex);
+    _idleReaders.push_back(reader);
+}
+
+void
+MBTiles::Driver::commit() const
+{
+    if (_writesInTransaction > 0u)
+    {
+        char* errorMsg = 0L;
+        if (SQLITE_OK != sqlite3_exec((sqlite3*)_database, "COMMIT TRANSACTION", 0L, 0L, &errorMsg))
+        {
+            OE_WARN << LC << "Failed to commit transaction: " << errorMsg << std::endl;
+            sqlite3_free( errorMsg );
+        }
+        _writesInTransaction = 0u;
+    }
 }
 
 Status
@@ -364,13 +477,26 @@ MBTiles::Driver::open(
         ? (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX)
         : (SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
 
-    sqlite3* database = (sqlite3*)_database;
     sqlite3** dbptr = (sqlite3**)&_database;
     int rc = sqlite3_open_v2(fullFilename.c_str(), dbptr, flags, 0L);
     if (rc != 0)
     {
         return Status(Status::ResourceUnavailable, Stringify()
-            << "Database \"" << fullFilename << "\": " << sqlite3_errmsg(database));
+            << "Database \"" << fullFilename << "\": " << sqlite3_errmsg((sqlite3*)_database));
+    }
+
+    _fullFilename = fullFilename;
+    _readWrite = readWrite;
+
+    // Write-ahead logging lets readers proceed while tiles are written.
+    if (readWrite)
+    {
+        char* errorMsg = 0L;
+        if (SQLITE_OK != sqlite3_exec((sqlite3*)_database, "PRAGMA journal_mode=WAL", 0L, 0L, &errorMsg))
+        {
+            OE_INFO << LC << "WAL journal mode not available: " << errorMsg << std::endl;
+            sqlite3_free( errorMsg );
+        }
     }
 
     // New database setup:
@@ -560,8 +686,6 @@ MBTiles::Driver::read(
     ProgressCallback* progress,
     const osgDB::Options* readOptions) const
 {
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     int z = key.getLevelOfDetail();
     int x = key.getTileX();
     int y = key.getTileY();
@@ -581,65 +705,73 @@ MBTiles::Driver::read(
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    sqlite3* database = (sqlite3*)_database;
-
     //Get the image
-    sqlite3_stmt* select = NULL;
-    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-    int rc = sqlite3_prepare_v2( database, query.c_str(), -1, &select, 0L );
-    if ( rc != SQLITE_OK )
+    std::string dataBuffer;
+    bool valid = false;
+
+    if (_readWrite)
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(database) << std::endl;
-        return ReadResult::RESULT_READER_ERROR;
+        // Read through the writing connection, so we see uncommitted tiles.
+        Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+        sqlite3* database = (sqlite3*)_database;
+        sqlite3_stmt* select = NULL;
+        int rc = sqlite3_prepare_v2( database, SELECT_TILE_SQL, -1, &select, 0L );
+        if ( rc != SQLITE_OK )
+        {
+            OE_WARN << LC << "Failed to prepare SQL: " << SELECT_TILE_SQL << "; " << sqlite3_errmsg(database) << std::endl;
+            return ReadResult::RESULT_READER_ERROR;
+        }
+
+        valid = selectTile(select, z, x, y, dataBuffer);
+
+        sqlite3_finalize( select );
     }
+    else
+    {
+        // Each thread reads through its own pooled connection.
+        Reader reader;
+        if (!acquireReader(reader))
+        {
+            return ReadResult::RESULT_READER_ERROR;
+        }
 
-    bool valid = true;
+        valid = selectTile((sqlite3_stmt*)reader._select, z, x, y, dataBuffer);
 
-    sqlite3_bind_int( select, 1, z );
-    sqlite3_bind_int( select, 2, x );
-    sqlite3_bind_int( select, 3, y );
+        releaseReader(reader);
+    }
 
-    osg::Image* result = NULL;
-    rc = sqlite3_step( select );
-    if ( rc == SQLITE_ROW)
+    if (!valid)
     {
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 0 );
-        int dataLen = sqlite3_column_bytes( select, 0 );
+        OE_DEBUG << LC << "SQL QUERY failed for " << SELECT_TILE_SQL << ": " << std::endl;
+        return ReadResult((osg::Image*)NULL);
+    }
 
-        std::string dataBuffer( data, dataLen );
+    osg::Image* result = NULL;
 
-        // decompress if necessary:
-        if ( _compressor.valid() )
+    // decompress if necessary:
+    if ( _compressor.valid() )
+    {
+        std::istringstream inputStream(dataBuffer);
+        std::string value;
+        if ( !_compressor->decompress(inputStream, value) )
         {
-            std::istringstream inputStream(dataBuffer);
-            std::string value;
-            if ( !_compressor->decompress(inputStream, value) )
-            {
-                OE_WARN << LC << "Decompression failed" << std::endl;
-                valid = false;
-            }
-            else
-            {
-                dataBuffer = value;
-            }
+            OE_WARN << LC << "Decompression failed" << std::endl;
+            valid = false;
         }
-
-        // decode the raw image data:
-        if ( valid )
+        else
         {
-            std::istringstream inputStream(dataBuffer);
-            result = ImageUtils::readStream(inputStream, _dbOptions.get());
+            dataBuffer = value;
         }
     }
-    else
+
+    // decode the raw image data:
+    if ( valid )
     {
-        OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
-        valid = false;
+        std::istringstream inputStream(dataBuffer);
+        result = ImageUtils::readStream(inputStream, _dbOptions.get());
     }
 
-    sqlite3_finalize( select );
-
     return ReadResult(result);
 }
 
@@ -653,8 +785,6 @@ MBTiles::Driver::write(
     if (!key.valid() || !image)
         return Status::AssertionFailure;
 
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     // encode the data stream:
     std::stringstream buf;
     osgDB::ReaderWriter::WriteResult wr;
@@ -696,16 +826,28 @@ MBTiles::Driver::write(
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y = numRows - y - 1;
 
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
     sqlite3* database = (sqlite3*)_database;
 
     // Prep the insert statement:
-    sqlite3_stmt* insert = NULL;
-    std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
-    int rc = sqlite3_prepare_v2(database, query.c_str(), -1, &insert, 0L);
-    if (rc != SQLITE_OK)
+    if (_insert == NULL)
+    {
+        sqlite3_stmt** insertptr = (sqlite3_stmt**)&_insert;
+        int rc = sqlite3_prepare_v2(database, INSERT_TILE_SQL, -1, insertptr, 0L);
+        if (rc != SQLITE_OK)
+        {
+            return Status(Status::GeneralError, Stringify()
+                << "Failed to prepare SQL: " << INSERT_TILE_SQL << "; " << sqlite3_errmsg(database));
+        }
+    }
+
+    sqlite3_stmt* insert = (sqlite3_stmt*)_insert;
+
+    // batch the writes into a transaction:
+    if (_writesInTransaction == 0u)
     {
-        return Status(Status::GeneralError, Stringify()
-            << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(database));
+        sqlite3_exec(database, "BEGIN TRANSACTION", 0L, 0L, 0L);
     }
 
     // bind parameters:
@@ -717,24 +859,29 @@ MBTiles::Driver::write(
     sqlite3_bind_blob(insert, 4, value.c_str(), value.length(), SQLITE_STATIC);
 
     // run the sql.
-    bool ok = true;
+    int rc;
     int tries = 0;
     do {
         rc = sqlite3_step(insert);
     } while (++tries < 100 && (rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
 
+    sqlite3_reset(insert);
+
+    // the transaction is open even if this write failed:
+    if (++_writesInTransaction >= WRITES_PER_TRANSACTION)
+    {
+        commit();
+    }
+
     if (SQLITE_OK != rc && SQLITE_DONE != rc)
     {
 #if SQLITE_VERSION_NUMBER >= 3007015
-        return Status(Status::GeneralError, Stringify()<<"Failed query: " << query << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(database));
+        return Status(Status::GeneralError, Stringify()<<"Failed query: " << INSERT_TILE_SQL << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(database));
 #else
-        return Status(Status::GeneralError, Stringify()<< "Failed query: " << query << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(database));
+        return Status(Status::GeneralError, Stringify()<< "Failed query: " << INSERT_TILE_SQL << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(database));
 #endif
-        ok = false;
     }
 
-    sqlite3_finalize(insert);
-
     return Status::NoError;
 }
 
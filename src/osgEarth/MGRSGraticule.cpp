@@ -334,6 +334,8 @@ MGRSGraticule::init()
 
     _root = new LocalRoot();
 
+    _nodeCache = new GraticuleNodeCache();
+
     GLUtils::setLighting(_root->getOrCreateStateSet(), osg::StateAttribute::OFF);
 
     // install the range callback for clip plane activation
@@ -375,6 +377,8 @@ MGRSGraticule::removedFromMap(const Map* map)
 {
     options().styleSheet().removedFromMap(map);
     _map = 0L;
+    if (_nodeCache.valid())
+        _nodeCache->clear();
     VisibleLayer::removedFromMap(map);
 }
 
@@ -386,6 +390,15 @@ MGRSGraticule::getNode() const
 
 namespace
 {
+    // Identifies one cell of a UTM grid; the extent tells apart cells
+    // with the same easting/northing in different zones.
+    std::string cellName(double size, double easting, double northing, const GeoExtent& extent)
+    {
+        return Stringify() << std::fixed << std::setprecision(0)
+            << size << ':' << easting << ':' << northing << ':'
+            << std::setprecision(7) << extent.xMin() << ':' << extent.yMin();
+    }
+
     void findPointClosestTo(const Feature* f, const osg::Vec3d& p1, osg::Vec3d& out)
     {
         out = p1;
@@ -512,6 +525,13 @@ namespace
             double x0 = _feature->getDouble("easting");
             double y0 = _feature->getDouble("northing");
 
+            // GeomCell and SQID100kmCell build a grid just to get its bound, and
+            // again when it pages in, so this is usually a cache hit.
+            std::string key = GraticuleNodeCache::makeKey("grid", cellName(_size, x0, y0, _extent), _style);
+            osg::Node* cached = _parent->getNodeCache()->get(key);
+            if (cached)
+                return cached;
+
             double interval = _size * 0.1;
 
             osg::ref_ptr<MultiGeometry> grid = new MultiGeometry();
@@ -546,6 +566,7 @@ namespace
             GeometryCompilerOptions gco;
             gco.shaderPolicy() = SHADERPOLICY_INHERIT;
             FeatureNode* node = new FeatureNode(f.get(), _style, gco);
+            _parent->getNodeCache()->insert(key, node);
             
             return node;
         }
@@ -604,9 +625,16 @@ namespace
 
     osg::Node* GeomCell::build()
     {
+        GeoExtent extent(_feature->getSRS(), _feature->getGeometry()->getBounds());
+        std::string key = GraticuleNodeCache::makeKey("cell", cellName(_size, _feature->getDouble("easting"), _feature->getDouble("northing"), extent), _style);
+        osg::Node* cached = _parent->getNodeCache()->get(key);
+        if (cached)
+            return cached;
+
         GeometryCompilerOptions gco;
         gco.shaderPolicy() = SHADERPOLICY_INHERIT;
         FeatureNode* node = new FeatureNode(_feature.get(), _style, gco);
+        _parent->getNodeCache()->insert(key, node);
         return node;
     }
 
@@ -785,13 +813,18 @@ namespace
 
         osg::Node* build(const Feature* f, const FeatureProfile* prof, const Map* map)
         {
-            osg::Group* group = new osg::Group();
-
             // Extract just the line and altitude symbols:
             const Style& gzdStyle = *_parent->getStyleSheet()->getStyle("gzd");
             Style lineStyle;
             lineStyle.add( const_cast<LineSymbol*>(gzdStyle.get<LineSymbol>()) );
             lineStyle.add( const_cast<AltitudeSymbol*>(gzdStyle.get<AltitudeSymbol>()) );
+
+            std::string key = GraticuleNodeCache::makeKey("gzd", getName(), lineStyle);
+            osg::Node* cached = _parent->getNodeCache()->get(key);
+            if (cached)
+                return cached;
+
+            osg::Group* group = new osg::Group();
             
             GeoExtent extent(f->getSRS(), f->getGeometry()->getBounds());
 
@@ -847,7 +880,9 @@ namespace
             osg::Vec3d centerECEF;
             extent.getSRS()->transform( tileCenter, ecefSRS, centerECEF );
 
-            return ClusterCullingFactory::createAndInstall(group, centerECEF);
+            osg::Node* node = ClusterCullingFactory::createAndInstall(group, centerECEF);
+            _parent->getNodeCache()->insert(key, node);
+            return node;
         }
         
 #ifdef DEBUG_MODE
@@ -24,17 +24,20 @@
 #include <osgEarth/FileUtils>
 #include <osgEarth/GeoData>
 #include <osgEarth/FeatureSource>
+#include <osgEarth/JobArena>
 #include <osgDB/Registry>
 #include <list>
 #include <stdio.h>
 #include <stdlib.h>
 #include "vector_tile.pb.h"
+#include <google/protobuf/arena.h>
 
 #ifdef OSGEARTH_HAVE_SQLITE3
 #include <sqlite3.h>
 #endif
 
 using namespace osgEarth;
+using namespace osgEarth::Util;
 using namespace osgEarth::MVT;
 
 #define LC "[MVT] "
@@ -47,13 +50,6 @@ using namespace osgEarth::MVT;
 namespace osgEarth { namespace MVT
 {
     // https://github.com/mapbox/mapnik-vector-tile/blob/master/examples/c%2B%2B/tileinfo.cpp
-    enum CommandType {
-        SEG_END    = 0,
-        SEG_MOVETO = 1,
-        SEG_LINETO = 2,
-        SEG_CLOSE = (0x40 | 0x0f)
-    };
-
     enum eGeomType {
         Unknown = 0,
         Point = 1,
@@ -61,60 +57,118 @@ namespace osgEarth { namespace MVT
         Polygon = 3
     };
 
-    int zig_zag_decode(int n)
+    // Layers with fewer features than this are not worth a thread
+    const unsigned MIN_FEATURES_PER_JOB = 128u;
+
+    // Maps tile coordinates to map coordinates
+    struct TileTransform
     {
-        return (n >> 1) ^ (-(n & 1));
-    }
+        double _x0, _y0, _sx, _sy;
+
+        TileTransform(const TileKey& key, unsigned int tileres)
+        {
+            const GeoExtent& e = key.getExtent();
+            _x0 = e.xMin();
+            _y0 = e.yMax();
+            _sx = e.width() / (double)tileres;
+            _sy = e.height() / (double)tileres;
+        }
+    };
 
-    Geometry* decodeLine(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
+    // One command from a feature's geometry stream
+    struct Path
     {
-        unsigned int length = 0;
-        int cmd = -1;
-        const int cmd_bits = 3;
+        unsigned _cmd;
+        unsigned _first; // index of the first point
+        unsigned _count; // number of points
+    };
 
-        int x = 0;
-        int y = 0;
+    // Scratch space for decoding geometry, reused for every feature in a layer
+    struct GeometryBuffers
+    {
+        std::vector<uint32_t> _raw;
+        std::vector<int> _deltas;
+        std::vector<osg::Vec3d> _points;
+        std::vector<Path> _paths;
+    };
 
-        std::vector< osg::ref_ptr< osgEarth::LineString > > lines;
-        osg::ref_ptr< osgEarth::LineString > currentLine;
+    // Decodes the command stream of a feature into a list of paths and their points.
+    // The parameters are collected first so that zigzag decoding runs as one
+    // branch-free loop over a contiguous array (which the compiler vectorizes),
+    // and the delta decoding and transform run as a second tight loop.
+    void decodeGeometry(const mapnik::vector::tile_feature& feature, const TileTransform& xform, GeometryBuffers& buf)
+    {
+        buf._raw.clear();
+        buf._paths.clear();
+
+        const uint32_t* g = feature.geometry().data();
+        const unsigned size = feature.geometry_size();
 
-        for (int k = 0; k < feature.geometry_size();)
+        for (unsigned k = 0; k < size;)
         {
-            if (!length)
+            unsigned cmd_length = g[k++];
+            unsigned cmd = cmd_length & ((1u << CMD_BITS) - 1u);
+            unsigned length = cmd_length >> CMD_BITS;
+
+            if (cmd == CMD_MOVETO || cmd == CMD_LINETO)
+            {
+                unsigned count = osg::minimum(length, (size - k) / 2u);
+                Path path = { cmd, (unsigned)buf._raw.size() / 2u, count };
+                buf._paths.push_back(path);
+                buf._raw.insert(buf._raw.end(), g + k, g + k + 2u*count);
+                k += 2u*count;
+            }
+            else if (cmd == CMD_CLOSEPATH)
             {
-                unsigned int cmd_length = feature.geometry(k++);
-                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                length = cmd_length >> cmd_bits;
+                Path path = { cmd, (unsigned)buf._raw.size() / 2u, 0u };
+                buf._paths.push_back(path);
             }
-            if (length > 0)
+            else
             {
-                length--;
+                // unknown command; we cannot tell how many parameters to skip
+                break;
+            }
+        }
 
-                if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
-                {
-                    if (cmd == SEG_MOVETO)
-                    {
-                        currentLine = new osgEarth::LineString;
-                        lines.push_back( currentLine.get() );
-                    }
-                    int px = feature.geometry(k++);
-                    int py = feature.geometry(k++);
-                    px = zig_zag_decode(px);
-                    py = zig_zag_decode(py);
+        const unsigned n = buf._raw.size();
+        buf._deltas.resize(n);
+        const uint32_t* raw = n > 0 ? &buf._raw[0] : 0L;
+        int* deltas = n > 0 ? &buf._deltas[0] : 0L;
 
-                    x += px;
-                    y += py;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            deltas[i] = (int)(raw[i] >> 1) ^ -(int)(raw[i] & 1u);
+        }
 
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
+        buf._points.resize(n / 2u);
+        int x = 0, y = 0;
+        for (unsigned i = 0; i < n / 2u; ++i)
+        {
+            x += deltas[2u*i];
+            y += deltas[2u*i + 1u];
+            buf._points[i].set(xform._x0 + xform._sx * (double)x, xform._y0 - xform._sy * (double)y, 0.0);
+        }
+    }
 
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
+    Geometry* decodeLine(const GeometryBuffers& buf)
+    {
+        std::vector< osg::ref_ptr< osgEarth::LineString > > lines;
+        osg::ref_ptr< osgEarth::LineString > currentLine;
 
-                    if (currentLine.valid())
-                    {
-                        currentLine->push_back(geoX, geoY, 0);
-                    }
+        for (unsigned p = 0; p < buf._paths.size(); ++p)
+        {
+            const Path& path = buf._paths[p];
+            for (unsigned i = path._first; i < path._first + path._count; ++i)
+            {
+                if (path._cmd == CMD_MOVETO)
+                {
+                    currentLine = new osgEarth::LineString;
+                    lines.push_back( currentLine.get() );
+                }
+
+                if (currentLine.valid())
+                {
+                    currentLine->push_back(buf._points[i]);
                 }
             }
         }
@@ -142,52 +196,21 @@ namespace osgEarth { namespace MVT
         }
     }
 
-    Geometry* decodePoint(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
+    Geometry* decodePoint(const GeometryBuffers& buf)
     {
-        unsigned int length = 0;
-        int cmd = -1;
-        const int cmd_bits = 3;
-
-        int x = 0;
-        int y = 0;
-
         osgEarth::PointSet *geometry = new osgEarth::PointSet();
+        geometry->reserve(buf._points.size());
 
-        for (int k = 0; k < feature.geometry_size();)
+        for (unsigned p = 0; p < buf._paths.size(); ++p)
         {
-            if (!length)
-            {
-                unsigned int cmd_length = feature.geometry(k++);
-                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                length = cmd_length >> cmd_bits;
-            }
-            if (length > 0)
-            {
-                length--;
-                if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
-                {
-                    int px = feature.geometry(k++);
-                    int py = feature.geometry(k++);
-                    px = zig_zag_decode(px);
-                    py = zig_zag_decode(py);
-
-                    x += px;
-                    y += py;
-
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
-
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
-                    geometry->push_back(geoX, geoY, 0);
-                }
-            }
+            const Path& path = buf._paths[p];
+            geometry->insert(geometry->end(), buf._points.begin() + path._first, buf._points.begin() + path._first + path._count);
         }
 
         return geometry;
     }
 
-    Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  TileKey& key, unsigned int tileres)
+    Geometry* decodePolygon(const GeometryBuffers& buf)
     {
         /*
          https://github.com/mapbox/vector-tile-spec/tree/master/2.1
@@ -197,14 +220,6 @@ namespace osgEarth { namespace MVT
          interior ring (inner polygon of the current polygon).
          */
 
-
-        unsigned int length = 0;
-        int cmd = -1;
-        const int cmd_bits = 3;
-
-        int x = 0;
-        int y = 0;
-
         // The list of polygons we've collected
         std::vector< osg::ref_ptr< osgEarth::Polygon > > polygons;
 
@@ -212,77 +227,56 @@ namespace osgEarth { namespace MVT
 
         osg::ref_ptr< osgEarth::Ring > currentRing;
 
-        for (int k = 0; k < feature.geometry_size();)
+        for (unsigned p = 0; p < buf._paths.size(); ++p)
         {
-            if (!length)
-            {
-                unsigned int cmd_length = feature.geometry(k++);
-                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                length = cmd_length >> cmd_bits;
-            }
-            if (length > 0)
+            const Path& path = buf._paths[p];
+
+            if (path._cmd == CMD_MOVETO || path._cmd == CMD_LINETO)
             {
-                length--;
-                if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
+                if (!currentRing)
                 {
-                    if (!currentRing)
-                    {
-                        currentRing = new osgEarth::Ring();
-                    }
+                    currentRing = new osgEarth::Ring();
+                }
 
-                    int px = feature.geometry(k++);
-                    int py = feature.geometry(k++);
-                    px = zig_zag_decode(px);
-                    py = zig_zag_decode(py);
+                currentRing->insert(currentRing->end(), buf._points.begin() + path._first, buf._points.begin() + path._first + path._count);
+            }
+            else if (path._cmd == CMD_CLOSEPATH && currentRing.valid())
+            {
+                // The orientation is the opposite of what we want for features.  clockwise means exterior ring, counter clockwise means interior
 
-                    x += px;
-                    y += py;
+                // Figure out what to do with the ring based on the orientation of the ring
+                Geometry::Orientation orientation = currentRing->getOrientation();
+                // Close the ring.
+                currentRing->close();
 
-                    double width = key.getExtent().width();
-                    double height = key.getExtent().height();
+                // Clockwise means exterior ring.  Start a new polygon and add the ring.
+                if (orientation == Geometry::ORIENTATION_CW)
+                {
+                    // osgearth orientations are reversed from mvt
+                    currentRing->rewind(Geometry::ORIENTATION_CCW);
 
-                    double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                    double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
-                    currentRing->push_back(geoX, geoY, 0);
+                    currentPolygon = new osgEarth::Polygon(&currentRing->asVector());
+                    polygons.push_back(currentPolygon.get());
                 }
-                else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1)))
+                else if (orientation == Geometry::ORIENTATION_CCW)
+                // Counter clockwise means a hole, add it to the existing polygon.
                 {
-                    // The orientation is the opposite of what we want for features.  clockwise means exterior ring, counter clockwise means interior
-
-                    // Figure out what to do with the ring based on the orientation of the ring
-                    Geometry::Orientation orientation = currentRing->getOrientation();
-                    // Close the ring.
-                    currentRing->close();
-
-                    // Clockwise means exterior ring.  Start a new polygon and add the ring.
-                    if (orientation == Geometry::ORIENTATION_CW)
+                    if (currentPolygon.valid())
                     {
                         // osgearth orientations are reversed from mvt
-                        currentRing->rewind(Geometry::ORIENTATION_CCW);
-
-                        currentPolygon = new osgEarth::Polygon(&currentRing->asVector());
-                        polygons.push_back(currentPolygon.get());
+                        currentRing->rewind(Geometry::ORIENTATION_CW);
+                        currentPolygon->getHoles().push_back( currentRing );
                     }
-                    else if (orientation == Geometry::ORIENTATION_CCW)
-                    // Counter clockwise means a hole, add it to the existing polygon.
+                    else
                     {
-                        if (currentPolygon.valid())
-                        {
-                            // osgearth orientations are reversed from mvt
-                            currentRing->rewind(Geometry::ORIENTATION_CW);
-                            currentPolygon->getHoles().push_back( currentRing );
-                        }
-                        else
-                        {
-                            // this means we encountered a "hole" without a parent outer ring,
-                            // discard for now -gw
-                            OE_INFO << LC << "Discarding improperly wound polygon (hole without an outer ring)\n";
-                        }
+                        // this means we encountered a "hole" without a parent outer ring,
+                        // discard for now -gw
+                        OE_INFO << LC << "Discarding improperly wound polygon (hole without an outer ring)\n";
                     }
-
-                    // Start a new ring
-                    currentRing = 0;
                 }
+
+                // Start a new ring
+                currentRing = 0;
             }
         }
 
@@ -310,6 +304,205 @@ namespace osgEarth { namespace MVT
         }
     }
 
+    // Converts a layer's value table to attribute values once, instead of
+    // once per feature tag that refers to it.
+    struct LayerValues
+    {
+        std::vector<AttributeValue> _values;
+        std::vector<float> _heights; // from "other_tags"; FLT_MAX if none
+
+        LayerValues(const mapnik::vector::tile_layer& layer)
+        {
+            _values.resize(layer.values_size());
+            _heights.resize(layer.values_size(), FLT_MAX);
+
+            for (int i = 0; i < layer.values_size(); ++i)
+            {
+                const mapnik::vector::tile_value& value = layer.values(i);
+                AttributeValue& a = _values[i];
+                a.first = ATTRTYPE_UNSPECIFIED;
+                a.second.set = true;
+
+                if (value.has_bool_value())
+                {
+                    a.first = ATTRTYPE_BOOL;
+                    a.second.boolValue = value.bool_value();
+                }
+                else if (value.has_double_value())
+                {
+                    a.first = ATTRTYPE_DOUBLE;
+                    a.second.doubleValue = value.double_value();
+                }
+                else if (value.has_float_value())
+                {
+                    a.first = ATTRTYPE_DOUBLE;
+                    a.second.doubleValue = value.float_value();
+                }
+                else if (value.has_int_value())
+                {
+                    a.first = ATTRTYPE_INT;
+                    a.second.intValue = (int)value.int_value();
+                }
+                else if (value.has_sint_value())
+                {
+                    a.first = ATTRTYPE_INT;
+                    a.second.intValue = (int)value.sint_value();
+                }
+                else if (value.has_string_value())
+                {
+                    a.first = ATTRTYPE_STRING;
+                    a.second.stringValue = value.string_value();
+                }
+                else if (value.has_uint_value())
+                {
+                    a.first = ATTRTYPE_INT;
+                    a.second.intValue = (int)value.uint_value();
+                }
+
+                // Special path for getting heights from our test dataset.
+                if (value.has_string_value())
+                {
+                    StringTokenizer tok("=>");
+                    StringVector tized;
+                    tok.tokenize(value.string_value(), tized);
+                    if (tized.size() == 3 && tized[0] == "height")
+                    {
+                        // Remove quotes from the height
+                        _heights[i] = as<float>(tized[2], FLT_MAX);
+                    }
+                }
+            }
+        }
+    };
+
+    void readLayer(const mapnik::vector::tile_layer& layer, const TileKey& key, FeatureList& features)
+    {
+        const SpatialReference* srs = key.getProfile()->getSRS();
+        TileTransform xform(key, layer.extent());
+        LayerValues values(layer);
+        GeometryBuffers buf;
+
+        AttributeValue layerName;
+        layerName.first = ATTRTYPE_STRING;
+        layerName.second.stringValue = layer.name();
+        layerName.second.set = true;
+
+        for (int j = 0; j < layer.features_size(); j++)
+        {
+            const mapnik::vector::tile_feature &feature = layer.features(j);
+
+            decodeGeometry(feature, xform, buf);
+
+            osg::ref_ptr< osgEarth::Geometry > geometry;
+
+            eGeomType geomType = static_cast<eGeomType>(feature.type());
+            if (geomType == MVT::Polygon)
+            {
+                geometry = decodePolygon(buf);
+            }
+            else if (geomType == MVT::LineString)
+            {
+                geometry = decodeLine(buf);
+            }
+            else if (geomType == MVT::Point)
+            {
+                geometry = decodePoint(buf);
+
+                // This is a bit of a hack, but if a point is outside of the extents we remove it.
+                // Lines and Polygons that extend outside of the tileset we keep though b/c we assume that they are just slightly going outside of the
+                // extent.  Should probably make this an option somewhere.
+                if (geometry)
+                {
+                    if (!key.getExtent().contains(geometry->getBounds().center()))
+                    {
+                        geometry = NULL;
+                    }
+                }
+            }
+            else
+            {
+                geometry = decodeLine(buf);
+            }
+
+            if (!geometry)
+                continue;
+
+            osg::ref_ptr< Feature > oeFeature = new Feature(geometry.get(), srs);
+
+            // Set the layer name as "mvt_layer" so we can filter it later
+            oeFeature->set("mvt_layer", layerName);
+
+            // Read attributes
+            for (int k = 0; k + 1 < feature.tags_size(); k+=2)
+            {
+                unsigned keyIndex = feature.tags(k);
+                unsigned valueIndex = feature.tags(k+1);
+                if ((int)keyIndex >= layer.keys_size() || valueIndex >= values._values.size())
+                    continue;
+
+                const std::string& name = layer.keys(keyIndex);
+                oeFeature->set(name, values._values[valueIndex]);
+
+                if (name == "other_tags" && values._heights[valueIndex] != FLT_MAX)
+                {
+                    oeFeature->set("height", (double)values._heights[valueIndex]);
+                }
+            }
+
+            features.push_back(oeFeature.get());
+        }
+    }
+
+    // Decodes the layers of one tile, with pool threads helping the caller
+    struct LayerGroup : public osg::Referenced
+    {
+        LayerGroup(const mapnik::vector::tile& tile, const TileKey& key) :
+            _tile(tile), _key(key), _next(0u), _remaining(tile.layers_size())
+        {
+            _features.resize(tile.layers_size());
+        }
+
+        //! Claims and decodes the next layer; returns false if there are none left.
+        bool runNext()
+        {
+            unsigned index = (++_next) - 1u;
+            if (index >= _features.size())
+                return false;
+
+            readLayer(_tile.layers(index), _key, _features[index]);
+
+            if (--_remaining == 0u)
+                _done.set();
+
+            return true;
+        }
+
+        void runAndWait()
+        {
+            while (runNext());
+            _done.wait();
+        }
+
+        const mapnik::vector::tile& _tile;
+        TileKey _key;
+        std::vector<FeatureList> _features;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+    };
+
+    struct LayerTask : public TaskRequest
+    {
+        LayerTask(LayerGroup* group) : _group(group) { }
+
+        void operator()(ProgressCallback*)
+        {
+            while (_group->runNext());
+        }
+
+        osg::ref_ptr<LayerGroup> _group;
+    };
+
     bool readTile(std::istream& in, const TileKey& key, FeatureList& features)
     {
         features.clear();
@@ -327,132 +520,51 @@ namespace osgEarth { namespace MVT
         std::string value;
         if (!compressor->decompress(in, value))
         {
-            value = original;
+            value.swap(original);
         }
 
+        // Parse into an arena so the thousands of small messages in a tile
+        // come out of a few large blocks and are freed all at once.
+        google::protobuf::Arena arena;
+        mapnik::vector::tile* tile = google::protobuf::Arena::CreateMessage<mapnik::vector::tile>(&arena);
 
-        mapnik::vector::tile tile;
-
-        if (tile.ParseFromString(value))
+        if (!tile->ParseFromString(value))
         {
-            for (int i = 0; i < tile.layers().size(); i++)
-            {
-                const mapnik::vector::tile_layer &layer = tile.layers().Get(i);
-
-                for (int j = 0; j < layer.features().size(); j++)
-                {
-                    const mapnik::vector::tile_feature &feature = layer.features().Get(j);
-
-                    osg::ref_ptr< Feature > oeFeature = new Feature(0, key.getProfile()->getSRS());
-
-                    // Set the layer name as "mvt_layer" so we can filter it later
-                    oeFeature->set("mvt_layer", layer.name());
-
-                    // Read attributes
-                    for (int k = 0; k < feature.tags().size(); k+=2)
-                    {
-                        std::string key = layer.keys().Get(feature.tags().Get(k));
-                        mapnik::vector::tile_value value = layer.values().Get(feature.tags().Get(k+1));
-
-                        if (value.has_bool_value())
-                        {
-                            oeFeature->set(key, value.bool_value());
-                        }
-                        else if (value.has_double_value())
-                        {
-                            oeFeature->set(key, value.double_value());
-                        }
-                        else if (value.has_float_value())
-                        {
-                            oeFeature->set(key, value.float_value());
-                        }
-                        else if (value.has_int_value())
-                        {
-                            oeFeature->set(key, (int)value.int_value());
-                        }
-                        else if (value.has_sint_value())
-                        {
-                            oeFeature->set(key, (int)value.sint_value());
-                        }
-                        else if (value.has_string_value())
-                        {
-                            oeFeature->set(key, value.string_value());
-                        }
-                        else if (value.has_uint_value())
-                        {
-                            oeFeature->set(key, (int)value.uint_value());
-                        }
-
-                        // Special path for getting heights from our test dataset.
-                        if (key == "other_tags")
-                        {
-                            std::string other_tags = value.string_value();
-
-                            StringTokenizer tok("=>");
-                            StringVector tized;
-                            tok.tokenize(other_tags, tized);
-                            if (tized.size() == 3)
-                            {
-                                if (tized[0] == "height")
-                                {
-                                    std::string value = tized[2];
-                                    // Remove quotes from the height
-                                    float height = as<float>(value, FLT_MAX);
-                                    if (height != FLT_MAX)
-                                    {
-                                        oeFeature->set("height", height);
-                                    }
-                                }
-                            }
-                        }
-                    }
+            OE_WARN_THROTTLED << "Failed to parse mvt" << key.str() << std::endl;
+            return false;
+        }
 
+        // Decode the layers in parallel when there is enough work to share.
+        unsigned numJobs = 0u;
+        for (int i = 0; i < tile->layers_size(); ++i)
+        {
+            if ((unsigned)tile->layers(i).features_size() >= MIN_FEATURES_PER_JOB)
+                ++numJobs;
+        }
 
+        if (numJobs > 1u)
+        {
+            osg::ref_ptr<LayerGroup> group = new LayerGroup(*tile, key);
 
-                    osg::ref_ptr< osgEarth::Geometry > geometry;
+            JobArena* jobs = JobArena::get("oe.mvt");
+            for (unsigned i = 1; i < numJobs; ++i)
+            {
+                jobs->dispatch(new LayerTask(group.get()));
+            }
 
-                    eGeomType geomType = static_cast<eGeomType>(feature.type());
-                    if (geomType == MVT::Polygon)
-                    {
-                        geometry = decodePolygon(feature, key, layer.extent());
-                    }
-                    else if (geomType == MVT::LineString)
-                    {
-                        geometry = decodeLine(feature, key, layer.extent());
-                    }
-                    else if (geomType == MVT::Point)
-                    {
-                        geometry = decodePoint(feature, key, layer.extent());
-
-                        // This is a bit of a hack, but if a point is outside of the extents we remove it.
-                        // Lines and Polygons that extend outside of the tileset we keep though b/c we assume that they are just slightly going outside of the
-                        // extent.  Should probably make this an option somewhere.
-                        if (geometry)
-                        {
-                            if (!key.getExtent().contains(geometry->getBounds().center()))
-                            {
-                                geometry = NULL;
-                            }
-                        }
-                    }
-                    else
-                    {
-                        geometry = decodeLine(feature, key, layer.extent());
-                    }
+            group->runAndWait();
 
-                    if (geometry)
-                    {
-                        oeFeature->setGeometry( geometry.get() );
-                        features.push_back(oeFeature.get());                     
-                    }
-                    
-                }
+            for (unsigned i = 0; i < group->_features.size(); ++i)
+            {
+                features.splice(features.end(), group->_features[i]);
             }
         }
         else
         {
-            OE_WARN << "Failed to parse mvt" << key.str() << std::endl;
-            return false;
+            for (int i = 0; i < tile->layers_size(); i++)
+            {
+                readLayer(tile->layers(i), key, features);
+            }
         }
 
         return true;
@@ -19,6 +19,7 @@
 #include <osgEarth/Map>
 #include <osgEarth/MapModelChange>
 #include <osgEarth/Registry>
+#include <osgEarth/JobArena>
 
 using namespace osgEarth;
 
@@ -44,6 +45,78 @@ void Map::LayerCB::onClose(Layer* layer)
 
 //...................................................................
 
+namespace
+{
+    /**
+     * Opens a set of layers at once. Opening a layer often means a network
+     * round trip (capabilities documents, service metadata) so the layers
+     * are claimed one at a time by the calling thread and a few helpers.
+     * Nothing here depends on another layer being open; references between
+     * layers are resolved later, in addedToMap(), in map order.
+     */
+    struct OpenLayersGroup : public osg::Referenced
+    {
+        OpenLayersGroup(const LayerVector& layers) :
+            _layers(layers), _next(0u), _remaining(layers.size()) { }
+
+        void run()
+        {
+            for (;;)
+            {
+                unsigned n = (++_next) - 1u;
+                if (n >= _layers.size())
+                    break;
+
+                if (_layers[n].valid())
+                {
+                    _layers[n]->open();
+                }
+
+                if (--_remaining == 0u)
+                    _done.set();
+            }
+        }
+
+        void runAndWait(unsigned numThreads)
+        {
+            if (_layers.empty())
+                return;
+
+            numThreads = osg::maximum(numThreads, 1u);
+
+            JobArena* arena = JobArena::get("oe.layeropen");
+            arena->setConcurrency(numThreads);
+
+            unsigned numHelpers = osg::minimum(numThreads, (unsigned)_layers.size()) - 1u;
+            for (unsigned i = 0; i < numHelpers; ++i)
+            {
+                arena->dispatch(new OpenTask(this));
+            }
+            run();
+            _done.wait();
+        }
+
+        struct OpenTask : public TaskRequest
+        {
+            OpenTask(OpenLayersGroup* group) : _group(group) { }
+
+            void operator()(ProgressCallback*)
+            {
+                _group->run();
+            }
+
+            osg::ref_ptr<OpenLayersGroup> _group;
+        };
+
+        LayerVector _layers;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+    };
+}
+
+//...................................................................
+
 Config
 Map::Options::getConfig() const
 {
@@ -60,6 +133,7 @@ Map::Options::getConfig() const
     conf.set( "elevation_interpolation", "triangulate", elevationInterpolation(), INTERP_TRIANGULATE);
 
     conf.set( "profile_layer", profileLayer() );
+    conf.set( "layer_open_threads", layerOpenThreads() );
 
     return conf;
 }
@@ -68,6 +142,7 @@ void
 Map::Options::fromConfig(const Config& conf)
 {
     elevationInterpolation().init(INTERP_BILINEAR);
+    layerOpenThreads().init(8u);
     
     conf.get( "name",         name() );
     conf.get( "profile",      profile() );
@@ -87,6 +162,7 @@ Map::Options::fromConfig(const Config& conf)
     conf.get( "elevation_interpolation", "triangulate", elevationInterpolation(), INTERP_TRIANGULATE);
 
     conf.get( "profile_layer", profileLayer() );
+    conf.get( "layer_open_threads", layerOpenThreads() );
 }
 
 //...................................................................
@@ -603,9 +679,12 @@ Map::addLayers(const LayerVector& layers)
             continue;
 
         layer->setReadOptions(getReadOptions());
+    }
 
-        // open, but don't call addedToMap(layer) yet.
-        layer->open();
+    // open, but don't call addedToMap(layer) yet.
+    {
+        osg::ref_ptr<OpenLayersGroup> group = new OpenLayersGroup(layers);
+        group->runAndWait(options().layerOpenThreads().get());
     }
 
     unsigned firstIndex;
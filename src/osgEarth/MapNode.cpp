@@ -20,6 +20,7 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarth/MapNode>
+#include <osgEarth/Metrics>
 #include <osgEarth/CascadeDrapingDecorator>
 #include <osgEarth/ClampingTechnique>
 #include <osgEarth/CullingUtils>
@@ -825,6 +826,16 @@ MapNode::traverse( osg::NodeVisitor& nv )
         std::for_each( _children.begin(), _children.end(), osg::NodeAcceptOp(nv) );
     }
 
+    else if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
+    {
+        OE_METRICS_TIMED_SCOPE("frame.update_us");
+
+        // run any async continuations that were routed to the main thread
+        Threading::MainThreadExecutor::instance()->drain();
+
+        osg::Group::traverse( nv );
+    }
+
     else
     {
         if (dynamic_cast<osgUtil::BaseOptimizerVisitor*>(&nv) == 0L)
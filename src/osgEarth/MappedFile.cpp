@@ -0,0 +1,133 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/MappedFile>
+#include <osgEarth/Notify>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#define LC "[MappedFile] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+MappedFile::MappedFile() :
+_data   ( 0L ),
+_size   ( 0u ),
+#ifdef _WIN32
+_file   ( 0L ),
+_mapping( 0L )
+#else
+_fd     ( -1 )
+#endif
+{
+    //nop
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool
+MappedFile::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    _file = file;
+
+    LARGE_INTEGER fileSize;
+    if (!::GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0)
+    {
+        close();
+        return false;
+    }
+
+    _mapping = ::CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping)
+    {
+        _data = (const char*)::MapViewOfFile((HANDLE)_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    _size = (uint64_t)fileSize.QuadPart;
+#else
+    _fd = ::open(path.c_str(), O_RDONLY);
+    if (_fd < 0)
+        return false;
+
+    struct stat st;
+    if (::fstat(_fd, &st) != 0 || st.st_size <= 0)
+    {
+        close();
+        return false;
+    }
+
+    void* data = ::mmap(0L, (size_t)st.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (data != MAP_FAILED)
+    {
+        _data = (const char*)data;
+    }
+    _size = (uint64_t)st.st_size;
+#endif
+
+    if (!_data)
+    {
+        OE_WARN << LC << "Failed to map \"" << path << "\"" << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void
+MappedFile::close()
+{
+#ifdef _WIN32
+    if (_data)
+        ::UnmapViewOfFile(_data);
+    if (_mapping)
+        ::CloseHandle((HANDLE)_mapping);
+    if (_file)
+        ::CloseHandle((HANDLE)_file);
+    _mapping = 0L;
+    _file = 0L;
+#else
+    if (_data)
+        ::munmap((void*)_data, (size_t)_size);
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+#endif
+    _data = 0L;
+    _size = 0u;
+}
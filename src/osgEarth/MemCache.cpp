@@ -17,6 +17,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/MemCache>
+#include <osg/Image>
+#include <osg/Shape>
+#include <list>
+#include <algorithm>
+#include <cstring>
 
 using namespace osgEarth;
 
@@ -31,10 +36,34 @@ namespace
     typedef std::pair<osg::ref_ptr<const osg::Object>, Config> MemCacheEntry;
     typedef LRUCache<std::string, MemCacheEntry> MemCacheLRU;
 
-    struct MemCacheBin : public CacheBin
+    // Base class so MemCache can collect stats from either kind of bin.
+    struct MemCacheBinBase : public CacheBin
+    {
+        MemCacheBinBase(const std::string& id) : CacheBin(id) { }
+
+        ReadResult readImage(const std::string& key, const osgDB::Options* readOptions)
+        {
+            return readObject(key, readOptions);
+        }
+
+        ReadResult readString(const std::string& key, const osgDB::Options* readOptions)
+        {
+            return readObject(key, readOptions);
+        }
+
+        std::string getHashedKey(const std::string& key) const
+        {
+            return key;
+        }
+
+        virtual void getStats(MemCache::Stats& out) const =0;
+    };
+
+    // Bin that caps the number of entries with a single LRU list.
+    struct MemCacheBin : public MemCacheBinBase
     {
         MemCacheBin( const std::string& id, unsigned maxSize )
-            : CacheBin( id ),
+            : MemCacheBinBase( id ),
               _lru    ( true /* MT-safe */, maxSize )
         {
             //nop
@@ -63,16 +92,6 @@ namespace
             }
         }
 
-        ReadResult readImage(const std::string& key, const osgDB::Options* readOptions)
-        {
-            return readObject(key, readOptions);
-        }
-
-        ReadResult readString(const std::string& key, const osgDB::Options* readOptions)
-        {
-            return readObject(key, readOptions);
-        }
-
         bool write( const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
         {
             if ( object ) 
@@ -108,19 +127,379 @@ namespace
             return _lru.has(key) ? STATUS_OK : STATUS_NOT_FOUND;
         }
 
-        bool purge()
+        bool clear()
         {
             _lru.clear();
             return true;
         }
 
-        std::string getHashedKey(const std::string& key) const
+        void getStats(MemCache::Stats& out) const
         {
-            return key;
+            CacheStats stats = _lru.getStats();
+            out._entries = stats._entries;
+            out._maxEntries = stats._maxEntries;
+            out._hits = (unsigned)(stats._hitRatio * (float)stats._queries + 0.5f);
+            out._misses = stats._queries - out._hits;
         }
 
         MemCacheLRU _lru;
     };
+
+    //--------------------------------------------------------------------
+
+    // Estimated memory held by a cache entry.
+    size_t getSizeInBytes(const std::string& key, const osg::Object* object)
+    {
+        // list node, index node, and key
+        size_t bytes = 128u + 2u*key.size();
+
+        const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+        if (image)
+            return bytes + image->getTotalSizeInBytesIncludingMipmaps();
+
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+        if (hf)
+            return bytes + hf->getHeightList().size() * sizeof(float);
+
+        // something small, like a string or a feature
+        return bytes + 1024u;
+    }
+
+    // FNV-1a hash of a cache key
+    unsigned hashKey(const std::string& key)
+    {
+        unsigned hash = 2166136261u;
+        for (std::string::const_iterator c = key.begin(); c != key.end(); ++c)
+        {
+            hash ^= (unsigned char)(*c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // Count-min sketch of 4-bit counters that estimates how often each key
+    // was requested recently. Counters are halved every so often, so the
+    // sketch forgets old history (TinyLFU).
+    class FrequencySketch
+    {
+    public:
+        enum { DEPTH = 4, WIDTH = 1024, WIDTH_BITS = 10, MAX_COUNT = 15 };
+
+        FrequencySketch() : _additions(0u)
+        {
+            ::memset(_counters, 0, sizeof(_counters));
+        }
+
+        void increment(unsigned hash)
+        {
+            for (unsigned d = 0; d < DEPTH; ++d)
+            {
+                unsigned char& counter = _counters[d][index(hash, d)];
+                if (counter < MAX_COUNT)
+                    ++counter;
+            }
+
+            if (++_additions >= 10u * WIDTH)
+                age();
+        }
+
+        unsigned frequency(unsigned hash) const
+        {
+            unsigned result = MAX_COUNT;
+            for (unsigned d = 0; d < DEPTH; ++d)
+                result = std::min(result, (unsigned)_counters[d][index(hash, d)]);
+            return result;
+        }
+
+        void clear()
+        {
+            ::memset(_counters, 0, sizeof(_counters));
+            _additions = 0u;
+        }
+
+    private:
+        unsigned char _counters[DEPTH][WIDTH];
+        unsigned _additions;
+
+        static unsigned index(unsigned hash, unsigned d)
+        {
+            static const unsigned seeds[DEPTH] = { 0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu };
+            return (hash * seeds[d]) >> (32 - WIDTH_BITS);
+        }
+
+        void age()
+        {
+            for (unsigned d = 0; d < DEPTH; ++d)
+                for (unsigned w = 0; w < WIDTH; ++w)
+                    _counters[d][w] >>= 1;
+            _additions /= 2u;
+        }
+    };
+
+    struct BudgetEntry
+    {
+        std::string _key;
+        osg::ref_ptr<const osg::Object> _object;
+        Config _meta;
+        unsigned _hash;
+        size_t _bytes;
+        bool _inWindow;
+    };
+    typedef std::list<BudgetEntry> BudgetEntryList;
+    typedef UnorderedMap<std::string, BudgetEntryList::iterator> BudgetEntryIndex;
+
+    // One independently locked slice of a budgeted bin.
+    //
+    // New entries go into a small "window" LRU, where they can build up
+    // some history. When an entry falls out of the window, it may only move
+    // into the main LRU over the main LRU's eviction victim if the sketch
+    // says it was requested more often than the victim.
+    struct BudgetShard
+    {
+        BudgetShard() : _windowBytes(0u), _mainBytes(0u), _windowBudget(0u), _mainBudget(0u),
+            _hits(0u), _misses(0u), _evictions(0u), _rejections(0u) { }
+
+        mutable Threading::Mutex _mutex;
+        BudgetEntryList  _window;
+        BudgetEntryList  _main;
+        BudgetEntryIndex _index;
+        FrequencySketch  _sketch;
+        size_t _windowBytes, _mainBytes;
+        size_t _windowBudget, _mainBudget;
+        unsigned _hits, _misses, _evictions, _rejections;
+
+        // all called with the mutex held:
+
+        void erase(BudgetEntryList::iterator e)
+        {
+            if (e->_inWindow)
+            {
+                _windowBytes -= e->_bytes;
+                _index.erase(e->_key);
+                _window.erase(e);
+            }
+            else
+            {
+                _mainBytes -= e->_bytes;
+                _index.erase(e->_key);
+                _main.erase(e);
+            }
+        }
+
+        void trimMain()
+        {
+            while (_mainBytes > _mainBudget && !_main.empty())
+            {
+                erase(--_main.end());
+                ++_evictions;
+            }
+        }
+
+        void trimWindow()
+        {
+            // The newest entry always stays in the window.
+            while (_windowBytes > _windowBudget && _window.size() > 1u)
+            {
+                BudgetEntryList::iterator candidate = --_window.end();
+
+                if (_mainBytes + candidate->_bytes > _mainBudget)
+                {
+                    bool admit =
+                        candidate->_bytes <= _mainBudget &&
+                        !_main.empty() &&
+                        _sketch.frequency(candidate->_hash) > _sketch.frequency(_main.back()._hash);
+
+                    if (!admit)
+                    {
+                        erase(candidate);
+                        ++_rejections;
+                        continue;
+                    }
+                }
+
+                _windowBytes -= candidate->_bytes;
+                _mainBytes += candidate->_bytes;
+                candidate->_inWindow = false;
+                _main.splice(_main.begin(), _window, candidate);
+                trimMain();
+            }
+        }
+    };
+
+    // Bin that caps the (estimated) bytes it holds, split into shards so
+    // loader threads rarely contend for the same lock.
+    struct BudgetMemCacheBin : public MemCacheBinBase
+    {
+        BudgetMemCacheBin(const std::string& id, size_t maxBytes) :
+            MemCacheBinBase(id),
+            _maxBytes(maxBytes)
+        {
+            // Give each shard room for a good number of large tiles.
+            _numShards = MAX_SHARDS;
+            while (_numShards > 1u && maxBytes / _numShards < (4u << 20))
+                _numShards >>= 1;
+
+            for (unsigned i = 0; i < _numShards; ++i)
+            {
+                size_t budget = maxBytes / _numShards;
+                _shards[i]._windowBudget = budget / 10u;
+                _shards[i]._mainBudget = budget - _shards[i]._windowBudget;
+            }
+        }
+
+        BudgetShard& shard(unsigned hash)
+        {
+            // low bits pick the shard; the sketch uses the high bits
+            return _shards[hash & (_numShards - 1)];
+        }
+
+        ReadResult readObject(const std::string& key, const osgDB::Options*)
+        {
+            unsigned hash = hashKey(key);
+            BudgetShard& s = shard(hash);
+            Threading::ScopedMutexLock lock(s._mutex);
+
+            s._sketch.increment(hash);
+
+            BudgetEntryIndex::iterator i = s._index.find(key);
+            if (i == s._index.end())
+            {
+                ++s._misses;
+                return ReadResult();
+            }
+
+            ++s._hits;
+            BudgetEntryList::iterator e = i->second;
+            BudgetEntryList& list = e->_inWindow ? s._window : s._main;
+            list.splice(list.begin(), list, e);
+
+            return ReadResult(const_cast<osg::Object*>(e->_object.get()), e->_meta);
+        }
+
+        bool write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options*)
+        {
+            if (!object)
+                return false;
+
+            unsigned hash = hashKey(key);
+            size_t bytes = getSizeInBytes(key, object);
+            BudgetShard& s = shard(hash);
+            Threading::ScopedMutexLock lock(s._mutex);
+
+            BudgetEntryIndex::iterator i = s._index.find(key);
+            if (i != s._index.end())
+            {
+                // replace the value in place:
+                BudgetEntryList::iterator e = i->second;
+                e->_object = object;
+                e->_meta = meta;
+                if (e->_inWindow)
+                {
+                    s._windowBytes += bytes - e->_bytes;
+                    e->_bytes = bytes;
+                    s._window.splice(s._window.begin(), s._window, e);
+                    s.trimWindow();
+                }
+                else
+                {
+                    s._mainBytes += bytes - e->_bytes;
+                    e->_bytes = bytes;
+                    s._main.splice(s._main.begin(), s._main, e);
+                    s.trimMain();
+                }
+                return true;
+            }
+
+            if (bytes > s._windowBudget + s._mainBudget)
+            {
+                ++s._rejections;
+                return false;
+            }
+
+            BudgetEntry entry;
+            entry._key = key;
+            entry._object = object;
+            entry._meta = meta;
+            entry._hash = hash;
+            entry._bytes = bytes;
+            entry._inWindow = true;
+            s._window.push_front(entry);
+            s._index[key] = s._window.begin();
+            s._windowBytes += bytes;
+            s.trimWindow();
+
+            return true;
+        }
+
+        bool remove(const std::string& key)
+        {
+            BudgetShard& s = shard(hashKey(key));
+            Threading::ScopedMutexLock lock(s._mutex);
+            BudgetEntryIndex::iterator i = s._index.find(key);
+            if (i != s._index.end())
+                s.erase(i->second);
+            return true;
+        }
+
+        bool touch(const std::string& key)
+        {
+            BudgetShard& s = shard(hashKey(key));
+            Threading::ScopedMutexLock lock(s._mutex);
+            BudgetEntryIndex::iterator i = s._index.find(key);
+            if (i == s._index.end())
+                return false;
+
+            BudgetEntryList::iterator e = i->second;
+            BudgetEntryList& list = e->_inWindow ? s._window : s._main;
+            list.splice(list.begin(), list, e);
+            return true;
+        }
+
+        RecordStatus getRecordStatus(const std::string& key)
+        {
+            // ignore minTime; MemCache does not support expiration
+            BudgetShard& s = shard(hashKey(key));
+            Threading::ScopedMutexLock lock(s._mutex);
+            return s._index.find(key) != s._index.end() ? STATUS_OK : STATUS_NOT_FOUND;
+        }
+
+        bool clear()
+        {
+            for (unsigned i = 0; i < _numShards; ++i)
+            {
+                BudgetShard& s = _shards[i];
+                Threading::ScopedMutexLock lock(s._mutex);
+                s._index.clear();
+                s._window.clear();
+                s._main.clear();
+                s._sketch.clear();
+                s._windowBytes = 0u;
+                s._mainBytes = 0u;
+            }
+            return true;
+        }
+
+        void getStats(MemCache::Stats& out) const
+        {
+            out._maxBytes = _maxBytes;
+            for (unsigned i = 0; i < _numShards; ++i)
+            {
+                const BudgetShard& s = _shards[i];
+                Threading::ScopedMutexLock lock(s._mutex);
+                out._entries += s._index.size();
+                out._bytes += s._windowBytes + s._mainBytes;
+                out._hits += s._hits;
+                out._misses += s._misses;
+                out._evictions += s._evictions;
+                out._rejections += s._rejections;
+            }
+        }
+
+        enum { MAX_SHARDS = 16 };
+        size_t _maxBytes;
+        unsigned _numShards;
+        BudgetShard _shards[MAX_SHARDS];
+    };
     
 
     static Threading::Mutex s_defaultBinMutex;
@@ -129,15 +508,41 @@ namespace
 //------------------------------------------------------------------------
 
 MemCache::MemCache( unsigned maxBinSize ) :
-_maxBinSize( osg::maximum(maxBinSize, 1u) )
+_maxBinSize( osg::maximum(maxBinSize, 1u) ),
+_maxBinBytes( 0u )
+{
+    Util::MemoryGovernor::instance()->addClient(this, Util::MemoryGovernor::PRIORITY_MEMORY_CACHE);
+}
+
+MemCache::MemCache( unsigned maxBinSize, size_t maxBinBytes ) :
+_maxBinSize( osg::maximum(maxBinSize, 1u) ),
+_maxBinBytes( maxBinBytes )
+{
+    Util::MemoryGovernor::instance()->addClient(this, Util::MemoryGovernor::PRIORITY_MEMORY_CACHE);
+}
+
+MemCache::~MemCache()
+{
+    Util::MemoryGovernor::instance()->removeClient(this);
+}
+
+CacheBin*
+MemCache::createBin(const std::string& binID) const
 {
-    //nop
+    if (_maxBinBytes > 0u)
+        return new BudgetMemCacheBin(binID, _maxBinBytes);
+    else
+        return new MemCacheBin(binID, _maxBinSize);
 }
 
 CacheBin*
 MemCache::addBin( const std::string& binID )
 {
-    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize) );
+    {
+        Threading::ScopedMutexLock lock( _binIDsMutex );
+        _binIDs.insert( binID );
+    }
+    return _bins.getOrCreate( binID, createBin(binID) );
 }
 
 CacheBin*
@@ -158,18 +563,70 @@ MemCache::getOrCreateDefaultBin()
         // double check
         if ( !_defaultBin.valid() )
         {
-            _defaultBin = new MemCacheBin("__default", _maxBinSize);
+            _defaultBin = createBin("__default");
         }
     }
 
     return _defaultBin.get();
 }
 
+bool
+MemCache::clear()
+{
+    if ( _defaultBin.valid() )
+        _defaultBin->clear();
+
+    Threading::ScopedMutexLock lock( _binIDsMutex );
+    for(std::set<std::string>::const_iterator i = _binIDs.begin(); i != _binIDs.end(); ++i)
+    {
+        CacheBin* bin = getBin(*i);
+        if ( bin )
+            bin->clear();
+    }
+    return true;
+}
+
+void
+MemCache::releaseMemory()
+{
+    clear();
+}
+
+bool
+MemCache::getStats(const std::string& binID, Stats& out)
+{
+    MemCacheBinBase* bin = static_cast<MemCacheBinBase*>(getBin(binID));
+    if ( !bin )
+        return false;
+
+    out = Stats();
+    bin->getStats(out);
+    return true;
+}
+
+bool
+MemCache::getDefaultBinStats(Stats& out)
+{
+    if ( !_defaultBin.valid() )
+        return false;
+
+    out = Stats();
+    static_cast<MemCacheBinBase*>(_defaultBin.get())->getStats(out);
+    return true;
+}
 
 void
 MemCache::dumpStats(const std::string& binID)
 {
-    MemCacheBin* bin = static_cast<MemCacheBin*>(getBin(binID));
-    CacheStats stats = bin->_lru.getStats();
-    OE_INFO << LC << "hit ratio = " << stats._hitRatio << std::endl;
+    Stats stats;
+    if ( !getStats(binID, stats) )
+        return;
+
+    OE_INFO << LC << binID
+        << ": entries = " << stats._entries
+        << ", MB = " << (double)stats._bytes / 1048576.0
+        << ", hit ratio = " << stats.getHitRatio()
+        << ", evictions = " << stats._evictions
+        << ", rejections = " << stats._rejections
+        << std::endl;
 }
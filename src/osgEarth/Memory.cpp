@@ -65,7 +65,7 @@ using namespace osgEarth::Util;
  * memory use) measured in bytes, or zero if the value cannot be
  * determined on this OS.
  */
-unsigned
+size_t
 Memory::getProcessPeakPhysicalUsage()
 {
 #if defined(_WIN32)
@@ -110,7 +110,7 @@ Memory::getProcessPeakPhysicalUsage()
  * Returns the current resident set size (physical memory use) measured
  * in bytes, or zero if the value cannot be determined on this OS.
  */
-unsigned
+size_t
 Memory::getProcessPhysicalUsage()
 {
 #if defined(_WIN32)
@@ -140,7 +140,7 @@ Memory::getProcessPhysicalUsage()
         return (size_t)0L;      /* Can't read? */
     }
     fclose( fp );
-    return (unsigned) ((size_t)rss * (size_t)sysconf( _SC_PAGESIZE));
+    return (size_t)rss * (size_t)sysconf( _SC_PAGESIZE);
 
 #else
     /* AIX, BSD, Solaris, and Unknown OS ------------------------ */
@@ -148,7 +148,7 @@ Memory::getProcessPhysicalUsage()
 #endif
 }
 
-unsigned
+size_t
 Memory::getProcessPrivateUsage()
 {
 #if defined(_WIN32)
@@ -162,7 +162,7 @@ Memory::getProcessPrivateUsage()
 }
 
 
-unsigned
+size_t
 Memory::getProcessPeakPrivateUsage()
 {
 #if defined(_WIN32)
@@ -0,0 +1,171 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/MemoryGovernor>
+#include <osgEarth/Memory>
+#include <osgEarth/Metrics>
+#include <osgEarth/StringUtils>
+#include <osgEarth/Notify>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[MemoryGovernor] "
+
+// how often getPressure() samples the process memory usage
+#define UPDATE_INTERVAL_S 0.5
+
+MemoryGovernor*
+MemoryGovernor::instance()
+{
+    static Threading::Mutex s_mutex;
+    static osg::ref_ptr<MemoryGovernor> s_instance;
+
+    Threading::ScopedMutexLock lock(s_mutex);
+    if (!s_instance.valid())
+    {
+        s_instance = new MemoryGovernor();
+    }
+    return s_instance.get();
+}
+
+MemoryGovernor::MemoryGovernor() :
+_budgetMB(0u),
+_pressure((unsigned)PRESSURE_NONE),
+_lastUpdate(0)
+{
+    const char* value = ::getenv("OSGEARTH_MEMORY_BUDGET_MB");
+    if (value)
+    {
+        _budgetMB = as<unsigned>(value, 0u);
+        if (_budgetMB > 0u)
+        {
+            OE_INFO << LC << "Memory budget = " << _budgetMB << " MB" << std::endl;
+        }
+    }
+}
+
+void
+MemoryGovernor::setBudgetMB(unsigned value)
+{
+    _budgetMB = value;
+}
+
+void
+MemoryGovernor::addClient(Client* client, int priority)
+{
+    if (client)
+    {
+        Threading::ScopedMutexLock lock(_clientsMutex);
+        Entry entry;
+        entry._client = client;
+        entry._priority = priority;
+        _clients.insert(std::upper_bound(_clients.begin(), _clients.end(), entry), entry);
+    }
+}
+
+void
+MemoryGovernor::removeClient(Client* client)
+{
+    Threading::ScopedMutexLock lock(_clientsMutex);
+    for (std::vector<Entry>::iterator i = _clients.begin(); i != _clients.end(); ++i)
+    {
+        if (i->_client == client)
+        {
+            _clients.erase(i);
+            break;
+        }
+    }
+}
+
+MemoryGovernor::Pressure
+MemoryGovernor::computePressure() const
+{
+    if (_budgetMB == 0u)
+        return PRESSURE_NONE;
+
+    double usageMB = (double)Memory::getProcessPhysicalUsage() / 1048576.0;
+    double ratio = usageMB / (double)_budgetMB;
+
+    OE_METRICS_GAUGE("memory.budget_percent", (long long)(ratio * 100.0));
+
+    return
+        ratio >= 1.0  ? PRESSURE_CRITICAL :
+        ratio >= 0.9  ? PRESSURE_HIGH :
+        ratio >= 0.75 ? PRESSURE_MODERATE :
+        PRESSURE_NONE;
+}
+
+MemoryGovernor::Pressure
+MemoryGovernor::getPressure()
+{
+    if (_budgetMB == 0u)
+        return PRESSURE_NONE;
+
+    // only one thread samples and relieves at a time; the others
+    // use the last known level.
+    if (_updateMutex.trylock() != 0)
+        return (Pressure)(unsigned)_pressure;
+
+    const osg::Timer* timer = osg::Timer::instance();
+    if (timer->delta_s(_lastUpdate, timer->tick()) >= UPDATE_INTERVAL_S)
+    {
+        relieve();
+    }
+
+    _updateMutex.unlock();
+    return (Pressure)(unsigned)_pressure;
+}
+
+MemoryGovernor::Pressure
+MemoryGovernor::update()
+{
+    Threading::ScopedMutexLock lock(_updateMutex);
+    relieve();
+    return (Pressure)(unsigned)_pressure;
+}
+
+void
+MemoryGovernor::relieve()
+{
+    _lastUpdate = osg::Timer::instance()->tick();
+
+    Pressure pressure = computePressure();
+
+    if (pressure >= PRESSURE_HIGH)
+    {
+        Threading::ScopedMutexLock lock(_clientsMutex);
+
+        // Ask each client in turn, stopping as soon as we are back
+        // under the high-water mark.
+        for (unsigned i = 0; i < _clients.size() && pressure >= PRESSURE_HIGH; ++i)
+        {
+            _clients[i]._client->releaseMemory();
+            pressure = computePressure();
+        }
+
+        OE_DEBUG << LC << "Relieved memory pressure; level is now " << (int)pressure << std::endl;
+    }
+
+    _pressure.exchange((unsigned)pressure);
+}
@@ -27,6 +27,7 @@
 #include <osg/Version>
 #include <osgDB/WriteFile>
 #include <osgUtil/MeshOptimizers>
+#include <algorithm>
 #include <limits>
 #include <map>
 #include <iterator>
@@ -63,27 +64,6 @@ namespace
         }
     };
 
-    template<typename FROM, typename TO>
-    osg::PrimitiveSet* copy( FROM* src, unsigned offset )
-    {
-        TO* newDE = new TO( src->getMode() );
-        newDE->reserve( src->size() );
-        for( typename FROM::const_iterator i = src->begin(); i != src->end(); ++i )
-            newDE->push_back( (*i) + offset );
-        return newDE;
-    }
-
-    template<typename FROM>
-    osg::PrimitiveSet* remake( FROM* src, unsigned numVerts, unsigned offset )
-    {
-        if ( numVerts < 0x100 )
-            return copy<FROM,osg::DrawElementsUByte>( src, offset );
-        else if ( numVerts < 0x10000 )
-            return copy<FROM,osg::DrawElementsUShort>( src, offset );
-        else
-            return copy<FROM,osg::DrawElementsUInt>( src, offset );
-    }
-
     template<typename TYPE>
     osg::Array* convertToBindPerVertex( TYPE* src, unsigned int numVerts)
     {
@@ -212,23 +192,6 @@ namespace
         }
     }
 
-    osg::PrimitiveSet* convertDAtoDE( osg::DrawArrays* da, unsigned numVerts, unsigned offset )
-    {
-        osg::DrawElements* de = 0L;
-        if ( numVerts < 0x100 )
-            de = new osg::DrawElementsUByte( da->getMode() );
-        else if ( numVerts < 0x10000 )
-            de = new osg::DrawElementsUShort( da->getMode() );
-        else
-            de = new osg::DrawElementsUInt( da->getMode() );
-
-        de->reserveElements( da->getCount() );
-        for( GLsizei i=0; i<da->getCount(); ++i )
-            de->addElement( offset + da->getFirst() + i );
-
-        return de;
-    }
-
     bool canOptimize( osg::Geometry& geom )
     {
         osg::Vec3Array* vertexArray = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
@@ -382,340 +345,745 @@ MeshConsolidator::convertToTriangles( osg::Geometry& geom, bool force )
     geom.setPrimitiveSetList( nonTriSets );
 }
 
-typedef std::vector<osg::ref_ptr<osg::Drawable> > DrawableList;
-
 namespace
 {
-    void merge( 
-        DrawableList::iterator&       start, 
-        DrawableList::iterator&       end,
-        unsigned                      numVerts,
-        unsigned                      numColors,
-        unsigned                      numNormals,
-        const std::vector<unsigned>&  texCoordArrayUnits,
-        bool                          useVBOs,
-        DrawableList&                 results )
+    // Vertex cache size the triangle order targets. Most GPUs since the
+    // days of fixed-size FIFOs behave at least this well.
+    const unsigned VERTEX_CACHE_SIZE = 16u;
+
+    // Fewest triangles in a cluster reordered for overdraw. Smaller
+    // clusters would cost more in vertex cache misses than they save.
+    const unsigned MIN_CLUSTER_SIZE = 64u;
+
+    // Indices of one primitive set in a merged batch.
+    struct Primitives
     {
-        osg::Array::Binding newColorsBinding, newNormalsBinding;
+        Primitives(GLenum mode, osg::Referenced* userData) : _mode(mode), _userData(userData) { }
+        GLenum                        _mode;
+        osg::ref_ptr<osg::Referenced> _userData;
+        std::vector<unsigned>         _indices;
+    };
 
-        osg::Vec3Array* newVerts = new osg::Vec3Array();
-        newVerts->reserve( numVerts );
+    // Vertex data and primitives of one merged batch.
+    struct Batch
+    {
+        osg::ref_ptr<osg::Vec3Array> _verts;
+        osg::ref_ptr<osg::Vec4Array> _colors;
+        osg::ref_ptr<osg::Vec3Array> _normals;
+        std::vector< osg::ref_ptr<osg::Array> > _texCoords;
+        std::vector<Primitives> _prims;
 
-        // Determine if we need to use 3D texture coordinates or not.
-        bool use3DTextureCoords = false;
-        for( DrawableList::iterator i = start; i != end; ++i )
+        Primitives& getTriangles(osg::Referenced* userData)
         {
-            for( unsigned a=0; a<texCoordArrayUnits.size(); ++a )
-            {
-                unsigned unit = texCoordArrayUnits[a];
+            for(unsigned i = 0; i < _prims.size(); ++i)
+                if (_prims[i]._mode == GL_TRIANGLES && _prims[i]._userData.get() == userData)
+                    return _prims[i];
+            _prims.push_back(Primitives(GL_TRIANGLES, userData));
+            return _prims.back();
+        }
+    };
 
-                osg::Vec3Array* texCoords = dynamic_cast<osg::Vec3Array*>(i->get()->asGeometry()->getTexCoordArray( unit ));
-                if (texCoords)
-                {
-                    use3DTextureCoords = true;
-                    break;
-                }
+    struct TriangleCollector
+    {
+        TriangleCollector() : _indices(0L), _offset(0u) { }
+
+        void operator()(unsigned i0, unsigned i1, unsigned i2)
+        {
+            if (i0 != i1 && i1 != i2 && i2 != i0)
+            {
+                _indices->push_back(_offset + i0);
+                _indices->push_back(_offset + i1);
+                _indices->push_back(_offset + i2);
             }
+        }
 
-            if (use3DTextureCoords) break;
+        std::vector<unsigned>* _indices;
+        unsigned _offset;
+    };
+
+    bool isSurface(GLenum mode)
+    {
+        return
+            mode == GL_TRIANGLES || mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN ||
+            mode == GL_QUADS || mode == GL_QUAD_STRIP || mode == GL_POLYGON;
+    }
+
+    // Like canOptimize, but leaves the geometry alone so it can be shared.
+    bool canMerge(const osg::Geometry& geom)
+    {
+        if (dynamic_cast<const osg::Vec3Array*>(geom.getVertexArray()) == 0L)
+            return false;
+
+        if (geom.getVertexAttribArrayList().size() > 0)
+            return false;
+
+        const osg::Array* colors = geom.getColorArray();
+        if (colors && (dynamic_cast<const osg::Vec4Array*>(colors) == 0L ||
+            (colors->getBinding() != osg::Array::BIND_PER_VERTEX && colors->getBinding() != osg::Array::BIND_OVERALL)))
+            return false;
+
+        const osg::Array* normals = geom.getNormalArray();
+        if (normals && (dynamic_cast<const osg::Vec3Array*>(normals) == 0L ||
+            (normals->getBinding() != osg::Array::BIND_PER_VERTEX && normals->getBinding() != osg::Array::BIND_OVERALL)))
+            return false;
+
+        for(unsigned u = 0; u < geom.getNumTexCoordArrays(); ++u)
+        {
+            const osg::Array* tc = geom.getTexCoordArray(u);
+            if (tc && dynamic_cast<const osg::Vec2Array*>(tc) == 0L && dynamic_cast<const osg::Vec3Array*>(tc) == 0L)
+                return false;
         }
 
+        return true;
+    }
+
+    // Appends one geometry's vertex data and primitives to a batch.
+    void append(const MeshConsolidator::TransformedGeometry& input, bool keepUserData, Batch& batch)
+    {
+        const osg::Geometry& geom = *input._geometry.get();
+        const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(geom.getVertexArray());
+        unsigned count = verts->size();
+        unsigned offset = batch._verts->size();
 
-        osg::Vec4Array* newColors =0L;
-        if ( numColors > 0 )
+        if (input._transform)
         {
-            newColors = new osg::Vec4Array();
-            newColors->reserve( numVerts );
-            newColorsBinding = osg::Array::BIND_PER_VERTEX;
+            for(unsigned i = 0; i < count; ++i)
+                batch._verts->push_back((*verts)[i] * input._matrix);
+        }
+        else
+        {
+            batch._verts->insert(batch._verts->end(), verts->begin(), verts->end());
         }
 
-        osg::Vec3Array* newNormals =0L;
-        if ( numNormals > 0 )
+        // Overall bindings and missing arrays become per-vertex, since other
+        // geometries in the batch may have per-vertex data.
+        if (batch._colors.valid())
         {
-            newNormals = new osg::Vec3Array();
-            newNormals->reserve( numVerts );
-            newNormalsBinding = osg::Array::BIND_PER_VERTEX;
+            const osg::Vec4Array* colors = static_cast<const osg::Vec4Array*>(geom.getColorArray());
+            if (colors && colors->getBinding() == osg::Array::BIND_PER_VERTEX && colors->size() >= count)
+                batch._colors->insert(batch._colors->end(), colors->begin(), colors->begin() + count);
+            else
+                batch._colors->insert(batch._colors->end(), count, colors && !colors->empty() ? colors->front() : osg::Vec4(1,1,1,1));
         }
 
-        std::vector<osg::Array*> newTexCoordsArrays;
-        for( unsigned i=0; i<texCoordArrayUnits.size(); ++i )
+        if (batch._normals.valid())
         {
-            osg::Array* newTexCoords;
-            if (use3DTextureCoords)
+            const osg::Vec3Array* normals = static_cast<const osg::Vec3Array*>(geom.getNormalArray());
+            bool perVertex = normals && normals->getBinding() == osg::Array::BIND_PER_VERTEX && normals->size() >= count;
+            osg::Vec3 overall = normals && !normals->empty() ? normals->front() : osg::Vec3(0,0,1);
+
+            if (input._transform)
             {
-                osg::Vec3Array* texCoords3D = new osg::Vec3Array;
-                texCoords3D->reserve( numVerts );
-                newTexCoords = texCoords3D;                                    
+                // normals transform by the inverse transpose
+                osg::Matrixd inverse = osg::Matrixd::inverse(input._matrix);
+                for(unsigned i = 0; i < count; ++i)
+                {
+                    osg::Vec3 n = osg::Matrixd::transform3x3(inverse, perVertex ? (*normals)[i] : overall);
+                    n.normalize();
+                    batch._normals->push_back(n);
+                }
+            }
+            else if (perVertex)
+            {
+                batch._normals->insert(batch._normals->end(), normals->begin(), normals->begin() + count);
             }
             else
             {
-                osg::Vec2Array* texCoords2D = new osg::Vec2Array;
-                texCoords2D->reserve( numVerts );
-                newTexCoords = texCoords2D;                                    
-            }                        
-            newTexCoordsArrays.push_back( newTexCoords );
+                batch._normals->insert(batch._normals->end(), count, overall);
+            }
         }
 
-        unsigned offset = 0;
-        osg::Geometry::PrimitiveSetList newPrimSets;
+        for(unsigned a = 0; a < batch._texCoords.size(); ++a)
+        {
+            const osg::Array* src = geom.getTexCoordArray(a);
+            const osg::Vec2Array* src2 = dynamic_cast<const osg::Vec2Array*>(src);
+            const osg::Vec3Array* src3 = dynamic_cast<const osg::Vec3Array*>(src);
 
-        std::vector<osg::ref_ptr<osg::Geometry> > nonOptimizedGeoms;
+            osg::Vec2Array* out2 = dynamic_cast<osg::Vec2Array*>(batch._texCoords[a].get());
+            osg::Vec3Array* out3 = dynamic_cast<osg::Vec3Array*>(batch._texCoords[a].get());
 
-        osg::StateSet* unifiedStateSet = 0L;
+            for(unsigned i = 0; i < count; ++i)
+            {
+                if (out2)
+                    out2->push_back(src2 && i < src2->size() ? (*src2)[i] : osg::Vec2(0,0));
+                else if (out3 && src3 && i < src3->size())
+                    out3->push_back((*src3)[i]);
+                else if (out3)
+                    out3->push_back(src2 && i < src2->size() ? osg::Vec3((*src2)[i], 0.0f) : osg::Vec3(0,0,0));
+            }
+        }
 
-        for( DrawableList::iterator i = start; i != end; ++i )
+        // all the surface primitives go into one set of triangles (per user data);
+        // everything else is copied as-is.
+        for(unsigned j = 0; j < geom.getNumPrimitiveSets(); ++j)
         {
-            osg::Geometry* geom = i->get()->asGeometry(); //geode.getDrawable(i)->asGeometry();
+            const osg::PrimitiveSet* pset = geom.getPrimitiveSet(j);
+            osg::Referenced* userData = keepUserData ? const_cast<osg::Referenced*>(pset->getUserData()) : 0L;
 
-            // merge in the stateset:
-            if ( unifiedStateSet == 0L )
-                unifiedStateSet = geom->getStateSet();
-            else if ( geom->getStateSet() )
-                unifiedStateSet->merge( *geom->getStateSet() );            
+            if (isSurface(pset->getMode()))
+            {
+                osg::TriangleIndexFunctor<TriangleCollector> collector;
+                collector._indices = &batch.getTriangles(userData)._indices;
+                collector._offset = offset;
+                pset->accept(collector);
+            }
+            else if (pset->getType() == osg::PrimitiveSet::DrawArrayLengthsPrimitiveType)
+            {
+                const osg::DrawArrayLengths* dal = static_cast<const osg::DrawArrayLengths*>(pset);
+                unsigned first = dal->getFirst();
+                for(osg::DrawArrayLengths::const_iterator k = dal->begin(); k != dal->end(); ++k)
+                {
+                    batch._prims.push_back(Primitives(pset->getMode(), userData));
+                    for(GLint i = 0; i < *k; ++i)
+                        batch._prims.back()._indices.push_back(offset + first + i);
+                    first += *k;
+                }
+            }
+            else
+            {
+                batch._prims.push_back(Primitives(pset->getMode(), userData));
+                std::vector<unsigned>& indices = batch._prims.back()._indices;
+                indices.reserve(pset->getNumIndices());
+                for(unsigned i = 0; i < pset->getNumIndices(); ++i)
+                    indices.push_back(offset + pset->index(i));
+            }
+        }
+    }
 
-            // copy over the verts:
-            osg::Vec3Array* geomVerts = dynamic_cast<osg::Vec3Array*>( geom->getVertexArray() );
-            if ( geomVerts )
+    // Orders vertices so identical ones (in every attribute) are adjacent
+    struct VertexLess
+    {
+        VertexLess(const std::vector<const osg::Array*>& arrays) : _arrays(arrays) { }
+
+        bool operator()(unsigned lhs, unsigned rhs) const
+        {
+            for(unsigned a = 0; a < _arrays.size(); ++a)
             {
-                std::copy( geomVerts->begin(), geomVerts->end(), std::back_inserter(*newVerts) );
+                int c = _arrays[a]->compare(lhs, rhs);
+                if (c != 0)
+                    return c < 0;
+            }
+            return false;
+        }
+
+        const std::vector<const osg::Array*>& _arrays;
+    };
+
+    /**
+     * Reorders triangles for the post-transform vertex cache using Tipsify
+     * (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+     * Locality and Reduced Overdraw", SIGGRAPH 2007). Also returns the
+     * triangles where the walk hit a dead end and had to jump elsewhere in
+     * the mesh; those split the output into clusters for sortClusters.
+     */
+    void tipsify(
+        const std::vector<unsigned>& input,
+        unsigned                     numVerts,
+        std::vector<unsigned>&       output,
+        std::vector<unsigned>&       clusters)
+    {
+        unsigned numTris = input.size() / 3u;
+
+        // triangles using each vertex
+        std::vector<unsigned> offsets(numVerts + 1u, 0u);
+        for(unsigned i = 0; i < input.size(); ++i)
+            ++offsets[input[i] + 1u];
+        for(unsigned v = 0; v < numVerts; ++v)
+            offsets[v + 1u] += offsets[v];
+
+        std::vector<unsigned> adjacency(input.size());
+        std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+        for(unsigned i = 0; i < input.size(); ++i)
+            adjacency[fill[input[i]]++] = i / 3u;
+
+        // triangles not yet emitted that use each vertex
+        std::vector<unsigned> live(numVerts);
+        for(unsigned v = 0; v < numVerts; ++v)
+            live[v] = offsets[v + 1u] - offsets[v];
+
+        std::vector<unsigned> cacheTime(numVerts, 0u);
+        std::vector<bool> emitted(numTris, false);
+        std::vector<unsigned> deadEnd;
+        std::vector<unsigned> candidates;
+        deadEnd.reserve(input.size());
+
+        output.clear();
+        output.reserve(input.size());
+        clusters.clear();
+        clusters.push_back(0u);
+
+        unsigned time = VERTEX_CACHE_SIZE + 1u;
+        unsigned cursor = 0u;
+
+        int fan = input.empty() ? -1 : (int)input[0];
+        while (fan >= 0)
+        {
+            // emit every remaining triangle around the fanning vertex
+            candidates.clear();
+            for(unsigned a = offsets[fan]; a < offsets[fan + 1]; ++a)
+            {
+                unsigned t = adjacency[a];
+                if (emitted[t])
+                    continue;
 
-                if ( newColors )
+                for(unsigned k = 0; k < 3u; ++k)
                 {
-                    osg::Vec4Array* colors = dynamic_cast<osg::Vec4Array*>( geom->getColorArray() );
-                    if ( colors )
-                    {
-                        if ( newColorsBinding == osg::Array::BIND_PER_VERTEX )
-                        {
-                            std::copy( colors->begin(), colors->end(), std::back_inserter(*newColors) );
-                        }
-                        else if ( i == start ) //i == 0 ) // overall
-                        {
-                            newColors->push_back( (*colors)[0] );
-                        }
-                    }
+                    unsigned v = input[3u*t + k];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (time - cacheTime[v] > VERTEX_CACHE_SIZE)
+                        cacheTime[v] = time++;
                 }
+                emitted[t] = true;
+            }
 
-                if ( newNormals )
+            // next, the candidate that will still be in the cache after its
+            // remaining triangles are emitted, preferring the oldest
+            int next = -1;
+            int best = -1;
+            for(unsigned c = 0; c < candidates.size(); ++c)
+            {
+                unsigned v = candidates[c];
+                if (live[v] > 0u)
                 {
-                    osg::Vec3Array* normals = dynamic_cast<osg::Vec3Array*>( geom->getNormalArray() );
-                    if ( normals )
+                    int priority = 0;
+                    if (time - cacheTime[v] + 2u*live[v] <= VERTEX_CACHE_SIZE)
+                        priority = (int)(time - cacheTime[v]);
+                    if (priority > best)
                     {
-                        if ( newNormalsBinding == osg::Array::BIND_PER_VERTEX )
-                        {
-                            std::copy( normals->begin(), normals->end(), std::back_inserter(*newNormals) );
-                        }
-                        else if ( i == start ) //0 ) // overall
-                        {
-                            newNormals->push_back( (*normals)[0] );
-                        }
+                        best = priority;
+                        next = (int)v;
                     }
                 }
+            }
 
-                if ( newTexCoordsArrays.size() > 0 )
+            if (next < 0)
+            {
+                // dead end: back up through the recent vertices, and failing
+                // that, scan for any vertex with triangles left.
+                while (next < 0 && !deadEnd.empty())
                 {
-                    for( unsigned a=0; a<texCoordArrayUnits.size(); ++a )
-                    {
-                        unsigned unit = texCoordArrayUnits[a];
-
-                        // We are just using 2D texture coordinates so only check for the 2D case
-                        if (!use3DTextureCoords)
-                        {
-                            osg::Vec2Array* texCoords2D = dynamic_cast<osg::Vec2Array*>( geom->getTexCoordArray(unit) );
-                            if (texCoords2D)
-                            {
-                                osg::Vec2Array* newTexCoords = static_cast< osg::Vec2Array*>( newTexCoordsArrays[a] );
-                                std::copy( texCoords2D->begin(), texCoords2D->end(), std::back_inserter(*newTexCoords) );
-                            }                                                           
-                        }
-                        else
-                        {
-                            // We are using 3D coordinates, so check for both 2D and 3D coordinates.  We will consolidate them all into 3D coordinates.
-                            osg::Vec2Array* texCoords2D = dynamic_cast<osg::Vec2Array*>( geom->getTexCoordArray(unit) );
-                            osg::Vec3Array* texCoords3D = dynamic_cast<osg::Vec3Array*>( geom->getTexCoordArray(unit) );
-                            if (texCoords2D || texCoords3D)
-                            {
-                                osg::Vec3Array* newTexCoords = static_cast< osg::Vec3Array*>( newTexCoordsArrays[a] );
-                                if (texCoords3D)
-                                {
-                                    std::copy( texCoords3D->begin(), texCoords3D->end(), std::back_inserter(*newTexCoords) );
-                                }
-                                else
-                                {
-                                    // Convert 2D to 3D coords
-                                    for (osg::Vec2Array::iterator itr = texCoords2D->begin(); itr != texCoords2D->end(); ++itr)
-                                    {                                        
-                                        newTexCoords->push_back( osg::Vec3(itr->x(), itr->y(), 0) );
-                                    }
-                                }
-                            }
-                        }                                                
-                    }
+                    unsigned v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (live[v] > 0u)
+                        next = (int)v;
+                }
+                while (next < 0 && cursor < numVerts)
+                {
+                    if (live[cursor] > 0u)
+                        next = (int)cursor;
+                    else
+                        ++cursor;
                 }
 
-                osg::ref_ptr<osg::Referenced> sharedUserData;
+                unsigned emittedTris = output.size() / 3u;
+                if (next >= 0 && emittedTris - clusters.back() >= MIN_CLUSTER_SIZE)
+                    clusters.push_back(emittedTris);
+            }
+
+            fan = next;
+        }
+    }
+
+    struct Cluster
+    {
+        unsigned _begin, _end; // triangles
+        float    _sortKey;
+        bool operator < (const Cluster& rhs) const { return _sortKey > rhs._sortKey; }
+    };
+
+    /**
+     * Reorders clusters of triangles so those facing out from the middle of
+     * the mesh draw first; they are the most likely to occlude the others,
+     * which then fail the depth test before shading. Order within each
+     * cluster (and so most of the vertex cache locality) is kept.
+     */
+    void sortClusters(
+        std::vector<unsigned>&       indices,
+        const std::vector<unsigned>& clusters,
+        const osg::Vec3Array&        verts)
+    {
+        if (clusters.size() < 2u)
+            return;
+
+        unsigned numTris = indices.size() / 3u;
 
-                for( unsigned j=0; j < geom->getNumPrimitiveSets(); ++j )
+        osg::Vec3d meshCenter;
+        for(unsigned i = 0; i < indices.size(); ++i)
+            meshCenter += osg::Vec3d(verts[indices[i]]);
+        meshCenter /= (double)indices.size();
+
+        std::vector<Cluster> sorted(clusters.size());
+        for(unsigned c = 0; c < clusters.size(); ++c)
+        {
+            Cluster& cluster = sorted[c];
+            cluster._begin = clusters[c];
+            cluster._end = c+1 < clusters.size() ? clusters[c+1] : numTris;
+
+            // area-weighted center and normal
+            osg::Vec3d center, normal;
+            double area = 0.0;
+            for(unsigned t = cluster._begin; t < cluster._end; ++t)
+            {
+                const osg::Vec3& v0 = verts[indices[3*t]];
+                const osg::Vec3& v1 = verts[indices[3*t+1]];
+                const osg::Vec3& v2 = verts[indices[3*t+2]];
+                osg::Vec3d n = (v1 - v0) ^ (v2 - v0);
+                double a = n.length();
+                center += osg::Vec3d(v0 + v1 + v2) * (a / 3.0);
+                normal += n;
+                area += a;
+            }
+
+            if (area > 0.0)
+                center /= area;
+            normal.normalize();
+
+            cluster._sortKey = (float)((center - meshCenter) * normal);
+        }
+
+        std::stable_sort(sorted.begin(), sorted.end());
+
+        std::vector<unsigned> output;
+        output.reserve(indices.size());
+        for(unsigned c = 0; c < sorted.size(); ++c)
+        {
+            output.insert(output.end(),
+                indices.begin() + 3u*sorted[c]._begin,
+                indices.begin() + 3u*sorted[c]._end);
+        }
+        indices.swap(output);
+    }
+
+    template<typename T>
+    T* reorder(const T* src, const std::vector<unsigned>& order)
+    {
+        T* result = new T();
+        result->setBinding(osg::Array::BIND_PER_VERTEX);
+        result->reserve(order.size());
+        for(unsigned i = 0; i < order.size(); ++i)
+            result->push_back((*src)[order[i]]);
+        return result;
+    }
+
+    osg::Array* reorderTexCoords(const osg::Array* src, const std::vector<unsigned>& order)
+    {
+        if (dynamic_cast<const osg::Vec3Array*>(src))
+            return reorder(static_cast<const osg::Vec3Array*>(src), order);
+        else
+            return reorder(static_cast<const osg::Vec2Array*>(src), order);
+    }
+
+    template<typename T>
+    osg::DrawElements* makeDrawElements(const Primitives& prims)
+    {
+        T* de = new T(prims._mode);
+        de->reserve(prims._indices.size());
+        for(unsigned i = 0; i < prims._indices.size(); ++i)
+            de->push_back(prims._indices[i]);
+        de->setUserData(prims._userData.get());
+        return de;
+    }
+
+    /**
+     * Welds identical vertices, reorders the triangles for the vertex cache
+     * and then for overdraw, reorders the vertices to match, and builds
+     * the geometry with the narrowest indices that fit.
+     */
+    osg::Geometry* build(Batch& batch)
+    {
+        unsigned numVerts = batch._verts->size();
+
+        // weld vertices that match in every attribute.
+        std::vector<const osg::Array*> arrays;
+        arrays.push_back(batch._verts.get());
+        if (batch._colors.valid())
+            arrays.push_back(batch._colors.get());
+        if (batch._normals.valid())
+            arrays.push_back(batch._normals.get());
+        for(unsigned a = 0; a < batch._texCoords.size(); ++a)
+            if (batch._texCoords[a].valid())
+                arrays.push_back(batch._texCoords[a].get());
+
+        std::vector<unsigned> order(numVerts);
+        for(unsigned i = 0; i < numVerts; ++i)
+            order[i] = i;
+
+        VertexLess less(arrays);
+        std::sort(order.begin(), order.end(), less);
+
+        std::vector<unsigned> weld(numVerts);
+        for(unsigned i = 0; i < numVerts; ++i)
+        {
+            weld[order[i]] = (i > 0 && !less(order[i-1], order[i])) ? weld[order[i-1]] : order[i];
+        }
+
+        for(unsigned p = 0; p < batch._prims.size(); ++p)
+        {
+            std::vector<unsigned>& indices = batch._prims[p]._indices;
+            for(unsigned i = 0; i < indices.size(); ++i)
+                indices[i] = weld[indices[i]];
+
+            if (batch._prims[p]._mode == GL_TRIANGLES)
+            {
+                // welding can make some triangles degenerate
+                unsigned n = 0;
+                for(unsigned t = 0; t + 2 < indices.size(); t += 3)
                 {
-                    osg::PrimitiveSet* pset = geom->getPrimitiveSet(j);
-                    osg::PrimitiveSet* newpset = 0L;
-
-                    // all primsets have the same user data (or else we would not have made it this far
-                    // since canOptimize would be false)
-                    if ( !sharedUserData.valid() )
-                        sharedUserData = pset->getUserData();
-
-                    if ( dynamic_cast<osg::DrawElementsUByte*>(pset) )
-                        newpset = remake( static_cast<osg::DrawElementsUByte*>(pset), numVerts, offset );
-                    else if ( dynamic_cast<osg::DrawElementsUShort*>(pset) )
-                        newpset = remake( static_cast<osg::DrawElementsUShort*>(pset), numVerts, offset );
-                    else if ( dynamic_cast<osg::DrawElementsUInt*>(pset) )
-                        newpset = remake( static_cast<osg::DrawElementsUInt*>(pset), numVerts, offset );
-                    else if ( dynamic_cast<osg::DrawArrays*>(pset) )
-                        newpset = convertDAtoDE( static_cast<osg::DrawArrays*>(pset), numVerts, offset );
-
-                    if ( newpset )
+                    if (indices[t] != indices[t+1] && indices[t+1] != indices[t+2] && indices[t+2] != indices[t])
                     {
-                        newpset->setUserData( sharedUserData.get() );
-
-                        newPrimSets.push_back( newpset );
+                        indices[n++] = indices[t];
+                        indices[n++] = indices[t+1];
+                        indices[n++] = indices[t+2];
                     }
                 }
+                indices.resize(n);
 
-                offset += geomVerts->size();
+                std::vector<unsigned> optimized, clusters;
+                tipsify(indices, numVerts, optimized, clusters);
+                sortClusters(optimized, clusters, *batch._verts.get());
+                indices.swap(optimized);
             }
         }
 
-        // assemble the new geometry.
-        osg::Geometry* newGeom = new osg::Geometry();
-        newGeom->setUseVertexBufferObjects(true);
-
-        newGeom->setVertexArray( newVerts );
-
-        if ( newColors )
+        // number the vertices in the order the primitives first use them.
+        std::vector<unsigned> remap(numVerts, ~0u);
+        std::vector<unsigned> fetchOrder;
+        fetchOrder.reserve(numVerts);
+        for(unsigned p = 0; p < batch._prims.size(); ++p)
         {
-            newColors->setBinding( newColorsBinding );
-            newGeom->setColorArray( newColors );
+            std::vector<unsigned>& indices = batch._prims[p]._indices;
+            for(unsigned i = 0; i < indices.size(); ++i)
+            {
+                unsigned& index = remap[indices[i]];
+                if (index == ~0u)
+                {
+                    index = fetchOrder.size();
+                    fetchOrder.push_back(indices[i]);
+                }
+                indices[i] = index;
+            }
         }
 
-        if ( newNormals )
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setVertexArray(reorder(batch._verts.get(), fetchOrder));
+        if (batch._colors.valid())
+            geom->setColorArray(reorder(batch._colors.get(), fetchOrder));
+        if (batch._normals.valid())
+            geom->setNormalArray(reorder(batch._normals.get(), fetchOrder));
+        for(unsigned a = 0; a < batch._texCoords.size(); ++a)
+            if (batch._texCoords[a].valid())
+                geom->setTexCoordArray(a, reorderTexCoords(batch._texCoords[a].get(), fetchOrder));
+
+        bool shortIndices = fetchOrder.size() <= 0x10000;
+
+        for(unsigned p = 0; p < batch._prims.size(); ++p)
         {
-            newNormals->setBinding(newNormalsBinding);
-            newGeom->setNormalArray( newNormals );
+            if (batch._prims[p]._indices.empty())
+                continue;
+
+            if (shortIndices)
+                geom->addPrimitiveSet(makeDrawElements<osg::DrawElementsUShort>(batch._prims[p]));
+            else
+                geom->addPrimitiveSet(makeDrawElements<osg::DrawElementsUInt>(batch._prims[p]));
         }
 
-        if ( newTexCoordsArrays.size() > 0 )
+        return geom;
+    }
+
+    // Merges a run of geometries into one.
+    osg::Geometry* merge(
+        MeshConsolidator::TransformedGeometryList::const_iterator start,
+        MeshConsolidator::TransformedGeometryList::const_iterator end,
+        unsigned numVerts,
+        bool     keepUserData)
+    {
+        Batch batch;
+        batch._verts = new osg::Vec3Array();
+        batch._verts->reserve(numVerts);
+
+        for(MeshConsolidator::TransformedGeometryList::const_iterator i = start; i != end; ++i)
         {
-            for( unsigned a=0; a<texCoordArrayUnits.size(); ++a )
+            const osg::Geometry* geom = i->_geometry.get();
+
+            if (geom->getColorArray() && !batch._colors.valid())
+                batch._colors = new osg::Vec4Array();
+
+            if (geom->getNormalArray() && !batch._normals.valid())
+                batch._normals = new osg::Vec3Array();
+
+            // Use 3D texture coordinates if any geometry has them.
+            if (batch._texCoords.size() < geom->getNumTexCoordArrays())
+                batch._texCoords.resize(geom->getNumTexCoordArrays());
+
+            for(unsigned u = 0; u < geom->getNumTexCoordArrays(); ++u)
             {
-                unsigned unit = texCoordArrayUnits[a];
-                newGeom->setTexCoordArray( unit, newTexCoordsArrays[a] );
+                const osg::Array* tc = geom->getTexCoordArray(u);
+                if (tc == 0L)
+                    continue;
+
+                if (dynamic_cast<const osg::Vec3Array*>(tc))
+                {
+                    if (!dynamic_cast<osg::Vec3Array*>(batch._texCoords[u].get()))
+                        batch._texCoords[u] = new osg::Vec3Array();
+                }
+                else if (!batch._texCoords[u].valid())
+                {
+                    batch._texCoords[u] = new osg::Vec2Array();
+                }
             }
         }
 
-        newGeom->setPrimitiveSetList( newPrimSets );
-        newGeom->setStateSet( unifiedStateSet );
+        if (batch._colors.valid())
+            batch._colors->reserve(numVerts);
+        if (batch._normals.valid())
+            batch._normals->reserve(numVerts);
+        for(unsigned a = 0; a < batch._texCoords.size(); ++a)
+            if (batch._texCoords[a].valid())
+                batch._texCoords[a]->reserveArray(numVerts);
+
+        for(MeshConsolidator::TransformedGeometryList::const_iterator i = start; i != end; ++i)
+        {
+            append(*i, keepUserData, batch);
+        }
 
-        newGeom->setUseVertexBufferObjects( useVBOs );
-        newGeom->setUseDisplayList( !useVBOs );
+        return build(batch);
+    }
 
-        results.push_back( newGeom );
+    // Splits the input into runs of up to maxVerts vertices and merges each one.
+    void mergeAll(
+        const MeshConsolidator::TransformedGeometryList& input,
+        unsigned maxVerts,
+        bool     keepUserData,
+        std::vector< osg::ref_ptr<osg::Geometry> >& results)
+    {
+#if defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
+        // GLES only supports UShort, not UInt
+        maxVerts = osg::minimum(maxVerts, 0x10000u);
+#endif
 
-        //GeometryValidator().apply( *newGeom );
+        unsigned numVerts = 0;
+        MeshConsolidator::TransformedGeometryList::const_iterator start = input.begin();
+
+        for(MeshConsolidator::TransformedGeometryList::const_iterator i = input.begin(); i != input.end(); ++i)
+        {
+            unsigned geomNumVerts = i->_geometry->getVertexArray()->getNumElements();
+
+            if (i != start && numVerts + geomNumVerts > maxVerts)
+            {
+                OE_DEBUG << LC << "Merging " << ((unsigned)(i-start)) << " geoms with " << numVerts << " verts." << std::endl;
+                osg::ref_ptr<osg::Geometry> geom = merge(start, i, numVerts, keepUserData);
+                if (geom->getNumPrimitiveSets() > 0)
+                    results.push_back(geom.get());
+                start = i;
+                numVerts = 0;
+            }
+
+            numVerts += geomNumVerts;
+        }
+
+        if (start != input.end())
+        {
+            OE_DEBUG << LC << "Merging " << ((unsigned)(input.end()-start)) << " geoms with " << numVerts << " verts." << std::endl;
+            osg::ref_ptr<osg::Geometry> geom = merge(start, input.end(), numVerts, keepUserData);
+            if (geom->getNumPrimitiveSets() > 0)
+                results.push_back(geom.get());
+        }
     }
 }
 
-
 void
 MeshConsolidator::run( osg::Geode& geode )
 {
-    bool useVBOs = false;
-    
+    run( geode, 0x10000 );
+}
+
+void
+MeshConsolidator::run( osg::Geode& geode, unsigned maxVertsPerBatch )
+{
     // NOTE: we'd rather use the IndexMeshVisitor instead of our own code here,
     // but the IMV does not preserve the user data attached to the primitive sets.
     // We need that since it holds the feature index information.
-    //osgUtil::IndexMeshVisitor mesher;
-    //geode.accept(mesher);
 
     // trivial bailout:
     if ( geode.getNumDrawables() <= 1 )
         return;
 
     // list of geometries to consolidate and not to consolidate.
-    DrawableList consolidate, dontConsolidate;
+    TransformedGeometryList consolidate;
+    std::vector< osg::ref_ptr<osg::Drawable> > dontConsolidate;
 
-    // list of texture coordinate array image units in use
-    std::vector<unsigned> texCoordArrayUnits;
-    texCoordArrayUnits.reserve(32);
+    bool useVBOs = false;
+    osg::StateSet* unifiedStateSet = 0L;
 
     // sort the drawables:
     for( unsigned i=0; i<geode.getNumDrawables(); ++i )
     {
         osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
-        if ( geom )
+        if ( geom && canMerge(*geom) )
         {
-            if ( canOptimize(*geom) )
-            {
-                // convert all surface primitives to triangles.
-                convertToTriangles( *geom );
-
-                // NOTE!! tex/attrib array counts much already be equal.
-                if ( texCoordArrayUnits.size() == 0 )
-                {
-                    for( unsigned u=0; u<32; ++u ) {
-                        if ( geom->getTexCoordArray(u) != 0L )
-                            texCoordArrayUnits.push_back( u );
-                    }
+            if ( geom->getUseVertexBufferObjects() )
+                useVBOs = true;
 
-                    if ( geom->getUseVertexBufferObjects() )
-                        useVBOs = true;
-                }
+            // merge in the stateset:
+            if ( unifiedStateSet == 0L )
+                unifiedStateSet = geom->getStateSet();
+            else if ( geom->getStateSet() )
+                unifiedStateSet->merge( *geom->getStateSet() );
 
-                consolidate.push_back(geom);
-            }
-            else
-            {
-                dontConsolidate.push_back(geom);
-            }
+            consolidate.push_back( TransformedGeometry(geom) );
+        }
+        else
+        {
+            dontConsolidate.push_back( geode.getDrawable(i) );
         }
     }
 
-    // start consolidating the geometries.
-    unsigned targetNumVertsPerGeom = 100000; //TODO: configurable?
-    DrawableList results;
+    std::vector< osg::ref_ptr<osg::Geometry> > results;
+    mergeAll( consolidate, maxVertsPerBatch, true, results );
 
-    unsigned numVerts = 0, numColors = 0, numNormals = 0;
-    DrawableList::iterator start = consolidate.begin();
+    // re-build the geode:
+    geode.removeDrawables( 0, geode.getNumDrawables() );
 
-    for( DrawableList::iterator end = consolidate.begin(); end != consolidate.end(); )
+    for( unsigned i = 0; i < results.size(); ++i )
     {
-        osg::Geometry* geom = end->get()->asGeometry(); // already type-checked this earlier.
-        unsigned geomNumVerts = geom->getVertexArray()->getNumElements();
-
-        ++end;
-
-        numVerts += geomNumVerts;
-        if ( geom->getColorArray() )
-            numColors += geom->getColorArray()->getNumElements();
-        if ( geom->getNormalArray() )
-            numNormals += geom->getNormalArray()->getNumElements();
+        osg::Geometry* geom = results[i].get();
+        geom->setStateSet( unifiedStateSet );
+        geom->setUseVertexBufferObjects( useVBOs );
+        geom->setUseDisplayList( !useVBOs );
+        geode.addDrawable( geom );
+    }
 
-        if ( numVerts > targetNumVertsPerGeom || end == consolidate.end() )
-        {
-            OE_DEBUG << LC << "Merging " << ((unsigned)(end-start)) << " geoms with " << numVerts << " verts." << std::endl;
+    for( unsigned i = 0; i < dontConsolidate.size(); ++i )
+        geode.addDrawable( dontConsolidate[i].get() );
+}
 
-            merge( start, end, numVerts, numColors, numNormals, texCoordArrayUnits, useVBOs, results );
+void
+MeshConsolidator::run(const TransformedGeometryList& input,
+                      unsigned                       maxVertsPerBatch,
+                      osg::Geode&                    output,
+                      TransformedGeometryList&       rejects)
+{
+    TransformedGeometryList consolidate;
+    consolidate.reserve(input.size());
 
-            start = end;
-            numVerts = 0, numColors = 0, numNormals = 0;
-        }
+    for(TransformedGeometryList::const_iterator i = input.begin(); i != input.end(); ++i)
+    {
+        if (i->_geometry.valid() && canMerge(*i->_geometry.get()))
+            consolidate.push_back(*i);
+        else if (i->_geometry.valid())
+            rejects.push_back(*i);
     }
 
-    // re-build the geode:
-    geode.removeDrawables( 0, geode.getNumDrawables() );
+    std::vector< osg::ref_ptr<osg::Geometry> > results;
+    mergeAll(consolidate, maxVertsPerBatch, false, results);
 
-    for( DrawableList::iterator i = results.begin(); i != results.end(); ++i )
-        geode.addDrawable( i->get() );
-
-    for( DrawableList::iterator i = dontConsolidate.begin(); i != dontConsolidate.end(); ++i )
-        geode.addDrawable( i->get() );
+    for(unsigned i = 0; i < results.size(); ++i)
+    {
+        results[i]->setUseVertexBufferObjects(true);
+        results[i]->setUseDisplayList(false);
+        output.addDrawable(results[i].get());
+    }
 }
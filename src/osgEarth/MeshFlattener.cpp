@@ -24,39 +24,15 @@
 #include <osgEarth/MeshFlattener>
 #include <osgEarth/StateSetCache>
 #include <osgEarth/Registry>
-#include <osgUtil/Optimizer>
 #include <osgDB/WriteFile>
 #include <osg/Billboard>
+#include <osg/MatrixTransform>
 
 #define LC "[MeshFlattener] "
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
-namespace
-{
-    struct RemoveEmptyGeometries : public osg::NodeVisitor
-    {
-        RemoveEmptyGeometries() {
-            setTraversalMode(TRAVERSE_ALL_CHILDREN);
-            setNodeMaskOverride(~0);
-        }
-        void apply(osg::Geode& geode) {
-            std::vector<osg::Drawable*> empties;
-            for (unsigned i = 0; i < geode.getNumDrawables(); ++i) {
-                osg::Geometry* g = geode.getDrawable(i)->asGeometry();
-                if (g) {
-                    if (g->getVertexArray() == 0L || g->getNumPrimitiveSets() == 0)
-                        empties.push_back(g);
-                }
-            }
-            for (unsigned i = 0; i < empties.size(); ++i) {
-                geode.removeDrawable(empties[i]);
-            }
-        }
-    };
-}
-
 /********************************/
 PrepareForOptimizationVisitor::PrepareForOptimizationVisitor():
 osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN )
@@ -126,7 +102,10 @@ osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN )
                 }
 
                 GeometryVector& geometries = _geometries[_ssStack];
-                geometries.push_back(geometry);
+                if (_matrixStack.empty())
+                    geometries.push_back(MeshConsolidator::TransformedGeometry(geometry));
+                else
+                    geometries.push_back(MeshConsolidator::TransformedGeometry(geometry, _matrixStack.back()));
 
                 if (geomSS.valid())
                 {
@@ -144,6 +123,16 @@ osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN )
 
     }
 
+    void FlattenSceneGraphVisitor::apply(osg::Transform& transform)
+    {
+        osg::Matrixd matrix = _matrixStack.empty() ? osg::Matrixd::identity() : _matrixStack.back();
+        transform.computeLocalToWorldMatrix(matrix, this);
+
+        _matrixStack.push_back(matrix);
+        apply(static_cast<osg::Node&>(transform));
+        _matrixStack.pop_back();
+    }
+
     void FlattenSceneGraphVisitor::pushStateSet(osg::StateSet* stateSet)
     {
         _ssStack.push_back(stateSet);
@@ -175,31 +164,44 @@ osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN )
 
             osg::Geode* geode = new osg::Geode;
             geode->setStateSet(ss);
-            // Add all of the drawables to the new Geode
-            for (GeometryVector::iterator gItr = itr->second.begin(); gItr != itr->second.end(); ++gItr)
-            {
-                osg::Geometry* g = gItr->get();
-                // Remove any stateset that might be on the Geometry
-                g->setStateSet(0);
-                geode->addDrawable( g );
-            }
             result->addChild(geode);
-            
-            // Consolidate all the drawables in the geode.
-            MeshConsolidator::run(*geode);
-        }
 
-        if (_mergeGeometry)
-        {
-            // Run MERGE_GEOMETRY so that it will merge all the primitive sets
-            osgUtil::Optimizer::MergeGeometryVisitor mg;
-            mg.setTargetMaximumNumberOfVertices(osg::maximum(_maxVertsPerCluster, Registry::instance()->getMaxNumberOfVertsPerDrawable()));
-            result->accept( mg );
-
-            // Remove any empty geoetries. For some reason the MergeGeometryVisitor sometimes 
-            // leaves them around.
-            RemoveEmptyGeometries reg;
-            result->accept( reg );
+            // Consolidate all the geometries into the geode, applying their
+            // transforms as they are copied. With merging on, the batches go
+            // up to the cluster size; otherwise they stay small enough for
+            // 16-bit indices.
+            unsigned maxVerts = _mergeGeometry ?
+                osg::maximum(_maxVertsPerCluster, Registry::instance()->getMaxNumberOfVertsPerDrawable()) :
+                0x10000u;
+
+            MeshConsolidator::TransformedGeometryList rejects;
+            MeshConsolidator::run(itr->second, maxVerts, *geode, rejects);
+
+            // Geometries that can't merge go in as they are, under their
+            // transform, minus the stateset that's now on the geode.
+            for (GeometryVector::iterator gItr = rejects.begin(); gItr != rejects.end(); ++gItr)
+            {
+                osg::ref_ptr<osg::Geometry> g = gItr->_geometry.get();
+                if (g->getStateSet())
+                {
+                    g = new osg::Geometry(*g.get(), osg::CopyOp::SHALLOW_COPY);
+                    g->setStateSet(0);
+                }
+
+                if (gItr->_transform)
+                {
+                    osg::MatrixTransform* xform = new osg::MatrixTransform(gItr->_matrix);
+                    osg::Geode* rejectGeode = new osg::Geode();
+                    rejectGeode->addDrawable(g.get());
+                    xform->addChild(rejectGeode);
+                    xform->setStateSet(ss);
+                    result->addChild(xform);
+                }
+                else
+                {
+                    geode->addDrawable(g.get());
+                }
+            }
         }
        
         //osgDB::writeNodeFile(*result, "clustered.osgt");
@@ -215,9 +217,8 @@ void MeshFlattener::run(osg::Group* group, unsigned maxVertsPerCluster)
     PrepareForOptimizationVisitor v;
     group->accept(v);
 
-    // Remove any transforms 
-    osgUtil::Optimizer optimizer;
-    optimizer.optimize(group, osgUtil::Optimizer::FLATTEN_STATIC_TRANSFORMS_DUPLICATING_SHARED_SUBGRAPHS);
+    // Transforms are applied as the geometry merges (see FlattenSceneGraphVisitor),
+    // so shared subgraphs don't need to be duplicated and transformed first.
 
     // Share all statesets and attributes so we can just do a pointer based stack.
     osg::ref_ptr< StateSetCache > sscache = new StateSetCache();
@@ -19,6 +19,8 @@
 #include <osgEarth/MeshSubdivider>
 #include <osgEarth/LineFunctor>
 #include <osgEarth/GeoMath>
+#include <osgEarth/Containers>
+#include <osgEarth/JobArena>
 #include <osg/TriangleFunctor>
 #include <osg/TriangleIndexFunctor>
 #include <climits>
@@ -116,6 +118,24 @@ namespace
         return fabs( acos( v0n * v1n ) );
     }
 
+    // the granularity to use given an allowable error: an edge spanning
+    // angle a sags r*(1-cos(a/2)) below a sphere of radius r, so edges
+    // whose sag is under the error can span more than the granularity.
+    double
+    effectiveGranularity( double granularity, double maxError, double radius )
+    {
+        if ( maxError <= 0.0 || radius <= maxError )
+            return granularity;
+
+        return osg::maximum( granularity, 2.0*acos(1.0 - maxError/radius) );
+    }
+
+    // (approximate) largest number of triangles to reserve space for up front
+    const unsigned MAX_RESERVED_TRIANGLES = 1u << 22;
+
+    // smallest number of input triangles worth giving its own thread
+    const unsigned MIN_TRIANGLES_PER_PARTITION = 256u;
+
     //--------------------------------------------------------------------
 
     struct Triangle
@@ -126,7 +146,6 @@ namespace
         GLuint _i0, _i1, _i2;
     };
 
-    typedef std::queue<Triangle> TriangleQueue;
     typedef std::vector<Triangle> TriangleVector;
     
 
@@ -142,7 +161,7 @@ namespace
         osg::ref_ptr<osg::Vec4Array> _colors;
         osg::ref_ptr<osg::Vec2Array> _texcoords;
         osg::ref_ptr<osg::Vec3Array> _normals;
-        TriangleQueue _tris;
+        TriangleVector _tris;
         
         TriangleData()
         {            
@@ -245,27 +264,19 @@ namespace
                 n2 = (*_sourceNormals)[p3];
             }
 
-            _tris.push( Triangle(record(v0, t0, c0, n0), record(v1, t1, c1, n1), record(v2, t2, c2, n2)) );
+            _tris.push_back( Triangle(record(v0, t0, c0, n0), record(v1, t1, c1, n1), record(v2, t2, c2, n2)) );
         }
     };      
 
-    struct Edge
+    // key for the edge between two vertices, in either direction
+    inline unsigned long long edgeKey( GLuint i0, GLuint i1 )
     {
-        Edge() : _i0(0), _i1(0) { }
-        Edge( GLuint i0, GLuint i1 ) : _i0(i0), _i1(i1) { }
-        GLuint _i0, _i1;
-        bool operator < (const Edge& rhs) const {
-            return
-                _i0 < rhs._i0 ? true :
-                _i0 > rhs._i0 ? false :
-                _i1 < rhs._i1 ? true :
-                //_i1 > rhs._i1 ? false : // redundant :)
-                false;
-        }
-        bool operator == (const Edge& rhs) const { return _i0==rhs._i0 && _i1==rhs._i1; }
-    };
+        return i0 < i1 ?
+            ((unsigned long long)i0 << 32) | (unsigned long long)i1 :
+            ((unsigned long long)i1 << 32) | (unsigned long long)i0;
+    }
 
-    typedef std::map<Edge,GLuint> EdgeMap;
+    typedef Util::UnorderedMap<unsigned long long, GLuint> EdgeMap;
     
     /**
      * Populates the geometry object with a collection of index elements primitives.
@@ -544,6 +555,7 @@ namespace
      */
     void subdivideLines(
         double               granularity,
+        double               maxError,
         GeoInterpolation     interp,
         osg::Geometry&       geom,
         const osg::Matrixd&  W2L, // world=>local xform
@@ -560,6 +572,14 @@ namespace
     
         int numLinesIn = data._lines.size();
 
+        if ( maxError > 0.0 )
+        {
+            double radius = 0.0;
+            for( unsigned i = 0; i < data._verts->size(); ++i )
+                radius = osg::maximum( radius, (osg::Vec3d((*data._verts)[i]) * L2W).length() );
+            granularity = effectiveGranularity( granularity, maxError, radius );
+        }
+
         LineVector done;
         done.reserve( 2 * data._lines.size() );
 
@@ -660,6 +680,245 @@ namespace
 
     //----------------------------------------------------------------------
 
+    /**
+     * A run of input triangles and everything subdividing it produces.
+     * Vertices a partition creates are kept apart from the input vertices,
+     * so partitions can run at the same time; their indices start at the
+     * number of input vertices and get remapped when the partitions merge.
+     */
+    struct TrianglePartition
+    {
+        TrianglePartition() : _begin(0u), _end(0u) { }
+
+        unsigned                _begin, _end;  // range of input triangles
+        TriangleVector          _done;         // output triangles
+        std::vector<osg::Vec3>  _verts;
+        std::vector<osg::Vec3d> _world;        // _verts in world coords
+        std::vector<osg::Vec3d> _unit;         // _world, normalized
+        std::vector<osg::Vec4>  _colors;
+        std::vector<osg::Vec2>  _texcoords;
+        std::vector<osg::Vec3>  _normals;
+    };
+
+    /**
+     * Subdivides the partitions of one mesh. Threads claim partitions
+     * one at a time until they're all done.
+     */
+    struct TriangleSubdivision : public osg::Referenced
+    {
+        TriangleSubdivision(
+            const TriangleData&  data,
+            double               granularity,
+            double               maxError,
+            GeoInterpolation     interp,
+            const osg::Matrixd&  W2L,
+            const osg::Matrixd&  L2W,
+            unsigned             numPartitions ) :
+            _data(data), _interp(interp), _W2L(W2L),
+            _numInput(data._verts->size()),
+            _parts(osg::maximum(numPartitions, 1u)),
+            _next(0u), _remaining(_parts.size())
+        {
+            // world coordinates of the input vertices, computed once
+            // for all partitions
+            double radius = 0.0;
+            _world.resize(_numInput);
+            _unit.resize(_numInput);
+            for(unsigned i = 0; i < _numInput; ++i)
+            {
+                _world[i] = osg::Vec3d((*data._verts)[i]) * L2W;
+                double len = _world[i].length();
+                _unit[i] = len > 0.0 ? _world[i] / len : _world[i];
+                radius = osg::maximum(radius, len);
+            }
+
+            _granularity = effectiveGranularity(granularity, maxError, radius);
+
+            // Compare angles by their cosines, so the inner loop needs no acos
+            _cosGranularity = cos(_granularity);
+
+            unsigned numTris = data._tris.size();
+            for(unsigned p = 0; p < _parts.size(); ++p)
+            {
+                _parts[p]._begin = (numTris * p) / _parts.size();
+                _parts[p]._end   = (numTris * (p+1)) / _parts.size();
+            }
+        }
+
+        bool runNext()
+        {
+            unsigned index = (++_next) - 1u;
+            if (index >= _parts.size())
+                return false;
+
+            subdivide(_parts[index]);
+
+            if (--_remaining == 0u)
+                _done.set();
+
+            return true;
+        }
+
+        const osg::Vec3d& world(const TrianglePartition& part, GLuint i) const {
+            return i < _numInput ? _world[i] : part._world[i - _numInput];
+        }
+
+        const osg::Vec3d& unit(const TrianglePartition& part, GLuint i) const {
+            return i < _numInput ? _unit[i] : part._unit[i - _numInput];
+        }
+
+        // index of the midpoint of an edge, creating it the first time
+        GLuint split(TrianglePartition& part, EdgeMap& edges, GLuint i0, GLuint i1) const
+        {
+            unsigned long long key = edgeKey(i0, i1);
+            EdgeMap::const_iterator ei = edges.find(key);
+            if (ei != edges.end())
+                return ei->second;
+
+            osg::Vec3d mid = geocentricMidpoint(world(part, i0), world(part, i1), _interp);
+            double len = mid.length();
+            part._world.push_back(mid);
+            part._unit.push_back(len > 0.0 ? mid / len : mid);
+            part._verts.push_back(mid * _W2L);
+
+            if (_data._colors.valid())
+            {
+                const osg::Vec4& c0 = i0 < _numInput ? (*_data._colors)[i0] : part._colors[i0 - _numInput];
+                const osg::Vec4& c1 = i1 < _numInput ? (*_data._colors)[i1] : part._colors[i1 - _numInput];
+                part._colors.push_back((c0 + c1) / 2.0f);
+            }
+            if (_data._texcoords.valid())
+            {
+                const osg::Vec2& t0 = i0 < _numInput ? (*_data._texcoords)[i0] : part._texcoords[i0 - _numInput];
+                const osg::Vec2& t1 = i1 < _numInput ? (*_data._texcoords)[i1] : part._texcoords[i1 - _numInput];
+                part._texcoords.push_back((t0 + t1) / 2.0f);
+            }
+            if (_data._normals.valid())
+            {
+                const osg::Vec3& n0 = i0 < _numInput ? (*_data._normals)[i0] : part._normals[i0 - _numInput];
+                const osg::Vec3& n1 = i1 < _numInput ? (*_data._normals)[i1] : part._normals[i1 - _numInput];
+                part._normals.push_back((n0 + n1) / 2.0f);
+            }
+
+            GLuint i = _numInput + part._verts.size() - 1;
+            edges[key] = i;
+            return i;
+        }
+
+        void subdivide(TrianglePartition& part) const
+        {
+            // Reserve the output up front. Splitting the edges of a triangle
+            // into n pieces makes about n^2 triangles and half as many
+            // new vertices.
+            double estimate = 0.0;
+            for(unsigned t = part._begin; t < part._end; ++t)
+            {
+                const Triangle& tri = _data._tris[t];
+                double dot = osg::minimum(
+                    _unit[tri._i0] * _unit[tri._i1], osg::minimum(
+                    _unit[tri._i1] * _unit[tri._i2],
+                    _unit[tri._i2] * _unit[tri._i0]));
+                double n = ceil(acos(osg::clampBetween(dot, -1.0, 1.0)) / _granularity);
+                estimate += osg::maximum(n*n, 1.0);
+            }
+            unsigned numTris = (unsigned)osg::minimum(estimate, (double)MAX_RESERVED_TRIANGLES);
+            unsigned numVerts = numTris / 2u;
+
+            part._done.reserve(numTris);
+            part._verts.reserve(numVerts);
+            part._world.reserve(numVerts);
+            part._unit.reserve(numVerts);
+            if (_data._colors.valid())
+                part._colors.reserve(numVerts);
+            if (_data._texcoords.valid())
+                part._texcoords.reserve(numVerts);
+            if (_data._normals.valid())
+                part._normals.reserve(numVerts);
+
+            // Used to make sure shared edges are not split more than once.
+            EdgeMap edges;
+#ifdef OSGEARTH_CXX11
+            edges.reserve(numVerts);
+#endif
+
+            // Subdivide each input triangle depth-first, so the triangles and
+            // vertices that come from it end up next to each other in the output.
+            TriangleVector stack;
+            for(unsigned t = part._begin; t < part._end; ++t)
+            {
+                stack.push_back(_data._tris[t]);
+
+                while(!stack.empty())
+                {
+                    Triangle tri = stack.back();
+                    stack.pop_back();
+
+                    const osg::Vec3d& u0 = unit(part, tri._i0);
+                    const osg::Vec3d& u1 = unit(part, tri._i1);
+                    const osg::Vec3d& u2 = unit(part, tri._i2);
+
+                    // the longest edge has the smallest cosine
+                    double d0 = u0 * u1;
+                    double d1 = u1 * u2;
+                    double d2 = u2 * u0;
+                    double min = osg::minimum(d0, osg::minimum(d1, d2));
+
+                    if (min < _cosGranularity)
+                    {
+                        if (d0 == min)
+                        {
+                            GLuint i = split(part, edges, tri._i0, tri._i1);
+                            stack.push_back(Triangle(i, tri._i1, tri._i2));
+                            stack.push_back(Triangle(tri._i0, i, tri._i2));
+                        }
+                        else if (d1 == min)
+                        {
+                            GLuint i = split(part, edges, tri._i1, tri._i2);
+                            stack.push_back(Triangle(i, tri._i2, tri._i0));
+                            stack.push_back(Triangle(tri._i1, i, tri._i0));
+                        }
+                        else
+                        {
+                            GLuint i = split(part, edges, tri._i2, tri._i0);
+                            stack.push_back(Triangle(i, tri._i0, tri._i1));
+                            stack.push_back(Triangle(tri._i2, i, tri._i1));
+                        }
+                    }
+                    else
+                    {
+                        // triangle is small enough- put it on the "done" list.
+                        part._done.push_back(tri);
+                    }
+                }
+            }
+        }
+
+        const TriangleData&            _data;
+        GeoInterpolation               _interp;
+        osg::Matrixd                   _W2L;
+        unsigned                       _numInput;
+        std::vector<osg::Vec3d>        _world;
+        std::vector<osg::Vec3d>        _unit;
+        double                         _granularity;
+        double                         _cosGranularity;
+        std::vector<TrianglePartition> _parts;
+        OpenThreads::Atomic            _next;
+        OpenThreads::Atomic            _remaining;
+        Threading::Event               _done;
+    };
+
+    struct TriangleSubdivisionTask : public TaskRequest
+    {
+        TriangleSubdivisionTask(TriangleSubdivision* sub) : _sub(sub) { }
+
+        void operator()(ProgressCallback*)
+        {
+            while (_sub->runNext());
+        }
+
+        osg::ref_ptr<TriangleSubdivision> _sub;
+    };
+
     /**
      * Collects all the triangles from the geometry, coalesces them into a single
      * triangle set, subdivides them according to the granularity threshold, and
@@ -671,11 +930,13 @@ namespace
      */
     void subdivideTriangles(
         double               granularity,
+        double               maxError,
         GeoInterpolation     interp,
         osg::Geometry&       geom,
         const osg::Matrixd&  W2L, // world=>local xform
         const osg::Matrixd&  L2W, // local=>world xform
-        unsigned int         maxElementsPerEBO )
+        unsigned int         maxElementsPerEBO,
+        unsigned             parallelism )
     {
         
         // collect all the triangled in the geometry.
@@ -689,140 +950,80 @@ namespace
 
         //TODO normals
         geom.accept( data );
-        
-        int numTrisIn = data._tris.size();        
 
-        TriangleVector done;
-        done.reserve(2.0 * data._tris.size());
-
-        // Used to make sure shared edges are not split more than once.
-        EdgeMap edges;
-
-        // Subdivide triangles until we run out
-        while( data._tris.size() > 0 )
-        {
-            Triangle tri = data._tris.front();
-            data._tris.pop();
+        if ( data._tris.empty() )
+            return;
 
-            osg::Vec3d v0_w = (*data._verts)[tri._i0] * L2W;
-            osg::Vec3d v1_w = (*data._verts)[tri._i1] * L2W;
-            osg::Vec3d v2_w = (*data._verts)[tri._i2] * L2W;
+        unsigned numPartitions = osg::clampBetween(
+            (unsigned)data._tris.size() / MIN_TRIANGLES_PER_PARTITION, 1u, osg::maximum(parallelism, 1u));
 
-            osg::Vec2 t0,t1,t2;
-            if ( data._texcoords.valid() )
-            {
-                t0 = (*data._texcoords)[tri._i0];
-                t1 = (*data._texcoords)[tri._i1];
-                t2 = (*data._texcoords)[tri._i2];
-            }
+        osg::ref_ptr<TriangleSubdivision> sub = new TriangleSubdivision(
+            data, granularity, maxError, interp, W2L, L2W, numPartitions);
 
-            osg::Vec4f c0,c1,c2;
-            if ( data._colors.valid() )
-            {
-                c0 = (*data._colors)[tri._i0];
-                c1 = (*data._colors)[tri._i1];
-                c2 = (*data._colors)[tri._i2];
-            }
+        if ( numPartitions > 1u )
+        {
+            JobArena* arena = JobArena::get("oe.meshsubdivider");
+            if (arena->getConcurrency() < numPartitions - 1u)
+                arena->setConcurrency(numPartitions - 1u);
 
-            osg::Vec3 n0,n1,n2;
-            if ( data._normals.valid() )
+            for(unsigned i = 1; i < numPartitions; ++i)
             {
-                n0 = (*data._normals)[tri._i0];
-                n1 = (*data._normals)[tri._i1];
-                n2 = (*data._normals)[tri._i2];
+                arena->dispatch(new TriangleSubdivisionTask(sub.get()));
             }
+        }
 
-            double g0 = angleBetween(v0_w, v1_w);
-            double g1 = angleBetween(v1_w, v2_w);
-            double g2 = angleBetween(v2_w, v0_w);
-            double max = osg::maximum( g0, osg::maximum(g1, g2) );
+        while (sub->runNext());
+        sub->_done.wait();
 
-            if ( max > granularity )
-            {
-                if ( g0 == max )
-                {
-                    Edge edge( osg::minimum(tri._i0, tri._i1), osg::maximum(tri._i0, tri._i1) );
-                    
-                    EdgeMap::iterator ei = edges.find(edge);
-                    GLuint i;
-                    if ( ei == edges.end() )
-                    {
-                        data._verts->push_back( geocentricMidpoint(v0_w, v1_w, interp) * W2L );
-                        if ( data._colors.valid() )
-                            data._colors->push_back( (c0 + c1) / 2.0f );
-                        if ( data._texcoords.valid() )
-                            data._texcoords->push_back( (t0 + t1) / 2.0f );
-                        if ( data._normals.valid() )
-                            data._normals->push_back( (n0 + n1) / 2.0f );
-                        i = data._verts->size() - 1;
-                        edges[edge] = i;
-                    }
-                    else
-                    {
-                        i = ei->second;
-                    }
+        // merge the partitions.
+        unsigned numInput = sub->_numInput;
+        unsigned numVerts = numInput, numTris = 0u;
+        for(unsigned p = 0; p < sub->_parts.size(); ++p)
+        {
+            numVerts += sub->_parts[p]._verts.size();
+            numTris += sub->_parts[p]._done.size();
+        }
 
-                    data._tris.push( Triangle(tri._i0, i, tri._i2) );
-                    data._tris.push( Triangle(i, tri._i1, tri._i2) );
-                }
-                else if ( g1 == max )
-                {
-                    Edge edge( osg::minimum(tri._i1, tri._i2), osg::maximum(tri._i1,tri._i2) );
+        data._verts->reserve(numVerts);
+        if ( data._colors.valid() )
+            data._colors->reserve(numVerts);
+        if ( data._texcoords.valid() )
+            data._texcoords->reserve(numVerts);
+        if ( data._normals.valid() )
+            data._normals->reserve(numVerts);
 
-                    EdgeMap::iterator ei = edges.find(edge);
-                    GLuint i;
-                    if ( ei == edges.end() )
-                    {
-                        data._verts->push_back( geocentricMidpoint(v1_w, v2_w, interp) * W2L );
-                        if ( data._colors.valid() )
-                            data._colors->push_back( (c1 + c2) / 2.0f );
-                        if ( data._texcoords.valid() )
-                            data._texcoords->push_back( (t1 + t2) / 2.0f );
-                        if ( data._normals.valid() )
-                            data._normals->push_back( (n1 + n2) / 2.0f );
-                        i = data._verts->size() - 1;
-                        edges[edge] = i;
-                    }
-                    else
-                    {
-                        i = ei->second;
-                    }
+        TriangleVector done;
+        done.reserve(numTris);
 
-                    data._tris.push( Triangle(tri._i1, i, tri._i0) );
-                    data._tris.push( Triangle(i, tri._i2, tri._i0) );
-                }
-                else if ( g2 == max )
-                {
-                    Edge edge( osg::minimum(tri._i2, tri._i0), osg::maximum(tri._i2,tri._i0) );
+        unsigned offset = numInput;
+        for(unsigned p = 0; p < sub->_parts.size(); ++p)
+        {
+            TrianglePartition& part = sub->_parts[p];
 
-                    EdgeMap::iterator ei = edges.find(edge);
-                    GLuint i;
-                    if ( ei == edges.end() )
-                    {
-                        data._verts->push_back( geocentricMidpoint(v2_w, v0_w, interp) * W2L );
-                        if ( data._colors.valid() )
-                            data._colors->push_back( (c2 + c0) / 2.0f );
-                        if ( data._texcoords.valid() )
-                            data._texcoords->push_back( (t2 + t0) / 2.0f );
-                        if ( data._normals.valid() )
-                            data._normals->push_back( (n2 + n0) / 2.0f );
-                        i = data._verts->size() - 1;
-                        edges[edge] = i;
-                    }
-                    else
-                    {
-                        i = ei->second;
-                    }
+            data._verts->insert(data._verts->end(), part._verts.begin(), part._verts.end());
+            if ( data._colors.valid() )
+                data._colors->insert(data._colors->end(), part._colors.begin(), part._colors.end());
+            if ( data._texcoords.valid() )
+                data._texcoords->insert(data._texcoords->end(), part._texcoords.begin(), part._texcoords.end());
+            if ( data._normals.valid() )
+                data._normals->insert(data._normals->end(), part._normals.begin(), part._normals.end());
 
-                    data._tris.push( Triangle(tri._i2, i, tri._i1) );
-                    data._tris.push( Triangle(i, tri._i0, tri._i1) );
-                }
+            if ( offset == numInput )
+            {
+                done.insert(done.end(), part._done.begin(), part._done.end());
             }
             else
             {
-                // triangle is small enough- put it on the "done" list.
-                done.push_back(tri);
+                for(TriangleVector::const_iterator t = part._done.begin(); t != part._done.end(); ++t)
+                {
+                    done.push_back(Triangle(
+                        t->_i0 < numInput ? t->_i0 : t->_i0 - numInput + offset,
+                        t->_i1 < numInput ? t->_i1 : t->_i1 - numInput + offset,
+                        t->_i2 < numInput ? t->_i2 : t->_i2 - numInput + offset));
+                }
             }
+
+            offset += part._verts.size();
         }
 
         if ( done.size() > 0 )
@@ -856,11 +1057,13 @@ namespace
 
     void subdivide(
         double               granularity,
+        double               maxError,
         GeoInterpolation     interp,
         osg::Geometry&       geom,
         const osg::Matrixd&  W2L, // world=>local xform
         const osg::Matrixd&  L2W, // local=>world xform
-        unsigned int         maxElementsPerEBO )
+        unsigned int         maxElementsPerEBO,
+        unsigned             parallelism )
     {
         if ( geom.getNumPrimitiveSets() == 0 )
             return;
@@ -872,11 +1075,11 @@ namespace
 
         if ( mode == GL_LINES || mode == GL_LINE_STRIP || mode == GL_LINE_LOOP )
         {
-            subdivideLines( granularity, interp, geom, W2L, L2W, maxElementsPerEBO );
+            subdivideLines( granularity, maxError, interp, geom, W2L, L2W, maxElementsPerEBO );
         }
         else
         {
-            subdivideTriangles( granularity, interp, geom, W2L, L2W, maxElementsPerEBO );
+            subdivideTriangles( granularity, maxError, interp, geom, W2L, L2W, maxElementsPerEBO, parallelism );
         }
     }
 }
@@ -887,7 +1090,9 @@ MeshSubdivider::MeshSubdivider(const osg::Matrixd& world2local,
                                const osg::Matrixd& local2world ) :
 _local2world(local2world),
 _world2local(world2local),
-_maxElementsPerEBO( INT_MAX )
+_maxElementsPerEBO( INT_MAX ),
+_maxError( 0.0 ),
+_parallelism( 1u )
 {
     if ( !_world2local.isIdentity() && _local2world.isIdentity() )
         _local2world = osg::Matrixd::inverse(_world2local);
@@ -905,5 +1110,5 @@ MeshSubdivider::run(osg::Geometry& geom, double granularity, GeoInterpolation in
     if ( geom.getVertexAttribArrayList().size() > 0 )
         return;
 
-    subdivide( granularity, interp, geom, _world2local, _local2world, _maxElementsPerEBO );
+    subdivide( granularity, _maxError, interp, geom, _world2local, _local2world, _maxElementsPerEBO, _parallelism );
 }
@@ -19,16 +19,454 @@
 
 
 #include <osgEarth/Metrics>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/StringUtils>
 #include <osgViewer/ViewerBase>
 #include <osgViewer/View>
 #include <osgEarth/Memory>
+#include <osg/Timer>
+#include <fstream>
+#include <map>
+#include <algorithm>
+#ifdef OSGEARTH_CXX11
+#include <atomic>
+#endif
 
+using namespace osgEarth;
 using namespace osgEarth::Util;
 
 #define LC "[Metrics] "
 
+// Number of per-thread slots in each counter. Threads hash to a slot by ID,
+// so a slot is almost never shared by two busy threads.
+#define NUM_SLOTS 16
+
 static bool s_metricsEnabled = true;
 
+//........................................................................
+
+// A cache-line-sized cell holding one thread's share of a value.
+class Metrics::Slots
+{
+public:
+    struct Slot
+    {
+#ifdef OSGEARTH_CXX11
+        std::atomic<long long> value;
+        Slot() : value(0) { }
+        void add(long long v) { value.fetch_add(v, std::memory_order_relaxed); }
+        void set(long long v) { value.store(v, std::memory_order_relaxed); }
+        long long get() const { return value.load(std::memory_order_relaxed); }
+#else
+        mutable Threading::Mutex mutex;
+        long long value;
+        Slot() : value(0) { }
+        void add(long long v) { Threading::ScopedMutexLock lock(mutex); value += v; }
+        void set(long long v) { Threading::ScopedMutexLock lock(mutex); value = v; }
+        long long get() const { Threading::ScopedMutexLock lock(mutex); return value; }
+#endif
+        char padding[64];
+    };
+
+    Slot _slots[NUM_SLOTS];
+
+    Slot& local() { return _slots[Threading::getCurrentThreadId() % NUM_SLOTS]; }
+
+    long long sum() const
+    {
+        long long total = 0;
+        for (unsigned i = 0; i < NUM_SLOTS; ++i)
+            total += _slots[i].get();
+        return total;
+    }
+};
+
+// Histogram samples touch several fields at once, so each slot has a lock;
+// threads use different slots, so the locks are uncontended.
+class Metrics::Histogram::Cells
+{
+public:
+    struct Cell
+    {
+        Threading::Mutex mutex;
+        unsigned long long count;
+        double sum, min, max;
+        std::vector<unsigned long long> buckets;
+        char padding[64];
+    };
+
+    Cell _cells[NUM_SLOTS];
+};
+
+namespace
+{
+    struct MetricsRegistry
+    {
+        Threading::ReadWriteMutex mutex;
+        std::map<std::string, Metrics::Counter*> counters;
+        std::map<std::string, Metrics::Gauge*> gauges;
+        std::map<std::string, Metrics::Histogram*> histograms;
+
+        std::string exportFile;
+        Metrics::ExportFormat exportFormat;
+        double exportInterval;
+        osg::Timer_t lastExport;
+    };
+
+    // Metrics are never deleted, so pointers handed out stay valid even
+    // during static destruction.
+    MetricsRegistry& registry()
+    {
+        static MetricsRegistry* s_registry = 0L;
+        static Threading::Mutex s_registryMutex;
+        if (!s_registry)
+        {
+            Threading::ScopedMutexLock lock(s_registryMutex);
+            if (!s_registry)
+            {
+                MetricsRegistry* r = new MetricsRegistry();
+                r->exportFormat = Metrics::FORMAT_JSON;
+                r->exportInterval = 5.0;
+                r->lastExport = osg::Timer::instance()->tick();
+
+                const char* env = ::getenv("OSGEARTH_METRICS_EXPORT");
+                if (env)
+                {
+                    r->exportFile = env;
+                    r->exportFormat = endsWith(r->exportFile, ".json", false) ?
+                        Metrics::FORMAT_JSON : Metrics::FORMAT_STATSD;
+                }
+                s_registry = r;
+            }
+        }
+        return *s_registry;
+    }
+
+    template<typename T>
+    T* findMetric(std::map<std::string, T*>& table, const std::string& name)
+    {
+        typename std::map<std::string, T*>::const_iterator i = table.find(name);
+        return i != table.end() ? i->second : 0L;
+    }
+
+    // JSON and StatsD both get plain dotted names; quote just in case.
+    std::string jsonString(const std::string& in)
+    {
+        std::string out = "\"";
+        for (unsigned i = 0; i < in.size(); ++i)
+        {
+            if (in[i] == '"' || in[i] == '\\') out += '\\';
+            out += in[i];
+        }
+        return out + "\"";
+    }
+}
+
+//........................................................................
+
+Metrics::Counter::Counter(const std::string& name) :
+    _name(name),
+    _slots(new Slots())
+{
+    //nop
+}
+
+void
+Metrics::Counter::add(long long value)
+{
+    _slots->local().add(value);
+}
+
+long long
+Metrics::Counter::get() const
+{
+    return _slots->sum();
+}
+
+Metrics::ScopedTimer::ScopedTimer(Counter* counter) :
+    _counter(counter),
+    _start(osg::Timer::instance()->tick())
+{
+    //nop
+}
+
+Metrics::ScopedTimer::~ScopedTimer()
+{
+    if (_counter)
+    {
+        const osg::Timer* timer = osg::Timer::instance();
+        _counter->add((long long)timer->delta_u(_start, timer->tick()));
+    }
+}
+
+Metrics::Gauge::Gauge(const std::string& name) :
+    _name(name),
+    _slots(new Slots())
+{
+    //nop
+}
+
+void
+Metrics::Gauge::set(long long value)
+{
+    // a gauge is one value, not a per-thread sum
+    _slots->_slots[0].set(value);
+}
+
+void
+Metrics::Gauge::add(long long value)
+{
+    _slots->_slots[0].add(value);
+}
+
+long long
+Metrics::Gauge::get() const
+{
+    return _slots->_slots[0].get();
+}
+
+Metrics::Histogram::Histogram(const std::string& name, const std::vector<double>& bounds) :
+    _name(name),
+    _bounds(bounds),
+    _cells(new Cells())
+{
+    if (_bounds.empty())
+    {
+        for (double decade = 1.0; decade <= 10000.0; decade *= 10.0)
+        {
+            _bounds.push_back(decade);
+            if (decade < 10000.0)
+            {
+                _bounds.push_back(decade * 2.0);
+                _bounds.push_back(decade * 5.0);
+            }
+        }
+    }
+    std::sort(_bounds.begin(), _bounds.end());
+
+    for (unsigned i = 0; i < NUM_SLOTS; ++i)
+    {
+        Cells::Cell& cell = _cells->_cells[i];
+        cell.count = 0u;
+        cell.sum = cell.min = cell.max = 0.0;
+        cell.buckets.assign(_bounds.size() + 1, 0u);
+    }
+}
+
+void
+Metrics::Histogram::sample(double value)
+{
+    unsigned b = std::lower_bound(_bounds.begin(), _bounds.end(), value) - _bounds.begin();
+
+    Cells::Cell& cell = _cells->_cells[Threading::getCurrentThreadId() % NUM_SLOTS];
+    Threading::ScopedMutexLock lock(cell.mutex);
+    if (cell.count == 0u || value < cell.min) cell.min = value;
+    if (cell.count == 0u || value > cell.max) cell.max = value;
+    ++cell.count;
+    cell.sum += value;
+    ++cell.buckets[b];
+}
+
+void
+Metrics::Histogram::get(Data& output) const
+{
+    output.count = 0u;
+    output.sum = output.min = output.max = 0.0;
+    output.bounds = _bounds;
+    output.buckets.assign(_bounds.size() + 1, 0u);
+
+    for (unsigned i = 0; i < NUM_SLOTS; ++i)
+    {
+        Cells::Cell& cell = _cells->_cells[i];
+        Threading::ScopedMutexLock lock(cell.mutex);
+        if (cell.count == 0u)
+            continue;
+        if (output.count == 0u || cell.min < output.min) output.min = cell.min;
+        if (output.count == 0u || cell.max > output.max) output.max = cell.max;
+        output.count += cell.count;
+        output.sum += cell.sum;
+        for (unsigned b = 0; b < cell.buckets.size(); ++b)
+            output.buckets[b] += cell.buckets[b];
+    }
+}
+
+double
+Metrics::Histogram::Data::percentile(double p) const
+{
+    if (count == 0u)
+        return 0.0;
+
+    unsigned long long target = (unsigned long long)(p * (double)count);
+    unsigned long long running = 0u;
+    for (unsigned b = 0; b < buckets.size(); ++b)
+    {
+        running += buckets[b];
+        if (running > target || running == count)
+            return b < bounds.size() ? std::min(bounds[b], max) : max;
+    }
+    return max;
+}
+
+Metrics::LayerHistograms
+Metrics::layerHistograms(const std::string& layerName)
+{
+    static std::vector<double> s_byteBounds;
+    static Threading::Mutex s_byteBoundsMutex;
+    {
+        Threading::ScopedMutexLock lock(s_byteBoundsMutex);
+        if (s_byteBounds.empty())
+        {
+            for (double b = 1024.0; b <= 16.0*1048576.0; b *= 4.0)
+                s_byteBounds.push_back(b);
+        }
+    }
+
+    std::string prefix = "layer." + layerName;
+    LayerHistograms h;
+    h.fetch   = histogram(prefix + ".fetch_ms");
+    h.cache   = histogram(prefix + ".cache_ms");
+    h.process = histogram(prefix + ".process_ms");
+    h.bytes   = histogram(prefix + ".bytes", s_byteBounds);
+    return h;
+}
+
+void
+Metrics::LayerHistograms::record(double fetchMS, double cacheMS, double processMS, unsigned numBytes) const
+{
+    if (!fetch)
+        return;
+    if (fetchMS >= 0.0)   fetch->sample(fetchMS);
+    if (cacheMS >= 0.0)   cache->sample(cacheMS);
+    if (processMS >= 0.0) process->sample(processMS);
+    bytes->sample((double)numBytes);
+}
+
+Metrics::Counter*
+Metrics::counter(const std::string& name)
+{
+    MetricsRegistry& r = registry();
+    {
+        Threading::ScopedReadLock lock(r.mutex);
+        Counter* c = findMetric(r.counters, name);
+        if (c) return c;
+    }
+    Threading::ScopedWriteLock lock(r.mutex);
+    Counter*& c = r.counters[name];
+    if (!c) c = new Counter(name);
+    return c;
+}
+
+Metrics::Gauge*
+Metrics::gauge(const std::string& name)
+{
+    MetricsRegistry& r = registry();
+    {
+        Threading::ScopedReadLock lock(r.mutex);
+        Gauge* g = findMetric(r.gauges, name);
+        if (g) return g;
+    }
+    Threading::ScopedWriteLock lock(r.mutex);
+    Gauge*& g = r.gauges[name];
+    if (!g) g = new Gauge(name);
+    return g;
+}
+
+void
+Metrics::getCounters(const std::string& prefix, std::vector<Counter*>& output)
+{
+    MetricsRegistry& r = registry();
+    Threading::ScopedReadLock lock(r.mutex);
+    for (std::map<std::string, Counter*>::const_iterator i = r.counters.lower_bound(prefix);
+        i != r.counters.end() && i->first.compare(0, prefix.size(), prefix) == 0;
+        ++i)
+    {
+        output.push_back(i->second);
+    }
+}
+
+Metrics::Histogram*
+Metrics::histogram(const std::string& name, const std::vector<double>& bounds)
+{
+    MetricsRegistry& r = registry();
+    {
+        Threading::ScopedReadLock lock(r.mutex);
+        Histogram* h = findMetric(r.histograms, name);
+        if (h) return h;
+    }
+    Threading::ScopedWriteLock lock(r.mutex);
+    Histogram*& h = r.histograms[name];
+    if (!h) h = new Histogram(name, bounds);
+    return h;
+}
+
+void
+Metrics::write(std::ostream& out, ExportFormat format)
+{
+    MetricsRegistry& r = registry();
+    Threading::ScopedReadLock lock(r.mutex);
+
+    if (format == FORMAT_STATSD)
+    {
+        // Values are cumulative, so everything goes out as a gauge.
+        for (std::map<std::string, Counter*>::const_iterator i = r.counters.begin(); i != r.counters.end(); ++i)
+            out << i->first << ":" << i->second->get() << "|g\n";
+
+        for (std::map<std::string, Gauge*>::const_iterator i = r.gauges.begin(); i != r.gauges.end(); ++i)
+            out << i->first << ":" << i->second->get() << "|g\n";
+
+        for (std::map<std::string, Histogram*>::const_iterator i = r.histograms.begin(); i != r.histograms.end(); ++i)
+        {
+            Histogram::Data data;
+            i->second->get(data);
+            out << i->first << ".count:" << data.count << "|g\n"
+                << i->first << ".mean:" << (data.count > 0u ? data.sum / (double)data.count : 0.0) << "|g\n"
+                << i->first << ".min:" << data.min << "|g\n"
+                << i->first << ".max:" << data.max << "|g\n";
+        }
+    }
+    else
+    {
+        out << "{\n  \"counters\": {";
+        for (std::map<std::string, Counter*>::const_iterator i = r.counters.begin(); i != r.counters.end(); ++i)
+            out << (i == r.counters.begin() ? "\n    " : ",\n    ") << jsonString(i->first) << ": " << i->second->get();
+
+        out << "\n  },\n  \"gauges\": {";
+        for (std::map<std::string, Gauge*>::const_iterator i = r.gauges.begin(); i != r.gauges.end(); ++i)
+            out << (i == r.gauges.begin() ? "\n    " : ",\n    ") << jsonString(i->first) << ": " << i->second->get();
+
+        out << "\n  },\n  \"histograms\": {";
+        for (std::map<std::string, Histogram*>::const_iterator i = r.histograms.begin(); i != r.histograms.end(); ++i)
+        {
+            Histogram::Data data;
+            i->second->get(data);
+            out << (i == r.histograms.begin() ? "\n    " : ",\n    ") << jsonString(i->first) << ": { "
+                << "\"count\": " << data.count
+                << ", \"sum\": " << data.sum
+                << ", \"min\": " << data.min
+                << ", \"max\": " << data.max
+                << ", \"bounds\": [";
+            for (unsigned b = 0; b < data.bounds.size(); ++b)
+                out << (b > 0 ? ", " : "") << data.bounds[b];
+            out << "], \"buckets\": [";
+            for (unsigned b = 0; b < data.buckets.size(); ++b)
+                out << (b > 0 ? ", " : "") << data.buckets[b];
+            out << "] }";
+        }
+        out << "\n  }\n}\n";
+    }
+}
+
+void
+Metrics::setExport(const std::string& filename, ExportFormat format, double intervalSeconds)
+{
+    MetricsRegistry& r = registry();
+    Threading::ScopedWriteLock lock(r.mutex);
+    r.exportFile = filename;
+    r.exportFormat = format;
+    r.exportInterval = intervalSeconds;
+    r.lastExport = osg::Timer::instance()->tick();
+}
+
 bool Metrics::enabled()
 {
     return s_metricsEnabled;
@@ -42,6 +480,31 @@ void Metrics::setEnabled(bool enabled)
 void Metrics::frame()
 {
     OE_PROFILING_FRAME_MARK;
+
+    MetricsRegistry& r = registry();
+    osg::Timer_t now = osg::Timer::instance()->tick();
+    {
+        Threading::ScopedReadLock lock(r.mutex);
+        if (r.exportFile.empty() ||
+            osg::Timer::instance()->delta_s(r.lastExport, now) < r.exportInterval)
+            return;
+    }
+
+    std::string filename;
+    ExportFormat format;
+    {
+        Threading::ScopedWriteLock lock(r.mutex);
+        r.lastExport = now;
+        filename = r.exportFile;
+        format = r.exportFormat;
+    }
+
+    // Overwrite the file each time so a reader always sees one whole snapshot.
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::trunc);
+    if (out.is_open())
+        write(out, format);
+    else
+        OE_WARN << LC << "Cannot write metrics to \"" << filename << "\"" << std::endl;
 }
 
 int Metrics::run(osgViewer::ViewerBase& viewer)
@@ -20,8 +20,17 @@
 
 #include <osg/ApplicationUsage>
 #include <osg/ref_ptr>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <OpenThreads/Condition>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#ifndef OSGEARTH_CXX11
+#include <osgEarth/ThreadingUtils>
+#include <map>
+#endif
 
 #include <stdlib.h>
 
@@ -58,21 +67,142 @@ protected:
     NullStreamBuffer* _buffer;
 };
 
-/** Stream buffer calling notify handler when buffer is synchronized (usually on std::endl).
- * Stream stores last notification severity to pass it to handler call.
+/** Hands finished messages to a background thread that calls the notify
+ * handler, so that logging threads never block on the output itself.
+ */
+struct NotifyQueue : public OpenThreads::Thread
+{
+    typedef std::pair<osg::NotifySeverity, std::string> Message;
+    typedef std::vector<Message> Messages;
+
+    NotifyQueue() : _async(true), _started(false), _done(false) { }
+
+    ~NotifyQueue()
+    {
+        stop();
+    }
+
+    void setNotifyHandler(osg::NotifyHandler *handler)
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_queueMutex);
+        _handler = handler;
+    }
+
+    osg::NotifyHandler *getNotifyHandler()
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_queueMutex);
+        return _handler.get();
+    }
+
+    void setAsync(bool value)
+    {
+        if (!value)
+            flush();
+        _async = value;
+    }
+
+    void write(osg::NotifySeverity severity, const char* message)
+    {
+        if (_async && severity > osg::FATAL)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_queueMutex);
+            if (!_done)
+            {
+                if (!_started)
+                {
+                    _started = true;
+                    start();
+                }
+                _messages.push_back(Message(severity, message));
+                _cond.signal();
+                return;
+            }
+        }
+
+        // synchronous: write out anything queued first to keep the order
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+        emit();
+        osg::ref_ptr<osg::NotifyHandler> handler = getNotifyHandler();
+        if (handler.valid())
+            handler->notify(severity, message);
+    }
+
+    void flush()
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+        emit();
+    }
+
+    void run()
+    {
+        while(true)
+        {
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_queueMutex);
+                while (_messages.empty() && !_done)
+                    _cond.wait(&_queueMutex);
+                if (_messages.empty() && _done)
+                    return;
+            }
+            flush();
+        }
+    }
+
+    void stop()
+    {
+        bool started;
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_queueMutex);
+            _done = true;
+            started = _started;
+            _cond.signal();
+        }
+        if (started)
+            join();
+        flush();
+    }
+
+private:
+
+    // call with _writeMutex held
+    void emit()
+    {
+        Messages batch;
+        osg::ref_ptr<osg::NotifyHandler> handler;
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_queueMutex);
+            batch.swap(_messages);
+            handler = _handler;
+        }
+        if (handler.valid())
+        {
+            for(Messages::const_iterator i = batch.begin(); i != batch.end(); ++i)
+                handler->notify(i->first, i->second.c_str());
+        }
+    }
+
+    bool _async;
+    bool _started;
+    bool _done;
+    Messages _messages;
+    osg::ref_ptr<osg::NotifyHandler> _handler;
+    OpenThreads::Mutex _queueMutex;
+    OpenThreads::Mutex _writeMutex;
+    OpenThreads::Condition _cond;
+};
+
+/** Stream buffer passing each message to the notify queue when buffer is synchronized (usually on std::endl).
+ * Stream stores last notification severity to pass it to the queue.
  */
 struct NotifyStreamBuffer : public std::stringbuf
 {
-    NotifyStreamBuffer() : _severity(osg::NOTICE)
+    NotifyStreamBuffer(NotifyQueue* queue) : _queue(queue), _severity(osg::NOTICE)
     {
-        /* reduce the need to reallocate the std::ostream buffer behind osgEarth::Notify (causing multitreading issues) by pre-allocating 4095 bytes */
+        /* reduce the need to reallocate the std::ostream buffer behind osgEarth::Notify by pre-allocating 4095 bytes */
         str(std::string(4095, 0));
         pubseekpos(0, std::ios_base::out);
     }
 
-    void setNotifyHandler(osg::NotifyHandler *handler) { _handler = handler; }
-    osg::NotifyHandler *getNotifyHandler() const { return _handler.get(); }
-
     /** Sets severity for next call of notify handler */
     void setCurrentSeverity(osg::NotifySeverity severity)
     {
@@ -90,21 +220,24 @@ private:
     int sync()
     {
         sputc(0); // string termination
-        if (_handler.valid())
-            _handler->notify(_severity, pbase());
+        if (*pbase() != 0)
+            _queue->write(_severity, pbase());
         pubseekpos(0, std::ios_base::out); // or str(std::string())
         return 0;
     }
 
-    osg::ref_ptr<osg::NotifyHandler> _handler;
+    NotifyQueue* _queue;
     osg::NotifySeverity _severity;
 };
 
+/** Notify stream owned by one thread, so that formatting a message
+ * never contends with other threads.
+ */
 struct NotifyStream : public std::ostream
 {
 public:
-    NotifyStream():
-        std::ostream(new NotifyStreamBuffer)
+    NotifyStream(NotifyQueue* queue):
+        std::ostream(new NotifyStreamBuffer(queue))
     {
         _buffer = static_cast<NotifyStreamBuffer *>(rdbuf());
     }
@@ -174,14 +307,24 @@ namespace
             }
 
             // Setup standard notify handler
-            NotifyStreamBuffer *buffer = dynamic_cast<NotifyStreamBuffer *>(_notifyStream.rdbuf());
-            if (buffer && !buffer->getNotifyHandler())
-                buffer->setNotifyHandler(new osg::StandardNotifyHandler);
+            _notifyQueue.setNotifyHandler(new osg::StandardNotifyHandler);
         }
 
+#ifndef OSGEARTH_CXX11
+        ~NotifySingleton()
+        {
+            for(std::map<unsigned, NotifyStream*>::iterator i = _streams.begin(); i != _streams.end(); ++i)
+                delete i->second;
+        }
+#endif
+
         osg::NotifySeverity _notifyLevel;
         NullStream     _nullStream;
-        NotifyStream   _notifyStream;
+        NotifyQueue    _notifyQueue;
+#ifndef OSGEARTH_CXX11
+        std::map<unsigned, NotifyStream*> _streams;
+        OpenThreads::Mutex _streamsMutex;
+#endif
     };
 
     static NotifySingleton& getNotifySingleton()
@@ -189,6 +332,25 @@ namespace
         static NotifySingleton s_NotifySingleton;
         return s_NotifySingleton;
     }
+
+#ifdef OSGEARTH_CXX11
+    static NotifyStream& getNotifyStream()
+    {
+        static thread_local NotifyStream s_notifyStream(&getNotifySingleton()._notifyQueue);
+        return s_notifyStream;
+    }
+#else
+    // No thread_local: keep one stream per thread ID, created on first use.
+    static NotifyStream& getNotifyStream()
+    {
+        NotifySingleton& s = getNotifySingleton();
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(s._streamsMutex);
+        NotifyStream*& stream = s._streams[Threading::getCurrentThreadId()];
+        if (!stream)
+            stream = new NotifyStream(&s._notifyQueue);
+        return *stream;
+    }
+#endif
 }
 
 bool osgEarth::initNotifyLevel()
@@ -212,14 +374,22 @@ osg::NotifySeverity osgEarth::getNotifyLevel()
 
 void osgEarth::setNotifyHandler(osg::NotifyHandler *handler)
 {
-    NotifyStreamBuffer *buffer = static_cast<NotifyStreamBuffer*>(getNotifySingleton()._notifyStream.rdbuf());
-    if (buffer) buffer->setNotifyHandler(handler);
+    getNotifySingleton()._notifyQueue.setNotifyHandler(handler);
 }
 
 osg::NotifyHandler* osgEarth::getNotifyHandler()
 {
-    NotifyStreamBuffer *buffer = static_cast<NotifyStreamBuffer *>(getNotifySingleton()._notifyStream.rdbuf());
-    return buffer ? buffer->getNotifyHandler() : 0;
+    return getNotifySingleton()._notifyQueue.getNotifyHandler();
+}
+
+void osgEarth::setNotifyAsync(bool value)
+{
+    getNotifySingleton()._notifyQueue.setAsync(value);
+}
+
+void osgEarth::flushNotify()
+{
+    getNotifySingleton()._notifyQueue.flush();
 }
 
 
@@ -234,8 +404,45 @@ std::ostream& osgEarth::notify(const osg::NotifySeverity severity)
 {
     if (osgEarth::isNotifyEnabled(severity))
     {
-        getNotifySingleton()._notifyStream.setCurrentSeverity(severity);
-        return getNotifySingleton()._notifyStream;
+        NotifyStream& stream = getNotifyStream();
+        stream.setCurrentSeverity(severity);
+        return stream;
     }
     return getNotifySingleton()._nullStream;
 }
+
+NotifyThrottle::NotifyThrottle(double interval) :
+    _intervalMs((long long)(interval * 1000.0)),
+    _nextMs(0),
+    _suppressed(0)
+{
+    //nop
+}
+
+int
+NotifyThrottle::pass()
+{
+    long long now = (long long)osg::Timer::instance()->time_m();
+
+#ifdef OSGEARTH_CXX11
+    long long next = _nextMs.load();
+
+    // only one thread wins the right to log for each interval
+    if (now >= next && _nextMs.compare_exchange_strong(next, now + _intervalMs))
+    {
+        return _suppressed.exchange(0);
+    }
+#else
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+        if (now >= _nextMs)
+        {
+            _nextMs = now + _intervalMs;
+            return (int)_suppressed.exchange(0);
+        }
+    }
+#endif
+
+    ++_suppressed;
+    return -1;
+}
@@ -24,7 +24,11 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
+#include <osgEarth/FileUtils>
+#include <osgDB/FileUtils>
 #include <list>
+#include <fstream>
+#include <algorithm>
 #include <cpl_error.h>
 #include <ogr_api.h>
 #include <queue>
@@ -107,7 +111,9 @@ _nextHandleToQueue( 0L ),
 _resultSetEndReached(false),
 _profile          ( profile ),
 _filters          ( filters ),
-_rewindPolygons   (rewindPolygons)
+_rewindPolygons   (rewindPolygons),
+_readFIDs         ( false ),
+_nextFID          ( 0u )
 {
     {
         OGR_SCOPED_LOCK;
@@ -204,6 +210,36 @@ _rewindPolygons   (rewindPolygons)
     readChunk();
 }
 
+OGR::OGRFeatureCursor::OGRFeatureCursor(OGRDataSourceH                dsHandle,
+                                        OGRLayerH                     layerHandle,
+                                        const std::vector<FeatureID>& fids,
+                                        const FeatureSource*          source,
+                                        const FeatureProfile*         profile,
+                                        const Query&                  query,
+                                        const FeatureFilterChain*     filters,
+                                        ProgressCallback*             progress,
+                                        bool                          rewindPolygons
+                                        ) :
+FeatureCursor     ( progress ),
+_source           ( source ),
+_dsHandle         ( dsHandle ),
+_layerHandle      ( layerHandle ),
+_resultSetHandle  ( layerHandle ),
+_spatialFilter    ( 0L ),
+_query            ( query ),
+_chunkSize        ( 500 ),
+_nextHandleToQueue( 0L ),
+_resultSetEndReached(false),
+_profile          ( profile ),
+_filters          ( filters ),
+_rewindPolygons   (rewindPolygons),
+_readFIDs         ( true ),
+_fids             ( fids ),
+_nextFID          ( 0u )
+{
+    readChunk();
+}
+
 OGR::OGRFeatureCursor::OGRFeatureCursor(OGRLayerH resultSetHandle, const FeatureProfile* profile) :
     FeatureCursor(NULL),
     _resultSetHandle(resultSetHandle),
@@ -213,7 +249,9 @@ OGR::OGRFeatureCursor::OGRFeatureCursor(OGRLayerH resultSetHandle, const Feature
     _spatialFilter(0L),
     _chunkSize(500),
     _nextHandleToQueue(0L),
-    _resultSetEndReached(false)
+    _resultSetEndReached(false),
+    _readFIDs(false),
+    _nextFID(0u)
 {
     OGR_SCOPED_LOCK;
 
@@ -266,6 +304,41 @@ OGR::OGRFeatureCursor::nextFeature()
     return _lastFeatureReturned.get();
 }
 
+unsigned
+OGR::OGRFeatureCursor::nextBatch(FeatureList& output, unsigned maxFeatures)
+{
+    unsigned count = 0u;
+    while( count < maxFeatures && hasMore() )
+    {
+        while( count < maxFeatures && !_queue.empty() )
+        {
+            output.push_back( _queue.front() );
+            _queue.pop();
+            ++count;
+        }
+
+        if ( _queue.empty() )
+            readChunk();
+    }
+    return count;
+}
+
+// next feature from the result set, or from the FID list. Call with the OGR mutex held.
+OGRFeatureH
+OGR::OGRFeatureCursor::readNextHandle()
+{
+    if ( !_readFIDs )
+        return OGR_L_GetNextFeature( _resultSetHandle );
+
+    while( _nextFID < _fids.size() )
+    {
+        OGRFeatureH handle = OGR_L_GetFeature( _layerHandle, _fids[_nextFID++] );
+        if ( handle )
+            return handle;
+    }
+    return 0L;
+}
+
 // reads a chunk of features into a memory cache; do this for performance
 // and to avoid needing the OGR Mutex every time
 void
@@ -276,12 +349,19 @@ OGR::OGRFeatureCursor::readChunk()
     
     OGR_SCOPED_LOCK;
 
+    // resolve the fields to convert once for the whole chunk, keeping only
+    // the attributes the query asked for (if it asked):
+    OgrUtils::FieldProjection fields;
+    fields.resolve(
+        OGR_L_GetLayerDefn( _resultSetHandle ),
+        _query.attributes().isSet() ? &_query.attributes().get() : 0L );
+
     while( _queue.size() < _chunkSize && !_resultSetEndReached )
     {
         FeatureList filterList;
         while( filterList.size() < _chunkSize && !_resultSetEndReached )
         {
-            OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
+            OGRFeatureH handle = readNextHandle();
             if ( handle )
             {
                 /*
@@ -293,7 +373,7 @@ OGR::OGRFeatureCursor::readChunk()
                     OGR_F_SetGeometry(handle, intersection);
                 }
                 */
-                osg::ref_ptr<Feature> feature = OgrUtils::createFeature( handle, _profile.get(), _rewindPolygons);
+                osg::ref_ptr<Feature> feature = OgrUtils::createFeature( handle, _profile.get(), fields, _rewindPolygons);
 
                 if (feature.valid())
                 {
@@ -364,6 +444,7 @@ OGRFeatureSource::Options::getConfig() const
     conf.set("ogr_driver", _ogrDriver);
     conf.set("build_spatial_index", _buildSpatialIndex);
     conf.set("force_rebuild_spatial_index", _forceRebuildSpatialIndex);
+    conf.set("sidecar_spatial_index", _sidecarSpatialIndex);
     conf.set("geometry", _geometryConfig);
     conf.set("geometry_url", _geometryUrl);
     conf.set("layer", _layer);
@@ -379,6 +460,7 @@ OGRFeatureSource::Options::fromConfig(const Config& conf)
     conf.get("ogr_driver", _ogrDriver);
     conf.get("build_spatial_index", _buildSpatialIndex);
     conf.get("force_rebuild_spatial_index", _forceRebuildSpatialIndex);
+    conf.get("sidecar_spatial_index", _sidecarSpatialIndex);
     conf.get("geometry", _geometryConfig);
     conf.get("geometry_url", _geometryUrl);
     conf.get("layer", _layer);
@@ -392,6 +474,7 @@ REGISTER_OSGEARTH_LAYER(ogrfeatures, OGRFeatureSource);
 OE_LAYER_PROPERTY_IMPL(OGRFeatureSource, URI, URL, url);
 OE_LAYER_PROPERTY_IMPL(OGRFeatureSource, std::string, Connection, connection);
 OE_LAYER_PROPERTY_IMPL(OGRFeatureSource, bool, BuildSpatialIndex, buildSpatialIndex);
+OE_LAYER_PROPERTY_IMPL(OGRFeatureSource, bool, SidecarSpatialIndex, sidecarSpatialIndex);
 OE_LAYER_PROPERTY_IMPL(OGRFeatureSource, std::string, OGRDriver, ogrDriver);
 OE_LAYER_PROPERTY_IMPL(OGRFeatureSource, URI, GeometryURL, geometryUrl);
 OE_LAYER_PROPERTY_IMPL(OGRFeatureSource, std::string, Layer, layer);
@@ -408,6 +491,7 @@ OGRFeatureSource::init()
     _needsSync = false;
     _writable = false;
     _geometryType = Geometry::TYPE_UNKNOWN;
+    _sidecarIndex = 0L;
 }
 
 Status
@@ -619,6 +703,11 @@ OGRFeatureSource::openImplementation()
         //Get the feature count
         _featureCount = OGR_L_GetFeatureCount(_layerHandle, 1);
 
+        if (options().sidecarSpatialIndex() == true && !_writable)
+        {
+            openSidecarIndex();
+        }
+
         // establish the feature schema:
         initSchema();
 
@@ -789,6 +878,89 @@ OGRFeatureSource::buildSpatialIndex()
    }
 }
 
+void
+OGRFeatureSource::openSidecarIndex()
+{
+    // only plain files get a sidecar; the index describes the file as it
+    // was when the index was written.
+    if (!osgDB::fileExists(_source))
+        return;
+
+    std::ifstream in(_source.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    std::streamoff fileSize = in.is_open() ? (std::streamoff)in.tellg() : 0;
+    in.close();
+
+    std::string path = _source + ".oeidx";
+    std::string stamp = Stringify()
+        << OGR_FD_GetName(OGR_L_GetLayerDefn(_layerHandle)) << ";"
+        << fileSize << ";"
+        << osgEarth::getLastModifiedTime(_source) << ";"
+        << _featureCount;
+
+    osg::ref_ptr<PackedRTree> index = new PackedRTree();
+
+    if (index->open(path, stamp) && options().forceRebuildSpatialIndex() != true)
+    {
+        OE_INFO << LC << "Mapped spatial index for " << getName() << " (" << index->size() << " features)" << std::endl;
+        _sidecarIndex = index.get();
+        return;
+    }
+
+    OE_INFO << LC << "Building spatial index for " << getName() << std::endl;
+
+    index = new PackedRTree();
+
+    // we only need the geometry envelopes, so skip reading the attributes.
+    OGRFeatureDefnH defn = OGR_L_GetLayerDefn(_layerHandle);
+    std::vector<std::string> names;
+    for (int i = 0; i < OGR_FD_GetFieldCount(defn); ++i)
+    {
+        names.push_back(OGR_Fld_GetNameRef(OGR_FD_GetFieldDefn(defn, i)));
+    }
+    names.push_back("OGR_STYLE");
+
+    std::vector<const char*> ignored;
+    for (unsigned i = 0; i < names.size(); ++i)
+    {
+        ignored.push_back(names[i].c_str());
+    }
+    ignored.push_back(0L);
+
+    OGR_L_SetIgnoredFields(_layerHandle, &ignored[0]);
+    OGR_L_ResetReading(_layerHandle);
+
+    OGRFeatureH handle;
+    while ((handle = OGR_L_GetNextFeature(_layerHandle)) != 0L)
+    {
+        OGRGeometryH geom = OGR_F_GetGeometryRef(handle);
+        if (geom)
+        {
+            OGREnvelope env;
+            OGR_G_GetEnvelope(geom, &env);
+            index->add((uint64_t)OGR_F_GetFID(handle), env.MinX, env.MinY, env.MaxX, env.MaxY);
+        }
+        OGR_F_Destroy(handle);
+    }
+
+    OGR_L_ResetReading(_layerHandle);
+    OGR_L_SetIgnoredFields(_layerHandle, 0L);
+
+    index->finish();
+
+    // map the written file so the build memory goes away; if we can't
+    // write next to the source, keep the index in memory for this session.
+    if (index->write(path, stamp) && index->open(path, stamp))
+    {
+        OE_INFO << LC << "Wrote spatial index " << path << std::endl;
+    }
+    else
+    {
+        OE_INFO << LC << "Unable to write spatial index " << path << "; using it in memory only" << std::endl;
+    }
+
+    _sidecarIndex = index.get();
+}
+
 FeatureCursor*
 OGRFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* progress)
 {
@@ -827,6 +999,42 @@ OGRFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* prog
 
             OE_DEBUG << newQuery.getConfig().toJSON(true) << std::endl;
 
+            // With a sidecar index, a plain extent query reads only the features
+            // whose envelopes intersect it. (SQL queries still go through OGR.)
+            if (_sidecarIndex.valid() &&
+                !newQuery.expression().isSet() &&
+                !newQuery.orderby().isSet() &&
+                (newQuery.bounds().isSet() || newQuery.tileKey().isSet()))
+            {
+                Bounds bounds;
+                if (newQuery.bounds().isSet())
+                    bounds = newQuery.bounds().get();
+                else
+                {
+                    bounds = newQuery.tileKey()->getExtent().transform(getFeatureProfile()->getSRS()).bounds();
+                    newQuery.bounds() = bounds;
+                }
+
+                std::vector<uint64_t> hits;
+                _sidecarIndex->search(bounds.xMin(), bounds.yMin(), bounds.xMax(), bounds.yMax(), hits);
+
+                // read in file order:
+                std::sort(hits.begin(), hits.end());
+                std::vector<FeatureID> fids(hits.begin(), hits.end());
+
+                return new OGR::OGRFeatureCursor(
+                    dsHandle,
+                    layerHandle,
+                    fids,
+                    this,
+                    getFeatureProfile(),
+                    newQuery,
+                    getFilters(),
+                    progress,
+                    *_options->rewindPolygons()
+                    );
+            }
+
             // cursor is responsible for the OGR handles.
             return new OGR::OGRFeatureCursor(
                 dsHandle,
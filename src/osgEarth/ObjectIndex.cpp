@@ -84,7 +84,7 @@ ObjectIndex::loadShaders(VirtualProgram* vp) const
 void
 ObjectIndex::setObjectIDAtrribLocation(int value)
 {
-    if ( _index.size() == 0 )
+    if ( size() == 0 )
     {
         _attribLocation = value;
     } 
@@ -97,49 +97,51 @@ ObjectIndex::setObjectIDAtrribLocation(int value)
 ObjectID
 ObjectIndex::insert(osg::Referenced* object)
 {
-    Threading::ScopedMutexLock excl( _mutex );
-    return insertImpl( object );
-}
-
-ObjectID
-ObjectIndex::insertImpl(osg::Referenced* object)
-{
-    // internal: assume mutex is locked
     ObjectID id = ++_idGen;
-    _index[id] = object;
-    OE_DEBUG << LC << "Insert " << id << "; size = " << _index.size() << "\n";
+    Shard& shard = _shards[id % NUM_SHARDS];
+    Threading::ScopedWriteLock excl( shard._mutex );
+    shard._index[id] = object;
+    OE_DEBUG << LC << "Insert " << id << "\n";
     return id;
 }
 
-osg::Referenced*
+osg::ref_ptr<osg::Referenced>
 ObjectIndex::getImpl(ObjectID id) const
 {
-    // assume the mutex is locked
-    IndexMap::const_iterator i = _index.find(id);
-    return i != _index.end() ? i->second.get() : 0L;
+    const Shard& shard = _shards[id % NUM_SHARDS];
+    Threading::ScopedReadLock shared( shard._mutex );
+    IndexMap::const_iterator i = shard._index.find(id);
+    osg::ref_ptr<osg::Referenced> object;
+    if ( i != shard._index.end() )
+        i->second.lock( object );
+    return object;
 }
 
 void
 ObjectIndex::remove(ObjectID id)
 {
-    Threading::ScopedMutexLock excl(_mutex);
-    removeImpl(id);
+    Shard& shard = _shards[id % NUM_SHARDS];
+    Threading::ScopedWriteLock excl( shard._mutex );
+    shard._index.erase( id );
+    OE_DEBUG << LC << "Remove " << id << "\n";
 }
 
-void
-ObjectIndex::removeImpl(ObjectID id)
+unsigned
+ObjectIndex::size() const
 {
-    // internal - assume mutex is locked
-    _index.erase( id );
-    OE_DEBUG << "Remove " << id << "; size = " << _index.size() << "\n";
-
+    unsigned count = 0u;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedReadLock shared( _shards[s]._mutex );
+        count += _shards[s]._index.size();
+    }
+    return count;
 }
 
 ObjectID
 ObjectIndex::tagDrawable(osg::Drawable* drawable, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagDrawable(drawable, oid);
     return oid;
 }
@@ -154,16 +156,29 @@ ObjectIndex::tagDrawable(osg::Drawable* drawable, ObjectID id) const
     if ( !geom )
         return;
 
-    // add a new integer attributer to store the feautre ID per vertex.
-    ObjectIDArray* ids = new ObjectIDArray();
+    osg::Array* verts = geom->getVertexArray();
+    if ( !verts )
+        return;
+
+    unsigned numVerts = verts->getNumElements();
+
+    // Re-tagging a drawable (e.g. a shared feature) just overwrites the
+    // existing array rather than allocating a new one.
+    ObjectIDArray* ids = dynamic_cast<ObjectIDArray*>(geom->getVertexAttribArray(_attribLocation));
+    if ( ids && ids->size() == numVerts )
+    {
+        std::fill( ids->begin(), ids->end(), id );
+        ids->dirty();
+        return;
+    }
+
+    // add a new integer attribute to store the object ID per vertex.
+    ids = new ObjectIDArray();
     ids->setBinding(osg::Array::BIND_PER_VERTEX);
     ids->setNormalize(false);
-    geom->setVertexAttribArray(_attribLocation, ids);
     ids->setPreserveDataType(true);
-
-    // The tag is actually FeatureID + 1, to preserve "0" as an "empty" value.
-    // TODO: use a ObjectID generator and mapping instead.
-    ids->assign( geom->getVertexArray()->getNumElements(), id );
+    ids->assign( numVerts, id );
+    geom->setVertexAttribArray(_attribLocation, ids);
 }
 
 namespace
@@ -190,8 +205,7 @@ namespace
 ObjectID
 ObjectIndex::tagAllDrawables(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagAllDrawables(node, oid);
     return oid;
 }
@@ -209,8 +223,7 @@ ObjectIndex::tagAllDrawables(osg::Node* node, ObjectID id) const
 ObjectID
 ObjectIndex::tagNode(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagNode(node, oid);
     return oid;
 }
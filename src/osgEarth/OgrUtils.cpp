@@ -46,19 +46,127 @@ namespace
         return OGR_F_IsFieldSet(handle, i);
     #endif
     }
+
+    void setAttribute(Feature* feature, OGRFeatureH handle, int i, const std::string& name, OGRFieldType field_type)
+    {
+        // set the value appropriately for the field type
+        switch( field_type )
+        {
+        case OFTInteger:
+            {     
+                if (IsFieldSet( handle, i ))
+                {
+                    int value = OGR_F_GetFieldAsInteger( handle, i );
+                    feature->set( name, value );                    
+                }
+                else
+                {
+                    feature->setNull( name, ATTRTYPE_INT );
+                }
+            }
+            break;
+        case OFTReal:
+            {
+                if (IsFieldSet( handle, i ))
+                {
+                    double value = OGR_F_GetFieldAsDouble( handle, i );
+                    feature->set( name, value );
+                }
+                else
+                {
+                    feature->setNull( name, ATTRTYPE_DOUBLE );
+                }
+            }
+            break;
+        default:
+            {
+                if (IsFieldSet( handle, i ))
+                {
+                    const char* value = OGR_F_GetFieldAsString(handle, i);
+                    feature->set( name, std::string(value) );
+                }
+                else
+                {
+                    feature->setNull( name, ATTRTYPE_STRING );
+                }
+            }
+        }
+    }
+}
+
+void
+OgrUtils::FieldProjection::resolve(OGRFeatureDefnH defn, const std::set<std::string>* names)
+{
+    _indices.clear();
+    _names.clear();
+    _types.clear();
+
+    if ( !defn )
+        return;
+
+    std::set<std::string> lowerNames;
+    if ( names )
+    {
+        for(std::set<std::string>::const_iterator i = names->begin(); i != names->end(); ++i)
+            lowerNames.insert( osgEarth::toLower(*i) );
+    }
+
+    int numFields = OGR_FD_GetFieldCount( defn );
+    for (int i = 0; i < numFields; ++i)
+    {
+        OGRFieldDefnH field_handle_ref = OGR_FD_GetFieldDefn( defn, i );
+        std::string name = osgEarth::toLower( std::string(OGR_Fld_GetNameRef(field_handle_ref)) );
+
+        if ( names == 0L || lowerNames.find(name) != lowerNames.end() )
+        {
+            _indices.push_back( i );
+            _names.push_back( name );
+            _types.push_back( OGR_Fld_GetType(field_handle_ref) );
+        }
+    }
 }
 
 void
 OgrUtils::populate( OGRGeometryH geomHandle, Geometry* target, int numPoints )
 {
-    for (int v = 0; v < numPoints; ++v)
+    if ( numPoints <= 0 )
+        return;
+
+    // Read the coordinates in bulk straight into the geometry's storage.
+    // (Z stays zero for 2D geometries.)
+    unsigned start = target->size();
+    target->resize( start + numPoints );
+
+    osg::Vec3d* data = &(*target)[start];
+    const int stride = sizeof(osg::Vec3d);
+    int numRead = OGR_G_GetPoints( geomHandle,
+        &data->x(), stride,
+        &data->y(), stride,
+        &data->z(), stride );
+
+    // not a simple curve or point; fall back on reading each point.
+    if ( numRead != numPoints )
     {
-        double x=0, y=0, z=0;
-        OGR_G_GetPoint( geomHandle, v, &x, &y, &z );
-        osg::Vec3d p( x, y, z );
-        if ( target->size() == 0 || p != target->back() ) // remove dupes
-            target->push_back( p );
+        for (int v = 0; v < numPoints; ++v)
+        {
+            double x=0, y=0, z=0;
+            OGR_G_GetPoint( geomHandle, v, &x, &y, &z );
+            data[v].set( x, y, z );
+        }
     }
+
+    // remove dupes in place:
+    unsigned out = start;
+    for (unsigned v = start; v < target->size(); ++v)
+    {
+        if ( out == 0 || (*target)[v] != (*target)[out-1] )
+        {
+            if ( out != v )
+                (*target)[out] = (*target)[v];
+            ++out;
+        }
+    }
+    target->resize( out );
 }
 
 MultiGeometry*
@@ -501,19 +609,28 @@ OgrUtils::createFeature(OGRFeatureH handle, const FeatureProfile* profile, bool
     Feature* f = 0L;
     if ( profile )
     {
-        f = createFeature( handle, profile->getSRS(), rewindPolygons);
+        f = createFeature( handle, profile->getSRS(), 0L, rewindPolygons);
         if ( f && profile->geoInterp().isSet() )
             f->geoInterp() = profile->geoInterp().get();
     }
     else
     {
-        f = createFeature( handle, (const SpatialReference*)0L, rewindPolygons);
+        f = createFeature( handle, (const SpatialReference*)0L, 0L, rewindPolygons);
     }
     return f;
 }            
 
 Feature*
-OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, bool rewindPolygons)
+OgrUtils::createFeature(OGRFeatureH handle, const FeatureProfile* profile, const FieldProjection& fields, bool rewindPolygons)
+{
+    Feature* f = createFeature( handle, profile ? profile->getSRS() : 0L, &fields, rewindPolygons );
+    if ( f && profile && profile->geoInterp().isSet() )
+        f->geoInterp() = profile->geoInterp().get();
+    return f;
+}
+
+Feature*
+OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, const FieldProjection* fields, bool rewindPolygons)
 {
     long fid = OGR_F_GetFID( handle );
 
@@ -528,59 +645,28 @@ OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, bool r
 
     Feature* feature = new Feature( geom, srs, Style(), fid );
 
-    int numAttrs = OGR_F_GetFieldCount(handle); 
-    for (int i = 0; i < numAttrs; ++i) 
-    { 
-        OGRFieldDefnH field_handle_ref = OGR_F_GetFieldDefnRef( handle, i ); 
-
-        // get the field name and convert to lower case:
-        const char* field_name = OGR_Fld_GetNameRef( field_handle_ref ); 
-        std::string name = osgEarth::toLower( std::string(field_name) );
-
-        // get the field type and set the value appropriately
-        OGRFieldType field_type = OGR_Fld_GetType( field_handle_ref );        
-        switch( field_type )
+    if ( fields )
+    {
+        // names and types were resolved up front
+        for (unsigned k = 0; k < fields->_indices.size(); ++k)
         {
-        case OFTInteger:
-            {     
-                if (IsFieldSet( handle, i ))
-                {
-                    int value = OGR_F_GetFieldAsInteger( handle, i );
-                    feature->set( name, value );                    
-                }
-                else
-                {
-                    feature->setNull( name, ATTRTYPE_INT );
-                }
-            }
-            break;
-        case OFTReal:
-            {
-                if (IsFieldSet( handle, i ))
-                {
-                    double value = OGR_F_GetFieldAsDouble( handle, i );
-                    feature->set( name, value );
-                }
-                else
-                {
-                    feature->setNull( name, ATTRTYPE_DOUBLE );
-                }
-            }
-            break;
-        default:
-            {
-                if (IsFieldSet( handle, i ))
-                {
-                    const char* value = OGR_F_GetFieldAsString(handle, i);
-                    feature->set( name, std::string(value) );
-                }
-                else
-                {
-                    feature->setNull( name, ATTRTYPE_STRING );
-                }
-            }
+            setAttribute( feature, handle, fields->_indices[k], fields->_names[k], fields->_types[k] );
         }
-    } 
+    }
+    else
+    {
+        int numAttrs = OGR_F_GetFieldCount(handle); 
+        for (int i = 0; i < numAttrs; ++i) 
+        { 
+            OGRFieldDefnH field_handle_ref = OGR_F_GetFieldDefnRef( handle, i ); 
+
+            // get the field name and convert to lower case:
+            const char* field_name = OGR_Fld_GetNameRef( field_handle_ref ); 
+            std::string name = osgEarth::toLower( std::string(field_name) );
+
+            setAttribute( feature, handle, i, name, OGR_Fld_GetType( field_handle_ref ) );
+        } 
+    }
 
     return feature;
 }
@@ -0,0 +1,381 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/PackedRTree>
+#include <osgEarth/Notify>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+
+#define LC "[PackedRTree] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const char     s_magic[8]  = { 'O','E','P','R','T','R','E','E' };
+    const uint32_t s_byteOrder = 0x01020304u;
+    const uint32_t s_version   = 1u;
+
+    struct FileHeader
+    {
+        char     magic[8];
+        uint32_t byteOrder; // s_byteOrder in the writer's byte order
+        uint32_t version;
+        uint32_t nodeSize;
+        uint32_t stampSize;
+        uint64_t numItems;
+        uint64_t numNodes;
+    };
+
+    // the stamp follows the header, padded so the nodes are 8-byte aligned.
+    inline uint64_t nodesOffset(uint32_t stampSize)
+    {
+        return (sizeof(FileHeader) + stampSize + 7u) & ~(uint64_t)7u;
+    }
+
+    // Position of (x, y) along a 16-bit Hilbert curve.
+    // From https://github.com/rawrunprotected/hilbert_curves (public domain)
+    uint32_t hilbert(uint32_t x, uint32_t y)
+    {
+        uint32_t a = x ^ y;
+        uint32_t b = 0xFFFF ^ a;
+        uint32_t c = 0xFFFF ^ (x | y);
+        uint32_t d = x & (y ^ 0xFFFF);
+
+        uint32_t A = a | (b >> 1);
+        uint32_t B = (a >> 1) ^ a;
+        uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+        uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+        a = A; b = B; c = C; d = D;
+        A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+        B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+        C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+        D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+        a = A; b = B; c = C; d = D;
+        A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+        B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+        C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+        D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+        a = A; b = B; c = C; d = D;
+        C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+        D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+        a = C ^ (C >> 1);
+        b = D ^ (D >> 1);
+
+        uint32_t i0 = x ^ y;
+        uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+        i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+        i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+        i0 = (i0 | (i0 << 2)) & 0x33333333;
+        i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+        i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+        i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+        i1 = (i1 | (i1 << 2)) & 0x33333333;
+        i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+        return (i1 << 1) | i0;
+    }
+
+    struct SortByHilbert
+    {
+        const std::vector<uint32_t>& _h;
+        SortByHilbert(const std::vector<uint32_t>& h) : _h(h) { }
+        bool operator()(uint64_t a, uint64_t b) const { return _h[a] < _h[b]; }
+    };
+}
+
+PackedRTree::PackedRTree(unsigned nodeSize) :
+_nodeSize  ( std::max(nodeSize, 2u) ),
+_numItems  ( 0u ),
+_numNodes  ( 0u ),
+_nodes     ( 0L ),
+_ready     ( false )
+{
+    //nop
+}
+
+PackedRTree::~PackedRTree()
+{
+    //nop
+}
+
+void
+PackedRTree::add(uint64_t id, double xmin, double ymin, double xmax, double ymax)
+{
+    Node node;
+    node.xmin = xmin, node.ymin = ymin, node.xmax = xmax, node.ymax = ymax;
+    node.index = id;
+    _built.push_back(node);
+    _numItems = _built.size();
+}
+
+void
+PackedRTree::computeLevelBounds()
+{
+    // Each level holds ceil(n/nodeSize) parents of the level below it;
+    // there is always a single root above the items.
+    _levelBounds.clear();
+
+    uint64_t n = _numItems;
+    uint64_t numNodes = n;
+    _levelBounds.push_back(numNodes);
+    do
+    {
+        n = (n + _nodeSize - 1) / _nodeSize;
+        numNodes += n;
+        _levelBounds.push_back(numNodes);
+    }
+    while (n != 1u);
+
+    _numNodes = numNodes;
+}
+
+void
+PackedRTree::finish()
+{
+    _ready = true;
+
+    if (_numItems == 0u)
+    {
+        _numNodes = 0u;
+        _nodes = 0L;
+        return;
+    }
+
+    computeLevelBounds();
+
+    // extent of all the items:
+    double xmin = DBL_MAX, ymin = DBL_MAX, xmax = -DBL_MAX, ymax = -DBL_MAX;
+    for (std::vector<Node>::const_iterator i = _built.begin(); i != _built.end(); ++i)
+    {
+        xmin = std::min(xmin, i->xmin); ymin = std::min(ymin, i->ymin);
+        xmax = std::max(xmax, i->xmax); ymax = std::max(ymax, i->ymax);
+    }
+
+    double width  = xmax - xmin;
+    double height = ymax - ymin;
+
+    // sort the items by the Hilbert value of their centers:
+    std::vector<uint32_t> h(_built.size());
+    std::vector<uint64_t> order(_built.size());
+    for (unsigned i = 0; i < _built.size(); ++i)
+    {
+        const Node& node = _built[i];
+        double x = width  > 0.0 ? 65535.0 * (0.5*(node.xmin + node.xmax) - xmin) / width  : 0.0;
+        double y = height > 0.0 ? 65535.0 * (0.5*(node.ymin + node.ymax) - ymin) / height : 0.0;
+        h[i] = hilbert((uint32_t)floor(x), (uint32_t)floor(y));
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), SortByHilbert(h));
+
+    std::vector<Node> nodes;
+    nodes.reserve(_numNodes);
+    for (unsigned i = 0; i < order.size(); ++i)
+    {
+        nodes.push_back(_built[order[i]]);
+    }
+
+    // build each level of parents from the one below it:
+    uint64_t pos = 0u;
+    for (unsigned level = 0; level + 1 < _levelBounds.size(); ++level)
+    {
+        uint64_t end = _levelBounds[level];
+        while (pos < end)
+        {
+            Node parent;
+            parent.xmin = DBL_MAX, parent.ymin = DBL_MAX, parent.xmax = -DBL_MAX, parent.ymax = -DBL_MAX;
+            parent.index = pos;
+
+            for (unsigned j = 0; j < _nodeSize && pos < end; ++j, ++pos)
+            {
+                const Node& child = nodes[pos];
+                parent.xmin = std::min(parent.xmin, child.xmin);
+                parent.ymin = std::min(parent.ymin, child.ymin);
+                parent.xmax = std::max(parent.xmax, child.xmax);
+                parent.ymax = std::max(parent.ymax, child.ymax);
+            }
+            nodes.push_back(parent);
+        }
+    }
+
+    _built.swap(nodes);
+    _nodes = &_built[0];
+}
+
+void
+PackedRTree::search(double xmin, double ymin, double xmax, double ymax,
+                    std::vector<uint64_t>& output) const
+{
+    if (!_ready || _numNodes == 0u)
+        return;
+
+    std::vector<uint64_t> stack;
+
+    // start at the root, which is the last node.
+    uint64_t nodeIndex = _numNodes - 1u;
+
+    while (true)
+    {
+        // the children of a node end at the node size or the end of their level.
+        uint64_t levelEnd = *std::upper_bound(_levelBounds.begin(), _levelBounds.end(), nodeIndex);
+        uint64_t end = std::min(nodeIndex + _nodeSize, levelEnd);
+
+        for (uint64_t pos = nodeIndex; pos < end; ++pos)
+        {
+            const Node& node = _nodes[pos];
+            if (xmax < node.xmin || ymax < node.ymin || xmin > node.xmax || ymin > node.ymax)
+                continue;
+
+            if (nodeIndex < _numItems)
+                output.push_back(node.index);
+            else
+                stack.push_back(node.index);
+        }
+
+        if (stack.empty())
+            break;
+
+        nodeIndex = stack.back();
+        stack.pop_back();
+    }
+}
+
+bool
+PackedRTree::write(const std::string& path, const std::string& stamp) const
+{
+    if (!_ready)
+        return false;
+
+    FileHeader header;
+    ::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.byteOrder = s_byteOrder;
+    header.version   = s_version;
+    header.nodeSize  = _nodeSize;
+    header.stampSize = (uint32_t)stamp.size();
+    header.numItems  = _numItems;
+    header.numNodes  = _numNodes;
+
+    // write to a temporary file and move it into place, so a reader
+    // never maps a partial index.
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+            return false;
+
+        out.write((const char*)&header, sizeof(header));
+        out.write(stamp.data(), stamp.size());
+
+        const char zeros[8] = { 0,0,0,0,0,0,0,0 };
+        out.write(zeros, nodesOffset(header.stampSize) - sizeof(header) - stamp.size());
+
+        if (_numNodes > 0u)
+            out.write((const char*)_nodes, _numNodes * sizeof(Node));
+
+        if (out.fail())
+        {
+            out.close();
+            ::remove(temp.c_str());
+            return false;
+        }
+    }
+
+    ::remove(path.c_str());
+    if (::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        ::remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool
+PackedRTree::open(const std::string& path, const std::string& stamp)
+{
+    _file.close();
+    _built.clear();
+    _levelBounds.clear();
+    _nodes = 0L;
+    _numItems = 0u;
+    _numNodes = 0u;
+    _ready = false;
+
+    if (!_file.open(path))
+        return false;
+
+    if (_file.size() < sizeof(FileHeader))
+    {
+        _file.close();
+        return false;
+    }
+
+    FileHeader header;
+    ::memcpy(&header, _file.data(), sizeof(header));
+
+    bool ok =
+        ::memcmp(header.magic, s_magic, sizeof(s_magic)) == 0 &&
+        header.byteOrder == s_byteOrder &&
+        header.version == s_version &&
+        header.nodeSize >= 2u &&
+        header.stampSize == stamp.size() &&
+        sizeof(FileHeader) + header.stampSize <= _file.size() &&
+        ::memcmp(_file.data() + sizeof(FileHeader), stamp.data(), stamp.size()) == 0;
+
+    if (ok)
+    {
+        _nodeSize = header.nodeSize;
+        _numItems = header.numItems;
+
+        if (_numItems > 0u)
+        {
+            computeLevelBounds();
+            ok =
+                _numNodes == header.numNodes &&
+                nodesOffset(header.stampSize) + _numNodes * sizeof(Node) <= _file.size();
+        }
+    }
+
+    if (!ok)
+    {
+        _file.close();
+        _levelBounds.clear();
+        _numItems = 0u;
+        _numNodes = 0u;
+        return false;
+    }
+
+    if (_numItems > 0u)
+    {
+        _nodes = (const Node*)(_file.data() + nodesOffset(header.stampSize));
+    }
+
+    _ready = true;
+    return true;
+}
@@ -18,6 +18,7 @@
  */
 #include <osgEarth/PagedNode>
 #include <osgEarth/Utils>
+#include <osgEarth/PagingScheduler>
 
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
@@ -98,6 +99,7 @@ void PagedNode::setupPaging()
         // assemble data to pass to the pseudoloader
         osgDB::Options* options = new osgDB::Options();
         OptionsData<PagedNode>::set(options, "osgEarth.PagedNode", this);
+        PagingScheduler::setSubsystem(options, PagingScheduler::PAGED_NODE);
         _plod->setDatabaseOptions( options );
 
         // Setup the min and max ranges.
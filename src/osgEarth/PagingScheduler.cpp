@@ -0,0 +1,258 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/PagingScheduler>
+#include <osgEarth/MemoryGovernor>
+#include <osgDB/DatabasePager>
+#include <osgDB/Options>
+#include <osgViewer/View>
+#include <algorithm>
+#include <functional>
+#include <cfloat>
+
+#define LC "[PagingScheduler] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define SUBSYSTEM_KEY "osgEarth.PagingSubsystem"
+
+namespace
+{
+    // DatabasePager that passes each request through the scheduler
+    // before queueing it.
+    class ScheduledDatabasePager : public osgDB::DatabasePager
+    {
+    public:
+        ScheduledDatabasePager(const osgDB::DatabasePager& rhs) :
+            osgDB::DatabasePager(rhs) { }
+
+        osgDB::DatabasePager* clone() const
+        {
+            return new ScheduledDatabasePager(*this);
+        }
+
+        void requestNodeFile(
+            const std::string& fileName,
+            osg::NodePath& nodePath,
+            float priority,
+            const osg::FrameStamp* framestamp,
+            osg::ref_ptr<osg::Referenced>& databaseRequest,
+            const osg::Referenced* options)
+        {
+            if (framestamp)
+            {
+                std::string subsystem = PagingScheduler::getSubsystem(
+                    dynamic_cast<const osgDB::Options*>(options));
+
+                if (!subsystem.empty() &&
+                    !PagingScheduler::instance()->admit(subsystem, priority, framestamp->getFrameNumber()))
+                {
+                    // Deferred; the node asks again next frame.
+                    return;
+                }
+            }
+
+            osgDB::DatabasePager::requestNodeFile(
+                fileName, nodePath, priority, framestamp, databaseRequest, options);
+        }
+    };
+}
+
+const std::string PagingScheduler::TERRAIN = "terrain";
+const std::string PagingScheduler::PAGED_NODE = "pagednode";
+const std::string PagingScheduler::SIMPLE_PAGER = "simplepager";
+const std::string PagingScheduler::FEATURES = "features";
+const std::string PagingScheduler::THREE_D_TILES = "3dtiles";
+
+PagingScheduler::Subsystem::Subsystem() :
+_quota(0u),
+_weight(1.0f),
+_frame(~0u),
+_admitted(0u),
+_cutoff(-FLT_MAX),
+_deferred(0u),
+_admittedCounter(0L),
+_deferredCounter(0L)
+{
+    //nop
+}
+
+PagingScheduler*
+PagingScheduler::instance()
+{
+    static Threading::Mutex s_mutex;
+    static osg::ref_ptr<PagingScheduler> s_instance;
+
+    Threading::ScopedMutexLock lock(s_mutex);
+    if (!s_instance.valid())
+    {
+        s_instance = new PagingScheduler();
+    }
+    return s_instance.get();
+}
+
+PagingScheduler::Subsystem&
+PagingScheduler::get(const std::string& name)
+{
+    Subsystems::iterator i = _subsystems.find(name);
+    if (i == _subsystems.end())
+    {
+        Subsystem& s = _subsystems[name];
+        s._admittedCounter = Metrics::counter("paging." + name + ".admitted");
+        s._deferredCounter = Metrics::counter("paging." + name + ".deferred");
+        return s;
+    }
+    return i->second;
+}
+
+void
+PagingScheduler::setQuota(const std::string& subsystem, unsigned value)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    get(subsystem)._quota = value;
+}
+
+unsigned
+PagingScheduler::getQuota(const std::string& subsystem) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    Subsystems::const_iterator i = _subsystems.find(subsystem);
+    return i != _subsystems.end() ? i->second._quota : 0u;
+}
+
+void
+PagingScheduler::setWeight(const std::string& subsystem, float value)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    get(subsystem)._weight = osg::maximum(value, 0.0f);
+}
+
+float
+PagingScheduler::getWeight(const std::string& subsystem) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    Subsystems::const_iterator i = _subsystems.find(subsystem);
+    return i != _subsystems.end() ? i->second._weight : 1.0f;
+}
+
+unsigned
+PagingScheduler::getNumDeferred(const std::string& subsystem) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    Subsystems::const_iterator i = _subsystems.find(subsystem);
+    return i != _subsystems.end() ? i->second._deferred : 0u;
+}
+
+bool
+PagingScheduler::admit(const std::string& subsystem, float& priority, unsigned frameNumber)
+{
+    // Under memory pressure, throttle every subsystem: halve its quota at
+    // HIGH and only let its single most important request through when
+    // over budget. (Unlimited subsystems get a nominal quota of 8.)
+    MemoryGovernor::Pressure pressure = MemoryGovernor::instance()->getPressure();
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    Subsystem& s = get(subsystem);
+
+    unsigned quota = s._quota;
+    if (pressure == MemoryGovernor::PRESSURE_HIGH)
+        quota = osg::maximum((quota > 0u ? quota : 8u) / 2u, 1u);
+    else if (pressure == MemoryGovernor::PRESSURE_CRITICAL)
+        quota = 1u;
+
+    if (frameNumber != s._frame)
+    {
+        // Pagers repeat their outstanding requests every frame, so last
+        // frame's requests tell us what this frame will look like. If there
+        // were more than the quota, only admit requests at least as
+        // important as the quota'th most important one.
+        s._cutoff = -FLT_MAX;
+        if (quota > 0u && s._priorities.size() > quota)
+        {
+            std::nth_element(
+                s._priorities.begin(),
+                s._priorities.begin() + (quota - 1u),
+                s._priorities.end(),
+                std::greater<float>());
+            s._cutoff = s._priorities[quota - 1u];
+        }
+        s._priorities.clear();
+        s._admitted = 0u;
+        s._frame = frameNumber;
+    }
+
+    bool ok = true;
+    if (quota > 0u)
+    {
+        s._priorities.push_back(priority);
+        ok = s._admitted < quota && priority >= s._cutoff;
+    }
+
+    if (ok)
+    {
+        ++s._admitted;
+        s._admittedCounter->add();
+    }
+    else
+    {
+        ++s._deferred;
+        s._deferredCounter->add();
+    }
+
+    priority *= s._weight;
+    return ok;
+}
+
+void
+PagingScheduler::setSubsystem(osgDB::Options* options, const std::string& subsystem)
+{
+    if (options)
+    {
+        options->setPluginStringData(SUBSYSTEM_KEY, subsystem);
+    }
+}
+
+std::string
+PagingScheduler::getSubsystem(const osgDB::Options* options)
+{
+    return options ? options->getPluginStringData(SUBSYSTEM_KEY) : std::string();
+}
+
+float
+PagingScheduler::fromScreenSpaceError(double error, double maxError)
+{
+    if (error <= 0.0)
+        return 0.0f;
+    if (maxError <= 0.0)
+        return 1.0f;
+    return (float)(error / (error + maxError));
+}
+
+void
+PagingScheduler::install(osgViewer::View* view)
+{
+    if (!view || !view->getDatabasePager())
+        return;
+
+    if (dynamic_cast<ScheduledDatabasePager*>(view->getDatabasePager()))
+        return;
+
+    view->setDatabasePager(new ScheduledDatabasePager(*view->getDatabasePager()));
+}
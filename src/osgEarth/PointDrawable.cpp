@@ -24,10 +24,13 @@
 #include <osgEarth/GLUtils>
 #include <osgEarth/CullingUtils>
 #include <osgEarth/LineFunctor>
+#include <osgEarth/NodeUtils>
 #include <osg/PointSprite>
 #include <osg/Point>
 #include <osgDB/ObjectWrapper>
 #include <osgUtil/Optimizer>
+#include <list>
+#include <map>
 
 
 #if defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
@@ -53,6 +56,380 @@ namespace osgEarth { namespace Serializers { namespace PointGroup
     }
 } } }
 
+namespace
+{
+    // Most vertices to pack into one shared batch
+#ifdef OE_GLES_AVAILABLE
+    const unsigned MAX_BATCH_VERTS = 0xFFFF;
+#else
+    const unsigned MAX_BATCH_VERTS = 1u << 20;
+#endif
+
+    // Whether a PointDrawable can draw from a shared batch. The shared
+    // buffers only carry positions and colors and draw every point, so
+    // anything that customizes either must draw on its own.
+    bool isBatchable(const PointDrawable* d)
+    {
+        if (d->getFirst() > 0u || d->getCount() > 0u)
+            return false;
+
+        if (d->getUpdateCallback() || d->getEventCallback() || d->getCullCallback() || d->getDrawCallback())
+            return false;
+
+        if (d->getVertexArray() == 0L || d->getColorArray() == 0L)
+            return false;
+
+        if (d->getNumPrimitiveSets() != 1u || dynamic_cast<const osg::DrawArrays*>(d->getPrimitiveSet(0)) == 0L)
+            return false;
+
+        if (d->getNormalArray() || d->getSecondaryColorArray() || d->getFogCoordArray())
+            return false;
+
+        for (unsigned i = 0; i < d->getNumTexCoordArrays(); ++i)
+            if (d->getTexCoordArray(i))
+                return false;
+
+        for (unsigned i = 0; i < d->getNumVertexAttribArrays(); ++i)
+            if (d->getVertexAttribArray(i))
+                return false;
+
+        return true;
+    }
+
+    // Changes whenever the drawable's arrays are dirtied
+    unsigned getRevision(const PointDrawable* d)
+    {
+        return d->getVertexArray()->getModifiedCount() + d->getColorArray()->getModifiedCount();
+    }
+
+    bool sameState(const osg::StateSet* a, const osg::StateSet* b)
+    {
+        if (a == b) return true;
+        if (a == 0L || b == 0L) return false;
+        return a->compare(*b, true) == 0;
+    }
+}
+
+/**
+ * Packs batchable PointDrawables into shared PointDrawables, one per
+ * distinct state set. Each drawable owns a range of the shared arrays with
+ * some room to grow; edits are copied into that range in place, and the
+ * batch is only repacked when a drawable outgrows its range or drawables
+ * come and go. Runs in the update traversal.
+ */
+class PointGroup::Batches : public osg::Referenced
+{
+public:
+    struct Batch
+    {
+        osg::ref_ptr<PointDrawable> geom;
+        osg::ref_ptr<osg::DrawElementsUInt> elements;
+        unsigned used;  // vertices allocated to members
+        bool repack;    // member ranges must be laid out again
+        bool reindex;   // element list must be rebuilt
+    };
+
+    struct Member
+    {
+        osg::ref_ptr<PointDrawable> drawable;
+        Batch* batch;
+        unsigned offset;   // first vertex of this member in the batch
+        unsigned capacity; // vertices reserved for this member
+        unsigned size;     // vertices in use
+        unsigned revision;
+        bool visible;
+        bool seen;
+
+        // state that decides which batch the member belongs to
+        const osg::StateSet* stateSet;
+        float width;
+        bool smooth;
+    };
+
+    typedef std::map<PointDrawable*, Member> Members;
+
+    Batches()
+    {
+        _geode = new osg::Geode();
+    }
+
+    void sync(PointGroup* group)
+    {
+        _unbatched.clear();
+
+        for (Members::iterator i = _members.begin(); i != _members.end(); ++i)
+            i->second.seen = false;
+
+        for (unsigned i = 0; i < group->getNumChildren(); ++i)
+        {
+            osg::Node* child = group->getChild(i);
+            PointDrawable* d = dynamic_cast<PointDrawable*>(child);
+            if (d == 0L || !isBatchable(d))
+            {
+                _unbatched.push_back(child);
+                continue;
+            }
+
+            Members::iterator mi = _members.find(d);
+            bool isNew = (mi == _members.end());
+            Member& m = isNew ? _members[d] : mi->second;
+            m.seen = true;
+
+            unsigned size = d->getVertexArray()->getNumElements();
+            bool visible = d->getNodeMask() != 0u;
+
+            bool rekey =
+                isNew ||
+                d->getStateSet() != m.stateSet ||
+                d->getPointSize() != m.width ||
+                d->getPointSmooth() != m.smooth;
+
+            if (rekey)
+            {
+                Batch* batch = isNew ? 0L : m.batch;
+                if (batch == 0L || !sameState(d->getStateSet(), batch->geom->getStateSet()))
+                {
+                    if (batch)
+                        batch->repack = true;
+
+                    m.drawable = d;
+                    m.batch = findBatch(d, size);
+                    m.batch->repack = true;
+                    m.capacity = 0u;
+                }
+
+                m.stateSet = d->getStateSet();
+                m.width = d->getPointSize();
+                m.smooth = d->getPointSmooth();
+            }
+
+            if (m.batch->repack)
+            {
+                // everything gets copied during the repack
+            }
+            else if (size > m.capacity)
+            {
+                m.batch->repack = true;
+            }
+            else
+            {
+                if (getRevision(d) != m.revision)
+                {
+                    store(m);
+                }
+                if (size != m.size || visible != m.visible)
+                {
+                    m.batch->reindex = true;
+                }
+            }
+
+            m.visible = visible;
+        }
+
+        // forget drawables that left the group
+        for (Members::iterator i = _members.begin(); i != _members.end(); )
+        {
+            if (i->second.seen == false)
+            {
+                i->second.batch->repack = true;
+                _members.erase(i++);
+            }
+            else ++i;
+        }
+
+        // collect the members of each batch that needs work
+        std::map<Batch*, std::vector<Member*> > work;
+        for (Members::iterator i = _members.begin(); i != _members.end(); ++i)
+        {
+            Batch* b = i->second.batch;
+            if (b->repack || b->reindex)
+                work[b].push_back(&i->second);
+        }
+
+        // batches created by a repack overflow land at the end of the list,
+        // so this loop still visits them.
+        for (std::list<Batch>::iterator b = _batches.begin(); b != _batches.end(); )
+        {
+            if (b->repack || b->reindex)
+            {
+                std::vector<Member*>& list = work[&(*b)];
+                if (list.empty())
+                {
+                    _geode->removeDrawable(b->geom.get());
+                    b = _batches.erase(b);
+                    continue;
+                }
+
+                if (b->repack)
+                    repack(*b, list, work);
+                else
+                    reindex(*b, list);
+            }
+            ++b;
+        }
+    }
+
+    void cull(osg::NodeVisitor& nv)
+    {
+        // batch drawables inject the shared point state themselves
+        if (_geode->getNumDrawables() > 0u)
+        {
+            _geode->accept(nv);
+        }
+
+        for (unsigned i = 0; i < _unbatched.size(); ++i)
+        {
+            _unbatched[i]->accept(nv);
+        }
+    }
+
+    void resizeGLObjectBuffers(unsigned maxSize)
+    {
+        _geode->resizeGLObjectBuffers(maxSize);
+    }
+
+    void releaseGLObjects(osg::State* state) const
+    {
+        _geode->releaseGLObjects(state);
+    }
+
+private:
+    Members _members;
+    std::list<Batch> _batches;
+    osg::ref_ptr<osg::Geode> _geode;
+    std::vector< osg::ref_ptr<osg::Node> > _unbatched;
+
+    Batch* findBatch(PointDrawable* d, unsigned size)
+    {
+        for (std::list<Batch>::iterator b = _batches.begin(); b != _batches.end(); ++b)
+        {
+            if (b->used + size <= MAX_BATCH_VERTS && sameState(d->getStateSet(), b->geom->getStateSet()))
+            {
+                return &(*b);
+            }
+        }
+        return createBatch(d);
+    }
+
+    Batch* createBatch(PointDrawable* d)
+    {
+        _batches.push_back(Batch());
+        Batch& b = _batches.back();
+        b.used = 0u;
+        b.repack = true;
+        b.reindex = false;
+
+        b.geom = new PointDrawable();
+        b.geom->setDataVariance(osg::Object::DYNAMIC);
+        b.geom->allocate(0u);
+
+        b.elements = new osg::DrawElementsUInt(GL_POINTS);
+        b.geom->removePrimitiveSet(0, b.geom->getNumPrimitiveSets());
+        b.geom->addPrimitiveSet(b.elements.get());
+
+        // Copy the state so later changes to the drawable don't leak
+        // into the other members of the batch.
+        if (d->getStateSet())
+        {
+            b.geom->setStateSet(osg::clone(d->getStateSet(), osg::CopyOp::SHALLOW_COPY));
+        }
+
+        _geode->addDrawable(b.geom.get());
+        return &b;
+    }
+
+    // Lays out the member ranges again, leaving each member some room to grow.
+    void repack(Batch& b, std::vector<Member*>& list, std::map<Batch*, std::vector<Member*> >& work)
+    {
+        unsigned total = 0u;
+        std::vector<Member*> placed;
+        placed.reserve(list.size());
+
+        for (unsigned i = 0; i < list.size(); ++i)
+        {
+            Member* m = list[i];
+            unsigned size = m->drawable->getVertexArray()->getNumElements();
+            unsigned capacity = size + size/4u;
+
+            if (total > 0u && total + capacity > MAX_BATCH_VERTS)
+            {
+                // Out of room; start a new batch with the same state.
+                m->batch = createBatch(m->drawable.get());
+                work[m->batch].push_back(m);
+                continue;
+            }
+
+            m->offset = total;
+            m->capacity = capacity;
+            total += capacity;
+            placed.push_back(m);
+        }
+
+        static_cast<osg::Vec3Array*>(b.geom->getVertexArray())->resize(total);
+        static_cast<osg::Vec4Array*>(b.geom->getColorArray())->resize(total);
+        b.used = total;
+
+        for (unsigned i = 0; i < placed.size(); ++i)
+        {
+            store(*placed[i]);
+        }
+
+        b.repack = false;
+        reindex(b, placed);
+    }
+
+    // Rebuilds the batch's element list from the visible members.
+    void reindex(Batch& b, const std::vector<Member*>& list)
+    {
+        b.elements->clear();
+        for (unsigned i = 0; i < list.size(); ++i)
+        {
+            const Member* m = list[i];
+            if (m->visible && m->batch == &b)
+            {
+                for (unsigned e = 0; e < m->size; ++e)
+                {
+                    b.elements->push_back(m->offset + e);
+                }
+            }
+        }
+        b.elements->dirty();
+        b.reindex = false;
+    }
+
+    // Copies a member's arrays into its range of the batch.
+    void store(Member& m)
+    {
+        Batch& b = *m.batch;
+        PointDrawable* d = m.drawable.get();
+
+        const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(d->getVertexArray());
+        const osg::Vec4Array* colors = static_cast<const osg::Vec4Array*>(d->getColorArray());
+        osg::Vec3Array* batchVerts = static_cast<osg::Vec3Array*>(b.geom->getVertexArray());
+        osg::Vec4Array* batchColors = static_cast<osg::Vec4Array*>(b.geom->getColorArray());
+
+        unsigned size = verts->size();
+
+        std::copy(verts->begin(), verts->end(), batchVerts->begin() + m.offset);
+        if (colors->size() == size)
+            std::copy(colors->begin(), colors->end(), batchColors->begin() + m.offset);
+
+        // Park unused vertices on a real point so they don't
+        // stretch the batch's bounds.
+        if (size > 0u)
+        {
+            std::fill(batchVerts->begin() + m.offset + size, batchVerts->begin() + m.offset + m.capacity, verts->back());
+        }
+
+        batchVerts->dirty();
+        batchColors->dirty();
+        b.geom->dirtyBound();
+
+        m.size = size;
+        m.revision = getRevision(d);
+    }
+};
+
 PointGroup::PointGroup()
 {
     //nop
@@ -61,7 +438,8 @@ PointGroup::PointGroup()
 PointGroup::PointGroup(const PointGroup& rhs, const osg::CopyOp& copy) :
 osg::Geode(rhs, copy)
 {
-    //nop
+    if (rhs.getUseBatching())
+        setUseBatching(true);
 }
 
 PointGroup::~PointGroup()
@@ -272,6 +650,59 @@ PointGroup::getPointDrawable(unsigned i)
     return i < getNumChildren() ? dynamic_cast<PointDrawable*>(getChild(i)) : 0L;
 }
 
+void
+PointGroup::setUseBatching(bool value)
+{
+    if (value == getUseBatching())
+        return;
+
+    if (value)
+    {
+        _batches = new Batches();
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+    else
+    {
+        _batches = 0L;
+        ADJUST_UPDATE_TRAV_COUNT(this, -1);
+    }
+}
+
+void
+PointGroup::traverse(osg::NodeVisitor& nv)
+{
+    if (_batches.valid())
+    {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+        {
+            _batches->sync(this);
+        }
+        else if (nv.getVisitorType() == nv.CULL_VISITOR)
+        {
+            _batches->cull(nv);
+            return;
+        }
+    }
+
+    osg::Geode::traverse(nv);
+}
+
+void
+PointGroup::resizeGLObjectBuffers(unsigned maxSize)
+{
+    osg::Geode::resizeGLObjectBuffers(maxSize);
+    if (_batches.valid())
+        _batches->resizeGLObjectBuffers(maxSize);
+}
+
+void
+PointGroup::releaseGLObjects(osg::State* state) const
+{
+    osg::Geode::releaseGLObjects(state);
+    if (_batches.valid())
+        _batches->releaseGLObjects(state);
+}
+
 //...................................................................
 
 #undef  LC
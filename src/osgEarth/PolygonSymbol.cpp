@@ -26,7 +26,8 @@ OSGEARTH_REGISTER_SIMPLE_SYMBOL(polygon, PolygonSymbol);
 PolygonSymbol::PolygonSymbol(const PolygonSymbol& rhs,const osg::CopyOp& copyop):
 Symbol(rhs, copyop),
 _fill(rhs._fill),
-_outline(rhs._outline)
+_outline(rhs._outline),
+_tessellation(rhs._tessellation)
 {
     //nop
 }
@@ -34,7 +35,8 @@ _outline(rhs._outline)
 PolygonSymbol::PolygonSymbol( const Config& conf ) :
 Symbol( conf ),
 _fill ( Fill() ),
-_outline( true )
+_outline( true ),
+_tessellation( TESSELLATION_EARCUT )
 {
     mergeConfig(conf);
 }
@@ -46,6 +48,9 @@ PolygonSymbol::getConfig() const
     conf.key() = "polygon";
     conf.set( "fill", _fill );
     conf.set("outline", _outline);
+    conf.set("tessellation", "earcut",  _tessellation, TESSELLATION_EARCUT);
+    conf.set("tessellation", "earclip", _tessellation, TESSELLATION_EARCLIP);
+    conf.set("tessellation", "osg",     _tessellation, TESSELLATION_OSG);
     return conf;
 }
 
@@ -54,6 +59,9 @@ PolygonSymbol::mergeConfig(const Config& conf )
 {
     conf.get( "fill", _fill );
     conf.get("outline", _outline);
+    conf.get("tessellation", "earcut",  _tessellation, TESSELLATION_EARCUT);
+    conf.get("tessellation", "earclip", _tessellation, TESSELLATION_EARCLIP);
+    conf.get("tessellation", "osg",     _tessellation, TESSELLATION_OSG);
 }
 
 void
@@ -65,6 +73,11 @@ PolygonSymbol::parseSLD(const Config& c, Style& style)
     else if ( match(c.key(), "fill-opacity") ) {
         style.getOrCreate<PolygonSymbol>()->fill()->color().a() = as<float>( c.value(), 1.0f );
     }
+    else if ( match(c.key(), "fill-tessellation") ) {
+        if      ( match(c.value(), "earcut") )  style.getOrCreate<PolygonSymbol>()->tessellation() = TESSELLATION_EARCUT;
+        else if ( match(c.value(), "earclip") ) style.getOrCreate<PolygonSymbol>()->tessellation() = TESSELLATION_EARCLIP;
+        else if ( match(c.value(), "osg") )     style.getOrCreate<PolygonSymbol>()->tessellation() = TESSELLATION_OSG;
+    }
     else if ( match(c.key(), "fill-script") ) {
         style.getOrCreate<PolygonSymbol>()->script() = StringExpression(c.value());
     }
@@ -27,6 +27,13 @@
 #include <osgEarth/GeometryUtils>
 #include <osgEarth/Network>
 #include <osgEarth/Math>
+#include <osgEarth/WireLines>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/Containers>
+
+#include <osg/MatrixTransform>
+#include <osg/Geode>
 
 #include <algorithm>
 #include <iterator>
@@ -97,8 +104,10 @@ PowerlineLayer::Options::Options(const ConfigOptions& options)
 void PowerlineLayer::Options::fromConfig(const Config& conf)
 {
     _point_features.init(false);
+    _gpu_cables.init(true);
 
     conf.get("point_features", point_features());
+    conf.get("gpu_cables", gpu_cables());
     lineSource().get(conf, "line_features");
     FeatureDisplayLayout layout = _layout.get();
     layout.cropFeatures() = true;
@@ -114,6 +123,7 @@ Config
 PowerlineLayer::Options::getConfig() const
 {
     Config conf = FeatureModelLayer::Options::getConfig();
+    conf.set("gpu_cables", gpu_cables());
     lineSource().set(conf, "line_features");
     for (std::vector<ModelOptions>::const_iterator i = towerModels().begin();
         i != towerModels().end();
@@ -130,6 +140,33 @@ void PowerlineLayer::Options::mergeConfig(const Config& conf)
     fromConfig(conf);
 }
 
+namespace
+{
+    // A solved cable span: the curve parameters and the frame in which to
+    // evaluate them, in world (ECEF) coordinates. See makeCatenary().
+    struct CableSpan
+    {
+        osg::Matrixd cat2world;
+        double a, x1, C;
+        double d;        // horizontal distance between the attachment points
+        double h;        // height difference between the attachment points
+        double straight; // straight-line distance between the attachment points
+        bool swapped;    // curve runs from the second point back to the first
+    };
+
+    // Every cable in one feature tile. Kept per tile so that a tile paging
+    // back in skips the network, attachment and solver work.
+    struct CablePlacement : public osg::Referenced
+    {
+        struct Cable
+        {
+            osg::ref_ptr<Feature> feature; // source line, for its attributes
+            std::vector<CableSpan> spans;
+        };
+        std::vector<Cable> cables;
+    };
+}
+
 class PowerlineFeatureNodeFactory : public GeomFeatureNodeFactory
 {
 public:
@@ -140,15 +177,20 @@ public:
                             osg::ref_ptr<osg::Node>& node,
                             const Query& query);
 private:
-    FeatureList makeCableFeatures(FeatureList& powerFeatures, FeatureList& towerFeatures,
-                                  const FilterContext& cx, const Query& query, const Style& style);
+    CablePlacement* makeCablePlacement(FeatureList& powerFeatures, FeatureList& towerFeatures,
+                                       const FilterContext& cx, const Query& query);
+    FeatureList makeCableFeatures(const CablePlacement& placement, const FilterContext& cx,
+                                  const Style& style);
+    osg::Node* makeCableNode(const CablePlacement& placement, const Style& style);
     std::string _lineSourceLayer;
     FeatureSource::Options _lineSource;
     Vec3dVector _attachments;
     std::string _modelName;
     osg::ref_ptr<StyleSheet> _styles;
     bool _point_features;
+    bool _gpu_cables;
     float _maxSag;
+    LRUCache<std::string, osg::ref_ptr<CablePlacement> > _placements;
 };
 
 PowerlineFeatureNodeFactory::PowerlineFeatureNodeFactory(const PowerlineLayer::Options& options, StyleSheet* styles)
@@ -157,7 +199,9 @@ PowerlineFeatureNodeFactory::PowerlineFeatureNodeFactory(const PowerlineLayer::O
       _lineSource(options.lineSourceEmbeddedOptions().get()),
       _styles(styles),
       _point_features(true),
-      _maxSag(6.0)
+      _gpu_cables(options.gpu_cables().get()),
+      _maxSag(6.0),
+      _placements(true, 128u)
 {
     if (options.towerModels().empty())
         return;
@@ -216,7 +260,7 @@ namespace
                 FeatureID fid = feature->getFID();
                 for (int seg = 0; seg < geom->size() - 1; ++seg)
                 {
-                    network.addEdge(EdgeNode(fid, seg), (*geom)[seg], (*geom)[seg - 1]);
+                    network.addEdge(EdgeNode(fid, seg), (*geom)[seg], (*geom)[seg + 1]);
                 }
             }
     }
@@ -434,9 +478,8 @@ namespace
 }
 
 
-void makeCatenary(osg::Vec3d p1, osg::Vec3d p2, const osg::Matrixd& orientation, double slack,
-                  double maxSag,
-                  std::vector<osg::Vec3d>& result, float tessellationSize)
+CableSpan solveCatenary(osg::Vec3d p1, osg::Vec3d p2, const osg::Matrixd& orientation, double slack,
+                        double maxSag)
 {
     // Create a frame centered at p1 with orientation normal to
     // earth's surface
@@ -497,9 +540,27 @@ void makeCatenary(osg::Vec3d p1, osg::Vec3d p2, const osg::Matrixd& orientation,
         double Lmin = solveBisect(minimum, newGuess, straightDist * slack, 0.01, 8);
         func = CatenaryFunc::solveIt(Lmin, d, h);
     }
+    CableSpan span;
+    span.cat2world = FrameCat * FrameP1;
+    span.a = func.a;
+    span.x1 = func.x1;
+    span.C = func.C;
+    span.d = d;
+    span.h = h;
+    span.straight = straightDist;
+    span.swapped = swapped;
+    return span;
+}
+
+void makeCatenary(const CableSpan& span, std::vector<osg::Vec3d>& result, float tessellationSize)
+{
+    const double d = span.d;
+    const double h = span.h;
+    const bool swapped = span.swapped;
+    CatenaryFunc func(span.a, span.x1, span.C);
     const osg::Vec3d P1(0.0, 0.0, 0.0), P2(d, 0.0, h);
     double begin, inc;
-    int numSteps = ceil(p2local.length() / tessellationSize);
+    int numSteps = ceil(span.straight / tessellationSize);
     std::vector<osg::Vec3d> cablePts;
     if (swapped)
     {
@@ -519,7 +580,7 @@ void makeCatenary(osg::Vec3d p1, osg::Vec3d p2, const osg::Matrixd& orientation,
         double z = func(x);
         cablePts.push_back(osg::Vec3d(x, 0.0, z));
     }
-    osg::Matrixd cat2world = FrameCat * FrameP1;
+    const osg::Matrixd& cat2world = span.cat2world;
     for (std::vector<osg::Vec3d>::iterator itr = cablePts.begin(), end = cablePts.end();
          itr != end;
          ++itr)
@@ -573,19 +634,18 @@ osg::Matrixd getLocalToWorld(const osg::Vec3d& geodeticPt,
     return result;
 }
 
-FeatureList PowerlineFeatureNodeFactory::makeCableFeatures(FeatureList& powerFeatures,
-                                                           FeatureList& towerFeatures, const FilterContext& cx,
-                                                           const Query& query,
-                                                           const Style& cableStyle)
-
+CablePlacement* PowerlineFeatureNodeFactory::makeCablePlacement(FeatureList& powerFeatures,
+                                                                FeatureList& towerFeatures,
+                                                                const FilterContext& cx,
+                                                                const Query& query)
 {
-    FeatureList result;
+    osg::ref_ptr<CablePlacement> result = new CablePlacement();
     const Session* session = cx.getSession();
 
     // the map against which we'll be doing elevation clamping
     osg::ref_ptr<const Map> map = session->getMap();
     if (!map.valid() || _attachments.empty())
-        return result;
+        return result.release();
 
     const SpatialReference* mapSRS = map->getSRS();
     osg::ref_ptr<const SpatialReference> featureSRS = cx.profile()->getSRS();
@@ -650,6 +710,8 @@ FeatureList PowerlineFeatureNodeFactory::makeCableFeatures(FeatureList& powerFea
                 osg::Matrixd geodMat = getLocalToWorld(itr->first, featureSRS.get(), targetSRS);
                 towerMats.push_back(headingMat * geodMat);
             }
+            if (towerMats.size() < 2)
+                continue;
             // For various reasons the headings of successive towers can be inconsistant, causing
             // the cables between attachment points to cross each other. Ideally, the points are
             // specified in pairs. If the attachment point being used causes a cable to cross over
@@ -661,13 +723,14 @@ FeatureList PowerlineFeatureNodeFactory::makeCableFeatures(FeatureList& powerFea
             {
                 for (int startingAttachment = 0; startingAttachment < 2; ++startingAttachment)
                 {
-                    // New feature for each cable
-                    Feature* newFeature = new Feature(*feature);
-                    LineString* newGeom = new LineString(size);
+                    // New cable for each attachment
+                    result->cables.push_back(CablePlacement::Cable());
+                    CablePlacement::Cable& cable = result->cables.back();
+                    cable.feature = feature;
                     int currAttachment = startingAttachment;
                     std::vector<osg::Vec3d> cablePoints;
                     cablePoints.push_back(attachments(attachRow, currAttachment) * towerMats[0]);
-                    for (int i = 1; i < size; ++i)
+                    for (int i = 1; i < towerMats.size(); ++i)
                     {
                         int next = chooseAttachment(towerMats[i - 1], towerMats[i],
                                                     attachments(attachRow, currAttachment),
@@ -676,41 +739,105 @@ FeatureList PowerlineFeatureNodeFactory::makeCableFeatures(FeatureList& powerFea
                         cablePoints.push_back(worldAttach);
                         currAttachment = next;
                     }
-                    const bool catenary = true;
-                    std::vector<osg::Vec3d> *cableSource = 0L;
-                    std::vector<osg::Vec3d> catenaryPoints;
-                    if (catenary)
-                    {
-                        for (int i = 0; i < cablePoints.size() -1; ++i)
-                        {
-                            makeCatenary(cablePoints[i], cablePoints[i + 1], towerMats[i], 1.002, _maxSag,
-                                         catenaryPoints,
-                                         cableStyle.get<LineSymbol>()->tessellationSize()->as(Units::METERS));
-                        }
-                        cableSource = &catenaryPoints;
-                    }
-                    else
-                    {
-                        cableSource = &cablePoints;
-                    }
-                    for (std::vector<osg::Vec3d>::iterator itr = cableSource->begin();
-                         itr != cableSource->end();
-                         ++itr)
+                    for (int i = 0; i < (int)cablePoints.size() - 1; ++i)
                     {
-                        osg::Vec3d wgs84, mapAttach;
-                        featureSRS->getGeographicSRS()->transformFromWorld(*itr, wgs84);
-                        featureSRS->getGeographicSRS()->transform(wgs84, featureSRS.get(), mapAttach);
-                        newGeom->push_back(mapAttach);
+                        cable.spans.push_back(
+                            solveCatenary(cablePoints[i], cablePoints[i + 1], towerMats[i], 1.002, _maxSag));
                     }
-                    newFeature->setGeometry(newGeom);
-                    result.push_back(newFeature);
                 }
             }
         }
     }
+    return result.release();
+}
+
+FeatureList PowerlineFeatureNodeFactory::makeCableFeatures(const CablePlacement& placement,
+                                                           const FilterContext& cx,
+                                                           const Style& cableStyle)
+{
+    FeatureList result;
+    osg::ref_ptr<const SpatialReference> featureSRS = cx.profile()->getSRS();
+    const float tessellationSize = cableStyle.get<LineSymbol>()->tessellationSize()->as(Units::METERS);
+
+    for (std::vector<CablePlacement::Cable>::const_iterator cable = placement.cables.begin();
+         cable != placement.cables.end();
+         ++cable)
+    {
+        std::vector<osg::Vec3d> catenaryPoints;
+        for (std::vector<CableSpan>::const_iterator span = cable->spans.begin();
+             span != cable->spans.end();
+             ++span)
+        {
+            makeCatenary(*span, catenaryPoints, tessellationSize);
+        }
+
+        Feature* newFeature = new Feature(*cable->feature.get());
+        LineString* newGeom = new LineString(catenaryPoints.size());
+        for (std::vector<osg::Vec3d>::iterator itr = catenaryPoints.begin();
+             itr != catenaryPoints.end();
+             ++itr)
+        {
+            osg::Vec3d wgs84, mapAttach;
+            featureSRS->getGeographicSRS()->transformFromWorld(*itr, wgs84);
+            featureSRS->getGeographicSRS()->transform(wgs84, featureSRS.get(), mapAttach);
+            newGeom->push_back(mapAttach);
+        }
+        newFeature->setGeometry(newGeom);
+        result.push_back(newFeature);
+    }
     return result;
 }
 
+// Builds the cables as instanced wires that the vertex shader shapes from
+// the span parameters, rather than tessellating every span on the CPU.
+osg::Node* PowerlineFeatureNodeFactory::makeCableNode(const CablePlacement& placement,
+                                                      const Style& cableStyle)
+{
+    std::vector<WireLinesOperator::CatenarySpan> spans;
+    double maxStraight = 0.0;
+    osg::Vec3d origin;
+
+    for (std::vector<CablePlacement::Cable>::const_iterator cable = placement.cables.begin();
+         cable != placement.cables.end();
+         ++cable)
+    {
+        for (std::vector<CableSpan>::const_iterator span = cable->spans.begin();
+             span != cable->spans.end();
+             ++span)
+        {
+            if (spans.empty())
+                origin = span->cat2world.getTrans();
+
+            // localize to the first span so the shader works in floats
+            WireLinesOperator::CatenarySpan wire;
+            wire.frame = span->cat2world * osg::Matrixd::translate(-origin);
+            wire.a = span->a;
+            wire.x1 = span->x1;
+            wire.C = span->C;
+            wire.length = span->d;
+            spans.push_back(wire);
+
+            maxStraight = osg::maximum(maxStraight, span->straight);
+        }
+    }
+
+    if (spans.empty())
+        return 0L;
+
+    const LineSymbol* line = cableStyle.get<LineSymbol>();
+    double tessellationSize = line->tessellationSize()->as(Units::METERS);
+    unsigned segments = osg::clampBetween((unsigned)ceil(maxStraight / tessellationSize), 1u, 64u);
+
+    WireLinesOperator wires(*line->stroke());
+    osg::Geode* geode = new osg::Geode();
+    geode->addDrawable(wires.createCatenaries(spans, segments));
+
+    osg::MatrixTransform* xform = new osg::MatrixTransform(osg::Matrixd::translate(origin));
+    xform->addChild(geode);
+    wires.installCatenaryShaders(xform);
+    return xform;
+}
+
 bool PowerlineFeatureNodeFactory::createOrUpdateNode(FeatureCursor* cursor, const Style& style,
                                                      const FilterContext& context,
                                                      osg::ref_ptr<osg::Node>& node,
@@ -782,11 +909,36 @@ bool PowerlineFeatureNodeFactory::createOrUpdateNode(FeatureCursor* cursor, cons
     GeomFeatureNodeFactory::createOrUpdateNode(listCursor.get(), towerStyle, localCX, pointsNode, query);
     osg::ref_ptr<osg::Group> results(new osg::Group);
     results->addChild(pointsNode.get());
-    FeatureList cableFeatures =  makeCableFeatures(workingSet, pointSet, localCX, query,
-                                                   cableStyle);
-    GeometryCompiler compiler;
-    osg::Node* cables = compiler.compile(cableFeatures, cableStyle, localCX);
-    results->addChild(cables);
+    // Reuse this tile's cable placement if it has paged in before.
+    osg::ref_ptr<CablePlacement> placement;
+    std::string placementKey = query.tileKey().isSet() ? query.tileKey()->str() : std::string();
+    LRUCache<std::string, osg::ref_ptr<CablePlacement> >::Record record;
+    if (!placementKey.empty() && _placements.get(placementKey, record))
+    {
+        placement = record.value();
+    }
+    else
+    {
+        placement = makeCablePlacement(workingSet, pointSet, localCX, query);
+        if (!placementKey.empty())
+            _placements.insert(placementKey, placement.get());
+    }
+
+    osg::Node* cables = 0L;
+    if (_gpu_cables &&
+        localCX.getSession()->isMapGeocentric() &&
+        Registry::capabilities().supportsTextureBuffer())
+    {
+        cables = makeCableNode(*placement.get(), cableStyle);
+    }
+    else
+    {
+        FeatureList cableFeatures = makeCableFeatures(*placement.get(), localCX, cableStyle);
+        GeometryCompiler compiler;
+        cables = compiler.compile(cableFeatures, cableStyle, localCX);
+    }
+    if (cables)
+        results->addChild(cables);
     node = results;
     return true;
 }
@@ -19,7 +19,11 @@
 
 #include <osgEarth/PrimitiveIntersector>
 #include <osgEarth/Utils>
+#include <osgEarth/ThreadingUtils>
 #include <osg/TemplatePrimitiveFunctor>
+#include <osg/TriangleIndexFunctor>
+#include <osg/UserDataContainer>
+#include <algorithm>
 
 #define LC "[PrmitiveIntersector] "
 
@@ -305,6 +309,265 @@ struct PrimitiveIntersectorFunctor
 
 };
 
+
+// Bounding volume hierarchy over the triangles of one geometry. Built on
+// the first pick and cached in the drawable's user data container; rebuilt
+// if the vertex array or primitive sets change.
+struct PrimitiveBVH : public osg::Object
+{
+    META_Object(osgEarth, PrimitiveBVH);
+
+    struct Triangle
+    {
+        unsigned _i[3];     // vertex indices
+        unsigned _ordinal;  // primitive ordinal, as counted by the functor
+    };
+
+    struct Node
+    {
+        osg::BoundingBox _box;
+        unsigned _left, _right;  // children (interior nodes)
+        unsigned _first, _count; // triangle range (leaves; _count > 0)
+    };
+
+    std::vector<Triangle> _triangles;
+    std::vector<Node> _nodes;
+    unsigned _revision;
+
+    PrimitiveBVH() : _revision(0u) { }
+    PrimitiveBVH(const PrimitiveBVH& rhs, const osg::CopyOp& op) :
+        osg::Object(rhs, op), _triangles(rhs._triangles), _nodes(rhs._nodes), _revision(rhs._revision) { }
+
+    // Sum of the modified counts of the vertex data and primitive sets;
+    // changes whenever either is dirtied.
+    static unsigned getRevision(const osg::Geometry* geom)
+    {
+        unsigned rev = geom->getVertexArray()->getModifiedCount() + geom->getVertexArray()->getNumElements();
+        for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+            rev += geom->getPrimitiveSet(i)->getModifiedCount() + geom->getPrimitiveSet(i)->getNumIndices();
+        return rev;
+    }
+
+    // Only plain triangle lists with Vec3 vertices qualify; anything else
+    // (points and lines need the thickness buffer) takes the functor path.
+    static bool supports(const osg::Geometry* geom)
+    {
+        if (!geom || !dynamic_cast<const osg::Vec3Array*>(geom->getVertexArray()))
+            return false;
+        if (geom->getNumPrimitiveSets() == 0)
+            return false;
+        for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+        {
+            if (geom->getPrimitiveSet(i)->getMode() != GL_TRIANGLES)
+                return false;
+        }
+        return true;
+    }
+
+    struct Collector
+    {
+        std::vector<Triangle>* _triangles;
+        void operator()(unsigned i0, unsigned i1, unsigned i2)
+        {
+            Triangle t;
+            t._i[0] = i0;
+            t._i[1] = i1;
+            t._i[2] = i2;
+            t._ordinal = _triangles->size();
+            _triangles->push_back(t);
+        }
+    };
+
+    struct CompareCentroids
+    {
+        const osg::Vec3Array& _verts;
+        int _axis;
+        CompareCentroids(const osg::Vec3Array& verts, int axis) : _verts(verts), _axis(axis) { }
+        float centroid(const Triangle& t) const {
+            return _verts[t._i[0]][_axis] + _verts[t._i[1]][_axis] + _verts[t._i[2]][_axis];
+        }
+        bool operator()(const Triangle& lhs, const Triangle& rhs) const {
+            return centroid(lhs) < centroid(rhs);
+        }
+    };
+
+    void build(osg::Geometry* geom)
+    {
+        _triangles.clear();
+        _nodes.clear();
+        _revision = getRevision(geom);
+
+        osg::TriangleIndexFunctor<Collector> collect;
+        collect._triangles = &_triangles;
+        geom->accept(collect);
+
+        const osg::Vec3Array& verts = static_cast<const osg::Vec3Array&>(*geom->getVertexArray());
+        for (std::vector<Triangle>::const_iterator t = _triangles.begin(); t != _triangles.end(); ++t)
+        {
+            if (t->_i[0] >= verts.size() || t->_i[1] >= verts.size() || t->_i[2] >= verts.size())
+            {
+                _triangles.clear();
+                return;
+            }
+        }
+
+        if (!_triangles.empty())
+        {
+            _nodes.reserve(2 * _triangles.size() / LEAF_SIZE + 1);
+            build(verts, 0, _triangles.size());
+        }
+    }
+
+    // Builds the subtree for triangles [first, first+count) and returns
+    // its node index. Splits at the median centroid on the longest axis.
+    unsigned build(const osg::Vec3Array& verts, unsigned first, unsigned count)
+    {
+        unsigned index = _nodes.size();
+        _nodes.push_back(Node());
+
+        osg::BoundingBox box, centroids;
+        for (unsigned i = first; i < first + count; ++i)
+        {
+            const Triangle& t = _triangles[i];
+            box.expandBy(verts[t._i[0]]);
+            box.expandBy(verts[t._i[1]]);
+            box.expandBy(verts[t._i[2]]);
+            centroids.expandBy((verts[t._i[0]] + verts[t._i[1]] + verts[t._i[2]]) / 3.0f);
+        }
+
+        _nodes[index]._box = box;
+
+        if (count <= LEAF_SIZE)
+        {
+            _nodes[index]._first = first;
+            _nodes[index]._count = count;
+            return index;
+        }
+
+        osg::Vec3 extent = centroids._max - centroids._min;
+        int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+
+        unsigned half = count / 2;
+        std::nth_element(
+            _triangles.begin() + first,
+            _triangles.begin() + first + half,
+            _triangles.begin() + first + count,
+            CompareCentroids(verts, axis));
+
+        unsigned left = build(verts, first, half);
+        unsigned right = build(verts, first + half, count - half);
+        _nodes[index]._left = left;
+        _nodes[index]._right = right;
+        _nodes[index]._count = 0u;
+        return index;
+    }
+
+    // Segment/box slab test in double precision.
+    static bool intersects(const osg::Vec3d& s, const osg::Vec3d& d, const osg::BoundingBox& box)
+    {
+        const double epsilon = 1e-4;
+        double t0 = 0.0, t1 = 1.0;
+        for (int a = 0; a < 3; ++a)
+        {
+            double lo = (double)box._min[a] - epsilon, hi = (double)box._max[a] + epsilon;
+            if (d[a] == 0.0)
+            {
+                if (s[a] < lo || s[a] > hi)
+                    return false;
+            }
+            else
+            {
+                double inv = 1.0 / d[a];
+                double ta = (lo - s[a]) * inv, tb = (hi - s[a]) * inv;
+                if (ta > tb) std::swap(ta, tb);
+                if (ta > t0) t0 = ta;
+                if (tb < t1) t1 = tb;
+                if (t0 > t1)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Runs the functor's triangle test on every triangle whose leaf box
+    // the segment s->e crosses.
+    void intersect(const osg::Vec3Array& verts, const osg::Vec3d& s, const osg::Vec3d& e, PrimitiveIntersectorFunctor& func) const
+    {
+        if (_nodes.empty())
+            return;
+
+        osg::Vec3d d = e - s;
+        unsigned stack[64];
+        int top = 0;
+        stack[top++] = 0u;
+
+        while (top > 0)
+        {
+            const Node& node = _nodes[stack[--top]];
+            if (!intersects(s, d, node._box))
+                continue;
+
+            if (node._count > 0)
+            {
+                for (unsigned i = node._first; i < node._first + node._count; ++i)
+                {
+                    const Triangle& t = _triangles[i];
+                    const osg::Vec3& v1 = verts[t._i[0]];
+                    const osg::Vec3& v2 = verts[t._i[1]];
+                    const osg::Vec3& v3 = verts[t._i[2]];
+                    func._index = t._ordinal;
+                    func.triNoBuffer(v1, v2, v3, &v1, &v2, &v3, false);
+                    if (func._limitOneIntersection && func._hit)
+                        return;
+                }
+            }
+            else if (top < 62)
+            {
+                stack[top++] = node._right;
+                stack[top++] = node._left;
+            }
+        }
+    }
+
+    enum { LEAF_SIZE = 4 };
+};
+
+// Returns the BVH for a drawable, building it if necessary, or NULL if
+// the drawable doesn't qualify. A stale BVH is replaced rather than rebuilt
+// in place, so a concurrent pick can keep using the old one.
+osg::ref_ptr<const PrimitiveBVH> getOrCreateBVH(osg::Drawable* drawable)
+{
+    static Threading::Mutex s_mutex;
+    static const char* s_name = "osgEarth.PrimitiveBVH";
+
+    osg::Geometry* geom = drawable->asGeometry();
+    if (!PrimitiveBVH::supports(geom))
+        return 0L;
+
+    Threading::ScopedMutexLock lock(s_mutex);
+
+    osg::UserDataContainer* udc = geom->getOrCreateUserDataContainer();
+    unsigned index = udc->getUserObjectIndex(s_name);
+    PrimitiveBVH* bvh = index < udc->getNumUserObjects() ?
+        dynamic_cast<PrimitiveBVH*>(udc->getUserObject(index)) : 0L;
+
+    if (!bvh || bvh->_revision != PrimitiveBVH::getRevision(geom))
+    {
+        osg::ref_ptr<PrimitiveBVH> newBVH = new PrimitiveBVH();
+        newBVH->setName(s_name);
+        newBVH->build(geom);
+
+        if (bvh)
+            udc->setUserObject(index, newBVH.get());
+        else
+            udc->addUserObject(newBVH.get());
+
+        return newBVH.get();
+    }
+
+    return bvh;
+}
+
 } //namespace
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -314,7 +577,8 @@ struct PrimitiveIntersectorFunctor
 PrimitiveIntersector::PrimitiveIntersector() :
 _parent(0),
 _thicknessVal(0),
-_overlayIgnore(false)
+_overlayIgnore(false),
+_useBVH(false)
 {
     //nop
 }
@@ -322,7 +586,8 @@ _overlayIgnore(false)
 PrimitiveIntersector::PrimitiveIntersector(CoordinateFrame cf, double x, double y, double thickness):
     Intersector(cf),
     _parent(0),
-    _overlayIgnore(false)
+    _overlayIgnore(false),
+    _useBVH(false)
 {
     switch(cf)
     {
@@ -338,7 +603,8 @@ PrimitiveIntersector::PrimitiveIntersector(CoordinateFrame cf, double x, double
 PrimitiveIntersector::PrimitiveIntersector(CoordinateFrame cf, const osg::Vec3d& start, const osg::Vec3d& end, double thickness, bool overlayIgnore):
     Intersector(cf),
     _parent(0),
-    _overlayIgnore(overlayIgnore)
+    _overlayIgnore(overlayIgnore),
+    _useBVH(false)
 {
   _start.set(start);
   _end.set(end);
@@ -365,6 +631,7 @@ osgUtil::Intersector* PrimitiveIntersector::clone(osgUtil::IntersectionVisitor&
         lsi->_thicknessVal = _thicknessVal;
         lsi->_parent = this;
         lsi->_intersectionLimit = _intersectionLimit;
+        lsi->_useBVH = _useBVH;
 
         return lsi.release();
     }
@@ -405,6 +672,7 @@ osgUtil::Intersector* PrimitiveIntersector::clone(osgUtil::IntersectionVisitor&
     lsi->_thicknessVal = _thicknessVal;
     lsi->_parent = this;
     lsi->_intersectionLimit = _intersectionLimit;
+    lsi->_useBVH = _useBVH;
     
     return lsi.release();
 }
@@ -446,7 +714,20 @@ void PrimitiveIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Draw
 
     ti.set(s,e,_thickness-_start);
     ti._limitOneIntersection = (_intersectionLimit == LIMIT_ONE_PER_DRAWABLE || _intersectionLimit == LIMIT_ONE);
-    drawable->accept(ti);
+
+    osg::ref_ptr<const PrimitiveBVH> bvh;
+    if (_useBVH)
+        bvh = getOrCreateBVH(drawable);
+
+    if (bvh.valid())
+    {
+        const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(drawable->asGeometry()->getVertexArray());
+        bvh->intersect(*verts, s, e, ti);
+    }
+    else
+    {
+        drawable->accept(ti);
+    }
 
     if (ti._hit)
     {
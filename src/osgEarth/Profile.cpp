@@ -348,9 +348,11 @@ osg::Referenced( true )
 
     // make a profile sig (sans srs) and an srs sig for quick comparisons.
     ProfileOptions temp = toProfileOptions();
-    _fullSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+    _fullSignatureHash = hashString( temp.getConfig().toJSON() );
+    _fullSignature = Stringify() << std::hex << _fullSignatureHash;
     temp.vsrsString() = "";
-    _horizSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+    _horizSignatureHash = hashString( temp.getConfig().toJSON() );
+    _horizSignature = Stringify() << std::hex << _horizSignatureHash;
 }
 
 Profile::Profile(const SpatialReference* srs,
@@ -375,9 +377,11 @@ osg::Referenced( true )
 
     // make a profile sig (sans srs) and an srs sig for quick comparisons.
     ProfileOptions temp = toProfileOptions();
-    _fullSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+    _fullSignatureHash = hashString( temp.getConfig().toJSON() );
+    _fullSignature = Stringify() << std::hex << _fullSignatureHash;
     temp.vsrsString() = "";
-    _horizSignature = Stringify() << std::hex << hashString( temp.getConfig().toJSON() );
+    _horizSignatureHash = hashString( temp.getConfig().toJSON() );
+    _horizSignature = Stringify() << std::hex << _horizSignatureHash;
 }
 
 Profile::ProfileType
@@ -500,13 +504,13 @@ Profile::getProfileTypeFromSRS(const std::string& srs_string)
 bool
 Profile::isEquivalentTo( const Profile* rhs ) const
 {
-    return rhs && getFullSignature() == rhs->getFullSignature();
+    return rhs && _fullSignatureHash == rhs->_fullSignatureHash;
 }
 
 bool
 Profile::isHorizEquivalentTo( const Profile* rhs ) const
 {
-    return rhs && getHorizSignature() == rhs->getHorizSignature();
+    return rhs && _horizSignatureHash == rhs->_horizSignatureHash;
 }
 
 void
@@ -727,6 +731,9 @@ Profile::addIntersectingTiles(const GeoExtent& key_ext, unsigned localLOD, std::
 
     OE_DEBUG << std::fixed << "  Dest Tiles: " << tileMinX << "," << tileMinY << " => " << tileMaxX << "," << tileMaxY << std::endl;
 
+    out_intersectingKeys.reserve(
+        out_intersectingKeys.size() + (tileMaxX - tileMinX + 1) * (tileMaxY - tileMinY + 1));
+
     for (int i = tileMinX; i <= tileMaxX; ++i)
     {
         for (int j = tileMinY; j <= tileMaxY; ++j)
@@ -798,6 +805,26 @@ Profile::getEquivalentLOD( const Profile* rhsProfile, unsigned rhsLOD ) const
     if (rhsProfile->isHorizEquivalentTo( this ) ) 
         return rhsLOD;
 
+    // This runs for every tile request against a layer in a foreign profile,
+    // so remember the answer for each source profile and LOD.
+    std::pair<unsigned, unsigned> cacheKey(rhsProfile->_fullSignatureHash, rhsLOD);
+    {
+        Threading::ScopedMutexLock lock(_equivalentLODsMutex);
+        EquivalentLODCache::const_iterator i = _equivalentLODs.find(cacheKey);
+        if (i != _equivalentLODs.end())
+            return i->second;
+    }
+
+    unsigned lod = computeEquivalentLOD(rhsProfile, rhsLOD);
+
+    Threading::ScopedMutexLock lock(_equivalentLODsMutex);
+    _equivalentLODs[cacheKey] = lod;
+    return lod;
+}
+
+unsigned
+Profile::computeEquivalentLOD( const Profile* rhsProfile, unsigned rhsLOD ) const
+{
     // Special check for geodetic to mercator or vise versa, they should match up in LOD.
     if ((rhsProfile->isEquivalentTo(Registry::instance()->getSphericalMercatorProfile()) && isEquivalentTo(Registry::instance()->getGlobalGeodeticProfile())) ||
         (rhsProfile->isEquivalentTo(Registry::instance()->getGlobalGeodeticProfile()) && isEquivalentTo(Registry::instance()->getSphericalMercatorProfile())))
@@ -32,7 +32,8 @@ _bounds(rhs._bounds),
 _expression(rhs._expression),
 _orderby(rhs._orderby),
 _tileKey(rhs._tileKey),
-_limit(rhs._limit)
+_limit(rhs._limit),
+_attributes(rhs._attributes)
 {
     //nop
 }
@@ -58,6 +59,14 @@ Query::mergeConfig( const Config& conf )
     }
 
     conf.get("limit", _limit);
+
+    std::string attributes;
+    if ( conf.get("attributes", attributes) )
+    {
+        StringVector tokens;
+        StringTokenizer( attributes, tokens, ",", "", false, true );
+        _attributes = std::set<std::string>( tokens.begin(), tokens.end() );
+    }
 }
 
 Config
@@ -67,6 +76,12 @@ Query::getConfig() const
     conf.set( "expr", _expression );
     conf.set( "orderby", _orderby);
     conf.set( "limit", _limit);
+    if ( _attributes.isSet() ) {
+        std::string attributes;
+        for( std::set<std::string>::const_iterator i = _attributes->begin(); i != _attributes->end(); ++i )
+            attributes += (i == _attributes->begin() ? "" : ",") + *i;
+        conf.set( "attributes", attributes );
+    }
     if ( _bounds.isSet() ) {
         Config bc( "extent" );
         bc.add( "xmin", toString(_bounds->xMin()) );
@@ -129,5 +144,21 @@ Query::combineWith( const Query& rhs ) const
         merged.bounds() = *rhs.bounds();
     }
 
+    // merge the attributes; a query that doesn't list any
+    // leaves the other's list in place.
+    if ( attributes().isSet() && rhs.attributes().isSet() )
+    {
+        merged.attributes() = *attributes();
+        merged.attributes()->insert( rhs.attributes()->begin(), rhs.attributes()->end() );
+    }
+    else if ( attributes().isSet() )
+    {
+        merged.attributes() = *attributes();
+    }
+    else if ( rhs.attributes().isSet() )
+    {
+        merged.attributes() = *rhs.attributes();
+    }
+
     return merged;
 }
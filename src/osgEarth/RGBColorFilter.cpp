@@ -104,6 +104,19 @@ void RGBColorFilter::install(osg::StateSet* stateSet) const
     }
 }
 
+void RGBColorFilter::apply(osg::Vec4f* colors, unsigned count) const
+{
+    // same as the shader
+    const osg::Vec3f rgb = getRGBOffset();
+    for (unsigned i = 0; i < count; ++i)
+    {
+        osg::Vec4f& c = colors[i];
+        c.r() = osg::clampBetween(c.r() + rgb.x(), 0.0f, 1.0f);
+        c.g() = osg::clampBetween(c.g() + rgb.y(), 0.0f, 1.0f);
+        c.b() = osg::clampBetween(c.b() + rgb.z(), 0.0f, 1.0f);
+    }
+}
+
 
 //---------------------------------------------------------------------------
 
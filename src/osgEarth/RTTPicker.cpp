@@ -29,20 +29,31 @@ using namespace osgEarth::Util;
 
 #define LC "[RTTPicker] "
 
+// Frames to wait for a readback before reporting a miss
+#define MAX_PICK_LATENCY 8u
+
 namespace
 {
-    // Callback to set the "far plane" uniform just before drawing.
+    // Callback to set the "far plane" uniform just before drawing,
+    // and to hand the render info to the readback image.
+    template<typename READBACK>
     struct CallHostCameraPreDrawCallback : public osg::Camera::DrawCallback
     {
         osg::observer_ptr<osg::Camera> _hostCamera;
+        osg::observer_ptr<READBACK> _readback;
 
-        CallHostCameraPreDrawCallback( osg::Camera* hostCamera ) :
-            _hostCamera( hostCamera )
+        CallHostCameraPreDrawCallback( osg::Camera* hostCamera, READBACK* readback ) :
+            _hostCamera( hostCamera ),
+            _readback( readback )
         {
         }
 
         void operator () (osg::RenderInfo& renderInfo) const
         {
+            osg::ref_ptr<READBACK> readback;
+            if ( _readback.lock(readback) )
+                readback->_ri = &renderInfo;
+
             osg::ref_ptr<osg::Camera> hostCamera;
             if ( _hostCamera.lock(hostCamera) )
             {
@@ -70,6 +81,112 @@ RTTPicker::createRTTProgram()
     return vp;
 }
 
+RTTPicker::ReadbackImage::ReadbackImage() :
+_ri(0L),
+_resultFrame(0u),
+_resultValid(false),
+_next(0u)
+{
+    _pbo[0] = _pbo[1] = 0u;
+    _fence[0] = _fence[1] = 0L;
+    _frame[0] = _frame[1] = 0u;
+}
+
+void
+RTTPicker::ReadbackImage::publish(const void* src, unsigned frame)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    ::memcpy(_result->data(), src, _result->getTotalSizeInBytes());
+    _result->dirty();
+    _resultFrame = frame;
+    _resultValid = true;
+}
+
+void
+RTTPicker::ReadbackImage::readPixels(
+    int x, int y, int width, int height,
+    GLenum pixelFormat, GLenum type, int packing)
+{
+    if (!_ri || !_result.valid())
+        return;
+
+    const osg::FrameStamp* fs = _ri->getState()->getFrameStamp();
+    unsigned frame = fs ? fs->getFrameNumber() : 0u;
+
+    osg::GLExtensions* ext = osg::GLExtensions::Get(_ri->getContextID(), true);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, getPacking());
+    glPixelStorei(GL_PACK_ROW_LENGTH, getRowLength());
+
+    bool async =
+        ext->glGenBuffers &&
+        ext->glBufferData &&
+        ext->glMapBufferRange &&
+        ext->glFenceSync &&
+        ext->glClientWaitSync &&
+        ext->glDeleteSync;
+
+    if (!async)
+    {
+        // synchronous:
+        glReadPixels(x, y, width, height, getPixelFormat(), getDataType(), data());
+        publish(data(), frame);
+        return;
+    }
+
+    unsigned size = getTotalSizeInBytes();
+    _ri->getState()->unbindPixelBufferObject();
+
+    // Publish any copies the GPU has finished, oldest first. The GPU
+    // completes them in order, so stop at the first one still pending.
+    for (unsigned n = 0; n < 2; ++n)
+    {
+        unsigned i = (_next + n) % 2;
+        if (_fence[i] == 0L)
+            continue;
+
+        GLenum result = ext->glClientWaitSync(_fence[i], 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            break;
+
+        ext->glDeleteSync(_fence[i]);
+        _fence[i] = 0L;
+
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _pbo[i]);
+        const void* src = ext->glMapBufferRange(GL_PIXEL_PACK_BUFFER_ARB, 0, size, GL_MAP_READ_BIT);
+        if (src)
+        {
+            publish(src, _frame[i]);
+            ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+        }
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    }
+
+    // If both buffers are still in flight the GPU is running well behind;
+    // skip this frame's copy rather than wait on it.
+    unsigned i = _next;
+    if (_fence[i] != 0L)
+        return;
+
+    if (_pbo[i] == 0u)
+    {
+        ext->glGenBuffers(1, &_pbo[i]);
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _pbo[i]);
+        ext->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, size, 0L, GL_STREAM_READ_ARB);
+    }
+    else
+    {
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _pbo[i]);
+    }
+
+    glReadPixels(x, y, width, height, getPixelFormat(), getDataType(), 0L);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    _fence[i] = ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _frame[i] = frame;
+    _next = (i + 1) % 2;
+}
+
 RTTPicker::RTTPicker(int cameraSize)
 {
     // group that will hold RTT children for all cameras
@@ -174,6 +291,12 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     c._image = new osg::Image();
     c._image->allocateImage(_rttSize, _rttSize, 1, GL_RGBA, GL_UNSIGNED_BYTE);    
     memset(c._image->data(), 0, _rttSize * _rttSize * 4);
+
+    // The camera reads back into this image, which publishes to c._image.
+    c._readback = new ReadbackImage();
+    c._readback->allocateImage(_rttSize, _rttSize, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    memset(c._readback->data(), 0, _rttSize * _rttSize * 4);
+    c._readback->_result = c._image.get();
     
     // Make an RTT camera and bind it to our image.
     // Note: don't use RF_INHERIT_VIEWPOINT because it's unnecessary and
@@ -189,7 +312,7 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     c._pickCamera->setViewport( 0, 0, _rttSize, _rttSize );
     c._pickCamera->setRenderOrder( osg::Camera::NESTED_RENDER );
     c._pickCamera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
-    c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._image.get() );
+    c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._readback.get() );
     c._pickCamera->setSmallFeatureCullingPixelSize( -1.0f );
     c._pickCamera->setCullMask( _cullMask );
 
@@ -242,7 +365,8 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     // Add a pre-draw callback that calls the view camera's pre-draw callback.  This
     // is better than assigning the same pre-draw callback, because the callback can
     // change over time (such as installing or uninstalling a Logarithmic Depth Buffer)
-    c._pickCamera->setPreDrawCallback( new CallHostCameraPreDrawCallback(view->getCamera()) );
+    c._pickCamera->setPreDrawCallback( new CallHostCameraPreDrawCallback<ReadbackImage>(
+        view->getCamera(), c._readback.get()) );
 
     return c;
 }
@@ -425,6 +549,22 @@ namespace
 bool
 RTTPicker::checkForPickResult(Pick& pick, unsigned frameNumber)
 {
+    ReadbackImage* readback = pick._context->_readback.get();
+    Threading::ScopedMutexLock lock(readback->_mutex);
+
+    // The readback lags the frame by one or more frames. Wait until we
+    // have an image rendered no earlier than the frame the pick was queued
+    // in, but give up if none arrives (e.g. the camera stopped drawing).
+    if (readback->_resultValid == false || readback->_resultFrame < pick._frame)
+    {
+        bool timedOut = frameNumber - pick._frame > MAX_PICK_LATENCY;
+        if (timedOut)
+        {
+            pick._callback->onMiss();
+        }
+        return timedOut;
+    }
+
     // decode the results
     osg::Image* image = pick._context->_image.get();
     ImageUtils::PixelReader read( image );
@@ -454,13 +594,13 @@ RTTPicker::checkForPickResult(Pick& pick, unsigned frameNumber)
     }
 
     // A pick expires if (a) it registers a hit, or (b) is registers a miss
-    // for 2 frames in a row. Why 2? Because the RTT picker itself delays 
-    // pick results by one frame, and the osgEarth draping/clamping systems
-    // also delay drawing by one frame. So we need 2 frames to positively
+    // in images from 2 frames. Why 2? Because the osgEarth draping/clamping
+    // systems delay drawing by one frame. So we need 2 frames to positively
     // register a hit on draped/clamped geometry.
     bool pickExpired =
         hit == true ||
-        frameNumber - pick._frame >= 2u;
+        readback->_resultFrame - pick._frame >= 1u ||
+        frameNumber - pick._frame > MAX_PICK_LATENCY;
 
     if ((hit == false) && (pickExpired == true))
     {
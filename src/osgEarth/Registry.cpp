@@ -785,6 +785,12 @@ Registry::getAsyncMemoryManager() const
     return _asyncMemoryManager.get();
 }
 
+void
+Registry::setAsyncMemoryManager(AsyncMemoryManager* value)
+{
+    _asyncMemoryManager = value;
+}
+
 namespace
 {
     //Simple class used to add a file extension alias for the earth_tile to the earth plugin
@@ -18,9 +18,9 @@
  */
 #include <osgEarth/ResampleFilter>
 #include <osgEarth/FilterContext>
+#include <osgEarth/FeatureBatch>
 #include <osgEarth/GeoMath>
 #include <osg/io_utils>
-#include <list>
 #include <cstdlib>
 
 using namespace osgEarth;
@@ -53,6 +53,104 @@ ResampleFilterOptions( conf )
 }
 
 
+void
+ResampleFilter::resample( const std::vector<osg::Vec3d>& input, std::vector<osg::Vec3d>& output ) const
+{
+    // Single pass over the input, equivalent to inserting and erasing in
+    // place: a short segment drops its end point (unless it's the last one),
+    // a long segment emits one split point and is measured again from there.
+    output.clear();
+    output.reserve( input.size() );
+    output.push_back( input[0] );
+
+    unsigned n = input.size();
+    unsigned j = 1;
+
+    while( j < n )
+    {
+        osg::Vec3d p0 = output.back();
+        const osg::Vec3d& p1 = input[j];
+        bool lastSeg = j == n-1;
+        osg::Vec3d seg = p1 - p0;
+
+        osg::Vec3d p0Rad, p1Rad;
+
+        if (resampleMode().value() == RESAMPLE_GREATCIRCLE || resampleMode().value() == RESAMPLE_RHUMB)
+        {
+            p0Rad = osg::Vec3d(osg::DegreesToRadians(p0.x()), osg::DegreesToRadians(p0.y()), p0.z());
+            p1Rad = osg::Vec3d(osg::DegreesToRadians(p1.x()), osg::DegreesToRadians(p1.y()), p1.z());
+        }
+                   
+        //Compute the length of the segment
+        double segLen = 0.0;
+        switch (resampleMode().value())
+        {
+        case RESAMPLE_LINEAR:
+            segLen = seg.length();
+            break;
+        case RESAMPLE_GREATCIRCLE:
+            segLen = GeoMath::distance(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+            break;
+        case RESAMPLE_RHUMB:
+            segLen = GeoMath::rhumbDistance(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+            break;
+        }
+
+        if ( segLen < _minLen.value() && !lastSeg && output.size() + (n-j) > 2 )
+        {
+            ++j;
+        }
+        else if ( segLen > _maxLen.value() )
+        {
+            //Compute the number of divisions to make
+            int numDivs = (1 + (int)(segLen/_maxLen.value()));
+            double newSegLen = segLen/(double)numDivs;
+            seg.normalize();
+            osg::Vec3d newPt;
+            double newHeight;
+            switch (resampleMode().value())
+            {
+            case RESAMPLE_LINEAR:
+                {
+                    newPt = p0 + seg * newSegLen;
+                }
+                break;
+            case RESAMPLE_GREATCIRCLE:
+                {
+                    double bearing = GeoMath::bearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+                    double lat,lon;
+                    GeoMath::destination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
+                    newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
+                    newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
+                }
+                break;
+            case RESAMPLE_RHUMB:
+                {
+                    double bearing = GeoMath::rhumbBearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+                    double lat,lon;
+                    GeoMath::rhumbDestination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
+                    newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
+                    newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
+                }
+                break;
+            }
+            
+            if ( _perturbThresh.value() > 0.0 && _perturbThresh.value() < newSegLen )
+            {
+                float r = 0.5 - (float)::rand()/(float)RAND_MAX;
+                newPt.x() += r;
+                newPt.y() += r;
+            }
+            output.push_back( newPt );
+        }
+        else
+        {
+            output.push_back( p1 );
+            ++j;
+        }
+    }
+}
+
 bool
 ResampleFilter::push( Feature* input, FilterContext& context )
 {
@@ -61,6 +159,8 @@ ResampleFilter::push( Feature* input, FilterContext& context )
 
     bool success = true;
 
+    std::vector<osg::Vec3d> output;
+
     GeometryIterator i( input->getGeometry() );
     while( i.hasMore() )
     {        
@@ -68,111 +168,50 @@ ResampleFilter::push( Feature* input, FilterContext& context )
 
         if ( part->size() < 2 ) continue;
 
-        unsigned int origSize = part->size();
-
-        // whether to resample the virtual segment that closes an open ring:
-        bool loop =
-            part->getComponentType() == Geometry::TYPE_RING &&
-            static_cast<Ring*>(part)->isOpen();
-
-        // copy the original part to a linked list. use a std::list since insert/erase
-        // will not invalidate iterators.
-        std::list<osg::Vec3d> plist;
-        plist.insert( plist.begin(), part->begin(), part->end() );
-
-        std::list<osg::Vec3d>::iterator v1 = plist.begin(); ++v1;
-        std::list<osg::Vec3d>::iterator v0 = plist.begin();
-        std::list<osg::Vec3d>::iterator last = plist.end(); --last;
+        resample( part->asVector(), output );
+        part->asVector().swap( output );
+    }
+    return success;
+}
 
-        while( v0 != last )
-        {
-            bool increment = true;
+FilterContext
+ResampleFilter::push( FeatureBatch& batch, FilterContext& context )
+{
+    std::vector<double> x, y, z;
+    std::vector<unsigned> partPoints;
+    x.reserve( batch.getNumPoints() );
+    y.reserve( batch.getNumPoints() );
+    z.reserve( batch.getNumPoints() );
+    partPoints.reserve( batch.getNumParts()+1 );
+    partPoints.push_back( 0 );
 
-            osg::Vec3d& p0 = *v0;
-            osg::Vec3d& p1 = *v1;
-            bool lastSeg = v1 == last;
-            osg::Vec3d seg = p1 - p0;
+    std::vector<osg::Vec3d> input, output;
 
-            osg::Vec3d p0Rad, p1Rad;
+    for( unsigned p = 0; p < batch.getNumParts(); ++p )
+    {
+        unsigned begin = batch.getFirstPoint(p), end = batch.getFirstPoint(p+1);
 
-            if (resampleMode().value() == RESAMPLE_GREATCIRCLE || resampleMode().value() == RESAMPLE_RHUMB)
-            {
-                p0Rad = osg::Vec3d(osg::DegreesToRadians(p0.x()), osg::DegreesToRadians(p0.y()), p0.z());
-                p1Rad = osg::Vec3d(osg::DegreesToRadians(p1.x()), osg::DegreesToRadians(p1.y()), p1.z());
-            }
-                       
-            //Compute the length of the segment
-            double segLen = 0.0;
-            switch (resampleMode().value())
-            {
-            case RESAMPLE_LINEAR:
-                segLen = seg.length();
-                break;
-            case RESAMPLE_GREATCIRCLE:
-                segLen = GeoMath::distance(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
-                break;
-            case RESAMPLE_RHUMB:
-                segLen = GeoMath::rhumbDistance(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
-                break;
-            }
+        input.resize( end-begin );
+        for( unsigned i = begin; i < end; ++i )
+            input[i-begin].set( batch.x()[i], batch.y()[i], batch.z()[i] );
 
-            if ( segLen < _minLen.value() && !lastSeg && plist.size() > 2 )
-            {
-                v1 = plist.erase( v1 );
-                increment = false;
-            }
-            else if ( segLen > _maxLen.value() )
-            {
-                //Compute the number of divisions to make
-                int numDivs = (1 + (int)(segLen/_maxLen.value()));
-                double newSegLen = segLen/(double)numDivs;
-                seg.normalize();
-                osg::Vec3d newPt;
-                double newHeight;
-                switch (resampleMode().value())
-                {
-                case RESAMPLE_LINEAR:
-                    {
-                        newPt = p0 + seg * newSegLen;
-                    }
-                    break;
-                case RESAMPLE_GREATCIRCLE:
-                    {
-                        double bearing = GeoMath::bearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
-                        double lat,lon;
-                        GeoMath::destination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
-                        newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
-                        newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
-                    }
-                    break;
-                case RESAMPLE_RHUMB:
-                    {
-                        double bearing = GeoMath::rhumbBearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
-                        double lat,lon;
-                        GeoMath::rhumbDestination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
-                        newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
-                        newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
-                    }
-                    break;
-                }
-                
-                if ( _perturbThresh.value() > 0.0 && _perturbThresh.value() < newSegLen )
-                {
-                    float r = 0.5 - (float)::rand()/(float)RAND_MAX;
-                    newPt.x() += r;
-                    newPt.y() += r;
-                }
-                v1 = plist.insert( v1, newPt );
-            }
+        if ( input.size() >= 2 )
+            resample( input, output );
+        else
+            output = input;
 
-            if ( increment ) { ++v0; ++v1; }
+        for( std::vector<osg::Vec3d>::const_iterator i = output.begin(); i != output.end(); ++i )
+        {
+            x.push_back( i->x() );
+            y.push_back( i->y() );
+            z.push_back( i->z() );
         }
-
-        part->clear();
-        part->reserve( plist.size() );
-        part->insert( part->begin(), plist.begin(), plist.end() );
+        partPoints.push_back( x.size() );
     }
-    return success;
+
+    batch.swapPoints( x, y, z, partPoints );
+
+    return context;
 }
 
 
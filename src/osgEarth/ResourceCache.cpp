@@ -17,16 +17,160 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/ResourceCache>
+#include <osgEarth/URI>
 #include <osg/Texture2D>
+#include <algorithm>
 
 using namespace osgEarth;
 
+namespace
+{
+    // Instance nodes shared by every ResourceCache in the process.
+    class InstanceStore
+    {
+    public:
+        static InstanceStore& get()
+        {
+            static InstanceStore s_store;
+            return s_store;
+        }
+
+        InstanceStore() : _maxBytes(256u*1024u*1024u), _bytes(0u), _clock(0u), _nextID(0u), _queries(0u), _hits(0u) { }
+
+        osg::ref_ptr<osg::Node> getOrCreate(InstanceResource* res, const osgDB::Options* readOptions)
+        {
+            std::string key = res->getConfig().toJSON(false);
+            if (readOptions)
+                key += readOptions->getOptionString();
+
+            Threading::Promise<osg::Node> promise;
+            Threading::Future<osg::Node> future;
+            unsigned id = 0u;
+            bool loader = false;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                ++_queries;
+                Entries::iterator i = _entries.find(key);
+                if (i != _entries.end())
+                {
+                    ++_hits;
+                    i->second._lastUse = ++_clock;
+                    future = i->second._future;
+                }
+                else
+                {
+                    Entry& entry = _entries[key];
+                    entry._future = promise.getFuture();
+                    entry._id = id = ++_nextID;
+                    entry._lastUse = ++_clock;
+                    entry._bytes = 0u;
+                    future = entry._future;
+                    loader = true;
+                }
+            }
+
+            // Somebody else is (or was) loading it; wait for the result.
+            if (!loader)
+            {
+                return future.get();
+            }
+
+            // Load outside the lock so other instances can load in parallel.
+            osg::ref_ptr<osg::Node> node = res->createNode(readOptions);
+            size_t bytes = node.valid() ? URIResultCache::getSizeInBytes(node.get()) : 0u;
+            promise.resolve(node.get());
+
+            Threading::ScopedMutexLock lock(_mutex);
+            Entries::iterator i = _entries.find(key);
+            if (i != _entries.end() && i->second._id == id)
+            {
+                if (node.valid())
+                {
+                    i->second._bytes = bytes;
+                    _bytes += bytes;
+                    trim();
+                }
+                else
+                {
+                    // let a later request try again
+                    _entries.erase(i);
+                }
+            }
+            return node;
+        }
+
+        void setMaxBytes(size_t value)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _maxBytes = value;
+            trim();
+        }
+
+        size_t getMaxBytes() const
+        {
+            return _maxBytes;
+        }
+
+        CacheStats getStats() const
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            return CacheStats(_entries.size(), 0u, _queries, _queries > 0u ? (float)_hits/(float)_queries : 0.0f);
+        }
+
+    private:
+        struct Entry
+        {
+            Threading::Future<osg::Node> _future;
+            unsigned _id;
+            unsigned _lastUse;
+            size_t   _bytes;
+        };
+        typedef std::map<std::string, Entry> Entries;
+
+        // Evicts the least recently used instances until the store is within
+        // budget. Skips instances still loading, and ones referenced outside
+        // the store (i.e. in a scene graph) since evicting those frees nothing.
+        // Assumes the mutex is locked.
+        void trim()
+        {
+            if (_bytes <= _maxBytes)
+                return;
+
+            std::vector<std::pair<unsigned, Entries::iterator> > candidates;
+            for (Entries::iterator i = _entries.begin(); i != _entries.end(); ++i)
+            {
+                Entry& entry = i->second;
+                if (entry._future.isAvailable() && entry._future.get() && entry._future.get()->referenceCount() == 1)
+                    candidates.push_back(std::make_pair(entry._lastUse, i));
+            }
+            std::sort(candidates.begin(), candidates.end(), LessLastUse());
+
+            for (unsigned c = 0; c < candidates.size() && _bytes > _maxBytes; ++c)
+            {
+                _bytes -= candidates[c].second->second._bytes;
+                _entries.erase(candidates[c].second);
+            }
+        }
+
+        struct LessLastUse
+        {
+            bool operator()(const std::pair<unsigned, Entries::iterator>& a, const std::pair<unsigned, Entries::iterator>& b) const {
+                return a.first < b.first;
+            }
+        };
+
+        Entries _entries;
+        size_t _maxBytes, _bytes;
+        unsigned _clock, _nextID, _queries, _hits;
+        mutable Threading::Mutex _mutex;
+    };
+}
+
 
 // internal thread-safety not required since we mutex it in this object.
 ResourceCache::ResourceCache() : // const osgDB::Options* dbOptions ) :
 //_dbOptions    ( dbOptions ),
 _skinCache    ( false ),
-_instanceCache( false ),
 _resourceLibraryCache( false )
 {
     //nop
@@ -105,30 +249,7 @@ ResourceCache::getOrCreateInstanceNode(InstanceResource*        res,
                                        osg::ref_ptr<osg::Node>& output,
                                        const osgDB::Options*    readOptions)
 {
-    output = 0L;
-    std::string key = res->getConfig().toJSON(false);
-
-    // exclusive lock (since it's an LRU)
-    {
-        Threading::ScopedMutexLock exclusive( _instanceMutex );
-
-        // double check to avoid race condition
-        InstanceCache::Record rec;
-        if ( _instanceCache.get(key, rec) && rec.value().valid() )
-        {
-            output = rec.value().get();
-        }
-        else
-        {
-            // still not there, make it.
-            output = res->createNode(readOptions);
-            if ( output.valid() )
-            {
-                _instanceCache.insert( key, output.get() );
-            }
-        }
-    }
-
+    output = InstanceStore::get().getOrCreate(res, readOptions);
     return output.valid();
 }
 
@@ -138,32 +259,32 @@ ResourceCache::cloneOrCreateInstanceNode(InstanceResource*        res,
                                          const osgDB::Options*    readOptions)
 {
     output = 0L;
-    std::string key = res->getConfig().toJSON(false);
 
-    // exclusive lock (since it's an LRU)
+    osg::ref_ptr<osg::Node> instance = InstanceStore::get().getOrCreate(res, readOptions);
+    if (instance.valid())
     {
-        Threading::ScopedMutexLock exclusive( _instanceMutex );
-
         // Deep copy everything except for images.  Some models may share imagery so we only want one copy of it at a time.
         osg::CopyOp copyOp = osg::CopyOp::DEEP_COPY_ALL & ~osg::CopyOp::DEEP_COPY_IMAGES & ~osg::CopyOp::DEEP_COPY_TEXTURES;
-
-        // double check to avoid race condition
-        InstanceCache::Record rec;
-        if ( _instanceCache.get(key, rec) && rec.value().valid() )
-        {
-            output = osg::clone(rec.value().get(), copyOp);
-        }
-        else
-        {
-            // still not there, make it.
-            output = res->createNode(readOptions);
-            if ( output.valid() )
-            {
-                _instanceCache.insert( key, output.get() );
-                output = osg::clone(output.get(), copyOp);
-            }
-        }
+        output = osg::clone(instance.get(), copyOp);
     }
 
     return output.valid();
 }
+
+const CacheStats
+ResourceCache::getInstanceStats() const
+{
+    return InstanceStore::get().getStats();
+}
+
+void
+ResourceCache::setMaxInstanceBytes(size_t value)
+{
+    InstanceStore::get().setMaxBytes(value);
+}
+
+size_t
+ResourceCache::getMaxInstanceBytes()
+{
+    return InstanceStore::get().getMaxBytes();
+}
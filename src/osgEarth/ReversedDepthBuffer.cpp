@@ -0,0 +1,130 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/ReversedDepthBuffer>
+#include <osgEarth/Shaders>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osg/Depth>
+#include <osg/Version>
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+#include <osg/ClipControl>
+#endif
+
+#ifndef GL_DEPTH_COMPONENT32F
+#define GL_DEPTH_COMPONENT32F 0x8CAC
+#endif
+
+#define LC "[ReversedDepthBuffer] "
+
+#define REVERSED_DEPTH_DEFINE "OE_REVERSED_DEPTH"
+#define NEAR_FAR_RATIO_KEY    "oe.reversed_depth.near_far_ratio"
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+
+ReversedDepthBuffer::ReversedDepthBuffer() :
+_nearFarRatio(1e-7)
+{
+    _supported = Registry::capabilities().supportsGLSL();
+    if ( !_supported )
+    {
+        OE_WARN << LC << "Not supported on this platform (no GLSL)" << std::endl;
+    }
+}
+
+void
+ReversedDepthBuffer::install(osg::Camera* camera)
+{
+    if ( camera && _supported && !isInstalled(camera) )
+    {
+        osg::StateSet* stateset = camera->getOrCreateStateSet();
+        stateset->setDefine(REVERSED_DEPTH_DEFINE);
+
+        // install the shader component:
+        VirtualProgram* vp = VirtualProgram::getOrCreate( stateset );
+        vp->setName("Reversed Depth Buffer");
+        Shaders pkg;
+        pkg.load( vp, pkg.ReversedDepthBuffer );
+
+        // near is 1, infinity is 0:
+        camera->setClearDepth( 0.0 );
+        stateset->setAttributeAndModes( new osg::Depth(osg::Depth::GEQUAL, 0.0, 1.0, true), osg::StateAttribute::ON );
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+        // store depth in [0..1] instead of [-1..1] so the float precision
+        // near zero (far away) is not lost to the [-1..1] -> [0..1] remap.
+        stateset->setAttributeAndModes( new osg::ClipControl(osg::ClipControl::LOWER_LEFT, osg::ClipControl::ZERO_TO_ONE), osg::StateAttribute::ON );
+#else
+        OE_WARN << LC << "OSG 3.6+ required for glClipControl; depth precision will be reduced" << std::endl;
+#endif
+
+        if ( camera->getRenderTargetImplementation() == osg::Camera::FRAME_BUFFER_OBJECT )
+        {
+            camera->attach( osg::Camera::DEPTH_BUFFER, GL_DEPTH_COMPONENT32F );
+        }
+        else
+        {
+            OE_INFO << LC << "Camera renders to a window; depth buffer stays fixed-point" << std::endl;
+        }
+
+        // the near plane can come much closer now:
+        camera->setUserValue( NEAR_FAR_RATIO_KEY, camera->getNearFarRatio() );
+        camera->setNearFarRatio( _nearFarRatio );
+    }
+}
+
+void
+ReversedDepthBuffer::uninstall(osg::Camera* camera)
+{
+    if ( camera && _supported && isInstalled(camera) )
+    {
+        osg::StateSet* stateset = camera->getStateSet();
+
+        VirtualProgram* vp = VirtualProgram::get( stateset );
+        if ( vp )
+        {
+            Shaders pkg;
+            pkg.unload( vp, pkg.ReversedDepthBuffer );
+        }
+
+        stateset->removeDefine(REVERSED_DEPTH_DEFINE);
+        stateset->removeAttribute(osg::StateAttribute::DEPTH);
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+        stateset->removeAttribute(osg::StateAttribute::CLIPCONTROL);
+#endif
+        camera->setClearDepth( 1.0 );
+
+        double ratio;
+        if ( camera->getUserValue(NEAR_FAR_RATIO_KEY, ratio) )
+        {
+            camera->setNearFarRatio( ratio );
+        }
+    }
+}
+
+bool
+ReversedDepthBuffer::isInstalled(const osg::Camera* camera)
+{
+    const osg::StateSet* stateset = camera ? camera->getStateSet() : 0L;
+    return stateset && stateset->getDefineList().count(REVERSED_DEPTH_DEFINE) > 0;
+}
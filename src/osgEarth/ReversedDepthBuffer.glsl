@@ -0,0 +1,21 @@
+#version $GLSL_VERSION_STR
+
+#pragma vp_entryPoint oe_reversedDepth_vert
+#pragma vp_location   vertex_clip
+#pragma vp_order      0.99
+
+void oe_reversedDepth_vert(inout vec4 clip)
+{
+    if (gl_ProjectionMatrix[3][3] == 0.0) // perspective
+    {
+        // Infinite far plane: depth = near/distance, which is 1.0 at the
+        // near plane and approaches 0.0 at infinity.
+        float NEAR = gl_ProjectionMatrix[3][2] / (gl_ProjectionMatrix[2][2] - 1.0);
+        clip.z = NEAR;
+    }
+    else // orthographic
+    {
+        // flip [-1..1] to [1..0]
+        clip.z = 0.5*(clip.w - clip.z);
+    }
+}
@@ -61,6 +61,10 @@ ScreenSpaceLayoutOptions::fromConfig( const Config& conf )
     conf.get( "leader_line_max_length", _leaderLineMaxLen );
     conf.get( "leader_line_color", _leaderLineColor );
     conf.get( "leader_line_width", _leaderLineWidth );
+    conf.get( "grid_cell_size", _gridCellSize );
+    conf.get( "reuse_placement", _reusePlacement );
+    conf.get( "time_budget", _timeBudget );
+    conf.get( "batch_text", _batchText );
 }
 
 Config
@@ -81,6 +85,10 @@ ScreenSpaceLayoutOptions::getConfig() const
     conf.set( "leader_line_max_length", _leaderLineMaxLen );
     conf.set( "leader_line_color", _leaderLineColor );
     conf.set( "leader_line_width", _leaderLineWidth );
+    conf.set( "grid_cell_size", _gridCellSize );
+    conf.set( "reuse_placement", _reusePlacement );
+    conf.set( "time_budget", _timeBudget );
+    conf.set( "batch_text", _batchText );
     return conf;
 }
 
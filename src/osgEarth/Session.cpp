@@ -166,6 +166,12 @@ Session::getStateSetCache()
     return _stateSetCache.get();
 }
 
+void
+Session::setStateSetCache(StateSetCache* value)
+{
+    _stateSetCache = value ? value : new StateSetCache();
+}
+
 void
 Session::setStyles( StyleSheet* value )
 {
@@ -6,16 +6,25 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_location   vertex_view
 #pragma vp_order      last
 
+#pragma import_defines(OE_SHADOW_STATIC)
 
 uniform mat4 oe_shadow_matrix[$OE_SHADOW_NUM_SLICES];
 
 out vec4 oe_shadow_coord[$OE_SHADOW_NUM_SLICES];
 
+#ifdef OE_SHADOW_STATIC
+uniform mat4 oe_shadow_static_matrix[$OE_SHADOW_NUM_SLICES];
+out vec4 oe_shadow_static_coord[$OE_SHADOW_NUM_SLICES];
+#endif
+
 void oe_shadow_vertex(inout vec4 VertexVIEW)
 {
     for(int i=0; i < $OE_SHADOW_NUM_SLICES; ++i)
     {
         oe_shadow_coord[i] = oe_shadow_matrix[i] * VertexVIEW;
+#ifdef OE_SHADOW_STATIC
+        oe_shadow_static_coord[i] = oe_shadow_static_matrix[i] * VertexVIEW;
+#endif
     }
 }
 
@@ -30,7 +39,7 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_location   fragment_lighting
 #pragma vp_order      0.9
 
-#pragma import_defines(OE_LIGHTING, OE_NUM_LIGHTS)
+#pragma import_defines(OE_LIGHTING, OE_NUM_LIGHTS, OE_SHADOW_STATIC)
 
 uniform sampler2DArray oe_shadow_map;
 uniform float          oe_shadow_color;
@@ -39,6 +48,11 @@ uniform float          oe_shadow_blur;
 in vec3 vp_Normal; // stage global
 in vec4 oe_shadow_coord[$OE_SHADOW_NUM_SLICES];
 
+// cached static slices live after the per-frame slices in oe_shadow_map
+#ifdef OE_SHADOW_STATIC
+in vec4 oe_shadow_static_coord[$OE_SHADOW_NUM_SLICES];
+#endif
+
 // Parameters of each light:
 struct osg_LightSourceParameters 
 {   
@@ -98,6 +112,23 @@ float oe_shadow_multisample(in vec3 c, in float refvalue, in float blur)
     return 1.0-(shadowed/OE_SHADOW_NUM_SAMPLES);
 }
 
+// visibility [0..1] of a fragment in one shadow map layer
+float oe_shadow_sample(in vec4 c, in float layer, in float bias)
+{
+    vec3 coord = vec3(c.x, c.y, layer);
+
+    // TODO: This causes an NVIDIA error (DUI_foreachId) - disable for now.
+    if ( oe_shadow_blur > 0.0 )
+    {
+        return oe_shadow_multisample(coord, c.z-bias, oe_shadow_blur);
+    }
+    else
+    {
+        float depth = texture(oe_shadow_map, coord).r;
+        return ( depth < 1.0 && depth < c.z-bias ) ? 0.0 : 1.0;
+    }
+}
+
 void oe_shadow_fragment(inout vec4 color)
 {
     float alpha = color.a;
@@ -111,26 +142,17 @@ void oe_shadow_fragment(inout vec4 color)
     float costheta = clamp(dot(L,N), 0.0, 1.0);
     float bias = b0*tan(acos(costheta));
 
-    float depth;
-
     // loop over the slices:
     for(int i=0; i<$OE_SHADOW_NUM_SLICES && factor > 0.0; ++i)
     {
-        vec4 c = oe_shadow_coord[i];
-        vec3 coord = vec3(c.x, c.y, float(i));
+        factor = min(factor, oe_shadow_sample(oe_shadow_coord[i], float(i), bias));
 
-        // TODO: This causes an NVIDIA error (DUI_foreachId) - disable for now.
-        if ( oe_shadow_blur > 0.0 )
-        {
-            factor = min(factor, oe_shadow_multisample(coord, c.z-bias, oe_shadow_blur));
-        }
-        else
+#ifdef OE_SHADOW_STATIC
+        if (factor > 0.0)
         {
-            //float depth = texture(oe_shadow_map, coord).r;
-            depth = texture(oe_shadow_map, coord).r;
-            if ( depth < 1.0 && depth < c.z-bias )
-                factor = 0.0;
+            factor = min(factor, oe_shadow_sample(oe_shadow_static_coord[i], float(i + $OE_SHADOW_NUM_SLICES), bias));
         }
+#endif
     }
 
     vec3 colorInFullShadow = color.rgb * oe_shadow_color;
@@ -53,9 +53,14 @@ _size         ( 2048 ),
 _texImageUnit ( 7 ),
 _blurFactor   ( 0.001f ),
 _color        ( 0.4f ),
-_traversalMask( ~0 )
+_traversalMask( ~0 ),
+_staticEnabled( false ),
+_staticLightThreshold( 0.25f ),
+_staticMoveThreshold( 0.1f ),
+_staticRefreshInterval( 120u )
 {
     _castingGroup = new osg::Group();
+    _staticCastingGroup = new osg::Group();
 
     _supported = Registry::capabilities().supportsGLSL();
     if ( _supported )
@@ -111,6 +116,13 @@ ShadowCaster::setShadowColor(float value)
         _shadowColorUniform->set(value);
 }
 
+void
+ShadowCaster::dirtyStaticShadows()
+{
+    for(unsigned i=0; i<_staticSlices.size(); ++i)
+        _staticSlices[i]._valid = false;
+}
+
 void
 ShadowCaster::reinitialize()
 {
@@ -119,6 +131,8 @@ ShadowCaster::reinitialize()
 
     _shadowmap = 0L;
     _rttCameras.clear();
+    _staticRttCameras.clear();
+    _staticSlices.clear();
 
     int numSlices = (int)_ranges.size() - 1;
     if ( numSlices < 1 )
@@ -127,9 +141,11 @@ ShadowCaster::reinitialize()
         return ;
     }
 
-    // create the projected texture:
+    // create the projected texture. When there are static casters, their
+    // cached slices follow the per-frame slices in the same array.
+    int numLayers = _staticEnabled ? numSlices*2 : numSlices;
     _shadowmap = new osg::Texture2DArray();
-    _shadowmap->setTextureSize( _size, _size, numSlices );
+    _shadowmap->setTextureSize( _size, _size, numLayers );
     _shadowmap->setInternalFormat( GL_DEPTH_COMPONENT );
     _shadowmap->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR );
     _shadowmap->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
@@ -137,9 +153,10 @@ ShadowCaster::reinitialize()
     _shadowmap->setWrap( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_BORDER );
     _shadowmap->setBorderColor(osg::Vec4(1,1,1,1));
 
-    // set up the RTT camera:
-    for(int i=0; i<numSlices; ++i)
+    // set up the RTT cameras; the static ones render the static casters:
+    for(int i=0; i<numLayers; ++i)
     {
+        bool isStatic = (i >= numSlices);
         osg::Camera* rtt = new osg::Camera();
         Shadowing::setIsShadowCamera(rtt);
         rtt->setReferenceFrame( osg::Camera::ABSOLUTE_RF_INHERIT_VIEWPOINT );
@@ -151,8 +168,20 @@ ShadowCaster::reinitialize()
         rtt->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
         rtt->setImplicitBufferAttachmentMask(0, 0);
         rtt->attach( osg::Camera::DEPTH_BUFFER, _shadowmap.get(), 0, i );
-        rtt->addChild( _castingGroup.get() );
-        _rttCameras.push_back(rtt);
+        if (isStatic)
+        {
+            rtt->addChild( _staticCastingGroup.get() );
+            _staticRttCameras.push_back(rtt);
+        }
+        else
+        {
+            rtt->addChild( _castingGroup.get() );
+            _rttCameras.push_back(rtt);
+        }
+    }
+    if (_staticEnabled)
+    {
+        _staticSlices.resize(numSlices);
     }
 
     _rttStateSet = new osg::StateSet();
@@ -187,6 +216,17 @@ ShadowCaster::reinitialize()
         osg::Uniform::FLOAT_MAT4,
         numSlices );
 
+    // the static casters' matrices, recomputed each frame from the cached light matrices:
+    _staticShadowMapTexGenUniform = 0L;
+    if (_staticEnabled)
+    {
+        _renderStateSet->setDefine("OE_SHADOW_STATIC");
+        _staticShadowMapTexGenUniform = _renderStateSet->getOrCreateUniform(
+            "oe_shadow_static_matrix",
+            osg::Uniform::FLOAT_MAT4,
+            numSlices );
+    }
+
     // bind the shadow map texture itself:
     _renderStateSet->setTextureAttribute(_texImageUnit, _shadowmap.get(), osg::StateAttribute::ON );
     _renderStateSet->addUniform( new osg::Uniform("oe_shadow_map", _texImageUnit) );
@@ -214,6 +254,8 @@ ShadowCaster::resizeGLObjectBuffers(unsigned maxSize)
         _renderStateSet->resizeGLObjectBuffers(maxSize);
     for(unsigned i=0; i<_rttCameras.size(); ++i)
         _rttCameras[i]->resizeGLObjectBuffers(maxSize);
+    for(unsigned i=0; i<_staticRttCameras.size(); ++i)
+        _staticRttCameras[i]->resizeGLObjectBuffers(maxSize);
 }
 
 void
@@ -229,15 +271,28 @@ ShadowCaster::releaseGLObjects(osg::State* state) const
         _renderStateSet->releaseGLObjects(state);
     for(unsigned i=0; i<_rttCameras.size(); ++i)
         _rttCameras[i]->releaseGLObjects(state);
+    for(unsigned i=0; i<_staticRttCameras.size(); ++i)
+        _staticRttCameras[i]->releaseGLObjects(state);
 }
 
 void
 ShadowCaster::traverse(osg::NodeVisitor& nv)
 {
+    // allocate (or drop) the cached static slices when static casters come or go.
+    if (_supported && nv.getVisitorType() == nv.CULL_VISITOR)
+    {
+        bool hasStatic = _staticCastingGroup->getNumChildren() > 0;
+        if (hasStatic != _staticEnabled)
+        {
+            _staticEnabled = hasStatic;
+            reinitialize();
+        }
+    }
+
     if (_supported                             && 
         _light.valid()                         &&
         nv.getVisitorType() == nv.CULL_VISITOR && 
-        _castingGroup->getNumChildren() > 0    && 
+        (_castingGroup->getNumChildren() > 0 || _staticEnabled) && 
         _shadowmap.valid() )
     {
         osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
@@ -274,6 +329,11 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
             osg::Matrix lightViewMatInv = osg::Matrix::inverse(lightViewMat);
             _shadowToPrimaryMatrix->set( lightViewMatInv * MV);
             
+            // this xforms from clip [-1..1] to texture [0..1] space
+            static osg::Matrix s_scaleBiasMat = 
+                osg::Matrix::translate(1.0,1.0,1.0) * 
+                osg::Matrix::scale(0.5,0.5,0.5);
+
             int i;
             for(i=0; i < (int) _ranges.size()-1; ++i)
             {
@@ -313,11 +373,6 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
                 _rttCameras[i]->setViewMatrix( lightViewMat );
                 _rttCameras[i]->setProjectionMatrix( lightProjMat );
 
-                // this xforms from clip [-1..1] to texture [0..1] space
-                static osg::Matrix s_scaleBiasMat = 
-                    osg::Matrix::translate(1.0,1.0,1.0) * 
-                    osg::Matrix::scale(0.5,0.5,0.5);
-                
                 // set the texture coordinate generation matrix that the shadow
                 // receiver will use to sample the shadow map. Doing this on the CPU
                 // prevents nasty precision issues!
@@ -325,6 +380,61 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
                 _shadowMapTexGenUniform->setElement(i, inverseMV * VPS);
             }
 
+            // Pick at most one cached static slice to re-render this frame,
+            // nearest first. A static slice covers the sphere of its far range
+            // around the camera, so it stays valid as the camera turns and only
+            // goes stale when the light moves, the camera moves away from where
+            // it was rendered, or it gets old.
+            int staticSlice = -1;
+            if (_staticEnabled)
+            {
+                unsigned frame = nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u;
+                double cosLightThreshold = cos(osg::DegreesToRadians((double)_staticLightThreshold));
+
+                for(i=0; i < (int)_staticSlices.size() && staticSlice < 0; ++i)
+                {
+                    const StaticSlice& slice = _staticSlices[i];
+                    double f = _ranges[i+1];
+                    if (!slice._valid ||
+                        slice._lightDir * lightVectorWorld < cosLightThreshold ||
+                        (slice._eye - lightPosWorld).length() > f * _staticMoveThreshold ||
+                        (_staticRefreshInterval > 0u && frame - slice._frame >= _staticRefreshInterval))
+                    {
+                        staticSlice = i;
+                    }
+                }
+
+                if (staticSlice >= 0)
+                {
+                    StaticSlice& slice = _staticSlices[staticSlice];
+                    double f = _ranges[staticSlice+1];
+                    osg::Matrix lightProjMat;
+                    lightProjMat.makeOrtho(-f, f, -f, f, -f, f);
+
+                    _staticRttCameras[staticSlice]->setViewMatrix( lightViewMat );
+                    _staticRttCameras[staticSlice]->setProjectionMatrix( lightProjMat );
+
+                    slice._VPS = lightViewMat * lightProjMat * s_scaleBiasMat;
+                    slice._eye = lightPosWorld;
+                    slice._lightDir = lightVectorWorld;
+                    slice._frame = frame;
+                    slice._valid = true;
+                }
+
+                // a slice that was never rendered maps everything outside the
+                // texture, where the border reads as "not shadowed".
+                static osg::Matrix s_outsideMat =
+                    osg::Matrix::scale(0.0,0.0,0.0) *
+                    osg::Matrix::translate(-10.0,-10.0,0.0);
+
+                for(i=0; i < (int)_staticSlices.size(); ++i)
+                {
+                    const StaticSlice& slice = _staticSlices[i];
+                    _staticShadowMapTexGenUniform->setElement(i,
+                        slice._valid ? inverseMV * slice._VPS : s_outsideMat);
+                }
+            }
+
             // install the shadow-casting traversal mask:
             unsigned saveMask = cv->getTraversalMask();
             cv->setTraversalMask( _traversalMask & saveMask );
@@ -335,6 +445,10 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
             {
                 _rttCameras[i]->accept( nv );
             }
+            if (staticSlice >= 0)
+            {
+                _staticRttCameras[staticSlice]->accept( nv );
+            }
             cv->popStateSet();
 
             // restore the previous mask
@@ -24,8 +24,12 @@
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/ImageLayer>
 #include <osgEarth/Lighting>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Containers>
+#include <osgEarth/Map>
 #include <osg/CullFace>
 #include <osg/Texture2D>
+#include <cfloat>
 
 using namespace osgEarth;
 
@@ -42,6 +46,7 @@ SimpleOceanLayer::Options::getConfig() const
     conf.set("use_bathymetry", _useBathymetry);
     conf.set("texture", _textureURI);
     conf.set("texture_lod", _textureLOD);
+    conf.set("mask_coverage_lod", _maskCoverageLOD);
     maskLayer().set(conf, "mask_layer");
     return conf;
 }
@@ -59,11 +64,158 @@ SimpleOceanLayer::Options::fromConfig(const Config& conf)
     conf.get("use_bathymetry", _useBathymetry);
     conf.get("texture", _textureURI);
     conf.get("texture_lod", _textureLOD);
+    conf.get("mask_coverage_lod", _maskCoverageLOD);
     maskLayer().get(conf, "mask_layer");
 }
 
 //...................................................................
 
+namespace
+{
+    // number of quadtree levels in a coverage record; the finest
+    // level is 2^(COVERAGE_LEVELS-1) cells on a side
+    const unsigned COVERAGE_LEVELS = 8u;
+
+    // Min/max mask value over one coarse mask tile, as a quadtree. Level
+    // d has 2^d cells on a side, laid out north to south like tile keys,
+    // so a cell covers exactly the descendant tile d LODs below.
+    struct Coverage : public osg::Referenced
+    {
+        std::vector<osg::Vec2f> _levels[COVERAGE_LEVELS];
+
+        Coverage(const osg::Image* image)
+        {
+            ImageUtils::PixelReader read(image);
+            int S = image->s(), T = image->t();
+
+            // finest level straight from the image
+            unsigned d = COVERAGE_LEVELS - 1u;
+            int n = 1 << d;
+            std::vector<osg::Vec2f>& finest = _levels[d];
+            finest.resize(n*n);
+            osg::Vec4f value;
+
+            for (int row = 0; row < n; ++row)
+            {
+                int tb = n - 1 - row; // image rows run south to north
+                int t0 = tb*T/n, t1 = osg::maximum(t0 + 1, (tb + 1)*T/n);
+
+                for (int col = 0; col < n; ++col)
+                {
+                    int s0 = col*S/n, s1 = osg::maximum(s0 + 1, (col + 1)*S/n);
+
+                    osg::Vec2f& mm = finest[row*n + col];
+                    mm.set(FLT_MAX, -FLT_MAX);
+                    for (int t = t0; t < t1; ++t)
+                    {
+                        for (int s = s0; s < s1; ++s)
+                        {
+                            read(value, s, t);
+                            mm.x() = osg::minimum(mm.x(), value.a());
+                            mm.y() = osg::maximum(mm.y(), value.a());
+                        }
+                    }
+                }
+            }
+
+            // each coarser cell merges its four children
+            while (d-- > 0u)
+            {
+                n = 1 << d;
+                const std::vector<osg::Vec2f>& child = _levels[d + 1u];
+                std::vector<osg::Vec2f>& level = _levels[d];
+                level.resize(n*n);
+
+                for (int row = 0; row < n; ++row)
+                {
+                    for (int col = 0; col < n; ++col)
+                    {
+                        const osg::Vec2f& a = child[(2*row)*(2*n) + 2*col];
+                        const osg::Vec2f& b = child[(2*row)*(2*n) + 2*col + 1];
+                        const osg::Vec2f& c = child[(2*row + 1)*(2*n) + 2*col];
+                        const osg::Vec2f& e = child[(2*row + 1)*(2*n) + 2*col + 1];
+                        level[row*n + col].set(
+                            osg::minimum(osg::minimum(a.x(), b.x()), osg::minimum(c.x(), e.x())),
+                            osg::maximum(osg::maximum(a.y(), b.y()), osg::maximum(c.y(), e.y())));
+                    }
+                }
+            }
+        }
+    };
+
+    // Tells the mask layer to skip tiles that its coarse coverage shows as
+    // all land or all water, so the terrain reuses the parent's mask there.
+    class MaskCoverage : public ImageLayer::Callback
+    {
+    public:
+        MaskCoverage(ImageLayer* mask, const Profile* profile, unsigned lod) :
+            _mask(mask),
+            _profile(profile),
+            _lod(lod),
+            _cache(true, 128u)
+        {
+            //nop
+        }
+
+        bool mayHaveData(const TileKey& key) const
+        {
+            // only keys in the map profile; the mask layer may query
+            // its own native keys while assembling a coverage tile
+            if (key.getLOD() <= _lod || !key.getProfile()->isHorizEquivalentTo(_profile.get()))
+                return true;
+
+            TileKey coarseKey = key.createAncestorKey(_lod);
+            osg::ref_ptr<Coverage> coverage = getOrCreateCoverage(coarseKey);
+            if (!coverage.valid())
+                return true;
+
+            unsigned d = key.getLOD() - _lod;
+            unsigned col = key.getTileX() - (coarseKey.getTileX() << d);
+            unsigned row = key.getTileY() - (coarseKey.getTileY() << d);
+            if (d >= COVERAGE_LEVELS)
+            {
+                col >>= (d - COVERAGE_LEVELS + 1u);
+                row >>= (d - COVERAGE_LEVELS + 1u);
+                d = COVERAGE_LEVELS - 1u;
+            }
+
+            const osg::Vec2f& mm = coverage->_levels[d][row*(1u << d) + col];
+            const float epsilon = 1.0f/255.0f;
+            bool allLand = mm.y() <= epsilon;
+            bool allWater = mm.x() >= 1.0f - epsilon;
+            return !allLand && !allWater;
+        }
+
+    private:
+        osg::observer_ptr<ImageLayer> _mask;
+        osg::ref_ptr<const Profile> _profile;
+        unsigned _lod;
+        mutable LRUCache<TileKey, osg::ref_ptr<Coverage> > _cache;
+
+        osg::ref_ptr<Coverage> getOrCreateCoverage(const TileKey& key) const
+        {
+            LRUCache<TileKey, osg::ref_ptr<Coverage> >::Record rec;
+            if (_cache.get(key, rec))
+                return rec.value();
+
+            osg::ref_ptr<ImageLayer> mask;
+            if (!_mask.lock(mask))
+                return 0L;
+
+            // a failed read is cached too (as NULL) so we don't keep retrying
+            osg::ref_ptr<Coverage> coverage;
+            GeoImage image = mask->createImage(key, 0L);
+            if (image.valid() && ImageUtils::PixelReader::supports(image.getImage()))
+                coverage = new Coverage(image.getImage());
+
+            _cache.insert(key, coverage);
+            return coverage;
+        }
+    };
+}
+
+//...................................................................
+
 
 /** Register this layer so it can be used in an earth file */
 REGISTER_OSGEARTH_LAYER(ocean, SimpleOceanLayer);
@@ -71,6 +223,7 @@ REGISTER_OSGEARTH_LAYER(simple_ocean, SimpleOceanLayer);
 
 OE_LAYER_PROPERTY_IMPL(SimpleOceanLayer, bool, UseBathymetry, useBathymetry);
 OE_LAYER_PROPERTY_IMPL(SimpleOceanLayer, unsigned, SurfaceTextureLOD, textureLOD);
+OE_LAYER_PROPERTY_IMPL(SimpleOceanLayer, unsigned, MaskCoverageLOD, maskCoverageLOD);
 
 
 void
@@ -229,6 +382,8 @@ SimpleOceanLayer::updateMaskLayer()
         ss->setDefine("OE_OCEAN_MASK", layer->getSharedTextureUniformName());
         ss->setDefine("OE_OCEAN_MASK_MATRIX", layer->getSharedTextureMatrixUniformName());
 
+        updateMaskCoverage(layer);
+
         OE_INFO << LC << "Installed \"" << layer->getName() << "\" as mask layer\n";
     }
 
@@ -238,14 +393,39 @@ SimpleOceanLayer::updateMaskLayer()
         ss->removeDefine("OE_OCEAN_MASK");
         ss->removeDefine("OE_OCEAN_MASK_MATRIX");
 
+        updateMaskCoverage(0L);
+
         //OE_INFO << LC << "Uninstalled mask layer\n";
     }
 }
 
+void
+SimpleOceanLayer::updateMaskCoverage(ImageLayer* layer)
+{
+    osg::ref_ptr<ImageLayer> oldLayer;
+    if (_maskCoverageLayer.lock(oldLayer) && _maskCoverage.valid())
+    {
+        oldLayer->removeCallback(_maskCoverage.get());
+    }
+    _maskCoverage = 0L;
+    _maskCoverageLayer = 0L;
+
+    if (layer && _mapProfile.valid() && options().maskCoverageLOD().isSet())
+    {
+        _maskCoverage = new MaskCoverage(layer, _mapProfile.get(), options().maskCoverageLOD().get());
+        _maskCoverageLayer = layer;
+        layer->addCallback(_maskCoverage.get());
+
+        OE_INFO << LC << "Mask coverage at LOD " << options().maskCoverageLOD().get() << "\n";
+    }
+}
+
 void
 SimpleOceanLayer::addedToMap(const Map* map)
 {    
     VisibleLayer::addedToMap(map);
+
+    _mapProfile = map->getProfile();
     
     options().maskLayer().addedToMap(map);
     updateMaskLayer();
@@ -256,6 +436,8 @@ SimpleOceanLayer::removedFromMap(const Map* map)
 {
     options().maskLayer().removedFromMap(map);
     updateMaskLayer();
+    updateMaskCoverage(0L);
+    _mapProfile = 0L;
 
     VisibleLayer::removedFromMap(map);
 }
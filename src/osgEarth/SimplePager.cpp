@@ -2,6 +2,7 @@
 #include <osgEarth/TileKey>
 #include <osgEarth/Utils>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/PagingScheduler>
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
 #include <osg/ShapeDrawable>
@@ -319,6 +320,7 @@ osg::Node* SimplePager::createPagedNode(const TileKey& key, ProgressCallback* pr
         osgDB::Options* options = new osgDB::Options();
         OptionsData<SimplePager>::set(options, "osgEarth.SimplePager", this);
         OptionsData<ProgressTracker>::set(options, "osgEarth.SimplePager.ProgressTracker", tracker);
+        PagingScheduler::setSubsystem(options, PagingScheduler::SIMPLE_PAGER);
         plod->setDatabaseOptions( options );
         
         // Install an FLC if the caller provided one
@@ -19,6 +19,7 @@
 
 #include <osgEarth/SimplexNoise>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/JobArena>
 #include <algorithm>
 
 #define POW2(x) ((double)(x==0 ? 1 : (2 << (x-1))))
@@ -229,6 +230,120 @@ double SimplexNoise::getTiledValueWithTurbulence(double x, double y, double F) c
     return n;
 }
 
+namespace
+{
+    // Shares the rows of a tiled noise grid between the calling thread
+    // and helpers from the job arena, one row per claim.
+    struct TiledRowGroup : public osg::Referenced
+    {
+        TiledRowGroup(const SimplexNoise& noise, const double* x, unsigned numX, const double* y, unsigned numY, double* output) :
+            _noise(noise), _x(x), _numX(numX), _y(y), _numY(numY), _output(output),
+            _next(0u), _remaining(numY) { }
+
+        void run()
+        {
+            for(;;)
+            {
+                unsigned row = (++_next) - 1u;
+                if (row >= _numY)
+                    break;
+
+                _noise.getTiledValues(_x, _numX, _y + row, 1u, _output + row*_numX, false);
+
+                if (--_remaining == 0u)
+                    _done.set();
+            }
+        }
+
+        struct RowTask : public TaskRequest
+        {
+            RowTask(TiledRowGroup* group) : _group(group) { }
+
+            void operator()(ProgressCallback*)
+            {
+                _group->run();
+            }
+
+            osg::ref_ptr<TiledRowGroup> _group;
+        };
+
+        SimplexNoise _noise;
+        const double* _x;
+        unsigned _numX;
+        const double* _y;
+        unsigned _numY;
+        double* _output;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+    };
+}
+
+void SimplexNoise::getTiledValues(const double* x, unsigned numX, const double* y, unsigned numY, double* output, bool parallel) const
+{
+    if (numX == 0 || numY == 0)
+        return;
+
+    if (parallel && numY > 1u)
+    {
+        osg::ref_ptr<TiledRowGroup> group = new TiledRowGroup(*this, x, numX, y, numY, output);
+        JobArena* arena = JobArena::get("oe.noise");
+        unsigned numHelpers = osg::minimum(arena->getConcurrency(), numY - 1u);
+        for (unsigned i = 0; i < numHelpers; ++i)
+        {
+            arena->dispatch(new TiledRowGroup::RowTask(group.get()));
+        }
+        group->run();
+        group->_done.wait();
+        return;
+    }
+
+    // Same as getTiledValue, but the circle mapping is computed once per
+    // column and once per row, and the octave parameters once per grid.
+    const double TwoPI = 2.0 * osg::PI;
+    unsigned o = osg::maximum(1u, _octaves);
+
+    std::vector<double> freqs(o), amps(o);
+    double freq = _freq, amp = 1.0, maxamp = 0.0;
+    for(unsigned k=0; k<o; ++k)
+    {
+        freqs[k] = freq, amps[k] = amp;
+        maxamp += amp;
+        amp *= _pers;
+        freq *= _lacunarity;
+    }
+
+    std::vector<double> nx(numX), nz(numX);
+    for(unsigned i=0; i<numX; ++i)
+    {
+        nx[i] = cos(x[i]*TwoPI)/TwoPI;
+        nz[i] = sin(x[i]*TwoPI)/TwoPI;
+    }
+
+    for(unsigned j=0; j<numY; ++j)
+    {
+        double ny = cos(y[j]*TwoPI)/TwoPI;
+        double nw = sin(y[j]*TwoPI)/TwoPI;
+        double* out = output + j*numX;
+
+        for(unsigned i=0; i<numX; ++i)
+        {
+            double n = 0.0;
+            for(unsigned k=0; k<o; ++k)
+            {
+                n += Noise(nx[i]*freqs[k], ny*freqs[k], nz[i]*freqs[k], nw*freqs[k]) * amps[k];
+            }
+
+            if ( _normalize )
+            {
+                n /= maxamp;
+                n = n * (_high-_low)/2.0 + (_high+_low)/2.0;
+            }
+            out[i] = n;
+        }
+    }
+}
+
 double SimplexNoise::getValue(double xin, double yin) const
 {
     double freq = _freq;
@@ -673,15 +788,21 @@ SimplexNoise::createSeamlessImage(unsigned dim) const
     float minN =  FLT_MAX;
     float maxN = -FLT_MAX;
 
+    // generate the whole grid at once:
+    std::vector<double> coords(dim);
+    for (unsigned i = 0; i < dim; ++i)
+        coords[i] = (double)i / (double)dim;
+
+    std::vector<double> values(dim*dim);
+    noise.getTiledValues(&coords[0], dim, &coords[0], dim, &values[0], true);
+
     // populate the image, tracking the min and max noise readings:
     osg::Vec4f value;
     for (unsigned s = 0; s < dim; ++s)
     {
-        double u = (double)s / (double)dim;
         for (unsigned t = 0; t < dim; ++t)
         {
-            double v = (double)t / (double)dim;
-            value.r() = noise.getTiledValue(u, v);
+            value.r() = values[t*dim + s];
             minN = osg::minimum(minN, value.r());
             maxN = osg::maximum(maxN, value.r());
             write(value, s, t);
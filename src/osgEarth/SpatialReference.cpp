@@ -44,37 +44,180 @@ namespace
         return "";
     } 
 
+    // The batch kernels below keep the per-ellipsoid constants out of the
+    // loops and avoid any per-point calls, so the compiler can vectorize them.
+
     void geodeticToGeocentric(std::vector<osg::Vec3d>& points, const osg::EllipsoidModel* em)
     {
-        for( unsigned i=0; i<points.size(); ++i )
+        const double a = em->getRadiusEquator();
+        const double e2 = em->getEccentricitySquared();
+        const double d2r = osg::PI / 180.0;
+        const unsigned count = points.size();
+        osg::Vec3d* p = count > 0 ? &points[0] : 0L;
+
+        for(unsigned i=0; i<count; ++i)
         {
-            double x, y, z;
-            em->convertLatLongHeightToXYZ(
-                osg::DegreesToRadians( points[i].y() ), osg::DegreesToRadians( points[i].x() ), points[i].z(),
-                x, y, z );
-            points[i].set( x, y, z );
+            double lat = p[i].y() * d2r, lon = p[i].x() * d2r, h = p[i].z();
+            double sinLat = sin(lat), cosLat = cos(lat);
+            double N = a / sqrt(1.0 - e2*sinLat*sinLat);
+            p[i].set(
+                (N + h) * cosLat * cos(lon),
+                (N + h) * cosLat * sin(lon),
+                (N*(1.0-e2) + h) * sinLat);
         }
     }
 
     void geocentricToGeodetic(std::vector<osg::Vec3d>& points, const osg::EllipsoidModel* em)
     {
-        for( unsigned i=0; i<points.size(); ++i )
+        // Bowring's method, as in osg::EllipsoidModel::convertXYZToLatLongHeight
+        const double a = em->getRadiusEquator();
+        const double b = em->getRadiusPolar();
+        const double e2 = em->getEccentricitySquared();
+        const double ed2 = (a*a - b*b) / (b*b);
+        const double r2d = 180.0 / osg::PI;
+        const unsigned count = points.size();
+        osg::Vec3d* pt = count > 0 ? &points[0] : 0L;
+
+        for(unsigned i=0; i<count; ++i)
+        {
+            double X = pt[i].x(), Y = pt[i].y(), Z = pt[i].z();
+            double p = sqrt(X*X + Y*Y);
+
+            if (p == 0.0)
+            {
+                // on the polar axis (or the center of the earth), where
+                // the general solution is undefined
+                pt[i].set(0.0, Z < 0.0 ? -90.0 : 90.0, Z < 0.0 ? -Z - b : Z - b);
+                continue;
+            }
+
+            double theta = atan2(Z*a, p*b);
+            double sinTheta = sin(theta), cosTheta = cos(theta);
+            double lat = atan(
+                (Z + ed2*b*sinTheta*sinTheta*sinTheta) /
+                (p - e2*a*cosTheta*cosTheta*cosTheta));
+            double sinLat = sin(lat);
+            double N = a / sqrt(1.0 - e2*sinLat*sinLat);
+
+            pt[i].set(atan2(Y, X) * r2d, lat * r2d, p/cos(lat) - N);
+        }
+    }
+
+    // wraps a longitude into [-180, 180], like PROJ does.
+    inline double wrapLongitude(double lon)
+    {
+        return lon < -180.0 || lon > 180.0 ? lon - 360.0*floor((lon + 180.0)/360.0) : lon;
+    }
+
+    // geographic (degrees) to spherical mercator on a sphere of radius R
+    bool geographicToSphericalMercator(double* x, double* y, unsigned count, double R)
+    {
+        const double d2r = osg::PI / 180.0;
+        bool ok = true;
+        for(unsigned i=0; i<count; ++i)
+        {
+            double lat = y[i] * d2r;
+            if (fabs(fabs(lat) - osg::PI_2) <= 1e-10)
+            {
+                x[i] = y[i] = HUGE_VAL;
+                ok = false;
+                continue;
+            }
+            x[i] = R * wrapLongitude(x[i]) * d2r;
+            y[i] = R * log(tan(osg::PI_4 + 0.5*lat));
+        }
+        return ok;
+    }
+
+    bool sphericalMercatorToGeographic(double* x, double* y, unsigned count, double R)
+    {
+        const double r2d = 180.0 / osg::PI;
+        for(unsigned i=0; i<count; ++i)
         {
-            double lat, lon, alt;
-            em->convertXYZToLatLongHeight(
-                points[i].x(), points[i].y(), points[i].z(),
-                lat, lon, alt );
-
-            // deal with bug in OSG 3.4.x in which convertXYZToLatLongHeight can return
-            // NANs when converting from (0,0,0) with a spherical ellipsoid -gw 2/5/2019
-            if (osg::isNaN(lon)) lon = 0.0;
-            if (osg::isNaN(lat)) lat = 0.0;
-            if (osg::isNaN(alt)) alt = 0.0;
-
-            points[i].set( osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), alt );
+            x[i] = wrapLongitude(x[i]/R * r2d);
+            y[i] = (osg::PI_2 - 2.0*atan(exp(-y[i]/R))) * r2d;
         }
+        return true;
     }
 
+    // Transverse Mercator by the 3rd-order Krueger series (as in the UTM
+    // literature), good to well under a millimeter within a UTM zone.
+    struct TransverseMercator
+    {
+        double lon0, k0A, falseEasting, falseNorthing, e;
+        double alpha[3], beta[3], delta[3];
+
+        TransverseMercator(double a, double b, int zone, bool south)
+        {
+            double f = (a - b) / a;
+            double n = f / (2.0 - f), n2 = n*n, n3 = n2*n;
+            lon0 = osg::DegreesToRadians(-183.0 + 6.0*zone);
+            k0A = 0.9996 * a / (1.0 + n) * (1.0 + n2/4.0 + n2*n2/64.0);
+            falseEasting = 500000.0;
+            falseNorthing = south ? 10000000.0 : 0.0;
+            e = 2.0*sqrt(n) / (1.0 + n);
+            alpha[0] = n/2.0 - 2.0*n2/3.0 + 5.0*n3/16.0;
+            alpha[1] = 13.0*n2/48.0 - 3.0*n3/5.0;
+            alpha[2] = 61.0*n3/240.0;
+            beta[0] = n/2.0 - 2.0*n2/3.0 + 37.0*n3/96.0;
+            beta[1] = n2/48.0 + n3/15.0;
+            beta[2] = 17.0*n3/480.0;
+            delta[0] = 2.0*n - 2.0*n2/3.0 - 2.0*n3;
+            delta[1] = 7.0*n2/3.0 - 8.0*n3/5.0;
+            delta[2] = 56.0*n3/15.0;
+        }
+
+        bool forward(double* x, double* y, unsigned count) const
+        {
+            const double d2r = osg::PI / 180.0;
+            for(unsigned i=0; i<count; ++i)
+            {
+                double lat = y[i]*d2r;
+                double dlon = wrapLongitude(x[i] - osg::RadiansToDegrees(lon0)) * d2r;
+                double sinLat = sin(lat);
+                double t = sinh(atanh(sinLat) - e*atanh(e*sinLat));
+                double xi = atan2(t, cos(dlon));
+                double eta = atanh(sin(dlon) / sqrt(1.0 + t*t));
+                double E = eta, N = xi;
+                for(int j=0; j<3; ++j)
+                {
+                    double k = 2.0*(j+1);
+                    E += alpha[j] * cos(k*xi) * sinh(k*eta);
+                    N += alpha[j] * sin(k*xi) * cosh(k*eta);
+                }
+                x[i] = falseEasting + k0A*E;
+                y[i] = falseNorthing + k0A*N;
+            }
+            return true;
+        }
+
+        bool inverse(double* x, double* y, unsigned count) const
+        {
+            const double r2d = 180.0 / osg::PI;
+            for(unsigned i=0; i<count; ++i)
+            {
+                double xi = (y[i] - falseNorthing) / k0A;
+                double eta = (x[i] - falseEasting) / k0A;
+                double xip = xi, etap = eta;
+                for(int j=0; j<3; ++j)
+                {
+                    double k = 2.0*(j+1);
+                    xip -= beta[j] * sin(k*xi) * cosh(k*eta);
+                    etap -= beta[j] * cos(k*xi) * sinh(k*eta);
+                }
+                double chi = asin(sin(xip) / cosh(etap));
+                double lat = chi;
+                for(int j=0; j<3; ++j)
+                {
+                    lat += delta[j] * sin(2.0*(j+1)*chi);
+                }
+                x[i] = wrapLongitude((lon0 + atan2(sinh(etap), cos(xip))) * r2d);
+                y[i] = lat * r2d;
+            }
+            return true;
+        }
+    };
+
     // Make a MatrixTransform suitable for use with a Locator object based on the given extents.
     // Calling Locator::setTransformAsExtents doesn't work with OSG 2.6 due to the fact that the
     // _inverse member isn't updated properly.  Calling Locator::setTransform works correctly.
@@ -390,6 +533,8 @@ _is_contiguous  ( false ),
 _is_user_defined( false ),
 _is_ltp         ( false ),
 _is_spherical_mercator( false ),
+_utm_zone       ( 0 ),
+_utm_south      ( false ),
 _ellipsoidId(0u)
 {
     // nop
@@ -409,7 +554,9 @@ _is_north_polar  ( false ),
 _is_south_polar  ( false ),
 _is_cube         ( false ),
 _is_contiguous   ( false ),
-_is_user_defined ( false )
+_is_user_defined ( false ),
+_utm_zone        ( 0 ),
+_utm_south       ( false )
 {
     //nop
 }
@@ -427,9 +574,12 @@ SpatialReference::~SpatialReference()
             OE_DEBUG << LC << "Destroying [unitialized SRS]" << std::endl;
         }
 
-        for (TransformHandleCache::iterator itr = _transformHandleCache.begin(); itr != _transformHandleCache.end(); ++itr)
+        for (ThreadTransformHandleCaches::iterator t = _transformHandleCaches.begin(); t != _transformHandleCaches.end(); ++t)
         {
-            OCTDestroyCoordinateTransformation(itr->second);
+            for (TransformHandleCache::iterator itr = t->second.begin(); itr != t->second.end(); ++itr)
+            {
+                OCTDestroyCoordinateTransformation(itr->second);
+            }
         }
 
         if ( _owns_handle )
@@ -1068,25 +1218,27 @@ SpatialReference::transformXYPointArrays(double*  x,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
-    // Transform the X and Y values inside an exclusive GDAL/OGR lock
-    GDAL_SCOPED_LOCK;
+    // Common pairs have native kernels, which avoid PROJ and the GDAL lock.
+    bool success;
+    if (transformXYPointArraysNative(x, y, count, out_srs, success))
+        return success;
 
-    //OE_INFO << LC << "Attempt transfrom from \n"
-    //    << "    " << getHorizInitString() << "\n"
-    //    << " -> " << out_srs->getHorizInitString() << std::endl;
+    // Each thread has its own transformation handles, so only creating
+    // a handle needs the GDAL lock.
+    TransformHandleCache& cache = getTransformHandleCache();
 
     void* xform_handle = NULL;
-    TransformHandleCache::const_iterator itr = _transformHandleCache.find(out_srs->getWKT());
-    if (itr != _transformHandleCache.end())
+    TransformHandleCache::const_iterator itr = cache.find(out_srs->getWKT());
+    if (itr != cache.end())
     {
-        //OE_DEBUG << LC << "using cached transform handle" << std::endl;
         xform_handle = itr->second;
     }
     else
     {
         OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
+        GDAL_SCOPED_LOCK;
         xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
-        const_cast<SpatialReference*>(this)->_transformHandleCache[out_srs->getWKT()] = xform_handle;
+        cache[out_srs->getWKT()] = xform_handle;
     }
 
     if ( !xform_handle )
@@ -1107,6 +1259,62 @@ SpatialReference::transformXYPointArrays(double*  x,
     return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
 }
 
+SpatialReference::TransformHandleCache&
+SpatialReference::getTransformHandleCache() const
+{
+    SpatialReference* ncthis = const_cast<SpatialReference*>(this);
+    Threading::ScopedMutexLock lock(ncthis->_transformHandleCachesMutex);
+    return ncthis->_transformHandleCaches[Threading::getCurrentThreadId()];
+}
+
+
+
+bool
+SpatialReference::transformXYPointArraysNative(double*  x,
+                                               double*  y,
+                                               unsigned count,
+                                               const SpatialReference* out_srs,
+                                               bool&    success) const
+{
+    // geographic <-> spherical mercator (the standard web mercator definition
+    // only), on the same geographic datum:
+    if (isGeographic() && out_srs->isSphericalMercator() &&
+        out_srs->isHorizEquivalentTo(get("spherical-mercator")) &&
+        isHorizEquivalentTo(out_srs->getGeographicSRS()))
+    {
+        success = geographicToSphericalMercator(x, y, count, out_srs->getEllipsoid()->getRadiusEquator());
+        return true;
+    }
+
+    if (isSphericalMercator() && out_srs->isGeographic() &&
+        isHorizEquivalentTo(get("spherical-mercator")) &&
+        out_srs->isHorizEquivalentTo(getGeographicSRS()))
+    {
+        success = sphericalMercatorToGeographic(x, y, count, getEllipsoid()->getRadiusEquator());
+        return true;
+    }
+
+    // geographic <-> UTM, on the same geographic datum:
+    if (isGeographic() && out_srs->_utm_zone > 0 &&
+        isHorizEquivalentTo(out_srs->getGeographicSRS()))
+    {
+        const osg::EllipsoidModel* em = out_srs->getEllipsoid();
+        TransverseMercator tm(em->getRadiusEquator(), em->getRadiusPolar(), out_srs->_utm_zone, out_srs->_utm_south);
+        success = tm.forward(x, y, count);
+        return true;
+    }
+
+    if (_utm_zone > 0 && out_srs->isGeographic() &&
+        out_srs->isHorizEquivalentTo(getGeographicSRS()))
+    {
+        const osg::EllipsoidModel* em = getEllipsoid();
+        TransverseMercator tm(em->getRadiusEquator(), em->getRadiusPolar(), _utm_zone, _utm_south);
+        success = tm.inverse(x, y, count);
+        return true;
+    }
+
+    return false;
+}
 
 bool
 SpatialReference::transformZ(std::vector<osg::Vec3d>& points,
@@ -1502,6 +1710,26 @@ SpatialReference::_init()
         CPLFree( proj4buf );
     }
 
+    // Detect UTM, which has a native transform kernel. Only metric
+    // definitions qualify.
+    _utm_zone = 0;
+    _utm_south = false;
+    std::string::size_type u = _proj4.find("+units=");
+    if ( _proj4.find("+proj=utm") != std::string::npos &&
+         (u == std::string::npos || _proj4.substr(u+7, _proj4.find(' ', u) - (u+7)) == "m") )
+    {
+        std::string::size_type z = _proj4.find("+zone=");
+        if ( z != std::string::npos )
+        {
+            int zone = as<int>( _proj4.substr(z+6, _proj4.find(' ', z) - (z+6)), 0 );
+            if ( zone >= 1 && zone <= 60 )
+            {
+                _utm_zone = zone;
+                _utm_south = _proj4.find("+south") != std::string::npos;
+            }
+        }
+    }
+
     // Try to extract the OGC well-known-text (WKT) string:
     char* wktbuf;
     if ( OSRExportToWkt( _handle, &wktbuf ) == OGRERR_NONE )
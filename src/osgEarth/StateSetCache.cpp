@@ -20,6 +20,7 @@
 #include <osg/NodeVisitor>
 #include <osg/BufferIndexBinding>
 #include <osg/ProxyNode>
+#include <osg/Texture>
 
 #define LC "[StateSetCache] "
 
@@ -247,43 +248,73 @@ namespace
 //------------------------------------------------------------------------
 
 StateSetCache::StateSetCache() :
-    _pruneCount       ( 0 ),
-    _maxSize          ( DEFAULT_PRUNE_ACCESS_COUNT ),
-    _attrShareAttempts( 0 ),
-    _attrsIneligible  ( 0 ),
-    _attrShareHits    ( 0 ),
-    _attrShareMisses  ( 0 )
+    _maxSize( DEFAULT_PRUNE_ACCESS_COUNT ),
+    _pruned ( 0u )
 {
     //nop
 }
 
 StateSetCache::~StateSetCache()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-    prune();
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedWriteLock lock( _shards[s]._mutex );
+        prune( _shards[s] );
+    }
 }
 
 void
 StateSetCache::releaseGLObjects(osg::State* state) const
 {
-    Threading::ScopedMutexLock lock( _mutex );
-    for(StateSetSet::const_iterator i = _stateSetCache.begin(); i != _stateSetCache.end(); ++i)
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
     {
-        i->get()->releaseGLObjects(state);
+        const Shard& shard = _shards[s];
+        Threading::ScopedReadLock lock( shard._mutex );
+        for(StateSetSet::const_iterator i = shard._stateSets.begin(); i != shard._stateSets.end(); ++i)
+        {
+            i->get()->releaseGLObjects(state);
+        }
     }
-
 }
 
 void
 StateSetCache::setMaxSize(unsigned value)
 {
     _maxSize = value;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
     {
-        Threading::ScopedMutexLock lock( _mutex );
-        pruneIfNecessary();
+        Threading::ScopedWriteLock lock( _shards[s]._mutex );
+        pruneIfNecessary( _shards[s] );
     }
 }
 
+StateSetCache::Shard&
+StateSetCache::getShard(const osg::StateSet* stateSet)
+{
+    // Only use properties that StateSet::compare treats as significant,
+    // so that equal statesets always land in the same shard.
+    unsigned h = 17u;
+    const osg::StateSet::AttributeList& attrs = stateSet->getAttributeList();
+    for(osg::StateSet::AttributeList::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+    {
+        h = h*31u + (unsigned)i->first.first;
+        h = h*31u + i->first.second;
+    }
+    h = h*31u + stateSet->getModeList().size();
+    h = h*31u + stateSet->getTextureAttributeList().size();
+    h = h*31u + stateSet->getUniformList().size();
+    h ^= (h >> 16);
+    return _shards[h % NUM_SHARDS];
+}
+
+StateSetCache::Shard&
+StateSetCache::getShard(const osg::StateAttribute* attr)
+{
+    // StateAttribute::compare orders by type first
+    unsigned h = (unsigned)attr->getType();
+    return _shards[h % NUM_SHARDS];
+}
+
 void
 StateSetCache::consolidateStateAttributes(osg::Node* node, bool traverseProxies)
 {
@@ -336,112 +367,130 @@ StateSetCache::share(osg::ref_ptr<osg::StateSet>& input,
     osg::ref_ptr<osg::StateSet>& output,
     bool                         checkEligible)
 {
-    bool shared     = false;
-    //bool shareattrs = true;
-
-    if ( !checkEligible || eligible(input.get()) )
+    if ( checkEligible && !eligible(input.get()) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
-
-        pruneIfNecessary();
+        _ineligible++;
+        output = input.get();
+        return false;
+    }
 
-        //shareattrs = false;
+    Shard& shard = getShard(input.get());
 
-        std::pair<StateSetSet::iterator,bool> result = _stateSetCache.insert( input );
-        if ( result.second )
-        {
-            // first use
-            output = input.get();
-            //shareattrs = true;
-            shared = false;
-        }
-        else
+    // most calls find a match, so try that under the shared lock first.
+    {
+        Threading::ScopedReadLock lock( shard._mutex );
+        StateSetSet::const_iterator i = shard._stateSets.find( input );
+        if ( i != shard._stateSets.end() )
         {
-            // found a share!
-            output = result.first->get();
-            shared = true;
+            output = i->get();
+            _stateSetShareHits++;
+            return true;
         }
     }
-    else
+
+    Threading::ScopedWriteLock lock( shard._mutex );
+
+    pruneIfNecessary( shard );
+
+    // another thread may have inserted an equal stateset since we checked.
+    std::pair<StateSetSet::iterator,bool> result = shard._stateSets.insert( input );
+    if ( result.second )
     {
+        // first use
         output = input.get();
-        shared = false;
+        _stateSetShareMisses++;
+        return false;
+    }
+    else
+    {
+        // found a share!
+        output = result.first->get();
+        _stateSetShareHits++;
+        return true;
     }
-
-    // OBE.
-    //if ( shareattrs )
-    //{
-    //    ShareStateAttributes sa(this);
-    //    sa.applyStateSet( input.get() );
-    //}
-
-    return shared;
 }
 
-
-
 bool
 StateSetCache::share(osg::ref_ptr<osg::StateAttribute>& input,
     osg::ref_ptr<osg::StateAttribute>& output,
     bool                               checkEligible)
 {
-    _attrShareAttempts++;
-
-    if ( !checkEligible || eligible(input.get()) )
+    if ( checkEligible && !eligible(input.get()) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
+        _ineligible++;
+        output = input.get();
+        return false;
+    }
 
-        pruneIfNecessary();
+    Shard& shard = getShard(input.get());
 
-        std::pair<StateAttributeSet::iterator,bool> result = _stateAttributeCache.insert( input );
-        if ( result.second )
-        {
-            // first use
-            output = input.get();
-            _attrShareMisses++;
-            return false;
-        }
-        else
+    {
+        Threading::ScopedReadLock lock( shard._mutex );
+        StateAttributeSet::const_iterator i = shard._attributes.find( input );
+        if ( i != shard._attributes.end() )
         {
-            // found a share!
-            output = result.first->get();
+            output = i->get();
             _attrShareHits++;
             return true;
         }
     }
-    else
+
+    Threading::ScopedWriteLock lock( shard._mutex );
+
+    pruneIfNecessary( shard );
+
+    std::pair<StateAttributeSet::iterator,bool> result = shard._attributes.insert( input );
+    if ( result.second )
     {
-        _attrsIneligible++;
+        // first use
         output = input.get();
+        _attrShareMisses++;
         return false;
     }
+    else
+    {
+        // found a share!
+        output = result.first->get();
+        _attrShareHits++;
+        return true;
+    }
 }
 
 void
-StateSetCache::pruneIfNecessary()
+StateSetCache::pruneIfNecessary(Shard& shard)
 {
-    // assume an exclusve mutex is taken
-    if ( _pruneCount++ >= _maxSize )
+    // assume the shard's write lock is taken
+    if ( ++shard._accesses >= _maxSize )
     {
-        prune();
-        _pruneCount = 0;
+        prune( shard );
+        shard._accesses.exchange( 0 );
     }
 }
 
 void
 StateSetCache::prune()
 {
-    // assume an exclusive mutex is taken.
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedWriteLock lock( _shards[s]._mutex );
+        prune( _shards[s] );
+    }
+}
+
+void
+StateSetCache::prune(Shard& shard)
+{
+    // assume the shard's write lock is taken.
 
     unsigned ss_count = 0, sa_count = 0;
 
-    for( StateSetSet::iterator i = _stateSetCache.begin(); i != _stateSetCache.end(); )
+    for( StateSetSet::iterator i = shard._stateSets.begin(); i != shard._stateSets.end(); )
     {
         if ( i->get()->referenceCount() <= 1 )
         {
             // do not call releaseGLObjects since the attrs themselves might still be shared
             // TODO: review this.
-            _stateSetCache.erase( i++ );
+            shard._stateSets.erase( i++ );
             ss_count++;
         }
         else
@@ -450,12 +499,12 @@ StateSetCache::prune()
         }
     }
 
-    for( StateAttributeSet::iterator i = _stateAttributeCache.begin(); i != _stateAttributeCache.end(); )
+    for( StateAttributeSet::iterator i = shard._attributes.begin(); i != shard._attributes.end(); )
     {
         if ( i->get()->referenceCount() <= 1 )
         {
             i->get()->releaseGLObjects( 0L );
-            _stateAttributeCache.erase( i++ );
+            shard._attributes.erase( i++ );
             sa_count++;
         }
         else
@@ -464,28 +513,94 @@ StateSetCache::prune()
         }
     }
 
-    OE_DEBUG << LC << "Pruned " << sa_count << " attributes, " << ss_count << " statesets" << std::endl;
+    if ( ss_count + sa_count > 0 )
+    {
+        Threading::ScopedMutexLock lock( _prunedMutex );
+        _pruned += (ss_count + sa_count);
+        OE_DEBUG << LC << "Pruned " << sa_count << " attributes, " << ss_count << " statesets" << std::endl;
+    }
+}
+
+unsigned
+StateSetCache::size() const
+{
+    unsigned count = 0u;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedReadLock lock( _shards[s]._mutex );
+        count += _shards[s]._stateSets.size();
+    }
+    return count;
 }
 
 void
 StateSetCache::clear()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-
-    prune();
-    _stateAttributeCache.clear();
-    _stateSetCache.clear();
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Shard& shard = _shards[s];
+        Threading::ScopedWriteLock lock( shard._mutex );
+        prune( shard );
+        shard._attributes.clear();
+        shard._stateSets.clear();
+    }
 }
 
+StateSetCache::Stats
+StateSetCache::getStats() const
+{
+    Stats stats;
+    stats.stateSets = 0u;
+    stats.attributes = 0u;
+    stats.textureMB = 0.0;
+
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        const Shard& shard = _shards[s];
+        Threading::ScopedReadLock lock( shard._mutex );
+        stats.stateSets += shard._stateSets.size();
+        stats.attributes += shard._attributes.size();
+
+        for(StateAttributeSet::const_iterator i = shard._attributes.begin(); i != shard._attributes.end(); ++i)
+        {
+            const osg::Texture* tex = dynamic_cast<const osg::Texture*>(i->get());
+            if ( tex )
+            {
+                for(unsigned k = 0; k < tex->getNumImages(); ++k)
+                {
+                    const osg::Image* image = tex->getImage(k);
+                    if ( image )
+                        stats.textureMB += (double)image->getTotalSizeInBytes() / 1048576.0;
+                }
+            }
+        }
+    }
+
+    stats.stateSetHits   = _stateSetShareHits;
+    stats.stateSetMisses = _stateSetShareMisses;
+    stats.attrHits       = _attrShareHits;
+    stats.attrMisses     = _attrShareMisses;
+    stats.ineligible     = _ineligible;
+    {
+        Threading::ScopedMutexLock lock( _prunedMutex );
+        stats.pruned = _pruned;
+    }
+    return stats;
+}
 
 void
 StateSetCache::dumpStats()
 {
-    Threading::ScopedMutexLock lock( _mutex );
+    Stats stats = getStats();
 
     OE_NOTICE << LC << "StateSetCache Dump:" << std::endl
-        << "    attr attempts     = " << _attrShareAttempts << std::endl
-        << "    ineligibles attrs = " << _attrsIneligible << std::endl
-        << "    attr share hits   = " << _attrShareHits << std::endl
-        << "    attr share misses = " << _attrShareMisses << std::endl;
+        << "    statesets           = " << stats.stateSets << std::endl
+        << "    attributes          = " << stats.attributes << std::endl
+        << "    texture memory (MB) = " << stats.textureMB << std::endl
+        << "    stateset hits       = " << stats.stateSetHits << std::endl
+        << "    stateset misses     = " << stats.stateSetMisses << std::endl
+        << "    attr share hits     = " << stats.attrHits << std::endl
+        << "    attr share misses   = " << stats.attrMisses << std::endl
+        << "    ineligibles         = " << stats.ineligible << std::endl
+        << "    pruned              = " << stats.pruned << std::endl;
 }
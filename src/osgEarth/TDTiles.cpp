@@ -23,12 +23,20 @@
 #include <osgEarth/URI>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
+#include <osgEarth/Endian>
+#include <osgEarth/Horizon>
+#include <osgEarth/PagingScheduler>
 #include <osgDB/FileNameUtils>
 #include <osgDB/Registry>
 #include <osgUtil/IncrementalCompileOperation>
 #include <osg/ShapeDrawable>
 #include <osg/PolygonMode>
 #include <osgEarth/LineDrawable>
+#include <osg/Geometry>
+#include <osg/Texture>
+#include <algorithm>
+#include <set>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -40,6 +48,156 @@ using namespace osgEarth::Contrib::ThreeDTiles;
 
 //........................................................................
 
+namespace
+{
+    // Estimates the memory used by loaded tile content: geometry arrays,
+    // primitive sets and texture images (each counted once).
+    struct ContentSizeVisitor : public osg::NodeVisitor
+    {
+        size_t _bytes;
+        std::set<const osg::Object*> _counted;
+
+        ContentSizeVisitor() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _bytes(0u)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Node& node)
+        {
+            applyStateSet(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            applyStateSet(drawable.getStateSet());
+
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom)
+            {
+                applyArray(geom->getVertexArray());
+                applyArray(geom->getNormalArray());
+                applyArray(geom->getColorArray());
+                applyArray(geom->getSecondaryColorArray());
+                applyArray(geom->getFogCoordArray());
+                for (unsigned i = 0; i < geom->getNumTexCoordArrays(); ++i)
+                    applyArray(geom->getTexCoordArray(i));
+                for (unsigned i = 0; i < geom->getNumVertexAttribArrays(); ++i)
+                    applyArray(geom->getVertexAttribArray(i));
+                for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                {
+                    const osg::DrawElements* de = geom->getPrimitiveSet(i)->getDrawElements();
+                    if (de && _counted.insert(de).second)
+                        _bytes += de->getTotalDataSize();
+                }
+            }
+        }
+
+        void applyArray(const osg::Array* array)
+        {
+            if (array && _counted.insert(array).second)
+                _bytes += array->getTotalDataSize();
+        }
+
+        void applyStateSet(osg::StateSet* stateSet)
+        {
+            if (!stateSet)
+                return;
+
+            for (unsigned unit = 0; unit < stateSet->getTextureAttributeList().size(); ++unit)
+            {
+                osg::Texture* tex = dynamic_cast<osg::Texture*>(
+                    stateSet->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+
+                if (tex && _counted.insert(tex).second)
+                {
+                    size_t imageBytes = 0u;
+                    for (unsigned i = 0; i < tex->getNumImages(); ++i)
+                    {
+                        if (tex->getImage(i))
+                            imageBytes += tex->getImage(i)->getTotalSizeInBytesIncludingMipmaps();
+                    }
+
+                    // the image may already be released after upload; fall back
+                    // on the texture size (RGBA with mipmaps).
+                    if (imageBytes == 0u)
+                    {
+                        imageBytes = (size_t)tex->getTextureWidth() * (size_t)tex->getTextureHeight() * 4u * 4u / 3u;
+                    }
+
+                    _bytes += imageBytes;
+                }
+            }
+        }
+    };
+
+    // eviction order under a memory budget
+    bool isLessImportant(const ThreeDTileNode* lhs, const ThreeDTileNode* rhs)
+    {
+        if (lhs->getLastScreenSpaceError() != rhs->getLastScreenSpaceError())
+            return lhs->getLastScreenSpaceError() < rhs->getLastScreenSpaceError();
+        return lhs->getLastCulledFrameNumber() < rhs->getLastCulledFrameNumber();
+    }
+}
+
+//........................................................................
+
+ContentBudget::ContentBudget() :
+    _maxBytes(0u),
+    _bytes(0u)
+{
+    //nop
+}
+
+ContentBudget*
+ContentBudget::getGlobal()
+{
+    static osg::ref_ptr<ContentBudget> s_global;
+    static Threading::Mutex s_globalMutex;
+
+    ScopedMutexLock lock(s_globalMutex);
+    if (!s_global.valid())
+    {
+        s_global = new ContentBudget();
+        const char* c = ::getenv("OSGEARTH_3DTILES_MAX_MEMORY_MB");
+        if (c)
+        {
+            s_global->setMaxBytes((size_t)atoi(c) * 1024u * 1024u);
+        }
+    }
+    return s_global.get();
+}
+
+size_t
+ContentBudget::getBytes() const
+{
+    ScopedMutexLock lock(_mutex);
+    return _bytes;
+}
+
+bool
+ContentBudget::isOverBudget() const
+{
+    ScopedMutexLock lock(_mutex);
+    return _maxBytes > 0u && _bytes > _maxBytes;
+}
+
+void
+ContentBudget::add(size_t bytes)
+{
+    ScopedMutexLock lock(_mutex);
+    _bytes += bytes;
+}
+
+void
+ContentBudget::remove(size_t bytes)
+{
+    ScopedMutexLock lock(_mutex);
+    _bytes = bytes < _bytes ? _bytes - bytes : 0u;
+}
+
+//........................................................................
+
 namespace osgEarth { namespace Contrib { namespace ThreeDTiles
 {
     class ThreeDTilesJSONReaderWriter : public osgDB::ReaderWriter
@@ -278,6 +436,222 @@ TileContent::getJSON() const
 
 //........................................................................
 
+void
+ImplicitTiling::fromJSON(const Json::Value& value, LoadContext& lc)
+{
+    if (value.isMember("subdivisionScheme"))
+        octree() = osgEarth::ciEquals(value["subdivisionScheme"].asString(), "OCTREE");
+    if (value.isMember("subtreeLevels"))
+        subtreeLevels() = osg::maximum(value["subtreeLevels"].asUInt(), 1u);
+    if (value.isMember("availableLevels"))
+        availableLevels() = value["availableLevels"].asUInt();
+    else if (value.isMember("maximumLevel"))
+        availableLevels() = value["maximumLevel"].asUInt() + 1u;
+    if (value.isMember("subtrees") && value["subtrees"].isMember("uri"))
+        subtrees() = URI(value["subtrees"]["uri"].asString(), lc._uc);
+}
+
+Json::Value
+ImplicitTiling::getJSON() const
+{
+    Json::Value value(Json::objectValue);
+    value["subdivisionScheme"] = octree().get() ? "OCTREE" : "QUADTREE";
+    value["subtreeLevels"] = subtreeLevels().get();
+    value["availableLevels"] = availableLevels().get();
+    if (subtrees().isSet())
+    {
+        Json::Value subtreesValue(Json::objectValue);
+        subtreesValue["uri"] = subtrees()->base();
+        value["subtrees"] = subtreesValue;
+    }
+    return value;
+}
+
+URI
+ImplicitTiling::expand(const URI& uriTemplate, unsigned level, unsigned x, unsigned y, unsigned z)
+{
+    std::string uri = uriTemplate.base();
+    replaceIn(uri, "{level}", Stringify() << level);
+    replaceIn(uri, "{x}", Stringify() << x);
+    replaceIn(uri, "{y}", Stringify() << y);
+    replaceIn(uri, "{z}", Stringify() << z);
+    return URI(uri, uriTemplate.context());
+}
+
+//........................................................................
+
+namespace
+{
+    // Interleaves the bits of tile coordinates relative to a subtree root
+    uint64_t mortonIndex(unsigned x, unsigned y, unsigned z, bool octree)
+    {
+        uint64_t index = 0;
+        unsigned stride = octree ? 3u : 2u;
+        for (unsigned bit = 0; bit < 21u; ++bit)
+        {
+            index |= (uint64_t)((x >> bit) & 1u) << (stride * bit);
+            index |= (uint64_t)((y >> bit) & 1u) << (stride * bit + 1u);
+            if (octree)
+                index |= (uint64_t)((z >> bit) & 1u) << (stride * bit + 2u);
+        }
+        return index;
+    }
+
+    // Index of the first tile of a level in a subtree's tile availability
+    uint64_t levelOffset(unsigned level, bool octree)
+    {
+        uint64_t branching = octree ? 8u : 4u;
+        uint64_t count = 1u;
+        for (unsigned i = 0; i < level; ++i)
+            count *= branching;
+        return (count - 1u) / (branching - 1u);
+    }
+
+    struct SubtreeBufferView
+    {
+        const unsigned char* _data;
+        size_t _length;
+    };
+
+    void parseAvailability(const Json::Value& value, const std::vector<SubtreeBufferView>& views, Subtree::Availability& out)
+    {
+        if (value.isMember("constant"))
+        {
+            out._constant = value["constant"].asInt() != 0;
+        }
+        else
+        {
+            // "bufferView" is the name used by the 1.0 extension
+            int index = value.isMember("bitstream") ? value["bitstream"].asInt() : value.get("bufferView", -1).asInt();
+            if (index >= 0 && index < (int)views.size())
+            {
+                out._bits.assign(views[index]._data, views[index]._data + views[index]._length);
+            }
+        }
+    }
+}
+
+bool
+Subtree::Availability::get(size_t index) const
+{
+    if (_bits.empty())
+        return _constant;
+    if ((index >> 3) >= _bits.size())
+        return false;
+    return (_bits[index >> 3] >> (index & 7u)) & 1u;
+}
+
+Subtree*
+Subtree::create(const std::string& data, const URIContext& uc, const osgDB::Options* options)
+{
+    Json::Value root(Json::objectValue);
+    std::string binary;
+
+    // binary subtree: 24 byte header, then the JSON and binary chunks
+    if (data.size() >= 24u && data.compare(0, 4, "subt") == 0)
+    {
+        uint64_t jsonLength, binaryLength;
+        memcpy(&jsonLength, data.data() + 8, 8);
+        memcpy(&binaryLength, data.data() + 16, 8);
+        jsonLength = le64toh(jsonLength);
+        binaryLength = le64toh(binaryLength);
+
+        if (24u + jsonLength + binaryLength > data.size())
+        {
+            OE_WARN << LC << "Truncated subtree" << std::endl;
+            return NULL;
+        }
+
+        Json::Reader reader;
+        if (!reader.parse(data.substr(24, jsonLength), root, false))
+            return NULL;
+
+        binary = data.substr(24 + jsonLength, binaryLength);
+    }
+    else
+    {
+        Json::Reader reader;
+        if (!reader.parse(data, root, false))
+            return NULL;
+    }
+
+    std::vector<std::string> buffers;
+    const Json::Value& buffersValue = root["buffers"];
+    for (Json::Value::const_iterator i = buffersValue.begin(); i != buffersValue.end(); ++i)
+    {
+        if ((*i).isMember("uri"))
+        {
+            ReadResult rr = URI((*i)["uri"].asString(), uc).readString(options);
+            if (rr.failed())
+            {
+                OE_WARN << LC << "Failed to read subtree buffer: " << rr.errorDetail() << std::endl;
+                return NULL;
+            }
+            buffers.push_back(rr.getString());
+        }
+        else
+        {
+            buffers.push_back(binary);
+        }
+    }
+
+    std::vector<SubtreeBufferView> views;
+    const Json::Value& viewsValue = root["bufferViews"];
+    for (Json::Value::const_iterator i = viewsValue.begin(); i != viewsValue.end(); ++i)
+    {
+        SubtreeBufferView view;
+        view._data = NULL;
+        view._length = 0u;
+
+        unsigned buffer = (*i).get("buffer", 0u).asUInt();
+        size_t offset = (*i).get("byteOffset", 0u).asUInt();
+        size_t length = (*i).get("byteLength", 0u).asUInt();
+        if (buffer < buffers.size() && offset + length <= buffers[buffer].size())
+        {
+            view._data = (const unsigned char*)buffers[buffer].data() + offset;
+            view._length = length;
+        }
+        views.push_back(view);
+    }
+
+    osg::ref_ptr<Subtree> subtree = new Subtree();
+
+    parseAvailability(root["tileAvailability"], views, subtree->_tileAvailability);
+    parseAvailability(root["childSubtreeAvailability"], views, subtree->_childSubtreeAvailability);
+
+    // an array in 3D Tiles 1.1 (one per content), an object in the 1.0 extension
+    const Json::Value& content = root["contentAvailability"];
+    if (content.isArray() && content.size() > 0)
+        parseAvailability(content[0u], views, subtree->_contentAvailability);
+    else if (content.isObject())
+        parseAvailability(content, views, subtree->_contentAvailability);
+
+    return subtree.release();
+}
+
+//........................................................................
+
+Tile::Tile() :
+    _refine(REFINE_ADD)
+{
+    initImplicit();
+}
+
+Tile::Tile(const Json::Value& value, LoadContext& uc)
+{
+    initImplicit();
+    fromJSON(value, uc);
+}
+
+void
+Tile::initImplicit()
+{
+    _level = _x = _y = _z = 0u;
+    _subtreeLevel = _subtreeX = _subtreeY = _subtreeZ = 0u;
+    _subtreeFailed = false;
+    _implicitChildrenCreated = false;
+}
+
 void
 Tile::fromJSON(const Json::Value& value, LoadContext& uc)
 {
@@ -313,6 +687,28 @@ Tile::fromJSON(const Json::Value& value, LoadContext& uc)
         }
     }
 
+    if (value.isMember("implicitTiling"))
+    {
+        implicitTiling() = new ImplicitTiling(value["implicitTiling"], uc);
+
+        // The content URI is a template; the root's own content is set
+        // once its subtree says it is available.
+        if (content().isSet() && content()->uri().isSet())
+        {
+            implicitTiling()->content() = content()->uri().get();
+        }
+        content().unset();
+
+        const Json::Value& box = value["boundingVolume"]["box"];
+        if (box.isArray() && box.size() == 12)
+        {
+            implicitTiling()->_box = true;
+            implicitTiling()->_boxCenter.set(box[0u].asDouble(), box[1u].asDouble(), box[2u].asDouble());
+            for (unsigned i = 0; i < 3; ++i)
+                implicitTiling()->_boxAxes[i].set(box[3 + 3 * i].asDouble(), box[4 + 3 * i].asDouble(), box[5 + 3 * i].asDouble());
+        }
+    }
+
     if (value.isMember("children"))
     {
         const Json::Value& a = value["children"];
@@ -342,6 +738,8 @@ Tile::getJSON() const
         value["refine"] = (refine().get() == REFINE_ADD) ? "ADD" : "REPLACE";
     if (content().isSet())
         value["content"] = content()->getJSON();
+    if (implicitTiling().valid())
+        value["implicitTiling"] = implicitTiling()->getJSON();
 
 
     if (!children().empty())
@@ -406,6 +804,142 @@ Tile::getBoundingSphere()
     return bsphere;
 }
 
+URI
+Tile::getSubtreeURI() const
+{
+    return isImplicit() ? ImplicitTiling::expand(_implicitTiling->subtrees().get(), _level, _x, _y, _z) : URI();
+}
+
+void
+Tile::setSubtree(Subtree* subtree)
+{
+    if (!subtree)
+    {
+        _subtreeFailed = true;
+        return;
+    }
+
+    _subtree = subtree;
+    _subtreeLevel = _level;
+    _subtreeX = _x, _subtreeY = _y, _subtreeZ = _z;
+
+    if (_subtree->_contentAvailability.get(0) && _implicitTiling->content().isSet())
+    {
+        content()->uri() = ImplicitTiling::expand(_implicitTiling->content().get(), _level, _x, _y, _z);
+    }
+}
+
+void
+Tile::createImplicitChildren()
+{
+    if (!_subtree.valid() || _implicitChildrenCreated)
+        return;
+
+    _implicitChildrenCreated = true;
+
+    if (_level + 1u >= _implicitTiling->availableLevels().get())
+        return;
+
+    unsigned numChildren = _implicitTiling->octree().get() ? 8u : 4u;
+    for (unsigned i = 0; i < numChildren; ++i)
+    {
+        Tile* child = createImplicitChild(i);
+        if (child)
+        {
+            children().push_back(child);
+        }
+    }
+}
+
+Tile*
+Tile::createImplicitChild(unsigned childIndex)
+{
+    bool octree = _implicitTiling->octree().get();
+    unsigned dx = childIndex & 1u, dy = (childIndex >> 1) & 1u, dz = (childIndex >> 2) & 1u;
+
+    unsigned level = _level + 1u;
+    unsigned x = 2u * _x + dx, y = 2u * _y + dy, z = 2u * _z + dz;
+
+    // coordinates relative to the subtree holding this tile
+    unsigned relativeLevel = level - _subtreeLevel;
+    uint64_t morton = mortonIndex(
+        x - (_subtreeX << relativeLevel),
+        y - (_subtreeY << relativeLevel),
+        z - (_subtreeZ << relativeLevel),
+        octree);
+
+    bool inSubtree = relativeLevel < _implicitTiling->subtreeLevels().get();
+    uint64_t availabilityIndex = levelOffset(relativeLevel, octree) + morton;
+
+    if (inSubtree && !_subtree->_tileAvailability.get(availabilityIndex))
+        return NULL;
+
+    // the child roots a subtree of its own
+    if (!inSubtree && !_subtree->_childSubtreeAvailability.get(morton))
+        return NULL;
+
+    osg::ref_ptr<Tile> child = new Tile();
+    child->implicitTiling() = _implicitTiling.get();
+    child->_level = level, child->_x = x, child->_y = y, child->_z = z;
+    child->refine() = refine().get();
+    child->geometricError() = 0.5 * geometricError().get();
+
+    if (boundingVolume()->region().isSet())
+    {
+        const osg::BoundingBoxd& r = boundingVolume()->region().get();
+        double width = 0.5 * (r.xMax() - r.xMin()), height = 0.5 * (r.yMax() - r.yMin());
+        osg::BoundingBoxd& cr = child->boundingVolume()->region().mutable_value();
+        cr.xMin() = r.xMin() + width * dx, cr.xMax() = cr.xMin() + width;
+        cr.yMin() = r.yMin() + height * dy, cr.yMax() = cr.yMin() + height;
+        if (octree)
+        {
+            double depth = 0.5 * (r.zMax() - r.zMin());
+            cr.zMin() = r.zMin() + depth * dz, cr.zMax() = cr.zMin() + depth;
+        }
+        else
+        {
+            cr.zMin() = r.zMin(), cr.zMax() = r.zMax();
+        }
+    }
+    else if (_implicitTiling->_box)
+    {
+        // divide the root's oriented box, then take the same extents
+        // as BoundingVolume::fromJSON does
+        double scale = ldexp(1.0, -(int)level);
+        double coords[3] = { (double)x, (double)y, (double)z };
+        osg::Vec3d center = _implicitTiling->_boxCenter;
+        osg::Vec3d axes[3];
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            bool split = (i < 2 || octree);
+            axes[i] = split ? _implicitTiling->_boxAxes[i] * scale : _implicitTiling->_boxAxes[i];
+            if (split)
+                center += _implicitTiling->_boxAxes[i] * ((2.0 * coords[i] + 1.0) * scale - 1.0);
+        }
+
+        osg::BoundingBoxd& box = child->boundingVolume()->box().mutable_value();
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            box.expandBy(center + axes[i]);
+            box.expandBy(center - axes[i]);
+        }
+    }
+
+    if (inSubtree)
+    {
+        child->_subtree = _subtree.get();
+        child->_subtreeLevel = _subtreeLevel;
+        child->_subtreeX = _subtreeX, child->_subtreeY = _subtreeY, child->_subtreeZ = _subtreeZ;
+
+        if (_subtree->_contentAvailability.get(availabilityIndex) && _implicitTiling->content().isSet())
+        {
+            child->content()->uri() = ImplicitTiling::expand(_implicitTiling->content().get(), level, x, y, z);
+        }
+    }
+
+    return child.release();
+}
+
 //........................................................................
 
 void
@@ -436,19 +970,178 @@ Tileset::getJSON() const
     return value;
 }
 
+namespace
+{
+    // Builds a Tileset straight from the events of a streaming parse.
+    // Only the members of the tiles currently open (minus their children)
+    // are ever held as Json values, so a large explicit tileset is never
+    // in memory as a whole document.
+    class TilesetSaxHandler : public Json::SaxHandler
+    {
+    public:
+        TilesetSaxHandler(LoadContext& lc) : _lc(lc), _building(false) { }
+
+        Tileset* release() { return _tileset.release(); }
+
+        bool null()                       { return begin() && _builder.null() && finish(); }
+        bool boolean(bool value)          { return begin() && _builder.boolean(value) && finish(); }
+        bool integer(Json::Value::Int v)  { return begin() && _builder.integer(v) && finish(); }
+        bool uinteger(Json::Value::UInt v){ return begin() && _builder.uinteger(v) && finish(); }
+        bool real(double value)           { return begin() && _builder.real(value) && finish(); }
+        bool string(const std::string& v) { return begin() && _builder.string(v) && finish(); }
+
+        bool key(const std::string& name)
+        {
+            if (_building)
+                return _builder.key(name);
+            _key = name;
+            return true;
+        }
+
+        bool startObject()
+        {
+            if (!_building)
+            {
+                if (_frames.empty())
+                {
+                    _frames.push_back(Frame(Frame::TILESET));
+                    return true;
+                }
+                if ((_frames.back()._type == Frame::TILESET && _key == "root") || _frames.back()._type == Frame::CHILDREN)
+                {
+                    _frames.push_back(Frame(Frame::TILE));
+                    return true;
+                }
+            }
+            return begin() && _builder.startObject();
+        }
+
+        bool endObject()
+        {
+            if (_building)
+                return _builder.endObject() && finish();
+
+            Frame& frame = _frames.back();
+            if (frame._type == Frame::TILE)
+            {
+                osg::ref_ptr<Tile> tile = new Tile(frame._members, _lc);
+                tile->children() = frame._children;
+                if (!frame._members.isMember("refine"))
+                    _inheritsRefine.insert(tile.get());
+
+                _frames.pop_back();
+                if (_frames.back()._type == Frame::CHILDREN)
+                    _frames.back()._children.push_back(tile.get());
+                else
+                    _root = tile.get();
+            }
+            else
+            {
+                _tileset = new Tileset(frame._members, _lc);
+                if (_root.valid())
+                {
+                    inheritRefine(_root.get(), REFINE_REPLACE);
+                    _tileset->root() = _root.get();
+                }
+                _frames.pop_back();
+            }
+            return true;
+        }
+
+        bool startArray()
+        {
+            if (!_building && !_frames.empty() && _frames.back()._type == Frame::TILE && _key == "children")
+            {
+                _frames.push_back(Frame(Frame::CHILDREN));
+                return true;
+            }
+            return begin() && _builder.startArray();
+        }
+
+        bool endArray()
+        {
+            if (_building)
+                return _builder.endArray() && finish();
+
+            std::vector< osg::ref_ptr<Tile> > children;
+            children.swap(_frames.back()._children);
+            _frames.pop_back();
+            _frames.back()._children.swap(children);
+            return true;
+        }
+
+    private:
+        struct Frame
+        {
+            enum Type { TILESET, TILE, CHILDREN };
+            Frame(Type type) : _type(type), _members(Json::objectValue) { }
+            Type _type;
+            Json::Value _members;
+            std::vector< osg::ref_ptr<Tile> > _children;
+        };
+
+        // starts collecting a member value, unless one is in progress
+        bool begin()
+        {
+            if (_frames.empty())
+                return false;
+            if (!_building)
+            {
+                _building = true;
+                _builder.reset();
+                _valueKey = _key;
+            }
+            return true;
+        }
+
+        // stores a collected member value once it is complete
+        bool finish()
+        {
+            if (_builder.isComplete())
+            {
+                _building = false;
+                if (_frames.back()._type != Frame::CHILDREN)
+                    _frames.back()._members[_valueKey] = _builder.value();
+            }
+            return true;
+        }
+
+        // Tiles without a refine policy take their parent's.
+        void inheritRefine(Tile* tile, RefinePolicy parentRefine)
+        {
+            if (_inheritsRefine.find(tile) != _inheritsRefine.end())
+                tile->refine() = parentRefine;
+            for (unsigned i = 0; i < tile->children().size(); ++i)
+                inheritRefine(tile->children()[i].get(), tile->refine().get());
+        }
+
+        LoadContext& _lc;
+        std::vector<Frame> _frames;
+        std::string _key, _valueKey;
+        Json::ValueBuilder _builder;
+        bool _building;
+        osg::ref_ptr<Tile> _root;
+        osg::ref_ptr<Tileset> _tileset;
+        std::set<Tile*> _inheritsRefine;
+    };
+}
+
 Tileset*
 Tileset::create(const std::string& json, const URIContext& uc)
 {
-    Json::Reader reader;
-    Json::Value root(Json::objectValue);
-    if (!reader.parse(json, root, false))
-        return NULL;
-
     LoadContext lc;
     lc._uc = uc;
     lc._defaultRefine = REFINE_REPLACE;
 
-    return new Tileset(root, lc);
+    TilesetSaxHandler handler(lc);
+    Json::SaxReader reader;
+    if (!reader.parse(json, handler))
+    {
+        OE_WARN << LC << "Failed to parse tileset: " << reader.getError() << std::endl;
+        return NULL;
+    }
+
+    return handler.release();
 }
 
 static VirtualProgram* getOrCreateDebugVirtualProgram()
@@ -492,8 +1185,13 @@ ThreeDTileNode::ThreeDTileNode(ThreeDTilesetNode* tileset, Tile* tile, bool imme
     _firstVisit(true),
     _options(options),
     _trackerItrValid(false),
+    _requestFrame(0u),
     _lastCulledFrameNumber(0),
-    _lastCulledFrameTime(0.0f)
+    _lastCulledFrameTime(0.0f),
+    _contentBytes(0u),
+    _lastError(0.0),
+    _terrainOcclusionFrame(~0u),
+    _terrainOccluded(false)
 {
     OE_PROFILING_ZONE;
     if (_tile->content().isSet())
@@ -501,14 +1199,21 @@ ThreeDTileNode::ThreeDTileNode(ThreeDTilesetNode* tileset, Tile* tile, bool imme
         OE_PROFILING_ZONE_TEXT(_tile->content()->uri()->full().c_str());
     }
 
-    // If this tile has content, store a URI Context to that relative-path external file
-    // references (textures) will resolve correctly.
-    if (_tile->content().isSet())
+    // The root of an implicit tileset needs its subtree before anything else.
+    if (_immediateLoad && _tile->needsSubtree())
     {
-        _options = Registry::instance()->cloneOrCreateOptions(options);
-        URIContext(_tile->content()->uri()->full()).store(_options.get());
+        URIContext context = _tile->getSubtreeURI().context();
+        if (!_tileset->getAuthorizationHeader().empty())
+        {
+            context.addHeader("authorization", _tileset->getAuthorizationHeader());
+        }
+        URI uri(_tile->getSubtreeURI().base(), context);
+        ReadResult rr = uri.readString(_options.get());
+        _tile->setSubtree(rr.succeeded() ? Subtree::create(rr.getString(), uri.context(), _options.get()) : NULL);
     }
 
+    initContentOptions(options);
+
     // the transform to localize this tile:
     if (tile->transform().isSet())
     {
@@ -528,10 +1233,47 @@ ThreeDTileNode::ThreeDTileNode(ThreeDTilesetNode* tileset, Tile* tile, bool imme
         _content = uri.getNode(_options.get());
         if (_content.valid())
         {
-            _tileset->runPreMergeOperations(_content.get());
-            _tileset->runPostMergeOperations(_content.get());
+            mergeContent();
+        }
+        OE_PROFILING_ZONE_TEXT("Immediate load");
+    }
+
+    _debugColor = randomColor();
+
+    getOrCreateStateSet()->getOrCreateUniform("debugColor", osg::Uniform::FLOAT_VEC4)->set(_debugColor);
+
+    computeBoundingVolume();
+
+    createDebugBounds();
+}
+
+void ThreeDTileNode::initContentOptions(osgDB::Options* options)
+{
+    // If this tile has content, store a URI Context to that relative-path external file
+    // references (textures) will resolve correctly.
+    if (_tile->content().isSet() && _tile->content()->uri().isSet())
+    {
+        _options = Registry::instance()->cloneOrCreateOptions(options);
+        URIContext(_tile->content()->uri()->full()).store(_options.get());
+    }
+}
+
+void ThreeDTileNode::createChildren()
+{
+    // Child nodes are created the first time a tile is culled, so only the
+    // traversed part of the tree (plus one level) ever exists in memory.
+    if (_children.valid())
+    {
+        return;
+    }
+
+    if (_tile->isImplicit())
+    {
+        if (_tile->needsSubtree())
+        {
+            return;
         }
-        OE_PROFILING_ZONE_TEXT("Immediate load");
+        _tile->createImplicitChildren();
     }
 
     if (_tile->children().size() > 0)
@@ -541,20 +1283,7 @@ ThreeDTileNode::ThreeDTileNode(ThreeDTilesetNode* tileset, Tile* tile, bool imme
         {
             _children->addChild(new ThreeDTileNode(_tileset, _tile->children()[i].get(), false, _options.get()));
         }
-
-        if (_children->getNumChildren() == 0)
-        {
-            _children = 0;
-        }
     }
-
-    _debugColor = randomColor();
-
-    getOrCreateStateSet()->getOrCreateUniform("debugColor", osg::Uniform::FLOAT_VEC4)->set(_debugColor);
-
-    computeBoundingVolume();
-
-    createDebugBounds();
 }
 
 void ThreeDTileNode::computeBoundingVolume()
@@ -720,7 +1449,8 @@ osg::BoundingSphere ThreeDTileNode::computeBound() const
 
 bool ThreeDTileNode::hasContent()
 {
-    return _tile->content().isSet() && _tile->content()->uri().isSet();
+    // A pending subtree counts as content so that the parent waits for it.
+    return _tile->needsSubtree() || (_tile->content().isSet() && _tile->content()->uri().isSet());
 }
 
 osg::Node* ThreeDTileNode::getContent()
@@ -734,21 +1464,51 @@ bool ThreeDTileNode::isContentReady()
     return _content.valid();
 }
 
+void ThreeDTileNode::resolveSubtree()
+{
+    if (_requestedContent && _tile->needsSubtree() && _subtreeFuture.isAvailable())
+    {
+        osg::ref_ptr<Subtree> subtree = _subtreeFuture.release();
+        _subtreeFuture = Future<Subtree>();
+        _requestedContent = false;
+
+        if (!subtree.valid())
+        {
+            OE_WARN << LC << "Failed to load subtree " << _tile->getSubtreeURI().full() << std::endl;
+        }
+
+        _tile->setSubtree(subtree.get());
+        initContentOptions(_options.get());
+    }
+}
+
 void ThreeDTileNode::resolveContent()
 {
+    resolveSubtree();
+
     // Resolve the future
-    if (!_content.valid() && _requestedContent && _contentFuture.isAvailable())
+    if (!_content.valid() && _requestedContent && _contentFuture.isAvailable() && _tileset->reserveMerge())
     {
         _content = _contentFuture.release();
 
         if (_content.valid())
         {
-            _tileset->runPreMergeOperations(_content.get());
-            _tileset->runPostMergeOperations(_content.get());
+            mergeContent();
         }
     }
 }
 
+void ThreeDTileNode::mergeContent()
+{
+    _tileset->runPreMergeOperations(_content.get());
+    _tileset->runPostMergeOperations(_content.get());
+
+    ContentSizeVisitor sizer;
+    _content->accept(sizer);
+    _contentBytes = sizer._bytes;
+    _tileset->addContentBytes(_contentBytes);
+}
+
 
 namespace
 {
@@ -874,10 +1634,70 @@ namespace
 
         return promise.getFuture();
     }
+
+    class LoadSubtreeOperation : public osg::Operation
+    {
+    public:
+        LoadSubtreeOperation(const URI& uri, osgDB::Options* options, osgEarth::Threading::Promise<Subtree> promise) :
+            _uri(uri),
+            _promise(promise),
+            _options(options)
+        {
+        }
+
+        void operator()(osg::Object*)
+        {
+            if (!_promise.isAbandoned())
+            {
+                osg::ref_ptr<Subtree> subtree;
+                ReadResult rr = _uri.readString(_options.get());
+                if (rr.succeeded())
+                {
+                    subtree = Subtree::create(rr.getString(), _uri.context(), _options.get());
+                }
+                _promise.resolve(subtree.get());
+            }
+        }
+
+        URI _uri;
+        osgEarth::Threading::Promise<Subtree> _promise;
+        osg::ref_ptr< osgDB::Options > _options;
+    };
+
+    Threading::Future<Subtree> readSubtreeAsync(const URI& uri, osgDB::Options* options)
+    {
+        Threading::Promise<Subtree> promise;
+
+        osg::ref_ptr<ThreadPool> threadPool;
+        if (options)
+        {
+            threadPool = ThreadPool::get(options);
+        }
+
+        osg::ref_ptr< osg::Operation > operation = new LoadSubtreeOperation(uri, options, promise);
+        if (threadPool.valid())
+        {
+            threadPool->getQueue()->add(operation.get());
+        }
+        else
+        {
+            operation->operator()(0);
+        }
+
+        return promise.getFuture();
+    }
 }
 
 
-void ThreeDTileNode::requestContent(osgUtil::IncrementalCompileOperation* ico)
+void ThreeDTileNode::requestContent(osgUtil::IncrementalCompileOperation* ico, double priority)
+{
+    if (!_content.valid() && !_requestedContent && hasContent())
+    {
+        _tileset->requestTile(this, priority, ico);
+    }
+}
+
+void ThreeDTileNode::startContentRequest(osgUtil::IncrementalCompileOperation* ico)
 {
     if (!_content.valid() && !_requestedContent && hasContent())
     {
@@ -893,6 +1713,19 @@ void ThreeDTileNode::requestContent(osgUtil::IncrementalCompileOperation* ico)
             localOptions = _options.get();
         }
 
+        if (_tile->needsSubtree())
+        {
+            URIContext context = _tile->getSubtreeURI().context();
+            if (!_tileset->getAuthorizationHeader().empty())
+            {
+                context.addHeader("authorization", _tileset->getAuthorizationHeader());
+            }
+
+            _subtreeFuture = readSubtreeAsync(URI(_tile->getSubtreeURI().base(), context), localOptions.get());
+            _requestedContent = true;
+            return;
+        }
+
         URIContext context = _tile->content()->uri()->context();
         if (!_tileset->getAuthorizationHeader().empty())
         {
@@ -913,6 +1746,25 @@ void ThreeDTileNode::requestContent(osgUtil::IncrementalCompileOperation* ico)
     }
 }
 
+bool ThreeDTileNode::cancelContentRequest()
+{
+    if (_requestedContent && !_content.valid() && !_contentFuture.isAvailable() && !_subtreeFuture.isAvailable())
+    {
+        // Releasing the future abandons the promise, so a loader that
+        // has not started on it yet will skip it.
+        _contentFuture = Future<osg::Node>();
+        _subtreeFuture = Future<Subtree>();
+        _requestedContent = false;
+        return true;
+    }
+    return false;
+}
+
+bool ThreeDTileNode::isContentRequestComplete() const
+{
+    return !_requestedContent || _content.valid() || _contentFuture.isAvailable() || _subtreeFuture.isAvailable();
+}
+
 double ThreeDTileNode::getDistanceToTile(osgUtil::CullVisitor* cv)
 {
     osg::BoundingSphere bs = _localBoundingSphere;
@@ -938,6 +1790,45 @@ double ThreeDTileNode::computeScreenSpaceError(osgUtil::CullVisitor* cv)
     }
 }
 
+bool ThreeDTileNode::isOccluded(osgUtil::CullVisitor* cv, const osg::Matrixd& localToWorld)
+{
+    osg::BoundingSphere bound = _localBoundingSphere;
+    if (!bound.valid())
+    {
+        return false;
+    }
+
+    // Regions ignore the tile transform (see computeBoundingVolume)
+    if (_tile->boundingVolume()->region().isSet())
+        bound.center() = bound.center() * getInverseMatrix() * localToWorld;
+    else
+        bound.center() = bound.center() * localToWorld;
+
+    if (_tileset->getHorizonCulling())
+    {
+        Horizon* horizon = Horizon::get(*cv);
+        if (horizon && !horizon->isVisible(bound.center(), bound.radius()))
+        {
+            return true;
+        }
+    }
+
+    if (_tileset->getElevationPool())
+    {
+        // The terrain test samples elevation data, so only repeat it every few frames.
+        unsigned int frame = cv->getFrameStamp()->getFrameNumber();
+        if (_terrainOcclusionFrame == ~0u || frame - _terrainOcclusionFrame >= 10u)
+        {
+            osg::Vec3d eye = osg::Vec3d(0.0, 0.0, 0.0) * cv->getCurrentCamera()->getInverseViewMatrix();
+            _terrainOccluded = _tileset->isTerrainOccluded(eye, bound);
+            _terrainOcclusionFrame = frame;
+        }
+        return _terrainOccluded;
+    }
+
+    return false;
+}
+
 bool ThreeDTileNode::unloadContent()
 {
     // Don't unload the content of tiles that were loaded immediately.  This shouldn't be called as they aren't tracked, but just in case.
@@ -955,10 +1846,14 @@ bool ThreeDTileNode::unloadContent()
         }
     }
 
+    _tileset->removeContentBytes(_contentBytes);
+    _contentBytes = 0u;
+
     _firstVisit = true;
     _content = 0;
     _requestedContent = false;
     _contentFuture = Future<osg::Node>();
+    _subtreeFuture = Future<Subtree>();
 
     return true;
 }
@@ -1011,7 +1906,11 @@ void ThreeDTileNode::updateTracking(osgUtil::CullVisitor* cv)
     // Update tracking if this node wasn't immediately loaded.  Tiles that were immediately loaded are expected to be tracked by their parent.
     if (hasContent() && !_immediateLoad)
     {
-        _tileset->touchTile(this);
+        // only touch once per frame, since the tracker is shared by all cull threads
+        if (!_trackerItrValid || _lastCulledFrameNumber != cv->getFrameStamp()->getFrameNumber())
+        {
+            _tileset->touchTile(this);
+        }
         _lastCulledFrameNumber = cv->getFrameStamp()->getFrameNumber();
         _lastCulledFrameTime = cv->getFrameStamp()->getReferenceTime();
     }
@@ -1037,6 +1936,12 @@ void ThreeDTileNode::traverse(osg::NodeVisitor& nv)
             }
         }
 
+        osg::Matrixd localToWorld = *cv->getModelViewMatrix() * cv->getCurrentCamera()->getInverseViewMatrix();
+        if (isOccluded(cv, localToWorld))
+        {
+            return;
+        }
+
         // Get the ICO so we can do incremental compiliation
         osgUtil::IncrementalCompileOperation* ico = 0;
         osgViewer::View* osgView = dynamic_cast<osgViewer::View*>(cv->getCurrentCamera()->getView());
@@ -1045,15 +1950,18 @@ void ThreeDTileNode::traverse(osg::NodeVisitor& nv)
             ico = osgView->getDatabasePager()->getIncrementalCompileOperation();
         }
 
-        // This allows nodes to reload themselves
-        requestContent(ico);
-        resolveContent();
-
         // Compute the SSE
         double error = computeScreenSpaceError(cv);
+        _lastError = error;
+
+        // This allows nodes to reload themselves
+        requestContent(ico, error);
+        resolveContent();
 
         updateTracking(cv);
 
+        createChildren();
+
         bool areChildrenReady = true;
         if (_children.valid())
         {
@@ -1064,10 +1972,17 @@ void ThreeDTileNode::traverse(osg::NodeVisitor& nv)
                 {
                     childTile->updateTracking(cv);
 
+                    // Occluded children are not loaded and don't hold back
+                    // refinement; they skip themselves when traversed.
+                    if (childTile->isOccluded(cv, childTile->getMatrix() * localToWorld))
+                    {
+                        continue;
+                    }
+
                     // Can we traverse the child?
                     if (childTile->hasContent() && !childTile->isContentReady())
                     {
-                        childTile->requestContent(ico);
+                        childTile->requestContent(ico, childTile->computeScreenSpaceError(cv));
                         areChildrenReady = false;
                     }
                 }
@@ -1177,9 +2092,15 @@ ThreeDTilesetNode::ThreeDTilesetNode(Tileset* tileset, const std::string& author
     _showColorPerTile(false),
     _maxAge(5.0f),
     _lastExpiredFrame(0),
+    _requestFrame(1u),
+    _maxConcurrentRequests(16u),
+    _maxMergesPerFrame(8u),
+    _budget(new ContentBudget()),
+    _sharedBudget(ContentBudget::getGlobal()),
     _authorizationHeader(authorizationHeader),
     _sgCallbacks(sceneGraphCallbacks),
-	_sseDenominator(1.0)
+	_sseDenominator(1.0),
+    _horizonCulling(true)
 {
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
     const char* c = ::getenv("OSGEARTH_3DTILES_CACHE_SIZE");
@@ -1208,6 +2129,59 @@ ThreeDTilesetNode::ThreeDTilesetNode(Tileset* tileset, const std::string& author
     }
 }
 
+ThreeDTilesetNode::~ThreeDTilesetNode()
+{
+    // give the shared budget back what this tileset's content was using
+    if (_sharedBudget.valid())
+    {
+        _sharedBudget->remove(_budget->getBytes());
+    }
+}
+
+size_t ThreeDTilesetNode::getMaxBytes() const
+{
+    return _budget->getMaxBytes();
+}
+
+void ThreeDTilesetNode::setMaxBytes(size_t value)
+{
+    _budget->setMaxBytes(value);
+}
+
+size_t ThreeDTilesetNode::getBytes() const
+{
+    return _budget->getBytes();
+}
+
+void ThreeDTilesetNode::setSharedBudget(ContentBudget* value)
+{
+    size_t bytes = _budget->getBytes();
+    if (_sharedBudget.valid())
+        _sharedBudget->remove(bytes);
+    _sharedBudget = value;
+    if (_sharedBudget.valid())
+        _sharedBudget->add(bytes);
+}
+
+void ThreeDTilesetNode::addContentBytes(size_t bytes)
+{
+    _budget->add(bytes);
+    if (_sharedBudget.valid())
+        _sharedBudget->add(bytes);
+}
+
+void ThreeDTilesetNode::removeContentBytes(size_t bytes)
+{
+    _budget->remove(bytes);
+    if (_sharedBudget.valid())
+        _sharedBudget->remove(bytes);
+}
+
+bool ThreeDTilesetNode::isOverBudget() const
+{
+    return _budget->isOverBudget() || (_sharedBudget.valid() && _sharedBudget->isOverBudget());
+}
+
 unsigned int ThreeDTilesetNode::getMaxTiles() const
 {
     return _maxTiles;
@@ -1228,6 +2202,26 @@ void ThreeDTilesetNode::setMaxAge(float maxAge)
     _maxAge = maxAge;
 }
 
+unsigned int ThreeDTilesetNode::getMaxConcurrentRequests() const
+{
+    return _maxConcurrentRequests;
+}
+
+void ThreeDTilesetNode::setMaxConcurrentRequests(unsigned int value)
+{
+    _maxConcurrentRequests = osg::maximum(value, 1u);
+}
+
+unsigned int ThreeDTilesetNode::getMaxMergesPerFrame() const
+{
+    return _maxMergesPerFrame;
+}
+
+void ThreeDTilesetNode::setMaxMergesPerFrame(unsigned int value)
+{
+    _maxMergesPerFrame = value;
+}
+
 float ThreeDTilesetNode::getMaximumScreenSpaceError() const
 {
     return _maximumScreenSpaceError;
@@ -1238,6 +2232,83 @@ void ThreeDTilesetNode::setMaximumScreenSpaceError(float maximumScreenSpaceError
     _maximumScreenSpaceError = maximumScreenSpaceError;
 }
 
+bool ThreeDTilesetNode::getHorizonCulling() const
+{
+    return _horizonCulling;
+}
+
+void ThreeDTilesetNode::setHorizonCulling(bool value)
+{
+    _horizonCulling = value;
+}
+
+ElevationPool* ThreeDTilesetNode::getElevationPool() const
+{
+    return _elevationPool.get();
+}
+
+void ThreeDTilesetNode::setElevationPool(ElevationPool* pool)
+{
+    Threading::ScopedMutexLock lock(_envelopesMutex);
+    _elevationPool = pool;
+    _envelopes.clear();
+}
+
+bool ThreeDTilesetNode::isTerrainOccluded(const osg::Vec3d& eye, const osg::BoundingSphere& bound)
+{
+    osg::ref_ptr<ElevationPool> pool;
+    if (!_elevationPool.lock(pool))
+    {
+        return false;
+    }
+
+    if ((eye - bound.center()).length() <= bound.radius())
+    {
+        return false;
+    }
+
+    // Sample the terrain along the line of sight to the top of the bound
+    osg::Vec3d up = bound.center();
+    up.normalize();
+    osg::Vec3d target = bound.center() + up * bound.radius();
+
+    static const osg::EllipsoidModel ellipsoid;
+    const unsigned numSamples = 8u;
+    double xs[numSamples], ys[numSamples], heights[numSamples];
+    float elevations[numSamples];
+    for (unsigned i = 0; i < numSamples; ++i)
+    {
+        osg::Vec3d p = eye + (target - eye) * ((double)(i + 1) / (double)(numSamples + 1));
+        double lat, lon;
+        ellipsoid.convertXYZToLatLongHeight(p.x(), p.y(), p.z(), lat, lon, heights[i]);
+        xs[i] = osg::RadiansToDegrees(lon);
+        ys[i] = osg::RadiansToDegrees(lat);
+    }
+
+    // ElevationEnvelope is not thread-safe, so keep one per cull thread.
+    osg::ref_ptr<ElevationEnvelope> envelope;
+    {
+        Threading::ScopedMutexLock lock(_envelopesMutex);
+        osg::ref_ptr<ElevationEnvelope>& threadEnvelope = _envelopes[Threading::getCurrentThreadId()];
+        if (!threadEnvelope.valid())
+        {
+            threadEnvelope = pool->createEnvelope(SpatialReference::get("wgs84"), 12u);
+        }
+        envelope = threadEnvelope.get();
+    }
+
+    envelope->getElevations(xs, ys, elevations, numSamples);
+
+    for (unsigned i = 0; i < numSamples; ++i)
+    {
+        if (elevations[i] != NO_DATA_VALUE && elevations[i] > heights[i])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool ThreeDTilesetNode::getShowBoundingVolumes() const
 {
     return _showBoundingVolumes;
@@ -1315,6 +2386,87 @@ void ThreeDTilesetNode::touchTile(ThreeDTileNode* node)
     node->_trackerItr = --_tracker.end();
 }
 
+void ThreeDTilesetNode::requestTile(ThreeDTileNode* node, double priority, osgUtil::IncrementalCompileOperation* ico)
+{
+    ScopedMutexLock lock(_requestsMutex);
+
+    // a tile can be requested by itself, its parent, and by more than one camera;
+    // only queue it once per frame.
+    if (node->_requestFrame != _requestFrame)
+    {
+        node->_requestFrame = _requestFrame;
+        Request request;
+        request._tile = node;
+        request._priority = priority;
+        request._ico = ico;
+        _requests.push_back(request);
+    }
+}
+
+bool ThreeDTilesetNode::reserveMerge()
+{
+    return _maxMergesPerFrame == 0u || ++_mergesThisFrame <= _maxMergesPerFrame;
+}
+
+void ThreeDTilesetNode::processRequests(const osg::NodeVisitor& nv)
+{
+    OE_PROFILING_ZONE;
+
+    unsigned int frameNumber = nv.getFrameStamp()->getFrameNumber();
+
+    // Retire completed requests, and cancel the ones for tiles that
+    // were not visible last frame.
+    for (unsigned int i = 0; i < _activeRequests.size(); )
+    {
+        ThreeDTileNode* tile = _activeRequests[i].get();
+        if (tile->isContentRequestComplete() ||
+            (tile->getLastCulledFrameNumber() + 1u < frameNumber && tile->cancelContentRequest()))
+        {
+            _activeRequests[i] = _activeRequests.back();
+            _activeRequests.pop_back();
+        }
+        else ++i;
+    }
+
+    std::vector<Request> requests;
+    {
+        ScopedMutexLock lock(_requestsMutex);
+        requests.swap(_requests);
+        ++_requestFrame;
+    }
+
+    // Start the most important requests first. Anything left over is
+    // requested again by the next cull if it is still visible.
+    std::sort(requests.begin(), requests.end());
+
+    // The shared paging scheduler can cap our concurrency with its
+    // quota for 3D tiles and defer requests.
+    PagingScheduler* scheduler = PagingScheduler::instance();
+    unsigned maxActive = _maxConcurrentRequests;
+    unsigned quota = scheduler->getQuota(PagingScheduler::THREE_D_TILES);
+    if (quota > 0u)
+        maxActive = osg::minimum(maxActive, quota);
+
+    for (std::vector<Request>::iterator r = requests.begin();
+        r != requests.end() && _activeRequests.size() < maxActive;
+        ++r)
+    {
+        float priority = PagingScheduler::fromScreenSpaceError(r->_priority, getMaximumScreenSpaceError());
+        if (!scheduler->admit(PagingScheduler::THREE_D_TILES, priority, frameNumber))
+            continue;
+
+        osg::ref_ptr<osgUtil::IncrementalCompileOperation> ico;
+        r->_ico.lock(ico);
+        r->_tile->startContentRequest(ico.get());
+        if (!r->_tile->isContentRequestComplete())
+        {
+            _activeRequests.push_back(r->_tile.get());
+        }
+    }
+
+    _mergesThisFrame.exchange(0u);
+}
+
 void ThreeDTilesetNode::expireTiles(const osg::NodeVisitor& nv)
 {
     OE_PROFILING_ZONE;
@@ -1334,7 +2486,52 @@ void ThreeDTilesetNode::expireTiles(const osg::NodeVisitor& nv)
 
     unsigned int numErased = 0;
     unsigned int numSkipped = 0;
-    while (_tracker.size() > _maxTiles && itr != _sentryItr)
+
+    bool useBudget =
+        _budget->getMaxBytes() > 0u ||
+        (_sharedBudget.valid() && _sharedBudget->getMaxBytes() > 0u);
+
+    if (useBudget)
+    {
+        if (isOverBudget())
+        {
+            // Candidates are the tiles that were not visible last frame (the ones
+            // before the sentry). Unload the least important ones first, then the
+            // ones that have been out of view the longest.
+            std::vector<ThreeDTileNode*> candidates;
+            for (; itr != _sentryItr; ++itr)
+            {
+                ThreeDTileNode* tile = itr->get();
+                if (tile && tile->getContentBytes() > 0u)
+                    candidates.push_back(tile);
+            }
+
+            std::sort(candidates.begin(), candidates.end(), isLessImportant);
+
+            for (std::vector<ThreeDTileNode*>::iterator c = candidates.begin(); c != candidates.end() && isOverBudget(); ++c)
+            {
+                ThreeDTileNode* tile = *c;
+                if (tile->unloadContent())
+                {
+                    tile->_trackerItrValid = false;
+                    _tracker.erase(tile->_trackerItr);
+                    ++numErased;
+                }
+                else
+                {
+                    numSkipped++;
+                }
+
+                endTime = osg::Timer::instance()->tick();
+                if (osg::Timer::instance()->delta_m(startTime, endTime) > maxTime)
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    else while (_tracker.size() > _maxTiles && itr != _sentryItr)
     {
         osg::ref_ptr< ThreeDTileNode > tile = dynamic_cast<ThreeDTileNode*>(itr->get());
         if (tile.valid())
@@ -1384,6 +2581,7 @@ void ThreeDTilesetNode::traverse(osg::NodeVisitor& nv)
         if (nv.getFrameStamp()->getFrameNumber() > _lastExpiredFrame)
         {
             expireTiles(nv);
+            processRequests(nv);
             _lastExpiredFrame = nv.getFrameStamp()->getFrameNumber();
         }
     }
@@ -1395,6 +2593,19 @@ void ThreeDTilesetNode::traverse(osg::NodeVisitor& nv)
 		double fovy, ar, zn, zf;
 		proj.getPerspective(fovy, ar, zn, zf);
 		_sseDenominator = 2.0 * tan(0.5 * osg::DegreesToRadians(fovy));
+
+        // Use the horizon installed by the map if there is one; either way
+        // bring its eye up to date for this camera.
+        if (_horizonCulling)
+        {
+            osg::ref_ptr<Horizon> horizon = Horizon::get(nv);
+            if (!horizon.valid())
+            {
+                horizon = new Horizon();
+                horizon->put(nv);
+            }
+            horizon->setEye(osg::Vec3d(0.0, 0.0, 0.0) * cv->getCurrentCamera()->getInverseViewMatrix());
+        }
 	}
 
     osg::Group::traverse(nv);
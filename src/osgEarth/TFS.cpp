@@ -259,37 +259,12 @@ TFSFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* prog
 {
     FeatureCursor* result = 0L;
 
-    std::string url = createURL(query);
-
     // the URL wil lbe empty if it was invalid or outside the level bounds of the layer.
-    if (url.empty())
+    if (createURL(query).empty())
         return 0L;
 
-    OE_DEBUG << LC << url << std::endl;
-    URI uri(url, options().url()->context());
-
-    // read the data:
-    ReadResult r = uri.readString(getReadOptions(), progress);
-
-    const std::string& buffer = r.getString();
-    const Config&      meta = r.metadata();
-
-    bool dataOK = false;
-
     FeatureList features;
-    if (!buffer.empty())
-    {
-        // Get the mime-type from the metadata record if possible
-        std::string mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
-        //If the mimetype is empty then try to set it from the format specification
-        if (mimeType.empty())
-        {
-            if (options().format().value() == "json") mimeType = "json";
-            else if (options().format().value().compare("gml") == 0) mimeType = "text/xml";
-            else if (options().format().value().compare("pbf") == 0) mimeType = "application/x-protobuf";
-        }
-        dataOK = getFeatures(buffer, *query.tileKey(), mimeType, features);
-    }
+    bool dataOK = readTile(query.tileKey().get(), features, progress);
 
     if (dataOK)
     {
@@ -326,6 +301,37 @@ TFSFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* prog
 }
 
 
+bool
+TFSFeatureSource::fetchTile(const TileKey& key, FeatureList& features, ProgressCallback* progress)
+{
+    Query query;
+    query.tileKey() = key;
+    std::string url = createURL(query);
+    if (url.empty())
+        return false;
+
+    OE_DEBUG << LC << url << std::endl;
+    URI uri(url, options().url()->context());
+
+    // read the data:
+    ReadResult r = uri.readString(getReadOptions(), progress);
+
+    const std::string& buffer = r.getString();
+    if (buffer.empty())
+        return false;
+
+    // Get the mime-type from the metadata record if possible
+    std::string mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
+    //If the mimetype is empty then try to set it from the format specification
+    if (mimeType.empty())
+    {
+        if (options().format().value() == "json") mimeType = "json";
+        else if (options().format().value().compare("gml") == 0) mimeType = "text/xml";
+        else if (options().format().value().compare("pbf") == 0) mimeType = "application/x-protobuf";
+    }
+    return getFeatures(buffer, key, mimeType, features);
+}
+
 bool
 TFSFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, const std::string& mimeType, FeatureList& features)
 {
@@ -22,6 +22,9 @@
 #include <osgEarth/TMSBackFiller>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageMosaic>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/GeoCommon>
+#include <osgEarth/JobArena>
 
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
@@ -33,10 +36,175 @@
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+namespace
+{
+    // Processes all the tiles in one level, sharing them out to the job arena.
+    struct LevelGroup : public osg::Referenced
+    {
+        LevelGroup(TMSBackFiller* backfiller, const std::vector<TileKey>& keys) :
+            _backfiller(backfiller), _keys(keys), _next(0u), _remaining(keys.size()) { }
+
+        void run()
+        {
+            for(;;)
+            {
+                unsigned n = (++_next) - 1u;
+                if (n >= _keys.size())
+                    break;
+
+                _backfiller->processKey(_keys[n]);
+
+                if (--_remaining == 0u)
+                    _done.set();
+            }
+        }
+
+        void runAndWait()
+        {
+            if (_keys.empty())
+                return;
+
+            JobArena* arena = JobArena::get("oe.backfill");
+            unsigned numHelpers = osg::minimum(arena->getConcurrency(), (unsigned)_keys.size() - 1u);
+            for (unsigned i = 0; i < numHelpers; ++i)
+            {
+                arena->dispatch(new LevelTask(this));
+            }
+            run();
+            _done.wait();
+        }
+
+        struct LevelTask : public TaskRequest
+        {
+            LevelTask(LevelGroup* group) : _group(group) { }
+
+            void operator()(ProgressCallback*)
+            {
+                _group->run();
+            }
+
+            osg::ref_ptr<LevelGroup> _group;
+        };
+
+        TMSBackFiller* _backfiller;
+        std::vector<TileKey> _keys;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        Threading::Event _done;
+    };
+
+    inline unsigned char combine(unsigned a, unsigned b, unsigned c, unsigned d, TMSBackFiller::Method method)
+    {
+        return
+            method == TMSBackFiller::METHOD_MIN ? (unsigned char)osg::minimum(osg::minimum(a, b), osg::minimum(c, d)) :
+            method == TMSBackFiller::METHOD_MAX ? (unsigned char)osg::maximum(osg::maximum(a, b), osg::maximum(c, d)) :
+            (unsigned char)((a + b + c + d + 2u) >> 2);
+    }
+
+    // Combines four same-sized 8-bit children into a parent of the same size
+    // by reducing each 2x2 block of bytes.
+    void downsampleBytes(const osg::Image* children[4], osg::Image* output, TMSBackFiller::Method method)
+    {
+        unsigned s = output->s(), t = output->t();
+        unsigned bpp = output->getPixelSizeInBits() / 8u;
+        unsigned halfRowBytes = (s / 2u) * bpp;
+
+        for (unsigned y = 0; y < t; ++y)
+        {
+            // Row 0 is the bottom of the image; the upper children (0 and 1)
+            // fill the top half of the parent.
+            unsigned my = 2u * y;
+            bool upper = my >= t;
+            unsigned cy = upper ? my - t : my;
+
+            for (unsigned side = 0; side < 2; ++side)
+            {
+                const osg::Image* child = children[(upper ? 0u : 2u) + side];
+                const unsigned char* row0 = child->data(0, cy);
+                const unsigned char* row1 = child->data(0, cy + 1u);
+                unsigned char* out = output->data(0, y) + side * halfRowBytes;
+
+                for (unsigned x = 0; x < halfRowBytes; x += bpp)
+                {
+                    const unsigned char* a = row0 + 2u * x;
+                    const unsigned char* b = row1 + 2u * x;
+                    for (unsigned c = 0; c < bpp; ++c)
+                    {
+                        out[x + c] = combine(a[c], a[c + bpp], b[c], b[c + bpp], method);
+                    }
+                }
+            }
+        }
+    }
+
+    // Combines four same-sized children of any readable format, skipping
+    // no-data values so they don't pull elevation averages down.
+    void downsamplePixels(const osg::Image* children[4], osg::Image* output, TMSBackFiller::Method method)
+    {
+        int s = output->s(), t = output->t();
+
+        ImageUtils::PixelReader readers[4];
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            readers[i].setImage(children[i]);
+            readers[i].setBilinear(false);
+        }
+
+        ImageUtils::PixelWriter write(output);
+        osg::Vec4f samples[4];
+
+        for (int y = 0; y < t; ++y)
+        {
+            for (int x = 0; x < s; ++x)
+            {
+                // Sample the 2x2 block in the (2s x 2t) mosaic of the children:
+                for (unsigned k = 0; k < 4; ++k)
+                {
+                    int mx = osg::minimum(2 * x + (int)(k & 1u), 2 * s - 1);
+                    int my = osg::minimum(2 * y + (int)(k >> 1), 2 * t - 1);
+                    bool upper = my >= t, right = mx >= s;
+                    unsigned child = (upper ? 0u : 2u) + (right ? 1u : 0u);
+                    readers[child](samples[k], right ? mx - s : mx, upper ? my - t : my);
+                }
+
+                osg::Vec4f result;
+                for (unsigned c = 0; c < 4; ++c)
+                {
+                    float value = NO_DATA_VALUE;
+                    float sum = 0.0f;
+                    unsigned count = 0u;
+                    for (unsigned k = 0; k < 4; ++k)
+                    {
+                        float v = samples[k][c];
+                        if (v == NO_DATA_VALUE)
+                            continue;
+
+                        value =
+                            count == 0u ? v :
+                            method == TMSBackFiller::METHOD_MIN ? osg::minimum(value, v) :
+                            method == TMSBackFiller::METHOD_MAX ? osg::maximum(value, v) :
+                            value;
+                        sum += v;
+                        ++count;
+                    }
+                    if (method == TMSBackFiller::METHOD_AVERAGE && count > 0u)
+                    {
+                        value = sum / (float)count;
+                    }
+                    result[c] = value;
+                }
+
+                write(result, x, y);
+            }
+        }
+    }
+}
+
 TMSBackFiller::TMSBackFiller() :
 _minLevel(0u),
 _maxLevel(0u),
-_verbose(false)
+_verbose(false),
+_method(METHOD_AVERAGE)
 {
     //nop
 }
@@ -65,7 +233,9 @@ void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
 
         GeoExtent extent( profile->getSRS(), _bounds );           
 
-        //Process each level in it's entirety
+        //Process each level in it's entirety. Tiles within a level only depend
+        //on the level below, so they can all be processed in parallel.
+        std::vector<TileKey> keys;
         for (int level = firstLevel; level >= static_cast<int>(_minLevel); level--)
         {
             if (_verbose) OE_NOTICE << "Processing level " << level << std::endl;                
@@ -73,15 +243,17 @@ void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
             TileKey ll = profile->createTileKey(extent.xMin(), extent.yMin(), level);
             TileKey ur = profile->createTileKey(extent.xMax(), extent.yMax(), level);
 
+            keys.clear();
             for (unsigned int x = ll.getTileX(); x <= ur.getTileX(); x++)
             {
                 for (unsigned int y = ur.getTileY(); y <= ll.getTileY(); y++)
                 {
-                    TileKey key = TileKey(level, x, y, profile.get());
-                    processKey( key );
+                    keys.push_back(TileKey(level, x, y, profile.get()));
                 }
             }                
 
+            osg::ref_ptr<LevelGroup> group = new LevelGroup(this, keys);
+            group->runAndWait();
         }            
     }
     else
@@ -107,21 +279,52 @@ void TMSBackFiller::processKey( const TileKey& key )
 
     if (ul.valid() && ur.valid() && ll.valid() && lr.valid())
     {            
-        //Merge them together
-        ImageMosaic mosaic;
-        mosaic.getImages().push_back( TileImage( ul.get(), ulKey ) );
-        mosaic.getImages().push_back( TileImage( ur.get(), urKey ) );
-        mosaic.getImages().push_back( TileImage( ll.get(), llKey ) );
-        mosaic.getImages().push_back( TileImage( lr.get(), lrKey ) );            
-
-        osg::ref_ptr< osg::Image> merged = mosaic.createImage();
-        if (merged.valid())
+        const osg::Image* children[4] = { ul.get(), ur.get(), ll.get(), lr.get() };
+
+        bool sameLayout = !ul->isCompressed() && ul->r() == 1;
+        for (unsigned i = 1; i < 4 && sameLayout; ++i)
+        {
+            sameLayout =
+                children[i]->s() == ul->s() &&
+                children[i]->t() == ul->t() &&
+                children[i]->r() == 1 &&
+                children[i]->getPixelFormat() == ul->getPixelFormat() &&
+                children[i]->getDataType() == ul->getDataType() &&
+                children[i]->getPacking() == ul->getPacking();
+        }
+
+        if (sameLayout && ImageUtils::PixelReader::supports(ul.get()))
         {
-            //Resize the image so it's the same size as one of the input files
-            osg::ref_ptr<osg::Image> resized;
-            ImageUtils::resizeImage( merged.get(), ul->s(), ul->t(), resized );
-            std::string outputFilename = getFilename( key );                
-            writeTile( key, resized.get() );
+            // Reduce the children straight into the parent:
+            osg::ref_ptr<osg::Image> parent = new osg::Image();
+            parent->allocateImage(ul->s(), ul->t(), 1, ul->getPixelFormat(), ul->getDataType(), ul->getPacking());
+            parent->setInternalTextureFormat(ul->getInternalTextureFormat());
+
+            bool evenSize = (ul->s() % 2) == 0 && (ul->t() % 2) == 0;
+            if (evenSize && ul->getDataType() == GL_UNSIGNED_BYTE)
+                downsampleBytes(children, parent.get(), _method);
+            else
+                downsamplePixels(children, parent.get(), _method);
+
+            writeTile( key, parent.get() );
+        }
+        else
+        {
+            //Merge them together
+            ImageMosaic mosaic;
+            mosaic.getImages().push_back( TileImage( ul.get(), ulKey ) );
+            mosaic.getImages().push_back( TileImage( ur.get(), urKey ) );
+            mosaic.getImages().push_back( TileImage( ll.get(), llKey ) );
+            mosaic.getImages().push_back( TileImage( lr.get(), lrKey ) );            
+
+            osg::ref_ptr< osg::Image> merged = mosaic.createImage();
+            if (merged.valid())
+            {
+                //Resize the image so it's the same size as one of the input files
+                osg::ref_ptr<osg::Image> resized;
+                ImageUtils::resizeImage( merged.get(), ul->s(), ul->t(), resized );
+                writeTile( key, resized.get() );
+            }
         }
     }                
 }    
@@ -141,8 +344,12 @@ osg::Image* TMSBackFiller::readTile( const TileKey& key )
 void TMSBackFiller::writeTile( const TileKey& key, osg::Image* image )
 {
     std::string filename = getFilename( key );
-    if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
-        osgEarth::makeDirectoryForFile( filename );
+    {
+        // tiles in the same folder may be written at once; create it once.
+        Threading::ScopedMutexLock lock(_dirMutex);
+        if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
+            osgEarth::makeDirectoryForFile( filename );
+    }
     osgDB::writeImageFile( *image, filename, _options.get() );        
 }
      
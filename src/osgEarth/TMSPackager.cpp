@@ -21,8 +21,16 @@
 #include <osgEarth/ImageToHeightFieldConverter>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageLayer>
+#include <osgEarth/ImageUtils>
 #include <osgDB/FileUtils>
 #include <osgDB/WriteFile>
+#include "sha1.hpp"
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
 
 
 #define LC "[TMSPackager] "
@@ -30,11 +38,172 @@
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+namespace
+{
+    // Hash of the layout and pixel data of an image, ignoring row padding.
+    std::string hashImage(const osg::Image* image)
+    {
+        sha1 hash;
+        int layout[5] = {
+            image->s(), image->t(), image->r(),
+            (int)image->getPixelFormat(), (int)image->getDataType() };
+        hash.add(layout, sizeof(layout));
+
+        for (int r = 0; r < image->r(); ++r)
+            for (int t = 0; t < image->t(); ++t)
+                hash.add(image->data(0, t, r), image->getRowSizeInBytes());
+
+        char hex[SHA1_HEX_SIZE];
+        hash.finalize().print_hex(hex);
+        return hex;
+    }
+
+    // Makes "to" refer to the same file as "from": a hard link if the
+    // file system supports it, otherwise a copy.
+    bool linkFile(const std::string& from, const std::string& to)
+    {
+        ::remove(to.c_str());
+#ifdef _WIN32
+        if (CreateHardLinkA(to.c_str(), from.c_str(), NULL))
+            return true;
+#else
+        if (::link(from.c_str(), to.c_str()) == 0)
+            return true;
+#endif
+        return osgDB::copyFile(from, to) == osgDB::COPY_FILE_OK;
+    }
+
+    // Encodes and writes one tile on a write thread.
+    class WriteTileTask : public TaskRequest
+    {
+    public:
+        WriteTileTask(WriteTMSTileHandler* handler, osg::Image* image, const std::string& path) :
+            _handler(handler), _image(image), _path(path) { }
+
+        void operator()(ProgressCallback*)
+        {
+            _handler->writeImage(_image.get(), _path);
+        }
+
+    private:
+        osg::ref_ptr<WriteTMSTileHandler> _handler;
+        osg::ref_ptr<osg::Image> _image;
+        std::string _path;
+    };
+}
+
 WriteTMSTileHandler::WriteTMSTileHandler(TileLayer* layer,  Map* map, TMSPackager* packager):
     _layer( layer ),
     _map(map),
-    _packager(packager)
+    _packager(packager),
+    _recentTiles(true, 4096u),
+    _numWritten(0),
+    _numLinked(0),
+    _numFailed(0)
 {
+    unsigned numWriteThreads = _packager->getNumWriteThreads();
+    if (numWriteThreads > 0u)
+    {
+        _writeArena = new JobArena("oe.tmspackager", numWriteThreads);
+
+        // bound the number of encoded-but-unwritten tiles held in memory
+        _writeArena->setMaxPending(numWriteThreads * 16u);
+    }
+}
+
+bool WriteTMSTileHandler::findTile(const std::string& hash, std::string& out_path)
+{
+    {
+        Threading::ScopedMutexLock lock(_singleColorTilesMutex);
+        std::map<std::string, std::string>::const_iterator i = _singleColorTiles.find(hash);
+        if (i != _singleColorTiles.end())
+        {
+            out_path = i->second;
+            return true;
+        }
+    }
+
+    LRUCache<std::string, std::string>::Record rec;
+    if (_recentTiles.get(hash, rec))
+    {
+        out_path = rec.value();
+        return true;
+    }
+    return false;
+}
+
+void WriteTMSTileHandler::recordTile(const std::string& hash, const std::string& path, bool singleColor)
+{
+    if (singleColor)
+    {
+        Threading::ScopedMutexLock lock(_singleColorTilesMutex);
+        _singleColorTiles.insert(std::make_pair(hash, path));
+    }
+    else
+    {
+        _recentTiles.insert(hash, path);
+    }
+}
+
+bool WriteTMSTileHandler::writeImage(const osg::Image* image, const std::string& path)
+{
+    // attempt to create the output folder:
+    osgEarth::makeDirectoryForFile( path );
+
+    std::string hash;
+    if (_packager->getDeduplicate())
+    {
+        hash = hashImage(image);
+
+        std::string original;
+        if (findTile(hash, original) && linkFile(original, path))
+        {
+            ++_numLinked;
+            return true;
+        }
+    }
+
+    if (!osgDB::writeImageFile(*image, path, _packager->getOptions()))
+    {
+        OE_WARN << LC << "Failed to write " << path << std::endl;
+        ++_numFailed;
+        return false;
+    }
+    ++_numWritten;
+
+    // Only record the tile once it is on disk, so a duplicate never links
+    // to a file that is still being written.
+    if (!hash.empty())
+    {
+        recordTile(hash, path, ImageUtils::isSingleColorImage(image, 0.0f));
+    }
+
+    return true;
+}
+
+bool WriteTMSTileHandler::write(osg::Image* image, const std::string& path)
+{
+    if (_writeArena.valid())
+    {
+        _writeArena->dispatch(new WriteTileTask(this, image, path));
+        return true;
+    }
+    return writeImage(image, path);
+}
+
+void WriteTMSTileHandler::flush()
+{
+    if (_writeArena.valid())
+    {
+        _writeArena->waitUntilIdle();
+    }
+
+    if (_packager->getDeduplicate() || _numFailed > 0)
+    {
+        OE_INFO << LC << "Wrote " << (unsigned)_numWritten << " tiles, linked "
+            << (unsigned)_numLinked << " duplicates, "
+            << (unsigned)_numFailed << " failed" << std::endl;
+    }
 }
 
 std::string WriteTMSTileHandler::getPathForTile( const TileKey &key )
@@ -106,9 +275,12 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
                 finalImage = ImageUtils::convertToRGB8( finalImage.get() );
             }
 
-            // attempt to create the output folder:
-            osgEarth::makeDirectoryForFile( path );
-            return osgDB::writeImageFile(*finalImage.get(), path, _packager->getOptions());
+            bool singleColor =
+                !_packager->getSubdivideSingleColorTiles() &&
+                ImageUtils::isSingleColorImage(finalImage.get(), 0.0f);
+
+            // a single-color tile ends the subdivision when requested
+            return write(finalImage.get(), path) && !singleColor;
         }
     }
     else if (elevationLayer )
@@ -120,9 +292,7 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
             ImageToHeightFieldConverter conv;
             osg::ref_ptr< osg::Image > image = conv.convert( hf.getHeightField(), _packager->getElevationPixelDepth() );
 
-            // attempt to create the output folder:
-            osgEarth::makeDirectoryForFile( path );
-            return osgDB::writeImageFile(*image.get(), path, _packager->getOptions());
+            return write(image.get(), path);
         }
     }
 
@@ -198,6 +368,10 @@ std::string WriteTMSTileHandler::getProcessString() const
     {
         buf << " --alpha-mask ";
     }
+    if (_packager->getSubdivideSingleColorTiles())
+    {
+        buf << " --continue-single-color ";
+    }
     return buf.str();
 }
 
@@ -212,8 +386,11 @@ _visitor(new TileVisitor()),
     _width(0),
     _height(0),
     _overwrite(false),
+    _subdivideSingleColorTiles(true),
     _keepEmpties(false),
     _applyAlphaMask(false),
+    _deduplicate(false),
+    _numWriteThreads(0u),
     _tileSource(0L)
 {
 }
@@ -308,6 +485,36 @@ void TMSPackager::setApplyAlphaMask(bool applyAlphaMask)
     _applyAlphaMask = applyAlphaMask;
 }
 
+bool TMSPackager::getSubdivideSingleColorTiles() const
+{
+    return _subdivideSingleColorTiles;
+}
+
+void TMSPackager::setSubdivideSingleColorTiles(bool value)
+{
+    _subdivideSingleColorTiles = value;
+}
+
+bool TMSPackager::getDeduplicate() const
+{
+    return _deduplicate;
+}
+
+void TMSPackager::setDeduplicate(bool deduplicate)
+{
+    _deduplicate = deduplicate;
+}
+
+unsigned TMSPackager::getNumWriteThreads() const
+{
+    return _numWriteThreads;
+}
+
+void TMSPackager::setNumWriteThreads(unsigned numWriteThreads)
+{
+    _numWriteThreads = numWriteThreads;
+}
+
 TileVisitor* TMSPackager::getTileVisitor() const
 {
     return _visitor.get();
@@ -393,6 +600,7 @@ void TMSPackager::run( TileLayer* layer,  Map* map  )
     _handler = new WriteTMSTileHandler(layer, map, this);
     _visitor->setTileHandler( _handler.get() );
     _visitor->run( map->getProfile() );
+    _handler->flush();
 }
 
 void TMSPackager::writeXML(TileLayer* layer, Map* map)
@@ -421,8 +629,8 @@ void TMSPackager::writeXML(TileLayer* layer, Map* map)
     }
 
 
-    //TODO:  Fix
-    unsigned int maxLevel = 23;
+    // TMS tile sets stop at level 23
+    unsigned int maxLevel = _visitor.valid() ? _visitor->getMaxLevel() : 23u;
     tileMap->setTitle( _layerName );
     tileMap->setVersion( "1.0.0" );
     tileMap->getFormat().setMimeType( mimeType );
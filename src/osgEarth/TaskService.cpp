@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/TaskService>
+#include <osgEarth/JobArena>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -284,80 +285,65 @@ TaskThread::cancel()
 
 TaskService::TaskService( const std::string& name, int numThreads, unsigned int maxSize ):
 osg::Referenced( true ),
-_lastRemoveFinishedThreadsStamp(0),
-_name(name),
-_numThreads( 0 )
+_numThreads( osg::maximum(1, numThreads) ),
+_stamp( 0 ),
+_stopped( false ),
+_name(name)
 {
-    _queue = new TaskRequestQueue( maxSize );
-    setNumThreads( numThreads );
+    _arena = new JobArena( name.empty() ? "oe.taskservice" : name, _numThreads );
+    _arena->setMaxPending( maxSize );
 }
 
 unsigned int
 TaskService::getNumRequests() const
 {
-    return _queue->getNumRequests();
+    return _arena->getNumPending();
 }
 
 void
 TaskService::add( TaskRequest* request )
 {   
-    //OE_INFO << LC << "TS [" << _name << "] adding request [" << request->getName() << "]" << std::endl;
-    _queue->add( request );
+    // A poison pill marks the end of the work; the service reports that it
+    // stopped once everything queued ahead of the pill has run.
+    if ( dynamic_cast<PoisonPill*>(request) )
+    {
+        _stopped = true;
+        return;
+    }
+
+    _arena->dispatch( request );
 }
 
 void TaskService::waitforThreadsToComplete()
 {        
-    for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
+    while ( areThreadsRunning() )
     {
-        (*i)->join();
-    }    
+        OpenThreads::Thread::microSleep( 1000 );
+    }
 }
 
 bool TaskService::areThreadsRunning()
 {
-    for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
-    {                
-        if ((*i)->isRunning())
-        {
-            return true;
-        }
-    }    
-    return false;
+    return !_stopped || !_arena->isIdle();
 }
 
 
 TaskService::~TaskService()
 {
-    _queue->setDone();
-
-    for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
-    {
-        (*i)->setDone(true);
-    }
-
-    for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
-    {
-        (*i)->cancel();
-        delete (*i);
-    }
+    _arena->cancelAll();
+    _arena->waitUntilIdle();
 }
 
 int
 TaskService::getStamp() const
 {
-    return _queue->getStamp();
+    return _stamp;
 }
 
 void
 TaskService::setStamp( int stamp )
 {
-    _queue->setStamp( stamp );
-    //Remove finished threads every 60 frames
-    if (stamp - _lastRemoveFinishedThreadsStamp > 60)
-    {
-        removeFinishedThreads();
-        _lastRemoveFinishedThreadsStamp = stamp;
-    }
+    _stamp = stamp;
 }
 
 int
@@ -372,86 +358,21 @@ TaskService::setNumThreads(int numThreads )
     if ( _numThreads != numThreads )
     {
         _numThreads = osg::maximum(1, numThreads);
-        adjustThreadCount();
-    }
-}
-
-void
-TaskService::adjustThreadCount()
-{
-    OpenThreads::ScopedLock<OpenThreads::ReentrantMutex> lock(_threadMutex);
-    removeFinishedThreads();
-    int numActiveThreads = 0;
-    for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
-    {
-        if (!(*i)->getDone()) numActiveThreads++;
-    }
-
-    int diff = _numThreads - numActiveThreads;
-    if (diff > 0)
-    {
-        OE_DEBUG << LC << "Adding " << diff << " threads to TaskService " << std::endl;
-        //We need to add some threads
-        for (int i = 0; i < diff; ++i)
-        {
-            TaskThread* thread = new TaskThread( _queue.get() );
-            _threads.push_back( thread );
-            thread->start();
-        }       
-    }
-    else if (diff < 0)
-    {
-        diff = osg::absolute( diff );
-        OE_DEBUG << LC << "Removing " << diff << " threads from TaskService " << std::endl;
-        int numRemoved = 0;
-        //We need to remove some threads
-        for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
-        {
-            if (!(*i)->getDone())
-            {
-                (*i)->setDone( true );
-                numRemoved++;
-                if (numRemoved == diff) break;
-            }
-        }
-    }  
-
-    OE_INFO << LC << "TaskService [" << _name << "] using " << _numThreads << " threads" << std::endl;
-}
-
-void
-TaskService::removeFinishedThreads()
-{
-    OpenThreads::ScopedLock<OpenThreads::ReentrantMutex> lock(_threadMutex);
-    unsigned int numRemoved = 0;
-    for (TaskThreads::iterator i = _threads.begin(); i != _threads.end();)
-    {
-        //Erase the threads are not running
-        if (!(*i)->isRunning())
-        {
-            i = _threads.erase( i );
-            numRemoved++;
-        }
-        else
-        {
-            i++;
-        }
-    }
-    if (numRemoved > 0)
-    {
-        OE_DEBUG << LC << "Removed " << numRemoved << " finished threads " << std::endl;
+        _arena->setConcurrency( _numThreads );
+        OE_INFO << LC << "TaskService [" << _name << "] using " << _numThreads << " threads" << std::endl;
     }
 }
 
 void
 TaskService::cancelAll()
 {
-    if (_numThreads > 0)
-    {
-        _numThreads = 0;
-        adjustThreadCount();
+    bool wasStopped = _stopped;
+    _stopped = true;
+    _arena->cancelAll();
 
-        OE_INFO << LC << "Cancelled all threads in TaskService [" << _name << "]" << std::endl;
+    if ( !wasStopped )
+    {
+        OE_INFO << LC << "Cancelled all tasks in TaskService [" << _name << "]" << std::endl;
     }
 }
 
@@ -22,8 +22,31 @@
 
 #define LC "[Terrain] "
 
+// LOD of the profile whose tiles form the cells of the callback index
+#define CALLBACK_INDEX_LOD 8
+
+// regions covering more cells than this are checked on every update instead
+#define MAX_CELLS_PER_CALLBACK 64
+
 using namespace osgEarth;
 
+namespace
+{
+    template<typename T>
+    void eraseUnordered(std::vector<T>& v, const T& value)
+    {
+        for (unsigned i = 0; i < v.size(); ++i)
+        {
+            if (v[i] == value)
+            {
+                v[i] = v.back();
+                v.pop_back();
+                return;
+            }
+        }
+    }
+}
+
 //---------------------------------------------------------------------------
 
 Terrain::onTileUpdateOperation::onTileUpdateOperation(const TileKey& key, osg::Node* node, Terrain* terrain)
@@ -63,15 +86,26 @@ void Terrain::onTileUpdateOperation::operator()(osg::Object*)
 
 Terrain::Terrain(osg::Node* graph, const Profile* mapProfile) :
 _graph         ( graph ),
-_profile       ( mapProfile )
+_profile       ( mapProfile ),
+_numIndexedCallbacks( 0u ),
+_cellsWide     ( 1u ),
+_cellsHigh     ( 1u ),
+_dispatchStamp ( 0u ),
+_maxTileUpdatesPerFrame( 0u )
 {
     _updateQueue = new osg::OperationQueue();
+
+    if (_profile.valid())
+    {
+        _profile->getNumTiles(CALLBACK_INDEX_LOD, _cellsWide, _cellsHigh);
+    }
 }
 
 void
 Terrain::update()
 {
     _updateQueue->runOperations();
+    firePendingTileUpdates();
 }
 
 bool
@@ -217,14 +251,51 @@ Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d&
 void
 Terrain::addTerrainCallback( TerrainCallback* cb )
 {
-    if ( cb )
-    {        
-        removeTerrainCallback( cb );
+    addTerrainCallback( cb, GeoExtent::INVALID );
+}
 
-        Threading::ScopedWriteLock exclusiveLock( _callbacksMutex );        
-        _callbacks.push_back( cb );
+void
+Terrain::addTerrainCallback( TerrainCallback* cb, const GeoExtent& region )
+{
+    if ( !cb )
+        return;
+
+    // express the region in the terrain SRS; anything we can't index
+    // (including a region that crosses the antimeridian) gets every update.
+    GeoExtent local;
+    if ( region.isValid() )
+    {
+        local = region.getSRS()->isHorizEquivalentTo(getSRS()) ? region : region.transform(getSRS());
+        if ( local.isValid() && local.crossesAntimeridian() )
+            local = GeoExtent::INVALID;
+    }
+
+    Threading::ScopedWriteLock exclusiveLock( _callbacksMutex );
+
+    CallbackEntry* entry;
+    Util::UnorderedMap<TerrainCallback*, CallbackList::iterator>::iterator i = _callbacksByPointer.find( cb );
+    if ( i != _callbacksByPointer.end() )
+    {
+        entry = &(*i->second);
+        unindexCallback( *entry );
+    }
+    else
+    {
+        _callbacks.push_back( CallbackEntry() );
+        entry = &_callbacks.back();
+        entry->_callback = cb;
+        entry->_stamp = 0u;
+        _callbacksByPointer[cb] = --_callbacks.end();
         ++_callbacksSize; // atomic increment
     }
+
+    entry->_spatial = local.isValid();
+    if ( entry->_spatial )
+    {
+        entry->_xmin = local.xMin(), entry->_ymin = local.yMin();
+        entry->_xmax = local.xMax(), entry->_ymax = local.yMax();
+    }
+    indexCallback( *entry );
 }
 
 void
@@ -232,20 +303,113 @@ Terrain::removeTerrainCallback( TerrainCallback* cb )
 {
     Threading::ScopedWriteLock exclusiveLock( _callbacksMutex );
 
-    for( CallbackList::iterator i = _callbacks.begin(); i != _callbacks.end(); )
-    {        
-        if ( i->get() == cb )
-        {
-            i = _callbacks.erase( i );
-            --_callbacksSize;
-        }
-        else
+    Util::UnorderedMap<TerrainCallback*, CallbackList::iterator>::iterator i = _callbacksByPointer.find( cb );
+    if ( i != _callbacksByPointer.end() )
+    {
+        unindexCallback( *i->second );
+        _callbacks.erase( i->second );
+        _callbacksByPointer.erase( i );
+        --_callbacksSize;
+    }
+}
+
+void
+Terrain::removeCallbacks( const std::vector<TerrainCallback*>& callbacks )
+{
+    for (unsigned i = 0; i < callbacks.size(); ++i)
+    {
+        // keep a reference, since the callback may be the last owner of itself
+        osg::ref_ptr<TerrainCallback> cb = callbacks[i];
+        removeTerrainCallback( cb.get() );
+    }
+}
+
+bool
+Terrain::getCell( double x, double y, unsigned& col, unsigned& row ) const
+{
+    const GeoExtent& e = getProfile()->getExtent();
+    if ( e.width() <= 0.0 || e.height() <= 0.0 )
+        return false;
+
+    // clamp to the edge cells, which is conservative
+    double c = floor( (x - e.xMin()) / e.width() * (double)_cellsWide );
+    double r = floor( (y - e.yMin()) / e.height() * (double)_cellsHigh );
+    col = (unsigned)osg::clampBetween( c, 0.0, (double)(_cellsWide - 1u) );
+    row = (unsigned)osg::clampBetween( r, 0.0, (double)(_cellsHigh - 1u) );
+    return true;
+}
+
+void
+Terrain::indexCallback( CallbackEntry& entry )
+{
+    entry._indexed = false;
+
+    if ( !entry._spatial )
+    {
+        _globalCallbacks.push_back( &entry );
+        return;
+    }
+
+    if ( getCell(entry._xmin, entry._ymin, entry._cellMin[0], entry._cellMin[1]) &&
+         getCell(entry._xmax, entry._ymax, entry._cellMax[0], entry._cellMax[1]) )
+    {
+        unsigned numCells =
+            (entry._cellMax[0] - entry._cellMin[0] + 1u) *
+            (entry._cellMax[1] - entry._cellMin[1] + 1u);
+
+        entry._indexed = ( numCells <= MAX_CELLS_PER_CALLBACK );
+    }
+
+    if ( entry._indexed )
+    {
+        for (unsigned row = entry._cellMin[1]; row <= entry._cellMax[1]; ++row)
+            for (unsigned col = entry._cellMin[0]; col <= entry._cellMax[0]; ++col)
+                _callbackCells[row*_cellsWide + col].push_back( &entry );
+        ++_numIndexedCallbacks;
+    }
+    else
+    {
+        _unindexedCallbacks.push_back( &entry );
+    }
+}
+
+void
+Terrain::unindexCallback( CallbackEntry& entry )
+{
+    if ( !entry._spatial )
+    {
+        eraseUnordered( _globalCallbacks, &entry );
+    }
+    else if ( !entry._indexed )
+    {
+        eraseUnordered( _unindexedCallbacks, &entry );
+    }
+    else
+    {
+        for (unsigned row = entry._cellMin[1]; row <= entry._cellMax[1]; ++row)
         {
-            ++i;
+            for (unsigned col = entry._cellMin[0]; col <= entry._cellMax[0]; ++col)
+            {
+                Util::UnorderedMap<unsigned, CallbackEntryVector>::iterator cell = _callbackCells.find( row*_cellsWide + col );
+                if ( cell != _callbackCells.end() )
+                {
+                    eraseUnordered( cell->second, &entry );
+                    if ( cell->second.empty() )
+                        _callbackCells.erase( cell );
+                }
+            }
         }
+        --_numIndexedCallbacks;
     }
 }
 
+void
+Terrain::addUpdateOperation(osg::Operation* operation)
+{
+    if (operation)
+        _updateQueue->add(operation);
+}
+
 void
 Terrain::notifyTileUpdate( const TileKey& key, osg::Node* node )
 {
@@ -254,36 +418,170 @@ Terrain::notifyTileUpdate( const TileKey& key, osg::Node* node )
         OE_WARN << LC << "notify with a null node!" << std::endl;
     }
 
+    ++_revision;
+
     if (_callbacksSize > 0)
     {
         if (!key.valid())
+        {
             OE_WARN << LC << "notifyTileUpdate with key = NULL\n";
-
-        _updateQueue->add(new onTileUpdateOperation(key, node, this));
+            _updateQueue->add(new onTileUpdateOperation(key, node, this));
+        }
+        else
+        {
+            // batch up for the next update traversal; a tile that updates
+            // more than once before then only fires once.
+            Threading::ScopedMutexLock lock(_pendingTileUpdatesMutex);
+            _pendingTileUpdates[key] = node;
+        }
     }
 }
 
 void
 Terrain::fireTileUpdate( const TileKey& key, osg::Node* node )
 {
-    Threading::ScopedReadLock sharedLock( _callbacksMutex );
+    std::vector<TerrainCallback*> removals;
+    {
+        Threading::ScopedReadLock sharedLock( _callbacksMutex );
+        dispatchTileUpdate( key, node, removals );
+    }
+    removeCallbacks( removals );
+}
 
-    for( CallbackList::iterator i = _callbacks.begin(); i != _callbacks.end(); )
-    {       
-        TerrainCallbackContext context( this );
-        i->get()->onTileUpdate( key, node, context );
+void
+Terrain::firePendingTileUpdates()
+{
+    std::vector< std::pair<TileKey, osg::observer_ptr<osg::Node> > > batch;
+    {
+        Threading::ScopedMutexLock lock(_pendingTileUpdatesMutex);
+        if (_pendingTileUpdates.empty())
+            return;
 
-        // if the callback set the "remove" flag, discard the callback.
-        if ( context.markedForRemoval() )
-            i = _callbacks.erase( i );
+        if (_maxTileUpdatesPerFrame == 0u || _pendingTileUpdates.size() <= _maxTileUpdatesPerFrame)
+        {
+            batch.assign(_pendingTileUpdates.begin(), _pendingTileUpdates.end());
+            _pendingTileUpdates.clear();
+        }
         else
-            ++i;
+        {
+            batch.reserve(_maxTileUpdatesPerFrame);
+            while (batch.size() < _maxTileUpdatesPerFrame)
+            {
+                batch.push_back(*_pendingTileUpdates.begin());
+                _pendingTileUpdates.erase(_pendingTileUpdates.begin());
+            }
+        }
     }
+
+    std::vector<TerrainCallback*> removals;
+    {
+        Threading::ScopedReadLock sharedLock( _callbacksMutex );
+        for (unsigned i = 0; i < batch.size(); ++i)
+        {
+            osg::ref_ptr<osg::Node> node;
+            if (batch[i].second.lock(node))
+            {
+                dispatchTileUpdate( batch[i].first, node.get(), removals );
+            }
+            else
+            {
+                // nop; tile expired; let it go.
+                OE_DEBUG << "Tile expired before notification: " << batch[i].first.str() << std::endl;
+            }
+        }
+    }
+    removeCallbacks( removals );
+}
+
+void
+Terrain::dispatchTileUpdate( const TileKey& key, osg::Node* node, std::vector<TerrainCallback*>& removals )
+{
+    // the stamp keeps a callback that spans several cells from firing twice
+    unsigned stamp = ++_dispatchStamp;
+
+#define OE_FIRE_CALLBACK(ENTRY) { \
+        TerrainCallbackContext context( this ); \
+        (ENTRY)->_stamp = stamp; \
+        (ENTRY)->_callback->onTileUpdate( key, node, context ); \
+        if ( context.markedForRemoval() ) \
+            removals.push_back( (ENTRY)->_callback.get() ); }
+
+    for (unsigned i = 0; i < _globalCallbacks.size(); ++i)
+    {
+        OE_FIRE_CALLBACK(_globalCallbacks[i]);
+    }
+
+    // without a key we don't know what changed, so everyone hears about it.
+    if ( !key.valid() )
+    {
+        for (CallbackList::iterator i = _callbacks.begin(); i != _callbacks.end(); ++i)
+        {
+            if ( i->_spatial )
+                OE_FIRE_CALLBACK(&(*i));
+        }
+        return;
+    }
+
+    const GeoExtent& extent = key.getExtent();
+    double xmin = extent.xMin(), ymin = extent.yMin(), xmax = extent.xMax(), ymax = extent.yMax();
+
+#define OE_OVERLAPS(ENTRY) \
+    ((ENTRY)->_stamp != stamp && \
+     (ENTRY)->_xmin <= xmax && (ENTRY)->_xmax >= xmin && \
+     (ENTRY)->_ymin <= ymax && (ENTRY)->_ymax >= ymin)
+
+    for (unsigned i = 0; i < _unindexedCallbacks.size(); ++i)
+    {
+        if ( OE_OVERLAPS(_unindexedCallbacks[i]) )
+            OE_FIRE_CALLBACK(_unindexedCallbacks[i]);
+    }
+
+    unsigned colMin, rowMin, colMax, rowMax;
+    if ( _numIndexedCallbacks > 0u &&
+         getCell(xmin, ymin, colMin, rowMin) &&
+         getCell(xmax, ymax, colMax, rowMax) )
+    {
+        unsigned numCells = (colMax - colMin + 1u) * (rowMax - rowMin + 1u);
+        if ( numCells > _numIndexedCallbacks )
+        {
+            // a low-LOD tile covers more cells than there are callbacks,
+            // so it's cheaper to check each callback.
+            for (CallbackList::iterator i = _callbacks.begin(); i != _callbacks.end(); ++i)
+            {
+                if ( i->_spatial && i->_indexed && OE_OVERLAPS(&(*i)) )
+                    OE_FIRE_CALLBACK(&(*i));
+            }
+        }
+        else
+        {
+            for (unsigned row = rowMin; row <= rowMax; ++row)
+            {
+                for (unsigned col = colMin; col <= colMax; ++col)
+                {
+                    Util::UnorderedMap<unsigned, CallbackEntryVector>::const_iterator cell = _callbackCells.find( row*_cellsWide + col );
+                    if ( cell != _callbackCells.end() )
+                    {
+                        const CallbackEntryVector& entries = cell->second;
+                        for (unsigned i = 0; i < entries.size(); ++i)
+                        {
+                            if ( OE_OVERLAPS(entries[i]) )
+                                OE_FIRE_CALLBACK(entries[i]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+#undef OE_OVERLAPS
+#undef OE_FIRE_CALLBACK
 }
 
 void
 Terrain::notifyMapElevationChanged()
 {
+    ++_revision;
+
     if (_callbacksSize > 0)
     {
         onTileUpdateOperation* op = new onTileUpdateOperation(TileKey::INVALID, 0L, this);
@@ -51,6 +51,11 @@ TerrainOptions::getConfig() const
     conf.set( "tile_pixel_size", _tilePixelSize);
     conf.set( "range_mode", "PIXEL_SIZE_ON_SCREEN", _rangeMode, osg::LOD::PIXEL_SIZE_ON_SCREEN);
     conf.set( "range_mode", "DISTANCE_FROM_EYE_POINT", _rangeMode, osg::LOD::DISTANCE_FROM_EYE_POINT);
+    conf.set( "debug_overlay", "none", _debugOverlay, DEBUG_OVERLAY_NONE);
+    conf.set( "debug_overlay", "lod", _debugOverlay, DEBUG_OVERLAY_LOD);
+    conf.set( "debug_overlay", "latency", _debugOverlay, DEBUG_OVERLAY_LATENCY);
+    conf.set( "debug_overlay", "bytes", _debugOverlay, DEBUG_OVERLAY_BYTES);
+    conf.set( "debug_overlay", "cost", _debugOverlay, DEBUG_OVERLAY_COST);
     conf.set( "skirt_ratio", heightFieldSkirtRatio() );
     conf.set( "color", color() );
     conf.set( "expiration_range", minExpiryRange() );
@@ -62,7 +67,17 @@ TerrainOptions::getConfig() const
     conf.set( "morph_elevation", morphTerrain() );
     conf.set( "morph_imagery", morphImagery() );
     conf.set( "merges_per_frame", mergesPerFrame() );
+    conf.set( "merge_time_budget", mergeTimeBudget() );
     conf.set( "priority_scale", priorityScale() );
+    conf.set( "layer_fetch_concurrency", layerFetchConcurrency() );
+    conf.set( "upload_ring_size", uploadRingSize() );
+    conf.set( "bindless_textures", bindlessTextures() );
+    conf.set( "tile_memory_budget", tileMemoryBudget() );
+    conf.set( "packed_vertices", packedVertices() );
+    conf.set( "prefetch_time", prefetchTime() );
+    conf.set( "max_geometry_lod", maxGeometryLOD() );
+    conf.set( "morph_imagery_mipmaps", morphImageryMipmaps() );
+    conf.set( "gpu_culling", gpuCulling() );
 
     return conf;
 }
@@ -101,7 +116,18 @@ TerrainOptions::fromConfig(const Config& conf)
     morphTerrain().init(true);
     morphImagery().init(true);
     mergesPerFrame().init(20u);
+    mergeTimeBudget().init(0.0);
     priorityScale().init(1.0f);
+    layerFetchConcurrency().init(4u);
+    uploadRingSize().init(0u);
+    bindlessTextures().init(false);
+    tileMemoryBudget().init(0u);
+    packedVertices().init(false);
+    prefetchTime().init(0.0f);
+    maxGeometryLOD().init(99u);
+    morphImageryMipmaps().init(false);
+    gpuCulling().init(false);
+    debugOverlay().init(DEBUG_OVERLAY_NONE);
 
     conf.get( "tile_size", _tileSize );
     conf.get( "vertical_scale", _verticalScale );
@@ -126,6 +152,11 @@ TerrainOptions::fromConfig(const Config& conf)
     conf.get( "tile_pixel_size", _tilePixelSize);
     conf.get( "range_mode", "PIXEL_SIZE_ON_SCREEN", _rangeMode, osg::LOD::PIXEL_SIZE_ON_SCREEN);
     conf.get( "range_mode", "DISTANCE_FROM_EYE_POINT", _rangeMode, osg::LOD::DISTANCE_FROM_EYE_POINT);
+    conf.get( "debug_overlay", "none", _debugOverlay, DEBUG_OVERLAY_NONE);
+    conf.get( "debug_overlay", "lod", _debugOverlay, DEBUG_OVERLAY_LOD);
+    conf.get( "debug_overlay", "latency", _debugOverlay, DEBUG_OVERLAY_LATENCY);
+    conf.get( "debug_overlay", "bytes", _debugOverlay, DEBUG_OVERLAY_BYTES);
+    conf.get( "debug_overlay", "cost", _debugOverlay, DEBUG_OVERLAY_COST);
     conf.get( "skirt_ratio", heightFieldSkirtRatio() );
     conf.get( "color", color() );
     conf.get( "expiration_range", minExpiryRange() );
@@ -136,7 +167,17 @@ TerrainOptions::fromConfig(const Config& conf)
     conf.get( "morph_terrain", morphTerrain() );
     conf.get( "morph_imagery", morphImagery() );
     conf.get( "merges_per_frame", mergesPerFrame() );
+    conf.get( "merge_time_budget", mergeTimeBudget() );
     conf.get( "priority_scale", priorityScale());
+    conf.get( "layer_fetch_concurrency", layerFetchConcurrency() );
+    conf.get( "upload_ring_size", uploadRingSize() );
+    conf.get( "bindless_textures", bindlessTextures() );
+    conf.get( "tile_memory_budget", tileMemoryBudget() );
+    conf.get( "packed_vertices", packedVertices() );
+    conf.get( "prefetch_time", prefetchTime() );
+    conf.get( "max_geometry_lod", maxGeometryLOD() );
+    conf.get( "morph_imagery_mipmaps", morphImageryMipmaps() );
+    conf.get( "gpu_culling", gpuCulling() );
 }
 
 //...................................................................
@@ -178,7 +219,18 @@ OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, NormalizeEdges, normalizeEdges);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, MorphTerrain, morphTerrain);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, MorphImagery, morphImagery);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, MergesPerFrame, mergesPerFrame);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, double, MergeTimeBudget, mergeTimeBudget);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, float, PriorityScale, priorityScale);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, LayerFetchConcurrency, layerFetchConcurrency);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, UploadRingSize, uploadRingSize);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, BindlessTextures, bindlessTextures);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, TileMemoryBudget, tileMemoryBudget);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, PackedVertices, packedVertices);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, float, PrefetchTime, prefetchTime);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, MaxGeometryLOD, maxGeometryLOD);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, MorphImageryMipmaps, morphImageryMipmaps);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, GPUCulling, gpuCulling);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, TerrainOptions::DebugOverlay, DebugOverlay, debugOverlay);
 
 void
 TerrainOptionsAPI::setDriver(const std::string& value)
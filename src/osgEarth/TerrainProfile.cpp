@@ -21,11 +21,110 @@
 */
 #include <osgEarth/TerrainProfile>
 #include <osgEarth/MapNode>
-#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/JobArena>
+#include <algorithm>
+#include <cmath>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+namespace
+{
+    // Number of spans along the path whose sample spacing is chosen
+    // separately from the resolution of the data under them.
+    const unsigned NUM_SPANS = 16u;
+
+    // True if the segment (x0,y0)-(x1,y1) touches the extent.
+    bool segmentIntersects(const GeoExtent& extent, double x0, double y0, double x1, double y1)
+    {
+        double tmin = 0.0, tmax = 1.0;
+        double d[2] = { x1 - x0, y1 - y0 };
+        double p[2] = { x0, y0 };
+        double lo[2] = { extent.xMin(), extent.yMin() };
+        double hi[2] = { extent.xMax(), extent.yMax() };
+
+        for (unsigned a = 0; a < 2; ++a)
+        {
+            if (d[a] == 0.0)
+            {
+                if (p[a] < lo[a] || p[a] > hi[a])
+                    return false;
+            }
+            else
+            {
+                double t0 = (lo[a] - p[a]) / d[a];
+                double t1 = (hi[a] - p[a]) / d[a];
+                if (t0 > t1) std::swap(t0, t1);
+                tmin = osg::maximum(tmin, t0);
+                tmax = osg::minimum(tmax, t1);
+                if (tmin > tmax)
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+/**
+ * Computes a profile on a worker thread and hands it to the update traversal.
+ */
+struct TerrainProfileCalculator::ComputeTask : public TaskRequest
+{
+    ComputeTask(TerrainProfileCalculator* calc, const Map* map, Terrain* terrain, unsigned generation) :
+        _calc(calc), _map(map), _terrain(terrain), _generation(generation),
+        _start(calc->_start), _end(calc->_end), _maxSamples(calc->_maxSamples) { }
+
+    void operator()(ProgressCallback*);
+
+    osg::observer_ptr<TerrainProfileCalculator> _calc;
+    osg::observer_ptr<const Map> _map;
+    osg::observer_ptr<Terrain> _terrain;
+    unsigned _generation;
+    GeoPoint _start, _end;
+    unsigned _maxSamples;
+};
+
+/**
+ * Installs a computed profile during the update traversal.
+ */
+struct TerrainProfileCalculator::DeliverOperation : public osg::Operation
+{
+    DeliverOperation(TerrainProfileCalculator* calc, unsigned generation, const TerrainProfile& profile) :
+        osg::Operation("TerrainProfileCalculator", false),
+        _calc(calc), _generation(generation), _profile(profile) { }
+
+    void operator()(osg::Object*)
+    {
+        osg::ref_ptr<TerrainProfileCalculator> calc;
+        if (_calc.lock(calc))
+            calc->onComputed(_generation, &_profile);
+    }
+
+    osg::observer_ptr<TerrainProfileCalculator> _calc;
+    unsigned _generation;
+    TerrainProfile _profile;
+};
+
+void
+TerrainProfileCalculator::ComputeTask::operator()(ProgressCallback*)
+{
+    osg::ref_ptr<TerrainProfileCalculator> calc;
+    if (!_calc.lock(calc))
+        return;
+
+    TerrainProfile profile;
+    osg::ref_ptr<const Map> map;
+    if (_map.lock(map))
+        computeTerrainProfile(map.get(), _start, _end, profile, _maxSamples);
+
+    osg::ref_ptr<Terrain> terrain;
+    if (_terrain.lock(terrain))
+        terrain->addUpdateOperation(new DeliverOperation(calc.get(), _generation, profile));
+    else
+        calc->onComputed(_generation, 0L);
+}
+
 /***************************************************/
 TerrainProfile::TerrainProfile():
 _spacing( 1.0 )
@@ -93,14 +192,22 @@ TerrainProfile::getElevationRanges(double &min, double &max ) const
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode, const GeoPoint& start, const GeoPoint& end):
 _mapNode( mapNode ),
 _start( start),
-_end( end )
+_end( end ),
+_maxSamples( 4096u ),
+_generation( 0u ),
+_computing( false ),
+_computePending( false )
 {        
     _mapNode->getTerrain()->addTerrainCallback( this );        
     recompute();
 }
 
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode):
-_mapNode( mapNode )
+_mapNode( mapNode ),
+_maxSamples( 4096u ),
+_generation( 0u ),
+_computing( false ),
+_computePending( false )
 {
     _mapNode->getTerrain()->addTerrainCallback( this );
 }
@@ -188,11 +295,19 @@ void TerrainProfileCalculator::onTileUpdate(const osgEarth::TileKey& tileKey, os
 {
     if (_start.isValid() && _end.isValid())
     {
-        GeoExtent extent( _start.getSRS());
-        extent.expandToInclude(_start.x(), _start.y());
-        extent.expandToInclude(_end.x(), _end.y());
+        // an invalid key means the map's elevation data changed everywhere.
+        if (!tileKey.valid())
+        {
+            recompute();
+            return;
+        }
 
-        if (tileKey.getExtent().intersects( extent ))
+        // only tiles that the path crosses can change the profile.
+        const GeoExtent& extent = tileKey.getExtent();
+        GeoPoint start, end;
+        if (_start.transform(extent.getSRS(), start) &&
+            _end.transform(extent.getSRS(), end) &&
+            segmentIntersects(extent, start.x(), start.y(), end.x(), end.y()))
         {
             recompute();
         }
@@ -201,9 +316,44 @@ void TerrainProfileCalculator::onTileUpdate(const osgEarth::TileKey& tileKey, os
 
 void TerrainProfileCalculator::recompute()
 {
-    if (_start.isValid() && _end.isValid())
+    Threading::ScopedMutexLock lock(_computeMutex);
+
+    // invalidates any computation already underway
+    ++_generation;
+
+    if (!_start.isValid() || !_end.isValid() || !_mapNode.valid())
+    {
+        _profile.clear();
+        return;
+    }
+
+    // one computation at a time; the latest request runs when it finishes.
+    if (_computing)
+    {
+        _computePending = true;
+        return;
+    }
+
+    _computing = true;
+    _computePending = false;
+
+    JobArena::get("oe.terrainprofile")->dispatch(new ComputeTask(
+        this, _mapNode->getMap(), _mapNode->getTerrain(), _generation));
+}
+
+void TerrainProfileCalculator::onComputed(unsigned generation, const TerrainProfile* profile)
+{
+    bool current, again;
     {
-        computeTerrainProfile( _mapNode.get(), _start, _end, _profile);
+        Threading::ScopedMutexLock lock(_computeMutex);
+        _computing = false;
+        current = (generation == _generation);
+        again = _computePending;
+    }
+
+    if (current && profile)
+    {
+        _profile = *profile;
 
         for( ChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
         {
@@ -211,26 +361,98 @@ void TerrainProfileCalculator::recompute()
                 i->get()->onChanged(this);
         }
     }
-    else
+
+    if (again)
     {
-        _profile.clear();
+        recompute();
     }
 }
 
 void TerrainProfileCalculator::computeTerrainProfile( osgEarth::MapNode* mapNode, const GeoPoint& start, const GeoPoint& end, TerrainProfile& profile)
 {
-    osg::Vec3d startvec, endvec;
-    start.toWorld( startvec, mapNode->getTerrain() );
-    end.toWorld( endvec, mapNode->getTerrain() );
-    osgSim::ElevationSlice slice;
-    slice.setStartPoint( startvec );
-    slice.setEndPoint( endvec );
-    slice.setDatabaseCacheReadCallback( 0 );
-    slice.computeIntersections( mapNode->getTerrainEngine());
+    computeTerrainProfile( mapNode ? mapNode->getMap() : 0L, start, end, profile );
+}
 
+void TerrainProfileCalculator::computeTerrainProfile( const osgEarth::Map* map, const GeoPoint& start, const GeoPoint& end, TerrainProfile& profile, unsigned maxSamples)
+{
     profile.clear();
-    for (unsigned int i = 0; i < slice.getDistanceHeightIntersections().size(); i++)
+
+    const SpatialReference* srs = map ? map->getSRS() : 0L;
+    GeoPoint p0, p1;
+    if (!srs || !start.transform(srs, p0) || !end.transform(srs, p1))
+        return;
+
+    // sample the straight world-space segment between the two points on the ellipsoid.
+    p0.z() = 0.0;
+    p0.altitudeMode() = ALTMODE_ABSOLUTE;
+    p1.z() = 0.0;
+    p1.altitudeMode() = ALTMODE_ABSOLUTE;
+    osg::Vec3d startWorld, endWorld;
+    if (!p0.toWorld(startWorld) || !p1.toWorld(endWorld))
+        return;
+
+    osg::Vec3d delta = endWorld - startWorld;
+    double length = delta.length();
+    if (length <= 0.0)
+        return;
+
+    // The finest spacing that stays within maxSamples picks the LOD to query;
+    // the envelope falls back on coarser data where that's all there is.
+    maxSamples = osg::maximum(maxSamples, NUM_SPANS + 2u);
+    double minSpacing = length / (double)(maxSamples - NUM_SPANS - 1u);
+    double midLat = srs->isGeographic() ? 0.5*(p0.y() + p1.y()) : 0.0;
+    double minSpacingMap = SpatialReference::transformUnits(Distance(minSpacing, Units::METERS), srs, midLat);
+
+    ElevationPool* pool = map->getElevationPool();
+    unsigned lod = map->getProfile()->getLevelOfDetailForHorizResolution(minSpacingMap, pool->getTileSize());
+    osg::ref_ptr<ElevationEnvelope> envelope = pool->createEnvelope(srs, lod);
+
+    // Probe the data resolution in the middle of each span and sample the
+    // span at that spacing, so flat coarse data doesn't cost fine samples.
+    std::vector<double> ts;
+    ts.reserve(maxSamples);
+    ts.push_back(0.0);
+
+    osg::Vec3d local;
+    for (unsigned s = 0; s < NUM_SPANS; ++s)
     {
-        profile.addElevation( slice.getDistanceHeightIntersections()[i].first, slice.getDistanceHeightIntersections()[i].second);
+        double t0 = (double)s / (double)NUM_SPANS;
+        double t1 = (double)(s + 1u) / (double)NUM_SPANS;
+
+        srs->transformFromWorld(startWorld + delta*(0.5*(t0 + t1)), local);
+        float resolution = envelope->getElevationAndResolution(local.x(), local.y()).second;
+
+        double spacing = minSpacing;
+        if (resolution > 0.0f)
+        {
+            spacing = osg::maximum(spacing, srs->transformUnits(
+                (double)resolution, srs->getGeocentricSRS(), srs->isGeographic() ? local.y() : 0.0));
+        }
+
+        unsigned steps = osg::maximum(1u, (unsigned)std::ceil((t1 - t0)*length / spacing));
+        for (unsigned i = 1; i <= steps; ++i)
+        {
+            ts.push_back(t0 + (t1 - t0)*(double)i / (double)steps);
+        }
+    }
+
+    // one batched query for the whole path; the envelope groups the samples by tile.
+    std::vector<double> xs(ts.size()), ys(ts.size());
+    std::vector<float> hs(ts.size());
+    for (unsigned i = 0; i < ts.size(); ++i)
+    {
+        srs->transformFromWorld(startWorld + delta*ts[i], local);
+        xs[i] = local.x();
+        ys[i] = local.y();
+    }
+
+    envelope->getElevations(&xs[0], &ys[0], &hs[0], ts.size());
+
+    for (unsigned i = 0; i < ts.size(); ++i)
+    {
+        if (hs[i] != NO_DATA_VALUE)
+        {
+            profile.addElevation(ts[i] * length, hs[i]);
+        }
     }
 }
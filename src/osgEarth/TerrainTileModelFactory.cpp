@@ -24,10 +24,12 @@
 #include <osgEarth/Metrics>
 
 #include <osg/Texture2D>
+#include <OpenThreads/Thread>
 
 #define LC "[TerrainTileModelFactory] "
 
 using namespace osgEarth;
+using namespace osgEarth::Util;
 
 //.........................................................................
 
@@ -51,6 +53,33 @@ void CreateTileManifest::insert(const Layer* layer)
     }
 }
 
+void CreateTileManifest::insert(const CreateTileManifest& rhs)
+{
+    // an empty manifest already requests everything
+    if (empty())
+        return;
+
+    if (rhs.empty())
+    {
+        _layers.clear();
+        _includesElevation = false;
+        _includesLandCover = false;
+        return;
+    }
+
+    for(LayerTable::const_iterator i = rhs._layers.begin(); i != rhs._layers.end(); ++i)
+    {
+        LayerTable::iterator j = _layers.find(i->first);
+        if (j == _layers.end())
+            _layers[i->first] = i->second;
+        else
+            j->second = osg::maximum(j->second, i->second);
+    }
+
+    _includesElevation = _includesElevation || rhs._includesElevation;
+    _includesLandCover = _includesLandCover || rhs._includesLandCover;
+}
+
 bool CreateTileManifest::excludes(const Layer* layer) const
 {
     return !empty() && _layers.find(layer->getUID()) == _layers.end();
@@ -130,8 +159,184 @@ _heightFieldCache( true, 128 )
     writeLC(osg::Vec4(0,0,0,0), 0, 0);
     _emptyLandCoverTexture = new osg::Texture2D(landCoverImage);
     _emptyLandCoverTexture->setUnRefImageDataAfterApply(Registry::instance()->unRefImageDataAfterApply().get());
+
+    // Helper threads for fetching a tile's layers in parallel. The per-tile
+    // limit is enforced by the factory; this only caps the total.
+    if (_options.layerFetchConcurrency().get() > 1u)
+    {
+        _fetchArena = new JobArena(
+            "oe.tilemodel",
+            osg::maximum(OpenThreads::GetNumberOfProcessors(), 2));
+    }
 }
 
+//.........................................................................
+
+namespace
+{
+    /**
+     * Progress callback for one of the fetches of a parallel tile model.
+     * Cancelation goes through to the tile's callback, but stats are kept
+     * locally (the stats table is not thread-safe) and merged afterwards.
+     */
+    struct FetchProgress : public ProgressCallback
+    {
+        FetchProgress(ProgressCallback* parent) : _parent(parent)
+        {
+            if (_parent.valid())
+                collectStats() = _parent->collectStats();
+        }
+
+        virtual void cancel()
+        {
+            ProgressCallback::cancel();
+            if (_parent.valid())
+                _parent->cancel();
+        }
+
+        virtual bool isCanceled()
+        {
+            return ProgressCallback::isCanceled() || (_parent.valid() && _parent->isCanceled());
+        }
+
+        //! Copies stats and the retry delay into the tile's callback.
+        void merge()
+        {
+            if (_parent.valid())
+            {
+                for (Stats::const_iterator i = _stats.begin(); i != _stats.end(); ++i)
+                    _parent->stats()[i->first] += i->second;
+
+                if (getRetryDelay() > _parent->getRetryDelay())
+                    _parent->setRetryDelay(getRetryDelay());
+            }
+        }
+
+        osg::ref_ptr<ProgressCallback> _parent;
+    };
+}
+
+//! One fetch operation in a parallel tile model.
+struct TerrainTileModelFactory::FetchJob : public osg::Referenced
+{
+    FetchJob(ProgressCallback* progress) : _progress(new FetchProgress(progress)) { }
+    virtual void run() =0;
+    osg::ref_ptr<FetchProgress> _progress;
+};
+
+//! Set of fetch jobs for one tile. The thread that creates the tile and any
+//! helper threads all claim jobs from the same list until it's empty, so the
+//! tile completes even when no helper threads are free.
+struct TerrainTileModelFactory::FetchGroup : public osg::Referenced
+{
+    FetchGroup() : _next(0u), _remaining(0u) { }
+
+    void add(FetchJob* job)
+    {
+        _jobs.push_back(job);
+        ++_remaining;
+    }
+
+    //! Claims and runs the next job; returns false if there are none left.
+    bool runNext()
+    {
+        unsigned index = (++_next) - 1u;
+        if (index >= _jobs.size())
+            return false;
+
+        _jobs[index]->run();
+
+        if (--_remaining == 0u)
+            _done.set();
+
+        return true;
+    }
+
+    //! Runs jobs on the calling thread, then waits for the helpers to finish.
+    void runAndWait()
+    {
+        while (runNext());
+        _done.wait();
+    }
+
+    std::vector< osg::ref_ptr<FetchJob> > _jobs;
+    OpenThreads::Atomic _next;
+    OpenThreads::Atomic _remaining;
+    Threading::Event _done;
+};
+
+//! Task that helps a fetch group from a JobArena thread.
+struct TerrainTileModelFactory::FetchTask : public TaskRequest
+{
+    FetchTask(FetchGroup* group) : _group(group) { }
+
+    void operator()(ProgressCallback*)
+    {
+        while (_group->runNext());
+    }
+
+    osg::ref_ptr<FetchGroup> _group;
+};
+
+struct TerrainTileModelFactory::ImageLayerFetch : public TerrainTileModelFactory::FetchJob
+{
+    ImageLayerFetch(TerrainTileModelFactory* factory, TerrainTileModel* model, ImageLayer* layer,
+                    const TileKey& key, const TerrainEngineRequirements* reqs, ProgressCallback* progress) :
+        FetchJob(progress), _factory(factory), _model(model), _layer(layer), _key(key), _reqs(reqs) { }
+
+    void run()
+    {
+        _result = _factory->createImageLayerModel(_model, _layer, _key, _reqs, _progress.get());
+    }
+
+    TerrainTileModelFactory* _factory;
+    TerrainTileModel* _model;
+    ImageLayer* _layer;
+    const TileKey& _key;
+    const TerrainEngineRequirements* _reqs;
+    osg::ref_ptr<TerrainTileImageLayerModel> _result;
+};
+
+struct TerrainTileModelFactory::ElevationFetch : public TerrainTileModelFactory::FetchJob
+{
+    ElevationFetch(TerrainTileModelFactory* factory, TerrainTileModel* model, const Map* map,
+                   const TileKey& key, const CreateTileManifest& manifest, unsigned border, ProgressCallback* progress) :
+        FetchJob(progress), _factory(factory), _model(model), _map(map), _key(key), _manifest(manifest), _border(border) { }
+
+    void run()
+    {
+        _factory->addElevation(_model, _map, _key, _manifest, _border, _progress.get());
+    }
+
+    TerrainTileModelFactory* _factory;
+    TerrainTileModel* _model;
+    const Map* _map;
+    const TileKey& _key;
+    const CreateTileManifest& _manifest;
+    unsigned _border;
+};
+
+struct TerrainTileModelFactory::LandCoverFetch : public TerrainTileModelFactory::FetchJob
+{
+    LandCoverFetch(TerrainTileModelFactory* factory, TerrainTileModel* model, const Map* map,
+                   const TileKey& key, const TerrainEngineRequirements* reqs, const CreateTileManifest& manifest, ProgressCallback* progress) :
+        FetchJob(progress), _factory(factory), _model(model), _map(map), _key(key), _reqs(reqs), _manifest(manifest) { }
+
+    void run()
+    {
+        _factory->addLandCover(_model, _map, _key, _reqs, _manifest, _progress.get());
+    }
+
+    TerrainTileModelFactory* _factory;
+    TerrainTileModel* _model;
+    const Map* _map;
+    const TileKey& _key;
+    const TerrainEngineRequirements* _reqs;
+    const CreateTileManifest& _manifest;
+};
+
+//.........................................................................
+
 TerrainTileModel*
 TerrainTileModelFactory::createTileModel(
     const Map*                       map,
@@ -146,17 +351,27 @@ TerrainTileModelFactory::createTileModel(
         key,
         map->getDataModelRevision() );
 
-    // assemble all the components:
-    addColorLayers(model.get(), map, requirements, key, manifest, progress, false);
+    unsigned concurrency = _options.layerFetchConcurrency().get();
 
-    if ( requirements == 0L || requirements->elevationTexturesRequired() )
+    if (concurrency > 1u && _fetchArena.valid())
     {
-        unsigned border = (requirements && requirements->elevationBorderRequired()) ? 1u : 0u;
-
-        addElevation( model.get(), map, key, manifest, border, progress );
+        // fetch the layers at the same time:
+        addLayersInParallel(model.get(), map, requirements, key, manifest, progress, concurrency);
     }
+    else
+    {
+        // assemble all the components:
+        addColorLayers(model.get(), map, requirements, key, manifest, progress, false);
 
-    addLandCover(model.get(), map, key, requirements, manifest, progress);
+        if ( requirements == 0L || requirements->elevationTexturesRequired() )
+        {
+            unsigned border = (requirements && requirements->elevationBorderRequired()) ? 1u : 0u;
+
+            addElevation( model.get(), map, key, manifest, border, progress );
+        }
+
+        addLandCover(model.get(), map, key, requirements, manifest, progress);
+    }
 
     //addPatchLayers(model.get(), map, key, filter, progress, false);
 
@@ -196,6 +411,107 @@ TerrainTileModelFactory::createStandaloneTileModel(
     return model.release();
 }
 
+void
+TerrainTileModelFactory::addLayersInParallel(
+    TerrainTileModel* model,
+    const Map* map,
+    const TerrainEngineRequirements* reqs,
+    const TileKey& key,
+    const CreateTileManifest& manifest,
+    ProgressCallback* progress,
+    unsigned concurrency)
+{
+    OE_PROFILING_ZONE;
+    OE_START_TIMER(fetch_layers);
+
+    osg::ref_ptr<FetchGroup> group = new FetchGroup();
+
+    // One slot per color layer, in map order, so the results go into the
+    // model in the same order as the serial path would put them.
+    std::vector< osg::ref_ptr<TerrainTileColorLayerModel> > colorSlots;
+    std::vector< osg::ref_ptr<ImageLayerFetch> > imageFetches;
+
+    LayerVector layers;
+    map->getLayers(layers);
+
+    for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+    {
+        Layer* layer = i->get();
+
+        if (!layer->isOpen())
+            continue;
+
+        if (layer->getRenderType() != layer->RENDERTYPE_TERRAIN_SURFACE)
+            continue;
+
+        if (manifest.excludes(layer))
+            continue;
+
+        ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer);
+        if (imageLayer)
+        {
+            ImageLayerFetch* fetch = new ImageLayerFetch(this, model, imageLayer, key, reqs, progress);
+            group->add(fetch);
+            imageFetches.push_back(fetch);
+            colorSlots.push_back(0L);
+        }
+        else // non-image kind of TILE layer:
+        {
+            TerrainTileColorLayerModel* colorModel = new TerrainTileColorLayerModel();
+            colorModel->setLayer(layer);
+            colorModel->setRevision(layer->getRevision());
+            colorSlots.push_back(colorModel);
+        }
+    }
+
+    // Elevation and land cover write to different parts of the model than
+    // the color layers, so they can run alongside them.
+    if (reqs == 0L || reqs->elevationTexturesRequired())
+    {
+        unsigned border = (reqs && reqs->elevationBorderRequired()) ? 1u : 0u;
+        group->add(new ElevationFetch(this, model, map, key, manifest, border, progress));
+    }
+
+    group->add(new LandCoverFetch(this, model, map, key, reqs, manifest, progress));
+
+    // The calling thread works too, so it only needs concurrency-1 helpers.
+    unsigned numHelpers = osg::minimum((unsigned)group->_jobs.size(), concurrency) - 1u;
+    for (unsigned i = 0; i < numHelpers; ++i)
+    {
+        _fetchArena->dispatch(new FetchTask(group.get()));
+    }
+
+    group->runAndWait();
+
+    // assemble the color layers in map order:
+    unsigned nextImage = 0;
+    for (unsigned i = 0; i < colorSlots.size(); ++i)
+    {
+        if (colorSlots[i].valid())
+        {
+            model->colorLayers().push_back(colorSlots[i].get());
+        }
+        else
+        {
+            TerrainTileImageLayerModel* layerModel = imageFetches[nextImage++]->_result.get();
+            if (layerModel)
+                addImageLayerModel(model, layerModel);
+        }
+    }
+
+    if (progress)
+    {
+        for (unsigned i = 0; i < group->_jobs.size(); ++i)
+            group->_jobs[i]->_progress->merge();
+
+        double tries = progress->stats()["hfcache_try_count"];
+        if (tries > 0.0)
+            progress->stats()["hfcache_hit_rate"] = progress->stats()["hfcache_hit_count"]/tries;
+
+        progress->stats()["fetch_layers_time"] += OE_STOP_TIMER(fetch_layers);
+    }
+}
+
 TerrainTileImageLayerModel*
 TerrainTileModelFactory::addImageLayer(
     TerrainTileModel* model,
@@ -203,11 +519,50 @@ TerrainTileModelFactory::addImageLayer(
     const TileKey& key,
     const TerrainEngineRequirements* reqs,
     ProgressCallback* progress)
+{
+    TerrainTileImageLayerModel* layerModel = createImageLayerModel(model, imageLayer, key, reqs, progress);
+
+    if (layerModel)
+    {
+        addImageLayerModel(model, layerModel);
+    }
+
+    return layerModel;
+}
+
+void
+TerrainTileModelFactory::addImageLayerModel(
+    TerrainTileModel* model,
+    TerrainTileImageLayerModel* layerModel) const
+{
+    model->colorLayers().push_back(layerModel);
+
+    const ImageLayer* imageLayer = layerModel->getImageLayer();
+
+    if (imageLayer && imageLayer->isShared())
+    {
+        model->sharedLayers().push_back(layerModel);
+    }
+
+    if (imageLayer && imageLayer->isDynamic())
+    {
+        model->setRequiresUpdateTraverse(true);
+    }
+}
+
+TerrainTileImageLayerModel*
+TerrainTileModelFactory::createImageLayerModel(
+    TerrainTileModel* model,
+    ImageLayer* imageLayer,
+    const TileKey& key,
+    const TerrainEngineRequirements* reqs,
+    ProgressCallback* progress)
 {
     TerrainTileImageLayerModel* layerModel = NULL;
-    osg::Texture* tex = 0L;
+    osg::ref_ptr<osg::Texture> tex;
     TextureWindow window;
     osg::Matrix scaleBiasMatrix;
+    bool shared = false;
         
     if (imageLayer->isKeyInLegalRange(key) && imageLayer->mayHaveData(key))
     {
@@ -220,53 +575,96 @@ TerrainTileModelFactory::addImageLayer(
 
         else
         {
-            GeoImage geoImage = imageLayer->createImage(key, progress);
+            // Reuse the texture if another tile already made one for this
+            // layer and key (e.g. its siblings falling back on the same parent).
+            std::string name;
+            if (!imageLayer->isDynamic())
+            {
+                name = Stringify() << imageLayer->getUID() << "/" << imageLayer->getRevision() << "/" << key.str();
+                shared = getSharedTexture(name, tex);
+            }
 
-            if (geoImage.valid())
+            if (!shared)
             {
-                if (imageLayer->isCoverage())
-                    tex = createCoverageTexture(geoImage.getImage());
-                else
-                    tex = createImageTexture(geoImage.getImage(), imageLayer);
+                GeoImage geoImage = imageLayer->createImage(key, progress);
+
+                if (geoImage.valid())
+                {
+                    if (imageLayer->isCoverage())
+                        tex = createCoverageTexture(geoImage.getImage());
+                    else
+                        tex = createImageTexture(geoImage.getImage(), imageLayer);
+
+                    if (!name.empty())
+                    {
+                        tex->setName(key.str());
+                        addSharedTexture(name, tex.get());
+                        shared = true;
+                    }
+                }
             }
         }
     }
 
     // if this is the first LOD, and the engine requires that the first LOD
     // be populated, make an empty texture if we didn't get one.
-    if (tex == 0L &&
+    if (!tex.valid() &&
         _options.firstLOD() == key.getLOD() &&
         reqs && reqs->fullDataAtFirstLodRequired())
     {
         tex = _emptyColorTexture.get();
     }
 
-    if (tex)
+    if (tex.valid())
     {
-        tex->setName(model->getKey().str());
+        if (!shared)
+            tex->setName(model->getKey().str());
 
         layerModel = new TerrainTileImageLayerModel();
 
         layerModel->setImageLayer(imageLayer);
 
-        layerModel->setTexture(tex);
+        layerModel->setTexture(tex.get());
         layerModel->setMatrix(new osg::RefMatrixf(scaleBiasMatrix));
         layerModel->setRevision(imageLayer->getRevision());
+    }
 
-        model->colorLayers().push_back(layerModel);
+    return layerModel;
+}
 
-        if (imageLayer->isShared())
-        {
-            model->sharedLayers().push_back(layerModel);
-        }
+bool
+TerrainTileModelFactory::getSharedTexture(const std::string& name, osg::ref_ptr<osg::Texture>& out)
+{
+    Threading::ScopedMutexLock lock(_sharedTexturesMutex);
+    SharedTextures::iterator i = _sharedTextures.find(name);
+    if (i != _sharedTextures.end())
+    {
+        if (i->second.lock(out))
+            return true;
+
+        _sharedTextures.erase(i);
+    }
+    return false;
+}
 
-        if (imageLayer->isDynamic())
+void
+TerrainTileModelFactory::addSharedTexture(const std::string& name, osg::Texture* tex)
+{
+    Threading::ScopedMutexLock lock(_sharedTexturesMutex);
+    _sharedTextures[name] = tex;
+
+    // textures go away with the tiles using them; sweep out the expired
+    // entries now and then.
+    if (_sharedTextures.size() % 1024u == 0u)
+    {
+        for (SharedTextures::iterator i = _sharedTextures.begin(); i != _sharedTextures.end(); )
         {
-            model->setRequiresUpdateTraverse(true);
+            if (!i->second.valid())
+                _sharedTextures.erase(i++);
+            else
+                ++i;
         }
     }
-
-    return layerModel;
 }
 
 void
@@ -280,6 +678,17 @@ TerrainTileModelFactory::addStandaloneImageLayer(
     TerrainTileImageLayerModel* layerModel = NULL;
     TileKey keyToUse = key;
     osg::Matrixf scaleBiasMatrix;
+
+    // Skip straight to the best ancestor the layer has data for; the
+    // tile samples its (shared) texture through the scale/bias matrix
+    // instead of a cropped and resampled copy.
+    TileKey bestKey = imageLayer->getBestAvailableTileKey(key);
+    if (bestKey.valid() && bestKey.getLOD() < key.getLOD())
+    {
+        key.getExtent().createScaleBias(bestKey.getExtent(), scaleBiasMatrix);
+        keyToUse = bestKey;
+    }
+
     while (keyToUse.valid() && !layerModel)
     {
         layerModel = addImageLayer(model, imageLayer, keyToUse, reqs, progress);
@@ -555,7 +964,10 @@ TerrainTileModelFactory::getOrCreateHeightField(
             true);              // initialize to HAE (0.0) heights
     }
 
-    if (!out_normalMap.valid() && _options.normalMaps() == true)
+    // Low-LOD tiles are only seen from high altitude; skip their normal maps.
+    if (!out_normalMap.valid() &&
+        _options.normalMaps() == true &&
+        key.getLOD() >= _options.minNormalMapLOD().get())
     {
         out_normalMap = new NormalMap(257, 257);
     }
@@ -23,6 +23,8 @@
 #include <limits.h>
 
 #include <osgEarth/Tessellator>
+#include <osgEarth/JobArena>
+#include <osgUtil/Tessellator>
 
 #ifdef OSGEARTH_CXX11
 
@@ -188,10 +190,130 @@ AreaPlane polygonPlane(osg::Vec3Array& verts)
 }
 
 
+Tessellator::Engine
+Tessellator::getDefaultEngine()
+{
+#ifdef USE_EARCUT
+    return ENGINE_EARCUT;
+#else
+    return ENGINE_EARCLIP;
+#endif
+}
+
+Tessellator::Tessellator() :
+_engine(getDefaultEngine())
+{
+    //nop
+}
+
+Tessellator::Tessellator(Engine engine) :
+_engine(engine)
+{
+    //nop
+}
+
 bool
 Tessellator::tessellateGeometry(osg::Geometry &geom)
 {
-#ifndef USE_EARCUT
+    switch (_engine)
+    {
+    case ENGINE_EARCUT:  return tessellateEarcut(geom);
+    case ENGINE_OSG:     return tessellateOSG(geom);
+    default:             return tessellateEarClip(geom);
+    }
+}
+
+namespace
+{
+    /**
+     * Geometries of one tessellateGeometries() call. Threads claim them one
+     * at a time until they're all done.
+     */
+    struct TessellationGroup : public osg::Referenced
+    {
+        TessellationGroup(const std::vector<osg::Geometry*>& geoms, Tessellator::Engine engine) :
+            _geoms(geoms), _engine(engine), _next(0u), _remaining(geoms.size()), _succeeded(0u) { }
+
+        bool runNext()
+        {
+            unsigned index = (++_next) - 1u;
+            if (index >= _geoms.size())
+                return false;
+
+            if (_geoms[index])
+            {
+                Tessellator tess(_engine);
+                if (tess.tessellateGeometry(*_geoms[index]))
+                    ++_succeeded;
+            }
+
+            if (--_remaining == 0u)
+                _done.set();
+
+            return true;
+        }
+
+        std::vector<osg::Geometry*> _geoms;
+        Tessellator::Engine _engine;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _remaining;
+        OpenThreads::Atomic _succeeded;
+        Threading::Event _done;
+    };
+
+    struct TessellationTask : public TaskRequest
+    {
+        TessellationTask(TessellationGroup* group) : _group(group) { }
+
+        void operator()(ProgressCallback*)
+        {
+            while (_group->runNext());
+        }
+
+        osg::ref_ptr<TessellationGroup> _group;
+    };
+}
+
+unsigned
+Tessellator::tessellateGeometries(const std::vector<osg::Geometry*>& geoms, unsigned numThreads)
+{
+    if (geoms.empty())
+        return 0u;
+
+    osg::ref_ptr<TessellationGroup> group = new TessellationGroup(geoms, _engine);
+
+    unsigned numHelpers = osg::minimum(numThreads, (unsigned)geoms.size());
+    if (numHelpers > 1u)
+    {
+        JobArena* arena = JobArena::get("oe.tessellator");
+        if (arena->getConcurrency() < numHelpers - 1u)
+            arena->setConcurrency(numHelpers - 1u);
+
+        for (unsigned i = 1; i < numHelpers; ++i)
+        {
+            arena->dispatch(new TessellationTask(group.get()));
+        }
+    }
+
+    while (group->runNext());
+    group->_done.wait();
+
+    return group->_succeeded;
+}
+
+bool
+Tessellator::tessellateOSG(osg::Geometry& geom)
+{
+    osgUtil::Tessellator tess;
+    tess.setTessellationType(osgUtil::Tessellator::TESS_TYPE_GEOMETRY);
+    tess.setWindingType(osgUtil::Tessellator::TESS_WINDING_ODD);
+    tess.retessellatePolygons(geom);
+    return true;
+}
+
+bool
+Tessellator::tessellateEarClip(osg::Geometry &geom)
+{
     osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
 
     if (!vertices || vertices->empty() || geom.getPrimitiveSetList().empty()) return false;
@@ -260,43 +382,66 @@ Tessellator::tessellateGeometry(osg::Geometry &geom)
         }
     }
     return success;
+}
+
+bool
+Tessellator::tessellateEarcut(osg::Geometry &geom)
+{
+#ifndef USE_EARCUT
+    return tessellateEarClip(geom);
 #else
-    // Create array
-    std::vector< std::vector< osg::Vec2 > > polygon;
-    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(geom.getVertexArray());
+    osg::Vec3Array* verts = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
+    if (!verts || verts->empty())
+        return false;
+
     int areaPlane = polygonPlane(*verts);
 
+    // earcut numbers the vertices of all rings in order, so keep a table
+    // back to the vertex array in case the rings aren't contiguous.
+    std::vector< std::vector< osg::Vec2 > > polygon;
+    std::vector<unsigned> vertexIndex;
+    vertexIndex.reserve(verts->size());
+
     for (unsigned int i = 0; i < geom.getNumPrimitiveSets(); i++)
     {
-        std::vector< osg::Vec2 > ring;
         osg::PrimitiveSet* pset = geom.getPrimitiveSet(i);
-        if (pset->getType() == osg::PrimitiveSet::DrawArraysPrimitiveType)
+        if (pset->getType() != osg::PrimitiveSet::DrawArraysPrimitiveType)
+            continue;
+
+        osg::DrawArrays* drawArray = static_cast<osg::DrawArrays*>(pset);
+        unsigned int first = drawArray->getFirst();
+        unsigned int last = first + drawArray->getCount();
+        if (last > verts->size())
+            return false;
+
+        polygon.push_back(std::vector<osg::Vec2>());
+        std::vector<osg::Vec2>& ring = polygon.back();
+        ring.reserve(drawArray->getCount());
+        for (unsigned int j = first; j < last; j++)
         {
-            osg::DrawArrays* drawArray = static_cast<osg::DrawArrays*>(pset);
-            unsigned int first = drawArray->getFirst();
-            unsigned int last = first + drawArray->getCount();
-            ring.reserve(drawArray->getCount());
-            for (unsigned int j = first; j < last; j++)
-            {
-                const osg::Vec3& v = verts->at(j);
-                switch (areaPlane) {
-                    case AREA_PLANE_XY: ring.push_back(osg::Vec2(v.x(), v.y())); break;
-                    case AREA_PLANE_XZ: ring.push_back(osg::Vec2(v.x(), v.z())); break;
-                    case AREA_PLANE_YZ: ring.push_back(osg::Vec2(v.y(), v.z())); break;
-                }
+            const osg::Vec3& v = (*verts)[j];
+            switch (areaPlane) {
+                case AREA_PLANE_XY: ring.push_back(osg::Vec2(v.x(), v.y())); break;
+                case AREA_PLANE_XZ: ring.push_back(osg::Vec2(v.x(), v.z())); break;
+                case AREA_PLANE_YZ: ring.push_back(osg::Vec2(v.y(), v.z())); break;
             }
+            vertexIndex.push_back(j);
         }
-        polygon.push_back(ring);
     }
 
-    // The index type. Defaults to uint32_t, but you can also pass uint16_t if you know that your
-    // data won't have more than 65536 vertices.
+    if (polygon.empty())
+        return false;
+
     std::vector<uint32_t> indices = mapbox::earcut<uint32_t>(polygon);
+    if (indices.empty())
+        return false;
+
     // Remove the existing primitive sets
     geom.removePrimitiveSet(0, geom.getNumPrimitiveSets());
     osg::DrawElementsUInt* drawElements = new osg::DrawElementsUInt(GL_TRIANGLES);
     drawElements->reserve(indices.size());
-    std::copy(indices.begin(), indices.end(), std::back_inserter(*drawElements));
+    for (std::vector<uint32_t>::const_iterator i = indices.begin(); i != indices.end(); ++i)
+        drawElements->push_back(vertexIndex[*i]);
     geom.addPrimitiveSet(drawElements);
     return true;
 #endif
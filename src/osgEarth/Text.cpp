@@ -228,6 +228,68 @@ Text::createStateSet()
 #endif
 }
 
+namespace
+{
+    // GlyphQuads keeps either one primitive or one per backdrop pass,
+    // depending on the OSG version; the foreground glyphs come first.
+    inline const osg::DrawElements* foreground(const osg::ref_ptr<osg::DrawElements>& p)
+    {
+        return p.get();
+    }
+
+    inline const osg::DrawElements* foreground(const std::vector< osg::ref_ptr<osg::DrawElements> >& p)
+    {
+        return p.empty() ? 0L : p.front().get();
+    }
+}
+
+bool
+Text::getGlyphTriangles(osg::State& state, osg::Matrix& matrix, std::vector<GlyphTriangles>& output) const
+{
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+    // boxes and non-shader backdrops need their own draw calls
+    if ((_drawMode & ~TEXT) != 0 ||
+        (_backdropType != NONE && _shaderTechnique == osgText::NO_TEXT_SHADER))
+    {
+        return false;
+    }
+
+    if (!_coords.valid() || !_texcoords.valid() || !_colorCoords.valid() ||
+        _texcoords->size() != _coords->size() ||
+        _colorCoords->size() != _coords->size())
+    {
+        return false;
+    }
+
+    // same transform drawImplementation would apply
+    osg::Matrix local;
+    if (computeMatrix(local, &state))
+        matrix = local * state.getModelViewMatrix();
+    else
+        matrix = state.getModelViewMatrix();
+
+    for(TextureGlyphQuadMap::const_iterator i = _textureGlyphQuadMap.begin();
+        i != _textureGlyphQuadMap.end();
+        ++i)
+    {
+        const osg::DrawElements* indices = foreground(i->second._primitives);
+        if (indices && indices->getNumIndices() > 0)
+        {
+            GlyphTriangles t;
+            t.texture = i->first.get();
+            t.coords = _coords.get();
+            t.texcoords = _texcoords.get();
+            t.colors = _colorCoords.get();
+            t.indices = indices;
+            output.push_back(t);
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 void
 Text::setFont(osg::ref_ptr<osgText::Font> font)
 {
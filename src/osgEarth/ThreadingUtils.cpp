@@ -283,3 +283,46 @@ ThreadPool::get(const osgDB::Options* options)
     return OptionsData<ThreadPool>::get(options, "osgEarth::ThreadPool");
 }
 
+
+//...................................................................
+
+MainThreadExecutor*
+MainThreadExecutor::instance()
+{
+    static osg::ref_ptr<MainThreadExecutor> s_instance = new MainThreadExecutor();
+    return s_instance.get();
+}
+
+void
+MainThreadExecutor::execute(osg::Operation* op)
+{
+    ScopedMutexLock lock(_mutex);
+    _queue.push_back(op);
+}
+
+unsigned
+MainThreadExecutor::drain(unsigned maxOps)
+{
+    std::vector< osg::ref_ptr<osg::Operation> > ops;
+    {
+        ScopedMutexLock lock(_mutex);
+        if (_queue.empty())
+            return 0u;
+
+        if (_queue.size() <= maxOps)
+        {
+            ops.swap(_queue);
+        }
+        else
+        {
+            ops.assign(_queue.begin(), _queue.begin() + maxOps);
+            _queue.erase(_queue.begin(), _queue.begin() + maxOps);
+        }
+    }
+
+    // run outside the lock so operations can queue more work
+    for (unsigned i = 0; i < ops.size(); ++i)
+        (*ops[i].get())(0L);
+
+    return ops.size();
+}
@@ -21,6 +21,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Utils>
 #include <osgEarth/ThreeDTilesLayer>
+#include <osgEarth/Map>
 
 #define LC "[ThreeDTilesLayer] " << getName() << " : "
 
@@ -38,6 +39,9 @@ ThreeDTilesLayer::Options::getConfig() const
     Config conf = VisibleLayer::Options::getConfig();
     conf.set("url", _url);
     conf.set("max_sse", _maximumScreenSpaceError);
+    conf.set("max_memory_mb", _maxMemoryMB);
+    conf.set("horizon_culling", _horizonCulling);
+    conf.set("terrain_occlusion", _terrainOcclusion);
     return conf;
 }
 
@@ -45,8 +49,14 @@ void
 ThreeDTilesLayer::Options::fromConfig( const Config& conf )
 {
     _maximumScreenSpaceError.init(15.0f);
+    _maxMemoryMB.init(0u);
+    _horizonCulling.init(true);
+    _terrainOcclusion.init(false);
     conf.get("url", _url);
     conf.get("max_sse", _maximumScreenSpaceError);
+    conf.get("max_memory_mb", _maxMemoryMB);
+    conf.get("horizon_culling", _horizonCulling);
+    conf.get("terrain_occlusion", _terrainOcclusion);
 }
 
 //........................................................................
@@ -101,6 +111,8 @@ ThreeDTilesLayer::openImplementation()
 
     _tilesetNode = new ThreeDTilesetNode(tileset, "", getSceneGraphCallbacks(), readOptions.get());
     _tilesetNode->setMaximumScreenSpaceError(*options().maximumScreenSpaceError());
+    _tilesetNode->setMaxBytes((size_t)options().maxMemoryMB().get() * 1024u * 1024u);
+    _tilesetNode->setHorizonCulling(options().horizonCulling().get());
 
     return STATUS_OK;
 }
@@ -121,6 +133,75 @@ ThreeDTilesLayer::setMaximumScreenSpaceError(float maximumScreenSpaceError)
     }
 }
 
+unsigned
+ThreeDTilesLayer::getMaxMemoryMB() const
+{
+    return *options().maxMemoryMB();
+}
+
+void
+ThreeDTilesLayer::setMaxMemoryMB(unsigned value)
+{
+    options().maxMemoryMB() = value;
+    if (_tilesetNode)
+    {
+        _tilesetNode->setMaxBytes((size_t)value * 1024u * 1024u);
+    }
+}
+
+bool
+ThreeDTilesLayer::getHorizonCulling() const
+{
+    return *options().horizonCulling();
+}
+
+void
+ThreeDTilesLayer::setHorizonCulling(bool value)
+{
+    options().horizonCulling() = value;
+    if (_tilesetNode)
+    {
+        _tilesetNode->setHorizonCulling(value);
+    }
+}
+
+bool
+ThreeDTilesLayer::getTerrainOcclusion() const
+{
+    return *options().terrainOcclusion();
+}
+
+void
+ThreeDTilesLayer::setTerrainOcclusion(bool value)
+{
+    options().terrainOcclusion() = value;
+
+    osg::ref_ptr<const Map> map;
+    if (_tilesetNode && _map.lock(map))
+    {
+        _tilesetNode->setElevationPool(value ? map->getElevationPool() : NULL);
+    }
+}
+
+void
+ThreeDTilesLayer::addedToMap(const Map* map)
+{
+    VisibleLayer::addedToMap(map);
+    _map = map;
+    setTerrainOcclusion(getTerrainOcclusion());
+}
+
+void
+ThreeDTilesLayer::removedFromMap(const Map* map)
+{
+    VisibleLayer::removedFromMap(map);
+    if (_tilesetNode)
+    {
+        _tilesetNode->setElevationPool(NULL);
+    }
+    _map = NULL;
+}
+
 osg::Node*
 ThreeDTilesLayer::getNode() const
 {
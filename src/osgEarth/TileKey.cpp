@@ -47,32 +47,50 @@ TileKey::TileKey(unsigned int lod, unsigned int tile_x, unsigned int tile_y, con
 
         _extent = GeoExtent( _profile->getSRS(), xmin, ymin, xmax, ymax );
 
-        char buf[255];
-        sprintf(buf, "%u/%u/%u", _lod, _x, _y);
-        _key = buf;
-#ifdef OSGEARTH_CXX11
-        _hash = std::hash<std::string>()(_key);
-#endif
+        _profileSig = _profile->getHorizSignatureHash();
+
+        // mix the packed (lod, x, y) with the profile signature:
+        unsigned long long packed =
+            ((unsigned long long)_lod << 58) ^
+            ((unsigned long long)_x << 29) ^
+            (unsigned long long)_y;
+        packed ^= (unsigned long long)_profileSig * 0x9E3779B97F4A7C15ull;
+        packed ^= packed >> 31;
+        packed *= 0xBF58476D1CE4E5B9ull;
+        packed ^= packed >> 29;
+        _hash = (size_t)packed;
     }
     else
     {
         _extent = GeoExtent::INVALID;
-        _key = "invalid";
+        _profileSig = 0u;
+        _hash = 0u;
     }
 }
 
 TileKey::TileKey( const TileKey& rhs ) :
-_key( rhs._key ),
 _lod(rhs._lod),
 _x(rhs._x),
 _y(rhs._y),
 _profile( rhs._profile.get() ),
 _extent( rhs._extent ),
+_profileSig(rhs._profileSig),
 _hash(rhs._hash)
 {
     //NOP
 }
 
+std::string
+TileKey::str() const
+{
+    if ( !valid() )
+        return "invalid";
+
+    char buf[36];
+    sprintf(buf, "%u/%u/%u", _lod, _x, _y);
+    return buf;
+}
+
 const Profile*
 TileKey::getProfile() const
 {
@@ -45,6 +45,7 @@ TileLayer::Options::getConfig() const
     conf.set( "no_data_value", _noDataValue);
     conf.set( "min_valid_value", _minValidValue);
     conf.set( "max_valid_value", _maxValidValue);
+    conf.set( "remember_empty_tiles", _rememberEmptyTiles);
 
     return conf;
 }
@@ -59,6 +60,7 @@ TileLayer::Options::fromConfig(const Config& conf)
     _noDataValue.init( -32767.0f ); // SHRT_MIN
     _minValidValue.init( -32766.0f ); // -(2^15 - 2)
     _maxValidValue.init( 32767.0f );
+    _rememberEmptyTiles.init( true );
 
     conf.get( "min_level", _minLevel );
     conf.get( "max_level", _maxLevel );
@@ -71,6 +73,7 @@ TileLayer::Options::fromConfig(const Config& conf)
     conf.get( "nodata_value", _noDataValue); // back compat
     conf.get( "min_valid_value", _minValidValue);
     conf.get( "max_valid_value", _maxValidValue);
+    conf.get( "remember_empty_tiles", _rememberEmptyTiles);
 }
 
 //------------------------------------------------------------------------
@@ -295,6 +298,16 @@ unsigned TileLayer::getTileSize() const
     return options().tileSize().get();
 }
 
+void TileLayer::setRememberEmptyTiles(bool value)
+{
+    options().rememberEmptyTiles() = value;
+}
+
+bool TileLayer::getRememberEmptyTiles() const
+{
+    return options().rememberEmptyTiles().get();
+}
+
 
 void
 TileLayer::init()
@@ -354,21 +367,43 @@ TileLayer::setUpL2Cache(unsigned minSize)
         OE_INFO << LC << "L2 cache size set from environment = " << l2CacheSize << "\n";
     }
 
+    // A memory budget (in MB) replaces the entry count.
+    unsigned l2CacheSizeMB = layerHints().L2CacheSizeMB().getOrUse(0u);
+
+    char const* l2mbEnv = ::getenv("OSGEARTH_L2_CACHE_MB");
+    if (l2mbEnv)
+    {
+        l2CacheSizeMB = as<int>(std::string(l2mbEnv), 0);
+        OE_INFO << LC << "L2 cache budget set from environment = " << l2CacheSizeMB << " MB\n";
+    }
+
     // Env cache-only mode also disables the L2 cache.
     char const* noCacheEnv = ::getenv("OSGEARTH_MEMORY_PROFILE");
     if (noCacheEnv)
     {
         l2CacheSize = 0;
+        l2CacheSizeMB = 0;
     }
 
     // Initialize the l2 cache if it's size is > 0
-    if (l2CacheSize > 0)
+    if (l2CacheSizeMB > 0)
+    {
+        _memCache = new MemCache(l2CacheSize, (size_t)l2CacheSizeMB * 1048576u);
+        OE_INFO << LC << "L2 cache budget = " << l2CacheSizeMB << " MB" << std::endl;
+    }
+    else if (l2CacheSize > 0)
     {
         _memCache = new MemCache(l2CacheSize);
         OE_INFO << LC << "L2 cache size = " << l2CacheSize << std::endl;
     }
 }
 
+bool
+TileLayer::getL2CacheStats(MemCache::Stats& out) const
+{
+    return _memCache.valid() && _memCache->getDefaultBinStats(out);
+}
+
 Status
 TileLayer::openImplementation()
 {
@@ -382,6 +417,13 @@ TileLayer::openImplementation()
     if (_memCache.valid())
         _memCache->clear();
 
+    {
+        Threading::ScopedMutexLock lock(_knownEmptyTilesMutex);
+        _knownEmptyTiles.clear();
+    }
+
+    _tileMetrics = Util::Metrics::layerHistograms(getName());
+
     return getStatus();
 }
 
@@ -399,7 +441,20 @@ TileLayer::openForWriting()
 
 Status
 TileLayer::closeImplementation()
-{    
+{
+    // keep whatever we learned about empty tiles for next time
+    KnownEmptyTilesMap knownEmptyTiles;
+    {
+        Threading::ScopedMutexLock lock(_knownEmptyTilesMutex);
+        knownEmptyTiles.swap(_knownEmptyTiles);
+    }
+
+    for (KnownEmptyTilesMap::const_iterator i = knownEmptyTiles.begin(); i != knownEmptyTiles.end(); ++i)
+    {
+        if (i->second._tiles->getNumUnsaved() > 0u)
+            saveKnownEmptyTiles(i->second._profile.get(), i->second._tiles.get());
+    }
+
     return Layer::closeImplementation();
 }
 
@@ -779,6 +834,27 @@ TileLayer::getExtent() const
 
 TileKey
 TileLayer::getBestAvailableTileKey(const TileKey& key) const
+{
+    TileKey bestKey = getBestAvailableTileKeyFromExtents(key);
+
+    // Walk up past any keys for which the source already came back empty.
+    if (bestKey.valid() && options().rememberEmptyTiles() == true)
+    {
+        KnownEmptyTiles* knownEmpty = getKnownEmptyTiles(key.getProfile());
+        if (knownEmpty && knownEmpty->size() > 0u)
+        {
+            while (bestKey.valid() && knownEmpty->contains(bestKey))
+            {
+                bestKey = getBestAvailableTileKeyFromExtents(bestKey.createParentKey());
+            }
+        }
+    }
+
+    return bestKey;
+}
+
+TileKey
+TileLayer::getBestAvailableTileKeyFromExtents(const TileKey& key) const
 {
     // trivial reject
     if ( !key.valid() )
@@ -889,3 +965,88 @@ TileLayer::mayHaveData(const TileKey& key) const
 {
     return key == getBestAvailableTileKey(key);
 }
+
+bool
+TileLayer::isKnownEmpty(const TileKey& key) const
+{
+    if (options().rememberEmptyTiles() == false)
+        return false;
+
+    KnownEmptyTiles* knownEmpty = getKnownEmptyTiles(key.getProfile());
+    return knownEmpty && knownEmpty->contains(key);
+}
+
+void
+TileLayer::recordEmptyTile(const TileKey& key, ProgressCallback* progress)
+{
+    // A canceled request (which includes recoverable network errors) says
+    // nothing about the tile; dynamic data may show up later.
+    if (!progress || progress->isCanceled() ||
+        options().rememberEmptyTiles() == false ||
+        isDynamic() ||
+        isWritingRequested())
+    {
+        return;
+    }
+
+    KnownEmptyTiles* knownEmpty = getKnownEmptyTiles(key.getProfile());
+    if (!knownEmpty)
+        return;
+
+    knownEmpty->insert(key);
+
+    // save periodically so a session that ends abruptly still keeps most of them
+    if (knownEmpty->getNumUnsaved() >= 64u)
+    {
+        saveKnownEmptyTiles(key.getProfile(), knownEmpty);
+    }
+}
+
+KnownEmptyTiles*
+TileLayer::getKnownEmptyTiles(const Profile* profile) const
+{
+    if (!profile || !isOpen())
+        return 0L;
+
+    Threading::ScopedMutexLock lock(_knownEmptyTilesMutex);
+
+    KnownEmptyTilesEntry& entry = _knownEmptyTiles[profile->getHorizSignature()];
+    if (!entry._tiles.valid())
+    {
+        entry._profile = profile;
+        entry._tiles = new KnownEmptyTiles();
+
+        // restore the keys found in earlier sessions:
+        const CacheSettings* cacheSettings = getCacheSettings();
+        if (cacheSettings && cacheSettings->cachePolicy()->isCacheReadable())
+        {
+            // cache pattern: cast to const for caching purposes
+            CacheBin* bin = const_cast<TileLayer*>(this)->getCacheBin(profile);
+            if (bin)
+            {
+                entry._tiles->load(bin, getKnownEmptyTilesKey(profile), cacheSettings->cachePolicy().get());
+            }
+        }
+    }
+    return entry._tiles.get();
+}
+
+std::string
+TileLayer::getKnownEmptyTilesKey(const Profile* profile) const
+{
+    return Stringify() << profile->getHorizSignature() << "_empty";
+}
+
+void
+TileLayer::saveKnownEmptyTiles(const Profile* profile, KnownEmptyTiles* tiles)
+{
+    const CacheSettings* cacheSettings = getCacheSettings();
+    if (cacheSettings && cacheSettings->cachePolicy()->isCacheWriteable())
+    {
+        CacheBin* bin = getCacheBin(profile);
+        if (bin)
+        {
+            tiles->save(bin, getKnownEmptyTilesKey(profile));
+        }
+    }
+}
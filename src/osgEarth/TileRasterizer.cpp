@@ -20,6 +20,7 @@
 #include <osgEarth/NodeUtils>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/GLUtils>
+#include <cstring>
 
 #define LC "[TileRasterizer] "
 
@@ -67,7 +68,9 @@ namespace
 
 TileRasterizer::TileRasterizer() :
 osg::Camera(),
-_frameLastUpdated(0u)
+_frameLastUpdated(0u),
+_attached(0L),
+_attachedReadback(0L)
 {
     // active an update traversal.
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
@@ -124,9 +127,6 @@ _frameLastUpdated(0u)
     _distortionU = new osg::Uniform("oe_rasterizer_f", 1.0f);
     ss->addUniform(_distortionU.get());
 #endif
-
-    _samplesQuery.resize(64u);
-    _samplesQuery.setAllElementsTo(INT_MAX);
 }
 
 TileRasterizer::~TileRasterizer()
@@ -151,20 +151,28 @@ TileRasterizer::ReadbackImage::readPixels(
     int x, int y, int width, int height,
     GLenum pixelFormat, GLenum type, int packing)
 {
+    // nothing to read when the camera is only drawing to poll transfers
+    if (!_target)
+        return;
+
     OE_DEBUG << LC << "ReadPixels in context " << _ri->getContextID() << std::endl;
 
-    glPixelStorei(GL_PACK_ALIGNMENT, _packing);
-    glPixelStorei(GL_PACK_ROW_LENGTH, _rowLength);
+    glPixelStorei(GL_PACK_ALIGNMENT, _target->getPacking());
+    glPixelStorei(GL_PACK_ROW_LENGTH, _target->getRowLength());
 
-    if (getPixelBufferObject())
+    if (_pbo != 0u)
     {
-        _ri->getState()->bindPixelBufferObject(getPixelBufferObject()->getOrCreateGLBufferObject(_ri->getContextID()));
-        glReadPixels(x, y, width, height, getPixelFormat(), getDataType(), 0L);
+        // asynchronous: the copy lands in the PBO and we map it once it's fenced.
+        osg::GLExtensions* ext = osg::GLExtensions::Get(_ri->getContextID(), true);
+        _ri->getState()->unbindPixelBufferObject();
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _pbo);
+        glReadPixels(x, y, width, height, _target->getPixelFormat(), _target->getDataType(), 0L);
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
     }
     else
     {
         // synchronous:
-        glReadPixels(x, y, width, height, getPixelFormat(), getDataType(), _data);
+        glReadPixels(x, y, width, height, _target->getPixelFormat(), _target->getDataType(), _target->data());
     }
 }
 
@@ -179,21 +187,19 @@ TileRasterizer::push(osg::Node* node, unsigned size, const GeoExtent& extent)
 
     job._node = node;
     job._extent = extent;
-    job._image = new ReadbackImage();
+    job._image = new osg::Image();
     job._image->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
 
-    //job._imagePBO = new osg::PixelBufferObject(job._image.get());
-    //job._imagePBO->setTarget(GL_PIXEL_PACK_BUFFER);
-    //job._imagePBO->setUsage(GL_STREAM_READ);
-    //job._image->setPixelBufferObject(job._imagePBO.get());
-
     return job._imagePromise.getFuture();
 }
 
 void
 TileRasterizer::accept(osg::NodeVisitor& nv)
 {
-    if (nv.getVisitorType() == nv.CULL_VISITOR && getBufferAttachmentMap().empty())
+    // Only draw while a job is rendering or a readback is in flight;
+    // the latter keeps the draw callbacks coming so we can poll the fences.
+    if (nv.getVisitorType() == nv.CULL_VISITOR &&
+        (getBufferAttachmentMap().empty() || (_readbackJobs.empty() && _transferJobs.empty())))
     {
         return;
     }
@@ -221,23 +227,29 @@ TileRasterizer::traverse(osg::NodeVisitor& nv)
 
         Threading::ScopedMutexLock lock(_mutex);
 
-        if (!_finishedJobs.empty())
+        while (!_finishedJobs.empty())
         {
             Job& job = _finishedJobs.front();
-            removeChild(job._node.get());
 
             // If the job didn't write any fragments, return a NULL image.
-            if (job._fragmentsWritten > 0)
-                job._imagePromise.resolve(job._image.get());
-            else
-                job._imagePromise.resolve(0L);
+            if (job._image.valid())
+            {
+                if (job._fragmentsWritten > 0)
+                    job._imagePromise.resolve(job._image.get());
+                else
+                    job._imagePromise.resolve(0L);
+            }
 
             _finishedJobs.pop(); 
-            detach(osg::Camera::COLOR_BUFFER);
-            dirtyAttachmentMap();
         }
 
-        if (!_pendingJobs.empty() && _readbackJobs.empty() && _finishedJobs.empty())
+        // The last job has drawn, so its node can go.
+        if (_readbackJobs.empty() && getNumChildren() > 0)
+        {
+            removeChildren(0, getNumChildren());
+        }
+
+        if (!_pendingJobs.empty() && _readbackJobs.empty())
         {
             Job& job = _pendingJobs.front();
 
@@ -251,16 +263,46 @@ TileRasterizer::traverse(osg::NodeVisitor& nv)
             {
                 // Setup the viewport and attach to the new texture
                 setViewport(0, 0, job._texture->getTextureWidth(), job._texture->getTextureHeight());
-                attach(COLOR_BUFFER, job._texture.get(), 0u, 0u, /*mipmap=*/false);
-                dirtyAttachmentMap();
+                if (_attached != job._texture.get())
+                {
+                    detach(COLOR_BUFFER);
+                    attach(COLOR_BUFFER, job._texture.get(), 0u, 0u, /*mipmap=*/false);
+                    dirtyAttachmentMap();
+                    _attached = job._texture.get();
+                    _attachedReadback = 0L;
+                }
             }
 
-            // Job includes an image to populate, so use the built-in FBO target texture:
+            // Job includes an image to populate, so render to the pooled target
+            // of that size and read it back into the job's image:
             else if (job._image.valid())
             {
-                setViewport(0, 0, job._image->s(), job._image->t());
-                attach(COLOR_BUFFER, job._image.get(), 0u, 0u);
-                dirtyAttachmentMap();
+                unsigned size = job._image->s();
+                Target& target = _targets[size];
+                if (!target._texture.valid())
+                {
+                    target._texture = new osg::Texture2D();
+                    target._texture->setTextureSize(size, size);
+                    target._texture->setInternalFormat(GL_RGBA8);
+                    target._texture->setSourceFormat(GL_RGBA);
+                    target._texture->setSourceType(GL_UNSIGNED_BYTE);
+                    target._texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+                    target._texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+
+                    target._readback = new ReadbackImage();
+                    target._readback->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+                }
+
+                setViewport(0, 0, size, size);
+                if (_attached != target._texture.get())
+                {
+                    detach(COLOR_BUFFER);
+                    attach(COLOR_BUFFER, target._texture.get(), 0u, 0u, /*mipmap=*/false);
+                    getBufferAttachmentMap()[COLOR_BUFFER]._image = target._readback.get();
+                    dirtyAttachmentMap();
+                    _attached = target._texture.get();
+                    _attachedReadback = target._readback.get();
+                }
             }
 
             // Add the node to the scene graph so it'll get rendered.
@@ -287,31 +329,128 @@ TileRasterizer::traverse(osg::NodeVisitor& nv)
     }
 }
 
+bool
+TileRasterizer::asyncReadbackSupported(osg::GLExtensions* ext) const
+{
+    return
+        ext->glGenBuffers &&
+        ext->glBufferData &&
+        ext->glMapBufferRange &&
+        ext->glFenceSync &&
+        ext->glClientWaitSync &&
+        ext->glDeleteSync;
+}
+
+GLuint
+TileRasterizer::acquirePBO(osg::GLExtensions* ext, unsigned size) const
+{
+    for (std::vector<PBO>::iterator i = _pbos.begin(); i != _pbos.end(); ++i)
+    {
+        if (i->_size == size)
+        {
+            GLuint handle = i->_handle;
+            _pbos.erase(i);
+            return handle;
+        }
+    }
+
+    GLuint handle = 0u;
+    ext->glGenBuffers(1, &handle);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, handle);
+    ext->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, size, 0L, GL_STREAM_READ_ARB);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    return handle;
+}
+
+void
+TileRasterizer::releasePBO(GLuint handle, unsigned size) const
+{
+    PBO pbo;
+    pbo._handle = handle;
+    pbo._size = size;
+    _pbos.push_back(pbo);
+}
+
+void
+TileRasterizer::transfer(osg::GLExtensions* ext) const
+{
+    // Copy out every readback the GPU has finished, in order.
+    while (!_transferJobs.empty())
+    {
+        Job& job = _transferJobs.front();
+
+        GLenum result = ext->glClientWaitSync(job._fence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            break;
+
+        ext->glDeleteSync(job._fence);
+        job._fence = 0L;
+
+        ext->glGetQueryObjectuiv(job._query, GL_QUERY_RESULT, &job._fragmentsWritten);
+        ext->glDeleteQueries(1, &job._query);
+        job._query = 0u;
+
+        unsigned size = job._image->getTotalSizeInBytes();
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, job._pbo);
+        const void* src = ext->glMapBufferRange(GL_PIXEL_PACK_BUFFER_ARB, 0, size, GL_MAP_READ_BIT);
+        if (src)
+        {
+            ::memcpy(job._image->data(), src, size);
+            ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+        }
+        else
+        {
+            job._fragmentsWritten = 0u;
+        }
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+        releasePBO(job._pbo, size);
+        job._pbo = 0u;
+
+        _finishedJobs.push(job);
+        _transferJobs.pop();
+    }
+}
+
 void
 TileRasterizer::preDraw(osg::RenderInfo& ri) const
 {
-    if (!_readbackJobs.empty())
+    if (!_readbackJobs.empty() || !_transferJobs.empty())
     {
         Threading::ScopedMutexLock lock(_mutex);
 
+        osg::GLExtensions* ext = osg::GLExtensions::Get(ri.getContextID(), true);
+
+        if (!_transferJobs.empty())
+        {
+            ri.getState()->unbindPixelBufferObject();
+            transfer(ext);
+        }
+
+        if (_attachedReadback)
+        {
+            _attachedReadback->_ri = &ri;
+            _attachedReadback->_pbo = 0u;
+            _attachedReadback->_target = 0L;
+        }
+
         if (!_readbackJobs.empty()) // double check!
         {
             Job& job = _readbackJobs.front();
-            if (job._image.valid())
+            if (job._image.valid() && _attachedReadback)
             {
-                job._image.get()->_ri = &ri;
-
-                // allocate a query on demand for this GC:
-                osg::GLExtensions* ext = osg::GLExtensions::Get(ri.getContextID(),true);
-                GLuint& query = _samplesQuery[ri.getContextID()];
-                if (query == INT_MAX)
+                if (asyncReadbackSupported(ext))
                 {
-                    ext->glGenQueries(1, &query);
+                    job._pbo = acquirePBO(ext, job._image->getTotalSizeInBytes());
                 }
 
+                _attachedReadback->_pbo = job._pbo;
+                _attachedReadback->_target = job._image.get();
+
                 // initiate a query for samples passing the fragment shader
                 // to see whether we drew anything.
-                ext->glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+                ext->glGenQueries(1, &job._query);
+                ext->glBeginQuery(GL_ANY_SAMPLES_PASSED, job._query);
             }
         }
     }
@@ -327,19 +466,40 @@ TileRasterizer::postDraw(osg::RenderInfo& ri) const
         if (!_readbackJobs.empty()) // double check!
         {
             Job& job = _readbackJobs.front();
+            osg::GLExtensions* ext = osg::GLExtensions::Get(ri.getContextID(), true);
 
-            if (job._image.valid())
+            if (job._query != 0u)
             {
-                // get the results of the query and store the
-                // # of fragments generated in the job.
-                osg::GLExtensions* ext = osg::GLExtensions::Get(ri.getContextID(), true);
-                GLuint query = _samplesQuery[ri.getContextID()];
                 ext->glEndQuery(GL_ANY_SAMPLES_PASSED);
-                ext->glGetQueryObjectuiv(query, GL_QUERY_RESULT, &job._fragmentsWritten);
             }
 
-            _finishedJobs.push(job);
+            if (job._pbo != 0u)
+            {
+                // readPixels already queued the copy; fence it and pick it
+                // up in a later frame.
+                job._fence = ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                _transferJobs.push(job);
+            }
+            else
+            {
+                if (job._query != 0u)
+                {
+                    // get the results of the query and store the
+                    // # of fragments generated in the job.
+                    ext->glGetQueryObjectuiv(job._query, GL_QUERY_RESULT, &job._fragmentsWritten);
+                    ext->glDeleteQueries(1, &job._query);
+                    job._query = 0u;
+                }
+                _finishedJobs.push(job);
+            }
+
             _readbackJobs.pop();
         }
+
+        if (_attachedReadback)
+        {
+            _attachedReadback->_pbo = 0u;
+            _attachedReadback->_target = 0L;
+        }
     }
 }
@@ -19,6 +19,10 @@
 #include <osgEarth/TileVisitor>
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <osg/Timer>
+#include <cstdio>
 
 #if OSG_VERSION_GREATER_OR_EQUAL(3,5,10)
 #include <osg/os_utils>
@@ -62,6 +66,21 @@ void TileVisitor::addExtent( const GeoExtent& extent )
 bool TileVisitor::intersects( const GeoExtent& extent )
 {    
     if ( _extents.empty()) return true;
+
+    // fast path for keys in the profile
+    else if (_profile.valid() && 
+             _profileExtents.size() == _extents.size() &&
+             _profile->getSRS()->isHorizEquivalentTo(extent.getSRS()))
+    {
+        for (unsigned int i = 0; i < _profileExtents.size(); ++i)
+        {
+            if (_profileExtents[i].intersects( extent, false ))
+            {
+                return true;
+            }
+        }
+    }
+
     else
     {
         for (unsigned int i = 0; i < _extents.size(); ++i)
@@ -92,6 +111,8 @@ void TileVisitor::run( const Profile* mapProfile )
     
     // Reset the progress in case this visitor has been ran before.
     resetProgress();
+
+    prepareExtents();
     
     estimate();
 
@@ -105,6 +126,19 @@ void TileVisitor::run( const Profile* mapProfile )
     }
 }
 
+void TileVisitor::prepareExtents()
+{
+    _profileExtents.clear();
+    if (!_profile.valid())
+        return;
+
+    for (unsigned int i = 0; i < _extents.size(); ++i)
+    {
+        // an extent that falls outside the profile stays invalid and matches nothing.
+        _profileExtents.push_back( _profile->clampAndTransformExtent( _extents[i] ) );
+    }
+}
+
 void TileVisitor::estimate()
 {
     //Estimate the number of tiles    
@@ -120,6 +154,21 @@ void TileVisitor::estimate()
 }
 
 void TileVisitor::processKey( const TileKey& key )
+{
+    if (_extents.empty())
+    {
+        processKey( key, 0L );
+    }
+    else
+    {
+        std::vector<unsigned> candidates;
+        for (unsigned int i = 0; i < _profileExtents.size(); ++i)
+            candidates.push_back(i);
+        processKey( key, &candidates );
+    }
+}
+
+void TileVisitor::processKey( const TileKey& key, const std::vector<unsigned>* candidates )
 {        
     // If we've been cancelled then just return.
     if (_progress && _progress->isCanceled())
@@ -137,10 +186,35 @@ void TileVisitor::processKey( const TileKey& key )
         return;
     }    
 
+    // Narrow the candidate extents to the ones that intersect this key; the
+    // children only need to test those, and none at all once a key lies
+    // entirely inside one extent. Subtrees without any data are never visited.
+    std::vector<unsigned> narrowed;
+    const std::vector<unsigned>* childCandidates = 0L;
+    bool hit = true;
+
+    if (candidates)
+    {
+        const GeoExtent& keyExtent = key.getExtent();
+        bool contained = false;
+        for (unsigned int i = 0; i < candidates->size() && !contained; ++i)
+        {
+            const GeoExtent& extent = _profileExtents[(*candidates)[i]];
+            if (extent.intersects( keyExtent, false ))
+            {
+                narrowed.push_back( (*candidates)[i] );
+                contained = extent.contains( keyExtent );
+            }
+        }
+
+        hit = !narrowed.empty();
+        childCandidates = contained ? 0L : &narrowed;
+    }
+
     bool traverseChildren = false;
 
     // If the key intersects the extent attempt to traverse
-    if (intersects( key.getExtent() ))
+    if (hit)
     {
         // If the lod is less than the min level don't do anything but do traverse the children.
         if (lod < _minLevel)
@@ -154,13 +228,14 @@ void TileVisitor::processKey( const TileKey& key )
         }
     }
 
-    // Traverse the children
+    // Traverse the children in Z (Morton) order, so that the keys of each
+    // subtree are emitted together.
     if (traverseChildren && lod < _maxLevel)
     {
         for (unsigned int i = 0; i < 4; i++)
         {
             TileKey k = key.createChildKey(i);
-            processKey( k );
+            processKey( k, childCandidates );
         }                                
     }       
 }
@@ -255,25 +330,23 @@ void MultithreadedTileVisitor::setNumThreads( unsigned int numThreads)
 
 void MultithreadedTileVisitor::run(const Profile* mapProfile)
 {                   
-    // Start up the task service
+    // Start up the job arena
     OE_INFO << "Starting " << _numThreads << std::endl;
-    _taskService = new TaskService( "MTTileHandler", _numThreads, 1000 );
+    _arena = new JobArena( "oe.mttilehandler", _numThreads );
+    _arena->setMaxPending( 1000 );
 
     // Produce the tiles
     TileVisitor::run( mapProfile );
 
-    // Send a poison pill to kill all the threads
-    _taskService->add( new PoisonPill() );
-
-    OE_INFO << "Waiting on threads to complete" << _taskService->getNumRequests() << " tasks remaining" << std::endl;
+    OE_INFO << "Waiting on threads to complete" << _arena->getNumPending() << " tasks remaining" << std::endl;
 
     // Wait for everything to finish, checking for cancellation while we wait so we can kill all the existing tasks.
-    while (_taskService->areThreadsRunning())
+    while (!_arena->isIdle())
     {
         OpenThreads::Thread::microSleep(10000);
         if (_progress && _progress->isCanceled())
         {            
-            _taskService->cancelAll();
+            _arena->cancelAll();
         }
     }
     OE_INFO << "All threads have completed" << std::endl;
@@ -281,8 +354,8 @@ void MultithreadedTileVisitor::run(const Profile* mapProfile)
 
 bool MultithreadedTileVisitor::handleTile( const TileKey& key )        
 {    
-    // Add the tile to the task queue.
-    _taskService->add( new HandleTileTask(_tileHandler.get(), this, key ) );
+    // Add the tile to the job queue.
+    _arena->dispatch( new HandleTileTask(_tileHandler.get(), this, key ) );
     return true;
 }
 
@@ -513,3 +586,422 @@ void TileKeyListVisitor::run(const Profile* mapProfile)
         }
     }
 }
+
+/*****************************************************************************************/
+
+#undef  LC
+#define LC "[ParallelTileVisitor] "
+
+struct ParallelTileVisitor::Subtree : public osg::Referenced
+{
+    TileKey _key;
+    OpenThreads::Atomic _pending;
+};
+
+struct ParallelTileVisitor::Task
+{
+    TileKey _key;
+
+    // the checkpoint subtree this key is in, if any
+    osg::ref_ptr<Subtree> _subtree;
+};
+
+struct ParallelTileVisitor::Worker : public OpenThreads::Thread
+{
+    ParallelTileVisitor* _visitor;
+    unsigned int _index;
+    std::deque<Task> _queue;
+    Threading::Mutex _mutex;
+
+    void run()
+    {
+        Task task;
+        while (true)
+        {
+            if (_visitor->take(_index, task))
+            {
+                _visitor->process(_index, task);
+                task._subtree = 0L;
+            }
+            else if (_visitor->_outstanding == 0)
+            {
+                break;
+            }
+            else
+            {
+                OpenThreads::Thread::microSleep(1000);
+            }
+        }
+    }
+};
+
+ParallelTileVisitor::ParallelTileVisitor():
+_numThreads( OpenThreads::GetNumberOfProcessors() ),
+_elapsed( 0.0 )
+{
+    // see MultithreadedTileVisitor
+    osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper( "osg::Image" );
+}
+
+ParallelTileVisitor::ParallelTileVisitor( TileHandler* handler ):
+TileVisitor( handler ),
+_numThreads( OpenThreads::GetNumberOfProcessors() ),
+_elapsed( 0.0 )
+{
+    osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper( "osg::Image" );
+}
+
+unsigned int ParallelTileVisitor::getNumThreads() const
+{
+    return _numThreads;
+}
+
+void ParallelTileVisitor::setNumThreads( unsigned int numThreads )
+{
+    _numThreads = osg::maximum(numThreads, 1u);
+}
+
+void ParallelTileVisitor::setCheckpointLevel( unsigned int level )
+{
+    _checkpointLevel = level;
+}
+
+void ParallelTileVisitor::setJournal( const std::string& filename )
+{
+    _journalFile = filename;
+}
+
+const std::string& ParallelTileVisitor::getJournal() const
+{
+    return _journalFile;
+}
+
+void ParallelTileVisitor::setCoordinationPath( const std::string& path, const std::string& workerName )
+{
+    _coordinationPath = path;
+    _workerName = workerName;
+}
+
+const std::string& ParallelTileVisitor::getCoordinationPath() const
+{
+    return _coordinationPath;
+}
+
+unsigned int ParallelTileVisitor::getNumTilesHandled() const
+{
+    return _handled;
+}
+
+double ParallelTileVisitor::getTilesPerSecond() const
+{
+    return _elapsed > 0.0 ? (double)(unsigned)_handled / _elapsed : 0.0;
+}
+
+unsigned int ParallelTileVisitor::getCheckpointLevel() const
+{
+    unsigned int level =
+        _checkpointLevel.isSet() ? _checkpointLevel.get() :
+        osg::maximum(_minLevel, _maxLevel > 8u ? _maxLevel - 8u : 0u);
+
+    return osg::minimum(level, _maxLevel);
+}
+
+void ParallelTileVisitor::loadJournal( const std::string& filename )
+{
+    std::ifstream in( filename.c_str(), std::ios::in );
+
+    // A line is "lod, x, y, ok". The last line may be cut short if the
+    // process died while writing it, so anything else doesn't count.
+    std::string line;
+    while (getline(in, line))
+    {
+        std::vector< std::string > parts;
+        StringTokenizer(line, parts, ",");
+
+        if (parts.size() == 4 && parts[3] == "ok")
+        {
+            _completed.insert( TileKey(
+                as<unsigned int>(parts[0], 0u),
+                as<unsigned int>(parts[1], 0u),
+                as<unsigned int>(parts[2], 0u),
+                _profile.get() ) );
+        }
+    }
+}
+
+void ParallelTileVisitor::openJournal()
+{
+    std::string filename = _journalFile;
+
+    if (!_coordinationPath.empty())
+    {
+        makeDirectory( _coordinationPath );
+
+        // Load the journals of all the workers, not just our own.
+        osgDB::DirectoryContents files = osgDB::getDirectoryContents( _coordinationPath );
+        for (unsigned int i = 0; i < files.size(); ++i)
+        {
+            if (osgDB::getLowerCaseFileExtension(files[i]) == "journal")
+            {
+                loadJournal( osgDB::concatPaths(_coordinationPath, files[i]) );
+            }
+        }
+
+        filename = osgDB::concatPaths(_coordinationPath, _workerName + ".journal");
+    }
+    else if (!filename.empty())
+    {
+        loadJournal( filename );
+    }
+
+    if (!filename.empty())
+    {
+        makeDirectoryForFile( filename );
+        _journal.open( filename.c_str(), std::ios::out | std::ios::app );
+        if (!_journal.is_open())
+        {
+            OE_WARN << LC << "Failed to open journal " << filename << "; this run cannot be resumed" << std::endl;
+        }
+    }
+}
+
+bool ParallelTileVisitor::claim( const TileKey& key )
+{
+    if (_coordinationPath.empty())
+        return true;
+
+    std::stringstream buf;
+    buf << "claims/" << key.getLevelOfDetail() << "/" << key.getTileX() << "/" << key.getTileY();
+    std::string filename = osgDB::concatPaths(_coordinationPath, buf.str());
+
+    makeDirectoryForFile( filename );
+
+    // Creating the file is atomic, even on network file systems, so only
+    // one worker can win.
+    FILE* file = fopen( filename.c_str(), "wx" );
+    if (file)
+    {
+        fputs( _workerName.c_str(), file );
+        fclose( file );
+        return true;
+    }
+
+    // Another worker has it - unless it was us in an earlier run that
+    // stopped before finishing the subtree.
+    std::string owner;
+    std::ifstream in( filename.c_str(), std::ios::in );
+    getline( in, owner );
+    return owner == _workerName;
+}
+
+void ParallelTileVisitor::complete( Subtree* subtree )
+{
+    Threading::ScopedMutexLock lock( _journalMutex );
+    if (_journal.is_open())
+    {
+        const TileKey& key = subtree->_key;
+        _journal << key.getLevelOfDetail() << ", " << key.getTileX() << ", " << key.getTileY() << ", ok" << std::endl;
+    }
+}
+
+void ParallelTileVisitor::push( unsigned int worker, const Task& task )
+{
+    ++_outstanding;
+    Threading::ScopedMutexLock lock( _workers[worker]->_mutex );
+    _workers[worker]->_queue.push_back( task );
+}
+
+bool ParallelTileVisitor::take( unsigned int worker, Task& task )
+{
+    // Our own newest key first, to go depth first and stay local...
+    {
+        Worker* w = _workers[worker];
+        Threading::ScopedMutexLock lock( w->_mutex );
+        if (!w->_queue.empty())
+        {
+            task = w->_queue.back();
+            w->_queue.pop_back();
+            return true;
+        }
+    }
+
+    // ...otherwise steal another worker's oldest key, which is the
+    // biggest piece of work it has.
+    for (unsigned int i = 1; i < _workers.size(); ++i)
+    {
+        Worker* w = _workers[(worker + i) % _workers.size()];
+        Threading::ScopedMutexLock lock( w->_mutex );
+        if (!w->_queue.empty())
+        {
+            task = w->_queue.front();
+            w->_queue.pop_front();
+            ++_steals;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ParallelTileVisitor::finish( Subtree* subtree, unsigned int count )
+{
+    if (subtree)
+    {
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            if (--subtree->_pending == 0)
+            {
+                complete( subtree );
+            }
+        }
+    }
+    --_outstanding;
+}
+
+void ParallelTileVisitor::process( unsigned int worker, Task& task )
+{
+    // Drop everything when canceled. The open subtrees never finish,
+    // so they stay out of the journal.
+    if (_progress && _progress->isCanceled())
+    {
+        --_outstanding;
+        return;
+    }
+
+    const TileKey& key = task._key;
+    unsigned int lod = key.getLevelOfDetail();
+    osg::ref_ptr<Subtree> subtree = task._subtree;
+
+    if (!subtree.valid() && lod == getCheckpointLevel())
+    {
+        if (_completed.find(key) != _completed.end() || !claim(key))
+        {
+            --_outstanding;
+            return;
+        }
+
+        subtree = new Subtree();
+        subtree->_key = key;
+        subtree->_pending = 1;
+    }
+
+    bool traverseChildren = false;
+
+    // same rules as TileVisitor::processKey
+    if (!_tileHandler.valid() || _tileHandler->hasData(key))
+    {
+        if (intersects( key.getExtent() ))
+        {
+            if (lod < _minLevel)
+            {
+                traverseChildren = true;
+            }
+            else
+            {
+                traverseChildren = handleTile( key );
+                ++_handled;
+            }
+        }
+    }
+
+    if (traverseChildren && lod < _maxLevel)
+    {
+        if (subtree.valid())
+        {
+            for (unsigned int i = 0; i < 4; ++i)
+                ++subtree->_pending;
+        }
+
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            Task child;
+            child._key = key.createChildKey(3 - i);
+            child._subtree = subtree;
+            push( worker, child );
+        }
+    }
+
+    finish( subtree.get(), 1 );
+}
+
+void ParallelTileVisitor::run( const Profile* mapProfile )
+{
+    _profile = mapProfile;
+
+    resetProgress();
+
+    prepareExtents();
+    estimate();
+
+    _handled.exchange( 0 );
+    _steals.exchange( 0 );
+    _outstanding.exchange( 0 );
+    _completed.clear();
+
+    openJournal();
+
+    if (!_completed.empty())
+    {
+        OE_INFO << LC << "Resuming; skipping " << _completed.size() << " completed subtrees" << std::endl;
+    }
+
+    for (unsigned int i = 0; i < _numThreads; ++i)
+    {
+        Worker* worker = new Worker();
+        worker->_visitor = this;
+        worker->_index = i;
+        _workers.push_back( worker );
+    }
+
+    // Deal the root keys out to the workers; they'll spread from there.
+    std::vector<TileKey> keys;
+    mapProfile->getRootKeys(keys);
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        Task task;
+        task._key = keys[i];
+        push( i % _workers.size(), task );
+    }
+
+    OE_INFO << LC << "Starting " << _workers.size() << " threads, checkpoint level " << getCheckpointLevel() << std::endl;
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    osg::Timer_t lastReport = start;
+
+    for (unsigned int i = 0; i < _workers.size(); ++i)
+    {
+        _workers[i]->start();
+    }
+
+    // Workers quit when nothing is queued or running.
+    while (_outstanding != 0)
+    {
+        OpenThreads::Thread::microSleep(100000);
+
+        osg::Timer_t now = osg::Timer::instance()->tick();
+        if (osg::Timer::instance()->delta_s(lastReport, now) >= 10.0)
+        {
+            _elapsed = osg::Timer::instance()->delta_s(start, now);
+            OE_INFO << LC << (unsigned)_handled << " tiles, " << getTilesPerSecond() << " tiles/sec" << std::endl;
+            lastReport = now;
+        }
+    }
+
+    _elapsed = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    for (unsigned int i = 0; i < _workers.size(); ++i)
+    {
+        _workers[i]->join();
+        delete _workers[i];
+    }
+    _workers.clear();
+
+    {
+        Threading::ScopedMutexLock lock( _journalMutex );
+        _journal.close();
+        _journal.clear();
+    }
+
+    OE_INFO << LC << "Handled " << (unsigned)_handled << " tiles in " << _elapsed << " s ("
+        << getTilesPerSecond() << " tiles/sec, " << (unsigned)_steals << " steals)" << std::endl;
+}
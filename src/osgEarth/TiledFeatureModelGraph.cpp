@@ -45,7 +45,7 @@ TiledFeatureModelGraph::setFilterChain(FeatureFilterChain* chain)
 FeatureCursor*
 TiledFeatureModelGraph::createCursor(FeatureSource* fs, FilterContext& cx, const Query& query, ProgressCallback* progress) const
 {
-    FeatureCursor* cursor = fs->createFeatureCursor(query, progress);
+    FeatureCursor* cursor = fs->createTileCursor(query, progress);
     if (_filterChain.valid())
     {
         cursor = new FilteredFeatureCursor(cursor, _filterChain.get(), cx);
@@ -69,7 +69,7 @@ osg::Node* TiledFeatureModelGraph::createNode(const TileKey& key, ProgressCallba
 
     GeomFeatureNodeFactory factory(options);
 
-    osg::ref_ptr< FeatureCursor > cursor = _features->createFeatureCursor(query, 0);
+    osg::ref_ptr< FeatureCursor > cursor = _features->createTileCursor(query, 0);
     osg::ref_ptr<osg::Node> node = new osg::Group;
     if (cursor)
     {
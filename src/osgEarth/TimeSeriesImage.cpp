@@ -0,0 +1,242 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/TimeSeriesImage>
+#include <osgEarth/JobArena>
+#include <osgEarth/Metrics>
+#include <osg/NodeVisitor>
+#include <osg/FrameStamp>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[TimeSeriesImage] "
+
+namespace
+{
+    // Loads one step in the background. Holds only an observer so that
+    // a tile paged out before the job runs does not load anything.
+    struct LoadStepJob : public TaskRequest
+    {
+        LoadStepJob(TimeSeriesImage* image, TimeSeriesImage::Source* source, const TileKey& key, unsigned step, float priority) :
+            TaskRequest(priority), _image(image), _source(source), _key(key), _step(step) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<TimeSeriesImage> image;
+            if (!_image.lock(image))
+                return;
+
+            osg::ref_ptr<osg::Image> result = _source->loadStep(_key, _step, progress);
+
+            if (result.valid())
+            {
+                image->setStep(_step, result.get());
+                Metrics::counter("timeseries.loaded")->add();
+            }
+            else
+            {
+                image->clearPending(_step);
+            }
+        }
+
+        osg::observer_ptr<TimeSeriesImage> _image;
+        osg::ref_ptr<TimeSeriesImage::Source> _source;
+        TileKey _key;
+        unsigned _step;
+    };
+}
+
+//........................................................................
+
+TimeSeriesImage::Source::Source() :
+_playing(0),
+_currentStep(0)
+{
+    //nop
+}
+
+//........................................................................
+
+TimeSeriesImage::TimeSeriesImage() :
+osg::ImageStream(),
+_secondsPerStep(1.0),
+_prefetchSteps(3u),
+_showing(-1)
+{
+    //nop
+}
+
+TimeSeriesImage::TimeSeriesImage(const TileKey& key,
+                                 unsigned numSteps,
+                                 double secondsPerStep,
+                                 Source* source) :
+osg::ImageStream(),
+_key(key),
+_secondsPerStep(secondsPerStep > 0.0 ? secondsPerStep : 1.0),
+_source(source),
+_prefetchSteps(3u),
+_steps(numSteps),
+_pending(numSteps, false),
+_showing(-1)
+{
+    setLoopingMode(LOOPING);
+    setLength(_secondsPerStep * (double)numSteps);
+}
+
+TimeSeriesImage::TimeSeriesImage(const TimeSeriesImage& rhs, const osg::CopyOp& copyop) :
+osg::ImageStream(rhs, copyop),
+_key(rhs._key),
+_secondsPerStep(rhs._secondsPerStep),
+_source(rhs._source),
+_prefetchSteps(rhs._prefetchSteps),
+_showing(rhs._showing)
+{
+    Threading::ScopedMutexLock lock(rhs._mutex);
+    _steps = rhs._steps;
+    _pending.assign(_steps.size(), false);
+}
+
+bool
+TimeSeriesImage::initialize(ProgressCallback* progress)
+{
+    if (!_source.valid() || _steps.empty())
+        return false;
+
+    unsigned step = _source->getCurrentStep() % _steps.size();
+
+    osg::ref_ptr<osg::Image> image = _source->loadStep(_key, step, progress);
+    if (!image.valid())
+        return false;
+
+    setStep(step, image.get());
+    show(step);
+    return true;
+}
+
+unsigned
+TimeSeriesImage::getNumStepsLoaded() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    unsigned count = 0u;
+    for (unsigned i = 0; i < _steps.size(); ++i)
+        if (_steps[i].valid())
+            ++count;
+    return count;
+}
+
+void
+TimeSeriesImage::setStep(unsigned step, osg::Image* image)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if (step < _steps.size())
+    {
+        _steps[step] = image;
+        _pending[step] = false;
+    }
+}
+
+void
+TimeSeriesImage::clearPending(unsigned step)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if (step < _pending.size())
+        _pending[step] = false;
+}
+
+void
+TimeSeriesImage::show(unsigned step)
+{
+    osg::ref_ptr<osg::Image> image;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        image = _steps[step].get();
+    }
+
+    // not here yet; keep showing the last step we had
+    if (!image.valid() || (int)step == _showing)
+        return;
+
+    // Point at the step's data rather than copying it; the step image
+    // stays resident, so the data outlives this reference.
+    setImage(
+        image->s(), image->t(), image->r(),
+        image->getInternalTextureFormat(),
+        image->getPixelFormat(),
+        image->getDataType(),
+        const_cast<unsigned char*>(image->data()),
+        osg::Image::NO_DELETE,
+        image->getPacking(),
+        image->getRowLength());
+
+    _showing = step;
+}
+
+void
+TimeSeriesImage::request(unsigned step, unsigned distance)
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        if (_steps[step].valid() || _pending[step])
+            return;
+        _pending[step] = true;
+    }
+
+    // Lower priorities run first: the nearest steps come before later
+    // ones across all tiles, and within a step, finer (closer) tiles
+    // come first.
+    float priority = (float)distance - (float)_key.getLOD() / 100.0f;
+
+    JobArena::get("oe.timeseries")->dispatch(
+        new LoadStepJob(this, _source.get(), _key, step, priority));
+}
+
+void
+TimeSeriesImage::update(osg::NodeVisitor* nv)
+{
+    if (!_source.valid() || _steps.empty())
+        return;
+
+    unsigned numSteps = _steps.size();
+    unsigned step;
+
+    if (_source->isPlaying() && nv && nv->getFrameStamp())
+    {
+        // All tiles read the same clock, so they stay in sync
+        double t = fmod(nv->getFrameStamp()->getSimulationTime(), getLength());
+        step = osg::clampBelow((unsigned)(t / _secondsPerStep), numSteps - 1u);
+        _source->setCurrentStep(step);
+    }
+    else
+    {
+        step = _source->getCurrentStep() % numSteps;
+    }
+
+    request(step, 0u);
+    show(step);
+
+    unsigned prefetch = osg::minimum(_prefetchSteps, numSteps - 1u);
+    for (unsigned i = 1; i <= prefetch; ++i)
+    {
+        request((step + i) % numSteps, i);
+    }
+}
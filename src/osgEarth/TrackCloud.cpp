@@ -0,0 +1,487 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/TrackCloud>
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/Shaders>
+#include <osgEarth/ShaderGenerator>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Lighting>
+#include <osgEarth/NodeUtils>
+#include <osg/Texture2DArray>
+#include <osg/BlendFunc>
+#include <osg/Depth>
+#include <osgText/String>
+#include <map>
+#include <cstring>
+
+#define LC "[TrackCloud] "
+
+using namespace osgEarth;
+
+namespace
+{
+    // glyph resolution to request from the font
+    const unsigned GLYPH_RESOLUTION = 32u;
+
+    // texture units
+    const int ICON_UNIT  = 0;
+    const int GLYPH_UNIT = 0;
+    const int TRACK_UNIT = 1;
+    const int GLYPHS_UNIT = 2;
+
+    // Every instance draws the same quad, centered on its track.
+    osg::Geometry* createPatternGeometry(unsigned instances)
+    {
+        osg::Vec3Array* pattern = new osg::Vec3Array();
+        pattern->push_back(osg::Vec3(-0.5f, -0.5f, 0.0f));
+        pattern->push_back(osg::Vec3( 0.5f, -0.5f, 0.0f));
+        pattern->push_back(osg::Vec3( 0.5f,  0.5f, 0.0f));
+        pattern->push_back(osg::Vec3(-0.5f, -0.5f, 0.0f));
+        pattern->push_back(osg::Vec3( 0.5f,  0.5f, 0.0f));
+        pattern->push_back(osg::Vec3(-0.5f,  0.5f, 0.0f));
+
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setUseDisplayList(false);
+        geom->setUseVertexBufferObjects(true);
+        geom->setDataVariance(osg::Object::DYNAMIC);
+        geom->setVertexArray(pattern);
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLES, 0, 6, instances));
+        return geom;
+    }
+
+    // Packs records into an RGBA32F texture buffer, reusing the buffer's
+    // image when the size has not changed.
+    void updateRecordBuffer(osg::TextureBuffer* tbo, const std::vector<osg::Vec4f>& records)
+    {
+        int count = osg::maximum((int)records.size(), 1);
+
+        osg::Image* image = tbo->getImage();
+        if (!image || image->s() != count)
+        {
+            image = new osg::Image();
+            image->allocateImage(count, 1, 1, GL_RGBA, GL_FLOAT);
+            image->setDataVariance(osg::Object::DYNAMIC);
+            tbo->setImage(image);
+            tbo->dirtyTextureObject();
+        }
+
+        if (!records.empty())
+            ::memcpy(image->data(), &records[0], records.size()*sizeof(osg::Vec4f));
+        else
+            ::memset(image->data(), 0, sizeof(osg::Vec4f));
+
+        image->dirty();
+    }
+
+    osg::TextureBuffer* createRecordBuffer()
+    {
+        osg::TextureBuffer* tbo = new osg::TextureBuffer();
+        tbo->setInternalFormat(GL_RGBA32F_ARB);
+        tbo->setUnRefImageDataAfterApply(false);
+        tbo->setDataVariance(osg::Object::DYNAMIC);
+        ShaderGenerator::setIgnoreHint(tbo, true);
+        return tbo;
+    }
+}
+
+//------------------------------------------------------------------------
+
+TrackCloud::TrackCloud(const SpatialReference* srs) :
+_srs(srs),
+_iconTextureSize(64u),
+_labelSize(14.0f),
+_labelOffset(20.0f, -5.0f),
+_tracksDirty(true),
+_iconsDirty(true),
+_labelsDirty(true)
+{
+    _font = osgText::Font::getDefaultFont();
+
+    _xform = new osg::MatrixTransform();
+    addChild(_xform.get());
+
+    osg::StateSet* stateSet = _xform->getOrCreateStateSet();
+    stateSet->setDataVariance(osg::Object::DYNAMIC);
+    stateSet->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+    stateSet->setMode(GL_BLEND, osg::StateAttribute::ON);
+    stateSet->setAttributeAndModes(new osg::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+    stateSet->setAttributeAndModes(new osg::Depth(osg::Depth::LEQUAL, 0.0, 1.0, false));
+    Lighting::set(stateSet, osg::StateAttribute::OFF);
+    ShaderGenerator::setIgnoreHint(_xform.get(), true);
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(stateSet);
+    vp->setName("TrackCloud");
+    Shaders pkg;
+    pkg.load(vp, pkg.TrackCloud);
+
+    _trackBuffer = createRecordBuffer();
+    stateSet->setTextureAttribute(TRACK_UNIT, _trackBuffer.get());
+    stateSet->getOrCreateUniform("oe_tc_tracks", osg::Uniform::SAMPLER_BUFFER)->set(TRACK_UNIT);
+
+    _anchor = stateSet->getOrCreateUniform("oe_tc_anchor", osg::Uniform::FLOAT_VEC3);
+    _anchor->set(osg::Vec3f(0,0,0));
+
+    _iconSize = stateSet->getOrCreateUniform("oe_tc_iconSize", osg::Uniform::FLOAT);
+    _iconSize->set(32.0f);
+
+    _labelColor = stateSet->getOrCreateUniform("oe_tc_labelColor", osg::Uniform::FLOAT_VEC4);
+    _labelColor->set(osg::Vec4f(1,1,1,1));
+
+    _iconGeom = createPatternGeometry(0u);
+    _iconGeode = new osg::Geode();
+    _iconGeode->addDrawable(_iconGeom.get());
+    _iconGeode->getOrCreateStateSet()->getOrCreateUniform("oe_tc_icons", osg::Uniform::SAMPLER_2D_ARRAY)->set(ICON_UNIT);
+    _xform->addChild(_iconGeode.get());
+
+    _labelGeode = new osg::Geode();
+    osg::StateSet* labelStateSet = _labelGeode->getOrCreateStateSet();
+    labelStateSet->setDefine("OE_TC_LABELS");
+#if defined(OSG_GL3_AVAILABLE) && !defined(OSG_GL2_AVAILABLE) && !defined(OSG_GL1_AVAILABLE)
+    labelStateSet->setDefine("OSGTEXT_GLYPH_ALPHA_FORMAT_IS_RED");
+#endif
+    labelStateSet->getOrCreateUniform("oe_tc_glyphTex", osg::Uniform::SAMPLER_2D)->set(GLYPH_UNIT);
+    labelStateSet->getOrCreateUniform("oe_tc_glyphs", osg::Uniform::SAMPLER_BUFFER)->set(GLYPHS_UNIT);
+    _xform->addChild(_labelGeode.get());
+
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+}
+
+unsigned
+TrackCloud::addIcon(const osg::Image* image)
+{
+    _iconImages.push_back(image);
+    _iconsDirty = true;
+    return _iconImages.size()-1;
+}
+
+void
+TrackCloud::setIconSize(float pixels)
+{
+    _iconSize->set(pixels);
+}
+
+void
+TrackCloud::setFont(osgText::Font* font)
+{
+    _font = font ? font : osgText::Font::getDefaultFont();
+    _labelsDirty = true;
+}
+
+void
+TrackCloud::setLabelSize(float pixels)
+{
+    _labelSize = pixels;
+    _labelsDirty = true;
+}
+
+void
+TrackCloud::setLabelColor(const osg::Vec4f& color)
+{
+    _labelColor->set(color);
+}
+
+void
+TrackCloud::setLabelOffset(const osg::Vec2f& pixels)
+{
+    _labelOffset = pixels;
+    _labelsDirty = true;
+}
+
+void
+TrackCloud::resize(unsigned count)
+{
+    _positions.resize(count);
+    _headings.resize(count, 0.0f);
+    _icons.resize(count, 0u);
+    _labels.resize(count);
+    _visible.resize(count, true);
+    _placed.resize(count, false);
+    _tracksDirty = true;
+    _labelsDirty = true;
+}
+
+void
+TrackCloud::setPosition(unsigned track, const GeoPoint& position)
+{
+    if (track < _positions.size())
+    {
+        GeoPoint p = _srs.valid() ? position.transform(_srs.get()) : position;
+        if (p.isValid() && p.toWorld(_positions[track]))
+        {
+            _placed[track] = true;
+            _tracksDirty = true;
+        }
+    }
+}
+
+void
+TrackCloud::setWorldPositions(unsigned first, const osg::Vec3d* world, unsigned count)
+{
+    for (unsigned i = 0; i < count && first + i < _positions.size(); ++i)
+    {
+        _positions[first + i] = world[i];
+        _placed[first + i] = true;
+    }
+    _tracksDirty = true;
+}
+
+void
+TrackCloud::setHeading(unsigned track, float degrees)
+{
+    if (track < _headings.size())
+    {
+        _headings[track] = degrees;
+        _tracksDirty = true;
+    }
+}
+
+void
+TrackCloud::setHeadings(unsigned first, const float* degrees, unsigned count)
+{
+    for (unsigned i = 0; i < count && first + i < _headings.size(); ++i)
+    {
+        _headings[first + i] = degrees[i];
+    }
+    _tracksDirty = true;
+}
+
+void
+TrackCloud::setIcon(unsigned track, unsigned icon)
+{
+    if (track < _icons.size())
+    {
+        _icons[track] = icon;
+        _tracksDirty = true;
+    }
+}
+
+void
+TrackCloud::setLabel(unsigned track, const std::string& text)
+{
+    if (track < _labels.size() && _labels[track] != text)
+    {
+        _labels[track] = text;
+        _labelsDirty = true;
+    }
+}
+
+void
+TrackCloud::setVisible(unsigned track, bool value)
+{
+    if (track < _visible.size())
+    {
+        _visible[track] = value;
+        _tracksDirty = true;
+    }
+}
+
+void
+TrackCloud::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        sync();
+    }
+    osg::Group::traverse(nv);
+}
+
+void
+TrackCloud::sync()
+{
+    if (_iconsDirty)
+    {
+        syncIcons();
+        _iconsDirty = false;
+    }
+
+    if (_tracksDirty)
+    {
+        syncTracks();
+        _tracksDirty = false;
+    }
+
+    if (_labelsDirty)
+    {
+        syncLabels();
+        _labelsDirty = false;
+    }
+}
+
+void
+TrackCloud::syncTracks()
+{
+    // Positions are stored relative to the center of the cloud so they
+    // keep their precision as floats.
+    osg::BoundingBoxd worldBounds;
+    for (unsigned i = 0; i < _positions.size(); ++i)
+    {
+        if (_placed[i])
+            worldBounds.expandBy(_positions[i]);
+    }
+
+    osg::Vec3d anchor = worldBounds.valid() ? worldBounds.center() : osg::Vec3d(0,0,0);
+    _xform->setMatrix(osg::Matrix::translate(anchor));
+    _anchor->set(osg::Vec3f(anchor));
+
+    std::vector<osg::Vec4f> records;
+    records.reserve(2 * _positions.size());
+    for (unsigned i = 0; i < _positions.size(); ++i)
+    {
+        osg::Vec3f local(_positions[i] - anchor);
+        records.push_back(osg::Vec4f(local, osg::DegreesToRadians(_headings[i])));
+        records.push_back(osg::Vec4f((float)_icons[i], _visible[i] && _placed[i] ? 1.0f : 0.0f, 0.0f, 0.0f));
+    }
+    updateRecordBuffer(_trackBuffer.get(), records);
+
+    static_cast<osg::DrawArrays*>(_iconGeom->getPrimitiveSet(0))->setNumInstances(_positions.size());
+    _iconGeom->getPrimitiveSet(0)->dirty();
+
+    // the pattern says nothing about where the tracks are
+    _localBounds.init();
+    if (worldBounds.valid())
+    {
+        _localBounds.expandBy(osg::Vec3f(worldBounds._min - anchor));
+        _localBounds.expandBy(osg::Vec3f(worldBounds._max - anchor));
+    }
+
+    _iconGeom->setInitialBound(_localBounds);
+    _iconGeom->dirtyBound();
+    for (unsigned i = 0; i < _labelGeode->getNumDrawables(); ++i)
+    {
+        _labelGeode->getDrawable(i)->setInitialBound(_localBounds);
+        _labelGeode->getDrawable(i)->dirtyBound();
+    }
+}
+
+void
+TrackCloud::syncIcons()
+{
+    unsigned size = osg::maximum(_iconTextureSize, 1u);
+    unsigned layers = osg::maximum((unsigned)_iconImages.size(), 1u);
+
+    osg::Texture2DArray* tex = new osg::Texture2DArray();
+    tex->setTextureSize(size, size, layers);
+    tex->setInternalFormat(GL_RGBA8);
+    tex->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR_MIPMAP_LINEAR);
+    tex->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    tex->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    tex->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+
+    for (unsigned i = 0; i < layers; ++i)
+    {
+        osg::ref_ptr<osg::Image> layer;
+        const osg::Image* icon = i < _iconImages.size() ? _iconImages[i].get() : 0L;
+        if (icon)
+        {
+            osg::ref_ptr<osg::Image> rgba = ImageUtils::convertToRGBA8(icon);
+            if (rgba.valid())
+                ImageUtils::resizeImage(rgba.get(), size, size, layer);
+        }
+
+        if (!layer.valid())
+        {
+            // keep the layer count; a blank icon draws nothing
+            layer = new osg::Image();
+            layer->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+            ::memset(layer->data(), 0, layer->getTotalSizeInBytes());
+            if (icon)
+            {
+                OE_WARN << LC << "Failed to convert icon " << i << std::endl;
+            }
+        }
+
+        tex->setImage(i, layer.get());
+    }
+
+    _iconGeode->getOrCreateStateSet()->setTextureAttribute(ICON_UNIT, tex);
+}
+
+void
+TrackCloud::syncLabels()
+{
+    _labelGeode->removeDrawables(0, _labelGeode->getNumDrawables());
+
+    if (!_font.valid())
+        return;
+
+    // glyph records, grouped by the glyph texture they sample
+    typedef std::map< osg::ref_ptr<osgText::GlyphTexture>, std::vector<osg::Vec4f> > GlyphRecords;
+    GlyphRecords glyphs;
+
+    osgText::FontResolution res(GLYPH_RESOLUTION, GLYPH_RESOLUTION);
+
+    for (unsigned track = 0; track < _labels.size(); ++track)
+    {
+        if (_labels[track].empty())
+            continue;
+
+        osgText::String text(_labels[track], osgText::String::ENCODING_UTF8);
+
+        // glyph metrics are in units of the character height
+        float pen = 0.0f;
+        for (osgText::String::const_iterator c = text.begin(); c != text.end(); ++c)
+        {
+            osgText::Glyph* glyph = _font->getGlyph(res, *c);
+            if (!glyph)
+                continue;
+
+            osgText::Glyph::TextureInfo* info = glyph->getOrCreateTextureInfo(osgText::GREYSCALE);
+            if (info && info->texture)
+            {
+                const osg::Vec2& bearing = glyph->getHorizontalBearing();
+                float x0 = _labelOffset.x() + (pen + bearing.x()) * _labelSize;
+                float y0 = _labelOffset.y() + bearing.y() * _labelSize;
+                float x1 = x0 + glyph->getWidth() * _labelSize;
+                float y1 = y0 + glyph->getHeight() * _labelSize;
+
+                std::vector<osg::Vec4f>& records = glyphs[info->texture];
+                records.push_back(osg::Vec4f((float)track, x0, y0, 0.0f));
+                records.push_back(osg::Vec4f(x1, y1, 0.0f, 0.0f));
+                records.push_back(osg::Vec4f(
+                    info->minTexCoord.x(), info->minTexCoord.y(),
+                    info->maxTexCoord.x(), info->maxTexCoord.y()));
+            }
+
+            pen += glyph->getHorizontalAdvance();
+        }
+    }
+
+    for (GlyphRecords::iterator i = glyphs.begin(); i != glyphs.end(); ++i)
+    {
+        osg::Geometry* geom = createPatternGeometry(i->second.size() / 3);
+        geom->setInitialBound(_localBounds);
+
+        osg::TextureBuffer* tbo = createRecordBuffer();
+        updateRecordBuffer(tbo, i->second);
+
+        osg::StateSet* stateSet = geom->getOrCreateStateSet();
+        stateSet->setTextureAttribute(GLYPH_UNIT, i->first.get());
+        stateSet->setTextureAttribute(GLYPHS_UNIT, tbo);
+
+        _labelGeode->addDrawable(geom);
+    }
+}
+
+#endif // OSG 3.6+
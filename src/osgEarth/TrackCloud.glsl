@@ -0,0 +1,179 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#extension GL_ARB_draw_instanced: enable
+
+#pragma vp_name       TrackCloud model
+#pragma vp_entryPoint oe_tc_VS_model
+#pragma vp_location   vertex_model
+#pragma vp_order      0.0
+#pragma import_defines(OE_TC_LABELS)
+
+// Two texels per track: (position, heading), (icon layer, visible, 0, 0)
+uniform samplerBuffer oe_tc_tracks;
+
+#ifdef OE_TC_LABELS
+// Three texels per glyph: (track, x0, y0, 0), (x1, y1, 0, 0), (s0, t0, s1, t1)
+uniform samplerBuffer oe_tc_glyphs;
+#endif
+
+// world position of the model origin
+uniform vec3 oe_tc_anchor;
+
+// stage globals
+vec2 oe_tc_pattern;
+vec4 oe_tc_rect;
+vec3 oe_tc_north;
+float oe_tc_heading;
+float oe_tc_visible;
+
+out vec2 oe_tc_uv;
+flat out float oe_tc_layer;
+
+void oe_tc_VS_model(inout vec4 vertex)
+{
+    // The shared pattern is a unit quad centered on the origin.
+    oe_tc_pattern = vertex.xy;
+
+#ifdef OE_TC_LABELS
+    vec4 g0 = texelFetch(oe_tc_glyphs, 3*gl_InstanceID);
+    vec4 g1 = texelFetch(oe_tc_glyphs, 3*gl_InstanceID+1);
+    vec4 g2 = texelFetch(oe_tc_glyphs, 3*gl_InstanceID+2);
+    int track = int(g0.x);
+    oe_tc_rect = vec4(g0.yz, g1.xy);
+    oe_tc_uv = mix(g2.xy, g2.zw, oe_tc_pattern + 0.5);
+    oe_tc_layer = 0.0;
+#else
+    int track = gl_InstanceID;
+    oe_tc_uv = oe_tc_pattern + 0.5;
+#endif
+
+    vec4 t0 = texelFetch(oe_tc_tracks, 2*track);
+    vec4 t1 = texelFetch(oe_tc_tracks, 2*track+1);
+
+    vertex = vec4(t0.xyz, 1.0);
+    oe_tc_heading = t0.w;
+    oe_tc_visible = t1.y;
+#ifndef OE_TC_LABELS
+    oe_tc_layer = t1.x;
+#endif
+
+    // local north, for orienting the icon
+    vec3 up = normalize(t0.xyz + oe_tc_anchor);
+    vec3 north = vec3(0.0, 0.0, 1.0) - up*up.z;
+    oe_tc_north = dot(north, north) > 0.0 ? normalize(north) : vec3(1.0, 0.0, 0.0);
+}
+
+[break]
+
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_name       TrackCloud view
+#pragma vp_entryPoint oe_tc_VS_view
+#pragma vp_location   vertex_view
+#pragma vp_order      0.0
+
+// stage globals
+vec3 oe_tc_north;
+vec4 oe_tc_viewPos;
+vec3 oe_tc_viewNorth;
+
+void oe_tc_VS_view(inout vec4 vertex)
+{
+    oe_tc_viewPos = vertex;
+    oe_tc_viewNorth = mat3(gl_ModelViewMatrix) * oe_tc_north;
+}
+
+[break]
+
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_name       TrackCloud clip
+#pragma vp_entryPoint oe_tc_VS_clip
+#pragma vp_location   vertex_clip
+#pragma vp_order      0.0
+#pragma import_defines(OE_TC_LABELS)
+
+// Set by the InstallCameraUniform callback
+uniform vec3 oe_Camera;
+
+// icon size in pixels
+uniform float oe_tc_iconSize;
+
+// stage globals
+vec2 oe_tc_pattern;
+vec4 oe_tc_rect;
+float oe_tc_heading;
+float oe_tc_visible;
+vec4 oe_tc_viewPos;
+vec3 oe_tc_viewNorth;
+
+void oe_tc_VS_clip(inout vec4 clip)
+{
+    if (oe_tc_visible < 0.5)
+    {
+        // outside the view volume
+        clip = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    vec2 pixels;
+
+#ifdef OE_TC_LABELS
+    // glyph rectangle in pixels relative to the track
+    pixels = mix(oe_tc_rect.xy, oe_tc_rect.zw, oe_tc_pattern + 0.5);
+#else
+    // direction of north on the screen, from a point just north of the track
+    vec4 northClip = gl_ProjectionMatrix * (oe_tc_viewPos + vec4(oe_tc_viewNorth * (0.01 * max(-oe_tc_viewPos.z, 1.0)), 0.0));
+    vec2 north = (northClip.xy/northClip.w - clip.xy/clip.w) * oe_Camera.xy;
+    north = dot(north, north) > 0.0 ? normalize(north) : vec2(0.0, 1.0);
+    vec2 east = vec2(north.y, -north.x);
+
+    // heading is clockwise from north
+    vec2 forward = sin(oe_tc_heading)*east + cos(oe_tc_heading)*north;
+    vec2 right = vec2(forward.y, -forward.x);
+    pixels = (oe_tc_pattern.x*right + oe_tc_pattern.y*forward) * oe_tc_iconSize;
+#endif
+
+    clip.xy += pixels * 2.0 / oe_Camera.xy * clip.w;
+}
+
+[break]
+
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_name       TrackCloud FS
+#pragma vp_entryPoint oe_tc_FS
+#pragma vp_location   fragment_coloring
+#pragma vp_order      0.0
+#pragma import_defines(OE_TC_LABELS, OSGTEXT_GLYPH_ALPHA_FORMAT_IS_RED)
+
+#ifdef OE_TC_LABELS
+uniform sampler2D oe_tc_glyphTex;
+uniform vec4 oe_tc_labelColor;
+#else
+uniform sampler2DArray oe_tc_icons;
+#endif
+
+in vec2 oe_tc_uv;
+flat in float oe_tc_layer;
+
+void oe_tc_FS(inout vec4 color)
+{
+#ifdef OE_TC_LABELS
+  #ifdef OSGTEXT_GLYPH_ALPHA_FORMAT_IS_RED
+    float alpha = texture(oe_tc_glyphTex, oe_tc_uv).r;
+  #else
+    float alpha = texture(oe_tc_glyphTex, oe_tc_uv).a;
+  #endif
+    color = vec4(oe_tc_labelColor.rgb, oe_tc_labelColor.a * alpha);
+#else
+    color = texture(oe_tc_icons, vec3(oe_tc_uv, oe_tc_layer));
+#endif
+
+    if (color.a < 0.01)
+        discard;
+}
@@ -19,6 +19,7 @@
 #include <osgEarth/TransformFilter>
 #include <osgEarth/Feature>
 #include <osgEarth/FilterContext>
+#include <osgEarth/FeatureBatch>
 #include <osg/ClusterCullingCallback>
 
 #define LC "[TransformFilter] "
@@ -116,6 +117,84 @@ TransformFilter::push( Feature* input, FilterContext& context )
     return true;
 }
 
+FilterContext
+TransformFilter::push( FeatureBatch& batch, FilterContext& incx )
+{
+    _bbox = osg::BoundingBoxd();
+
+    bool needsSRSXform =
+        _outputSRS.valid() &&
+        ( ! incx.profile()->getSRS()->isEquivalentTo( _outputSRS.get() ) );
+
+    bool needsMatrixXform = !_mat.isIdentity();
+
+    std::vector<double>& x = batch.x();
+    std::vector<double>& y = batch.y();
+    std::vector<double>& z = batch.z();
+    unsigned numPoints = batch.getNumPoints();
+
+    if ( numPoints > 0 && needsSRSXform )
+    {
+        // one SRS transform for all points in the batch. The matrix goes
+        // on while filling the scratch array.
+        std::vector<osg::Vec3d> points( numPoints );
+        for( unsigned i=0; i<numPoints; ++i )
+            points[i].set( x[i], y[i], z[i] );
+
+        if ( needsMatrixXform )
+        {
+            for( unsigned i=0; i<numPoints; ++i )
+                points[i] = points[i] * _mat;
+        }
+
+        incx.profile()->getSRS()->transform( points, _outputSRS.get() );
+
+        for( unsigned i=0; i<numPoints; ++i )
+        {
+            x[i] = points[i].x(), y[i] = points[i].y(), z[i] = points[i].z();
+        }
+    }
+
+    else if ( needsMatrixXform )
+    {
+        for( unsigned i=0; i<numPoints; ++i )
+        {
+            osg::Vec3d p = osg::Vec3d( x[i], y[i], z[i] ) * _mat;
+            x[i] = p.x(), y[i] = p.y(), z[i] = p.z();
+        }
+    }
+
+    if ( _localize )
+    {
+        for( unsigned i=0; i<numPoints; ++i )
+            _bbox.expandBy( x[i], y[i], z[i] );
+    }
+
+    FilterContext outcx( incx );
+
+    if ( _outputSRS.valid() )
+    {
+        if ( incx.extent()->isValid() )
+            outcx.setProfile( new FeatureProfile( incx.extent()->transform( _outputSRS.get()) ) );
+        else
+            outcx.setProfile( new FeatureProfile( incx.profile()->getExtent().transform( _outputSRS.get()) ) );
+
+        batch.setSRS( _outputSRS.get() );
+    }
+
+    // shift the data to the centroid, same as the FeatureList version.
+    if ( _bbox.valid() && _localize )
+    {
+        osg::Vec3d center = _bbox.center();
+        for( unsigned i=0; i<numPoints; ++i )
+        {
+            x[i] -= center.x(), y[i] -= center.y(), z[i] -= center.z();
+        }
+    }
+
+    return outcx;
+}
+
 FilterContext
 TransformFilter::push( FeatureList& input, FilterContext& incx )
 {
@@ -23,10 +23,17 @@
 #include <osgEarth/Progress>
 #include <osgEarth/Utils>
 #include <osgEarth/Metrics>
+#include <osgEarth/JobArena>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/Archive>
 #include <osgUtil/IncrementalCompileOperation>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Shape>
+#include <osg/Texture>
+#include <list>
+#include <set>
 
 #define LC "[URI] "
 
@@ -113,6 +120,35 @@ namespace
         Threading::Event _block;
         URI _uri;
     };
+
+    class LoadImageOperation : public osg::Operation
+    {
+    public:
+        LoadImageOperation(const URI& uri, const osgDB::Options* options, ProgressCallback* progress, Promise<osg::Image> promise) :
+            _uri(uri),
+            _promise(promise),
+            _options(options),
+            _progress(progress)
+        {
+        }
+
+        void operator()(osg::Object*)
+        {
+            OE_PROFILING_ZONE_NAMED("loadAsyncImage");
+            OE_PROFILING_ZONE_TEXT(_uri.full());
+
+            if (!_promise.isAbandoned())
+            {
+                osgEarth::ReadResult result = _uri.readImage(_options.get(), _progress.get());
+                _promise.resolve(result.getImage());
+            }
+        }
+
+        Promise<osg::Image> _promise;
+        osg::ref_ptr<const osgDB::Options> _options;
+        osg::ref_ptr<ProgressCallback> _progress;
+        URI _uri;
+    };
 }
 
 //------------------------------------------------------------------------
@@ -409,6 +445,36 @@ namespace
     }
 
 
+    //--------------------------------------------------------------------
+    // Conditional requests
+
+    // ETag header from the metadata of an earlier response, if any
+    std::string getETag(const Config& meta)
+    {
+        for (ConfigSet::const_iterator i = meta.children().begin(); i != meta.children().end(); ++i)
+        {
+            if (ciEquals(i->key(), "ETag"))
+                return trim(i->value());
+        }
+        return std::string();
+    }
+
+    // Request for a URI, conditional on the version we already have
+    HTTPRequest makeRequest(const URI& uri, TimeStamp lastModified, const std::string& etag)
+    {
+        HTTPRequest req(uri.full());
+        req.getHeaders() = uri.context().getHeaders();
+        if (lastModified > 0)
+        {
+            req.setLastModified(lastModified);
+        }
+        if (!etag.empty())
+        {
+            req.addHeader("If-None-Match", etag);
+        }
+        return req;
+    }
+
     //--------------------------------------------------------------------
     // Read functors (used by the doRead method)
 
@@ -417,15 +483,9 @@ namespace
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const std::string& etag )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
-            return HTTPClient::readObject(req, opt, p);
+            return HTTPClient::readObject(makeRequest(uri, lastModified, etag), opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
             osgDB::ReaderWriter::ReadResult osgRR = osgDB::Registry::instance()->readObject(uri, opt);
@@ -439,15 +499,9 @@ namespace
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key ) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const std::string& etag )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
-            return HTTPClient::readNode(req, opt, p);
+            return HTTPClient::readNode(makeRequest(uri, lastModified, etag), opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
             osgDB::ReaderWriter::ReadResult osgRR = osgDB::Registry::instance()->readNode(uri, opt);
@@ -471,15 +525,8 @@ namespace
             if ( r.getImage() ) r.getImage()->setFileName( key );
             return r;
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified ) {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
-            ReadResult r = HTTPClient::readImage(req, opt, p);
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const std::string& etag ) {
+            ReadResult r = HTTPClient::readImage(makeRequest(uri, lastModified, etag), opt, p);
             if ( r.getImage() ) r.getImage()->setFileName( uri.full() );
             return r;
         }
@@ -505,21 +552,65 @@ namespace
         ReadResult fromCache( CacheBin* bin, const std::string& key) { 
             return bin->readString(key, 0L);
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const std::string& etag )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
-            return HTTPClient::readString(req, opt, p);
+            return HTTPClient::readString(makeRequest(uri, lastModified, etag), opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
             return readStringFile(uri, opt);
         }
     };
 
+    //--------------------------------------------------------------------
+    // Background revalidation of expired cache records
+
+    Threading::Mutex s_revalidatingMutex;
+    std::set<std::string> s_revalidating;
+
+    // True if the caller should start revalidating this cache key; false if
+    // another thread already is.
+    bool beginRevalidate(const std::string& key)
+    {
+        Threading::ScopedMutexLock lock(s_revalidatingMutex);
+        return s_revalidating.insert(key).second;
+    }
+
+    void endRevalidate(const std::string& key)
+    {
+        Threading::ScopedMutexLock lock(s_revalidatingMutex);
+        s_revalidating.erase(key);
+    }
+
+    template<typename READ_FUNCTOR>
+    struct RevalidateTask : public TaskRequest
+    {
+        RevalidateTask(const URI& uri, const osgDB::Options* options, CacheBin* bin, const ReadResult& cached) :
+            _uri(uri), _options(options), _bin(bin),
+            _lastModified(cached.lastModifiedTime()),
+            _etag(getETag(cached.metadata())) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            READ_FUNCTOR reader;
+            ReadResult r = reader.fromHTTP(_uri, _options.get(), progress, _lastModified, _etag);
+            if (r.code() == ReadResult::RESULT_NOT_MODIFIED)
+            {
+                _bin->touch(_uri.cacheKey());
+            }
+            else if (r.succeeded())
+            {
+                _bin->write(_uri.cacheKey(), r.getObject(), r.metadata(), _options.get());
+            }
+            endRevalidate(_uri.cacheKey());
+        }
+
+        URI _uri;
+        osg::ref_ptr<const osgDB::Options> _options;
+        osg::ref_ptr<CacheBin> _bin;
+        TimeStamp _lastModified;
+        std::string _etag;
+    };
+
     //--------------------------------------------------------------------
     // MASTER read template function. I templatized this so we wouldn't
     // have 4 95%-identical code paths to maintain...
@@ -632,6 +723,11 @@ namespace
                         {
                             expired = cp->isExpired(result.lastModifiedTime());
                             result.setIsFromCache(true);
+                            Util::Metrics::counter("cache." + bin->getID() + ".hits")->add();
+                        }
+                        else
+                        {
+                            Util::Metrics::counter("cache." + bin->getID() + ".misses")->add();
                         }
                     }
 
@@ -660,10 +756,22 @@ namespace
 
                         if ( !gotResultFromCallback )
                         {
+                            // Expired, but the policy allows using it while a fresh
+                            // copy is fetched in the background:
+                            if ( expired && cp->staleWhileRevalidate() == true && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
+                            {
+                                if ( beginRevalidate(uri.cacheKey()) )
+                                {
+                                    OE_DEBUG << LC << uri.full() << " expired, revalidating in the background" << std::endl;
+                                    JobArena::get("oe.revalidate")->dispatch(
+                                        new RevalidateTask<READ_FUNCTOR>(uri, remoteOptions.get(), bin.get(), result));
+                                }
+                            }
+
                             // still no data, go to the source:
-                            if ( (result.empty() || expired) && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
+                            else if ( (result.empty() || expired) && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
                             {
-                                ReadResult remoteResult = reader.fromHTTP( uri, remoteOptions.get(), progress, result.lastModifiedTime() );
+                                ReadResult remoteResult = reader.fromHTTP( uri, remoteOptions.get(), progress, result.lastModifiedTime(), getETag(result.metadata()) );
                                 if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED)
                                 {
                                     OE_DEBUG << LC << uri.full() << " not modified, using cached result" << std::endl;
@@ -671,6 +779,15 @@ namespace
                                     if (bin)
                                         bin->touch( uri.cacheKey() );
                                 }
+                                else if (expired && remoteResult.failed() &&
+                                         remoteResult.code() != ReadResult::RESULT_CANCELED &&
+                                         remoteResult.code() != ReadResult::RESULT_NOT_FOUND)
+                                {
+                                    // The server is unreachable or broken; an old copy
+                                    // beats no copy at all.
+                                    OE_INFO_THROTTLED << LC << uri.full() << " unavailable (" << remoteResult.getResultCodeString()
+                                        << "), using expired cached result" << std::endl;
+                                }
                                 else
                                 {
                                     OE_DEBUG << LC << "Got remote result for " << uri.full() << std::endl;
@@ -796,6 +913,310 @@ URI::readNodeAsync(const osgDB::Options* dbOptions,
     return promise.getFuture();
 }
 
+Future<osg::Image>
+URI::readImageAsync(const osgDB::Options* dbOptions,
+                    ProgressCallback* progress) const
+{
+    osg::ref_ptr<ThreadPool> threadPool;
+    if (dbOptions)
+    {
+        threadPool = ThreadPool::get(dbOptions);
+    }
+
+    Promise<osg::Image> promise;
+
+    osg::ref_ptr<osg::Operation> operation = new LoadImageOperation(*this, dbOptions, progress, promise);
+
+    if (threadPool.valid())
+    {
+        threadPool->getQueue()->add(operation.get());
+    }
+    else
+    {
+        OE_DEBUG << "Immediately resolving async operation, please set a ThreadPool on the Options object" << std::endl;
+        operation->operator()(0);
+    }
+
+    return promise.getFuture();
+}
+
+//------------------------------------------------------------------------
+
+#define URI_RESULT_CACHE_SHARDS 8u
+
+namespace
+{
+    // Adds up the geometry and texture data under a node, counting each
+    // shared array or image once.
+    struct NodeSizeVisitor : public osg::NodeVisitor
+    {
+        NodeSizeVisitor() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _bytes(0u) { }
+
+        void apply(osg::Node& node)
+        {
+            addStateSet(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Geode& geode)
+        {
+            addStateSet(geode.getStateSet());
+            for (unsigned i = 0; i < geode.getNumDrawables(); ++i)
+                apply(*geode.getDrawable(i));
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            addStateSet(drawable.getStateSet());
+
+            osg::Geometry* geom = drawable.asGeometry();
+            if (!geom)
+            {
+                _bytes += 256u;
+                return;
+            }
+
+            osg::Geometry::ArrayList arrays;
+            geom->getArrayList(arrays);
+            for (unsigned i = 0; i < arrays.size(); ++i)
+            {
+                if (arrays[i].valid() && _seen.insert(arrays[i].get()).second)
+                    _bytes += arrays[i]->getTotalDataSize();
+            }
+
+            for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+            {
+                osg::DrawElements* de = geom->getPrimitiveSet(i)->getDrawElements();
+                if (de && _seen.insert(de).second)
+                    _bytes += de->getTotalDataSize();
+            }
+        }
+
+        void addStateSet(osg::StateSet* stateSet)
+        {
+            if (!stateSet || !_seen.insert(stateSet).second)
+                return;
+
+            for (unsigned unit = 0; unit < stateSet->getNumTextureAttributeLists(); ++unit)
+            {
+                osg::Texture* tex = dynamic_cast<osg::Texture*>(
+                    stateSet->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+                if (!tex)
+                    continue;
+
+                for (unsigned i = 0; i < tex->getNumImages(); ++i)
+                {
+                    osg::Image* image = tex->getImage(i);
+                    if (image && _seen.insert(image).second)
+                        _bytes += image->getTotalSizeInBytesIncludingMipmaps();
+                }
+            }
+        }
+
+        size_t _bytes;
+        std::set<const void*> _seen;
+    };
+}
+
+struct URIResultCache::Shard
+{
+    struct Entry
+    {
+        std::string _key;
+        ReadResult  _result;
+        size_t      _bytes;
+    };
+    typedef std::list<Entry> LRU;
+
+    Shard() : _bytes(0u), _hits(0u), _misses(0u), _evictions(0u) { }
+
+    Threading::Mutex _mutex;
+    LRU _lru;
+    UnorderedMap<std::string, LRU::iterator> _index;
+    size_t _bytes;
+    unsigned _hits, _misses, _evictions;
+};
+
+URIResultCache::URIResultCache(size_t maxBytes) :
+_maxBytes(maxBytes)
+{
+    _shards = new Shard[URI_RESULT_CACHE_SHARDS];
+}
+
+URIResultCache::~URIResultCache()
+{
+    delete [] _shards;
+}
+
+URIResultCache*
+URIResultCache::shared()
+{
+    static osg::ref_ptr<URIResultCache> s_shared = new URIResultCache();
+    return s_shared.get();
+}
+
+URIResultCache::Shard&
+URIResultCache::getShard(const URI& uri) const
+{
+    // FNV-1a
+    unsigned hash = 2166136261u;
+    const std::string& key = uri.full();
+    for (std::string::const_iterator c = key.begin(); c != key.end(); ++c)
+    {
+        hash ^= (unsigned char)(*c);
+        hash *= 16777619u;
+    }
+    return _shards[hash % URI_RESULT_CACHE_SHARDS];
+}
+
+bool
+URIResultCache::get(const URI& uri, Record& out)
+{
+    Shard& shard = getShard(uri);
+    bool hit = false;
+    {
+        Threading::ScopedMutexLock lock(shard._mutex);
+        UnorderedMap<std::string, Shard::LRU::iterator>::iterator i = shard._index.find(uri.full());
+        if (i != shard._index.end())
+        {
+            // most recently used goes to the front
+            shard._lru.splice(shard._lru.begin(), shard._lru, i->second);
+            out = Record(i->second->_result);
+            ++shard._hits;
+            hit = true;
+        }
+        else
+        {
+            ++shard._misses;
+        }
+    }
+
+    if (hit) {
+        OE_METRICS_COUNT("uri_result_cache.hits", 1);
+    }
+    else {
+        OE_METRICS_COUNT("uri_result_cache.misses", 1);
+    }
+    return hit;
+}
+
+void
+URIResultCache::insert(const URI& uri, const ReadResult& result)
+{
+    // list node, index node and key, plus the object
+    size_t bytes = 256u + 2u*uri.full().size() + getSizeInBytes(result.getObject());
+
+    Shard& shard = getShard(uri);
+    Threading::ScopedMutexLock lock(shard._mutex);
+
+    // too big to ever fit in this shard's share of the budget
+    if (bytes > _maxBytes / URI_RESULT_CACHE_SHARDS)
+        return;
+
+    UnorderedMap<std::string, Shard::LRU::iterator>::iterator i = shard._index.find(uri.full());
+    if (i != shard._index.end())
+    {
+        shard._bytes -= i->second->_bytes;
+        shard._lru.erase(i->second);
+        shard._index.erase(i);
+    }
+
+    Shard::Entry entry;
+    entry._key = uri.full();
+    entry._result = result;
+    entry._bytes = bytes;
+    shard._lru.push_front(entry);
+    shard._index[uri.full()] = shard._lru.begin();
+    shard._bytes += bytes;
+
+    trim(shard);
+}
+
+void
+URIResultCache::trim(Shard& shard)
+{
+    // assumes the shard is locked
+    size_t budget = _maxBytes / URI_RESULT_CACHE_SHARDS;
+    while (shard._bytes > budget && !shard._lru.empty())
+    {
+        Shard::Entry& last = shard._lru.back();
+        shard._bytes -= last._bytes;
+        shard._index.erase(last._key);
+        shard._lru.pop_back();
+        ++shard._evictions;
+    }
+}
+
+void
+URIResultCache::clear()
+{
+    for (unsigned s = 0; s < URI_RESULT_CACHE_SHARDS; ++s)
+    {
+        Threading::ScopedMutexLock lock(_shards[s]._mutex);
+        _shards[s]._lru.clear();
+        _shards[s]._index.clear();
+        _shards[s]._bytes = 0u;
+    }
+}
+
+void
+URIResultCache::setMaxBytes(size_t value)
+{
+    _maxBytes = value;
+    for (unsigned s = 0; s < URI_RESULT_CACHE_SHARDS; ++s)
+    {
+        Threading::ScopedMutexLock lock(_shards[s]._mutex);
+        trim(_shards[s]);
+    }
+}
+
+URIResultCache::Stats
+URIResultCache::getStats() const
+{
+    Stats out;
+    out._maxBytes = _maxBytes;
+    for (unsigned s = 0; s < URI_RESULT_CACHE_SHARDS; ++s)
+    {
+        Threading::ScopedMutexLock lock(_shards[s]._mutex);
+        out._entries += _shards[s]._index.size();
+        out._bytes += _shards[s]._bytes;
+        out._hits += _shards[s]._hits;
+        out._misses += _shards[s]._misses;
+        out._evictions += _shards[s]._evictions;
+    }
+    return out;
+}
+
+size_t
+URIResultCache::getSizeInBytes(const osg::Object* object)
+{
+    if (!object)
+        return 0u;
+
+    const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+    if (image)
+        return image->getTotalSizeInBytesIncludingMipmaps();
+
+    const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+    if (hf)
+        return hf->getHeightList().size() * sizeof(float);
+
+    const StringObject* str = dynamic_cast<const StringObject*>(object);
+    if (str)
+        return str->getString().size();
+
+    const osg::Node* node = dynamic_cast<const osg::Node*>(object);
+    if (node)
+    {
+        NodeSizeVisitor visitor;
+        const_cast<osg::Node*>(node)->accept(visitor);
+        return 1024u + visitor._bytes;
+    }
+
+    // something small, like a shader
+    return 1024u;
+}
+
 //------------------------------------------------------------------------
 
 void
@@ -224,6 +224,8 @@ UTMGraticule::init()
 
     _root = new osg::Group();
 
+    _nodeCache = new GraticuleNodeCache();
+
     // install the range callback for clip plane activation
     _root->addCullCallback( new RangeUniformCullCallback() );
 }
@@ -241,6 +243,8 @@ UTMGraticule::removedFromMap(const Map* map)
 {
     VisibleLayer::removedFromMap(map);
     _map = 0L;
+    if (_nodeCache.valid())
+        _nodeCache->clear();
 }
 
 osg::Node*
@@ -306,11 +310,18 @@ UTMGraticule::rebuild()
     // initialize the UTM sector tables for this profile.
     _utmData.rebuild(_profile.get());
 
-    // now build the lateral tiles for the GZD level.
+    // now build the lateral tiles for the GZD level, reusing the ones
+    // from the last rebuild if their style did not change.
     for( UTMData::SectorTable::iterator i = _utmData.sectorTable().begin(); i != _utmData.sectorTable().end(); ++i )
     {
-        osg::Node* tile = _utmData.buildGZDTile(i->first, i->second, options().gzdStyle().get(), _featureProfile.get(), map.get());
-        if ( tile )
-            _root->addChild( tile );
+        std::string key = GraticuleNodeCache::makeKey("gzd", i->first, options().gzdStyle().get());
+        osg::ref_ptr<osg::Node> tile = _nodeCache->get(key);
+        if ( !tile.valid() )
+        {
+            tile = _utmData.buildGZDTile(i->first, i->second, options().gzdStyle().get(), _featureProfile.get(), map.get());
+            _nodeCache->insert(key, tile.get());
+        }
+        if ( tile.valid() )
+            _root->addChild( tile.get() );
     }
 }
@@ -50,6 +50,7 @@ void
 UTMLabelingEngine::setMaxResolution(double value)
 {
     _maxRes = osg::maximum(value, 1.0);
+    dirtyLayout();
     OE_INFO << LC << "Max resolution = " << _maxRes << std::endl;
 }
 
@@ -161,9 +162,7 @@ UTMLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_world
             window.clampToBottom(p, eye); // also xforms to geographic
             if (p.y() < 84.0 && p.y() > -80.0)
             {
-                data.xLabels[xi]->setPosition(p);
-                data.xLabels[xi]->setText(Stringify() << std::setprecision(8) << xx);
-                data.xLabels[xi]->setNodeMask(~0);
+                showLabel(data.xLabels[xi].get(), p, Stringify() << std::setprecision(8) << xx);
             }
         }
         
@@ -183,9 +182,7 @@ UTMLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_world
             window.clampToLeft(p, eye); // also xforms to geographic
             if (p.y() < 84.0 && p.y() > -80.0)
             {
-                data.yLabels[yi]->setPosition(p);
-                data.yLabels[yi]->setText(Stringify() << std::setprecision(8) << yy);
-                data.yLabels[yi]->setNodeMask(~0);
+                showLabel(data.yLabels[yi].get(), p, Stringify() << std::setprecision(8) << yy);
             }
         }
     }
@@ -210,9 +207,7 @@ UTMLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_world
             window.clampToBottom(p, eye); // also xforms to geographic
             if (p.y() < 84.0 && p.y() > -80.0)
             {
-                data.xLabels[xi]->setPosition(p);
-                data.xLabels[xi]->setText(Stringify() << std::setprecision(8) << xx);
-                data.xLabels[xi]->setNodeMask(~0);
+                showLabel(data.xLabels[xi].get(), p, Stringify() << std::setprecision(8) << xx);
             }
         }
     }
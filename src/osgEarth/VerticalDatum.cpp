@@ -22,6 +22,7 @@
 #include <osgEarth/GeoData>
 
 #include <osgDB/ReadFile>
+#include <iomanip>
 
 using namespace osgEarth;
 
@@ -70,7 +71,8 @@ VerticalDatum::VerticalDatum(const std::string& name,
 _name      ( name ),
 _initString( initString ),
 _geoid     ( geoid ),
-_units     ( Units::METERS )
+_units     ( Units::METERS ),
+_geoidGrids( true, 64u )
 {
     if ( _geoid.valid() )
         _units = _geoid->getUnits();
@@ -79,7 +81,8 @@ _units     ( Units::METERS )
 VerticalDatum::VerticalDatum( const Units& units ) :
 _name      ( units.getName() ),
 _initString( units.getName() ),
-_units     ( units )
+_units     ( units ),
+_geoidGrids( true, 64u )
 {
     //nop
 }
@@ -136,7 +139,53 @@ VerticalDatum::transform(const VerticalDatum* from,
 
     unsigned cols = hf->getNumColumns();
     unsigned rows = hf->getNumRows();
-    
+
+    osg::ref_ptr<const osg::FloatArray> fromGrid, toGrid;
+    if ( from )
+        fromGrid = from->getGeoidGrid(extent, cols, rows);
+    if ( to )
+        toGrid = to->getGeoidGrid(extent, cols, rows);
+
+    Units fromUnits = from ? from->getUnits() : Units::METERS;
+    Units toUnits = to ? to->getUnits() : Units::METERS;
+    float scale = (float)fromUnits.convertTo(toUnits, 1.0);
+
+    // msl2hae, then the unit conversion, then hae2msl:
+    // h = scale*(h + fromGeoid) - toGeoid
+    float* h = &(*hf->getFloatArray())[0];
+    const float* fromH = fromGrid.valid() ? &(*fromGrid)[0] : 0L;
+    const float* toH = toGrid.valid() ? &(*toGrid)[0] : 0L;
+    unsigned count = cols*rows;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (h[i] != NO_DATA_VALUE)
+        {
+            float offset = (fromH ? scale*fromH[i] : 0.0f) - (toH ? toH[i] : 0.0f);
+            h[i] = scale*h[i] + offset;
+        }
+    }
+
+    return true;
+}
+
+osg::ref_ptr<const osg::FloatArray>
+VerticalDatum::getGeoidGrid(const GeoExtent& extent, unsigned cols, unsigned rows) const
+{
+    if ( !_geoid.valid() || !extent.isValid() || cols < 2 || rows < 2 )
+        return 0L;
+
+    std::string key = Stringify()
+        << std::setprecision(12)
+        << extent.getSRS()->getHorizInitString() << ","
+        << extent.west() << "," << extent.south() << ","
+        << extent.east() << "," << extent.north() << ","
+        << cols << "x" << rows;
+
+    GeoidGridCache::Record rec;
+    if ( _geoidGrids.get(key, rec) )
+        return rec.value();
+
     osg::Vec3d sw(extent.west(), extent.south(), 0.0);
     osg::Vec3d ne(extent.east(), extent.north(), 0.0);
     
@@ -152,21 +201,24 @@ VerticalDatum::transform(const VerticalDatum* from,
         ystep = (ne.y()-sw.y()) / double(rows-1);
     }
 
-    for( unsigned c=0; c<cols; ++c)
+    // sample locations, in heightfield order
+    std::vector<double> lats(cols*rows), lons(cols*rows);
+    for( unsigned r=0; r<rows; ++r)
     {
-        double lon = sw.x() + xstep*double(c);
-        for( unsigned r=0; r<rows; ++r)
+        double lat = sw.y() + ystep*double(r);
+        for( unsigned c=0; c<cols; ++c)
         {
-            double lat = sw.y() + ystep*double(r);
-            float& h = hf->getHeight(c, r);
-            if (h != NO_DATA_VALUE)
-            {
-                VerticalDatum::transform( from, to, lat, lon, h );
-            }
+            lats[r*cols + c] = lat;
+            lons[r*cols + c] = sw.x() + xstep*double(c);
         }
     }
 
-    return true;
+    osg::ref_ptr<osg::FloatArray> grid = new osg::FloatArray(cols*rows);
+    _geoid->getHeights(&lats[0], &lons[0], &(*grid)[0], cols*rows);
+
+    _geoidGrids.insert(key, grid.get());
+
+    return grid;
 }
 
 double 
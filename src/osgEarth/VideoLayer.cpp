@@ -18,9 +18,329 @@
 */
 #include <osgEarth/VideoLayer>
 #include <osg/ImageStream>
+#include <osg/GLExtensions>
 #include <osgEarth/Registry>
+#include <osgEarth/JobArena>
+#include <OpenThreads/Thread>
+#include <cstring>
 
 using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[VideoLayer] "
+
+namespace
+{
+    /**
+     * Texture that streams the frames of a video into GL.
+     *
+     * The decoder (e.g. the ffmpeg plugin) writes frames into the image on
+     * its own thread. When the draw thread sees a new frame, a worker copies
+     * it into one of three slots of a persistently mapped pixel buffer; a
+     * later apply() uploads the newest copied frame from the buffer and
+     * fences the slot. The draw thread therefore never touches the pixels,
+     * and the decoder, the copy and the GPU transfer each work on their own
+     * slot.
+     *
+     * Without GL_ARB_buffer_storage, in other graphics contexts, or if the
+     * frame size changes, the texture uploads from the image as usual.
+     */
+    class StreamingTexture : public osg::Texture2D
+    {
+    public:
+        enum { NUM_SLOTS = 3 };
+
+        StreamingTexture(osg::Image* image) :
+            osg::Texture2D(image),
+            _contextID(~0u),
+            _disabled(false),
+            _pbo(0u),
+            _mapped(0L),
+            _slotSize(0u),
+            _uploadedFrame(~0u),
+            _numCopies(0u)
+        {
+            for (unsigned i = 0; i < NUM_SLOTS; ++i)
+            {
+                _slots[i]._state = Slot::FREE;
+                _slots[i]._frame = 0u;
+                _slots[i]._fence = 0L;
+            }
+        }
+
+        void apply(osg::State& state) const
+        {
+            const osg::Image* image = getImage();
+            TextureObject* to = getTextureObject(state.getContextID());
+
+            // let OSG create the texture and handle the first frame
+            if (!to || !image || !image->data() || !stream(state, *image, to))
+            {
+                osg::Texture2D::apply(state);
+            }
+        }
+
+        void releaseGLObjects(osg::State* state) const
+        {
+            osg::Texture2D::releaseGLObjects(state);
+
+            Threading::ScopedMutexLock lock(_mutex);
+
+            if (_pbo == 0u || (state && state->getContextID() != _contextID))
+                return;
+
+            // wait for the workers to finish copying into the buffer
+            while (_numCopies > 0u)
+            {
+                _mutex.unlock();
+                OpenThreads::Thread::microSleep(1000);
+                _mutex.lock();
+            }
+
+            if (state)
+            {
+                osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+                for (unsigned i = 0; i < NUM_SLOTS; ++i)
+                {
+                    if (_slots[i]._fence)
+                        ext->glDeleteSync(_slots[i]._fence);
+                }
+                ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _pbo);
+                ext->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
+                ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                ext->glDeleteBuffers(1, &_pbo);
+            }
+
+            for (unsigned i = 0; i < NUM_SLOTS; ++i)
+            {
+                _slots[i]._state = Slot::FREE;
+                _slots[i]._fence = 0L;
+            }
+            _pbo = 0u;
+            _mapped = 0L;
+            _contextID = ~0u;
+            _uploadedFrame = ~0u;
+        }
+
+        // Copies a frame into a slot; runs on a worker thread.
+        void copy(unsigned slot, const osg::Image* image) const
+        {
+            unsigned char* dst;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                if (!_mapped || _slots[slot]._state != Slot::COPYING)
+                    return;
+                dst = _mapped + slot*_slotSize;
+                ++_numCopies;
+            }
+
+            ::memcpy(dst, image->data(), _slotSize);
+
+            Threading::ScopedMutexLock lock(_mutex);
+            --_numCopies;
+            if (_slots[slot]._state == Slot::COPYING)
+                _slots[slot]._state = Slot::READY;
+        }
+
+    protected:
+        virtual ~StreamingTexture() { }
+
+    private:
+        struct Slot
+        {
+            enum State { FREE, COPYING, READY, FENCED };
+            State _state;
+            unsigned _frame;  // image modified count of the pixels in the slot
+            GLsync _fence;
+        };
+
+        mutable Slot _slots[NUM_SLOTS];
+        mutable unsigned _contextID;
+        mutable bool _disabled;
+        mutable GLuint _pbo;
+        mutable unsigned char* _mapped;
+        mutable unsigned _slotSize;
+        mutable unsigned _uploadedFrame;
+        mutable unsigned _numCopies;
+        mutable Threading::Mutex _mutex;
+
+        bool initialize(osg::State& state, unsigned slotSize) const;
+        bool stream(osg::State& state, const osg::Image& image, TextureObject* to) const;
+    };
+
+    // Worker job that copies a frame into a slot of the streaming buffer
+    struct CopyFrameJob : public TaskRequest
+    {
+        CopyFrameJob(const StreamingTexture* texture, unsigned slot, const osg::Image* image) :
+            _texture(texture), _slot(slot), _image(image) { }
+
+        void operator()(ProgressCallback*)
+        {
+            _texture->copy(_slot, _image.get());
+        }
+
+        osg::ref_ptr<const StreamingTexture> _texture;
+        unsigned _slot;
+        osg::ref_ptr<const osg::Image> _image;
+    };
+
+    bool
+    StreamingTexture::initialize(osg::State& state, unsigned slotSize) const
+    {
+        _contextID = state.getContextID();
+
+        osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+        bool supported =
+            osg::isGLExtensionSupported(_contextID, "GL_ARB_buffer_storage") &&
+            ext->glBufferStorage &&
+            ext->glMapBufferRange &&
+            ext->glFenceSync &&
+            ext->glClientWaitSync &&
+            ext->glDeleteSync;
+
+        if (!supported)
+        {
+            OE_INFO << LC << "GL_ARB_buffer_storage not available; video frames will upload directly" << std::endl;
+            return false;
+        }
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        ext->glGenBuffers(1, &_pbo);
+        ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _pbo);
+        ext->glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, NUM_SLOTS*slotSize, 0L, flags);
+        _mapped = (unsigned char*)ext->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, NUM_SLOTS*slotSize, flags);
+        ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+        if (!_mapped)
+        {
+            OE_WARN << LC << "Failed to map the frame buffer; video frames will upload directly" << std::endl;
+            ext->glDeleteBuffers(1, &_pbo);
+            _pbo = 0u;
+            return false;
+        }
+
+        _slotSize = slotSize;
+        return true;
+    }
+
+    bool
+    StreamingTexture::stream(osg::State& state, const osg::Image& image, TextureObject* to) const
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        if (_disabled)
+            return false;
+
+        if (_contextID == ~0u)
+        {
+            if (!initialize(state, image.getTotalSizeInBytes()))
+            {
+                _disabled = true;
+                return false;
+            }
+
+            // OSG uploaded the current frame when it made the texture
+            _uploadedFrame = image.getModifiedCount();
+        }
+
+        if (state.getContextID() != _contextID)
+            return false;
+
+        if (image.getTotalSizeInBytes() != _slotSize ||
+            image.s() != to->_profile._width ||
+            image.t() != to->_profile._height)
+        {
+            OE_INFO << LC << "Video frame size changed; video frames will upload directly" << std::endl;
+            _disabled = true;
+            return false;
+        }
+
+        osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+        to->bind();
+
+        // recycle slots whose transfers are done
+        Slot* newest = 0L;
+        for (unsigned i = 0; i < NUM_SLOTS; ++i)
+        {
+            Slot& slot = _slots[i];
+            if (slot._state == Slot::FENCED)
+            {
+                GLenum result = ext->glClientWaitSync(slot._fence, 0, 0);
+                if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+                {
+                    ext->glDeleteSync(slot._fence);
+                    slot._fence = 0L;
+                    slot._state = Slot::FREE;
+                }
+            }
+            else if (slot._state == Slot::READY)
+            {
+                if (newest == 0L || slot._frame > newest->_frame)
+                    newest = &slot;
+            }
+        }
+
+        // upload the newest copied frame
+        if (newest && newest->_frame != _uploadedFrame)
+        {
+            unsigned offset = (unsigned)(newest - _slots) * _slotSize;
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, image.getPacking());
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, image.getRowLength());
+
+            ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _pbo);
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                image.s(), image.t(),
+                image.getPixelFormat(), image.getDataType(),
+                (const GLvoid*)(size_t)offset);
+
+            ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+            newest->_fence = ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            newest->_state = Slot::FENCED;
+            _uploadedFrame = newest->_frame;
+        }
+
+        // older copied frames are superseded
+        for (unsigned i = 0; i < NUM_SLOTS; ++i)
+        {
+            if (_slots[i]._state == Slot::READY && _slots[i]._frame != _uploadedFrame && &_slots[i] != newest)
+                _slots[i]._state = Slot::FREE;
+        }
+
+        // copy the latest decoded frame into a free slot, unless it's
+        // already on its way
+        unsigned latest = image.getModifiedCount();
+        if (latest != _uploadedFrame)
+        {
+            int freeSlot = -1;
+            for (unsigned i = 0; i < NUM_SLOTS; ++i)
+            {
+                if (_slots[i]._state != Slot::FREE && _slots[i]._state != Slot::FENCED && _slots[i]._frame == latest)
+                {
+                    freeSlot = -1;
+                    break;
+                }
+                if (_slots[i]._state == Slot::FREE && freeSlot < 0)
+                    freeSlot = i;
+            }
+
+            if (freeSlot >= 0)
+            {
+                _slots[freeSlot]._state = Slot::COPYING;
+                _slots[freeSlot]._frame = latest;
+                JobArena::get("oe.video")->dispatch(new CopyFrameJob(this, freeSlot, &image));
+            }
+        }
+
+        return true;
+    }
+}
 
 //.......................................................................
 
@@ -77,7 +397,8 @@ VideoLayer::openImplementation()
                 is->play();                 
             }
 
-            _texture = new osg::Texture2D( image );
+            // streams new frames through a worker thread and a pixel buffer
+            _texture = new StreamingTexture( image );
             _texture->setResizeNonPowerOfTwoHint( false );
             _texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture2D::LINEAR);
             _texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture2D::LINEAR);
@@ -0,0 +1,377 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/ViewshedLayer>
+#include <osgEarth/Shaders>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/MapNode>
+#include <osgEarth/Terrain>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/CameraUtils>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/NodeUtils>
+#include <osg/PolygonMode>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[ViewshedLayer] "
+
+//...................................................................
+
+Config
+ViewshedLayer::Options::getConfig() const
+{
+    Config conf = VisibleLayer::Options::getConfig();
+    conf.set("observer", _observer);
+    conf.set("radius", _radius);
+    conf.set("texture_size", _textureSize);
+    conf.set("visible_color", _visibleColor);
+    conf.set("invisible_color", _invisibleColor);
+    return conf;
+}
+
+void
+ViewshedLayer::Options::fromConfig(const Config& conf)
+{
+    _radius.init(10000.0f);
+    _textureSize.init(1024u);
+    _visibleColor.init(Color(0.0f, 1.0f, 0.0f, 0.5f));
+    _invisibleColor.init(Color(1.0f, 0.0f, 0.0f, 0.5f));
+
+    conf.get("observer", _observer);
+    conf.get("radius", _radius);
+    conf.get("texture_size", _textureSize);
+    conf.get("visible_color", _visibleColor);
+    conf.get("invisible_color", _invisibleColor);
+}
+
+//...................................................................
+
+// Scene graph node that finds the MapNode and renders the cube map.
+class ViewshedLayer::ViewshedNode : public osg::Group
+{
+public:
+    ViewshedNode(ViewshedLayer* layer) : _layer(layer)
+    {
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+
+    void traverse(osg::NodeVisitor& nv)
+    {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+        {
+            if (_layer->_mapNode.valid() == false)
+            {
+                MapNode* mapNode = osgEarth::findInNodePath<MapNode>(nv);
+                if (mapNode)
+                {
+                    _layer->setMapNode(mapNode);
+                }
+            }
+        }
+        else if (nv.getVisitorType() == nv.CULL_VISITOR)
+        {
+            _layer->cull(nv);
+        }
+
+        osg::Group::traverse(nv);
+    }
+
+    ViewshedLayer* _layer;
+};
+
+//...................................................................
+
+REGISTER_OSGEARTH_LAYER(viewshed, ViewshedLayer);
+
+OE_LAYER_PROPERTY_IMPL(ViewshedLayer, unsigned, TextureSize, textureSize);
+
+void
+ViewshedLayer::setObserver(const GeoPoint& value)
+{
+    options().observer() = value;
+    dirty();
+}
+
+const GeoPoint&
+ViewshedLayer::getObserver() const
+{
+    return options().observer().get();
+}
+
+void
+ViewshedLayer::setRadius(const float& value)
+{
+    options().radius() = value;
+    updateUniforms();
+    dirty();
+}
+
+const float&
+ViewshedLayer::getRadius() const
+{
+    return options().radius().get();
+}
+
+void
+ViewshedLayer::setVisibleColor(const Color& value)
+{
+    options().visibleColor() = value;
+    updateUniforms();
+}
+
+const Color&
+ViewshedLayer::getVisibleColor() const
+{
+    return options().visibleColor().get();
+}
+
+void
+ViewshedLayer::setInvisibleColor(const Color& value)
+{
+    options().invisibleColor() = value;
+    updateUniforms();
+}
+
+const Color&
+ViewshedLayer::getInvisibleColor() const
+{
+    return options().invisibleColor().get();
+}
+
+void
+ViewshedLayer::dirty()
+{
+    _dirty = true;
+}
+
+void
+ViewshedLayer::init()
+{
+    VisibleLayer::init();
+
+    setRenderType(RENDERTYPE_TERRAIN_SURFACE);
+
+    _dirty = true;
+    _terrainRevision = 0u;
+
+    osg::StateSet* ss = getOrCreateStateSet();
+    ss->setDataVariance(ss->DYNAMIC);
+
+    _samplerUniform = new osg::Uniform(osg::Uniform::SAMPLER_CUBE, "oe_viewshed_map");
+    ss->addUniform(_samplerUniform.get());
+
+    _observerUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC3, "oe_viewshed_observer");
+    ss->addUniform(_observerUniform.get());
+
+    _rangeUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC3, "oe_viewshed_range");
+    ss->addUniform(_rangeUniform.get());
+
+    _visibleColorUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "oe_viewshed_visibleColor");
+    ss->addUniform(_visibleColorUniform.get());
+
+    _invisibleColorUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "oe_viewshed_invisibleColor");
+    ss->addUniform(_invisibleColorUniform.get());
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(ss);
+    vp->setName("ViewshedLayer");
+    Shaders shaders;
+    shaders.load(vp, shaders.ViewshedLayer);
+
+    updateUniforms();
+
+    _node = new ViewshedNode(this);
+
+    installDefaultOpacityShader();
+}
+
+Status
+ViewshedLayer::openImplementation()
+{
+    Status parent = VisibleLayer::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    createCameras();
+
+    osg::ref_ptr<MapNode> mapNode;
+    if (_mapNode.lock(mapNode))
+    {
+        setMapNode(mapNode.get());
+    }
+
+    return Status::NoError;
+}
+
+osg::Node*
+ViewshedLayer::getNode() const
+{
+    return _node.get();
+}
+
+void
+ViewshedLayer::setTerrainResources(TerrainResources* res)
+{
+    if (!res->reserveTextureImageUnitForLayer(_reservation, this, "Viewshed"))
+    {
+        setStatus(Status::ResourceUnavailable, "No texture image units available");
+        return;
+    }
+
+    if (_cubeMap.valid())
+    {
+        osg::StateSet* ss = getOrCreateStateSet();
+        ss->setTextureAttributeAndModes(_reservation.unit(), _cubeMap.get(), osg::StateAttribute::ON);
+        _samplerUniform->set(_reservation.unit());
+    }
+}
+
+void
+ViewshedLayer::createCameras()
+{
+    unsigned size = options().textureSize().get();
+
+    // Depth cube map around the observer, the point-light shadow map.
+    _cubeMap = new osg::TextureCubeMap();
+    _cubeMap->setTextureSize(size, size);
+    _cubeMap->setInternalFormat(GL_DEPTH_COMPONENT);
+    _cubeMap->setSourceFormat(GL_DEPTH_COMPONENT);
+    _cubeMap->setSourceType(GL_FLOAT);
+    _cubeMap->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _cubeMap->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+    _cubeMap->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _cubeMap->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _cubeMap->setWrap(osg::Texture::WRAP_R, osg::Texture::CLAMP_TO_EDGE);
+
+    _cameras.clear();
+
+    for (unsigned face = 0; face < 6; ++face)
+    {
+        osg::Camera* camera = new osg::Camera();
+        camera->setName("Viewshed");
+        camera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+        camera->setClearDepth(1.0);
+        camera->setClearMask(GL_DEPTH_BUFFER_BIT);
+        camera->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+        camera->setViewport(0, 0, size, size);
+        camera->setRenderOrder(osg::Camera::PRE_RENDER);
+        camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+        camera->setImplicitBufferAttachmentMask(0, 0);
+        camera->attach(osg::Camera::DEPTH_BUFFER, _cubeMap.get(), 0, face);
+        camera->setSmallFeatureCullingPixelSize(-1.0f);
+
+        // tells the terrain to render depth only
+        CameraUtils::setIsDepthCamera(camera);
+
+        osg::StateSet* ss = camera->getOrCreateStateSet();
+        ss->setMode(GL_BLEND, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+        ss->setAttributeAndModes(
+            new osg::PolygonMode(osg::PolygonMode::FRONT_AND_BACK, osg::PolygonMode::FILL),
+            osg::StateAttribute::ON | osg::StateAttribute::PROTECTED);
+
+        // cancel out any higher-up VP code (including this layer's)
+        VirtualProgram* vp = VirtualProgram::getOrCreate(ss);
+        vp->setName("Viewshed RTT");
+        vp->setInheritShaders(false);
+
+        _cameras.push_back(camera);
+    }
+
+    _dirty = true;
+}
+
+void
+ViewshedLayer::setMapNode(MapNode* mapNode)
+{
+    _mapNode = mapNode;
+
+    for (unsigned i = 0; i < _cameras.size(); ++i)
+    {
+        _cameras[i]->removeChildren(0, _cameras[i]->getNumChildren());
+        if (mapNode)
+        {
+            _cameras[i]->addChild(mapNode->getTerrainEngine());
+        }
+    }
+
+    _dirty = true;
+}
+
+void
+ViewshedLayer::updateUniforms()
+{
+    float radius = options().radius().get();
+
+    // near, far, radius
+    _rangeUniform->set(osg::Vec3f(1.0f, radius*1.1f, radius));
+    _visibleColorUniform->set(options().visibleColor().get());
+    _invisibleColorUniform->set(options().invisibleColor().get());
+}
+
+void
+ViewshedLayer::cull(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() != nv.CULL_VISITOR || !getVisible() || !options().observer().isSet())
+        return;
+
+    osg::ref_ptr<MapNode> mapNode;
+    if (!_mapNode.lock(mapNode) || _cameras.empty())
+        return;
+
+    // Re-render the cube map only when something changed. The terrain's
+    // revision advances as tiles load, which picks up higher-resolution
+    // data around the observer as it arrives.
+    unsigned revision = mapNode->getTerrain()->getRevision();
+    if (!_dirty && revision == _terrainRevision)
+        return;
+
+    osg::Vec3d eye;
+    if (!options().observer().get().toWorld(eye, mapNode->getTerrain()))
+        return;
+
+    // GL cube map face order and orientation
+    static const osg::Vec3d dirs[6] = {
+        osg::Vec3d( 1, 0, 0), osg::Vec3d(-1, 0, 0),
+        osg::Vec3d( 0, 1, 0), osg::Vec3d( 0,-1, 0),
+        osg::Vec3d( 0, 0, 1), osg::Vec3d( 0, 0,-1) };
+    static const osg::Vec3d ups[6] = {
+        osg::Vec3d( 0,-1, 0), osg::Vec3d( 0,-1, 0),
+        osg::Vec3d( 0, 0, 1), osg::Vec3d( 0, 0,-1),
+        osg::Vec3d( 0,-1, 0), osg::Vec3d( 0,-1, 0) };
+
+    float radius = options().radius().get();
+    for (unsigned face = 0; face < 6; ++face)
+    {
+        _cameras[face]->setViewMatrixAsLookAt(eye, eye + dirs[face], ups[face]);
+        _cameras[face]->setProjectionMatrixAsPerspective(90.0, 1.0, 1.0, radius*1.1);
+    }
+
+    _observerUniform->set(osg::Vec3f(eye));
+
+    for (unsigned face = 0; face < 6; ++face)
+    {
+        _cameras[face]->accept(nv);
+    }
+
+    _dirty = false;
+    _terrainRevision = revision;
+}
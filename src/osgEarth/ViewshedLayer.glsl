@@ -0,0 +1,54 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_name       Viewshed VS
+#pragma vp_entryPoint oe_viewshed_VS
+#pragma vp_location   vertex_view
+
+uniform mat4 osg_ViewMatrixInverse;
+uniform vec3 oe_viewshed_observer;
+
+// vector from the observer to the vertex (world axes)
+out vec3 oe_viewshed_vec;
+
+void oe_viewshed_VS(inout vec4 vertex)
+{
+    oe_viewshed_vec = (osg_ViewMatrixInverse * vertex).xyz - oe_viewshed_observer;
+}
+
+[break]
+
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_name       Viewshed FS
+#pragma vp_entryPoint oe_viewshed_FS
+#pragma vp_location   fragment_coloring
+
+uniform samplerCube oe_viewshed_map;
+uniform vec3 oe_viewshed_range; // near, far, radius
+uniform vec4 oe_viewshed_visibleColor;
+uniform vec4 oe_viewshed_invisibleColor;
+
+in vec3 oe_viewshed_vec;
+
+void oe_viewshed_FS(inout vec4 color)
+{
+    if (length(oe_viewshed_vec) > oe_viewshed_range.z)
+        discard;
+
+    // distance along the major axis is the eye depth in that face
+    vec3 a = abs(oe_viewshed_vec);
+    float depth = max(a.x, max(a.y, a.z));
+
+    // linearize the nearest occluder's depth from the cube map
+    float n = oe_viewshed_range.x;
+    float f = oe_viewshed_range.y;
+    float ndc = texture(oe_viewshed_map, oe_viewshed_vec).r * 2.0 - 1.0;
+    float occluder = 2.0*f*n / (f + n - ndc*(f - n));
+
+    // bias grows with distance to absorb depth quantization
+    float bias = max(2.0, 0.01*depth);
+
+    color = depth <= occluder + bias ? oe_viewshed_visibleColor : oe_viewshed_invisibleColor;
+}
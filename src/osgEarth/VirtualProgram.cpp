@@ -27,6 +27,7 @@
 #include <osgEarth/Containers>
 #include <osgEarth/Metrics>
 #include <osgEarth/Cache>
+#include <osgEarth/Config>
 #include <osg/Shader>
 #include <osg/Program>
 #include <osg/State>
@@ -34,11 +35,15 @@
 #include <osg/Version>
 #include <osg/GL2Extensions>
 #include <osg/GLExtensions>
+#include <osg/GraphicsContext>
+#include <osg/Timer>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <OpenThreads/Thread>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
 #include <stdlib.h> // getenv
 
 using namespace osgEarth;
@@ -59,6 +64,10 @@ using namespace osgEarth::ShaderComp;
 
 #define USE_PROGRAM_REPO
 
+// Look up programs by the revisions of the VPs on the attribute stack
+// before accumulating shaders
+#define USE_STACK_KEY
+
 // Without a program repo, we need to store a refptr to the actual Program somewhere.
 #ifndef USE_PROGRAM_REPO
 #define USE_LAST_USED_PROGRAM
@@ -84,7 +93,7 @@ using namespace osgEarth::ShaderComp;
 
 
 #ifdef USE_POLYSHADER_CACHE
-Threading::Mutex PolyShader::_cacheMutex;
+Threading::ReadWriteMutex PolyShader::_cacheMutex;
 PolyShader::PolyShaderCache PolyShader::_polyShaderCache;
 #endif
 
@@ -193,6 +202,9 @@ ProgramRepo::release(UID user, osg::State* state)
             // remove "user" from the users list:
             e->_users.erase(user);
 
+            // the context caches still list this user; invalidate them
+            ++_generation;
+
             //OE_TEST << LC << "PR REL prog=" << (e->_program.get()) << " user=" << (user) << " total=" << e->_users.size() << std::endl;
 
             if (e->_users.empty())
@@ -256,6 +268,48 @@ ProgramRepo::add(const ProgramKey& key, osg::ref_ptr<osg::Program>& in_out, unsi
     newEntry->_users.insert(user);
 }
 
+osg::ref_ptr<osg::Program>
+ProgramRepo::useFromContextCache(const ProgramKey& key, unsigned contextID, UID user)
+{
+    ContextCache& cache = _contextCaches[contextID];
+
+    unsigned generation = _generation;
+    if (cache._generation != generation)
+    {
+        cache._programs.clear();
+        cache._generation = generation;
+        return 0L;
+    }
+
+    std::map<ProgramKey, ContextCache::Entry>::const_iterator i = cache._programs.find(key);
+    if (i == cache._programs.end())
+        return 0L;
+
+    // A new user has to register with the repo, under the lock.
+    // Note: this path does not update the entry's last-used frame.
+    if (i->second._users.find(user) == i->second._users.end())
+        return 0L;
+
+    return i->second._program;
+}
+
+void
+ProgramRepo::addToContextCache(const ProgramKey& key, osg::Program* program, unsigned contextID, UID user)
+{
+    ContextCache& cache = _contextCaches[contextID];
+
+    unsigned generation = _generation;
+    if (cache._generation != generation)
+    {
+        cache._programs.clear();
+        cache._generation = generation;
+    }
+
+    ContextCache::Entry& entry = cache._programs[key];
+    entry._program = program;
+    entry._users.insert(user);
+}
+
 void
 ProgramRepo::prune(unsigned frameNumber, osg::State* state)
 {
@@ -265,6 +319,8 @@ ProgramRepo::prune(unsigned frameNumber, osg::State* state)
 void
 ProgramRepo::resizeGLObjectBuffers(unsigned maxSize)
 {
+    _contextCaches.resize(maxSize);
+
     for (ProgramMap::iterator i = _db.begin(); i != _db.end(); ++i)
     {
         i->second->_program->resizeGLObjectBuffers(maxSize);
@@ -275,6 +331,10 @@ void
 ProgramRepo::releaseGLObjects(osg::State* state) const
 {
     OE_TEST << LC << "Main release, size=" << _db.size() << std::endl;
+
+    // the context caches are cleared lazily by their own threads
+    ++_generation;
+
     // First try to find an entry with an equivalent program:
     for (ProgramMap::iterator i = _db.begin(); i != _db.end(); ++i)
     {
@@ -294,9 +354,11 @@ ProgramRepo::linkProgram(
 {
     OE_PROFILING_ZONE_NAMED("link");
 
+    osg::Timer_t startTime = osg::Timer::instance()->tick();
+    bool readFromCache = false;
+
     if (isProgramBinaryCachingActive())
     {
-        bool readFromCache = false;
         std::fstream fStream;
         std::string programCacheName;
 
@@ -325,12 +387,27 @@ ProgramRepo::linkProgram(
         programCacheNameStream << "_" << defineHash;
         programCacheNameStream << ".bin";
 
-        programCacheName = osgDB::concatPaths(
-            _programBinaryCacheFolder, 
-            osgEarth::toLegalFileName(programCacheNameStream.str(), false, "-"));
+        std::string programCacheFile = osgEarth::toLegalFileName(programCacheNameStream.str(), false, "-");
+        programCacheName = osgDB::concatPaths(_programBinaryCacheFolder, programCacheFile);
+
+        // A binary loaded by warmUp saves the trip to disk.
+        {
+            Threading::ScopedMutexLock lock(_warmUpMutex);
+            BinaryMap::iterator i = _warmBinaries.find(programCacheFile);
+            if (i != _warmBinaries.end())
+            {
+                program->setProgramBinary(i->second.get());
+                _warmBinaries.erase(i);
+                readFromCache = true;
+            }
+        }
 
         //currently set to be able to read and write to the binary file so only need to open file once.
-        fStream.open(programCacheName.c_str(), std::fstream::in | std::fstream::out | std::fstream::app | std::fstream::binary);
+        if (!readFromCache)
+        {
+            fStream.open(programCacheName.c_str(), std::fstream::in | std::fstream::out | std::fstream::app | std::fstream::binary);
+        }
+
         if (fStream.is_open())
         {
             // get length of file:
@@ -387,6 +464,9 @@ ProgramRepo::linkProgram(
                         fStream.write((char*)binary->getData(), binary->getSize());
                         fStream.close();
                         OE_DEBUG << LC << "Wrote a shader binary from the cache (" << programCacheName << ")" << std::endl;
+
+                        // so warmUp can build it in a later session
+                        recordProgram(programCacheFile, program, pcp, defineStr);
                     }
                     else
                     {
@@ -404,11 +484,313 @@ ProgramRepo::linkProgram(
                 remove(programCacheName.c_str());
             }
         }
+        else if (readFromCache && !pcp->isLinked())
+        {
+            // warm binary was rejected; rebuild it next time
+            OE_WARN << LC << "Failed to link program binary (" << programCacheName << ")" << std::endl;
+            remove(programCacheName.c_str());
+        }
     }
     else
     {
         program->compileGLObjects(state);
     }
+
+    if (!readFromCache)
+    {
+        double ms = osg::Timer::instance()->delta_m(startTime, osg::Timer::instance()->tick());
+
+        ColdLink coldLink;
+        coldLink._name = program->getName();
+        coldLink._milliseconds = ms;
+
+        Threading::ScopedMutexLock lock(_warmUpMutex);
+        _coldLinks.push_back(coldLink);
+
+        OE_DEBUG << LC << "Cold link of " << program->getName() << " took " << ms << " ms" << std::endl;
+    }
+}
+
+namespace
+{
+    // Extension of the files that record the source of each cached binary
+    const char* PROGRAM_RECORD_EXTENSION = "program";
+
+    // Inserts the define string after the #version line, like osg::Shader does
+    std::string insertDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty())
+            return source;
+
+        std::string::size_type pos = source.find("#version");
+        if (pos != std::string::npos)
+        {
+            std::string::size_type eol = source.find('\n', pos);
+            if (eol != std::string::npos)
+                return source.substr(0, eol + 1) + defines + source.substr(eol + 1);
+        }
+        return defines + source;
+    }
+}
+
+void
+ProgramRepo::recordProgram(
+    const std::string& binaryFile,
+    osg::Program* program,
+    osg::Program::PerContextProgram* pcp,
+    const std::string& defines)
+{
+    Config conf("program");
+    conf.set("name", program->getName());
+    conf.set("binary", binaryFile);
+    conf.set("defines", defines);
+
+    for (unsigned i = 0; i < program->getNumShaders(); ++i)
+    {
+        const osg::Shader* shader = program->getShader(i);
+        Config shaderConf("shader");
+        shaderConf.set("type", std::string(shader->getTypename()));
+        shaderConf.set("source", shader->getShaderSource());
+        conf.add(shaderConf);
+    }
+
+    // the actual attribute locations, so a rebuilt binary matches this one
+    const osg::Program::ActiveVarInfoMap& attribs = pcp->getActiveAttribs();
+    for (osg::Program::ActiveVarInfoMap::const_iterator i = attribs.begin(); i != attribs.end(); ++i)
+    {
+        if (i->second._location >= 0)
+        {
+            Config attribConf("attribute");
+            attribConf.set("name", i->first);
+            attribConf.set("location", i->second._location);
+            conf.add(attribConf);
+        }
+    }
+
+    const osg::Program::FragDataBindingList& fragData = program->getFragDataBindingList();
+    for (osg::Program::FragDataBindingList::const_iterator i = fragData.begin(); i != fragData.end(); ++i)
+    {
+        Config fragConf("frag_data");
+        fragConf.set("name", i->first);
+        fragConf.set("location", i->second);
+        conf.add(fragConf);
+    }
+
+    std::string recordName = osgDB::concatPaths(
+        _programBinaryCacheFolder,
+        osgDB::getNameLessExtension(binaryFile) + "." + PROGRAM_RECORD_EXTENSION);
+
+    std::ofstream out(recordName.c_str());
+    if (out.is_open())
+    {
+        out << conf.toJSON(false);
+    }
+}
+
+struct ProgramRepo::WarmUpOperation : public osg::Operation
+{
+    WarmUpOperation(ProgramRepo* repo, osg::GraphicsContext* gc) :
+        osg::Operation("ProgramRepo warm-up", false),
+        _repo(repo),
+        _gc(gc)
+    {
+    }
+
+    void operator()(osg::Object*)
+    {
+        _repo->warmUpImplementation(_gc.get());
+    }
+
+    ProgramRepo* _repo;
+    osg::ref_ptr<osg::GraphicsContext> _gc;
+};
+
+void
+ProgramRepo::warmUp(osg::GraphicsContext* gc)
+{
+    if (!isProgramBinaryCachingActive())
+    {
+        OE_WARN << LC << "Program warm-up requires a program binary cache location" << std::endl;
+        return;
+    }
+
+    Threading::ScopedMutexLock lock(_warmUpMutex);
+    if (!_warmUpPool.valid())
+        _warmUpPool = new Threading::ThreadPool(1u);
+
+    _warmUpPool->getQueue()->add(new WarmUpOperation(this, gc));
+}
+
+void
+ProgramRepo::warmUpImplementation(osg::GraphicsContext* gc)
+{
+    OE_PROFILING_ZONE_NAMED("ProgramRepo warm-up");
+
+    osg::Timer_t startTime = osg::Timer::instance()->tick();
+
+    osgDB::DirectoryContents files = osgDB::getDirectoryContents(_programBinaryCacheFolder);
+
+    // The graphics context for building missing binaries; created on demand.
+    osg::ref_ptr<osg::GraphicsContext> pbuffer;
+    bool pbufferFailed = false;
+
+    unsigned numLoaded = 0u, numBuilt = 0u;
+
+    for (osgDB::DirectoryContents::const_iterator f = files.begin(); f != files.end(); ++f)
+    {
+        if (osgDB::getLowerCaseFileExtension(*f) != PROGRAM_RECORD_EXTENSION)
+            continue;
+
+        std::ifstream in(osgDB::concatPaths(_programBinaryCacheFolder, *f).c_str());
+        if (!in.is_open())
+            continue;
+
+        std::stringstream buf;
+        buf << in.rdbuf();
+        Config conf;
+        if (!conf.fromJSON(buf.str()))
+            continue;
+
+        std::string binaryFile = conf.value("binary");
+        std::string binaryName = osgDB::concatPaths(_programBinaryCacheFolder, binaryFile);
+
+        osg::ref_ptr<osg::Program::ProgramBinary> binary;
+
+        // Read an existing binary into memory:
+        std::ifstream binIn(binaryName.c_str(), std::ifstream::binary);
+        if (binIn.is_open())
+        {
+            binIn.seekg(0, binIn.end);
+            int length = binIn.tellg();
+            binIn.seekg(0, binIn.beg);
+
+            if (length > (int)sizeof(GLenum))
+            {
+                unsigned char* buffer = new unsigned char[length - sizeof(GLenum)];
+                GLenum format;
+                binIn.read((char*)&format, sizeof(GLenum));
+                binIn.read((char*)buffer, length - sizeof(GLenum));
+
+                binary = new osg::Program::ProgramBinary();
+                binary->setFormat(format);
+                binary->assign(length - sizeof(GLenum), buffer);
+                delete [] buffer;
+                ++numLoaded;
+            }
+            binIn.close();
+        }
+
+        // Or build it from the recorded source:
+        if (!binary.valid() && gc && !pbufferFailed)
+        {
+            if (!pbuffer.valid())
+            {
+                osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits();
+                if (gc->getTraits())
+                {
+                    traits->displayNum = gc->getTraits()->displayNum;
+                    traits->screenNum = gc->getTraits()->screenNum;
+                    traits->glContextVersion = gc->getTraits()->glContextVersion;
+                    traits->glContextProfileMask = gc->getTraits()->glContextProfileMask;
+                }
+                traits->x = 0;
+                traits->y = 0;
+                traits->width = 1;
+                traits->height = 1;
+                traits->windowDecoration = false;
+                traits->doubleBuffer = false;
+                traits->pbuffer = true;
+
+                pbuffer = osg::GraphicsContext::createGraphicsContext(traits.get());
+                if (pbuffer.valid() && pbuffer->realize() && pbuffer->makeCurrent())
+                {
+                    pbuffer->getState()->initializeExtensionProcs();
+                }
+                else
+                {
+                    OE_WARN << LC << "Failed to create a graphics context for program warm-up" << std::endl;
+                    pbuffer = 0L;
+                    pbufferFailed = true;
+                    continue;
+                }
+            }
+
+            osg::State& state = *pbuffer->getState();
+            std::string defines = conf.value("defines");
+
+            osg::ref_ptr<osg::Program> program = new osg::Program();
+            program->setName(conf.value("name"));
+
+            const ConfigSet shaders = conf.children("shader");
+            for (ConfigSet::const_iterator s = shaders.begin(); s != shaders.end(); ++s)
+            {
+                osg::Shader::Type type = osg::Shader::getTypeId(s->value("type"));
+                program->addShader(new osg::Shader(type, insertDefines(s->value("source"), defines)));
+            }
+
+            const ConfigSet attribs = conf.children("attribute");
+            for (ConfigSet::const_iterator a = attribs.begin(); a != attribs.end(); ++a)
+            {
+                program->addBindAttribLocation(a->value("name"), a->value("location", 0));
+            }
+
+            const ConfigSet fragData = conf.children("frag_data");
+            for (ConfigSet::const_iterator d = fragData.begin(); d != fragData.end(); ++d)
+            {
+                program->addBindFragDataLocation(d->value("name"), d->value("location", 0));
+            }
+
+            // request a retrievable binary
+            program->setProgramBinary(new osg::Program::ProgramBinary());
+            program->compileGLObjects(state);
+
+            osg::Program::PerContextProgram* pcp = program->getPCP(state);
+            if (pcp && pcp->isLinked())
+            {
+                binary = pcp->compileProgramBinary(state);
+                if (binary.valid() && binary->getSize() > 0)
+                {
+                    std::ofstream out(binaryName.c_str(), std::ofstream::binary);
+                    GLenum format = binary->getFormat();
+                    out.write((char*)&format, sizeof(GLenum));
+                    out.write((char*)binary->getData(), binary->getSize());
+                    ++numBuilt;
+                }
+                else
+                {
+                    binary = 0L;
+                }
+            }
+            else
+            {
+                OE_WARN << LC << "Warm-up failed to link " << program->getName() << std::endl;
+            }
+
+            program->releaseGLObjects(&state);
+        }
+
+        if (binary.valid())
+        {
+            Threading::ScopedMutexLock lock(_warmUpMutex);
+            _warmBinaries[binaryFile] = binary.get();
+        }
+    }
+
+    if (pbuffer.valid())
+    {
+        pbuffer->releaseContext();
+        pbuffer->close();
+    }
+
+    OE_INFO << LC << "Warm-up loaded " << numLoaded << " and built " << numBuilt << " program binaries in "
+        << osg::Timer::instance()->delta_s(startTime, osg::Timer::instance()->tick()) << " s" << std::endl;
+}
+
+void
+ProgramRepo::getColdLinks(std::vector<ColdLink>& out) const
+{
+    Threading::ScopedMutexLock lock(_warmUpMutex);
+    out = _coldLinks;
 }
 
 //------------------------------------------------------------------------
@@ -949,6 +1331,38 @@ VirtualProgram::setProgramBinaryCacheLocation(const std::string& folder)
     Registry::programRepo().setProgramBinaryCacheLocation(folder);
 }
 
+void
+VirtualProgram::warmUpPrograms(osg::GraphicsContext* gc)
+{
+    Registry::programRepo().warmUp(gc);
+}
+
+namespace
+{
+    bool slowerLink(const ProgramRepo::ColdLink& lhs, const ProgramRepo::ColdLink& rhs)
+    {
+        return lhs._milliseconds > rhs._milliseconds;
+    }
+}
+
+std::string
+VirtualProgram::getColdLinkReport()
+{
+    std::vector<ProgramRepo::ColdLink> links;
+    Registry::programRepo().getColdLinks(links);
+    std::sort(links.begin(), links.end(), slowerLink);
+
+    double total = 0.0;
+    std::stringstream buf;
+    for (unsigned i = 0; i < links.size(); ++i)
+    {
+        buf << std::fixed << std::setprecision(1) << links[i]._milliseconds << " ms  " << links[i]._name << "\n";
+        total += links[i]._milliseconds;
+    }
+    buf << links.size() << " cold links, " << std::fixed << std::setprecision(1) << total << " ms total\n";
+    return buf.str();
+}
+
 //------------------------------------------------------------------------
 
 VirtualProgram::VirtualProgram(unsigned mask) :
@@ -959,7 +1373,9 @@ VirtualProgram::VirtualProgram(unsigned mask) :
     _logShaders(false),
     _logPath(""),
     _acceptCallbacksVaryPerFrame(false),
-    _isAbstract(false)
+    _isAbstract(false),
+    _revision(0u),
+    _hasAcceptCallbacks(false)
 {
     // Note: we cannot set _active here. Wait until apply().
     // It will cause a conflict in the Registry.
@@ -1013,7 +1429,9 @@ VirtualProgram::VirtualProgram(const VirtualProgram& rhs, const osg::CopyOp& cop
     _logPath(rhs._logPath),
     _template(osg::clone(rhs._template.get())),
     _acceptCallbacksVaryPerFrame(rhs._acceptCallbacksVaryPerFrame),
-    _isAbstract(rhs._isAbstract)
+    _isAbstract(rhs._isAbstract),
+    _revision(0u),
+    _hasAcceptCallbacks(rhs._hasAcceptCallbacks)
 {
     _id = osgEarth::Registry::instance()->createUID();
 
@@ -1112,6 +1530,8 @@ VirtualProgram::addBindAttribLocation(const std::string& name, GLuint index)
     _attribBindingList[name] = index;
 #endif
 
+    dirtyContribution();
+
     _dataModelMutex.unlock();
 }
 
@@ -1129,6 +1549,8 @@ VirtualProgram::removeBindAttribLocation(const std::string& name)
     _attribBindingList.erase(name);
 #endif
 
+    dirtyContribution();
+
     _dataModelMutex.unlock();
 }
 
@@ -1153,6 +1575,10 @@ VirtualProgram::resizeGLObjectBuffers(unsigned maxSize)
     Registry::programRepo().unlock();
 #endif
 
+#ifdef USE_STACK_KEY
+    _stackKeyCache.resize(maxSize);
+#endif
+
     // Resize shaders in the PolyShader
     for (ShaderMap::iterator i = _shaderMap.begin(); i != _shaderMap.end(); ++i)
     {
@@ -1195,6 +1621,10 @@ VirtualProgram::releaseGLObjects(osg::State* state) const
     }
     _lastUsedProgram.setAllElementsTo(NULL);
 #endif
+
+#ifdef USE_STACK_KEY
+    _stackKeyCache.setAllElementsTo(StackKeyCache());
+#endif
 }
 
 PolyShader*
@@ -1240,6 +1670,8 @@ VirtualProgram::setShader(const std::string&                 shaderID,
         entry._overrideValue = ov;
         entry._accept = 0L;
 
+        dirtyContribution();
+
         _dataModelMutex.unlock();
     }
 
@@ -1280,6 +1712,8 @@ VirtualProgram::setShader(osg::Shader*                       shader,
         entry._overrideValue = ov;
         entry._accept = 0L;
 
+        dirtyContribution();
+
         _dataModelMutex.unlock();
     }
 
@@ -1347,6 +1781,11 @@ VirtualProgram::setFunction(const std::string&           functionName,
         entry._overrideValue = osg::StateAttribute::ON;
         entry._accept = accept;
 
+        if (accept)
+            _hasAcceptCallbacks = true;
+
+        dirtyContribution();
+
         _dataModelMutex.unlock();
 
     } // release lock
@@ -1357,6 +1796,7 @@ VirtualProgram::addGLSLExtension(const std::string& extension)
 {
     _dataModelMutex.lock();
     std::pair<ExtensionsSet::const_iterator, bool> insertPair = _globalExtensions.insert(extension);
+    dirtyContribution();
     _dataModelMutex.unlock();
     return insertPair.second;
 }
@@ -1375,6 +1815,7 @@ VirtualProgram::removeGLSLExtension(const std::string& extension)
 {
     _dataModelMutex.lock();
     ExtensionsSet::size_type erased = _globalExtensions.erase(extension);
+    dirtyContribution();
     _dataModelMutex.unlock();
     return erased > 0;
 }
@@ -1387,6 +1828,8 @@ VirtualProgram::removeShader(const std::string& shaderID)
 
     _shaderMap.erase(MAKE_SHADER_ID(shaderID));
 
+    dirtyContribution();
+
     for (FunctionLocationMap::iterator i = _functions.begin(); i != _functions.end(); ++i)
     {
         OrderedFunctionMap& ofm = i->second;
@@ -1416,6 +1859,10 @@ VirtualProgram::setInheritShaders(bool value)
     {
         _inherit = value;
 
+        _dataModelMutex.lock();
+        dirtyContribution();
+        _dataModelMutex.unlock();
+
 #ifdef USE_PROGRAM_REPO
         // clear the program cache please
         {
@@ -1506,6 +1953,37 @@ VirtualProgram::apply(osg::State& state) const
     // exclude shaders based on any condition.
     bool acceptCallbacksVary = _acceptCallbacksVaryPerFrame;
     ProgramKey key;
+
+#ifdef USE_STACK_KEY
+    // Identify the accumulation by the identity and revision of each
+    // contributing VP. If an earlier apply saw the same stack, reuse its
+    // program and skip the accumulation and the repo lookup.
+    StackKey stackKey;
+    unsigned stackHash = 0u;
+    bool useStackKey = !program.valid() && makeStackKey(state, stackKey, stackHash);
+    if (useStackKey)
+    {
+        StackKeyCache& cache = _stackKeyCache[contextID];
+
+        // a repo release may have invalidated the remembered programs
+        unsigned generation = Registry::programRepo().getGeneration();
+        if (cache.generation != generation)
+        {
+            cache.entries.clear();
+            cache.generation = generation;
+        }
+        else
+        {
+            std::map<unsigned, StackKeyEntry>::const_iterator i = cache.entries.find(stackHash);
+            if (i != cache.entries.end() && i->second.stackKey == stackKey)
+            {
+                program = i->second.program;
+                key = i->second.programKey;
+            }
+        }
+    }
+#endif
+
     if (!program.valid())
     {
 #ifdef PREALLOCATE_APPLY_VARS
@@ -1590,10 +2068,22 @@ VirtualProgram::apply(osg::State& state) const
         unsigned frameNumber = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0;
 
 #ifdef USE_PROGRAM_REPO
-        // LOCK the program repo to look up the program.
-        Registry::programRepo().lock();
+        // Check this context's private copy of the repo first; it takes no lock.
+        program = Registry::programRepo().useFromContextCache(local.programKey, contextID, _id);
+        bool fromContextCache = program.valid();
+
+        // buildProgram regenerates the key, so keep the one we looked up with
+        ProgramKey lookupKey;
+
+        if (!fromContextCache)
+        {
+            lookupKey = local.programKey;
 
-        program = Registry::programRepo().use(local.programKey, frameNumber, _id);
+            // LOCK the program repo to look up the program.
+            Registry::programRepo().lock();
+
+            program = Registry::programRepo().use(local.programKey, frameNumber, _id);
+        }
 #endif
 
         if (!program.valid())
@@ -1654,8 +2144,32 @@ VirtualProgram::apply(osg::State& state) const
             Registry::programRepo().prune(frameNumber, &state);
 #endif
         }
-        Registry::programRepo().unlock();
+
+#ifdef USE_PROGRAM_REPO
+        if (!fromContextCache)
+        {
+            // publish to this context's cache so the next lookup skips the lock
+            if (program.valid())
+                Registry::programRepo().addToContextCache(lookupKey, program.get(), contextID, _id);
+
+            Registry::programRepo().unlock();
+        }
+#endif
         key = local.programKey;
+
+#ifdef USE_STACK_KEY
+        if (useStackKey && program.valid())
+        {
+            StackKeyCache& cache = _stackKeyCache[contextID];
+            if (cache.entries.size() >= MAX_PROGRAM_CACHE_SIZE)
+                cache.entries.clear();
+
+            StackKeyEntry& entry = cache.entries[stackHash];
+            entry.stackKey = stackKey;
+            entry.programKey = key;
+            entry.program = program;
+        }
+#endif
     }
 
     // finally, apply the program attribute.
@@ -1964,6 +2478,75 @@ VirtualProgram::accumulateShaders(const osg::State&  state,
     }
 }
 
+bool
+VirtualProgram::makeStackKey(const osg::State& state, StackKey& out, unsigned& hash) const
+{
+    // Accept callbacks make the accumulation depend on more than the stack.
+    if (_acceptCallbacksVaryPerFrame || _hasAcceptCallbacks)
+        return false;
+
+    out.clear();
+
+    if (_inherit)
+    {
+        const AttrStack* av = StateEx::getProgramStack(state);
+        if (av && av->size() > 0)
+        {
+            // same walk as accumulateShaders:
+            unsigned start = 0;
+            const osg::StateAttribute* sa;
+            for (start = (int)av->size() - 1; start > 0; --start)
+            {
+                sa = (*av)[start].first;
+#ifdef USE_TYPEID
+                if (typeid(*sa) != typeid(VirtualProgram))
+                    continue;
+                const VirtualProgram* vp = static_cast<const VirtualProgram*>(sa);
+#else
+                const VirtualProgram* vp = dynamic_cast<const VirtualProgram*>(sa);
+                if (!vp)
+                    continue;
+#endif
+                if ((vp->_mask & _mask) && vp->_inherit == false)
+                    break;
+            }
+
+            for (unsigned i = start; i < av->size(); ++i)
+            {
+                sa = (*av)[i].first;
+#ifdef USE_TYPEID
+                if (typeid(*sa) != typeid(VirtualProgram))
+                    continue;
+                const VirtualProgram* vp = static_cast<const VirtualProgram*>(sa);
+#else
+                const VirtualProgram* vp = dynamic_cast<const VirtualProgram*>(sa);
+                if (!vp)
+                    continue;
+#endif
+                if (vp->_mask & _mask)
+                {
+                    if (vp->_acceptCallbacksVaryPerFrame || vp->_hasAcceptCallbacks)
+                        return false;
+
+                    out.push_back(std::make_pair(vp->_id, vp->_revision));
+                }
+            }
+        }
+    }
+
+    out.push_back(std::make_pair(_id, _revision));
+
+    hash = 0u;
+    for (StackKey::const_iterator i = out.begin(); i != out.end(); ++i)
+    {
+        //same as boost hash_combine
+        hash ^= (unsigned)i->first + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        hash ^= i->second + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+
+    return true;
+}
+
 void
 VirtualProgram::addShadersToAccumulationMap(VirtualProgram::ShaderMap& accumMap,
     const osg::State&          state) const
@@ -2230,15 +2813,18 @@ PolyShader::lookUpShader(const std::string& functionName, const std::string& sha
 
 #ifdef USE_POLYSHADER_CACHE
 
-    Threading::ScopedMutexLock lock(_cacheMutex);
-
     std::pair<std::string, std::string> hashKey = std::pair<std::string, std::string>(functionName, shaderSource);
 
-    PolyShaderCache::iterator iter = _polyShaderCache.find(hashKey);
-
-    if (iter != _polyShaderCache.end())
+    // Lookups vastly outnumber insertions, so readers share the lock.
     {
-        shader = iter->second.get();
+        Threading::ScopedReadLock lock(_cacheMutex);
+
+        PolyShaderCache::iterator iter = _polyShaderCache.find(hashKey);
+
+        if (iter != _polyShaderCache.end())
+        {
+            shader = iter->second.get();
+        }
     }
 #endif
 
@@ -2249,14 +2835,22 @@ PolyShader::lookUpShader(const std::string& functionName, const std::string& sha
         std::string source(shaderSource);
         osgEarth::replaceIn(source, "\"", " ");
 
-        shader = new PolyShader();
-        shader->setName(functionName);
-        shader->setLocation(location);
-        shader->setShaderSource(source);
-        shader->prepare();
+        osg::ref_ptr<PolyShader> newShader = new PolyShader();
+        newShader->setName(functionName);
+        newShader->setLocation(location);
+        newShader->setShaderSource(source);
+        newShader->prepare();
 
 #ifdef USE_POLYSHADER_CACHE
-        _polyShaderCache[hashKey] = shader;
+        Threading::ScopedWriteLock lock(_cacheMutex);
+
+        // another thread may have published the same shader in the meantime
+        osg::ref_ptr<PolyShader>& cached = _polyShaderCache[hashKey];
+        if (!cached.valid())
+            cached = newShader.get();
+        shader = cached.get();
+#else
+        shader = newShader.release();
 #endif
     }
 
@@ -2267,7 +2861,7 @@ PolyShader::lookUpShader(const std::string& functionName, const std::string& sha
 void PolyShader::clearShaderCache()
 {
     /* MERGE: does this compile? hm, we need to redo this for glen's changes */
-    _cacheMutex.lock();
+    _cacheMutex.writeLock();
     // Erase our PolyShaders from the static
     // _shaderCache
     PolyShaderCache::iterator shadeEnd = _polyShaderCache.end();
@@ -2277,7 +2871,7 @@ void PolyShader::clearShaderCache()
     {
         shadeItr->second = NULL;
     }
-    _cacheMutex.unlock();
+    _cacheMutex.writeUnlock();
 }
 
 //.......................................................................
@@ -507,26 +507,12 @@ WFSFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* prog
 {
     FeatureCursor* result = 0L;
 
-    std::string url = createURL(query);
-
-    OE_DEBUG << LC << url << std::endl;
-    URI uri(url, options().url()->context());
-
-    // read the data:
-    ReadResult r = uri.readString(getReadOptions(), progress);
-
-    const std::string& buffer = r.getString();
-    const Config&      meta = r.metadata();
-
-    bool dataOK = false;
-
+    // Tile queries go through the tile pipeline so that neighbors
+    // prefetch and parsed results cache; anything else reads directly.
     FeatureList features;
-    if (!buffer.empty())
-    {
-        // Get the mime-type from the metadata record if possible
-        const std::string& mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
-        dataOK = getFeatures(buffer, mimeType, features);
-    }
+    bool dataOK = query.tileKey().isSet() ?
+        readTile(query.tileKey().get(), features, progress) :
+        readFeatures(query, features, progress);
 
     if (dataOK)
     {
@@ -560,4 +546,32 @@ WFSFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* prog
     result = dataOK ? new FeatureListCursor(features) : 0L;
 
     return result;
-}
\ No newline at end of file
+}
+
+bool
+WFSFeatureSource::fetchTile(const TileKey& key, FeatureList& features, ProgressCallback* progress)
+{
+    Query query;
+    query.tileKey() = key;
+    return readFeatures(query, features, progress);
+}
+
+bool
+WFSFeatureSource::readFeatures(const Query& query, FeatureList& features, ProgressCallback* progress)
+{
+    std::string url = createURL(query);
+
+    OE_DEBUG << LC << url << std::endl;
+    URI uri(url, options().url()->context());
+
+    // read the data:
+    ReadResult r = uri.readString(getReadOptions(), progress);
+
+    const std::string& buffer = r.getString();
+    if (buffer.empty())
+        return false;
+
+    // Get the mime-type from the metadata record if possible
+    const std::string& mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
+    return getFeatures(buffer, mimeType, features);
+}
@@ -21,7 +21,6 @@
 #include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
 #include <osgEarth/Registry>
-#include <osg/ImageSequence>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
 
@@ -381,6 +380,7 @@ WMS::WMSImageLayerOptions::getConfig() const
     conf.set("transparent", _transparent);
     conf.set("times", _times);
     conf.set("seconds_per_frame", _secondsPerFrame);
+    conf.set("prefetch_frames", _prefetchFrames);
     return conf;
 }
 
@@ -390,6 +390,7 @@ WMS::WMSImageLayerOptions::fromConfig(const Config& conf)
     _wmsVersion.init("1.1.1");
     _transparent.init(true);
     _secondsPerFrame.init(1.0);
+    _prefetchFrames.init(3u);
 
     conf.get("url", _url);
     conf.get("capabilities_url", _capabilitiesUrl);
@@ -404,22 +405,30 @@ WMS::WMSImageLayerOptions::fromConfig(const Config& conf)
     conf.get("times", _times);
     conf.get("time", _times); // alternative
     conf.get("seconds_per_frame", _secondsPerFrame);
+    conf.get("prefetch_frames", _prefetchFrames);
 }
 
 //........................................................................
 
 namespace osgEarth {  namespace WMS
 {
-    // All looping ImageSequences deriving from this class will be in sync due to
-    // a shared reference time.
-    struct SyncImageSequence : public osg::ImageSequence
+    // Loads one WMS-T frame of a tile. Each frame is a separate request
+    // with its own TIME parameter, so the cache keys them by time as well.
+    struct TimeStepSource : public TimeSeriesImage::Source
     {
-        SyncImageSequence() : osg::ImageSequence() { }
-        virtual void update(osg::NodeVisitor* nv)
+        TimeStepSource(Driver* driver) : _driver(driver) { }
+
+        osg::Image* loadStep(const TileKey& key, unsigned step, ProgressCallback* progress)
         {
-            setReferenceTime( 0.0 );
-            osg::ImageSequence::update( nv );
+            osg::ref_ptr<Driver> driver;
+            if (!_driver.lock(driver) || step >= driver->_timesVec.size())
+                return 0L;
+
+            ReadResult response;
+            return driver->fetchTileImage(key, std::string("TIME=") + driver->_timesVec[step], progress, response);
         }
+
+        osg::observer_ptr<Driver> _driver;
     };
 } } // namespace osgEarth::WMS
 
@@ -456,6 +465,12 @@ WMS::Driver::open(osg::ref_ptr<const Profile>& profile,
             _seqFrameInfoVec.push_back(SequenceFrameInfo());
             _seqFrameInfoVec.back().timeIdentifier = _timesVec[i];
         }
+
+        if (_timesVec.size() > 1)
+        {
+            _timeSeries = new TimeStepSource(this);
+            _timeSeries->setPlaying(_sequence->isSequencePlaying());
+        }
     }
 
     // localize it since we might override them:
@@ -661,38 +676,26 @@ WMS::Driver::createImage(const TileKey& key, ProgressCallback* progress)
 }
 
 
-//! Creates an image from timestamped data
+//! Creates an image from timestamped data. Only the current frame loads
+//! here; the image fetches the frames that follow in the background.
 osg::Image*
 WMS::Driver::createImageSequence(const TileKey& key, ProgressCallback* progress)
 {
-    osg::ref_ptr< osg::ImageSequence > seq = new SyncImageSequence();
+    osg::ref_ptr<TimeSeriesImage> image = new TimeSeriesImage(
+        key,
+        _timesVec.size(),
+        options().secondsPerFrame().value(),
+        _timeSeries.get());
 
-    seq->setLoopingMode(osg::ImageStream::LOOPING);
-    seq->setLength(options().secondsPerFrame().value() * (double)_timesVec.size());
-    if (_sequence->isSequencePlaying())
-        seq->play();
+    image->setPrefetchSteps(options().prefetchFrames().value());
 
-    for (unsigned int r = 0; r < _timesVec.size(); ++r)
-    {
-        std::string extraAttrs = std::string("TIME=") + _timesVec[r];
-
-        ReadResult response;
-        osg::ref_ptr<osg::Image> image = fetchTileImage(key, extraAttrs, progress, response);
-        if (image.get())
-        {
-            seq->addImage(image);
-        }
-    }
-
-    // Just return an empty image if we didn't get any images
-    unsigned size = seq->getNumImageData();
-
-    if (size == 0)
+    // Just return an empty image if we didn't get the first frame
+    if (!image->initialize(progress))
     {
         return ImageUtils::createEmptyImage();
     }
 
-    return seq.release();
+    return image.release();
 }
 
 //! Generates a URI for a tile key using the WMS request prototype
@@ -732,6 +735,9 @@ WMS::Driver::getCurrentSequenceFrameIndex(const osg::FrameStamp* fs, double seco
     if (_seqFrameInfoVec.size() == 0)
         return 0;
 
+    if (_timeSeries.valid() && !_timeSeries->isPlaying())
+        return _timeSeries->getCurrentStep();
+
     double len = secondsPerFrame * (double)_timesVec.size();
     double t = fmod(fs->getSimulationTime(), len) / len;
     return osg::clampBetween(
@@ -755,6 +761,7 @@ OE_LAYER_PROPERTY_IMPL(WMSImageLayer, std::string, CRS, crs);
 OE_LAYER_PROPERTY_IMPL(WMSImageLayer, bool, Transparent, transparent);
 OE_LAYER_PROPERTY_IMPL(WMSImageLayer, std::string, Times, times);
 OE_LAYER_PROPERTY_IMPL(WMSImageLayer, double, SecondsPerFrame, secondsPerFrame);
+OE_LAYER_PROPERTY_IMPL(WMSImageLayer, unsigned, PrefetchFrames, prefetchFrames);
 
 
 void
@@ -816,21 +823,32 @@ void
 WMSImageLayer::playSequence()
 {
     _isPlaying = true;
+
+    WMS::Driver* driver = static_cast<WMS::Driver*>(_driver.get());
+    if (driver && driver->getTimeSeries())
+        driver->getTimeSeries()->setPlaying(true);
 }
 
 /** Stops playback */
 void
 WMSImageLayer::pauseSequence()
 {
-    //todo
     _isPlaying = false;
+
+    WMS::Driver* driver = static_cast<WMS::Driver*>(_driver.get());
+    if (driver && driver->getTimeSeries())
+        driver->getTimeSeries()->setPlaying(false);
 }
 
 /** Seek to a specific frame */
 void
 WMSImageLayer::seekToSequenceFrame(unsigned frame)
 {
-    //todo
+    // Only takes effect while paused; during playback the frame
+    // follows the clock.
+    WMS::Driver* driver = static_cast<WMS::Driver*>(_driver.get());
+    if (driver && driver->getTimeSeries() && frame < driver->getSequenceFrameInfo().size())
+        driver->getTimeSeries()->setCurrentStep(frame);
 }
 
 /** Whether the object is in playback mode */
@@ -0,0 +1,42 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#extension GL_ARB_draw_instanced: enable
+
+#pragma vp_name Wire Lines Catenary Model
+#pragma vp_entryPoint oe_WireLine_Catenary_VS_MODEL
+#pragma vp_location vertex_model
+#pragma vp_order first
+
+// Four texels per span. The xyz parts are the catenary frame (X axis,
+// Y axis, Z axis, origin); the w parts are the curve parameters
+// z = a * cosh((x + x1) / a) + C and the horizontal length d.
+uniform samplerBuffer oe_WireLine_spans;
+
+vec3 vp_Normal;
+
+// Each instance draws one span. In the pattern, x runs from 0 to 1
+// along the span and y is the angle around the wire; the wire lines
+// stage then pushes each vertex out along vp_Normal.
+void oe_WireLine_Catenary_VS_MODEL(inout vec4 vertex)
+{
+    int i = gl_InstanceID * 4;
+    vec4 X = texelFetch(oe_WireLine_spans, i);
+    vec4 Y = texelFetch(oe_WireLine_spans, i + 1);
+    vec4 Z = texelFetch(oe_WireLine_spans, i + 2);
+    vec4 O = texelFetch(oe_WireLine_spans, i + 3);
+
+    float a = X.w, x1 = Y.w, C = Z.w, d = O.w;
+
+    float x = vertex.x * d;
+    float z = a * cosh((x + x1) / a) + C;
+
+    // ring around the tangent (1, 0, dz/dx)
+    float slope = sinh((x + x1) / a);
+    vec3 up = normalize(vec3(-slope, 0.0, 1.0));
+    vec3 n = cos(vertex.y) * up + sin(vertex.y) * vec3(0.0, 1.0, 0.0);
+
+    mat3 frame = mat3(X.xyz, Y.xyz, Z.xyz);
+    vertex = vec4(frame * vec3(x, 0.0, z) + O.xyz, 1.0);
+    vp_Normal = frame * n;
+}
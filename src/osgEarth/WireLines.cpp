@@ -1,15 +1,20 @@
 #include <osgEarth/WireLines>
 #include <osgEarth/Array>
 #include <osgEarth/Math>
+#include <osgEarth/Registry>
 #include <osgEarth/Shaders>
 #include <osgEarth/VirtualProgram>
 
 #include <osg/Multisample>
+#include <osg/TextureBuffer>
 #include <osg/Math>
 #include <osg/Quat>
 
 using namespace osgEarth;
 
+// static texture unit binding. Changable by the user.
+int WireLinesOperator::CatenaryBufferUnit = 14;
+
 WireLinesOperator::WireLinesOperator(const Stroke& stroke)
     : _stroke(stroke)
 {
@@ -183,3 +188,105 @@ void WireLinesOperator::installShaders(osg::Node* node) const
     // XXX shouldn't be needed
     stateset->setMode(GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE | osg::StateAttribute::PROTECTED);
 }
+
+osg::Geometry* WireLinesOperator::createCatenaries(const std::vector<CatenarySpan>& spans, unsigned segments) const
+{
+    if (spans.empty() || segments == 0u)
+        return 0L;
+
+    // Ring pattern: x runs along the span [0..1], y is the angle around the wire.
+    const unsigned numRings = segments + 1u;
+    osg::Vec3Array* pattern = new osg::Vec3Array(osg::Array::BIND_PER_VERTEX, numRings * numWireVerts);
+    GeomView matPattern(&(*pattern)[0], numRings, numWireVerts);
+    for (unsigned ring = 0; ring < numRings; ++ring)
+    {
+        for (unsigned i = 0; i < numWireVerts; ++i)
+        {
+            float angle = (2.0f * (float)osg::PI / numWireVerts) * i;
+            matPattern(ring, i).set((float)ring / (float)segments, angle, 0.0f);
+        }
+    }
+
+    std::vector<unsigned> ebo;
+    for (unsigned ring0 = 0, ring1 = 1; ring1 < numRings; ++ring0, ++ring1)
+    {
+        for (unsigned circleVert0 = 0; circleVert0 < numWireVerts; ++circleVert0)
+        {
+            unsigned circleVert1 = (circleVert0 + 1) % numWireVerts;
+            addQuad(ebo,
+                ring0 * numWireVerts + circleVert0,
+                ring0 * numWireVerts + circleVert1,
+                ring1 * numWireVerts + circleVert1,
+                ring1 * numWireVerts + circleVert0);
+        }
+    }
+
+    osg::DrawElements* primset = pattern->size() > 0xFFFF ?
+        (osg::DrawElements*)new osg::DrawElementsUInt(GL_TRIANGLES) :
+        (osg::DrawElements*)new osg::DrawElementsUShort(GL_TRIANGLES);
+    primset->reserveElements(ebo.size());
+    for (unsigned i = 0; i < ebo.size(); ++i)
+    {
+        primset->addElement(ebo[i]);
+    }
+    primset->setNumInstances(spans.size());
+
+    // Four texels per span; see WireLines.Catenary.glsl.
+    osg::Image* image = new osg::Image();
+    image->allocateImage(4 * spans.size(), 1, 1, GL_RGBA, GL_FLOAT);
+    osg::Vec4f* texel = reinterpret_cast<osg::Vec4f*>(image->data());
+
+    osg::BoundingBox bounds;
+    for (unsigned s = 0; s < spans.size(); ++s)
+    {
+        const CatenarySpan& span = spans[s];
+        const osg::Matrixd& m = span.frame;
+        texel[4 * s + 0].set(m(0, 0), m(0, 1), m(0, 2), span.a);
+        texel[4 * s + 1].set(m(1, 0), m(1, 1), m(1, 2), span.x1);
+        texel[4 * s + 2].set(m(2, 0), m(2, 1), m(2, 2), span.C);
+        texel[4 * s + 3].set(m(3, 0), m(3, 1), m(3, 2), span.length);
+
+        // the curve sags below its endpoints, but never below its vertex:
+        bounds.expandBy(osg::Vec3d(0.0, 0.0, span.a * cosh(span.x1 / span.a) + span.C) * m);
+        bounds.expandBy(osg::Vec3d(span.length, 0.0, span.a * cosh((span.length + span.x1) / span.a) + span.C) * m);
+        if (-span.x1 > 0.0 && -span.x1 < span.length)
+            bounds.expandBy(osg::Vec3d(-span.x1, 0.0, span.a + span.C) * m);
+    }
+
+    osg::TextureBuffer* tbo = new osg::TextureBuffer(image);
+    tbo->setInternalFormat(GL_RGBA32F_ARB);
+    tbo->setUnRefImageDataAfterApply(Registry::instance()->unRefImageDataAfterApply().get());
+
+    osg::Geometry* geom = new osg::Geometry();
+    geom->setUseDisplayList(false);
+    geom->setUseVertexBufferObjects(true);
+    geom->setVertexArray(pattern);
+    geom->addPrimitiveSet(primset);
+
+    osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_OVERALL, 1);
+    (*colors)[0] = _stroke.color();
+    geom->setColorArray(colors);
+
+    // The pattern says nothing about where the wires are, so
+    // bound the geometry by the spans themselves.
+    float radius = Distance(*_stroke.width(), *_stroke.widthUnits()).as(Units::METERS) / 2.0f;
+    bounds.expandBy(bounds.corner(0) - osg::Vec3(radius, radius, radius));
+    bounds.expandBy(bounds.corner(7) + osg::Vec3(radius, radius, radius));
+    geom->setInitialBound(bounds);
+
+    osg::StateSet* stateset = geom->getOrCreateStateSet();
+    stateset->setTextureAttribute(CatenaryBufferUnit, tbo);
+    stateset->getOrCreateUniform("oe_WireLine_spans", osg::Uniform::SAMPLER_BUFFER)->set(CatenaryBufferUnit);
+
+    return geom;
+}
+
+void WireLinesOperator::installCatenaryShaders(osg::Node* node) const
+{
+    if (!node)
+        return;
+    installShaders(node);
+    VirtualProgram* vp = VirtualProgram::getOrCreate(node->getOrCreateStateSet());
+    Shaders shaders;
+    shaders.load(vp, shaders.WireLinesCatenary);
+}
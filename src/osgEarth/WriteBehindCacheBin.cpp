@@ -0,0 +1,375 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/WriteBehindCacheBin>
+#include <osgEarth/Cache>
+#include <osgEarth/DateTime>
+#include <osgEarth/Notify>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace osgEarth;
+
+#define LC "[WriteBehindCacheBin] "
+
+#define DEFAULT_MAX_PENDING 256u
+
+//...................................................................
+
+void
+WriteBehindCacheBin::Writer::run()
+{
+    _bin->writePending();
+}
+
+//...................................................................
+
+unsigned
+WriteBehindCacheBin::getDefaultMaxPending()
+{
+    const char* value = ::getenv(OSGEARTH_ENV_CACHE_WRITE_BEHIND);
+    if (value)
+        return (unsigned)std::max(::atoi(value), 0);
+    else
+        return DEFAULT_MAX_PENDING;
+}
+
+WriteBehindCacheBin::WriteBehindCacheBin(CacheBin* bin, unsigned maxPending) :
+CacheBin(bin->getID()),
+_bin(bin),
+_maxPending(std::max(maxPending, 1u)),
+_done(false),
+_writer(0L)
+{
+    _hashKeys = bin->getHashKeys();
+}
+
+WriteBehindCacheBin::~WriteBehindCacheBin()
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _done = true;
+        _notEmpty.signal();
+    }
+
+    // the writer drains the queue before it exits.
+    if (_writer)
+    {
+        _writer->join();
+        delete _writer;
+    }
+}
+
+void
+WriteBehindCacheBin::enqueue(const std::string& key,
+                             const osg::Object* object,
+                             const Config& metadata,
+                             const osgDB::Options* dbo)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // A write that replaces a waiting one doesn't grow the queue;
+    // anything else waits for room.
+    while (_pending.size() >= _maxPending && _pending.find(key) == _pending.end())
+    {
+        _notFull.wait(&_mutex);
+    }
+
+    Pending& pending = _pending[key];
+    pending._record = WriteRecord(key, object, metadata);
+    pending._dbo = dbo;
+    pending._time = DateTime().asTimeStamp();
+
+    if (!_writer)
+    {
+        _writer = new Writer(this);
+        _writer->start();
+    }
+
+    _notEmpty.signal();
+}
+
+void
+WriteBehindCacheBin::writePending()
+{
+    while (true)
+    {
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+
+            while (_pending.empty() && !_done)
+                _notEmpty.wait(&_mutex);
+
+            if (_pending.empty())
+                return;
+
+            _writing.swap(_pending);
+            _notFull.broadcast();
+        }
+
+        // Only this thread changes _writing, so there's no need to hold the
+        // lock while reading it. Write the records in as few batches as the
+        // options allow.
+        WriteRecords records;
+        const osgDB::Options* dbo = 0L;
+
+        for (PendingMap::const_iterator i = _writing.begin(); i != _writing.end(); ++i)
+        {
+            if (!records.empty() && i->second._dbo.get() != dbo)
+            {
+                if (!_bin->writeBatch(records, dbo))
+                    OE_DEBUG << LC << "Failed to write " << records.size() << " records to bin [" << getID() << "]" << std::endl;
+                records.clear();
+            }
+            dbo = i->second._dbo.get();
+            records.push_back(i->second._record);
+        }
+
+        if (!records.empty())
+        {
+            if (!_bin->writeBatch(records, dbo))
+                OE_DEBUG << LC << "Failed to write " << records.size() << " records to bin [" << getID() << "]" << std::endl;
+        }
+
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _writing.clear();
+            _written.broadcast();
+        }
+    }
+}
+
+bool
+WriteBehindCacheBin::findPending(const std::string& key, ReadResult& result) const
+{
+    // newest first:
+    PendingMap::const_iterator i = _pending.find(key);
+    if (i == _pending.end())
+    {
+        i = _writing.find(key);
+        if (i == _writing.end())
+            return false;
+    }
+
+    result = ReadResult(
+        const_cast<osg::Object*>(i->second._record._object.get()),
+        i->second._record._metadata);
+
+    // as the underlying bin would report it once written:
+    result.setIsFromCache(true);
+    result.setLastModifiedTime(i->second._time);
+
+    return true;
+}
+
+void
+WriteBehindCacheBin::waitForKey(const std::string& key)
+{
+    // call with the mutex held
+    _pending.erase(key);
+    while (_writing.find(key) != _writing.end())
+    {
+        _written.wait(&_mutex);
+    }
+}
+
+void
+WriteBehindCacheBin::flush()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    while (!_pending.empty() || !_writing.empty())
+    {
+        _written.wait(&_mutex);
+    }
+}
+
+unsigned
+WriteBehindCacheBin::getNumPending() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _pending.size() + _writing.size();
+}
+
+ReadResult
+WriteBehindCacheBin::readObject(const std::string& key, const osgDB::Options* dbo)
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        ReadResult result;
+        if (findPending(key, result))
+            return result;
+    }
+    return _bin->readObject(key, dbo);
+}
+
+ReadResult
+WriteBehindCacheBin::readImage(const std::string& key, const osgDB::Options* dbo)
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        ReadResult result;
+        if (findPending(key, result))
+            return result;
+    }
+    return _bin->readImage(key, dbo);
+}
+
+ReadResult
+WriteBehindCacheBin::readString(const std::string& key, const osgDB::Options* dbo)
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        ReadResult result;
+        if (findPending(key, result))
+            return result;
+    }
+    return _bin->readString(key, dbo);
+}
+
+bool
+WriteBehindCacheBin::write(const std::string& key,
+                           const osg::Object* object,
+                           const Config& metadata,
+                           const osgDB::Options* dbo)
+{
+    if (!object)
+        return false;
+
+    enqueue(key, object, metadata, dbo);
+    return true;
+}
+
+void
+WriteBehindCacheBin::readMany(const std::vector<std::string>& keys,
+                              ReadType type,
+                              std::vector<ReadResult>& output,
+                              const osgDB::Options* dbo)
+{
+    output.clear();
+    output.resize(keys.size());
+
+    // answer what we can from the queue, and read the rest in one go.
+    std::vector<std::string> missingKeys;
+    std::vector<unsigned> missing;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        for (unsigned i = 0; i < keys.size(); ++i)
+        {
+            if (!findPending(keys[i], output[i]))
+            {
+                missingKeys.push_back(keys[i]);
+                missing.push_back(i);
+            }
+        }
+    }
+
+    if (!missingKeys.empty())
+    {
+        std::vector<ReadResult> results;
+        _bin->readMany(missingKeys, type, results, dbo);
+        for (unsigned i = 0; i < missing.size() && i < results.size(); ++i)
+        {
+            output[missing[i]] = results[i];
+        }
+    }
+}
+
+bool
+WriteBehindCacheBin::writeBatch(const WriteRecords& records, const osgDB::Options* dbo)
+{
+    bool ok = true;
+    for (WriteRecords::const_iterator i = records.begin(); i != records.end(); ++i)
+    {
+        if (i->_object.valid())
+            enqueue(i->_key, i->_object.get(), i->_metadata, dbo);
+        else
+            ok = false;
+    }
+    return ok;
+}
+
+CacheBin::RecordStatus
+WriteBehindCacheBin::getRecordStatus(const std::string& key)
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        if (_pending.find(key) != _pending.end() || _writing.find(key) != _writing.end())
+            return STATUS_OK;
+    }
+    return _bin->getRecordStatus(key);
+}
+
+bool
+WriteBehindCacheBin::remove(const std::string& key)
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        waitForKey(key);
+    }
+    return _bin->remove(key);
+}
+
+bool
+WriteBehindCacheBin::touch(const std::string& key)
+{
+    {
+        // a waiting record will be new when it lands.
+        Threading::ScopedMutexLock lock(_mutex);
+        if (_pending.find(key) != _pending.end() || _writing.find(key) != _writing.end())
+            return true;
+    }
+    return _bin->touch(key);
+}
+
+Config
+WriteBehindCacheBin::readMetadata()
+{
+    return _bin->readMetadata();
+}
+
+bool
+WriteBehindCacheBin::writeMetadata(const Config& meta)
+{
+    return _bin->writeMetadata(meta);
+}
+
+bool
+WriteBehindCacheBin::clear()
+{
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _pending.clear();
+        _notFull.broadcast();
+        while (!_writing.empty())
+            _written.wait(&_mutex);
+    }
+    return _bin->clear();
+}
+
+bool
+WriteBehindCacheBin::compact()
+{
+    flush();
+    return _bin->compact();
+}
+
+unsigned
+WriteBehindCacheBin::getStorageSize()
+{
+    return _bin->getStorageSize();
+}
@@ -126,36 +126,11 @@ XYZFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* prog
 {
     FeatureCursor* result = 0L;
 
-    URI uri = createURL(query);
-    if (uri.empty()) return 0;
-
-    OE_DEBUG << LC << uri.full() << std::endl;
-
-    // read the data:
-    ReadResult r = uri.readString(getReadOptions(), progress);
-
-    const std::string& buffer = r.getString();
-    const Config&      meta = r.metadata();
-
-    bool dataOK = false;
+    if (!query.tileKey().isSet())
+        return 0L;
 
     FeatureList features;
-    if (!buffer.empty())
-    {
-        // Get the mime-type from the metadata record if possible
-        std::string mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
-        //If the mimetype is empty then try to set it from the format specification
-        if (mimeType.empty())
-        {
-            if (options().format().value() == "json")
-                mimeType = "json";
-            else if (options().format().value().compare("gml") == 0)
-                mimeType = "text/xml";
-            else if (options().format().value().compare("pbf") == 0)
-                mimeType = "application/x-protobuf";
-        }
-        dataOK = getFeatures(buffer, *query.tileKey(), mimeType, features);
-    }
+    bool dataOK = readTile(query.tileKey().get(), features, progress);
 
     if (dataOK)
     {
@@ -193,6 +168,39 @@ XYZFeatureSource::createFeatureCursor(const Query& query, ProgressCallback* prog
     return result;
 }
 
+bool
+XYZFeatureSource::fetchTile(const TileKey& key, FeatureList& features, ProgressCallback* progress)
+{
+    Query query;
+    query.tileKey() = key;
+    URI uri = createURL(query);
+    if (uri.empty())
+        return false;
+
+    OE_DEBUG << LC << uri.full() << std::endl;
+
+    // read the data:
+    ReadResult r = uri.readString(getReadOptions(), progress);
+
+    const std::string& buffer = r.getString();
+    if (buffer.empty())
+        return false;
+
+    // Get the mime-type from the metadata record if possible
+    std::string mimeType = r.metadata().value(IOMetadata::CONTENT_TYPE);
+    //If the mimetype is empty then try to set it from the format specification
+    if (mimeType.empty())
+    {
+        if (options().format().value() == "json")
+            mimeType = "json";
+        else if (options().format().value().compare("gml") == 0)
+            mimeType = "text/xml";
+        else if (options().format().value().compare("pbf") == 0)
+            mimeType = "application/x-protobuf";
+    }
+    return getFeatures(buffer, key, mimeType, features);
+}
+
 bool
 XYZFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, const std::string& mimeType, FeatureList& features)
 {
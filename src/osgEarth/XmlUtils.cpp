@@ -20,6 +20,7 @@
 #include <osgEarth/XmlUtils>
 
 #include "tinyxml.h"
+#include <iterator>
 
 
 using namespace osgEarth;
@@ -269,16 +270,23 @@ XmlElement::getConfig(const std::string& referrer) const
 		Config conf( name );
         conf.setReferrer( referrer );
 
+		// attribute names are unique, so there is nothing to replace
 		for( XmlAttributes::const_iterator a = attrs.begin(); a != attrs.end(); a++ )
 		{
-			conf.set( a->first, a->second );
+			conf.add( a->first, a->second );
 		}
 
+		// Child elements already carry the referrer, so they are swapped
+		// straight into place rather than copied and re-stamped by add().
 		for( XmlNodeList::const_iterator c = children.begin(); c != children.end(); c++ )
 		{
 			XmlNode* n = c->get();
 			if ( n->isElement() )
-				conf.add( static_cast<const XmlElement*>(n)->getConfig(referrer) );
+			{
+				Config child = static_cast<const XmlElement*>(n)->getConfig(referrer);
+				conf.children().push_back( Config() );
+				conf.children().back().swap( child );
+			}
 		}
 
 		conf.setValue(getText());
@@ -443,10 +451,9 @@ XmlDocument::load( std::istream& in, const URIContext& uriContext )
     TiXmlDocument xmlDoc;
 
     //Read the entire document into a string
-    std::stringstream buffer;
-    buffer << in.rdbuf();
-    std::string xmlStr;
-    xmlStr = buffer.str();
+    std::string xmlStr(
+        (std::istreambuf_iterator<char>(in)),
+        std::istreambuf_iterator<char>());
 
     removeDocType( xmlStr );
     //OE_NOTICE << xmlStr;
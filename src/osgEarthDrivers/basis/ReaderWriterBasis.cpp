@@ -24,6 +24,8 @@
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
+#include <vector>
+#include <string.h>
 
 #include <basisu/transcoder/basisu_transcoder.h>
 
@@ -35,6 +37,9 @@ public:
     ReaderWriterBasis()
     {
         supportsExtension("basis", "Basis image format");
+#if BASISD_SUPPORT_KTX2
+        supportsExtension("ktx2", "KTX2 image format (Basis Universal supercompressed)");
+#endif
 
         // one-time initialization at startup
         basist::basisu_transcoder_init();
@@ -62,6 +67,16 @@ public:
         char* data = new char[length];
         fin.read(data, length);
 
+#if BASISD_SUPPORT_KTX2
+        static const unsigned char ktx2Magic[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        if (length >= 12 && memcmp(data, ktx2Magic, 12) == 0)
+        {
+            ReadResult result = readKTX2((const unsigned char*)data, length);
+            delete[] data;
+            return result;
+        }
+#endif
+
         basist::basisu_transcoder transcoder(&sel_codebook);
 
         unsigned int numImages = transcoder.get_total_images(data, length);
@@ -168,6 +183,66 @@ public:
     }
 
 private:
+
+#if BASISD_SUPPORT_KTX2
+    // Transcodes a KTX2 file (as used by the glTF KHR_texture_basisu extension)
+    // into the same GPU-compressed formats as .basis files.
+    ReadResult readKTX2(const unsigned char* data, unsigned int length) const
+    {
+        basist::ktx2_transcoder transcoder(const_cast<basist::etc1_global_selector_codebook*>(&sel_codebook));
+        if (!transcoder.init(data, length) || !transcoder.start_transcoding())
+        {
+            return ReadResult::ERROR_IN_READING_FILE;
+        }
+
+        basist::transcoder_texture_format transcoder_texture_format = basist::transcoder_texture_format::cTFBC1;
+        GLenum pixelFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        if (transcoder.get_has_alpha())
+        {
+            transcoder_texture_format = basist::transcoder_texture_format::cTFBC3;
+            pixelFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        }
+
+        unsigned int bytesPerBlock = basist::basis_get_bytes_per_block(transcoder_texture_format);
+        unsigned int totalSize = 0;
+        std::vector< unsigned int > mipmapDataOffsets;
+        std::vector< basist::ktx2_image_level_info > levels(transcoder.get_levels());
+
+        for (unsigned int levelIndex = 0; levelIndex < levels.size(); levelIndex++)
+        {
+            if (levelIndex > 0)
+            {
+                mipmapDataOffsets.push_back(totalSize);
+            }
+            transcoder.get_image_level_info(levels[levelIndex], levelIndex, 0, 0);
+            totalSize += bytesPerBlock * levels[levelIndex].m_total_blocks;
+        }
+
+        unsigned char* decoded = new unsigned char[totalSize];
+        memset(decoded, 0, totalSize);
+
+        for (unsigned int levelIndex = 0; levelIndex < levels.size(); levelIndex++)
+        {
+            unsigned int offset = levelIndex > 0 ? mipmapDataOffsets[levelIndex - 1] : 0;
+            if (!transcoder.transcode_image_level(levelIndex, 0, 0, &decoded[offset], levels[levelIndex].m_total_blocks, transcoder_texture_format))
+            {
+                delete[] decoded;
+                return ReadResult::ERROR_IN_READING_FILE;
+            }
+        }
+
+        osg::Image* image = new osg::Image;
+        image->setImage(transcoder.get_width(), transcoder.get_height(), 1, pixelFormat, pixelFormat, GL_UNSIGNED_BYTE, decoded, osg::Image::USE_NEW_DELETE);
+        if (!mipmapDataOffsets.empty())
+        {
+            image->setMipmapLevels(mipmapDataOffsets);
+        }
+
+        image->flipVertical();
+        return image;
+    }
+#endif
+
     basist::etc1_global_selector_codebook sel_codebook;
 };
 
@@ -18,6 +18,7 @@
  */
 #include "FileSystemCache"
 #include <osgEarth/Cache>
+#include <osgEarth/CacheCodec>
 #include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/XmlUtils>
@@ -150,6 +151,39 @@ namespace
             meta.fromJSON( bufStr );
         }
     }
+
+    // Reads a record written with a CacheCodec, if that's what the file holds.
+    // Returns false if it's a regular osgb file.
+    bool readEncoded( const std::string& fullPath, const osgDB::Options* dbo, osgDB::ReaderWriter::ReadResult& r )
+    {
+        std::ifstream in( fullPath.c_str(), std::ios::in | std::ios::binary );
+        if ( !in.is_open() || !CacheCodec::isEncoded(in) )
+            return false;
+
+        osg::Object* object = CacheCodec::decode( in, dbo );
+        if ( object )
+            r = osgDB::ReaderWriter::ReadResult( object );
+        else
+            r = osgDB::ReaderWriter::ReadResult( osgDB::ReaderWriter::ReadResult::ERROR_IN_READING_FILE );
+        return true;
+    }
+
+    // Writes a record with a CacheCodec; returns false if the codec
+    // does not apply to the object.
+    bool writeEncoded( const osg::Object* object, const std::string& codec, const std::string& fullPath, const osgDB::Options* dbo )
+    {
+        std::stringstream buf;
+        if ( !CacheCodec::encode(object, codec, buf, dbo) )
+            return false;
+
+        std::ofstream out( fullPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+        if ( !out.is_open() )
+            return false;
+
+        out << buf.rdbuf();
+        out.close();
+        return !out.fail();
+    }
 }
 
 
@@ -355,7 +389,8 @@ namespace
         {
             ScopedReadLock lock(_mutex);
 
-            r = _rw->readImage( path, dbo.get() );
+            if ( !readEncoded(path, dbo.get(), r) )
+                r = _rw->readImage( path, dbo.get() );
             if ( !r.success() )
                 return ReadResult();
 
@@ -396,7 +431,8 @@ namespace
         {
             ScopedReadLock lock(_mutex);
 
-            r = _rw->readObject( path, dbo.get() );
+            if ( !readEncoded(path, dbo.get(), r) )
+                r = _rw->readObject( path, dbo.get() );
             if ( !r.success() )
                 return ReadResult();
 
@@ -462,7 +498,11 @@ namespace
 
             osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(writeOptions);
 
-            if ( dynamic_cast<const osg::Image*>(object) )
+            if ( !getCodec().empty() && writeEncoded(object, getCodec(), fileURI.full() + OSG_EXT, dbo.get()) )
+            {
+                objWriteOK = true;
+            }
+            else if ( dynamic_cast<const osg::Image*>(object) )
             {
                 std::string filename = fileURI.full() + OSG_EXT;
                 r = _rw->writeImage( *static_cast<const osg::Image*>(object), filename, dbo.get() );
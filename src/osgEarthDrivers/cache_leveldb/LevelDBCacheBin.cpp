@@ -18,11 +18,13 @@
  */
 #include "LevelDBCacheBin"
 #include <osgEarth/Cache>
+#include <osgEarth/CacheCodec>
 #include <osgEarth/Registry>
 #include <osgEarth/Random>
 #include <osgDB/Registry>
 #include <leveldb/write_batch.h>
 #include <string>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace osgEarth::Threading;
@@ -253,20 +255,13 @@ LevelDBCacheBin::read(const std::string& key, const Reader& reader)
 
     ++_tracker->reads;
 
-    Config metadata;
     leveldb::Status status;
     leveldb::ReadOptions ro;
 
     // first read the metadata record.
     std::string metavalue;
     status = _db->Get( ro, metaKey(key), &metavalue );
-    TimeStamp lastModified = (TimeStamp)0;
-    if ( status.ok() )
-    {        
-        decodeMeta(metavalue, metadata);
-        DateTime t( metadata.value(TIME_FIELD));
-        lastModified = t.asTimeStamp();
-    }
+    bool hasMeta = status.ok();
         
     // next read the data record.
     std::string datakey = dataKey(key);
@@ -278,13 +273,99 @@ LevelDBCacheBin::read(const std::string& key, const Reader& reader)
         return ReadResult(ReadResult::RESULT_NOT_FOUND);
     }
 
+    return decode(key, hasMeta ? &metavalue : 0L, datavalue, reader);
+}
+
+void
+LevelDBCacheBin::readMany(const std::vector<std::string>& keys,
+                          ReadType                        type,
+                          std::vector<ReadResult>&        output,
+                          const osgDB::Options*           readOptions)
+{
+    output.clear();
+    output.reserve(keys.size());
+
+    if ( !binValidForReading() )
+    {
+        output.resize(keys.size(), ReadResult(ReadResult::RESULT_NOT_FOUND));
+        return;
+    }
+
+    for(unsigned i=0; i<keys.size(); ++i)
+        ++_tracker->reads;
+
+    // LevelDB has no multi-get, so visit the metadata and data records of
+    // every key in sorted order with a single iterator instead. Nearby
+    // keys then come from the same blocks.
+    std::vector<std::pair<std::string, unsigned> > dbkeys;
+    dbkeys.reserve(keys.size()*2);
+    for(unsigned i=0; i<keys.size(); ++i)
+    {
+        dbkeys.push_back( std::make_pair(metaKey(keys[i]), 2*i) );
+        dbkeys.push_back( std::make_pair(dataKey(keys[i]), 2*i+1) );
+    }
+    std::sort( dbkeys.begin(), dbkeys.end() );
+
+    std::vector<std::string> values(dbkeys.size());
+    std::vector<bool> found(dbkeys.size(), false);
+
+    leveldb::Iterator* it = _db->NewIterator( leveldb::ReadOptions() );
+    for(unsigned i=0; i<dbkeys.size(); ++i)
+    {
+        it->Seek( dbkeys[i].first );
+        if ( it->Valid() && it->key() == leveldb::Slice(dbkeys[i].first) )
+        {
+            values[dbkeys[i].second] = it->value().ToString();
+            found[dbkeys[i].second] = true;
+        }
+    }
+    delete it;
+
+    ImageReader imageReader(_rw.get(), readOptions);
+    ObjectReader objectReader(_rw.get(), readOptions);
+    const Reader& reader = type == READ_IMAGE ?
+        static_cast<const Reader&>(imageReader) :
+        static_cast<const Reader&>(objectReader);
+
+    for(unsigned i=0; i<keys.size(); ++i)
+    {
+        if ( found[2*i+1] )
+            output.push_back( decode(keys[i], found[2*i] ? &values[2*i] : 0L, values[2*i+1], reader) );
+        else
+            output.push_back( ReadResult(ReadResult::RESULT_NOT_FOUND) );
+    }
+}
+
+ReadResult
+LevelDBCacheBin::decode(const std::string& key, const std::string* metavalue, std::string& datavalue, const Reader& reader)
+{
+    Config metadata;
+    TimeStamp lastModified = (TimeStamp)0;
+    if ( metavalue )
+    {        
+        decodeMeta(*metavalue, metadata);
+        DateTime t( metadata.value(TIME_FIELD));
+        lastModified = t.asTimeStamp();
+    }
+
     // blend the data string
     if ( _tracker->seed().isSet() )
         unblend(datavalue, _tracker->seed().value());
 
-    // finally, decode the OSGB stream into an object.
+    // finally, decode the record (OSGB unless it has a codec tag) into an object.
     std::istringstream datastream(datavalue);
-    osgDB::ReaderWriter::ReadResult r = reader.read(datastream);
+    osgDB::ReaderWriter::ReadResult r;
+    if ( CacheCodec::isEncoded(datavalue.data(), datavalue.size()) )
+    {
+        osg::Object* object = CacheCodec::decode(datastream, reader._op);
+        if ( object )
+            r = osgDB::ReaderWriter::ReadResult(object);
+    }
+    else
+    {
+        r = reader.read(datastream);
+    }
+
     if ( !r.success() )
     {
         OE_WARN << LC << "Cache read failure!"
@@ -337,14 +418,92 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
 {
     if ( !binValidForWriting() || !object ) 
         return false;
-        
+
+    DateTime now;
+    leveldb::WriteBatch batch;
+
+    bool objWriteOK = addToBatch(key, object, meta, now, writeOptions, batch);
+
+    if (objWriteOK)
+    {
+        objWriteOK = _db->Write( leveldb::WriteOptions(), &batch ).ok();
+
+        if ( objWriteOK )
+        {
+            ++_tracker->writes;
+            postWrite();
+            
+            if ( _debug )
+            {
+                OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")\n";
+            }
+        }
+        else
+        {
+            OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << ")\n";
+        }
+    }
+
+    return objWriteOK;
+}
+
+bool
+LevelDBCacheBin::writeBatch(const WriteRecords& records, const osgDB::Options* writeOptions)
+{
+    if ( !binValidForWriting() ) 
+        return false;
+
+    // Commit all the records in one write.
+    DateTime now;
+    leveldb::WriteBatch batch;
+    unsigned count = 0u;
+
+    for(WriteRecords::const_iterator record = records.begin(); record != records.end(); ++record)
+    {
+        if ( record->_object.valid() &&
+             addToBatch(record->_key, record->_object.get(), record->_metadata, now, writeOptions, batch) )
+        {
+            ++count;
+        }
+    }
+
+    if ( count == 0u )
+        return records.empty();
+
+    if ( _db->Write( leveldb::WriteOptions(), &batch ).ok() == false )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write a batch of " << count << " record(s)\n";
+        return false;
+    }
+
+    for(unsigned i=0; i<count; ++i)
+    {
+        ++_tracker->writes;
+        postWrite();
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote a batch of " << count << " record(s)\n";
+    }
+
+    return count == records.size();
+}
+
+bool
+LevelDBCacheBin::addToBatch(const std::string& key, const osg::Object* object, const Config& meta, const DateTime& now, const osgDB::Options* writeOptions, leveldb::WriteBatch& batch)
+{
     osgDB::ReaderWriter::WriteResult r;
     bool objWriteOK = false;
 
     std::string       data;
     std::stringstream datastream;
 
-    if ( dynamic_cast<const osg::Image*>(object) )
+    if ( !getCodec().empty() && CacheCodec::encode(object, getCodec(), datastream, writeOptions) )
+    {
+        objWriteOK = true;
+    }
+    else if ( dynamic_cast<const osg::Image*>(object) )
     {
         if ( (_rw->supportedFeatures() & _rw->FEATURE_WRITE_IMAGE) == 0 )
         {
@@ -377,9 +536,6 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
 
     if (objWriteOK)
     {
-        DateTime now;
-        leveldb::WriteBatch batch;
-
         // write the data:
         data = datastream.str();
         if ( _tracker->seed().isSet() )
@@ -394,23 +550,8 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
         metadata.set( TIME_FIELD, now.asCompactISO8601() );
         encodeMeta( metadata, data );
         batch.Put( metaKey(key), data );
-
-        objWriteOK = _db->Write( leveldb::WriteOptions(), &batch ).ok();
-
-        if ( objWriteOK )
-        {
-            ++_tracker->writes;
-            postWrite();
-            
-            if ( _debug )
-            {
-                OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")\n";
-            }
-        }
     }
-
-        
-    if ( !objWriteOK )
+    else
     {
         OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \"" 
             << r.message() << "\"\n";
@@ -0,0 +1,244 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "MappedFile"
+#include <osgEarth/Notify>
+#include <cstdio>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::PackCache;
+
+#define LC "[PackCache] "
+
+MappedFile::MappedFile() :
+_data(0L),
+_size(0u),
+_removeOnClose(false),
+#ifdef _WIN32
+_file(0L),
+_mapping(0L)
+#else
+_fd(-1)
+#endif
+{
+    //nop
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+
+    if (_removeOnClose && !_path.empty())
+    {
+        ::remove(_path.c_str());
+    }
+}
+
+#ifdef _WIN32
+
+bool
+MappedFile::open(const std::string& path, uint64_t minSize)
+{
+    close();
+    _path = path;
+
+    HANDLE file = ::CreateFileA(
+        path.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        OE_WARN << LC << "Failed to open \"" << path << "\"" << std::endl;
+        return false;
+    }
+    _file = file;
+
+    LARGE_INTEGER fileSize;
+    if (!::GetFileSizeEx(file, &fileSize))
+    {
+        close();
+        return false;
+    }
+
+    // a mapping larger than the file grows the file:
+    uint64_t size = (uint64_t)fileSize.QuadPart;
+    if (size < minSize)
+        size = minSize;
+
+    if (size == 0u)
+    {
+        close();
+        return false;
+    }
+
+    _mapping = ::CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)(size & 0xffffffff), NULL);
+    if (_mapping == 0L)
+    {
+        OE_WARN << LC << "Failed to map \"" << path << "\"" << std::endl;
+        close();
+        return false;
+    }
+
+    _data = (char*)::MapViewOfFile((HANDLE)_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+    if (_data == 0L)
+    {
+        OE_WARN << LC << "Failed to map \"" << path << "\"" << std::endl;
+        close();
+        return false;
+    }
+
+    _size = size;
+    return true;
+}
+
+void
+MappedFile::flush()
+{
+    if (_data)
+        ::FlushViewOfFile(_data, 0);
+}
+
+void
+MappedFile::close()
+{
+    if (_data)
+        ::UnmapViewOfFile(_data);
+    if (_mapping)
+        ::CloseHandle((HANDLE)_mapping);
+    if (_file)
+        ::CloseHandle((HANDLE)_file);
+
+    _data = 0L;
+    _mapping = 0L;
+    _file = 0L;
+    _size = 0u;
+}
+
+bool
+MappedFile::truncate(const std::string& path, uint64_t size)
+{
+    HANDLE file = ::CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER pos;
+    pos.QuadPart = (LONGLONG)size;
+    bool ok = ::SetFilePointerEx(file, pos, NULL, FILE_BEGIN) && ::SetEndOfFile(file);
+    ::CloseHandle(file);
+    return ok;
+}
+
+#else // !_WIN32
+
+bool
+MappedFile::open(const std::string& path, uint64_t minSize)
+{
+    close();
+    _path = path;
+
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd < 0)
+    {
+        OE_WARN << LC << "Failed to open \"" << path << "\"" << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(_fd, &st) != 0)
+    {
+        close();
+        return false;
+    }
+
+    // growing the file this way leaves it sparse, so the unused
+    // part takes up no disk space.
+    uint64_t size = (uint64_t)st.st_size;
+    if (size < minSize)
+    {
+        if (::ftruncate(_fd, (off_t)minSize) != 0)
+        {
+            OE_WARN << LC << "Failed to grow \"" << path << "\"" << std::endl;
+            close();
+            return false;
+        }
+        size = minSize;
+    }
+
+    if (size == 0u)
+    {
+        close();
+        return false;
+    }
+
+    void* data = ::mmap(0L, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        OE_WARN << LC << "Failed to map \"" << path << "\"" << std::endl;
+        close();
+        return false;
+    }
+
+    _data = (char*)data;
+    _size = size;
+    return true;
+}
+
+void
+MappedFile::flush()
+{
+    if (_data)
+        ::msync(_data, (size_t)_size, MS_ASYNC);
+}
+
+void
+MappedFile::close()
+{
+    if (_data)
+        ::munmap(_data, (size_t)_size);
+    if (_fd >= 0)
+        ::close(_fd);
+
+    _data = 0L;
+    _fd = -1;
+    _size = 0u;
+}
+
+bool
+MappedFile::truncate(const std::string& path, uint64_t size)
+{
+    return ::truncate(path.c_str(), (off_t)size) == 0;
+}
+
+#endif // _WIN32
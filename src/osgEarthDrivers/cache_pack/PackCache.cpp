@@ -0,0 +1,215 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackCache"
+#include "PackCacheBin"
+#include <osgEarth/URI>
+#include <osgDB/Registry>
+#include <osgDB/FileUtils>
+#include <osgDB/ObjectWrapper>
+#include <osg/Math>
+
+#define LC "[PackCache] "
+
+// how often the compactor looks for packs to compact
+#define COMPACTION_PERIOD_MS 30000u
+
+using namespace osgEarth;
+using namespace osgEarth::PackCache;
+
+
+void
+PackCacheImpl::Compactor::run()
+{
+    while (!_done)
+    {
+        _wake.wait(COMPACTION_PERIOD_MS);
+        _wake.reset();
+
+        if (_done)
+            break;
+
+        Stores stores;
+        {
+            Threading::ScopedMutexLock lock(_cache->_storesMutex);
+            stores = _cache->_stores;
+        }
+
+        float threshold = osg::clampBetween(_cache->_options.compactionThreshold().get(), 0.0f, 1.0f);
+
+        for (Stores::iterator i = stores.begin(); i != stores.end() && !_done; ++i)
+        {
+            unsigned count = (*i)->compact(threshold);
+            if (count > 0u)
+            {
+                OE_DEBUG << LC << "Compacted " << count << " pack(s)" << std::endl;
+            }
+        }
+    }
+}
+
+PackCacheImpl::PackCacheImpl( const CacheOptions& options ) :
+osgEarth::Cache( options ),
+_options       ( options ),
+_compactor     ( 0L )
+{
+    // Force OSG to initialize the image wrapper. Failure to do this can result
+    // in a race condition within OSG when the cache is accessed from multiple threads.
+    osgDB::ObjectWrapperManager* owm = osgDB::Registry::instance()->getObjectWrapperManager();
+    owm->findWrapper("osg::Image");
+    owm->findWrapper("osg::HeightField");
+
+    if ( _options.rootPath().isSet() )
+    {
+        _rootPath = URI( *_options.rootPath(), options.referrer() ).full();
+    }
+    else
+    {
+        // read the root path from ENV is necessary:
+        const char* cachePath = ::getenv(OSGEARTH_ENV_CACHE_PATH);
+        if ( cachePath )
+        {
+            _rootPath = cachePath;
+            OE_INFO << LC << "Cache location set from environment: \""
+                << cachePath << "\"" << std::endl;
+        }
+    }
+
+    if ( _rootPath.empty() )
+    {
+        _status.set(Status::ConfigurationError, "No root path set for cache");
+        OE_WARN << LC << "Illegal: no root path set for cache!" << std::endl;
+        return;
+    }
+
+    if ( !osgDB::fileExists(_rootPath) && !osgDB::makeDirectory(_rootPath) )
+    {
+        _status.set(Status::ResourceUnavailable, Stringify()
+            << "Failed to create or access folder \"" << _rootPath << "\"");
+        return;
+    }
+
+    if ( _options.compactionThreshold().get() < 1.0f )
+    {
+        _compactor = new Compactor(this);
+        _compactor->start();
+    }
+
+    OE_INFO << LC << "Opened a pack cache at \"" << _rootPath << "\"" << std::endl;
+}
+
+PackCacheImpl::~PackCacheImpl()
+{
+    if ( _compactor )
+    {
+        _compactor->_done = true;
+        _compactor->_wake.set();
+        _compactor->join();
+        delete _compactor;
+        _compactor = 0L;
+    }
+}
+
+CacheBin*
+PackCacheImpl::createBin( const std::string& binID )
+{
+    // Two stores on the same files would corrupt each other, so only
+    // make the bin if it doesn't already exist.
+    Threading::ScopedMutexLock lock(_storesMutex);
+
+    CacheBin* bin = binID == "_default" ? _defaultBin.get() : _bins.get(binID);
+    if ( bin )
+        return bin;
+
+    osg::ref_ptr<PackCacheBin> newBin = new PackCacheBin(binID, _rootPath, _options);
+    if ( !newBin->isOpen() )
+        return 0L;
+
+    _stores.push_back( newBin->getStore() );
+
+    if ( binID == "_default" )
+    {
+        _defaultBin = newBin.get();
+        return _defaultBin.get();
+    }
+    else
+    {
+        return _bins.getOrCreate(binID, newBin.get());
+    }
+}
+
+CacheBin*
+PackCacheImpl::addBin( const std::string& name )
+{
+    if ( getStatus().isError() )
+        return 0L;
+
+    return createBin(name);
+}
+
+CacheBin*
+PackCacheImpl::getOrCreateDefaultBin()
+{
+    if ( getStatus().isError() )
+        return 0L;
+
+    return createBin("_default");
+}
+
+off_t
+PackCacheImpl::getApproximateSize() const
+{
+    Threading::ScopedMutexLock lock(_storesMutex);
+
+    off_t size = 0;
+    for (Stores::const_iterator i = _stores.begin(); i != _stores.end(); ++i)
+        size += (off_t)(*i)->getSize();
+
+    return size;
+}
+
+bool
+PackCacheImpl::compact()
+{
+    Stores stores;
+    {
+        Threading::ScopedMutexLock lock(_storesMutex);
+        stores = _stores;
+    }
+
+    for (Stores::iterator i = stores.begin(); i != stores.end(); ++i)
+        (*i)->compact(0.0f);
+
+    return !stores.empty();
+}
+
+bool
+PackCacheImpl::clear()
+{
+    Stores stores;
+    {
+        Threading::ScopedMutexLock lock(_storesMutex);
+        stores = _stores;
+    }
+
+    bool ok = true;
+    for (Stores::iterator i = stores.begin(); i != stores.end(); ++i)
+        ok = (*i)->clear() && ok;
+
+    return ok;
+}
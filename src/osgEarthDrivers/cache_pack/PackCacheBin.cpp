@@ -0,0 +1,369 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackCacheBin"
+#include <osgEarth/Registry>
+#include <osgEarth/CacheCodec>
+#include <osgEarth/DateTime>
+#include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+using namespace osgEarth::PackCache;
+
+#undef  LC
+#define LC "[PackCacheBin] "
+
+namespace
+{
+    // Reads straight out of a block of memory (i.e., the pack mapping)
+    // without copying it.
+    class MemoryStreamBuf : public std::streambuf
+    {
+    public:
+        MemoryStreamBuf(const char* data, uint32_t size)
+        {
+            char* begin = const_cast<char*>(data);
+            setg(begin, begin, begin + size);
+        }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+        {
+            if ((which & std::ios_base::in) == 0)
+                return pos_type(off_type(-1));
+
+            off_type base =
+                dir == std::ios_base::beg ? 0 :
+                dir == std::ios_base::cur ? gptr() - eback() :
+                egptr() - eback();
+
+            off_type pos = base + off;
+            if (pos < 0 || pos > egptr() - eback())
+                return pos_type(off_type(-1));
+
+            setg(eback(), eback() + pos, egptr());
+            return pos_type(pos);
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+}
+
+PackCacheBin::PackCacheBin(const std::string&      binID,
+                           const std::string&      rootPath,
+                           const PackCacheOptions& options) :
+osgEarth::CacheBin( binID ),
+_debug            ( false )
+{
+    std::string binPath = osgDB::concatPaths(rootPath, binID);
+    _metaPath = osgDB::concatPaths(binPath, "osgearth_cacheinfo.json");
+
+    _rw = osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+
+    _zlibOptions = osgEarth::Registry::instance()->cloneOrCreateOptions();
+
+    if (::getenv(OSGEARTH_ENV_DEFAULT_COMPRESSOR) != 0L)
+    {
+        _compressorName = ::getenv(OSGEARTH_ENV_DEFAULT_COMPRESSOR);
+    }
+    else
+    {
+        _compressorName = "zlib";
+    }
+
+    if (_compressorName.length() > 0)
+    {
+        _zlibOptions->setPluginStringData("Compressor", _compressorName);
+    }
+
+    _debug = ::getenv("OSGEARTH_CACHE_DEBUG") != 0L;
+
+    if (_rw.valid())
+    {
+        _store = new PackStore(
+            binPath,
+            (uint64_t)options.packSizeMB().get() * 1048576u,
+            (uint64_t)options.maxSizeMB().get() * 1048576u);
+
+        if (!_store->open())
+        {
+            OE_WARN << LC << "Failed to open cache bin at [" << binPath << "]" << std::endl;
+            _store = 0L;
+        }
+    }
+    else
+    {
+        OE_WARN << LC << "No osgb plugin; cannot open cache bin [" << binID << "]" << std::endl;
+    }
+}
+
+const osgDB::Options*
+PackCacheBin::mergeOptions(const osgDB::Options* dbo)
+{
+    if (!dbo)
+    {
+        return _zlibOptions.get();
+    }
+    else if (!_zlibOptions.valid())
+    {
+        return dbo;
+    }
+    else
+    {
+        osgDB::Options* merged = Registry::cloneOrCreateOptions(dbo);
+        if (_compressorName.length())
+        {
+            merged->setPluginStringData("Compressor", _compressorName);
+        }
+        return merged;
+    }
+}
+
+ReadResult
+PackCacheBin::readImage(const std::string& key, const osgDB::Options* readOptions)
+{
+    osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(readOptions);
+    return read(key, ImageReader(_rw.get(), dbo.get()));
+}
+
+ReadResult
+PackCacheBin::readObject(const std::string& key, const osgDB::Options* readOptions)
+{
+    osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(readOptions);
+    return read(key, ObjectReader(_rw.get(), dbo.get()));
+}
+
+ReadResult
+PackCacheBin::read(const std::string& key, const Reader& reader)
+{
+    if ( !_store.valid() )
+        return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+    // the record points into the pack mapping, and holds the pack
+    // open while we decode it.
+    PackStore::Record record;
+    if ( !_store->read(key, record) )
+        return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+    Config meta;
+    if ( record._metaSize > 0u )
+        meta.fromJSON( std::string(record._meta, record._metaSize) );
+
+    MemoryStreamBuf buf(record._data, record._dataSize);
+    std::istream datastream(&buf);
+
+    osgDB::ReaderWriter::ReadResult r;
+    if ( CacheCodec::isEncoded(record._data, record._dataSize) )
+    {
+        osg::Object* object = CacheCodec::decode(datastream, reader._op);
+        if ( object )
+            r = osgDB::ReaderWriter::ReadResult(object);
+    }
+    else
+    {
+        r = reader.read(datastream);
+    }
+
+    if ( !r.success() )
+    {
+        OE_WARN << LC << "Cache read failure!"
+            << "\n reader = " << reader.name()
+            << "\n error detail = " << r.message()
+            << "\n";
+
+        return ReadResult(ReadResult::RESULT_READER_ERROR);
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": read (" << key << ")\n";
+    }
+
+    ReadResult rr(r.getObject(), meta);
+    rr.setLastModifiedTime(record._time);
+    return rr;
+}
+
+ReadResult
+PackCacheBin::readString(const std::string& key, const osgDB::Options* readOptions)
+{
+    ReadResult r = readObject(key, readOptions);
+    if ( r.succeeded() )
+    {
+        if ( r.get<StringObject>() )
+            return r;
+        else
+            return ReadResult();
+    }
+    else
+    {
+        return r;
+    }
+}
+
+bool
+PackCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+{
+    if ( !_store.valid() || !object )
+        return false;
+
+    osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(writeOptions);
+
+    osgDB::ReaderWriter::WriteResult r;
+    std::stringstream datastream;
+
+    if ( !getCodec().empty() && CacheCodec::encode(object, getCodec(), datastream, dbo.get()) )
+    {
+        r = osgDB::ReaderWriter::WriteResult(osgDB::ReaderWriter::WriteResult::FILE_SAVED);
+    }
+    else if ( dynamic_cast<const osg::Image*>(object) )
+    {
+        r = _rw->writeImage( *static_cast<const osg::Image*>(object), datastream, dbo.get() );
+    }
+    else if ( dynamic_cast<const osg::Node*>(object) )
+    {
+        r = _rw->writeNode( *static_cast<const osg::Node*>(object), datastream, dbo.get() );
+    }
+    else
+    {
+        r = _rw->writeObject( *object, datastream, dbo.get() );
+    }
+
+    bool objWriteOK = r.success();
+
+    if ( objWriteOK )
+    {
+        std::string metavalue;
+        if ( !meta.empty() )
+            metavalue = meta.toJSON(false);
+
+        objWriteOK = _store->write( key, metavalue, datastream.str(), DateTime().asTimeStamp() );
+    }
+
+    if ( objWriteOK )
+    {
+        if ( _debug )
+        {
+            OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")\n";
+        }
+    }
+    else
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \""
+            << r.message() << "\"\n";
+    }
+
+    return objWriteOK;
+}
+
+CacheBin::RecordStatus
+PackCacheBin::getRecordStatus(const std::string& key)
+{
+    return _store.valid() && _store->contains(key) ? STATUS_OK : STATUS_NOT_FOUND;
+}
+
+bool
+PackCacheBin::remove(const std::string& key)
+{
+    return _store.valid() && _store->remove(key);
+}
+
+bool
+PackCacheBin::touch(const std::string& key)
+{
+    return _store.valid() && _store->touch(key, DateTime().asTimeStamp());
+}
+
+bool
+PackCacheBin::clear()
+{
+    if ( !_store.valid() )
+        return false;
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Cleared bin " << getID() << std::endl;
+    }
+
+    return _store->clear();
+}
+
+bool
+PackCacheBin::compact()
+{
+    if ( !_store.valid() )
+        return false;
+
+    // reclaim every pack that holds any garbage.
+    _store->compact(0.0f);
+    return true;
+}
+
+unsigned
+PackCacheBin::getStorageSize()
+{
+    return _store.valid() ? (unsigned)_store->getSize() : 0u;
+}
+
+Config
+PackCacheBin::readMetadata()
+{
+    if ( !_store.valid() )
+        return Config();
+
+    ScopedMutexLock lock(_metaMutex);
+
+    std::ifstream input( _metaPath.c_str() );
+    if ( !input.is_open() )
+        return Config();
+
+    input >> std::noskipws;
+    std::stringstream buf;
+    buf << input.rdbuf();
+
+    Config conf;
+    conf.fromJSON( buf.str() );
+    return conf;
+}
+
+bool
+PackCacheBin::writeMetadata( const Config& conf )
+{
+    if ( !_store.valid() )
+        return false;
+
+    ScopedMutexLock lock(_metaMutex);
+
+    std::fstream output( _metaPath.c_str(), std::ios_base::out );
+    if ( output.is_open() )
+    {
+        output << conf.toJSON(true);
+        output.flush();
+        output.close();
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,53 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackCache"
+#include <osgEarth/Cache>
+#include <osgDB/Registry>
+#include <osgDB/FileNameUtils>
+
+namespace osgEarth { namespace PackCache
+{
+    /**
+     * Plugin that creates a PackCacheImpl (driver name "pack").
+     */
+    class PackCacheDriver : public osgEarth::CacheDriver
+    {
+    public:
+        PackCacheDriver()
+        {
+            supportsExtension( "osgearth_cache_pack", "pack file cache for osgEarth" );
+        }
+
+        virtual const char* className() const
+        {
+            return "pack file cache for osgEarth";
+        }
+
+        virtual ReadResult readObject(const std::string& file_name, const Options* options) const
+        {
+            if ( !acceptsExtension(osgDB::getLowerCaseFileExtension( file_name )))
+                return ReadResult::FILE_NOT_HANDLED;
+
+            return ReadResult( new PackCacheImpl( getCacheOptions(options) ) );
+        }
+    };
+
+    REGISTER_OSGPLUGIN(osgearth_cache_pack, PackCacheDriver);
+
+} } // namespace osgEarth::PackCache
@@ -0,0 +1,824 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackStore"
+#include <osgEarth/Notify>
+#include <osgEarth/StringUtils>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::PackCache;
+using namespace osgEarth::Threading;
+using namespace osgEarth::Util;
+
+#define LC "[PackCache] "
+
+#define PACK_STORE_VERSION 1u
+#define INDEX_MAGIC        "OEPKIDX"
+#define PACK_MAGIC         "OEPKDAT"
+#define RECORD_MAGIC       0x4F455052u
+#define INITIAL_CAPACITY   65536u
+#define MIN_PACK_SIZE      1048576u
+
+namespace
+{
+    const uint32_t SLOT_EMPTY   = 0u;
+    const uint32_t SLOT_REMOVED = ~0u;
+
+    // FNV-1a
+    uint64_t hashKey(const std::string& key)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (std::string::const_iterator c = key.begin(); c != key.end(); ++c)
+        {
+            hash ^= (unsigned char)*c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // records start on 8-byte boundaries
+    uint64_t paddedSize(uint64_t size)
+    {
+        return (size + 7u) & ~(uint64_t)7u;
+    }
+}
+
+PackStore::PackStore(const std::string& path, uint64_t packSize, uint64_t maxSize) :
+_path      ( path ),
+_packSize  ( std::max(packSize, (uint64_t)MIN_PACK_SIZE) ),
+_maxSize   ( maxSize ),
+_size      ( 0u ),
+_activePack( 0u )
+{
+    //nop
+}
+
+PackStore::~PackStore()
+{
+    if (_index.valid())
+        _index->flush();
+
+    for (Packs::iterator p = _packs.begin(); p != _packs.end(); ++p)
+        p->second._file->flush();
+}
+
+std::string
+PackStore::indexPath() const
+{
+    return osgDB::concatPaths(_path, "index.oepk");
+}
+
+std::string
+PackStore::packPath(uint32_t id) const
+{
+    char buf[32];
+    sprintf(buf, "pack-%08u.oepk", id);
+    return osgDB::concatPaths(_path, buf);
+}
+
+bool
+PackStore::open()
+{
+    if (!osgDB::fileExists(_path) && !osgDB::makeDirectory(_path))
+    {
+        OE_WARN << LC << "Failed to create folder \"" << _path << "\"" << std::endl;
+        return false;
+    }
+
+    ScopedMutexLock writeLock(_writeMutex);
+    ScopedWriteLock indexLock(_indexMutex);
+
+    if (!openIndex() || !openPacks())
+    {
+        _index = 0L;
+        _packs.clear();
+        return false;
+    }
+
+    OE_DEBUG << LC << "Opened \"" << _path << "\" with "
+        << indexHeader()->_count << " records in " << _packs.size() << " pack(s)" << std::endl;
+
+    return true;
+}
+
+void
+PackStore::initIndex(uint64_t capacity)
+{
+    ::memset(_index->data(), 0, (size_t)_index->size());
+
+    IndexHeader* h = indexHeader();
+    ::memcpy(h->_magic, INDEX_MAGIC, sizeof(h->_magic));
+    h->_version = PACK_STORE_VERSION;
+    h->_nextPack = 1u;
+    h->_capacity = capacity;
+}
+
+bool
+PackStore::openIndex()
+{
+    uint64_t initialSize = sizeof(IndexHeader) + INITIAL_CAPACITY * sizeof(Slot);
+
+    _index = new MappedFile();
+    if (!_index->open(indexPath(), initialSize))
+        return false;
+
+    const IndexHeader* h = indexHeader();
+
+    bool isNew = h->_magic[0] == 0;
+
+    bool ok =
+        !isNew &&
+        ::memcmp(h->_magic, INDEX_MAGIC, sizeof(h->_magic)) == 0 &&
+        h->_version == PACK_STORE_VERSION &&
+        h->_capacity > 0u &&
+        (h->_capacity & (h->_capacity - 1u)) == 0u &&
+        sizeof(IndexHeader) + h->_capacity * sizeof(Slot) == _index->size();
+
+    if (!ok)
+    {
+        if (!isNew)
+        {
+            OE_WARN << LC << "Index \"" << indexPath() << "\" is unreadable; starting over" << std::endl;
+        }
+
+        if (_index->size() != initialSize)
+        {
+            _index = 0L;
+            MappedFile::truncate(indexPath(), 0u);
+            _index = new MappedFile();
+            if (!_index->open(indexPath(), initialSize))
+                return false;
+        }
+
+        initIndex(INITIAL_CAPACITY);
+    }
+
+    return true;
+}
+
+bool
+PackStore::rebuildIndex(uint64_t capacity)
+{
+    // call with both locks held.
+    std::string newPath = indexPath() + ".new";
+    ::remove(newPath.c_str());
+
+    osg::ref_ptr<MappedFile> next = new MappedFile();
+    if (!next->open(newPath, sizeof(IndexHeader) + capacity * sizeof(Slot)))
+    {
+        OE_WARN << LC << "Failed to grow index \"" << indexPath() << "\"" << std::endl;
+        return false;
+    }
+
+    const IndexHeader* oldHeader = indexHeader();
+    IndexHeader* newHeader = reinterpret_cast<IndexHeader*>(next->data());
+    *newHeader = *oldHeader;
+    newHeader->_capacity = capacity;
+    newHeader->_used = oldHeader->_count;
+
+    // re-insert the live slots; this also gets rid of the removed ones.
+    const Slot* oldSlots = slots();
+    Slot* newSlots = reinterpret_cast<Slot*>(next->data() + sizeof(IndexHeader));
+    uint64_t mask = capacity - 1u;
+
+    for (uint64_t i = 0; i < oldHeader->_capacity; ++i)
+    {
+        const Slot& slot = oldSlots[i];
+        if (slot._pack == SLOT_EMPTY || slot._pack == SLOT_REMOVED)
+            continue;
+
+        for (uint64_t j = 0; j < capacity; ++j)
+        {
+            Slot& target = newSlots[(slot._hash + j) & mask];
+            if (target._pack == SLOT_EMPTY)
+            {
+                target = slot;
+                break;
+            }
+        }
+    }
+
+    next->flush();
+
+    // Close both mappings before replacing the file (Windows can't
+    // replace a mapped file).
+    next = 0L;
+    _index = 0L;
+
+    if (::rename(newPath.c_str(), indexPath().c_str()) != 0)
+    {
+        ::remove(indexPath().c_str());
+        ::rename(newPath.c_str(), indexPath().c_str());
+    }
+
+    _index = new MappedFile();
+    if (!_index->open(indexPath(), 0u))
+    {
+        OE_WARN << LC << "Lost index \"" << indexPath() << "\"" << std::endl;
+        _index = 0L;
+        return false;
+    }
+
+    OE_DEBUG << LC << "Index \"" << indexPath() << "\" now has " << capacity << " slots" << std::endl;
+    return true;
+}
+
+bool
+PackStore::openPacks()
+{
+    std::vector<uint32_t> ids;
+
+    osgDB::DirectoryContents files = osgDB::getDirectoryContents(_path);
+    for (osgDB::DirectoryContents::const_iterator f = files.begin(); f != files.end(); ++f)
+    {
+        if (startsWith(*f, "pack-") && endsWith(*f, ".oepk"))
+        {
+            uint32_t id = as<unsigned>(f->substr(5, f->length() - 10), 0u);
+            if (id > 0u)
+                ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    IndexHeader* h = indexHeader();
+    uint32_t newest = ids.empty() ? 0u : ids.back();
+
+    for (std::vector<uint32_t>::const_iterator id = ids.begin(); id != ids.end(); ++id)
+    {
+        std::string path = packPath(*id);
+
+        osg::ref_ptr<MappedFile> file = new MappedFile();
+        if (!file->open(path, 0u))
+        {
+            file = 0L;
+            ::remove(path.c_str());
+            continue;
+        }
+
+        const PackHeader* ph = packHeader(file.get());
+        if (::memcmp(ph->_magic, PACK_MAGIC, sizeof(ph->_magic)) != 0 ||
+            ph->_version != PACK_STORE_VERSION ||
+            ph->_end < sizeof(PackHeader) ||
+            ph->_end > file->size())
+        {
+            OE_WARN << LC << "Pack \"" << path << "\" is unreadable; removing it" << std::endl;
+            file->setRemoveOnClose(true);
+            continue;
+        }
+
+        uint64_t end = ph->_end;
+
+        // Full packs give back the unused space at their end. The newest
+        // one keeps its room to grow.
+        if (*id != newest && file->size() > end)
+        {
+            file = 0L;
+            MappedFile::truncate(path, end);
+            file = new MappedFile();
+            if (!file->open(path, 0u))
+                continue;
+        }
+        else if (*id == newest && file->size() < _packSize)
+        {
+            file = 0L;
+            file = new MappedFile();
+            if (!file->open(path, _packSize))
+                continue;
+        }
+
+        Pack& pack = _packs[*id];
+        pack._file = file.get();
+        pack._live = 0u;
+        _size += end;
+
+        if (*id >= h->_nextPack)
+            h->_nextPack = *id + 1u;
+    }
+
+    // Drop slots that point at missing or damaged packs, and total up
+    // the live bytes in each pack.
+    h->_count = 0u;
+    h->_used = 0u;
+    Slot* s = slots();
+    for (uint64_t i = 0; i < h->_capacity; ++i)
+    {
+        Slot& slot = s[i];
+        if (slot._pack == SLOT_EMPTY)
+            continue;
+
+        ++h->_used;
+
+        if (slot._pack == SLOT_REMOVED)
+            continue;
+
+        Packs::iterator p = _packs.find(slot._pack);
+        if (p == _packs.end() ||
+            slot._offset < sizeof(PackHeader) ||
+            slot._offset + slot._size > packHeader(p->second._file.get())->_end)
+        {
+            slot._pack = SLOT_REMOVED;
+            continue;
+        }
+
+        p->second._live += slot._size;
+        ++h->_count;
+    }
+
+    Packs::iterator last = _packs.find(newest);
+    if (last != _packs.end() && packHeader(last->second._file.get())->_end < last->second._file->size())
+    {
+        _activePack = newest;
+        return true;
+    }
+    else
+    {
+        return createPack();
+    }
+}
+
+bool
+PackStore::createPack()
+{
+    // call with both locks held.
+    IndexHeader* h = indexHeader();
+    uint32_t id = h->_nextPack++;
+
+    std::string path = packPath(id);
+    ::remove(path.c_str());
+
+    osg::ref_ptr<MappedFile> file = new MappedFile();
+    if (!file->open(path, _packSize))
+    {
+        OE_WARN << LC << "Failed to create pack \"" << path << "\"" << std::endl;
+        return false;
+    }
+
+    PackHeader* ph = packHeader(file.get());
+    ::memcpy(ph->_magic, PACK_MAGIC, sizeof(ph->_magic));
+    ph->_version = PACK_STORE_VERSION;
+    ph->_end = sizeof(PackHeader);
+
+    Pack& pack = _packs[id];
+    pack._file = file.get();
+    pack._live = 0u;
+    _size += sizeof(PackHeader);
+    _activePack = id;
+
+    return true;
+}
+
+void
+PackStore::dropPack(uint32_t id)
+{
+    // call with both locks held.
+    Packs::iterator p = _packs.find(id);
+    if (p == _packs.end())
+        return;
+
+    IndexHeader* h = indexHeader();
+    Slot* s = slots();
+    for (uint64_t i = 0; i < h->_capacity; ++i)
+    {
+        if (s[i]._pack == id)
+        {
+            s[i]._pack = SLOT_REMOVED;
+            --h->_count;
+        }
+    }
+
+    // The file goes away once the last reader lets go of it.
+    _size -= packHeader(p->second._file.get())->_end;
+    p->second._file->setRemoveOnClose(true);
+    _packs.erase(p);
+
+    OE_DEBUG << LC << "Dropped pack \"" << packPath(id) << "\"" << std::endl;
+}
+
+bool
+PackStore::matches(const Slot& slot, const std::string& key) const
+{
+    Packs::const_iterator p = _packs.find(slot._pack);
+    if (p == _packs.end())
+        return false;
+
+    const MappedFile* file = p->second._file.get();
+    if (slot._offset + sizeof(RecordHeader) + key.size() > file->size())
+        return false;
+
+    const char* ptr = file->data() + slot._offset;
+    const RecordHeader* rh = reinterpret_cast<const RecordHeader*>(ptr);
+
+    return
+        rh->_magic == RECORD_MAGIC &&
+        rh->_keySize == key.size() &&
+        ::memcmp(ptr + sizeof(RecordHeader), key.data(), key.size()) == 0;
+}
+
+PackStore::Slot*
+PackStore::find(const std::string& key, uint64_t hash) const
+{
+    const IndexHeader* h = indexHeader();
+    uint64_t mask = h->_capacity - 1u;
+    Slot* s = slots();
+
+    for (uint64_t i = 0; i < h->_capacity; ++i)
+    {
+        Slot* slot = &s[(hash + i) & mask];
+        if (slot->_pack == SLOT_EMPTY)
+            return 0L;
+        if (slot->_pack != SLOT_REMOVED && slot->_hash == hash && matches(*slot, key))
+            return slot;
+    }
+    return 0L;
+}
+
+PackStore::Slot*
+PackStore::findForInsert(const std::string& key, uint64_t hash, bool& exists) const
+{
+    const IndexHeader* h = indexHeader();
+    uint64_t mask = h->_capacity - 1u;
+    Slot* s = slots();
+    Slot* firstRemoved = 0L;
+
+    exists = false;
+
+    for (uint64_t i = 0; i < h->_capacity; ++i)
+    {
+        Slot* slot = &s[(hash + i) & mask];
+        if (slot->_pack == SLOT_EMPTY)
+        {
+            return firstRemoved ? firstRemoved : slot;
+        }
+        else if (slot->_pack == SLOT_REMOVED)
+        {
+            if (!firstRemoved)
+                firstRemoved = slot;
+        }
+        else if (slot->_hash == hash && matches(*slot, key))
+        {
+            exists = true;
+            return slot;
+        }
+    }
+    return firstRemoved;
+}
+
+void
+PackStore::setSlot(Slot* slot, bool exists, uint64_t hash, uint32_t pack, uint64_t offset, uint32_t size, TimeStamp time)
+{
+    // call with both locks held.
+    IndexHeader* h = indexHeader();
+
+    if (exists)
+    {
+        // the old copy of the record is garbage now.
+        Packs::iterator old = _packs.find(slot->_pack);
+        if (old != _packs.end())
+            old->second._live -= slot->_size;
+    }
+    else
+    {
+        if (slot->_pack == SLOT_EMPTY)
+            ++h->_used;
+        ++h->_count;
+    }
+
+    slot->_hash = hash;
+    slot->_offset = offset;
+    slot->_size = size;
+    slot->_pack = pack;
+    slot->_time = (int64_t)time;
+
+    Packs::iterator p = _packs.find(pack);
+    if (p != _packs.end())
+        p->second._live += size;
+}
+
+char*
+PackStore::reserve(uint32_t size, uint32_t& pack, uint64_t& offset)
+{
+    // call with _writeMutex held.
+    Packs::iterator active = _packs.find(_activePack);
+
+    if (active == _packs.end() ||
+        packHeader(active->second._file.get())->_end + size > active->second._file->size())
+    {
+        if (active != _packs.end())
+            active->second._file->flush();
+
+        ScopedWriteLock indexLock(_indexMutex);
+        if (!createPack())
+            return 0L;
+
+        active = _packs.find(_activePack);
+    }
+
+    MappedFile* file = active->second._file.get();
+    PackHeader* ph = packHeader(file);
+
+    pack = _activePack;
+    offset = ph->_end;
+    ph->_end += size;
+    _size += size;
+
+    return file->data() + offset;
+}
+
+bool
+PackStore::read(const std::string& key, Record& out) const
+{
+    ScopedReadLock indexLock(_indexMutex);
+
+    if (!_index.valid())
+        return false;
+
+    const Slot* slot = find(key, hashKey(key));
+    if (!slot)
+        return false;
+
+    const MappedFile* file = _packs.find(slot->_pack)->second._file.get();
+    if (slot->_offset + slot->_size > file->size())
+        return false;
+
+    const char* ptr = file->data() + slot->_offset;
+    const RecordHeader* rh = reinterpret_cast<const RecordHeader*>(ptr);
+    if ((uint64_t)sizeof(RecordHeader) + rh->_keySize + rh->_metaSize + rh->_dataSize > slot->_size)
+        return false;
+
+    out._pack = const_cast<MappedFile*>(file);
+    out._meta = ptr + sizeof(RecordHeader) + rh->_keySize;
+    out._metaSize = rh->_metaSize;
+    out._data = out._meta + rh->_metaSize;
+    out._dataSize = rh->_dataSize;
+    out._time = (TimeStamp)slot->_time;
+
+    return true;
+}
+
+bool
+PackStore::write(const std::string& key, const std::string& meta, const std::string& data, TimeStamp time)
+{
+    uint64_t recordSize = paddedSize(sizeof(RecordHeader) + key.size() + meta.size() + data.size());
+    if (recordSize + sizeof(PackHeader) > _packSize)
+    {
+        OE_WARN << LC << "Record (" << key << ") is too large for a pack of " << _packSize << " bytes" << std::endl;
+        return false;
+    }
+
+    ScopedMutexLock writeLock(_writeMutex);
+
+    if (!_index.valid())
+        return false;
+
+    uint32_t pack;
+    uint64_t offset;
+    char* ptr = reserve((uint32_t)recordSize, pack, offset);
+    if (!ptr)
+        return false;
+
+    // Fill in the record before the index points to it. Nobody else looks
+    // at this part of the pack until then.
+    RecordHeader rh;
+    rh._magic = RECORD_MAGIC;
+    rh._keySize = (uint32_t)key.size();
+    rh._metaSize = (uint32_t)meta.size();
+    rh._dataSize = (uint32_t)data.size();
+
+    char* p = ptr;
+    ::memcpy(p, &rh, sizeof(RecordHeader)); p += sizeof(RecordHeader);
+    ::memcpy(p, key.data(), key.size());    p += key.size();
+    ::memcpy(p, meta.data(), meta.size());  p += meta.size();
+    ::memcpy(p, data.data(), data.size());  p += data.size();
+    ::memset(p, 0, ptr + recordSize - p);
+
+    {
+        ScopedWriteLock indexLock(_indexMutex);
+
+        uint64_t hash = hashKey(key);
+        bool exists;
+        Slot* slot = findForInsert(key, hash, exists);
+        if (!slot)
+            return false;
+
+        setSlot(slot, exists, hash, pack, offset, (uint32_t)recordSize, time);
+
+        // keep the table under 3/4 full, doubling it when the records
+        // alone would fill half of it.
+        IndexHeader* h = indexHeader();
+        if (h->_used * 4u > h->_capacity * 3u)
+        {
+            rebuildIndex(h->_count * 2u > h->_capacity ? h->_capacity * 2u : h->_capacity);
+        }
+    }
+
+    // over the limit? drop the oldest packs.
+    while (_maxSize > 0u && _size > _maxSize && _packs.size() > 1u && _packs.begin()->first != _activePack)
+    {
+        ScopedWriteLock indexLock(_indexMutex);
+        dropPack(_packs.begin()->first);
+    }
+
+    return _index.valid();
+}
+
+bool
+PackStore::contains(const std::string& key) const
+{
+    ScopedReadLock indexLock(_indexMutex);
+    return _index.valid() && find(key, hashKey(key)) != 0L;
+}
+
+bool
+PackStore::remove(const std::string& key)
+{
+    ScopedMutexLock writeLock(_writeMutex);
+    ScopedWriteLock indexLock(_indexMutex);
+
+    if (!_index.valid())
+        return false;
+
+    Slot* slot = find(key, hashKey(key));
+    if (!slot)
+        return false;
+
+    Packs::iterator p = _packs.find(slot->_pack);
+    if (p != _packs.end())
+        p->second._live -= slot->_size;
+
+    slot->_pack = SLOT_REMOVED;
+    --indexHeader()->_count;
+
+    return true;
+}
+
+bool
+PackStore::touch(const std::string& key, TimeStamp time)
+{
+    ScopedMutexLock writeLock(_writeMutex);
+    ScopedWriteLock indexLock(_indexMutex);
+
+    if (!_index.valid())
+        return false;
+
+    Slot* slot = find(key, hashKey(key));
+    if (!slot)
+        return false;
+
+    slot->_time = (int64_t)time;
+    return true;
+}
+
+bool
+PackStore::clear()
+{
+    ScopedMutexLock writeLock(_writeMutex);
+    ScopedWriteLock indexLock(_indexMutex);
+
+    if (!_index.valid())
+        return false;
+
+    for (Packs::iterator p = _packs.begin(); p != _packs.end(); ++p)
+        p->second._file->setRemoveOnClose(true);
+
+    _packs.clear();
+    _size = 0u;
+
+    // keep counting up, so no new pack has the name of a file that a
+    // reader may still hold.
+    uint32_t nextPack = indexHeader()->_nextPack;
+    initIndex(indexHeader()->_capacity);
+    indexHeader()->_nextPack = nextPack;
+
+    return createPack();
+}
+
+uint64_t
+PackStore::getSize() const
+{
+    ScopedMutexLock writeLock(_writeMutex);
+    return _size;
+}
+
+unsigned
+PackStore::compact(float minDeadRatio)
+{
+    std::vector<uint32_t> candidates;
+    {
+        ScopedMutexLock writeLock(_writeMutex);
+
+        for (Packs::const_iterator p = _packs.begin(); p != _packs.end(); ++p)
+        {
+            if (p->first == _activePack)
+                continue;
+
+            uint64_t payload = packHeader(p->second._file.get())->_end - sizeof(PackHeader);
+            uint64_t dead = payload - p->second._live;
+            if (dead > 0u && (double)dead >= (double)minDeadRatio * (double)payload)
+                candidates.push_back(p->first);
+        }
+    }
+
+    unsigned count = 0u;
+    for (std::vector<uint32_t>::const_iterator id = candidates.begin(); id != candidates.end(); ++id)
+    {
+        if (compactPack(*id))
+            ++count;
+    }
+    return count;
+}
+
+bool
+PackStore::compactPack(uint32_t id)
+{
+    typedef std::pair<uint64_t, uint32_t> Location; // offset, size
+    std::vector<Location> live;
+    osg::ref_ptr<MappedFile> file;
+
+    {
+        ScopedReadLock indexLock(_indexMutex);
+
+        Packs::const_iterator p = _packs.find(id);
+        if (!_index.valid() || p == _packs.end())
+            return false;
+
+        file = p->second._file.get();
+
+        const IndexHeader* h = indexHeader();
+        const Slot* s = slots();
+        for (uint64_t i = 0; i < h->_capacity; ++i)
+        {
+            if (s[i]._pack == id)
+                live.push_back(Location(s[i]._offset, s[i]._size));
+        }
+    }
+
+    // read the old pack front to back
+    std::sort(live.begin(), live.end());
+
+    // Copy one record at a time so writers only wait for one copy.
+    for (std::vector<Location>::const_iterator i = live.begin(); i != live.end(); ++i)
+    {
+        ScopedMutexLock writeLock(_writeMutex);
+
+        if (!_index.valid())
+            return false;
+
+        if (i->first + i->second > file->size())
+            continue;
+
+        const char* src = file->data() + i->first;
+        const RecordHeader* rh = reinterpret_cast<const RecordHeader*>(src);
+        if (rh->_magic != RECORD_MAGIC || sizeof(RecordHeader) + rh->_keySize > i->second)
+            continue;
+
+        std::string key(src + sizeof(RecordHeader), rh->_keySize);
+        uint64_t hash = hashKey(key);
+
+        // skip it if someone replaced or removed it in the meantime
+        Slot* slot = find(key, hash);
+        if (!slot || slot->_pack != id || slot->_offset != i->first)
+            continue;
+
+        uint32_t pack;
+        uint64_t offset;
+        char* dst = reserve(i->second, pack, offset);
+        if (!dst)
+            return false;
+
+        ::memcpy(dst, src, i->second);
+
+        ScopedWriteLock indexLock(_indexMutex);
+        setSlot(slot, true, hash, pack, offset, i->second, (TimeStamp)slot->_time);
+    }
+
+    {
+        ScopedMutexLock writeLock(_writeMutex);
+        ScopedWriteLock indexLock(_indexMutex);
+        if (_index.valid() && id != _activePack)
+            dropPack(id);
+    }
+
+    OE_DEBUG << LC << "Compacted pack " << id << " in \"" << _path << "\" (" << live.size() << " records)" << std::endl;
+    return true;
+}
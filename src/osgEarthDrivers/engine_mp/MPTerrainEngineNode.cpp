@@ -1039,6 +1039,11 @@ MPTerrainEngineNode::updateState()
                                 for( ColorFilterChain::const_iterator j = chain.begin(); j != chain.end(); ++j )
                                 {
                                     const ColorFilter* filter = j->get();
+
+                                    // already applied to the tile images
+                                    if ( layer->getCPUColorFilters() && filter->supportsCPU() )
+                                        continue;
+
                                     cf_head << "void " << filter->getEntryPointFunctionName() << "(inout vec4 color);\n";
                                     cf_body << I << I << filter->getEntryPointFunctionName() << "(color);\n";
                                     filter->install( terrainStateSet );
@@ -0,0 +1,239 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2008-2014 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "BindlessTextures"
+#include <osgEarth/Notify>
+#include <osg/GLExtensions>
+#include <osg/Image>
+
+using namespace osgEarth::REX;
+using namespace osgEarth;
+
+#define LC "[BindlessTextures] "
+
+namespace
+{
+    // Textures whose contents or parameters may change after the first
+    // upload can't use a handle, because a handle freezes the texture.
+    bool isEligible(const osg::Texture* texture)
+    {
+        if (texture->getDataVariance() == osg::Object::DYNAMIC)
+            return false;
+
+        for (unsigned i = 0; i < texture->getNumImages(); ++i)
+        {
+            const osg::Image* image = texture->getImage(i);
+            if (image &&
+                (image->getDataVariance() == osg::Object::DYNAMIC || image->requiresUpdateCall()))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+BindlessTextures::PerContext::PerContext() :
+_initialized(false),
+_supported(false),
+_lastFlushFrame(~0u),
+_glGetTextureHandle(0L),
+_glMakeTextureHandleResident(0L),
+_glMakeTextureHandleNonResident(0L),
+_glUniformHandleui64(0L)
+{
+    //nop
+}
+
+BindlessTextures::BindlessTextures()
+{
+    _pc.resize(64);
+}
+
+BindlessTextures::PerContext&
+BindlessTextures::get(unsigned contextID) const
+{
+    PerContext& pc = _pc[contextID];
+
+    if (!pc._initialized)
+    {
+        pc._initialized = true;
+
+        if (osg::isGLExtensionSupported(contextID, "GL_ARB_bindless_texture"))
+        {
+            osg::setGLExtensionFuncPtr(pc._glGetTextureHandle, "glGetTextureHandleARB");
+            osg::setGLExtensionFuncPtr(pc._glMakeTextureHandleResident, "glMakeTextureHandleResidentARB");
+            osg::setGLExtensionFuncPtr(pc._glMakeTextureHandleNonResident, "glMakeTextureHandleNonResidentARB");
+            osg::setGLExtensionFuncPtr(pc._glUniformHandleui64, "glUniformHandleui64ARB");
+
+            pc._supported =
+                pc._glGetTextureHandle != 0L &&
+                pc._glMakeTextureHandleResident != 0L &&
+                pc._glMakeTextureHandleNonResident != 0L &&
+                pc._glUniformHandleui64 != 0L;
+        }
+
+        if (pc._supported)
+        {
+            OE_INFO << LC << "Using bindless textures in context " << contextID << std::endl;
+        }
+        else
+        {
+            OE_INFO << LC << "GL_ARB_bindless_texture not available in context " << contextID
+                << "; textures will bind normally" << std::endl;
+        }
+    }
+
+    return pc;
+}
+
+bool
+BindlessTextures::isSupported(osg::State& state) const
+{
+    return get(state.getContextID())._supported;
+}
+
+GLuint64
+BindlessTextures::getHandle(osg::Texture* texture, osg::State& state)
+{
+    unsigned contextID = state.getContextID();
+    PerContext& pc = get(contextID);
+
+    if (!pc._supported || texture == 0L)
+        return 0;
+
+    Entries::iterator i = pc._entries.find(texture);
+    if (i != pc._entries.end())
+    {
+        osg::Texture::TextureObject* to = texture->getTextureObject(contextID);
+        if (to && to->id() == i->second._name)
+            return i->second._handle;
+
+        // Someone replaced the texture object since we took the handle.
+        // Drop the stale handle and take a new one below.
+        pc._glMakeTextureHandleNonResident(i->second._handle);
+        pc._entries.erase(i);
+    }
+
+    if (!isEligible(texture))
+        return 0;
+
+    // Compile and upload the texture, and get its parameters in place,
+    // before we freeze it with a handle.
+    texture->apply(state);
+
+    osg::Texture::TextureObject* to = texture->getTextureObject(contextID);
+    if (!to || !to->isAllocated())
+        return 0;
+
+    GLuint64 handle = pc._glGetTextureHandle(to->id());
+    if (handle == 0)
+        return 0;
+
+    pc._glMakeTextureHandleResident(handle);
+
+    Entry& entry = pc._entries[texture];
+    entry._texture = texture;
+    entry._name = to->id();
+    entry._handle = handle;
+
+    return handle;
+}
+
+void
+BindlessTextures::setUniformHandle(osg::State& state, GLint location, GLuint64 handle) const
+{
+    get(state.getContextID())._glUniformHandleui64(location, handle);
+}
+
+void
+BindlessTextures::release(PerContext& pc, Entry& entry, unsigned contextID) const
+{
+    pc._glMakeTextureHandleNonResident(entry._handle);
+
+    // A GL texture with a handle can never be re-specified, but OSG recycles
+    // texture objects for new textures with the same profile. Swap in a new
+    // name so the recycled object starts out with mutable storage.
+    osg::Texture::TextureObject* to = entry._texture->getTextureObject(contextID);
+    if (to && to->id() == entry._name)
+    {
+        glDeleteTextures(1, &to->_id);
+        glGenTextures(1, &to->_id);
+        to->setAllocated(false);
+    }
+
+    entry._texture = 0L;
+}
+
+void
+BindlessTextures::flush(osg::State& state)
+{
+    unsigned contextID = state.getContextID();
+    PerContext& pc = get(contextID);
+
+    if (!pc._supported || pc._entries.empty())
+        return;
+
+    unsigned frame = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0u;
+    if (frame == pc._lastFlushFrame)
+        return;
+    pc._lastFlushFrame = frame;
+
+    for (Entries::iterator i = pc._entries.begin(); i != pc._entries.end(); )
+    {
+        // we hold the only reference, so no tile can draw it any more:
+        if (i->second._texture->referenceCount() == 1)
+        {
+            release(pc, i->second, contextID);
+            pc._entries.erase(i++);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+unsigned
+BindlessTextures::getNumHandles(unsigned contextID) const
+{
+    return _pc[contextID]._entries.size();
+}
+
+void
+BindlessTextures::releaseGLObjects(osg::State* state) const
+{
+    if (state)
+    {
+        unsigned contextID = state->getContextID();
+        PerContext& pc = _pc[contextID];
+        if (pc._supported)
+        {
+            for (Entries::iterator i = pc._entries.begin(); i != pc._entries.end(); ++i)
+                release(pc, i->second, contextID);
+        }
+        pc._entries.clear();
+    }
+    else
+    {
+        // No context; the GL objects are going away with their contexts,
+        // so just let go of the textures.
+        for (unsigned i = 0; i < _pc.size(); ++i)
+            _pc[i]._entries.clear();
+    }
+}
@@ -62,7 +62,7 @@ CreateTileImplementation::createTile(
     }
 
     // Dimension of each tile in vertices
-    unsigned tileSize = context->options().tileSize().get();
+    unsigned tileSize = context->getTileSize(model->getKey().getLOD());
 
     bool includeTilesWithMasks = (flags & TerrainEngineNode::CREATE_TILE_INCLUDE_TILES_WITH_MASKS) != 0;
     bool includeTilesWithoutMasks = (flags & TerrainEngineNode::CREATE_TILE_INCLUDE_TILES_WITHOUT_MASKS) != 0;
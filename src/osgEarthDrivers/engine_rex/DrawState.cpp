@@ -45,6 +45,8 @@ PerContextDrawState::refresh(osg::RenderInfo& ri, const RenderBindings* bindings
         //_runningLayerDrawOrder = 0;
         _elevTexelCoeff.clear();
         _morphConstants.clear();
+        _vertexOffset.clear();
+        _vertexScale.clear();
         _parentTextureExists.clear();
         _samplerState.clear();
 
@@ -54,6 +56,7 @@ PerContextDrawState::refresh(osg::RenderInfo& ri, const RenderBindings* bindings
         {
             const SamplerBinding& binding = (*bindings)[i];
             _samplerState._samplers[i]._matrixUL = pcp->getUniformLocation(osg::Uniform::getNameID(binding.matrixName()));
+            _samplerState._samplers[i]._samplerUL = pcp->getUniformLocation(osg::Uniform::getNameID(binding.samplerName()));
         }
 
         // resolve all the other uniform locations:
@@ -63,6 +66,8 @@ PerContextDrawState::refresh(osg::RenderInfo& ri, const RenderBindings* bindings
         _layerUidUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_uid"));
         _layerOrderUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_order"));
         _morphConstantsUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_morph"));
+        _vertexOffsetUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_vertexOffset"));
+        _vertexScaleUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_vertexScale"));
     }
 
     _pcp = pcp;
@@ -78,8 +78,33 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
 
             if (sampler._texture.valid() && !samplerState._texture.isSetTo(sampler._texture.get()))
             {
-                state.setActiveTextureUnit((*dsMaster._bindings)[s].unit());
-                sampler._texture->apply(state);
+                int unit = (*dsMaster._bindings)[s].unit();
+                state.setActiveTextureUnit(unit);
+
+                if (ds._bindless && samplerState._samplerUL >= 0)
+                {
+                    // Point the sampler straight at the texture's handle if it
+                    // has one; otherwise point it back at the texture unit.
+                    GLuint64 handle = dsMaster._bindless->getHandle(sampler._texture.get(), state);
+                    if (handle != 0)
+                    {
+                        dsMaster._bindless->setUniformHandle(state, samplerState._samplerUL, handle);
+                        samplerState._handle = true;
+                    }
+                    else
+                    {
+                        sampler._texture->apply(state);
+                        if (!samplerState._handle.isSetTo(false))
+                        {
+                            ds._ext->glUniform1i(samplerState._samplerUL, unit);
+                            samplerState._handle = false;
+                        }
+                    }
+                }
+                else
+                {
+                    sampler._texture->apply(state);
+                }
                 samplerState._texture = sampler._texture.get();
             }
 
@@ -123,6 +148,29 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
         }
     }
 
+    // Unpacking constants for a packed geometry
+    if (_geom.valid() && _geom->isPacked())
+    {
+        if (ds._vertexOffsetUL >= 0 && !ds._vertexOffset.isSetTo(_geom->getPackOffset()))
+        {
+            ds._ext->glUniform3fv(ds._vertexOffsetUL, 1, _geom->getPackOffset().ptr());
+            ds._vertexOffset = _geom->getPackOffset();
+        }
+
+        if (ds._vertexScaleUL >= 0 && !ds._vertexScale.isSetTo(_geom->getPackScale()))
+        {
+            ds._ext->glUniform3fv(ds._vertexScaleUL, 1, _geom->getPackScale().ptr());
+            ds._vertexScale = _geom->getPackScale();
+        }
+    }
+
+    // Whether to draw through the GPU culler's commands. Set this even
+    // for patch callbacks, which may draw the geometry themselves.
+    if (_geom.valid())
+    {
+        _geom->_indirect[ri.getContextID()] = ds._indirect;
+    }
+
     if (_drawCallback)
     {
         PatchLayer::DrawContext dc;
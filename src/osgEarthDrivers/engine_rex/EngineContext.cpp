@@ -65,3 +65,16 @@ EngineContext::getMap() const
     _map.lock(map);
     return map;
 }
+
+unsigned
+EngineContext::getTileSize(unsigned lod) const
+{
+    unsigned size = _options.tileSize().get();
+    unsigned maxLOD = _options.maxGeometryLOD().get();
+    if (lod > maxLOD && size > 2u)
+    {
+        unsigned shift = osg::minimum(lod - maxLOD, 16u);
+        size = osg::maximum(((size - 1u) >> shift) + 1u, 2u);
+    }
+    return size;
+}
@@ -0,0 +1,319 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2008-2014 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "GPUCuller"
+#include "DrawTileCommand"
+#include "Shaders"
+#include <osgEarth/ShaderLoader>
+#include <osgEarth/Notify>
+#include <cfloat>
+
+using namespace osgEarth::REX;
+using namespace osgEarth;
+
+#define LC "[GPUCuller] "
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+
+namespace
+{
+    // must match local_size_x in the shader
+    const GLuint WORKGROUP_SIZE = 64u;
+
+    GLuint getElementSize(GLenum type)
+    {
+        return
+            type == GL_UNSIGNED_BYTE ? 1u :
+            type == GL_UNSIGNED_SHORT ? 2u :
+            4u;
+    }
+}
+
+GPUCuller::PerContext::PerContext() :
+_initialized(false),
+_supported(false),
+_program(0),
+_projectionUL(-1),
+_numTilesUL(-1),
+_tileBuffer(0),
+_commandBuffer(0),
+_glDispatchCompute(0L),
+_glMemoryBarrier(0L),
+_glDrawElementsIndirect(0L)
+{
+    //nop
+}
+
+GPUCuller::GPUCuller() :
+_active(false)
+{
+    _pc.resize(64);
+
+    Shaders package;
+    _source = ShaderLoader::load(package.ENGINE_GPU_CULL, package);
+}
+
+GPUCuller::PerContext&
+GPUCuller::get(osg::State& state) const
+{
+    unsigned contextID = state.getContextID();
+    PerContext& pc = _pc[contextID];
+
+    if (!pc._initialized)
+    {
+        pc._initialized = true;
+
+        if (osg::isGLExtensionOrVersionSupported(contextID, "GL_ARB_compute_shader", 4.3f) &&
+            osg::isGLExtensionOrVersionSupported(contextID, "GL_ARB_shader_storage_buffer_object", 4.3f) &&
+            osg::isGLExtensionOrVersionSupported(contextID, "GL_ARB_draw_indirect", 4.0f))
+        {
+            osg::setGLExtensionFuncPtr(pc._glDispatchCompute, "glDispatchCompute");
+            osg::setGLExtensionFuncPtr(pc._glMemoryBarrier, "glMemoryBarrier");
+            osg::setGLExtensionFuncPtr(pc._glDrawElementsIndirect, "glDrawElementsIndirect");
+
+            pc._supported =
+                pc._glDispatchCompute != 0L &&
+                pc._glMemoryBarrier != 0L &&
+                pc._glDrawElementsIndirect != 0L &&
+                compile(pc, contextID);
+        }
+
+        if (pc._supported)
+        {
+            _active = true;
+            OE_INFO << LC << "Culling terrain tiles on the GPU in context " << contextID << std::endl;
+        }
+        else
+        {
+            OE_INFO << LC << "Compute shaders or indirect draws not available in context " << contextID
+                << "; terrain tiles will cull on the CPU" << std::endl;
+        }
+    }
+
+    return pc;
+}
+
+bool
+GPUCuller::compile(PerContext& pc, unsigned contextID) const
+{
+    pc._ext = osg::GLExtensions::Get(contextID, true);
+    osg::GLExtensions* ext = pc._ext.get();
+
+    GLint ok = GL_FALSE;
+    char log[1024];
+
+    GLuint shader = ext->glCreateShader(GL_COMPUTE_SHADER);
+    const GLchar* source = _source.c_str();
+    ext->glShaderSource(shader, 1, &source, 0L);
+    ext->glCompileShader(shader);
+    ext->glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok != GL_TRUE)
+    {
+        ext->glGetShaderInfoLog(shader, sizeof(log), 0L, log);
+        OE_WARN << LC << "Culling shader failed to compile: " << log << std::endl;
+        ext->glDeleteShader(shader);
+        return false;
+    }
+
+    pc._program = ext->glCreateProgram();
+    ext->glAttachShader(pc._program, shader);
+    ext->glLinkProgram(pc._program);
+    ext->glDeleteShader(shader);
+    ext->glGetProgramiv(pc._program, GL_LINK_STATUS, &ok);
+    if (ok != GL_TRUE)
+    {
+        ext->glGetProgramInfoLog(pc._program, sizeof(log), 0L, log);
+        OE_WARN << LC << "Culling shader failed to link: " << log << std::endl;
+        ext->glDeleteProgram(pc._program);
+        pc._program = 0;
+        return false;
+    }
+
+    pc._projectionUL = ext->glGetUniformLocation(pc._program, "oe_gpucull_projection");
+    pc._numTilesUL = ext->glGetUniformLocation(pc._program, "oe_gpucull_numTiles");
+
+    ext->glGenBuffers(1, &pc._tileBuffer);
+    ext->glGenBuffers(1, &pc._commandBuffer);
+
+    return true;
+}
+
+bool
+GPUCuller::isSupported(osg::State& state) const
+{
+    return get(state)._supported;
+}
+
+void
+GPUCuller::setCommand(Command& command, const osg::DrawElements* elements, const osg::GLBufferObject* ebo) const
+{
+    command._instanceCount = 1u;
+    command._baseVertex = 0;
+    command._baseInstance = 0u;
+
+    if (elements && ebo && elements->getNumIndices() > 0u)
+    {
+        command._count = elements->getNumIndices();
+        command._firstIndex = ebo->getOffset(elements->getBufferIndex()) / getElementSize(elements->getDataType());
+    }
+    else
+    {
+        command._count = 0u;
+        command._firstIndex = 0u;
+    }
+}
+
+bool
+GPUCuller::cull(const std::vector<DrawTileCommand>& tiles, osg::State& state)
+{
+    PerContext& pc = get(state);
+
+    if (!pc._supported || tiles.empty())
+        return false;
+
+    unsigned contextID = state.getContextID();
+    osg::GLExtensions* ext = pc._ext.get();
+
+    pc._tiles.resize(tiles.size());
+    pc._commands.resize(tiles.size() * 2u);
+
+    for (unsigned i = 0; i < tiles.size(); ++i)
+    {
+        const DrawTileCommand& tile = tiles[i];
+        Tile& record = pc._tiles[i];
+
+        record._modelView.set(*tile._modelViewMatrix);
+
+        if (tile._box && tile._box->valid())
+        {
+            record._boxMin.set(tile._box->xMin(), tile._box->yMin(), tile._box->zMin(), 1.0f);
+            record._boxMax.set(tile._box->xMax(), tile._box->yMax(), tile._box->zMax(), 1.0f);
+        }
+        else
+        {
+            // no box; never cull it
+            record._boxMin.set(-FLT_MAX, -FLT_MAX, -FLT_MAX, 1.0f);
+            record._boxMax.set(FLT_MAX, FLT_MAX, FLT_MAX, 1.0f);
+        }
+
+        const osg::DrawElements* drawElements = 0L;
+        const osg::DrawElements* maskElements = 0L;
+        osg::GLBufferObject* ebo = 0L;
+
+        // Patch layers draw through their own callbacks.
+        if (tile._geom.valid() && !tile._drawCallback)
+        {
+            drawElements = tile._geom->getDrawElements();
+            maskElements = tile._geom->getMaskElements();
+            ebo = tile._geom->getDrawElements()->getOrCreateGLBufferObject(contextID);
+
+            // The element offsets aren't known until the buffer compiles.
+            if (ebo && ebo->isDirty())
+            {
+                state.bindElementBufferObject(ebo);
+                state.unbindElementBufferObject();
+            }
+        }
+
+        setCommand(pc._commands[2u*i], drawElements, ebo);
+        setCommand(pc._commands[2u*i+1u], maskElements, ebo);
+    }
+
+    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, pc._tileBuffer);
+    ext->glBufferData(GL_SHADER_STORAGE_BUFFER, pc._tiles.size()*sizeof(Tile), &pc._tiles.front(), GL_STREAM_DRAW_ARB);
+    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, pc._commandBuffer);
+    ext->glBufferData(GL_SHADER_STORAGE_BUFFER, pc._commands.size()*sizeof(Command), &pc._commands.front(), GL_STREAM_DRAW_ARB);
+    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pc._tileBuffer);
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, pc._commandBuffer);
+
+    ext->glUseProgram(pc._program);
+    osg::Matrixf projection(state.getProjectionMatrix());
+    ext->glUniformMatrix4fv(pc._projectionUL, 1, GL_FALSE, projection.ptr());
+    ext->glUniform1ui(pc._numTilesUL, (GLuint)tiles.size());
+    pc._glDispatchCompute(((GLuint)tiles.size() + WORKGROUP_SIZE - 1u) / WORKGROUP_SIZE, 1u, 1u);
+    pc._glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+    // Put back the terrain program that OSG thinks is current.
+    const osg::Program::PerContextProgram* pcp = state.getLastAppliedProgramObject();
+    ext->glUseProgram(pcp ? pcp->getHandle() : 0);
+
+    // Release the storage bindings, and have OSG reapply any of its own
+    // there next time it applies state.
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+    state.haveAppliedAttribute(osg::StateAttribute::SHADERSTORAGEBUFFERBINDING, 0);
+    state.haveAppliedAttribute(osg::StateAttribute::SHADERSTORAGEBUFFERBINDING, 1);
+
+    ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, pc._commandBuffer);
+
+    return true;
+}
+
+SharedGeometry::IndirectDraw
+GPUCuller::getIndirectDraw(unsigned index, osg::State& state) const
+{
+    SharedGeometry::IndirectDraw indirect;
+    indirect._glDrawElementsIndirect = _pc[state.getContextID()]._glDrawElementsIndirect;
+    indirect._offset = (GLintptr)(2u * index * COMMAND_SIZE);
+    return indirect;
+}
+
+void
+GPUCuller::finish(osg::State& state) const
+{
+    PerContext& pc = _pc[state.getContextID()];
+    if (pc._supported)
+    {
+        pc._ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
+
+void
+GPUCuller::releaseGLObjects(osg::State* state) const
+{
+    if (state)
+    {
+        PerContext& pc = _pc[state->getContextID()];
+        if (pc._supported)
+        {
+            pc._ext->glDeleteBuffers(1, &pc._tileBuffer);
+            pc._ext->glDeleteBuffers(1, &pc._commandBuffer);
+            pc._ext->glDeleteProgram(pc._program);
+        }
+        pc = PerContext();
+    }
+    else
+    {
+        // No context; the GL objects are going away with their contexts.
+        for (unsigned i = 0; i < _pc.size(); ++i)
+            _pc[i] = PerContext();
+    }
+}
@@ -17,11 +17,13 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include "GeometryPool"
+#include "GPUCuller"
 #include <osgEarth/Locators>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/TopologyGraph>
 #include <osg/Point>
 #include <cstdlib> // for getenv
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -29,6 +31,10 @@ using namespace osgEarth::REX;
 
 #define LC "[GeometryPool] "
 
+// Number of masked tile geometries to keep around after their tiles
+// unload, in case the tiles come back.
+#define MAX_IDLE_MASKED_GEOMETRIES 256
+
 // TODO: experiment with sharing a single texture coordinate array 
 //// across all shared geometries.
 /// JB:  Disabled to fix issues with ATI.
@@ -48,6 +54,7 @@ using namespace osgEarth::REX;
 
 GeometryPool::GeometryPool(const TerrainOptions& options) :
 _options ( options ),
+_maskedGeometryUses( 0u ),
 _enabled ( true ),
 _debug   ( false )
 {
@@ -90,7 +97,11 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
         bool masking = maskSet && maskSet->hasMasks();
 
         GeometryMap::iterator i = _geometryMap.find( geomKey );
-        if ( !masking && i != _geometryMap.end() )
+        if ( masking )
+        {
+            getMaskedGeometry( tileKey, tileSize, geomKey, maskSet, out );
+        }
+        else if ( i != _geometryMap.end() )
         {
             // Found. return it.
             out = i->second.get();
@@ -100,7 +111,7 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
             // Not found. Create it.
             out = createGeometry( tileKey, tileSize, maskSet );
 
-            if (!masking && out.valid())
+            if (out.valid())
             {
                 _geometryMap[ geomKey ] = out.get();
             }
@@ -118,6 +129,96 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
     }
 }
 
+void
+GeometryPool::getMaskedGeometry(const TileKey&                tileKey,
+                                unsigned                      tileSize,
+                                const GeometryKey&            geomKey,
+                                MaskGenerator*                maskSet,
+                                osg::ref_ptr<SharedGeometry>& out)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    std::vector<osg::ref_ptr<osg::Vec3dArray> > boundaries;
+    maskSet->getBoundaries(boundaries);
+
+    MaskedGeometry& entry = _maskedGeometryMap[tileKey];
+
+    if (entry._boundaries != boundaries)
+    {
+        // New, or the masks changed. Build it.
+        entry._boundaries.swap(boundaries);
+        entry._geom = createGeometry( tileKey, tileSize, maskSet );
+
+        // The masks only overlapped the tile's bounding box, so it came out as
+        // a regular tile, which we can share with other tiles. (Tiles where a
+        // mask cut out the whole tile are empty and we keep those.)
+        if (entry._geom.valid() &&
+            !entry._geom->empty() &&
+            !entry._geom->getMaskElements())
+        {
+            osg::ref_ptr<SharedGeometry>& pooled = _geometryMap[geomKey];
+            if (!pooled.valid())
+                pooled = entry._geom.get();
+            entry._geom = 0L;
+        }
+    }
+
+    entry._lastUsed = _maskedGeometryUses++;
+
+    if (entry._geom.valid())
+    {
+        out = entry._geom.get();
+    }
+    else
+    {
+        osg::ref_ptr<SharedGeometry>& pooled = _geometryMap[geomKey];
+        if (!pooled.valid())
+            pooled = createGeometry( tileKey, tileSize, 0L );
+        out = pooled.get();
+    }
+}
+
+namespace
+{
+    struct SortByLastUse
+    {
+        bool operator()(const GeometryPool::MaskedGeometryMap::iterator& lhs,
+                        const GeometryPool::MaskedGeometryMap::iterator& rhs) const
+        {
+            return lhs->second._lastUsed > rhs->second._lastUsed;
+        }
+    };
+}
+
+void
+GeometryPool::pruneMaskedGeometry()
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    std::vector<MaskedGeometryMap::iterator> idle;
+    for (MaskedGeometryMap::iterator i = _maskedGeometryMap.begin(); i != _maskedGeometryMap.end(); ++i)
+    {
+        if (!i->second._geom.valid() || i->second._geom->referenceCount() == 1)
+        {
+            idle.push_back(i);
+        }
+    }
+
+    if (idle.size() > MAX_IDLE_MASKED_GEOMETRIES)
+    {
+        // keep the most recently used ones
+        std::sort(idle.begin(), idle.end(), SortByLastUse());
+
+        for (unsigned i = MAX_IDLE_MASKED_GEOMETRIES; i < idle.size(); ++i)
+        {
+            if (idle[i]->second._geom.valid())
+                idle[i]->second._geom->releaseGLObjects(NULL);
+
+            _maskedGeometryMap.erase(idle[i]);
+        }
+    }
+}
+
 void
 GeometryPool::createKeyForTileKey(const TileKey&             tileKey,
                                   unsigned                   tileSize,
@@ -514,6 +615,11 @@ GeometryPool::createGeometry(const TileKey& tileKey,
         }
     }
 
+    if (_options.packedVertices() == true)
+    {
+        geom->createPackedArrays();
+    }
+
     return geom.release();
 }
 
@@ -545,6 +651,8 @@ GeometryPool::traverse(osg::NodeVisitor& nv)
         {
             _geometryMap.erase(*key);
         }
+
+        pruneMaskedGeometry();
     }
 
     osg::Group::traverse(nv);
@@ -556,6 +664,7 @@ GeometryPool::clear()
     releaseGLObjects(NULL);
     _geometryMapMutex.lock();
     _geometryMap.clear();
+    _maskedGeometryMap.clear();
     _geometryMapMutex.unlock();
 }
 
@@ -572,6 +681,12 @@ GeometryPool::resizeGLObjectBuffers(unsigned maxsize)
         {
             i->second->resizeGLObjectBuffers(maxsize);
         }
+
+        for (MaskedGeometryMap::const_iterator i = _maskedGeometryMap.begin(); i != _maskedGeometryMap.end(); ++i)
+        {
+            if (i->second._geom.valid())
+                i->second._geom->resizeGLObjectBuffers(maxsize);
+        }
     }
     _geometryMapMutex.unlock();
 }
@@ -595,6 +710,16 @@ GeometryPool::releaseGLObjects(osg::State* state) const
                 i->second->releaseGLObjects(state);
         }
 
+        for (MaskedGeometryMap::const_iterator i = _maskedGeometryMap.begin(); i != _maskedGeometryMap.end(); ++i)
+        {
+            if (!i->second._geom.valid())
+                continue;
+            else if (_releaser.valid())
+                objects.push_back(i->second._geom.get());
+            else
+                i->second._geom->releaseGLObjects(state);
+        }
+
         if (_releaser.valid() && !objects.empty())
         {
             OE_INFO << LC << "Released " << objects.size() << " objects in the geometry pool\n";
@@ -618,6 +743,7 @@ SharedGeometry::SharedGeometry()
     _supportsVertexBufferObjects = true;
     _ptype.resize(64u);
     _ptype.setAllElementsTo(GL_TRIANGLES);
+    _indirect.resize(64u);
 }
 
 SharedGeometry::SharedGeometry(const SharedGeometry& rhs,const osg::CopyOp& copyop):
@@ -628,7 +754,14 @@ SharedGeometry::SharedGeometry(const SharedGeometry& rhs,const osg::CopyOp& copy
     _neighborArray(rhs._neighborArray),
     _neighborNormalArray(rhs._neighborNormalArray),
     _drawElements(rhs._drawElements),
-    _maskElements(rhs._maskElements)
+    _maskElements(rhs._maskElements),
+    _packedVertexArray(rhs._packedVertexArray),
+    _packedNormalArray(rhs._packedNormalArray),
+    _packedTexCoordArray(rhs._packedTexCoordArray),
+    _packedNeighborArray(rhs._packedNeighborArray),
+    _packedNeighborNormalArray(rhs._packedNeighborNormalArray),
+    _packOffset(rhs._packOffset),
+    _packScale(rhs._packScale)
 {
     //nop
 }
@@ -646,6 +779,121 @@ SharedGeometry::empty() const
         (_maskElements.valid() == false || _maskElements->getNumIndices() == 0);
 }
 
+size_t
+SharedGeometry::getTotalDataSize() const
+{
+    size_t bytes = 0u;
+    if (_vertexArray.valid())         bytes += _vertexArray->getTotalDataSize();
+    if (_normalArray.valid())         bytes += _normalArray->getTotalDataSize();
+    if (_colorArray.valid())          bytes += _colorArray->getTotalDataSize();
+    if (_texcoordArray.valid())       bytes += _texcoordArray->getTotalDataSize();
+    if (_neighborArray.valid())       bytes += _neighborArray->getTotalDataSize();
+    if (_neighborNormalArray.valid()) bytes += _neighborNormalArray->getTotalDataSize();
+    if (_drawElements.valid())        bytes += _drawElements->getTotalDataSize();
+    if (_maskElements.valid())        bytes += _maskElements->getTotalDataSize();
+    if (_packedVertexArray.valid())   bytes += _packedVertexArray->getTotalDataSize();
+    if (_packedNormalArray.valid())   bytes += _packedNormalArray->getTotalDataSize();
+    if (_packedTexCoordArray.valid()) bytes += _packedTexCoordArray->getTotalDataSize();
+    if (_packedNeighborArray.valid()) bytes += _packedNeighborArray->getTotalDataSize();
+    if (_packedNeighborNormalArray.valid()) bytes += _packedNeighborNormalArray->getTotalDataSize();
+    return bytes;
+}
+
+namespace
+{
+    inline short quantize(float value)
+    {
+        return (short)osg::clampBetween(osg::round(value), -32767.0f, 32767.0f);
+    }
+
+    inline osg::Vec4s packPosition(const osg::Vec3f& v, const osg::Vec3f& offset, const osg::Vec3f& scale)
+    {
+        osg::Vec3f p = v - offset;
+        return osg::Vec4s(quantize(p.x()/scale.x()), quantize(p.y()/scale.y()), quantize(p.z()/scale.z()), 1);
+    }
+}
+
+void
+SharedGeometry::createPackedArrays()
+{
+    const osg::Vec3Array* verts = dynamic_cast<const osg::Vec3Array*>(_vertexArray.get());
+    const osg::Vec3Array* normals = dynamic_cast<const osg::Vec3Array*>(_normalArray.get());
+    const osg::Vec3Array* texCoords = dynamic_cast<const osg::Vec3Array*>(_texcoordArray.get());
+    const osg::Vec3Array* neighbors = dynamic_cast<const osg::Vec3Array*>(_neighborArray.get());
+    const osg::Vec3Array* neighborNormals = dynamic_cast<const osg::Vec3Array*>(_neighborNormalArray.get());
+
+    if (!verts || verts->empty())
+        return;
+
+    // Positions and neighbor positions are quantized across the bounds:
+    osg::BoundingBox box;
+    for (osg::Vec3Array::const_iterator i = verts->begin(); i != verts->end(); ++i)
+        box.expandBy(*i);
+    if (neighbors)
+        for (osg::Vec3Array::const_iterator i = neighbors->begin(); i != neighbors->end(); ++i)
+            box.expandBy(*i);
+
+    _packOffset = box.center();
+    _packScale = (box._max - box._min) * (0.5f / 32767.0f);
+    for (unsigned i = 0; i < 3; ++i)
+        if (_packScale[i] <= 0.0f) _packScale[i] = 1.0f;
+
+    osg::ref_ptr<osg::VertexBufferObject> vbo = new osg::VertexBufferObject();
+
+    osg::Vec4sArray* packedVerts = new osg::Vec4sArray();
+    packedVerts->setBinding(osg::Array::BIND_PER_VERTEX);
+    packedVerts->setVertexBufferObject(vbo.get());
+    packedVerts->reserve(verts->size());
+    for (osg::Vec3Array::const_iterator i = verts->begin(); i != verts->end(); ++i)
+        packedVerts->push_back(packPosition(*i, _packOffset, _packScale));
+    _packedVertexArray = packedVerts;
+
+    if (normals)
+    {
+        osg::Vec3sArray* packed = new osg::Vec3sArray();
+        packed->setBinding(osg::Array::BIND_PER_VERTEX);
+        packed->setNormalize(true);
+        packed->setVertexBufferObject(vbo.get());
+        packed->reserve(normals->size());
+        for (osg::Vec3Array::const_iterator i = normals->begin(); i != normals->end(); ++i)
+            packed->push_back(osg::Vec3s(quantize(i->x()*32767.0f), quantize(i->y()*32767.0f), quantize(i->z()*32767.0f)));
+        _packedNormalArray = packed;
+    }
+
+    if (texCoords)
+    {
+        osg::Vec4sArray* packed = new osg::Vec4sArray();
+        packed->setBinding(osg::Array::BIND_PER_VERTEX);
+        packed->setVertexBufferObject(vbo.get());
+        packed->reserve(texCoords->size());
+        for (osg::Vec3Array::const_iterator i = texCoords->begin(); i != texCoords->end(); ++i)
+            packed->push_back(osg::Vec4s(quantize(i->x()*32767.0f), quantize(i->y()*32767.0f), (short)i->z(), 1));
+        _packedTexCoordArray = packed;
+    }
+
+    if (neighbors)
+    {
+        osg::Vec4sArray* packed = new osg::Vec4sArray();
+        packed->setBinding(osg::Array::BIND_PER_VERTEX);
+        packed->setVertexBufferObject(vbo.get());
+        packed->reserve(neighbors->size());
+        for (osg::Vec3Array::const_iterator i = neighbors->begin(); i != neighbors->end(); ++i)
+            packed->push_back(packPosition(*i, _packOffset, _packScale));
+        _packedNeighborArray = packed;
+    }
+
+    if (neighborNormals)
+    {
+        osg::Vec4sArray* packed = new osg::Vec4sArray();
+        packed->setBinding(osg::Array::BIND_PER_VERTEX);
+        packed->setVertexBufferObject(vbo.get());
+        packed->reserve(neighborNormals->size());
+        for (osg::Vec3Array::const_iterator i = neighborNormals->begin(); i != neighborNormals->end(); ++i)
+            packed->push_back(osg::Vec4s(quantize(i->x()*32767.0f), quantize(i->y()*32767.0f), quantize(i->z()*32767.0f), 0));
+        _packedNeighborNormalArray = packed;
+    }
+}
+
 #ifdef SUPPORTS_VAO
 #if OSG_MIN_VERSION_REQUIRED(3,5,9)
 osg::VertexArrayState* SharedGeometry::createVertexArrayStateImplementation(osg::RenderInfo& renderInfo) const
@@ -692,6 +940,11 @@ void SharedGeometry::resizeGLObjectBuffers(unsigned int maxSize)
     if (_neighborNormalArray.valid()) _neighborNormalArray->resizeGLObjectBuffers(maxSize);
     if (_drawElements.valid()) _drawElements->resizeGLObjectBuffers(maxSize);
     if (_maskElements.valid()) _maskElements->resizeGLObjectBuffers(maxSize);
+    if (_packedVertexArray.valid()) _packedVertexArray->resizeGLObjectBuffers(maxSize);
+    if (_packedNormalArray.valid()) _packedNormalArray->resizeGLObjectBuffers(maxSize);
+    if (_packedTexCoordArray.valid()) _packedTexCoordArray->resizeGLObjectBuffers(maxSize);
+    if (_packedNeighborArray.valid()) _packedNeighborArray->resizeGLObjectBuffers(maxSize);
+    if (_packedNeighborNormalArray.valid()) _packedNeighborNormalArray->resizeGLObjectBuffers(maxSize);
 
     //osg::BufferObject* vbo = _vertexArray->getVertexBufferObject();
     //if (vbo) vbo->resizeGLObjectBuffers(maxSize);
@@ -712,6 +965,11 @@ void SharedGeometry::releaseGLObjects(osg::State* state) const
     if (_neighborNormalArray.valid()) _neighborNormalArray->releaseGLObjects(state);
     if (_drawElements.valid()) _drawElements->releaseGLObjects(state);
     if (_maskElements.valid()) _maskElements->releaseGLObjects(state);
+    if (_packedVertexArray.valid()) _packedVertexArray->releaseGLObjects(state);
+    if (_packedNormalArray.valid()) _packedNormalArray->releaseGLObjects(state);
+    if (_packedTexCoordArray.valid()) _packedTexCoordArray->releaseGLObjects(state);
+    if (_packedNeighborArray.valid()) _packedNeighborArray->releaseGLObjects(state);
+    if (_packedNeighborNormalArray.valid()) _packedNeighborNormalArray->releaseGLObjects(state);
 
     //osg::BufferObject* vbo = _vertexArray->getVertexBufferObject();
     //if (vbo) vbo->releaseGLObjects(state);
@@ -731,9 +989,17 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
     osg::AttributeDispatchers& dispatchers = state.getAttributeDispatchers();
 #endif
 
+    // Draw the packed arrays if we have them:
+    bool packed = _packedVertexArray.valid();
+    const osg::Array* vertexArray = packed ? _packedVertexArray.get() : _vertexArray.get();
+    const osg::Array* normalArray = packed ? _packedNormalArray.get() : _normalArray.get();
+    const osg::Array* texcoordArray = packed ? _packedTexCoordArray.get() : _texcoordArray.get();
+    const osg::Array* neighborArray = packed ? _packedNeighborArray.get() : _neighborArray.get();
+    const osg::Array* neighborNormalArray = packed ? _packedNeighborNormalArray.get() : _neighborNormalArray.get();
+
     dispatchers.reset();
     dispatchers.setUseVertexAttribAlias(state.getUseVertexAttributeAliasing());
-    dispatchers.activateNormalArray(_normalArray.get());
+    dispatchers.activateNormalArray(normalArray);
 
 #ifdef SUPPORTS_VAO
     osg::VertexArrayState* vas = state.getCurrentVertexArrayState();
@@ -743,23 +1009,23 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
         vas->lazyDisablingOfVertexAttributes();
 
         // set up arrays
-        if( _vertexArray.valid() )
-            vas->setVertexArray(state, _vertexArray.get());
+        if( vertexArray )
+            vas->setVertexArray(state, vertexArray);
 
-        if (_normalArray.valid() && _normalArray->getBinding()==osg::Array::BIND_PER_VERTEX)
-            vas->setNormalArray(state, _normalArray.get());
+        if (normalArray && normalArray->getBinding()==osg::Array::BIND_PER_VERTEX)
+            vas->setNormalArray(state, normalArray);
 
         if (_colorArray.valid() && _colorArray->getBinding()==osg::Array::BIND_PER_VERTEX)
             vas->setColorArray(state, _colorArray.get());
 
-        if (_texcoordArray.valid() && _texcoordArray->getBinding()==osg::Array::BIND_PER_VERTEX)
-            vas->setTexCoordArray(state, 0, _texcoordArray.get());
+        if (texcoordArray && texcoordArray->getBinding()==osg::Array::BIND_PER_VERTEX)
+            vas->setTexCoordArray(state, 0, texcoordArray);
 
-        if (_neighborArray.valid() && _neighborArray->getBinding()==osg::Array::BIND_PER_VERTEX)
-            vas->setTexCoordArray(state, 1, _neighborArray.get());
+        if (neighborArray && neighborArray->getBinding()==osg::Array::BIND_PER_VERTEX)
+            vas->setTexCoordArray(state, 1, neighborArray);
 
-        if (_neighborNormalArray.valid() && _neighborNormalArray->getBinding()==osg::Array::BIND_PER_VERTEX)
-            vas->setTexCoordArray(state, 2, _neighborNormalArray.get());
+        if (neighborNormalArray && neighborNormalArray->getBinding()==osg::Array::BIND_PER_VERTEX)
+            vas->setTexCoordArray(state, 2, neighborNormalArray);
 
         vas->applyDisablingOfVertexAttributes(state);
     }
@@ -769,20 +1035,20 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
     {
         state.lazyDisablingOfVertexAttributes();
 
-        if( _vertexArray.valid() )
-            state.setVertexPointer(_vertexArray.get());
+        if( vertexArray )
+            state.setVertexPointer(vertexArray);
 
-        if (_normalArray.valid())
-            state.setNormalPointer(_normalArray.get());
+        if (normalArray)
+            state.setNormalPointer(normalArray);
 
-        if (_texcoordArray.valid())
-            state.setTexCoordPointer(0, _texcoordArray.get());
+        if (texcoordArray)
+            state.setTexCoordPointer(0, texcoordArray);
 
-        if (_neighborArray.valid())
-            state.setTexCoordPointer(1, _neighborArray.get());
+        if (neighborArray)
+            state.setTexCoordPointer(1, neighborArray);
 
-        if (_neighborNormalArray.valid())
-            state.setTexCoordPointer(2, _neighborNormalArray.get());
+        if (neighborNormalArray)
+            state.setTexCoordPointer(2, neighborNormalArray);
 
         state.applyDisablingOfVertexAttributes();
     }
@@ -795,10 +1061,26 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
 #endif
 
     GLenum primitiveType = _ptype[state.getContextID()];
+    const IndirectDraw& indirect = _indirect[state.getContextID()];
 
     osg::GLBufferObject* ebo = _drawElements->getOrCreateGLBufferObject(state.getContextID());
 
-    if (ebo)
+    if (ebo && indirect._glDrawElementsIndirect)
+    {
+        // The GPU culler wrote the element ranges (or empty draws, if
+        // the tile is out of view) into the bound indirect buffer.
+        state.bindElementBufferObject(ebo);
+
+        indirect._glDrawElementsIndirect(primitiveType, _drawElements->getDataType(), (const GLvoid *)(indirect._offset));
+
+        if (_maskElements.valid() && _maskElements->getNumIndices() > 0u)
+        {
+            indirect._glDrawElementsIndirect(primitiveType, _maskElements->getDataType(), (const GLvoid *)(indirect._offset + GPUCuller::COMMAND_SIZE));
+        }
+
+        state.unbindElementBufferObject();
+    }
+    else if (ebo)
     {
         /*if (request_bind_unbind)*/ state.bindElementBufferObject(ebo);
 
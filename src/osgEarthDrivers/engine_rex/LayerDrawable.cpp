@@ -34,7 +34,8 @@ _visibleLayer(0L),
 _imageLayer(0L),
 _patchLayer(0L),
 _clearOsgState(false),
-_draw(true)
+_draw(true),
+_drawTime(0L)
 {
     setDataVariance(DYNAMIC);
     setUseDisplayList(false);
@@ -86,6 +87,11 @@ LayerDrawable::drawImplementation(osg::RenderInfo& ri) const
     char buf[64];
     sprintf(buf, "%.36s (%zd tiles)", _layer ? _layer->getName().c_str() : "unknown layer", _tiles.size());
     OE_PROFILING_ZONE_TEXT(buf);
+
+    if (!_drawTime)
+        _drawTime = Util::Metrics::counter("frame.draw." + (_layer ? _layer->getName() : std::string("unknown")) + "_us");
+    Util::Metrics::ScopedTimer drawTimer(_drawTime);
+
     //OE_INFO << LC << (_layer ? _layer->getName() : "[empty]") << " tiles=" << _tiles.size() << std::endl;
 
     // Get this context's state values:
@@ -93,6 +99,23 @@ LayerDrawable::drawImplementation(osg::RenderInfo& ri) const
 
     ds.refresh(ri, _drawState->_bindings);
 
+    // Only the terrain surface shaders declare their color samplers as
+    // bindless; other layers have their own programs and bind normally.
+    ds._bindless =
+        _renderType == Layer::RENDERTYPE_TERRAIN_SURFACE &&
+        _drawState->_bindless.valid() &&
+        _drawState->_bindless->isSupported(*ri.getState());
+
+    if (ds._bindless)
+    {
+        _drawState->_bindless->flush(*ri.getState());
+
+        // OSG may have reapplied the sampler uniforms between drawables,
+        // so don't trust what we think the color samplers hold.
+        ds._samplerState._samplers[SamplerBinding::COLOR].clear();
+        ds._samplerState._samplers[SamplerBinding::COLOR_PARENT].clear();
+    }
+
     if (ds._layerUidUL >= 0)
     {
         GLint uid = _layer ? (GLint)_layer->getUID() : (GLint)-1;
@@ -109,9 +132,25 @@ LayerDrawable::drawImplementation(osg::RenderInfo& ri) const
         _patchLayer->getDrawCallback()->preDraw(ri, layerData);
     }
 
-    for (DrawTileCommands::const_iterator tile = _tiles.begin(); tile != _tiles.end(); ++tile)
+    // Frustum-cull the tiles in a compute shader if we can. Patch layers
+    // draw through their own callbacks, so they don't take part.
+    bool gpuCulled =
+        _drawState->_gpuCuller.valid() &&
+        !_patchLayer &&
+        _drawState->_gpuCuller->cull(_tiles, *ri.getState());
+
+    for (unsigned i = 0; i < _tiles.size(); ++i)
+    {
+        if (gpuCulled)
+            ds._indirect = _drawState->_gpuCuller->getIndirectDraw(i, *ri.getState());
+
+        _tiles[i].draw(ri, *_drawState, layerData.get());
+    }
+
+    if (gpuCulled)
     {
-        tile->draw(ri, *_drawState, layerData.get());
+        _drawState->_gpuCuller->finish(*ri.getState());
+        ds._indirect = SharedGeometry::IndirectDraw();
     }
 
     if (_patchLayer && _patchLayer->getDrawCallback())
@@ -28,11 +28,45 @@ using namespace osgEarth;
 
 #define LC "[LoadTileData] "
 
+namespace
+{
+    unsigned getTextureSize(const osg::Texture* tex)
+    {
+        unsigned size = 0u;
+        if (tex)
+        {
+            for (unsigned i = 0; i < tex->getNumImages(); ++i)
+            {
+                const osg::Image* image = tex->getImage(i);
+                if (image)
+                    size += image->getTotalSizeInBytes();
+            }
+        }
+        return size;
+    }
+
+    // Total size of the texture data in a tile model
+    unsigned getModelSize(const TerrainTileModel* model)
+    {
+        unsigned size = 0u;
+        for (TerrainTileColorLayerModelVector::const_iterator i = model->colorLayers().begin();
+            i != model->colorLayers().end();
+            ++i)
+        {
+            size += getTextureSize(i->get()->getTexture());
+        }
+        size += getTextureSize(model->getElevationTexture());
+        size += getTextureSize(model->getNormalTexture());
+        size += getTextureSize(model->getLandCoverTexture());
+        return size;
+    }
+}
 
 LoadTileData::LoadTileData(TileNode* tilenode, EngineContext* context) :
 _tilenode(tilenode),
 _context(context),
-_enableCancel(true)
+_enableCancel(true),
+_mergeSize(0u)
 {
     this->setTileKey(tilenode->getKey());
     _map = context->getMap();
@@ -43,7 +77,8 @@ LoadTileData::LoadTileData(const CreateTileManifest& manifest, TileNode* tilenod
     _manifest(manifest),
     _tilenode(tilenode),
     _context(context),
-    _enableCancel(true)
+    _enableCancel(true),
+    _mergeSize(0u)
 {
     this->setTileKey(tilenode->getKey());
     _map = context->getMap();
@@ -104,6 +139,21 @@ LoadTileData::run(ProgressCallback* progress)
         _dataModel->getElevationTexture()->setUnRefImageDataAfterApply(false);
     }
 
+    _mergeSize = _dataModel.valid() ? getModelSize(_dataModel.get()) : 0u;
+
+    if (_dataModel.valid())
+    {
+        OE_METRICS_COUNT("rex.tiles.loaded", 1);
+    }
+
+    // Copy the textures into the GPU upload ring while we're still
+    // off the draw thread.
+    osg::ref_ptr<EngineContext> context;
+    if (_dataModel.valid() && _context.lock(context) && context->getUploadRing())
+    {
+        context->getUploadRing()->stage(_dataModel.get());
+    }
+
     return _dataModel.valid();
 }
 
@@ -153,6 +203,7 @@ LoadTileData::merge(const osg::FrameStamp* stamp)
 
     // Merge the new data into the tile.
     tilenode->merge(_dataModel.get(), this);
+    OE_METRICS_COUNT("rex.tiles.merged", 1);
 
     OE_DEBUG << LC << "apply " << _dataModel->getKey().str() << "\n";
 
@@ -177,6 +228,7 @@ namespace
             {
                 OE_PROFILING_ZONE;
                 OE_PROFILING_ZONE_TEXT(_dataModel->getKey().str());
+                OE_METRICS_TIMED_SCOPE("frame.compile_us");
                 OE_DEBUG << "MCA: compiling " << dataModel->getKey().str() << std::endl;
                 dataModel->compileGLObjects(state);
             }
@@ -23,6 +23,7 @@
 #include <osgEarth/Utils>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Metrics>
+#include <osgEarth/PagingScheduler>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -30,6 +31,7 @@
 #include <osgDB/ReaderWriter>
 
 #include <string>
+#include <cmath>
 
 #define REPORT_ACTIVITY true
 
@@ -248,9 +250,64 @@ namespace
 }
 
 
+PagerLoader::MergeStats::MergeStats() :
+_lastFrameMerges ( 0u ),
+_lastFrameTime_ms( 0.0 ),
+_maxFrameTime_ms ( 0.0 ),
+_avgFrameTime_ms ( 0.0 ),
+_estimateError_ms( 0.0 ),
+_queueSize       ( 0u ),
+_totalMerges     ( 0u )
+{
+    //nop
+}
+
+PagerLoader::MergeCostModel::MergeCostModel() :
+_base_s   ( 0.0001 ), // initial guess: 0.1ms per merge,
+_perByte_s( 1.0e-9 ), // plus about 1GB/s of texture data
+_w(0.0), _x(0.0), _y(0.0), _xx(0.0), _xy(0.0)
+{
+    //nop
+}
+
+double
+PagerLoader::MergeCostModel::estimate(unsigned bytes) const
+{
+    return _base_s + _perByte_s * (double)bytes;
+}
+
+void
+PagerLoader::MergeCostModel::record(unsigned bytes, double seconds)
+{
+    // older samples fade out so the model follows changes in load
+    const double decay = 0.98;
+    double x = (double)bytes;
+
+    _w  = _w*decay  + 1.0;
+    _x  = _x*decay  + x;
+    _y  = _y*decay  + seconds;
+    _xx = _xx*decay + x*x;
+    _xy = _xy*decay + x*seconds;
+
+    double denom = _w*_xx - _x*_x;
+    if (_w >= 2.0 && denom > 1e-6 * _w*_xx)
+    {
+        _perByte_s = osg::maximum((_w*_xy - _x*_y) / denom, 0.0);
+        _base_s    = osg::maximum((_y - _perByte_s*_x) / _w, 0.0);
+    }
+    else
+    {
+        // all samples the same size, so only the average is known:
+        _base_s = osg::maximum(_y/_w - _perByte_s*(_x/_w), 0.0);
+    }
+}
+
+//...............................................
+
 PagerLoader::PagerLoader(TerrainEngineNode* engine) :
 _checkpoint    ( (osg::Timer_t)0 ),
 _mergesPerFrame( 0 ),
+_mergeBudget_s ( 0.0 ),
 _frameNumber   ( 0 ),
 _frameLastUpdated( 0u ),
 _numLODs       ( 20u )
@@ -261,6 +318,7 @@ _numLODs       ( 20u )
     _dboptions->setFileLocationCallback( new FileLocationCallback() );
 
     OptionsData<PagerLoader>::set(_dboptions.get(), "osgEarth.PagerLoader", this);
+    PagingScheduler::setSubsystem(_dboptions.get(), PagingScheduler::TERRAIN);
 
     // initialize the LOD priority scales and offsets
     for (unsigned i = 0; i < 64; ++i)
@@ -286,6 +344,32 @@ PagerLoader::setMergesPerFrame(int value)
     
 }
 
+void
+PagerLoader::setMergeTimeBudget(double milliseconds)
+{
+    _mergeBudget_s = osg::maximum(milliseconds, 0.0) * 0.001;
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    OE_DEBUG << LC << "Merge time budget = " << milliseconds << " ms" << std::endl;
+}
+
+void
+PagerLoader::resetMergeStats()
+{
+    _mergeStats = MergeStats();
+}
+
+void
+PagerLoader::updateMergeStats(unsigned merges, double time_s)
+{
+    double time_ms = time_s * 1000.0;
+    _mergeStats._lastFrameMerges = merges;
+    _mergeStats._lastFrameTime_ms = time_ms;
+    _mergeStats._maxFrameTime_ms = osg::maximum(_mergeStats._maxFrameTime_ms, time_ms);
+    _mergeStats._avgFrameTime_ms += 0.05 * (time_ms - _mergeStats._avgFrameTime_ms);
+    _mergeStats._queueSize = _mergeQueue.size();
+    _mergeStats._totalMerges += merges;
+}
+
 void
 PagerLoader::setLODPriorityScale(unsigned lod, float priorityScale)
 {
@@ -403,13 +487,34 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
             // process pending merges.
             {
                 OE_PROFILING_ZONE_NAMED("loader.merge");
+                OE_METRICS_TIMED_SCOPE("frame.merge_us");
+                const osg::Timer* timer = osg::Timer::instance();
+                double spent_s = 0.0;
+                unsigned numMerged = 0u;
                 int count;
-                for(count=0; count < _mergesPerFrame && !_mergeQueue.empty(); ++count)
+                for(count=0;
+                    (_mergesPerFrame == 0 || count < _mergesPerFrame) && !_mergeQueue.empty();
+                    ++count)
                 {
                     Request* req = _mergeQueue.begin()->get();
                     if ( req && req->_lastTick >= _checkpoint )
                     {
+                        // in budget mode, stop once the next merge would go
+                        // over the budget (but always make some progress)
+                        unsigned size = req->getMergeSize();
+                        double estimate_s = _mergeCost.estimate(size);
+                        if (_mergeBudget_s > 0.0 && numMerged > 0u && spent_s + estimate_s > _mergeBudget_s)
+                            break;
+
+                        osg::Timer_t start = timer->tick();
                         bool merged = req->merge( getFrameStamp() );
+                        double actual_s = timer->delta_s(start, timer->tick());
+
+                        spent_s += actual_s;
+                        ++numMerged;
+                        _mergeCost.record(size, actual_s);
+                        _mergeStats._estimateError_ms +=
+                            0.05 * (fabs(estimate_s - actual_s)*1000.0 - _mergeStats._estimateError_ms);
                     
                         if (merged)
                         {
@@ -427,6 +532,8 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
 
                     _mergeQueue.erase( _mergeQueue.begin() );
                 }
+
+                updateMergeStats(numMerged, spent_s);
             }
 
             // cull finished requests.
@@ -485,6 +592,9 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
                     }
                 }
 
+                OE_METRICS_GAUGE("rex.loader.requests", _requests.size());
+                OE_METRICS_GAUGE("rex.loader.merges_pending", _mergeQueue.size());
+
                 _requests.unlock();
 
                 //OE_NOTICE << LC << "PagerLoader: requests=" << _requests.size() << "; mergeQueue=" << _mergeQueue.size() << std::endl;
@@ -509,7 +619,7 @@ PagerLoader::addChild(osg::Node* node)
             // and running (i.e. has not been canceled along the way)
             if (req->_lastTick >= _checkpoint && req->isRunning())
             {
-                if ( _mergesPerFrame > 0 )
+                if ( _mergesPerFrame > 0 || _mergeBudget_s > 0.0 )
                 {
                     _mergeQueue.insert( req );
                     req->setState( Request::MERGING );
@@ -146,6 +146,17 @@ MaskGenerator::MaskGenerator(const TileKey& key, unsigned tileSize, const Map* m
     }
 }
 
+void
+MaskGenerator::getBoundaries(std::vector<osg::ref_ptr<osg::Vec3dArray> >& out) const
+{
+    out.clear();
+    out.reserve(_maskRecords.size());
+    for (MaskRecordVector::const_iterator mr = _maskRecords.begin(); mr != _maskRecords.end(); ++mr)
+    {
+        out.push_back(mr->_boundary.get());
+    }
+}
+
 void
 MaskGenerator::setupMaskRecord(osg::Vec3dArray* boundary)
 {
@@ -0,0 +1,79 @@
+#version 430
+
+/**
+ * Compute shader that frustum-culls terrain tiles for GPUCuller.
+ * Each tile has two indirect draw commands (surface and mask elements);
+ * the CPU fills in their element ranges and this shader zeroes their
+ * instance counts when the tile's box is out of view.
+ */
+
+layout(local_size_x = 64) in;
+
+struct oe_gpucull_Tile
+{
+    mat4 modelView;
+    vec4 boxMin;
+    vec4 boxMax;
+};
+
+struct oe_gpucull_Command
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int  baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer oe_gpucull_TileBuffer
+{
+    oe_gpucull_Tile oe_gpucull_tiles[];
+};
+
+layout(std430, binding = 1) buffer oe_gpucull_CommandBuffer
+{
+    oe_gpucull_Command oe_gpucull_commands[];
+};
+
+uniform mat4 oe_gpucull_projection;
+uniform uint oe_gpucull_numTiles;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= oe_gpucull_numTiles)
+        return;
+
+    oe_gpucull_Tile tile = oe_gpucull_tiles[i];
+    mat4 mvp = oe_gpucull_projection * tile.modelView;
+
+    // A tile is out of view when all 8 corners of its box are outside
+    // the same clip plane; keep one bit per plane that every corner is
+    // outside of.
+    int outside = 0x3F;
+
+    for (int c = 0; c < 8; ++c)
+    {
+        vec4 corner = vec4(
+            (c & 1) != 0 ? tile.boxMax.x : tile.boxMin.x,
+            (c & 2) != 0 ? tile.boxMax.y : tile.boxMin.y,
+            (c & 4) != 0 ? tile.boxMax.z : tile.boxMin.z,
+            1.0);
+
+        vec4 clip = mvp * corner;
+
+        int planes = 0;
+        if (clip.x < -clip.w) planes |= 0x01;
+        if (clip.x >  clip.w) planes |= 0x02;
+        if (clip.y < -clip.w) planes |= 0x04;
+        if (clip.y >  clip.w) planes |= 0x08;
+        if (clip.z < -clip.w) planes |= 0x10;
+        if (clip.z >  clip.w) planes |= 0x20;
+        outside &= planes;
+    }
+
+    uint visible = outside == 0 ? 1u : 0u;
+
+    oe_gpucull_commands[2u*i].instanceCount = visible;
+    oe_gpucull_commands[2u*i+1u].instanceCount = visible;
+}
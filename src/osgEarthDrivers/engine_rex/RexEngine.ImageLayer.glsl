@@ -6,6 +6,8 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_location   vertex_view
 #pragma vp_order      0.4
 
+#pragma import_defines(OE_TERRAIN_MORPH_IMAGERY_MIPMAP)
+
 // Stage globals
 vec4 oe_layer_tilec;
 vec2 oe_layer_texc;
@@ -18,7 +20,9 @@ void oe_rex_imageLayer_VS(inout vec4 vertexView)
 {
     // calculate the texture coordinates:
     oe_layer_texc       = (oe_layer_texMatrix * oe_layer_tilec).st;
+#ifndef OE_TERRAIN_MORPH_IMAGERY_MIPMAP
 	oe_layer_texcParent = (oe_layer_texParentMatrix * oe_layer_tilec).st;
+#endif
 }
 
 
@@ -34,20 +38,36 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 
 #pragma import_defines(OE_TERRAIN_RENDER_IMAGERY)
 #pragma import_defines(OE_TERRAIN_MORPH_IMAGERY)
+#pragma import_defines(OE_TERRAIN_MORPH_IMAGERY_MIPMAP)
 #pragma import_defines(OE_TERRAIN_BLEND_IMAGERY)
 #pragma import_defines(OE_TERRAIN_CAST_SHADOWS)
 #pragma import_defines(OE_IS_PICK_CAMERA)
 #pragma import_defines(OE_IS_SHADOW_CAMERA)
 #pragma import_defines(OE_IS_DEPTH_CAMERA)
+#pragma import_defines(OE_TERRAIN_BINDLESS_TEXTURES)
+
+#ifdef OE_TERRAIN_BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : enable
+#endif
+
+// In bindless mode the engine sets texture handles directly in the color
+// samplers; it only does so when the extension is available.
+#if defined(OE_TERRAIN_BINDLESS_TEXTURES) && defined(GL_ARB_bindless_texture)
+#define OE_LAYER_SAMPLER layout(bindless_sampler) uniform sampler2D
+#else
+#define OE_LAYER_SAMPLER uniform sampler2D
+#endif
 
-uniform sampler2D oe_layer_tex;
+OE_LAYER_SAMPLER oe_layer_tex;
 uniform int       oe_layer_uid;
 uniform int       oe_layer_order;
 
 #ifdef OE_TERRAIN_MORPH_IMAGERY
-uniform sampler2D oe_layer_texParent;
+#ifndef OE_TERRAIN_MORPH_IMAGERY_MIPMAP
+OE_LAYER_SAMPLER oe_layer_texParent;
 uniform float oe_layer_texParentExists;
 in vec2 oe_layer_texcParent;
+#endif
 in float oe_rex_morphFactor;
 #endif
 
@@ -114,12 +134,18 @@ void oe_rex_imageLayer_FS(inout vec4 color)
 #ifdef OE_TERRAIN_MORPH_IMAGERY
         // sample the main texture:
 
+#ifdef OE_TERRAIN_MORPH_IMAGERY_MIPMAP
+        // approximate the parent with the next coarser mipmap of this texture;
+        // the parent covers twice the extent with the same number of texels.
+        vec4 texelParent = texture(oe_layer_tex, oe_layer_texc, 1.0);
+#else
         // sample the parent texture:
         vec4 texelParent = texture(oe_layer_texParent, oe_layer_texcParent);
 
         // if the parent texture does not exist, use the current texture with alpha=0 as the parent
         // so we can "fade in" an image layer that starts at LOD > 0:
         texelParent = mix( vec4(texel.rgb, 0.0), texelParent, oe_layer_texParentExists );
+#endif
 
         // Resolve the final texel color:
         texel = mix(texel, texelParent, oe_rex_morphFactor);
@@ -9,6 +9,7 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma import_defines(OE_TERRAIN_MORPH_GEOMETRY)
 #pragma import_defines(OE_TERRAIN_RENDER_ELEVATION)
 #pragma import_defines(OE_IS_DEPTH_CAMERA)
+#pragma import_defines(OE_TERRAIN_PACKED_VERTICES)
 
 // stage
 vec3 vp_Normal;
@@ -26,6 +27,11 @@ uniform float oe_tile_size;
 uniform mat4 oe_shadowToPrimaryMatrix;
 #endif
 
+#ifdef OE_TERRAIN_PACKED_VERTICES
+uniform vec3 oe_tile_vertexOffset;
+uniform vec3 oe_tile_vertexScale;
+#endif
+
 // SDK functions:
 float oe_terrain_getElevation(in vec2 uv);
 
@@ -73,8 +79,13 @@ void oe_rex_morph(inout vec4 vertexModel)
         oe_rex_morphFactor = oe_rex_ComputeMorphFactor(vertexModel, vp_Normal);    
 
 #ifdef OE_TERRAIN_MORPH_GEOMETRY
+#ifdef OE_TERRAIN_PACKED_VERTICES
+        vec3 neighborVertexModel = oe_tile_vertexOffset + gl_MultiTexCoord1.xyz*oe_tile_vertexScale;
+        vec3 neighborNormal = gl_MultiTexCoord2.xyz/32767.0;
+#else
         vec3 neighborVertexModel = gl_MultiTexCoord1.xyz;        
         vec3 neighborNormal = gl_MultiTexCoord2.xyz;
+#endif
         
         float halfSize        = (0.5*oe_tile_size)-0.5;
         float twoOverHalfSize = 2.0/(oe_tile_size-1.0);   
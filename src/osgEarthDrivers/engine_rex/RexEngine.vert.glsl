@@ -6,9 +6,16 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_location   vertex_model
 #pragma vp_order      first
 
+#pragma import_defines(OE_TERRAIN_PACKED_VERTICES)
+
 // uniforms
 uniform vec4 oe_terrain_color;
 
+#ifdef OE_TERRAIN_PACKED_VERTICES
+uniform vec3 oe_tile_vertexOffset;
+uniform vec3 oe_tile_vertexScale;
+#endif
+
 // outputs
 out vec4 vp_Color;
 out vec4 oe_layer_tilec;
@@ -19,8 +26,14 @@ flat out int oe_terrain_vertexMarker;
 
 void oe_rex_init_model(inout vec4 vertexModel)
 {
+#ifdef OE_TERRAIN_PACKED_VERTICES
+    // Unpack the 16-bit position and texture coordinate
+    vertexModel = vec4(oe_tile_vertexOffset + vertexModel.xyz*oe_tile_vertexScale, 1.0);
+    oe_layer_tilec = vec4(gl_MultiTexCoord0.xy/32767.0, gl_MultiTexCoord0.z, 1.0);
+#else
     // Texture coordinate for the tile (always 0..1)
     oe_layer_tilec = gl_MultiTexCoord0;
+#endif
 
     // Color of the underlying map geometry (untextured)
     vp_Color = oe_terrain_color;
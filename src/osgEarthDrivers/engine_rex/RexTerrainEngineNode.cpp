@@ -32,6 +32,8 @@
 #include <osgEarth/Utils>
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/Metrics>
+#include <osgEarth/CameraUtils>
+#include <osgEarth/Cache>
 
 #include <osg/Version>
 #include <osg/BlendFunc>
@@ -172,6 +174,9 @@ RexTerrainEngineNode::RexTerrainEngineNode() :
 RexTerrainEngineNode::~RexTerrainEngineNode()
 {
     OE_DEBUG << LC << "~RexTerrainEngineNode\n";
+
+    if (_elevationRanges.valid())
+        _elevationRanges->save();
 }
 
 void
@@ -209,6 +214,21 @@ RexTerrainEngineNode::releaseGLObjects(osg::State* state) const
     //    _geometryPool->clear();
     //}
 
+    if (_uploadRing.valid())
+    {
+        _uploadRing->releaseGLObjects(state);
+    }
+
+    if (_bindlessTextures.valid())
+    {
+        _bindlessTextures->releaseGLObjects(state);
+    }
+
+    if (_gpuCuller.valid())
+    {
+        _gpuCuller->releaseGLObjects(state);
+    }
+
     TerrainEngineNode::releaseGLObjects(state);
 }
 
@@ -235,8 +255,11 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
         _morphingSupported = false;
     }
 
-    // morphing imagery LODs requires we bind parent textures to their own unit.
-    if (options().morphImagery() == true && _morphingSupported)
+    // morphing imagery LODs requires we bind parent textures to their own unit,
+    // unless we are approximating the parent with a coarser mipmap.
+    if (options().morphImagery() == true && 
+        options().morphImageryMipmaps() == false &&
+        _morphingSupported)
     {
         _requireParentTextures = true;
     }
@@ -287,11 +310,36 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
     PagerLoader* loader = new PagerLoader( this );
     loader->setNumLODs(options().maxLOD().getOrUse(DEFAULT_MAX_LOD));
     loader->setMergesPerFrame(options().mergesPerFrame().get() );
+    loader->setMergeTimeBudget(options().mergeTimeBudget().get() );
     loader->setOverallPriorityScale(options().priorityScale().get());
 
     _loader = loader;
     this->addChild( _loader.get() );
 
+    // Optional ring buffer for streaming tile textures to the GPU
+    if (options().uploadRingSize().get() > 0u)
+    {
+        _uploadRing = new TextureUploadRing(options().uploadRingSize().get() * 1048576u);
+    }
+
+    // Optional bindless handles for tile color textures
+    if (options().bindlessTextures() == true)
+    {
+        _bindlessTextures = new BindlessTextures();
+    }
+
+    // Optional compute-shader culling of terrain tiles
+    if (options().gpuCulling() == true)
+    {
+        _gpuCuller = new GPUCuller();
+    }
+
+    // Optional prefetching of tiles along the camera's path
+    if (options().prefetchTime().get() > 0.0f)
+    {
+        _trajectoryPredictor = new TrajectoryPredictor();
+    }
+
     // if the envvar for tile expiration is set, override the options setting
     unsigned expirationThreshold = options().expirationThreshold().get();
     const char* val = ::getenv("OSGEARTH_EXPIRATION_THRESHOLD");
@@ -307,6 +355,7 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
     _unloader->setMaxAge(options().minExpiryTime().get());
     _unloader->setMaxTilesToUnloadPerFrame(options().maxTilesToUnloadPerFrame().get());
     _unloader->setMinimumRange(options().minExpiryRange().get());
+    _unloader->setMemoryBudget((size_t)options().tileMemoryBudget().get() * 1048576u);
     //_unloader->setReleaser(_releaser.get());
     this->addChild( _unloader.get() );
 
@@ -342,6 +391,23 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
         options(),
         _selectionInfo);
 
+    _engineContext->setUploadRing(_uploadRing.get());
+    _engineContext->setBindlessTextures(_bindlessTextures.get());
+    _engineContext->setGPUCuller(_gpuCuller.get());
+
+    // Per-tile elevation ranges, persisted in the map's cache when there is one
+    if (_elevationRanges.valid())
+        _elevationRanges->save();
+
+    _elevationRanges = new ElevationRangeIndex(map->getProfile());
+    Cache* cache = map->getCache();
+    if (cache && map->getCachePolicy().isCacheEnabled())
+    {
+        _elevationRanges->setCacheBin(cache->addBin("rex_elevation_ranges"));
+        _elevationRanges->load();
+    }
+    _engineContext->setElevationRanges(_elevationRanges.get());
+
     // Calculate the LOD morphing parameters:
     unsigned maxLOD = options().maxLOD().getOrUse(DEFAULT_MAX_LOD);
 
@@ -619,6 +685,7 @@ void
 RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
 {
     OE_PROFILING_ZONE;
+    OE_METRICS_TIMED_SCOPE("frame.cull.terrain_us");
 
     // Inform the registry of the current frame so that Tiles have access
     // to the information.
@@ -629,14 +696,67 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
 
     osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>(&nv);
 
-    // Initialize a new culler
-    TerrainCuller culler(cv, this->getEngineContext());
+    const RenderBindings& bindings = this->getEngineContext()->getRenderBindings();
+    osg::ref_ptr<TerrainCuller> culler;
+    unsigned orphanedPassesDetected = 0u;
+
+    TerrainCullGroup* group = getCullGroup(cv->getCurrentCamera());
+    if (group)
+    {
+        Threading::ScopedMutexLock lock(group->mutex());
+
+        if (!group->canFollow(cv))
+        {
+            // Lead the group: cull the terrain once against a frustum that
+            // encloses all the group's cameras, and publish the results.
+            osg::RefMatrix* cullProjection = group->computeCullProjection(cv);
+            if (cullProjection)
+            {
+                cv->pushProjectionMatrix(cullProjection);
+            }
+
+            osg::ref_ptr<TerrainCuller> leader = new TerrainCuller(cv, this->getEngineContext());
+            leader->setup(getMap(), _cachedLayerExtents, bindings);
+            setupPrefetch(cv, leader.get());
+            _terrain->accept(*leader);
+            orphanedPassesDetected = leader->_orphanedPassesDetected;
+
+            if (cullProjection)
+            {
+                // Bypass CullVisitor::popProjectionMatrix, which would
+                // clamp near/far for drawables we did not add.
+                cv->osg::CullStack::popProjectionMatrix();
+            }
+
+            group->publish(cv, leader->_terrain, cullProjection != 0L);
 
-    // Prepare the culler with the set of renderable layers:
-    culler.setup(getMap(), _cachedLayerExtents, this->getEngineContext()->getRenderBindings());
+            if (cullProjection == 0L)
+            {
+                culler = leader;
+            }
+        }
+
+        if (!culler.valid())
+        {
+            // Take our share of the group's results, refined to our frustum.
+            culler = new TerrainCuller(cv, this->getEngineContext());
+            culler->setup(getMap(), _cachedLayerExtents, bindings);
+            group->follow(cv, culler->_terrain);
+        }
+    }
+    else
+    {
+        // Initialize a new culler
+        culler = new TerrainCuller(cv, this->getEngineContext());
 
-    // Assemble the terrain drawables:
-    _terrain->accept(culler);
+        // Prepare the culler with the set of renderable layers:
+        culler->setup(getMap(), _cachedLayerExtents, bindings);
+        setupPrefetch(cv, culler.get());
+
+        // Assemble the terrain drawables:
+        _terrain->accept(*culler);
+        orphanedPassesDetected = culler->_orphanedPassesDetected;
+    }
 
     // If we're using geometry pooling, optimize the drawable for shared state
     // by sorting the draw commands.
@@ -644,7 +764,7 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
     unsigned totalTiles = 0L;
     if (getEngineContext()->getGeometryPool()->isEnabled())
     {
-        totalTiles = culler._terrain.sortDrawCommands();
+        totalTiles = culler->_terrain.sortDrawCommands();
     }
 
     // The common stateset for the terrain group:
@@ -660,8 +780,8 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
 
     osg::State::StateSetStack stateSetStack;
 
-    for (LayerDrawableList::iterator i = culler._terrain.layers().begin();
-        i != culler._terrain.layers().end();
+    for (LayerDrawableList::iterator i = culler->_terrain.layers().begin();
+        i != culler->_terrain.layers().end();
         ++i)
     {
         // Note: Cannot save lastLayer here because its _tiles may be empty, which can lead to a crash later
@@ -756,10 +876,10 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
 
     // If the culler found any orphaned data, we need to update the render model
     // during the next update cycle.
-    if (culler._orphanedPassesDetected > 0u)
+    if (orphanedPassesDetected > 0u)
     {
         _renderModelUpdateRequired = true;
-        OE_INFO << LC << "Detected " << culler._orphanedPassesDetected << " orphaned rendering passes\n";
+        OE_INFO << LC << "Detected " << orphanedPassesDetected << " orphaned rendering passes\n";
     }
 
     // we don't call this b/c we don't want _terrain
@@ -775,6 +895,33 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
         _rasterizer->accept(nv);
 }
 
+void
+RexTerrainEngineNode::setupPrefetch(osgUtil::CullVisitor* cv, TerrainCuller* culler)
+{
+    // Spy cameras only look at what the others loaded.
+    if (!_trajectoryPredictor.valid() || culler->_isSpy)
+        return;
+
+    culler->_prefetch = _trajectoryPredictor->predict(
+        cv,
+        options().prefetchTime().get(),
+        culler->_prefetchEye);
+}
+
+TerrainCullGroup*
+RexTerrainEngineNode::getCullGroup(const osg::Camera* camera)
+{
+    unsigned groupID = CameraUtils::getTerrainCullGroup(camera);
+    if (groupID == 0u)
+        return 0L;
+
+    Threading::ScopedMutexLock lock(_cullGroupsMutex);
+    osg::ref_ptr<TerrainCullGroup>& group = _cullGroups[groupID];
+    if (!group.valid())
+        group = new TerrainCullGroup();
+    return group.get();
+}
+
 void
 RexTerrainEngineNode::update_traverse(osg::NodeVisitor& nv)
 {
@@ -1189,6 +1336,11 @@ RexTerrainEngineNode::updateState()
         terrainVP->setName("Rex Terrain");
         package.load(terrainVP, package.ENGINE_VERT);
 
+        if (options().packedVertices() == true)
+        {
+            terrainStateSet->setDefine("OE_TERRAIN_PACKED_VERTICES");
+        }
+
         // Shaders that affect only terrain surface layers (RENDERTYPE_TERRAIN_SURFACE)
         VirtualProgram* surfaceVP = VirtualProgram::getOrCreate(surfaceStateSet);
         surfaceVP->setName("Rex Surface");
@@ -1200,6 +1352,11 @@ RexTerrainEngineNode::updateState()
         surfaceStateSet->addUniform(new osg::Uniform("oe_terrain_altitude", (float)0.0f));
         surfaceStateSet->setDefine("OE_TERRAIN_RENDER_IMAGERY");
 
+        if (options().bindlessTextures() == true)
+        {
+            surfaceStateSet->setDefine("OE_TERRAIN_BINDLESS_TEXTURES");
+        }
+
         if (options().gpuTessellation() == true)
         {
             package.load(surfaceVP, package.ENGINE_TESSELLATION);
@@ -1254,6 +1411,11 @@ RexTerrainEngineNode::updateState()
                 if (options().morphImagery() == true)
                 {
                     surfaceStateSet->setDefine("OE_TERRAIN_MORPH_IMAGERY");
+
+                    if (options().morphImageryMipmaps() == true)
+                    {
+                        surfaceStateSet->setDefine("OE_TERRAIN_MORPH_IMAGERY_MIPMAP");
+                    }
                 }
             }
         }
@@ -1302,6 +1464,11 @@ RexTerrainEngineNode::updateState()
                         for( ColorFilterChain::const_iterator j = chain.begin(); j != chain.end(); ++j )
                         {
                             const ColorFilter* filter = j->get();
+
+                            // already applied to the tile images
+                            if ( layer->getCPUColorFilters() && filter->supportsCPU() )
+                                continue;
+
                             cf_head << "void " << filter->getEntryPointFunctionName() << "(inout vec4 color);\n";
                             cf_body << I << I << filter->getEntryPointFunctionName() << "(color);\n";
                             filter->install( surfaceStateSet );
@@ -1372,6 +1539,31 @@ RexTerrainEngineNode::updateState()
     }
 }
 
+bool
+RexTerrainEngineNode::intersectTiles(const osg::Vec3d& start,
+                                     const osg::Vec3d& end,
+                                     osg::Vec3d& out_point,
+                                     osg::Vec3d& out_normal) const
+{
+    if (!_terrain.valid())
+        return false;
+
+    double ratio = 1.0;
+    bool hit = false;
+
+    for (unsigned i = 0; i < _terrain->getNumChildren(); ++i)
+    {
+        const TileNode* tile = dynamic_cast<const TileNode*>(_terrain->getChild(i));
+        if (tile && tile->intersect(start, end, ratio, out_normal))
+            hit = true;
+    }
+
+    if (hit)
+    {
+        out_point = start + (end - start)*ratio;
+    }
+    return hit;
+}
 
 osg::Node*
 RexTerrainEngineNode::createStandaloneTile(
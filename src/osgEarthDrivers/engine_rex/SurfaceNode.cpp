@@ -46,6 +46,25 @@ using namespace osgEarth;
 
 namespace
 {    
+    LineDrawable* makeBoxLines(const osg::BoundingBox& bbox, const osg::Vec4& color)
+    {
+        static const int index[24] = {
+            0,1, 1,3, 3,2, 2,0,
+            0,4, 1,5, 2,6, 3,7,
+            4,5, 5,7, 7,6, 6,4
+        };
+
+        LineDrawable* lines = new LineDrawable(GL_LINES);
+        for(int i=0; i<24; i+=2)
+        {
+            lines->pushVertex(bbox.corner(index[i]));
+            lines->pushVertex(bbox.corner(index[i+1]));
+        }
+        lines->setColor(color);
+        lines->finish();
+        return lines;
+    }
+
     osg::Node* makeBBox(const osg::BoundingBox& bbox, const TileKey& key)
     {
         osg::Group* geode = new osg::Group();
@@ -54,20 +73,7 @@ namespace
 
         if ( bbox.valid() )
         {
-            static const int index[24] = {
-                0,1, 1,3, 3,2, 2,0,
-                0,4, 1,5, 2,6, 3,7,
-                4,5, 5,7, 7,6, 6,4
-            };
-
-            LineDrawable* lines = new LineDrawable(GL_LINES);            
-            for(int i=0; i<24; i+=2)
-            {
-                lines->pushVertex(bbox.corner(index[i]));
-                lines->pushVertex(bbox.corner(index[i+1]));
-            }
-            lines->setColor(osg::Vec4(1,0,0,1));
-            lines->finish();
+            LineDrawable* lines = makeBoxLines(bbox, osg::Vec4(1,0,0,1));
             sizeStr = Stringify() << key.str() << "\nmax="<<bbox.zMax()<<"\nmin="<<bbox.zMin()<<"\n";
             zpos = bbox.zMax();
 
@@ -381,6 +387,38 @@ SurfaceNode::removeDebugNode(void)
     }
 }
 
+osg::Node*
+SurfaceNode::getOverlayNode(const osg::Vec4f& color)
+{
+    const osg::BoundingBox& box = getAlignedBoundingBox();
+    if (!box.valid())
+        return 0L;
+
+    if (!_overlayNode.valid())
+    {
+        _overlayNode = new osg::MatrixTransform();
+        osg::StateSet* ss = _overlayNode->getOrCreateStateSet();
+        ss->setMode(GL_BLEND, osg::StateAttribute::ON);
+        ss->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+    }
+
+    // rebuild the box if the elevation data changed the tile's bounds
+    if (!_overlayLines.valid() || _overlayBox != box)
+    {
+        _overlayNode->removeChildren(0, _overlayNode->getNumChildren());
+        _overlayLines = makeBoxLines(box, color);
+        _overlayNode->addChild(_overlayLines.get());
+        _overlayBox = box;
+    }
+    else if (_overlayLines->getColor() != color)
+    {
+        _overlayLines->setColor(color);
+    }
+
+    _overlayNode->setMatrix(getMatrix());
+    return _overlayNode.get();
+}
+
 void
 SurfaceNode::setDebugText(const std::string& strText)
 {
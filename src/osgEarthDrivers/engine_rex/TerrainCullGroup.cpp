@@ -0,0 +1,230 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2008-2014 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "TerrainCullGroup"
+#include <osg/Polytope>
+#include <algorithm>
+#include <cfloat>
+
+using namespace osgEarth::REX;
+using namespace osgEarth;
+
+#define LC "[TerrainCullGroup] "
+
+namespace
+{
+    // Bounds of a set of eye-space points and directions, as tangents
+    // (x/depth, y/depth) and depths.
+    struct FrustumBounds
+    {
+        double _l, _r, _b, _t, _n, _f;
+
+        FrustumBounds() :
+            _l(DBL_MAX), _r(-DBL_MAX), _b(DBL_MAX), _t(-DBL_MAX), _n(DBL_MAX), _f(0.0) { }
+
+        void expandByDirection(const osg::Vec3d& v)
+        {
+            double depth = -v.z();
+            _l = osg::minimum(_l, v.x() / depth);
+            _r = osg::maximum(_r, v.x() / depth);
+            _b = osg::minimum(_b, v.y() / depth);
+            _t = osg::maximum(_t, v.y() / depth);
+        }
+
+        void expandByPoint(const osg::Vec3d& p)
+        {
+            expandByDirection(p);
+            _n = osg::minimum(_n, -p.z());
+            _f = osg::maximum(_f, -p.z());
+        }
+    };
+}
+
+TerrainCullGroup::TerrainCullGroup() :
+_frame(~0u)
+{
+    //nop
+}
+
+void
+TerrainCullGroup::touch(osg::Camera* camera, unsigned frame)
+{
+    for (Members::iterator i = _members.begin(); i != _members.end(); )
+    {
+        if (!i->_camera.valid())
+        {
+            i = _members.erase(i);
+        }
+        else if (i->_camera.get() == camera)
+        {
+            i->_lastFrame = frame;
+            return;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    Member member;
+    member._camera = camera;
+    member._lastFrame = frame;
+    _members.push_back(member);
+}
+
+bool
+TerrainCullGroup::canFollow(osgUtil::CullVisitor* cv)
+{
+    unsigned frame = cv->getFrameStamp() ? cv->getFrameStamp()->getFrameNumber() : 0u;
+    osg::Camera* camera = cv->getCurrentCamera();
+
+    touch(camera, frame);
+
+    // A camera that was not yet in the group when the leader culled is
+    // not in the shared frustum, and needs to cull on its own this time.
+    return
+        _frame == frame &&
+        std::find(_included.begin(), _included.end(), camera) != _included.end();
+}
+
+osg::RefMatrix*
+TerrainCullGroup::computeCullProjection(osgUtil::CullVisitor* cv)
+{
+    unsigned frame = cv->getFrameStamp() ? cv->getFrameStamp()->getFrameNumber() : 0u;
+    osg::Camera* leader = cv->getCurrentCamera();
+
+    touch(leader, frame);
+    _included.clear();
+
+    // The terrain under any transforms is the same for all cameras, so we
+    // can work in the leader camera's eye space.
+    const osg::Matrixd& leaderView = leader->getViewMatrix();
+
+    FrustumBounds bounds;
+
+    for (Members::const_iterator i = _members.begin(); i != _members.end(); ++i)
+    {
+        // only cameras that rendered in this frame or the last one:
+        osg::Camera* camera = i->_camera.get();
+        if (!camera || i->_lastFrame + 1u < frame)
+            continue;
+
+        const osg::Matrixd& proj = camera->getProjectionMatrix();
+
+        // only perspective projections
+        if (proj(3,3) != 0.0)
+            return 0L;
+
+        osg::Matrixd clipToLeader = osg::Matrixd::inverse(camera->getViewMatrix() * proj) * leaderView;
+
+        // Each frustum edge (near corner to far corner) has to be enclosed.
+        // Near/far plane culling is off when OSG computes the near/far planes,
+        // so enclose the edge directions too, since the frustum goes on past
+        // the far corners.
+        for (int x = -1; x <= 1; x += 2)
+        {
+            for (int y = -1; y <= 1; y += 2)
+            {
+                osg::Vec3d nearPoint = osg::Vec3d(x, y, -1) * clipToLeader;
+                osg::Vec3d farPoint  = osg::Vec3d(x, y,  1) * clipToLeader;
+                osg::Vec3d direction = farPoint - nearPoint;
+
+                // if part of a frustum is behind the leader's eye, no
+                // single frustum can enclose them all.
+                if (nearPoint.z() > -1e-6 || farPoint.z() > -1e-6 || direction.z() > -1e-6)
+                    return 0L;
+
+                bounds.expandByPoint(nearPoint);
+                bounds.expandByPoint(farPoint);
+                bounds.expandByDirection(direction);
+            }
+        }
+
+        _included.push_back(camera);
+    }
+
+    if (_included.empty())
+        return 0L;
+
+    return cv->createOrReuseMatrix(osg::Matrixd::frustum(
+        bounds._l * bounds._n, bounds._r * bounds._n,
+        bounds._b * bounds._n, bounds._t * bounds._n,
+        bounds._n, bounds._f));
+}
+
+void
+TerrainCullGroup::publish(osgUtil::CullVisitor* cv, const TerrainRenderData& data, bool shared)
+{
+    if (shared)
+    {
+        _frame = cv->getFrameStamp() ? cv->getFrameStamp()->getFrameNumber() : 0u;
+        _modelView = *cv->getModelViewMatrix();
+        _layers = data.layers();
+        _bs = data._drawState->_bs;
+        _box = data._drawState->_box;
+    }
+    else
+    {
+        _frame = ~0u;
+        _layers.clear();
+        _included.clear();
+    }
+}
+
+void
+TerrainCullGroup::follow(osgUtil::CullVisitor* cv, TerrainRenderData& data)
+{
+    // Moves a leader's model view matrix into this camera's view
+    osg::Matrixd delta = osg::Matrixd::inverse(_modelView) * (*cv->getModelViewMatrix());
+
+    // This camera's own frustum, in its eye space
+    osg::Polytope frustum;
+    frustum.setToUnitFrustum(false, false);
+    frustum.transformProvidingInverse(*cv->getProjectionMatrix());
+
+    for (LayerDrawableList::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
+    {
+        const LayerDrawable* source = i->get();
+        if (source->_tiles.empty())
+            continue;
+
+        osg::ref_ptr<LayerDrawable>& target = data.layer(source->_layer ? source->_layer->getUID() : -1);
+        if (!target.valid() || !target->_draw)
+            continue;
+
+        target->_tiles.reserve(source->_tiles.size());
+
+        for (DrawTileCommands::const_iterator cmd = source->_tiles.begin(); cmd != source->_tiles.end(); ++cmd)
+        {
+            osg::Matrixd mvm = (*cmd->_modelViewMatrix) * delta;
+
+            if (cmd->_box)
+            {
+                osg::BoundingSphere bs(cmd->_box->center() * mvm, cmd->_box->radius());
+                if (!frustum.contains(bs))
+                    continue;
+            }
+
+            target->_tiles.push_back(*cmd);
+            target->_tiles.back()._modelViewMatrix = cv->createOrReuseMatrix(mvm);
+        }
+    }
+
+    data._drawState->_bs = _bs;
+    data._drawState->_box = _box;
+}
@@ -34,7 +34,11 @@ _camera(0L),
 _currentTileNode(0L),
 _orphanedPassesDetected(0u),
 _cv(cullVisitor),
-_context(context)
+_context(context),
+_rangeTileNode(0L),
+_rangeTileValue(0.0f),
+_gpuCulling(false),
+_prefetch(false)
 {
     setVisitorType(CULL_VISITOR);
     setTraversalMode(TRAVERSE_ALL_CHILDREN);
@@ -62,6 +66,14 @@ TerrainCuller::setup(const Map* map, LayerExtentMap& layerExtents, const RenderB
     unsigned frameNum = getFrameStamp() ? getFrameStamp()->getFrameNumber() : 0u;
     _layerExtents = &layerExtents;
     _terrain.setup(map, bindings, frameNum, _cv);
+    _terrain._drawState->_bindless = _context->getBindlessTextures();
+    _terrain._drawState->_gpuCuller = _context->getGPUCuller();
+
+    // Leave the per-tile box test to the GPU once it's known to work;
+    // until then (or if it never does) keep culling on the CPU.
+    _gpuCulling =
+        _context->getGPUCuller() != 0L &&
+        _context->getGPUCuller()->isActive();
 }
 
 float
@@ -78,8 +90,6 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
     if ( !surface )
         return 0L;
 
-    const RenderBindings& bindings = _context->getRenderBindings();
-
     // skip layers that are not visible:
     if (pass && 
         pass->visibleLayer() && 
@@ -123,9 +133,15 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
             tile->_geom = surface->getDrawable()->_geom.get();
             tile->_morphConstants = tileNode->getMorphConstants();
             tile->_key = &tileNode->getKey();
+            tile->_box = &surface->getAlignedBoundingBox();
 
-            osg::Vec3 c = surface->getBound().center() * surface->getInverseMatrix();
-            tile->_range = getDistanceToViewPoint(c, true);
+            if (_rangeTileNode != tileNode)
+            {
+                osg::Vec3 c = surface->getBound().center() * surface->getInverseMatrix();
+                _rangeTileValue = getDistanceToViewPoint(c, true);
+                _rangeTileNode = tileNode;
+            }
+            tile->_range = _rangeTileValue;
 
             tile->_layerOrder = drawable->_drawOrder;
 
@@ -279,8 +295,9 @@ TerrainCuller::apply(SurfaceNode& node)
     node.computeLocalToWorldMatrix(*matrix,this);
     _cv->pushModelViewMatrix(matrix, node.getReferenceFrame());
 
-    // now test against the local bounding box for tighter culling:
-    if (!_cv->isCulled(node.getAlignedBoundingBox()))
+    // now test against the local bounding box for tighter culling,
+    // unless the GPU culler is going to do that at draw time:
+    if (_gpuCulling || !_cv->isCulled(node.getAlignedBoundingBox()))
     {
         if (!_isSpy)
         {
@@ -0,0 +1,485 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2008-2014 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "TextureUploadRing"
+#include <osgEarth/Notify>
+#include <osg/BufferObject>
+#include <osg/buffered_value>
+#include <cstring>
+
+using namespace osgEarth::REX;
+using namespace osgEarth;
+
+#define LC "[TextureUploadRing] "
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+
+#ifndef GL_ALPHA
+#define GL_ALPHA 0x1906
+#endif
+
+#ifndef GL_LUMINANCE
+#define GL_LUMINANCE 0x1909
+#endif
+
+#ifndef GL_LUMINANCE_ALPHA
+#define GL_LUMINANCE_ALPHA 0x190A
+#endif
+
+#ifndef GL_INTENSITY
+#define GL_INTENSITY 0x8049
+#endif
+
+// Offsets in the ring are aligned to this many bytes
+#define RING_ALIGNMENT 256u
+
+namespace
+{
+    bool usesMipmaps(const osg::Texture2D& texture)
+    {
+        osg::Texture::FilterMode f = texture.getFilter(osg::Texture::MIN_FILTER);
+        return
+            f == osg::Texture::LINEAR_MIPMAP_LINEAR ||
+            f == osg::Texture::LINEAR_MIPMAP_NEAREST ||
+            f == osg::Texture::NEAREST_MIPMAP_LINEAR ||
+            f == osg::Texture::NEAREST_MIPMAP_NEAREST;
+    }
+
+    // Legacy pixel formats need OSG's own handling in a core profile
+    bool isLegacyFormat(GLenum pixelFormat)
+    {
+        return
+            pixelFormat == GL_LUMINANCE ||
+            pixelFormat == GL_LUMINANCE_ALPHA ||
+            pixelFormat == GL_ALPHA ||
+            pixelFormat == GL_INTENSITY;
+    }
+
+    /**
+     * Uploads a texture from its ring block, or from the image when the
+     * block is unavailable in the current context.
+     */
+    struct RingSubload : public osg::Texture2D::SubloadCallback
+    {
+        RingSubload(TextureUploadRing* ring, TextureUploadRing::Block* block, unsigned stagedCount) :
+            _ring(ring), _block(block), _stagedCount(stagedCount) { }
+
+        void load(const osg::Texture2D& texture, osg::State& state) const
+        {
+            const osg::Image* image = texture.getImage();
+            if (!image || !image->data())
+                return;
+
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, image->getPacking());
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, image->getRowLength());
+
+            unsigned uploadedCount = image->getModifiedCount();
+
+            if (_ring->begin(state, _block.get()))
+            {
+                // allocate the storage, then stream the pixels from the ring:
+                glTexImage2D(GL_TEXTURE_2D, 0, texture.getInternalFormat(),
+                    image->s(), image->t(), 0,
+                    image->getPixelFormat(), image->getDataType(), 0L);
+
+                ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _ring->getBuffer());
+
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                    image->s(), image->t(),
+                    image->getPixelFormat(), image->getDataType(),
+                    (const GLvoid*)(size_t)_block->_offset);
+
+                ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+                _ring->end(state, _block.get());
+                ++_ring->_numRingUploads;
+
+                // if the image changed after staging, subload() catches up
+                uploadedCount = _stagedCount;
+            }
+            else
+            {
+                glTexImage2D(GL_TEXTURE_2D, 0, texture.getInternalFormat(),
+                    image->s(), image->t(), 0,
+                    image->getPixelFormat(), image->getDataType(), image->data());
+
+                ++_ring->_numDirectUploads;
+            }
+
+            if (usesMipmaps(texture) && ext->glGenerateMipmap)
+                ext->glGenerateMipmap(GL_TEXTURE_2D);
+
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+            _modifiedCount[state.getContextID()] = uploadedCount;
+        }
+
+        void subload(const osg::Texture2D& texture, osg::State& state) const
+        {
+            const osg::Image* image = texture.getImage();
+            if (!image || !image->data())
+                return;
+
+            unsigned& modifiedCount = _modifiedCount[state.getContextID()];
+
+            if (modifiedCount != image->getModifiedCount())
+            {
+                // image changed after the first upload; it's rare enough to
+                // just go straight from the image.
+                glPixelStorei(GL_UNPACK_ALIGNMENT, image->getPacking());
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, image->getRowLength());
+
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                    image->s(), image->t(),
+                    image->getPixelFormat(), image->getDataType(), image->data());
+
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+                osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+                if (usesMipmaps(texture) && ext->glGenerateMipmap)
+                    ext->glGenerateMipmap(GL_TEXTURE_2D);
+
+                modifiedCount = image->getModifiedCount();
+            }
+
+            else if (
+                texture.getUnRefImageDataAfterApply() &&
+                texture.areAllTextureObjectsLoaded() &&
+                image->getDataVariance() == osg::Object::STATIC)
+            {
+                // same as the normal texture path: drop the CPU copy once
+                // every context has the texture.
+                const_cast<osg::Texture2D&>(texture).setImage(0L);
+            }
+        }
+
+        osg::ref_ptr<TextureUploadRing> _ring;
+        osg::ref_ptr<TextureUploadRing::Block> _block;
+        unsigned _stagedCount;
+        mutable osg::buffered_value<unsigned> _modifiedCount;
+
+    protected:
+        virtual ~RingSubload()
+        {
+            if (_block.valid())
+                _ring->discard(_block.get());
+        }
+    };
+}
+
+//........................................................................
+
+TextureUploadRing::TextureUploadRing(unsigned size) :
+_size      ( size ),
+_head      ( 0u ),
+_generation( 0u ),
+_contextID ( ~0u ),
+_disabled  ( size == 0u ),
+_pbo       ( 0u ),
+_mapped    ( 0L )
+{
+    //nop
+}
+
+void
+TextureUploadRing::stage(TerrainTileModel* model)
+{
+    if (!model || _disabled)
+        return;
+
+    for (TerrainTileColorLayerModelVector::const_iterator i = model->colorLayers().begin();
+        i != model->colorLayers().end();
+        ++i)
+    {
+        stage(dynamic_cast<osg::Texture2D*>(i->get()->getTexture()));
+    }
+
+    stage(dynamic_cast<osg::Texture2D*>(model->getElevationTexture()));
+    stage(dynamic_cast<osg::Texture2D*>(model->getNormalTexture()));
+    stage(dynamic_cast<osg::Texture2D*>(model->getLandCoverTexture()));
+}
+
+bool
+TextureUploadRing::stage(osg::Texture2D* texture)
+{
+    if (!texture || _disabled)
+        return false;
+
+    // Only textures that belong to this tile alone; shared placeholder
+    // textures may already be in use by the draw thread.
+    if (texture->referenceCount() > 1 || texture->getSubloadCallback())
+        return false;
+
+    osg::Image* image = texture->getImage();
+    if (!image || !image->data() ||
+        image->isCompressed() ||
+        image->r() > 1 ||
+        image->isMipmap() ||
+        image->getPixelBufferObject() ||
+        isLegacyFormat(image->getPixelFormat()))
+    {
+        return false;
+    }
+
+    unsigned size = image->getTotalSizeInBytes();
+
+    osg::ref_ptr<Block> block;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        // The ring maps on the draw thread when the first texture loads,
+        // so until then the callback is installed without a block.
+        if (_mapped)
+        {
+            block = allocate(size);
+            if (block.valid())
+            {
+                ::memcpy(_mapped + block->_offset, image->data(), size);
+            }
+        }
+    }
+
+    texture->setTextureSize(image->s(), image->t());
+    texture->setInternalFormat(image->getInternalTextureFormat());
+    texture->setSubloadCallback(new RingSubload(this, block.get(), image->getModifiedCount()));
+    return true;
+}
+
+TextureUploadRing::Block*
+TextureUploadRing::allocate(unsigned size)
+{
+    unsigned alignedSize = ((size + RING_ALIGNMENT - 1u) / RING_ALIGNMENT) * RING_ALIGNMENT;
+    if (alignedSize == 0u || alignedSize >= _size)
+        return 0L;
+
+    if (_blocks.empty())
+        _head = 0u;
+
+    unsigned tail = _blocks.empty() ? 0u : _blocks.front()->_offset;
+    unsigned offset;
+
+    if (_blocks.empty() || _head > tail)
+    {
+        // free space is after the head, and before the tail once we wrap:
+        if (_head + alignedSize <= _size)
+            offset = _head;
+        else if (alignedSize < tail)
+            offset = 0u;
+        else
+            return 0L;
+    }
+    else
+    {
+        // wrapped; free space is between the head and the tail:
+        if (_head + alignedSize < tail)
+            offset = _head;
+        else
+            return 0L;
+    }
+
+    Block* block = new Block();
+    block->_offset = offset;
+    block->_size = alignedSize;
+    block->_generation = _generation;
+    block->_state = Block::STAGED;
+    block->_fence = 0L;
+    _blocks.push_back(block);
+
+    _head = offset + alignedSize;
+    return block;
+}
+
+bool
+TextureUploadRing::initialize(osg::State& state)
+{
+    _contextID = state.getContextID();
+
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+    bool supported =
+        osg::isGLExtensionSupported(_contextID, "GL_ARB_buffer_storage") &&
+        ext->glBufferStorage &&
+        ext->glMapBufferRange &&
+        ext->glFenceSync &&
+        ext->glClientWaitSync &&
+        ext->glDeleteSync;
+
+    if (!supported)
+    {
+        OE_INFO << LC << "GL_ARB_buffer_storage not available; tile textures will upload normally" << std::endl;
+        _disabled = true;
+        return false;
+    }
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    ext->glGenBuffers(1, &_pbo);
+    ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _pbo);
+    ext->glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, _size, 0L, flags);
+    _mapped = (unsigned char*)ext->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, _size, flags);
+    ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+    if (!_mapped)
+    {
+        OE_WARN << LC << "Failed to map the upload ring; tile textures will upload normally" << std::endl;
+        ext->glDeleteBuffers(1, &_pbo);
+        _pbo = 0u;
+        _disabled = true;
+        return false;
+    }
+
+    OE_INFO << LC << "Mapped a " << (_size/1048576u) << "MB upload ring" << std::endl;
+    return true;
+}
+
+void
+TextureUploadRing::retire(osg::State& state)
+{
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+    // Free blocks in allocation order, stopping at the first one that's
+    // still waiting for its upload or whose upload the GPU hasn't finished.
+    while (!_blocks.empty())
+    {
+        Block* block = _blocks.front().get();
+
+        if (block->_state == Block::FENCED)
+        {
+            GLenum result = ext->glClientWaitSync(block->_fence, 0, 0);
+            if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+                break;
+
+            ext->glDeleteSync(block->_fence);
+            block->_fence = 0L;
+            block->_state = Block::FREE;
+        }
+
+        if (block->_state != Block::FREE)
+            break;
+
+        _blocks.pop_front();
+    }
+}
+
+bool
+TextureUploadRing::begin(osg::State& state, Block* block)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (_disabled)
+        return false;
+
+    if (_contextID == ~0u && !initialize(state))
+        return false;
+
+    if (state.getContextID() != _contextID || !_mapped)
+        return false;
+
+    // every upload in the owning context recycles finished blocks, even
+    // the ones that don't come from the ring:
+    retire(state);
+
+    return
+        block &&
+        block->_generation == _generation &&
+        block->_state == Block::STAGED;
+}
+
+void
+TextureUploadRing::end(osg::State& state, Block* block)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+    block->_fence = ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    block->_state = Block::FENCED;
+}
+
+void
+TextureUploadRing::discard(Block* block)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (block->_state == Block::STAGED)
+        block->_state = Block::FREE;
+}
+
+void
+TextureUploadRing::releaseGLObjects(osg::State* state) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (_pbo == 0u)
+        return;
+
+    if (state)
+    {
+        if (state->getContextID() != _contextID)
+            return;
+
+        osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+
+        for (unsigned i = 0; i < _blocks.size(); ++i)
+        {
+            if (_blocks[i]->_fence)
+                ext->glDeleteSync(_blocks[i]->_fence);
+        }
+
+        ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _pbo);
+        ext->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
+        ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+        ext->glDeleteBuffers(1, &_pbo);
+    }
+
+    // Outstanding blocks belong to the old buffer; textures holding one
+    // will upload from their images instead.
+    _blocks.clear();
+    ++_generation;
+    _head = 0u;
+    _pbo = 0u;
+    _mapped = 0L;
+    _contextID = ~0u;
+}
@@ -21,6 +21,7 @@
 
 #include <osg/Version>
 #include <iterator>
+#include <cfloat>
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/ImageUtils>
@@ -44,6 +45,16 @@ ModifyBoundingBoxCallback::operator()(const TileKey& key, osg::BoundingBox& bbox
 {
     _engine->getEngine()->fireModifyTileBoundingBoxCallbacks(key, bbox);
 
+    // make room for the tile's true elevation range (recorded in a previous
+    // session, or by a loaded tile) before its own elevation data arrives.
+    ElevationRangeIndex* ranges = _engine->getElevationRanges();
+    float minHeight, maxHeight;
+    if (ranges && ranges->getElevationRange(key, minHeight, maxHeight))
+    {
+        bbox.zMin() = osg::minimum(bbox.zMin(), minHeight);
+        bbox.zMax() = osg::maximum(bbox.zMax(), maxHeight);
+    }
+
     osg::ref_ptr<const Map> map = _engine->getMap();
     if (map.valid())
     {
@@ -69,7 +80,9 @@ _key         ( key ),
 _geom        ( geometry ),
 _tileSize    ( tileSize ),
 _bboxRadius  ( 1.0 ),
-_bboxCB      ( NULL )
+_bboxCB      ( NULL ),
+_minHeight   ( 0.0f ),
+_maxHeight   ( 0.0f )
 {   
     // a mesh to materialize the heightfield for functors
     _mesh = new osg::Vec3f[ tileSize*tileSize ];
@@ -119,6 +132,9 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
     
     const osg::Vec3Array& verts = *static_cast<osg::Vec3Array*>(_geom->getVertexArray());
 
+    _minHeight = 0.0f;
+    _maxHeight = 0.0f;
+
     if ( _elevationRaster.valid() )
     {
         const osg::Vec3Array& normals = *static_cast<osg::Vec3Array*>(_geom->getNormalArray());
@@ -139,6 +155,9 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
         {
             OE_WARN << LC << "Precision loss in tile " << _key.str() << "\n";
         }
+
+        _minHeight = FLT_MAX;
+        _maxHeight = -FLT_MAX;
     
         for(int t=0; t<_tileSize; ++t)
         {
@@ -155,6 +174,9 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
                 readElevation(sample, u, v);
 
                 _mesh[index] = verts[index] + normals[index] * sample.r();
+
+                _minHeight = osg::minimum(_minHeight, sample.r());
+                _maxHeight = osg::maximum(_maxHeight, sample.r());
             }
         }
     }
@@ -50,6 +50,13 @@ using namespace osgEarth::Util;
 
 namespace
 {
+    // Debug overlay colors, and the metric values that map to full red
+    const osg::Vec4f GHOST_COLOR(0.6f, 0.6f, 0.6f, 0.35f);
+    const osg::Vec4f NEVER_DRAWN_COLOR(1.0f, 0.0f, 1.0f, 1.0f);
+    const float OVERLAY_MAX_LATENCY = 2.0f; // seconds
+    const float OVERLAY_MAX_BYTES = 4.0f * 1024.0f * 1024.0f;
+    const float OVERLAY_MAX_PASSES = 4.0f;
+
     // Scale and bias matrices, one for each TileKey quadrant.
     const osg::Matrixf scaleBias[4] =
     {
@@ -58,16 +65,120 @@ namespace
         osg::Matrixf(0.5f,0,0,0, 0,0.5f,0,0, 0,0,1.0f,0, 0.0f,0.0f,0,1.0f),
         osg::Matrixf(0.5f,0,0,0, 0,0.5f,0,0, 0,0,1.0f,0, 0.5f,0.0f,0,1.0f)
     };
+
+    // Whether the segment p0->p1 passes through a bounding sphere.
+    bool segmentIntersectsSphere(const osg::Vec3d& p0, const osg::Vec3d& p1, const osg::BoundingSphere& bs)
+    {
+        if (!bs.valid())
+            return false;
+
+        osg::Vec3d center(bs.center());
+        osg::Vec3d d = p1 - p0;
+        double len2 = d.length2();
+        double t = len2 > 0.0 ? ((center - p0) * d) / len2 : 0.0;
+        t = osg::clampBetween(t, 0.0, 1.0);
+        return ((p0 + d*t) - center).length2() <= bs.radius2();
+    }
+
+    // Clips the segment p0->p1 to a box, returning the parametric range inside it.
+    bool clipSegmentToBox(const osg::Vec3d& p0, const osg::Vec3d& p1, const osg::BoundingBox& box, double& t0, double& t1)
+    {
+        t0 = 0.0, t1 = 1.0;
+        osg::Vec3d d = p1 - p0;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (osg::equivalent(d[i], 0.0))
+            {
+                if (p0[i] < box._min[i] || p0[i] > box._max[i])
+                    return false;
+            }
+            else
+            {
+                double a = (box._min[i] - p0[i]) / d[i];
+                double b = (box._max[i] - p0[i]) / d[i];
+                if (a > b) std::swap(a, b);
+                t0 = osg::maximum(t0, a);
+                t1 = osg::minimum(t1, b);
+                if (t0 > t1)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Samples a tile's elevation raster at map coordinates, the same way
+    // TileDrawable does when it builds the tile's mesh.
+    struct HeightfieldSampler
+    {
+        HeightfieldSampler(const GeoExtent& extent, const osg::Image* raster, const osg::Matrixf& scaleBias) :
+            _extent(extent), _reader(raster), _raster(raster), _scaleBias(scaleBias)
+        {
+            _reader.setBilinear(true);
+        }
+
+        // Normalized tile coordinates of a map point; false if it's outside the tile.
+        bool toUV(double x, double y, double& u, double& v) const
+        {
+            u = (x - _extent.xMin()) / _extent.width();
+            v = (y - _extent.yMin()) / _extent.height();
+            return u >= 0.0 && u <= 1.0 && v >= 0.0 && v <= 1.0;
+        }
+
+        float elevation(double u, double v) const
+        {
+            if (!_raster)
+                return 0.0f;
+            u = osg::clampBetween(u, 0.0, 1.0);
+            v = osg::clampBetween(v, 0.0, 1.0);
+            osg::Vec4f sample;
+            _reader(sample,
+                u*_scaleBias(0,0) + _scaleBias(3,0),
+                v*_scaleBias(1,1) + _scaleBias(3,1));
+            return sample.r();
+        }
+
+        // Height of a world point above the heightfield; false if it's outside the tile.
+        bool heightAbove(const osg::Vec3d& world, double& out_height) const
+        {
+            GeoPoint p;
+            double u, v;
+            if (!p.fromWorld(_extent.getSRS(), world) || !toUV(p.x(), p.y(), u, v))
+                return false;
+            out_height = p.z() - elevation(u, v);
+            return true;
+        }
+
+        // World position of the heightfield surface at normalized tile coordinates.
+        osg::Vec3d surface(double u, double v) const
+        {
+            GeoPoint p(_extent.getSRS(),
+                _extent.xMin() + u*_extent.width(),
+                _extent.yMin() + v*_extent.height(),
+                elevation(u, v),
+                ALTMODE_ABSOLUTE);
+            osg::Vec3d world;
+            p.toWorld(world);
+            return world;
+        }
+
+        const GeoExtent& _extent;
+        ImageUtils::PixelReader _reader;
+        const osg::Image* _raster;
+        osg::Matrixf _scaleBias;
+    };
 }
 
 TileNode::TileNode() : 
 _loadsInQueue(0u),
+_loadStartTick(0),
+_loadLatency(-1.0f),
 _childrenReady( false ),
 _lastTraversalTime(0.0),
 _lastTraversalFrame(0.0),
 _empty(false),              // an "empty" node exists but has no geometry or children.,
 _imageUpdatesActive(false),
-_doNotExpire(false)
+_doNotExpire(false),
+_geometryBytes(0u)
 {
     //nop
 }
@@ -99,7 +210,7 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
     if (!map.valid())
         return;
 
-    unsigned tileSize = options().tileSize().get();
+    unsigned tileSize = context->getTileSize(key.getLOD());
 
     // Mask generator creates geometry from masking boundaries when they exist.
     osg::ref_ptr<MaskGenerator> masks = new MaskGenerator(key, tileSize, map.get());
@@ -121,11 +232,18 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
         return;
     }
 
+    // Pooled geometry is shared by many tiles, so only count it against
+    // this tile if it's ours alone (masked geometry is kept per tile).
+    if (!context->getGeometryPool()->isEnabled() || geom->getMaskElements())
+    {
+        _geometryBytes = geom->getTotalDataSize();
+    }
+
     // Create the drawable for the terrain surface:
     TileDrawable* surfaceDrawable = new TileDrawable(
         key, 
         geom.get(),
-        options().tileSize().get() );
+        tileSize );
 
     // Give the tile Drawable access to the render model so it can properly
     // calculate its bounding box and sphere.
@@ -154,8 +272,17 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
     float range, morphStart, morphEnd;
     context->getSelectionInfo().get(_key, range, morphStart, morphEnd);
 
-    float one_over_end_minus_start = 1.0f/(morphEnd - morphStart);
-    _morphConstants.set(morphEnd * one_over_end_minus_start, one_over_end_minus_start);
+    if (_key.getLOD() > options().maxGeometryLOD().get())
+    {
+        // Past the max geometry LOD the mesh has the same vertex spacing
+        // as the parent's, so there is nothing to morph toward.
+        _morphConstants.set(1.0f, 0.0f);
+    }
+    else
+    {
+        float one_over_end_minus_start = 1.0f/(morphEnd - morphStart);
+        _morphConstants.set(morphEnd * one_over_end_minus_start, one_over_end_minus_start);
+    }
 
     // Make a tilekey to use for testing whether to subdivide.
     if (_key.getTileY() <= th/2)
@@ -222,6 +349,7 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
 
     // register me.
     context->liveTiles()->add( this );
+    updateMemoryUsage();
 
     // signal the tile to start loading data:
     refreshAllLayers();
@@ -247,16 +375,24 @@ TileNode::computeBound() const
 bool
 TileNode::isDormant(const osg::FrameStamp* fs) const
 {
-    const unsigned minMinExpiryFrames = 3u;
     osg::Timer_t now = osg::Timer::instance()->tick();
 
     bool dormant = 
-           fs &&
-           fs->getFrameNumber() - _lastTraversalFrame > osg::maximum(options().minExpiryFrames().get(), minMinExpiryFrames) &&
+           isOutOfView(fs) &&
            now - _lastTraversalTime > options().minExpiryTime().get();
     return dormant;
 }
 
+bool
+TileNode::isOutOfView(const osg::FrameStamp* fs) const
+{
+    const unsigned minMinExpiryFrames = 3u;
+
+    return
+        fs &&
+        fs->getFrameNumber() - _lastTraversalFrame > osg::maximum(options().minExpiryFrames().get(), minMinExpiryFrames);
+}
+
 bool
 TileNode::areSiblingsDormant(const osg::FrameStamp* fs) const
 {
@@ -264,6 +400,19 @@ TileNode::areSiblingsDormant(const osg::FrameStamp* fs) const
     return parent ? parent->areSubTilesDormant(fs) : true;
 }
 
+bool
+TileNode::areSiblingsOutOfView(const osg::FrameStamp* fs) const
+{
+    const TileNode* parent = getParentTile();
+    return
+        parent == 0L ||
+        (parent->getNumChildren() >= 4 &&
+         parent->getSubTile(0)->isOutOfView(fs) &&
+         parent->getSubTile(1)->isOutOfView(fs) &&
+         parent->getSubTile(2)->isOutOfView(fs) &&
+         parent->getSubTile(3)->isOutOfView(fs));
+}
+
 void
 TileNode::setElevationRaster(const osg::Image* image, const osg::Matrixf& matrix)
 {
@@ -306,17 +455,32 @@ TileNode::refreshAllLayers()
 void
 TileNode::refreshLayers(const CreateTileManifest& manifest)
 {
-    LoadTileData* r = new LoadTileData(manifest, this, _context.get());
-    r->setName(_key.str());
-    r->setTileKey(_key);
+    _loadQueue.lock();
 
-    // if the set is empty, the load job will refresh ALL data
-    //for (std::set<UID>::const_iterator i = layers.begin(); i != layers.end(); ++i)
-    //    r->addLayerToFilter(*i);
+    // Only the request at the front of the queue goes to the loader. If
+    // there's another one waiting behind it, just add these layers to that
+    // one, so that a tile that keeps getting dirtied (say, by a layer that
+    // refreshes itself periodically) doesn't pile up requests while it's
+    // out of view.
+    if (_loadQueue.size() >= 2u)
+    {
+        _loadQueue.back()->addToManifest(manifest);
+    }
+    else
+    {
+        // if the set is empty, the load job will refresh ALL data
+        LoadTileData* r = new LoadTileData(manifest, this, _context.get());
+        r->setName(_key.str());
+        r->setTileKey(_key);
+
+        _loadQueue.push(r);
+        _loadsInQueue = _loadQueue.size();
+
+        // time the load from here for the debug overlay
+        if (_loadsInQueue == 1u)
+            _loadStartTick = osg::Timer::instance()->tick();
+    }
 
-    _loadQueue.lock();
-    _loadQueue.push(r);
-    _loadsInQueue = _loadQueue.size();
     _loadQueue.unlock();
 }
 
@@ -401,9 +565,31 @@ TileNode::cull_spy(TerrainCuller* culler)
     // trick to spy on another camera.
     unsigned frame = culler->getFrameStamp()->getFrameNumber();
 
+    int overlay = context->options().debugOverlay().get();
+
     if ( frame - _surface->getLastFramePassedCull() < 2u)
     {
         _surface->accept( *culler );
+
+        if (overlay != TerrainOptions::DEBUG_OVERLAY_NONE)
+        {
+            cull_overlay(culler, dirty() ? GHOST_COLOR : getOverlayColor(overlay));
+
+            // subtiles the main camera has not drawn (yet):
+            if (_childrenReady)
+            {
+                for(int i=0; i<4; ++i)
+                {
+                    TileNode* child = getSubTile(i);
+                    if (child == NULL)
+                        continue;
+                    else if (child->dirty())
+                        child->cull_overlay(culler, GHOST_COLOR);
+                    else if (child->_surface->getLastFramePassedCull() == 0u)
+                        child->cull_overlay(culler, NEVER_DRAWN_COLOR);
+                }
+            }
+        }
     }
 
     else if ( _childrenReady )
@@ -419,6 +605,55 @@ TileNode::cull_spy(TerrainCuller* culler)
     return visible;
 }
 
+void
+TileNode::cull_overlay(TerrainCuller* culler, const osg::Vec4f& color)
+{
+    osg::Node* node = _surface->getOverlayNode(color);
+    if (node)
+    {
+        node->accept(culler->getParent());
+    }
+}
+
+osg::Vec4f
+TileNode::getOverlayColor(int metric) const
+{
+    float t = 0.0f;
+
+    if (metric == TerrainOptions::DEBUG_OVERLAY_LOD)
+    {
+        t = (float)_key.getLOD() / (float)std::max(_context->options().maxLOD().get(), 1u);
+    }
+    else if (metric == TerrainOptions::DEBUG_OVERLAY_LATENCY)
+    {
+        if (_loadLatency < 0.0f)
+            return GHOST_COLOR;
+        t = _loadLatency / OVERLAY_MAX_LATENCY;
+    }
+    else if (metric == TerrainOptions::DEBUG_OVERLAY_BYTES)
+    {
+        size_t cpuBytes, gpuBytes;
+        _renderModel.getMemoryUsage(cpuBytes, gpuBytes);
+        t = (float)(gpuBytes + _geometryBytes) / OVERLAY_MAX_BYTES;
+    }
+    else if (metric == TerrainOptions::DEBUG_OVERLAY_COST)
+    {
+        // vertices the tile submits per frame, relative to a full-size
+        // tile drawn in OVERLAY_MAX_PASSES passes
+        const osg::Array* verts = _surface->getDrawable()->getVertexArray();
+        float tileSize = (float)_context->options().tileSize().get();
+        if (verts)
+            t = (float)(verts->getNumElements() * std::max(_renderModel._passes.size(), (size_t)1u)) /
+                (tileSize * tileSize * OVERLAY_MAX_PASSES);
+    }
+
+    // green -> yellow -> red
+    t = osg::clampBetween(t, 0.0f, 1.0f);
+    return t < 0.5f ?
+        osg::Vec4f(2.0f*t, 1.0f, 0.0f, 1.0f) :
+        osg::Vec4f(1.0f, 2.0f*(1.0f-t), 0.0f, 1.0f);
+}
+
 bool
 TileNode::cull(TerrainCuller* culler)
 {
@@ -445,6 +680,9 @@ TileNode::cull(TerrainCuller* culler)
         _key.getLOD() == opt.firstLOD().get() ||
         _key.getLOD() >= opt.minLOD().get();
 
+    // whether to start loading the children early for the predicted eye point.
+    bool canPrefetch = culler->_prefetch;
+
     // whether to accept the current surface node and not the children.
     bool canAcceptSurface = false;
 
@@ -455,6 +693,7 @@ TileNode::cull(TerrainCuller* culler)
     {
         canCreateChildren = false;
         canLoadData = false;
+        canPrefetch = false;
     }
     
     else
@@ -471,6 +710,7 @@ TileNode::cull(TerrainCuller* culler)
                 // this will allow the terrain to always show the higest tessellation level
                 // even as the data is still loading ..
                 canCreateChildren = false;
+                canPrefetch = false;
             }
         }
     }    
@@ -520,6 +760,12 @@ TileNode::cull(TerrainCuller* culler)
     else
     {
         canAcceptSurface = true;
+
+        // If the camera is headed toward the children, start on them now.
+        if (canPrefetch)
+        {
+            prefetch(culler);
+        }
     }
 
     // accept this surface if necessary.
@@ -806,6 +1052,15 @@ TileNode::merge(const TerrainTileModel* model, LoadTileData* request)
             //setElevationRaster(tex->getImage(0), osg::Matrixf::identity());
             updateElevationRaster();
 
+            // remember this tile's true elevation range for bounding it
+            // before its data arrives (later in this session or the next)
+            ElevationRangeIndex* ranges = _context->getElevationRanges();
+            if (ranges && _surface.valid())
+            {
+                const TileDrawable* drawable = _surface->getDrawable();
+                ranges->record(_key, drawable->getMinHeight(), drawable->getMaxHeight());
+            }
+
             newElevationData = true;
         }
 
@@ -941,6 +1196,8 @@ TileNode::merge(const TerrainTileModel* model, LoadTileData* request)
         _context->getEngine()->getTerrain()->notifyTileUpdate(getKey(), this);
     }
 
+    updateMemoryUsage();
+
     // Remove the load request that spawned this merge.
     // The only time the request will NOT be in the queue is if it was
     // loadSync() was called.
@@ -948,9 +1205,26 @@ TileNode::merge(const TerrainTileModel* model, LoadTileData* request)
     if (_loadQueue.empty() == false)
         _loadQueue.pop();
     _loadsInQueue = _loadQueue.size();
+    osg::Timer_t now = osg::Timer::instance()->tick();
+    if (_loadStartTick != 0)
+        _loadLatency = osg::Timer::instance()->delta_s(_loadStartTick, now);
+    _loadStartTick = _loadsInQueue > 0u ? now : 0;
     _loadQueue.unlock();
 }
 
+void
+TileNode::updateMemoryUsage()
+{
+    size_t cpuBytes, gpuBytes;
+    _renderModel.getMemoryUsage(cpuBytes, gpuBytes);
+
+    // OSG keeps the vertex arrays around after uploading them
+    cpuBytes += _geometryBytes;
+    gpuBytes += _geometryBytes;
+
+    _context->liveTiles()->setMemoryUsage(this, cpuBytes, gpuBytes);
+}
+
 void TileNode::inheritSharedSampler(int binding)
 {
     TileNode* parent = getParentTile();
@@ -1156,7 +1430,7 @@ TileNode::passInLegalRange(const RenderingPass& pass) const
 }
 
 void
-TileNode::load(TerrainCuller* culler)
+TileNode::load(TerrainCuller* culler, bool prefetch)
 {    
     const SelectionInfo& si = _context->getSelectionInfo();
     int lod     = getKey().getLOD();
@@ -1181,6 +1455,15 @@ TileNode::load(TerrainCuller* culler)
     // (because of the biggest range), and second by distance.
     float priority = lodPriority + distPriority;
 
+    // Prefetches go after all the visible tiles, nearest to the predicted
+    // eye point first. If the tile comes into view, the next regular load
+    // takes over the request at its proper priority.
+    if (prefetch)
+    {
+        distance = (osg::Vec3d(getBound().center()) - culler->_prefetchEye).length() * culler->getLODScale();
+        priority = osg::clampBetween(1.0f - distance/maxRange, 0.0f, 1.0f) - 1.0f;
+    }
+
     // Submit to the loader.
     _loadQueue.lock(); // lock the load queue
     if (_loadQueue.empty() == false)
@@ -1191,6 +1474,72 @@ TileNode::load(TerrainCuller* culler)
     _loadQueue.unlock(); // unlock the load queue
 }
 
+void
+TileNode::prefetch(TerrainCuller* culler)
+{
+    // Only distance-to-eye ranges can be tested from another eye point.
+    if (options().rangeMode() == osg::LOD::PIXEL_SIZE_ON_SCREEN)
+        return;
+
+    const SelectionInfo& si = _context->getSelectionInfo();
+    unsigned lod = _key.getLOD();
+    if (lod+1 >= si.getNumLODs())
+        return;
+
+    float range = si.getRange(_subdivideTestKey);
+    if (!_surface->anyChildBoxWithinRange(range, culler->_prefetchEye, culler->getLODScale()))
+        return;
+
+    if (!_childrenReady)
+    {
+        _mutex.lock();
+        if (!_childrenReady)
+        {
+            createChildren(_context.get());
+            _childrenReady = true;
+        }
+        _mutex.unlock();
+
+        // Like cull(), wait a frame before loading the new children.
+        return;
+    }
+
+    const osg::FrameStamp* fs = culler->getFrameStamp();
+    const TerrainOptions& opt = _context->options();
+
+    // Don't prefetch in progressive mode until this tile is up to date
+    bool canLoadData = !(opt.progressive() == true && dirty());
+
+    // The view from the predicted eye is taken to have the same orientation
+    // as the current one, so test the children against the current frustum
+    // moved along with the eye.
+    osg::Vec3d offset = culler->_prefetchEye - culler->getEyeLocal();
+
+    for (int i = 0; i < 4; ++i)
+    {
+        TileNode* child = getSubTile(i);
+        if (!child || child->_empty)
+            continue;
+
+        osg::BoundingSphere bs = child->getBound();
+        bs.center() -= offset;
+        if (culler->isCulled(bs))
+            continue;
+
+        // Keep the child from expiring while the camera is still headed its way.
+        child->_lastTraversalFrame.exchange(fs->getFrameNumber());
+        child->_lastTraversalTime = fs->getReferenceTime();
+        _context->liveTiles()->update(child, *culler);
+
+        if (canLoadData && child->dirty() && child->_key.getLOD() >= opt.minLOD().get())
+        {
+            child->load(culler, true);
+        }
+
+        child->prefetch(culler);
+    }
+}
+
 void
 TileNode::loadSync()
 {
@@ -1324,4 +1673,104 @@ const TerrainOptions&
 TileNode::options() const
 {
     return _context->options();
-}
\ No newline at end of file
+}
+
+bool
+TileNode::intersect(const osg::Vec3d& start, const osg::Vec3d& end, double& inout_ratio, osg::Vec3d& out_normal) const
+{
+    if (_empty || !segmentIntersectsSphere(start, end, getBound()))
+        return false;
+
+    // Mirror the non-cull traversal: descend into the subtiles if there are any,
+    // otherwise this tile's surface is the one in the scene graph.
+    if (getNumChildren() > 0)
+    {
+        bool hit = false;
+        for (unsigned i = 0; i < getNumChildren(); ++i)
+        {
+            const TileNode* child = dynamic_cast<const TileNode*>(_children[i].get());
+            if (child && child->intersect(start, end, inout_ratio, out_normal))
+                hit = true;
+        }
+        return hit;
+    }
+
+    if (!_surface.valid() || !_surface->getDrawable())
+        return false;
+
+    const TileDrawable* drawable = _surface->getDrawable();
+
+    // Clip the segment to the tile's bounding box in its local frame;
+    // the transform is affine so the parametric range carries over.
+    const osg::Matrixd& local2world = _surface->getMatrix();
+    osg::Matrixd world2local;
+    world2local.invert(local2world);
+
+    double t0, t1;
+    if (!clipSegmentToBox(start*world2local, end*world2local, drawable->getBoundingBox(), t0, t1) ||
+        t0 >= inout_ratio)
+    {
+        return false;
+    }
+    t1 = osg::minimum(t1, inout_ratio);
+
+    HeightfieldSampler hf(_key.getExtent(), drawable->getElevationRaster(), drawable->getElevationMatrix());
+
+    // March along the clipped segment in steps of about one mesh cell, looking
+    // for a change of side relative to the surface.
+    osg::Vec3d dir = end - start;
+    double cellSize = drawable->getWidth() / (double)osg::maximum(drawable->_tileSize-1, 1);
+    double length = dir.length() * (t1 - t0);
+    unsigned steps = osg::clampBetween((unsigned)(length / osg::maximum(cellSize, 1e-3)) + 1u, 1u, 4096u);
+
+    double prevT = t0, prevH = 0.0;
+    bool prevValid = hf.heightAbove(start + dir*t0, prevH);
+
+    for (unsigned s = 1; s <= steps; ++s)
+    {
+        double t = t0 + (t1 - t0) * (double)s / (double)steps;
+        double h;
+        if (!hf.heightAbove(start + dir*t, h))
+        {
+            prevValid = false;
+            continue;
+        }
+
+        if (prevValid && (prevH > 0.0) != (h > 0.0))
+        {
+            // refine the crossing by bisection:
+            double a = prevT, b = t, ha = prevH;
+            for (int i = 0; i < 16; ++i)
+            {
+                double m = 0.5*(a + b), hm;
+                if (!hf.heightAbove(start + dir*m, hm))
+                    break;
+                if ((hm > 0.0) == (ha > 0.0))
+                    a = m, ha = hm;
+                else
+                    b = m;
+            }
+            double hitT = 0.5*(a + b);
+            if (hitT >= inout_ratio)
+                return false;
+
+            inout_ratio = hitT;
+
+            // normal from the surface gradient around the hit:
+            GeoPoint p;
+            p.fromWorld(_key.getExtent().getSRS(), start + dir*hitT);
+            double u, v;
+            hf.toUV(p.x(), p.y(), u, v);
+            double du = 0.5 / (double)osg::maximum(drawable->_tileSize-1, 1);
+            osg::Vec3d east = hf.surface(u+du, v) - hf.surface(u-du, v);
+            osg::Vec3d north = hf.surface(u, v+du) - hf.surface(u, v-du);
+            out_normal = east ^ north;
+            out_normal.normalize();
+            return true;
+        }
+
+        prevT = t, prevH = h, prevValid = true;
+    }
+
+    return false;
+}
@@ -19,6 +19,7 @@
 #include "TileNodeRegistry"
 
 #include <osgEarth/Metrics>
+#include <algorithm>
 
 using namespace osgEarth::REX;
 using namespace osgEarth;
@@ -28,8 +29,6 @@ using namespace osgEarth;
 #define OE_TEST OE_NULL
 //#define OE_TEST OE_INFO
 
-#define SENTRY_VALUE NULL
-
 #define PROFILING_REX_TILES "Live Terrain Tiles"
 
 //----------------------------------------------------------------------------
@@ -38,10 +37,11 @@ TileNodeRegistry::TileNodeRegistry(const std::string& name) :
 _name              ( name ),
 _revisioningEnabled( false ),
 _notifyNeighbors   ( false ),
-_firstLOD          ( 0u )
+_firstLOD          ( 0u ),
+_totalCPUBytes     ( 0u ),
+_totalGPUBytes     ( 0u )
 {
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr = _tracker.begin();
+    moveToFront(&_sentry);
 }
 
 TileNodeRegistry::~TileNodeRegistry()
@@ -122,118 +122,82 @@ TileNodeRegistry::add(TileNode* tile)
     // the registry records for its descendants, but the orphaned record has
     // not yet itself been removed by the Unloader. So we have to check!
 
-    bool recyclingOrphan = false;
-    TrackerEntry* se;
     TableEntry* te;
 
     TileTable::iterator i = _tiles.find(tile->getKey());
     if (i != _tiles.end())
     {
         // found an orphan! Reuse and overwrite it.
-        recyclingOrphan = true;
         te = &i->second;
-        se = (*te->_trackerptr);
-        _tracker.erase(te->_trackerptr); // since we need to move it to the front
+        _totalCPUBytes -= te->_cpuBytes;
+        _totalGPUBytes -= te->_gpuBytes;
         OE_DEBUG << "Reused orphaned tile record " << tile->getKey().str() << std::endl;
     }
     else
     {
         te = &_tiles[tile->getKey()];
-        se = new TrackerEntry();
     }
 
-    // init the tracker entry and place it at the front of the tracker:
-    se->_tile = tile;
-    se->_lastTime = DBL_MAX;
-    se->_lastFrame = ~0;
-    se->_lastRange = FLT_MAX;
-    _tracker.push_front(se);
-
-    // init the table entry:
+    // init the entry and place it at the front of the tracker:
     te->_tile = tile;
-    te->_trackerptr = _tracker.begin();
-    
-    // Start waiting on our neighbors.
-    // (If we're recycling and orphaned record, we need to remove old listeners first)
+    te->_lastTime = DBL_MAX;
+    te->_lastFrame = ~0;
+    te->_lastRange = FLT_MAX;
+    te->_lastVisitRange = FLT_MAX;
+    te->_cpuBytes = 0u;
+    te->_gpuBytes = 0u;
+    moveToFront(te);
+
     if (_notifyNeighbors)
     {
-        const TileKey& key = tile->getKey();
-
-        // If we're recycling, we need to remove the old listeners first
-        if (recyclingOrphan)
-        {
-            stopListeningFor(key.createNeighborKey(1, 0), key);
-            stopListeningFor(key.createNeighborKey(0, 1), key);
-        }
-
-        startListeningFor(key.createNeighborKey(1, 0), tile);
-        startListeningFor(key.createNeighborKey(0, 1), tile);
-
-        // check for tiles that are waiting on this tile, and notify them!
-        TileKeyOneToMany::iterator notifier = _notifiers.find( tile->getKey() );
-        if ( notifier != _notifiers.end() )
-        {
-            TileKeySet& listeners = notifier->second;
-
-            for(TileKeySet::iterator listener = listeners.begin(); listener != listeners.end(); ++listener)
-            {
-                TileTable::iterator i = _tiles.find( *listener );
-                if ( i != _tiles.end())
-                {
-                    i->second._tile->notifyOfArrival( tile );
-                }
-            }
-            _notifiers.erase( notifier );
-        }
-
-        OE_DEBUG << LC << _name 
-            << ": tiles=" << _tiles.size()
-            << ", notifiers=" << _notifiers.size()
-            << std::endl;
+        notifyNeighbors(tile);
     }
 
     _mutex.unlock();
 }
 
 void
-TileNodeRegistry::startListeningFor(const TileKey& tileToWaitFor, TileNode* waiter)
+TileNodeRegistry::notifyNeighbors(TileNode* tile)
 {
     // ASSUME EXCLUSIVE LOCK
 
-    TileTable::iterator i = _tiles.find(tileToWaitFor);
+    // Each tile wants its east and south neighbors. Rather than keeping
+    // a table of who is waiting for whom, look the neighbors up by key
+    // in both directions whenever a tile arrives.
+    const TileKey& key = tile->getKey();
+    TileTable::iterator i;
+
+    i = _tiles.find(key.createNeighborKey(1, 0));
     if (i != _tiles.end())
-    {
-        TileNode* tile = i->second._tile.get();
+        tile->notifyOfArrival(i->second._tile.get());
+
+    i = _tiles.find(key.createNeighborKey(0, 1));
+    if (i != _tiles.end())
+        tile->notifyOfArrival(i->second._tile.get());
 
-        OE_DEBUG << LC << waiter->getKey().str() << " listened for " << tileToWaitFor.str()
-            << ", but it was already in the repo.\n";
+    i = _tiles.find(key.createNeighborKey(-1, 0));
+    if (i != _tiles.end())
+        i->second._tile->notifyOfArrival(tile);
 
-        waiter->notifyOfArrival( tile );
-    }
-    else
-    {
-        OE_DEBUG << LC << waiter->getKey().str() << " listened for " << tileToWaitFor.str() << ".\n";
-        _notifiers[tileToWaitFor].insert( waiter->getKey() );
-    }
+    i = _tiles.find(key.createNeighborKey(0, -1));
+    if (i != _tiles.end())
+        i->second._tile->notifyOfArrival(tile);
 }
 
 void
-TileNodeRegistry::stopListeningFor(const TileKey& tileToWaitFor, const TileKey& waiterKey)
+TileNodeRegistry::moveToFront(TableEntry* entry)
 {
     // ASSUME EXCLUSIVE LOCK
 
-    TileKeyOneToMany::iterator i = _notifiers.find(tileToWaitFor);
-    if (i != _notifiers.end())
-    {
-        // remove the waiter from this set:
-        i->second.erase(waiterKey);
+    // unlink (a no-op for an entry that links to itself)...
+    entry->_prev->_next = entry->_next;
+    entry->_next->_prev = entry->_prev;
 
-        // if the set is now empty, remove the set entirely
-        if (i->second.empty())
-        {
-            _notifiers.erase(i);
-        }
-    }
+    // ...and relink right after the head.
+    entry->_prev = &_tracker;
+    entry->_next = _tracker._next;
+    _tracker._next->_prev = entry;
+    _tracker._next = entry;
 }
 
 void
@@ -253,16 +217,12 @@ TileNodeRegistry::releaseAll(ResourceReleaser* releaser)
 
     _tiles.clear();
 
-    for (Tracker::iterator i = _tracker.begin(); i != _tracker.end(); ++i)
-    {
-        TrackerEntry* e = *i;
-        delete e;
-    }
-    _tracker.clear();
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr = _tracker.begin();
+    _tracker._prev = _tracker._next = &_tracker;
+    _sentry._prev = _sentry._next = &_sentry;
+    moveToFront(&_sentry);
 
-    _notifiers.clear();
+    _totalCPUBytes = 0u;
+    _totalGPUBytes = 0u;
 
     OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_tiles.size()));
 
@@ -285,21 +245,19 @@ TileNodeRegistry::update(TileNode* tile, osg::NodeVisitor& nv)
     {
         const osg::FrameStamp* fs = nv.getFrameStamp();
 
-        TableEntry& e = i->second;
-        TrackerEntry* se = (*e._trackerptr);
+        TableEntry* se = &i->second;
         se->_lastTime = fs->getReferenceTime();
         se->_lastFrame = fs->getFrameNumber();
 
         const osg::BoundingSphere& bs = tile->getBound();
         float range = nv.getDistanceToViewPoint(bs.center(), true) - bs.radius();
         se->_lastRange = osg::minimum(se->_lastRange, range);
+        se->_lastVisitRange = se->_lastRange;
 
         // Move the tracker to the front of the list (ahead of the sentry).
         // Once a cull traversal is complete, all visited tiles will be
         // in front of the sentry, leaving all non-visited tiles behind it.
-        _tracker.erase(e._trackerptr);
-        _tracker.push_front(se);
-        e._trackerptr = _tracker.begin();
+        moveToFront(se);
     }
     else
     {
@@ -309,6 +267,71 @@ TileNodeRegistry::update(TileNode* tile, osg::NodeVisitor& nv)
     _mutex.unlock();
 }
 
+void
+TileNodeRegistry::setMemoryUsage(TileNode* tile, size_t cpuBytes, size_t gpuBytes)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    TileTable::iterator i = _tiles.find(tile->getKey());
+    if (i != _tiles.end() && i->second._tile.get() == tile)
+    {
+        TableEntry* se = &i->second;
+
+        _totalCPUBytes = _totalCPUBytes - se->_cpuBytes + cpuBytes;
+        _totalGPUBytes = _totalGPUBytes - se->_gpuBytes + gpuBytes;
+
+        se->_cpuBytes = cpuBytes;
+        se->_gpuBytes = gpuBytes;
+    }
+}
+
+size_t
+TileNodeRegistry::getTotalCPUBytes() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _totalCPUBytes;
+}
+
+size_t
+TileNodeRegistry::getTotalGPUBytes() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _totalGPUBytes;
+}
+
+void
+TileNodeRegistry::remove(TableEntry* se, std::vector<osg::observer_ptr<TileNode> >& output)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    TileKey key = se->_tile->getKey();
+
+    _totalCPUBytes -= se->_cpuBytes;
+    _totalGPUBytes -= se->_gpuBytes;
+
+    // put the tile on the output list:
+    output.push_back(se->_tile);
+
+    // remove it from the tracker list:
+    se->_prev->_next = se->_next;
+    se->_next->_prev = se->_prev;
+
+    // remove it from the main tile table (which frees the entry):
+    _tiles.erase(key);
+}
+
+namespace
+{
+    // A tile we may unload early to get back under the memory budget.
+    struct Candidate
+    {
+        double _score;
+        TileNodeRegistry::TableEntry* _entry;
+
+        bool operator < (const Candidate& rhs) const { return _score > rhs._score; }
+    };
+}
+
 void
 TileNodeRegistry::collectDormantTiles(
     osg::NodeVisitor& nv,
@@ -316,65 +339,84 @@ TileNodeRegistry::collectDormantTiles(
     unsigned oldestAllowableFrame,
     float farthestAllowableRange,
     unsigned maxTiles,
+    size_t bytesToFree,
     std::vector<osg::observer_ptr<TileNode> >& output)
 {
     _mutex.lock();
 
     unsigned count = 0u;
+    size_t bytesFreed = 0u;
 
     const osg::FrameStamp* fs = nv.getFrameStamp();
+    double now = fs->getReferenceTime();
+
+    std::vector<Candidate> candidates;
 
     // After cull, all visited tiles are in front of the sentry, and all
     // non-visited tiles are behind it. Start at the sentry position and
     // iterate over the non-visited tiles, checking them for deletion.
-    Tracker::iterator i = _sentryptr;
-    Tracker::iterator tmp;
-    for(++i; i != _tracker.end() && count < maxTiles; ++i)
+    TableEntry* next;
+    for(TableEntry* se = _sentry._next; se != &_tracker && count < maxTiles; se = next)
     {
-        TrackerEntry* se = *i;
+        next = se->_next;
 
-        const TileKey& key = se->_tile->getKey();
+        // Out of view for a few frames, and safe to remove:
+        bool removable =
+            se->_tile->getDoNotExpire() == false &&
+            se->_lastFrame < oldestAllowableFrame;
 
-        if (se->_tile->getDoNotExpire() == false &&
+        if (removable &&
             se->_lastTime < oldestAllowableTime &&
-            se->_lastFrame < oldestAllowableFrame &&
             se->_lastRange > farthestAllowableRange &&
             se->_tile->areSiblingsDormant(fs))
         {
-            if (_notifyNeighbors)
-            {
-                // remove neighbor listeners:
-                stopListeningFor(key.createNeighborKey(1, 0), key);
-                stopListeningFor(key.createNeighborKey(0, 1), key);
-            }
-
-            // back up the iterator so we can safely erase the tracker entry:
-            tmp = i;
-            --i;
-
-            // put the tile on the output list:
-            output.push_back(se->_tile);
-
-            // remove it from the main tile table:
-            _tiles.erase(key);
+            bytesFreed += se->_gpuBytes;
 
-            // remove it from the tracker list:
-            _tracker.erase(tmp);
-            delete se;
+            remove(se, output);
 
             ++count;
         }
         else
         {
+            // Over budget, the tile can go before its time is up if it
+            // and its siblings are out of view. Score it so the tiles
+            // using the most memory the longest ago, the farthest away,
+            // go first.
+            if (removable &&
+                bytesToFree > 0u &&
+                se->_gpuBytes > 0u &&
+                se->_tile->areSiblingsOutOfView(fs))
+            {
+                Candidate c;
+                c._score =
+                    (double)se->_gpuBytes *
+                    (1.0 + osg::maximum(now - se->_lastTime, 0.0)) *
+                    (1.0 + osg::maximum((double)se->_lastVisitRange, 0.0));
+                c._entry = se;
+                candidates.push_back(c);
+            }
+
             // reset the range in preparation for the next frame.
             se->_lastRange = FLT_MAX;
         }
     }
 
+    if (bytesFreed < bytesToFree && !candidates.empty())
+    {
+        std::sort(candidates.begin(), candidates.end());
+
+        for (std::vector<Candidate>::iterator c = candidates.begin();
+            c != candidates.end() && bytesFreed < bytesToFree && count < maxTiles;
+            ++c)
+        {
+            bytesFreed += c->_entry->_gpuBytes;
+            remove(c->_entry, output);
+            ++count;
+        }
+    }
+
     // reset the sentry.
-    _tracker.erase(_sentryptr);
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr =_tracker.begin();
+    moveToFront(&_sentry);
 
     _mutex.unlock();
 
@@ -0,0 +1,115 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2008-2014 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "TrajectoryPredictor"
+
+using namespace osgEarth::REX;
+using namespace osgEarth;
+
+#define LC "[TrajectoryPredictor] "
+
+namespace
+{
+    // Weight of the newest frame in the smoothed velocity
+    const double VELOCITY_SMOOTHING = 0.25;
+
+    // A pause longer than this (seconds) between frames starts the
+    // velocity estimate over.
+    const double MAX_FRAME_GAP = 1.0;
+
+    // Cameras not seen in this many frames are forgotten.
+    const unsigned MAX_IDLE_FRAMES = 60u;
+}
+
+TrajectoryPredictor::TrajectoryPredictor()
+{
+    //nop
+}
+
+TrajectoryPredictor::Track&
+TrajectoryPredictor::getTrack(const osg::Camera* camera)
+{
+    for (Tracks::iterator i = _tracks.begin(); i != _tracks.end(); ++i)
+    {
+        if (i->_camera.get() == camera)
+            return *i;
+    }
+
+    Track track;
+    track._camera = camera;
+    track._time = 0.0;
+    track._frame = ~0u;
+    track._moving = false;
+    _tracks.push_back(track);
+    return _tracks.back();
+}
+
+bool
+TrajectoryPredictor::predict(osgUtil::CullVisitor* cv, double seconds, osg::Vec3d& out_eye)
+{
+    const osg::FrameStamp* fs = cv->getFrameStamp();
+    if (!fs || seconds <= 0.0)
+        return false;
+
+    const unsigned frame = fs->getFrameNumber();
+    const double time = fs->getReferenceTime();
+    const osg::Vec3d eye = cv->getEyeLocal();
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // forget cameras that went away or stopped rendering:
+    for (Tracks::iterator i = _tracks.begin(); i != _tracks.end(); )
+    {
+        if (!i->_camera.valid() || (i->_frame != ~0u && frame - i->_frame > MAX_IDLE_FRAMES))
+            i = _tracks.erase(i);
+        else
+            ++i;
+    }
+
+    Track& track = getTrack(cv->getCurrentCamera());
+
+    // only sample once per frame, even if the camera culls more than once.
+    if (track._frame != frame)
+    {
+        double dt = time - track._time;
+
+        if (track._frame == ~0u || dt <= 0.0 || dt > MAX_FRAME_GAP)
+        {
+            track._velocity.set(0.0, 0.0, 0.0);
+            track._moving = false;
+        }
+        else
+        {
+            osg::Vec3d velocity = (eye - track._eye) / dt;
+            track._velocity = track._moving ?
+                track._velocity*(1.0-VELOCITY_SMOOTHING) + velocity*VELOCITY_SMOOTHING :
+                velocity;
+            track._moving = true;
+        }
+
+        track._eye = eye;
+        track._time = time;
+        track._frame = frame;
+    }
+
+    if (!track._moving || track._velocity.length2() == 0.0)
+        return false;
+
+    out_eye = eye + track._velocity * seconds;
+    return true;
+}
@@ -35,6 +35,7 @@ _cacheSize(0u),
 _maxAge(0.1),
 _minRange(0.0f),
 _maxTilesToUnloadPerFrame(~0),
+_memoryBudget(0u),
 _frameLastUpdated(0u)
 {
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
@@ -69,13 +70,24 @@ UnloaderGroup::traverse(osg::NodeVisitor& nv)
             double oldestAllowableTime = now - _maxAge;
             unsigned oldestAllowableFrame = osg::maximum(nv.getFrameStamp()->getFrameNumber(), 3u) - 3u;
 
+            // Over the memory budget, free up the difference:
+            size_t bytesToFree = 0u;
+            if (_memoryBudget > 0u)
+            {
+                size_t bytes = _tiles->getTotalGPUBytes();
+                if (bytes > _memoryBudget)
+                    bytesToFree = bytes - _memoryBudget;
+            }
+
             // Remove them from the registry:
             _tiles->collectDormantTiles(
                 nv, 
                 oldestAllowableTime,
                 oldestAllowableFrame,
                 _minRange,
-                _maxTilesToUnloadPerFrame, _deadpool);
+                _maxTilesToUnloadPerFrame,
+                bytesToFree,
+                _deadpool);
 
             // Remove them from the scene graph:
             for(std::vector<osg::observer_ptr<TileNode> >::iterator i = _deadpool.begin();
@@ -74,28 +74,80 @@ public:
             break;
         }
 
-        //Copy over the source data to an array
-        unsigned char *in = 0;
-        in = (unsigned char*)memalign(16, sourceImage->getTotalSizeInBytes());
-        memcpy(in, sourceImage->data(0,0), sourceImage->getTotalSizeInBytes());
+        //Build the RGBA mipmaps first, then compress each level
+        if (generateMipMap && !sourceImage->isMipmap())
+        {
+            if (!rgba.valid())
+            {
+                rgba = new osg::Image(image, osg::CopyOp::DEEP_COPY_ALL);
+                sourceImage = rgba.get();
+            }
+            ImageUtils::generateMipmaps(sourceImage);
+        }
 
+        unsigned numLevels = sourceImage->getNumMipmapLevels();
+        unsigned blockBytes = format == FORMAT_DXT1 ? 8u : 16u;
 
+        //A level smaller than one block still takes up a whole block
+        unsigned totalBytes = 0u;
+        for (unsigned level = 0; level < numLevels; ++level)
+        {
+            unsigned s = osg::maximum(sourceImage->s() >> level, 1);
+            unsigned t = osg::maximum(sourceImage->t() >> level, 1);
+            totalBytes += ((s+3u)/4u) * ((t+3u)/4u) * blockBytes;
+        }
 
-        //Allocate memory for the output
-        unsigned char* out = (unsigned char*)memalign(16, image.s()*image.t()*4);
-        memset(out, 0, image.s()*image.t()*4);
+        unsigned char* data = (unsigned char*)malloc(totalBytes);
+        osg::Image::MipmapDataType mipOffsets;
+
+        //Working buffers, big enough for level 0 (or one block)
+        unsigned maxS = osg::maximum(sourceImage->s(), 4);
+        unsigned maxT = osg::maximum(sourceImage->t(), 4);
+        unsigned char* in = (unsigned char*)memalign(16, maxS*maxT*4);
+        unsigned char* out = (unsigned char*)memalign(16, maxS*maxT*4);
 
         osg::Timer_t start = osg::Timer::instance()->tick();
-        int outputBytes = CompressDXT(in, out, sourceImage->s(), sourceImage->t(), format);
+
+        unsigned offset = 0u;
+        for (unsigned level = 0; level < numLevels; ++level)
+        {
+            unsigned s = osg::maximum(sourceImage->s() >> level, 1);
+            unsigned t = osg::maximum(sourceImage->t() >> level, 1);
+
+            //FastDXT works on whole 4x4 blocks, so pad the small levels
+            //by repeating their edge pixels
+            unsigned paddedS = osg::maximum(s, 4u);
+            unsigned paddedT = osg::maximum(t, 4u);
+            const unsigned char* levelData = sourceImage->getMipmapData(level);
+            for (unsigned y = 0; y < paddedT; ++y)
+            {
+                for (unsigned x = 0; x < paddedS; ++x)
+                {
+                    memcpy(
+                        in + (y*paddedS + x)*4,
+                        levelData + (osg::minimum(y, t-1)*s + osg::minimum(x, s-1))*4,
+                        4);
+                }
+            }
+
+            int outputBytes = CompressDXT(in, out, paddedS, paddedT, format);
+
+            if (level > 0)
+                mipOffsets.push_back(offset);
+            memcpy(data + offset, out, outputBytes);
+            offset += outputBytes;
+        }
+
         osg::Timer_t end = osg::Timer::instance()->tick();
         OE_DEBUG << "compression took" << osg::Timer::instance()->delta_m(start, end) << std::endl;
 
-        //Allocate and copy over the output data to the correct size array.
-        unsigned char* data = (unsigned char*)malloc(outputBytes);
-        memcpy(data, out, outputBytes);
         memfree(out);
         memfree(in);
-        image.setImage(image.s(), image.t(), image.r(), pixelFormat, pixelFormat, GL_UNSIGNED_BYTE, data, osg::Image::USE_MALLOC_FREE);
+        image.setImage(sourceImage->s(), sourceImage->t(), sourceImage->r(), pixelFormat, pixelFormat, GL_UNSIGNED_BYTE, data, osg::Image::USE_MALLOC_FREE);
+        if (!mipOffsets.empty())
+        {
+            image.setMipmapLevels(mipOffsets);
+        }
     }
 
     virtual void generateMipMap(osg::Image& image, bool resizeToPowerOfTwo, CompressionMethod method)
@@ -109,10 +109,17 @@ public: // FeatureFilter
             }
             else
             {
-                // Transform the boundaries into the coordinate system of the features
+                // Transform the boundaries into the coordinate system of the features,
+                // and prepare each one once for all the point tests in this tile
+                std::vector< osg::ref_ptr<PreparedGeometry> > prepared;
+                prepared.reserve(boundaries.size());
                 for (FeatureList::iterator itr = boundaries.begin(); itr != boundaries.end(); ++itr)
                 {
                     itr->get()->transform( context.profile()->getSRS() );
+                    if (itr->get()->getGeometry())
+                    {
+                        prepared.push_back( new PreparedGeometry(itr->get()->getGeometry()) );
+                    }
                 }
 
                 for(FeatureList::const_iterator f = input.begin(); f != input.end(); ++f)
@@ -127,10 +134,9 @@ public: // FeatureFilter
                             // coarsest:
                             if (_featureSource->getFeatureProfile()->getExtent().contains(GeoPoint(feature->getSRS(), c.x(), c.y())))
                             {
-                                for (FeatureList::iterator itr = boundaries.begin(); itr != boundaries.end(); ++itr)
+                                for (unsigned b = 0; b < prepared.size(); ++b)
                                 {
-                                    Ring* ring = dynamic_cast< Ring*>(itr->get()->getGeometry());
-                                    if (ring && ring->contains2D(c.x(), c.y()))
+                                    if (prepared[b]->contains2D(c.x(), c.y()))
                                     {
                                         output.push_back( feature );
                                     }
@@ -145,10 +151,9 @@ public: // FeatureFilter
                             // coarsest:
                             if (_featureSource->getFeatureProfile()->getExtent().contains(GeoPoint(feature->getSRS(), c.x(), c.y())))
                             {
-                                for (FeatureList::iterator itr = boundaries.begin(); itr != boundaries.end(); ++itr)
+                                for (unsigned b = 0; b < prepared.size(); ++b)
                                 {
-                                    Ring* ring = dynamic_cast< Ring*>(itr->get()->getGeometry());
-                                    if (ring && ring->contains2D(c.x(), c.y()))
+                                    if (prepared[b]->contains2D(c.x(), c.y()))
                                     {                             
                                         contained = true;
                                         break;
@@ -170,10 +170,20 @@ public:
         if (!fout.is_open())
             return osgDB::ReaderWriter::WriteResult::ERROR_IN_WRITING_FILE;
 
+        // Batch information is optional; a producer (like a 3D Tiles exporter)
+        // can attach it to the root node as user values.
+        unsigned batchLength = 1u;
+        node.getUserValue("b3dm.batchLength", batchLength);
+
+        std::string batchTableJSON;
+        node.getUserValue("b3dm.batchTable", batchTableJSON);
+        int batchTablePadding = 4 - (batchTableJSON.length() % 4);
+        if (batchTablePadding == 4) batchTablePadding = 0;
+
         std::string featureTableJSON;
         {
             Json::Value value(Json::objectValue);
-            value["BATCH_LENGTH"] = 1;
+            value["BATCH_LENGTH"] = batchLength;
             // no RTC_CENTER
             Json::FastWriter writer;
             featureTableJSON = writer.write(value);
@@ -183,7 +193,7 @@ public:
 
         // no binary feature table
 
-        // no batch table, json or binary
+        // no binary batch table
 
         // convert OSG to GLTF and write to a buffer:
         GLTFWriter gltfWriter;
@@ -203,7 +213,7 @@ public:
         header.version = 1;
         header.featureTableJSONByteLength = featureTableJSON.length() + featureTablePadding;
         header.featureTableBinaryByteLength = 0;
-        header.batchTableJSONByteLength = 0;
+        header.batchTableJSONByteLength = batchTableJSON.length() + batchTablePadding;
         header.batchTableBinaryByteLength = 0;
         header.byteLength =
             sizeof(b3dmheader) +
@@ -239,7 +249,13 @@ public:
         output->write(featureTableJSON.c_str(), featureTableJSON.length());
         output->write("   ", featureTablePadding);
 
-        // If we want to write the other 3 tables, they go here
+        // If we want to write the binary tables, they go here
+
+        if (!batchTableJSON.empty())
+        {
+            output->write(batchTableJSON.c_str(), batchTableJSON.length());
+            output->write("   ", batchTablePadding);
+        }
 
         // GLTF binary data
         output->write(gltfData.c_str(), gltfData.length());
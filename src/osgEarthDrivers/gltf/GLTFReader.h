@@ -35,6 +35,11 @@
 #include <osgEarth/Containers>
 #include <osgEarth/Registry>
 #include <osgEarth/ShaderUtils>
+#include <sstream>
+
+#ifdef OSGEARTH_HAVE_MESHOPT
+#include <meshoptimizer.h>
+#endif
 
 
 #undef LC
@@ -55,6 +60,29 @@ public:
         return tinygltf::ExpandFilePath(path, userData);
     }
 
+    //! True if the data is a KTX2 file (KHR_texture_basisu)
+    static bool isKTX2(const unsigned char* bytes, int size)
+    {
+        static const unsigned char magic[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        return size >= 12 && memcmp(bytes, magic, 12) == 0;
+    }
+
+    //! Image loader that keeps KTX2 images encoded, so they can be transcoded
+    //! later by the basis plugin; everything else goes to the default loader.
+    static bool LoadImageData(tinygltf::Image* image, const int image_idx, std::string* err, std::string* warn,
+                              int req_width, int req_height, const unsigned char* bytes, int size, void* user_data)
+    {
+        if (isKTX2(bytes, size))
+        {
+            image->image.assign(bytes, bytes + size);
+            image->width = 0;
+            image->height = 0;
+            image->mimeType = "image/ktx2";
+            return true;
+        }
+        return tinygltf::LoadImageData(image, image_idx, err, warn, req_width, req_height, bytes, size, user_data);
+    }
+
     struct Env
     {
         Env(const std::string& loc, const osgDB::Options* opt) : referrer(loc), readOptions(opt) { }
@@ -90,6 +118,7 @@ public:
         fs.WriteWholeFile = &tinygltf::WriteWholeFile;
         fs.user_data = (void*)&location;
         loader.SetFsCallbacks(fs);
+        loader.SetImageLoader(&GLTFReader::LoadImageData, NULL);
 
         tinygltf::Options opt;
         opt.skip_imagery = readOptions && readOptions->getOptionString().find("gltfSkipImagery") != std::string::npos;
@@ -131,10 +160,119 @@ public:
             return osgDB::ReaderWriter::ReadResult::ERROR_IN_READING_FILE;
         }
 
+        for (unsigned i = 0; i < model.extensionsRequired.size(); ++i)
+        {
+            const std::string& ext = model.extensionsRequired[i];
+#ifndef OSGEARTH_HAVE_DRACO
+            if (ext == "KHR_draco_mesh_compression")
+            {
+                OE_WARN << LC << location << " requires " << ext << "; build osgEarth with draco to load it" << std::endl;
+                return osgDB::ReaderWriter::ReadResult::ERROR_IN_READING_FILE;
+            }
+#endif
+#ifndef OSGEARTH_HAVE_MESHOPT
+            if (ext == "EXT_meshopt_compression")
+            {
+                OE_WARN << LC << location << " requires " << ext << "; build osgEarth with meshoptimizer to load it" << std::endl;
+                return osgDB::ReaderWriter::ReadResult::ERROR_IN_READING_FILE;
+            }
+#endif
+        }
+
+#ifdef OSGEARTH_HAVE_MESHOPT
+        if (!decodeMeshopt(model))
+        {
+            OE_WARN << LC << "Failed to decode EXT_meshopt_compression data in " << location << std::endl;
+            return osgDB::ReaderWriter::ReadResult::ERROR_IN_READING_FILE;
+        }
+#endif
+
         Env env(location, readOptions);
         return makeNodeFromModel(model, env);
     }
 
+#ifdef OSGEARTH_HAVE_MESHOPT
+    //! Decodes every buffer view compressed with EXT_meshopt_compression
+    //! into a new buffer, and points the view at it.
+    bool decodeMeshopt(tinygltf::Model& model) const
+    {
+        for (unsigned i = 0; i < model.bufferViews.size(); ++i)
+        {
+            tinygltf::BufferView& view = model.bufferViews[i];
+            tinygltf::ExtensionMap::const_iterator ext = view.extensions.find("EXT_meshopt_compression");
+            if (ext == view.extensions.end())
+                continue;
+
+            const tinygltf::Value& v = ext->second;
+            if (!v.Get("buffer").IsInt() || !v.Get("byteLength").IsNumber() ||
+                !v.Get("byteStride").IsNumber() || !v.Get("count").IsNumber())
+                return false;
+
+            int buffer = v.Get("buffer").Get<int>();
+            size_t byteOffset = v.Has("byteOffset") ? (size_t)v.Get("byteOffset").GetNumberAsInt() : 0u;
+            size_t byteLength = (size_t)v.Get("byteLength").GetNumberAsInt();
+            size_t byteStride = (size_t)v.Get("byteStride").GetNumberAsInt();
+            size_t count = (size_t)v.Get("count").GetNumberAsInt();
+            std::string mode = v.Get("mode").IsString() ? v.Get("mode").Get<std::string>() : "ATTRIBUTES";
+            std::string filter = v.Get("filter").IsString() ? v.Get("filter").Get<std::string>() : "NONE";
+
+            if (buffer < 0 || buffer >= (int)model.buffers.size() ||
+                byteOffset + byteLength > model.buffers[buffer].data.size())
+                return false;
+
+            const unsigned char* source = &model.buffers[buffer].data[byteOffset];
+
+            tinygltf::Buffer decoded;
+            decoded.data.resize(count * byteStride);
+
+            int rc = -1;
+            if (mode == "ATTRIBUTES")
+                rc = meshopt_decodeVertexBuffer(&decoded.data[0], count, byteStride, source, byteLength);
+            else if (mode == "TRIANGLES")
+                rc = meshopt_decodeIndexBuffer(&decoded.data[0], count, byteStride, source, byteLength);
+            else if (mode == "INDICES")
+                rc = meshopt_decodeIndexSequence(&decoded.data[0], count, byteStride, source, byteLength);
+
+            if (rc != 0)
+                return false;
+
+            if (filter == "OCTAHEDRAL")
+                meshopt_decodeFilterOct(&decoded.data[0], count, byteStride);
+            else if (filter == "QUATERNION")
+                meshopt_decodeFilterQuat(&decoded.data[0], count, byteStride);
+            else if (filter == "EXPONENTIAL")
+                meshopt_decodeFilterExp(&decoded.data[0], count, byteStride);
+
+            model.buffers.push_back(decoded);
+            view.buffer = (int)model.buffers.size() - 1;
+            view.byteOffset = 0;
+            view.byteLength = decoded.data.size();
+        }
+        return true;
+    }
+#endif
+
+    //! Transcodes an embedded KTX2 image with the basis plugin.
+    osg::Image* readKTX2(const std::vector<unsigned char>& data, const osgDB::Options* readOptions) const
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension("ktx2");
+        if (!rw)
+        {
+            OE_WARN << LC << "No KTX2 reader available; build osgEarth with Basis Universal" << std::endl;
+            return NULL;
+        }
+
+        std::istringstream in(std::string((const char*)&data[0], data.size()));
+        osgDB::ReaderWriter::ReadResult rr = rw->readImage(in, readOptions);
+        if (!rr.validImage())
+            return NULL;
+
+        // like the other embedded images, keep the glTF row order
+        osg::Image* image = rr.takeImage();
+        image->flipVertical();
+        return image;
+    }
+
     osg::Node* makeNodeFromModel(const tinygltf::Model &model, const Env& env) const
     {
         // Rotate y-up to z-up
@@ -284,7 +422,21 @@ public:
                             int index = i->second;
 
                             const tinygltf::Texture& texture = model.textures[index];
-                            const tinygltf::Image& image = model.images[texture.source];
+
+                            // KHR_texture_basisu points at a KTX2 image
+                            int source = texture.source;
+                            tinygltf::ExtensionMap::const_iterator basisu = texture.extensions.find("KHR_texture_basisu");
+                            if (basisu != texture.extensions.end() && basisu->second.Get("source").IsInt())
+                            {
+                                source = basisu->second.Get("source").Get<int>();
+                            }
+
+                            if (source < 0 || source >= (int)model.images.size())
+                            {
+                                continue;
+                            }
+
+                            const tinygltf::Image& image = model.images[source];
 
                             // don't cache embedded textures!
                             bool imageEmbedded = 
@@ -308,10 +460,14 @@ public:
                                 OE_DEBUG << "New Texture: " << imageURI.full() << ", embedded=" << imageEmbedded << std::endl;
 
                                 // First load the image
-                                const tinygltf::Image& image = model.images[texture.source];
                                 osg::ref_ptr<osg::Image> img;
 
-                                if (image.image.size() > 0)
+                                if (image.image.size() > 0 && image.mimeType == "image/ktx2" && image.width == 0)
+                                {
+                                    img = readKTX2(image.image, env.readOptions);
+                                }
+
+                                else if (image.image.size() > 0)
                                 {
                                     GLenum format = GL_RGB, texFormat = GL_RGB8;
                                     if (image.component == 4) format = GL_RGBA, texFormat = GL_RGBA8;
@@ -531,114 +687,85 @@ public:
         }
 
         return group;
-    } // Turn all of the accessors and turn them into arrays
+    }
+
+    // Reads one component of an accessor element as a float, applying the
+    // glTF normalization rules to integer types (KHR_mesh_quantization and
+    // compressed meshes often store attributes that way).
+    static float readComponent(const unsigned char* ptr, int componentType, bool normalized)
+    {
+        switch (componentType)
+        {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return *(const float*)ptr;
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            return normalized ? osg::maximum((float)*(const signed char*)ptr / 127.0f, -1.0f) : (float)*(const signed char*)ptr;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return normalized ? (float)*ptr / 255.0f : (float)*ptr;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            return normalized ? osg::maximum((float)*(const short*)ptr / 32767.0f, -1.0f) : (float)*(const short*)ptr;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return normalized ? (float)*(const unsigned short*)ptr / 65535.0f : (float)*(const unsigned short*)ptr;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            return (float)*(const unsigned int*)ptr;
+        default:
+            return 0.0f;
+        }
+    }
+
+    // Turn all of the accessors and turn them into arrays
     void extractArrays(const tinygltf::Model &model, std::vector<osg::ref_ptr<osg::Array>> &arrays) const
     {
         for (unsigned int i = 0; i < model.accessors.size(); i++)
         {
             const tinygltf::Accessor& accessor = model.accessors[i];
-            const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-            const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-
 
             osg::ref_ptr< osg::Array > osgArray;
 
-            if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT)
+            int numComponents =
+                accessor.type == TINYGLTF_TYPE_SCALAR ? 1 :
+                accessor.type == TINYGLTF_TYPE_VEC2 ? 2 :
+                accessor.type == TINYGLTF_TYPE_VEC3 ? 3 :
+                accessor.type == TINYGLTF_TYPE_VEC4 ? 4 : 0;
+
+            int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+
+            if (numComponents > 0 && componentSize > 0 && accessor.count > 0 &&
+                accessor.bufferView >= 0 && accessor.bufferView < (int)model.bufferViews.size())
             {
-                if (accessor.type == TINYGLTF_TYPE_SCALAR)
-                {
-                    osg::FloatArray* floatArray = new osg::FloatArray;
-                    const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-                    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-
-                    float* array = (float*)(&buffer.data.at(0) + accessor.byteOffset + bufferView.byteOffset);
-                    unsigned int pos = 0;
-                    floatArray->reserve(accessor.count);
-                    for (unsigned int j = 0; j < accessor.count; j++)
-                    {
-                        float s = array[pos];
-                        if (bufferView.byteStride > 0)
-                        {
-                            pos += (bufferView.byteStride / 4);
-                        }
-                        else
-                        {
-                            pos += 1;
-                        }
-                        floatArray->push_back(s);
-                    }
-                    osgArray = floatArray;
-                }
-                else if (accessor.type == TINYGLTF_TYPE_VEC2)
-                {
-                    osg::Vec2Array* vec2Array = new osg::Vec2Array;
-                    const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-                    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-
-                    float* array = (float*)(&buffer.data.at(0) + accessor.byteOffset + bufferView.byteOffset);
-                    unsigned int pos = 0;
-                    vec2Array->reserve(accessor.count);
-                    for (unsigned int j = 0; j < accessor.count; j++)
-                    {
-                        float s = array[pos];
-                        float t = array[pos + 1];
-                        if (bufferView.byteStride > 0)
-                        {
-                            pos += (bufferView.byteStride / 4);
-                        }
-                        else
-                        {
-                            pos += 2;
-                        }
-                        vec2Array->push_back(osg::Vec2(s, t));
-                    }
-                    osgArray = vec2Array;
-                }
-                else if (accessor.type == TINYGLTF_TYPE_VEC3)
-                {
-                    osg::Vec3Array* vec3Array = new osg::Vec3Array;
-                    float* array = (float*)(&buffer.data.at(0) + accessor.byteOffset + bufferView.byteOffset);
-                    unsigned int pos = 0;
-                    vec3Array->reserve(accessor.count);
-                    for (unsigned int j = 0; j < accessor.count; j++)
-                    {
-                        float x = array[pos];
-                        float y = array[pos + 1];
-                        float z = array[pos + 2];
-                        if (bufferView.byteStride > 0)
-                        {
-                            pos += (bufferView.byteStride / 4);
-                        }
-                        else
-                        {
-                            pos += 3;
-                        }
-                        vec3Array->push_back(osg::Vec3(x, y, z));
-                        osgArray = vec3Array;
-                    }
-                }
-                else if (accessor.type == TINYGLTF_TYPE_VEC4)
+                const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+                const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+
+                size_t elementSize = numComponents * componentSize;
+                size_t stride = bufferView.byteStride > 0 ? bufferView.byteStride : elementSize;
+                size_t start = bufferView.byteOffset + accessor.byteOffset;
+
+                if (start + (accessor.count - 1) * stride + elementSize <= buffer.data.size())
                 {
-                    osg::Vec4Array* vec4Array = new osg::Vec4Array;
-                    float* array = (float*)(&buffer.data.at(0) + accessor.byteOffset + bufferView.byteOffset);
-                    unsigned int pos = 0;
-                    vec4Array->reserve(accessor.count);
-                    for (unsigned int j = 0; j < accessor.count; j++)
+                    const unsigned char* ptr = &buffer.data[start];
+                    float v[4];
+
+                    osg::FloatArray* floatArray = numComponents == 1 ? new osg::FloatArray() : 0L;
+                    osg::Vec2Array* vec2Array = numComponents == 2 ? new osg::Vec2Array() : 0L;
+                    osg::Vec3Array* vec3Array = numComponents == 3 ? new osg::Vec3Array() : 0L;
+                    osg::Vec4Array* vec4Array = numComponents == 4 ? new osg::Vec4Array() : 0L;
+
+                    if (floatArray) { floatArray->reserve(accessor.count); osgArray = floatArray; }
+                    if (vec2Array) { vec2Array->reserve(accessor.count); osgArray = vec2Array; }
+                    if (vec3Array) { vec3Array->reserve(accessor.count); osgArray = vec3Array; }
+                    if (vec4Array) { vec4Array->reserve(accessor.count); osgArray = vec4Array; }
+
+                    for (unsigned int j = 0; j < accessor.count; j++, ptr += stride)
                     {
-                        float r = array[pos];
-                        float g = array[pos + 1];
-                        float b = array[pos + 2];
-                        float a = array[pos + 3];
-                        if (bufferView.byteStride > 0)
+                        for (int c = 0; c < numComponents; ++c)
                         {
-                            pos += (bufferView.byteStride / 4);
+                            v[c] = readComponent(ptr + c * componentSize, accessor.componentType, accessor.normalized);
                         }
-                        else
-                        {
-                            pos += 4;
-                        }
-                        vec4Array->push_back(osg::Vec4(r, g, b, a));
-                        osgArray = vec4Array;
+
+                        if (floatArray) floatArray->push_back(v[0]);
+                        else if (vec2Array) vec2Array->push_back(osg::Vec2(v[0], v[1]));
+                        else if (vec3Array) vec3Array->push_back(osg::Vec3(v[0], v[1], v[2]));
+                        else vec4Array->push_back(osg::Vec4(v[0], v[1], v[2], v[3]));
                     }
                 }
             }
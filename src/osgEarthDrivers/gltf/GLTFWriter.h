@@ -235,7 +235,11 @@ public:
     {
         ArraySequenceMap::iterator a = _accessors.find(data);
         if (a != _accessors.end())
+        {
+            // shared array (e.g. an instanced model): reuse the accessor
+            prim.attributes[attr] = a->second;
             return a->second;
+        }
 
         ArraySequenceMap::iterator bv = _bufferViews.find(data);
         if (bv == _bufferViews.end())
@@ -494,6 +498,20 @@ public:
                 getOrCreateBufferView(texCoords.get(), GL_FLOAT, GL_ARRAY_BUFFER_ARB);
             }
 
+            // 3D Tiles batch IDs, if the geometry carries them
+            osg::FloatArray* batchIds = 0L;
+            for (unsigned i = 0; i < geom->getNumVertexAttribArrays() && !batchIds; ++i)
+            {
+                osg::Array* attrib = geom->getVertexAttribArray(i);
+                if (attrib && attrib->getName() == "_BATCHID")
+                    batchIds = dynamic_cast<osg::FloatArray*>(attrib);
+            }
+
+            if (batchIds)
+            {
+                getOrCreateBufferView(batchIds, GL_FLOAT, GL_ARRAY_BUFFER_ARB);
+            }
+
             for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
             {
                 osg::PrimitiveSet* pset = geom->getPrimitiveSet(i);
@@ -520,17 +538,23 @@ public:
 
                 // record min/max for position array (required):
                 tinygltf::Accessor& posacc = _model.accessors[a];
-                posacc.minValues.push_back(posMin.x());
-                posacc.minValues.push_back(posMin.y());
-                posacc.minValues.push_back(posMin.z());
-                posacc.maxValues.push_back(posMax.x());
-                posacc.maxValues.push_back(posMax.y());
-                posacc.maxValues.push_back(posMax.z());                
+                if (posacc.minValues.empty())
+                {
+                    posacc.minValues.push_back(posMin.x());
+                    posacc.minValues.push_back(posMin.y());
+                    posacc.minValues.push_back(posMin.z());
+                    posacc.maxValues.push_back(posMax.x());
+                    posacc.maxValues.push_back(posMax.y());
+                    posacc.maxValues.push_back(posMax.z());
+                }
 
                 getOrCreateAccessor(normals, pset, primitive, "NORMAL");
 
                 getOrCreateAccessor(colors, pset, primitive, "COLOR_0");
                 getOrCreateAccessor(texCoords.get(), pset, primitive, "TEXCOORD_0");
+
+                if (batchIds)
+                    getOrCreateAccessor(batchIds, pset, primitive, "_BATCHID");
             }
 
             if (pushedStateSet)
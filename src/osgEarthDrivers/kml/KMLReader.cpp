@@ -24,6 +24,7 @@
 #include <osgEarth/XmlUtils>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/ScreenSpaceLayout>
+#include <osgEarth/JobArena>
 #include <stack>
 #include <iterator>
 
@@ -40,6 +41,100 @@ _options( options )
     //nop
 }
 
+namespace
+{
+    // Holds a KML scene graph built on a worker thread until the next
+    // update traversal adds it to the placeholder group.
+    class AttachKMLCallback : public osg::NodeCallback
+    {
+    public:
+        AttachKMLCallback() : _ready(false) { }
+
+        void setResult(osg::Node* node)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _result = node;
+            _ready = true;
+        }
+
+        void operator()(osg::Node* node, osg::NodeVisitor* nv)
+        {
+            // keep this callback alive while it removes itself
+            osg::ref_ptr<osg::NodeCallback> self = this;
+
+            osg::ref_ptr<osg::Node> result;
+            bool ready;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                result = _result.release();
+                ready = _ready;
+            }
+
+            if (ready)
+            {
+                if (result.valid() && node->asGroup())
+                {
+                    node->asGroup()->addChild(result.get());
+                }
+                node->setUpdateCallback(0L);
+            }
+
+            traverse(node, nv);
+        }
+
+    private:
+        Threading::Mutex _mutex;
+        osg::ref_ptr<osg::Node> _result;
+        bool _ready;
+    };
+
+    // Parses and builds a KML document on a worker thread.
+    class BuildKMLTask : public TaskRequest
+    {
+    public:
+        BuildKMLTask(std::string& xml, MapNode* mapNode, const KMLOptions& options,
+                     const osgDB::Options* dbOptions, AttachKMLCallback* attach) :
+            _mapNode(mapNode), _options(options), _dbOptions(dbOptions), _attach(attach)
+        {
+            _xml.swap(xml);
+        }
+
+        void operator()(ProgressCallback*)
+        {
+            osg::ref_ptr<osg::Node> node;
+
+            osg::ref_ptr<MapNode> mapNode;
+            if (_mapNode.lock(mapNode))
+            {
+                osg::Timer_t start = osg::Timer::instance()->tick();
+                try
+                {
+                    xml_document<> doc;
+                    doc.parse<0>(&_xml[0]);
+
+                    KMLReader reader(mapNode.get(), &_options);
+                    node = reader.read(doc, _dbOptions.get());
+                }
+                catch (const rapidxml::parse_error& e)
+                {
+                    OE_WARN << LC << "Failed to parse KML: " << e.what() << std::endl;
+                }
+                osg::Timer_t end = osg::Timer::instance()->tick();
+                OE_INFO << LC << "Loaded KML in the background in " << osg::Timer::instance()->delta_s(start, end) << std::endl;
+            }
+
+            _attach->setResult(node.get());
+        }
+
+    private:
+        std::string _xml;
+        osg::observer_ptr<MapNode> _mapNode;
+        KMLOptions _options;
+        osg::ref_ptr<const osgDB::Options> _dbOptions;
+        osg::ref_ptr<AttachKMLCallback> _attach;
+    };
+}
+
 osg::Node*
 KMLReader::read( std::istream& in, const osgDB::Options* dbOptions )
 {
@@ -49,10 +144,24 @@ KMLReader::read( std::istream& in, const osgDB::Options* dbOptions )
 
 	// Load the XML
     osg::Timer_t start = osg::Timer::instance()->tick();
-	std::stringstream buffer;
-    buffer << in.rdbuf();
-    std::string xmlStr;
-    xmlStr = buffer.str();
+    std::string xmlStr(
+        (std::istreambuf_iterator<char>(in)),
+        std::istreambuf_iterator<char>());
+
+    if (_options && _options->background() == true && !_options->iconAndLabelGroup().valid())
+    {
+        osg::Group* placeholder = new osg::Group();
+        placeholder->setName( context.referrer() );
+
+        AttachKMLCallback* attach = new AttachKMLCallback();
+        placeholder->setUpdateCallback(attach);
+
+        JobArena::get("oe.kml")->dispatch(
+            new BuildKMLTask(xmlStr, _mapNode, *_options, dbOptions, attach));
+
+        return placeholder;
+    }
+
 	xml_document<> doc;
 	doc.parse<0>(&xmlStr[0]);
 
@@ -86,12 +195,12 @@ KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
     cx._groupStack.push( root );
 
 
-    // clone the dbOptions, and install a resource cache if there isn't one already:
-    URIResultCache defaultUriCache;
+    // clone the dbOptions, and install a resource cache if there isn't one already.
+    // The shared cache keeps icons and models around for the next KML document too.
     if ( !URIResultCache::from(dbOptions) )
     {
         osgDB::Options* newOptions = Registry::instance()->cloneOrCreateOptions();
-        defaultUriCache.apply( newOptions );
+        URIResultCache::shared()->apply( newOptions );
         cx._dbOptions = newOptions;
     }
     else
@@ -133,11 +242,15 @@ KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
     }
 
     URIResultCache* cacheUsed = URIResultCache::from(cx._dbOptions.get());
-    CacheStats stats = cacheUsed->getStats();
-    OE_INFO << LC << "  URI Cache: " << stats._queries << " reads, " << (stats._hitRatio*100.0) << "% hits" << std::endl;
+    URIResultCache::Stats stats = cacheUsed->getStats();
+    OE_INFO << LC << "  URI Cache: " << (stats._hits + stats._misses) << " reads, " << (stats.getHitRatio()*100.0) << "% hits, "
+        << stats._entries << " entries, " << (double)stats._bytes / 1048576.0 << " MB" << std::endl;
 
     // Make sure the KML gets rendered after the terrain.
     root->getOrCreateStateSet()->setRenderBinDetails(2, "RenderBin");
 
+    // release the build-time reference; the caller takes ownership
+    root->unref_nodelete();
+
     return root;
 }
@@ -58,6 +58,14 @@ MonitorExtension::MonitorExtension()
 MonitorExtension::MonitorExtension(const ConfigOptions& options)
 {
     ctor();
+
+    // e.g. <monitor spike_threshold_ms="50" spike_file="spikes.log"/>
+    const Config& conf = options.getConfig();
+    double threshold = 0.0;
+    if (conf.get("spike_threshold_ms", threshold))
+        _ui->setSpikeThreshold(threshold);
+    if (conf.hasValue("spike_file"))
+        _ui->setSpikeFile(conf.value("spike_file"));
 }
 
 MonitorExtension::~MonitorExtension()
@@ -81,6 +89,9 @@ MonitorExtension::connect(MapNode* mapNode)
     {
         _mapNode = mapNode;
         _mapNode->addEventCallback(new EventFrame(this));
+
+        if (_ui.valid())
+            _ui->setMap(mapNode->getMap());
     }
     
     return true;
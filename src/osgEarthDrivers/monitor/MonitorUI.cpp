@@ -19,6 +19,10 @@
 #include "MonitorUI"
 #include <osgEarth/Memory>
 #include <osgEarth/Registry>
+#include <osgEarth/TileLayer>
+#include <osgEarth/FeatureSource>
+#include <iomanip>
+#include <fstream>
 
 using namespace osgEarth::Monitor;
 using namespace osgEarth;
@@ -52,18 +56,182 @@ MonitorUI::MonitorUI()
     _ppb->setHorizAlign(ALIGN_RIGHT);
     this->setControl(1, r, _ppb.get());
     ++r;
+
+    // per-layer timings go below this header, one row per layer
+    this->setControl(0, r, new ui::LabelControl("Layer"));
+    this->setControl(1, r, new ui::LabelControl("Fetch ms (p50/p95)"));
+    this->setControl(2, r, new ui::LabelControl("Cache ms"));
+    this->setControl(3, r, new ui::LabelControl("Process ms"));
+    this->setControl(4, r, new ui::LabelControl("Avg KB"));
+    ++r;
+
+    _nextRow = r;
+
+    // frame attribution goes in its own columns to the right
+    this->setControl(6, 0, new ui::LabelControl("Frame ms (avg)"));
+    this->setControl(6, 1, new ui::LabelControl("total"));
+    _frameTotal = new ui::LabelControl();
+    _frameTotal->setHorizAlign(ALIGN_RIGHT);
+    this->setControl(7, 1, _frameTotal.get());
+    _nextFrameRow = 2;
+
+    _lastFrameTime = -1.0;
+    _frame_ms = 0.0;
+    _avgFrame_ms = 0.0;
+    _spikeThreshold_ms = 0.0;
+    _spikeFile = "osgearth_spikes.log";
+    _lastSpikeTime = -1.0;
+}
+
+void
+MonitorUI::sampleFrame(const osg::FrameStamp* fs)
+{
+    // The counters hold the total time spent in each area; the change since
+    // the last FRAME event is the time spent in the frame that just ended.
+    std::vector<Metrics::Counter*> counters;
+    Metrics::getCounters("frame.", counters);
+
+    for (std::vector<Metrics::Counter*>::const_iterator i = counters.begin(); i != counters.end(); ++i)
+    {
+        Metrics::Counter* counter = *i;
+        FrameRow& row = _frameRows[counter->getName()];
+        if (!row._label.valid())
+        {
+            // "frame.cull.terrain_us" => "cull.terrain"
+            std::string name = counter->getName().substr(6);
+            if (endsWith(name, "_us"))
+                name = name.substr(0, name.size() - 3);
+
+            this->setControl(6, _nextFrameRow, new ui::LabelControl(name));
+            row._label = new ui::LabelControl();
+            row._label->setHorizAlign(ALIGN_RIGHT);
+            this->setControl(7, _nextFrameRow, row._label.get());
+            ++_nextFrameRow;
+        }
+
+        long long total_us = counter->get();
+        row._last_ms = (double)(total_us - row._total_us) / 1000.0;
+        row._avg_ms += 0.1 * (row._last_ms - row._avg_ms);
+        row._total_us = total_us;
+    }
+
+    double now = fs->getReferenceTime();
+    if (_lastFrameTime >= 0.0)
+    {
+        _frame_ms = (now - _lastFrameTime) * 1000.0;
+        _avgFrame_ms += 0.1 * (_frame_ms - _avgFrame_ms);
+
+        if (_spikeThreshold_ms > 0.0 && _frame_ms > _spikeThreshold_ms)
+        {
+            // at most one report per second, so a slow stretch doesn't flood the file
+            if (_lastSpikeTime < 0.0 || now - _lastSpikeTime >= 1.0)
+            {
+                captureSpike(fs);
+                _lastSpikeTime = now;
+            }
+        }
+    }
+    _lastFrameTime = now;
+}
+
+void
+MonitorUI::captureSpike(const osg::FrameStamp* fs)
+{
+    OE_WARN << LC << "Frame " << fs->getFrameNumber() << " took "
+        << std::fixed << std::setprecision(1) << _frame_ms << " ms; details in " << _spikeFile << std::endl;
+
+    std::ofstream out(_spikeFile.c_str(), std::ios::out | std::ios::app);
+    if (!out.is_open())
+        return;
+
+    out << "=== Frame " << fs->getFrameNumber()
+        << " at t=" << std::fixed << std::setprecision(3) << fs->getReferenceTime()
+        << ": " << std::setprecision(1) << _frame_ms << " ms (avg " << _avgFrame_ms << " ms)\n";
+
+    for (FrameRows::const_iterator i = _frameRows.begin(); i != _frameRows.end(); ++i)
+    {
+        out << "  " << i->first << " = " << i->second._last_ms << " ms"
+            << " (avg " << i->second._avg_ms << " ms)\n";
+    }
+
+    // counters, gauges (loader and job queues) and histograms at this moment
+    Metrics::write(out, Metrics::FORMAT_JSON);
+    out << std::endl;
+}
+
+void
+MonitorUI::updateLayer(const std::string& name, const Metrics::LayerHistograms& metrics)
+{
+    if (!metrics.fetch)
+        return;
+
+    LayerRow& row = _layerRows[name];
+    if (!row._fetch.valid())
+    {
+        this->setControl(0, _nextRow, new ui::LabelControl(name));
+        this->setControl(1, _nextRow, row._fetch = new ui::LabelControl());
+        this->setControl(2, _nextRow, row._cache = new ui::LabelControl());
+        this->setControl(3, _nextRow, row._process = new ui::LabelControl());
+        this->setControl(4, _nextRow, row._size = new ui::LabelControl());
+        ++_nextRow;
+    }
+
+    Metrics::Histogram::Data fetch, cache, process, size;
+    metrics.fetch->get(fetch);
+    metrics.cache->get(cache);
+    metrics.process->get(process);
+    metrics.bytes->get(size);
+
+    row._fetch->setText(Stringify() << std::fixed << std::setprecision(1)
+        << fetch.percentile(0.5) << " / " << fetch.percentile(0.95));
+    row._cache->setText(Stringify() << std::fixed << std::setprecision(1) << cache.mean());
+    row._process->setText(Stringify() << std::fixed << std::setprecision(1) << process.mean());
+    row._size->setText(Stringify() << (unsigned)(size.mean() / 1024.0));
 }
 
 void
 MonitorUI::update(const osg::FrameStamp* fs)
 {
+    if (fs)
+    {
+        sampleFrame(fs);
+    }
+
     if (fs && fs->getFrameNumber() % 15 == 0)
     {
+        _frameTotal->setText(Stringify() << std::fixed << std::setprecision(2) << _avgFrame_ms);
+        for (FrameRows::const_iterator i = _frameRows.begin(); i != _frameRows.end(); ++i)
+        {
+            i->second._label->setText(Stringify() << std::fixed << std::setprecision(2) << i->second._avg_ms);
+        }
+
         _ws->setText(Stringify() << (Memory::getProcessPhysicalUsage() / 1048576) << " M");
         _pb->setText(Stringify() << (Memory::getProcessPrivateUsage() / 1048576) << " M");
         _ppb->setText(Stringify() << (Memory::getProcessPeakPrivateUsage() / 1048576) << " M");
 
         //Registry::instance()->startActivity("Current Mem", Stringify() <<  (bytes / 1048576) << " M");
         //Registry::instance()->startActivity("Peak Mem", Stringify() << (Memory::getProcessPeakUsage() / 1048576) << " M");
+
+        osg::ref_ptr<const Map> map;
+        if (_map.lock(map))
+        {
+            LayerVector layers;
+            map->getLayers(layers);
+            for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+            {
+                const TileLayer* tileLayer = dynamic_cast<const TileLayer*>(i->get());
+                if (tileLayer)
+                {
+                    updateLayer(tileLayer->getName(), tileLayer->getTileMetrics());
+                    continue;
+                }
+
+                const FeatureSource* features = dynamic_cast<const FeatureSource*>(i->get());
+                if (features)
+                {
+                    updateLayer(features->getName(), features->getCursorMetrics());
+                }
+            }
+        }
     }
 }
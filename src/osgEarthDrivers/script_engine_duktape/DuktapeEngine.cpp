@@ -22,6 +22,7 @@
 #include <osgEarth/StringUtils>
 #include <osgEarth/GeometryUtils>
 #include <sstream>
+#include <cstring>
 
 #undef  LC
 #define LC "[duktape] "
@@ -195,9 +196,14 @@ namespace
                 duk_put_prop_string(ctx, feature_i, "properties"); // [global] [feature]
 
                 duk_idx_t geometry_i = duk_push_object(ctx);  // [global] [feature] [geometry]
+                const Geometry* geometry = feature->getGeometry();
+                if (geometry)
                 {
-                    duk_push_string(ctx, Geometry::toString(feature->getGeometry()->getType()).c_str()); // [global] [feature] [geometry] [type]
+                    duk_push_string(ctx, Geometry::toString(geometry->getType()).c_str()); // [global] [feature] [geometry] [type]
                     duk_put_prop_string(ctx, geometry_i, "type"); // [global] [feature] [geometry]
+
+                    // points/parts views and methods, read from the native geometry on demand
+                    GeometryAPI::bindNative(ctx, geometry);       // [global] [feature] [geometry]
                 }
                 duk_put_prop_string(ctx, feature_i, "geometry");
             }
@@ -243,13 +249,13 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
         duk_push_c_function( _ctx, log, DUK_VARARGS ); // [global, function]
         duk_put_prop_string( _ctx, -2, "log" );        // [global]
 
+        GeometryAPI::install(_ctx);
+
         if ( complete )
         {
             // feature.save() callback
             duk_push_c_function(_ctx, oe_duk_save_feature, 1/*numargs*/); // [global, function]
             duk_put_prop_string(_ctx, -2, "oe_duk_save_feature");         // [global]
-
-            GeometryAPI::install(_ctx);
         }
 
         duk_pop(_ctx); // []
@@ -276,7 +282,95 @@ _options    ( options )
 
 DuktapeEngine::~DuktapeEngine()
 {
-    //nop
+    for (std::vector<Context*>::iterator i = _pool.begin(); i != _pool.end(); ++i)
+        delete *i;
+    _pool.clear();
+}
+
+DuktapeEngine::Context*
+DuktapeEngine::acquireContext(bool complete)
+{
+    Context* c = 0L;
+    {
+        Threading::ScopedMutexLock lock(_poolMutex);
+        if (!_pool.empty())
+        {
+            // most recently used first; its caches are the warmest.
+            c = _pool.back();
+            _pool.pop_back();
+        }
+    }
+
+    if (!c)
+    {
+        c = new Context();
+    }
+
+    c->initialize( _options, complete );
+    return c;
+}
+
+void
+DuktapeEngine::releaseContext(Context* c)
+{
+    Threading::ScopedMutexLock lock(_poolMutex);
+    _pool.push_back(c);
+}
+
+bool
+DuktapeEngine::pushFunction(duk_context* ctx, const std::string& code)
+{
+    // Each context keeps its compiled functions in the heap stash, keyed by source.
+    duk_push_heap_stash(ctx);                                   // [stash]
+    if (duk_get_prop_string(ctx, -1, code.c_str()))            // [stash, function]
+    {
+        duk_remove(ctx, -2);                                    // [function]
+        return true;
+    }
+    duk_pop(ctx);                                               // [stash]
+
+    bool loaded = false;
+    {
+        Threading::ScopedMutexLock lock(_bytecodeMutex);
+        std::map<std::string, std::string>::const_iterator i = _bytecode.find(code);
+        if (i != _bytecode.end())
+        {
+            void* buf = duk_push_fixed_buffer(ctx, i->second.size()); // [stash, bytecode]
+            ::memcpy(buf, i->second.data(), i->second.size());
+            loaded = true;
+        }
+    }
+
+    if (loaded)
+    {
+        // another context already compiled it:
+        duk_load_function(ctx);                                 // [stash, function]
+    }
+    else
+    {
+        if (duk_pcompile_lstring(ctx, DUK_COMPILE_EVAL, code.c_str(), code.length()) != 0)
+        {
+            duk_remove(ctx, -2);                                // [error]
+            return false;
+        }
+        // [stash, function]
+
+        // share the bytecode with the other contexts:
+        duk_dup_top(ctx);                                       // [stash, function, function]
+        duk_dump_function(ctx);                                 // [stash, function, bytecode]
+        duk_size_t len = 0;
+        const char* buf = static_cast<const char*>(duk_get_buffer(ctx, -1, &len));
+        {
+            Threading::ScopedMutexLock lock(_bytecodeMutex);
+            _bytecode[code].assign(buf, len);
+        }
+        duk_pop(ctx);                                           // [stash, function]
+    }
+
+    duk_dup_top(ctx);                                           // [stash, function, function]
+    duk_put_prop_string(ctx, -3, code.c_str());                 // [stash, function]
+    duk_remove(ctx, -2);                                        // [function]
+    return true;
 }
 
 ScriptResult
@@ -298,9 +392,9 @@ DuktapeEngine::run(const std::string&   code,
     c.initialize( _options, complete );
     duk_context* ctx = c._ctx;
 #else
-    // cache the Context on a per-thread basis
-    Context& c = _contexts.get();
-    c.initialize( _options, complete );
+    // borrow a warmed context from the pool
+    Context* pooled = acquireContext( complete );
+    Context& c = *pooled;
     duk_context* ctx = c._ctx;
 #endif
 
@@ -317,7 +411,13 @@ DuktapeEngine::run(const std::string&   code,
     // message instead of the return value.
     std::string resultString;
 
-    duk_int_t r = (duk_peval_string(ctx, code.c_str()) == 0); // [ "result" ]
+    duk_int_t r = 0;
+    if (pushFunction(ctx, code))                                // [function]
+    {
+        duk_push_global_object(ctx);                            // [function, global]
+        r = (duk_pcall_method(ctx, 0) == DUK_EXEC_SUCCESS);     // [ "result" ]
+    }
+
     const char* resultVal = duk_to_string(ctx, -1);
     if ( resultVal )
         resultString = resultVal;
@@ -331,6 +431,10 @@ DuktapeEngine::run(const std::string&   code,
     // pop the return value:
     duk_pop(ctx); // []
 
+#ifndef MAXIMUM_ISOLATION
+    releaseContext(pooled);
+#endif
+
     return r >= 0 ?
         ScriptResult(resultString, true) :
         ScriptResult("", false, resultString);
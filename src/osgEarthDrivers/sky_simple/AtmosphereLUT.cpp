@@ -0,0 +1,217 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "AtmosphereLUT"
+
+#include <osgEarth/Registry>
+#include <osgEarth/Cache>
+#include <osgEarth/CacheBin>
+#include <osgEarth/CachePolicy>
+#include <osgEarth/StringUtils>
+#include <osgEarth/Notify>
+#include <osg/Texture>
+#include <cmath>
+
+#define LC "[AtmosphereLUT] "
+
+#define CACHE_BIN_ID "simple_sky"
+
+// bump when the table layout or the integral changes
+#define LUT_VERSION 1
+
+using namespace osgEarth;
+using namespace osgEarth::SimpleSky;
+
+AtmosphereLUT::AtmosphereLUT(const Parameters& params) :
+_params(params)
+{
+    //nop
+}
+
+osg::Vec4f
+AtmosphereLUT::getSize()
+{
+    return osg::Vec4f(NU_SIZE, MUS_SIZE, MU_SIZE, H_SIZE);
+}
+
+osg::Texture3D*
+AtmosphereLUT::getOrCreateTexture()
+{
+    if (_texture.valid())
+        return _texture.get();
+
+    optional<CachePolicy> policy;
+    Registry::instance()->resolveCachePolicy(policy);
+
+    Cache* cache = Registry::instance()->getDefaultCache();
+    CacheBin* bin = cache && policy->isCacheEnabled() ? cache->addBin(CACHE_BIN_ID) : 0L;
+    const std::string key = getCacheKey();
+
+    osg::ref_ptr<osg::Image> image;
+
+    if (bin && policy->isCacheReadable())
+    {
+        ReadResult rr = bin->readImage(key, 0L);
+        if (rr.succeeded() &&
+            rr.getImage()->s() == NU_SIZE*MUS_SIZE &&
+            rr.getImage()->t() == MU_SIZE &&
+            rr.getImage()->r() == H_SIZE)
+        {
+            image = rr.releaseImage();
+            OE_INFO << LC << "Loaded scattering table from cache" << std::endl;
+        }
+    }
+
+    if (!image.valid())
+    {
+        image = compute();
+        OE_INFO << LC << "Computed scattering table" << std::endl;
+
+        if (bin && policy->isCacheWriteable())
+        {
+            bin->write(key, image.get(), 0L);
+        }
+    }
+
+    image->setInternalTextureFormat(GL_RGB16F_ARB);
+
+    _texture = new osg::Texture3D(image.get());
+    _texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    _texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    _texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _texture->setWrap(osg::Texture::WRAP_R, osg::Texture::CLAMP_TO_EDGE);
+    _texture->setResizeNonPowerOfTwoHint(false);
+    _texture->setUnRefImageDataAfterApply(true);
+
+    return _texture.get();
+}
+
+std::string
+AtmosphereLUT::getCacheKey() const
+{
+    std::string params = Stringify()
+        << LUT_VERSION << ","
+        << NU_SIZE << "," << MUS_SIZE << "," << MU_SIZE << "," << H_SIZE << ","
+        << _params.innerRadius << "," << _params.outerRadius << ","
+        << _params.scaleDepth << "," << _params.kr4PI << "," << _params.km4PI << ","
+        << _params.invWavelength.x() << "," << _params.invWavelength.y() << "," << _params.invWavelength.z() << ","
+        << _params.samples;
+
+    return Stringify() << "atmosphere_" << std::hex << hashString(params);
+}
+
+float
+AtmosphereLUT::scale(float fCos) const
+{
+    // same fit as atmos_scale() in the shaders
+    float x = 1.0f - fCos;
+    return _params.scaleDepth * expf(-0.00287f + x*(0.459f + x*(3.83f + x*(-6.80f + x*5.25f))));
+}
+
+osg::Vec3f
+AtmosphereLUT::integrate(float h, float mu, float mus, float nu) const
+{
+    // Camera on the z axis, view ray in the xz plane, sun placed to
+    // satisfy both its zenith angle and its angle to the view ray.
+    osg::Vec3f start(0.0f, 0.0f, h);
+    float sinMu = sqrtf(osg::maximum(0.0f, 1.0f - mu*mu));
+    osg::Vec3f ray(sinMu, 0.0f, mu);
+
+    float sinMus = sqrtf(osg::maximum(0.0f, 1.0f - mus*mus));
+    float lx = sinMu > 1e-4f ? osg::clampBetween((nu - mu*mus) / sinMu, -sinMus, sinMus) : 0.0f;
+    float ly = sqrtf(osg::maximum(0.0f, 1.0f - lx*lx - mus*mus));
+    osg::Vec3f lightDir(lx, ly, mus);
+
+    // distance to where the ray leaves the atmosphere, which is where
+    // the dome vertex sits
+    float R2 = _params.outerRadius * _params.outerRadius;
+    float far = -h*mu + sqrtf(osg::maximum(0.0f, h*h*mu*mu - h*h + R2));
+
+    float fScale = 1.0f / (_params.outerRadius - _params.innerRadius);
+    float fScaleOverScaleDepth = fScale / _params.scaleDepth;
+
+    float startDepth = expf(fScaleOverScaleDepth * (_params.innerRadius - h));
+    float startOffset = startDepth * scale(mu);
+
+    float sampleLength = far / (float)_params.samples;
+    float scaledLength = sampleLength * fScale;
+    osg::Vec3f sampleRay = ray * sampleLength;
+    osg::Vec3f samplePoint = start + sampleRay * 0.5f;
+
+    osg::Vec3f extinction(
+        _params.invWavelength.x() * _params.kr4PI + _params.km4PI,
+        _params.invWavelength.y() * _params.kr4PI + _params.km4PI,
+        _params.invWavelength.z() * _params.kr4PI + _params.km4PI);
+
+    osg::Vec3f frontColor;
+    for (int i = 0; i < _params.samples; ++i)
+    {
+        float height = samplePoint.length();
+        float depth = expf(fScaleOverScaleDepth * (_params.innerRadius - height));
+        float lightAngle = (lightDir * samplePoint) / height;
+        float cameraAngle = (ray * samplePoint) / height;
+        float scatter = startOffset + depth*(scale(lightAngle) - scale(cameraAngle));
+        float weight = depth * scaledLength;
+        frontColor.x() += expf(-scatter * extinction.x()) * weight;
+        frontColor.y() += expf(-scatter * extinction.y()) * weight;
+        frontColor.z() += expf(-scatter * extinction.z()) * weight;
+        samplePoint += sampleRay;
+    }
+
+    return frontColor;
+}
+
+osg::Image*
+AtmosphereLUT::compute() const
+{
+    osg::Image* image = new osg::Image();
+    image->allocateImage(NU_SIZE*MUS_SIZE, MU_SIZE, H_SIZE, GL_RGB, GL_FLOAT);
+
+    float* ptr = (float*)image->data();
+
+    for (int r = 0; r < H_SIZE; ++r)
+    {
+        // squared spacing puts more rows near the ground, where the
+        // integral changes fastest
+        float t = (float)r / (float)(H_SIZE - 1);
+        float h = _params.innerRadius + (_params.outerRadius - _params.innerRadius) * t * t;
+
+        for (int y = 0; y < MU_SIZE; ++y)
+        {
+            float mu = -1.0f + 2.0f * (float)y / (float)(MU_SIZE - 1);
+
+            for (int n = 0; n < NU_SIZE; ++n)
+            {
+                float nu = -1.0f + 2.0f * (float)n / (float)(NU_SIZE - 1);
+
+                for (int x = 0; x < MUS_SIZE; ++x)
+                {
+                    float mus = -1.0f + 2.0f * (float)x / (float)(MUS_SIZE - 1);
+
+                    osg::Vec3f c = integrate(h, mu, mus, nu);
+                    *ptr++ = c.x();
+                    *ptr++ = c.y();
+                    *ptr++ = c.z();
+                }
+            }
+        }
+    }
+
+    return image;
+}
@@ -5,6 +5,8 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_location   vertex_view
 #pragma vp_order      0.5
 
+#pragma import_defines(OE_SIMPLE_SKY_LUT)
+
 // Atmospheric Scattering and Sun Shaders
 // Adapted from code that is Copyright (c) 2004 Sean ONeil
 
@@ -139,6 +141,65 @@ void atmos_SkyFromAtmosphere(void)
     atmos_v3Direction = vVec - v3Pos; 				
 } 
 
+#ifdef OE_SIMPLE_SKY_LUT
+
+uniform sampler3D atmos_skyLUT;       // precomputed front color (see AtmosphereLUT)
+uniform vec4 atmos_skyLUTSize;        // table size: nu, mus, mu, h
+
+// Looks up the scattering integral for a ray that starts inside (or on)
+// the atmosphere and ends where it leaves the outer radius.
+vec3 atmos_lookupFrontColor(in vec3 v3Start, in vec3 v3Ray)
+{
+    float fHeight = length(v3Start);
+    vec3 up = v3Start / fHeight;
+
+    vec4 t = vec4(
+        dot(v3Ray, atmos_v3LightDir),
+        dot(atmos_v3LightDir, up),
+        dot(v3Ray, up),
+        0.0) * 0.5 + 0.5;
+    t.w = sqrt(clamp((fHeight - atmos_fInnerRadius) * atmos_fScale, 0.0, 1.0));
+
+    // texel centers, so the end rows hold the exact end values
+    vec4 coord = (0.5 + t * (atmos_skyLUTSize - 1.0)) / atmos_skyLUTSize;
+
+    // the view/sun angle is stored as slices along s; blend between two of them
+    float slice = t.x * (atmos_skyLUTSize.x - 1.0);
+    float slice0 = floor(slice);
+    float slice1 = min(slice0 + 1.0, atmos_skyLUTSize.x - 1.0);
+    float s = (0.5 + t.y * (atmos_skyLUTSize.y - 1.0));
+    float width = atmos_skyLUTSize.x * atmos_skyLUTSize.y;
+
+    vec3 c0 = texture(atmos_skyLUT, vec3((slice0 * atmos_skyLUTSize.y + s) / width, coord.z, coord.w)).rgb;
+    vec3 c1 = texture(atmos_skyLUT, vec3((slice1 * atmos_skyLUTSize.y + s) / width, coord.z, coord.w)).rgb;
+    return mix(c0, c1, slice - slice0);
+}
+
+void atmos_SkyFromLUT(void)
+{
+    vec3 v3Pos = gl_Vertex.xyz;
+    vec3 v3Ray = normalize(v3Pos - vVec);
+    vec3 v3Start = vVec;
+
+    // from space, start where the ray enters the atmosphere
+    if (atmos_fCameraHeight >= atmos_fOuterRadius)
+    {
+        float B = 2.0 * dot(vVec, v3Ray);
+        float C = atmos_fCameraHeight2 - atmos_fOuterRadius2;
+        float fDet = max(0.0, B*B - 4.0 * C);
+        float fNear = 0.5 * (-B - sqrt(fDet));
+        v3Start = vVec + v3Ray * fNear;
+    }
+
+    vec3 v3FrontColor = atmos_lookupFrontColor(v3Start, v3Ray);
+
+    atmos_mieColor      = v3FrontColor * atmos_fKmESun;
+    atmos_rayleighColor = v3FrontColor * (atmos_v3InvWavelength * atmos_fKrESun);
+    atmos_v3Direction = vVec - v3Pos;
+}
+
+#endif
+
 uniform float FFF;
 
 void atmos_vertex_main(inout vec4 VertexVIEW) 
@@ -147,6 +208,9 @@ void atmos_vertex_main(inout vec4 VertexVIEW)
     vVec = osg_ViewMatrixInverse[3].xyz; 
     atmos_fCameraHeight = length(vVec); 
     atmos_fCameraHeight2 = atmos_fCameraHeight*atmos_fCameraHeight; 
+#ifdef OE_SIMPLE_SKY_LUT
+    atmos_SkyFromLUT();
+#else
     if(atmos_fCameraHeight >= atmos_fOuterRadius)
     { 
         atmos_SkyFromSpace(); 
@@ -157,6 +221,7 @@ void atmos_vertex_main(inout vec4 VertexVIEW)
         atmos_SkyFromAtmosphere(); 
         //atmos_renderFromSpace = 0.0;
     }
+#endif
 
     // Transition from space to atmosphere
     atmos_renderFromSpace = 1.0 - clamp(
@@ -505,6 +505,19 @@ SimpleSkyNode::makeSceneLighting()
 
     float Scale = 1.0f / (_outerRadius - _innerRadius);
 
+    if (_options.precomputedAtmosphere() == true)
+    {
+        AtmosphereLUT::Parameters params;
+        params.innerRadius = _innerRadius;
+        params.outerRadius = _outerRadius;
+        params.scaleDepth = RayleighScaleDepth;
+        params.kr4PI = Kr4PI;
+        params.km4PI = Km4PI;
+        params.invWavelength = RGB_wl;
+        params.samples = 16; // the table is built once, so it can afford many more samples
+        _atmosphereLUT = new AtmosphereLUT(params);
+    }
+
     //TODO: make all these constants. -gw
     stateset->getOrCreateUniform( "atmos_v3InvWavelength", osg::Uniform::FLOAT_VEC3 )->set( RGB_wl );
     stateset->getOrCreateUniform( "atmos_fInnerRadius",    osg::Uniform::FLOAT )->set( _innerRadius );
@@ -564,6 +577,15 @@ SimpleSkyNode::makeAtmosphere(const osg::EllipsoidModel* em)
         Shaders pkg;
         pkg.load( vp, pkg.Atmosphere_Vert );
         pkg.load( vp, pkg.Atmosphere_Frag );
+
+        if (_atmosphereLUT.valid())
+        {
+            atmosSet->setTextureAttributeAndModes(0, _atmosphereLUT->getOrCreateTexture(), osg::StateAttribute::ON);
+            atmosSet->addUniform(new osg::Uniform("atmos_skyLUT", 0));
+            atmosSet->addUniform(new osg::Uniform("atmos_skyLUTSize", AtmosphereLUT::getSize()));
+            atmosSet->setDefine("OE_SIMPLE_SKY_LUT");
+            OE_INFO << LC << "Using precomputed atmospheric scattering\n";
+        }
     }
 
     // A nested camera isolates the projection matrix calculations so the node won't 
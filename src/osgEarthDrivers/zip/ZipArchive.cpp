@@ -23,12 +23,185 @@
 #include <osgDB/ReadFile>
 #include <osgDB/Registry>
 #include <osgEarth/ThreadingUtils>
+#include <osg/Math>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <sstream>
 #include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const zip_uint64_t NOT_STORED = ~(zip_uint64_t)0;
+
+    // zip records are little-endian
+    inline zip_uint64_t readLE(const char* p, unsigned bytes)
+    {
+        zip_uint64_t value = 0;
+        for (unsigned i = bytes; i > 0; --i)
+            value = (value << 8) | (unsigned char)p[i - 1];
+        return value;
+    }
+
+    struct CentralEntry
+    {
+        std::string  name;
+        zip_uint64_t localHeader;
+    };
+
+    // Walks the central directory of a mapped archive and records, in
+    // directory order (which is also libzip's index order), the local header
+    // offset of each entry that is stored uncompressed and unencrypted.
+    // Returns false if the directory cannot be parsed.
+    bool parseCentralDirectory(const char* data, zip_uint64_t size, std::vector<CentralEntry>& output)
+    {
+        // end of central directory record, which may be followed by a comment
+        if (size < 22u)
+            return false;
+
+        zip_uint64_t eocd = size - 22u;
+        zip_uint64_t limit = size > 22u + 65535u ? size - 22u - 65535u : 0u;
+        while (readLE(data + eocd, 4) != 0x06054b50u)
+        {
+            if (eocd == limit)
+                return false;
+            --eocd;
+        }
+
+        zip_uint64_t count = readLE(data + eocd + 10, 2);
+        zip_uint64_t cdSize = readLE(data + eocd + 12, 4);
+        zip_uint64_t cdOffset = readLE(data + eocd + 16, 4);
+
+        if (count == 0xffffu || cdSize == 0xffffffffu || cdOffset == 0xffffffffu)
+        {
+            // ZIP64: the real values are in the ZIP64 end of central directory record
+            if (eocd < 20u || readLE(data + eocd - 20u, 4) != 0x07064b50u)
+                return false;
+
+            zip_uint64_t eocd64 = readLE(data + eocd - 20u + 8, 8);
+            if (size < 56u || eocd64 > size - 56u || readLE(data + eocd64, 4) != 0x06064b50u)
+                return false;
+
+            count = readLE(data + eocd64 + 32, 8);
+            cdSize = readLE(data + eocd64 + 40, 8);
+            cdOffset = readLE(data + eocd64 + 48, 8);
+        }
+
+        if (cdOffset > size || cdSize > size - cdOffset)
+            return false;
+
+        output.reserve((size_t)osg::minimum(count, cdSize / 46u));
+
+        zip_uint64_t pos = cdOffset;
+        const zip_uint64_t end = cdOffset + cdSize;
+        for (zip_uint64_t i = 0; i < count; ++i)
+        {
+            if (pos + 46u > end || readLE(data + pos, 4) != 0x02014b50u)
+                return false;
+
+            unsigned flags = (unsigned)readLE(data + pos + 8, 2);
+            unsigned method = (unsigned)readLE(data + pos + 10, 2);
+            zip_uint64_t compressedSize = readLE(data + pos + 20, 4);
+            zip_uint64_t uncompressedSize = readLE(data + pos + 24, 4);
+            unsigned nameLen = (unsigned)readLE(data + pos + 28, 2);
+            unsigned extraLen = (unsigned)readLE(data + pos + 30, 2);
+            unsigned commentLen = (unsigned)readLE(data + pos + 32, 2);
+            zip_uint64_t localHeader = readLE(data + pos + 42, 4);
+
+            zip_uint64_t next = pos + 46u + nameLen + extraLen + commentLen;
+            if (next > end)
+                return false;
+
+            // ZIP64 extended information: 64-bit values for the saturated fields, in order
+            const char* extra = data + pos + 46u + nameLen;
+            const char* extraEnd = extra + extraLen;
+            while (extra + 4 <= extraEnd)
+            {
+                unsigned id = (unsigned)readLE(extra, 2);
+                unsigned len = (unsigned)readLE(extra + 2, 2);
+                const char* field = extra + 4;
+                const char* fieldEnd = osg::minimum(field + len, extraEnd);
+                if (id == 0x0001u)
+                {
+                    if (uncompressedSize == 0xffffffffu && field + 8 <= fieldEnd)
+                        uncompressedSize = readLE(field, 8), field += 8;
+                    if (compressedSize == 0xffffffffu && field + 8 <= fieldEnd)
+                        compressedSize = readLE(field, 8), field += 8;
+                    if (localHeader == 0xffffffffu && field + 8 <= fieldEnd)
+                        localHeader = readLE(field, 8), field += 8;
+                    break;
+                }
+                extra = field + len;
+            }
+
+            CentralEntry entry;
+            entry.name.assign(data + pos + 46u, nameLen);
+            entry.localHeader =
+                method == 0u && (flags & 0x1u) == 0u && compressedSize == uncompressedSize ?
+                localHeader : NOT_STORED;
+            output.push_back(entry);
+
+            pos = next;
+        }
+
+        return true;
+    }
+}
+
+// Read-only stream over a block of memory: either an uncompressed entry
+// in the mapped archive, or an entry inflated into the stream's storage.
+// Hands entries to a ReaderWriter without copying them into a stringstream.
+class ZipEntryStream : public std::istream
+{
+public:
+    ZipEntryStream() : std::istream(&_buf) { }
+
+    std::string& storage() { return _storage; }
+
+    void set(const char* data, size_t size)
+    {
+        _buf.set(data, size);
+        clear();
+    }
+
+private:
+    struct Buffer : public std::streambuf
+    {
+        void set(const char* data, size_t size)
+        {
+            char* begin = const_cast<char*>(data);
+            setg(begin, begin, begin + size);
+        }
+
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+        {
+            if ((which & std::ios_base::in) == 0)
+                return pos_type(off_type(-1));
+
+            char* target =
+                dir == std::ios_base::beg ? eback() + off :
+                dir == std::ios_base::cur ? gptr() + off :
+                egptr() + off;
+
+            if (target < eback() || target > egptr())
+                return pos_type(off_type(-1));
+
+            setg(eback(), target, egptr());
+            return pos_type(target - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    Buffer      _buf;
+    std::string _storage;
+};
 
 ZipArchive::ZipArchive()  :
 _zipLoaded( false )
@@ -48,13 +221,16 @@ void ZipArchive::close()
         OpenThreads::ScopedLock<OpenThreads::Mutex> exclusive(_zipMutex);
         if ( _zipLoaded )
         {
-            // close the file (on one thread since it's a shared file)
-            const PerThreadData& data = getDataNoLock();
-
-            zip_close(data._zipHandle);
-            // clear out the file handles
+            // close the handles opened by every thread
+            for (PerThreadDataMap::iterator i = _perThreadData.begin(); i != _perThreadData.end(); ++i)
+            {
+                if (i->second._zipHandle)
+                    zip_close(i->second._zipHandle);
+            }
             _perThreadData.clear();
 
+            _mapped.close();
+
             // clear out the index.
             _zipIndex.clear();
 
@@ -66,8 +242,7 @@ void ZipArchive::close()
 /** return true if file exists in archive.*/
 bool ZipArchive::fileExists(const std::string& filename) const
 {
-    zip_uint64_t idx;
-    return GetZipIndex(filename, idx);
+    return GetZipEntry(filename) != NULL;
 }
 
 /** Get the file name which represents the master file recorded in the Archive.*/
@@ -125,12 +300,18 @@ bool ZipArchive::open(const std::string& file, ArchiveStatus /*status*/, const o
             _password = ReadPassword(options);
 
             // open the zip file in this thread:
-            const PerThreadData& data = getDataNoLock();
+            zip_t* handle = openHandle();
 
             // establish a shared (read-only) index:
-            if ( data._zipHandle != NULL )
+            if ( handle != NULL )
             {
-                IndexZipFiles( data._zipHandle );
+                _perThreadData[osgEarth::Threading::getCurrentThreadId()]._zipHandle = handle;
+
+                // map the archive so uncompressed entries can be read in place;
+                // without a mapping every read goes through libzip
+                _mapped.open(_filename);
+
+                IndexZipFiles( handle );
                 _zipLoaded = true;
             }
         }
@@ -146,7 +327,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readObject(const std::string& file,
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;    
 
-    std::stringstream buffer;
+    ZipEntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -174,7 +355,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readImage(const std::string& file,co
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    ZipEntryStream buffer;
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
     {
@@ -201,7 +382,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readHeightField(const std::string& f
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    ZipEntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -230,7 +411,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readNode(const std::string& file,con
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    ZipEntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -259,7 +440,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readScript(const std::string& file,c
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    ZipEntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -288,7 +469,7 @@ osgDB::ReaderWriter::ReadResult ZipArchive::readShader(const std::string& file,c
     std::string ext = osgDB::getLowerCaseFileExtension(file);
     if (!_zipLoaded || !acceptsExtension(ext)) return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
 
-    std::stringstream buffer;
+    ZipEntryStream buffer;
 
     osgDB::ReaderWriter* rw = ReadFromZipIndex(file, options, buffer);
     if (rw != NULL)
@@ -340,39 +521,90 @@ osgDB::ReaderWriter::WriteResult ZipArchive::writeShader(const osg::Shader& /*sh
     return osgDB::ReaderWriter::WriteResult(osgDB::ReaderWriter::WriteResult::FILE_NOT_HANDLED);
 }
 
-osgDB::ReaderWriter* ZipArchive::ReadFromZipIndex(const std::string& filename, const osgDB::ReaderWriter::Options* options, std::stringstream& streamIn) const
+osgDB::ReaderWriter* ZipArchive::ReadFromZipIndex(const std::string& filename, const osgDB::ReaderWriter::Options* options, ZipEntryStream& streamIn) const
 {
-    zip_uint64_t idx;
-    if (GetZipIndex(filename, idx))
+    const ZipEntry* entry = GetZipEntry(filename);
+    if (entry == NULL)
+        return NULL;
+
+    bool ok = false;
+
+    // uncompressed entries stream straight out of the mapping:
+    const char* stored = getStoredData(*entry);
+    if (stored != NULL)
+    {
+        streamIn.set(stored, (size_t)entry->size);
+        ok = true;
+    }
+
+    // everything else inflates on this thread through its own handle,
+    // in one pass into a buffer of the final size:
+    else
     {
-        // fetch the handle for the current thread:
-        const PerThreadData& data = getData();
-        if (data._zipHandle != NULL)
+        zip_t* handle = getData();
+        if (handle != NULL)
         {
             zip_file_t* zf;
-            if ((zf = zip_fopen_index(data._zipHandle, idx, 0)) != NULL)
-            {             
-                char buf[8192];
+            if ((zf = zip_fopen_index(handle, entry->index, 0)) != NULL)
+            {
+                std::string& buf = streamIn.storage();
+                buf.resize((size_t)entry->size);
+
+                zip_uint64_t total = 0;
                 zip_int64_t n;
-                while ((n = zip_fread(zf, buf, sizeof(buf))) > 0) {
-                    streamIn.write(buf, (size_t)n);
+                while (total < entry->size && (n = zip_fread(zf, &buf[(size_t)total], entry->size - total)) > 0)
+                {
+                    total += (zip_uint64_t)n;
                 }
                 zip_fclose(zf);
-                
-                std::string file_ext = osgDB::getFileExtension(filename);
-                osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(file_ext);
-                if (rw != NULL)
+
+                if (total == entry->size)
                 {
-                    return rw;
+                    streamIn.set(buf.data(), buf.size());
+                    ok = true;
                 }
+            }
+        }
+    }
 
-            }            
-        }        
+    if (ok)
+    {
+        std::string file_ext = osgDB::getFileExtension(filename);
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(file_ext);
+        if (rw != NULL)
+        {
+            return rw;
+        }
     }
 
     return NULL;
 }
 
+const char* ZipArchive::getStoredData(const ZipEntry& entry) const
+{
+    if (entry.localHeader == NOT_STORED || !_mapped.valid())
+        return NULL;
+
+    // the data follows the local header, whose name and extra field
+    // lengths can differ from the central directory's:
+    const char* data = _mapped.data();
+    zip_uint64_t size = _mapped.size();
+    if (entry.localHeader > size || size - entry.localHeader < 30u ||
+        readLE(data + entry.localHeader, 4) != 0x04034b50u)
+    {
+        return NULL;
+    }
+
+    zip_uint64_t start = entry.localHeader + 30u +
+        readLE(data + entry.localHeader + 26, 2) +
+        readLE(data + entry.localHeader + 28, 2);
+
+    if (start > size || size - start < entry.size)
+        return NULL;
+
+    return data + start;
+}
+
 
 void CleanupFileString(std::string& strFileOrDir)
 {
@@ -402,33 +634,51 @@ void ZipArchive::IndexZipFiles(zip_t* zip)
     if (zip != NULL && !_zipLoaded)
     {
         zip_uint64_t  count = zip_get_num_entries(zip, 0);
+
+        // locate the uncompressed entries, if the archive is mapped; the
+        // directory must agree with libzip's entry for entry or it's ignored
+        std::vector<CentralEntry> central;
+        if (_mapped.valid() &&
+            (!parseCentralDirectory(_mapped.data(), _mapped.size(), central) || central.size() != count))
+        {
+            central.clear();
+        }
+
         for (zip_uint64_t i = 0; i < count; i++)
         {
             std::string name(zip_get_name(zip, i, 0));
             CleanupFileString(name);
             if (!name.empty())
             {
-                _zipIndex.insert(ZipEntryMapping(name, i));
+                ZipEntry entry;
+                entry.index = i;
+                entry.localHeader = NOT_STORED;
+
+                zip_stat_t st;
+                zip_stat_init(&st);
+                if (zip_stat_index(zip, i, 0, &st) != 0 || (st.valid & ZIP_STAT_SIZE) == 0)
+                    continue;
+                entry.size = st.size;
+
+                const char* rawName = zip_get_name(zip, i, ZIP_FL_ENC_RAW);
+                if (!central.empty() && rawName && central[(size_t)i].name == rawName)
+                    entry.localHeader = central[(size_t)i].localHeader;
+
+                _zipIndex.insert(ZipEntryMap::value_type(name, entry));
             }
-        }        
+        }
     }
 }
 
-bool ZipArchive::GetZipIndex(const std::string& filename, zip_uint64_t& idx) const
+const ZipArchive::ZipEntry* ZipArchive::GetZipEntry(const std::string& filename) const
 {
-    const ZipEntryMap::iterator iter = const_cast<ZipEntryMap*>(&_zipIndex)->find(filename);
-    if (iter != _zipIndex.end())
-    {
-        idx = (*iter).second;
-        return true;
-    }
-    return false;
+    ZipEntryMap::const_iterator iter = _zipIndex.find(filename);
+    return iter != _zipIndex.end() ? &iter->second : NULL;
 }
 
 osgDB::FileType ZipArchive::getFileType(const std::string& filename) const
 {
-    zip_uint64_t idx;
-    if (GetZipIndex(filename, idx))
+    if (GetZipEntry(filename) != NULL)
     {
         return osgDB::REGULAR_FILE;
     }
@@ -507,49 +757,47 @@ std::string ZipArchive::ReadPassword(const osgDB::ReaderWriter::Options* options
     return password;
 }
 
-const ZipArchive::PerThreadData&
+zip_t*
 ZipArchive::getData() const
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> exclusive( const_cast<ZipArchive*>(this)->_zipMutex );
-    return getDataNoLock();
-}
-
-
-const ZipArchive::PerThreadData&
-ZipArchive::getDataNoLock() const
-{
-    // get/create data for the currently running thread:
+    // get the handle for the currently running thread:
     size_t current = osgEarth::Threading::getCurrentThreadId();
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( const_cast<ZipArchive*>(this)->_zipMutex );
+        PerThreadDataMap::const_iterator i = _perThreadData.find( current );
+        if ( i != _perThreadData.end() && i->second._zipHandle != NULL )
+            return i->second._zipHandle;
+    }
 
-    PerThreadDataMap::const_iterator i = _perThreadData.find( current );
-
-    if ( i == _perThreadData.end() || i->second._zipHandle == NULL )
+    // none yet, so open the ZIP with a handle exclusively for this thread.
+    // Opening reads the whole central directory, so do it outside the lock
+    // rather than stall every other thread's reads.
+    zip_t* handle = openHandle();
+    if ( handle != NULL )
     {
         // cache pattern: cast to const for caching purposes
         ZipArchive* ncThis = const_cast<ZipArchive*>(this);
 
-        // data does not already exist, so open the ZIP with a handle exclusively for this thread:
-        PerThreadData& data = ncThis->_perThreadData[current];
-        if ( !_filename.empty() )
-        {
-            int errorCode;
-            data._zipHandle = zip_open(_filename.c_str(), ZIP_RDONLY, &errorCode);
-            if (!data._zipHandle)
-            {
-                zip_error_t error;
-                zip_error_init_with_code(&error, errorCode);
-                OSG_WARN << "Failed to open zip " << _filename << ": " << zip_error_strerror(&error) << std::endl;
-                zip_error_fini(&error);                
-            }
-        }
-        else
-        {
-            data._zipHandle = NULL;
-        }
-        return data;
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( ncThis->_zipMutex );
+        ncThis->_perThreadData[current]._zipHandle = handle;
     }
-    else
+    return handle;
+}
+
+zip_t*
+ZipArchive::openHandle() const
+{
+    if ( _filename.empty() )
+        return NULL;
+
+    int errorCode;
+    zip_t* handle = zip_open(_filename.c_str(), ZIP_RDONLY, &errorCode);
+    if (!handle)
     {
-        return i->second;
+        zip_error_t error;
+        zip_error_init_with_code(&error, errorCode);
+        OSG_WARN << "Failed to open zip " << _filename << ": " << zip_error_strerror(&error) << std::endl;
+        zip_error_fini(&error);
     }
+    return handle;
 }
@@ -7,8 +7,13 @@
 #include <osgDB/Archive>
 #include <OpenThreads/Mutex>
 
+#include <osgEarth/Containers>
+#include <osgEarth/MappedFile>
+
 #include <zip.h>
 
+class ZipEntryStream;
+
 class ZipArchive : public osgDB::Archive
 {
     public:
@@ -62,31 +67,42 @@ class ZipArchive : public osgDB::Archive
 
     protected:
 
+        struct ZipEntry
+        {
+            zip_uint64_t index;       // libzip index
+            zip_uint64_t size;        // uncompressed size
+            zip_uint64_t localHeader; // local header offset of an uncompressed entry, or ~0
+        };
+
         void IndexZipFiles(zip_t* zip);
-        bool GetZipIndex(const std::string& filename, zip_uint64_t& idx) const;
-        osgDB::ReaderWriter* ReadFromZipIndex(const std::string& filename, const osgDB::ReaderWriter::Options* options, std::stringstream& streamIn) const;
+        const ZipEntry* GetZipEntry(const std::string& filename) const;
+        osgDB::ReaderWriter* ReadFromZipIndex(const std::string& filename, const osgDB::ReaderWriter::Options* options, ZipEntryStream& streamIn) const;
         std::string ReadPassword(const osgDB::ReaderWriter::Options* options) const;
 
     private:
 
-        typedef std::pair<std::string, zip_uint64_t > ZipEntryMapping;
-        typedef std::map<std::string, zip_uint64_t > ZipEntryMap;
+        typedef osgEarth::Util::UnorderedMap<std::string, ZipEntry> ZipEntryMap;
 
         std::string _filename, _password, _membuffer;
 
         OpenThreads::Mutex _zipMutex;
         bool               _zipLoaded;
-        ZipEntryMap        _zipIndex;        
+        ZipEntryMap        _zipIndex;
+
+        // the whole archive, mapped for reading uncompressed entries in place
+        osgEarth::Util::MappedFile _mapped;
 
         struct PerThreadData {
+            PerThreadData() : _zipHandle(NULL) { }
             zip_t* _zipHandle;
         };
 
         typedef std::map<size_t, PerThreadData> PerThreadDataMap;
         PerThreadDataMap _perThreadData;
 
-        const PerThreadData& getData() const;
-        const PerThreadData& getDataNoLock() const;
+        zip_t* getData() const;
+        zip_t* openHandle() const;
+        const char* getStoredData(const ZipEntry& entry) const;
 };
 
 
@@ -42,7 +42,9 @@ SilverLiningContextNode::SilverLiningContextNode(SilverLiningNode* node,
 _silverLiningNode (node),
 _camera           (camera),
 _options          (options),
-_lastAltitude(DBL_MAX)
+_lastAltitude(DBL_MAX),
+_cullEyeValid(false),
+_locationValid(false)
 {
     // The main silver lining data:
     _SL = new SilverLiningContext( options );
@@ -93,7 +95,30 @@ SilverLiningContextNode::traverse(osg::NodeVisitor& nv)
     {
         if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
         {
-			int frameNumber = nv.getFrameStamp()->getFrameNumber();
+            // Apply the eye point from the last cull here, on the update
+            // thread, so the cull stays cheap. SL recomputes its sky for a
+            // new location, so skip that until the eye actually moves.
+            osg::Vec3d eye;
+            bool eyeValid;
+            {
+                Threading::ScopedMutexLock lock(_cullEyeMutex);
+                eye = _cullEye;
+                eyeValid = _cullEyeValid;
+            }
+
+            if (eyeValid)
+            {
+                if (!_locationValid || (eye - _locationEye).length2() > 1.0)
+                {
+                    _SL->setCameraPosition(eye);
+                    _SL->updateLocation();
+                    _locationEye = eye;
+                    _locationValid = true;
+                }
+
+                _SL->updateLight();
+            }
+
             _skyDrawable->dirtyBound();
 
             if( _cloudsDrawable )
@@ -124,15 +149,16 @@ SilverLiningContextNode::traverse(osg::NodeVisitor& nv)
 				if(getTargetCamera() == camera)
 #endif
      			{
-					// TODO: make this multi-camera safe
-					_SL->setCameraPosition( nv.getEyePoint() );
+					// SL itself is updated in the next update traversal.
+					{
+						Threading::ScopedMutexLock lock(_cullEyeMutex);
+						_cullEye = nv.getEyePoint();
+						_cullEyeValid = true;
+					}
 
 					_lastAltitude = _SL->getSRS()->isGeographic() ?
 						cv->getEyePoint().length() - _SL->getSRS()->getEllipsoid()->getRadiusEquator() :
 					cv->getEyePoint().z();
-
-					_SL->updateLocation();
-					_SL->updateLight();
 				}
 			}
         }
@@ -0,0 +1,116 @@
+#version 430
+
+// Generates the ground cover instances for one tile. Runs once per tile;
+// the results stay in a GPU buffer that GroundCover.VS.glsl reads with
+// OE_GROUNDCOVER_USE_INSTANCE_BUFFER defined.
+
+#pragma import_defines(OE_LANDCOVER_TEX)
+#pragma import_defines(OE_LANDCOVER_TEX_MATRIX)
+#pragma import_defines(OE_GROUNDCOVER_MASK_SAMPLER)
+#pragma import_defines(OE_GROUNDCOVER_MASK_MATRIX)
+
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+
+struct DrawElementsIndirectCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding=0) buffer oe_GroundCover_CommandBuffer {
+    DrawElementsIndirectCommand oe_GroundCover_cmd[];
+};
+
+// tilec = (s, t, biome index, land cover value)
+struct oe_GroundCover_Instance {
+    vec4 tilec;
+    vec4 noise;
+};
+
+layout(std430, binding=1) buffer oe_GroundCover_InstanceBuffer {
+    oe_GroundCover_Instance oe_GroundCover_instances[];
+};
+
+// Noise texture:
+uniform sampler2D oe_GroundCover_noiseTex;
+
+// noise texture channels:
+#define NOISE_SMOOTH   0
+#define NOISE_RANDOM   1
+#define NOISE_RANDOM_2 2
+#define NOISE_CLUMPY   3
+
+// LandCover texture
+uniform sampler2D OE_LANDCOVER_TEX;
+uniform mat4 OE_LANDCOVER_TEX_MATRIX;
+
+#ifdef OE_GROUNDCOVER_MASK_SAMPLER
+uniform sampler2D OE_GROUNDCOVER_MASK_SAMPLER;
+uniform mat4 OE_GROUNDCOVER_MASK_MATRIX;
+#endif
+
+uniform vec2 oe_GroundCover_numInstances;
+
+// read by the generated predicate function
+float oe_LandCover_coverage;
+
+struct oe_GroundCover_Biome {
+    int firstObjectIndex;
+    int numObjects;
+    float density;
+    float fill;
+    vec2 maxWidthHeight;
+};
+void oe_GroundCover_getBiome(in int index, out oe_GroundCover_Biome biome);
+
+// Generated in GroundCover.cpp
+int oe_GroundCover_getBiomeIndex(in vec4);
+
+void main()
+{
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    if (cell.x >= int(oe_GroundCover_numInstances.x) || cell.y >= int(oe_GroundCover_numInstances.y))
+        return;
+
+    // half the distance between cell centers
+    vec2 halfSpacing = 0.5 / oe_GroundCover_numInstances;
+
+    // tile coords [0..1]
+    vec4 tilec = vec4(halfSpacing + vec2(cell) / oe_GroundCover_numInstances, 0, 1);
+
+    vec4 noise = textureLod(oe_GroundCover_noiseTex, tilec.st, 0);
+
+    // randomly shift each point off center
+    vec2 shift = vec2(fract(noise[NOISE_RANDOM]*1.5), fract(noise[NOISE_RANDOM_2]*1.5))*2.0-1.0;
+
+    tilec.xy += shift * halfSpacing;
+
+    // sample the landcover data
+    oe_LandCover_coverage = textureLod(OE_LANDCOVER_TEX, (OE_LANDCOVER_TEX_MATRIX*tilec).st, 0).r;
+
+    int biomeIndex = oe_GroundCover_getBiomeIndex(tilec);
+    if (biomeIndex < 0)
+        return;
+
+#ifdef OE_GROUNDCOVER_MASK_SAMPLER
+    float mask = textureLod(OE_GROUNDCOVER_MASK_SAMPLER, (OE_GROUNDCOVER_MASK_MATRIX*tilec).st, 0).a;
+    if (mask > 0.0)
+        return;
+#endif
+
+    oe_GroundCover_Biome biome;
+    oe_GroundCover_getBiome(biomeIndex, biome);
+
+    // discard instances based on noise value threshold (coverage). If it passes,
+    // scale the noise value back up to [0..1]
+    if (noise[NOISE_SMOOTH] > biome.fill)
+        return;
+    else
+        noise[NOISE_SMOOTH] /= biome.fill;
+
+    uint slot = atomicAdd(oe_GroundCover_cmd[0].instanceCount, 1);
+    oe_GroundCover_instances[slot].tilec = vec4(tilec.xy, float(biomeIndex), oe_LandCover_coverage);
+    oe_GroundCover_instances[slot].noise = noise;
+}
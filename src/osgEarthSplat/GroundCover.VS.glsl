@@ -11,6 +11,23 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma import_defines(OE_GROUNDCOVER_MASK_SAMPLER)
 #pragma import_defines(OE_GROUNDCOVER_MASK_MATRIX)
 #pragma import_defines(OE_IS_SHADOW_CAMERA)
+#pragma import_defines(OE_GROUNDCOVER_USE_INSTANCE_BUFFER)
+
+#ifdef OE_GROUNDCOVER_USE_INSTANCE_BUFFER
+#extension GL_ARB_shader_storage_buffer_object : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Instances generated once per tile by GroundCover.CS.glsl
+// tilec = (s, t, biome index, land cover value)
+struct oe_GroundCover_Instance {
+    vec4 tilec;
+    vec4 noise;
+};
+
+layout(std430, binding=1) buffer oe_GroundCover_InstanceBuffer {
+    oe_GroundCover_Instance oe_GroundCover_instances[];
+};
+#endif
 
 // Noise texture:
 uniform sampler2D oe_GroundCover_noiseTex;
@@ -131,6 +148,32 @@ void oe_GroundCover_VS(inout vec4 vertex_view)
     // intialize with a "no draw" value (consider using a compute/gs cull instead)
     oe_GroundCover_atlasIndex = -1.0;
 
+#ifdef OE_GROUNDCOVER_USE_INSTANCE_BUFFER
+
+    // The compute shader already placed this instance and ran the land cover,
+    // mask and fill tests; the indirect draw only includes the survivors.
+    if (oe_GroundCover_instancedModel == 1)
+        modelCoords = gl_MultiTexCoord3.st;
+
+    oe_GroundCover_Instance instanceData = oe_GroundCover_instances[gl_InstanceID];
+    oe_layer_tilec = vec4(instanceData.tilec.xy, 0, 1);
+    vec4 noise = instanceData.noise;
+
+    vertex_view.xyz += gl_NormalMatrix * vec3(mix(oe_GroundCover_LL.xy, oe_GroundCover_UR.xy, oe_layer_tilec.xy), 0);
+
+    if (oe_GroundCover_instancedModel == 0)
+    {
+        vp_Normal = vec3(0, 0, 1);
+        vp_Color = vec4(1, 1, 1, 0);
+    }
+
+    oe_LandCover_coverage = instanceData.tilec.w;
+
+    oe_GroundCover_Biome biome;
+    oe_GroundCover_getBiome(int(instanceData.tilec.z), biome);
+
+#else // generate the instance here:
+
     int instanceID;
     if (oe_GroundCover_instancedModel == 1)
     {
@@ -207,6 +250,8 @@ void oe_GroundCover_VS(inout vec4 vertex_view)
     else
         noise[NOISE_SMOOTH] /= biome.fill;
 
+#endif // OE_GROUNDCOVER_USE_INSTANCE_BUFFER
+
     // Clamp the center point to the elevation.
     oe_GroundCover_clamp(vertex_view, oe_UpVectorView, oe_layer_tilec.st);
 
@@ -28,6 +28,9 @@
 #include <osgUtil/CullVisitor>
 #include <osgEarth/LineDrawable>
 #include <osgEarth/NodeUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/StringUtils>
 #include <osg/BlendFunc>
 #include <osg/Multisample>
 #include <osg/Texture2D>
@@ -37,6 +40,7 @@
 #include <osgDB/WriteFile>
 #include <osgUtil/Optimizer>
 #include <cstdlib> // getenv
+#include <cstring> // memcmp
 
 #define LC "[GroundCoverLayer] " << getName() << ": "
 
@@ -47,6 +51,18 @@
 #define GL_MULTISAMPLE 0x809D
 #endif
 
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+// Buffer bindings shared with GroundCover.CS.glsl and GroundCover.VS.glsl
+#define BINDING_COMMAND_BUFFER 0
+#define BINDING_INSTANCE_BUFFER 1
+
+// Number of frames a tile's generated instances stay cached after the
+// tile was last drawn
+#define INSTANCE_EXPIRATION_FRAMES 300
+
 using namespace osgEarth::Splat;
 
 REGISTER_OSGEARTH_LAYER(groundcover, GroundCoverLayer);
@@ -82,6 +98,7 @@ GroundCoverLayer::Options::getConfig() const
     conf.set("cast_shadows", _castShadows);
     conf.set("max_alpha", maxAlpha());
     conf.set("alpha_to_coverage", alphaToCoverage());
+    conf.set("compute_instances", computeInstances());
 
     Config zones("zones");
     for (int i = 0; i < _zones.size(); ++i) {
@@ -102,6 +119,7 @@ GroundCoverLayer::Options::fromConfig(const Config& conf)
     castShadows().init(false);
     maxAlpha().init(0.15f);
     alphaToCoverage().init(true);
+    computeInstances().init(false);
 
     maskLayer().get(conf, "mask_layer");
     colorLayer().get(conf, "color_layer");
@@ -109,6 +127,7 @@ GroundCoverLayer::Options::fromConfig(const Config& conf)
     conf.get("cast_shadows", _castShadows);
     conf.get("max_alpha", maxAlpha());
     conf.get("alpha_to_coverage", alphaToCoverage());
+    conf.get("compute_instances", computeInstances());
 
     const Config* zones = conf.child_ptr("zones");
     if (zones)
@@ -166,8 +185,9 @@ namespace
     {
         META_StateAttribute(osgEarth, GroundCoverSA, (osg::StateAttribute::Type)(osg::StateAttribute::CAPABILITY + 90210));
         GroundCover* _groundcover;
+        osg::ref_ptr<osg::Program> _computeProgram; // generates instances when set
         GroundCoverSA() : _groundcover(NULL) { }
-        GroundCoverSA(const GroundCoverSA& sa, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY) : osg::StateAttribute(sa, copyop), _groundcover(sa._groundcover) { }
+        GroundCoverSA(const GroundCoverSA& sa, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY) : osg::StateAttribute(sa, copyop), _groundcover(sa._groundcover), _computeProgram(sa._computeProgram) { }
         GroundCoverSA(GroundCover* gc) : _groundcover(gc) { }
         virtual int compare(const StateAttribute& sa) const { return 0; }
         static const GroundCoverSA* extract(const osg::State* state) {
@@ -178,6 +198,17 @@ namespace
             return dynamic_cast<const GroundCoverSA*>(i->second.attributeVec.front().first);
         }
     };
+
+    // Copies a VirtualProgram function shader into the compute stage
+    // so it can link with the instance generation shader.
+    osg::Shader* makeComputeShader(const osg::Shader* shader)
+    {
+        std::string source = shader->getShaderSource();
+        osgEarth::Util::replaceIn(source, "#version " GLSL_VERSION_STR, "#version 430");
+        osg::Shader* result = new osg::Shader(osg::Shader::COMPUTE, source);
+        result->setName(shader->getName() + "_COMPUTE");
+        return result;
+    }
 }
 
 void
@@ -358,6 +389,18 @@ GroundCoverLayer::getUseAlphaToCoverage() const
     return options().alphaToCoverage().get();
 }
 
+void
+GroundCoverLayer::setComputeInstances(bool value)
+{
+    options().computeInstances() = value;
+}
+
+bool
+GroundCoverLayer::getComputeInstances() const
+{
+    return options().computeInstances().get();
+}
+
 void
 GroundCoverLayer::addedToMap(const Map* map)
 {
@@ -531,6 +574,18 @@ GroundCoverLayer::buildStateSets()
 
     float maxRangeAcrossZones = getMaxVisibleRange();
 
+    // Generate the instances once per tile with a compute shader?
+    bool computeInstances = false;
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0) && !defined(USE_GEOMETRY_SHADER) && defined(USE_INSTANCING_IN_VERTEX_SHADER)
+    if (getComputeInstances() && supportsComputeInstances())
+    {
+        if (Registry::capabilities().supportsGLSL(430u))
+            computeInstances = true;
+        else
+            OE_WARN << LC << "Compute instances require GLSL 4.3; generating instances per frame instead\n";
+    }
+#endif
+
     for (Zones::iterator z = _zones.begin(); z != _zones.end(); ++z)
     {
         Zone* zone = z->get();
@@ -539,6 +594,8 @@ GroundCoverLayer::buildStateSets()
         {
             if (!groundCover->getBiomes().empty() || groundCover->getTotalNumObjects() > 0)
             {
+                osg::ref_ptr<GroundCoverSA> groundCoverSA = new GroundCoverSA(groundCover);
+
                 osg::StateSet* zoneStateSet = groundCover->getOrCreateStateSet();
 
                 float maxDistance = osg::minimum(
@@ -612,6 +669,22 @@ GroundCoverLayer::buildStateSets()
                 zoneStateSet->setDefine("OE_GROUNDCOVER_USE_INSTANCING");
 #endif
 
+                if (computeInstances)
+                {
+                    // The compute program links the generation shader with the
+                    // same biome lookup functions as the vertex shader:
+                    osg::Program* program = new osg::Program();
+                    program->setName("GroundCover instances (" + groundCover->getName() + ")");
+                    program->addShader(new osg::Shader(
+                        osg::Shader::COMPUTE,
+                        ShaderLoader::load(shaders.GroundCover_CS, shaders, getReadOptions())));
+                    program->addShader(makeComputeShader(covTest));
+                    program->addShader(makeComputeShader(layerShader.get()));
+                    groundCoverSA->_computeProgram = program;
+
+                    zoneStateSet->setDefine("OE_GROUNDCOVER_USE_INSTANCE_BUFFER");
+                }
+
 #endif
 
                 // whether to support top-down image billboards. We disable it when not in use
@@ -628,7 +701,7 @@ GroundCoverLayer::buildStateSets()
                 zoneStateSet->setTextureAttribute(_groundCoverTexBinding.unit(), tex);
                 zoneStateSet->addUniform(new osg::Uniform(GCTEX_SAMPLER, _groundCoverTexBinding.unit()));
 
-                zoneStateSet->setAttribute(new GroundCoverSA(groundCover));
+                zoneStateSet->setAttribute(groundCoverSA.get());
             }
             else
             {
@@ -843,6 +916,52 @@ GroundCoverLayer::createGeometry(unsigned vboTileDim) const
 
 //........................................................................
 
+namespace
+{
+    struct DrawElementsIndirectCommand {
+        GLuint  count;
+        GLuint  instanceCount;
+        GLuint  firstIndex;
+        GLuint  baseVertex;
+        GLuint  baseInstance;
+    };
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+    // Draws the billboard geometry once for each instance in a tile's
+    // instance buffer. The instance count comes from the command buffer
+    // written by the compute shader.
+    struct InstanceBufferDrawCallback : public osg::Drawable::DrawCallback
+    {
+        GLuint _instanceBuffer;
+        GLuint _commandBuffer;
+
+        InstanceBufferDrawCallback() : _instanceBuffer(0), _commandBuffer(0) { }
+
+        void drawImplementation(osg::RenderInfo& ri, const osg::Drawable* drawable) const
+        {
+            osg::State& state = *ri.getState();
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+            const osg::Geometry* geom = drawable->asGeometry();
+            geom->drawVertexArraysImplementation(ri);
+
+            osg::GLBufferObject* ebo = geom->getPrimitiveSet(0)->getOrCreateGLBufferObject(state.getContextID());
+            if (ebo->isDirty())
+                ebo->compileBuffer();
+            state.getCurrentVertexArrayState()->bindElementBufferObject(ebo);
+
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INSTANCE_BUFFER, _instanceBuffer);
+
+            ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+            ext->glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_BYTE, 0, 1, 0);
+            ext->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+            ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INSTANCE_BUFFER, 0);
+        }
+    };
+#endif
+}
+
 // only used with non-GS implementation
 GroundCoverLayer::Renderer::DrawState::DrawState()
 {
@@ -859,6 +978,17 @@ GroundCoverLayer::Renderer::DrawState::DrawState()
     _tilesDrawnThisFrame = 0;
     _numInstances1D = 0;
     _instancedModelValue = -1;
+    _lastExpirationFrame = 0u;
+}
+
+GroundCoverLayer::Renderer::DrawState::TileInstances::TileInstances() :
+    _instanceBuffer(0),
+    _commandBuffer(0),
+    _numInstances(0),
+    _lastFrame(0),
+    _renderPCP(NULL)
+{
+    //nop
 }
 
 void
@@ -919,6 +1049,8 @@ GroundCoverLayer::Renderer::preDraw(osg::RenderInfo& ri, osg::ref_ptr<osg::Refer
 
     ds.reset(ri.getState(), &_settings);
 
+    expireInstances(ri.getState(), ds);
+
 #if OSG_VERSION_GREATER_OR_EQUAL(3,5,6)
     // Need to unbind any VAO since we'll be doing straight GL calls
     //ri.getState()->unbindVertexArrayObject();
@@ -930,17 +1062,6 @@ GroundCoverLayer::Renderer::preDraw(osg::RenderInfo& ri, osg::ref_ptr<osg::Refer
     //ri.getState()->bindElementBufferObject(ebo);
 }
 
-namespace
-{
-    struct DrawElementsIndirectCommand {
-        GLuint  count;
-        GLuint  instanceCount;
-        GLuint  firstIndex;
-        GLuint  baseVertex;
-        GLuint  baseInstance;
-    };
-}
-
 void
 GroundCoverLayer::Renderer::draw(osg::RenderInfo& ri, const DrawContext& tile, osg::Referenced* data)
 {
@@ -1010,6 +1131,31 @@ GroundCoverLayer::Renderer::draw(osg::RenderInfo& ri, const DrawContext& tile, o
     const GroundCoverSA* sa = GroundCoverSA::extract(ri.getState());
     osg::ref_ptr<osg::Geometry>& geom = ds._geom[sa->_groundcover];
 
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+    if (sa->_computeProgram.valid() && tile._key)
+    {
+        // generate this tile's instances unless they are already cached,
+        // and point the draw at them:
+        DrawState::TileInstances& instances = ds._tiles[std::make_pair((const void*)sa->_groundcover, *tile._key)];
+        instances._lastFrame = ri.getState()->getFrameStamp()->getFrameNumber();
+
+        if (!isTileCurrent(ri.getState(), instances) &&
+            !generateInstances(ri, ds, sa->_computeProgram.get(), instances))
+        {
+            return;
+        }
+
+        InstanceBufferDrawCallback* callback = dynamic_cast<InstanceBufferDrawCallback*>(geom->getDrawCallback());
+        if (callback == NULL)
+        {
+            callback = new InstanceBufferDrawCallback();
+            geom->setDrawCallback(callback);
+        }
+        callback->_instanceBuffer = instances._instanceBuffer;
+        callback->_commandBuffer = instances._commandBuffer;
+    }
+#endif
+
     // draw the instanced billboard geometry:
     geom->draw(ri);
 
@@ -1028,6 +1174,181 @@ GroundCoverLayer::Renderer::postDraw(osg::RenderInfo& ri, osg::Referenced* data)
 #endif
 }
 
+bool
+GroundCoverLayer::Renderer::isTileCurrent(osg::State* state, const DrawState::TileInstances& tile) const
+{
+    if (tile._instanceBuffer == 0)
+        return false;
+
+    // The matrices are only comparable in the program that generated the
+    // instances (another camera may draw with a different one)
+    const osg::Program::PerContextProgram* pcp = state->getLastAppliedProgramObject();
+    if (pcp != tile._renderPCP)
+        return true;
+
+    // A new texture matrix means the tile got new land cover or mask data
+    // (e.g. its own data replacing its parent's), so regenerate.
+    osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+    GLfloat matrix[16];
+    for (unsigned i = 0; i < tile._matrixLocations.size(); ++i)
+    {
+        ext->glGetUniformfv(pcp->getHandle(), tile._matrixLocations[i], matrix);
+        if (::memcmp(matrix, &tile._matrices[i * 16], sizeof(matrix)) != 0)
+            return false;
+    }
+    return true;
+}
+
+bool
+GroundCoverLayer::Renderer::generateInstances(osg::RenderInfo& ri, DrawState& ds, osg::Program* program, DrawState::TileInstances& tile)
+{
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,0)
+    osg::State* state = ri.getState();
+    osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+
+    const osg::Program::PerContextProgram* renderPCP = state->getLastAppliedProgramObject();
+    unsigned numInstances = ds._numInstances1D * ds._numInstances1D;
+    if (renderPCP == NULL || numInstances == 0)
+        return false;
+
+    // allocate GL objects on first run
+    if (tile._numInstances != numInstances)
+    {
+        if (tile._instanceBuffer != 0)
+        {
+            ext->glDeleteBuffers(1, &tile._instanceBuffer);
+            ext->glDeleteBuffers(1, &tile._commandBuffer);
+        }
+
+        ext->glGenBuffers(1, &tile._commandBuffer);
+        ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile._commandBuffer);
+        ext->glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+        // two vec4's per instance:
+        ext->glGenBuffers(1, &tile._instanceBuffer);
+        ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile._instanceBuffer);
+        ext->glBufferStorage(GL_SHADER_STORAGE_BUFFER, numInstances * 8 * sizeof(GLfloat), NULL, 0);
+
+        tile._numInstances = numInstances;
+    }
+
+    // Clear out the instance count (12 indices per billboard):
+    DrawElementsIndirectCommand command = { 12, 0, 0, 0, 0 };
+    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile._commandBuffer);
+    ext->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(DrawElementsIndirectCommand), &command);
+    ext->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // activate the compute shader
+    program->apply(*state);
+    const osg::Program::PerContextProgram* computePCP = state->getLastAppliedProgramObject();
+
+    if (computePCP)
+    {
+        // The terrain engine applied this tile's samplers and texture matrices
+        // to the render program. Copy them, and any other uniforms the two
+        // programs share, into the compute program.
+        tile._renderPCP = renderPCP;
+        tile._matrixLocations.clear();
+        tile._matrices.clear();
+
+        GLuint renderHandle = renderPCP->getHandle();
+        GLfloat f[16];
+        GLint i;
+
+        const osg::Program::ActiveUniformMap& uniforms = computePCP->getActiveUniforms();
+        for (osg::Program::ActiveUniformMap::const_iterator u = uniforms.begin(); u != uniforms.end(); ++u)
+        {
+            GLint renderLocation = renderPCP->getUniformLocation(u->first);
+            GLint computeLocation = u->second._location;
+            if (renderLocation < 0 || computeLocation < 0)
+                continue;
+
+            switch (u->second._type)
+            {
+            case GL_FLOAT_MAT4:
+                ext->glGetUniformfv(renderHandle, renderLocation, f);
+                ext->glUniformMatrix4fv(computeLocation, 1, GL_FALSE, f);
+                tile._matrixLocations.push_back(renderLocation);
+                tile._matrices.insert(tile._matrices.end(), f, f + 16);
+                break;
+            case GL_FLOAT:
+                ext->glGetUniformfv(renderHandle, renderLocation, f);
+                ext->glUniform1fv(computeLocation, 1, f);
+                break;
+            case GL_FLOAT_VEC2:
+                ext->glGetUniformfv(renderHandle, renderLocation, f);
+                ext->glUniform2fv(computeLocation, 1, f);
+                break;
+            case GL_FLOAT_VEC3:
+                ext->glGetUniformfv(renderHandle, renderLocation, f);
+                ext->glUniform3fv(computeLocation, 1, f);
+                break;
+            case GL_FLOAT_VEC4:
+                ext->glGetUniformfv(renderHandle, renderLocation, f);
+                ext->glUniform4fv(computeLocation, 1, f);
+                break;
+            case GL_INT:
+            case GL_SAMPLER_2D:
+                ext->glGetUniformiv(renderHandle, renderLocation, &i);
+                ext->glUniform1i(computeLocation, i);
+                break;
+            default:
+                break;
+            }
+        }
+
+        ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_COMMAND_BUFFER, tile._commandBuffer);
+        ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INSTANCE_BUFFER, tile._instanceBuffer);
+
+        // one invocation per grid cell, in 8x8 work groups
+        GLuint numGroups = (ds._numInstances1D + 7) / 8;
+        ext->glDispatchCompute(numGroups, numGroups, 1);
+
+        ext->glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_COMMAND_BUFFER, 0);
+        ext->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INSTANCE_BUFFER, 0);
+    }
+
+    // restore the render program
+    renderPCP->useProgram();
+    state->setLastAppliedProgramObject(renderPCP);
+
+    return computePCP != NULL;
+#else
+    return false;
+#endif
+}
+
+void
+GroundCoverLayer::Renderer::expireInstances(osg::State* state, DrawState& ds)
+{
+    if (ds._tiles.empty() || state->getFrameStamp() == NULL)
+        return;
+
+    unsigned frame = state->getFrameStamp()->getFrameNumber();
+    if (frame == ds._lastExpirationFrame)
+        return;
+
+    ds._lastExpirationFrame = frame;
+
+    // release the instances of tiles we have not drawn in a while
+    osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+    for (DrawState::TileInstancesMap::iterator i = ds._tiles.begin(); i != ds._tiles.end(); )
+    {
+        if (frame - i->second._lastFrame > INSTANCE_EXPIRATION_FRAMES)
+        {
+            if (i->second._instanceBuffer != 0)
+            {
+                ext->glDeleteBuffers(1, &i->second._instanceBuffer);
+                ext->glDeleteBuffers(1, &i->second._commandBuffer);
+            }
+            ds._tiles.erase(i++);
+        }
+        else ++i;
+    }
+}
+
 void
 GroundCoverLayer::Renderer::resizeGLObjectBuffers(unsigned maxSize)
 {
@@ -1063,6 +1384,12 @@ GroundCoverLayer::Renderer::releaseGLObjects(osg::State* state) const
                 j->second->releaseGLObjects(state);
             }
         }
+
+        // forget the cached instances; their buffers go away with the context
+        if (state == NULL || state->getContextID() == i)
+        {
+            const_cast<DrawState&>(ds)._tiles.clear();
+        }
     }
 }
 
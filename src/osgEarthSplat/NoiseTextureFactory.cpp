@@ -54,6 +54,12 @@ NoiseTextureFactory::create(unsigned dim, unsigned chans) const
     const float L[4] = { 2.2f,  1.0f,  1.0f, 4.0f };
 
     Random random(0, Random::METHOD_FAST);
+
+    std::vector<double> coords(dim);
+    for(unsigned i=0; i<dim; ++i)
+        coords[i] = (double)i/(double)dim;
+
+    std::vector<double> values;
     
     for(unsigned k=0; k<chans; ++k)
     {
@@ -74,12 +80,17 @@ NoiseTextureFactory::create(unsigned dim, unsigned chans) const
         ImageUtils::PixelWriter write( image );
         osg::Vec4f v;
 
+        // simplex channels: generate the whole tiled grid in parallel
+        if ( k != 1 && k != 2 && dim > 0 )
+        {
+            values.resize(dim*dim);
+            noise.getTiledValues(&coords[0], dim, &coords[0], dim, &values[0], true);
+        }
+
         for(int t=0; t<(int)dim; ++t)
         {
-            double rt = (double)t/(double)dim;
             for(int s=0; s<(int)dim; ++s)
             {
-                double rs = (double)s/(double)dim;
                 read(v, s, t);
                 double n;
 
@@ -89,7 +100,7 @@ NoiseTextureFactory::create(unsigned dim, unsigned chans) const
                 }
                 else
                 {
-                    n = noise.getTiledValue(rs, rt);
+                    n = values[t*dim + s];
                     n = osg::clampBetween(n, 0.0, 1.0);
                 }
 
@@ -34,6 +34,10 @@
 #define NOISE_SAMPLER    "oe_splat_noiseTex"
 #define LUT_SAMPLER      "oe_splat_coverageLUT"
 
+// Frames to hold on to unloaded zone textures, in case a draw
+// thread still references them
+#define RETIRED_TEXTURE_FRAMES 5
+
 using namespace osgEarth::Splat;
 
 REGISTER_OSGEARTH_LAYER(splat, SplatLayer);
@@ -47,6 +51,7 @@ SplatLayer::Options::getConfig() const
 {
     Config conf = VisibleLayer::Options::getConfig();
     conf.set("land_cover_layer", landCoverLayer() );
+    conf.set("max_texture_memory_mb", maxTextureMemoryMB() );
 
     Config zones("zones");
     for (int i = 0; i < _zones.size(); ++i) {
@@ -62,7 +67,10 @@ SplatLayer::Options::getConfig() const
 void
 SplatLayer::Options::fromConfig(const Config& conf)
 {
+    maxTextureMemoryMB().init(0u);
+
     conf.get("land_cover_layer", landCoverLayer() );
+    conf.get("max_texture_memory_mb", maxTextureMemoryMB() );
 
     const Config* zones = conf.child_ptr("zones");
     if (zones) {
@@ -107,10 +115,22 @@ SplatLayer::ZoneSelector::operator()(osg::Node* node, osg::NodeVisitor* nv) cons
             }
 
             osg::StateSet* zoneStateSet = 0L;
-            Surface* surface = _layer->_zones[zoneIndex]->getSurface();
-            if (surface)
+
+            if (_layer->_streaming)
+            {
+                zoneStateSet = _layer->getResidentStateSet(zoneIndex, cv->getFrameStamp()->getFrameNumber());
+
+                // textures are still loading; draw nothing until they arrive
+                if (zoneStateSet == 0L)
+                    return;
+            }
+            else
             {
-                zoneStateSet = surface->getStateSet();
+                Surface* surface = _layer->_zones[zoneIndex]->getSurface();
+                if (surface)
+                {
+                    zoneStateSet = surface->getStateSet();
+                }
             }
 
             if (zoneStateSet == 0L)
@@ -139,6 +159,8 @@ SplatLayer::init()
     VisibleLayer::init();
 
     _zonesConfigured = false;
+    _streaming = false;
+    _residentBytes = 0u;
 
     _editMode = (::getenv("OSGEARTH_SPLAT_EDIT") != 0L); // TODO deprecate
     _gpuNoise = (::getenv("OSGEARTH_SPLAT_GPU_NOISE") != 0L); // TODO deprecate
@@ -156,6 +178,18 @@ SplatLayer::init()
     setCullCallback(new ZoneSelector(this));
 }
 
+void
+SplatLayer::setMaxTextureMemoryMB(unsigned value)
+{
+    options().maxTextureMemoryMB() = value;
+}
+
+unsigned
+SplatLayer::getMaxTextureMemoryMB() const
+{
+    return options().maxTextureMemoryMB().get();
+}
+
 void
 SplatLayer::setLandCoverDictionary(LandCoverDictionary* layer)
 {
@@ -265,41 +299,63 @@ SplatLayer::buildStateSets()
     //    return;
     //}
 
-    // Load all the splatting textures
     for (Zones::iterator z = _zones.begin(); z != _zones.end(); ++z)
     {
         Zone* zone = z->get();
-        Surface* surface = z->get()->getSurface();
-        if (surface == 0L)
+        if (zone->getSurface() == 0L)
         {
             OE_WARN << LC << "No surface defined for zone " << zone->getName() << std::endl;
             return;
         }
-        if (surface->loadTextures(getLandCoverDictionary(), getReadOptions()) == false)
-        {
-            OE_WARN << LC << "Texture load failed for zone " << zone->getName() << "\n";
-            return;
-        }
     }
 
-    // Set up the zone-specific elements:
-    for (Zones::iterator z = _zones.begin(); z != _zones.end(); ++z)
+    _streaming = getMaxTextureMemoryMB() > 0u;
+
+    if (_streaming)
     {
-        Zone* zone = z->get();
+        // Zone textures load on demand; see getResidentStateSet.
+        Threading::ScopedMutexLock lock(_residencyMutex);
+        _residency.clear();
+        _residency.resize(_zones.size());
+        _residentBytes = 0u;
 
-        osg::StateSet* zoneStateset = zone->getSurface()->getOrCreateStateSet();
-        zoneStateset->setName("Splat Zone");
+        if (!_loadPool.valid())
+            _loadPool = new Threading::ThreadPool(1u);
 
-        // The texture array for the zone:
-        const SplatTextureDef& texdef = zone->getSurface()->getTextureDef();
+        OE_INFO << LC << "Streaming zone textures with a budget of " << getMaxTextureMemoryMB() << " MB\n";
+    }
+    else
+    {
+        // Load all the splatting textures
+        for (Zones::iterator z = _zones.begin(); z != _zones.end(); ++z)
+        {
+            Zone* zone = z->get();
+            if (zone->getSurface()->loadTextures(getLandCoverDictionary(), getReadOptions()) == false)
+            {
+                OE_WARN << LC << "Texture load failed for zone " << zone->getName() << "\n";
+                return;
+            }
+        }
+
+        // Set up the zone-specific elements:
+        for (Zones::iterator z = _zones.begin(); z != _zones.end(); ++z)
+        {
+            Zone* zone = z->get();
 
-        // apply the splatting texture catalog:
-        zoneStateset->setTextureAttribute(_splatBinding.unit(), texdef._texture.get());
+            osg::StateSet* zoneStateset = zone->getSurface()->getOrCreateStateSet();
+            zoneStateset->setName("Splat Zone");
 
-        // apply the buffer containing the coverage-to-splat LUT:
-        zoneStateset->setTextureAttribute(_lutBinding.unit(), texdef._splatLUTBuffer.get());
+            // The texture array for the zone:
+            const SplatTextureDef& texdef = zone->getSurface()->getTextureDef();
 
-        OE_DEBUG << LC << "Installed getRenderInfo for zone \"" << zone->getName() << "\" (uid=" << zone->getUID() << ")\n";
+            // apply the splatting texture catalog:
+            zoneStateset->setTextureAttribute(_splatBinding.unit(), texdef._texture.get());
+
+            // apply the buffer containing the coverage-to-splat LUT:
+            zoneStateset->setTextureAttribute(_lutBinding.unit(), texdef._splatLUTBuffer.get());
+
+            OE_DEBUG << LC << "Installed getRenderInfo for zone \"" << zone->getName() << "\" (uid=" << zone->getUID() << ")\n";
+        }
     }
 
     // Next set up the elements that apply to all zones:
@@ -343,6 +399,143 @@ SplatLayer::buildStateSets()
     OE_DEBUG << LC << "Statesets built!! Ready!\n";
 }
 
+//........................................................................
+
+struct SplatLayer::LoadZoneTexturesOperation : public osg::Operation
+{
+    LoadZoneTexturesOperation(SplatLayer* layer, int zoneIndex, Threading::Promise<ZoneTextures> promise) :
+        osg::Operation("SplatLayer zone textures", false),
+        _layer(layer),
+        _zoneIndex(zoneIndex),
+        _promise(promise)
+    {
+    }
+
+    void operator()(osg::Object*)
+    {
+        osg::ref_ptr<ZoneTextures> textures;
+        osg::ref_ptr<SplatLayer> layer;
+        if (!_promise.isAbandoned() && _layer.lock(layer))
+        {
+            textures = layer->loadZoneTextures(_zoneIndex);
+        }
+        // resolve even on failure so the cull thread stops waiting
+        _promise.resolve(textures.get());
+    }
+
+    osg::observer_ptr<SplatLayer> _layer;
+    int _zoneIndex;
+    Threading::Promise<ZoneTextures> _promise;
+};
+
+SplatLayer::ZoneTextures*
+SplatLayer::loadZoneTextures(int zoneIndex)
+{
+    Zone* zone = _zones[zoneIndex].get();
+    Surface* surface = zone->getSurface();
+
+    if (surface->loadTextures(getLandCoverDictionary(), getReadOptions()) == false)
+    {
+        OE_WARN << LC << "Texture load failed for zone " << zone->getName() << "\n";
+        return 0L;
+    }
+
+    const SplatTextureDef& texdef = surface->getTextureDef();
+
+    ZoneTextures* textures = new ZoneTextures();
+    textures->_stateSet = new osg::StateSet();
+    textures->_stateSet->setName("Splat Zone");
+    textures->_stateSet->setTextureAttribute(_splatBinding.unit(), texdef._texture.get());
+    textures->_stateSet->setTextureAttribute(_lutBinding.unit(), texdef._splatLUTBuffer.get());
+    textures->_bytes = surface->getTextureSizeInBytes();
+
+    OE_INFO << LC << "Loaded textures for zone \"" << zone->getName() << "\" ("
+        << (textures->_bytes / 1048576u) << " MB)\n";
+
+    return textures;
+}
+
+osg::StateSet*
+SplatLayer::getResidentStateSet(int zoneIndex, unsigned frame)
+{
+    Threading::ScopedMutexLock lock(_residencyMutex);
+
+    if (zoneIndex >= (int)_residency.size())
+        return 0L;
+
+    ZoneResidency& zone = _residency[zoneIndex];
+    zone._lastFrame = frame;
+
+    if (!zone._textures.valid() && !zone._failed)
+    {
+        if (zone._future.isAvailable())
+        {
+            zone._textures = zone._future.release();
+            zone._future = Threading::Future<ZoneTextures>();
+
+            if (zone._textures.valid())
+            {
+                _residentBytes += zone._textures->_bytes;
+                evictZoneTextures(frame);
+            }
+            else
+            {
+                // don't retry a zone that failed to load
+                zone._failed = true;
+            }
+        }
+        else if (zone._future.isAbandoned())
+        {
+            Threading::Promise<ZoneTextures> promise;
+            zone._future = promise.getFuture();
+            _loadPool->getQueue()->add(new LoadZoneTexturesOperation(this, zoneIndex, promise));
+        }
+    }
+
+    // let go of unloaded textures once no draw can still be using them
+    while (!_retired.empty() && _retired.front().second + RETIRED_TEXTURE_FRAMES < frame)
+    {
+        _retired.erase(_retired.begin());
+    }
+
+    return zone._textures.valid() ? zone._textures->_stateSet.get() : 0L;
+}
+
+void
+SplatLayer::evictZoneTextures(unsigned frame)
+{
+    // Caller holds _residencyMutex.
+    unsigned maxBytes = getMaxTextureMemoryMB() * 1024u * 1024u;
+
+    while (_residentBytes > maxBytes)
+    {
+        // least recently used zone not needed this frame
+        int lru = -1;
+        for (unsigned i = 0; i < _residency.size(); ++i)
+        {
+            const ZoneResidency& zone = _residency[i];
+            if (zone._textures.valid() && zone._lastFrame < frame &&
+                (lru < 0 || zone._lastFrame < _residency[lru]._lastFrame))
+            {
+                lru = i;
+            }
+        }
+
+        if (lru < 0)
+            break;
+
+        ZoneResidency& zone = _residency[lru];
+        _residentBytes -= zone._textures->_bytes;
+        _retired.push_back(std::make_pair(zone._textures, frame));
+        zone._textures = 0L;
+
+        _zones[lru]->getSurface()->unloadTextures();
+
+        OE_INFO << LC << "Unloaded textures for zone \"" << _zones[lru]->getName() << "\"\n";
+    }
+}
+
+//........................................................................
 
 void
 SplatLayer::resizeGLObjectBuffers(unsigned maxSize)
@@ -352,6 +545,15 @@ SplatLayer::resizeGLObjectBuffers(unsigned maxSize)
         z->get()->resizeGLObjectBuffers(maxSize);
     }
 
+    {
+        Threading::ScopedMutexLock lock(_residencyMutex);
+        for (unsigned i = 0; i < _residency.size(); ++i)
+        {
+            if (_residency[i]._textures.valid())
+                _residency[i]._textures->_stateSet->resizeGLObjectBuffers(maxSize);
+        }
+    }
+
     VisibleLayer::resizeGLObjectBuffers(maxSize);
 }
 
@@ -363,6 +565,19 @@ SplatLayer::releaseGLObjects(osg::State* state) const
         z->get()->releaseGLObjects(state);
     }
 
+    {
+        Threading::ScopedMutexLock lock(_residencyMutex);
+        for (unsigned i = 0; i < _residency.size(); ++i)
+        {
+            if (_residency[i]._textures.valid())
+                _residency[i]._textures->_stateSet->releaseGLObjects(state);
+        }
+        for (unsigned i = 0; i < _retired.size(); ++i)
+        {
+            _retired[i].first->_stateSet->releaseGLObjects(state);
+        }
+    }
+
     VisibleLayer::releaseGLObjects(state);
 
     // For some unknown reason, release doesn't work on the zone 
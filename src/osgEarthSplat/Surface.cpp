@@ -86,6 +86,46 @@ Surface::loadTextures(const LandCoverDictionary* landCoverDict, const osgDB::Opt
     return true;
 }
 
+void
+Surface::unloadTextures()
+{
+    _textureDef._texture = 0L;
+    _textureDef._splatLUTBuffer = 0L;
+}
+
+unsigned
+Surface::getTextureSizeInBytes() const
+{
+    unsigned bytes = 0u;
+
+    const osg::Texture2DArray* tex = _textureDef._texture.get();
+    if (tex)
+    {
+        for (unsigned i = 0; i < tex->getNumImages(); ++i)
+        {
+            const osg::Image* image = tex->getImage(i);
+            if (image)
+            {
+                unsigned imageBytes = image->getTotalSizeInBytesIncludingMipmaps();
+
+                // the GPU generates the mipmaps when the image has none
+                if (!image->isMipmap())
+                    imageBytes += imageBytes / 3u;
+
+                bytes += imageBytes;
+            }
+        }
+    }
+
+    const osg::TextureBuffer* lut = dynamic_cast<const osg::TextureBuffer*>(_textureDef._splatLUTBuffer.get());
+    if (lut && lut->getImage())
+    {
+        bytes += lut->getImage()->getTotalSizeInBytes();
+    }
+
+    return bytes;
+}
+
 #define NUM_FLOATS_PER_LOD 6
 #define NUM_LODS 26
 #define NUM_CLASSES 256
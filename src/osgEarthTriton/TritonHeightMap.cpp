@@ -94,11 +94,17 @@ namespace
     {
         osg::observer_ptr<TritonHeightMap> _hm;
         TerrainDirtyCallback(TritonHeightMap* hm) : _hm(hm) { }
-        void onTileUpdate(const osgEarth::TileKey&, osg::Node*, osgEarth::TerrainCallbackContext&)
+        void onTileUpdate(const osgEarth::TileKey& key, osg::Node*, osgEarth::TerrainCallbackContext&)
         {
             osg::ref_ptr<TritonHeightMap> hm;
             if (_hm.lock(hm))
-                hm->dirty();
+            {
+                // only the height maps that can see the tile care about it
+                if (key.valid())
+                    hm->dirty(key.getExtent().createWorldBoundingSphere(-11000.0, 9000.0));
+                else
+                    hm->dirty();
+            }
         }
     };
 }
@@ -106,7 +112,8 @@ namespace
 TritonHeightMap::TritonHeightMap() :
 _texSize(0u),
 _internalFormat((GLint)0),
-_sourceFormat((GLenum)0)
+_sourceFormat((GLenum)0),
+_threshold(0.05)
 {
     setCullingActive(false);
 }
@@ -144,7 +151,30 @@ TritonHeightMap::setMaskLayer(const osgEarth::ImageLayer* layer)
 void
 TritonHeightMap::SetDirty::operator()(CameraLocal& local)
 {
-    local._mvpw.makeIdentity();
+    local._dirty = true;
+}
+
+void
+TritonHeightMap::SetDirtyInBounds::operator()(CameraLocal& local)
+{
+    // the map covers a cylinder of radius horizonDistance around the
+    // eye's vertical axis, clipped at the eye
+    if (local._horizonDistance <= 0.0)
+    {
+        local._dirty = true;
+        return;
+    }
+
+    osg::Vec3d axis = local._eye;
+    axis.normalize();
+    osg::Vec3d toCenter = _bounds.center() - local._eye;
+    double along = toCenter * axis;
+    double across = (toCenter - axis*along).length();
+
+    if (across <= local._horizonDistance + _bounds.radius() && along <= _bounds.radius())
+    {
+        local._dirty = true;
+    }
 }
 
 void
@@ -154,6 +184,13 @@ TritonHeightMap::dirty()
     _local.forEach(setDirty);
 }
 
+void
+TritonHeightMap::dirty(const osg::BoundingSphered& bounds)
+{
+    SetDirtyInBounds setDirty(bounds);
+    _local.forEach(setDirty);
+}
+
 bool
 TritonHeightMap::configure(unsigned texSize, osg::State& state)
 {
@@ -284,6 +321,8 @@ TritonHeightMap::setup(CameraLocal& local, const std::string& name)
         return;
 
     local._frameNum = 0u;
+    local._horizonDistance = 0.0;
+    local._dirty = true;
 
     local._tex = new osg::Texture2D();
     local._tex->setName(Stringify() << "Triton HM (" << name << ")");
@@ -352,6 +391,20 @@ TritonHeightMap::setup(CameraLocal& local, const std::string& name)
 #define MAXABS4(A,B,C,D) \
     osg::maximum(fabs(A), osg::maximum(fabs(B), osg::maximum(fabs(C),fabs(D))))
 
+bool
+TritonHeightMap::needsRegeneration(const CameraLocal& local, const osg::Vec3d& eye, double horizonDistance) const
+{
+    if (local._dirty || local._horizonDistance <= 0.0)
+        return true;
+
+    // The map is an ortho view straight down from the eye, sized to the
+    // horizon distance; it only goes stale as the eye moves.
+    double limit = local._horizonDistance * _threshold;
+    return
+        (eye - local._eye).length() > limit ||
+        fabs(horizonDistance - local._horizonDistance) > limit;
+}
+
 void
 TritonHeightMap::update(CameraLocal& local, const osg::Camera* cam, osgEarth::Horizon* horizon)
 {
@@ -359,6 +412,10 @@ TritonHeightMap::update(CameraLocal& local, const osg::Camera* cam, osgEarth::Ho
 
     double hd = horizon->getDistanceToVisibleHorizon();
 
+    local._eye = eye;
+    local._horizonDistance = hd;
+    local._dirty = false;
+
     local._rtt->setProjectionMatrix(osg::Matrix::ortho(-hd, hd, -hd, hd, 1.0, eye.length()));
     local._rtt->setViewMatrixAsLookAt(eye, osg::Vec3d(0.0,0.0,0.0), osg::Vec3d(0.0,0.0,1.0));
 
@@ -391,18 +448,18 @@ TritonHeightMap::traverse(osg::NodeVisitor& nv)
                     setup(local, camera->getName());
                 }
 
-                // only update when the MVPW changes.
-                if (local._mvpw != *cv->getMVPW())
+                // only regenerate when the eye moves far enough or the terrain changes.
+                osgEarth::Horizon* horizon = osgEarth::Horizon::get(nv);
+                osg::Vec3d eye = osg::Vec3d(0,0,0) * camera->getInverseViewMatrix();
+                if (horizon && needsRegeneration(local, eye, horizon->getDistanceToVisibleHorizon()))
                 {
                     // update the RTT based on the current camera:
-                    osgEarth::Horizon* horizon = osgEarth::Horizon::get(nv);
                     update(local, camera, horizon);
 
                     // finally, traverse the camera to build the height map.
                     local._rtt->accept(nv);
                     
                     local._frameNum = nv.getFrameStamp()->getFrameNumber();
-                    local._mvpw = *cv->getMVPW();
                 }
            }
            else
@@ -130,6 +130,7 @@ namespace osgEarth { namespace Triton
             {
                 TritonHeightMap* heightMapGen = new TritonHeightMap();
                 heightMapGen->setTerrain(mapNode->getTerrainEngine());
+                heightMapGen->setRegenerationThreshold(_tritonLayer->getHeightMapThreshold());
                 if (_maskLayer.getLayer())
                     heightMapGen->setMaskLayer(_maskLayer.getLayer());
                 this->addChild(heightMapGen);
@@ -258,6 +259,7 @@ TritonLayer::Options::fromConfig(const osgEarth::Config& conf)
 {
     _useHeightMap.init(true);
     _heightMapSize.init(1024);
+    _heightMapThreshold.init(0.05);
     _renderBinNumber.init(12);
     _maxAltitude.init(50000);
 
@@ -265,6 +267,7 @@ TritonLayer::Options::fromConfig(const osgEarth::Config& conf)
     conf.get("resource_path", _resourcePath);
     conf.get("use_height_map", _useHeightMap);
     conf.get("height_map_size", _heightMapSize);
+    conf.get("height_map_threshold", _heightMapThreshold);
     conf.get("render_bin_number", _renderBinNumber);
     conf.get("max_altitude", _maxAltitude);
     maskLayer().get(conf, "mask_layer");
@@ -278,6 +281,7 @@ TritonLayer::Options::getConfig() const
     conf.set("resource_path", _resourcePath);
     conf.set("use_height_map", _useHeightMap);
     conf.set("height_map_size", _heightMapSize);
+    conf.set("height_map_threshold", _heightMapThreshold);
     conf.set("render_bin_number", _renderBinNumber);
     conf.set("max_altitude", _maxAltitude);
     maskLayer().set(conf, "mask_layer");
@@ -299,6 +303,7 @@ OE_LAYER_PROPERTY_IMPL(TritonLayer, std::string, LicenseCode, licenseCode);
 OE_LAYER_PROPERTY_IMPL(TritonLayer, std::string, ResourcePath, resourcePath);
 OE_LAYER_PROPERTY_IMPL(TritonLayer, bool, UseHeightMap, useHeightMap);
 OE_LAYER_PROPERTY_IMPL(TritonLayer, unsigned, HeightMapSize, heightMapSize);
+OE_LAYER_PROPERTY_IMPL(TritonLayer, double, HeightMapThreshold, heightMapThreshold);
 OE_LAYER_PROPERTY_IMPL(TritonLayer, int, RenderBinNumber, renderBinNumber);
 OE_LAYER_PROPERTY_IMPL(TritonLayer, float, MaxAltitude, maxAltitude);
 
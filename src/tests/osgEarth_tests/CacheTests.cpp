@@ -24,6 +24,12 @@
 #include <osgEarth/GeoData>
 #include <osgEarth/Registry>
 #include <osgEarth/Cache>
+#include <osgEarth/CacheCodec>
+#include <osgEarth/WriteBehindCacheBin>
+#include <osgEarth/MemCache>
+#include <osgEarth/TileVisitor>
+#include <osgEarth/FileUtils>
+#include <osgDB/FileNameUtils>
 
 using namespace osgEarth;
 
@@ -82,4 +88,155 @@ TEST_CASE( "Cache" ) {
         ReadResult r2 = bin->readImage(key, 0L);
         REQUIRE(r2.failed());
     }  
+
+    SECTION("WriteBehind")
+    {
+        osg::ref_ptr<WriteBehindCacheBin> wb = new WriteBehindCacheBin(bin.get(), 4u);
+
+        std::string key("write_behind_key");
+        osg::ref_ptr<StringObject> s1 = new StringObject("first");
+        osg::ref_ptr<StringObject> s2 = new StringObject("second");
+
+        // The second write replaces the first one
+        REQUIRE(wb->write(key, s1.get(), 0L));
+        REQUIRE(wb->write(key, s2.get(), 0L));
+
+        // Reads see the latest write whether or not it landed yet
+        ReadResult r = wb->readString(key, 0L);
+        REQUIRE(r.succeeded());
+        REQUIRE(r.getString().compare("second") == 0);
+
+        // After a flush, the underlying bin has it
+        wb->flush();
+        REQUIRE(wb->getNumPending() == 0u);
+        ReadResult r2 = bin->readString(key, 0L);
+        REQUIRE(r2.succeeded());
+        REQUIRE(r2.getString().compare("second") == 0);
+
+        // More writes than the queue holds still all arrive
+        for (unsigned i = 0; i < 32; ++i)
+        {
+            osg::ref_ptr<StringObject> s = new StringObject("value");
+            REQUIRE(wb->write(Stringify() << key << i, s.get(), 0L));
+        }
+        wb->flush();
+        for (unsigned i = 0; i < 32; ++i)
+        {
+            REQUIRE(bin->readString(Stringify() << key << i, 0L).succeeded());
+            REQUIRE(bin->remove(Stringify() << key << i));
+        }
+
+        REQUIRE(wb->remove(key));
+        REQUIRE(wb->readString(key, 0L).failed());
+    }
+}
+
+TEST_CASE( "MemCache budget" ) {
+
+    // 1MB: one shard, room for about 50 of these images
+    osg::ref_ptr<MemCache> cache = new MemCache(16u, 1048576u);
+    CacheBin* bin = cache->getOrCreateDefaultBin();
+    REQUIRE(bin != 0L);
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(64, 64, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    // A small working set, read many times:
+    for (unsigned pass = 0; pass < 10; ++pass)
+    {
+        for (unsigned i = 0; i < 8; ++i)
+        {
+            std::string key = Stringify() << "hot" << i;
+            if (bin->readImage(key, 0L).failed())
+                bin->write(key, image.get(), 0L);
+        }
+    }
+
+    // A long scan of keys read once each must not flush the working set:
+    for (unsigned i = 0; i < 500; ++i)
+    {
+        std::string key = Stringify() << "scan" << i;
+        if (bin->readImage(key, 0L).failed())
+            bin->write(key, image.get(), 0L);
+    }
+
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        REQUIRE(bin->readImage(Stringify() << "hot" << i, 0L).succeeded());
+    }
+
+    MemCache::Stats stats;
+    REQUIRE(cache->getDefaultBinStats(stats));
+    REQUIRE(stats._bytes <= stats._maxBytes);
+    REQUIRE(stats._rejections > 0u);
+
+    REQUIRE(cache->clear());
+    REQUIRE(bin->readImage("hot0", 0L).failed());
+}
+
+TEST_CASE( "CacheCodec" ) {
+
+    if (CacheCodec::isAvailable("zlib"))
+    {
+        osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+        hf->allocate(17, 17);
+        for (unsigned i = 0; i < hf->getHeightList().size(); ++i)
+            hf->getHeightList()[i] = 100.0f + 0.5f*(float)i;
+
+        std::stringstream buf;
+        REQUIRE(CacheCodec::encode(hf.get(), "zlib", buf, 0L));
+        REQUIRE(CacheCodec::isEncoded(buf));
+
+        osg::ref_ptr<osg::Object> object = CacheCodec::decode(buf, 0L);
+        osg::HeightField* out = dynamic_cast<osg::HeightField*>(object.get());
+        REQUIRE(out != 0L);
+        REQUIRE(out->getNumColumns() == 17u);
+        REQUIRE(out->getNumRows() == 17u);
+        REQUIRE(out->getHeightList() == hf->getHeightList());
+    }
+
+    // Objects the codec does not apply to are left to the caller
+    osg::ref_ptr<StringObject> s = new StringObject("value");
+    std::stringstream buf;
+    REQUIRE_FALSE(CacheCodec::encode(s.get(), "zlib", buf, 0L));
+    REQUIRE(buf.str().empty());
+}
+
+namespace
+{
+    struct CountingTileHandler : public osgEarth::Util::TileHandler
+    {
+        OpenThreads::Atomic _count;
+
+        virtual bool handleTile(const TileKey& key, const osgEarth::Util::TileVisitor& tv)
+        {
+            ++_count;
+            return true;
+        }
+    };
+}
+
+TEST_CASE( "ParallelTileVisitor resumes from its journal" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    std::string journal = getTempName(osgDB::concatPaths(getTempPath(), "seed"), ".journal");
+
+    osg::ref_ptr<CountingTileHandler> handler = new CountingTileHandler();
+    osg::ref_ptr<osgEarth::Util::ParallelTileVisitor> visitor = new osgEarth::Util::ParallelTileVisitor(handler.get());
+    visitor->setNumThreads(4);
+    visitor->setMaxLevel(3);
+    visitor->setCheckpointLevel(1);
+    visitor->setJournal(journal);
+
+    // two root tiles, 4x more at each level
+    visitor->run(profile);
+    REQUIRE((unsigned)handler->_count == 2u + 8u + 32u + 128u);
+    REQUIRE(visitor->getNumTilesHandled() == 170u);
+
+    // every checkpoint subtree is in the journal, so only the roots remain
+    handler->_count.exchange(0);
+    visitor->run(profile);
+    REQUIRE((unsigned)handler->_count == 2u);
+
+    remove(journal.c_str());
 }
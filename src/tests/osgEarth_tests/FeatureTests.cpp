@@ -24,9 +24,50 @@
 
 #include <osgEarth/Feature>
 #include <osgEarth/GeometryUtils>
+#include <osgEarth/FeatureBatch>
+#include <osgEarth/FeatureCursor>
+#include <osgEarth/FeatureSource>
+#include <osgEarth/Registry>
+#include <osgEarth/PackedRTree>
+#include <osgEarth/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <cstdio>
 
 using namespace osgEarth;
 
+namespace
+{
+    // Untiled feature source that counts how often it is queried
+    class CountingFeatureSource : public FeatureSource
+    {
+    public:
+        META_Layer(osgEarth, CountingFeatureSource, FeatureSource::Options, FeatureSource, counting_features);
+
+        virtual void init()
+        {
+            FeatureSource::init();
+            _queries = 0;
+        }
+
+        virtual FeatureCursor* createFeatureCursor(const Query& query, ProgressCallback* progress)
+        {
+            ++_queries;
+            FeatureList output;
+            GeoExtent extent = query.tileKey()->getExtent();
+            for (FeatureList::iterator i = _features.begin(); i != _features.end(); ++i)
+            {
+                if (extent.intersects(i->get()->getExtent()))
+                    output.push_back(i->get());
+            }
+            return new FeatureListCursor(output);
+        }
+
+        FeatureList _features;
+        int _queries;
+    };
+}
+
 TEST_CASE("Feature::splitAcrossDateLine doesn't modify features that don't cross the dateline") {
     osg::ref_ptr< Feature > feature = new Feature(GeometryUtils::geometryFromWKT("POLYGON((-81 26, -40.5 45, -40.5 75.5, -81 60))"), osgEarth::SpatialReference::create("wgs84"));
     FeatureList features;
@@ -103,3 +144,180 @@ TEST_CASE("Feature handles attributes correctly.") {
         REQUIRE(feature->getBool("bool") == false);
     }
 }
+
+TEST_CASE("FeatureBatch round-trips features") {
+    const SpatialReference* wgs84 = SpatialReference::create("wgs84");
+    osg::ref_ptr< Feature > polygon = new Feature(GeometryUtils::geometryFromWKT("POLYGON((0 0, 10 0, 10 10, 0 10), (2 2, 4 2, 4 4))"), wgs84, Style(), 1);
+    polygon->set("name", std::string("first"));
+    polygon->set("height", 12.5);
+    osg::ref_ptr< Feature > lines = new Feature(GeometryUtils::geometryFromWKT("MULTILINESTRING((0 0, 1 1), (2 2, 3 3, 4 4))"), wgs84, Style(), 2);
+    lines->set("lanes", 4);
+
+    FeatureList input;
+    input.push_back(polygon.get());
+    input.push_back(lines.get());
+
+    osg::ref_ptr<FeatureBatch> batch = new FeatureBatch();
+    batch->add(input);
+    REQUIRE(batch->getNumFeatures() == 2);
+    REQUIRE(batch->getNumParts() == 4);
+    REQUIRE((int)batch->getNumPoints() == polygon->getGeometry()->getTotalPointCount() + lines->getGeometry()->getTotalPointCount());
+
+    FeatureList output;
+    batch->toFeatures(output);
+    REQUIRE(output.size() == 2);
+
+    Feature* f0 = output.front().get();
+    REQUIRE(f0->getFID() == 1);
+    REQUIRE(f0->getGeometry()->getType() == Geometry::TYPE_POLYGON);
+    REQUIRE(static_cast<Polygon*>(f0->getGeometry())->getHoles().size() == 1);
+    REQUIRE(f0->getString("name") == "first");
+    REQUIRE(f0->getDouble("height") == 12.5);
+    REQUIRE_FALSE(f0->hasAttr("lanes"));
+
+    Feature* f1 = output.back().get();
+    REQUIRE(f1->getGeometry()->getType() == Geometry::TYPE_MULTI);
+    REQUIRE(f1->getGeometry()->getTotalPointCount() == 5);
+    REQUIRE(f1->getInt("lanes") == 4);
+    REQUIRE_FALSE(f1->hasAttr("name"));
+}
+
+TEST_CASE("Compiled NumericExpression evaluation matches Feature::eval") {
+    NumericExpression expr("([height]*2 + [floors]) / 2");
+    REQUIRE(expr.variables().size() == 2);
+
+    double values[2] = { 10.0, 4.0 };
+    REQUIRE(expr.eval(values) == 12.0);
+
+    FeatureList features;
+    for (int i = 0; i < 4; ++i)
+    {
+        Feature* f = new Feature(new PointSet(), 0L, Style(), i);
+        f->set("HEIGHT", 5.0 * i);
+        f->set("floors", i + 1);
+        features.push_back(f);
+    }
+
+    osg::ref_ptr<FeatureBatch> batch = new FeatureBatch();
+    batch->add(features);
+
+    std::vector<double> output;
+    REQUIRE(batch->eval(expr, output));
+    REQUIRE(output.size() == features.size());
+
+    unsigned f = 0;
+    for (FeatureList::iterator i = features.begin(); i != features.end(); ++i, ++f)
+    {
+        REQUIRE((*i)->eval(expr, (const FilterContext*)0L) == output[f]);
+    }
+
+    // not every feature has the attribute
+    features.front()->set("other", 1.0);
+    batch = new FeatureBatch();
+    batch->add(features);
+    REQUIRE_FALSE(batch->eval(NumericExpression("[other]"), output));
+}
+
+TEST_CASE("PrefetchFeatureCursor returns every feature in order") {
+    FeatureList input;
+    for (int i = 0; i < 1234; ++i)
+    {
+        input.push_back(new Feature(new PointSet(), 0L, Style(), i));
+    }
+
+    osg::ref_ptr<FeatureCursor> cursor = new PrefetchFeatureCursor(new FeatureListCursor(input), 100u, 3u);
+
+    FeatureList output;
+    REQUIRE(cursor->nextBatch(output, 50u) == 50u);
+    while (cursor->hasMore())
+    {
+        output.push_back(cursor->nextFeature());
+    }
+    REQUIRE(cursor->nextBatch(output, 50u) == 0u);
+
+    REQUIRE(output.size() == input.size());
+    int expected = 0;
+    for (FeatureList::iterator i = output.begin(); i != output.end(); ++i)
+    {
+        REQUIRE((*i)->getFID() == expected++);
+    }
+}
+
+TEST_CASE("FeatureTileCache serves child tiles from a cached parent") {
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    osg::ref_ptr<CountingFeatureSource> source = new CountingFeatureSource();
+    source->setTileCacheSizeMB(16u);
+    source->setFeatureProfile(new FeatureProfile(profile->getExtent()));
+    source->_features.push_back(new Feature(GeometryUtils::geometryFromWKT("POLYGON((-101 -41, -99 -41, -99 -39, -101 -39))"), profile->getSRS(), Style(), 1));
+    source->_features.push_back(new Feature(GeometryUtils::geometryFromWKT("POLYGON((-101 39, -99 39, -99 41, -101 41))"), profile->getSRS(), Style(), 2));
+    source->_features.push_back(new Feature(GeometryUtils::geometryFromWKT("POLYGON((99 39, 101 39, 101 41, 99 41))"), profile->getSRS(), Style(), 3));
+    REQUIRE(source->open().isOK());
+    REQUIRE(source->getTileCache() != 0L);
+
+    TileKey parent(0, 0, 0, profile);
+    Query query;
+    query.tileKey() = parent;
+
+    FeatureList features;
+    osg::ref_ptr<FeatureCursor> cursor = source->createTileCursor(query, 0L);
+    cursor->fill(features);
+    REQUIRE(features.size() == 2);
+    REQUIRE(source->_queries == 1);
+
+    // same tile again, as copies of the cached features
+    features.clear();
+    cursor = source->createTileCursor(query, 0L);
+    cursor->fill(features);
+    REQUIRE(features.size() == 2);
+    REQUIRE(features.front().get() != source->_features.front().get());
+    REQUIRE(source->_queries == 1);
+
+    // the north-west child comes out of the parent's features
+    query.tileKey() = parent.createChildKey(0);
+    features.clear();
+    cursor = source->createTileCursor(query, 0L);
+    cursor->fill(features);
+    REQUIRE(features.size() == 1);
+    REQUIRE(features.front()->getFID() == 2);
+    REQUIRE(source->_queries == 1);
+
+    FeatureTileCache::Stats stats = source->getTileCache()->getStats();
+    REQUIRE(stats._hits == 1u);
+    REQUIRE(stats._parentHits == 1u);
+    REQUIRE(stats._misses == 1u);
+}
+
+TEST_CASE("PackedRTree searches the same after a round trip through a file") {
+    osg::ref_ptr<PackedRTree> tree = new PackedRTree(4);
+    for (unsigned i = 0; i < 100; ++i)
+    {
+        double x = (double)(i % 10) * 10.0, y = (double)(i / 10) * 10.0;
+        tree->add(i, x, y, x + 5.0, y + 5.0);
+    }
+    tree->finish();
+    REQUIRE(tree->size() == 100);
+
+    std::vector<uint64_t> hits;
+    tree->search(12.0, 12.0, 28.0, 18.0, hits);
+    std::sort(hits.begin(), hits.end());
+    REQUIRE(hits.size() == 2);
+    REQUIRE(hits[0] == 11);
+    REQUIRE(hits[1] == 12);
+
+    std::string path = getTempName(osgDB::concatPaths(getTempPath(), "rtree"), ".oeidx");
+    REQUIRE(tree->write(path, "stamp"));
+
+    osg::ref_ptr<PackedRTree> mapped = new PackedRTree();
+    REQUIRE_FALSE(mapped->open(path, "other stamp"));
+    REQUIRE(mapped->open(path, "stamp"));
+    REQUIRE(mapped->size() == 100);
+
+    std::vector<uint64_t> mappedHits;
+    mapped->search(12.0, 12.0, 28.0, 18.0, mappedHits);
+    std::sort(mappedHits.begin(), mappedHits.end());
+    REQUIRE(mappedHits == hits);
+
+    mapped = 0L;
+    ::remove(path.c_str());
+}
@@ -25,6 +25,7 @@
 #include <osgEarth/ImageLayer>
 #include <osgEarth/Registry>
 #include <osgEarth/GDAL>
+#include <osgEarth/ImageUtils>
 
 using namespace osgEarth;
 
@@ -70,4 +71,36 @@ TEST_CASE("Attribution works")
 
     REQUIRE(status.isOK());
     REQUIRE(layer->getAttribution() == attribution);
-}
\ No newline at end of file
+}
+
+TEST_CASE( "ImageUtils fast paths handle RGBA8 images" )
+{
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(2, 2, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    for (unsigned i = 0; i < 16; ++i)
+        image->data()[i] = (unsigned char)(i * 16);
+
+    SECTION("Nearest resize copies pixels")
+    {
+        osg::ref_ptr<osg::Image> output;
+        REQUIRE(ImageUtils::resizeImage(image.get(), 4, 4, output, 0, false));
+        REQUIRE(output->s() == 4);
+        REQUIRE(output->data(0, 0)[0] == 0);
+        REQUIRE(output->data(3, 0)[0] == 64);
+        REQUIRE(output->data(0, 3)[0] == 128);
+        REQUIRE(output->data(3, 3)[3] == 240);
+    }
+
+    SECTION("Premultiplied alpha scales the colors")
+    {
+        REQUIRE(ImageUtils::convertToPremultipliedAlpha(image.get()));
+        REQUIRE(image->data(1, 1)[0] == 181); // 192 * 240 / 255
+        REQUIRE(image->data(1, 1)[3] == 240);
+    }
+
+    SECTION("Empty test reads the alpha channel")
+    {
+        REQUIRE(ImageUtils::isEmptyImage(image.get(), 0.99f) == true);
+        REQUIRE(ImageUtils::isEmptyImage(image.get(), 0.5f) == false);
+    }
+}
@@ -90,3 +90,48 @@ TEST_CASE("Plate Carre SpatialReferences can be created") {
     REQUIRE(!plateCarre->isGeodetic());
     REQUIRE(plateCarre->isProjected());
 }
+
+TEST_CASE("Native SRS transform kernels") {
+    osg::ref_ptr< const SpatialReference > wgs84 = SpatialReference::create("wgs84");
+    REQUIRE(wgs84.valid());
+
+    SECTION("geographic to geocentric") {
+        osg::Vec3d ecef;
+        REQUIRE(wgs84->transform(osg::Vec3d(0, 0, 0), wgs84->getGeocentricSRS(), ecef));
+        REQUIRE(ecef.x() == Approx(6378137.0));
+        REQUIRE(ecef.y() == Approx(0.0));
+        REQUIRE(ecef.z() == Approx(0.0));
+
+        osg::Vec3d geo;
+        REQUIRE(wgs84->getGeocentricSRS()->transform(ecef, wgs84.get(), geo));
+        REQUIRE(geo.x() == Approx(0.0));
+        REQUIRE(geo.y() == Approx(0.0));
+    }
+
+    SECTION("geographic to spherical mercator") {
+        osg::ref_ptr< const SpatialReference > merc = SpatialReference::create("spherical-mercator");
+        osg::Vec3d out;
+        REQUIRE(wgs84->transform(osg::Vec3d(10, 45, 0), merc.get(), out));
+        REQUIRE(out.x() == Approx(1113194.9079).epsilon(1e-9));
+        REQUIRE(out.y() == Approx(5621521.4862).epsilon(1e-9));
+
+        osg::Vec3d geo;
+        REQUIRE(merc->transform(out, wgs84.get(), geo));
+        REQUIRE(geo.x() == Approx(10.0));
+        REQUIRE(geo.y() == Approx(45.0));
+    }
+
+    SECTION("geographic to UTM") {
+        osg::ref_ptr< const SpatialReference > utm = SpatialReference::create("+proj=utm +zone=33 +datum=WGS84 +units=m +no_defs");
+        REQUIRE(utm.valid());
+        osg::Vec3d out;
+        REQUIRE(wgs84->transform(osg::Vec3d(16.5, 48.2, 0), utm.get(), out));
+        REQUIRE(out.x() == Approx(611458.686).epsilon(1e-8));
+        REQUIRE(out.y() == Approx(5339617.543).epsilon(1e-9));
+
+        osg::Vec3d geo;
+        REQUIRE(utm->transform(out, wgs84.get(), geo));
+        REQUIRE(geo.x() == Approx(16.5).epsilon(1e-9));
+        REQUIRE(geo.y() == Approx(48.2).epsilon(1e-9));
+    }
+}
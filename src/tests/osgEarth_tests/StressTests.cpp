@@ -0,0 +1,270 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/MemCache>
+#include <osgEarth/Cache>
+#include <osgEarth/GDAL>
+#include <osgEarth/Map>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/StringUtils>
+#include <OpenThreads/Thread>
+#include <osg/Timer>
+#include <cstdlib>
+#include <iomanip>
+#include <vector>
+
+using namespace osgEarth;
+
+// These tests hammer one subsystem from 1, 2, 4 ... N threads, check that
+// every result is correct, and print the throughput at each thread count
+// so that scaling regressions are visible. They are tagged hidden ([.])
+// and run with:
+//
+//   osgEarth_tests "[stress]"
+//
+// Set OSGEARTH_STRESS_THREADS to change N (default: number of cores, at
+// least 2). Build with -DOSGEARTH_ENABLE_TSAN=ON to run them under
+// ThreadSanitizer, and with -DOSGEARTH_ENABLE_STRESS_TESTS=ON to add them
+// to ctest.
+
+namespace StressTest
+{
+    // One unit of work; called concurrently from many threads.
+    struct Operation
+    {
+        virtual ~Operation() { }
+        virtual void operator()(unsigned thread, unsigned iteration) = 0;
+    };
+
+    class Worker : public OpenThreads::Thread
+    {
+    public:
+        Worker(Operation& op, unsigned index, unsigned count, Threading::Event& go) :
+            _op(op), _index(index), _count(count), _go(go) { }
+
+        void run()
+        {
+            _go.wait();
+            for (unsigned i = 0; i < _count; ++i)
+                _op(_index, i);
+        }
+
+        Operation& _op;
+        unsigned _index;
+        unsigned _count;
+        Threading::Event& _go;
+    };
+
+    unsigned getMaxThreads()
+    {
+        const char* env = ::getenv("OSGEARTH_STRESS_THREADS");
+        int n = env ? as<int>(env, 0) : OpenThreads::GetNumberOfProcessors();
+        return (unsigned)osg::maximum(n, 2);
+    }
+
+    // Runs the operation opsPerThread times on each of numThreads threads
+    // and returns the aggregate throughput in operations per second.
+    double run(Operation& op, unsigned numThreads, unsigned opsPerThread)
+    {
+        Threading::Event go;
+        std::vector<Worker*> workers;
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            workers.push_back(new Worker(op, i, opsPerThread, go));
+            workers.back()->start();
+        }
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        go.set();
+
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            workers[i]->join();
+            delete workers[i];
+        }
+
+        double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        return (double)(numThreads * opsPerThread) / osg::maximum(seconds, 1e-6);
+    }
+
+    // Measures throughput at 1, 2, 4 ... N threads and reports the scaling
+    // relative to one thread.
+    void measureScaling(const std::string& name, Operation& op, unsigned opsPerThread)
+    {
+        unsigned maxThreads = getMaxThreads();
+        double base = 0.0;
+        for (unsigned n = 1; ; n = osg::minimum(n * 2u, maxThreads))
+        {
+            double opsPerSecond = run(op, n, opsPerThread);
+            if (n == 1)
+                base = opsPerSecond;
+
+            OE_NOTICE << "[stress] " << name << ": " << n << " threads, "
+                << (unsigned)opsPerSecond << " ops/s ("
+                << std::setprecision(3) << opsPerSecond / base << "x)" << std::endl;
+
+            if (n == maxThreads)
+                break;
+        }
+    }
+
+    // Mixed reads and writes against a shared cache bin. Every value
+    // written is its own key, so any read that returns someone else's
+    // data is a race.
+    struct CacheBinOperation : public Operation
+    {
+        CacheBinOperation(CacheBin* bin) : _bin(bin), _failures(0) { }
+
+        void operator()(unsigned thread, unsigned i)
+        {
+            std::string key = Stringify() << "stress_" << ((i * 7u + thread) % 512u);
+            if (i % 4u == 0u)
+            {
+                osg::ref_ptr<StringObject> value = new StringObject(key);
+                if (!_bin->write(key, value.get(), 0L))
+                    ++_failures;
+            }
+            else
+            {
+                ReadResult r = _bin->readString(key, 0L);
+                if (r.succeeded() && r.getString() != key)
+                    ++_failures;
+            }
+        }
+
+        CacheBin* _bin;
+        OpenThreads::Atomic _failures;
+    };
+
+    // Tile requests against one image layer.
+    struct ImageLayerOperation : public Operation
+    {
+        ImageLayerOperation(ImageLayer* layer) : _layer(layer), _failures(0) { }
+
+        void operator()(unsigned thread, unsigned i)
+        {
+            unsigned lod = 1u + (i % 3u);
+            unsigned tx, ty;
+            _layer->getProfile()->getNumTiles(lod, tx, ty);
+            unsigned n = i * 31u + thread;
+            TileKey key(lod, n % tx, (n / tx) % ty, _layer->getProfile());
+
+            GeoImage image = _layer->createImage(key);
+            if (!image.valid() || image.getExtent() != key.getExtent())
+                ++_failures;
+        }
+
+        ImageLayer* _layer;
+        OpenThreads::Atomic _failures;
+    };
+
+    // Point queries against the elevation pool, spread over a small area
+    // so that threads share (and contend for) the same tiles.
+    struct ElevationPoolOperation : public Operation
+    {
+        ElevationPoolOperation(ElevationPool* pool, const SpatialReference* srs) :
+            _pool(pool), _srs(srs), _failures(0) { }
+
+        void operator()(unsigned thread, unsigned i)
+        {
+            unsigned n = i * 17u + thread * 101u;
+            double x = -121.80 + 0.08 * (double)(n % 97u) / 97.0;
+            double y =   46.82 + 0.06 * (double)((n / 97u) % 89u) / 89.0;
+
+            Future<ElevationSample> result = _pool->getElevation(GeoPoint(_srs, x, y, 0.0, ALTMODE_ABSOLUTE), 12u);
+            osg::ref_ptr<ElevationSample> sample = result.get();
+            if (!sample.valid())
+                ++_failures;
+        }
+
+        ElevationPool* _pool;
+        const SpatialReference* _srs;
+        OpenThreads::Atomic _failures;
+    };
+}
+
+TEST_CASE( "MemCache under concurrent readers and writers", "[.][stress]" ) {
+
+    using namespace StressTest;
+
+    osg::ref_ptr<MemCache> cache = new MemCache(16u, 8u * 1048576u);
+    CacheBin* bin = cache->getOrCreateDefaultBin();
+    REQUIRE(bin != 0L);
+
+    CacheBinOperation op(bin);
+    measureScaling("MemCache", op, 20000u);
+    REQUIRE(op._failures == 0u);
+}
+
+TEST_CASE( "RocksDB cache bin under concurrent readers and writers", "[.][stress]" ) {
+
+    using namespace StressTest;
+
+    Config conf("cache");
+    conf.set("driver", "rocksdb");
+    conf.set("path", "osgearth_stress_cache");
+    osg::ref_ptr<Cache> cache = CacheFactory::create(CacheOptions(ConfigOptions(conf)));
+
+    if (!cache.valid() || !cache->getStatus().isOK())
+    {
+        OE_WARN << "[stress] RocksDB cache plugin not available; skipping" << std::endl;
+        return;
+    }
+
+    osg::ref_ptr<CacheBin> bin = cache->addBin("stress");
+    REQUIRE(bin.valid());
+
+    CacheBinOperation op(bin.get());
+    measureScaling("RocksDBCacheBin", op, 5000u);
+    REQUIRE(op._failures == 0u);
+}
+
+TEST_CASE( "ImageLayer::createImage from many threads", "[.][stress]" ) {
+
+    using namespace StressTest;
+
+    osg::ref_ptr<GDALImageLayer> layer = new GDALImageLayer();
+    layer->setURL("../data/world.tif");
+    REQUIRE(layer->open().isOK());
+
+    ImageLayerOperation op(layer.get());
+    measureScaling("ImageLayer::createImage", op, 100u);
+    REQUIRE(op._failures == 0u);
+}
+
+TEST_CASE( "ElevationPool::getElevation from many threads", "[.][stress]" ) {
+
+    using namespace StressTest;
+
+    osg::ref_ptr<GDALElevationLayer> layer = new GDALElevationLayer();
+    layer->setURL("../data/terrain/mt_rainier_90m.tif");
+
+    osg::ref_ptr<Map> map = new Map();
+    map->addLayer(layer.get());
+    REQUIRE(layer->getStatus().isOK());
+
+    ElevationPoolOperation op(map->getElevationPool(), SpatialReference::get("wgs84"));
+    measureScaling("ElevationPool::getElevation", op, 2000u);
+    REQUIRE(op._failures == 0u);
+}
@@ -22,6 +22,7 @@
 
 #include <osgEarth/catch.hpp>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarth/JobArena>
 
 using namespace osgEarth;
 
@@ -132,4 +133,94 @@ TEST_CASE( "ReadWriteMutex can handle multiple read locks from the same thread w
     REQUIRE(!thread2.isRunning());
     REQUIRE(elapsedTime < maxTimeSeconds);
 }
-*/
\ No newline at end of file
+*/
+
+namespace JobArenaTest
+{
+    OpenThreads::Atomic running;
+    OpenThreads::Atomic completed;
+    osgEarth::Threading::Mutex maxMutex;
+    unsigned maxRunning = 0u;
+
+    struct CountingJob : public osgEarth::Util::TaskRequest
+    {
+        void operator()(osgEarth::ProgressCallback*)
+        {
+            unsigned now = ++running;
+            {
+                osgEarth::Threading::ScopedMutexLock lock(maxMutex);
+                maxRunning = osg::maximum(maxRunning, now);
+            }
+            OpenThreads::Thread::microSleep(1000);
+            --running;
+            ++completed;
+        }
+    };
+}
+
+TEST_CASE( "JobArena runs every job and honors its concurrency limit" ) {
+
+    using namespace osgEarth::Util;
+
+    osg::ref_ptr<JobScheduler> scheduler = new JobScheduler(4u);
+    osg::ref_ptr<JobArena> arena = new JobArena("test", 2u, JobScheduler::BAND_NORMAL, scheduler.get());
+
+    for (unsigned i = 0; i < 64; ++i)
+        arena->dispatch(new JobArenaTest::CountingJob());
+
+    arena->waitUntilIdle();
+
+    REQUIRE(JobArenaTest::completed == 64u);
+    REQUIRE(JobArenaTest::maxRunning <= 2u);
+
+    scheduler->shutdown();
+}
+
+namespace FutureTest
+{
+    struct Value : public osg::Referenced
+    {
+        Value(int v) : _v(v) { }
+        int _v;
+    };
+
+    struct Double : public osgEarth::Threading::FutureContinuation<Value, Value>
+    {
+        Value* run(Value* input) { return new Value(input->_v * 2); }
+    };
+}
+
+TEST_CASE( "Future continuations and when_all" ) {
+
+    using namespace osgEarth::Threading;
+    using namespace FutureTest;
+
+    SECTION("then() chains a continuation")
+    {
+        Promise<Value> p;
+        Future<Value> doubled = p.getFuture().then(new Double());
+        REQUIRE(!doubled.isAvailable());
+        p.resolve(new Value(21));
+        REQUIRE(doubled.isAvailable());
+        REQUIRE(doubled.get()->_v == 42);
+    }
+
+    SECTION("when_all waits for every input, including abandoned ones")
+    {
+        std::vector< Future<Value> > inputs;
+        Promise<Value> a;
+        inputs.push_back(a.getFuture());
+        Future< FutureResults<Value> > all;
+        {
+            Promise<Value> b;
+            inputs.push_back(b.getFuture());
+            all = when_all(inputs);
+            a.resolve(new Value(1));
+            REQUIRE(!all.isAvailable());
+        }
+        // b went away without resolving
+        REQUIRE(all.isAvailable());
+        REQUIRE(all.get()->_results[0]->_v == 1);
+        REQUIRE(!all.get()->_results[1].valid());
+    }
+}
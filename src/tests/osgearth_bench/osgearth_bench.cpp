@@ -0,0 +1,581 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+// Microbenchmarks for the kernels that run on every tile: ImageUtils,
+// GeoImage crop/reproject, HeightFieldUtils, GeoHeightField, the
+// polygon tessellation engines and the geocentric mesh subdivider.
+// Results go to stdout (or --out) as JSON or CSV so they can be compared
+// between builds.
+
+#include <osgEarth/ImageUtils>
+#include <osgEarth/GeoData>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/SpatialReference>
+#include <osgEarth/Random>
+#include <osgEarth/Registry>
+#include <osgEarth/Tessellator>
+#include <osgEarth/MeshSubdivider>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    /**
+     * One benchmark. The constructor builds the inputs; run() does one
+     * iteration of the kernel and should not allocate anything else.
+     */
+    struct Benchmark : public osg::Referenced
+    {
+        Benchmark(const std::string& name, unsigned items) : _name(name), _items(items) { }
+        virtual void run() =0;
+
+        std::string _name;
+        unsigned    _items;   // pixels or samples processed per iteration
+    };
+
+    struct Result
+    {
+        std::string _name;
+        unsigned    _iterations;
+        double      _min, _median, _mean; // seconds per iteration
+        double      _itemsPerSecond;
+    };
+
+    osg::Image* makeImage(unsigned s, unsigned t, GLenum format, GLenum type, unsigned seed)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(s, t, 1, format, type);
+        image->setInternalTextureFormat(
+            type == GL_FLOAT ? GL_R32F :
+            format == GL_RGB ? GL_RGB8 : GL_RGBA8);
+
+        Random random(seed);
+        if (type == GL_FLOAT)
+        {
+            float* ptr = (float*)image->data();
+            for (unsigned i = 0; i < s*t; ++i)
+                ptr[i] = (float)(random.next() * 4000.0);
+        }
+        else
+        {
+            for (unsigned i = 0; i < image->getTotalSizeInBytes(); ++i)
+                image->data()[i] = (unsigned char)random.next(256);
+        }
+        return image;
+    }
+
+    osg::HeightField* makeHeightField(unsigned size, unsigned seed)
+    {
+        osg::HeightField* hf = new osg::HeightField();
+        hf->allocate(size, size);
+        Random random(seed);
+        for (unsigned i = 0; i < hf->getHeightList().size(); ++i)
+            hf->getHeightList()[i] = (float)(random.next() * 4000.0);
+        return hf;
+    }
+
+    //....................................................................
+
+    struct ResizeImage : public Benchmark
+    {
+        ResizeImage(const std::string& name, GLenum format, GLenum type, unsigned in, unsigned out, bool bilinear) :
+            Benchmark(name, out*out), _out(out), _bilinear(bilinear)
+        {
+            _input = makeImage(in, in, format, type, 1);
+        }
+        void run()
+        {
+            ImageUtils::resizeImage(_input.get(), _out, _out, _output, 0, _bilinear);
+        }
+        osg::ref_ptr<osg::Image> _input, _output;
+        unsigned _out;
+        bool _bilinear;
+    };
+
+    struct MixImage : public Benchmark
+    {
+        MixImage(const std::string& name, unsigned size) : Benchmark(name, size*size)
+        {
+            _src = makeImage(size, size, GL_RGBA, GL_UNSIGNED_BYTE, 1);
+            _dest = makeImage(size, size, GL_RGBA, GL_UNSIGNED_BYTE, 2);
+        }
+        void run()
+        {
+            ImageUtils::mix(_dest.get(), _src.get(), 0.5f);
+        }
+        osg::ref_ptr<osg::Image> _src, _dest;
+    };
+
+    struct ConvertImage : public Benchmark
+    {
+        ConvertImage(const std::string& name, GLenum fromFormat, GLenum toFormat, unsigned size) :
+            Benchmark(name, size*size), _toFormat(toFormat)
+        {
+            _input = makeImage(size, size, fromFormat, GL_UNSIGNED_BYTE, 1);
+        }
+        void run()
+        {
+            osg::ref_ptr<osg::Image> output = ImageUtils::convert(_input.get(), _toFormat, GL_UNSIGNED_BYTE);
+        }
+        osg::ref_ptr<osg::Image> _input;
+        GLenum _toFormat;
+    };
+
+    struct PremultiplyImage : public Benchmark
+    {
+        PremultiplyImage(const std::string& name, unsigned size) : Benchmark(name, size*size)
+        {
+            _input = makeImage(size, size, GL_RGBA, GL_UNSIGNED_BYTE, 1);
+        }
+        void run()
+        {
+            ImageUtils::convertToPremultipliedAlpha(_input.get());
+        }
+        osg::ref_ptr<osg::Image> _input;
+    };
+
+    struct EmptyImage : public Benchmark
+    {
+        // a fully transparent image is the worst case: every pixel is read
+        EmptyImage(const std::string& name, unsigned size) : Benchmark(name, size*size)
+        {
+            _input = ImageUtils::createEmptyImage(size, size);
+        }
+        void run()
+        {
+            ImageUtils::isEmptyImage(_input.get());
+        }
+        osg::ref_ptr<osg::Image> _input;
+    };
+
+    struct CropGeoImage : public Benchmark
+    {
+        CropGeoImage(const std::string& name, unsigned size) : Benchmark(name, size*size/4)
+        {
+            const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+            _image = GeoImage(makeImage(size, size, GL_RGBA, GL_UNSIGNED_BYTE, 1), GeoExtent(wgs84, 0.0, 0.0, 10.0, 10.0));
+            _extent = GeoExtent(wgs84, 2.5, 2.5, 7.5, 7.5);
+        }
+        void run()
+        {
+            GeoImage cropped = _image.crop(_extent, true, 0, 0, true);
+        }
+        GeoImage _image;
+        GeoExtent _extent;
+    };
+
+    struct ReprojectGeoImage : public Benchmark
+    {
+        ReprojectGeoImage(const std::string& name, unsigned size) : Benchmark(name, size*size), _size(size)
+        {
+            const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+            _image = GeoImage(makeImage(size, size, GL_RGBA, GL_UNSIGNED_BYTE, 1), GeoExtent(wgs84, 0.0, 0.0, 10.0, 10.0));
+            _mercator = SpatialReference::get("spherical-mercator");
+            _extent = _image.getExtent().transform(_mercator.get());
+        }
+        void run()
+        {
+            GeoImage warped = _image.reproject(_mercator.get(), &_extent, _size, _size, true);
+        }
+        GeoImage _image;
+        osg::ref_ptr<const SpatialReference> _mercator;
+        GeoExtent _extent;
+        unsigned _size;
+    };
+
+    struct ResampleHeightField : public Benchmark
+    {
+        ResampleHeightField(const std::string& name, unsigned in, unsigned out) : Benchmark(name, out*out), _out(out)
+        {
+            _hf = makeHeightField(in, 1);
+            _extent = GeoExtent(SpatialReference::get("wgs84"), 0.0, 0.0, 1.0, 1.0);
+        }
+        void run()
+        {
+            osg::ref_ptr<osg::HeightField> output = HeightFieldUtils::resampleHeightField(_hf.get(), _extent, _out, _out, INTERP_BILINEAR);
+        }
+        osg::ref_ptr<osg::HeightField> _hf;
+        GeoExtent _extent;
+        int _out;
+    };
+
+    struct SubSampleHeightField : public Benchmark
+    {
+        SubSampleHeightField(const std::string& name, unsigned size) : Benchmark(name, size*size)
+        {
+            const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+            _hf = makeHeightField(size, 1);
+            _extent = GeoExtent(wgs84, 0.0, 0.0, 1.0, 1.0);
+            _subExtent = GeoExtent(wgs84, 0.25, 0.25, 0.75, 0.75);
+        }
+        void run()
+        {
+            osg::ref_ptr<osg::HeightField> output = HeightFieldUtils::createSubSample(_hf.get(), _extent, _subExtent, INTERP_BILINEAR);
+        }
+        osg::ref_ptr<osg::HeightField> _hf;
+        GeoExtent _extent, _subExtent;
+    };
+
+    struct SampleHeightField : public Benchmark
+    {
+        SampleHeightField(const std::string& name, unsigned size, unsigned samples) : Benchmark(name, samples)
+        {
+            _hf = makeHeightField(size, 1);
+            Random random(3);
+            for (unsigned i = 0; i < samples; ++i)
+                _points.push_back(osg::Vec2d(random.next(), random.next()));
+        }
+        void run()
+        {
+            float sum = 0.0f;
+            for (unsigned i = 0; i < _points.size(); ++i)
+                sum += HeightFieldUtils::getHeightAtNormalizedLocation(_hf.get(), _points[i].x(), _points[i].y(), INTERP_BILINEAR);
+            _sum = sum;
+        }
+        osg::ref_ptr<osg::HeightField> _hf;
+        std::vector<osg::Vec2d> _points;
+        volatile float _sum;
+    };
+
+    struct NormalMapHeightField : public Benchmark
+    {
+        NormalMapHeightField(const std::string& name, unsigned size) : Benchmark(name, size*size)
+        {
+            _hood._center = makeHeightField(size, 1);
+            _hood._center->setXInterval(1.0 / (double)(size - 1));
+            _hood._center->setYInterval(1.0 / (double)(size - 1));
+            _srs = SpatialReference::get("wgs84");
+        }
+        void run()
+        {
+            osg::ref_ptr<NormalMap> normals = HeightFieldUtils::convertToNormalMap(_hood, _srs.get());
+        }
+        HeightFieldNeighborhood _hood;
+        osg::ref_ptr<const SpatialReference> _srs;
+    };
+
+    struct GetElevation : public Benchmark
+    {
+        GetElevation(const std::string& name, unsigned size, unsigned samples) : Benchmark(name, samples)
+        {
+            _hf = GeoHeightField(makeHeightField(size, 1), GeoExtent(SpatialReference::get("wgs84"), 0.0, 0.0, 1.0, 1.0));
+            Random random(3);
+            for (unsigned i = 0; i < samples; ++i)
+                _points.push_back(osg::Vec2d(random.next(), random.next()));
+        }
+        void run()
+        {
+            float sum = 0.0f;
+            for (unsigned i = 0; i < _points.size(); ++i)
+                sum += _hf.getElevation(_points[i].x(), _points[i].y());
+            _sum = sum;
+        }
+        GeoHeightField _hf;
+        std::vector<osg::Vec2d> _points;
+        volatile float _sum;
+    };
+
+    struct TessellatePolygons : public Benchmark
+    {
+        // star-shaped outlines, each with a square hole in the middle
+        TessellatePolygons(const std::string& name, Tessellator::Engine engine, unsigned count, unsigned points, unsigned threads) :
+            Benchmark(name, count), _engine(engine), _threads(threads)
+        {
+            Random random(1);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                osg::Geometry* geom = new osg::Geometry();
+                osg::Vec3Array* verts = new osg::Vec3Array();
+                for (unsigned p = 0; p < points; ++p)
+                {
+                    double a = osg::PI * 2.0 * (double)p / (double)points;
+                    double r = 50.0 + random.next() * 50.0;
+                    verts->push_back(osg::Vec3(r*cos(a), r*sin(a), 0.0f));
+                }
+                verts->push_back(osg::Vec3(-10, -10, 0));
+                verts->push_back(osg::Vec3(-10,  10, 0));
+                verts->push_back(osg::Vec3( 10,  10, 0));
+                verts->push_back(osg::Vec3( 10, -10, 0));
+                geom->setVertexArray(verts);
+
+                osg::Geometry::PrimitiveSetList rings;
+                rings.push_back(new osg::DrawArrays(GL_LINE_LOOP, 0, points));
+                rings.push_back(new osg::DrawArrays(GL_LINE_LOOP, points, 4));
+
+                _geoms.push_back(geom);
+                _rings.push_back(rings);
+                _ptrs.push_back(geom);
+            }
+        }
+        void run()
+        {
+            for (unsigned i = 0; i < _geoms.size(); ++i)
+                _geoms[i]->setPrimitiveSetList(_rings[i]);
+
+            Tessellator tess(_engine);
+            tess.tessellateGeometries(_ptrs, _threads);
+        }
+        std::vector< osg::ref_ptr<osg::Geometry> > _geoms;
+        std::vector<osg::Geometry::PrimitiveSetList> _rings;
+        std::vector<osg::Geometry*> _ptrs;
+        Tessellator::Engine _engine;
+        unsigned _threads;
+    };
+
+    struct SubdivideMesh : public Benchmark
+    {
+        // a size x size grid of quads over a 30 x 30 degree patch of a sphere
+        SubdivideMesh(const std::string& name, unsigned size, double granularity_deg, double maxError, unsigned threads) :
+            Benchmark(name, 2*size*size), _granularity(osg::DegreesToRadians(granularity_deg)), _maxError(maxError), _threads(threads)
+        {
+            _geom = new osg::Geometry();
+            _verts = new osg::Vec3Array();
+            for (unsigned row = 0; row <= size; ++row)
+            {
+                double lat = osg::DegreesToRadians(30.0 * (double)row / (double)size);
+                for (unsigned col = 0; col <= size; ++col)
+                {
+                    double lon = osg::DegreesToRadians(30.0 * (double)col / (double)size);
+                    _verts->push_back(osg::Vec3(
+                        6378137.0 * cos(lat) * cos(lon),
+                        6378137.0 * cos(lat) * sin(lon),
+                        6378137.0 * sin(lat)));
+                }
+            }
+
+            osg::DrawElementsUInt* tris = new osg::DrawElementsUInt(GL_TRIANGLES);
+            for (unsigned row = 0; row < size; ++row)
+            {
+                for (unsigned col = 0; col < size; ++col)
+                {
+                    unsigned i = row*(size+1) + col;
+                    tris->push_back(i); tris->push_back(i+1); tris->push_back(i+size+2);
+                    tris->push_back(i); tris->push_back(i+size+2); tris->push_back(i+size+1);
+                }
+            }
+            _prims.push_back(tris);
+        }
+        void run()
+        {
+            _geom->setVertexArray(_verts.get());
+            _geom->setPrimitiveSetList(_prims);
+
+            MeshSubdivider ms;
+            ms.setMaxError(_maxError);
+            ms.setParallelism(_threads);
+            ms.run(*_geom, _granularity, GEOINTERP_GREAT_CIRCLE);
+        }
+        osg::ref_ptr<osg::Geometry> _geom;
+        osg::ref_ptr<osg::Vec3Array> _verts;
+        osg::Geometry::PrimitiveSetList _prims;
+        double _granularity, _maxError;
+        unsigned _threads;
+    };
+
+    typedef std::vector< osg::ref_ptr<Benchmark> > Benchmarks;
+
+    void createBenchmarks(Benchmarks& b)
+    {
+        b.push_back(new ResizeImage("ImageUtils/resizeImage/rgba8/256-128/nearest", GL_RGBA, GL_UNSIGNED_BYTE, 256, 128, false));
+        b.push_back(new ResizeImage("ImageUtils/resizeImage/rgba8/256-512/nearest", GL_RGBA, GL_UNSIGNED_BYTE, 256, 512, false));
+        b.push_back(new ResizeImage("ImageUtils/resizeImage/rgba8/256-512/bilinear", GL_RGBA, GL_UNSIGNED_BYTE, 256, 512, true));
+        b.push_back(new ResizeImage("ImageUtils/resizeImage/rgb8/256-512/bilinear", GL_RGB, GL_UNSIGNED_BYTE, 256, 512, true));
+        b.push_back(new ResizeImage("ImageUtils/resizeImage/r32f/257-129/bilinear", GL_RED, GL_FLOAT, 257, 129, true));
+        b.push_back(new MixImage("ImageUtils/mix/rgba8/256", 256));
+        b.push_back(new ConvertImage("ImageUtils/convert/rgb8-rgba8/256", GL_RGB, GL_RGBA, 256));
+        b.push_back(new ConvertImage("ImageUtils/convert/rgba8-rgb8/256", GL_RGBA, GL_RGB, 256));
+        b.push_back(new PremultiplyImage("ImageUtils/convertToPremultipliedAlpha/rgba8/256", 256));
+        b.push_back(new EmptyImage("ImageUtils/isEmptyImage/rgba8/256", 256));
+        b.push_back(new CropGeoImage("GeoImage/crop/rgba8/512", 512));
+        b.push_back(new ReprojectGeoImage("GeoImage/reproject/rgba8/256/wgs84-mercator", 256));
+        b.push_back(new ResampleHeightField("HeightFieldUtils/resampleHeightField/257-129", 257, 129));
+        b.push_back(new SubSampleHeightField("HeightFieldUtils/createSubSample/257", 257));
+        b.push_back(new SampleHeightField("HeightFieldUtils/getHeightAtNormalizedLocation/257/10000", 257, 10000));
+        b.push_back(new NormalMapHeightField("HeightFieldUtils/convertToNormalMap/257", 257));
+        b.push_back(new GetElevation("GeoHeightField/getElevation/257/10000", 257, 10000));
+        b.push_back(new TessellatePolygons("Tessellator/earcut/1000x64", Tessellator::ENGINE_EARCUT, 1000, 64, 1));
+        b.push_back(new TessellatePolygons("Tessellator/earcut/1000x64/4-threads", Tessellator::ENGINE_EARCUT, 1000, 64, 4));
+        b.push_back(new TessellatePolygons("Tessellator/earclip/1000x64", Tessellator::ENGINE_EARCLIP, 1000, 64, 1));
+        b.push_back(new TessellatePolygons("Tessellator/osg/1000x64", Tessellator::ENGINE_OSG, 1000, 64, 1));
+        b.push_back(new SubdivideMesh("MeshSubdivider/run/32x32/0.25deg", 32, 0.25, 0.0, 1));
+        b.push_back(new SubdivideMesh("MeshSubdivider/run/32x32/0.25deg/4-threads", 32, 0.25, 0.0, 4));
+        b.push_back(new SubdivideMesh("MeshSubdivider/run/32x32/0.25deg/100m-error", 32, 0.25, 100.0, 1));
+    }
+
+    Result measure(Benchmark* bench, double minTime, unsigned minIterations)
+    {
+        osg::Timer* timer = osg::Timer::instance();
+        std::vector<double> times;
+
+        // warm up
+        bench->run();
+
+        double total = 0.0;
+        while (total < minTime || times.size() < minIterations)
+        {
+            osg::Timer_t start = timer->tick();
+            bench->run();
+            double t = timer->delta_s(start, timer->tick());
+            times.push_back(t);
+            total += t;
+        }
+
+        std::sort(times.begin(), times.end());
+
+        Result result;
+        result._name = bench->_name;
+        result._iterations = times.size();
+        result._min = times.front();
+        result._median = times[times.size()/2];
+        result._mean = total / (double)times.size();
+        result._itemsPerSecond = result._median > 0.0 ? (double)bench->_items / result._median : 0.0;
+        return result;
+    }
+
+    void writeJSON(std::ostream& out, const std::vector<Result>& results)
+    {
+        out << "{\n  \"benchmarks\": [\n";
+        for (unsigned i = 0; i < results.size(); ++i)
+        {
+            const Result& r = results[i];
+            out << "    { \"name\": \"" << r._name << "\""
+                << ", \"iterations\": " << r._iterations
+                << std::fixed << std::setprecision(3)
+                << ", \"min_us\": " << r._min*1e6
+                << ", \"median_us\": " << r._median*1e6
+                << ", \"mean_us\": " << r._mean*1e6
+                << std::setprecision(0)
+                << ", \"items_per_second\": " << r._itemsPerSecond
+                << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    void writeCSV(std::ostream& out, const std::vector<Result>& results)
+    {
+        out << "name,iterations,min_us,median_us,mean_us,items_per_second\n";
+        for (unsigned i = 0; i < results.size(); ++i)
+        {
+            const Result& r = results[i];
+            out << r._name << "," << r._iterations
+                << std::fixed << std::setprecision(3)
+                << "," << r._min*1e6 << "," << r._median*1e6 << "," << r._mean*1e6
+                << std::setprecision(0)
+                << "," << r._itemsPerSecond << "\n";
+        }
+    }
+
+    int usage(const char* name)
+    {
+        std::cout
+            << "Runs the osgEarth raster kernel benchmarks.\n\n"
+            << name << "\n"
+            << "    [--filter <text>]      Only run benchmarks whose names contain <text>\n"
+            << "    [--min-time <s>]       Run each benchmark for at least this long (default 0.5)\n"
+            << "    [--min-iterations <n>] Run each benchmark at least this many times (default 10)\n"
+            << "    [--format json|csv]    Output format (default json)\n"
+            << "    [--out <file>]         Write results to a file instead of stdout\n"
+            << "    [--list]               List the benchmarks and exit\n"
+            << std::endl;
+        return 0;
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+
+    if (arguments.read("--help") || arguments.read("-h"))
+        return usage(argv[0]);
+
+    std::string filter;
+    arguments.read("--filter", filter);
+
+    double minTime = 0.5;
+    arguments.read("--min-time", minTime);
+
+    unsigned minIterations = 10;
+    arguments.read("--min-iterations", minIterations);
+
+    std::string format = "json";
+    arguments.read("--format", format);
+
+    std::string outFile;
+    arguments.read("--out", outFile);
+
+    bool list = arguments.read("--list");
+
+    Benchmarks benchmarks;
+    createBenchmarks(benchmarks);
+
+    std::vector<Result> results;
+
+    for (Benchmarks::iterator i = benchmarks.begin(); i != benchmarks.end(); ++i)
+    {
+        Benchmark* bench = i->get();
+        if (!filter.empty() && bench->_name.find(filter) == std::string::npos)
+            continue;
+
+        if (list)
+        {
+            std::cout << bench->_name << std::endl;
+            continue;
+        }
+
+        // progress goes to stderr so stdout stays machine-readable
+        std::cerr << bench->_name << "..." << std::flush;
+        results.push_back(measure(bench, minTime, minIterations));
+        std::cerr << " " << std::fixed << std::setprecision(1) << results.back()._median*1e6 << " us" << std::endl;
+    }
+
+    if (list)
+        return 0;
+
+    std::ofstream file;
+    if (!outFile.empty())
+    {
+        file.open(outFile.c_str());
+        if (!file.is_open())
+        {
+            std::cerr << "Cannot write to " << outFile << std::endl;
+            return -1;
+        }
+    }
+    std::ostream& out = file.is_open() ? (std::ostream&)file : std::cout;
+
+    if (format == "csv")
+        writeCSV(out, results);
+    else
+        writeJSON(out, results);
+
+    return 0;
+}
@@ -3848,8 +3848,19 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
   buffer->uri.clear();
   ParseStringProperty(&buffer->uri, err, o, "uri", false, "Buffer");
 
+  // EXT_meshopt_compression fallback buffers may have no data; the
+  // compressed buffer views are decoded by the application after loading.
+  bool meshoptFallback = false;
+  {
+    json_const_iterator extIt, meshoptIt;
+    if (FindMember(o, "extensions", extIt) &&
+        FindMember(GetValue(extIt), "EXT_meshopt_compression", meshoptIt)) {
+      meshoptFallback = buffer->uri.empty();
+    }
+  }
+
   // having an empty uri for a non embedded image should not be valid
-  if (!is_binary && buffer->uri.empty()) {
+  if (!is_binary && buffer->uri.empty() && !meshoptFallback) {
     if (err) {
       (*err) += "'uri' is missing from non binary glTF file buffer.\n";
     }
@@ -3865,7 +3876,9 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
     }
   }
 
-  if (is_binary) {
+  if (meshoptFallback) {
+    buffer->data.clear();
+  } else if (is_binary) {
     // Still binary glTF accepts external dataURI.
     if (!buffer->uri.empty()) {
       // First try embedded data URI.